@@ -0,0 +1,331 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr.h"
+#include "apr_aio.h"
+#include "apr_arch_aio_private.h"
+
+#if defined(HAVE_IO_URING)
+#define AIO_DEFAULT_METHOD APR_AIO_IO_URING
+#else
+#define AIO_DEFAULT_METHOD APR_AIO_THREADPOOL
+#endif
+
+static apr_aio_method_e aio_default_method = AIO_DEFAULT_METHOD;
+
+#if defined(HAVE_IO_URING)
+extern const apr_aio_provider_t *apr_aio_provider_io_uring;
+#endif
+extern const apr_aio_provider_t *apr_aio_provider_threadpool;
+
+static const apr_aio_provider_t *aio_provider(apr_aio_method_e method)
+{
+    const apr_aio_provider_t *provider = NULL;
+    switch (method) {
+        case APR_AIO_IO_URING:
+#if defined(HAVE_IO_URING)
+            provider = apr_aio_provider_io_uring;
+#endif
+        break;
+        case APR_AIO_THREADPOOL:
+            provider = apr_aio_provider_threadpool;
+        break;
+        case APR_AIO_DEFAULT:
+        break;
+    }
+    return provider;
+}
+
+static apr_status_t aio_ring_cleanup(void *p)
+{
+    apr_aio_ring_t *ring = (apr_aio_ring_t *) p;
+    if (ring->provider->cleanup) {
+        (*ring->provider->cleanup)(ring);
+    }
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_aio_ring_create_ex(apr_aio_ring_t **ret_ring,
+                                                 apr_uint32_t size,
+                                                 apr_pool_t *p,
+                                                 apr_uint32_t flags,
+                                                 apr_aio_method_e method)
+{
+    apr_status_t rv;
+    apr_aio_ring_t *ring;
+    const apr_aio_provider_t *provider = NULL;
+
+    *ret_ring = NULL;
+
+    if (size == 0) {
+        return APR_EINVAL;
+    }
+
+    if (method == APR_AIO_DEFAULT)
+        method = aio_default_method;
+    while (provider == NULL) {
+        provider = aio_provider(method);
+        if (!provider) {
+            if ((flags & APR_AIO_NODEFAULT) == APR_AIO_NODEFAULT)
+                return APR_ENOTIMPL;
+            if (method == aio_default_method)
+                return APR_ENOTIMPL;
+            method = aio_default_method;
+        }
+    }
+
+    ring = apr_palloc(p, sizeof(*ring));
+    ring->pool = p;
+    ring->size = size;
+    ring->flags = flags;
+    ring->count = 0;
+    ring->done = apr_palloc(p, size * sizeof(apr_aio_op_t *));
+    ring->p = NULL;
+    ring->provider = provider;
+
+    rv = (*provider->create)(ring, size, p, flags);
+    if (rv == APR_ENOTIMPL) {
+        /* io_uring not available at runtime */
+        if ((flags & APR_AIO_NODEFAULT) == APR_AIO_NODEFAULT) {
+            return rv;
+        }
+        provider = apr_aio_provider_threadpool;
+        if (provider == ring->provider) {
+            return rv;
+        }
+        rv = (*provider->create)(ring, size, p, flags);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        ring->provider = provider;
+    }
+    else if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    /* Before the subpools are destroyed, those of the threads running
+     * the operations included
+     */
+    apr_pool_pre_cleanup_register(p, ring, aio_ring_cleanup);
+
+    *ret_ring = ring;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_aio_ring_create(apr_aio_ring_t **ring,
+                                              apr_uint32_t size,
+                                              apr_pool_t *p,
+                                              apr_uint32_t flags)
+{
+    apr_aio_method_e method = APR_AIO_DEFAULT;
+    return apr_aio_ring_create_ex(ring, size, p, flags, method);
+}
+
+APR_DECLARE(apr_status_t) apr_aio_ring_destroy(apr_aio_ring_t *ring)
+{
+    return apr_pool_cleanup_run(ring->pool, ring, aio_ring_cleanup);
+}
+
+APR_DECLARE(const char *) apr_aio_ring_method_name(apr_aio_ring_t *ring)
+{
+    return ring->provider->name;
+}
+
+static apr_status_t aio_queue(apr_aio_ring_t *ring, apr_aio_op_t *op,
+                              apr_aio_opcode_e opcode,
+                              apr_aio_cb_t *cb, void *data)
+{
+    apr_status_t rv;
+
+    if (ring->count >= ring->size) {
+        return APR_EAGAIN;
+    }
+
+    op->opcode = opcode;
+    op->cb = cb;
+    op->data = data;
+    op->status = APR_SUCCESS;
+    op->nbytes = 0;
+    op->accepted = NULL;
+    op->ctx = NULL;
+    op->next = NULL;
+
+    rv = (*ring->provider->queue)(ring, op);
+    if (rv == APR_SUCCESS) {
+        ring->count++;
+    }
+    return rv;
+}
+
+static void aio_init_socket_op(apr_aio_op_t *op, apr_socket_t *sock,
+                               void *buf, apr_size_t len)
+{
+    op->sock = sock;
+    op->file = NULL;
+    op->buf = buf;
+    op->len = len;
+    op->offset = 0;
+    op->sa = NULL;
+    op->pool = NULL;
+}
+
+static apr_status_t aio_init_file_op(apr_aio_op_t *op, apr_file_t *file,
+                                     void *buf, apr_size_t len,
+                                     apr_off_t offset)
+{
+    /* The buffer of the file would be bypassed */
+    if (apr_file_flags_get(file) & APR_FOPEN_BUFFERED) {
+        return APR_EINVAL;
+    }
+
+    op->sock = NULL;
+    op->file = file;
+    op->buf = buf;
+    op->len = len;
+    op->offset = offset;
+    op->sa = NULL;
+    op->pool = NULL;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_aio_socket_recv(apr_aio_ring_t *ring,
+                                              apr_aio_op_t *op,
+                                              apr_socket_t *sock,
+                                              char *buf, apr_size_t len,
+                                              apr_aio_cb_t *cb, void *data)
+{
+    aio_init_socket_op(op, sock, buf, len);
+    return aio_queue(ring, op, APR_AIO_OP_RECV, cb, data);
+}
+
+APR_DECLARE(apr_status_t) apr_aio_socket_send(apr_aio_ring_t *ring,
+                                              apr_aio_op_t *op,
+                                              apr_socket_t *sock,
+                                              const char *buf, apr_size_t len,
+                                              apr_aio_cb_t *cb, void *data)
+{
+    aio_init_socket_op(op, sock, (void *)buf, len);
+    return aio_queue(ring, op, APR_AIO_OP_SEND, cb, data);
+}
+
+APR_DECLARE(apr_status_t) apr_aio_socket_accept(apr_aio_ring_t *ring,
+                                                apr_aio_op_t *op,
+                                                apr_socket_t *sock,
+                                                apr_pool_t *pool,
+                                                apr_aio_cb_t *cb, void *data)
+{
+    aio_init_socket_op(op, sock, NULL, 0);
+    op->pool = pool;
+    return aio_queue(ring, op, APR_AIO_OP_ACCEPT, cb, data);
+}
+
+APR_DECLARE(apr_status_t) apr_aio_socket_connect(apr_aio_ring_t *ring,
+                                                 apr_aio_op_t *op,
+                                                 apr_socket_t *sock,
+                                                 apr_sockaddr_t *sa,
+                                                 apr_aio_cb_t *cb, void *data)
+{
+    aio_init_socket_op(op, sock, NULL, 0);
+    op->sa = sa;
+    return aio_queue(ring, op, APR_AIO_OP_CONNECT, cb, data);
+}
+
+APR_DECLARE(apr_status_t) apr_aio_file_read(apr_aio_ring_t *ring,
+                                            apr_aio_op_t *op,
+                                            apr_file_t *file,
+                                            void *buf, apr_size_t len,
+                                            apr_off_t offset,
+                                            apr_aio_cb_t *cb, void *data)
+{
+    apr_status_t rv = aio_init_file_op(op, file, buf, len, offset);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    return aio_queue(ring, op, APR_AIO_OP_READ, cb, data);
+}
+
+APR_DECLARE(apr_status_t) apr_aio_file_write(apr_aio_ring_t *ring,
+                                             apr_aio_op_t *op,
+                                             apr_file_t *file,
+                                             const void *buf, apr_size_t len,
+                                             apr_off_t offset,
+                                             apr_aio_cb_t *cb, void *data)
+{
+    apr_status_t rv = aio_init_file_op(op, file, (void *)buf, len, offset);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    return aio_queue(ring, op, APR_AIO_OP_WRITE, cb, data);
+}
+
+APR_DECLARE(apr_status_t) apr_aio_file_sync(apr_aio_ring_t *ring,
+                                            apr_aio_op_t *op,
+                                            apr_file_t *file,
+                                            apr_aio_cb_t *cb, void *data)
+{
+    apr_status_t rv = aio_init_file_op(op, file, NULL, 0, 0);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    return aio_queue(ring, op, APR_AIO_OP_SYNC, cb, data);
+}
+
+APR_DECLARE(apr_status_t) apr_aio_ring_submit(apr_aio_ring_t *ring)
+{
+    return (*ring->provider->submit)(ring);
+}
+
+APR_DECLARE(apr_status_t) apr_aio_ring_reap(apr_aio_ring_t *ring,
+                                            apr_interval_time_t timeout,
+                                            apr_aio_op_t **ops,
+                                            apr_int32_t max,
+                                            apr_int32_t *num)
+{
+    apr_uint32_t i, n = 0;
+    apr_status_t rv;
+
+    *num = 0;
+
+    if (max <= 0) {
+        return APR_EINVAL;
+    }
+    if (!ring->count) {
+        return APR_TIMEUP;
+    }
+    if ((apr_uint32_t)max > ring->size) {
+        max = ring->size;
+    }
+
+    rv = (*ring->provider->reap)(ring, timeout, ring->done, max, &n);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    /* The callbacks may queue more operations */
+    ring->count -= n;
+    for (i = 0; i < n; i++) {
+        apr_aio_op_t *op = ring->done[i];
+
+        if (op->cb) {
+            (*op->cb)(op);
+        }
+        else if (ops) {
+            ops[(*num)++] = op;
+        }
+    }
+
+    return APR_SUCCESS;
+}
@@ -0,0 +1,242 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr.h"
+#include "apr_aio.h"
+#include "apr_time.h"
+#include "apr_arch_aio_private.h"
+#include "apr_arch_uring.h"
+
+#if defined(HAVE_IO_URING)
+
+#include "apr_arch_file_io.h"
+#include "apr_arch_networkio.h"
+
+/*
+ * Each operation is one SQE, whose user_data is the apr_aio_op_t.  The
+ * ring has room for all the operations in flight, and twice as much for
+ * their completions, so the queues never overflow.
+ */
+
+/* At most MAX_RW_COUNT bytes are transferred by a read or write */
+#define URING_MAX_LEN 0x7ffff000
+
+struct apr_aio_ring_private_t
+{
+    apr_uring_t ring;
+};
+
+static apr_status_t uring_aio_cleanup(apr_aio_ring_t *ring)
+{
+    apr_uring_close(&ring->p->ring);
+    return APR_SUCCESS;
+}
+
+static apr_status_t uring_aio_create(apr_aio_ring_t *ring, apr_uint32_t size,
+                                     apr_pool_t *p, apr_uint32_t flags)
+{
+    apr_aio_ring_private_t *u;
+    apr_status_t rv;
+
+    u = apr_pcalloc(p, sizeof(*u));
+    if ((rv = apr_uring_setup(&u->ring, size)) != APR_SUCCESS) {
+        return rv;
+    }
+
+    ring->p = u;
+    return APR_SUCCESS;
+}
+
+static apr_status_t uring_aio_queue(apr_aio_ring_t *ring, apr_aio_op_t *op)
+{
+    apr_uring_t *r = &ring->p->ring;
+    struct io_uring_sqe *sqe;
+    apr_sockaddr_t *sa;
+    apr_status_t rv;
+
+    sqe = apr_uring_get_sqe(r, &rv);
+    if (!sqe) {
+        return rv;
+    }
+
+    switch (op->opcode) {
+    case APR_AIO_OP_RECV:
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = op->sock->socketdes;
+        sqe->addr = (apr_uint64_t)(apr_uintptr_t)op->buf;
+        sqe->len = op->len > URING_MAX_LEN ? URING_MAX_LEN : op->len;
+        break;
+    case APR_AIO_OP_SEND:
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = op->sock->socketdes;
+        sqe->addr = (apr_uint64_t)(apr_uintptr_t)op->buf;
+        sqe->len = op->len > URING_MAX_LEN ? URING_MAX_LEN : op->len;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        break;
+    case APR_AIO_OP_ACCEPT:
+        /* The peer address, passed to apr_socket_accepted() */
+        sa = apr_palloc(op->pool, sizeof(*sa));
+        sa->salen = sizeof(sa->sa);
+        op->ctx = sa;
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = op->sock->socketdes;
+        sqe->addr = (apr_uint64_t)(apr_uintptr_t)&sa->sa;
+        sqe->addr2 = (apr_uint64_t)(apr_uintptr_t)&sa->salen;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        break;
+    case APR_AIO_OP_CONNECT:
+        sqe->opcode = IORING_OP_CONNECT;
+        sqe->fd = op->sock->socketdes;
+        sqe->addr = (apr_uint64_t)(apr_uintptr_t)&op->sa->sa;
+        sqe->off = op->sa->salen;
+        break;
+    case APR_AIO_OP_READ:
+    case APR_AIO_OP_WRITE:
+        sqe->opcode = op->opcode == APR_AIO_OP_READ ? IORING_OP_READ
+                                                    : IORING_OP_WRITE;
+        sqe->fd = op->file->filedes;
+        sqe->addr = (apr_uint64_t)(apr_uintptr_t)op->buf;
+        sqe->len = op->len > URING_MAX_LEN ? URING_MAX_LEN : op->len;
+        sqe->off = op->offset;
+        break;
+    case APR_AIO_OP_SYNC:
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fd = op->file->filedes;
+        break;
+    default:
+        return APR_ENOTIMPL;
+    }
+    sqe->user_data = (apr_uint64_t)(apr_uintptr_t)op;
+    apr_uring_commit_sqe(r);
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t uring_aio_submit(apr_aio_ring_t *ring)
+{
+    apr_status_t rv = apr_uring_submit(&ring->p->ring);
+
+    /* Short of resources, retried by the next submit or reap */
+    if (rv == EAGAIN || rv == EBUSY) {
+        rv = APR_SUCCESS;
+    }
+    return rv;
+}
+
+/* Set the results of the operation from the CQE's */
+static void uring_aio_complete(apr_aio_op_t *op, int res)
+{
+    if (res < 0) {
+        op->status = -res;
+        return;
+    }
+
+    switch (op->opcode) {
+    case APR_AIO_OP_RECV:
+    case APR_AIO_OP_READ:
+        op->nbytes = res;
+        if (res == 0 && op->len) {
+            op->status = APR_EOF;
+        }
+        break;
+    case APR_AIO_OP_SEND:
+    case APR_AIO_OP_WRITE:
+        op->nbytes = res;
+        break;
+    case APR_AIO_OP_ACCEPT:
+        op->status = apr_socket_accepted(&op->accepted, op->sock, res,
+                                         op->ctx, op->pool);
+        break;
+    case APR_AIO_OP_CONNECT:
+        /* Connected, let apr_socket_connect() (EISCONN) update the
+         * addresses of the socket
+         */
+        op->status = apr_socket_connect(op->sock, op->sa);
+        break;
+    case APR_AIO_OP_SYNC:
+        break;
+    }
+}
+
+static apr_status_t uring_aio_reap(apr_aio_ring_t *ring,
+                                   apr_interval_time_t timeout,
+                                   apr_aio_op_t **done, apr_uint32_t max,
+                                   apr_uint32_t *num)
+{
+    apr_uring_t *r = &ring->p->ring;
+    struct io_uring_cqe cqe;
+    apr_time_t deadline = 0;
+    apr_uint32_t n = 0;
+    apr_status_t rv;
+
+    if (timeout > 0) {
+        deadline = apr_time_monotonic() + timeout;
+    }
+
+    for (;;) {
+        unsigned wait;
+        int ret;
+
+        /* Submit and wait in the same call */
+        wait = (timeout != 0 && !apr_uring_cq_ready(r));
+        ret = apr_uring_enter(r, apr_uring_sq_pending(r), wait,
+                              IORING_ENTER_GETEVENTS, timeout);
+        rv = ret < 0 ? errno : APR_SUCCESS;
+        if (rv != APR_SUCCESS && rv != ETIME && rv != EINTR
+            && rv != EAGAIN && rv != EBUSY) {
+            return rv;
+        }
+
+        while (n < max && apr_uring_get_cqe(r, &cqe)) {
+            apr_aio_op_t *op = (apr_aio_op_t *)(apr_uintptr_t)cqe.user_data;
+
+            uring_aio_complete(op, cqe.res);
+            done[n++] = op;
+        }
+
+        if (n) {
+            break;
+        }
+        if (rv == EINTR) {
+            return APR_EINTR;
+        }
+        if (timeout == 0) {
+            return APR_TIMEUP;
+        }
+        if (timeout > 0) {
+            timeout = deadline - apr_time_monotonic();
+            if (timeout <= 0) {
+                return APR_TIMEUP;
+            }
+        }
+    }
+
+    *num = n;
+    return APR_SUCCESS;
+}
+
+static const apr_aio_provider_t impl = {
+    uring_aio_create,
+    uring_aio_queue,
+    uring_aio_submit,
+    uring_aio_reap,
+    uring_aio_cleanup,
+    "io_uring"
+};
+
+const apr_aio_provider_t *apr_aio_provider_io_uring = &impl;
+
+#endif /* HAVE_IO_URING */
@@ -0,0 +1,371 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr.h"
+#include "apr_aio.h"
+#include "apr_poll.h"
+#include "apr_portable.h"
+#include "apr_thread_pool.h"
+#include "apr_thread_mutex.h"
+#include "apr_thread_cond.h"
+#include "apr_atomic.h"
+#include "apr_arch_aio_private.h"
+
+#if APR_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if APR_HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+/*
+ * The operations run with the blocking APR calls, each on a thread of an
+ * apr_thread_pool_t.  Sockets are polled for readiness first, in slices
+ * of AIO_WAIT_SLICE so that destroying the ring does not wait forever for
+ * a peer.
+ */
+#define AIO_WAIT_SLICE apr_time_from_msec(100)
+
+#if defined(HAVE_PREAD) && defined(HAVE_PWRITE) \
+    && APR_HAS_LARGE_FILES && defined(_LARGEFILE64_SOURCE)
+#define pread(f,b,n,o) pread64(f,b,n,o)
+#define pwrite(f,b,n,o) pwrite64(f,b,n,o)
+#endif
+
+#if APR_HAS_THREADS
+#define aio_lock(p)   apr_thread_mutex_lock((p)->lock)
+#define aio_unlock(p) apr_thread_mutex_unlock((p)->lock)
+#else
+#define aio_lock(p)
+#define aio_unlock(p)
+#endif
+
+struct apr_aio_ring_private_t
+{
+    /* Queued, not submitted yet */
+    apr_aio_op_t *queued;
+    apr_aio_op_t **queued_tail;
+    volatile apr_uint32_t shutdown;
+#if APR_HAS_THREADS
+    apr_thread_pool_t *tp;
+    apr_thread_mutex_t *lock;
+    apr_thread_cond_t *cond;
+    /* Completed, not reaped yet */
+    apr_aio_op_t *done;
+    apr_aio_op_t **done_tail;
+#endif
+#if !defined(HAVE_PREAD) || !defined(HAVE_PWRITE)
+#if APR_HAS_THREADS
+    /* Serializes the seek and read or write */
+    apr_thread_mutex_t *file_lock;
+#endif
+#endif
+};
+
+static apr_status_t tp_wait(apr_aio_ring_private_t *tp, apr_socket_t *sock,
+                            apr_int16_t reqevents)
+{
+    apr_pollfd_t pfd;
+    apr_int32_t n;
+    apr_status_t rv;
+
+    pfd.p = NULL;
+    pfd.desc_type = APR_POLL_SOCKET;
+    pfd.reqevents = reqevents;
+    pfd.rtnevents = 0;
+    pfd.desc.s = sock;
+    pfd.client_data = NULL;
+
+    do {
+        if (apr_atomic_read32(&tp->shutdown)) {
+            return APR_EINTR;
+        }
+        rv = apr_poll(&pfd, 1, &n, AIO_WAIT_SLICE);
+    } while (APR_STATUS_IS_TIMEUP(rv) || APR_STATUS_IS_EINTR(rv));
+
+    return rv;
+}
+
+static apr_status_t tp_file_io(apr_aio_ring_private_t *tp, apr_aio_op_t *op)
+{
+#if defined(HAVE_PREAD) && defined(HAVE_PWRITE)
+    apr_os_file_t fd;
+    apr_ssize_t n;
+
+    apr_os_file_get(&fd, op->file);
+    do {
+        if (op->opcode == APR_AIO_OP_READ) {
+            n = pread(fd, op->buf, op->len, op->offset);
+        }
+        else {
+            n = pwrite(fd, op->buf, op->len, op->offset);
+        }
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        return errno;
+    }
+    op->nbytes = n;
+    if (n == 0 && op->len && op->opcode == APR_AIO_OP_READ) {
+        return APR_EOF;
+    }
+    return APR_SUCCESS;
+#else
+    apr_off_t offset = op->offset;
+    apr_size_t n = op->len;
+    apr_status_t rv;
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(tp->file_lock);
+#endif
+    rv = apr_file_seek(op->file, APR_SET, &offset);
+    if (rv == APR_SUCCESS) {
+        if (op->opcode == APR_AIO_OP_READ) {
+            rv = apr_file_read(op->file, op->buf, &n);
+        }
+        else {
+            rv = apr_file_write(op->file, op->buf, &n);
+        }
+        op->nbytes = n;
+    }
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(tp->file_lock);
+#endif
+    return rv;
+#endif
+}
+
+static apr_status_t tp_run(apr_aio_ring_private_t *tp, apr_aio_op_t *op)
+{
+    apr_size_t n = op->len;
+    apr_status_t rv;
+
+    switch (op->opcode) {
+    case APR_AIO_OP_RECV:
+        do {
+            if ((rv = tp_wait(tp, op->sock, APR_POLLIN)) == APR_SUCCESS) {
+                n = op->len;
+                rv = apr_socket_recv(op->sock, op->buf, &n);
+            }
+        } while (APR_STATUS_IS_EAGAIN(rv));
+        op->nbytes = n;
+        return rv;
+
+    case APR_AIO_OP_SEND:
+        do {
+            if ((rv = tp_wait(tp, op->sock, APR_POLLOUT)) == APR_SUCCESS) {
+                n = op->len;
+                rv = apr_socket_send(op->sock, op->buf, &n);
+            }
+        } while (APR_STATUS_IS_EAGAIN(rv));
+        op->nbytes = n;
+        return rv;
+
+    case APR_AIO_OP_ACCEPT:
+        do {
+            if ((rv = tp_wait(tp, op->sock, APR_POLLIN)) == APR_SUCCESS) {
+                rv = apr_socket_accept(&op->accepted, op->sock, op->pool);
+            }
+        } while (APR_STATUS_IS_EAGAIN(rv));
+        return rv;
+
+    case APR_AIO_OP_CONNECT:
+        rv = apr_socket_connect(op->sock, op->sa);
+        while (APR_STATUS_IS_EINPROGRESS(rv) || APR_STATUS_IS_EALREADY(rv)) {
+            /* Non-blocking socket, connect() again once done */
+            if ((rv = tp_wait(tp, op->sock, APR_POLLOUT)) == APR_SUCCESS) {
+                rv = apr_socket_connect(op->sock, op->sa);
+            }
+        }
+        return rv;
+
+    case APR_AIO_OP_READ:
+    case APR_AIO_OP_WRITE:
+        return tp_file_io(tp, op);
+
+    case APR_AIO_OP_SYNC:
+        return apr_file_sync(op->file);
+    }
+
+    return APR_ENOTIMPL;
+}
+
+#if APR_HAS_THREADS
+
+static void tp_complete(apr_aio_ring_private_t *tp, apr_aio_op_t *op)
+{
+    aio_lock(tp);
+    op->next = NULL;
+    *tp->done_tail = op;
+    tp->done_tail = &op->next;
+    apr_thread_cond_signal(tp->cond);
+    aio_unlock(tp);
+}
+
+static void *APR_THREAD_FUNC tp_task(apr_thread_t *thd, void *data)
+{
+    apr_aio_op_t *op = data;
+    apr_aio_ring_private_t *tp = op->ctx;
+
+    op->status = tp_run(tp, op);
+    tp_complete(tp, op);
+    return NULL;
+}
+
+#endif /* APR_HAS_THREADS */
+
+static apr_status_t tp_cleanup(apr_aio_ring_t *ring)
+{
+    apr_aio_ring_private_t *tp = ring->p;
+
+    apr_atomic_set32(&tp->shutdown, 1);
+#if APR_HAS_THREADS
+    /* Cancels the operations not started, and waits for the others */
+    apr_thread_pool_destroy(tp->tp);
+#endif
+    return APR_SUCCESS;
+}
+
+static apr_status_t tp_create(apr_aio_ring_t *ring, apr_uint32_t size,
+                              apr_pool_t *p, apr_uint32_t flags)
+{
+    apr_aio_ring_private_t *tp;
+#if APR_HAS_THREADS
+    apr_status_t rv;
+#endif
+
+    tp = apr_pcalloc(p, sizeof(*tp));
+    tp->queued_tail = &tp->queued;
+#if APR_HAS_THREADS
+    tp->done_tail = &tp->done;
+    if ((rv = apr_thread_mutex_create(&tp->lock, APR_THREAD_MUTEX_DEFAULT,
+                                      p)) != APR_SUCCESS) {
+        return rv;
+    }
+    if ((rv = apr_thread_cond_create(&tp->cond, p)) != APR_SUCCESS) {
+        return rv;
+    }
+#if !defined(HAVE_PREAD) || !defined(HAVE_PWRITE)
+    if ((rv = apr_thread_mutex_create(&tp->file_lock,
+                                      APR_THREAD_MUTEX_DEFAULT,
+                                      p)) != APR_SUCCESS) {
+        return rv;
+    }
+#endif
+    if ((rv = apr_thread_pool_create(&tp->tp, 0, size, p)) != APR_SUCCESS) {
+        return rv;
+    }
+#endif
+
+    ring->p = tp;
+    return APR_SUCCESS;
+}
+
+static apr_status_t tp_queue(apr_aio_ring_t *ring, apr_aio_op_t *op)
+{
+    apr_aio_ring_private_t *tp = ring->p;
+
+    op->ctx = tp;
+    *tp->queued_tail = op;
+    tp->queued_tail = &op->next;
+    return APR_SUCCESS;
+}
+
+static apr_status_t tp_submit(apr_aio_ring_t *ring)
+{
+#if APR_HAS_THREADS
+    apr_aio_ring_private_t *tp = ring->p;
+    apr_aio_op_t *op;
+    apr_status_t rv;
+
+    while ((op = tp->queued) != NULL) {
+        tp->queued = op->next;
+        rv = apr_thread_pool_push(tp->tp, tp_task, op,
+                                  APR_THREAD_TASK_PRIORITY_NORMAL, ring);
+        if (rv != APR_SUCCESS) {
+            /* Reaped as failed */
+            op->status = rv;
+            tp_complete(tp, op);
+        }
+    }
+    tp->queued_tail = &tp->queued;
+#endif
+    return APR_SUCCESS;
+}
+
+static apr_status_t tp_reap(apr_aio_ring_t *ring,
+                            apr_interval_time_t timeout,
+                            apr_aio_op_t **done, apr_uint32_t max,
+                            apr_uint32_t *num)
+{
+    apr_aio_ring_private_t *tp = ring->p;
+    apr_aio_op_t *op;
+    apr_uint32_t n = 0;
+#if APR_HAS_THREADS
+    apr_time_t deadline = 0;
+
+    tp_submit(ring);
+
+    if (timeout > 0) {
+        deadline = apr_time_monotonic() + timeout;
+    }
+
+    aio_lock(tp);
+    while (!tp->done && timeout != 0) {
+        if (timeout < 0) {
+            apr_thread_cond_wait(tp->cond, tp->lock);
+        }
+        else {
+            apr_thread_cond_timedwait(tp->cond, tp->lock, timeout);
+            timeout = deadline - apr_time_monotonic();
+            if (timeout <= 0) {
+                break;
+            }
+        }
+    }
+    while (n < max && (op = tp->done) != NULL) {
+        tp->done = op->next;
+        done[n++] = op;
+    }
+    if (!tp->done) {
+        tp->done_tail = &tp->done;
+    }
+    aio_unlock(tp);
+#else
+    /* Run the queued operations here, the timeout cannot be honored */
+    while (n < max && (op = tp->queued) != NULL) {
+        tp->queued = op->next;
+        op->status = tp_run(tp, op);
+        done[n++] = op;
+    }
+    if (!tp->queued) {
+        tp->queued_tail = &tp->queued;
+    }
+#endif
+
+    *num = n;
+    return n ? APR_SUCCESS : APR_TIMEUP;
+}
+
+static const apr_aio_provider_t impl = {
+    tp_create,
+    tp_queue,
+    tp_submit,
+    tp_reap,
+    tp_cleanup,
+    "threadpool"
+};
+
+const apr_aio_provider_t *apr_aio_provider_threadpool = &impl;
@@ -135,6 +135,18 @@ LIB32=link.exe -lib
 # Begin Group "Source Files"
 
 # PROP Default_Filter ".c"
+# Begin Group "aio"
+
+# PROP Default_Filter ""
+# Begin Source File
+
+SOURCE=.\aio\unix\aio.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\aio\unix\threadpool.c
+# End Source File
+# End Group
 # Begin Group "atomic"
 
 # PROP Default_Filter ""
@@ -164,6 +176,10 @@ SOURCE=.\buckets\apr_buckets_alloc.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\buckets\apr_buckets_digest.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\buckets\apr_buckets_eos.c
 # End Source File
 # Begin Source File
@@ -295,6 +311,10 @@ SOURCE=.\dbm\apr_dbm_gdbm.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\dbm\apr_dbm_lsm.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\dbm\apr_dbm_sdbm.c
 # End Source File
 # End Group
@@ -331,6 +351,10 @@ SOURCE=.\file_io\unix\copy.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\file_io\unix\dirwalk.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\file_io\win32\dir.c
 # End Source File
 # Begin Source File
@@ -367,6 +391,14 @@ SOURCE=.\file_io\unix\fullrw.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\file_io\unix\groupcommit.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\file_io\unix\lineiter.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\file_io\unix\mktemp.c
 # End Source File
 # Begin Source File
@@ -387,6 +419,14 @@ SOURCE=.\file_io\win32\seek.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\file_io\unix\splice.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\file_io\unix\statcache.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\file_io\unix\tempdir.c
 # End Source File
 # End Group
@@ -403,6 +443,14 @@ SOURCE=.\hooks\apr_hooks.c
 # PROP Default_Filter ""
 # Begin Source File
 
+SOURCE=.\locks\unix\lock_profile.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\locks\unix\proc_rwlock.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\locks\win32\proc_mutex.c
 # End Source File
 # Begin Source File
@@ -433,6 +481,10 @@ SOURCE=.\memcache\apr_memcache.c
 
 SOURCE=.\memory\unix\apr_pools.c
 # End Source File
+# Begin Source File
+
+SOURCE=.\memory\unix\apr_slab.c
+# End Source File
 # End Group
 # Begin Group "misc"
 
@@ -520,6 +572,10 @@ SOURCE=.\network_io\win32\sendrecv.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\network_io\unix\resolver.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\network_io\unix\sockaddr.c
 # End Source File
 # Begin Source File
@@ -556,6 +612,10 @@ SOURCE=.\poll\unix\pollset.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\poll\unix\pollsource.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\poll\unix\poll.c
 # End Source File
 # Begin Source File
@@ -592,6 +652,10 @@ SOURCE=.\dbm\sdbm\sdbm.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\dbm\sdbm\sdbm_cache.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\dbm\sdbm\sdbm_hash.c
 # End Source File
 # Begin Source File
@@ -640,6 +704,10 @@ SOURCE=.\strings\apr_snprintf.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\strings\apr_strbuf.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\strings\apr_strings.c
 # End Source File
 # Begin Source File
@@ -664,6 +732,18 @@ SOURCE=.\strmatch\apr_strmatch.c
 # PROP Default_Filter ""
 # Begin Source File
 
+SOURCE=.\tables\apr_chash.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\tables\apr_flatmap.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\tables\apr_heap.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\tables\apr_hash.c
 # End Source File
 # Begin Source File
@@ -740,6 +820,10 @@ SOURCE=.\util-misc\apu_dso.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\util-misc\apr_metrics.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\util-misc\apr_queue.c
 # End Source File
 # Begin Source File
@@ -752,6 +836,14 @@ SOURCE=.\util-misc\apr_rmm.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\util-misc\apr_shm_hash.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\util-misc\apr_shm_ring.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\util-misc\apr_thread_pool.c
 # End Source File
 # End Group
@@ -886,6 +978,10 @@ InputPath=.\include\apr.hw
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_aio.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_allocator.h
 # End Source File
 # Begin Source File
@@ -894,6 +990,10 @@ SOURCE=.\include\apr_atomic.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_dir_walk.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_dso.h
 # End Source File
 # Begin Source File
@@ -1003,6 +1103,18 @@ SOURCE=.\include\apr_global_mutex.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_chash.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\apr_flatmap.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\apr_heap.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_hash.h
 # End Source File
 # Begin Source File
@@ -1015,6 +1127,14 @@ SOURCE=.\include\apr_lib.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_lock_profile.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\apr_metrics.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_mmap.h
 # End Source File
 # Begin Source File
@@ -1039,10 +1159,18 @@ SOURCE=.\include\apr_proc_mutex.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_proc_rwlock.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_random.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_resolver.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_ring.h
 # End Source File
 # Begin Source File
@@ -1051,6 +1179,14 @@ SOURCE=.\include\apr_shm.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_shm_hash.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\apr_shm_ring.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_signal.h
 # End Source File
 # Begin Source File
@@ -1059,6 +1195,14 @@ SOURCE=.\include\apr_skiplist.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_slab.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\apr_strbuf.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_strings.h
 # End Source File
 # Begin Source File
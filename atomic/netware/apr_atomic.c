@@ -76,3 +76,55 @@ APR_DECLARE(void*) apr_atomic_xchgptr(void *volatile *mem, void *with)
 {
     return (void*)atomic_xchg((unsigned long *)mem,(unsigned long)with);
 }
+
+APR_DECLARE(apr_uint32_t) apr_atomic_and32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_uint32_t prev, old = *mem;
+
+    while ((prev = apr_atomic_cas32(mem, old & val, old)) != old) {
+        old = prev;
+    }
+    return old;
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_or32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_uint32_t prev, old = *mem;
+
+    while ((prev = apr_atomic_cas32(mem, old | val, old)) != old) {
+        old = prev;
+    }
+    return old;
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_xor32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_uint32_t prev, old = *mem;
+
+    while ((prev = apr_atomic_cas32(mem, old ^ val, old)) != old) {
+        old = prev;
+    }
+    return old;
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_read32_acquire(volatile apr_uint32_t *mem)
+{
+    return *mem;
+}
+
+APR_DECLARE(void) apr_atomic_set32_release(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    *mem = val;
+}
+
+APR_DECLARE(void) apr_atomic_fence(void)
+{
+    static volatile apr_uint32_t fence;
+
+    /* The locked exchange is a full barrier */
+    apr_atomic_xchg32(&fence, 0);
+}
+
+APR_DECLARE(void) apr_atomic_pause(void)
+{
+}
@@ -137,3 +137,61 @@ APR_DECLARE(void*) apr_atomic_xchgptr(void *volatile *mem_ptr, void *new_ptr)
 
     return old_ptr;
 }
+
+apr_uint32_t apr_atomic_and32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_uint32_t old, new_val;
+
+    old = *mem;   /* old is automatically updated on cs failure */
+    do {
+        new_val = old & val;
+    } while (__cs(&old, (cs_t *)mem, new_val));
+
+    return old;
+}
+
+apr_uint32_t apr_atomic_or32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_uint32_t old, new_val;
+
+    old = *mem;   /* old is automatically updated on cs failure */
+    do {
+        new_val = old | val;
+    } while (__cs(&old, (cs_t *)mem, new_val));
+
+    return old;
+}
+
+apr_uint32_t apr_atomic_xor32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_uint32_t old, new_val;
+
+    old = *mem;   /* old is automatically updated on cs failure */
+    do {
+        new_val = old ^ val;
+    } while (__cs(&old, (cs_t *)mem, new_val));
+
+    return old;
+}
+
+apr_uint32_t apr_atomic_read32_acquire(volatile apr_uint32_t *mem)
+{
+    return *mem;
+}
+
+void apr_atomic_set32_release(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    *mem = val;
+}
+
+void apr_atomic_fence(void)
+{
+    static volatile apr_uint32_t fence;
+
+    /* cs serializes */
+    apr_atomic_xchg32(&fence, 0);
+}
+
+void apr_atomic_pause(void)
+{
+}
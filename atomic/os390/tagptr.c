@@ -0,0 +1 @@
+#include "../unix/tagptr.c"
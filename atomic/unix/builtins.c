@@ -136,4 +136,66 @@ APR_DECLARE(void*) apr_atomic_xchgptr(void *volatile *mem, void *ptr)
 #endif
 }
 
+APR_DECLARE(apr_uint32_t) apr_atomic_and32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+#if HAVE__ATOMIC_BUILTINS
+    return __atomic_fetch_and(mem, val, __ATOMIC_SEQ_CST);
+#else
+    return __sync_fetch_and_and(mem, val);
+#endif
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_or32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+#if HAVE__ATOMIC_BUILTINS
+    return __atomic_fetch_or(mem, val, __ATOMIC_SEQ_CST);
+#else
+    return __sync_fetch_and_or(mem, val);
+#endif
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_xor32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+#if HAVE__ATOMIC_BUILTINS
+    return __atomic_fetch_xor(mem, val, __ATOMIC_SEQ_CST);
+#else
+    return __sync_fetch_and_xor(mem, val);
+#endif
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_read32_acquire(volatile apr_uint32_t *mem)
+{
+#if HAVE__ATOMIC_BUILTINS
+    return __atomic_load_n(mem, __ATOMIC_ACQUIRE);
+#else
+    return apr_atomic_read32(mem);
+#endif
+}
+
+APR_DECLARE(void) apr_atomic_set32_release(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+#if HAVE__ATOMIC_BUILTINS
+    __atomic_store_n(mem, val, __ATOMIC_RELEASE);
+#elif WEAK_MEMORY_ORDERING
+    __sync_synchronize();
+    *mem = val;
+#else
+    *mem = val;
+#endif
+}
+
+APR_DECLARE(void) apr_atomic_fence(void)
+{
+#if HAVE__ATOMIC_BUILTINS
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#else
+    __sync_synchronize();
+#endif
+}
+
+APR_DECLARE(void) apr_atomic_pause(void)
+{
+    APR__ATOMIC_PAUSE();
+}
+
 #endif /* USE_ATOMICS_BUILTINS */
@@ -107,4 +107,49 @@ APR_DECLARE(apr_uint64_t) apr_atomic_xchg64(volatile apr_uint64_t *mem, apr_uint
 #endif
 }
 
+APR_DECLARE(apr_uint64_t) apr_atomic_and64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+#if HAVE__ATOMIC_BUILTINS64
+    return __atomic_fetch_and(mem, val, __ATOMIC_SEQ_CST);
+#else
+    return __sync_fetch_and_and(mem, val);
+#endif
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_or64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+#if HAVE__ATOMIC_BUILTINS64
+    return __atomic_fetch_or(mem, val, __ATOMIC_SEQ_CST);
+#else
+    return __sync_fetch_and_or(mem, val);
+#endif
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_xor64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+#if HAVE__ATOMIC_BUILTINS64
+    return __atomic_fetch_xor(mem, val, __ATOMIC_SEQ_CST);
+#else
+    return __sync_fetch_and_xor(mem, val);
+#endif
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_read64_acquire(volatile apr_uint64_t *mem)
+{
+#if HAVE__ATOMIC_BUILTINS64
+    return __atomic_load_n(mem, __ATOMIC_ACQUIRE);
+#else
+    return apr_atomic_read64(mem);
+#endif
+}
+
+APR_DECLARE(void) apr_atomic_set64_release(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+#if HAVE__ATOMIC_BUILTINS64
+    __atomic_store_n(mem, val, __ATOMIC_RELEASE);
+#else
+    apr_atomic_set64(mem, val);
+#endif
+}
+
 #endif /* USE_ATOMICS_BUILTINS64 */
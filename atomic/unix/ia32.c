@@ -128,4 +128,65 @@ APR_DECLARE(void*) apr_atomic_xchgptr(void *volatile *mem, void *with)
     return prev;
 }
 
+APR_DECLARE(apr_uint32_t) apr_atomic_and32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_uint32_t prev, old = *mem;
+
+    while ((prev = apr_atomic_cas32(mem, old & val, old)) != old) {
+        old = prev;
+    }
+    return old;
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_or32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_uint32_t prev, old = *mem;
+
+    while ((prev = apr_atomic_cas32(mem, old | val, old)) != old) {
+        old = prev;
+    }
+    return old;
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_xor32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_uint32_t prev, old = *mem;
+
+    while ((prev = apr_atomic_cas32(mem, old ^ val, old)) != old) {
+        old = prev;
+    }
+    return old;
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_read32_acquire(volatile apr_uint32_t *mem)
+{
+    apr_uint32_t val = *mem;
+
+    /* Loads are not reordered with later accesses, only the compiler */
+    asm volatile ("" : : : "memory");
+    return val;
+}
+
+APR_DECLARE(void) apr_atomic_set32_release(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    /* Stores are not reordered with earlier accesses, only the compiler */
+    asm volatile ("" : : : "memory");
+    *mem = val;
+}
+
+APR_DECLARE(void) apr_atomic_fence(void)
+{
+#if APR_SIZEOF_VOIDP == 4
+    /* mfence needs SSE2, a locked instruction orders as well */
+    asm volatile ("lock; addl $0,0(%%esp)" : : : "memory", "cc");
+#else
+    asm volatile ("mfence" : : : "memory");
+#endif
+}
+
+APR_DECLARE(void) apr_atomic_pause(void)
+{
+    APR__ATOMIC_PAUSE();
+}
+
 #endif /* USE_ATOMICS_IA32 */
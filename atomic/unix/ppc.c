@@ -239,4 +239,67 @@ APR_DECLARE(void*) apr_atomic_xchgptr(void *volatile *mem, void *with)
     return prev;
 }
 
+APR_DECLARE(apr_uint32_t) apr_atomic_and32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_uint32_t prev, old = *mem;
+
+    while ((prev = apr_atomic_cas32(mem, old & val, old)) != old) {
+        old = prev;
+    }
+    return old;
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_or32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_uint32_t prev, old = *mem;
+
+    while ((prev = apr_atomic_cas32(mem, old | val, old)) != old) {
+        old = prev;
+    }
+    return old;
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_xor32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_uint32_t prev, old = *mem;
+
+    while ((prev = apr_atomic_cas32(mem, old ^ val, old)) != old) {
+        old = prev;
+    }
+    return old;
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_read32_acquire(volatile apr_uint32_t *mem)
+{
+    apr_uint32_t val;
+    asm volatile ("    lwz %0,%1\n"            /* load                   */
+                  "    cmpw 7,%0,%0\n"         /* compare (always equal) */
+                  "    bne- 7,$+4\n"           /* goto next in any case  */
+                  "    isync"                  /* acquire barrier (bc+isync) */
+                  : "=r"(val)
+                  : "m"(*mem)
+                  : "cc", "memory");
+    return val;
+}
+
+APR_DECLARE(void) apr_atomic_set32_release(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    asm volatile ("    lwsync\n"               /* release barrier      */
+                  "    stw %1,%0"              /* store                */
+                  : "=m"(*mem)
+                  : "r"(val)
+                  : "memory");
+}
+
+APR_DECLARE(void) apr_atomic_fence(void)
+{
+    asm volatile ("    sync"                   /* full barrier         */
+                  : : : "memory");
+}
+
+APR_DECLARE(void) apr_atomic_pause(void)
+{
+    APR__ATOMIC_PAUSE();
+}
+
 #endif /* USE_ATOMICS_PPC */
@@ -80,4 +80,63 @@ APR_DECLARE(void*) apr_atomic_xchgptr(void *volatile *mem, void *with)
     return atomic_swap_ptr(mem, with);
 }
 
+APR_DECLARE(apr_uint32_t) apr_atomic_and32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_uint32_t prev, old = *mem;
+
+    /* The atomic_and_32_nv() result can't give the old value back */
+    while ((prev = atomic_cas_32(mem, old, old & val)) != old) {
+        old = prev;
+    }
+    return old;
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_or32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_uint32_t prev, old = *mem;
+
+    /* The atomic_or_32_nv() result can't give the old value back */
+    while ((prev = atomic_cas_32(mem, old, old | val)) != old) {
+        old = prev;
+    }
+    return old;
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_xor32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_uint32_t prev, old = *mem;
+
+    while ((prev = atomic_cas_32(mem, old, old ^ val)) != old) {
+        old = prev;
+    }
+    return old;
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_read32_acquire(volatile apr_uint32_t *mem)
+{
+    apr_uint32_t val = *mem;
+
+    membar_consumer();
+    return val;
+}
+
+APR_DECLARE(void) apr_atomic_set32_release(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    membar_exit();
+    *mem = val;
+}
+
+APR_DECLARE(void) apr_atomic_fence(void)
+{
+    /* #StoreLoad|#StoreStore, #LoadStore|#StoreStore, then #LoadLoad */
+    membar_enter();
+    membar_exit();
+    membar_consumer();
+}
+
+APR_DECLARE(void) apr_atomic_pause(void)
+{
+    APR__ATOMIC_PAUSE();
+}
+
 #endif /* USE_ATOMICS_SOLARIS */
@@ -0,0 +1,163 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_arch_atomic.h"
+
+/* The tagged pointers are swapped with the 64-bit compare-and-swap when
+ * they fit, with cmpxchg16b or the 128-bit builtin when available, or
+ * else under a spinlock.
+ */
+#if APR_SIZEOF_VOIDP == 4
+#   define USE_TAGPTR_CAS64
+#elif defined(__GNUC__) && !defined(__STRICT_ANSI__) && defined(__x86_64__)
+#   define USE_TAGPTR_CMPXCHG16B
+#elif defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+#   define USE_TAGPTR_SYNC16
+#endif
+
+#ifdef USE_TAGPTR_CAS64
+
+APR_DECLARE(int) apr_atomic_cas_tagptr(volatile apr_atomic_tagptr_t *mem,
+                                       apr_atomic_tagptr_t *cmp,
+                                       apr_atomic_tagptr_t with)
+{
+    union {
+        apr_atomic_tagptr_t tp;
+        apr_uint64_t u;
+    } w, c, prev;
+
+    w.tp = with;
+    c.tp = *cmp;
+    prev.u = apr_atomic_cas64((volatile apr_uint64_t *)mem, w.u, c.u);
+    if (prev.u == c.u) {
+        return 1;
+    }
+    *cmp = prev.tp;
+    return 0;
+}
+
+#else /* USE_TAGPTR_CAS64 */
+
+#define NUM_TAGPTR_LOCKS 7
+#define TAGPTR_HASH(x) (unsigned int)(((apr_uintptr_t)(x)>>4)%NUM_TAGPTR_LOCKS)
+
+static volatile apr_uint32_t tagptr_locks[NUM_TAGPTR_LOCKS];
+
+static int cas_tagptr_locked(volatile apr_atomic_tagptr_t *mem,
+                             apr_atomic_tagptr_t *cmp,
+                             apr_atomic_tagptr_t with)
+{
+    volatile apr_uint32_t *lock = &tagptr_locks[TAGPTR_HASH(mem)];
+    int swapped;
+
+    while (apr_atomic_xchg32(lock, 1)) {
+        do {
+            apr_atomic_pause();
+        } while (apr_atomic_read32(lock));
+    }
+
+    swapped = (mem->ptr == cmp->ptr && mem->tag == cmp->tag);
+    if (swapped) {
+        mem->ptr = with.ptr;
+        mem->tag = with.tag;
+    }
+    else {
+        cmp->ptr = mem->ptr;
+        cmp->tag = mem->tag;
+    }
+
+    apr_atomic_set32(lock, 0);
+    return swapped;
+}
+
+#if defined(USE_TAGPTR_CMPXCHG16B)
+
+static int have_cmpxchg16b(void)
+{
+    static int cx16 = -1;
+
+    if (cx16 < 0) {
+        unsigned int eax = 1, ebx, ecx, edx;
+
+        asm volatile ("cpuid"
+                      : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+        cx16 = (ecx >> 13) & 1;
+    }
+    return cx16;
+}
+
+static int cas_tagptr_hw(volatile apr_atomic_tagptr_t *mem,
+                         apr_atomic_tagptr_t *cmp,
+                         apr_atomic_tagptr_t with)
+{
+    apr_uint64_t lo = (apr_uintptr_t)cmp->ptr, hi = cmp->tag;
+    unsigned char swapped;
+
+    asm volatile ("lock; cmpxchg16b %1\n\t"
+                  "setz %0"
+                  : "=q" (swapped), "+m" (*mem), "+a" (lo), "+d" (hi)
+                  : "b" ((apr_uint64_t)(apr_uintptr_t)with.ptr),
+                    "c" ((apr_uint64_t)with.tag)
+                  : "memory", "cc");
+    if (!swapped) {
+        cmp->ptr = (void *)(apr_uintptr_t)lo;
+        cmp->tag = hi;
+    }
+    return swapped;
+}
+
+#define HAVE_TAGPTR_HW() have_cmpxchg16b()
+
+#elif defined(USE_TAGPTR_SYNC16)
+
+static int cas_tagptr_hw(volatile apr_atomic_tagptr_t *mem,
+                         apr_atomic_tagptr_t *cmp,
+                         apr_atomic_tagptr_t with)
+{
+    union {
+        apr_atomic_tagptr_t tp;
+        unsigned __int128 u;
+    } w, c, prev;
+
+    w.tp = with;
+    c.tp = *cmp;
+    prev.u = __sync_val_compare_and_swap((volatile unsigned __int128 *)mem,
+                                         c.u, w.u);
+    if (prev.u == c.u) {
+        return 1;
+    }
+    *cmp = prev.tp;
+    return 0;
+}
+
+#define HAVE_TAGPTR_HW() 1
+
+#endif
+
+APR_DECLARE(int) apr_atomic_cas_tagptr(volatile apr_atomic_tagptr_t *mem,
+                                       apr_atomic_tagptr_t *cmp,
+                                       apr_atomic_tagptr_t with)
+{
+#ifdef HAVE_TAGPTR_HW
+    /* The double-width instructions fault on misaligned memory */
+    if (((apr_uintptr_t)mem & (sizeof(*mem) - 1)) == 0 && HAVE_TAGPTR_HW()) {
+        return cas_tagptr_hw(mem, cmp, with);
+    }
+#endif
+    return cas_tagptr_locked(mem, cmp, with);
+}
+
+#endif /* USE_TAGPTR_CAS64 */
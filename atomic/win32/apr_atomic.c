@@ -109,3 +109,68 @@ APR_DECLARE(void*) apr_atomic_xchgptr(void *volatile *mem, void *with)
 {
     return InterlockedExchangePointer(mem, with);
 }
+
+APR_DECLARE(apr_uint32_t) apr_atomic_and32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    return InterlockedAnd((long volatile *)mem, val);
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_or32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    return InterlockedOr((long volatile *)mem, val);
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_xor32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    return InterlockedXor((long volatile *)mem, val);
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_read32_acquire(volatile apr_uint32_t *mem)
+{
+    apr_uint32_t val = *mem;
+
+    MemoryBarrier();
+    return val;
+}
+
+APR_DECLARE(void) apr_atomic_set32_release(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    MemoryBarrier();
+    *mem = val;
+}
+
+APR_DECLARE(void) apr_atomic_fence(void)
+{
+    MemoryBarrier();
+}
+
+APR_DECLARE(void) apr_atomic_pause(void)
+{
+    YieldProcessor();
+}
+
+APR_DECLARE(int) apr_atomic_cas_tagptr(volatile apr_atomic_tagptr_t *mem,
+                                       apr_atomic_tagptr_t *cmp,
+                                       apr_atomic_tagptr_t with)
+{
+#if APR_SIZEOF_VOIDP == 8
+    /* *cmp is updated with the value of *mem in any case */
+    return InterlockedCompareExchange128((volatile LONG64 *)mem,
+                                         (LONG64)with.tag, (LONG64)with.ptr,
+                                         (LONG64 *)cmp);
+#else
+    union {
+        apr_atomic_tagptr_t tp;
+        LONG64 u;
+    } w, c, prev;
+
+    w.tp = with;
+    c.tp = *cmp;
+    prev.u = InterlockedCompareExchange64((volatile LONG64 *)mem, w.u, c.u);
+    if (prev.u == c.u) {
+        return 1;
+    }
+    *cmp = prev.tp;
+    return 0;
+#endif
+}
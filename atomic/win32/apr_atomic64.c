@@ -80,3 +80,32 @@ APR_DECLARE(apr_uint64_t) apr_atomic_xchg64(volatile apr_uint64_t *mem, apr_uint
 {
     return InterlockedExchange64((volatile LONG64 *)mem, val);
 }
+
+APR_DECLARE(apr_uint64_t) apr_atomic_and64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return InterlockedAnd64((volatile LONG64 *)mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_or64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return InterlockedOr64((volatile LONG64 *)mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_xor64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return InterlockedXor64((volatile LONG64 *)mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_read64_acquire(volatile apr_uint64_t *mem)
+{
+    apr_uint64_t val = apr_atomic_read64(mem);
+
+    MemoryBarrier();
+    return val;
+}
+
+APR_DECLARE(void) apr_atomic_set64_release(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    MemoryBarrier();
+    apr_atomic_set64(mem, val);
+}
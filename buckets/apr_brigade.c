@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include "apr_private.h"
+
 #include "apr.h"
 #include "apr_lib.h"
 #include "apr_strings.h"
@@ -29,6 +31,20 @@
 #include <sys/uio.h>
 #endif
 
+#ifdef HAVE_SPLICE
+#include "apr_portable.h"
+#include "apr_support.h"
+#if APR_HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#if APR_HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#if APR_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#endif
+
 static apr_status_t brigade_cleanup(void *data)
 {
     return apr_brigade_cleanup(data);
@@ -58,6 +74,10 @@ APR_DECLARE(apr_status_t) apr_brigade_cleanup(void *data)
     }
 #endif
 
+    if (b->length_tracked) {
+        b->length = 0;
+    }
+
     /* We don't need to free(bb) because it's allocated from a pool. */
     return APR_SUCCESS;
 }
@@ -90,6 +110,8 @@ APR_DECLARE(apr_bucket_brigade *) apr_brigade_create(apr_pool_t *p,
     b = apr_palloc(p, sizeof(*b));
     b->p = p;
     b->bucket_alloc = list;
+    b->length = -1;
+    b->length_tracked = 0;
 
     APR_RING_INIT(&b->list, apr_bucket, link);
 
@@ -114,6 +136,25 @@ APR_DECLARE(apr_bucket_brigade *) apr_brigade_split_ex(apr_bucket_brigade *b,
      */
     if (e != APR_BRIGADE_SENTINEL(b)) {
         f = APR_RING_LAST(&b->list);
+        if (b->length >= 0 || a->length >= 0) {
+            /* Either tracks its length, what is moved is known */
+            apr_off_t moved = 0;
+            apr_bucket *g;
+
+            for (g = e; g != APR_BRIGADE_SENTINEL(b); g = APR_BUCKET_NEXT(g)) {
+                if (g->length == (apr_size_t)(-1)) {
+                    moved = -1;
+                    break;
+                }
+                moved += g->length;
+            }
+            if (b->length >= 0) {
+                b->length -= moved;
+            }
+            if (a->length >= 0) {
+                a->length = moved;
+            }
+        }
         APR_RING_UNSPLICE(e, f, link);
         APR_RING_SPLICE_HEAD(&a->list, e, f, apr_bucket, link);
     }
@@ -223,6 +264,11 @@ APR_DECLARE(apr_status_t) apr_brigade_length(apr_bucket_brigade *bb,
     apr_bucket *bkt;
     apr_status_t status = APR_SUCCESS;
 
+    if (bb->length >= 0) {
+        *length = bb->length;
+        return APR_SUCCESS;
+    }
+
     for (bkt = APR_BRIGADE_FIRST(bb);
          bkt != APR_BRIGADE_SENTINEL(bb);
          bkt = APR_BUCKET_NEXT(bkt))
@@ -245,10 +291,24 @@ APR_DECLARE(apr_status_t) apr_brigade_length(apr_bucket_brigade *bb,
         total += bkt->length;
     }
 
+    if (bb->length_tracked && status == APR_SUCCESS && total >= 0) {
+        bb->length = total;
+    }
     *length = total;
     return status;
 }
 
+APR_DECLARE(void) apr_brigade_length_track(apr_bucket_brigade *bb, int on)
+{
+    bb->length_tracked = on;
+    bb->length = -1;
+    if (on) {
+        apr_off_t ignore;
+
+        apr_brigade_length(bb, 0, &ignore);
+    }
+}
+
 APR_DECLARE(apr_status_t) apr_brigade_flatten(apr_bucket_brigade *bb,
                                               char *c, apr_size_t *len)
 {
@@ -330,6 +390,64 @@ APR_DECLARE(apr_status_t) apr_brigade_pflatten(apr_bucket_brigade *bb,
     return APR_SUCCESS;
 }
 
+APR_DECLARE(apr_status_t) apr_brigade_peek_contiguous(apr_bucket_brigade *bb,
+                                                      const char **data,
+                                                      apr_size_t *len,
+                                                      apr_pool_t *pool)
+{
+    const char *start = NULL;
+    apr_size_t total = 0;
+    apr_bucket *b;
+    char *c;
+    apr_status_t rv;
+
+    for (b = APR_BRIGADE_FIRST(bb);
+         b != APR_BRIGADE_SENTINEL(bb);
+         b = APR_BUCKET_NEXT(b))
+    {
+        const char *str;
+        apr_size_t str_len;
+
+        rv = apr_bucket_read(b, &str, &str_len, APR_BLOCK_READ);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        if (!str_len) {
+            continue;
+        }
+
+        if (!start) {
+            start = str;
+            total = str_len;
+        }
+        else if (str == start + total) {
+            /* Adjacent data, e.g. buckets split from the same one */
+            total += str_len;
+        }
+        else {
+            break;
+        }
+    }
+
+    if (b == APR_BRIGADE_SENTINEL(bb)) {
+        *data = start ? start : "";
+        *len = total;
+        return APR_SUCCESS;
+    }
+    if (!pool) {
+        return APR_INCOMPLETE;
+    }
+
+    rv = apr_brigade_pflatten(bb, &c, &total, pool);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    *data = c;
+    *len = total;
+    return APR_SUCCESS;
+}
+
 APR_DECLARE(apr_status_t) apr_brigade_split_line(apr_bucket_brigade *bbOut,
                                                  apr_bucket_brigade *bbIn,
                                                  apr_read_type_e block,
@@ -338,6 +456,8 @@ APR_DECLARE(apr_status_t) apr_brigade_split_line(apr_bucket_brigade *bbOut,
     apr_off_t readbytes = 0;
     apr_bucket *prev = NULL;
 
+    APR_BRIGADE_LENGTH_INVALIDATE(bbIn);
+
     while (!APR_BRIGADE_EMPTY(bbIn)) {
         const char *pos;
         const char *str;
@@ -415,6 +535,25 @@ memmem(const void *_hay, size_t hay_len, const void *needle, size_t needle_len)
 }
 #endif
 
+/*
+ * Find the first offset from off where the data up to len is the start of
+ * the boundary, or len if none.  Only the offsets of the first byte of the
+ * boundary are compared, found with memchr() (vectorized in most libcs).
+ */
+static apr_size_t find_partial_boundary(const char *str, apr_size_t off,
+                                        apr_size_t len, const char *boundary)
+{
+    const char *pos = str + off, *end = str + len;
+
+    while (pos < end && (pos = memchr(pos, boundary[0], end - pos))) {
+        if (!memcmp(pos, boundary, end - pos)) {
+            return pos - str;
+        }
+        pos++;
+    }
+    return len;
+}
+
 APR_DECLARE(apr_status_t) apr_brigade_split_boundary(apr_bucket_brigade *bbOut,
                                                      apr_bucket_brigade *bbIn,
                                                      apr_read_type_e block,
@@ -433,6 +572,8 @@ APR_DECLARE(apr_status_t) apr_brigade_split_boundary(apr_bucket_brigade *bbOut,
         boundary_len = strlen(boundary);
     }
 
+    APR_BRIGADE_LENGTH_INVALIDATE(bbIn);
+
     /*
      * While the call describes itself as searching for a boundary string,
      * what we actually do is search for anything that is definitely not
@@ -479,7 +620,6 @@ APR_DECLARE(apr_status_t) apr_brigade_split_boundary(apr_bucket_brigade *bbOut,
         if ((len - ignore) >= boundary_len) {
 
             apr_size_t off;
-            apr_size_t leftover;
 
             pos = memmem(str + ignore, len - ignore, boundary, boundary_len);
 
@@ -506,29 +646,24 @@ APR_DECLARE(apr_status_t) apr_brigade_split_boundary(apr_bucket_brigade *bbOut,
             }
 
             /* any partial matches at the end? */
-            leftover = boundary_len - 1;
-            off = (len - leftover);
+            off = find_partial_boundary(str, len - (boundary_len - 1), len,
+                                        boundary);
+            if (off < len) {
 
-            while (leftover) {
-                if (!memcmp(str + off, boundary, leftover)) {
-
-                    if (off) {
+                if (off) {
 
-                        apr_bucket_split(e, off);
-                        APR_BUCKET_REMOVE(e);
-                        APR_BRIGADE_INSERT_TAIL(bbOut, e);
-                        ignore = 0;
+                    apr_bucket_split(e, off);
+                    APR_BUCKET_REMOVE(e);
+                    APR_BRIGADE_INSERT_TAIL(bbOut, e);
+                    ignore = 0;
 
-                        e = APR_BRIGADE_FIRST(bbIn);
-                    }
+                    e = APR_BRIGADE_FIRST(bbIn);
+                }
 
-                    outbytes += off;
-                    inbytes -= off;
+                outbytes += off;
+                inbytes -= off;
 
-                    goto skip;
-                }
-                off++;
-                leftover--;
+                goto skip;
             }
 
             APR_BUCKET_REMOVE(e);
@@ -549,39 +684,34 @@ APR_DECLARE(apr_status_t) apr_brigade_split_boundary(apr_bucket_brigade *bbOut,
          */
         else {
 
-            apr_size_t off = ignore;
-
-            len -= ignore;
+            apr_size_t off;
 
             /* find all definite non matches */
-            while (len) {
-                if (!memcmp(str + off, boundary, len)) {
+            off = find_partial_boundary(str, ignore, len, boundary);
+            if (off < len) {
 
-                    if (off) {
+                if (off) {
 
-                        apr_bucket_split(e, off);
-                        APR_BUCKET_REMOVE(e);
-                        APR_BRIGADE_INSERT_TAIL(bbOut, e);
-                        ignore = 0;
+                    apr_bucket_split(e, off);
+                    APR_BUCKET_REMOVE(e);
+                    APR_BRIGADE_INSERT_TAIL(bbOut, e);
+                    ignore = 0;
 
-                        outbytes += off;
+                    outbytes += off;
 
-                        e = APR_BRIGADE_FIRST(bbIn);
-                    }
+                    e = APR_BRIGADE_FIRST(bbIn);
+                }
 
-                    inbytes -= off;
+                inbytes -= off;
 
-                    goto skip;
-                }
-                off++;
-                len--;
+                goto skip;
             }
 
             APR_BUCKET_REMOVE(e);
             APR_BRIGADE_INSERT_TAIL(bbOut, e);
             ignore = 0;
 
-            outbytes += off;
+            outbytes += len;
 
             continue;
 
@@ -686,6 +816,144 @@ skip:
     return APR_INCOMPLETE;
 }
 
+APR_DECLARE(apr_status_t) apr_brigade_find(apr_bucket_brigade *bb,
+                                           const apr_strmatch_pattern *pattern,
+                                           apr_read_type_e block,
+                                           apr_bucket **bucket,
+                                           apr_size_t *offset)
+{
+    apr_strmatch_stream_t stream;
+    apr_bucket *e;
+    char *buf = NULL;
+    apr_status_t rv = APR_NOTFOUND;
+
+    if (pattern->length == 0) {
+        return APR_EINVAL;
+    }
+    if (pattern->length > 1) {
+        buf = apr_bucket_alloc(APR_STRMATCH_STREAM_BUFSIZE(pattern),
+                               bb->bucket_alloc);
+    }
+    apr_strmatch_stream_init(&stream, pattern, buf);
+
+    for (e = APR_BRIGADE_FIRST(bb);
+         e != APR_BRIGADE_SENTINEL(bb);
+         e = APR_BUCKET_NEXT(e)) {
+        const char *str;
+        apr_size_t len, used;
+        apr_off_t match, start;
+
+        if (APR_BUCKET_IS_METADATA(e)) {
+            continue;
+        }
+
+        rv = apr_bucket_read(e, &str, &len, block);
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+
+        rv = apr_strmatch_stream(&stream, str, len, &match, &used);
+        if (rv == APR_SUCCESS) {
+            /* The match may start in the previous buckets, all read */
+            start = stream.offset - used;
+            while (match < start) {
+                e = APR_BUCKET_PREV(e);
+                start -= e->length;
+            }
+            *bucket = e;
+            *offset = (apr_size_t)(match - start);
+            break;
+        }
+    }
+
+    if (buf) {
+        apr_bucket_free(buf);
+    }
+    return rv;
+}
+
+/* Put the result of a chunk before e, in a heap bucket */
+static apr_status_t brigade_encode_chunk(apr_bucket_brigade *bb,
+                                         apr_bucket *e,
+                                         apr_encode_stream_t *st,
+                                         const char *str, apr_size_t len,
+                                         int final)
+{
+    apr_bucket *h;
+    apr_size_t size;
+    apr_status_t rv;
+    char *buf;
+
+    if (final) {
+        apr_encode_stream_final(st, NULL, &size);
+    }
+    else {
+        apr_encode_stream(st, NULL, str, len, &size);
+    }
+    buf = apr_bucket_alloc(size ? size : 1, bb->bucket_alloc);
+
+    if (final) {
+        rv = apr_encode_stream_final(st, buf, &size);
+    }
+    else {
+        rv = apr_encode_stream(st, buf, str, len, &size);
+    }
+
+    if (size) {
+        h = apr_bucket_heap_create(buf, size, apr_bucket_free,
+                                   bb->bucket_alloc);
+        APR_BUCKET_INSERT_BEFORE(e, h);
+    }
+    else {
+        apr_bucket_free(buf);
+    }
+    return rv;
+}
+
+APR_DECLARE(apr_status_t) apr_brigade_encode(apr_bucket_brigade *bb,
+                                             apr_encode_stream_t *st)
+{
+    apr_bucket *e, *next;
+    apr_status_t rv = APR_SUCCESS;
+
+    APR_BRIGADE_LENGTH_INVALIDATE(bb);
+
+    for (e = APR_BRIGADE_FIRST(bb);
+         e != APR_BRIGADE_SENTINEL(bb);
+         e = next) {
+        const char *str;
+        apr_size_t len;
+
+        if (APR_BUCKET_IS_EOS(e)) {
+            next = APR_BUCKET_NEXT(e);
+            rv = brigade_encode_chunk(bb, e, st, NULL, 0, 1);
+            if (rv != APR_SUCCESS) {
+                break;
+            }
+            continue;
+        }
+        if (APR_BUCKET_IS_METADATA(e)) {
+            next = APR_BUCKET_NEXT(e);
+            continue;
+        }
+
+        rv = apr_bucket_read(e, &str, &len, APR_BLOCK_READ);
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+        /* the read may have split the rest of the data off e */
+        next = APR_BUCKET_NEXT(e);
+
+        rv = brigade_encode_chunk(bb, e, st, str, len, 0);
+        apr_bucket_delete(e);
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+    }
+
+    return rv;
+}
+
 
 APR_DECLARE(apr_status_t) apr_brigade_to_iovec(apr_bucket_brigade *b,
                                                struct iovec *vec, int *nvec)
@@ -719,6 +987,349 @@ APR_DECLARE(apr_status_t) apr_brigade_to_iovec(apr_bucket_brigade *b,
     return APR_SUCCESS;
 }
 
+/* Delete the buckets of the first len bytes (and the metadata buckets
+ * after them), splitting the bucket written partly.
+ */
+static apr_status_t brigade_consume(apr_bucket_brigade *bb, apr_size_t len)
+{
+    apr_bucket *e;
+    apr_status_t rv;
+
+    while (!APR_BRIGADE_EMPTY(bb)) {
+        e = APR_BRIGADE_FIRST(bb);
+        if (e->length) {
+            if (!len) {
+                break;
+            }
+            if (e->length > len) {
+                rv = apr_bucket_split(e, len);
+                if (rv != APR_SUCCESS) {
+                    return rv;
+                }
+            }
+            len -= e->length;
+        }
+        apr_bucket_delete(e);
+    }
+    return APR_SUCCESS;
+}
+
+#ifdef HAVE_SPLICE
+
+/* The most spliced at once from a pipe bucket, and through the pipe
+ * between the sockets (its usual capacity) for a socket bucket.
+ */
+#define SPLICE_PIPE_CHUNK   (1024 * 1024)
+#define SPLICE_SOCKET_CHUNK (64 * 1024)
+
+/* Wait for f or s, with its timeout (APR_EAGAIN if none) */
+static apr_status_t splice_wait(apr_file_t *f, apr_socket_t *s, int for_read)
+{
+    apr_interval_time_t timeout;
+    apr_status_t rv;
+
+    rv = apr_wait_for_io_or_timeout(f, s, for_read);
+    if (APR_STATUS_IS_TIMEUP(rv)) {
+        if (f) {
+            apr_file_pipe_timeout_get(f, &timeout);
+        }
+        else {
+            apr_socket_timeout_get(s, &timeout);
+        }
+        if (!timeout) {
+            rv = APR_EAGAIN;
+        }
+    }
+    return rv;
+}
+
+/* splice() up to len bytes from in to out, waiting for the infile/insock
+ * and outsock ends (when given) if they are not ready.
+ */
+static apr_status_t splice_once(int in, apr_file_t *infile,
+                                apr_socket_t *insock, int out,
+                                apr_socket_t *outsock, apr_size_t len,
+                                apr_size_t *spliced)
+{
+    apr_status_t rv;
+    ssize_t n;
+
+    for (;;) {
+        n = splice(in, NULL, out, NULL, len, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n >= 0) {
+            *spliced = n;
+            return n ? APR_SUCCESS : APR_EOF;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            return errno;
+        }
+        /* Either end may be the one not ready */
+        if (infile || insock) {
+            rv = splice_wait(infile, insock, 1);
+            if (rv != APR_SUCCESS) {
+                return rv;
+            }
+        }
+        if (outsock) {
+            rv = splice_wait(NULL, outsock, 0);
+            if (rv != APR_SUCCESS) {
+                return rv;
+            }
+        }
+    }
+}
+
+/* Put the len bytes left in the pipe back in the brigade, before e */
+static apr_status_t splice_setaside(apr_bucket *e, int in, apr_size_t len)
+{
+    char *buf = apr_bucket_alloc(len, e->list);
+    apr_size_t off = 0;
+    ssize_t n;
+
+    while (off < len) {
+        n = read(in, buf + off, len - off);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            apr_bucket_free(buf);
+            return n < 0 ? errno : APR_EOF;
+        }
+        off += n;
+    }
+    APR_BUCKET_INSERT_BEFORE(e, apr_bucket_heap_create(buf, len,
+                                                       apr_bucket_free,
+                                                       e->list));
+    return APR_SUCCESS;
+}
+
+/* Write the pipe or socket bucket e to sock until its end (deleting the
+ * bucket), without reading the data.  The pipe between the sockets in
+ * fds is created on first use.  APR_ENOTIMPL if nothing could be spliced.
+ */
+static apr_status_t splice_bucket(apr_bucket *e, apr_socket_t *sock, int *fds)
+{
+    apr_os_sock_t out;
+    apr_size_t n, m;
+    apr_status_t rv, srv;
+    int first = 1;
+
+    apr_os_sock_get(&out, sock);
+
+    if (APR_BUCKET_IS_PIPE(e)) {
+        apr_file_t *f = e->data;
+        apr_os_file_t in;
+
+        apr_os_file_get(&in, f);
+        for (;;) {
+            rv = splice_once(in, f, NULL, out, sock, SPLICE_PIPE_CHUNK, &n);
+            if (rv != APR_SUCCESS) {
+                break;
+            }
+            first = 0;
+        }
+        if (rv == APR_EOF) {
+            apr_file_close(f);
+        }
+    }
+    else {
+        apr_socket_t *s = e->data;
+        apr_os_sock_t in;
+
+        if (fds[0] < 0 && pipe(fds) < 0) {
+            fds[0] = fds[1] = -1;
+            return APR_ENOTIMPL;
+        }
+        apr_os_sock_get(&in, s);
+        for (;;) {
+            rv = splice_once(in, NULL, s, fds[1], NULL, SPLICE_SOCKET_CHUNK,
+                             &n);
+            if (rv != APR_SUCCESS) {
+                break;
+            }
+            first = 0;
+            while (n) {
+                rv = splice_once(fds[0], NULL, NULL, out, sock, n, &m);
+                if (rv != APR_SUCCESS) {
+                    /* Keep what was not written */
+                    srv = splice_setaside(e, fds[0], n);
+                    return srv != APR_SUCCESS ? srv : rv;
+                }
+                n -= m;
+            }
+        }
+    }
+
+    if (rv == APR_EOF) {
+        apr_bucket_delete(e);
+        return APR_SUCCESS;
+    }
+    if (first && (rv == EINVAL || rv == ENOSYS)) {
+        /* Not supported by the descriptors */
+        return APR_ENOTIMPL;
+    }
+    return rv;
+}
+
+#endif /* HAVE_SPLICE */
+
+APR_DECLARE(apr_status_t) apr_brigade_write_socket(apr_bucket_brigade *bb,
+                                                   apr_socket_t *sock,
+                                                   apr_int32_t flags)
+{
+    struct iovec vec[APR_MAX_IOVEC_SIZE];
+    apr_status_t rv = APR_SUCCESS, arv, rrv;
+    apr_int32_t corked = 0;
+#ifdef HAVE_SPLICE
+    int fds[2] = { -1, -1 };
+    int nosplice = !(flags & APR_BRIGADE_WRITE_SPLICE);
+#endif
+
+    apr_socket_opt_get(sock, APR_TCP_NOPUSH, &corked);
+
+    /* The buckets are deleted, split and set aside in place */
+    APR_BRIGADE_LENGTH_INVALIDATE(bb);
+
+    while (!APR_BRIGADE_EMPTY(bb)) {
+        apr_bucket *e, *fe = NULL, *se = NULL;
+        apr_size_t written = 0;
+        int nvec = 0, nhdr = 0;
+
+        rrv = APR_SUCCESS;
+
+        /* The memory buckets up to the second file bucket */
+        for (e = APR_BRIGADE_FIRST(bb);
+             e != APR_BRIGADE_SENTINEL(bb) && nvec < APR_MAX_IOVEC_SIZE;
+             e = APR_BUCKET_NEXT(e))
+        {
+            const char *str;
+            apr_size_t len;
+
+#ifdef HAVE_SPLICE
+            if (!nosplice && (APR_BUCKET_IS_PIPE(e)
+                              || APR_BUCKET_IS_SOCKET(e))) {
+                if (!nvec && !fe) {
+                    se = e;
+                }
+                break;
+            }
+#endif
+#if APR_HAS_SENDFILE
+            if (APR_BUCKET_IS_FILE(e) && e->length
+                && (apr_file_flags_get(((apr_bucket_file *)e->data)->fd)
+                    & APR_FOPEN_SENDFILE_ENABLED)) {
+                if (fe) {
+                    break;
+                }
+                fe = e;
+                nhdr = nvec;
+                continue;
+            }
+#endif
+            rrv = apr_bucket_read(e, &str, &len, APR_BLOCK_READ);
+            if (rrv != APR_SUCCESS) {
+                /* Write what was read first */
+                break;
+            }
+            if (len) {
+                vec[nvec].iov_base = (void *)str;
+                vec[nvec].iov_len = len;
+                nvec++;
+            }
+        }
+#ifdef HAVE_SPLICE
+        if (se) {
+            /* The metadata first */
+            rv = brigade_consume(bb, 0);
+            if (rv == APR_SUCCESS) {
+                if (!corked && apr_socket_opt_set(sock, APR_TCP_NOPUSH,
+                                                  1) == APR_SUCCESS) {
+                    corked = 1;
+                }
+                rv = splice_bucket(se, sock, fds);
+                if (rv == APR_ENOTIMPL) {
+                    /* Read it then */
+                    nosplice = 1;
+                    rv = APR_SUCCESS;
+                }
+            }
+            if (rv != APR_SUCCESS) {
+                break;
+            }
+            continue;
+        }
+#endif
+        if (!nvec && !fe) {
+            /* Nothing but metadata (or a read error) */
+            rv = brigade_consume(bb, 0);
+            if (rrv != APR_SUCCESS) {
+                rv = rrv;
+            }
+            break;
+        }
+
+        if (!corked && (e != APR_BRIGADE_SENTINEL(bb) || (fe && nvec)
+                        || (flags & APR_BRIGADE_WRITE_MORE))) {
+            /* More writes to come */
+            if (apr_socket_opt_set(sock, APR_TCP_NOPUSH, 1) == APR_SUCCESS) {
+                corked = 1;
+            }
+        }
+
+#if APR_HAS_SENDFILE
+        if (fe && !corked && nhdr) {
+            /* Not corked (e.g. not TCP), apr_socket_sendfile() would fail
+             * to cork for the headers and trailers, send them apart.
+             */
+            rv = apr_socket_sendv(sock, vec, nhdr, &written);
+        }
+        else if (fe) {
+            apr_bucket_file *f = fe->data;
+            apr_hdtr_t hdtr;
+            apr_off_t offset = fe->start;
+
+            hdtr.headers = vec;
+            hdtr.numheaders = nhdr;
+            hdtr.trailers = vec + nhdr;
+            hdtr.numtrailers = corked ? nvec - nhdr : 0;
+            written = fe->length;
+            rv = apr_socket_sendfile(sock, f->fd, &hdtr, &offset, &written,
+                                     0);
+        }
+        else
+#endif
+        {
+            rv = apr_socket_sendv(sock, vec, nvec, &written);
+        }
+
+        arv = brigade_consume(bb, written);
+        if (rv == APR_SUCCESS) {
+            rv = arv != APR_SUCCESS ? arv : rrv;
+        }
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+    }
+
+#ifdef HAVE_SPLICE
+    if (fds[0] >= 0) {
+        close(fds[0]);
+        close(fds[1]);
+    }
+#endif
+
+    if (corked && !(flags & APR_BRIGADE_WRITE_MORE)) {
+        arv = apr_socket_opt_set(sock, APR_TCP_NOPUSH, 0);
+        if (rv == APR_SUCCESS) {
+            rv = arv;
+        }
+    }
+    return rv;
+}
+
 APR_DECLARE(apr_status_t) apr_brigade_vputstrs(apr_bucket_brigade *b,
                                                apr_brigade_flush flush,
                                                void *ctx,
@@ -802,18 +1413,19 @@ APR_DECLARE(apr_status_t) apr_brigade_write(apr_bucket_brigade *b,
         buf = apr_bucket_alloc(APR_BUCKET_BUFF_SIZE, b->bucket_alloc);
         e = apr_bucket_heap_create(buf, APR_BUCKET_BUFF_SIZE,
                                    apr_bucket_free, b->bucket_alloc);
-        APR_BRIGADE_INSERT_TAIL(b, e);
         e->length = 0;   /* We are writing into the brigade, and
                           * allocating more memory than we need.  This
                           * ensures that the bucket thinks it is empty just
                           * after we create it.  We'll fix the length
                           * once we put data in it below.
                           */
+        APR_BRIGADE_INSERT_TAIL(b, e);
     }
 
     /* there is a sufficiently big buffer bucket available now */
     memcpy(buf, str, nbyte);
     e->length += nbyte;
+    APR_BRIGADE_LENGTH_ADD(b, nbyte);
 
     return APR_SUCCESS;
 }
@@ -883,6 +1495,7 @@ APR_DECLARE(apr_status_t) apr_brigade_writev(apr_bucket_brigade *b,
                 buf += len;
             }
             e->length += total_len;
+            APR_BRIGADE_LENGTH_ADD(b, total_len);
             return APR_SUCCESS;
         }
         else {
@@ -902,6 +1515,7 @@ APR_DECLARE(apr_status_t) apr_brigade_writev(apr_bucket_brigade *b,
                 remaining -= len;
             }
             e->length += (buf - start_buf);
+            APR_BRIGADE_LENGTH_ADD(b, buf - start_buf);
             total_len -= (buf - start_buf);
 
             if (flush) {
@@ -1034,6 +1648,210 @@ APR_DECLARE(apr_status_t) apr_brigade_vprintf(apr_bucket_brigade *b,
     return apr_brigade_write(b, flush, ctx, buf, vd.vbuff.curpos - buf);
 }
 
+struct apr_brigade_writer_t {
+    apr_bucket_brigade *bb;
+    apr_brigade_flush flush;
+    void *ctx;
+    char *buf;      /* the buffer, allocated on demand */
+    apr_size_t len; /* the data in the buffer */
+    apr_size_t size;
+};
+
+static apr_status_t writer_cleanup(void *data)
+{
+    apr_brigade_writer_t *w = data;
+
+    if (w->buf) {
+        apr_bucket_free(w->buf);
+        w->buf = NULL;
+    }
+    return APR_SUCCESS;
+}
+
+/* Append the buffer to the brigade, and flush if asked to then */
+static apr_status_t writer_commit(apr_brigade_writer_t *w, int flush)
+{
+    if (w->buf) {
+        if (w->len) {
+            apr_bucket *e = apr_bucket_heap_create(w->buf, w->len,
+                                                   apr_bucket_free,
+                                                   w->bb->bucket_alloc);
+            /* For the writes to the brigade to use the rest */
+            ((apr_bucket_heap *)e->data)->alloc_len = w->size;
+            APR_BRIGADE_INSERT_TAIL(w->bb, e);
+        }
+        else {
+            apr_bucket_free(w->buf);
+        }
+        w->buf = NULL;
+        w->len = 0;
+    }
+    if (flush && w->flush) {
+        return w->flush(w->bb, w->ctx);
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t writer_alloc(apr_brigade_writer_t *w)
+{
+    w->buf = apr_bucket_alloc(w->size, w->bb->bucket_alloc);
+    if (!w->buf) {
+        return APR_ENOMEM;
+    }
+    w->len = 0;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_brigade_writer_create(apr_brigade_writer_t **w,
+                                                    apr_bucket_brigade *bb,
+                                                    apr_size_t size,
+                                                    apr_brigade_flush flush,
+                                                    void *ctx)
+{
+    apr_brigade_writer_t *nw = apr_pcalloc(bb->p, sizeof(*nw));
+
+    nw->bb = bb;
+    nw->flush = flush;
+    nw->ctx = ctx;
+    nw->size = size ? size : APR_BUCKET_BUFF_SIZE;
+    apr_pool_cleanup_register(bb->p, nw, writer_cleanup,
+                              apr_pool_cleanup_null);
+
+    *w = nw;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_brigade_writer_write(apr_brigade_writer_t *w,
+                                                   const char *str,
+                                                   apr_size_t nbyte)
+{
+    apr_status_t rv;
+
+    if (w->buf && nbyte <= w->size - w->len) {
+        memcpy(w->buf + w->len, str, nbyte);
+        w->len += nbyte;
+        return APR_SUCCESS;
+    }
+
+    if (nbyte >= w->size) {
+        /* Not coalesced */
+        apr_bucket *e;
+
+        writer_commit(w, 0);
+        if (w->flush) {
+            e = apr_bucket_transient_create(str, nbyte, w->bb->bucket_alloc);
+            APR_BRIGADE_INSERT_TAIL(w->bb, e);
+            return w->flush(w->bb, w->ctx);
+        }
+        e = apr_bucket_heap_create(str, nbyte, NULL, w->bb->bucket_alloc);
+        APR_BRIGADE_INSERT_TAIL(w->bb, e);
+        return APR_SUCCESS;
+    }
+
+    if (w->buf) {
+        /* Fill the buffer first */
+        apr_size_t room = w->size - w->len;
+
+        memcpy(w->buf + w->len, str, room);
+        w->len += room;
+        str += room;
+        nbyte -= room;
+        rv = writer_commit(w, 1);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+    }
+    if ((rv = writer_alloc(w)) != APR_SUCCESS) {
+        return rv;
+    }
+    memcpy(w->buf, str, nbyte);
+    w->len = nbyte;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_brigade_writer_puts(apr_brigade_writer_t *w,
+                                                  const char *str)
+{
+    return apr_brigade_writer_write(w, str, strlen(str));
+}
+
+APR_DECLARE(apr_status_t) apr_brigade_writer_putc(apr_brigade_writer_t *w,
+                                                  const char c)
+{
+    if (w->buf && w->len < w->size) {
+        w->buf[w->len++] = c;
+        return APR_SUCCESS;
+    }
+    return apr_brigade_writer_write(w, &c, 1);
+}
+
+struct writer_vprintf_data_t {
+    apr_vformatter_buff_t vbuff;
+    apr_brigade_writer_t *w;
+    apr_status_t rv;
+};
+
+static int writer_vprintf_flush(apr_vformatter_buff_t *buff)
+{
+    struct writer_vprintf_data_t *vd = (struct writer_vprintf_data_t *)buff;
+    apr_brigade_writer_t *w = vd->w;
+
+    /* The buffer is full */
+    w->len = w->size;
+    if ((vd->rv = writer_commit(w, 1)) != APR_SUCCESS
+        || (vd->rv = writer_alloc(w)) != APR_SUCCESS) {
+        return -1;
+    }
+    vd->vbuff.curpos = w->buf;
+    vd->vbuff.endpos = w->buf + w->size;
+    return 0;
+}
+
+APR_DECLARE(apr_status_t) apr_brigade_writer_vprintf(apr_brigade_writer_t *w,
+                                                     const char *fmt,
+                                                     va_list va)
+{
+    struct writer_vprintf_data_t vd;
+    apr_status_t rv;
+    int written;
+
+    if (!w->buf && (rv = writer_alloc(w)) != APR_SUCCESS) {
+        return rv;
+    }
+    vd.vbuff.curpos = w->buf + w->len;
+    vd.vbuff.endpos = w->buf + w->size;
+    vd.w = w;
+    vd.rv = APR_SUCCESS;
+
+    written = apr_vformatter(writer_vprintf_flush, &vd.vbuff, fmt, va);
+    if (w->buf) {
+        w->len = vd.vbuff.curpos - w->buf;
+    }
+
+    if (written == -1) {
+        return vd.rv != APR_SUCCESS ? vd.rv : APR_EGENERAL;
+    }
+    return APR_SUCCESS;
+}
+
+APR_DECLARE_NONSTD(apr_status_t) apr_brigade_writer_printf(
+                                                      apr_brigade_writer_t *w,
+                                                      const char *fmt, ...)
+{
+    va_list ap;
+    apr_status_t rv;
+
+    va_start(ap, fmt);
+    rv = apr_brigade_writer_vprintf(w, fmt, ap);
+    va_end(ap);
+    return rv;
+}
+
+APR_DECLARE(apr_status_t) apr_brigade_writer_flush(apr_brigade_writer_t *w)
+{
+    return writer_commit(w, 1);
+}
+
 /* A "safe" maximum bucket size, 1Gb */
 #define MAX_BUCKET_SIZE (0x40000000)
 
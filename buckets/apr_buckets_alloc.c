@@ -19,6 +19,10 @@
 #include "apr_buckets.h"
 #include "apr_allocator.h"
 #include "apr_support.h"
+#if APR_HAS_THREADS
+#include "apr_atomic.h"
+#include "apr_portable.h"
+#endif
 
 #define ALLOC_AMT (8192 - APR_MEMNODE_T_SIZE)
 
@@ -32,16 +36,103 @@ typedef struct node_header_t {
 #define SIZEOF_NODE_HEADER_T  APR_ALIGN_DEFAULT(sizeof(node_header_t))
 #define SMALL_NODE_SIZE       (APR_BUCKET_ALLOC_SIZE + SIZEOF_NODE_HEADER_T)
 
+/*
+ * The nodes are served by size classes, each with its free list.  The
+ * nodes of the carved classes are cut from the blocks, like the buckets
+ * (SMALL_NODE_SIZE), and kept until the allocator is destroyed.  Those of
+ * the larger classes are memnodes of the allocator's sizes (8K to 64K),
+ * the ones freed being kept up to the max_free of their class, such that
+ * the heap buckets (APR_BUCKET_BUFF_SIZE) do not go back and forth to the
+ * (possibly mutex protected) allocator.  Larger nodes are not kept.
+ */
+#define CARVED_CLASSES        3
+#define MEMNODE_CLASSES       4
+#define NUM_CLASSES           (CARVED_CLASSES + MEMNODE_CLASSES)
+#define MEMNODE_CLASS_MIN     8192
+#define MEMNODE_CLASS_SIZE(i) ((MEMNODE_CLASS_MIN << ((i) - CARVED_CLASSES)) \
+                               - APR_MEMNODE_T_SIZE)
+
+/* Up to 64K per memnode class by default */
+#define DEFAULT_MAX_FREE(i)   ((8 * MEMNODE_CLASS_MIN) / (MEMNODE_CLASS_SIZE(i) \
+                                                     + APR_MEMNODE_T_SIZE))
+
+typedef struct node_class_t {
+    node_header_t *freelist;
+    apr_size_t size;
+    apr_size_t nfree;
+    apr_size_t max_free;
+    apr_uint64_t nalloc;
+    apr_uint64_t nreuse;
+} node_class_t;
+
 /** A list of free memory from which new buckets or private bucket
  *  structures can be allocated.
  */
 struct apr_bucket_alloc_t {
     apr_pool_t *pool;
     apr_allocator_t *allocator;
-    node_header_t *freelist;
     apr_memnode_t *blocks;
+    node_class_t classes[NUM_CLASSES];
+    apr_uint64_t nalloc_large;
+#if APR_HAS_THREADS
+    /* The nodes freed by other threads than the owner, if any */
+    apr_os_thread_t owner;
+    int owned;
+    void *volatile remote;
+#endif
 };
 
+/* The smallest class of nodes of (at least) size, or NUM_CLASSES */
+static APR_INLINE int node_class(const apr_bucket_alloc_t *list,
+                                 apr_size_t size)
+{
+    int i;
+
+    for (i = 0; i < NUM_CLASSES; i++) {
+        if (size <= list->classes[i].size) {
+            break;
+        }
+    }
+    return i;
+}
+
+static void node_free(apr_bucket_alloc_t *list, node_header_t *node);
+
+#if APR_HAS_THREADS
+/* Take back the nodes freed by the other threads */
+static void drain_remote(apr_bucket_alloc_t *list)
+{
+    node_header_t *node, *next;
+
+    node = apr_atomic_xchgptr((void *volatile *)&list->remote, NULL);
+    while (node) {
+        next = node->next;
+        node_free(list, node);
+        node = next;
+    }
+}
+#else
+#define drain_remote(list)
+#endif
+
+/* Give back the memnodes kept by the memnode classes */
+static void free_memnode_classes(apr_bucket_alloc_t *list, apr_size_t keep)
+{
+    int i;
+
+    for (i = CARVED_CLASSES; i < NUM_CLASSES; i++) {
+        node_class_t *c = &list->classes[i];
+        apr_size_t max = keep < c->max_free ? keep : c->max_free;
+
+        while (c->nfree > max) {
+            node_header_t *node = c->freelist;
+            c->freelist = node->next;
+            c->nfree--;
+            apr_allocator_free(list->allocator, node->memnode);
+        }
+    }
+}
+
 static apr_status_t alloc_cleanup(void *data)
 {
     apr_bucket_alloc_t *list = data;
@@ -55,6 +146,8 @@ static apr_status_t alloc_cleanup(void *data)
     }
 #endif
 
+    drain_remote(list);
+    free_memnode_classes(list, 0);
     apr_allocator_free(list->allocator, list->blocks);
 
 #if APR_POOL_DEBUG
@@ -101,16 +194,23 @@ APR_DECLARE_NONSTD(apr_bucket_alloc_t *) apr_bucket_alloc_create_ex(
 {
     apr_bucket_alloc_t *list;
     apr_memnode_t *block;
+    int i;
 
     block = apr_allocator_alloc(allocator, ALLOC_AMT);
     if (!block) {
         return NULL;
     }
     list = (apr_bucket_alloc_t *)block->first_avail;
-    list->pool = NULL;
+    memset(list, 0, sizeof(*list));
     list->allocator = allocator;
-    list->freelist = NULL;
     list->blocks = block;
+    list->classes[0].size = SMALL_NODE_SIZE;
+    list->classes[1].size = 512;
+    list->classes[2].size = 2048;
+    for (i = CARVED_CLASSES; i < NUM_CLASSES; i++) {
+        list->classes[i].size = MEMNODE_CLASS_SIZE(i);
+        list->classes[i].max_free = DEFAULT_MAX_FREE(i);
+    }
     block->first_avail += APR_ALIGN_DEFAULT(sizeof(*list));
     APR_VALGRIND_NOACCESS(block->first_avail,
                           block->endp - block->first_avail);
@@ -123,6 +223,8 @@ APR_DECLARE_NONSTD(void) apr_bucket_alloc_destroy(apr_bucket_alloc_t *list)
         apr_pool_cleanup_kill(list->pool, list, alloc_cleanup);
     }
 
+    drain_remote(list);
+    free_memnode_classes(list, 0);
     apr_allocator_free(list->allocator, list->blocks);
 
 #if APR_POOL_DEBUG
@@ -135,8 +237,10 @@ APR_DECLARE_NONSTD(void) apr_bucket_alloc_destroy(apr_bucket_alloc_t *list)
 APR_DECLARE_NONSTD(apr_size_t) apr_bucket_alloc_aligned_floor(apr_bucket_alloc_t *list,
                                                               apr_size_t size)
 {
-    if (size <= SMALL_NODE_SIZE) {
-        size = SMALL_NODE_SIZE;
+    int i = node_class(list, size);
+
+    if (i < CARVED_CLASSES) {
+        size = list->classes[i].size;
     }
     else {
         if (size < APR_MEMNODE_T_SIZE) {
@@ -156,49 +260,73 @@ APR_DECLARE_NONSTD(void *) apr_bucket_alloc(apr_size_t in_size,
                                             apr_bucket_alloc_t *list)
 {
     node_header_t *node;
+    node_class_t *c;
     apr_memnode_t *active = list->blocks;
     char *endp;
     apr_size_t size;
+    int i;
+
+#if APR_HAS_THREADS
+    if (list->remote) {
+        drain_remote(list);
+    }
+#endif
 
     size = in_size + SIZEOF_NODE_HEADER_T;
-    if (size <= SMALL_NODE_SIZE) {
-        if (list->freelist) {
-            node = list->freelist;
-            list->freelist = node->next;
-            APR_VALGRIND_UNDEFINED((char *)node + SIZEOF_NODE_HEADER_T,
-                                   SMALL_NODE_SIZE - SIZEOF_NODE_HEADER_T);
+    i = node_class(list, size);
+    if (i == NUM_CLASSES) {
+        apr_memnode_t *memnode = apr_allocator_alloc(list->allocator, size);
+        if (!memnode) {
+            return NULL;
         }
-        else {
-            endp = active->first_avail + SMALL_NODE_SIZE;
-            if (endp >= active->endp) {
-                list->blocks = apr_allocator_alloc(list->allocator, ALLOC_AMT);
-                if (!list->blocks) {
-                    list->blocks = active;
-                    return NULL;
-                }
-                list->blocks->next = active;
-                active = list->blocks;
-                endp = active->first_avail + SMALL_NODE_SIZE;
-                APR_VALGRIND_NOACCESS(active->first_avail,
-                                      active->endp - active->first_avail);
+        node = (node_header_t *)memnode->first_avail;
+        node->alloc = list;
+        node->memnode = memnode;
+        node->size = size;
+        list->nalloc_large++;
+        return ((char *)node) + SIZEOF_NODE_HEADER_T;
+    }
+
+    c = &list->classes[i];
+    c->nalloc++;
+    if (c->freelist) {
+        node = c->freelist;
+        c->freelist = node->next;
+        c->nfree--;
+        c->nreuse++;
+        APR_VALGRIND_UNDEFINED((char *)node + SIZEOF_NODE_HEADER_T,
+                               c->size - SIZEOF_NODE_HEADER_T);
+    }
+    else if (i < CARVED_CLASSES) {
+        endp = active->first_avail + c->size;
+        if (endp >= active->endp) {
+            list->blocks = apr_allocator_alloc(list->allocator, ALLOC_AMT);
+            if (!list->blocks) {
+                list->blocks = active;
+                return NULL;
             }
-            node = (node_header_t *)active->first_avail;
-            APR_VALGRIND_UNDEFINED(node, SMALL_NODE_SIZE);
-            node->alloc = list;
-            node->memnode = active;
-            node->size = SMALL_NODE_SIZE;
-            active->first_avail = endp;
+            list->blocks->next = active;
+            active = list->blocks;
+            endp = active->first_avail + c->size;
+            APR_VALGRIND_NOACCESS(active->first_avail,
+                                  active->endp - active->first_avail);
         }
+        node = (node_header_t *)active->first_avail;
+        APR_VALGRIND_UNDEFINED(node, c->size);
+        node->alloc = list;
+        node->memnode = active;
+        node->size = c->size;
+        active->first_avail = endp;
     }
     else {
-        apr_memnode_t *memnode = apr_allocator_alloc(list->allocator, size);
+        apr_memnode_t *memnode = apr_allocator_alloc(list->allocator, c->size);
         if (!memnode) {
             return NULL;
         }
         node = (node_header_t *)memnode->first_avail;
         node->alloc = list;
         node->memnode = memnode;
-        node->size = size;
+        node->size = c->size;
     }
     return ((char *)node) + SIZEOF_NODE_HEADER_T;
 }
@@ -207,10 +335,9 @@ APR_DECLARE_NONSTD(void *) apr_bucket_alloc(apr_size_t in_size,
 #if APR_HAVE_STDLIB_H
 #include <stdlib.h>
 #endif
-static void check_not_already_free(node_header_t *node)
+static void check_not_already_free(node_header_t *node, node_class_t *c)
 {
-    apr_bucket_alloc_t *list = node->alloc;
-    node_header_t *curr = list->freelist;
+    node_header_t *curr = c->freelist;
 
     while (curr) {
         if (node == curr) {
@@ -220,21 +347,102 @@ static void check_not_already_free(node_header_t *node)
     }
 }
 #else
-#define check_not_already_free(node)
+#define check_not_already_free(node, c)
 #endif
 
+static void node_free(apr_bucket_alloc_t *list, node_header_t *node)
+{
+    int i = node_class(list, node->size);
+    node_class_t *c = &list->classes[i];
+
+    if (i < CARVED_CLASSES || (i < NUM_CLASSES && c->nfree < c->max_free)) {
+        check_not_already_free(node, c);
+        node->next = c->freelist;
+        c->freelist = node;
+        c->nfree++;
+        APR_VALGRIND_NOACCESS((char *)node + SIZEOF_NODE_HEADER_T,
+                              c->size - SIZEOF_NODE_HEADER_T);
+    }
+    else {
+        apr_allocator_free(list->allocator, node->memnode);
+    }
+}
+
 APR_DECLARE_NONSTD(void) apr_bucket_free(void *mem)
 {
     node_header_t *node = (node_header_t *)((char *)mem - SIZEOF_NODE_HEADER_T);
     apr_bucket_alloc_t *list = node->alloc;
 
-    if (node->size == SMALL_NODE_SIZE) {
-        check_not_already_free(node);
-        node->next = list->freelist;
-        list->freelist = node;
-        APR_VALGRIND_NOACCESS(mem, SMALL_NODE_SIZE - SIZEOF_NODE_HEADER_T);
+#if APR_HAS_THREADS
+    if (list->owned && !apr_os_thread_equal(list->owner,
+                                            apr_os_thread_current())) {
+        /* Queued for the owner, which is the only consumer and takes the
+         * whole list at once, so there is no ABA issue.
+         */
+        void *head;
+        do {
+            head = list->remote;
+            node->next = head;
+        } while (apr_atomic_casptr((void *volatile *)&list->remote,
+                                   node, head) != head);
+        return;
     }
-    else {
-        apr_allocator_free(list->allocator, node->memnode);
+#endif
+
+    node_free(list, node);
+}
+
+APR_DECLARE_NONSTD(apr_status_t) apr_bucket_alloc_owner_set(
+                                             apr_bucket_alloc_t *list,
+                                             int owned)
+{
+#if APR_HAS_THREADS
+    drain_remote(list);
+    list->owner = apr_os_thread_current();
+    list->owned = owned;
+    return APR_SUCCESS;
+#else
+    return owned ? APR_ENOTIMPL : APR_SUCCESS;
+#endif
+}
+
+APR_DECLARE_NONSTD(apr_status_t) apr_bucket_alloc_max_free_set(
+                                             apr_bucket_alloc_t *list,
+                                             apr_size_t size,
+                                             apr_size_t max_free)
+{
+    int i = node_class(list, size + SIZEOF_NODE_HEADER_T);
+
+    if (i < CARVED_CLASSES || i == NUM_CLASSES) {
+        return APR_EINVAL;
+    }
+    list->classes[i].max_free = max_free;
+    free_memnode_classes(list, APR_SIZE_MAX);
+    return APR_SUCCESS;
+}
+
+APR_DECLARE_NONSTD(int) apr_bucket_alloc_stats_get(apr_bucket_alloc_t *list,
+                                              apr_bucket_alloc_stats_t *stats,
+                                              int nstats)
+{
+    int i;
+
+    for (i = 0; i < NUM_CLASSES && i < nstats; i++) {
+        node_class_t *c = &list->classes[i];
+
+        stats[i].size = c->size - SIZEOF_NODE_HEADER_T;
+        stats[i].max_free = i < CARVED_CLASSES ? APR_SIZE_MAX : c->max_free;
+        stats[i].nfree = c->nfree;
+        stats[i].nalloc = c->nalloc;
+        stats[i].nreuse = c->nreuse;
+    }
+    if (i < nstats) {
+        /* The larger nodes */
+        stats[i].size = APR_SIZE_MAX;
+        stats[i].max_free = 0;
+        stats[i].nfree = 0;
+        stats[i].nalloc = list->nalloc_large;
+        stats[i].nreuse = 0;
     }
+    return NUM_CLASSES + 1;
 }
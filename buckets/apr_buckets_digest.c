@@ -0,0 +1,236 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "apr_buckets.h"
+#include "apr_md5.h"
+#include "apr_sha1.h"
+#include "apr_crypto.h"
+
+#include <limits.h>
+
+typedef struct digest_bucket_data {
+    apr_brigade_digest_e type;
+    void *ctx;
+    /* The bucket wrapped, alone in its ring so that what a read or a split
+     * of it inserts after it can be taken and wrapped in turn.
+     */
+    APR_RING_HEAD(digest_bucket_ring, apr_bucket) ring;
+} digest_bucket_data;
+
+#define DIGEST_BUCKET_FIRST(d) APR_RING_FIRST(&(d)->ring)
+#define DIGEST_BUCKET_SENTINEL(d) APR_RING_SENTINEL(&(d)->ring, apr_bucket, link)
+
+static apr_status_t digest_update(apr_brigade_digest_e type, void *ctx,
+                                  const char *str, apr_size_t len)
+{
+    switch (type) {
+    case APR_BRIGADE_DIGEST_MD5:
+        return apr_md5_update(ctx, str, len);
+    case APR_BRIGADE_DIGEST_SHA1:
+        while (len > UINT_MAX) {
+            apr_sha1_update_binary(ctx, (const unsigned char *)str, UINT_MAX);
+            str += UINT_MAX;
+            len -= UINT_MAX;
+        }
+        apr_sha1_update_binary(ctx, (const unsigned char *)str,
+                               (unsigned int)len);
+        return APR_SUCCESS;
+    case APR_BRIGADE_DIGEST_CRYPTO:
+#if APU_HAVE_CRYPTO
+        return apr_crypto_digest_update(ctx, (const unsigned char *)str, len);
+#else
+        return APR_ENOTIMPL;
+#endif
+    }
+    return APR_EINVAL;
+}
+
+APR_DECLARE(apr_status_t) apr_brigade_digest(apr_bucket_brigade *bb,
+                                             apr_brigade_digest_e type,
+                                             void *ctx)
+{
+    apr_bucket *e;
+    apr_status_t rv;
+
+    for (e = APR_BRIGADE_FIRST(bb);
+         e != APR_BRIGADE_SENTINEL(bb);
+         e = APR_BUCKET_NEXT(e)) {
+        const char *str;
+        apr_size_t len;
+
+        if (APR_BUCKET_IS_METADATA(e)) {
+            continue;
+        }
+
+        rv = apr_bucket_read(e, &str, &len, APR_BLOCK_READ);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        rv = digest_update(type, ctx, str, len);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+    }
+
+    return APR_SUCCESS;
+}
+
+static apr_bucket *digest_bucket_wrap(apr_bucket *b, apr_bucket *e,
+                                      apr_brigade_digest_e type, void *ctx)
+{
+    digest_bucket_data *d;
+
+    d = apr_bucket_alloc(sizeof(*d), b->list);
+    d->type = type;
+    d->ctx = ctx;
+    APR_RING_INIT(&d->ring, apr_bucket, link);
+    APR_RING_INSERT_TAIL(&d->ring, e, apr_bucket, link);
+
+    b->type   = &apr_bucket_type_digest;
+    b->length = e->length;
+    b->start  = 0;
+    b->data   = d;
+
+    return b;
+}
+
+/* Wrap the buckets that a read or a split of the bucket of b left after it
+ * in new DIGEST buckets, which follow b in the same order.
+ */
+static void digest_bucket_wrap_rest(apr_bucket *b)
+{
+    digest_bucket_data *d = b->data;
+    apr_bucket *e, *next, *after = b;
+
+    for (e = APR_BUCKET_NEXT(DIGEST_BUCKET_FIRST(d));
+         e != DIGEST_BUCKET_SENTINEL(d);
+         e = next) {
+        next = APR_BUCKET_NEXT(e);
+        APR_BUCKET_REMOVE(e);
+
+        e = apr_bucket_digest_create(e, d->type, d->ctx, b->list);
+        APR_BUCKET_INSERT_AFTER(after, e);
+        after = e;
+    }
+}
+
+static apr_status_t digest_bucket_read(apr_bucket *b, const char **str,
+                                       apr_size_t *len, apr_read_type_e block)
+{
+    digest_bucket_data *d = b->data;
+    apr_bucket *e = DIGEST_BUCKET_FIRST(d);
+    apr_status_t rv;
+
+    rv = apr_bucket_read(e, str, len, block);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    digest_bucket_wrap_rest(b);
+    b->length = e->length;
+
+    rv = digest_update(d->type, d->ctx, *str, *len);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    /* Now that its data is in the digest, b becomes the bucket read, which
+     * takes over the data (not copied) of the wrapped one.
+     */
+    b->type   = e->type;
+    b->length = e->length;
+    b->start  = e->start;
+    b->data   = e->data;
+    e->free(e);
+    apr_bucket_free(d);
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t digest_bucket_setaside(apr_bucket *b, apr_pool_t *pool)
+{
+    digest_bucket_data *d = b->data;
+
+    return apr_bucket_setaside(DIGEST_BUCKET_FIRST(d), pool);
+}
+
+static apr_status_t digest_bucket_split(apr_bucket *b, apr_size_t point)
+{
+    digest_bucket_data *d = b->data;
+    apr_bucket *e = DIGEST_BUCKET_FIRST(d);
+    apr_status_t rv;
+
+    rv = apr_bucket_split(e, point);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    b->length = e->length;
+
+    digest_bucket_wrap_rest(b);
+
+    return APR_SUCCESS;
+}
+
+static void digest_bucket_destroy(void *data)
+{
+    digest_bucket_data *d = data;
+    apr_bucket *e, *next;
+
+    /* The data never read is not in the digest */
+    for (e = DIGEST_BUCKET_FIRST(d);
+         e != DIGEST_BUCKET_SENTINEL(d);
+         e = next) {
+        next = APR_BUCKET_NEXT(e);
+        apr_bucket_destroy(e);
+    }
+    apr_bucket_free(d);
+}
+
+APR_DECLARE(apr_bucket *) apr_bucket_digest_make(apr_bucket *b,
+                                                 apr_brigade_digest_e type,
+                                                 void *ctx)
+{
+    apr_bucket *e;
+
+    /* b stays in place, its data moves to a new bucket that it wraps */
+    e = apr_bucket_alloc(sizeof(*e), b->list);
+    *e = *b;
+    e->free = apr_bucket_free;
+
+    return digest_bucket_wrap(b, e, type, ctx);
+}
+
+APR_DECLARE(apr_bucket *) apr_bucket_digest_create(apr_bucket *e,
+                                                   apr_brigade_digest_e type,
+                                                   void *ctx,
+                                                   apr_bucket_alloc_t *list)
+{
+    apr_bucket *b = apr_bucket_alloc(sizeof(*b), list);
+
+    APR_BUCKET_INIT(b);
+    b->free = apr_bucket_free;
+    b->list = list;
+    return digest_bucket_wrap(b, e, type, ctx);
+}
+
+APR_DECLARE_DATA const apr_bucket_type_t apr_bucket_type_digest = {
+    "DIGEST", 5, APR_BUCKET_DATA,
+    digest_bucket_destroy,
+    digest_bucket_read,
+    digest_bucket_setaside,
+    digest_bucket_split,
+    apr_bucket_copy_notimpl
+};
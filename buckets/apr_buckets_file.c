@@ -14,13 +14,26 @@
  * limitations under the License.
  */
 
+#include "apr_private.h"
+
 #include "apr.h"
 #include "apr_general.h"
 #include "apr_file_io.h"
 #include "apr_buckets.h"
 
+#if defined(HAVE_POSIX_FADVISE)
+#include "apr_portable.h"
+#if APR_HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#endif
+
 #if APR_HAS_MMAP
 #include "apr_mmap.h"
+#if defined(HAVE_MADVISE) && defined(HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#define FILE_MMAP_ADVISE
+#endif
 
 /* mmap support for static files based on ideas from John Heidemann's
  * patch against 1.0.5.  See
@@ -40,6 +53,31 @@ static void file_bucket_destroy(void *data)
     }
 }
 
+/* Advise the kernel to read ahead up to a window past offset (and before
+ * end), unless it was advised to at least half a window ago.
+ */
+static void file_read_ahead(apr_bucket_file *a, apr_off_t offset,
+                            apr_off_t end)
+{
+#ifdef HAVE_POSIX_FADVISE
+    apr_os_file_t fd;
+    apr_off_t from, to;
+
+    if (a->read_ahead_off - offset >= (apr_off_t)a->read_ahead / 2) {
+        return;
+    }
+    from = offset > a->read_ahead_off ? offset : a->read_ahead_off;
+    to = offset + a->read_ahead;
+    if (to > end) {
+        to = end;
+    }
+    if (to > from && apr_os_file_get(&fd, a->fd) == APR_SUCCESS) {
+        posix_fadvise(fd, from, to - from, POSIX_FADV_WILLNEED);
+        a->read_ahead_off = to;
+    }
+#endif
+}
+
 #if APR_HAS_MMAP
 static int file_make_mmap(apr_bucket *e, apr_size_t filelength,
                            apr_off_t fileoffset, apr_pool_t *p)
@@ -66,6 +104,19 @@ static int file_make_mmap(apr_bucket *e, apr_size_t filelength,
     {
         return 0;
     }
+#ifdef FILE_MMAP_ADVISE
+    if (a->read_ahead) {
+        char *addr = (char *)mm->mm - mm->poffset;
+        apr_size_t size = mm->size + mm->poffset;
+
+        madvise(addr, size, MADV_SEQUENTIAL);
+        madvise(addr, size < a->read_ahead ? size : a->read_ahead,
+                MADV_WILLNEED);
+#ifdef MADV_HUGEPAGE
+        madvise(addr, size, MADV_HUGEPAGE);
+#endif
+    }
+#endif
     apr_bucket_mmap_make(e, mm, 0, filelength);
     file_bucket_destroy(a);
     return 1;
@@ -123,6 +174,9 @@ static apr_status_t file_bucket_read(apr_bucket *e, const char **str,
         apr_bucket_free(buf);
         return rv;
     }
+    if (a->read_ahead) {
+        file_read_ahead(a, fileoffset + *len, fileoffset + filelength);
+    }
     filelength -= *len;
     /*
      * Change the current bucket to refer to what we read,
@@ -164,6 +218,8 @@ APR_DECLARE(apr_bucket *) apr_bucket_file_make(apr_bucket *b, apr_file_t *fd,
     f->can_mmap = 1;
 #endif
     f->read_size = APR_BUCKET_BUFF_SIZE;
+    f->read_ahead = 0;
+    f->read_ahead_off = 0;
 
     b = apr_bucket_shared_make(b, f, offset, len);
     b->type = &apr_bucket_type_file;
@@ -212,6 +268,30 @@ APR_DECLARE(apr_status_t) apr_bucket_file_set_buf_size(apr_bucket *e,
     return APR_SUCCESS;
 }
 
+APR_DECLARE(apr_status_t) apr_bucket_file_set_read_ahead(apr_bucket *e,
+                                                         apr_size_t size)
+{
+#if defined(HAVE_POSIX_FADVISE) || defined(FILE_MMAP_ADVISE)
+    apr_bucket_file *a = e->data;
+#ifdef HAVE_POSIX_FADVISE
+    apr_os_file_t fd;
+
+    if (size && apr_os_file_get(&fd, a->fd) == APR_SUCCESS) {
+        posix_fadvise(fd, e->start, e->length, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
+    a->read_ahead = size;
+    a->read_ahead_off = e->start;
+    if (size) {
+        /* Start reading now */
+        file_read_ahead(a, e->start, e->start + e->length);
+    }
+    return APR_SUCCESS;
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
 static apr_status_t file_bucket_setaside(apr_bucket *b, apr_pool_t *reqpool)
 {
     apr_bucket_file *a = b->data;
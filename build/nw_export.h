@@ -55,6 +55,7 @@
 #include "apr_signal.h"
 #include "apr_siphash.h"
 #include "apr_skiplist.h"
+#include "apr_strbuf.h"
 #include "apr_strings.h"
 #include "apr_strmatch.h"
 #include "apr_support.h"
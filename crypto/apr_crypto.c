@@ -24,7 +24,11 @@
 #include "apr_strings.h"
 #include "apr_hash.h"
 #include "apr_thread_mutex.h"
+#include "apr_thread_pool.h"
+#include "apr_atomic.h"
 #include "apr_lib.h"
+#include "apr_siphash.h"
+#include "apr_general.h"
 
 #if APU_HAVE_CRYPTO
 
@@ -617,6 +621,150 @@ APR_DECLARE(apr_status_t) apr_crypto_passphrase(apr_crypto_key_t **key,
             type, mode, doPad, iterations, f, p);
 }
 
+/* A derived key, in its own pool to be freed when replaced.  The
+ * passphrase is not kept but authenticated with SipHash-2-4 under two
+ * random keys of the cache, like by apr_password_validate_cached().
+ */
+
+#define CRYPTO_KEY_CACHE_TAG (2 * APR_SIPHASH_DSIZE)
+
+typedef struct crypto_key_cache_entry_t {
+    apr_pool_t *pool;           /* NULL while unused */
+    apr_crypto_key_t *key;
+    apr_size_t ivSize;
+    unsigned char tag[CRYPTO_KEY_CACHE_TAG];    /* of the passphrase */
+    unsigned char *salt;
+    apr_size_t saltLen;
+    apr_crypto_block_key_type_e type;
+    apr_crypto_block_key_mode_e mode;
+    int doPad;
+    int iterations;
+    apr_uint64_t used;          /* when last used, for the LRU */
+} crypto_key_cache_entry_t;
+
+struct apr_crypto_key_cache_t {
+    const apr_crypto_t *f;
+    apr_pool_t *pool;
+    crypto_key_cache_entry_t *entries;
+    int size;
+    apr_uint64_t clock;
+    unsigned char keys[2][APR_SIPHASH_KSIZE];
+};
+
+APR_DECLARE(apr_status_t) apr_crypto_key_cache_create(
+        apr_crypto_key_cache_t **cache, int size, const apr_crypto_t *f,
+        apr_pool_t *p)
+{
+#if APR_HAS_RANDOM
+    apr_crypto_key_cache_t *c;
+    apr_status_t rv;
+
+    if (size < 1) {
+        return APR_EINVAL;
+    }
+
+    c = apr_palloc(p, sizeof(*c));
+    rv = apr_generate_random_bytes(&c->keys[0][0], sizeof(c->keys));
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    c->f = f;
+    c->pool = p;
+    c->entries = apr_pcalloc(p, size * sizeof(crypto_key_cache_entry_t));
+    c->size = size;
+    c->clock = 0;
+
+    /* the tags of the passphrases and their keys are not left behind */
+    apr_crypto_clear(p, c->entries, size * sizeof(crypto_key_cache_entry_t));
+    apr_crypto_clear(p, c->keys, sizeof(c->keys));
+
+    *cache = c;
+    return APR_SUCCESS;
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
+APR_DECLARE(apr_status_t) apr_crypto_passphrase_cached(
+        const apr_crypto_key_t **key, apr_size_t *ivSize,
+        apr_crypto_key_cache_t *cache, const char *pass, apr_size_t passLen,
+        const unsigned char *salt, apr_size_t saltLen,
+        const apr_crypto_block_key_type_e type,
+        const apr_crypto_block_key_mode_e mode, const int doPad,
+        const int iterations)
+{
+    crypto_key_cache_entry_t *e, *lru = NULL;
+    unsigned char tag[CRYPTO_KEY_CACHE_TAG];
+    apr_crypto_key_t *k = NULL;
+    apr_size_t size = 0;
+    apr_pool_t *pool;
+    apr_status_t rv;
+    int i;
+
+    apr_siphash24_auth(tag, pass, passLen, cache->keys[0]);
+    apr_siphash24_auth(tag + APR_SIPHASH_DSIZE, pass, passLen,
+                       cache->keys[1]);
+
+    for (i = 0; i < cache->size; i++) {
+        e = &cache->entries[i];
+        if (!e->pool) {
+            if (!lru || lru->pool) {
+                lru = e;
+            }
+            continue;
+        }
+        if (e->type == type && e->mode == mode && e->doPad == doPad
+            && e->iterations == iterations && e->saltLen == saltLen
+            && !memcmp(e->salt, salt, saltLen)
+            && apr_crypto_equals(e->tag, tag, sizeof(tag))) {
+            apr_crypto_memzero(tag, sizeof(tag));
+            e->used = ++cache->clock;
+            *key = e->key;
+            if (ivSize) {
+                *ivSize = e->ivSize;
+            }
+            return APR_SUCCESS;
+        }
+        if (!lru || (lru->pool && e->used < lru->used)) {
+            lru = e;
+        }
+    }
+
+    /* derive the key before replacing any, it may fail */
+    apr_pool_create(&pool, cache->pool);
+    rv = apr_crypto_passphrase(&k, &size, pass, passLen, salt, saltLen,
+                               type, mode, doPad, iterations, cache->f,
+                               pool);
+    if (rv != APR_SUCCESS) {
+        apr_crypto_memzero(tag, sizeof(tag));
+        apr_pool_destroy(pool);
+        return rv;
+    }
+
+    e = lru;
+    if (e->pool) {
+        apr_pool_destroy(e->pool);
+    }
+    e->pool = pool;
+    e->key = k;
+    e->ivSize = size;
+    memcpy(e->tag, tag, sizeof(tag));
+    apr_crypto_memzero(tag, sizeof(tag));
+    e->salt = apr_pmemdup(pool, salt, saltLen);
+    e->saltLen = saltLen;
+    e->type = type;
+    e->mode = mode;
+    e->doPad = doPad;
+    e->iterations = iterations;
+    e->used = ++cache->clock;
+
+    *key = k;
+    if (ivSize) {
+        *ivSize = size;
+    }
+    return APR_SUCCESS;
+}
+
 /**
  * @brief Initialise a context for encrypting arbitrary data using the given key.
  * @note If *ctx is NULL, a apr_crypto_block_t will be created from a pool. If
@@ -793,6 +941,253 @@ APR_DECLARE(apr_status_t) apr_crypto_block_cleanup(apr_crypto_block_t *ctx)
     return ctx->provider->block_cleanup(ctx);
 }
 
+APR_DECLARE(apr_status_t) apr_crypto_aead_encrypt(unsigned char *out,
+        unsigned char *tag, apr_size_t taglen, const unsigned char *in,
+        apr_size_t inlen, const unsigned char *aad, apr_size_t aadlen,
+        const unsigned char *iv, const apr_crypto_key_t *key)
+{
+    if (!key->provider->aead_encrypt) {
+        return APR_ENOTIMPL;
+    }
+    return key->provider->aead_encrypt(out, tag, taglen, in, inlen, aad,
+            aadlen, iv, key);
+}
+
+APR_DECLARE(apr_status_t) apr_crypto_aead_decrypt(unsigned char *out,
+        const unsigned char *tag, apr_size_t taglen, const unsigned char *in,
+        apr_size_t inlen, const unsigned char *aad, apr_size_t aadlen,
+        const unsigned char *iv, const apr_crypto_key_t *key)
+{
+    if (!key->provider->aead_decrypt) {
+        return APR_ENOTIMPL;
+    }
+    return key->provider->aead_decrypt(out, tag, taglen, in, inlen, aad,
+            aadlen, iv, key);
+}
+
+/* A STREAM encryption or decryption, its chunks shared by the threads */
+typedef struct crypto_stream_t {
+    unsigned char *out;
+    const unsigned char *in;
+    apr_size_t len;             /* of the plain text */
+    apr_size_t chunksize;       /* of the plain text */
+    apr_uint32_t nchunks;
+    const unsigned char *prefix;
+    const apr_crypto_key_t *key;
+    int encrypt;
+    volatile apr_uint32_t next;
+    volatile apr_uint32_t status;
+} crypto_stream_t;
+
+/* Encrypt or decrypt the chunk i to out */
+static apr_status_t crypto_stream_chunk(const crypto_stream_t *st,
+        apr_uint32_t i, unsigned char *out)
+{
+    unsigned char iv[APR_CRYPTO_AEAD_IVSIZE];
+    apr_size_t pt = (apr_size_t) i * st->chunksize,
+               ct = (apr_size_t) i * (st->chunksize + APR_CRYPTO_AEAD_TAGSIZE),
+               len = i + 1 < st->nchunks ? st->chunksize : st->len - pt;
+
+    /* the nonce: prefix, big endian counter, last chunk flag */
+    memcpy(iv, st->prefix, APR_CRYPTO_STREAM_PREFIXSIZE);
+    iv[7] = (unsigned char) (i >> 24);
+    iv[8] = (unsigned char) (i >> 16);
+    iv[9] = (unsigned char) (i >> 8);
+    iv[10] = (unsigned char) i;
+    iv[11] = i + 1 == st->nchunks;
+
+    if (st->encrypt) {
+        return apr_crypto_aead_encrypt(out, out + len,
+                APR_CRYPTO_AEAD_TAGSIZE, st->in + pt, len, NULL, 0, iv,
+                st->key);
+    }
+    return apr_crypto_aead_decrypt(out, st->in + ct + len,
+            APR_CRYPTO_AEAD_TAGSIZE, st->in + ct, len, NULL, 0, iv, st->key);
+}
+
+static void crypto_stream_run(crypto_stream_t *st)
+{
+    apr_uint32_t i;
+
+    while (!apr_atomic_read32(&st->status)
+            && (i = apr_atomic_inc32(&st->next)) < st->nchunks) {
+        apr_size_t size = st->chunksize
+                          + (st->encrypt ? APR_CRYPTO_AEAD_TAGSIZE : 0);
+        apr_status_t rv = crypto_stream_chunk(st, i, st->out + i * size);
+        if (rv != APR_SUCCESS) {
+            apr_atomic_cas32(&st->status, rv, 0);
+        }
+    }
+}
+
+#if APR_HAS_THREADS
+static void *APR_THREAD_FUNC crypto_stream_task(apr_thread_t *thd, void *data)
+{
+    crypto_stream_run(data);
+    return NULL;
+}
+#endif
+
+static apr_status_t crypto_stream(crypto_stream_t *st,
+        struct apr_thread_pool *tp)
+{
+#if APR_HAS_THREADS
+    apr_size_t n = 0;
+
+    /* the other threads help with the chunks, the first one is ours */
+    if (tp && st->nchunks > 1) {
+        apr_size_t ntasks = apr_thread_pool_thread_max_get(tp);
+
+        if (ntasks > st->nchunks - 1) {
+            ntasks = st->nchunks - 1;
+        }
+        for (; n < ntasks; n++) {
+            if (apr_thread_pool_push(tp, crypto_stream_task, st,
+                    APR_THREAD_TASK_PRIORITY_HIGHEST, st) != APR_SUCCESS) {
+                break;
+            }
+        }
+    }
+#endif
+
+    crypto_stream_run(st);
+
+#if APR_HAS_THREADS
+    /* all the chunks are taken, the tasks not started yet are useless
+     * and the others finish theirs
+     */
+    if (n) {
+        apr_thread_pool_tasks_cancel(tp, st);
+    }
+#endif
+
+    return apr_atomic_read32(&st->status);
+}
+
+APR_DECLARE(apr_status_t) apr_crypto_stream_encrypt(unsigned char *out,
+        apr_size_t *outlen, const unsigned char *in, apr_size_t inlen,
+        apr_size_t chunksize, const unsigned char *prefix,
+        const apr_crypto_key_t *key, struct apr_thread_pool *tp)
+{
+    crypto_stream_t st;
+    apr_size_t n;
+
+    if (!chunksize) {
+        return APR_EINVAL;
+    }
+    n = inlen / chunksize + (inlen % chunksize != 0);
+    if (!n) {
+        n = 1;
+    }
+    if (n > APR_UINT32_MAX
+            || n > (APR_SIZE_MAX - inlen) / APR_CRYPTO_AEAD_TAGSIZE) {
+        return APR_EINVAL;
+    }
+    *outlen = inlen + n * APR_CRYPTO_AEAD_TAGSIZE;
+    if (!out) {
+        return APR_SUCCESS;
+    }
+
+    memset(&st, 0, sizeof(st));
+    st.out = out;
+    st.in = in;
+    st.len = inlen;
+    st.chunksize = chunksize;
+    st.nchunks = (apr_uint32_t) n;
+    st.prefix = prefix;
+    st.key = key;
+    st.encrypt = 1;
+
+    return crypto_stream(&st, tp);
+}
+
+/* The number of chunks and the length of the plain text of a STREAM */
+static apr_status_t crypto_stream_size(apr_size_t inlen, apr_size_t chunksize,
+        apr_size_t *nchunks, apr_size_t *len)
+{
+    apr_size_t size = chunksize + APR_CRYPTO_AEAD_TAGSIZE, n;
+
+    if (!chunksize || size < chunksize) {
+        return APR_EINVAL;
+    }
+    n = inlen / size + (inlen % size != 0);
+    if (!n || n > APR_UINT32_MAX
+            || inlen - (n - 1) * size < APR_CRYPTO_AEAD_TAGSIZE) {
+        return APR_EINVAL;
+    }
+    *nchunks = n;
+    *len = inlen - n * APR_CRYPTO_AEAD_TAGSIZE;
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_crypto_stream_decrypt(unsigned char *out,
+        apr_size_t *outlen, const unsigned char *in, apr_size_t inlen,
+        apr_size_t chunksize, const unsigned char *prefix,
+        const apr_crypto_key_t *key, struct apr_thread_pool *tp)
+{
+    crypto_stream_t st;
+    apr_size_t n, len;
+    apr_status_t rv;
+
+    rv = crypto_stream_size(inlen, chunksize, &n, &len);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    *outlen = len;
+    if (!out) {
+        return APR_SUCCESS;
+    }
+
+    memset(&st, 0, sizeof(st));
+    st.out = out;
+    st.in = in;
+    st.len = len;
+    st.chunksize = chunksize;
+    st.nchunks = (apr_uint32_t) n;
+    st.prefix = prefix;
+    st.key = key;
+
+    rv = crypto_stream(&st, tp);
+    if (rv != APR_SUCCESS) {
+        /* what was decrypted is not authentic as a whole */
+        apr_crypto_memzero(out, len);
+    }
+    return rv;
+}
+
+APR_DECLARE(apr_status_t) apr_crypto_stream_decrypt_chunk(unsigned char *out,
+        apr_size_t *outlen, const unsigned char *in, apr_size_t inlen,
+        apr_size_t chunksize, apr_size_t index, const unsigned char *prefix,
+        const apr_crypto_key_t *key)
+{
+    crypto_stream_t st;
+    apr_size_t n, len;
+    apr_status_t rv;
+
+    rv = crypto_stream_size(inlen, chunksize, &n, &len);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    if (index >= n) {
+        return APR_EINVAL;
+    }
+    *outlen = index + 1 < n ? chunksize : len - index * chunksize;
+    if (!out) {
+        return APR_SUCCESS;
+    }
+
+    memset(&st, 0, sizeof(st));
+    st.in = in;
+    st.len = len;
+    st.chunksize = chunksize;
+    st.nchunks = (apr_uint32_t) n;
+    st.prefix = prefix;
+    st.key = key;
+
+    return crypto_stream_chunk(&st, (apr_uint32_t) index, out);
+}
+
 /**
  * @brief Clean sign / verify context.
  * @note After cleanup, a context is free to be reused if necessary.
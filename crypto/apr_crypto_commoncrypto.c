@@ -1466,7 +1466,8 @@ APR_MODULE_DECLARE_DATA const apr_crypto_driver_t apr_crypto_commoncrypto_driver
         crypto_digest_init, crypto_digest_update, crypto_digest_final,
         crypto_digest, crypto_block_cleanup, crypto_digest_cleanup,
         crypto_cleanup, crypto_shutdown, crypto_error, crypto_key,
-        cprng_stream_ctx_make, cprng_stream_ctx_free, cprng_stream_ctx_bytes
+        cprng_stream_ctx_make, cprng_stream_ctx_free, cprng_stream_ctx_bytes,
+        NULL, NULL
 };
 
 #endif
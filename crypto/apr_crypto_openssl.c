@@ -27,6 +27,7 @@
 #include "apr_time.h"
 #include "apr_buckets.h"
 #include "apr_thread_mutex.h"
+#include "apr_atomic.h"
 
 #include "apr_crypto_internal.h"
 
@@ -59,6 +60,19 @@
 #endif /* defined(LIBRESSL_VERSION_NUMBER) */
 #endif /* ndef APR_USE_OPENSSL_PRE_1_1_API */
 
+/* The AEAD ciphers of crypto_aead_encrypt() and crypto_aead_decrypt() */
+#if defined(EVP_CTRL_GCM_SET_TAG)
+#define CRYPTO_OPENSSL_HAVE_GCM 1
+#else
+#define CRYPTO_OPENSSL_HAVE_GCM 0
+#endif
+#if !APR_USE_OPENSSL_PRE_1_1_API && !defined(OPENSSL_NO_CHACHA) \
+    && !defined(OPENSSL_NO_POLY1305)
+#define CRYPTO_OPENSSL_HAVE_CHACHA20_POLY1305 1
+#else
+#define CRYPTO_OPENSSL_HAVE_CHACHA20_POLY1305 0
+#endif
+
 struct apr_crypto_t {
     apr_pool_t *pool;
     const apr_crypto_driver_t *provider;
@@ -85,6 +99,11 @@ struct apr_crypto_key_t {
     int keyLen;
     int doPad;
     int ivSize;
+    int aead;
+    /* An EVP context of the AEAD cipher set up with the key, cached here
+     * between the calls (taken and given back atomically).
+     */
+    void *volatile aeadCtx;
 };
 
 struct apr_crypto_block_t {
@@ -93,6 +112,9 @@ struct apr_crypto_block_t {
     const apr_crypto_t *f;
     const apr_crypto_key_t *key;
     EVP_CIPHER_CTX *cipherCtx;
+    /* the key data set up in cipherCtx, for encrypting or not */
+    const unsigned char *keyData;
+    int encrypt;
     int initialised;
     int ivSize;
     int blockSize;
@@ -129,12 +151,23 @@ static struct apr_crypto_block_key_type_t key_types[] =
 { APR_KEY_3DES_192, 24, 8, 8 },
 { APR_KEY_AES_128, 16, 16, 16 },
 { APR_KEY_AES_192, 24, 16, 16 },
-{ APR_KEY_AES_256, 32, 16, 16 } };
+{ APR_KEY_AES_256, 32, 16, 16 }
+#if CRYPTO_OPENSSL_HAVE_CHACHA20_POLY1305
+, { APR_KEY_CHACHA20, 32, 1, 12 }
+#endif
+};
 
 static struct apr_crypto_block_key_mode_t key_modes[] =
 {
 { APR_MODE_ECB },
-{ APR_MODE_CBC } };
+{ APR_MODE_CBC }
+#if CRYPTO_OPENSSL_HAVE_GCM
+, { APR_MODE_GCM }
+#endif
+#if CRYPTO_OPENSSL_HAVE_CHACHA20_POLY1305
+, { APR_MODE_POLY1305 }
+#endif
+};
 
 /* sufficient space to wrap a key */
 #define BUFFER_SIZE 128
@@ -250,9 +283,15 @@ void EVP_CIPHER_CTX_free(EVP_CIPHER_CTX *ctx)
  */
 static apr_status_t crypto_key_cleanup(apr_crypto_key_t *key)
 {
+    EVP_CIPHER_CTX *aeadCtx;
+
     if (key->pkey) {
         EVP_PKEY_free(key->pkey);
     }
+    aeadCtx = apr_atomic_xchgptr(&key->aeadCtx, NULL);
+    if (aeadCtx) {
+        EVP_CIPHER_CTX_free(aeadCtx);
+    }
 
     return APR_SUCCESS;
 }
@@ -282,6 +321,7 @@ static apr_status_t crypto_block_cleanup(apr_crypto_block_t *ctx)
 #endif
             ctx->cipherCtx = NULL;
         }
+        ctx->keyData = NULL;
         ctx->initialised = 0;
     }
 
@@ -449,6 +489,9 @@ static apr_status_t crypto_make(apr_crypto_t **ff,
     apr_hash_set(f->types, "aes128", APR_HASH_KEY_STRING, &(key_types[++i]));
     apr_hash_set(f->types, "aes192", APR_HASH_KEY_STRING, &(key_types[++i]));
     apr_hash_set(f->types, "aes256", APR_HASH_KEY_STRING, &(key_types[++i]));
+#if CRYPTO_OPENSSL_HAVE_CHACHA20_POLY1305
+    apr_hash_set(f->types, "chacha20", APR_HASH_KEY_STRING, &(key_types[++i]));
+#endif
 
     f->modes = apr_hash_make(pool);
     if (!f->modes) {
@@ -456,6 +499,12 @@ static apr_status_t crypto_make(apr_crypto_t **ff,
     }
     apr_hash_set(f->modes, "ecb", APR_HASH_KEY_STRING, &(key_modes[i = 0]));
     apr_hash_set(f->modes, "cbc", APR_HASH_KEY_STRING, &(key_modes[++i]));
+#if CRYPTO_OPENSSL_HAVE_GCM
+    apr_hash_set(f->modes, "gcm", APR_HASH_KEY_STRING, &(key_modes[++i]));
+#endif
+#if CRYPTO_OPENSSL_HAVE_CHACHA20_POLY1305
+    apr_hash_set(f->modes, "poly1305", APR_HASH_KEY_STRING, &(key_modes[++i]));
+#endif
 
     f->digests = apr_hash_make(pool);
     if (!f->digests) {
@@ -533,6 +582,38 @@ static apr_status_t crypto_cipher_mechanism(apr_crypto_key_t *key,
         const apr_crypto_block_key_type_e type,
         const apr_crypto_block_key_mode_e mode, const int doPad, apr_pool_t *p)
 {
+    EVP_CIPHER_CTX *aeadCtx;
+
+    /* a context cached for the previous key is of no use */
+    aeadCtx = apr_atomic_xchgptr(&key->aeadCtx, NULL);
+    if (aeadCtx) {
+        EVP_CIPHER_CTX_free(aeadCtx);
+    }
+
+    /* the AEAD modes go with their ciphers only */
+    switch (mode) {
+    case APR_MODE_GCM:
+        if (!CRYPTO_OPENSSL_HAVE_GCM || type == APR_KEY_3DES_192
+                || type == APR_KEY_CHACHA20) {
+            return APR_ENOCIPHER;
+        }
+        key->aead = 1;
+        break;
+    case APR_MODE_POLY1305:
+        if (!CRYPTO_OPENSSL_HAVE_CHACHA20_POLY1305
+                || type != APR_KEY_CHACHA20) {
+            return APR_ENOCIPHER;
+        }
+        key->aead = 1;
+        break;
+    default:
+        if (type == APR_KEY_CHACHA20) {
+            return APR_ENOCIPHER;
+        }
+        key->aead = 0;
+        break;
+    }
+
     /* determine the cipher to be used */
     switch (type) {
 
@@ -552,6 +633,11 @@ static apr_status_t crypto_cipher_mechanism(apr_crypto_key_t *key,
         if (mode == APR_MODE_CBC) {
             key->cipher = EVP_aes_128_cbc();
         }
+#if CRYPTO_OPENSSL_HAVE_GCM
+        else if (mode == APR_MODE_GCM) {
+            key->cipher = EVP_aes_128_gcm();
+        }
+#endif
         else {
             key->cipher = EVP_aes_128_ecb();
         }
@@ -562,6 +648,11 @@ static apr_status_t crypto_cipher_mechanism(apr_crypto_key_t *key,
         if (mode == APR_MODE_CBC) {
             key->cipher = EVP_aes_192_cbc();
         }
+#if CRYPTO_OPENSSL_HAVE_GCM
+        else if (mode == APR_MODE_GCM) {
+            key->cipher = EVP_aes_192_gcm();
+        }
+#endif
         else {
             key->cipher = EVP_aes_192_ecb();
         }
@@ -572,11 +663,23 @@ static apr_status_t crypto_cipher_mechanism(apr_crypto_key_t *key,
         if (mode == APR_MODE_CBC) {
             key->cipher = EVP_aes_256_cbc();
         }
+#if CRYPTO_OPENSSL_HAVE_GCM
+        else if (mode == APR_MODE_GCM) {
+            key->cipher = EVP_aes_256_gcm();
+        }
+#endif
         else {
             key->cipher = EVP_aes_256_ecb();
         }
         break;
 
+#if CRYPTO_OPENSSL_HAVE_CHACHA20_POLY1305
+    case (APR_KEY_CHACHA20):
+
+        key->cipher = EVP_chacha20_poly1305();
+        break;
+#endif
+
     default:
 
         /* unknown key type, give up */
@@ -913,18 +1016,30 @@ static apr_status_t crypto_block_encrypt_init(apr_crypto_block_t **ctx,
         return APR_ENOMEM;
     }
     block->f = key->f;
-    block->pool = p;
     block->provider = key->provider;
     block->key = key;
 
-    apr_pool_cleanup_register(p, block, crypto_block_cleanup_helper,
-            apr_pool_cleanup_null);
+    /* a context made again keeps its cleanup, in the same pool */
+    if (block->pool != p) {
+        if (block->pool) {
+            apr_pool_cleanup_kill(block->pool, block,
+                    crypto_block_cleanup_helper);
+        }
+        block->pool = p;
+        apr_pool_cleanup_register(p, block, crypto_block_cleanup_helper,
+                apr_pool_cleanup_null);
+    }
 
     switch (key->rec->ktype) {
 
     case APR_CRYPTO_KTYPE_PASSPHRASE:
     case APR_CRYPTO_KTYPE_SECRET: {
 
+        /* the AEAD ciphers go through crypto_aead_encrypt() */
+        if (key->aead) {
+            return APR_EINVAL;
+        }
+
         /* create a new context for encryption */
         if (!block->initialised) {
             block->cipherCtx = EVP_CIPHER_CTX_new();
@@ -954,15 +1069,29 @@ static apr_status_t crypto_block_encrypt_init(apr_crypto_block_t **ctx,
             }
         }
 
+        /* reusing the context for the same key, only the IV is set */
+        if (block->encrypt && block->keyData == key->key) {
+#if CRYPTO_OPENSSL_CONST_BUFFERS
+            if (!EVP_EncryptInit_ex(block->cipherCtx, NULL, NULL, NULL,
+                    usedIv)) {
+#else
+            if (!EVP_EncryptInit_ex(block->cipherCtx, NULL, NULL, NULL,
+                    (unsigned char *) usedIv)) {
+#endif
+                return APR_EINIT;
+            }
+        }
         /* set up our encryption context */
 #if CRYPTO_OPENSSL_CONST_BUFFERS
-        if (!EVP_EncryptInit_ex(block->cipherCtx, key->cipher, config->engine,
-                key->key, usedIv)) {
+        else if (!EVP_EncryptInit_ex(block->cipherCtx, key->cipher,
+                config->engine, key->key, usedIv)) {
 #else
-        if (!EVP_EncryptInit_ex(block->cipherCtx, key->cipher, config->engine, (unsigned char *) key->key, (unsigned char *) usedIv)) {
+        else if (!EVP_EncryptInit_ex(block->cipherCtx, key->cipher, config->engine, (unsigned char *) key->key, (unsigned char *) usedIv)) {
 #endif
             return APR_EINIT;
         }
+        block->keyData = key->key;
+        block->encrypt = 1;
 
         /* Clear up any read padding */
         if (!EVP_CIPHER_CTX_set_padding(block->cipherCtx, key->doPad)) {
@@ -1083,13 +1212,16 @@ static apr_status_t crypto_block_encrypt_finish(unsigned char *out,
         apr_status_t rc = APR_SUCCESS;
         int len = *outlen;
 
+        /* the EVP context stays set up with the key, for the next
+         * crypto_block_encrypt_init() to only reset the IV
+         */
         if (EVP_EncryptFinal_ex(block->cipherCtx, out, &len) == 0) {
+            crypto_block_cleanup(block);
             rc = APR_EPADDING;
         }
         else {
             *outlen = len;
         }
-        crypto_block_cleanup(block);
 
         return rc;
 
@@ -1131,18 +1263,30 @@ static apr_status_t crypto_block_decrypt_init(apr_crypto_block_t **ctx,
         return APR_ENOMEM;
     }
     block->f = key->f;
-    block->pool = p;
     block->provider = key->provider;
     block->key = key;
 
-    apr_pool_cleanup_register(p, block, crypto_block_cleanup_helper,
-            apr_pool_cleanup_null);
+    /* a context made again keeps its cleanup, in the same pool */
+    if (block->pool != p) {
+        if (block->pool) {
+            apr_pool_cleanup_kill(block->pool, block,
+                    crypto_block_cleanup_helper);
+        }
+        block->pool = p;
+        apr_pool_cleanup_register(p, block, crypto_block_cleanup_helper,
+                apr_pool_cleanup_null);
+    }
 
     switch (key->rec->ktype) {
 
     case APR_CRYPTO_KTYPE_PASSPHRASE:
     case APR_CRYPTO_KTYPE_SECRET: {
 
+        /* the AEAD ciphers go through crypto_aead_decrypt() */
+        if (key->aead) {
+            return APR_EINVAL;
+        }
+
         /* create a new context for encryption */
         if (!block->initialised) {
             block->cipherCtx = EVP_CIPHER_CTX_new();
@@ -1156,15 +1300,28 @@ static apr_status_t crypto_block_decrypt_init(apr_crypto_block_t **ctx,
             }
         }
 
+        /* reusing the context for the same key, only the IV is set */
+        if (!block->encrypt && block->keyData == key->key) {
+#if CRYPTO_OPENSSL_CONST_BUFFERS
+            if (!EVP_DecryptInit_ex(block->cipherCtx, NULL, NULL, NULL, iv)) {
+#else
+            if (!EVP_DecryptInit_ex(block->cipherCtx, NULL, NULL, NULL,
+                    (unsigned char *) iv)) {
+#endif
+                return APR_EINIT;
+            }
+        }
         /* set up our encryption context */
 #if CRYPTO_OPENSSL_CONST_BUFFERS
-        if (!EVP_DecryptInit_ex(block->cipherCtx, key->cipher, config->engine,
-                key->key, iv)) {
+        else if (!EVP_DecryptInit_ex(block->cipherCtx, key->cipher,
+                config->engine, key->key, iv)) {
 #else
-            if (!EVP_DecryptInit_ex(block->cipherCtx, key->cipher, config->engine, (unsigned char *) key->key, (unsigned char *) iv)) {
+        else if (!EVP_DecryptInit_ex(block->cipherCtx, key->cipher, config->engine, (unsigned char *) key->key, (unsigned char *) iv)) {
 #endif
             return APR_EINIT;
         }
+        block->keyData = key->key;
+        block->encrypt = 0;
 
         /* Clear up any read padding */
         if (!EVP_CIPHER_CTX_set_padding(block->cipherCtx, key->doPad)) {
@@ -1286,13 +1443,16 @@ static apr_status_t crypto_block_decrypt_finish(unsigned char *out,
         apr_status_t rc = APR_SUCCESS;
         int len = *outlen;
 
+        /* the EVP context stays set up with the key, for the next
+         * crypto_block_decrypt_init() to only reset the IV
+         */
         if (EVP_DecryptFinal_ex(block->cipherCtx, out, &len) == 0) {
+            crypto_block_cleanup(block);
             rc = APR_EPADDING;
         }
         else {
             *outlen = len;
         }
-        crypto_block_cleanup(block);
 
         return rc;
 
@@ -1306,6 +1466,123 @@ static apr_status_t crypto_block_decrypt_finish(unsigned char *out,
 
 }
 
+/* The EVP functions take int lengths */
+#define CRYPTO_AEAD_CHUNK (1 << 30)
+
+static int crypto_aead_update(EVP_CIPHER_CTX *ctx, unsigned char *out,
+        const unsigned char *in, apr_size_t inlen)
+{
+    int len;
+
+    do {
+        int n = inlen < CRYPTO_AEAD_CHUNK ? (int) inlen : CRYPTO_AEAD_CHUNK;
+
+        if (!EVP_CipherUpdate(ctx, out, &len, (unsigned char *) in, n)) {
+            return 0;
+        }
+        if (out) {
+            out += len;
+        }
+        in += n;
+        inlen -= n;
+    } while (inlen);
+
+    return 1;
+}
+
+/**
+ * @brief Encrypt or decrypt with an AEAD cipher in one go, with the EVP
+ *        context cached in the key (or a new one when another thread has
+ *        it at the same time).
+ */
+static apr_status_t crypto_aead(unsigned char *out, unsigned char *tag,
+        apr_size_t taglen, const unsigned char *in, apr_size_t inlen,
+        const unsigned char *aad, apr_size_t aadlen, const unsigned char *iv,
+        const apr_crypto_key_t *key, int enc)
+{
+    /* the cache only is modified, the key stays the same */
+    apr_crypto_key_t *k = (apr_crypto_key_t *) key;
+    EVP_CIPHER_CTX *ctx;
+    apr_status_t rv = APR_ECRYPT;
+    int len;
+
+    if (!key->aead || !taglen || taglen > APR_CRYPTO_AEAD_TAGSIZE) {
+        return APR_EINVAL;
+    }
+    if (!iv) {
+        return APR_ENOIV;
+    }
+
+    ctx = apr_atomic_xchgptr(&k->aeadCtx, NULL);
+    if (ctx) {
+        if (!EVP_CipherInit_ex(ctx, NULL, NULL, NULL, iv, enc)) {
+            goto out;
+        }
+    }
+    else {
+        ctx = EVP_CIPHER_CTX_new();
+        if (!ctx) {
+            return APR_ENOMEM;
+        }
+        if (!EVP_CipherInit_ex(ctx, key->cipher, key->f->config->engine,
+                key->key, iv, enc)) {
+            goto out;
+        }
+    }
+
+    if (!enc && !EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, (int) taglen,
+            tag)) {
+        goto out;
+    }
+    if (aadlen && !crypto_aead_update(ctx, NULL, aad, aadlen)) {
+        goto out;
+    }
+    if (inlen && !crypto_aead_update(ctx, out, in, inlen)) {
+        goto out;
+    }
+
+    if (enc) {
+        if (!EVP_CipherFinal_ex(ctx, out + inlen, &len)
+                || !EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG,
+                        (int) taglen, tag)) {
+            goto out;
+        }
+    }
+    else if (EVP_CipherFinal_ex(ctx, out + inlen, &len) <= 0) {
+        /* not authentic, nothing of it is given */
+        apr_crypto_memzero(out, inlen);
+        rv = APR_ENOVERIFY;
+        goto cache;
+    }
+    rv = APR_SUCCESS;
+
+cache:
+    /* the next call only resets the IV, unless another one did already */
+    if (apr_atomic_casptr(&k->aeadCtx, ctx, NULL) == NULL) {
+        return rv;
+    }
+out:
+    EVP_CIPHER_CTX_free(ctx);
+    return rv;
+}
+
+static apr_status_t crypto_aead_encrypt(unsigned char *out,
+        unsigned char *tag, apr_size_t taglen, const unsigned char *in,
+        apr_size_t inlen, const unsigned char *aad, apr_size_t aadlen,
+        const unsigned char *iv, const apr_crypto_key_t *key)
+{
+    return crypto_aead(out, tag, taglen, in, inlen, aad, aadlen, iv, key, 1);
+}
+
+static apr_status_t crypto_aead_decrypt(unsigned char *out,
+        const unsigned char *tag, apr_size_t taglen, const unsigned char *in,
+        apr_size_t inlen, const unsigned char *aad, apr_size_t aadlen,
+        const unsigned char *iv, const apr_crypto_key_t *key)
+{
+    return crypto_aead(out, (unsigned char *) tag, taglen, in, inlen, aad,
+            aadlen, iv, key, 0);
+}
+
 static apr_status_t crypto_digest_init(apr_crypto_digest_t **d,
         const apr_crypto_key_t *key, apr_crypto_digest_rec_t *rec, apr_pool_t *p)
 {
@@ -1691,7 +1968,8 @@ APR_MODULE_DECLARE_DATA const apr_crypto_driver_t apr_crypto_openssl_driver = {
     crypto_block_decrypt, crypto_block_decrypt_finish,
     crypto_digest_init, crypto_digest_update, crypto_digest_final, crypto_digest,
     crypto_block_cleanup, crypto_digest_cleanup, crypto_cleanup, crypto_shutdown, crypto_error,
-    crypto_key, cprng_stream_ctx_make, cprng_stream_ctx_free, cprng_stream_ctx_bytes
+    crypto_key, cprng_stream_ctx_make, cprng_stream_ctx_free, cprng_stream_ctx_bytes,
+    crypto_aead_encrypt, crypto_aead_decrypt
 };
 
 #endif
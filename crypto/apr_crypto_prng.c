@@ -55,6 +55,12 @@
 
 #include <stdlib.h> /* for malloc() */
 
+#if defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CPRNG_CHACHA20_SSE2
+#endif
+
 #if APU_HAVE_OPENSSL
 /** Recommended prng driver for this platform */
 #define APU_CRYPTO_PRNG_RECOMMENDED_DRIVER "openssl"
@@ -67,6 +73,8 @@
 
 #define CPRNG_BUF_SIZE_MIN (CPRNG_KEY_SIZE * (8 - 1))
 #define CPRNG_BUF_SIZE_DEF (CPRNG_KEY_SIZE * (24 - 1))
+/* Per-thread CPRNGs are lock free, refill them by larger batches (4KB) */
+#define CPRNG_BUF_SIZE_THREAD (CPRNG_KEY_SIZE * (128 - 1))
 
 APR_TYPEDEF_STRUCT(apr_crypto_t,
     apr_pool_t *pool;
@@ -95,6 +103,16 @@ static apr_thread_mutex_t *cprng_ring_mutex;
 
 static apr_threadkey_t *cprng_thread_key = NULL;
 
+#ifdef APR_THREAD_LOCAL
+/* The CPRNG of the current thread, valid for the apr_crypto_prng_init()
+ * it was created after only (cprng_thread_gen == cprng_gen), which saves
+ * the threadkey lookup.
+ */
+static APR_THREAD_LOCAL apr_crypto_prng_t *cprng_thread;
+static APR_THREAD_LOCAL apr_uint32_t cprng_thread_gen;
+static apr_uint32_t cprng_gen;
+#endif
+
 #define cprng_lock(g) \
     if ((g)->mutex) \
         apr_thread_mutex_lock((g)->mutex)
@@ -113,6 +131,9 @@ static apr_threadkey_t *cprng_thread_key = NULL;
 
 static void cprng_thread_destroy(void *cprng)
 {
+#ifdef APR_THREAD_LOCAL
+    cprng_thread = NULL;
+#endif
     apr_threadkey_private_set(NULL, cprng_thread_key);
     if (cprng) {
         apr_crypto_prng_destroy(cprng);
@@ -154,6 +175,9 @@ APR_DECLARE(apr_status_t) apr_crypto_prng_init(apr_pool_t *pool, apr_crypto_t *c
         if (rv != APR_SUCCESS) {
             return rv;
         }
+#ifdef APR_THREAD_LOCAL
+        cprng_gen++;
+#endif
 #endif
     }
 
@@ -197,6 +221,9 @@ APR_DECLARE(apr_status_t) apr_crypto_prng_term(void)
     return APR_SUCCESS;
 }
 
+static apr_status_t cprng_bytes(apr_crypto_prng_t *cprng,
+                                void *buf, apr_size_t len);
+
 APR_DECLARE(apr_status_t) apr_crypto_random_bytes(void *buf, apr_size_t len)
 {
     if (!cprng_global) {
@@ -218,6 +245,13 @@ APR_DECLARE(apr_status_t) apr_crypto_random_thread_bytes(void *buf,
         return APR_EINIT;
     }
 
+#ifdef APR_THREAD_LOCAL
+    cprng = cprng_thread;
+    if (cprng && cprng_thread_gen == cprng_gen) {
+        return cprng_bytes(cprng, buf, len);
+    }
+#endif
+
     rv = apr_threadkey_private_get(&private, cprng_thread_key);
     if (rv != APR_SUCCESS) {
         return rv;
@@ -225,7 +259,8 @@ APR_DECLARE(apr_status_t) apr_crypto_random_thread_bytes(void *buf,
 
     cprng = private;
     if (!cprng) {
-        rv = apr_crypto_prng_create(&cprng, cprng_global->crypto, cprng_global->cipher, 0,
+        rv = apr_crypto_prng_create(&cprng, cprng_global->crypto,
+                cprng_global->cipher, CPRNG_BUF_SIZE_THREAD,
                 APR_CRYPTO_PRNG_PER_THREAD, NULL, NULL);
         if (rv != APR_SUCCESS) {
             return rv;
@@ -237,8 +272,13 @@ APR_DECLARE(apr_status_t) apr_crypto_random_thread_bytes(void *buf,
             return rv;
         }
     }
+#ifdef APR_THREAD_LOCAL
+    cprng_thread = cprng;
+    cprng_thread_gen = cprng_gen;
+#endif
 
-    return apr_crypto_prng_bytes(cprng, buf, len);
+    /* Per-thread CPRNGs are not locked */
+    return cprng_bytes(cprng, buf, len);
 }
 #endif
 
@@ -374,11 +414,17 @@ APR_DECLARE(apr_status_t) apr_crypto_prng_create(apr_crypto_prng_t **pcprng,
     }
 #endif
 
-    rv = cprng->crypto->provider->cprng_stream_ctx_make(&cprng->ctx,
-            cprng->crypto, cprng->cipher, pool);
-    if (rv != APR_SUCCESS) {
-        cprng_cleanup(cprng);
-        return rv;
+    /* ChaCha20 is built-in (cprng->ctx == NULL), other ciphers are
+     * provided by the driver.
+     */
+    if (cprng->cipher != APR_CRYPTO_CIPHER_AUTO
+            && cprng->cipher != APR_CRYPTO_CIPHER_CHACHA20) {
+        rv = cprng->crypto->provider->cprng_stream_ctx_make(&cprng->ctx,
+                cprng->crypto, cprng->cipher, pool);
+        if (rv != APR_SUCCESS) {
+            cprng_cleanup(cprng);
+            return rv;
+        }
     }
 
     if (seed) {
@@ -428,11 +474,172 @@ APR_DECLARE(apr_status_t) apr_crypto_prng_destroy(apr_crypto_prng_t *cprng)
     return apr_pool_cleanup_run(cprng->pool, cprng, cprng_cleanup);
 }
 
+/*
+ * Built-in ChaCha20 keystream (RFC 8439), with a zero nonce and the block
+ * counter starting at zero, i.e. the same keystream as the drivers'.
+ * The counter never wraps since less than 2^31 bytes are produced for
+ * each key (the buffer size is limited to APR_INT32_MAX).
+ */
+
+#define CHACHA20_ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define CHACHA20_QR(a, b, c, d) do { \
+    a += b; d ^= a; d = CHACHA20_ROTL(d, 16); \
+    c += d; b ^= c; b = CHACHA20_ROTL(b, 12); \
+    a += b; d ^= a; d = CHACHA20_ROTL(d, 8); \
+    c += d; b ^= c; b = CHACHA20_ROTL(b, 7); \
+} while (0)
+
+static void cprng_chacha20_block(apr_uint32_t s[16], unsigned char *out)
+{
+    apr_uint32_t x[16];
+    int i;
+
+    memcpy(x, s, sizeof(x));
+    for (i = 0; i < 10; i++) {
+        CHACHA20_QR(x[0], x[4], x[8], x[12]);
+        CHACHA20_QR(x[1], x[5], x[9], x[13]);
+        CHACHA20_QR(x[2], x[6], x[10], x[14]);
+        CHACHA20_QR(x[3], x[7], x[11], x[15]);
+        CHACHA20_QR(x[0], x[5], x[10], x[15]);
+        CHACHA20_QR(x[1], x[6], x[11], x[12]);
+        CHACHA20_QR(x[2], x[7], x[8], x[13]);
+        CHACHA20_QR(x[3], x[4], x[9], x[14]);
+    }
+    for (i = 0; i < 16; i++) {
+        apr_uint32_t v = x[i] + s[i];
+        out[i * 4 + 0] = (unsigned char)(v);
+        out[i * 4 + 1] = (unsigned char)(v >> 8);
+        out[i * 4 + 2] = (unsigned char)(v >> 16);
+        out[i * 4 + 3] = (unsigned char)(v >> 24);
+    }
+    apr_memzero_explicit(x, sizeof(x));
+    s[12]++;
+}
+
+#ifdef CPRNG_CHACHA20_SSE2
+/* Four blocks at once, each vector holding the same word of the blocks */
+
+#define CHACHA20_ROTL4(v, n) \
+    _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+
+#define CHACHA20_QR4(a, b, c, d) do { \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); \
+    d = _mm_shufflehi_epi16(_mm_shufflelo_epi16(d, 0xB1), 0xB1); \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); \
+    b = CHACHA20_ROTL4(b, 12); \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); \
+    d = CHACHA20_ROTL4(d, 8); \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); \
+    b = CHACHA20_ROTL4(b, 7); \
+} while (0)
+
+static void cprng_chacha20_blocks4(apr_uint32_t s[16], unsigned char *out)
+{
+    __m128i x[16], in[16], t0, t1, t2, t3;
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        in[i] = _mm_set1_epi32((int)s[i]);
+    }
+    in[12] = _mm_add_epi32(in[12], _mm_set_epi32(3, 2, 1, 0));
+    memcpy(x, in, sizeof(x));
+
+    for (i = 0; i < 10; i++) {
+        CHACHA20_QR4(x[0], x[4], x[8], x[12]);
+        CHACHA20_QR4(x[1], x[5], x[9], x[13]);
+        CHACHA20_QR4(x[2], x[6], x[10], x[14]);
+        CHACHA20_QR4(x[3], x[7], x[11], x[15]);
+        CHACHA20_QR4(x[0], x[5], x[10], x[15]);
+        CHACHA20_QR4(x[1], x[6], x[11], x[12]);
+        CHACHA20_QR4(x[2], x[7], x[8], x[13]);
+        CHACHA20_QR4(x[3], x[4], x[9], x[14]);
+    }
+
+    /* Transpose each group of four words back to the blocks */
+    for (i = 0; i < 16; i += 4) {
+        __m128i a0 = _mm_add_epi32(x[i + 0], in[i + 0]);
+        __m128i a1 = _mm_add_epi32(x[i + 1], in[i + 1]);
+        __m128i a2 = _mm_add_epi32(x[i + 2], in[i + 2]);
+        __m128i a3 = _mm_add_epi32(x[i + 3], in[i + 3]);
+
+        t0 = _mm_unpacklo_epi32(a0, a1);
+        t1 = _mm_unpacklo_epi32(a2, a3);
+        t2 = _mm_unpackhi_epi32(a0, a1);
+        t3 = _mm_unpackhi_epi32(a2, a3);
+        _mm_storeu_si128((__m128i *)(out + i * 4),
+                         _mm_unpacklo_epi64(t0, t1));
+        _mm_storeu_si128((__m128i *)(out + 64 + i * 4),
+                         _mm_unpackhi_epi64(t0, t1));
+        _mm_storeu_si128((__m128i *)(out + 128 + i * 4),
+                         _mm_unpacklo_epi64(t2, t3));
+        _mm_storeu_si128((__m128i *)(out + 192 + i * 4),
+                         _mm_unpackhi_epi64(t2, t3));
+    }
+    apr_memzero_explicit(x, sizeof(x));
+    apr_memzero_explicit(in, sizeof(in));
+    s[12] += 4;
+}
+#endif /* CPRNG_CHACHA20_SSE2 */
+
+static void cprng_chacha20_bytes(unsigned char *key, unsigned char *to,
+                                 apr_size_t n)
+{
+    apr_uint32_t s[16];
+    unsigned char block[64];
+    apr_size_t m;
+    int i;
+
+    /* "expand 32-byte k" */
+    s[0] = 0x61707865;
+    s[1] = 0x3320646e;
+    s[2] = 0x79622d32;
+    s[3] = 0x6b206574;
+    for (i = 0; i < 8; i++) {
+        s[4 + i] = (apr_uint32_t)key[i * 4]
+                   | (apr_uint32_t)key[i * 4 + 1] << 8
+                   | (apr_uint32_t)key[i * 4 + 2] << 16
+                   | (apr_uint32_t)key[i * 4 + 3] << 24;
+    }
+    s[12] = s[13] = s[14] = s[15] = 0;
+
+    /* The next key first, then the random bytes (possibly to the key) */
+    cprng_chacha20_block(s, block);
+    memcpy(key, block, CPRNG_KEY_SIZE);
+    if (n) {
+        m = (n < 64 - CPRNG_KEY_SIZE) ? n : 64 - CPRNG_KEY_SIZE;
+        memcpy(to, block + CPRNG_KEY_SIZE, m);
+        to += m;
+        n -= m;
+
+#ifdef CPRNG_CHACHA20_SSE2
+        for (; n >= 4 * 64; n -= 4 * 64, to += 4 * 64) {
+            cprng_chacha20_blocks4(s, to);
+        }
+#endif
+        for (; n >= 64; n -= 64, to += 64) {
+            cprng_chacha20_block(s, to);
+        }
+        if (n) {
+            cprng_chacha20_block(s, block);
+            memcpy(to, block, n);
+        }
+    }
+
+    apr_memzero_explicit(block, sizeof(block));
+    apr_memzero_explicit(s, sizeof(s));
+}
+
 static apr_status_t cprng_stream_bytes(apr_crypto_prng_t *cprng,
                                        void *to, apr_size_t len)
 {
     apr_status_t rv;
 
+    if (!cprng->ctx) {
+        cprng_chacha20_bytes(cprng->key, to, len);
+        return APR_SUCCESS;
+    }
+
     rv = cprng->crypto->provider->cprng_stream_ctx_bytes(&cprng->ctx,
             cprng->key, to, len, cprng->buf);
     if (rv != APR_SUCCESS && len) {
@@ -89,8 +89,6 @@
 static void MD5Transform(apr_uint32_t state[4], const unsigned char block[64]);
 static void Encode(unsigned char *output, const apr_uint32_t *input,
                    unsigned int len);
-static void Decode(apr_uint32_t *output, const unsigned char *input,
-                   unsigned int len);
 
 static const unsigned char PADDING[64] =
 {
@@ -105,13 +103,22 @@ static apr_xlate_t *xlate_ebcdic_to_ascii; /* used in apr_md5_encode() */
 #define DO_XLATE 0
 #define SKIP_XLATE 1
 
-/* F, G, H and I are basic MD5 functions.
+/* F, G, H and I are basic MD5 functions.  F selects with one operation
+ * less than the textbook form, and G is the sum of two disjoint halves,
+ * which GG adds one at a time to shorten the dependency chain on b.
  */
-#define F(x, y, z) (((x) & (y)) | ((~x) & (z)))
-#define G(x, y, z) (((x) & (z)) | ((y) & (~z)))
+#define F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define G1(x, y, z) ((y) & (~z))
+#define G2(x, y, z) ((x) & (z))
 #define H(x, y, z) ((x) ^ (y) ^ (z))
 #define I(x, y, z) ((y) ^ ((x) | (~z)))
 
+/* LOAD_LE32 reads the little-endian word at p.
+ */
+#define LOAD_LE32(p) \
+    ((apr_uint32_t)(p)[0] | (apr_uint32_t)(p)[1] << 8 | \
+     (apr_uint32_t)(p)[2] << 16 | (apr_uint32_t)(p)[3] << 24)
+
 /* ROTATE_LEFT rotates x left n bits.
  */
 #define ROTATE_LEFT(x, n) (((x) << (n)) | ((x) >> (32-(n))))
@@ -125,7 +132,8 @@ static apr_xlate_t *xlate_ebcdic_to_ascii; /* used in apr_md5_encode() */
  (a) += (b); \
   }
 #define GG(a, b, c, d, x, s, ac) { \
- (a) += G ((b), (c), (d)) + (x) + (apr_uint32_t)(ac); \
+ (a) += G1 ((b), (c), (d)) + (x) + (apr_uint32_t)(ac); \
+ (a) += G2 ((b), (c), (d)); \
  (a) = ROTATE_LEFT ((a), (s)); \
  (a) += (b); \
   }
@@ -140,6 +148,80 @@ static apr_xlate_t *xlate_ebcdic_to_ascii; /* used in apr_md5_encode() */
  (a) += (b); \
   }
 
+/* The 64 steps of the MD5 transform, on words or on vectors of them */
+#define MD5_ROUNDS(a, b, c, d, x) \
+    /* Round 1 */                                    \
+    FF(a, b, c, d, x[0],  S11, 0xd76aa478); /* 1 */  \
+    FF(d, a, b, c, x[1],  S12, 0xe8c7b756); /* 2 */  \
+    FF(c, d, a, b, x[2],  S13, 0x242070db); /* 3 */  \
+    FF(b, c, d, a, x[3],  S14, 0xc1bdceee); /* 4 */  \
+    FF(a, b, c, d, x[4],  S11, 0xf57c0faf); /* 5 */  \
+    FF(d, a, b, c, x[5],  S12, 0x4787c62a); /* 6 */  \
+    FF(c, d, a, b, x[6],  S13, 0xa8304613); /* 7 */  \
+    FF(b, c, d, a, x[7],  S14, 0xfd469501); /* 8 */  \
+    FF(a, b, c, d, x[8],  S11, 0x698098d8); /* 9 */  \
+    FF(d, a, b, c, x[9],  S12, 0x8b44f7af); /* 10 */ \
+    FF(c, d, a, b, x[10], S13, 0xffff5bb1); /* 11 */ \
+    FF(b, c, d, a, x[11], S14, 0x895cd7be); /* 12 */ \
+    FF(a, b, c, d, x[12], S11, 0x6b901122); /* 13 */ \
+    FF(d, a, b, c, x[13], S12, 0xfd987193); /* 14 */ \
+    FF(c, d, a, b, x[14], S13, 0xa679438e); /* 15 */ \
+    FF(b, c, d, a, x[15], S14, 0x49b40821); /* 16 */ \
+                                                     \
+    /* Round 2 */                                    \
+    GG(a, b, c, d, x[1],  S21, 0xf61e2562); /* 17 */ \
+    GG(d, a, b, c, x[6],  S22, 0xc040b340); /* 18 */ \
+    GG(c, d, a, b, x[11], S23, 0x265e5a51); /* 19 */ \
+    GG(b, c, d, a, x[0],  S24, 0xe9b6c7aa); /* 20 */ \
+    GG(a, b, c, d, x[5],  S21, 0xd62f105d); /* 21 */ \
+    GG(d, a, b, c, x[10], S22, 0x2441453);  /* 22 */ \
+    GG(c, d, a, b, x[15], S23, 0xd8a1e681); /* 23 */ \
+    GG(b, c, d, a, x[4],  S24, 0xe7d3fbc8); /* 24 */ \
+    GG(a, b, c, d, x[9],  S21, 0x21e1cde6); /* 25 */ \
+    GG(d, a, b, c, x[14], S22, 0xc33707d6); /* 26 */ \
+    GG(c, d, a, b, x[3],  S23, 0xf4d50d87); /* 27 */ \
+    GG(b, c, d, a, x[8],  S24, 0x455a14ed); /* 28 */ \
+    GG(a, b, c, d, x[13], S21, 0xa9e3e905); /* 29 */ \
+    GG(d, a, b, c, x[2],  S22, 0xfcefa3f8); /* 30 */ \
+    GG(c, d, a, b, x[7],  S23, 0x676f02d9); /* 31 */ \
+    GG(b, c, d, a, x[12], S24, 0x8d2a4c8a); /* 32 */ \
+                                                     \
+    /* Round 3 */                                    \
+    HH(a, b, c, d, x[5],  S31, 0xfffa3942); /* 33 */ \
+    HH(d, a, b, c, x[8],  S32, 0x8771f681); /* 34 */ \
+    HH(c, d, a, b, x[11], S33, 0x6d9d6122); /* 35 */ \
+    HH(b, c, d, a, x[14], S34, 0xfde5380c); /* 36 */ \
+    HH(a, b, c, d, x[1],  S31, 0xa4beea44); /* 37 */ \
+    HH(d, a, b, c, x[4],  S32, 0x4bdecfa9); /* 38 */ \
+    HH(c, d, a, b, x[7],  S33, 0xf6bb4b60); /* 39 */ \
+    HH(b, c, d, a, x[10], S34, 0xbebfbc70); /* 40 */ \
+    HH(a, b, c, d, x[13], S31, 0x289b7ec6); /* 41 */ \
+    HH(d, a, b, c, x[0],  S32, 0xeaa127fa); /* 42 */ \
+    HH(c, d, a, b, x[3],  S33, 0xd4ef3085); /* 43 */ \
+    HH(b, c, d, a, x[6],  S34, 0x4881d05);  /* 44 */ \
+    HH(a, b, c, d, x[9],  S31, 0xd9d4d039); /* 45 */ \
+    HH(d, a, b, c, x[12], S32, 0xe6db99e5); /* 46 */ \
+    HH(c, d, a, b, x[15], S33, 0x1fa27cf8); /* 47 */ \
+    HH(b, c, d, a, x[2],  S34, 0xc4ac5665); /* 48 */ \
+                                                     \
+    /* Round 4 */                                    \
+    II(a, b, c, d, x[0],  S41, 0xf4292244); /* 49 */ \
+    II(d, a, b, c, x[7],  S42, 0x432aff97); /* 50 */ \
+    II(c, d, a, b, x[14], S43, 0xab9423a7); /* 51 */ \
+    II(b, c, d, a, x[5],  S44, 0xfc93a039); /* 52 */ \
+    II(a, b, c, d, x[12], S41, 0x655b59c3); /* 53 */ \
+    II(d, a, b, c, x[3],  S42, 0x8f0ccc92); /* 54 */ \
+    II(c, d, a, b, x[10], S43, 0xffeff47d); /* 55 */ \
+    II(b, c, d, a, x[1],  S44, 0x85845dd1); /* 56 */ \
+    II(a, b, c, d, x[8],  S41, 0x6fa87e4f); /* 57 */ \
+    II(d, a, b, c, x[15], S42, 0xfe2ce6e0); /* 58 */ \
+    II(c, d, a, b, x[6],  S43, 0xa3014314); /* 59 */ \
+    II(b, c, d, a, x[13], S44, 0x4e0811a1); /* 60 */ \
+    II(a, b, c, d, x[4],  S41, 0xf7537e82); /* 61 */ \
+    II(d, a, b, c, x[11], S42, 0xbd3af235); /* 62 */ \
+    II(c, d, a, b, x[2],  S43, 0x2ad7d2bb); /* 63 */ \
+    II(b, c, d, a, x[9],  S44, 0xeb86d391); /* 64 */
+
 /* MD5 initialization. Begins an MD5 operation, writing a new context.
  */
 APR_DECLARE(apr_status_t) apr_md5_init(apr_md5_ctx_t *context)
@@ -334,6 +416,126 @@ APR_DECLARE(apr_status_t) apr_md5(unsigned char digest[APR_MD5_DIGESTSIZE],
     return apr_md5_final(digest, &ctx);
 }
 
+/* Several messages are hashed at once in the lanes of vectors, using the
+ * compiler's generic vector extension.  The eight lanes are held in pairs
+ * of SSE2 or NEON registers, two independent chains that keep the vector
+ * units busier than a single AVX2 register of eight lanes does.
+ */
+#if defined(__GNUC__) && (defined(__SSE2__) || defined(__ARM_NEON)) \
+    && (defined(__clang__) || __GNUC__ >= 5)
+#define MD5_LANES 8
+
+typedef apr_uint32_t md5_lanes_t __attribute__((vector_size(32)));
+
+static void md5_multi_lanes(unsigned char (*digests)[APR_MD5_DIGESTSIZE],
+                            const void *const *inputs,
+                            const apr_size_t *lens, int n)
+{
+    static const unsigned char zero[64];
+    unsigned char tail[MD5_LANES][128];
+    apr_size_t full[MD5_LANES], blocks[MD5_LANES], most = 0, t;
+    md5_lanes_t state[4], x[16], a, b, c, d;
+    int i, j;
+
+    /* The last partial block of each message is padded in tail */
+    for (i = 0; i < MD5_LANES; i++) {
+        apr_size_t rest, size;
+        apr_uint64_t bits;
+
+        if (i >= n) {
+            full[i] = blocks[i] = 0;
+            continue;
+        }
+        full[i] = lens[i] / 64;
+        rest = lens[i] % 64;
+        size = (rest < 56) ? 64 : 128;
+        memcpy(tail[i], (const unsigned char *)inputs[i] + full[i] * 64,
+               rest);
+        memcpy(tail[i] + rest, PADDING, size - rest - 8);
+        bits = (apr_uint64_t)lens[i] << 3;
+        for (j = 0; j < 8; j++) {
+            tail[i][size - 8 + j] = (unsigned char)(bits >> (8 * j));
+        }
+        blocks[i] = full[i] + size / 64;
+        if (most < blocks[i]) {
+            most = blocks[i];
+        }
+    }
+
+    for (j = 0; j < MD5_LANES; j++) {
+        state[0][j] = 0x67452301;
+        state[1][j] = 0xefcdab89;
+        state[2][j] = 0x98badcfe;
+        state[3][j] = 0x10325476;
+    }
+
+    for (t = 0; t < most; t++) {
+        const unsigned char *p[MD5_LANES];
+
+        /* finished lanes hash zeros, and their result is ignored */
+        for (i = 0; i < MD5_LANES; i++) {
+            if (t < full[i]) {
+                p[i] = (const unsigned char *)inputs[i] + t * 64;
+            }
+            else if (t < blocks[i]) {
+                p[i] = tail[i] + (t - full[i]) * 64;
+            }
+            else {
+                p[i] = zero;
+            }
+        }
+        for (j = 0; j < 16; j++) {
+            for (i = 0; i < MD5_LANES; i++) {
+                x[j][i] = LOAD_LE32(p[i] + 4 * j);
+            }
+        }
+
+        a = state[0];
+        b = state[1];
+        c = state[2];
+        d = state[3];
+        MD5_ROUNDS(a, b, c, d, x);
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+
+        for (i = 0; i < n; i++) {
+            if (blocks[i] == t + 1) {
+                for (j = 0; j < 4; j++) {
+                    digests[i][4 * j] = (unsigned char)state[j][i];
+                    digests[i][4 * j + 1] = (unsigned char)(state[j][i] >> 8);
+                    digests[i][4 * j + 2] = (unsigned char)(state[j][i] >> 16);
+                    digests[i][4 * j + 3] = (unsigned char)(state[j][i] >> 24);
+                }
+            }
+        }
+    }
+}
+
+#endif /* MD5_LANES */
+
+APR_DECLARE(apr_status_t) apr_md5_multi(unsigned char (*digests)[APR_MD5_DIGESTSIZE],
+                                        const void *const *inputs,
+                                        const apr_size_t *lens, int n)
+{
+    int i = 0;
+
+#ifdef MD5_LANES
+    /* Fewer messages than this are faster one at a time */
+    for (; n - i >= 3; i += MD5_LANES) {
+        md5_multi_lanes(digests + i, inputs + i, lens + i,
+                        (n - i < MD5_LANES) ? n - i : MD5_LANES);
+    }
+#endif
+
+    for (; i < n; i++) {
+        apr_md5(digests[i], inputs[i], lens[i]);
+    }
+
+    return APR_SUCCESS;
+}
+
 /* MD5 basic transformation. Transforms state based on block. */
 static void MD5Transform(apr_uint32_t state[4], const unsigned char block[64])
 {
@@ -347,81 +549,18 @@ static void MD5Transform(apr_uint32_t state[4], const unsigned char block[64])
     } else
 #endif
     {
-        Decode(tmpbuf, block, 64);
-	x = tmpbuf;
+#if !APR_IS_BIGENDIAN
+        memcpy(tmpbuf, block, 64);
+#else
+        int i;
+
+        for (i = 0; i < 16; i++)
+            tmpbuf[i] = LOAD_LE32(block + 4 * i);
+#endif
+        x = tmpbuf;
     }
 
-    /* Round 1 */
-    FF(a, b, c, d, x[0],  S11, 0xd76aa478); /* 1 */
-    FF(d, a, b, c, x[1],  S12, 0xe8c7b756); /* 2 */
-    FF(c, d, a, b, x[2],  S13, 0x242070db); /* 3 */
-    FF(b, c, d, a, x[3],  S14, 0xc1bdceee); /* 4 */
-    FF(a, b, c, d, x[4],  S11, 0xf57c0faf); /* 5 */
-    FF(d, a, b, c, x[5],  S12, 0x4787c62a); /* 6 */
-    FF(c, d, a, b, x[6],  S13, 0xa8304613); /* 7 */
-    FF(b, c, d, a, x[7],  S14, 0xfd469501); /* 8 */
-    FF(a, b, c, d, x[8],  S11, 0x698098d8); /* 9 */
-    FF(d, a, b, c, x[9],  S12, 0x8b44f7af); /* 10 */
-    FF(c, d, a, b, x[10], S13, 0xffff5bb1); /* 11 */
-    FF(b, c, d, a, x[11], S14, 0x895cd7be); /* 12 */
-    FF(a, b, c, d, x[12], S11, 0x6b901122); /* 13 */
-    FF(d, a, b, c, x[13], S12, 0xfd987193); /* 14 */
-    FF(c, d, a, b, x[14], S13, 0xa679438e); /* 15 */
-    FF(b, c, d, a, x[15], S14, 0x49b40821); /* 16 */
-
-    /* Round 2 */
-    GG(a, b, c, d, x[1],  S21, 0xf61e2562); /* 17 */
-    GG(d, a, b, c, x[6],  S22, 0xc040b340); /* 18 */
-    GG(c, d, a, b, x[11], S23, 0x265e5a51); /* 19 */
-    GG(b, c, d, a, x[0],  S24, 0xe9b6c7aa); /* 20 */
-    GG(a, b, c, d, x[5],  S21, 0xd62f105d); /* 21 */
-    GG(d, a, b, c, x[10], S22, 0x2441453);  /* 22 */
-    GG(c, d, a, b, x[15], S23, 0xd8a1e681); /* 23 */
-    GG(b, c, d, a, x[4],  S24, 0xe7d3fbc8); /* 24 */
-    GG(a, b, c, d, x[9],  S21, 0x21e1cde6); /* 25 */
-    GG(d, a, b, c, x[14], S22, 0xc33707d6); /* 26 */
-    GG(c, d, a, b, x[3],  S23, 0xf4d50d87); /* 27 */
-    GG(b, c, d, a, x[8],  S24, 0x455a14ed); /* 28 */
-    GG(a, b, c, d, x[13], S21, 0xa9e3e905); /* 29 */
-    GG(d, a, b, c, x[2],  S22, 0xfcefa3f8); /* 30 */
-    GG(c, d, a, b, x[7],  S23, 0x676f02d9); /* 31 */
-    GG(b, c, d, a, x[12], S24, 0x8d2a4c8a); /* 32 */
-
-    /* Round 3 */
-    HH(a, b, c, d, x[5],  S31, 0xfffa3942); /* 33 */
-    HH(d, a, b, c, x[8],  S32, 0x8771f681); /* 34 */
-    HH(c, d, a, b, x[11], S33, 0x6d9d6122); /* 35 */
-    HH(b, c, d, a, x[14], S34, 0xfde5380c); /* 36 */
-    HH(a, b, c, d, x[1],  S31, 0xa4beea44); /* 37 */
-    HH(d, a, b, c, x[4],  S32, 0x4bdecfa9); /* 38 */
-    HH(c, d, a, b, x[7],  S33, 0xf6bb4b60); /* 39 */
-    HH(b, c, d, a, x[10], S34, 0xbebfbc70); /* 40 */
-    HH(a, b, c, d, x[13], S31, 0x289b7ec6); /* 41 */
-    HH(d, a, b, c, x[0],  S32, 0xeaa127fa); /* 42 */
-    HH(c, d, a, b, x[3],  S33, 0xd4ef3085); /* 43 */
-    HH(b, c, d, a, x[6],  S34, 0x4881d05);  /* 44 */
-    HH(a, b, c, d, x[9],  S31, 0xd9d4d039); /* 45 */
-    HH(d, a, b, c, x[12], S32, 0xe6db99e5); /* 46 */
-    HH(c, d, a, b, x[15], S33, 0x1fa27cf8); /* 47 */
-    HH(b, c, d, a, x[2],  S34, 0xc4ac5665); /* 48 */
-
-    /* Round 4 */
-    II(a, b, c, d, x[0],  S41, 0xf4292244); /* 49 */
-    II(d, a, b, c, x[7],  S42, 0x432aff97); /* 50 */
-    II(c, d, a, b, x[14], S43, 0xab9423a7); /* 51 */
-    II(b, c, d, a, x[5],  S44, 0xfc93a039); /* 52 */
-    II(a, b, c, d, x[12], S41, 0x655b59c3); /* 53 */
-    II(d, a, b, c, x[3],  S42, 0x8f0ccc92); /* 54 */
-    II(c, d, a, b, x[10], S43, 0xffeff47d); /* 55 */
-    II(b, c, d, a, x[1],  S44, 0x85845dd1); /* 56 */
-    II(a, b, c, d, x[8],  S41, 0x6fa87e4f); /* 57 */
-    II(d, a, b, c, x[15], S42, 0xfe2ce6e0); /* 58 */
-    II(c, d, a, b, x[6],  S43, 0xa3014314); /* 59 */
-    II(b, c, d, a, x[13], S44, 0x4e0811a1); /* 60 */
-    II(a, b, c, d, x[4],  S41, 0xf7537e82); /* 61 */
-    II(d, a, b, c, x[11], S42, 0xbd3af235); /* 62 */
-    II(c, d, a, b, x[2],  S43, 0x2ad7d2bb); /* 63 */
-    II(b, c, d, a, x[9],  S44, 0xeb86d391); /* 64 */
+    MD5_ROUNDS(a, b, c, d, x);
 
     state[0] += a;
     state[1] += b;
@@ -455,21 +594,6 @@ static void Encode(unsigned char *output, const apr_uint32_t *input,
     }
 }
 
-/* Decodes input (unsigned char) into output (apr_uint32_t). Assumes len is
- * a multiple of 4.
- */
-static void Decode(apr_uint32_t *output, const unsigned char *input,
-                   unsigned int len)
-{
-    unsigned int i, j;
-
-    for (i = 0, j = 0; j < len; i++, j += 4)
-        output[i] = ((apr_uint32_t)input[j])             |
-                    (((apr_uint32_t)input[j + 1]) << 8)  |
-                    (((apr_uint32_t)input[j + 2]) << 16) |
-                    (((apr_uint32_t)input[j + 3]) << 24);
-}
-
 #if APR_CHARSET_EBCDIC
 APR_DECLARE(apr_status_t) apr_MD5InitEBCDIC(apr_xlate_t *xlate)
 {
@@ -19,6 +19,9 @@
 #include "apr_lib.h"
 #include "apr_private.h"
 #include "apr_sha1.h"
+#include "apr_siphash.h"
+#include "apr_hash.h"
+#include "apr_general.h"
 #include "crypt_blowfish.h"
 
 #if APR_HAVE_STRING_H
@@ -209,6 +212,220 @@ APR_DECLARE(apr_status_t) apr_password_validate(const char *passwd,
     return (strcmp(sample, hash) == 0) ? APR_SUCCESS : APR_EMISMATCH;
 }
 
+/* The cached successes: the hash validated against (NUL terminated) with
+ * a MAC of the password, until it expires.  The entries are chained by
+ * index in their bucket, and in the LRU order, like those of
+ * apr_stat_cached().
+ */
+
+#define PASSWORD_CACHE_BUF 128
+#define PASSWORD_CACHE_TAG (2 * APR_SIPHASH_DSIZE)
+
+typedef struct password_cache_entry_t {
+    unsigned int hash;
+    int bucket_next;
+    int lru_prev;
+    int lru_next;
+    apr_time_t expires;
+    unsigned char tag[PASSWORD_CACHE_TAG];
+    apr_size_t len;
+    char stored[PASSWORD_CACHE_BUF];
+} password_cache_entry_t;
+
+struct apr_password_cache_t {
+    password_cache_entry_t *entries;
+    int *buckets;
+    unsigned int mask;
+    int size;
+    int used;
+    int lru_first;  /* the most recently used */
+    int lru_last;   /* the least recently used */
+    apr_interval_time_t ttl;
+    unsigned char keys[2][APR_SIPHASH_KSIZE];
+};
+
+static apr_status_t password_cache_cleanup(void *data)
+{
+    apr_password_cache_t *c = data;
+
+    apr_memzero_explicit(c->entries,
+                         c->size * sizeof(password_cache_entry_t));
+    apr_memzero_explicit(c->keys, sizeof(c->keys));
+    c->used = 0;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_password_cache_create(
+                                                apr_password_cache_t **cache,
+                                                int size,
+                                                apr_interval_time_t ttl,
+                                                apr_pool_t *p)
+{
+#if APR_HAS_RANDOM
+    apr_password_cache_t *c;
+    unsigned int nbuckets = 1;
+    unsigned int i;
+    apr_status_t rv;
+
+    if (size < 1 || ttl <= 0) {
+        return APR_EINVAL;
+    }
+    while (nbuckets < (unsigned int)size) {
+        nbuckets <<= 1;
+    }
+
+    c = apr_palloc(p, sizeof(*c));
+    rv = apr_generate_random_bytes(&c->keys[0][0], sizeof(c->keys));
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    c->entries = apr_palloc(p, size * sizeof(password_cache_entry_t));
+    c->buckets = apr_palloc(p, nbuckets * sizeof(int));
+    for (i = 0; i < nbuckets; i++) {
+        c->buckets[i] = -1;
+    }
+    c->mask = nbuckets - 1;
+    c->size = size;
+    c->used = 0;
+    c->lru_first = c->lru_last = -1;
+    c->ttl = ttl;
+    apr_pool_cleanup_register(p, c, password_cache_cleanup,
+                              apr_pool_cleanup_null);
+
+    *cache = c;
+    return APR_SUCCESS;
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
+static void password_cache_unlink(apr_password_cache_t *c, int i)
+{
+    password_cache_entry_t *e = &c->entries[i];
+
+    if (e->lru_prev >= 0) {
+        c->entries[e->lru_prev].lru_next = e->lru_next;
+    }
+    else {
+        c->lru_first = e->lru_next;
+    }
+    if (e->lru_next >= 0) {
+        c->entries[e->lru_next].lru_prev = e->lru_prev;
+    }
+    else {
+        c->lru_last = e->lru_prev;
+    }
+}
+
+static void password_cache_use(apr_password_cache_t *c, int i)
+{
+    password_cache_entry_t *e = &c->entries[i];
+
+    e->lru_prev = -1;
+    e->lru_next = c->lru_first;
+    if (c->lru_first >= 0) {
+        c->entries[c->lru_first].lru_prev = i;
+    }
+    else {
+        c->lru_last = i;
+    }
+    c->lru_first = i;
+}
+
+/* Compare the MACs in constant time */
+static int password_cache_equals(const unsigned char *a,
+                                 const unsigned char *b)
+{
+    unsigned char diff = 0;
+    int i;
+
+    for (i = 0; i < PASSWORD_CACHE_TAG; i++) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
+APR_DECLARE(apr_status_t) apr_password_validate_cached(
+                                                apr_password_cache_t *cache,
+                                                const char *passwd,
+                                                const char *hash)
+{
+    password_cache_entry_t *e = NULL;
+    unsigned char tag[PASSWORD_CACHE_TAG];
+    apr_ssize_t len = APR_HASH_KEY_STRING;
+    apr_size_t plen = strlen(passwd);
+    apr_time_t now;
+    apr_status_t rv;
+    unsigned int h;
+    int i, *ref;
+
+    h = apr_hashfunc_default(hash, &len);
+    if ((apr_size_t)len >= PASSWORD_CACHE_BUF) {
+        return apr_password_validate(passwd, hash);
+    }
+
+    for (i = cache->buckets[h & cache->mask]; i >= 0;
+         i = cache->entries[i].bucket_next) {
+        e = &cache->entries[i];
+        if (e->hash == h && e->len == (apr_size_t)len
+            && !memcmp(e->stored, hash, len)) {
+            break;
+        }
+    }
+
+    apr_siphash24_auth(tag, passwd, plen, cache->keys[0]);
+    apr_siphash24_auth(tag + APR_SIPHASH_DSIZE, passwd, plen, cache->keys[1]);
+    now = apr_time_now();
+
+    if (i >= 0 && e->expires > now && password_cache_equals(e->tag, tag)) {
+        apr_memzero_explicit(tag, sizeof(tag));
+        password_cache_unlink(cache, i);
+        password_cache_use(cache, i);
+        return APR_SUCCESS;
+    }
+
+    /* Only the successes are cached, a mismatch keeps the entry */
+    rv = apr_password_validate(passwd, hash);
+    if (rv != APR_SUCCESS) {
+        apr_memzero_explicit(tag, sizeof(tag));
+        return rv;
+    }
+
+    if (i < 0) {
+        /* Take a new entry, or replace the least recently used one */
+        if (cache->used < cache->size) {
+            i = cache->used++;
+        }
+        else {
+            i = cache->lru_last;
+            e = &cache->entries[i];
+            for (ref = &cache->buckets[e->hash & cache->mask]; *ref != i;
+                 ref = &cache->entries[*ref].bucket_next) {
+                /* find the link to the entry */
+            }
+            *ref = e->bucket_next;
+            password_cache_unlink(cache, i);
+            apr_memzero_explicit(e, sizeof(*e));
+        }
+        e = &cache->entries[i];
+        e->hash = h;
+        e->len = len;
+        memcpy(e->stored, hash, len + 1);
+        e->bucket_next = cache->buckets[h & cache->mask];
+        cache->buckets[h & cache->mask] = i;
+    }
+    else {
+        password_cache_unlink(cache, i);
+    }
+    password_cache_use(cache, i);
+
+    memcpy(e->tag, tag, sizeof(tag));
+    apr_memzero_explicit(tag, sizeof(tag));
+    e->expires = now + cache->ttl;
+
+    return APR_SUCCESS;
+}
+
 static const char * const bcrypt_id = "$2y$";
 APR_DECLARE(apr_status_t) apr_bcrypt_encode(const char *pw,
                                             unsigned int count,
@@ -51,6 +51,7 @@
 #if APR_CHARSET_EBCDIC
 #include "apr_xlate.h"
 #endif /*APR_CHARSET_EBCDIC*/
+#include "apr_sha_private.h"
 #include <string.h>
 
 /* a bit faster & bigger, if defined */
@@ -201,6 +202,73 @@ static void maybe_byte_reverse(apr_uint32_t *buffer, int count)
     }
 }
 
+#ifdef SHA_NI
+
+/* Four rounds of SHA-NI, the s-th of the twenty, on the message words
+ * in M[s % 4], scheduling the words of the rounds to come as it goes.
+ */
+#define SHA1_NI_STEP(s) \
+    E[(s) & 1] = (s) ? _mm_sha1nexte_epu32(E[(s) & 1], M[(s) % 4]) \
+                     : _mm_add_epi32(E[0], M[0]); \
+    E[((s) + 1) & 1] = ABCD; \
+    if ((s) >= 3 && (s) <= 18) \
+        M[((s) + 1) % 4] = _mm_sha1msg2_epu32(M[((s) + 1) % 4], M[(s) % 4]); \
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E[(s) & 1], (s) / 5); \
+    if ((s) >= 1 && (s) <= 16) \
+        M[((s) + 3) % 4] = _mm_sha1msg1_epu32(M[((s) + 3) % 4], M[(s) % 4]); \
+    if ((s) >= 2 && (s) <= 17) \
+        M[((s) + 2) % 4] = _mm_xor_si128(M[((s) + 2) % 4], M[(s) % 4])
+
+/* do SHA transformation of a block of big endian words with SHA-NI */
+SHA_NI_TARGET
+static void sha_transform_ni(apr_uint32_t digest[5], const apr_byte_t *block)
+{
+    const __m128i mask = _mm_set_epi64x(APR_INT64_C(0x0001020304050607),
+                                        APR_INT64_C(0x08090a0b0c0d0e0f));
+    __m128i ABCD, ABCD_SAVE, E_SAVE, E[2], M[4];
+    int i;
+
+    ABCD = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)digest), 0x1B);
+    E[0] = _mm_set_epi32(digest[4], 0, 0, 0);
+    ABCD_SAVE = ABCD;
+    E_SAVE = E[0];
+
+    for (i = 0; i < 4; i++) {
+        M[i] = _mm_shuffle_epi8(
+                _mm_loadu_si128((const __m128i *)(block + 16 * i)), mask);
+    }
+
+    SHA1_NI_STEP(0);  SHA1_NI_STEP(1);  SHA1_NI_STEP(2);  SHA1_NI_STEP(3);
+    SHA1_NI_STEP(4);  SHA1_NI_STEP(5);  SHA1_NI_STEP(6);  SHA1_NI_STEP(7);
+    SHA1_NI_STEP(8);  SHA1_NI_STEP(9);  SHA1_NI_STEP(10); SHA1_NI_STEP(11);
+    SHA1_NI_STEP(12); SHA1_NI_STEP(13); SHA1_NI_STEP(14); SHA1_NI_STEP(15);
+    SHA1_NI_STEP(16); SHA1_NI_STEP(17); SHA1_NI_STEP(18); SHA1_NI_STEP(19);
+
+    E[0] = _mm_sha1nexte_epu32(E[0], E_SAVE);
+    ABCD = _mm_add_epi32(ABCD, ABCD_SAVE);
+
+    _mm_storeu_si128((__m128i *)digest, _mm_shuffle_epi32(ABCD, 0x1B));
+    digest[4] = (apr_uint32_t)_mm_extract_epi32(E[0], 3);
+}
+
+#endif /* SHA_NI */
+
+/* do SHA transformation of a block as read, in big endian words */
+static void sha_block(apr_sha1_ctx_t *sha_info, const apr_byte_t *block)
+{
+#ifdef SHA_NI
+    if (HAVE_SHA_NI()) {
+        sha_transform_ni(sha_info->digest, block);
+        return;
+    }
+#endif
+    if (block != (const apr_byte_t *) sha_info->data) {
+        memcpy(sha_info->data, block, SHA_BLOCKSIZE);
+    }
+    maybe_byte_reverse(sha_info->data, SHA_BLOCKSIZE);
+    sha_transform(sha_info);
+}
+
 /* initialize the SHA digest */
 
 APR_DECLARE(void) apr_sha1_init(apr_sha1_ctx_t *sha_info)
@@ -238,19 +306,16 @@ APR_DECLARE(void) apr_sha1_update_binary(apr_sha1_ctx_t *sha_info,
         buffer += i;
         sha_info->local += i;
         if (sha_info->local == SHA_BLOCKSIZE) {
-            maybe_byte_reverse(sha_info->data, SHA_BLOCKSIZE);
-            sha_transform(sha_info);
+            sha_block(sha_info, (apr_byte_t *) sha_info->data);
         }
         else {
             return;
         }
     }
     while (count >= SHA_BLOCKSIZE) {
-        memcpy(sha_info->data, buffer, SHA_BLOCKSIZE);
+        sha_block(sha_info, buffer);
         buffer += SHA_BLOCKSIZE;
         count -= SHA_BLOCKSIZE;
-        maybe_byte_reverse(sha_info->data, SHA_BLOCKSIZE);
-        sha_transform(sha_info);
     }
     memcpy(sha_info->data, buffer, count);
     sha_info->local = count;
@@ -283,8 +348,7 @@ APR_DECLARE(void) apr_sha1_update(apr_sha1_ctx_t *sha_info, const char *buf,
         buffer += i;
         sha_info->local += i;
         if (sha_info->local == SHA_BLOCKSIZE) {
-            maybe_byte_reverse(sha_info->data, SHA_BLOCKSIZE);
-            sha_transform(sha_info);
+            sha_block(sha_info, (apr_byte_t *) sha_info->data);
         }
         else {
             return;
@@ -296,8 +360,7 @@ APR_DECLARE(void) apr_sha1_update(apr_sha1_ctx_t *sha_info, const char *buf,
                               (apr_byte_t *) sha_info->data, &outbytes_left);
         buffer += SHA_BLOCKSIZE;
         count -= SHA_BLOCKSIZE;
-        maybe_byte_reverse(sha_info->data, SHA_BLOCKSIZE);
-        sha_transform(sha_info);
+        sha_block(sha_info, (apr_byte_t *) sha_info->data);
     }
     inbytes_left = outbytes_left = count;
     apr_xlate_conv_buffer(ebcdic2ascii_xlate, buffer, &inbytes_left,
@@ -316,24 +379,25 @@ APR_DECLARE(void) apr_sha1_final(unsigned char digest[APR_SHA1_DIGESTSIZE],
     int count, i, j;
     apr_uint32_t lo_bit_count, hi_bit_count, k;
 
+    apr_byte_t *data = (apr_byte_t *) sha_info->data;
+
     lo_bit_count = sha_info->count_lo;
     hi_bit_count = sha_info->count_hi;
     count = (int) ((lo_bit_count >> 3) & 0x3f);
-    ((apr_byte_t *) sha_info->data)[count++] = 0x80;
+    data[count++] = 0x80;
     if (count > SHA_BLOCKSIZE - 8) {
-        memset(((apr_byte_t *) sha_info->data) + count, 0, SHA_BLOCKSIZE - count);
-        maybe_byte_reverse(sha_info->data, SHA_BLOCKSIZE);
-        sha_transform(sha_info);
-        memset((apr_byte_t *) sha_info->data, 0, SHA_BLOCKSIZE - 8);
+        memset(data + count, 0, SHA_BLOCKSIZE - count);
+        sha_block(sha_info, data);
+        memset(data, 0, SHA_BLOCKSIZE - 8);
     }
     else {
-        memset(((apr_byte_t *) sha_info->data) + count, 0,
-               SHA_BLOCKSIZE - 8 - count);
+        memset(data + count, 0, SHA_BLOCKSIZE - 8 - count);
     }
-    maybe_byte_reverse(sha_info->data, SHA_BLOCKSIZE);
-    sha_info->data[14] = hi_bit_count;
-    sha_info->data[15] = lo_bit_count;
-    sha_transform(sha_info);
+    for (i = 0; i < 4; i++) {
+        data[SHA_BLOCKSIZE - 8 + i] = (apr_byte_t) (hi_bit_count >> (24 - 8 * i));
+        data[SHA_BLOCKSIZE - 4 + i] = (apr_byte_t) (lo_bit_count >> (24 - 8 * i));
+    }
+    sha_block(sha_info, data);
 
     for (i = 0, j = 0; j < APR_SHA1_DIGESTSIZE; i++) {
         k = sha_info->digest[i];
@@ -344,6 +408,160 @@ APR_DECLARE(void) apr_sha1_final(unsigned char digest[APR_SHA1_DIGESTSIZE],
     }
 }
 
+/* Several messages are hashed at once in the lanes of vectors, using the
+ * compiler's generic vector extension over SSE2 or NEON.  Where SHA-NI is
+ * available, hashing each message on its own with it is faster.
+ */
+#if defined(__GNUC__) && (defined(__SSE2__) || defined(__ARM_NEON)) \
+    && (defined(__clang__) || __GNUC__ >= 5)
+#define SHA1_LANES 4
+
+typedef apr_uint32_t sha1_lanes_t __attribute__((vector_size(16)));
+
+#define LOAD_BE32(p) \
+    ((apr_uint32_t) (p)[0] << 24 | (apr_uint32_t) (p)[1] << 16 | \
+     (apr_uint32_t) (p)[2] << 8 | (apr_uint32_t) (p)[3])
+
+#define FUNC_LANES(n,i) \
+    if (i >= 16) { \
+        temp = W[(i-3) & 15] ^ W[(i-8) & 15] ^ W[(i-14) & 15] ^ W[i & 15]; \
+        W[i & 15] = ROT32(temp, 1); \
+    } \
+    temp = ROT32(A,5) + f##n(B,C,D) + E + W[i & 15] + CONST##n; \
+    E = D; D = C; C = ROT32(B,30); B = A; A = temp
+
+static void sha1_multi_lanes(unsigned char (*digests)[APR_SHA1_DIGESTSIZE],
+                             const unsigned char *const *inputs,
+                             const apr_size_t *lens, int n)
+{
+    static const apr_byte_t zero[SHA_BLOCKSIZE];
+    apr_byte_t tail[SHA1_LANES][2 * SHA_BLOCKSIZE];
+    apr_size_t full[SHA1_LANES], blocks[SHA1_LANES], most = 0, t;
+    sha1_lanes_t H[5], W[16], temp, A, B, C, D, E;
+    int i, j;
+
+    /* The last partial block of each message is padded in tail */
+    for (i = 0; i < SHA1_LANES; i++) {
+        apr_size_t rest, size;
+        apr_uint64_t bits;
+
+        if (i >= n) {
+            full[i] = blocks[i] = 0;
+            continue;
+        }
+        full[i] = lens[i] / SHA_BLOCKSIZE;
+        rest = lens[i] % SHA_BLOCKSIZE;
+        size = (rest < SHA_BLOCKSIZE - 8) ? SHA_BLOCKSIZE : 2 * SHA_BLOCKSIZE;
+        memcpy(tail[i], inputs[i] + full[i] * SHA_BLOCKSIZE, rest);
+        tail[i][rest] = 0x80;
+        memset(tail[i] + rest + 1, 0, size - rest - 1 - 8);
+        bits = (apr_uint64_t) lens[i] << 3;
+        for (j = 0; j < 8; j++) {
+            tail[i][size - 1 - j] = (apr_byte_t) (bits >> (8 * j));
+        }
+        blocks[i] = full[i] + size / SHA_BLOCKSIZE;
+        if (most < blocks[i]) {
+            most = blocks[i];
+        }
+    }
+
+    H[0] = (sha1_lanes_t) { 0x67452301, 0x67452301, 0x67452301, 0x67452301 };
+    H[1] = (sha1_lanes_t) { 0xefcdab89, 0xefcdab89, 0xefcdab89, 0xefcdab89 };
+    H[2] = (sha1_lanes_t) { 0x98badcfe, 0x98badcfe, 0x98badcfe, 0x98badcfe };
+    H[3] = (sha1_lanes_t) { 0x10325476, 0x10325476, 0x10325476, 0x10325476 };
+    H[4] = (sha1_lanes_t) { 0xc3d2e1f0, 0xc3d2e1f0, 0xc3d2e1f0, 0xc3d2e1f0 };
+
+    for (t = 0; t < most; t++) {
+        const apr_byte_t *p[SHA1_LANES];
+
+        /* finished lanes hash zeros, and their result is ignored */
+        for (i = 0; i < SHA1_LANES; i++) {
+            if (t < full[i]) {
+                p[i] = inputs[i] + t * SHA_BLOCKSIZE;
+            }
+            else if (t < blocks[i]) {
+                p[i] = tail[i] + (t - full[i]) * SHA_BLOCKSIZE;
+            }
+            else {
+                p[i] = zero;
+            }
+        }
+        for (j = 0; j < 16; j++) {
+            W[j] = (sha1_lanes_t) { LOAD_BE32(p[0] + 4 * j),
+                                    LOAD_BE32(p[1] + 4 * j),
+                                    LOAD_BE32(p[2] + 4 * j),
+                                    LOAD_BE32(p[3] + 4 * j) };
+        }
+
+        A = H[0];
+        B = H[1];
+        C = H[2];
+        D = H[3];
+        E = H[4];
+        for (j = 0; j < 20; j++) {
+            FUNC_LANES(1, j);
+        }
+        for (j = 20; j < 40; j++) {
+            FUNC_LANES(2, j);
+        }
+        for (j = 40; j < 60; j++) {
+            FUNC_LANES(3, j);
+        }
+        for (j = 60; j < 80; j++) {
+            FUNC_LANES(4, j);
+        }
+        H[0] += A;
+        H[1] += B;
+        H[2] += C;
+        H[3] += D;
+        H[4] += E;
+
+        for (i = 0; i < n; i++) {
+            if (blocks[i] == t + 1) {
+                for (j = 0; j < 5; j++) {
+                    digests[i][4 * j] = (unsigned char) (H[j][i] >> 24);
+                    digests[i][4 * j + 1] = (unsigned char) (H[j][i] >> 16);
+                    digests[i][4 * j + 2] = (unsigned char) (H[j][i] >> 8);
+                    digests[i][4 * j + 3] = (unsigned char) H[j][i];
+                }
+            }
+        }
+    }
+}
+
+#endif /* SHA1_LANES */
+
+APR_DECLARE(void) apr_sha1_multi(unsigned char (*digests)[APR_SHA1_DIGESTSIZE],
+                                 const unsigned char *const *inputs,
+                                 const apr_size_t *lens, int n)
+{
+    int i = 0;
+
+#ifdef SHA1_LANES
+#ifdef SHA_NI
+    if (!HAVE_SHA_NI())
+#endif
+    for (; i + 1 < n; i += SHA1_LANES) {
+        sha1_multi_lanes(digests + i, inputs + i, lens + i,
+                         (n - i < SHA1_LANES) ? n - i : SHA1_LANES);
+    }
+#endif
+
+    for (; i < n; i++) {
+        apr_sha1_ctx_t context;
+        const unsigned char *input = inputs[i];
+        apr_size_t len = lens[i];
+
+        apr_sha1_init(&context);
+        while (len > APR_UINT32_MAX) {
+            apr_sha1_update_binary(&context, input, APR_UINT32_MAX);
+            input += APR_UINT32_MAX;
+            len -= APR_UINT32_MAX;
+        }
+        apr_sha1_update_binary(&context, input, (unsigned int) len);
+        apr_sha1_final(digests[i], &context);
+    }
+}
 
 APR_DECLARE(void) apr_sha1_base64(const char *clear, int len, char *out)
 {
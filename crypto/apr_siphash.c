@@ -20,6 +20,11 @@
  */
 
 #include "apr_siphash.h"
+#include "apr_hash.h"
+
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
 
 #define ROTL64(x, n) (((x) << (n)) | ((x) >> (64 - (n))))
 
@@ -45,6 +50,34 @@ do { \
     (p)[7] = (unsigned char)((v) >> 56); \
 } while (0)
 
+/* The last word of a message of n bytes: its remaining bytes at ptr and
+ * its length
+ */
+static APR_INLINE apr_uint64_t siphash_last(const unsigned char *ptr,
+                                            apr_size_t n)
+{
+    apr_uint64_t m = (apr_uint64_t)(n & 0xff) << 56;
+
+    switch (n & 0x7) {
+        case 7: m |= (apr_uint64_t)ptr[6] << 48;
+            /* fall through */
+        case 6: m |= (apr_uint64_t)ptr[5] << 40;
+            /* fall through */
+        case 5: m |= (apr_uint64_t)ptr[4] << 32;
+            /* fall through */
+        case 4: m |= (apr_uint64_t)ptr[3] << 24;
+            /* fall through */
+        case 3: m |= (apr_uint64_t)ptr[2] << 16;
+            /* fall through */
+        case 2: m |= (apr_uint64_t)ptr[1] << 8;
+            /* fall through */
+        case 1: m |= (apr_uint64_t)ptr[0];
+            /* fall through */
+        case 0: break;
+    }
+    return m;
+}
+
 #define SIPROUND() \
 do { \
     v0 += v1; v1=ROTL64(v1,13); v1 ^= v0; v0=ROTL64(v0,32); \
@@ -74,17 +107,7 @@ do { \
         cROUNDS \
         v0 ^= m; \
     } \
-    m = (apr_uint64_t)(n & 0xff) << 56; \
-    switch (rem) { \
-        case 7: m |= (apr_uint64_t)ptr[6] << 48; \
-        case 6: m |= (apr_uint64_t)ptr[5] << 40; \
-        case 5: m |= (apr_uint64_t)ptr[4] << 32; \
-        case 4: m |= (apr_uint64_t)ptr[3] << 24; \
-        case 3: m |= (apr_uint64_t)ptr[2] << 16; \
-        case 2: m |= (apr_uint64_t)ptr[1] << 8; \
-        case 1: m |= (apr_uint64_t)ptr[0]; \
-        case 0: break; \
-    } \
+    m = siphash_last(ptr, (n)); \
     v3 ^= m; \
     cROUNDS \
     v0 ^= m; \
@@ -194,3 +217,237 @@ APR_DECLARE(void) apr_siphash48_auth(unsigned char out[APR_SIPHASH_DSIZE],
     U64TO8_LE(out, h);
 }
 
+APR_DECLARE(apr_uint64_t) apr_siphash13(const void *src, apr_size_t len,
+                               const unsigned char key[APR_SIPHASH_KSIZE])
+{
+    apr_uint64_t h;
+
+#undef  cROUNDS
+#define cROUNDS \
+        SIPROUND();
+
+#undef  dROUNDS
+#define dROUNDS \
+        SIPROUND(); \
+        SIPROUND(); \
+        SIPROUND();
+
+    SIPHASH(h, src, len, key);
+    return h;
+}
+
+APR_DECLARE(void) apr_siphash13_auth(unsigned char out[APR_SIPHASH_DSIZE],
+                                     const void *src, apr_size_t len,
+                               const unsigned char key[APR_SIPHASH_KSIZE])
+{
+    apr_uint64_t h;
+    h = apr_siphash13(src, len, key);
+    U64TO8_LE(out, h);
+}
+
+/* Several messages are hashed at once in the lanes of an AVX2 register,
+ * using the compiler's generic vector extension for the SIPROUND()s to
+ * apply as is.  AVX2 is detected at run time by HAVE_SIPHASH_LANES() and
+ * enabled by SIPHASH_LANES_TARGET, SSE2 pairs of lanes being no faster
+ * than hashing the messages one at a time.
+ */
+#if defined(__GNUC__) && defined(__x86_64__) \
+    && (defined(__clang__) || __GNUC__ >= 5)
+#define SIPHASH_LANES 4
+
+#if defined(__AVX2__)
+
+#define SIPHASH_LANES_TARGET
+
+#define HAVE_SIPHASH_LANES() 1
+
+#else
+
+#define SIPHASH_LANES_TARGET __attribute__((target("avx2")))
+
+static APR_INLINE int have_avx2(void)
+{
+    static int avx2 = -1;
+
+    if (avx2 < 0) {
+        unsigned int eax = 0, ebx, ecx, edx;
+        unsigned int max, features;
+
+        __asm__ __volatile__ ("cpuid"
+                              : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+        max = eax;
+
+        eax = 1;
+        __asm__ __volatile__ ("cpuid"
+                              : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+        features = ecx;
+
+        avx2 = 0;
+        /* the OS must also save the YMM registers (OSXSAVE, then XCR0) */
+        if (max >= 7 && (features & (1u << 27))) {
+            __asm__ __volatile__ ("xgetbv"
+                                  : "=a" (eax), "=d" (edx) : "c" (0));
+            if ((eax & 0x6) == 0x6) {
+                eax = 7;
+                ecx = 0;
+                __asm__ __volatile__ ("cpuid"
+                                      : "+a" (eax), "=b" (ebx), "+c" (ecx),
+                                        "=d" (edx));
+                avx2 = (ebx >> 5) & 1;
+            }
+        }
+    }
+    return avx2;
+}
+
+#define HAVE_SIPHASH_LANES() have_avx2()
+
+#endif
+
+typedef apr_uint64_t siphash_lanes_t __attribute__((vector_size(32)));
+
+/* The words are loaded whole where the byte order allows it */
+#if APR_IS_BIGENDIAN
+#define LANE_LOAD(p) U8TO64_LE(p)
+#else
+static APR_INLINE apr_uint64_t lane_load(const unsigned char *p)
+{
+    apr_uint64_t m;
+    memcpy(&m, p, sizeof(m));
+    return m;
+}
+#define LANE_LOAD(p) lane_load(p)
+#endif
+
+SIPHASH_LANES_TARGET
+static void siphash13_lanes(apr_uint64_t *hashes, const void *const *srcs,
+                            const apr_size_t *lens, int n,
+                            const unsigned char key[APR_SIPHASH_KSIZE])
+{
+    siphash_lanes_t v0, v1, v2, v3, m, w, done[4];
+    static const unsigned char zero[8];
+    const unsigned char *p[SIPHASH_LANES];
+    apr_size_t words[SIPHASH_LANES], most = 0, fewest = APR_SIZE_MAX, t;
+    apr_uint64_t last[SIPHASH_LANES], k0, k1;
+    int i;
+
+    /* The last word of each message has its remaining bytes and length */
+    for (i = 0; i < SIPHASH_LANES; i++) {
+        const unsigned char *ptr;
+
+        if (i >= n) {
+            p[i] = zero;
+            words[i] = last[i] = 0;
+            fewest = 0;
+            continue;
+        }
+        p[i] = srcs[i];
+        words[i] = lens[i] / 8;
+        if (fewest > words[i]) {
+            fewest = words[i];
+        }
+        ptr = p[i] + words[i] * 8;
+        last[i] = siphash_last(ptr, lens[i]);
+        if (most < words[i] + 1) {
+            most = words[i] + 1;
+        }
+    }
+
+    k0 = U8TO64_LE(key + 0);
+    k1 = U8TO64_LE(key + 8);
+    v3 = v2 = v1 = v0 = (siphash_lanes_t){ 0 };
+    done[3] = done[2] = done[1] = done[0] = v0;
+    w = (siphash_lanes_t){ words[0], words[1], words[2], words[3] };
+    v3 += k1 ^ (apr_uint64_t)0x7465646279746573ULL;
+    v2 += k0 ^ (apr_uint64_t)0x6c7967656e657261ULL;
+    v1 += k1 ^ (apr_uint64_t)0x646f72616e646f6dULL;
+    v0 += k0 ^ (apr_uint64_t)0x736f6d6570736575ULL;
+
+    /* All the lanes have full words up to the shortest message */
+    for (t = 0; t < fewest; t++) {
+        m = (siphash_lanes_t){ LANE_LOAD(p[0] + t * 8),
+                               LANE_LOAD(p[1] + t * 8),
+                               LANE_LOAD(p[2] + t * 8),
+                               LANE_LOAD(p[3] + t * 8) };
+        v3 ^= m;
+        SIPROUND();
+        v0 ^= m;
+    }
+
+    for (; t < most; t++) {
+        siphash_lanes_t mask;
+
+        /* finished lanes compress zeros, their state was kept */
+        for (i = 0; i < SIPHASH_LANES; i++) {
+            if (t < words[i]) {
+                m[i] = LANE_LOAD(p[i] + t * 8);
+            }
+            else if (t == words[i]) {
+                m[i] = last[i];
+            }
+            else {
+                m[i] = 0;
+            }
+        }
+        v3 ^= m;
+        SIPROUND();
+        v0 ^= m;
+
+        mask = (siphash_lanes_t)(w == t);
+        done[0] = (done[0] & ~mask) | (v0 & mask);
+        done[1] = (done[1] & ~mask) | (v1 & mask);
+        done[2] = (done[2] & ~mask) | (v2 & mask);
+        done[3] = (done[3] & ~mask) | (v3 & mask);
+    }
+
+    v0 = done[0];
+    v1 = done[1];
+    v2 = done[2] ^ 0xff;
+    v3 = done[3];
+    SIPROUND();
+    SIPROUND();
+    SIPROUND();
+    m = v0 ^ v1 ^ v2 ^ v3;
+    for (i = 0; i < n; i++) {
+        hashes[i] = m[i];
+    }
+}
+
+#endif /* SIPHASH_LANES */
+
+APR_DECLARE(void) apr_siphash13_multi(apr_uint64_t *hashes,
+                                      const void *const *srcs,
+                                      const apr_size_t *lens, int n,
+                               const unsigned char key[APR_SIPHASH_KSIZE])
+{
+    int i = 0;
+
+#ifdef SIPHASH_LANES
+    /* A single message is faster alone */
+    for (; n - i >= 2 && HAVE_SIPHASH_LANES(); i += SIPHASH_LANES) {
+        siphash13_lanes(hashes + i, srcs + i, lens + i,
+                        (n - i < SIPHASH_LANES) ? n - i : SIPHASH_LANES, key);
+    }
+#endif
+
+    for (; i < n; i++) {
+        hashes[i] = apr_siphash13(srcs[i], lens[i], key);
+    }
+}
+
+static unsigned char hashfunc_key[APR_SIPHASH_KSIZE];
+
+APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_siphash13(const char *key,
+                                                        apr_ssize_t *klen)
+{
+    if (*klen == APR_HASH_KEY_STRING) {
+        *klen = strlen(key);
+    }
+    return (unsigned int)apr_siphash13(key, *klen, hashfunc_key);
+}
+
+APR_DECLARE(void) apr_hashfunc_siphash13_key(
+                               const unsigned char key[APR_SIPHASH_KSIZE])
+{
+    memcpy(hashfunc_key, key, APR_SIPHASH_KSIZE);
+}
@@ -16,11 +16,13 @@
 
 /*
  * This attempts to generate V1 UUIDs according to the Internet Draft
- * located at http://www.webdav.org/specs/draft-leach-uuids-guids-01.txt
+ * located at http://www.webdav.org/specs/draft-leach-uuids-guids-01.txt,
+ * and V7 UUIDs according to RFC 9562.
  */
 #include "apr.h"
 #include "apr_uuid.h"
 #include "apr_md5.h"
+#include "apr_atomic.h"
 #include "apr_general.h"
 #include "apr_portable.h"
 
@@ -48,8 +50,21 @@
 
 #define NODE_LENGTH 6
 
-static int uuid_state_seqnum;
-static unsigned char uuid_state_node[NODE_LENGTH] = { 0 };
+/* The node ID (low 48 bits) and clock sequence (next 14 bits) of this
+ * process, with bit 62 set once they are chosen.  Keeping them in one
+ * word lets racing initializers agree on the first one published.
+ */
+#define UUID_STATE_SET (APR_UINT64_C(1) << 62)
+static volatile apr_uint64_t uuid_state;
+
+/* The last V1 timestamp handed out, in 100ns units since 1582 */
+static volatile apr_uint64_t uuid_time_last;
+
+/* The last V7 timestamp handed out: Unix milliseconds shifted left 12
+ * bits, with the sub-millisecond fraction in the low bits (RFC 9562,
+ * section 6.2, method 3).
+ */
+static volatile apr_uint64_t uuid_v7_last;
 
 
 static void get_random_info(unsigned char node[NODE_LENGTH])
@@ -137,56 +152,73 @@ static int true_random(void)
     return rand() & 0x0FFFF;
 }
 
-static void init_state(void)
+static void get_random_bytes(unsigned char *buf, apr_size_t len)
 {
-    uuid_state_seqnum = true_random();
-    get_pseudo_node_identifier(uuid_state_node);
+#if APR_HAS_RANDOM
+    if (apr_generate_random_bytes(buf, len) == APR_SUCCESS) {
+        return;
+    }
+#endif
+    while (len--) {
+        *buf++ = (unsigned char)true_random();
+    }
 }
 
-static void get_current_time(apr_uint64_t *timestamp)
+static apr_uint64_t get_state(void)
 {
-    /* ### this needs to be made thread-safe! */
-
-    apr_uint64_t time_now;
-    static apr_uint64_t time_last = 0;
-    static apr_uint64_t fudge = 0;
-
-    get_system_time(&time_now);
-
-    /* if clock reading changed since last UUID generated... */
-    if (time_last != time_now) {
-        /* The clock reading has changed since the last UUID was generated.
-           Reset the fudge factor. if we are generating them too fast, then
-           the fudge may need to be reset to something greater than zero. */
-        if (time_last + fudge > time_now)
-            fudge = time_last + fudge - time_now + 1;
-        else
-            fudge = 0;
-        time_last = time_now;
-    }
-    else {
-        /* We generated two really fast. Bump the fudge factor. */
-        ++fudge;
+    apr_uint64_t state = apr_atomic_read64(&uuid_state);
+
+    if (!state) {
+        unsigned char node[NODE_LENGTH];
+        apr_uint64_t mine;
+        int i;
+
+        get_pseudo_node_identifier(node);
+        mine = UUID_STATE_SET
+               | ((apr_uint64_t)(true_random() & 0x3FFF) << 48);
+        for (i = 0; i < NODE_LENGTH; i++) {
+            mine |= (apr_uint64_t)node[i] << (8 * (NODE_LENGTH - 1 - i));
+        }
+
+        state = apr_atomic_cas64(&uuid_state, mine, 0);
+        if (!state) {
+            state = mine;
+        }
     }
 
-    *timestamp = time_now + fudge;
+    return state;
 }
 
-APR_DECLARE(void) apr_uuid_get(apr_uuid_t *uuid)
+/* Reserve n consecutive values after both the clock reading now and
+ * every value reserved before, and return the first one.  Threads that
+ * race for the same values retry, so none is ever handed out twice.
+ */
+static apr_uint64_t reserve_time(volatile apr_uint64_t *last,
+                                 apr_uint64_t now, apr_size_t n)
 {
-    apr_uint64_t timestamp;
-    unsigned char *d = uuid->data;
+    apr_uint64_t prev = apr_atomic_read64(last), first;
 
-#if APR_HAS_OS_UUID
-    if (apr_os_uuid_get(d) == APR_SUCCESS) {
-        return;
-    }
-#endif /* !APR_HAS_OS_UUID */
+    for (;;) {
+        apr_uint64_t seen;
+
+        /* if the clock did not move, or went back, continue from the
+         * last value instead */
+        first = (now > prev) ? now : prev + 1;
 
-    if (!uuid_state_node[0])
-        init_state();
+        seen = apr_atomic_cas64(last, first + n - 1, prev);
+        if (seen == prev) {
+            return first;
+        }
+        prev = seen;
+    }
+}
 
-    get_current_time(&timestamp);
+static void uuid_v1_make(apr_uuid_t *uuid, apr_uint64_t timestamp,
+                         apr_uint64_t state)
+{
+    unsigned char *d = uuid->data;
+    int seqnum = (int)(state >> 48);
+    int i;
 
     /* time_low, uint32 */
     d[3] = (unsigned char)timestamp;
@@ -200,9 +232,96 @@ APR_DECLARE(void) apr_uuid_get(apr_uuid_t *uuid)
     d[7] = (unsigned char)(timestamp >> 48);
     d[6] = (unsigned char)(((timestamp >> 56) & 0x0F) | 0x10);
     /* clock_seq_hi_and_reserved, uint8 */
-    d[8] = (unsigned char)(((uuid_state_seqnum >> 8) & 0x3F) | 0x80);
+    d[8] = (unsigned char)(((seqnum >> 8) & 0x3F) | 0x80);
     /* clock_seq_low, uint8 */
-    d[9] = (unsigned char)uuid_state_seqnum;
+    d[9] = (unsigned char)seqnum;
     /* node, byte[6] */
-    memcpy(&d[10], uuid_state_node, NODE_LENGTH);
+    for (i = 0; i < NODE_LENGTH; i++) {
+        d[10 + i] = (unsigned char)(state >> (8 * (NODE_LENGTH - 1 - i)));
+    }
+}
+
+APR_DECLARE(void) apr_uuid_get(apr_uuid_t *uuid)
+{
+    apr_uuid_get_batch(uuid, 1);
+}
+
+APR_DECLARE(void) apr_uuid_get_batch(apr_uuid_t *uuids, apr_size_t n)
+{
+    apr_uint64_t state, timestamp;
+    apr_size_t i;
+
+#if APR_HAS_OS_UUID
+    for (i = 0; i < n; i++) {
+        if (apr_os_uuid_get(uuids[i].data) != APR_SUCCESS) {
+            break;
+        }
+    }
+    uuids += i;
+    n -= i;
+#endif /* !APR_HAS_OS_UUID */
+
+    if (!n) {
+        return;
+    }
+
+    state = get_state();
+
+    get_system_time(&timestamp);
+    timestamp = reserve_time(&uuid_time_last, timestamp, n);
+
+    for (i = 0; i < n; i++) {
+        uuid_v1_make(&uuids[i], timestamp + i, state);
+    }
+}
+
+APR_DECLARE(void) apr_uuid_get_v7(apr_uuid_t *uuid)
+{
+    apr_uuid_get_v7_batch(uuid, 1);
+}
+
+/* random bits fetched per call to the random source */
+#define UUID_V7_CHUNK 32
+
+APR_DECLARE(void) apr_uuid_get_v7_batch(apr_uuid_t *uuids, apr_size_t n)
+{
+    unsigned char rand_b[UUID_V7_CHUNK * 8];
+    apr_uint64_t timestamp;
+    apr_time_t now;
+    apr_size_t i, j;
+
+    if (!n) {
+        return;
+    }
+
+    now = apr_time_now();
+    timestamp = ((apr_uint64_t)apr_time_as_msec(now) << 12)
+                | (apr_uint64_t)(now % 1000 * 4096 / 1000);
+    timestamp = reserve_time(&uuid_v7_last, timestamp, n);
+
+    for (i = 0; i < n; i++, timestamp++) {
+        unsigned char *d = uuids[i].data;
+        apr_uint64_t ms = timestamp >> 12;
+
+        j = i % UUID_V7_CHUNK;
+        if (!j) {
+            apr_size_t left = n - i;
+            get_random_bytes(rand_b, 8 * (left < UUID_V7_CHUNK
+                                          ? left : UUID_V7_CHUNK));
+        }
+
+        /* unix_ts_ms, uint48 */
+        d[0] = (unsigned char)(ms >> 40);
+        d[1] = (unsigned char)(ms >> 32);
+        d[2] = (unsigned char)(ms >> 24);
+        d[3] = (unsigned char)(ms >> 16);
+        d[4] = (unsigned char)(ms >> 8);
+        d[5] = (unsigned char)ms;
+        /* ver and rand_a, the sub-millisecond fraction */
+        d[6] = (unsigned char)(((timestamp >> 8) & 0x0F) | 0x70);
+        d[7] = (unsigned char)timestamp;
+        /* var and rand_b */
+        memcpy(&d[8], &rand_b[8 * j], 8);
+        d[8] = (d[8] & 0x3F) | 0x80;
+    }
 }
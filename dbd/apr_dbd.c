@@ -22,6 +22,7 @@
 #include "apr_pools.h"
 #include "apr_dso.h"
 #include "apr_strings.h"
+#include "apr_strbuf.h"
 #include "apr_hash.h"
 #include "apr_thread_mutex.h"
 #include "apr_lib.h"
@@ -344,6 +345,143 @@ APR_DECLARE(const char*) apr_dbd_get_entry(const apr_dbd_driver_t *driver,
     return driver->get_entry(row,col);
 }
 
+struct apr_dbd_batch_t {
+    apr_pool_t *pool;
+    int size;
+    int nrows;
+    int ncols;
+    int maxcols;
+    int rv;
+    /* by column, then row */
+    const char **values;
+    apr_size_t *lengths;
+    apr_size_t *offsets;
+    /* the values of all the columns */
+    char *buf;
+    apr_size_t bufsize;
+    apr_dbd_row_t *row;
+};
+
+#define DBD_BATCH_NULL ((apr_size_t)-1)
+
+APR_DECLARE(apr_status_t) apr_dbd_batch_create(apr_dbd_batch_t **batch,
+                                               int size, apr_pool_t *pool)
+{
+    if (size <= 0) {
+        return APR_EINVAL;
+    }
+
+    *batch = apr_pcalloc(pool, sizeof(apr_dbd_batch_t));
+    (*batch)->pool = pool;
+    (*batch)->size = size;
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(int) apr_dbd_get_batch(const apr_dbd_driver_t *driver,
+                                   apr_dbd_results_t *res,
+                                   apr_dbd_batch_t *batch)
+{
+    apr_size_t len = 0, vlen, total;
+    int ncols, size = batch->size;
+    int i, n, idx, rv = 0;
+
+    batch->nrows = 0;
+    if (batch->rv) {
+        /* the error which ended the previous batch */
+        rv = batch->rv;
+        batch->rv = 0;
+        return rv;
+    }
+
+    ncols = driver->num_cols(res);
+    if (ncols < 0) {
+        ncols = 0;
+    }
+    if (ncols > batch->maxcols) {
+        total = (apr_size_t)ncols * size;
+        batch->values = apr_palloc(batch->pool, total * sizeof(char *));
+        batch->lengths = apr_palloc(batch->pool, total * sizeof(apr_size_t));
+        batch->offsets = apr_palloc(batch->pool, total * sizeof(apr_size_t));
+        batch->maxcols = ncols;
+    }
+    batch->ncols = ncols;
+
+    for (n = 0; n < size; n++) {
+        rv = driver->get_row(batch->pool, res, &batch->row, -1);
+        if (rv) {
+            break;
+        }
+        for (i = 0; i < ncols; i++) {
+            const char *value = driver->get_entry(batch->row, i);
+
+            idx = i * size + n;
+            if (!value) {
+                batch->offsets[idx] = DBD_BATCH_NULL;
+                batch->lengths[idx] = 0;
+                continue;
+            }
+            vlen = strlen(value);
+            if (len + vlen + 1 > batch->bufsize) {
+                char *buf;
+
+                batch->bufsize = (len + vlen + 1) * 2;
+                buf = apr_palloc(batch->pool, batch->bufsize);
+                if (len) {
+                    memcpy(buf, batch->buf, len);
+                }
+                batch->buf = buf;
+            }
+            memcpy(batch->buf + len, value, vlen + 1);
+            batch->offsets[idx] = len;
+            batch->lengths[idx] = vlen;
+            len += vlen + 1;
+        }
+    }
+    batch->nrows = n;
+
+    /* the buffer may have moved while filling it */
+    for (i = 0; i < ncols; i++) {
+        for (n = 0; n < batch->nrows; n++) {
+            idx = i * size + n;
+            if (batch->offsets[idx] == DBD_BATCH_NULL) {
+                batch->values[idx] = NULL;
+            }
+            else {
+                batch->values[idx] = batch->buf + batch->offsets[idx];
+            }
+        }
+    }
+
+    if (batch->nrows) {
+        if (rv != -1) {
+            batch->rv = rv;
+        }
+        return 0;
+    }
+    return rv;
+}
+
+APR_DECLARE(int) apr_dbd_batch_nrows(const apr_dbd_batch_t *batch)
+{
+    return batch->nrows;
+}
+
+APR_DECLARE(apr_status_t) apr_dbd_batch_column(const apr_dbd_batch_t *batch,
+                                               int col,
+                                               const char *const **values,
+                                               const apr_size_t **lengths)
+{
+    if (col < 0 || col >= batch->ncols) {
+        return APR_EINVAL;
+    }
+
+    *values = batch->values + (apr_size_t)col * batch->size;
+    *lengths = batch->lengths + (apr_size_t)col * batch->size;
+
+    return APR_SUCCESS;
+}
+
 APR_DECLARE(const char*) apr_dbd_get_name(const apr_dbd_driver_t *driver,
                                           apr_dbd_results_t *res, int col)
 {
@@ -570,3 +708,198 @@ APR_DECLARE(apr_status_t) apr_dbd_datum_get(const apr_dbd_driver_t *driver,
 {
     return driver->datum_get(row,col,type,data);
 }
+
+APR_DECLARE(int) apr_dbd_pipeline_begin(const apr_dbd_driver_t *driver,
+                                        apr_pool_t *pool, apr_dbd_t *handle)
+{
+    if (!driver->pipeline_begin) {
+        return APR_ENOTIMPL;
+    }
+    return driver->pipeline_begin(pool,handle);
+}
+
+APR_DECLARE(int) apr_dbd_pipeline_pquery(const apr_dbd_driver_t *driver,
+                                         apr_pool_t *pool, apr_dbd_t *handle,
+                                         apr_dbd_prepared_t *statement,
+                                         int nargs, const char **args)
+{
+    if (!driver->pipeline_pquery) {
+        return APR_ENOTIMPL;
+    }
+    return driver->pipeline_pquery(pool,handle,statement,args);
+}
+
+APR_DECLARE(int) apr_dbd_pipeline_pbquery(const apr_dbd_driver_t *driver,
+                                          apr_pool_t *pool, apr_dbd_t *handle,
+                                          apr_dbd_prepared_t *statement,
+                                          const void **args)
+{
+    if (!driver->pipeline_pbquery) {
+        return APR_ENOTIMPL;
+    }
+    return driver->pipeline_pbquery(pool,handle,statement,args);
+}
+
+APR_DECLARE(int) apr_dbd_pipeline_end(const apr_dbd_driver_t *driver,
+                                      apr_pool_t *pool, apr_dbd_t *handle,
+                                      int *nrows, apr_int16_t *reqevents)
+{
+    if (!driver->pipeline_end) {
+        return APR_ENOTIMPL;
+    }
+    return driver->pipeline_end(pool,handle,nrows,reqevents);
+}
+
+APR_DECLARE(apr_status_t) apr_dbd_socket_get(const apr_dbd_driver_t *driver,
+                                             apr_pool_t *pool,
+                                             apr_dbd_t *handle,
+                                             apr_socket_t **sock)
+{
+    if (!driver->socket_get) {
+        return APR_ENOTIMPL;
+    }
+    return driver->socket_get(pool,handle,sock);
+}
+
+/* The multi-row INSERTs of the drivers without bulk load */
+#define DBD_BULK_ROWS 256
+#define DBD_BULK_SIZE 65536
+
+struct apr_dbd_bulk_t {
+    const apr_dbd_driver_t *driver;
+    apr_dbd_t *handle;
+    void *bulk; /* of the driver if supported */
+    int ncols;
+    int nrows;
+    int errnum;
+    /* multi-row INSERTs */
+    apr_pool_t *pool;
+    const char *insert;
+    apr_strbuf_t sb;
+    int pending;
+};
+
+static int dbd_bulk_flush(apr_dbd_bulk_t *bulk)
+{
+    int ret, nrows = 0;
+
+    ret = bulk->driver->query(bulk->handle, &nrows,
+                              apr_strbuf_finish(&bulk->sb, NULL));
+    if (!ret) {
+        bulk->nrows += nrows;
+    }
+    bulk->pending = 0;
+
+    apr_pool_clear(bulk->pool);
+    apr_strbuf_init(&bulk->sb, bulk->pool, 0);
+
+    return ret;
+}
+
+APR_DECLARE(int) apr_dbd_bulk_begin(const apr_dbd_driver_t *driver,
+                                    apr_pool_t *pool, apr_dbd_t *handle,
+                                    apr_dbd_bulk_t **bulk, const char *table,
+                                    int ncols, const char *const *columns)
+{
+    apr_dbd_bulk_t *b;
+    int i, ret;
+
+    if (ncols <= 0) {
+        return APR_EINVAL;
+    }
+
+    b = apr_pcalloc(pool, sizeof(apr_dbd_bulk_t));
+    b->driver = driver;
+    b->handle = handle;
+    b->ncols = ncols;
+
+    if (driver->bulk_begin) {
+        ret = driver->bulk_begin(pool, handle, table, ncols, columns,
+                                 &b->bulk);
+        if (ret) {
+            return ret;
+        }
+    }
+    else {
+        apr_strbuf_t sb;
+
+        apr_strbuf_init(&sb, pool, 0);
+        apr_strbuf_appendf(&sb, "INSERT INTO %s (", table);
+        for (i = 0; i < ncols; i++) {
+            apr_strbuf_appendf(&sb, i ? ", %s" : "%s", columns[i]);
+        }
+        apr_strbuf_appendstr(&sb, ") VALUES ");
+        b->insert = apr_strbuf_finish(&sb, NULL);
+
+        apr_pool_create(&b->pool, pool);
+        apr_strbuf_init(&b->sb, b->pool, 0);
+    }
+
+    *bulk = b;
+    return 0;
+}
+
+APR_DECLARE(int) apr_dbd_bulk_row(const apr_dbd_driver_t *driver,
+                                  apr_dbd_bulk_t *bulk,
+                                  const char *const *values)
+{
+    int i;
+
+    if (bulk->errnum) {
+        return bulk->errnum;
+    }
+
+    if (bulk->bulk) {
+        return bulk->errnum = driver->bulk_row(bulk->bulk, values);
+    }
+
+    apr_strbuf_appendstr(&bulk->sb, bulk->pending ? ", (" : bulk->insert);
+    if (!bulk->pending) {
+        apr_strbuf_appendc(&bulk->sb, '(');
+    }
+    for (i = 0; i < bulk->ncols; i++) {
+        if (i) {
+            apr_strbuf_append(&bulk->sb, ", ", 2);
+        }
+        if (values[i]) {
+            apr_strbuf_appendc(&bulk->sb, '\'');
+            apr_strbuf_appendstr(&bulk->sb,
+                                 driver->escape(bulk->pool, values[i],
+                                                bulk->handle));
+            apr_strbuf_appendc(&bulk->sb, '\'');
+        }
+        else {
+            apr_strbuf_append(&bulk->sb, "NULL", 4);
+        }
+    }
+    apr_strbuf_appendc(&bulk->sb, ')');
+
+    if (++bulk->pending >= DBD_BULK_ROWS || bulk->sb.len >= DBD_BULK_SIZE) {
+        bulk->errnum = dbd_bulk_flush(bulk);
+    }
+
+    return bulk->errnum;
+}
+
+APR_DECLARE(int) apr_dbd_bulk_end(const apr_dbd_driver_t *driver,
+                                  apr_dbd_bulk_t *bulk, int *nrows)
+{
+    int ret;
+
+    if (bulk->bulk) {
+        ret = driver->bulk_end(bulk->bulk, nrows);
+        bulk->bulk = NULL;
+        return bulk->errnum ? bulk->errnum : ret;
+    }
+
+    if (bulk->pending && !bulk->errnum) {
+        bulk->errnum = dbd_bulk_flush(bulk);
+    }
+    if (bulk->pool) {
+        apr_pool_destroy(bulk->pool);
+        bulk->pool = NULL;
+    }
+
+    *nrows = bulk->nrows;
+    return bulk->errnum;
+}
@@ -77,6 +77,7 @@ static void check_error(apr_dbd_t *a, const char *step, SQLRETURN rc,
 #define MAX_ERROR_STRING 1024           /* max length of message in dbc */
 #define MAX_COLUMN_NAME 256             /* longest column name recognized */
 #define DEFAULT_BUFFER_SIZE 1024        /* value for defaultBufferSize */
+#define DEFAULT_PARAMSET 256            /* value for paramset */
 
 #define MAX_PARAMS  20
 #define DEFAULTSEPS " \t\r\n,="
@@ -118,6 +119,8 @@ struct apr_dbd_t
     apr_intptr_t dboptions;     /* driver options re SQLGetData */
     apr_intptr_t default_transaction_mode;
     int can_commit;             /* controls end_trans behavior */
+    int rowset;                 /* rows per fetch of sequential selects */
+    int paramset;               /* rows per execute of bulk loads */
 };
 
 struct apr_dbd_results_t
@@ -140,6 +143,13 @@ struct apr_dbd_results_t
                                  */
     int *all_data_fetched;      /* flags data as all fetched, for LOBs  */
     void *data;                 /* buffer for all data for one row */
+    int rowset;                 /* rows per fetch, 1 without block cursor */
+    SQLULEN nfetched;           /* rows in the rowset */
+    SQLULEN rowpos;             /* current row in the rowset */
+    SQLUSMALLINT *rowstatus;    /* status of the rows in the rowset */
+    char **blockptrs;           /* column-wise buffers of the rowset */
+    SQLLEN **blockinds;         /* column-wise indicators of the rowset */
+    SQLPOINTER *convptrs;       /* buffers for SQLGetData in the rowset */
 };
 
 enum                            /* results column states */
@@ -301,6 +311,19 @@ static apr_status_t odbc_close_results(void *d)
     	if (!dbr->isclosed)
             rc = SQLCloseCursor(dbr->stmt);
     	dbr->isclosed = 1;
+#ifndef ODBCV2
+        if (dbr->rowset > 1) {
+            /* a prepared statement must not keep the rowset of these
+             * results, nor pointers to their pool
+             */
+            SQLFreeStmt(dbr->stmt, SQL_UNBIND);
+            SQLSetStmtAttr(dbr->stmt, SQL_ATTR_ROW_ARRAY_SIZE,
+                           (SQLPOINTER)1, 0);
+            SQLSetStmtAttr(dbr->stmt, SQL_ATTR_ROW_STATUS_PTR, NULL, 0);
+            SQLSetStmtAttr(dbr->stmt, SQL_ATTR_ROWS_FETCHED_PTR, NULL, 0);
+            dbr->rowset = 1;
+        }
+#endif
     }
     return APR_FROM_SQL_RESULT(rc);
 }
@@ -467,6 +490,66 @@ static SQLRETURN odbc_set_result_column(int icol, apr_dbd_results_t *res,
     return rc;
 }
 
+#ifndef ODBCV2
+/* bind the columns to arrays of rowset rows, for SQLFetch to fetch that
+ * many rows at once, unless some column cannot be bound (LOBs)
+ */
+static SQLRETURN odbc_set_block_cursor(apr_dbd_results_t *res, int rowset)
+{
+    SQLRETURN rc;
+    SQLULEN size = 0;
+    int i;
+
+    for (i = 0; i < res->ncols; i++) {
+        if (res->colstate[i] != COL_BOUND)
+            return SQL_SUCCESS;
+    }
+
+    rc = SQLSetStmtAttr(res->stmt, SQL_ATTR_ROW_BIND_TYPE,
+                        (SQLPOINTER)SQL_BIND_BY_COLUMN, 0);
+    if (SQL_SUCCEEDED(rc)) {
+        /* the driver may use a smaller rowset (SQL_SUCCESS_WITH_INFO) */
+        rc = SQLSetStmtAttr(res->stmt, SQL_ATTR_ROW_ARRAY_SIZE,
+                            (SQLPOINTER)(SQLULEN)rowset, 0);
+    }
+    if (SQL_SUCCEEDED(rc)) {
+        rc = SQLGetStmtAttr(res->stmt, SQL_ATTR_ROW_ARRAY_SIZE, &size,
+                            sizeof(size), NULL);
+    }
+    if (!SQL_SUCCEEDED(rc) || size <= 1) {
+        /* no block cursor, the columns are still bound to one row */
+        SQLSetStmtAttr(res->stmt, SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER)1, 0);
+        return SQL_SUCCESS;
+    }
+    res->rowset = (int)size;
+
+    res->rowstatus = apr_palloc(res->pool,
+                                res->rowset * sizeof(SQLUSMALLINT));
+    res->blockptrs = apr_palloc(res->pool, res->ncols * sizeof(char *));
+    res->blockinds = apr_palloc(res->pool, res->ncols * sizeof(SQLLEN *));
+    res->convptrs = apr_pcalloc(res->pool, res->ncols * sizeof(SQLPOINTER));
+
+    rc = SQLSetStmtAttr(res->stmt, SQL_ATTR_ROW_STATUS_PTR,
+                        res->rowstatus, 0);
+    if (SQL_SUCCEEDED(rc)) {
+        rc = SQLSetStmtAttr(res->stmt, SQL_ATTR_ROWS_FETCHED_PTR,
+                            &res->nfetched, 0);
+    }
+    for (i = 0; i < res->ncols && SQL_SUCCEEDED(rc); i++) {
+        res->blockptrs[i] = apr_pcalloc(res->pool,
+                                        res->rowset * res->colsizes[i]);
+        res->blockinds[i] = apr_pcalloc(res->pool,
+                                        res->rowset * sizeof(SQLLEN));
+        rc = SQLBindCol(res->stmt, i + 1, res->coltypes[i],
+                        res->blockptrs[i], res->colsizes[i],
+                        res->blockinds[i]);
+    }
+    CHECK_ERROR(res->apr_dbd, "SQLBindCol (rowset)", rc, SQL_HANDLE_STMT,
+                res->stmt);
+    return rc;
+}
+#endif
+
 /* create and populate an apr_dbd_results_t for a select */
 static SQLRETURN odbc_create_results(apr_dbd_t *handle, SQLHANDLE hstmt,
                                      apr_pool_t *pool, const int random,
@@ -499,6 +582,15 @@ static SQLRETURN odbc_create_results(apr_dbd_t *handle, SQLHANDLE hstmt,
         for (i = 0; i < ncols; i++) {
             odbc_set_result_column(i, (*res), hstmt);
         }
+
+        (*res)->rowset = 1;
+#ifndef ODBCV2
+        if (handle->rowset > 1 && !random
+            && (handle->dboptions & SQL_GD_BLOCK)
+            && (handle->dboptions & SQL_GD_BOUND)) {
+            rc = odbc_set_block_cursor(*res, handle->rowset);
+        }
+#endif
     }
     return rc;
 }
@@ -746,6 +838,7 @@ static void *odbc_get(const apr_dbd_row_t *row, const int col,
 {
     SQLRETURN rc;
     SQLLEN indicator;
+    SQLPOINTER buf;
     int state = row->res->colstate[col];
     apr_intptr_t options = row->res->apr_dbd->dboptions;
 
@@ -787,11 +880,30 @@ static void *odbc_get(const apr_dbd_row_t *row, const int col,
         /* this driver won't let us re-get bound columns */
         return (void *)-1;
 
-    /* a LOB might not have a buffer allocated yet - so create one */
-    if (!row->res->colptrs[col])
-        row->res->colptrs[col] = apr_pcalloc(row->pool, row->res->colsizes[col]);
+    if (row->res->rowset > 1) {
+        /* the bound buffers hold the rowset, so convert the current row
+         * into another buffer; the column keeps its type for the next rows
+         */
+        rc = SQLSetPos(row->res->stmt, row->res->rowpos + 1,
+                       SQL_POSITION, SQL_LOCK_NO_CHANGE);
+        CHECK_ERROR(row->res->apr_dbd, "SQLSetPos", rc, SQL_HANDLE_STMT,
+                    row->res->stmt);
+        if (!SQL_SUCCEEDED(rc))
+            return (void *)-1;
+        if (!row->res->convptrs[col])
+            row->res->convptrs[col] = apr_pcalloc(row->res->pool,
+                                                  row->res->colsizes[col]);
+        buf = row->res->convptrs[col];
+    }
+    else {
+        /* a LOB might not have a buffer allocated yet - so create one */
+        if (!row->res->colptrs[col])
+            row->res->colptrs[col] = apr_pcalloc(row->pool,
+                                                 row->res->colsizes[col]);
+        buf = row->res->colptrs[col];
+    }
 
-    rc = SQLGetData(row->res->stmt, col + 1, sqltype, row->res->colptrs[col],
+    rc = SQLGetData(row->res->stmt, col + 1, sqltype, buf,
                     row->res->colsizes[col], &indicator);
     CHECK_ERROR(row->res->apr_dbd, "SQLGetData", rc, SQL_HANDLE_STMT,
                 row->res->stmt);
@@ -800,13 +912,14 @@ static void *odbc_get(const apr_dbd_row_t *row, const int col,
 
     if (SQL_SUCCEEDED(rc)) {
         /* whatever it was originally, it is now this sqltype */
-        row->res->coltypes[col] = sqltype;
+        if (row->res->rowset == 1)
+            row->res->coltypes[col] = sqltype;
         /* this allows getting CLOBs in text mode by calling get_entry
          *   until it returns NULL
          */
         row->res->colstate[col] =
             (rc == SQL_SUCCESS_WITH_INFO) ? COL_AVAIL : COL_RETRIEVED;
-        return row->res->colptrs[col];
+        return buf;
     }
     else
         return (void *)-1;
@@ -816,7 +929,8 @@ static void *odbc_get(const apr_dbd_row_t *row, const int col,
 static apr_status_t odbc_parse_params(apr_pool_t *pool, const char *params,
                                int *connect, SQLCHAR **datasource,
                                SQLCHAR **user, SQLCHAR **password,
-                               int *defaultBufferSize, int *nattrs,
+                               int *defaultBufferSize, int *rowset,
+                               int *paramset, int *nattrs,
                                int **attrs, apr_intptr_t **attrvals)
 {
     char *seps, *last, *next, *name[MAX_PARAMS], *val[MAX_PARAMS];
@@ -870,6 +984,16 @@ static apr_status_t odbc_parse_params(apr_pool_t *pool, const char *params,
         else if (!apr_strnatcasecmp(name[i], "BUFSIZE")) {
             *defaultBufferSize = atoi(val[i]);
         }
+        else if (!apr_strnatcasecmp(name[i], "ROWSET")) {
+            *rowset = atoi(val[i]);
+            if (*rowset < 1)
+                return SQL_ERROR;
+        }
+        else if (!apr_strnatcasecmp(name[i], "PARAMSET")) {
+            *paramset = atoi(val[i]);
+            if (*paramset < 1)
+                return SQL_ERROR;
+        }
         else if (!apr_strnatcasecmp(name[i], "ACCESS")) {
             if (!apr_strnatcasecmp(val[i], "READ_ONLY"))
                 (*attrvals)[j] = SQL_MODE_READ_ONLY;
@@ -1059,6 +1183,7 @@ static apr_dbd_t *odbc_open(apr_pool_t *pool, const char *params, const char **e
     char *err_step;
     int err_htype, i;
     int defaultBufferSize = DEFAULT_BUFFER_SIZE;
+    int rowset = 1, paramset = DEFAULT_PARAMSET;
     SQLHANDLE err_h = NULL;
     SQLCHAR  *datasource = (SQLCHAR *)"", *user = (SQLCHAR *)"",
              *password = (SQLCHAR *)"";
@@ -1074,8 +1199,8 @@ static apr_dbd_t *odbc_open(apr_pool_t *pool, const char *params, const char **e
         err_htype = SQL_HANDLE_DBC;
         err_h = hdbc;
         rc = odbc_parse_params(pool, params, &connect, &datasource, &user,
-                               &password, &defaultBufferSize, &nattrs, &attrs,
-                               &attrvals);
+                               &password, &defaultBufferSize, &rowset,
+                               &paramset, &nattrs, &attrs, &attrvals);
     }
     if (SQL_SUCCEEDED(rc)) {
         for (i = 0; i < nattrs && SQL_SUCCEEDED(rc); i++) {
@@ -1113,6 +1238,8 @@ static apr_dbd_t *odbc_open(apr_pool_t *pool, const char *params, const char **e
         handle->dbc = hdbc;
         handle->pool = pool;
         handle->defaultBufferSize = defaultBufferSize;
+        handle->rowset = rowset;
+        handle->paramset = paramset;
         CHECK_ERROR(handle, "SQLConnect", rc, SQL_HANDLE_DBC, handle->dbc);
         handle->default_transaction_mode = 0;
         handle->can_commit = APR_DBD_TRANSACTION_IGNORE_ERRORS;
@@ -1306,6 +1433,49 @@ static int odbc_num_tuples(apr_dbd_results_t *res)
     return SQL_SUCCEEDED(rc) ? (int)nrows : -1;
 }
 
+/* get the next row of a block cursor, from the rowset when it is not
+ * exhausted, or from the next rowset fetched
+ */
+static int odbc_get_rowset_row(apr_dbd_results_t *res)
+{
+    SQLRETURN rc = SQL_SUCCESS;
+    SQLULEN pos = res->rowpos;
+    int c;
+
+    do {
+        if (res->nfetched && pos + 1 < res->nfetched) {
+            pos++;
+        }
+        else {
+            res->nfetched = 0;
+            rc = SQLFetch(res->stmt);
+            CHECK_ERROR(res->apr_dbd, "SQLFetch", rc, SQL_HANDLE_STMT,
+                        res->stmt);
+            if (!SQL_SUCCEEDED(rc) || !res->nfetched) {
+                /* early close, as for a sequential fetch */
+                odbc_close_results(res);
+                return -1;
+            }
+            pos = 0;
+        }
+    } while (res->rowstatus[pos] == SQL_ROW_NOROW
+             || res->rowstatus[pos] == SQL_ROW_DELETED);
+    res->rowpos = pos;
+
+    if (res->rowstatus[pos] == SQL_ROW_ERROR)
+        return -1;
+
+    for (c = 0; c < res->ncols; c++) {
+        res->colptrs[c] = res->blockptrs[c] + pos * res->colsizes[c];
+        res->colinds[c] = res->blockinds[c][pos];
+        res->colstate[c] = COL_BOUND;
+        /* some drivers do not null-term zero-len CHAR data */
+        if (res->colinds[c] == 0)
+            *(char *)res->colptrs[c] = 0;
+    }
+    return 0;
+}
+
 /** get_row: get a row from a result set **/
 static int odbc_get_row(apr_pool_t *pool, apr_dbd_results_t *res,
                         apr_dbd_row_t **row, int rownum)
@@ -1320,6 +1490,9 @@ static int odbc_get_row(apr_pool_t *pool, apr_dbd_results_t *res,
     (*row)->res = res;
     (*row)->pool = res->pool;
 
+    if (res->rowset > 1)
+        return odbc_get_rowset_row(res);
+
     /* mark all the columns as needing SQLGetData unless they are bound  */
     for (c = 0; c < res->ncols; c++) {
         if (res->colstate[c] != COL_BOUND) {
@@ -1697,6 +1870,216 @@ static int odbc_pvbselect(apr_pool_t *pool, apr_dbd_t *handle,
     return odbc_pbselect(pool, handle, res, statement, random, (const void **)values);
 }
 
+typedef struct {
+    apr_dbd_t *handle;
+    apr_pool_t *pool;           /* pool from bulk_begin */
+    apr_pool_t *rows;           /* values of the pending rows */
+    SQLHANDLE stmt;             /* the INSERT statement */
+    int ncols;
+    int paramset;               /* rows per execute */
+    int npending;               /* rows not executed yet */
+    int nrows;
+    int errnum;
+    const char **values;        /* paramset rows of ncols values */
+    SQLLEN *maxlens;            /* longest pending value of each column */
+} odbc_bulk_t;
+
+static apr_status_t odbc_bulk_cleanup(void *data)
+{
+    odbc_bulk_t *b = data;
+
+    if (b->stmt && b->handle->dbc) {
+        SQLFreeHandle(SQL_HANDLE_STMT, b->stmt);
+    }
+    b->stmt = NULL;
+    return APR_SUCCESS;
+}
+
+/* execute the INSERT once for all the pending rows, bound column-wise
+ * as arrays of strings as long as the longest value of their column
+ */
+static int odbc_bulk_flush(odbc_bulk_t *b)
+{
+    SQLRETURN rc = SQL_SUCCESS;
+    SQLLEN rowcount;
+    int i, r;
+
+    if (!b->npending)
+        return 0;
+
+    for (i = 0; i < b->ncols && SQL_SUCCEEDED(rc); i++) {
+        SQLLEN len = b->maxlens[i] + 1;
+        char *buf = apr_palloc(b->rows, b->npending * len);
+        SQLLEN *inds = apr_palloc(b->rows, b->npending * sizeof(SQLLEN));
+
+        for (r = 0; r < b->npending; r++) {
+            const char *value = b->values[r * b->ncols + i];
+
+            if (value) {
+                strcpy(buf + r * len, value);
+                inds[r] = SQL_NTS;
+            }
+            else {
+                inds[r] = SQL_NULL_DATA;
+            }
+        }
+        rc = SQLBindParameter(b->stmt, (SQLUSMALLINT)(i + 1), SQL_PARAM_INPUT,
+                              SQL_C_CHAR, SQL_VARCHAR,
+                              len > 1 ? len - 1 : 1, 0, buf, len, inds);
+        CHECK_ERROR(b->handle, "SQLBindParameter", rc, SQL_HANDLE_STMT,
+                    b->stmt);
+    }
+#ifndef ODBCV2
+    if (SQL_SUCCEEDED(rc) && b->paramset > 1) {
+        rc = SQLSetStmtAttr(b->stmt, SQL_ATTR_PARAMSET_SIZE,
+                            (SQLPOINTER)(SQLULEN)b->npending, 0);
+        CHECK_ERROR(b->handle, "SQLSetStmtAttr (SQL_ATTR_PARAMSET_SIZE)",
+                    rc, SQL_HANDLE_STMT, b->stmt);
+    }
+#endif
+    if (SQL_SUCCEEDED(rc)) {
+        rc = SQLExecute(b->stmt);
+        CHECK_ERROR(b->handle, "SQLExecute", rc, SQL_HANDLE_STMT, b->stmt);
+    }
+    if (SQL_SUCCEEDED(rc)) {
+        rc = SQLRowCount(b->stmt, &rowcount);
+        CHECK_ERROR(b->handle, "SQLRowCount", rc, SQL_HANDLE_STMT, b->stmt);
+        if (SQL_SUCCEEDED(rc) && rowcount > 0)
+            b->nrows += (int)rowcount;
+    }
+
+    b->npending = 0;
+    memset(b->maxlens, 0, b->ncols * sizeof(SQLLEN));
+    apr_pool_clear(b->rows);
+
+    return APR_FROM_SQL_RESULT(rc);
+}
+
+/** bulk_begin: an INSERT executed with arrays of PARAMSET rows **/
+static int odbc_bulk_begin(apr_pool_t *pool, apr_dbd_t *handle,
+                           const char *table, int ncols,
+                           const char *const *columns, void **bulk)
+{
+    SQLRETURN rc;
+#ifndef ODBCV2
+    SQLULEN size = 0;
+#endif
+    odbc_bulk_t *b;
+    char *query;
+    int i;
+
+    if (odbc_check_rollback(handle))
+        return APR_EGENERAL;
+
+    query = apr_pstrcat(pool, "INSERT INTO ", table, " (", NULL);
+    for (i = 0; i < ncols; i++) {
+        query = apr_pstrcat(pool, query, i ? ", " : "", columns[i], NULL);
+    }
+    query = apr_pstrcat(pool, query, ") VALUES (", NULL);
+    for (i = 0; i < ncols; i++) {
+        query = apr_pstrcat(pool, query, i ? ", ?" : "?", NULL);
+    }
+    query = apr_pstrcat(pool, query, ")", NULL);
+
+    b = apr_pcalloc(pool, sizeof(*b));
+    b->handle = handle;
+    b->pool = pool;
+    b->ncols = ncols;
+    b->paramset = handle->paramset;
+
+    rc = SQLAllocHandle(SQL_HANDLE_STMT, handle->dbc, &b->stmt);
+    CHECK_ERROR(handle, "SQLAllocHandle (STMT)", rc, SQL_HANDLE_DBC,
+                handle->dbc);
+    if (!SQL_SUCCEEDED(rc))
+        return APR_FROM_SQL_RESULT(rc);
+    apr_pool_cleanup_register(pool, b, odbc_bulk_cleanup,
+                              apr_pool_cleanup_null);
+
+    rc = SQLPrepare(b->stmt, (SQLCHAR *)query, SQL_NTS);
+    CHECK_ERROR(handle, "SQLPrepare", rc, SQL_HANDLE_STMT, b->stmt);
+    if (!SQL_SUCCEEDED(rc)) {
+        apr_pool_cleanup_run(pool, b, odbc_bulk_cleanup);
+        return APR_FROM_SQL_RESULT(rc);
+    }
+
+#ifdef ODBCV2
+    /* no parameter arrays in ODBC v2, a row per execute */
+    b->paramset = 1;
+#else
+    if (b->paramset > 1) {
+        rc = SQLSetStmtAttr(b->stmt, SQL_ATTR_PARAM_BIND_TYPE,
+                            (SQLPOINTER)SQL_PARAM_BIND_BY_COLUMN, 0);
+        if (SQL_SUCCEEDED(rc)) {
+            /* the driver may use a smaller size (SQL_SUCCESS_WITH_INFO) */
+            rc = SQLSetStmtAttr(b->stmt, SQL_ATTR_PARAMSET_SIZE,
+                                (SQLPOINTER)(SQLULEN)b->paramset, 0);
+        }
+        if (SQL_SUCCEEDED(rc)) {
+            rc = SQLGetStmtAttr(b->stmt, SQL_ATTR_PARAMSET_SIZE, &size,
+                                sizeof(size), NULL);
+        }
+        if (!SQL_SUCCEEDED(rc) || size <= 1) {
+            /* no parameter arrays, a row per execute */
+            SQLSetStmtAttr(b->stmt, SQL_ATTR_PARAMSET_SIZE, (SQLPOINTER)1, 0);
+            size = 1;
+        }
+        b->paramset = (int)size;
+    }
+#endif
+
+    apr_pool_create(&b->rows, pool);
+    b->values = apr_palloc(pool, b->paramset * ncols * sizeof(char *));
+    b->maxlens = apr_pcalloc(pool, ncols * sizeof(SQLLEN));
+
+    *bulk = b;
+    return 0;
+}
+
+/** bulk_row: add a row to the pending ones, executed when PARAMSET **/
+static int odbc_bulk_row(void *bulk, const char *const *values)
+{
+    odbc_bulk_t *b = bulk;
+    const char **row;
+    int i;
+
+    if (b->errnum)
+        return b->errnum;
+
+    row = b->values + b->npending * b->ncols;
+    for (i = 0; i < b->ncols; i++) {
+        if (values[i]) {
+            SQLLEN len = (SQLLEN)strlen(values[i]);
+
+            row[i] = apr_pstrmemdup(b->rows, values[i], len);
+            if (len > b->maxlens[i])
+                b->maxlens[i] = len;
+        }
+        else {
+            row[i] = NULL;
+        }
+    }
+
+    if (++b->npending >= b->paramset)
+        b->errnum = odbc_bulk_flush(b);
+
+    return b->errnum;
+}
+
+/** bulk_end: execute the pending rows **/
+static int odbc_bulk_end(void *bulk, int *nrows)
+{
+    odbc_bulk_t *b = bulk;
+
+    if (!b->errnum)
+        b->errnum = odbc_bulk_flush(b);
+
+    apr_pool_cleanup_run(b->pool, b, odbc_bulk_cleanup);
+    apr_pool_destroy(b->rows);
+
+    *nrows = b->nrows;
+    return b->errnum;
+}
+
 APR_MODULE_DECLARE_DATA const apr_dbd_driver_t ODBC_DRIVER_ENTRY = {
     ODBC_DRIVER_STRING,
     odbc_init,
@@ -1728,7 +2111,15 @@ APR_MODULE_DECLARE_DATA const apr_dbd_driver_t ODBC_DRIVER_ENTRY = {
     odbc_pvbselect,
     odbc_pbquery,
     odbc_pbselect,
-    odbc_datum_get
+    odbc_datum_get,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    odbc_bulk_begin,
+    odbc_bulk_row,
+    odbc_bulk_end
 };
 
 #endif
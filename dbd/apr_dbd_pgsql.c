@@ -31,6 +31,8 @@
 #include "apr_strings.h"
 #include "apr_time.h"
 #include "apr_buckets.h"
+#include "apr_poll.h"
+#include "apr_portable.h"
 
 #include "apr_dbd_internal.h"
 
@@ -43,6 +45,10 @@ struct apr_dbd_transaction_t {
 struct apr_dbd_t {
     PGconn *conn;
     apr_dbd_transaction_t *trans;
+    /* pipeline mode */
+    int synced;
+    int nrows;
+    int errnum;
 };
 
 struct apr_dbd_results_t {
@@ -1123,6 +1129,353 @@ static int dbd_pgsql_pvbselect(apr_pool_t * pool, apr_dbd_t * sql,
     return dbd_pgsql_pbselect(pool, sql, results, statement, seek, values);
 }
 
+#ifdef LIBPQ_HAS_PIPELINING
+
+static int dbd_pgsql_pipeline_begin(apr_pool_t *pool, apr_dbd_t *sql)
+{
+    if (sql->trans && sql->trans->errnum) {
+        return sql->trans->errnum;
+    }
+
+    if (!PQenterPipelineMode(sql->conn)) {
+        return PGRES_FATAL_ERROR;
+    }
+    sql->synced = 0;
+    sql->nrows = 0;
+    sql->errnum = 0;
+
+    return 0;
+}
+
+static int dbd_pgsql_pipeline_send(apr_dbd_t *sql,
+                                   apr_dbd_prepared_t *statement,
+                                   const char **values,
+                                   const int *len, const int *fmt)
+{
+    int ret;
+
+    if (statement->prepared) {
+        ret = PQsendQueryPrepared(sql->conn, statement->name,
+                                  statement->nargs, values, len, fmt, 0);
+    }
+    else {
+        ret = PQsendQueryParams(sql->conn, statement->name,
+                                statement->nargs, 0, values, len, fmt, 0);
+    }
+
+    return ret ? 0 : PGRES_FATAL_ERROR;
+}
+
+static int dbd_pgsql_pipeline_pquery(apr_pool_t *pool, apr_dbd_t *sql,
+                                     apr_dbd_prepared_t *statement,
+                                     const char **values)
+{
+    int *len, *fmt;
+    const char **val;
+
+    if (PQpipelineStatus(sql->conn) == PQ_PIPELINE_OFF || sql->synced) {
+        return APR_EINVAL;
+    }
+
+    val = apr_palloc(pool, sizeof(*val) * statement->nargs);
+    len = apr_pcalloc(pool, sizeof(*len) * statement->nargs);
+    fmt = apr_pcalloc(pool, sizeof(*fmt) * statement->nargs);
+
+    dbd_pgsql_bind(statement, values, val, len, fmt);
+
+    return dbd_pgsql_pipeline_send(sql, statement, val, len, fmt);
+}
+
+static int dbd_pgsql_pipeline_pbquery(apr_pool_t *pool, apr_dbd_t *sql,
+                                      apr_dbd_prepared_t *statement,
+                                      const void **values)
+{
+    int *len, *fmt;
+    const char **val;
+
+    if (PQpipelineStatus(sql->conn) == PQ_PIPELINE_OFF || sql->synced) {
+        return APR_EINVAL;
+    }
+
+    val = apr_palloc(pool, sizeof(*val) * statement->nargs);
+    len = apr_pcalloc(pool, sizeof(*len) * statement->nargs);
+    fmt = apr_pcalloc(pool, sizeof(*fmt) * statement->nargs);
+
+    dbd_pgsql_bbind(pool, statement, values, val, len, fmt);
+
+    return dbd_pgsql_pipeline_send(sql, statement, val, len, fmt);
+}
+
+/* Collect the results up to the sync point, APR_EAGAIN if some are still
+ * to be received in nonblocking mode.
+ */
+static int dbd_pgsql_pipeline_results(apr_dbd_t *sql, int nonblocking)
+{
+    PGresult *res;
+    int ret;
+
+    for (;;) {
+        if (nonblocking && PQisBusy(sql->conn)) {
+            return APR_EAGAIN;
+        }
+        res = PQgetResult(sql->conn);
+        if (!res) {
+            /* end of the results of a query, unless the connection broke */
+            if (PQstatus(sql->conn) != CONNECTION_OK) {
+                return PGRES_FATAL_ERROR;
+            }
+            continue;
+        }
+
+        ret = PQresultStatus(res);
+        if (ret == PGRES_PIPELINE_SYNC) {
+            PQclear(res);
+            return 0;
+        }
+        if (dbd_pgsql_is_success(ret)) {
+            sql->nrows += atoi(PQcmdTuples(res));
+        }
+        else if (!sql->errnum) {
+            /* the first error, the next queries are PGRES_PIPELINE_ABORTED */
+            sql->errnum = ret;
+        }
+        PQclear(res);
+    }
+}
+
+static int dbd_pgsql_pipeline_end(apr_pool_t *pool, apr_dbd_t *sql,
+                                  int *nrows, apr_int16_t *reqevents)
+{
+    int ret;
+
+    if (PQpipelineStatus(sql->conn) == PQ_PIPELINE_OFF) {
+        return APR_EINVAL;
+    }
+
+    if (!sql->synced) {
+        if (reqevents && PQsetnonblocking(sql->conn, 1)) {
+            return PGRES_FATAL_ERROR;
+        }
+        if (!PQpipelineSync(sql->conn)) {
+            return PGRES_FATAL_ERROR;
+        }
+        sql->synced = 1;
+    }
+
+    if (reqevents) {
+        ret = PQflush(sql->conn);
+        if (ret < 0) {
+            ret = PGRES_FATAL_ERROR;
+            goto done;
+        }
+        if (ret > 0) {
+            /* libpq reads the input too while waiting to write */
+            *reqevents = APR_POLLIN | APR_POLLOUT;
+            return APR_EAGAIN;
+        }
+        if (!PQconsumeInput(sql->conn)) {
+            ret = PGRES_FATAL_ERROR;
+            goto done;
+        }
+    }
+
+    ret = dbd_pgsql_pipeline_results(sql, reqevents != NULL);
+    if (ret == APR_EAGAIN) {
+        *reqevents = APR_POLLIN;
+        return APR_EAGAIN;
+    }
+
+done:
+    if (!ret) {
+        ret = sql->errnum;
+        if (dbd_pgsql_is_success(ret)) {
+            ret = 0;
+        }
+    }
+    *nrows = sql->nrows;
+
+    PQexitPipelineMode(sql->conn);
+    if (reqevents) {
+        PQsetnonblocking(sql->conn, 0);
+    }
+    sql->synced = 0;
+
+    if (TXN_NOTICE_ERRORS(sql->trans)) {
+        sql->trans->errnum = ret;
+    }
+    return ret;
+}
+
+#endif
+
+static apr_status_t dbd_pgsql_socket_get(apr_pool_t *pool, apr_dbd_t *sql,
+                                         apr_socket_t **sock)
+{
+    apr_os_sock_t sd;
+    int fd = PQsocket(sql->conn);
+
+    if (fd < 0) {
+        return APR_ENOTSOCK;
+    }
+
+    sd = fd;
+    *sock = NULL;
+    return apr_os_sock_put(sock, &sd, pool);
+}
+
+typedef struct {
+    apr_dbd_t *sql;
+    int ncols;
+    int errnum;
+    /* the line of a row, reused */
+    char *buf;
+    apr_size_t size;
+    apr_pool_t *pool;
+} dbd_pgsql_bulk_t;
+
+static int dbd_pgsql_bulk_begin(apr_pool_t *pool, apr_dbd_t *sql,
+                                const char *table, int ncols,
+                                const char *const *columns, void **bulk)
+{
+    dbd_pgsql_bulk_t *b;
+    PGresult *res;
+    char *query;
+    int i, ret;
+
+    if (sql->trans && sql->trans->errnum) {
+        return sql->trans->errnum;
+    }
+
+    query = apr_pstrcat(pool, "COPY ", table, " (", NULL);
+    for (i = 0; i < ncols; i++) {
+        query = apr_pstrcat(pool, query, i ? ", " : "", columns[i], NULL);
+    }
+    query = apr_pstrcat(pool, query, ") FROM STDIN", NULL);
+
+    res = PQexec(sql->conn, query);
+    if (!res) {
+        return PGRES_FATAL_ERROR;
+    }
+    ret = PQresultStatus(res);
+    PQclear(res);
+    if (ret != PGRES_COPY_IN) {
+        if (TXN_NOTICE_ERRORS(sql->trans)) {
+            sql->trans->errnum = ret;
+        }
+        return ret;
+    }
+
+    b = apr_pcalloc(pool, sizeof(*b));
+    b->sql = sql;
+    b->ncols = ncols;
+    b->pool = pool;
+
+    *bulk = b;
+    return 0;
+}
+
+/* A row in the text format of COPY: tab separated, \N for NULL */
+static int dbd_pgsql_bulk_row(void *bulk, const char *const *values)
+{
+    dbd_pgsql_bulk_t *b = bulk;
+    apr_size_t len = 0, need;
+    const char *c;
+    int i;
+
+    for (i = 0; i < b->ncols; i++) {
+        /* worst case: every character escaped, separator */
+        need = len + (values[i] ? strlen(values[i]) * 2 : 2) + 1;
+        if (need > b->size) {
+            char *buf;
+
+            b->size = need * 2;
+            buf = apr_palloc(b->pool, b->size);
+            if (len) {
+                memcpy(buf, b->buf, len);
+            }
+            b->buf = buf;
+        }
+        if (i) {
+            b->buf[len++] = '\t';
+        }
+        if (!values[i]) {
+            b->buf[len++] = '\\';
+            b->buf[len++] = 'N';
+            continue;
+        }
+        for (c = values[i]; *c; c++) {
+            switch (*c) {
+            case '\\':
+                b->buf[len++] = '\\';
+                b->buf[len++] = '\\';
+                break;
+            case '\t':
+                b->buf[len++] = '\\';
+                b->buf[len++] = 't';
+                break;
+            case '\n':
+                b->buf[len++] = '\\';
+                b->buf[len++] = 'n';
+                break;
+            case '\r':
+                b->buf[len++] = '\\';
+                b->buf[len++] = 'r';
+                break;
+            default:
+                b->buf[len++] = *c;
+                break;
+            }
+        }
+    }
+    if (len + 1 > b->size) {
+        char *buf;
+
+        b->size = len + 1;
+        buf = apr_palloc(b->pool, b->size);
+        memcpy(buf, b->buf, len);
+        b->buf = buf;
+    }
+    b->buf[len++] = '\n';
+
+    /* buffered by libpq */
+    if (PQputCopyData(b->sql->conn, b->buf, len) != 1) {
+        b->errnum = PGRES_FATAL_ERROR;
+        return b->errnum;
+    }
+
+    return 0;
+}
+
+static int dbd_pgsql_bulk_end(void *bulk, int *nrows)
+{
+    dbd_pgsql_bulk_t *b = bulk;
+    apr_dbd_t *sql = b->sql;
+    PGresult *res;
+    int ret = PGRES_FATAL_ERROR;
+
+    *nrows = 0;
+
+    /* all or nothing */
+    if (PQputCopyEnd(sql->conn, b->errnum ? "aborted" : NULL) == 1) {
+        while ((res = PQgetResult(sql->conn))) {
+            ret = PQresultStatus(res);
+            if (dbd_pgsql_is_success(ret)) {
+                ret = 0;
+                *nrows = atoi(PQcmdTuples(res));
+            }
+            PQclear(res);
+        }
+    }
+    if (b->errnum) {
+        ret = b->errnum;
+    }
+
+    if (ret && TXN_NOTICE_ERRORS(sql->trans)) {
+        sql->trans->errnum = ret;
+    }
+    return ret;
+}
+
 static int dbd_pgsql_start_transaction(apr_pool_t *pool, apr_dbd_t *handle,
                                        apr_dbd_transaction_t **trans)
 {
@@ -1309,6 +1662,21 @@ APR_MODULE_DECLARE_DATA const apr_dbd_driver_t apr_dbd_pgsql_driver = {
     dbd_pgsql_pvbselect,
     dbd_pgsql_pbquery,
     dbd_pgsql_pbselect,
-    dbd_pgsql_datum_get
+    dbd_pgsql_datum_get,
+#ifdef LIBPQ_HAS_PIPELINING
+    dbd_pgsql_pipeline_begin,
+    dbd_pgsql_pipeline_pquery,
+    dbd_pgsql_pipeline_pbquery,
+    dbd_pgsql_pipeline_end,
+#else
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+#endif
+    dbd_pgsql_socket_get,
+    dbd_pgsql_bulk_begin,
+    dbd_pgsql_bulk_row,
+    dbd_pgsql_bulk_end
 };
 #endif
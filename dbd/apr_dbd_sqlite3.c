@@ -27,11 +27,48 @@
 #include "apr_strings.h"
 #include "apr_time.h"
 #include "apr_buckets.h"
+#include "apr_hash.h"
+#include "apr_ring.h"
 
 #include "apr_dbd_internal.h"
 
-#define MAX_RETRY_COUNT 15
-#define MAX_RETRY_SLEEP 100000
+/* How long to wait for the locks of other connections (ms) */
+#define BUSY_TIMEOUT 1500
+
+/* Each connection is serialized by SQLite (SQLITE_OPEN_FULLMUTEX) so that
+ * connections to different databases run concurrently; the global dbd mutex
+ * is only needed when SQLite is not threadsafe at all.
+ */
+#define dbd_sqlite3_lock() do { \
+    if (!sqlite3_threadsafe()) \
+        apr_dbd_mutex_lock(); \
+} while (0)
+#define dbd_sqlite3_unlock() do { \
+    if (!sqlite3_threadsafe()) \
+        apr_dbd_mutex_unlock(); \
+} while (0)
+
+/* The statements are long lived, either prepared or cached */
+#ifdef SQLITE_PREPARE_PERSISTENT
+#define dbd_sqlite3_prepare_stmt(conn, query, length, stmt, tail) \
+    sqlite3_prepare_v3(conn, query, length, SQLITE_PREPARE_PERSISTENT, \
+                       stmt, tail)
+#else
+#define dbd_sqlite3_prepare_stmt(conn, query, length, stmt, tail) \
+    sqlite3_prepare_v2(conn, query, length, stmt, tail)
+#endif
+
+/* How many ad hoc queries are kept prepared for each connection */
+#define STMT_CACHE_SIZE 16
+
+typedef struct dbd_sqlite3_cached_t dbd_sqlite3_cached_t;
+struct dbd_sqlite3_cached_t {
+    APR_RING_ENTRY(dbd_sqlite3_cached_t) link;
+    sqlite3_stmt *stmt;
+    const char *query; /* sqlite3_sql(stmt) */
+    apr_size_t len;
+    int busy; /* in use, by a sequential result maybe */
+};
 
 struct apr_dbd_transaction_t {
     int mode;
@@ -44,6 +81,12 @@ struct apr_dbd_t {
     apr_dbd_transaction_t *trans;
     apr_pool_t *pool;
     apr_dbd_prepared_t *prep;
+    /* ad hoc queries by text, the most recently used first */
+    apr_hash_t *cache_hash;
+    APR_RING_HEAD(dbd_sqlite3_cache, dbd_sqlite3_cached_t) cache;
+    int cache_count;
+    /* sequential results still stepping their statement */
+    APR_RING_HEAD(dbd_sqlite3_streams, apr_dbd_results_t) streams;
 };
 
 typedef struct {
@@ -51,6 +94,8 @@ typedef struct {
     char *value;
     int size;
     int type;
+    char *buf; /* reused by sequential results */
+    apr_size_t bufsize;
 } apr_dbd_column_t;
 
 struct apr_dbd_row_t {
@@ -70,6 +115,15 @@ struct apr_dbd_results_t {
     int tuples;
     char **col_names;
     apr_pool_t *pool;
+    /* sequential access: the statement (if still stepping) is positioned
+     * on the next row, copied into the single reused row on get_row()
+     */
+    APR_RING_ENTRY(apr_dbd_results_t) link;
+    apr_dbd_t *sql;
+    dbd_sqlite3_cached_t *cached;
+    int finalize;
+    int err;
+    apr_dbd_row_t *row;
 };
 
 struct apr_dbd_prepared_t {
@@ -82,12 +136,182 @@ struct apr_dbd_prepared_t {
 
 #define dbd_sqlite3_is_success(x) (((x) == SQLITE_DONE) || ((x) == SQLITE_OK))
 
+static dbd_sqlite3_cached_t *dbd_sqlite3_cache_put(apr_dbd_t *sql,
+                                                   sqlite3_stmt *stmt)
+{
+    dbd_sqlite3_cached_t *c;
+
+    if (sql->cache_count < STMT_CACHE_SIZE) {
+        c = apr_palloc(sql->pool, sizeof(*c));
+        sql->cache_count++;
+    }
+    else {
+        /* recycle the least recently used, unless in use */
+        for (c = APR_RING_LAST(&sql->cache);
+             c != APR_RING_SENTINEL(&sql->cache, dbd_sqlite3_cached_t, link);
+             c = APR_RING_PREV(c, link)) {
+            if (!c->busy) {
+                break;
+            }
+        }
+        if (c == APR_RING_SENTINEL(&sql->cache, dbd_sqlite3_cached_t, link)) {
+            return NULL;
+        }
+        APR_RING_REMOVE(c, link);
+        apr_hash_set(sql->cache_hash, c->query, c->len, NULL);
+        sqlite3_finalize(c->stmt);
+    }
+    c->stmt = stmt;
+    c->query = sqlite3_sql(stmt);
+    c->len = strlen(c->query);
+    c->busy = 1;
+    apr_hash_set(sql->cache_hash, c->query, c->len, c);
+    APR_RING_INSERT_HEAD(&sql->cache, c, dbd_sqlite3_cached_t, link);
+    return c;
+}
+
+/* Prepare the (first) statement of an ad hoc query, from the cache if it
+ * is the whole query and not in use already; a non-NULL *cached tells to
+ * reset rather than finalize it.
+ */
+static int dbd_sqlite3_prepare_adhoc(apr_dbd_t *sql, const char *query,
+                                     int length, sqlite3_stmt **stmt,
+                                     const char **tail,
+                                     dbd_sqlite3_cached_t **cached)
+{
+    dbd_sqlite3_cached_t *c;
+    int ret;
+
+    c = apr_hash_get(sql->cache_hash, query, length);
+    if (c && !c->busy) {
+        APR_RING_REMOVE(c, link);
+        APR_RING_INSERT_HEAD(&sql->cache, c, dbd_sqlite3_cached_t, link);
+        c->busy = 1;
+        *stmt = c->stmt;
+        *tail = query + length;
+        *cached = c;
+        return SQLITE_OK;
+    }
+
+    *cached = NULL;
+    ret = dbd_sqlite3_prepare_stmt(sql->conn, query, length, stmt, tail);
+    if (ret == SQLITE_OK && *stmt && *tail == query + length && !c) {
+        *cached = dbd_sqlite3_cache_put(sql, *stmt);
+    }
+    return ret;
+}
+
+/* Done with a statement, cached, ad hoc (finalize) or prepared */
+static void dbd_sqlite3_release_stmt(sqlite3_stmt *stmt,
+                                     dbd_sqlite3_cached_t *cached,
+                                     int finalize)
+{
+    if (cached) {
+        cached->busy = 0;
+        sqlite3_reset(stmt);
+    }
+    else if (finalize) {
+        sqlite3_finalize(stmt);
+    }
+    else {
+        sqlite3_reset(stmt);
+    }
+}
+
+#define dbd_sqlite3_release_adhoc(stmt, cached) \
+    dbd_sqlite3_release_stmt(stmt, cached, 1)
+
+/* Release the statement of a sequential result once stepped to the end */
+static void dbd_sqlite3_stream_end(apr_dbd_results_t *res)
+{
+    if (res->stmt) {
+        APR_RING_REMOVE(res, link);
+        dbd_sqlite3_release_stmt(res->stmt, res->cached, res->finalize);
+        res->stmt = NULL;
+        res->cached = NULL;
+    }
+}
+
+static apr_status_t dbd_sqlite3_stream_cleanup(void *data)
+{
+    dbd_sqlite3_lock();
+    dbd_sqlite3_stream_end(data);
+    dbd_sqlite3_unlock();
+    return APR_SUCCESS;
+}
+
+static void dbd_sqlite3_stream_close(apr_dbd_results_t *res)
+{
+    if (res->stmt) {
+        apr_pool_cleanup_kill(res->pool, res, dbd_sqlite3_stream_cleanup);
+        dbd_sqlite3_stream_end(res);
+    }
+}
+
+/* A prepared statement is about to be reset, end its sequential results */
+static void dbd_sqlite3_stream_detach(apr_dbd_t *sql, sqlite3_stmt *stmt)
+{
+    apr_dbd_results_t *res, *next;
+
+    for (res = APR_RING_FIRST(&sql->streams);
+         res != APR_RING_SENTINEL(&sql->streams, apr_dbd_results_t, link);
+         res = next) {
+        next = APR_RING_NEXT(res, link);
+        if (res->stmt == stmt) {
+            dbd_sqlite3_stream_close(res);
+        }
+    }
+}
+
+/* Copy the current row of a sequential result into its reused row, the
+ * buffers grow as needed only.
+ */
+static void dbd_sqlite3_stream_fetch(apr_dbd_results_t *res)
+{
+    apr_dbd_row_t *row = res->row;
+    sqlite3_stmt *stmt = res->stmt;
+    int i;
+
+    for (i = 0; i < row->columnCount; i++) {
+        apr_dbd_column_t *column = row->columns[i];
+        const char *hold;
+
+        column->type = sqlite3_column_type(stmt, i);
+        switch (column->type) {
+        case SQLITE_BLOB:
+            hold = sqlite3_column_blob(stmt, i);
+            break;
+        case SQLITE_NULL:
+            hold = NULL;
+            break;
+        default:
+            hold = (const char *) sqlite3_column_text(stmt, i);
+            break;
+        }
+        column->size = sqlite3_column_bytes(stmt, i);
+        if (!hold) {
+            column->value = NULL;
+            continue;
+        }
+        if ((apr_size_t)column->size >= column->bufsize) {
+            column->bufsize = (column->size | 63) + 1;
+            column->buf = apr_palloc(res->pool, column->bufsize);
+        }
+        memcpy(column->buf, hold, column->size);
+        column->buf[column->size] = '\0';
+        column->value = column->buf;
+    }
+    row->rownum = res->tuples++;
+}
+
 static int dbd_sqlite3_select_internal(apr_pool_t *pool,
                                        apr_dbd_t *sql,
                                        apr_dbd_results_t **results,
-                                       sqlite3_stmt *stmt, int seek)
+                                       sqlite3_stmt *stmt, int seek,
+                                       dbd_sqlite3_cached_t *cached,
+                                       int finalize)
 {
-    int ret, retry_count = 0, column_count;
+    int ret, column_count;
     size_t i, num_tuples = 0;
     int increment = 0;
     apr_dbd_row_t *row = NULL;
@@ -99,24 +323,57 @@ static int dbd_sqlite3_select_internal(apr_pool_t *pool,
     if (!*results) {
         *results = apr_pcalloc(pool, sizeof(apr_dbd_results_t));
     }
-    (*results)->stmt = stmt;
+    else {
+        dbd_sqlite3_stream_close(*results);
+    }
+    (*results)->stmt = NULL;
     (*results)->sz = column_count;
     (*results)->random = seek;
     (*results)->next_row = 0;
     (*results)->tuples = 0;
     (*results)->col_names = apr_pcalloc(pool, column_count * sizeof(char *));
     (*results)->pool = pool;
+    (*results)->err = 0;
+    (*results)->row = NULL;
+
+    if (!seek) {
+        /* step to the first row only, the next ones are stepped (and
+         * copied into the same row) by get_row()
+         */
+        ret = sqlite3_step(stmt);
+        if (ret != SQLITE_ROW) {
+            dbd_sqlite3_release_stmt(stmt, cached, finalize);
+            return dbd_sqlite3_is_success(ret) ? 0 : ret;
+        }
+
+        row = apr_palloc(pool, sizeof(apr_dbd_row_t));
+        row->res = *results;
+        row->columns = apr_palloc(pool, column_count * sizeof(*row->columns));
+        row->columnCount = column_count;
+        row->next_row = NULL;
+        for (i = 0; i < (size_t)column_count; i++) {
+            column = apr_pcalloc(pool, sizeof(apr_dbd_column_t));
+            row->columns[i] = column;
+            (*results)->col_names[i] =
+                apr_pstrdup(pool, sqlite3_column_name(stmt, i));
+            column->name = (*results)->col_names[i];
+        }
+        (*results)->row = row;
+
+        (*results)->stmt = stmt;
+        (*results)->sql = sql;
+        (*results)->cached = cached;
+        (*results)->finalize = finalize;
+        APR_RING_INSERT_TAIL(&sql->streams, *results, apr_dbd_results_t, link);
+        apr_pool_cleanup_register(pool, *results, dbd_sqlite3_stream_cleanup,
+                                  apr_pool_cleanup_null);
+        return 0;
+    }
+
     do {
+        /* SQLITE_BUSY once the busy timeout elapsed */
         ret = sqlite3_step(stmt);
-        if (ret == SQLITE_BUSY) {
-            if (retry_count++ > MAX_RETRY_COUNT) {
-                ret = SQLITE_ERROR;
-            } else {
-                apr_dbd_mutex_unlock();
-                apr_sleep(MAX_RETRY_SLEEP);
-                apr_dbd_mutex_lock();
-            }
-        } else if (ret == SQLITE_ROW) {
+        if (ret == SQLITE_ROW) {
             int length;
             row = apr_palloc(pool, sizeof(apr_dbd_row_t));
             row->res = *results;
@@ -168,7 +425,9 @@ static int dbd_sqlite3_select_internal(apr_pool_t *pool,
             }
             lastrow = row;
         }
-    } while (ret == SQLITE_ROW || ret == SQLITE_BUSY);
+    } while (ret == SQLITE_ROW);
+
+    dbd_sqlite3_release_stmt(stmt, cached, finalize);
 
     if (dbd_sqlite3_is_success(ret)) {
         ret = 0;
@@ -182,21 +441,27 @@ static int dbd_sqlite3_select(apr_pool_t *pool, apr_dbd_t *sql,
 {
     sqlite3_stmt *stmt = NULL;
     const char *tail = NULL;
+    dbd_sqlite3_cached_t *cached;
     int ret;
 
     if (sql->trans && sql->trans->errnum) {
         return sql->trans->errnum;
     }
 
-    apr_dbd_mutex_lock();
+    dbd_sqlite3_lock();
 
-    ret = sqlite3_prepare(sql->conn, query, strlen(query), &stmt, &tail);
+    ret = dbd_sqlite3_prepare_adhoc(sql, query, strlen(query), &stmt, &tail,
+                                    &cached);
     if (dbd_sqlite3_is_success(ret)) {
-        ret = dbd_sqlite3_select_internal(pool, sql, results, stmt, seek);
+        /* releases the statement */
+        ret = dbd_sqlite3_select_internal(pool, sql, results, stmt, seek,
+                                          cached, 1);
+    }
+    else {
+        dbd_sqlite3_release_adhoc(stmt, cached);
     }
-    sqlite3_finalize(stmt);
 
-    apr_dbd_mutex_unlock();
+    dbd_sqlite3_unlock();
 
     if (TXN_NOTICE_ERRORS(sql->trans)) {
         sql->trans->errnum = ret;
@@ -218,6 +483,33 @@ static int dbd_sqlite3_get_row(apr_pool_t *pool, apr_dbd_results_t *res,
 {
     int i = 0;
 
+    if (!res->random) {
+        int ret;
+
+        if (res->err) {
+            ret = res->err;
+            res->err = 0;
+            return ret;
+        }
+        if (!res->stmt) {
+            return -1;
+        }
+
+        dbd_sqlite3_lock();
+        dbd_sqlite3_stream_fetch(res);
+        ret = sqlite3_step(res->stmt);
+        if (ret != SQLITE_ROW) {
+            if (!dbd_sqlite3_is_success(ret)) {
+                res->err = ret;
+            }
+            dbd_sqlite3_stream_close(res);
+        }
+        dbd_sqlite3_unlock();
+
+        *rowp = res->row;
+        return 0;
+    }
+
     if (rownum == -1) {
         *rowp = res->next_row;
         if (*rowp == 0)
@@ -315,7 +607,12 @@ static apr_status_t dbd_sqlite3_datum_get(const apr_dbd_row_t *row, int n,
         apr_bucket *e;
         apr_bucket_brigade *b = (apr_bucket_brigade*)data;
 
-        e = apr_bucket_pool_create(row->columns[n]->value,
+        /* the row of a sequential result is overwritten by the next */
+        e = apr_bucket_pool_create(row->res->random
+                                   ? row->columns[n]->value
+                                   : apr_pmemdup(row->res->pool,
+                                                 row->columns[n]->value,
+                                                 row->columns[n]->size),
                                    row->columns[n]->size,
                                    row->res->pool, b->bucket_alloc);
         APR_BRIGADE_INSERT_TAIL(b, e);
@@ -339,17 +636,10 @@ static const char *dbd_sqlite3_error(apr_dbd_t *sql, int n)
 static int dbd_sqlite3_query_internal(apr_dbd_t *sql, sqlite3_stmt *stmt,
                                       int *nrows)
 {
-    int ret = -1, retry_count = 0;
-
-    while(retry_count++ <= MAX_RETRY_COUNT) {
-        ret = sqlite3_step(stmt);
-        if (ret != SQLITE_BUSY)
-            break;
+    int ret;
 
-        apr_dbd_mutex_unlock();
-        apr_sleep(MAX_RETRY_SLEEP);
-        apr_dbd_mutex_lock();
-    }
+    /* SQLITE_BUSY once the busy timeout elapsed */
+    ret = sqlite3_step(stmt);
 
     *nrows = sqlite3_changes(sql->conn);
 
@@ -363,6 +653,7 @@ static int dbd_sqlite3_query(apr_dbd_t *sql, int *nrows, const char *query)
 {
     sqlite3_stmt *stmt = NULL;
     const char *tail = NULL;
+    dbd_sqlite3_cached_t *cached;
     int ret = -1, length = 0;
 
     if (sql->trans && sql->trans->errnum) {
@@ -370,10 +661,11 @@ static int dbd_sqlite3_query(apr_dbd_t *sql, int *nrows, const char *query)
     }
 
     length = strlen(query);
-    apr_dbd_mutex_lock();
+    dbd_sqlite3_lock();
 
     do {
-        ret = sqlite3_prepare(sql->conn, query, length, &stmt, &tail);
+        ret = dbd_sqlite3_prepare_adhoc(sql, query, length, &stmt, &tail,
+                                        &cached);
         if (ret != SQLITE_OK) {
             sqlite3_finalize(stmt);
             break;
@@ -381,12 +673,12 @@ static int dbd_sqlite3_query(apr_dbd_t *sql, int *nrows, const char *query)
 
         ret = dbd_sqlite3_query_internal(sql, stmt, nrows);
 
-        sqlite3_finalize(stmt);
+        dbd_sqlite3_release_adhoc(stmt, cached);
         length -= (tail - query);
         query = tail;
     } while (length > 0);
 
-    apr_dbd_mutex_unlock();
+    dbd_sqlite3_unlock();
 
     if (TXN_NOTICE_ERRORS(sql->trans)) {
         sql->trans->errnum = ret;
@@ -418,9 +710,10 @@ static int dbd_sqlite3_prepare(apr_pool_t *pool, apr_dbd_t *sql,
     const char *tail = NULL;
     int ret;
 
-    apr_dbd_mutex_lock();
+    dbd_sqlite3_lock();
 
-    ret = sqlite3_prepare(sql->conn, query, strlen(query), &stmt, &tail);
+    ret = dbd_sqlite3_prepare_stmt(sql->conn, query, strlen(query), &stmt,
+                                   &tail);
     if (ret == SQLITE_OK) {
         apr_dbd_prepared_t *prep;
 
@@ -439,7 +732,7 @@ static int dbd_sqlite3_prepare(apr_pool_t *pool, apr_dbd_t *sql,
         sqlite3_finalize(stmt);
     }
 
-    apr_dbd_mutex_unlock();
+    dbd_sqlite3_unlock();
 
     return ret;
 }
@@ -489,8 +782,9 @@ static int dbd_sqlite3_pquery(apr_pool_t *pool, apr_dbd_t *sql,
         return sql->trans->errnum;
     }
 
-    apr_dbd_mutex_lock();
+    dbd_sqlite3_lock();
 
+    dbd_sqlite3_stream_detach(sql, stmt);
     ret = sqlite3_reset(stmt);
     if (ret == SQLITE_OK) {
         dbd_sqlite3_bind(statement, values);
@@ -500,7 +794,7 @@ static int dbd_sqlite3_pquery(apr_pool_t *pool, apr_dbd_t *sql,
         sqlite3_reset(stmt);
     }
 
-    apr_dbd_mutex_unlock();
+    dbd_sqlite3_unlock();
 
     if (TXN_NOTICE_ERRORS(sql->trans)) {
         sql->trans->errnum = ret;
@@ -539,18 +833,19 @@ static int dbd_sqlite3_pselect(apr_pool_t *pool, apr_dbd_t *sql,
         return sql->trans->errnum;
     }
 
-    apr_dbd_mutex_lock();
+    dbd_sqlite3_lock();
 
+    dbd_sqlite3_stream_detach(sql, stmt);
     ret = sqlite3_reset(stmt);
     if (ret == SQLITE_OK) {
         dbd_sqlite3_bind(statement, values);
 
-        ret = dbd_sqlite3_select_internal(pool, sql, results, stmt, seek);
-
-        sqlite3_reset(stmt);
+        /* resets the statement */
+        ret = dbd_sqlite3_select_internal(pool, sql, results, stmt, seek,
+                                          NULL, 0);
     }
 
-    apr_dbd_mutex_unlock();
+    dbd_sqlite3_unlock();
 
     if (TXN_NOTICE_ERRORS(sql->trans)) {
         sql->trans->errnum = ret;
@@ -669,8 +964,9 @@ static int dbd_sqlite3_pbquery(apr_pool_t * pool, apr_dbd_t * sql,
         return sql->trans->errnum;
     }
 
-    apr_dbd_mutex_lock();
+    dbd_sqlite3_lock();
 
+    dbd_sqlite3_stream_detach(sql, stmt);
     ret = sqlite3_reset(stmt);
     if (ret == SQLITE_OK) {
         dbd_sqlite3_bbind(statement, values);
@@ -680,7 +976,7 @@ static int dbd_sqlite3_pbquery(apr_pool_t * pool, apr_dbd_t * sql,
         sqlite3_reset(stmt);
     }
 
-    apr_dbd_mutex_unlock();
+    dbd_sqlite3_unlock();
 
     if (TXN_NOTICE_ERRORS(sql->trans)) {
         sql->trans->errnum = ret;
@@ -720,18 +1016,19 @@ static int dbd_sqlite3_pbselect(apr_pool_t * pool, apr_dbd_t * sql,
         return sql->trans->errnum;
     }
 
-    apr_dbd_mutex_lock();
+    dbd_sqlite3_lock();
 
+    dbd_sqlite3_stream_detach(sql, stmt);
     ret = sqlite3_reset(stmt);
     if (ret == SQLITE_OK) {
         dbd_sqlite3_bbind(statement, values);
 
-        ret = dbd_sqlite3_select_internal(pool, sql, results, stmt, seek);
-
-        sqlite3_reset(stmt);
+        /* resets the statement */
+        ret = dbd_sqlite3_select_internal(pool, sql, results, stmt, seek,
+                                          NULL, 0);
     }
 
-    apr_dbd_mutex_unlock();
+    dbd_sqlite3_unlock();
 
     if (TXN_NOTICE_ERRORS(sql->trans)) {
         sql->trans->errnum = ret;
@@ -796,6 +1093,120 @@ static int dbd_sqlite3_end_transaction(apr_dbd_transaction_t *trans)
     return ret;
 }
 
+typedef struct {
+    apr_dbd_t *sql;
+    sqlite3_stmt *stmt;
+    int ncols;
+    int nrows;
+    int errnum;
+    int own_trans;
+} dbd_sqlite3_bulk_t;
+
+/* A single transaction (unless in one already) and INSERT statement */
+static int dbd_sqlite3_bulk_begin(apr_pool_t *pool, apr_dbd_t *sql,
+                                  const char *table, int ncols,
+                                  const char *const *columns, void **bulk)
+{
+    dbd_sqlite3_bulk_t *b;
+    char *query;
+    int i, ret, nrows;
+
+    query = apr_pstrcat(pool, "INSERT INTO ", table, " (", NULL);
+    for (i = 0; i < ncols; i++) {
+        query = apr_pstrcat(pool, query, i ? ", " : "", columns[i], NULL);
+    }
+    query = apr_pstrcat(pool, query, ") VALUES (", NULL);
+    for (i = 0; i < ncols; i++) {
+        query = apr_pstrcat(pool, query, i ? ", ?" : "?", NULL);
+    }
+    query = apr_pstrcat(pool, query, ")", NULL);
+
+    b = apr_pcalloc(pool, sizeof(*b));
+    b->sql = sql;
+    b->ncols = ncols;
+
+    if (!sql->trans) {
+        ret = dbd_sqlite3_query(sql, &nrows, "BEGIN IMMEDIATE");
+        if (ret) {
+            return ret;
+        }
+        b->own_trans = 1;
+    }
+    else if (sql->trans->errnum) {
+        return sql->trans->errnum;
+    }
+
+    dbd_sqlite3_lock();
+    ret = sqlite3_prepare_v2(sql->conn, query, -1, &b->stmt, NULL);
+    dbd_sqlite3_unlock();
+    if (ret != SQLITE_OK) {
+        sqlite3_finalize(b->stmt);
+        if (b->own_trans) {
+            dbd_sqlite3_query(sql, &nrows, "ROLLBACK");
+        }
+        return ret;
+    }
+
+    *bulk = b;
+    return 0;
+}
+
+static int dbd_sqlite3_bulk_row(void *bulk, const char *const *values)
+{
+    dbd_sqlite3_bulk_t *b = bulk;
+    int i, ret;
+
+    dbd_sqlite3_lock();
+
+    for (i = 0; i < b->ncols; i++) {
+        if (values[i]) {
+            sqlite3_bind_text(b->stmt, i + 1, values[i], -1, SQLITE_STATIC);
+        }
+        else {
+            sqlite3_bind_null(b->stmt, i + 1);
+        }
+    }
+    ret = sqlite3_step(b->stmt);
+    sqlite3_reset(b->stmt);
+
+    dbd_sqlite3_unlock();
+
+    if (ret != SQLITE_DONE) {
+        b->errnum = ret;
+        if (TXN_NOTICE_ERRORS(b->sql->trans)) {
+            b->sql->trans->errnum = ret;
+        }
+        return ret;
+    }
+    b->nrows++;
+
+    return 0;
+}
+
+static int dbd_sqlite3_bulk_end(void *bulk, int *nrows)
+{
+    dbd_sqlite3_bulk_t *b = bulk;
+    int ret = 0, n;
+
+    dbd_sqlite3_lock();
+    sqlite3_finalize(b->stmt);
+    dbd_sqlite3_unlock();
+
+    if (b->own_trans) {
+        /* all or nothing */
+        if (b->errnum) {
+            dbd_sqlite3_query(b->sql, &n, "ROLLBACK");
+            b->nrows = 0;
+        }
+        else {
+            ret = dbd_sqlite3_query(b->sql, &n, "COMMIT");
+        }
+    }
+    *nrows = b->nrows;
+
+    return ret;
+}
+
 static int dbd_sqlite3_transaction_mode_get(apr_dbd_transaction_t *trans)
 {
     if (!trans)
@@ -821,7 +1232,12 @@ static apr_dbd_t *dbd_sqlite3_open(apr_pool_t *pool, const char *params,
     int sqlres;
     if (!params)
         return NULL;
+#ifdef SQLITE_OPEN_FULLMUTEX
+    sqlres = sqlite3_open_v2(params, &conn, SQLITE_OPEN_READWRITE
+            | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX, NULL);
+#else
     sqlres = sqlite3_open(params, &conn);
+#endif
     if (sqlres != SQLITE_OK) {
         if (error) {
             *error = apr_pstrdup(pool, sqlite3_errmsg(conn));
@@ -829,11 +1245,15 @@ static apr_dbd_t *dbd_sqlite3_open(apr_pool_t *pool, const char *params,
         sqlite3_close(conn);
         return NULL;
     }
+    sqlite3_busy_timeout(conn, BUSY_TIMEOUT);
     /* should we register rand or power functions to the sqlite VM? */
     sql = apr_pcalloc(pool, sizeof(*sql));
     sql->conn = conn;
     sql->pool = pool;
     sql->trans = NULL;
+    sql->cache_hash = apr_hash_make(pool);
+    APR_RING_INIT(&sql->cache, dbd_sqlite3_cached_t, link);
+    APR_RING_INIT(&sql->streams, apr_dbd_results_t, link);
 
     return sql;
 }
@@ -841,12 +1261,22 @@ static apr_dbd_t *dbd_sqlite3_open(apr_pool_t *pool, const char *params,
 static apr_status_t dbd_sqlite3_close(apr_dbd_t *handle)
 {
     apr_dbd_prepared_t *prep = handle->prep;
+    dbd_sqlite3_cached_t *c;
+
+    while (!APR_RING_EMPTY(&handle->streams, apr_dbd_results_t, link)) {
+        dbd_sqlite3_stream_close(APR_RING_FIRST(&handle->streams));
+    }
 
     /* finalize all prepared statements, or we'll get SQLITE_BUSY on close */
     while (prep) {
         sqlite3_finalize(prep->stmt);
         prep = prep->next;
     }
+    for (c = APR_RING_FIRST(&handle->cache);
+         c != APR_RING_SENTINEL(&handle->cache, dbd_sqlite3_cached_t, link);
+         c = APR_RING_NEXT(c, link)) {
+        sqlite3_finalize(c->stmt);
+    }
 
     sqlite3_close(handle->conn);
     return APR_SUCCESS;
@@ -876,6 +1306,10 @@ static int dbd_sqlite3_num_cols(apr_dbd_results_t *res)
 
 static int dbd_sqlite3_num_tuples(apr_dbd_results_t *res)
 {
+    if (!res->random) {
+        /* unknown until stepped to the end */
+        return -1;
+    }
     return res->tuples;
 }
 
@@ -910,6 +1344,14 @@ APR_MODULE_DECLARE_DATA const apr_dbd_driver_t apr_dbd_sqlite3_driver = {
     dbd_sqlite3_pvbselect,
     dbd_sqlite3_pbquery,
     dbd_sqlite3_pbselect,
-    dbd_sqlite3_datum_get
+    dbd_sqlite3_datum_get,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    dbd_sqlite3_bulk_begin,
+    dbd_sqlite3_bulk_row,
+    dbd_sqlite3_bulk_end
 };
 #endif
@@ -95,6 +95,7 @@ APR_DECLARE(apr_status_t) apr_dbm_get_driver(const apr_dbm_driver_t **vtable,
 #if APU_HAVE_DB
     else if (!strcasecmp(type, "db"))     *vtable = &apr_dbm_type_db;
 #endif
+    else if (!strcasecmp(type, "lsm"))    *vtable = &apr_dbm_type_lsm;
     else if (*type && !strcasecmp(type + 1, "dbm")) {
 #if APU_HAVE_GDBM
         if (*type == 'G' || *type == 'g') *vtable = &apr_dbm_type_gdbm;
@@ -142,6 +143,7 @@ APR_DECLARE(apr_status_t) apr_dbm_get_driver(const apr_dbm_driver_t **vtable,
 
     if (!strcasecmp(type, "default"))        type = DBM_NAME;
     else if (!strcasecmp(type, "db"))        type = "db";
+    else if (!strcasecmp(type, "lsm"))       type = "lsm";
     else if (*type && !strcasecmp(type + 1, "dbm")) {
         if      (*type == 'G' || *type == 'g') type = "gdbm";
         else if (*type == 'N' || *type == 'n') type = "ndbm";
@@ -169,6 +171,7 @@ APR_DECLARE(apr_status_t) apr_dbm_get_driver(const apr_dbm_driver_t **vtable,
 
         drivers = apr_hash_make(pool);
         apr_hash_set(drivers, "sdbm", APR_HASH_KEY_STRING, &apr_dbm_type_sdbm);
+        apr_hash_set(drivers, "lsm", APR_HASH_KEY_STRING, &apr_dbm_type_lsm);
 
         apr_pool_cleanup_register(pool, NULL, dbm_term,
                                   apr_pool_cleanup_null);
@@ -273,6 +276,33 @@ APR_DECLARE(apr_status_t) apr_dbm_fetch(apr_dbm_t *dbm, apr_datum_t key,
     return (*dbm->type->fetch)(dbm, key, pvalue);
 }
 
+APR_DECLARE(apr_status_t) apr_dbm_fetch_multi(apr_dbm_t *dbm,
+                                              const apr_datum_t *keys,
+                                              apr_size_t nkeys,
+                                              apr_datum_t *values,
+                                              apr_pool_t *pool)
+{
+    apr_status_t rv;
+    apr_size_t i;
+
+    if (dbm->type->fetch_multi)
+        return (*dbm->type->fetch_multi)(dbm, keys, nkeys, values, pool);
+
+    for (i = 0; i < nkeys; i++) {
+        apr_datum_t value;
+
+        if ((rv = (*dbm->type->fetch)(dbm, keys[i], &value)) != APR_SUCCESS)
+            return rv;
+        values[i].dsize = value.dsize;
+        values[i].dptr = value.dptr ? apr_pmemdup(pool, value.dptr,
+                                                  value.dsize) : NULL;
+        if (value.dptr)
+            (*dbm->type->freedatum)(dbm, value);
+    }
+
+    return APR_SUCCESS;
+}
+
 APR_DECLARE(apr_status_t) apr_dbm_store(apr_dbm_t *dbm, apr_datum_t key,
                                         apr_datum_t value)
 {
@@ -299,6 +329,32 @@ APR_DECLARE(apr_status_t) apr_dbm_nextkey(apr_dbm_t *dbm, apr_datum_t *pkey)
     return (*dbm->type->nextkey)(dbm, pkey);
 }
 
+APR_DECLARE(apr_status_t) apr_dbm_iterate(apr_dbm_t *dbm,
+                                          apr_dbm_iterate_cb_t *cb,
+                                          void *baton)
+{
+    apr_datum_t key, value;
+    apr_status_t rv;
+    int more = 1;
+
+    if (dbm->type->iterate)
+        return (*dbm->type->iterate)(dbm, cb, baton);
+
+    rv = (*dbm->type->firstkey)(dbm, &key);
+    while (rv == APR_SUCCESS && key.dptr != NULL && more) {
+        if ((rv = (*dbm->type->fetch)(dbm, key, &value)) != APR_SUCCESS)
+            break;
+        if (value.dptr != NULL) {
+            more = cb(baton, key, value);
+            (*dbm->type->freedatum)(dbm, value);
+        }
+        if (more)
+            rv = (*dbm->type->nextkey)(dbm, &key);
+    }
+
+    return rv;
+}
+
 APR_DECLARE(void) apr_dbm_freedatum(apr_dbm_t *dbm, apr_datum_t data)
 {
     (*dbm->type->freedatum)(dbm, data);
@@ -373,6 +373,58 @@ static apr_status_t vt_db_nextkey(apr_dbm_t *dbm, apr_datum_t * pkey)
     return set_error(dbm, APR_SUCCESS);
 }
 
+/* a cursor of its own, returning the keys with their data */
+static apr_status_t vt_db_iterate(apr_dbm_t *dbm, apr_dbm_iterate_cb_t *cb,
+                                  void *baton)
+{
+    real_file_t *f = dbm->file;
+    DBT ckey = { 0 };
+    DBT data = { 0 };
+    apr_datum_t kd, vd;
+    int dberr;
+#if DB_VER == 1
+    int flag = R_FIRST;
+
+    while ((dberr = (*f->bdb->seq)(f->bdb, &ckey, &data, flag)) == 0) {
+        kd.dptr = ckey.data;
+        kd.dsize = ckey.size;
+        vd.dptr = data.data;
+        vd.dsize = data.size;
+        if (!cb(baton, kd, vd))
+            break;
+        flag = R_NEXT;
+    }
+    if (dberr == RET_SPECIAL)
+        dberr = 0;
+#else
+    DBC *curs;
+    int flag = DB_FIRST;
+
+    if ((dberr = (*f->bdb->cursor)(f->bdb, NULL, &curs
+#if DB_VER >= 3 || ((DB_VERSION_MAJOR == 2) && (DB_VERSION_MINOR > 5))
+                                   , 0
+#endif
+             )) != 0)
+        return set_error(dbm, db2s(dberr));
+
+    while ((dberr = (*curs->c_get)(curs, &ckey, &data, flag)) == 0) {
+        kd.dptr = ckey.data;
+        kd.dsize = ckey.size;
+        vd.dptr = data.data;
+        vd.dsize = data.size;
+        if (!cb(baton, kd, vd))
+            break;
+        flag = DB_NEXT;
+    }
+    if (dberr == DB_NOTFOUND)
+        dberr = 0;
+    (*curs->c_close)(curs);
+#endif
+
+    /* store any error info into DBM, and return a status code. */
+    return set_error(dbm, db2s(dberr));
+}
+
 static void vt_db_freedatum(apr_dbm_t *dbm, apr_datum_t data)
 {
     /* nothing to do */
@@ -398,7 +450,9 @@ APR_MODULE_DECLARE_DATA const apr_dbm_driver_t apr_dbm_type_db = {
     vt_db_firstkey,
     vt_db_nextkey,
     vt_db_freedatum,
-    vt_db_usednames
+    vt_db_usednames,
+    NULL,
+    vt_db_iterate
 };
 
 #endif /* APU_HAVE_DB */
@@ -0,0 +1,1318 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * lsm - an append-only, log structured dbm.
+ *
+ * The records are appended to a log (name.log) and kept sorted in memory
+ * (the memtable). Past LSM_MEMTABLE_MAX bytes of log, the memtable is
+ * written to an immutable sorted run (name.<seq>.run) and the log is
+ * emptied. The runs are memory mapped, and listed newest first by the
+ * manifest (name.lsm), which is replaced atomically. Past LSM_RUNS_MAX
+ * runs, they are merged into one, by a thread of its own where there are
+ * threads.
+ *
+ * A lookup goes through the memtable and then the runs, the newest
+ * record of a key winning, deletions included (as tombstones, until
+ * merged into the oldest run). A single process writes, holding a lock
+ * on the log; readers open a snapshot of the database, the log first and
+ * then the runs listed by the manifest.
+ */
+
+#include "apr_strings.h"
+#include "apr_file_io.h"
+#include "apr_file_info.h"
+#include "apr_mmap.h"
+#include "apr_skiplist.h"
+#include "apr_thread_mutex.h"
+#include "apr_thread_pool.h"
+#define APR_WANT_MEMFUNC
+#define APR_WANT_STRFUNC
+#include "apr_want.h"
+
+#include <stdlib.h> /* for malloc, realloc, free */
+
+#include "apu.h"
+#include "apr_private.h"
+#include "apr_dbm_private.h"
+
+#define LSM_MANIFEXT        ".lsm"
+#define LSM_LOGEXT          ".log"
+
+#define LSM_MANIFEST_MAGIC  "APR-LSM 1\n"
+#define LSM_RUN_MAGIC       "APRLSMR1"
+
+/* run header: magic, count, reserved, index offset */
+#define LSM_RUN_HDRSIZ      24
+/* run index entry: offset of the key (the value follows), klen, vlen */
+#define LSM_RUN_ENTSIZ      16
+/* log record header: klen, vlen */
+#define LSM_LOG_HDRSIZ      8
+
+#define LSM_TOMBSTONE       0xFFFFFFFFU
+#define LSM_MEMTABLE_MAX    (1024 * 1024)   /* log bytes before a flush */
+#define LSM_RUNS_MAX        4               /* runs before a compaction */
+#define LSM_OPEN_RETRIES    5               /* runs merged while opening */
+
+typedef struct lsm_entry_t {
+    const char *key;
+    apr_size_t klen;
+    const char *val;
+    apr_size_t vlen;
+    int deleted;
+} lsm_entry_t;
+
+typedef struct lsm_run_t {
+    apr_pool_t *pool;               /* unmanaged, the run's own */
+    const char *name;
+    apr_uint32_t seq;
+    int refs;                       /* by the runsets */
+    int obsolete;                   /* removed when released */
+    apr_file_t *f;
+#if APR_HAS_MMAP
+    apr_mmap_t *mm;
+#endif
+    const unsigned char *base;
+    apr_uint32_t count;
+    const unsigned char *index;
+} lsm_run_t;
+
+/* the runs of the database at some point, newest first */
+typedef struct lsm_runset_t {
+    int refs;
+    int nruns;
+    lsm_run_t *runs[1];
+} lsm_runset_t;
+
+typedef struct lsm_t {
+    apr_pool_t *pool;
+    const char *name;
+    const char *manifname;
+    apr_fileperms_t perm;
+    int rdonly;
+    apr_file_t *log;
+    apr_off_t logsize;
+
+    apr_skiplist *mem;              /* the memtable */
+    apr_uint32_t memgen;            /* changes of the memtable */
+
+    lsm_runset_t *current;          /* under lock */
+    lsm_runset_t *held;             /* by the last call, for its datums */
+    apr_uint32_t nextseq;           /* under lock */
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *lock;
+    apr_thread_pool_t *tp;
+#endif
+    int compacting;                 /* under lock */
+    apr_status_t compacted;         /* under lock, error of the last one */
+
+    /* firstkey/nextkey */
+    lsm_runset_t *iterset;
+    apr_uint32_t *iterpos;
+    apr_skiplistnode *itermem;
+    apr_uint32_t itergen;
+} lsm_t;
+
+#if APR_HAS_THREADS
+#define LSM_LOCK(db)    apr_thread_mutex_lock((db)->lock)
+#define LSM_UNLOCK(db)  apr_thread_mutex_unlock((db)->lock)
+#else
+#define LSM_LOCK(db)
+#define LSM_UNLOCK(db)
+#endif
+
+/* --------------------------------------------------------------------------
+**
+** UTILITY FUNCTIONS
+*/
+
+static void put32(unsigned char *p, apr_uint32_t n)
+{
+    p[0] = (unsigned char)n;
+    p[1] = (unsigned char)(n >> 8);
+    p[2] = (unsigned char)(n >> 16);
+    p[3] = (unsigned char)(n >> 24);
+}
+
+static apr_uint32_t get32(const unsigned char *p)
+{
+    return (apr_uint32_t)p[0] | ((apr_uint32_t)p[1] << 8)
+           | ((apr_uint32_t)p[2] << 16) | ((apr_uint32_t)p[3] << 24);
+}
+
+static void put64(unsigned char *p, apr_uint64_t n)
+{
+    put32(p, (apr_uint32_t)n);
+    put32(p + 4, (apr_uint32_t)(n >> 32));
+}
+
+static apr_uint64_t get64(const unsigned char *p)
+{
+    return (apr_uint64_t)get32(p) | ((apr_uint64_t)get32(p + 4) << 32);
+}
+
+static int keycmp(const char *a, apr_size_t alen, const char *b,
+                  apr_size_t blen)
+{
+    int rc = memcmp(a, b, alen < blen ? alen : blen);
+
+    if (rc)
+        return rc;
+    return (alen > blen) - (alen < blen);
+}
+
+static int entry_cmp(void *a, void *b)
+{
+    const lsm_entry_t *ea = a, *eb = b;
+
+    return keycmp(ea->key, ea->klen, eb->key, eb->klen);
+}
+
+static void entry_free(void *e)
+{
+    free(e);
+}
+
+static apr_status_t set_error(apr_dbm_t *dbm, apr_status_t dbm_said)
+{
+    dbm->errcode = dbm_said;
+
+    if (dbm_said != APR_SUCCESS) {
+        dbm->errmsg = apr_psprintf(dbm->pool, "%pm", &dbm_said);
+    } else {
+        dbm->errmsg = NULL;
+    }
+
+    return dbm_said;
+}
+
+static const char *run_name(apr_pool_t *p, const char *name,
+                            apr_uint32_t seq)
+{
+    return apr_psprintf(p, "%s.%08x.run", name, seq);
+}
+
+/* --------------------------------------------------------------------------
+**
+** RUNS
+*/
+
+static const unsigned char *run_entry(const lsm_run_t *run, apr_uint32_t i,
+                                      const char **key, apr_size_t *klen,
+                                      const char **val, apr_size_t *vlen,
+                                      int *deleted)
+{
+    const unsigned char *ent = run->index + (apr_size_t)i * LSM_RUN_ENTSIZ;
+    const char *k = (const char *)run->base + get64(ent);
+    apr_uint32_t vl = get32(ent + 12);
+
+    *key = k;
+    *klen = get32(ent + 8);
+    if (val) {
+        *deleted = (vl == LSM_TOMBSTONE);
+        *val = k + *klen;
+        *vlen = *deleted ? 0 : vl;
+    }
+    return ent;
+}
+
+/* binary search, returns 0 if not found */
+static int run_find(const lsm_run_t *run, const char *key, apr_size_t klen,
+                    const char **val, apr_size_t *vlen, int *deleted)
+{
+    apr_uint32_t lo = 0, hi = run->count;
+
+    while (lo < hi) {
+        apr_uint32_t mid = lo + (hi - lo) / 2;
+        const char *k;
+        apr_size_t kl;
+        int rc;
+
+        run_entry(run, mid, &k, &kl, NULL, NULL, NULL);
+        rc = keycmp(key, klen, k, kl);
+        if (rc == 0) {
+            run_entry(run, mid, &k, &kl, val, vlen, deleted);
+            return 1;
+        }
+        if (rc < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    return 0;
+}
+
+static void run_destroy(lsm_run_t *run)
+{
+#if APR_HAS_MMAP
+    if (run->mm)
+        (void) apr_mmap_delete(run->mm);
+#endif
+    if (run->f)
+        (void) apr_file_close(run->f);
+    if (run->obsolete)
+        (void) apr_file_remove(run->name, run->pool);
+    apr_pool_destroy(run->pool);
+}
+
+/* may run in the compaction thread: everything in the run's own pool */
+static apr_status_t run_open(lsm_run_t **prun, const char *dbname,
+                             apr_uint32_t seq)
+{
+    apr_pool_t *pool;
+    lsm_run_t *run;
+    apr_finfo_t finfo;
+    apr_uint64_t idxoff;
+    apr_status_t rv;
+
+    *prun = NULL;
+
+    if ((rv = apr_pool_create_unmanaged_ex(&pool, NULL, NULL))
+            != APR_SUCCESS)
+        return rv;
+
+    run = apr_pcalloc(pool, sizeof(*run));
+    run->pool = pool;
+    run->seq = seq;
+    run->name = run_name(pool, dbname, seq);
+
+    rv = apr_file_open(&run->f, run->name, APR_FOPEN_READ | APR_FOPEN_BINARY,
+                       APR_FPROT_OS_DEFAULT, pool);
+    if (rv == APR_SUCCESS)
+        rv = apr_file_info_get(&finfo, APR_FINFO_SIZE, run->f);
+    if (rv == APR_SUCCESS
+        && (finfo.size < LSM_RUN_HDRSIZ
+            || (apr_off_t)(apr_size_t)finfo.size != finfo.size))
+        rv = APR_EGENERAL;
+    if (rv != APR_SUCCESS) {
+        run_destroy(run);
+        return rv;
+    }
+
+#if APR_HAS_MMAP
+    rv = apr_mmap_create(&run->mm, run->f, 0, (apr_size_t)finfo.size,
+                         APR_MMAP_READ, pool);
+    if (rv == APR_SUCCESS)
+        run->base = run->mm->mm;
+#else
+    {
+        unsigned char *buf = apr_palloc(pool, (apr_size_t)finfo.size);
+
+        rv = apr_file_read_full(run->f, buf, (apr_size_t)finfo.size, NULL);
+        run->base = buf;
+    }
+#endif
+    if (rv == APR_SUCCESS) {
+        run->count = get32(run->base + 8);
+        idxoff = get64(run->base + 16);
+        if (memcmp(run->base, LSM_RUN_MAGIC, 8) != 0
+            || idxoff > (apr_uint64_t)finfo.size
+            || ((apr_uint64_t)finfo.size - idxoff) / LSM_RUN_ENTSIZ
+                    < run->count)
+            rv = APR_EGENERAL;
+        else
+            run->index = run->base + idxoff;
+    }
+    if (rv != APR_SUCCESS) {
+        run_destroy(run);
+        return rv;
+    }
+
+    *prun = run;
+    return APR_SUCCESS;
+}
+
+/* under lock */
+static void runset_release(lsm_runset_t *set)
+{
+    int i;
+
+    if (set == NULL || --set->refs > 0)
+        return;
+    for (i = 0; i < set->nruns; i++)
+        if (--set->runs[i]->refs == 0)
+            run_destroy(set->runs[i]);
+    free(set);
+}
+
+/* with one ref, and one more on each run */
+static lsm_runset_t *runset_make(lsm_run_t *const *runs, int nruns,
+                                 lsm_run_t *const *more, int nmore)
+{
+    lsm_runset_t *set;
+    int i;
+
+    set = malloc(sizeof(*set) + (nruns + nmore) * sizeof(lsm_run_t *));
+    if (set == NULL)
+        return NULL;
+    set->refs = 1;
+    set->nruns = 0;
+    for (i = 0; i < nruns; i++)
+        set->runs[set->nruns++] = runs[i];
+    for (i = 0; i < nmore; i++)
+        set->runs[set->nruns++] = more[i];
+    for (i = 0; i < set->nruns; i++)
+        set->runs[i]->refs++;
+    return set;
+}
+
+/* the datums of the previous call are released, the current runs held */
+static lsm_runset_t *lsm_hold(lsm_t *db)
+{
+    LSM_LOCK(db);
+    runset_release(db->held);
+    db->held = db->current;
+    db->held->refs++;
+    LSM_UNLOCK(db);
+
+    return db->held;
+}
+
+typedef struct {
+    apr_file_t *f;
+    const char *name;
+    const char *tmpname;
+    unsigned char *index;
+    apr_uint32_t count;
+    apr_uint32_t size;
+    apr_uint64_t off;
+} run_writer_t;
+
+static apr_status_t writer_open(run_writer_t *w, const char *name,
+                                apr_fileperms_t perm, apr_pool_t *p)
+{
+    static const unsigned char zeros[LSM_RUN_HDRSIZ] = { 0 };
+    apr_status_t rv;
+
+    memset(w, 0, sizeof(*w));
+    w->name = name;
+    w->tmpname = apr_pstrcat(p, name, ".tmp", NULL);
+    w->off = LSM_RUN_HDRSIZ;
+
+    rv = apr_file_open(&w->f, w->tmpname, APR_FOPEN_WRITE | APR_FOPEN_CREATE
+                       | APR_FOPEN_TRUNCATE | APR_FOPEN_BUFFERED
+                       | APR_FOPEN_BINARY, perm, p);
+    if (rv == APR_SUCCESS)
+        rv = apr_file_write_full(w->f, zeros, sizeof(zeros), NULL);
+    return rv;
+}
+
+static apr_status_t writer_add(run_writer_t *w, const char *key,
+                               apr_size_t klen, const char *val,
+                               apr_size_t vlen, int deleted)
+{
+    unsigned char *ent;
+    apr_status_t rv;
+
+    if (w->count == w->size) {
+        apr_uint32_t size = w->size ? w->size * 2 : 1024;
+        unsigned char *index;
+
+        if ((index = realloc(w->index, (apr_size_t)size * LSM_RUN_ENTSIZ))
+                == NULL)
+            return APR_ENOMEM;
+        w->index = index;
+        w->size = size;
+    }
+    ent = w->index + (apr_size_t)w->count++ * LSM_RUN_ENTSIZ;
+    put64(ent, w->off);
+    put32(ent + 8, (apr_uint32_t)klen);
+    put32(ent + 12, deleted ? LSM_TOMBSTONE : (apr_uint32_t)vlen);
+
+    if ((rv = apr_file_write_full(w->f, key, klen, NULL)) != APR_SUCCESS
+        || (!deleted && vlen
+            && (rv = apr_file_write_full(w->f, val, vlen, NULL))
+                    != APR_SUCCESS))
+        return rv;
+    w->off += klen + (deleted ? 0 : vlen);
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t writer_close(run_writer_t *w, apr_pool_t *p, int ok)
+{
+    unsigned char hdr[LSM_RUN_HDRSIZ];
+    apr_off_t off = 0;
+    apr_status_t rv = ok;
+
+    if (ok == APR_SUCCESS) {
+        memset(hdr, 0, sizeof(hdr));
+        memcpy(hdr, LSM_RUN_MAGIC, 8);
+        put32(hdr + 8, w->count);
+        put64(hdr + 16, w->off);
+        if ((rv = apr_file_write_full(w->f, w->index,
+                                      (apr_size_t)w->count * LSM_RUN_ENTSIZ,
+                                      NULL)) == APR_SUCCESS
+            && (rv = apr_file_seek(w->f, APR_SET, &off)) == APR_SUCCESS
+            && (rv = apr_file_write_full(w->f, hdr, sizeof(hdr),
+                                         NULL)) == APR_SUCCESS
+            && (rv = apr_file_flush(w->f)) == APR_SUCCESS)
+            rv = apr_file_sync(w->f);
+    }
+    free(w->index);
+    w->index = NULL;
+
+    if (w->f) {
+        apr_status_t rv2 = apr_file_close(w->f);
+
+        if (rv == APR_SUCCESS)
+            rv = rv2;
+    }
+    if (rv == APR_SUCCESS)
+        rv = apr_file_rename(w->tmpname, w->name, p);
+    if (rv != APR_SUCCESS)
+        (void) apr_file_remove(w->tmpname, p);
+
+    return rv;
+}
+
+/* --------------------------------------------------------------------------
+**
+** MANIFEST
+*/
+
+static apr_status_t manifest_read(lsm_t *db, apr_uint32_t **pseqs,
+                                  int *pnseqs, apr_pool_t *p)
+{
+    apr_file_t *f;
+    apr_finfo_t finfo;
+    apr_uint32_t *seqs;
+    apr_size_t len = sizeof(LSM_MANIFEST_MAGIC) - 1;
+    char *buf, *line, *last;
+    int nseqs = 0;
+    apr_status_t rv;
+
+    *pseqs = NULL;
+    *pnseqs = 0;
+
+    rv = apr_file_open(&f, db->manifname, APR_FOPEN_READ | APR_FOPEN_BINARY,
+                       APR_FPROT_OS_DEFAULT, p);
+    if (rv != APR_SUCCESS)
+        return rv;
+    if ((rv = apr_file_info_get(&finfo, APR_FINFO_SIZE, f)) == APR_SUCCESS) {
+        buf = apr_palloc(p, (apr_size_t)finfo.size + 1);
+        rv = apr_file_read_full(f, buf, (apr_size_t)finfo.size, NULL);
+        buf[finfo.size] = '\0';
+    }
+    (void) apr_file_close(f);
+    if (rv != APR_SUCCESS)
+        return rv;
+
+    if ((apr_size_t)finfo.size < len
+        || memcmp(buf, LSM_MANIFEST_MAGIC, len) != 0)
+        return APR_EGENERAL;
+
+    seqs = apr_palloc(p, ((apr_size_t)finfo.size / 2 + 1) * sizeof(*seqs));
+    for (line = apr_strtok(buf + len, "\n", &last); line;
+         line = apr_strtok(NULL, "\n", &last)) {
+        char *end;
+        apr_int64_t seq = apr_strtoi64(line, &end, 16);
+
+        if (*end || end == line || seq < 0 || seq > LSM_TOMBSTONE)
+            return APR_EGENERAL;
+        seqs[nseqs++] = (apr_uint32_t)seq;
+    }
+
+    *pseqs = seqs;
+    *pnseqs = nseqs;
+    return APR_SUCCESS;
+}
+
+/* under lock, replaced atomically */
+static apr_status_t manifest_write(lsm_t *db, const lsm_runset_t *set,
+                                   apr_pool_t *p)
+{
+    const char *tmpname = apr_pstrcat(p, db->manifname, ".tmp", NULL);
+    char *buf = apr_palloc(p, sizeof(LSM_MANIFEST_MAGIC) + 9 * set->nruns);
+    apr_size_t len = sizeof(LSM_MANIFEST_MAGIC) - 1;
+    apr_file_t *f;
+    apr_status_t rv, rv2;
+    int i;
+
+    memcpy(buf, LSM_MANIFEST_MAGIC, len);
+    for (i = 0; i < set->nruns; i++)
+        len += apr_snprintf(buf + len, 10, "%08x\n", set->runs[i]->seq);
+
+    rv = apr_file_open(&f, tmpname, APR_FOPEN_WRITE | APR_FOPEN_CREATE
+                       | APR_FOPEN_TRUNCATE | APR_FOPEN_BINARY, db->perm, p);
+    if (rv != APR_SUCCESS)
+        return rv;
+    if ((rv = apr_file_write_full(f, buf, len, NULL)) == APR_SUCCESS)
+        rv = apr_file_sync(f);
+    rv2 = apr_file_close(f);
+    if (rv == APR_SUCCESS)
+        rv = rv2;
+    if (rv == APR_SUCCESS)
+        rv = apr_file_rename(tmpname, db->manifname, p);
+    if (rv != APR_SUCCESS)
+        (void) apr_file_remove(tmpname, p);
+
+    return rv;
+}
+
+/* --------------------------------------------------------------------------
+**
+** COMPACTION
+*/
+
+/*
+ * merge all the runs of the set, newest first, into the run seq: being
+ * the oldest then, the tombstones are dropped.
+ */
+static apr_status_t runs_merge(lsm_t *db, const lsm_runset_t *set,
+                               apr_uint32_t seq, apr_pool_t *p)
+{
+    run_writer_t w;
+    apr_uint32_t *pos;
+    apr_status_t rv;
+    int i;
+
+    if ((pos = calloc(set->nruns, sizeof(*pos))) == NULL)
+        return APR_ENOMEM;
+
+    rv = writer_open(&w, run_name(p, db->name, seq), db->perm, p);
+    while (rv == APR_SUCCESS) {
+        const char *key = NULL, *k, *val;
+        apr_size_t klen = 0, kl, vlen;
+        int winner = -1, deleted;
+
+        /* the smallest key, from the newest run having it */
+        for (i = 0; i < set->nruns; i++) {
+            if (pos[i] >= set->runs[i]->count)
+                continue;
+            run_entry(set->runs[i], pos[i], &k, &kl, NULL, NULL, NULL);
+            if (winner < 0 || keycmp(k, kl, key, klen) < 0) {
+                winner = i;
+                key = k;
+                klen = kl;
+            }
+        }
+        if (winner < 0)
+            break;
+
+        run_entry(set->runs[winner], pos[winner], &k, &kl, &val, &vlen,
+                  &deleted);
+        if (!deleted)
+            rv = writer_add(&w, key, klen, val, vlen, 0);
+
+        for (i = 0; i < set->nruns; i++) {
+            if (pos[i] >= set->runs[i]->count)
+                continue;
+            run_entry(set->runs[i], pos[i], &k, &kl, NULL, NULL, NULL);
+            if (keycmp(k, kl, key, klen) == 0)
+                pos[i]++;
+        }
+    }
+    free(pos);
+
+    return writer_close(&w, p, rv);
+}
+
+static apr_status_t lsm_compact(lsm_t *db)
+{
+    lsm_runset_t *set, *cur, *newset = NULL;
+    lsm_run_t *merged = NULL;
+    apr_uint32_t seq;
+    apr_pool_t *p;
+    apr_status_t rv;
+    int i, nnew;
+
+    if ((rv = apr_pool_create_unmanaged_ex(&p, NULL, NULL)) != APR_SUCCESS)
+        return rv;
+
+    LSM_LOCK(db);
+    set = db->current;
+    set->refs++;
+    seq = db->nextseq++;
+    LSM_UNLOCK(db);
+
+    rv = runs_merge(db, set, seq, p);
+    if (rv == APR_SUCCESS)
+        rv = run_open(&merged, db->name, seq);
+
+    LSM_LOCK(db);
+    if (rv == APR_SUCCESS) {
+        /* the runs flushed meanwhile are newer, in front */
+        cur = db->current;
+        nnew = cur->nruns - set->nruns;
+        if ((newset = runset_make(cur->runs, nnew, &merged, 1)) == NULL)
+            rv = APR_ENOMEM;
+        else if ((rv = manifest_write(db, newset, p)) == APR_SUCCESS) {
+            for (i = 0; i < set->nruns; i++)
+                set->runs[i]->obsolete = 1;
+            db->current = newset;
+            runset_release(cur);
+            newset = NULL;
+        }
+    }
+    if (newset)
+        runset_release(newset);
+    else if (merged && merged->refs == 0) {
+        merged->obsolete = 1;
+        run_destroy(merged);
+    }
+    runset_release(set);
+    db->compacting = 0;
+    db->compacted = rv;
+    LSM_UNLOCK(db);
+
+    apr_pool_destroy(p);
+    return rv;
+}
+
+#if APR_HAS_THREADS
+static void *APR_THREAD_FUNC lsm_compact_task(apr_thread_t *thd, void *data)
+{
+    (void) lsm_compact(data);
+    return NULL;
+}
+#endif
+
+static apr_status_t lsm_compact_maybe(lsm_t *db)
+{
+    int compact;
+
+    LSM_LOCK(db);
+    compact = !db->compacting && db->current->nruns > LSM_RUNS_MAX;
+    if (compact)
+        db->compacting = 1;
+    LSM_UNLOCK(db);
+
+    if (!compact)
+        return APR_SUCCESS;
+
+#if APR_HAS_THREADS
+    {
+        apr_status_t rv = APR_SUCCESS;
+
+        if (db->tp == NULL)
+            rv = apr_thread_pool_create(&db->tp, 0, 1, db->pool);
+        if (rv == APR_SUCCESS)
+            rv = apr_thread_pool_push(db->tp, lsm_compact_task, db,
+                                      APR_THREAD_TASK_PRIORITY_NORMAL, db);
+        if (rv == APR_SUCCESS)
+            return APR_SUCCESS;
+        /* otherwise compact now */
+    }
+#endif
+    return lsm_compact(db);
+}
+
+/* --------------------------------------------------------------------------
+**
+** MEMTABLE AND LOG
+*/
+
+static apr_status_t mem_put(lsm_t *db, const char *key, apr_size_t klen,
+                            const char *val, apr_size_t vlen, int deleted)
+{
+    lsm_entry_t *e;
+    char *data;
+
+    if ((e = malloc(sizeof(*e) + klen + vlen)) == NULL)
+        return APR_ENOMEM;
+    data = (char *)(e + 1);
+    memcpy(data, key, klen);
+    if (vlen)
+        memcpy(data + klen, val, vlen);
+    e->key = data;
+    e->klen = klen;
+    e->val = data + klen;
+    e->vlen = vlen;
+    e->deleted = deleted;
+
+    if (apr_skiplist_replace(db->mem, e, entry_free) == NULL) {
+        free(e);
+        return APR_ENOMEM;
+    }
+    db->memgen++;
+
+    return APR_SUCCESS;
+}
+
+/* the memtable to a new run, emptying the log */
+static apr_status_t lsm_flush(lsm_t *db)
+{
+    lsm_runset_t *newset;
+    lsm_run_t *run = NULL;
+    apr_skiplistnode *node;
+    lsm_entry_t *e;
+    run_writer_t w;
+    apr_uint32_t seq;
+    apr_pool_t *p;
+    apr_status_t rv;
+
+    if (apr_skiplist_size(db->mem) == 0)
+        return APR_SUCCESS;
+
+    if ((rv = apr_pool_create(&p, db->pool)) != APR_SUCCESS)
+        return rv;
+
+    LSM_LOCK(db);
+    seq = db->nextseq++;
+    LSM_UNLOCK(db);
+
+    rv = writer_open(&w, run_name(p, db->name, seq), db->perm, p);
+    for (node = apr_skiplist_getlist(db->mem);
+         rv == APR_SUCCESS && node != NULL;
+         apr_skiplist_next(db->mem, &node)) {
+        e = apr_skiplist_element(node);
+        rv = writer_add(&w, e->key, e->klen, e->val, e->vlen, e->deleted);
+    }
+    rv = writer_close(&w, p, rv);
+    if (rv == APR_SUCCESS)
+        rv = run_open(&run, db->name, seq);
+
+    if (rv == APR_SUCCESS) {
+        LSM_LOCK(db);
+        if ((newset = runset_make(&run, 1, db->current->runs,
+                                  db->current->nruns)) == NULL)
+            rv = APR_ENOMEM;
+        else if ((rv = manifest_write(db, newset, p)) == APR_SUCCESS) {
+            runset_release(db->current);
+            db->current = newset;
+        }
+        else
+            runset_release(newset);
+        LSM_UNLOCK(db);
+    }
+    if (rv != APR_SUCCESS && run != NULL && run->refs == 0) {
+        run->obsolete = 1;
+        run_destroy(run);
+    }
+
+    /* in the run now */
+    if (rv == APR_SUCCESS && (rv = apr_file_trunc(db->log, 0)) == APR_SUCCESS) {
+        db->logsize = 0;
+        apr_skiplist_remove_all(db->mem, entry_free);
+        db->memgen++;
+        rv = lsm_compact_maybe(db);
+    }
+
+    apr_pool_destroy(p);
+    return rv;
+}
+
+static apr_status_t log_append(lsm_t *db, const char *key, apr_size_t klen,
+                               const char *val, apr_size_t vlen, int deleted)
+{
+    unsigned char hdr[LSM_LOG_HDRSIZ];
+    apr_status_t rv;
+
+    if (klen >= LSM_TOMBSTONE || vlen >= LSM_TOMBSTONE)
+        return APR_EINVAL;
+
+    put32(hdr, (apr_uint32_t)klen);
+    put32(hdr + 4, deleted ? LSM_TOMBSTONE : (apr_uint32_t)vlen);
+    if ((rv = apr_file_write_full(db->log, hdr, sizeof(hdr), NULL))
+                != APR_SUCCESS
+        || (rv = apr_file_write_full(db->log, key, klen, NULL))
+                != APR_SUCCESS
+        || (!deleted && vlen
+            && (rv = apr_file_write_full(db->log, val, vlen, NULL))
+                    != APR_SUCCESS))
+        return rv;
+    db->logsize += sizeof(hdr) + klen + (deleted ? 0 : vlen);
+
+    if ((rv = mem_put(db, key, klen, val, vlen, deleted)) != APR_SUCCESS)
+        return rv;
+
+    if (db->logsize >= LSM_MEMTABLE_MAX)
+        return lsm_flush(db);
+    return APR_SUCCESS;
+}
+
+/* the log to the memtable, up to a torn last record */
+static apr_status_t log_replay(lsm_t *db, apr_file_t *log)
+{
+    unsigned char hdr[LSM_LOG_HDRSIZ];
+    char *buf = NULL;
+    apr_size_t bufsize = 0, len;
+    apr_off_t off = 0;
+    apr_status_t rv;
+
+    if ((rv = apr_file_seek(log, APR_SET, &off)) != APR_SUCCESS)
+        return rv;
+
+    for (;;) {
+        apr_uint32_t klen, vlen;
+        int deleted;
+
+        rv = apr_file_read_full(log, hdr, sizeof(hdr), &len);
+        if (rv != APR_SUCCESS)
+            break;
+        klen = get32(hdr);
+        vlen = get32(hdr + 4);
+        deleted = (vlen == LSM_TOMBSTONE);
+        if (deleted)
+            vlen = 0;
+        if ((apr_size_t)klen + vlen > bufsize) {
+            char *nbuf = realloc(buf, (apr_size_t)klen + vlen);
+
+            if (nbuf == NULL) {
+                free(buf);
+                return APR_ENOMEM;
+            }
+            buf = nbuf;
+            bufsize = (apr_size_t)klen + vlen;
+        }
+        rv = apr_file_read_full(log, buf, (apr_size_t)klen + vlen, &len);
+        if (rv != APR_SUCCESS)
+            break;
+        if ((rv = mem_put(db, buf, klen, buf + klen, vlen, deleted))
+                != APR_SUCCESS) {
+            free(buf);
+            return rv;
+        }
+        off += sizeof(hdr) + klen + vlen;
+    }
+    free(buf);
+
+    if (!APR_STATUS_IS_EOF(rv))
+        return rv;
+
+    /* drop a torn record, the writer appends after the good ones */
+    db->logsize = off;
+    if (!db->rdonly && (rv = apr_file_trunc(log, off)) != APR_SUCCESS)
+        return rv;
+
+    return APR_SUCCESS;
+}
+
+/* the runs of the manifest, retried if merged meanwhile */
+static apr_status_t runs_load(lsm_t *db, apr_pool_t *p)
+{
+    apr_uint32_t *seqs;
+    lsm_run_t **runs;
+    apr_status_t rv;
+    int nseqs, n, i, tries = 0;
+
+    do {
+        rv = manifest_read(db, &seqs, &nseqs, p);
+        if (APR_STATUS_IS_ENOENT(rv)) {
+            nseqs = 0;
+            rv = APR_SUCCESS;
+        }
+        if (rv != APR_SUCCESS)
+            return rv;
+
+        runs = apr_pcalloc(p, (nseqs + 1) * sizeof(*runs));
+        for (n = 0; n < nseqs; n++)
+            if ((rv = run_open(&runs[n], db->name, seqs[n])) != APR_SUCCESS)
+                break;
+        if (rv == APR_SUCCESS) {
+            if ((db->current = runset_make(runs, n, NULL, 0)) == NULL)
+                rv = APR_ENOMEM;
+            db->nextseq = 0;
+            for (i = 0; i < n; i++)
+                if (seqs[i] >= db->nextseq)
+                    db->nextseq = seqs[i] + 1;
+        }
+        for (i = 0; i < n; i++)
+            if (runs[i]->refs == 0)
+                run_destroy(runs[i]);
+    } while (APR_STATUS_IS_ENOENT(rv) && ++tries < LSM_OPEN_RETRIES);
+
+    return rv;
+}
+
+static apr_status_t lsm_cleanup(void *data)
+{
+    lsm_t *db = data;
+    apr_status_t rv = APR_SUCCESS;
+
+#if APR_HAS_THREADS
+    /* let a compaction finish */
+    if (db->tp)
+        (void) apr_thread_pool_destroy(db->tp);
+#endif
+
+    free(db->iterpos);
+    db->iterpos = NULL;
+    runset_release(db->iterset);
+    runset_release(db->held);
+    runset_release(db->current);
+    db->iterset = db->held = db->current = NULL;
+
+    if (db->mem)
+        apr_skiplist_remove_all(db->mem, entry_free);
+
+    if (db->log)
+        rv = apr_file_close(db->log);
+
+    return rv;
+}
+
+/* --------------------------------------------------------------------------
+**
+** DEFINE THE VTABLE FUNCTIONS FOR LSM
+*/
+
+static apr_status_t vt_lsm_open(apr_dbm_t **pdb, const char *pathname,
+                                apr_int32_t mode, apr_fileperms_t perm,
+                                apr_pool_t *pool)
+{
+    lsm_t *db;
+    apr_file_t *log = NULL;
+    apr_int32_t flags = APR_FOPEN_READ | APR_FOPEN_BINARY;
+    const char *logname;
+    apr_pool_t *p;
+    apr_status_t rv;
+
+    *pdb = NULL;
+
+    switch (mode) {
+    case APR_DBM_READONLY:
+        break;
+    case APR_DBM_READWRITE:
+        flags |= APR_FOPEN_WRITE | APR_FOPEN_APPEND | APR_FOPEN_BUFFERED;
+        break;
+    case APR_DBM_RWCREATE:
+    case APR_DBM_RWTRUNC:
+        flags |= APR_FOPEN_WRITE | APR_FOPEN_APPEND | APR_FOPEN_BUFFERED
+                 | APR_FOPEN_CREATE;
+        break;
+    default:
+        return APR_EINVAL;
+    }
+
+    db = apr_pcalloc(pool, sizeof(*db));
+    db->pool = pool;
+    db->name = apr_pstrdup(pool, pathname);
+    db->manifname = apr_pstrcat(pool, pathname, LSM_MANIFEXT, NULL);
+    db->perm = perm;
+    db->rdonly = (mode == APR_DBM_READONLY);
+    logname = apr_pstrcat(pool, pathname, LSM_LOGEXT, NULL);
+
+    if ((rv = apr_pool_create(&p, pool)) != APR_SUCCESS)
+        return rv;
+
+#if APR_HAS_THREADS
+    if ((rv = apr_thread_mutex_create(&db->lock, APR_THREAD_MUTEX_DEFAULT,
+                                      pool)) != APR_SUCCESS)
+        goto error;
+#endif
+    if ((rv = apr_skiplist_init(&db->mem, pool)) != APR_SUCCESS)
+        goto error;
+    apr_skiplist_set_compare(db->mem, entry_cmp, entry_cmp);
+
+    /*
+     * the writer holds the lock on the log. a reader reads the log
+     * first: the records flushed meanwhile are in the runs already.
+     */
+    rv = apr_file_open(&log, logname, flags, perm, pool);
+    if (rv == APR_SUCCESS && !db->rdonly)
+        rv = apr_file_lock(log, APR_FLOCK_EXCLUSIVE | APR_FLOCK_NONBLOCK);
+    if (rv == APR_SUCCESS && mode == APR_DBM_RWTRUNC) {
+        if ((rv = runs_load(db, p)) == APR_SUCCESS) {
+            int i;
+
+            for (i = 0; i < db->current->nruns; i++)
+                db->current->runs[i]->obsolete = 1;
+            runset_release(db->current);
+            db->current = runset_make(NULL, 0, NULL, 0);
+            if (db->current == NULL)
+                rv = APR_ENOMEM;
+            else if ((rv = manifest_write(db, db->current, p))
+                        == APR_SUCCESS)
+                rv = apr_file_trunc(log, 0);
+        }
+    }
+    else if (rv == APR_SUCCESS)
+        rv = log_replay(db, log);
+    else if (db->rdonly && APR_STATUS_IS_ENOENT(rv)) {
+        /* all in the runs, if any */
+        apr_finfo_t finfo;
+
+        rv = apr_stat(&finfo, db->manifname, APR_FINFO_TYPE, p);
+    }
+    if (rv != APR_SUCCESS)
+        goto error;
+
+    if (db->current == NULL && (rv = runs_load(db, p)) != APR_SUCCESS)
+        goto error;
+
+    if (db->rdonly && log) {
+        (void) apr_file_close(log);
+        log = NULL;
+    }
+    db->log = log;
+    log = NULL;
+
+    apr_pool_cleanup_register(pool, db, lsm_cleanup, apr_pool_cleanup_null);
+
+    if (!db->rdonly && db->logsize >= LSM_MEMTABLE_MAX
+        && (rv = lsm_flush(db)) != APR_SUCCESS) {
+        apr_pool_cleanup_run(pool, db, lsm_cleanup);
+        apr_pool_destroy(p);
+        return rv;
+    }
+    apr_pool_destroy(p);
+
+    /* we have an open database... return it */
+    *pdb = apr_pcalloc(pool, sizeof(**pdb));
+    (*pdb)->pool = pool;
+    (*pdb)->type = &apr_dbm_type_lsm;
+    (*pdb)->file = db;
+
+    return APR_SUCCESS;
+
+error:
+    if (log)
+        (void) apr_file_close(log);
+    runset_release(db->current);
+    db->current = NULL;
+    if (db->mem)
+        apr_skiplist_remove_all(db->mem, entry_free);
+    apr_pool_destroy(p);
+    return rv;
+}
+
+static void vt_lsm_close(apr_dbm_t *dbm)
+{
+    apr_pool_cleanup_run(dbm->pool, dbm->file, lsm_cleanup);
+}
+
+static apr_status_t vt_lsm_fetch(apr_dbm_t *dbm, apr_datum_t key,
+                                 apr_datum_t *pvalue)
+{
+    lsm_t *db = dbm->file;
+    lsm_runset_t *set = lsm_hold(db);
+    lsm_entry_t probe, *e;
+    const char *val;
+    apr_size_t vlen;
+    int i, deleted;
+
+    pvalue->dptr = NULL;
+    pvalue->dsize = 0;
+
+    probe.key = key.dptr;
+    probe.klen = key.dsize;
+    if ((e = apr_skiplist_find(db->mem, &probe, NULL)) != NULL) {
+        if (!e->deleted) {
+            pvalue->dptr = (char *)e->val;
+            pvalue->dsize = e->vlen;
+        }
+        return set_error(dbm, APR_SUCCESS);
+    }
+
+    for (i = 0; i < set->nruns; i++) {
+        if (run_find(set->runs[i], key.dptr, key.dsize, &val, &vlen,
+                     &deleted)) {
+            if (!deleted) {
+                pvalue->dptr = (char *)val;
+                pvalue->dsize = vlen;
+            }
+            break;
+        }
+    }
+
+    return set_error(dbm, APR_SUCCESS);
+}
+
+static apr_status_t vt_lsm_store(apr_dbm_t *dbm, apr_datum_t key,
+                                 apr_datum_t value)
+{
+    lsm_t *db = dbm->file;
+    apr_status_t rv;
+
+    if (db->rdonly)
+        return set_error(dbm, APR_EINVAL);
+    (void) lsm_hold(db);
+
+    /* a failed compaction, reported once */
+    LSM_LOCK(db);
+    rv = db->compacted;
+    db->compacted = APR_SUCCESS;
+    LSM_UNLOCK(db);
+    if (rv == APR_SUCCESS)
+        rv = log_append(db, key.dptr, key.dsize, value.dptr, value.dsize, 0);
+
+    /* store any error info into DBM, and return a status code. */
+    return set_error(dbm, rv);
+}
+
+static apr_status_t vt_lsm_del(apr_dbm_t *dbm, apr_datum_t key)
+{
+    lsm_t *db = dbm->file;
+
+    if (db->rdonly)
+        return set_error(dbm, APR_EINVAL);
+    (void) lsm_hold(db);
+
+    /* store any error info into DBM, and return a status code. */
+    return set_error(dbm, log_append(db, key.dptr, key.dsize, NULL, 0, 1));
+}
+
+static int vt_lsm_exists(apr_dbm_t *dbm, apr_datum_t key)
+{
+    apr_datum_t value;
+
+    return vt_lsm_fetch(dbm, key, &value) == APR_SUCCESS
+           && value.dptr != NULL;
+}
+
+/*
+ * merge the memtable and the runs held for the iteration, in key order,
+ * the newest record of each key winning.
+ */
+static apr_status_t lsm_nextkey(lsm_t *db, apr_datum_t *pkey)
+{
+    lsm_runset_t *set = db->iterset;
+
+    pkey->dptr = NULL;
+    pkey->dsize = 0;
+
+    if (set == NULL)
+        return APR_SUCCESS;
+    if (db->itergen != db->memgen)
+        return APR_EINVAL;   /* changed while iterating */
+
+    for (;;) {
+        const char *key = NULL, *k;
+        apr_size_t klen = 0, kl;
+        lsm_entry_t *e = apr_skiplist_element(db->itermem);
+        int i, winner = -1, deleted = 0;
+
+        if (e) {
+            key = e->key;
+            klen = e->klen;
+            deleted = e->deleted;
+            winner = set->nruns;
+        }
+        for (i = 0; i < set->nruns; i++) {
+            if (db->iterpos[i] >= set->runs[i]->count)
+                continue;
+            run_entry(set->runs[i], db->iterpos[i], &k, &kl, NULL, NULL,
+                      NULL);
+            if (winner < 0 || keycmp(k, kl, key, klen) < 0) {
+                winner = i;
+                key = k;
+                klen = kl;
+            }
+        }
+        if (winner < 0)
+            break;
+
+        /* the newest, and past this key everywhere */
+        if (e && keycmp(e->key, e->klen, key, klen) == 0) {
+            winner = set->nruns;
+            deleted = e->deleted;
+            apr_skiplist_next(db->mem, &db->itermem);
+        }
+        for (i = set->nruns - 1; i >= 0; i--) {
+            if (db->iterpos[i] >= set->runs[i]->count)
+                continue;
+            run_entry(set->runs[i], db->iterpos[i], &k, &kl, NULL, NULL,
+                      NULL);
+            if (keycmp(k, kl, key, klen) == 0) {
+                const char *val;
+                apr_size_t vlen;
+                int del;
+
+                if (winner != set->nruns) {
+                    run_entry(set->runs[i], db->iterpos[i], &k, &kl, &val,
+                              &vlen, &del);
+                    winner = i;
+                    deleted = del;
+                }
+                db->iterpos[i]++;
+            }
+        }
+
+        if (!deleted) {
+            pkey->dptr = (char *)key;
+            pkey->dsize = klen;
+            return APR_SUCCESS;
+        }
+    }
+
+    /* done */
+    free(db->iterpos);
+    db->iterpos = NULL;
+    LSM_LOCK(db);
+    runset_release(db->iterset);
+    LSM_UNLOCK(db);
+    db->iterset = NULL;
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t vt_lsm_firstkey(apr_dbm_t *dbm, apr_datum_t *pkey)
+{
+    lsm_t *db = dbm->file;
+    lsm_runset_t *set = lsm_hold(db);
+
+    free(db->iterpos);
+    LSM_LOCK(db);
+    runset_release(db->iterset);
+    db->iterset = set;
+    set->refs++;
+    LSM_UNLOCK(db);
+
+    if ((db->iterpos = calloc(set->nruns + 1, sizeof(*db->iterpos)))
+            == NULL) {
+        LSM_LOCK(db);
+        runset_release(db->iterset);
+        LSM_UNLOCK(db);
+        db->iterset = NULL;
+        return set_error(dbm, APR_ENOMEM);
+    }
+    db->itermem = apr_skiplist_getlist(db->mem);
+    db->itergen = db->memgen;
+
+    /* store any error info into DBM, and return a status code. */
+    return set_error(dbm, lsm_nextkey(db, pkey));
+}
+
+static apr_status_t vt_lsm_nextkey(apr_dbm_t *dbm, apr_datum_t *pkey)
+{
+    lsm_t *db = dbm->file;
+
+    (void) lsm_hold(db);
+
+    /* store any error info into DBM, and return a status code. */
+    return set_error(dbm, lsm_nextkey(db, pkey));
+}
+
+static void vt_lsm_freedatum(apr_dbm_t *dbm, apr_datum_t data)
+{
+}
+
+static void vt_lsm_usednames(apr_pool_t *pool, const char *pathname,
+                             const char **used1, const char **used2)
+{
+    *used1 = apr_pstrcat(pool, pathname, LSM_MANIFEXT, NULL);
+    *used2 = apr_pstrcat(pool, pathname, LSM_LOGEXT, NULL);
+}
+
+APR_MODULE_DECLARE_DATA const apr_dbm_driver_t apr_dbm_type_lsm = {
+    "lsm",
+    vt_lsm_open,
+    vt_lsm_close,
+    vt_lsm_fetch,
+    vt_lsm_store,
+    vt_lsm_del,
+    vt_lsm_exists,
+    vt_lsm_firstkey,
+    vt_lsm_nextkey,
+    vt_lsm_freedatum,
+    vt_lsm_usednames,
+    NULL,
+    NULL
+};
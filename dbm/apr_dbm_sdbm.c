@@ -19,6 +19,8 @@
 #define APR_WANT_STRFUNC
 #include "apr_want.h"
 
+#include <stdlib.h> /* for malloc, free */
+
 #include "apu.h"
 #include "apr_private.h"
 
@@ -202,6 +204,73 @@ static void vt_sdbm_freedatum(apr_dbm_t *dbm, apr_datum_t data)
 {
 }
 
+static apr_status_t vt_sdbm_fetch_multi(apr_dbm_t *dbm,
+                                        const apr_datum_t *keys,
+                                        apr_size_t nkeys,
+                                        apr_datum_t *values,
+                                        apr_pool_t *pool)
+{
+    apr_status_t rv;
+    apr_sdbm_datum_t *kd, *vd;
+    apr_size_t i;
+
+    if (nkeys > APR_INT32_MAX / 2)
+        return set_error(dbm, APR_EINVAL);
+    if (nkeys == 0)
+        return set_error(dbm, APR_SUCCESS);
+
+    if ((kd = malloc(2 * nkeys * sizeof(*kd))) == NULL)
+        return set_error(dbm, APR_ENOMEM);
+    vd = kd + nkeys;
+
+    for (i = 0; i < nkeys; i++) {
+        kd[i].dptr = keys[i].dptr;
+        kd[i].dsize = (int)keys[i].dsize;
+    }
+
+    rv = apr_sdbm_fetch_multi(dbm->file, vd, kd, (int)nkeys, pool);
+
+    for (i = 0; rv == APR_SUCCESS && i < nkeys; i++) {
+        values[i].dptr = vd[i].dptr;
+        values[i].dsize = vd[i].dsize;
+    }
+    free(kd);
+
+    /* store any error info into DBM, and return a status code. */
+    return set_error(dbm, rv);
+}
+
+typedef struct {
+    apr_dbm_iterate_cb_t *cb;
+    void *baton;
+} sdbm_iterate_t;
+
+static int sdbm_iterate_cb(void *baton, apr_sdbm_datum_t key,
+                           apr_sdbm_datum_t value)
+{
+    sdbm_iterate_t *it = baton;
+    apr_datum_t kd, vd;
+
+    kd.dptr = key.dptr;
+    kd.dsize = key.dsize;
+    vd.dptr = value.dptr;
+    vd.dsize = value.dsize;
+
+    return it->cb(it->baton, kd, vd);
+}
+
+static apr_status_t vt_sdbm_iterate(apr_dbm_t *dbm, apr_dbm_iterate_cb_t *cb,
+                                    void *baton)
+{
+    sdbm_iterate_t it;
+
+    it.cb = cb;
+    it.baton = baton;
+
+    /* store any error info into DBM, and return a status code. */
+    return set_error(dbm, apr_sdbm_iterate(dbm->file, sdbm_iterate_cb, &it));
+}
+
 static void vt_sdbm_usednames(apr_pool_t *pool, const char *pathname,
                               const char **used1, const char **used2)
 {
@@ -220,7 +289,9 @@ APR_MODULE_DECLARE_DATA const apr_dbm_driver_t apr_dbm_type_sdbm = {
     vt_sdbm_firstkey,
     vt_sdbm_nextkey,
     vt_sdbm_freedatum,
-    vt_sdbm_usednames
+    vt_sdbm_usednames,
+    vt_sdbm_fetch_multi,
+    vt_sdbm_iterate
 };
 
 #endif /* APU_HAVE_SDBM */
@@ -43,6 +43,18 @@ static apr_status_t setdbit(apr_sdbm_t *, long);
 static apr_status_t getpage(apr_sdbm_t *db, long, int, int);
 static apr_status_t getnext(apr_sdbm_datum_t *key, apr_sdbm_t *db);
 static apr_status_t makroom(apr_sdbm_t *, long, int);
+static apr_status_t read_from(apr_file_t *, void *, apr_off_t, apr_size_t,
+                              int);
+static apr_status_t write_to(apr_file_t *, const void *, apr_off_t,
+                             apr_size_t);
+static apr_status_t gethdr(apr_sdbm_t *, apr_size_t);
+static apr_status_t getval(apr_sdbm_t *, apr_sdbm_datum_t *);
+static apr_status_t putval(apr_sdbm_t *, apr_sdbm_datum_t *);
+static apr_status_t freeval(apr_sdbm_t *, apr_sdbm_datum_t);
+#if APR_HAS_MMAP
+static apr_status_t mapdb(apr_sdbm_t *);
+static char *mappage(apr_sdbm_t *, long);
+#endif
 
 /*
  * useful macros
@@ -50,8 +62,18 @@ static apr_status_t makroom(apr_sdbm_t *, long, int);
 #define bad(x)		((x).dptr == NULL || (x).dsize <= 0)
 #define exhash(item)	sdbm_hash((item).dptr, (item).dsize)
 
-#define OFF_PAG(off)	(apr_off_t) (off) * PBLKSIZ
-#define OFF_DIR(off)	(apr_off_t) (off) * DBLKSIZ
+#define OFF_PAG(db, off)	((apr_off_t) (off) * (db)->pblksiz)
+#define OFF_DIR(db, off)	((apr_off_t) (off) * DBLKSIZ + (db)->dirhdr)
+
+/*
+ * the values of the databases with a header are tagged: either inline,
+ * or a reference to the blocks (of pblksiz) of the overflow file where
+ * the values larger than SDBM_INLINEMAX are stored.
+ */
+#define VAL_INLINE	0
+#define VAL_OVERFLOW	1
+#define VAL_REFSIZ	9	/* tag, block, length */
+#define SDBM_INLINEMAX(db)	((db)->pblksiz / 8)
 
 static const long masks[] = {
         000000000000, 000000000001, 000000000003, 000000000007,
@@ -69,22 +91,44 @@ const apr_sdbm_datum_t sdbm_nullitem = { NULL, 0 };
 static apr_status_t database_cleanup(void *data)
 {
     apr_sdbm_t *db = data;
+    apr_status_t status = APR_SUCCESS;
 
     /*
      * Can't rely on apr_sdbm_unlock, since it will merely
      * decrement the refcnt if several locks are held.
      */
+    if (db->flags & SDBM_EXCLUSIVE_LOCK) {
+        status = sdbm_cache_flush(&db->pagcache);
+        if (status == APR_SUCCESS)
+            status = sdbm_cache_flush(&db->dircache);
+    }
+    sdbm_cache_clear(&db->pagcache);
+    sdbm_cache_clear(&db->dircache);
     if (db->flags & (SDBM_SHARED_LOCK | SDBM_EXCLUSIVE_LOCK))
         (void) apr_file_unlock(db->dirf);
+#if APR_HAS_MMAP
+    if (db->dirmm)
+        (void) apr_mmap_delete(db->dirmm);
+    if (db->pagmm)
+        (void) apr_mmap_delete(db->pagmm);
+    if (db->ovfmm)
+        (void) apr_mmap_delete(db->ovfmm);
+#endif
     (void) apr_file_close(db->dirf);
     (void) apr_file_close(db->pagf);
+    if (db->ovff)
+        (void) apr_file_close(db->ovff);
+    free(db->pagbuf);
+    free(db->ovfbuf);
     free(db);
 
-    return APR_SUCCESS;
+    return status;
 }
 
 static apr_status_t prep(apr_sdbm_t **pdb, const char *dirname, const char *pagname,
-                         apr_int32_t flags, apr_fileperms_t perms, apr_pool_t *p)
+                         const char *ovfname, apr_int32_t flags,
+                         apr_fileperms_t perms, apr_size_t pagesize,
+                         apr_pool_t *p)
 {
     apr_sdbm_t *db;
     apr_status_t status;
@@ -94,6 +138,7 @@ static apr_status_t prep(apr_sdbm_t **pdb, const char *dirname, const char *pagn
     db = malloc(sizeof(*db));
     memset(db, 0, sizeof(*db));
     db->pagbno = -1L;
+    db->pblksiz = PBLKSIZ;
 
     db->pool = p;
 
@@ -142,6 +187,34 @@ static apr_status_t prep(apr_sdbm_t **pdb, const char *dirname, const char *pagn
      * apr_sdbm_lock stated the dirf->size and invalidated the cache
      */
 
+    /*
+     * the page size is in the header if any, or given to a new database
+     */
+    if ((status = gethdr(db, pagesize)) != APR_SUCCESS)
+        goto error;
+
+    if ((db->pagbuf = malloc(4 * db->pblksiz)) == NULL) {
+        status = APR_ENOMEM;
+        goto error;
+    }
+    db->twinbuf = db->pagbuf + db->pblksiz;
+    db->splbuf = db->twinbuf + db->pblksiz;
+    db->valbuf = db->splbuf + db->pblksiz;
+
+    if (db->flags & SDBM_OVERFLOW) {
+        apr_int32_t ovfflags = flags;
+
+        if (!(db->flags & SDBM_RDONLY))
+            ovfflags |= APR_FOPEN_CREATE;
+        status = apr_file_open(&db->ovff, ovfname, ovfflags, perms, p);
+        if (status != APR_SUCCESS) {
+            /* no large value was ever stored */
+            if (!APR_STATUS_IS_ENOENT(status) || !(db->flags & SDBM_RDONLY))
+                goto error;
+            db->ovff = NULL;
+        }
+    }
+
     /*
      * if we are opened in SHARED mode, unlock ourself
      */
@@ -149,6 +222,16 @@ static apr_status_t prep(apr_sdbm_t **pdb, const char *dirname, const char *pagn
         if ((status = apr_sdbm_unlock(db)) != APR_SUCCESS)
             goto error;
 
+#if APR_HAS_MMAP
+    /*
+     * otherwise, read-only, we hold the shared lock until closed so the
+     * files can't change: look the pages up in place if they map.
+     */
+    if ((db->flags & (SDBM_RDONLY | SDBM_SHARED)) == SDBM_RDONLY)
+        if (mapdb(db) == APR_SUCCESS)
+            db->flags |= SDBM_MAPPED;
+#endif
+
     /* make sure that we close the database at some point */
     apr_pool_cleanup_register(p, db, database_cleanup, apr_pool_cleanup_null);
 
@@ -159,11 +242,22 @@ static apr_status_t prep(apr_sdbm_t **pdb, const char *dirname, const char *pagn
 error:
     if (db->dirf && db->pagf)
         (void) apr_sdbm_unlock(db);
+#if APR_HAS_MMAP
+    if (db->dirmm)
+        (void) apr_mmap_delete(db->dirmm);
+    if (db->pagmm)
+        (void) apr_mmap_delete(db->pagmm);
+    if (db->ovfmm)
+        (void) apr_mmap_delete(db->ovfmm);
+#endif
     if (db->dirf != NULL)
         (void) apr_file_close(db->dirf);
     if (db->pagf != NULL) {
         (void) apr_file_close(db->pagf);
     }
+    if (db->ovff != NULL)
+        (void) apr_file_close(db->ovff);
+    free(db->pagbuf);
     free(db);
     return status;
 }
@@ -171,11 +265,26 @@ error:
 APR_DECLARE(apr_status_t) apr_sdbm_open(apr_sdbm_t **db, const char *file,
                                         apr_int32_t flags,
                                         apr_fileperms_t perms, apr_pool_t *p)
+{
+    return apr_sdbm_open_ex(db, file, flags, perms, 0, p);
+}
+
+APR_DECLARE(apr_status_t) apr_sdbm_open_ex(apr_sdbm_t **db, const char *file,
+                                           apr_int32_t flags,
+                                           apr_fileperms_t perms,
+                                           apr_size_t pagesize, apr_pool_t *p)
 {
     char *dirname = apr_pstrcat(p, file, APR_SDBM_DIRFEXT, NULL);
     char *pagname = apr_pstrcat(p, file, APR_SDBM_PAGFEXT, NULL);
+    char *ovfname = apr_pstrcat(p, file, APR_SDBM_OVFFEXT, NULL);
 
-    return prep(db, dirname, pagname, flags, perms, p);
+    if (pagesize && (pagesize < SDBM_MINPBLK || pagesize > SDBM_MAXPBLK
+                     || (pagesize & (pagesize - 1)))) {
+        *db = NULL;
+        return APR_EINVAL;
+    }
+
+    return prep(db, dirname, pagname, ovfname, flags, perms, pagesize, p);
 }
 
 APR_DECLARE(apr_status_t) apr_sdbm_close(apr_sdbm_t *db)
@@ -191,12 +300,37 @@ APR_DECLARE(apr_status_t) apr_sdbm_fetch(apr_sdbm_t *db, apr_sdbm_datum_t *val,
     if (db == NULL || bad(key))
         return APR_EINVAL;
 
+#if APR_HAS_MMAP
+    /*
+     * lock free, and nothing is written to db: threads can fetch
+     * concurrently, the value pointing into the mapping.
+     */
+    if (db->flags & SDBM_MAPPED) {
+        char *pag = mappage(db, exhash(key));
+
+        if (pag == NULL) {
+            /* a hole, read as 0s */
+            *val = sdbm_nullitem;
+            return APR_SUCCESS;
+        }
+        if (!chkpage(pag, db->pblksiz))
+            return APR_ENOSPC; /* ### better error? */
+
+        *val = getpair(pag, key, db->pblksiz);
+        if (db->flags & SDBM_OVERFLOW)
+            return getval(db, val);
+        return APR_SUCCESS;
+    }
+#endif
+
     if ((status = apr_sdbm_lock(db, APR_FLOCK_SHARED)) != APR_SUCCESS)
         return status;
 
     if ((status = getpage(db, exhash(key), 0, 1)) == APR_SUCCESS) {
-        *val = getpair(db->pagbuf, key);
+        *val = getpair(db->pagbuf, key, db->pblksiz);
         /* ### do we want a not-found result? */
+        if (db->flags & SDBM_OVERFLOW)
+            status = getval(db, val);
     }
 
     (void) apr_sdbm_unlock(db);
@@ -206,13 +340,11 @@ APR_DECLARE(apr_status_t) apr_sdbm_fetch(apr_sdbm_t *db, apr_sdbm_datum_t *val,
 
 static apr_status_t write_page(apr_sdbm_t *db, const char *buf, long pagno)
 {
-    apr_status_t status;
-    apr_off_t off = OFF_PAG(pagno);
-
-    if ((status = apr_file_seek(db->pagf, APR_SET, &off)) == APR_SUCCESS)
-        status = apr_file_write_full(db->pagf, buf, PBLKSIZ, NULL);
+    /* written back on unlock if cached */
+    if (db->pagcache.maxblocks)
+        return sdbm_cache_put(&db->pagcache, pagno, buf, 1);
 
-    return status;
+    return write_to(db->pagf, buf, OFF_PAG(db, pagno), db->pblksiz);
 }
 
 APR_DECLARE(apr_status_t) apr_sdbm_delete(apr_sdbm_t *db,
@@ -229,11 +361,15 @@ APR_DECLARE(apr_status_t) apr_sdbm_delete(apr_sdbm_t *db,
         return status;
 
     if ((status = getpage(db, exhash(key), 0, 1)) == APR_SUCCESS) {
-        if (!delpair(db->pagbuf, key))
+        apr_sdbm_datum_t val = getpair(db->pagbuf, key, db->pblksiz);
+
+        if (val.dptr == NULL)
             /* ### should we define some APRUTIL codes? */
             status = APR_EGENERAL;
-        else
+        else if ((status = freeval(db, val)) == APR_SUCCESS) {
+            (void) delpair(db->pagbuf, key, db->pblksiz);
             status = write_page(db, db->pagbuf, db->pagbno);
+        }
     }
 
     (void) apr_sdbm_unlock(db);
@@ -252,11 +388,17 @@ APR_DECLARE(apr_status_t) apr_sdbm_store(apr_sdbm_t *db, apr_sdbm_datum_t key,
         return APR_EINVAL;
     if (apr_sdbm_rdonly(db))
         return APR_EINVAL;
-    need = key.dsize + val.dsize;
+    if (val.dsize < 0)
+        return APR_EINVAL;
+    if (db->flags & SDBM_OVERFLOW)
+        need = key.dsize + (1 + val.dsize <= SDBM_INLINEMAX(db)
+                            ? 1 + val.dsize : VAL_REFSIZ);
+    else
+        need = key.dsize + val.dsize;
     /*
      * is the pair too big (or too small) for this database ??
      */
-    if (need < 0 || need > PAIRMAX)
+    if (need < 0 || need > SDBM_PAIRMAX(db->pblksiz))
         return APR_EINVAL;
 
     if ((status = apr_sdbm_lock(db, APR_FLOCK_EXCLUSIVE)) != APR_SUCCESS)
@@ -268,23 +410,38 @@ APR_DECLARE(apr_status_t) apr_sdbm_store(apr_sdbm_t *db, apr_sdbm_datum_t key,
          * if we need to replace, delete the key/data pair
          * first. If it is not there, ignore.
          */
-        if (flags == APR_SDBM_REPLACE)
-            (void) delpair(db->pagbuf, key);
-        else if (!(flags & APR_SDBM_INSERTDUP) && duppair(db->pagbuf, key)) {
+        if (flags == APR_SDBM_REPLACE) {
+            apr_sdbm_datum_t old = getpair(db->pagbuf, key, db->pblksiz);
+
+            if (old.dptr != NULL) {
+                if ((status = freeval(db, old)) != APR_SUCCESS)
+                    goto error;
+                (void) delpair(db->pagbuf, key, db->pblksiz);
+            }
+        }
+        else if (!(flags & APR_SDBM_INSERTDUP)
+                 && duppair(db->pagbuf, key, db->pblksiz)) {
             status = APR_EEXIST;
             goto error;
         }
+        /*
+         * tag the value, writing it to the overflow file if large.
+         */
+        if ((status = putval(db, &val)) != APR_SUCCESS)
+            goto error;
         /*
          * if we do not have enough room, we have to split.
          */
-        if (!fitpair(db->pagbuf, need))
-            if ((status = makroom(db, hash, need)) != APR_SUCCESS)
+        if (!fitpair(db->pagbuf, need, db->pblksiz))
+            if ((status = makroom(db, hash, need)) != APR_SUCCESS) {
+                (void) freeval(db, val);
                 goto error;
+            }
         /*
          * we have enough room or split is successful. insert the key,
          * and update the page file.
          */
-        (void) putpair(db->pagbuf, key, val);
+        (void) putpair(db->pagbuf, key, val, db->pblksiz);
 
         status = write_page(db, db->pagbuf, db->pagbno);
     }
@@ -303,9 +460,8 @@ error:
 static apr_status_t makroom(apr_sdbm_t *db, long hash, int need)
 {
     long newp;
-    char twin[PBLKSIZ];
     char *pag = db->pagbuf;
-    char *new = twin;
+    char *new = db->twinbuf;
     register int smax = SPLTMAX;
     apr_status_t status;
 
@@ -313,7 +469,7 @@ static apr_status_t makroom(apr_sdbm_t *db, long hash, int need)
         /*
          * split the current page
          */
-        (void) splpage(pag, new, db->hmask + 1);
+        (void) splpage(pag, new, db->hmask + 1, db->splbuf, db->pblksiz);
         /*
          * address of the new page
          */
@@ -333,7 +489,7 @@ static apr_status_t makroom(apr_sdbm_t *db, long hash, int need)
                 return status;
 
             db->pagbno = newp;
-            (void) memcpy(pag, new, PBLKSIZ);
+            (void) memcpy(pag, new, db->pblksiz);
         }
         else {
             if ((status = write_page(db, new, newp)) != APR_SUCCESS)
@@ -345,7 +501,7 @@ static apr_status_t makroom(apr_sdbm_t *db, long hash, int need)
         /*
          * see if we have enough room now
          */
-        if (fitpair(pag, need))
+        if (fitpair(pag, need, db->pblksiz))
             return APR_SUCCESS;
         /*
          * try again... update curbit and hmask as getpage would have
@@ -398,6 +554,292 @@ static apr_status_t read_from(apr_file_t *f, void *buf,
     return status;
 }
 
+/* Writes 'len' bytes from buf to file 'f' at offset 'off'. */
+static apr_status_t write_to(apr_file_t *f, const void *buf,
+                             apr_off_t off, apr_size_t len)
+{
+    apr_status_t status;
+
+    if ((status = apr_file_seek(f, APR_SET, &off)) == APR_SUCCESS)
+        status = apr_file_write_full(f, buf, len, NULL);
+
+    return status;
+}
+
+/*
+ * the header of the databases with a page size: the magic, the version
+ * and the log2 of the page size, padded to SDBM_HDRSIZ. it is read under
+ * the lock taken by prep(), or written there if the database is new.
+ */
+static apr_status_t gethdr(apr_sdbm_t *db, apr_size_t pagesize)
+{
+    apr_finfo_t finfo;
+    apr_status_t status;
+    unsigned char hdr[SDBM_HDRSIZ];
+    int shift;
+
+    if ((status = apr_file_info_get(&finfo, APR_FINFO_SIZE, db->dirf))
+                != APR_SUCCESS)
+        return status;
+
+    if (finfo.size >= SDBM_HDRSIZ) {
+        if ((status = read_from(db->dirf, hdr, 0, SDBM_HDRSIZ,
+                                0)) != APR_SUCCESS)
+            return status;
+        if (memcmp(hdr, SDBM_MAGIC, 4) != 0)
+            return APR_SUCCESS;  /* no header, 1024 bytes pages */
+        if (hdr[4] != SDBM_VERSION
+            || (1 << hdr[5]) < SDBM_MINPBLK || (1 << hdr[5]) > SDBM_MAXPBLK)
+            return APR_EGENERAL; /* ### better error? */
+        db->pblksiz = 1 << hdr[5];
+    }
+    else if (finfo.size == 0 && pagesize && !(db->flags & SDBM_RDONLY)) {
+        apr_finfo_t pinfo;
+
+        if ((status = apr_file_info_get(&pinfo, APR_FINFO_SIZE, db->pagf))
+                    != APR_SUCCESS)
+            return status;
+        /* an existing database whose first page was never split */
+        if (pinfo.size != 0)
+            return APR_SUCCESS;
+
+        for (shift = 0; (apr_size_t)1 << shift < pagesize; shift++)
+            ;
+        memset(hdr, 0, sizeof(hdr));
+        memcpy(hdr, SDBM_MAGIC, 4);
+        hdr[4] = SDBM_VERSION;
+        hdr[5] = (unsigned char)shift;
+        if ((status = write_to(db->dirf, hdr, 0, SDBM_HDRSIZ)) != APR_SUCCESS)
+            return status;
+        db->pblksiz = (int)pagesize;
+        finfo.size = SDBM_HDRSIZ;
+    }
+    else
+        return APR_SUCCESS;
+
+    db->dirhdr = SDBM_HDRSIZ;
+    db->flags |= SDBM_OVERFLOW;
+    SDBM_INVALIDATE_CACHE(db, finfo);
+
+    return APR_SUCCESS;
+}
+
+/*
+ * the overflow file is made of blocks of pblksiz, the first one starting
+ * with the number of the first free extent (0 if none). each value is
+ * stored in an extent of contiguous blocks, a free extent starting with
+ * the number of the next free one and its own number of blocks.
+ */
+#define OVF_MAGIC	"SDBO"
+#define OVF_BLOCKS(db, len)	(((len) + (db)->pblksiz - 1) / (db)->pblksiz)
+
+static void put32(unsigned char *p, apr_uint32_t n)
+{
+    p[0] = (unsigned char)n;
+    p[1] = (unsigned char)(n >> 8);
+    p[2] = (unsigned char)(n >> 16);
+    p[3] = (unsigned char)(n >> 24);
+}
+
+static apr_uint32_t get32(const unsigned char *p)
+{
+    return (apr_uint32_t)p[0] | ((apr_uint32_t)p[1] << 8)
+           | ((apr_uint32_t)p[2] << 16) | ((apr_uint32_t)p[3] << 24);
+}
+
+static apr_status_t ovf_read(apr_sdbm_t *db, apr_uint32_t blk,
+                             apr_uint32_t *first, apr_uint32_t *second)
+{
+    unsigned char buf[8];
+    apr_status_t status;
+
+    if ((status = read_from(db->ovff, buf, (apr_off_t)blk * db->pblksiz,
+                            sizeof(buf), blk == 0)) != APR_SUCCESS)
+        return status;
+    if (blk == 0 && get32(buf) == 0)
+        buf[4] = buf[5] = buf[6] = buf[7] = 0;   /* a new file */
+    else if (blk == 0 && memcmp(buf, OVF_MAGIC, 4) != 0)
+        return APR_EGENERAL; /* ### better error? */
+    *first = get32(buf);
+    *second = get32(buf + 4);
+    return APR_SUCCESS;
+}
+
+static apr_status_t ovf_write(apr_sdbm_t *db, apr_uint32_t blk,
+                              apr_uint32_t first, apr_uint32_t second)
+{
+    unsigned char buf[8];
+
+    if (blk == 0)
+        memcpy(buf, OVF_MAGIC, 4);
+    else
+        put32(buf, first);
+    put32(buf + 4, second);
+    return write_to(db->ovff, buf, (apr_off_t)blk * db->pblksiz,
+                    sizeof(buf));
+}
+
+/*
+ * first fit in the free extents, from the tail of a larger one,
+ * else at the end of the file.
+ */
+static apr_status_t ovf_alloc(apr_sdbm_t *db, apr_uint32_t nblks,
+                              apr_uint32_t *pblk)
+{
+    apr_uint32_t prev = 0, prevsize = 0, cur, next, size, magic;
+    apr_finfo_t finfo;
+    apr_status_t status;
+
+    if ((status = ovf_read(db, 0, &magic, &cur)) != APR_SUCCESS)
+        return status;
+
+    while (cur != 0) {
+        if ((status = ovf_read(db, cur, &next, &size)) != APR_SUCCESS)
+            return status;
+        if (size == nblks) {
+            /* unlink the extent */
+            *pblk = cur;
+            return ovf_write(db, prev, next, prev ? prevsize : next);
+        }
+        if (size > nblks) {
+            *pblk = cur + size - nblks;
+            return ovf_write(db, cur, next, size - nblks);
+        }
+        prev = cur;
+        prevsize = size;
+        cur = next;
+    }
+
+    if ((status = apr_file_info_get(&finfo, APR_FINFO_SIZE, db->ovff))
+                != APR_SUCCESS)
+        return status;
+    if (finfo.size == 0) {
+        if ((status = ovf_write(db, 0, 0, 0)) != APR_SUCCESS)
+            return status;
+        finfo.size = 1;
+    }
+    *pblk = (apr_uint32_t)OVF_BLOCKS(db, finfo.size);
+    return APR_SUCCESS;
+}
+
+static apr_status_t ovf_free(apr_sdbm_t *db, apr_uint32_t blk,
+                             apr_uint32_t nblks)
+{
+    apr_uint32_t magic, head;
+    apr_status_t status;
+
+    if ((status = ovf_read(db, 0, &magic, &head)) != APR_SUCCESS
+        || (status = ovf_write(db, blk, head, nblks)) != APR_SUCCESS)
+        return status;
+    return ovf_write(db, 0, 0, blk);
+}
+
+/*
+ * untag a value, reading it from the overflow file when referenced.
+ */
+static apr_status_t getval(apr_sdbm_t *db, apr_sdbm_datum_t *val)
+{
+    const unsigned char *ref = (const unsigned char *)val->dptr;
+    apr_uint32_t blk, len;
+    apr_off_t off;
+    apr_status_t status;
+
+    if (ref == NULL)
+        return APR_SUCCESS;
+    if (val->dsize >= 1 && ref[0] == VAL_INLINE) {
+        val->dptr++;
+        val->dsize--;
+        return APR_SUCCESS;
+    }
+    if (val->dsize != VAL_REFSIZ || ref[0] != VAL_OVERFLOW)
+        return APR_EGENERAL; /* ### better error? */
+
+    blk = get32(ref + 1);
+    len = get32(ref + 5);
+    off = (apr_off_t)blk * db->pblksiz;
+
+#if APR_HAS_MMAP
+    if (db->flags & SDBM_MAPPED) {
+        if (db->ovfmm == NULL
+            || off + (apr_off_t)len > (apr_off_t)db->ovfmm->size)
+            return APR_EGENERAL;
+        val->dptr = (char *)db->ovfmm->mm + off;
+        val->dsize = (int)len;
+        return APR_SUCCESS;
+    }
+#endif
+
+    if (db->ovff == NULL)
+        return APR_EGENERAL;
+    if (len > db->ovfbufsiz) {
+        char *buf = realloc(db->ovfbuf, len);
+
+        if (buf == NULL)
+            return APR_ENOMEM;
+        db->ovfbuf = buf;
+        db->ovfbufsiz = len;
+    }
+    if ((status = read_from(db->ovff, db->ovfbuf, off, len,
+                            0)) != APR_SUCCESS)
+        return status;
+
+    val->dptr = db->ovfbuf;
+    val->dsize = (int)len;
+    return APR_SUCCESS;
+}
+
+/*
+ * tag a value in valbuf, storing it in the overflow file if large.
+ */
+static apr_status_t putval(apr_sdbm_t *db, apr_sdbm_datum_t *val)
+{
+    unsigned char *ref = (unsigned char *)db->valbuf;
+    apr_uint32_t blk;
+    apr_status_t status;
+
+    if (!(db->flags & SDBM_OVERFLOW))
+        return APR_SUCCESS;
+
+    if (1 + val->dsize <= SDBM_INLINEMAX(db)) {
+        ref[0] = VAL_INLINE;
+        if (val->dsize)
+            memcpy(ref + 1, val->dptr, val->dsize);
+        val->dptr = db->valbuf;
+        val->dsize++;
+        return APR_SUCCESS;
+    }
+
+    if ((status = ovf_alloc(db, OVF_BLOCKS(db, (apr_uint32_t)val->dsize),
+                            &blk)) != APR_SUCCESS)
+        return status;
+    if ((status = write_to(db->ovff, val->dptr, (apr_off_t)blk * db->pblksiz,
+                           val->dsize)) != APR_SUCCESS) {
+        (void) ovf_free(db, blk, OVF_BLOCKS(db, (apr_uint32_t)val->dsize));
+        return status;
+    }
+
+    ref[0] = VAL_OVERFLOW;
+    put32(ref + 1, blk);
+    put32(ref + 5, (apr_uint32_t)val->dsize);
+    val->dptr = db->valbuf;
+    val->dsize = VAL_REFSIZ;
+    return APR_SUCCESS;
+}
+
+/*
+ * release the overflow blocks of a tagged value, if any.
+ */
+static apr_status_t freeval(apr_sdbm_t *db, apr_sdbm_datum_t val)
+{
+    const unsigned char *ref = (const unsigned char *)val.dptr;
+
+    if (!(db->flags & SDBM_OVERFLOW) || val.dsize != VAL_REFSIZ
+        || ref[0] != VAL_OVERFLOW)
+        return APR_SUCCESS;
+
+    return ovf_free(db, get32(ref + 1), OVF_BLOCKS(db, get32(ref + 5)));
+}
+
 /*
  * the following two routines will break if
  * deletions aren't taken into account. (ndbm bug)
@@ -439,6 +881,123 @@ APR_DECLARE(apr_status_t) apr_sdbm_nextkey(apr_sdbm_t *db,
     return status;
 }
 
+/*
+ * the pages are the sets of hashes sharing their low bits: ordered by
+ * their reversed bits, the keys of a page are next to each other.
+ */
+typedef struct {
+    apr_uint32_t order;
+    int i;
+} keyorder_t;
+
+static int keyorder_cmp(const void *a, const void *b)
+{
+    const keyorder_t *ka = a, *kb = b;
+
+    if (ka->order != kb->order)
+        return ka->order < kb->order ? -1 : 1;
+    return ka->i - kb->i;
+}
+
+APR_DECLARE(apr_status_t) apr_sdbm_fetch_multi(apr_sdbm_t *db,
+                                               apr_sdbm_datum_t *values,
+                                               const apr_sdbm_datum_t *keys,
+                                               int nkeys, apr_pool_t *pool)
+{
+    keyorder_t *order;
+    apr_sdbm_datum_t val;
+    apr_status_t status;
+    apr_uint32_t h, r;
+    int i, b;
+
+    if (db == NULL || nkeys < 0 || (nkeys && (keys == NULL || values == NULL)))
+        return APR_EINVAL;
+    for (i = 0; i < nkeys; i++)
+        if (bad(keys[i]))
+            return APR_EINVAL;
+    if (nkeys == 0)
+        return APR_SUCCESS;
+
+    if ((order = malloc(nkeys * sizeof(*order))) == NULL)
+        return APR_ENOMEM;
+    for (i = 0; i < nkeys; i++) {
+        h = (apr_uint32_t)exhash(keys[i]);
+        for (r = 0, b = 0; b < 32; b++, h >>= 1)
+            r = (r << 1) | (h & 1);
+        order[i].order = r;
+        order[i].i = i;
+    }
+    qsort(order, nkeys, sizeof(*order), keyorder_cmp);
+
+    if ((status = apr_sdbm_lock(db, APR_FLOCK_SHARED)) != APR_SUCCESS) {
+        free(order);
+        return status;
+    }
+
+    for (i = 0; i < nkeys; i++) {
+        apr_sdbm_datum_t *value = &values[order[i].i];
+
+        if ((status = apr_sdbm_fetch(db, &val,
+                                     keys[order[i].i])) != APR_SUCCESS)
+            break;
+        value->dsize = val.dsize;
+        value->dptr = val.dptr ? apr_pmemdup(pool, val.dptr, val.dsize)
+                               : NULL;
+    }
+
+    (void) apr_sdbm_unlock(db);
+    free(order);
+
+    return status;
+}
+
+APR_DECLARE(apr_status_t) apr_sdbm_iterate(apr_sdbm_t *db,
+                                           apr_sdbm_iterate_cb_t *cb,
+                                           void *baton)
+{
+    apr_sdbm_datum_t key, val;
+    apr_status_t status;
+    char *pag;
+    long blk;
+    int n;
+
+    if (db == NULL || cb == NULL)
+        return APR_EINVAL;
+
+    if ((status = apr_sdbm_lock(db, APR_FLOCK_SHARED)) != APR_SUCCESS)
+        return status;
+
+    /* a copy, the callback may fetch */
+    if ((pag = malloc(db->pblksiz)) == NULL) {
+        (void) apr_sdbm_unlock(db);
+        return APR_ENOMEM;
+    }
+
+    for (blk = 0; ; blk++) {
+        if ((status = getpage(db, blk, 1, blk == 0)) != APR_SUCCESS) {
+            if (APR_STATUS_IS_EOF(status))
+                status = APR_SUCCESS;
+            break;
+        }
+        memcpy(pag, db->pagbuf, db->pblksiz);
+
+        for (n = 1; (key = getnkey(pag, n, db->pblksiz)).dptr != NULL; n++) {
+            val = getnval(pag, n);
+            if ((db->flags & SDBM_OVERFLOW)
+                && (status = getval(db, &val)) != APR_SUCCESS)
+                goto done;
+            if (!cb(baton, key, val))
+                goto done;
+        }
+    }
+
+done:
+    free(pag);
+    (void) apr_sdbm_unlock(db);
+
+    return status;
+}
+
 /*
  * all important binary tree traversal
  */
@@ -475,13 +1034,28 @@ static apr_status_t getpage(apr_sdbm_t *db, long hash, int by_num, int create)
          * ### joe: this assumption was surely never correct? but
          * ### we make it so in read_from anyway.
          */
-        if ((status = read_from(db->pagf, db->pagbuf,
-                                OFF_PAG(pagb), PBLKSIZ,
-                                create)) != APR_SUCCESS)
-            return status;
+        if (!sdbm_cache_get(&db->pagcache, pagb, db->pagbuf)) {
+            /*
+             * EOF ends the iteration, the holes before the pages not
+             * written back yet must read as 0s.
+             */
+            if (!create && db->pagcache.ndirty
+                && (status = sdbm_cache_flush(&db->pagcache))
+                        != APR_SUCCESS)
+                return status;
 
-        if (!chkpage(db->pagbuf))
-            return APR_ENOSPC; /* ### better error? */
+            if ((status = read_from(db->pagf, db->pagbuf,
+                                    OFF_PAG(db, pagb), db->pblksiz,
+                                    create)) != APR_SUCCESS)
+                return status;
+
+            if (!chkpage(db->pagbuf, db->pblksiz))
+                return APR_ENOSPC; /* ### better error? */
+
+            if ((status = sdbm_cache_put(&db->pagcache, pagb, db->pagbuf,
+                                         0)) != APR_SUCCESS)
+                return status;
+        }
 
         db->pagbno = pagb;
 
@@ -499,9 +1073,12 @@ static int getdbit(apr_sdbm_t *db, long dbit)
     dirb = c / DBLKSIZ;
 
     if (dirb != db->dirbno) {
-        if (read_from(db->dirf, db->dirbuf,
-                      OFF_DIR(dirb), DBLKSIZ,
-                      1) != APR_SUCCESS)
+        if (!sdbm_cache_get(&db->dircache, dirb, db->dirbuf)
+            && (read_from(db->dirf, db->dirbuf,
+                          OFF_DIR(db, dirb), DBLKSIZ,
+                          1) != APR_SUCCESS
+                || sdbm_cache_put(&db->dircache, dirb, db->dirbuf,
+                                  0) != APR_SUCCESS))
             return 0;
 
         db->dirbno = dirb;
@@ -517,15 +1094,15 @@ static apr_status_t setdbit(apr_sdbm_t *db, long dbit)
     register long c;
     register long dirb;
     apr_status_t status;
-    apr_off_t off;
 
     c = dbit / BYTESIZ;
     dirb = c / DBLKSIZ;
 
     if (dirb != db->dirbno) {
-        if ((status = read_from(db->dirf, db->dirbuf,
-                                OFF_DIR(dirb), DBLKSIZ,
-                                1)) != APR_SUCCESS)
+        if (!sdbm_cache_get(&db->dircache, dirb, db->dirbuf)
+            && (status = read_from(db->dirf, db->dirbuf,
+                                   OFF_DIR(db, dirb), DBLKSIZ,
+                                   1)) != APR_SUCCESS)
             return status;
 
         db->dirbno = dirb;
@@ -538,13 +1115,85 @@ static apr_status_t setdbit(apr_sdbm_t *db, long dbit)
     if (dbit >= db->maxbno)
         db->maxbno += DBLKSIZ * BYTESIZ;
 
-    off = OFF_DIR(dirb);
-    if ((status = apr_file_seek(db->dirf, APR_SET, &off)) == APR_SUCCESS)
-        status = apr_file_write_full(db->dirf, db->dirbuf, DBLKSIZ, NULL);
+    /* written back on unlock if cached */
+    if (db->dircache.maxblocks)
+        return sdbm_cache_put(&db->dircache, dirb, db->dirbuf, 1);
+
+    return write_to(db->dirf, db->dirbuf, OFF_DIR(db, dirb), DBLKSIZ);
+}
+
+#if APR_HAS_MMAP
+static apr_status_t mapfile(apr_file_t *f, apr_mmap_t **mm, apr_pool_t *p)
+{
+    apr_finfo_t finfo;
+    apr_status_t status;
+
+    if ((status = apr_file_info_get(&finfo, APR_FINFO_SIZE, f))
+                != APR_SUCCESS)
+        return status;
+
+    /* nothing to map, all 0s */
+    if (finfo.size == 0)
+        return APR_SUCCESS;
+    if ((apr_off_t)(apr_size_t)finfo.size != finfo.size)
+        return APR_ENOMEM;
+
+    return apr_mmap_create(mm, f, 0, (apr_size_t)finfo.size, APR_MMAP_READ, p);
+}
+
+static apr_status_t mapdb(apr_sdbm_t *db)
+{
+    apr_status_t status;
 
+    if ((status = mapfile(db->dirf, &db->dirmm, db->pool)) != APR_SUCCESS)
+        return status;
+    if ((status = mapfile(db->pagf, &db->pagmm, db->pool)) == APR_SUCCESS
+        && (db->ovff == NULL
+            || (status = mapfile(db->ovff, &db->ovfmm, db->pool))
+                    == APR_SUCCESS))
+        return APR_SUCCESS;
+
+    if (db->dirmm) {
+        (void) apr_mmap_delete(db->dirmm);
+        db->dirmm = NULL;
+    }
+    if (db->pagmm) {
+        (void) apr_mmap_delete(db->pagmm);
+        db->pagmm = NULL;
+    }
     return status;
 }
 
+/*
+ * getpage() and getdbit() on the mappings, without touching db.
+ * returns NULL for a page past the end of the file (a hole).
+ */
+static char *mappage(apr_sdbm_t *db, long hash)
+{
+    const char *dir = NULL;
+    apr_size_t dirsize = 0;
+    register int hbit = 0;
+    register long dbit = 0;
+    apr_off_t off;
+
+    if (db->dirmm && db->dirmm->size > (apr_size_t)db->dirhdr) {
+        dir = (const char *)db->dirmm->mm + db->dirhdr;
+        dirsize = db->dirmm->size - db->dirhdr;
+    }
+
+    while (dbit < db->maxbno
+           && (apr_size_t)(dbit / BYTESIZ) < dirsize
+           && (dir[dbit / BYTESIZ] & (1 << dbit % BYTESIZ)))
+        dbit = 2 * dbit + ((hash & (1 << hbit++)) ? 2 : 1);
+
+    off = OFF_PAG(db, hash & masks[hbit]);
+    if (db->pagmm == NULL || off + db->pblksiz > (apr_off_t)db->pagmm->size)
+        return NULL;
+
+    return (char *)db->pagmm->mm + off;
+}
+#endif
+
 /*
 * getnext - get the next key in the page, and if done with
 * the page, try the next page in sequence
@@ -554,7 +1203,7 @@ static apr_status_t getnext(apr_sdbm_datum_t *key, apr_sdbm_t *db)
     apr_status_t status;
     for (;;) {
         db->keyptr++;
-        *key = getnkey(db->pagbuf, db->keyptr);
+        *key = getnkey(db->pagbuf, db->keyptr, db->pblksiz);
         if (key->dptr != NULL)
             return APR_SUCCESS;
         /*
@@ -0,0 +1,223 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * sdbm - ndbm work-alike hashed database library
+ * LRU cache of the page and directory blocks, written back on unlock.
+ */
+
+#include "apr_sdbm.h"
+
+#include "sdbm_private.h"
+#include "sdbm_tune.h"
+
+#include <stdlib.h> /* for malloc, free, qsort */
+#include <string.h> /* for memcpy */
+
+struct sdbm_block_t {
+    APR_RING_ENTRY(sdbm_block_t) link;
+    long blkno;
+    int dirty;
+    char *buf;
+};
+
+static apr_status_t write_block(sdbm_cache_t *c, sdbm_block_t *blk)
+{
+    apr_status_t status;
+    apr_off_t off = c->base + (apr_off_t)blk->blkno * c->blksiz;
+
+    if ((status = apr_file_seek(c->f, APR_SET, &off)) == APR_SUCCESS
+        && (status = apr_file_write_full(c->f, blk->buf, c->blksiz,
+                                         NULL)) == APR_SUCCESS) {
+        blk->dirty = 0;
+        c->ndirty--;
+    }
+
+    return status;
+}
+
+static int block_cmp(const void *a, const void *b)
+{
+    long an = (*(sdbm_block_t *const *)a)->blkno;
+    long bn = (*(sdbm_block_t *const *)b)->blkno;
+
+    return (an > bn) - (an < bn);
+}
+
+int sdbm_cache_get(sdbm_cache_t *c, long blkno, char *buf)
+{
+    sdbm_block_t *blk;
+
+    if (!c->maxblocks)
+        return 0;
+
+    blk = apr_hash_get(c->index, &blkno, sizeof(blkno));
+    if (blk == NULL) {
+        c->misses++;
+        return 0;
+    }
+
+    APR_RING_REMOVE(blk, link);
+    APR_RING_INSERT_HEAD(&c->lru, blk, sdbm_block_t, link);
+    memcpy(buf, blk->buf, c->blksiz);
+    c->hits++;
+
+    return 1;
+}
+
+apr_status_t sdbm_cache_put(sdbm_cache_t *c, long blkno, const char *buf,
+                            int dirty)
+{
+    sdbm_block_t *blk;
+    apr_status_t status;
+
+    if (!c->maxblocks)
+        return APR_SUCCESS;
+
+    blk = apr_hash_get(c->index, &blkno, sizeof(blkno));
+    if (blk != NULL) {
+        APR_RING_REMOVE(blk, link);
+    }
+    else if (c->nblocks < c->maxblocks) {
+        if ((blk = malloc(sizeof(*blk) + c->blksiz)) == NULL)
+            return APR_ENOMEM;
+        blk->buf = (char *)(blk + 1);
+        blk->dirty = 0;
+        c->nblocks++;
+    }
+    else {
+        /* evict the least recently used block */
+        blk = APR_RING_LAST(&c->lru);
+        if (blk->dirty && (status = write_block(c, blk)) != APR_SUCCESS)
+            return status;
+        APR_RING_REMOVE(blk, link);
+        apr_hash_set(c->index, &blk->blkno, sizeof(blk->blkno), NULL);
+    }
+
+    if (blk->dirty != dirty)
+        c->ndirty += dirty ? 1 : -1;
+    blk->dirty = dirty;
+    blk->blkno = blkno;
+    memcpy(blk->buf, buf, c->blksiz);
+    apr_hash_set(c->index, &blk->blkno, sizeof(blk->blkno), blk);
+    APR_RING_INSERT_HEAD(&c->lru, blk, sdbm_block_t, link);
+
+    return APR_SUCCESS;
+}
+
+/*
+ * write the dirty blocks in file order.
+ */
+apr_status_t sdbm_cache_flush(sdbm_cache_t *c)
+{
+    sdbm_block_t *blk, **dirty;
+    apr_status_t status = APR_SUCCESS;
+    int i, n = 0;
+
+    if (!c->ndirty)
+        return APR_SUCCESS;
+
+    if ((dirty = malloc(c->ndirty * sizeof(*dirty))) == NULL)
+        return APR_ENOMEM;
+
+    for (blk = APR_RING_FIRST(&c->lru);
+         blk != APR_RING_SENTINEL(&c->lru, sdbm_block_t, link);
+         blk = APR_RING_NEXT(blk, link))
+        if (blk->dirty)
+            dirty[n++] = blk;
+    qsort(dirty, n, sizeof(*dirty), block_cmp);
+
+    for (i = 0; i < n && status == APR_SUCCESS; i++)
+        status = write_block(c, dirty[i]);
+
+    free(dirty);
+    return status;
+}
+
+/*
+ * forget the cached blocks, the dirty ones included.
+ */
+void sdbm_cache_clear(sdbm_cache_t *c)
+{
+    sdbm_block_t *blk;
+
+    if (!c->nblocks)
+        return;
+
+    while (!APR_RING_EMPTY(&c->lru, sdbm_block_t, link)) {
+        blk = APR_RING_FIRST(&c->lru);
+        APR_RING_REMOVE(blk, link);
+        apr_hash_set(c->index, &blk->blkno, sizeof(blk->blkno), NULL);
+        free(blk);
+    }
+    c->nblocks = 0;
+    c->ndirty = 0;
+}
+
+apr_status_t sdbm_cache_resize(sdbm_cache_t *c, int maxblocks,
+                               apr_file_t *f, apr_off_t base, int blksiz,
+                               apr_pool_t *p)
+{
+    sdbm_block_t *blk;
+    apr_status_t status;
+
+    if (c->index == NULL) {
+        c->index = apr_hash_make(p);
+        APR_RING_INIT(&c->lru, sdbm_block_t, link);
+    }
+    c->f = f;
+    c->base = base;
+    c->blksiz = blksiz;
+
+    while (c->nblocks > maxblocks) {
+        blk = APR_RING_LAST(&c->lru);
+        if (blk->dirty && (status = write_block(c, blk)) != APR_SUCCESS)
+            return status;
+        APR_RING_REMOVE(blk, link);
+        apr_hash_set(c->index, &blk->blkno, sizeof(blk->blkno), NULL);
+        free(blk);
+        c->nblocks--;
+    }
+    c->maxblocks = maxblocks;
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_sdbm_cache_set(apr_sdbm_t *db,
+                                             apr_size_t nblocks)
+{
+    apr_status_t status;
+
+    if (db == NULL || nblocks > SDBM_MAXCACHE)
+        return APR_EINVAL;
+
+    if ((status = sdbm_cache_resize(&db->pagcache, (int)nblocks, db->pagf,
+                                    0, db->pblksiz, db->pool))
+                != APR_SUCCESS)
+        return status;
+
+    return sdbm_cache_resize(&db->dircache, (int)nblocks, db->dirf,
+                             db->dirhdr, DBLKSIZ, db->pool);
+}
+
+APR_DECLARE(void) apr_sdbm_cache_stats(apr_sdbm_t *db, apr_size_t *hits,
+                                       apr_size_t *misses)
+{
+    if (hits)
+        *hits = db->pagcache.hits + db->dircache.hits;
+    if (misses)
+        *misses = db->pagcache.misses + db->dircache.misses;
+}
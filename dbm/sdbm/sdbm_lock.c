@@ -58,6 +58,8 @@ APR_DECLARE(apr_status_t) apr_sdbm_lock(apr_sdbm_t *db, int type)
         }
 
         SDBM_INVALIDATE_CACHE(db, finfo);
+        sdbm_cache_clear(&db->pagcache);
+        sdbm_cache_clear(&db->dircache);
 
         ++db->lckcnt;
         if (type == APR_FLOCK_SHARED)
@@ -70,10 +72,21 @@ APR_DECLARE(apr_status_t) apr_sdbm_lock(apr_sdbm_t *db, int type)
 
 APR_DECLARE(apr_status_t) apr_sdbm_unlock(apr_sdbm_t *db)
 {
+    apr_status_t status = APR_SUCCESS, rv;
+
     if (!(db->flags & (SDBM_SHARED_LOCK | SDBM_EXCLUSIVE_LOCK)))
         return APR_EINVAL;
     if (--db->lckcnt > 0)
         return APR_SUCCESS;
+    /*
+     * write back the cached blocks before others can read them
+     */
+    if (db->flags & SDBM_EXCLUSIVE_LOCK) {
+        status = sdbm_cache_flush(&db->pagcache);
+        if (status == APR_SUCCESS)
+            status = sdbm_cache_flush(&db->dircache);
+    }
     db->flags &= ~(SDBM_SHARED_LOCK | SDBM_EXCLUSIVE_LOCK);
-    return apr_file_unlock(db->dirf);
+    rv = apr_file_unlock(db->dirf);
+    return status != APR_SUCCESS ? status : rv;
 }
@@ -37,7 +37,7 @@
 /*
  * forward
  */
-static int seepair(char *, int, char *, int);
+static int seepair(char *, int, char *, int, int);
 
 /*
  * page format:
@@ -57,19 +57,22 @@ static int seepair(char *, int, char *, int);
  * of entries (ino[0]) is zero, the offset to the END of
  * the free area is the block size. Otherwise, it is the
  * nth (ino[ino[0]]) entry's offset.
+ *
+ * the block size is pblksiz, PBLKSIZ for the databases without a header.
  */
 
 int
-fitpair(pag, need)
+fitpair(pag, need, pblksiz)
 char *pag;
 int need;
+int pblksiz;
 {
 	register int n;
 	register int off;
 	register int avail;
 	register short *ino = (short *) pag;
 
-	off = ((n = ino[0]) > 0) ? ino[n] : PBLKSIZ;
+	off = ((n = ino[0]) > 0) ? ino[n] : pblksiz;
 	avail = off - (n + 1) * sizeof(short);
 	need += 2 * sizeof(short);
 
@@ -79,16 +82,17 @@ int need;
 }
 
 void
-putpair(pag, key, val)
+putpair(pag, key, val, pblksiz)
 char *pag;
 apr_sdbm_datum_t key;
 apr_sdbm_datum_t val;
+int pblksiz;
 {
 	register int n;
 	register int off;
 	register short *ino = (short *) pag;
 
-	off = ((n = ino[0]) > 0) ? ino[n] : PBLKSIZ;
+	off = ((n = ino[0]) > 0) ? ino[n] : pblksiz;
 /*
  * enter the key first
  */
@@ -108,9 +112,10 @@ apr_sdbm_datum_t val;
 }
 
 apr_sdbm_datum_t
-getpair(pag, key)
+getpair(pag, key, pblksiz)
 char *pag;
 apr_sdbm_datum_t key;
+int pblksiz;
 {
 	register int i;
 	register int n;
@@ -120,7 +125,7 @@ apr_sdbm_datum_t key;
 	if ((n = ino[0]) == 0)
 		return sdbm_nullitem;
 
-	if ((i = seepair(pag, n, key.dptr, key.dsize)) == 0)
+	if ((i = seepair(pag, n, key.dptr, key.dsize, pblksiz)) == 0)
 		return sdbm_nullitem;
 
 	val.dptr = pag + ino[i + 1];
@@ -129,18 +134,21 @@ apr_sdbm_datum_t key;
 }
 
 int
-duppair(pag, key)
+duppair(pag, key, pblksiz)
 char *pag;
 apr_sdbm_datum_t key;
+int pblksiz;
 {
 	register short *ino = (short *) pag;
-	return ino[0] > 0 && seepair(pag, ino[0], key.dptr, key.dsize) > 0;
+	return ino[0] > 0 &&
+	       seepair(pag, ino[0], key.dptr, key.dsize, pblksiz) > 0;
 }
 
 apr_sdbm_datum_t
-getnkey(pag, num)
+getnkey(pag, num, pblksiz)
 char *pag;
 int num;
+int pblksiz;
 {
 	apr_sdbm_datum_t key;
 	register int off;
@@ -150,7 +158,7 @@ int num;
 	if (ino[0] == 0 || num > ino[0])
 		return sdbm_nullitem;
 
-	off = (num > 1) ? ino[num - 1] : PBLKSIZ;
+	off = (num > 1) ? ino[num - 1] : pblksiz;
 
 	key.dptr = pag + ino[num];
 	key.dsize = off - ino[num];
@@ -158,10 +166,29 @@ int num;
 	return key;
 }
 
+apr_sdbm_datum_t
+getnval(pag, num)
+char *pag;
+int num;
+{
+	apr_sdbm_datum_t val;
+	register short *ino = (short *) pag;
+
+	num = num * 2;
+	if (ino[0] == 0 || num > ino[0])
+		return sdbm_nullitem;
+
+	val.dptr = pag + ino[num];
+	val.dsize = ino[num - 1] - ino[num];
+
+	return val;
+}
+
 int
-delpair(pag, key)
+delpair(pag, key, pblksiz)
 char *pag;
 apr_sdbm_datum_t key;
+int pblksiz;
 {
 	register int n;
 	register int i;
@@ -170,7 +197,7 @@ apr_sdbm_datum_t key;
 	if ((n = ino[0]) == 0)
 		return 0;
 
-	if ((i = seepair(pag, n, key.dptr, key.dsize)) == 0)
+	if ((i = seepair(pag, n, key.dptr, key.dsize, pblksiz)) == 0)
 		return 0;
 /*
  * found the key. if it is the last entry
@@ -181,7 +208,7 @@ apr_sdbm_datum_t key;
  */
 	if (i < n - 1) {
 		register int m;
-		register char *dst = pag + (i == 1 ? PBLKSIZ : ino[i - 1]);
+		register char *dst = pag + (i == 1 ? pblksiz : ino[i - 1]);
 		register char *src = pag + ino[i + 1];
 		register short zoo = (short) (dst - src);
 
@@ -231,14 +258,15 @@ apr_sdbm_datum_t key;
  * return 0 if not found.
  */
 static int
-seepair(pag, n, key, siz)
+seepair(pag, n, key, siz, pblksiz)
 char *pag;
 register int n;
 register char *key;
 register int siz;
+int pblksiz;
 {
 	register int i;
-	register int off = PBLKSIZ;
+	register int off = pblksiz;
 	register short *ino = (short *) pag;
 
 	for (i = 1; i < n; i += 2) {
@@ -251,22 +279,23 @@ register int siz;
 }
 
 void
-splpage(pag, new, sbit)
+splpage(pag, new, sbit, cur, pblksiz)
 char *pag;
 char *new;
 long sbit;
+char *cur;			/* pblksiz bytes of scratch */
+int pblksiz;
 {
 	apr_sdbm_datum_t key;
 	apr_sdbm_datum_t val;
 
 	register int n;
-	register int off = PBLKSIZ;
-	char cur[PBLKSIZ];
+	register int off = pblksiz;
 	register short *ino = (short *) cur;
 
-	(void) memcpy(cur, pag, PBLKSIZ);
-	(void) memset(pag, 0, PBLKSIZ);
-	(void) memset(new, 0, PBLKSIZ);
+	(void) memcpy(cur, pag, pblksiz);
+	(void) memset(pag, 0, pblksiz);
+	(void) memset(new, 0, pblksiz);
 
 	n = ino[0];
 	for (ino++; n > 0; ino += 2) {
@@ -277,7 +306,8 @@ long sbit;
 /*
  * select the page pointer (by looking at sbit) and insert
  */
-		(void) putpair((exhash(key) & sbit) ? new : pag, key, val);
+		(void) putpair((exhash(key) & sbit) ? new : pag, key, val,
+			       pblksiz);
 
 		off = ino[1];
 		n -= 2;
@@ -295,18 +325,19 @@ long sbit;
  * this could be made more rigorous.
  */
 int
-chkpage(pag)
+chkpage(pag, pblksiz)
 char *pag;
+int pblksiz;
 {
 	register int n;
 	register int off;
 	register short *ino = (short *) pag;
 
-	if ((n = ino[0]) < 0 || n > PBLKSIZ / sizeof(short))
+	if ((n = ino[0]) < 0 || n > pblksiz / (int)sizeof(short))
 		return 0;
 
 	if (n > 0) {
-		off = PBLKSIZ;
+		off = pblksiz;
 		for (ino++; n > 0; ino += 2) {
 			if (ino[0] < 0 || ino[0] > off ||
 			    ino[1] < 0 || ino[1] > off ||
@@ -23,18 +23,20 @@
 #define duppair apu__sdbm_duppair
 #define fitpair apu__sdbm_fitpair
 #define getnkey apu__sdbm_getnkey
+#define getnval apu__sdbm_getnval
 #define getpair apu__sdbm_getpair
 #define putpair apu__sdbm_putpair
 #define splpage apu__sdbm_splpage
 
-int fitpair(char *, int);
-void  putpair(char *, apr_sdbm_datum_t, apr_sdbm_datum_t);
-apr_sdbm_datum_t getpair(char *, apr_sdbm_datum_t);
-int  delpair(char *, apr_sdbm_datum_t);
-int  chkpage (char *);
-apr_sdbm_datum_t getnkey(char *, int);
-void splpage(char *, char *, long);
-int duppair(char *, apr_sdbm_datum_t);
+int fitpair(char *, int, int);
+void  putpair(char *, apr_sdbm_datum_t, apr_sdbm_datum_t, int);
+apr_sdbm_datum_t getpair(char *, apr_sdbm_datum_t, int);
+int  delpair(char *, apr_sdbm_datum_t, int);
+int  chkpage (char *, int);
+apr_sdbm_datum_t getnkey(char *, int, int);
+apr_sdbm_datum_t getnval(char *, int);
+void splpage(char *, char *, long, char *, int);
+int duppair(char *, apr_sdbm_datum_t, int);
 
 #endif /* SDBM_PAIR_H */
 
@@ -26,6 +26,9 @@
 #include "apr.h"
 #include "apr_pools.h"
 #include "apr_file_io.h"
+#include "apr_mmap.h"
+#include "apr_hash.h"
+#include "apr_ring.h"
 #include "apr_errno.h" /* for apr_status_t */
 
 #if 0
@@ -40,11 +43,46 @@
 #endif
 #define SPLTMAX	10			/* maximum allowed splits */
 
+/*
+ * the databases created with a page size (apr_sdbm_open_ex) start their
+ * dirfile with a header giving it, and have an overflow file for the
+ * large values. apart from that header, the directory is the same.
+ */
+#define SDBM_HDRSIZ	16		/* dirfile header size */
+#define SDBM_MAGIC	"SDBM"		/* can't start a dirfile bitmap */
+#define SDBM_VERSION	1
+#define SDBM_MINPBLK	1024
+#define SDBM_MAXPBLK	16384		/* for the short offsets */
+#define SDBM_PAIRMAX(pblksiz)	((pblksiz) - (PBLKSIZ - PAIRMAX))
+
+#define SDBM_MAXCACHE	65536		/* maximum cached blocks */
+
+/*
+ * LRU cache of the blocks of a file, most recent first, indexed by
+ * block numbers. the dirty blocks are written back on apr_sdbm_unlock.
+ */
+typedef struct sdbm_block_t sdbm_block_t;
+
+typedef struct sdbm_cache_t {
+    APR_RING_HEAD(sdbm_blocks_t, sdbm_block_t) lru;
+    apr_hash_t *index;
+    apr_file_t *f;			/* file of the blocks */
+    apr_off_t base;			/* offset of block 0 */
+    int blksiz;
+    int nblocks;
+    int maxblocks;			/* 0 when disabled */
+    int ndirty;
+    apr_size_t hits;
+    apr_size_t misses;
+} sdbm_cache_t;
+
 /* for apr_sdbm_t.flags */
 #define SDBM_RDONLY	        0x1    /* data base open read-only */
 #define SDBM_SHARED	        0x2    /* data base open for sharing */
 #define SDBM_SHARED_LOCK	0x4    /* data base locked for shared read */
 #define SDBM_EXCLUSIVE_LOCK	0x8    /* data base locked for write */
+#define SDBM_MAPPED	        0x10   /* data base read from its mappings */
+#define SDBM_OVERFLOW	        0x20   /* data base with a header, tagged values */
 
 struct apr_sdbm_t {
     apr_pool_t *pool;
@@ -58,27 +96,58 @@ struct apr_sdbm_t {
     int  keyptr;		       /* current key for nextkey */
     long blkno;			       /* current page to read/write */
     long pagbno;		       /* current page in pagbuf */
-    char pagbuf[PBLKSIZ];	       /* page file block buffer */
+    char *pagbuf;		       /* page file block buffer */
     long dirbno;		       /* current block in dirbuf */
     char dirbuf[DBLKSIZ];	       /* directory file block buffer */
     int  lckcnt;                       /* number of calls to sdbm_lock */
+    int  pblksiz;		       /* page size */
+    int  dirhdr;		       /* dirfile header size, 0 if none */
+    char *twinbuf;		       /* split page buffer */
+    char *splbuf;		       /* splpage() scratch buffer */
+    char *valbuf;		       /* tagged value buffer */
+    apr_file_t *ovff;		       /* overflow file descriptor, if any */
+    char *ovfbuf;		       /* overflow values read buffer */
+    apr_size_t ovfbufsiz;
+    sdbm_cache_t pagcache;	       /* page blocks cache */
+    sdbm_cache_t dircache;	       /* directory blocks cache */
+#if APR_HAS_MMAP
+    apr_mmap_t *dirmm;		       /* directory file mapping, if any */
+    apr_mmap_t *pagmm;		       /* page file mapping, if any */
+    apr_mmap_t *ovfmm;		       /* overflow file mapping, if any */
+#endif
 };
 
 
 #define sdbm_hash apu__sdbm_hash
 #define sdbm_nullitem apu__sdbm_nullitem
+#define sdbm_cache_get apu__sdbm_cache_get
+#define sdbm_cache_put apu__sdbm_cache_put
+#define sdbm_cache_flush apu__sdbm_cache_flush
+#define sdbm_cache_clear apu__sdbm_cache_clear
+#define sdbm_cache_resize apu__sdbm_cache_resize
 
 extern const apr_sdbm_datum_t sdbm_nullitem;
 
 long sdbm_hash(const char *str, int len);
 
+/* sdbm_cache.c */
+int sdbm_cache_get(sdbm_cache_t *c, long blkno, char *buf);
+apr_status_t sdbm_cache_put(sdbm_cache_t *c, long blkno, const char *buf,
+                            int dirty);
+apr_status_t sdbm_cache_flush(sdbm_cache_t *c);
+void sdbm_cache_clear(sdbm_cache_t *c);
+apr_status_t sdbm_cache_resize(sdbm_cache_t *c, int maxblocks,
+                               apr_file_t *f, apr_off_t base, int blksiz,
+                               apr_pool_t *p);
+
 /*
  * zero the cache
  */
 #define SDBM_INVALIDATE_CACHE(db, finfo) \
-    do { db->dirbno = (!finfo.size) ? 0 : -1; \
+    do { db->dirbno = (finfo.size <= db->dirhdr) ? 0 : -1; \
          db->pagbno = -1; \
-         db->maxbno = (long)(finfo.size * BYTESIZ); \
+         db->maxbno = (finfo.size <= db->dirhdr) ? 0 \
+                    : (long)((finfo.size - db->dirhdr) * BYTESIZ); \
     } while (0);
 
 #endif /* SDBM_PRIVATE_H */
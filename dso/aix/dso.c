@@ -146,6 +146,15 @@ APR_DECLARE(apr_status_t) apr_dso_load(apr_dso_handle_t **res_handle,
     return APR_SUCCESS;
 }
 
+APR_DECLARE(apr_status_t) apr_dso_load_ex(apr_dso_handle_t **res_handle,
+                                          const char *path,
+                                          apr_int32_t flags,
+                                          apr_pool_t *ctx)
+{
+    /* No binding options here */
+    return apr_dso_load(res_handle, path, ctx);
+}
+
 APR_DECLARE(apr_status_t) apr_dso_unload(apr_dso_handle_t *handle)
 {
     return apr_pool_cleanup_run(handle->pool, handle, dso_cleanup);
@@ -79,9 +79,19 @@ static apr_status_t dso_cleanup(void *thedso)
 
 APR_DECLARE(apr_status_t) apr_dso_load(apr_dso_handle_t **res_handle,
                                        const char *path, apr_pool_t *pool)
+{
+    return apr_dso_load_ex(res_handle, path, 0, pool);
+}
+
+APR_DECLARE(apr_status_t) apr_dso_load_ex(apr_dso_handle_t **res_handle,
+                                          const char *path,
+                                          apr_int32_t flags,
+                                          apr_pool_t *pool)
 {
 #if defined(DSO_USE_SHL)
-    shl_t os_handle = shl_load(path, BIND_IMMEDIATE, 0L);
+    shl_t os_handle = shl_load(path, (flags & APR_DSO_LAZY) ? BIND_DEFERRED
+                                                            : BIND_IMMEDIATE,
+                               0L);
 
 #elif defined(DSO_USE_DYLD)
     NSObjectFileImage image;
@@ -120,10 +130,14 @@ APR_DECLARE(apr_status_t) apr_dso_load(apr_dso_handle_t **res_handle,
 #if defined(OSF1) || defined(SEQUENT) || defined(SNI) ||\
     (defined(__FreeBSD_version) && (__FreeBSD_version >= 220000)) ||\
     defined(__DragonFly__)
-    void *os_handle = dlopen((char *)path, RTLD_NOW | RTLD_GLOBAL);
+    void *os_handle = dlopen((char *)path,
+                             ((flags & APR_DSO_LAZY) ? RTLD_LAZY : RTLD_NOW)
+                             | ((flags & APR_DSO_LOCAL) ? RTLD_LOCAL
+                                                        : RTLD_GLOBAL));
 
 #else
-    int flags = RTLD_NOW | RTLD_GLOBAL;
+    int dlflags = ((flags & APR_DSO_LAZY) ? RTLD_LAZY : RTLD_NOW)
+                  | ((flags & APR_DSO_LOCAL) ? RTLD_LOCAL : RTLD_GLOBAL);
     void *os_handle;
 #ifdef _AIX
     if (strchr(path + 1, '(') && path[strlen(path) - 1] == ')')
@@ -133,10 +147,10 @@ APR_DECLARE(apr_status_t) apr_dso_load(apr_dso_handle_t **res_handle,
          * dlopen() support for such a library requires that the
          * RTLD_MEMBER flag be enabled.
          */
-        flags |= RTLD_MEMBER;
+        dlflags |= RTLD_MEMBER;
     }
 #endif
-    os_handle = dlopen(path, flags);
+    os_handle = dlopen(path, dlflags);
 #endif
 #endif /* DSO_USE_x */
 
@@ -208,6 +208,351 @@ static const char base32hex[] =
 static const char base16[] = "0123456789ABCDEF";
 static const char base16lower[] = "0123456789abcdef";
 
+/* The bulk of the base64 and base16 conversions runs on the vectors of
+ * apr_encode_private.h.  Only whole blocks of valid characters are
+ * converted this way, the tails, the padding, the separators and the
+ * errors are left to the loops below, so that the results are the same.
+ */
+#if defined(ENCODE_SSSE3)
+
+/* 12 bytes to 16 characters at a time, reading 16 bytes */
+ENCODE_SIMD_TARGET
+static apr_size_t encode_base64_simd(char *dest, const unsigned char *src,
+                                     apr_size_t count, int url)
+{
+    const __m128i shuf = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4,
+                                       7, 6, 8, 7, 10, 9, 11, 10);
+    /* offsets from the 6 bits to the characters, by range */
+    const __m128i offs = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52,
+                                       '0' - 52, '0' - 52, '0' - 52,
+                                       '0' - 52, '0' - 52, '0' - 52,
+                                       '0' - 52, '0' - 52,
+                                       url ? '-' - 62 : '+' - 62,
+                                       url ? '_' - 63 : '/' - 63,
+                                       'A', 0, 0);
+    apr_size_t i;
+
+    for (i = 0; i + 16 <= count; i += 12, dest += 16) {
+        __m128i in = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i six, range;
+
+        in = _mm_shuffle_epi8(in, shuf);
+        six = _mm_or_si128(
+                _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)),
+                                _mm_set1_epi32(0x04000040)),
+                _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)),
+                                _mm_set1_epi32(0x01000010)));
+
+        range = _mm_subs_epu8(six, _mm_set1_epi8(51));
+        range = _mm_or_si128(range,
+                             _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26),
+                                                          six),
+                                           _mm_set1_epi8(13)));
+        _mm_storeu_si128((__m128i *)dest,
+                         _mm_add_epi8(six, _mm_shuffle_epi8(offs, range)));
+    }
+    return i;
+}
+
+ENCODE_SIMD_TARGET
+static APR_INLINE __m128i in_range(__m128i c, char lo, char hi)
+{
+    return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(lo - 1)),
+                         _mm_cmplt_epi8(c, _mm_set1_epi8(hi + 1)));
+}
+
+/* 16 characters to 12 bytes at a time, or only their validation without
+ * a dest, as long as they are of either alphabet like with pr2six.
+ */
+ENCODE_SIMD_TARGET
+static apr_size_t decode_base64_simd(unsigned char *dest,
+                                     const unsigned char *src,
+                                     apr_size_t count)
+{
+    const __m128i shuf = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9,
+                                       8, 14, 13, 12, -1, -1, -1, -1);
+    apr_size_t i;
+
+    for (i = 0; i + 16 <= count; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i upper = in_range(c, 'A', 'Z');
+        __m128i lower = in_range(c, 'a', 'z');
+        __m128i digit = in_range(c, '0', '9');
+        __m128i s62 = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('+')),
+                                   _mm_cmpeq_epi8(c, _mm_set1_epi8('-')));
+        __m128i s63 = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('/')),
+                                   _mm_cmpeq_epi8(c, _mm_set1_epi8('_')));
+        __m128i six;
+        int tail;
+
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(upper, lower),
+                                           _mm_or_si128(digit,
+                                                        _mm_or_si128(s62,
+                                                                     s63))))
+            != 0xffff) {
+            break;
+        }
+        if (!dest) {
+            continue;
+        }
+
+        six = _mm_and_si128(upper, _mm_sub_epi8(c, _mm_set1_epi8('A')));
+        six = _mm_or_si128(six, _mm_and_si128(lower,
+                                    _mm_sub_epi8(c, _mm_set1_epi8('a' - 26))));
+        six = _mm_or_si128(six, _mm_and_si128(digit,
+                                    _mm_add_epi8(c, _mm_set1_epi8(52 - '0'))));
+        six = _mm_or_si128(six, _mm_and_si128(s62, _mm_set1_epi8(62)));
+        six = _mm_or_si128(six, _mm_and_si128(s63, _mm_set1_epi8(63)));
+
+        /* merge the 6 bits in pairs, then the pairs in 24 bits */
+        six = _mm_maddubs_epi16(six, _mm_set1_epi32(0x01400140));
+        six = _mm_madd_epi16(six, _mm_set1_epi32(0x00011000));
+        six = _mm_shuffle_epi8(six, shuf);
+
+        /* no more than the 12 bytes, dest being sized exactly */
+        _mm_storel_epi64((__m128i *)dest, six);
+        tail = _mm_cvtsi128_si32(_mm_srli_si128(six, 8));
+        memcpy(dest + 8, &tail, 4);
+        dest += 12;
+    }
+    return i;
+}
+
+/* 16 bytes to 32 characters at a time */
+ENCODE_SIMD_TARGET
+static apr_size_t encode_base16_simd(char *dest, const unsigned char *src,
+                                     apr_size_t count, const char *base)
+{
+    const __m128i digits = _mm_loadu_si128((const __m128i *)base);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    apr_size_t i;
+
+    for (i = 0; i + 16 <= count; i += 16, dest += 32) {
+        __m128i in = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i hi, lo;
+
+        hi = _mm_shuffle_epi8(digits,
+                              _mm_and_si128(_mm_srli_epi16(in, 4), nibble));
+        lo = _mm_shuffle_epi8(digits, _mm_and_si128(in, nibble));
+        _mm_storeu_si128((__m128i *)dest, _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i *)(dest + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+    return i;
+}
+
+ENCODE_SIMD_TARGET
+static APR_INLINE int decode_hex_simd(__m128i c, __m128i *hex)
+{
+    __m128i digit = in_range(c, '0', '9');
+    __m128i upper = in_range(c, 'A', 'F');
+    __m128i lower = in_range(c, 'a', 'f');
+
+    *hex = _mm_or_si128(
+             _mm_and_si128(digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+             _mm_or_si128(
+               _mm_and_si128(upper, _mm_sub_epi8(c, _mm_set1_epi8('A' - 10))),
+               _mm_and_si128(lower, _mm_sub_epi8(c, _mm_set1_epi8('a' - 10)))));
+    return _mm_movemask_epi8(_mm_or_si128(digit, _mm_or_si128(upper, lower)))
+           == 0xffff;
+}
+
+/* 32 characters to 16 bytes at a time, or only their validation without
+ * a dest.
+ */
+ENCODE_SIMD_TARGET
+static apr_size_t decode_base16_simd(unsigned char *dest,
+                                     const unsigned char *src,
+                                     apr_size_t count)
+{
+    const __m128i low = _mm_set1_epi16(0x00ff);
+    apr_size_t i;
+
+    for (i = 0; i + 32 <= count; i += 32) {
+        __m128i a, b;
+
+        if (!decode_hex_simd(_mm_loadu_si128((const __m128i *)(src + i)),
+                             &a)
+            || !decode_hex_simd(_mm_loadu_si128((const __m128i *)(src + i
+                                                                  + 16)),
+                                &b)) {
+            break;
+        }
+        if (!dest) {
+            continue;
+        }
+
+        /* the first character of each pair is the high nibble */
+        a = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(a, low), 4),
+                         _mm_srli_epi16(a, 8));
+        b = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(b, low), 4),
+                         _mm_srli_epi16(b, 8));
+        _mm_storeu_si128((__m128i *)dest, _mm_packus_epi16(a, b));
+        dest += 16;
+    }
+    return i;
+}
+
+#elif defined(ENCODE_NEON)
+
+static APR_INLINE uint8x16_t in_range(uint8x16_t c, unsigned char lo,
+                                      unsigned char hi)
+{
+    return vandq_u8(vcgeq_u8(c, vdupq_n_u8(lo)), vcleq_u8(c, vdupq_n_u8(hi)));
+}
+
+/* 48 bytes to 64 characters at a time */
+static apr_size_t encode_base64_simd(char *dest, const unsigned char *src,
+                                     apr_size_t count, int url)
+{
+    const char *base = url ? base64url : base64;
+    const uint8x16_t mask = vdupq_n_u8(0x3f);
+    uint8x16x4_t alphabet;
+    apr_size_t i;
+
+    alphabet.val[0] = vld1q_u8((const uint8_t *)base);
+    alphabet.val[1] = vld1q_u8((const uint8_t *)base + 16);
+    alphabet.val[2] = vld1q_u8((const uint8_t *)base + 32);
+    alphabet.val[3] = vld1q_u8((const uint8_t *)base + 48);
+
+    for (i = 0; i + 48 <= count; i += 48, dest += 64) {
+        uint8x16x3_t in = vld3q_u8(src + i);
+        uint8x16x4_t out;
+
+        out.val[0] = vshrq_n_u8(in.val[0], 2);
+        out.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4),
+                                       vshrq_n_u8(in.val[1], 4)), mask);
+        out.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2),
+                                       vshrq_n_u8(in.val[2], 6)), mask);
+        out.val[3] = vandq_u8(in.val[2], mask);
+
+        out.val[0] = vqtbl4q_u8(alphabet, out.val[0]);
+        out.val[1] = vqtbl4q_u8(alphabet, out.val[1]);
+        out.val[2] = vqtbl4q_u8(alphabet, out.val[2]);
+        out.val[3] = vqtbl4q_u8(alphabet, out.val[3]);
+        vst4q_u8((uint8_t *)dest, out);
+    }
+    return i;
+}
+
+static APR_INLINE uint8x16_t decode_six_simd(uint8x16_t c, uint8x16_t *valid)
+{
+    uint8x16_t upper = in_range(c, 'A', 'Z');
+    uint8x16_t lower = in_range(c, 'a', 'z');
+    uint8x16_t digit = in_range(c, '0', '9');
+    uint8x16_t s62 = vorrq_u8(vceqq_u8(c, vdupq_n_u8('+')),
+                              vceqq_u8(c, vdupq_n_u8('-')));
+    uint8x16_t s63 = vorrq_u8(vceqq_u8(c, vdupq_n_u8('/')),
+                              vceqq_u8(c, vdupq_n_u8('_')));
+    uint8x16_t six;
+
+    *valid = vandq_u8(*valid, vorrq_u8(vorrq_u8(upper, lower),
+                                       vorrq_u8(digit, vorrq_u8(s62, s63))));
+
+    six = vandq_u8(upper, vsubq_u8(c, vdupq_n_u8('A')));
+    six = vorrq_u8(six, vandq_u8(lower, vsubq_u8(c, vdupq_n_u8('a' - 26))));
+    six = vorrq_u8(six, vandq_u8(digit, vaddq_u8(c, vdupq_n_u8(52 - '0'))));
+    six = vorrq_u8(six, vandq_u8(s62, vdupq_n_u8(62)));
+    return vorrq_u8(six, vandq_u8(s63, vdupq_n_u8(63)));
+}
+
+/* 64 characters to 48 bytes at a time, or only their validation without
+ * a dest, as long as they are of either alphabet like with pr2six.
+ */
+static apr_size_t decode_base64_simd(unsigned char *dest,
+                                     const unsigned char *src,
+                                     apr_size_t count)
+{
+    apr_size_t i;
+
+    for (i = 0; i + 64 <= count; i += 64) {
+        uint8x16x4_t in = vld4q_u8(src + i);
+        uint8x16_t valid = vdupq_n_u8(0xff);
+        uint8x16x3_t out;
+
+        in.val[0] = decode_six_simd(in.val[0], &valid);
+        in.val[1] = decode_six_simd(in.val[1], &valid);
+        in.val[2] = decode_six_simd(in.val[2], &valid);
+        in.val[3] = decode_six_simd(in.val[3], &valid);
+        if (vminvq_u8(valid) != 0xff) {
+            break;
+        }
+        if (!dest) {
+            continue;
+        }
+
+        out.val[0] = vorrq_u8(vshlq_n_u8(in.val[0], 2),
+                              vshrq_n_u8(in.val[1], 4));
+        out.val[1] = vorrq_u8(vshlq_n_u8(in.val[1], 4),
+                              vshrq_n_u8(in.val[2], 2));
+        out.val[2] = vorrq_u8(vshlq_n_u8(in.val[2], 6), in.val[3]);
+        vst3q_u8(dest, out);
+        dest += 48;
+    }
+    return i;
+}
+
+/* 16 bytes to 32 characters at a time */
+static apr_size_t encode_base16_simd(char *dest, const unsigned char *src,
+                                     apr_size_t count, const char *base)
+{
+    const uint8x16_t digits = vld1q_u8((const uint8_t *)base);
+    apr_size_t i;
+
+    for (i = 0; i + 16 <= count; i += 16, dest += 32) {
+        uint8x16_t in = vld1q_u8(src + i);
+        uint8x16x2_t out;
+
+        out.val[0] = vqtbl1q_u8(digits, vshrq_n_u8(in, 4));
+        out.val[1] = vqtbl1q_u8(digits, vandq_u8(in, vdupq_n_u8(0x0f)));
+        vst2q_u8((uint8_t *)dest, out);
+    }
+    return i;
+}
+
+static APR_INLINE uint8x16_t decode_hex_simd(uint8x16_t c, uint8x16_t *valid)
+{
+    uint8x16_t digit = in_range(c, '0', '9');
+    uint8x16_t upper = in_range(c, 'A', 'F');
+    uint8x16_t lower = in_range(c, 'a', 'f');
+
+    *valid = vandq_u8(*valid, vorrq_u8(digit, vorrq_u8(upper, lower)));
+    return vorrq_u8(vandq_u8(digit, vsubq_u8(c, vdupq_n_u8('0'))),
+                    vorrq_u8(vandq_u8(upper,
+                                      vsubq_u8(c, vdupq_n_u8('A' - 10))),
+                             vandq_u8(lower,
+                                      vsubq_u8(c, vdupq_n_u8('a' - 10)))));
+}
+
+/* 32 characters to 16 bytes at a time, or only their validation without
+ * a dest.
+ */
+static apr_size_t decode_base16_simd(unsigned char *dest,
+                                     const unsigned char *src,
+                                     apr_size_t count)
+{
+    apr_size_t i;
+
+    for (i = 0; i + 32 <= count; i += 32) {
+        uint8x16x2_t in = vld2q_u8(src + i);
+        uint8x16_t valid = vdupq_n_u8(0xff);
+
+        in.val[0] = decode_hex_simd(in.val[0], &valid);
+        in.val[1] = decode_hex_simd(in.val[1], &valid);
+        if (vminvq_u8(valid) != 0xff) {
+            break;
+        }
+        if (!dest) {
+            continue;
+        }
+
+        vst1q_u8(dest, vorrq_u8(vshlq_n_u8(in.val[0], 4), in.val[1]));
+        dest += 16;
+    }
+    return i;
+}
+
+#endif /* ENCODE_NEON */
+
 APR_DECLARE(apr_status_t) apr_encode_base64(char *dest, const char *src,
                               apr_ssize_t slen, int flags, apr_size_t * len)
 {
@@ -234,6 +579,13 @@ APR_DECLARE(apr_status_t) apr_encode_base64(char *dest, const char *src,
         }
 
         if (count > 2) {
+#ifdef HAVE_ENCODE_SIMD
+            if (HAVE_ENCODE_SIMD()) {
+                i = encode_base64_simd(bufout, (const unsigned char *)src,
+                                       count, flags & APR_ENCODE_BASE64URL);
+                bufout += i / 3u * 4u;
+            }
+#endif
             for (; i < count - 2; i += 3) {
                 *bufout++ = base[(TO_ASCII(src[i]) >> 2) & 0x3F];
                 *bufout++ = base[((TO_ASCII(src[i]) & 0x3) << 4 |
@@ -300,6 +652,13 @@ APR_DECLARE(apr_status_t) apr_encode_base64_binary(char *dest, const unsigned ch
         }
 
         if (count > 2) {
+#ifdef HAVE_ENCODE_SIMD
+            if (HAVE_ENCODE_SIMD()) {
+                i = encode_base64_simd(bufout, src, count,
+                                       flags & APR_ENCODE_BASE64URL);
+                bufout += i / 3u * 4u;
+            }
+#endif
             for (; i < count - 2; i += 3) {
                 *bufout++ = base[(src[i] >> 2) & 0x3F];
                 *bufout++ = base[((src[i] & 0x3) << 4 |
@@ -408,8 +767,17 @@ APR_DECLARE(apr_status_t) apr_decode_base64(char *dest, const char *src,
 
     if (src) {
         const unsigned char *bufin;
+        apr_size_t done = 0;
 
         bufin = (const unsigned char *)src;
+#ifdef HAVE_ENCODE_SIMD
+        if (HAVE_ENCODE_SIMD()) {
+            /* converted right away, the same as below */
+            done = decode_base64_simd((unsigned char *)dest, bufin, count);
+            bufin += done;
+            count -= done;
+        }
+#endif
         while (count) {
             if (pr2six[*bufin] >= 64) {
                 if (!(flags & APR_ENCODE_RELAXED)) {
@@ -433,8 +801,9 @@ APR_DECLARE(apr_status_t) apr_decode_base64(char *dest, const char *src,
         if (dest) {
             unsigned char *bufout;
 
-            bufout = (unsigned char *)dest;
-            bufin = (const unsigned char *)src;
+            bufout = (unsigned char *)dest + done / 4u * 3u;
+            bufin = (const unsigned char *)src + done;
+            count -= done;
 
             while (count >= 4) {
                 *(bufout++) = TO_NATIVE(pr2six[bufin[0]] << 2 |
@@ -500,8 +869,17 @@ APR_DECLARE(apr_status_t) apr_decode_base64_binary(unsigned char *dest,
 
     if (src) {
         const unsigned char *bufin;
+        apr_size_t done = 0;
 
         bufin = (const unsigned char *)src;
+#ifdef HAVE_ENCODE_SIMD
+        if (HAVE_ENCODE_SIMD()) {
+            /* converted right away, the same as below */
+            done = decode_base64_simd((unsigned char *)dest, bufin, count);
+            bufin += done;
+            count -= done;
+        }
+#endif
         while (count) {
             if (pr2six[*bufin] >= 64) {
                 if (!(flags & APR_ENCODE_RELAXED)) {
@@ -525,8 +903,9 @@ APR_DECLARE(apr_status_t) apr_decode_base64_binary(unsigned char *dest,
         if (dest) {
             unsigned char *bufout;
 
-            bufout = (unsigned char *)dest;
-            bufin = (const unsigned char *)src;
+            bufout = (unsigned char *)dest + done / 4u * 3u;
+            bufin = (const unsigned char *)src + done;
+            count -= done;
 
             while (count >= 4) {
                 *(bufout++) = (pr2six[bufin[0]] << 2 |
@@ -1235,7 +1614,15 @@ APR_DECLARE(apr_status_t) apr_encode_base16(char *dest,
             base = base16;
         }
 
-        for (i = 0; i < count; i++) {
+        i = 0;
+#ifdef HAVE_ENCODE_SIMD
+        if (!(flags & APR_ENCODE_COLON) && HAVE_ENCODE_SIMD()) {
+            i = encode_base16_simd(bufout, (const unsigned char *)src, count,
+                                   base);
+            bufout += i * 2u;
+        }
+#endif
+        for (; i < count; i++) {
             if ((flags & APR_ENCODE_COLON) && i) {
                 *(bufout++) = ':';
             }
@@ -1288,7 +1675,15 @@ APR_DECLARE(apr_status_t) apr_encode_base16_binary(char *dest,
             base = base16;
         }
 
-        for (i = 0; i < count; i++) {
+        i = 0;
+#ifdef HAVE_ENCODE_SIMD
+        if (!(flags & APR_ENCODE_COLON) && HAVE_ENCODE_SIMD()) {
+            i = encode_base16_simd(bufout, (const unsigned char *)src, count,
+                                   base);
+            bufout += i * 2u;
+        }
+#endif
+        for (; i < count; i++) {
             if ((flags & APR_ENCODE_COLON) && i) {
                 *(bufout++) = ':';
             }
@@ -1385,8 +1780,17 @@ APR_DECLARE(apr_status_t) apr_decode_base16(char *dest,
 
     if (src) {
         const unsigned char *bufin;
+        apr_size_t done = 0;
 
         bufin = (const unsigned char *)src;
+#ifdef HAVE_ENCODE_SIMD
+        if (!(flags & APR_ENCODE_COLON) && HAVE_ENCODE_SIMD()) {
+            /* converted right away, the same as below */
+            done = decode_base16_simd((unsigned char *)dest, bufin, count);
+            bufin += done;
+            count -= done;
+        }
+#endif
         while (count) {
             if (pr2two[*bufin] >= 16
                 && (!(flags & APR_ENCODE_COLON)
@@ -1404,8 +1808,9 @@ APR_DECLARE(apr_status_t) apr_decode_base16(char *dest,
         if (dest) {
             unsigned char *bufout;
 
-            bufout = (unsigned char *)dest;
-            bufin = (const unsigned char *)src;
+            bufout = (unsigned char *)dest + done / 2u;
+            bufin = (const unsigned char *)src + done;
+            count -= done;
 
             while (count >= 2) {
                 if (pr2two[bufin[0]] == 32 /* ':' */) {
@@ -1463,8 +1868,17 @@ APR_DECLARE(apr_status_t) apr_decode_base16_binary(unsigned char *dest,
 
     if (src) {
         const unsigned char *bufin;
+        apr_size_t done = 0;
 
         bufin = (const unsigned char *)src;
+#ifdef HAVE_ENCODE_SIMD
+        if (!(flags & APR_ENCODE_COLON) && HAVE_ENCODE_SIMD()) {
+            /* converted right away, the same as below */
+            done = decode_base16_simd((unsigned char *)dest, bufin, count);
+            bufin += done;
+            count -= done;
+        }
+#endif
         while (count) {
             if (pr2two[*bufin] >= 16
                 && (!(flags & APR_ENCODE_COLON)
@@ -1482,8 +1896,9 @@ APR_DECLARE(apr_status_t) apr_decode_base16_binary(unsigned char *dest,
         if (dest) {
             unsigned char *bufout;
 
-            bufout = (unsigned char *)dest;
-            bufin = (const unsigned char *)src;
+            bufout = (unsigned char *)dest + done / 2u;
+            bufin = (const unsigned char *)src + done;
+            count -= done;
 
             while (count >= 2) {
                 if (pr2two[bufin[0]] == 32 /* ':' */) {
@@ -1575,3 +1990,291 @@ APR_DECLARE(const unsigned char *)apr_pdecode_base16_binary(apr_pool_t * p,
 
     return NULL;
 }
+
+/* The groups of the codecs, converted a whole number of them at a time */
+static const struct {
+    apr_size_t bytes;
+    apr_size_t chars;
+    apr_status_t (*encode)(char *dest, const unsigned char *src,
+                           apr_ssize_t slen, int flags, apr_size_t *len);
+    apr_status_t (*decode)(unsigned char *dest, const char *src,
+                           apr_ssize_t slen, int flags, apr_size_t *len);
+} stream_codecs[] = {
+    { 3, 4, apr_encode_base64_binary, apr_decode_base64_binary },
+    { 5, 8, apr_encode_base32_binary, apr_decode_base32_binary },
+    { 1, 2, apr_encode_base16_binary, apr_decode_base16_binary }
+};
+
+#define STREAM_CODEC(st) (&stream_codecs[(st)->codec])
+#define STREAM_COLON(st) ((st)->codec == APR_ENCODE_CODEC_BASE16 \
+                          && ((st)->flags & APR_ENCODE_COLON))
+
+static apr_status_t stream_init(apr_encode_stream_t *st,
+                                apr_encode_codec_e codec, int flags,
+                                int decode)
+{
+    if ((unsigned int)codec >= sizeof(stream_codecs) / sizeof(stream_codecs[0])) {
+        return APR_EINVAL;
+    }
+
+    memset(st, 0, sizeof(*st));
+    st->codec = codec;
+    st->flags = flags;
+    st->decode = decode;
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_encode_stream_init(apr_encode_stream_t *st,
+        apr_encode_codec_e codec, int flags)
+{
+    return stream_init(st, codec, flags, 0);
+}
+
+APR_DECLARE(apr_status_t) apr_decode_stream_init(apr_encode_stream_t *st,
+        apr_encode_codec_e codec, int flags)
+{
+    return stream_init(st, codec, flags, 1);
+}
+
+/* Encode whole groups, writing no NUL after them: the encoders terminate
+ * their output, so the last group goes through a buffer of its own.
+ */
+static apr_size_t stream_encode_groups(apr_encode_stream_t *st, char *dest,
+                                       const unsigned char *src,
+                                       apr_size_t slen)
+{
+    const apr_size_t bytes = STREAM_CODEC(st)->bytes;
+    const apr_size_t lead = slen - bytes;
+    char last[16], *out = dest;
+    apr_size_t n;
+
+    if (STREAM_COLON(st) && st->count) {
+        *out++ = ':';
+    }
+    if (lead) {
+        STREAM_CODEC(st)->encode(out, src, lead, st->flags, &n);
+        out += n;
+        if (STREAM_COLON(st)) {
+            *out++ = ':';
+        }
+    }
+    STREAM_CODEC(st)->encode(last, src + lead, bytes, st->flags, &n);
+    memcpy(out, last, n);
+    out += n;
+
+    st->count += slen;
+    return out - dest;
+}
+
+static apr_size_t stream_encode(apr_encode_stream_t *st, char *dest,
+                                const unsigned char *src, apr_size_t slen)
+{
+    const apr_size_t bytes = STREAM_CODEC(st)->bytes;
+    apr_size_t out = 0, n;
+
+    if (st->nheld) {
+        n = bytes - st->nheld;
+        if (n > slen) {
+            n = slen;
+        }
+        memcpy(st->held + st->nheld, src, n);
+        st->nheld += n;
+        src += n;
+        slen -= n;
+        if (st->nheld < bytes) {
+            return 0;
+        }
+        out = stream_encode_groups(st, dest, st->held, bytes);
+        st->nheld = 0;
+    }
+
+    n = slen - slen % bytes;
+    if (n) {
+        out += stream_encode_groups(st, dest + out, src, n);
+    }
+    memcpy(st->held, src + n, slen - n);
+    st->nheld = slen - n;
+
+    return out;
+}
+
+/* Decode whole groups, noting where the decoding stopped short */
+static apr_status_t stream_decode_groups(apr_encode_stream_t *st,
+                                         unsigned char *dest,
+                                         const char *src, apr_size_t slen,
+                                         apr_size_t *len)
+{
+    apr_status_t rv;
+
+    rv = STREAM_CODEC(st)->decode(dest, src, slen, st->flags, len);
+    if (rv != APR_SUCCESS) {
+        st->status = rv;
+    }
+    else if (*len < slen / STREAM_CODEC(st)->chars * STREAM_CODEC(st)->bytes) {
+        /* the padding, or an invalid character when relaxed */
+        st->done = 1;
+    }
+    return rv;
+}
+
+/* Nothing may follow the end of the decoding, unless relaxed */
+static apr_status_t stream_decode_rest(apr_encode_stream_t *st,
+                                       apr_size_t rest)
+{
+    if (rest && !(st->flags & APR_ENCODE_RELAXED)) {
+        st->status = APR_BADCH;
+    }
+    return st->status;
+}
+
+static apr_status_t stream_decode(apr_encode_stream_t *st,
+                                  unsigned char *dest, const char *src,
+                                  apr_size_t slen, apr_size_t *len)
+{
+    const apr_size_t chars = STREAM_CODEC(st)->chars;
+    apr_size_t out = 0, n;
+    apr_status_t rv = APR_SUCCESS;
+
+    if (st->nheld) {
+        n = chars - st->nheld;
+        if (n > slen) {
+            n = slen;
+        }
+        memcpy(st->held + st->nheld, src, n);
+        st->nheld += n;
+        src += n;
+        slen -= n;
+        if (st->nheld < chars) {
+            *len = 0;
+            return APR_SUCCESS;
+        }
+        st->nheld = 0;
+        rv = stream_decode_groups(st, dest, (const char *)st->held, chars,
+                                  &out);
+        if (rv != APR_SUCCESS || st->done) {
+            *len = out;
+            return rv != APR_SUCCESS ? rv : stream_decode_rest(st, slen);
+        }
+    }
+
+    n = slen - slen % chars;
+    if (n) {
+        apr_size_t l;
+
+        rv = stream_decode_groups(st, dest + out, src, n, &l);
+        out += l;
+        if (rv != APR_SUCCESS || st->done) {
+            *len = out;
+            return rv != APR_SUCCESS ? rv : stream_decode_rest(st, slen - n);
+        }
+    }
+    memcpy(st->held, src + n, slen - n);
+    st->nheld = slen - n;
+
+    *len = out;
+    return APR_SUCCESS;
+}
+
+/* The colons may separate the pairs, one at the end being incomplete like
+ * with apr_decode_base16_binary(): a colon is held until the next pair.
+ */
+static apr_status_t stream_decode_colon(apr_encode_stream_t *st,
+                                        unsigned char *dest,
+                                        const unsigned char *src,
+                                        apr_size_t slen, apr_size_t *len)
+{
+    unsigned char *out = dest;
+    apr_size_t i;
+
+    for (i = 0; i < slen; i++) {
+        if (pr2two[src[i]] >= 16 && pr2two[src[i]] != 32 /* ':' */) {
+            st->done = 1;
+            if (stream_decode_rest(st, 1) != APR_SUCCESS && st->nheld) {
+                /* an odd character fails first */
+                st->status = APR_EINCOMPLETE;
+            }
+            break;
+        }
+        if (st->nheld && pr2two[st->held[0]] == 32 /* ':' */) {
+            st->nheld = 0;
+        }
+        st->held[st->nheld++] = src[i];
+        if (st->nheld == 2) {
+            *out++ = (pr2two[st->held[0]] << 4 | pr2two[st->held[1]]);
+            st->nheld = 0;
+        }
+    }
+
+    *len = out - dest;
+    return st->status;
+}
+
+APR_DECLARE(apr_status_t) apr_encode_stream(apr_encode_stream_t *st,
+        char *dest, const char *src, apr_size_t slen, apr_size_t *len)
+{
+    const apr_size_t total = st->nheld + slen;
+
+    if (!st->decode) {
+        if (!dest) {
+            *len = total / STREAM_CODEC(st)->bytes
+                   * (STREAM_CODEC(st)->chars + (STREAM_COLON(st) ? 1 : 0));
+            return APR_SUCCESS;
+        }
+        *len = stream_encode(st, dest, (const unsigned char *)src, slen);
+        return APR_SUCCESS;
+    }
+
+    if (!dest) {
+        *len = total / STREAM_CODEC(st)->chars * STREAM_CODEC(st)->bytes;
+        return st->status;
+    }
+    *len = 0;
+    if (st->status != APR_SUCCESS) {
+        return st->status;
+    }
+    if (st->done) {
+        return stream_decode_rest(st, slen);
+    }
+    if (STREAM_COLON(st)) {
+        return stream_decode_colon(st, (unsigned char *)dest,
+                                   (const unsigned char *)src, slen, len);
+    }
+    return stream_decode(st, (unsigned char *)dest, src, slen, len);
+}
+
+APR_DECLARE(apr_status_t) apr_encode_stream_final(apr_encode_stream_t *st,
+        char *dest, apr_size_t *len)
+{
+    apr_status_t rv = APR_SUCCESS;
+
+    if (!dest) {
+        *len = st->nheld ? STREAM_CODEC(st)->chars : 0;
+        return st->decode ? st->status : APR_SUCCESS;
+    }
+
+    *len = 0;
+    if (st->decode && st->status != APR_SUCCESS) {
+        rv = st->status;
+    }
+    else if (!st->decode && st->nheld) {
+        char last[16];
+
+        STREAM_CODEC(st)->encode(last, st->held, st->nheld, st->flags, len);
+        memcpy(dest, last, *len);
+    }
+    else if (st->decode && STREAM_COLON(st)) {
+        if (st->nheld) {
+            rv = APR_EINCOMPLETE;
+        }
+    }
+    else if (st->decode && st->nheld) {
+        rv = STREAM_CODEC(st)->decode((unsigned char *)dest,
+                                      (const char *)st->held, st->nheld,
+                                      st->flags, len);
+    }
+
+    st->nheld = 0;
+    st->done = 1;
+    return rv;
+}
@@ -38,6 +38,122 @@
  */
 #define TEST_CHAR(c, f)        (test_char_table[(unsigned)(c)] & (f))
 
+/* The same against the test_char_runs of a flag (or an OR of them). */
+#define TEST_RUN(runs, c) \
+    ((runs)[((c) & 0x0f) | (((c) >> 3) & 0x10)] & (1u << (((c) >> 4) & 7)))
+
+static APR_INLINE const unsigned char *run_table(unsigned f)
+{
+    unsigned i = 0;
+
+    while (!(f & 1)) {
+        f >>= 1;
+        i++;
+    }
+    return test_char_runs[i];
+}
+
+/* The runs of characters copied as is are skipped (or memcpy()ed) at once,
+ * 16 at a time with the vectors of apr_encode_private.h: the low nibble of
+ * each character picks the entry of the runs table, its high nibble the
+ * bit.  The 8-bit characters end the runs too when high is set.
+ */
+#if defined(ENCODE_SSSE3)
+
+ENCODE_SIMD_TARGET
+static apr_size_t escape_run_simd(const unsigned char *runs,
+                                  const unsigned char *s, apr_size_t slen,
+                                  int high)
+{
+    const __m128i lo_runs = _mm_loadu_si128((const __m128i *)runs);
+    const __m128i hi_runs = _mm_loadu_si128((const __m128i *)(runs + 16));
+    const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+                                       1, 2, 4, 8, 16, 32, 64, -128);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i eight = _mm_set1_epi8(8);
+    apr_size_t i;
+
+    for (i = 0; i + 16 <= slen; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i lo = _mm_and_si128(x, nibble);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(x, 4), nibble);
+        __m128i low = _mm_cmplt_epi8(hi, eight);
+        __m128i row = _mm_or_si128(
+                _mm_and_si128(low, _mm_shuffle_epi8(lo_runs, lo)),
+                _mm_andnot_si128(low, _mm_shuffle_epi8(hi_runs, lo)));
+        __m128i bit = _mm_shuffle_epi8(bits, hi);
+        int mask = _mm_movemask_epi8(
+                _mm_cmpeq_epi8(_mm_and_si128(row, bit), bit));
+
+        if (high) {
+            mask |= _mm_movemask_epi8(x);
+        }
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i;
+}
+
+#elif defined(ENCODE_NEON)
+
+static apr_size_t escape_run_simd(const unsigned char *runs,
+                                  const unsigned char *s, apr_size_t slen,
+                                  int high)
+{
+    static const unsigned char bits_table[16] = {
+        1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128
+    };
+    const uint8x16_t lo_runs = vld1q_u8(runs);
+    const uint8x16_t hi_runs = vld1q_u8(runs + 16);
+    const uint8x16_t bits = vld1q_u8(bits_table);
+    apr_size_t i;
+
+    for (i = 0; i + 16 <= slen; i += 16) {
+        uint8x16_t x = vld1q_u8(s + i);
+        uint8x16_t lo = vandq_u8(x, vdupq_n_u8(0x0f));
+        uint8x16_t hi = vshrq_n_u8(x, 4);
+        uint8x16_t row = vbslq_u8(vcltq_u8(hi, vdupq_n_u8(8)),
+                                  vqtbl1q_u8(lo_runs, lo),
+                                  vqtbl1q_u8(hi_runs, lo));
+        uint8x16_t stop = vtstq_u8(row, vqtbl1q_u8(bits, hi));
+        apr_uint64_t mask;
+
+        if (high) {
+            stop = vorrq_u8(stop, vcgeq_u8(x, vdupq_n_u8(0x80)));
+        }
+        /* 4 bits per byte, NEON having no movemask */
+        mask = vget_lane_u64(vreinterpret_u64_u8(
+                             vshrn_n_u16(vreinterpretq_u16_u8(stop), 4)), 0);
+        if (mask) {
+            return i + (__builtin_ctzll(mask) >> 2);
+        }
+    }
+    return i;
+}
+
+#endif
+
+static APR_INLINE apr_size_t escape_run(const unsigned char *runs,
+                                        const unsigned char *s,
+                                        apr_size_t slen, int high)
+{
+    apr_size_t i = 0;
+
+    if (!slen || TEST_RUN(runs, *s) || (high && !apr_isascii(*s))) {
+        return 0;
+    }
+#ifdef HAVE_ENCODE_SIMD
+    if (slen >= 16 && HAVE_ENCODE_SIMD()) {
+        i = escape_run_simd(runs, s, slen, high);
+    }
+#endif
+    while (i < slen && !TEST_RUN(runs, s[i]) && !(high && !apr_isascii(s[i]))) {
+        i++;
+    }
+    return i;
+}
+
 APR_DECLARE(apr_status_t) apr_escape_shell(char *escaped, const char *str,
         apr_ssize_t slen, apr_size_t *len)
 {
@@ -50,8 +166,22 @@ APR_DECLARE(apr_status_t) apr_escape_shell(char *escaped, const char *str,
     s = (const unsigned char *) str;
 
     if (s) {
+        if (slen < 0) {
+            slen = strlen(str);
+        }
         if (d) {
             for (; *s && slen; ++s, slen--) {
+                apr_size_t n = escape_run(run_table(T_ESCAPE_SHELL_CMD),
+                                          s, slen, 0);
+
+                /* all but the last one, copied below */
+                if (n > 1) {
+                    memcpy(d, s, n - 1);
+                    d += n - 1;
+                    s += n - 1;
+                    size += n - 1;
+                    slen -= n - 1;
+                }
 #if defined(OS2) || defined(WIN32)
                 /*
                  * Newlines to Win32/OS2 CreateProcess() are ill advised.
@@ -78,6 +208,14 @@ APR_DECLARE(apr_status_t) apr_escape_shell(char *escaped, const char *str,
         }
         else {
             for (; *s && slen; ++s, slen--) {
+                apr_size_t n = escape_run(run_table(T_ESCAPE_SHELL_CMD),
+                                          s, slen, 0);
+
+                if (n > 1) {
+                    s += n - 1;
+                    size += n - 1;
+                    slen -= n - 1;
+                }
                 if (TEST_CHAR(*s, T_ESCAPE_SHELL_CMD)) {
                     size++;
                     found = 1;
@@ -308,8 +446,21 @@ APR_DECLARE(apr_status_t) apr_escape_path_segment(char *escaped,
     unsigned c;
 
     if (s) {
+        if (slen < 0) {
+            slen = strlen(str);
+        }
         if (d) {
             while ((c = *s) && slen) {
+                apr_size_t n = escape_run(run_table(T_ESCAPE_PATH_SEGMENT), s, slen, 0);
+
+                if (n) {
+                    memcpy(d, s, n);
+                    d += n;
+                    s += n;
+                    size += n;
+                    slen -= n;
+                    continue;
+                }
                 if (TEST_CHAR(c, T_ESCAPE_PATH_SEGMENT)) {
                     d = c2x(c, '%', d);
                     size += 2;
@@ -326,6 +477,14 @@ APR_DECLARE(apr_status_t) apr_escape_path_segment(char *escaped,
         }
         else {
             while ((c = *s) && slen) {
+                apr_size_t n = escape_run(run_table(T_ESCAPE_PATH_SEGMENT), s, slen, 0);
+
+                if (n) {
+                    s += n;
+                    size += n;
+                    slen -= n;
+                    continue;
+                }
                 if (TEST_CHAR(c, T_ESCAPE_PATH_SEGMENT)) {
                     size += 2;
                     found = 1;
@@ -392,8 +551,21 @@ APR_DECLARE(apr_status_t) apr_escape_path(char *escaped, const char *path,
             found = 1;
         }
     }
+    if (slen < 0) {
+        slen = strlen(path);
+    }
     if (d) {
         while ((c = *s) && slen) {
+            apr_size_t n = escape_run(run_table(T_OS_ESCAPE_PATH), s, slen, 0);
+
+            if (n) {
+                memcpy(d, s, n);
+                d += n;
+                s += n;
+                size += n;
+                slen -= n;
+                continue;
+            }
             if (TEST_CHAR(c, T_OS_ESCAPE_PATH)) {
                 d = c2x(c, '%', d);
                 size += 2;
@@ -410,6 +582,14 @@ APR_DECLARE(apr_status_t) apr_escape_path(char *escaped, const char *path,
     }
     else {
         while ((c = *s) && slen) {
+            apr_size_t n = escape_run(run_table(T_OS_ESCAPE_PATH), s, slen, 0);
+
+            if (n) {
+                s += n;
+                size += n;
+                slen -= n;
+                continue;
+            }
             if (TEST_CHAR(c, T_OS_ESCAPE_PATH)) {
                 size += 2;
                 found = 1;
@@ -459,8 +639,21 @@ APR_DECLARE(apr_status_t) apr_escape_urlencoded(char *escaped, const char *str,
     unsigned c;
 
     if (s) {
+        if (slen < 0) {
+            slen = strlen(str);
+        }
         if (d) {
             while ((c = *s) && slen) {
+                apr_size_t n = escape_run(run_table(T_ESCAPE_URLENCODED), s, slen, 0);
+
+                if (n) {
+                    memcpy(d, s, n);
+                    d += n;
+                    s += n;
+                    size += n;
+                    slen -= n;
+                    continue;
+                }
                 if (TEST_CHAR(c, T_ESCAPE_URLENCODED)) {
                     d = c2x(c, '%', d);
                     size += 2;
@@ -481,6 +674,14 @@ APR_DECLARE(apr_status_t) apr_escape_urlencoded(char *escaped, const char *str,
         }
         else {
             while ((c = *s) && slen) {
+                apr_size_t n = escape_run(run_table(T_ESCAPE_URLENCODED), s, slen, 0);
+
+                if (n) {
+                    s += n;
+                    size += n;
+                    slen -= n;
+                    continue;
+                }
                 if (TEST_CHAR(c, T_ESCAPE_URLENCODED)) {
                     size += 2;
                     found = 1;
@@ -533,8 +734,21 @@ APR_DECLARE(apr_status_t) apr_escape_entity(char *escaped, const char *str,
     unsigned c;
 
     if (s) {
+        if (slen < 0) {
+            slen = strlen(str);
+        }
         if (d) {
             while ((c = *s) && slen) {
+                apr_size_t n = escape_run(run_table(T_ESCAPE_XML), s, slen, toasc);
+
+                if (n) {
+                    memcpy(d, s, n);
+                    d += n;
+                    s += n;
+                    size += n;
+                    slen -= n;
+                    continue;
+                }
                 if (TEST_CHAR(c, T_ESCAPE_XML)) {
                     switch (c) {
                     case '>': {
@@ -587,6 +801,14 @@ APR_DECLARE(apr_status_t) apr_escape_entity(char *escaped, const char *str,
         }
         else {
             while ((c = *s) && slen) {
+                apr_size_t n = escape_run(run_table(T_ESCAPE_XML), s, slen, toasc);
+
+                if (n) {
+                    s += n;
+                    size += n;
+                    slen -= n;
+                    continue;
+                }
                 if (TEST_CHAR(c, T_ESCAPE_XML)) {
                     switch (c) {
                     case '>': {
@@ -839,8 +1061,21 @@ APR_DECLARE(apr_status_t) apr_escape_echo(char *escaped, const char *str,
     unsigned c;
 
     if (s) {
+        if (slen < 0) {
+            slen = strlen(str);
+        }
         if (d) {
             while ((c = *s) && slen) {
+                apr_size_t n = escape_run(run_table(T_ESCAPE_ECHO), s, slen, 0);
+
+                if (n) {
+                    memcpy(d, s, n);
+                    d += n;
+                    s += n;
+                    size += n;
+                    slen -= n;
+                    continue;
+                }
                 if (TEST_CHAR(c, T_ESCAPE_ECHO)) {
                     *d++ = '\\';
                     size++;
@@ -914,6 +1149,14 @@ APR_DECLARE(apr_status_t) apr_escape_echo(char *escaped, const char *str,
         }
         else {
             while ((c = *s) && slen) {
+                apr_size_t n = escape_run(run_table(T_ESCAPE_ECHO), s, slen, 0);
+
+                if (n) {
+                    s += n;
+                    size += n;
+                    slen -= n;
+                    continue;
+                }
                 if (TEST_CHAR(c, T_ESCAPE_ECHO)) {
                     size++;
                     switch (c) {
@@ -1149,11 +1392,33 @@ APR_DECLARE(apr_status_t) apr_escape_ldap(char *escaped, const void *str,
     int found = 0;
     const unsigned char *s = (const unsigned char *) str;
     unsigned char *d = (unsigned char *) escaped;
+    unsigned char runs[32] = { 1 }; /* NUL */
     unsigned c;
 
     if (s) {
+        if (slen < 0) {
+            slen = strlen(str);
+        }
+        for (c = 0; c < sizeof(runs); c++) {
+            if (flags & APR_ESCAPE_LDAP_DN) {
+                runs[c] |= run_table(T_ESCAPE_LDAP_DN)[c];
+            }
+            if (flags & APR_ESCAPE_LDAP_FILTER) {
+                runs[c] |= run_table(T_ESCAPE_LDAP_FILTER)[c];
+            }
+        }
         if (d) {
             while (((c = *s) && slen) || (slen > 0)) {
+                apr_size_t n = escape_run(runs, s, slen, 0);
+
+                if (n) {
+                    memcpy(d, s, n);
+                    d += n;
+                    s += n;
+                    size += n;
+                    slen -= n;
+                    continue;
+                }
                 if (((flags & APR_ESCAPE_LDAP_DN) && TEST_CHAR(c, T_ESCAPE_LDAP_DN))
                      || ((flags & APR_ESCAPE_LDAP_FILTER) && TEST_CHAR(c, T_ESCAPE_LDAP_FILTER))) {
                     d = c2x(c, '\\', d);
@@ -1171,6 +1436,14 @@ APR_DECLARE(apr_status_t) apr_escape_ldap(char *escaped, const void *str,
         }
         else {
             while (((c = *s) && slen) || (slen > 0)) {
+                apr_size_t n = escape_run(runs, s, slen, 0);
+
+                if (n) {
+                    s += n;
+                    size += n;
+                    slen -= n;
+                    continue;
+                }
                 if (((flags & APR_ESCAPE_LDAP_DN) && TEST_CHAR(c, T_ESCAPE_LDAP_DN))
                      || ((flags & APR_ESCAPE_LDAP_FILTER) && TEST_CHAR(c, T_ESCAPE_LDAP_FILTER))) {
                     size += 2;
@@ -110,6 +110,8 @@ APR_DECLARE(apr_status_t) apr_file_info_get(apr_finfo_t *finfo,
 {
     struct stat info;
 
+    wanted &= ~APR_FINFO_NOSYNC; /* only a hint for unix statx() */
+
     if (thefile->buffered) {
         /* XXX: flush here is not mutex protected */
         apr_status_t rv = apr_file_flush(thefile);
@@ -318,6 +320,8 @@ APR_DECLARE(apr_status_t) apr_stat(apr_finfo_t *finfo,
     int srv;
     NXPathCtx_t pathCtx = 0;
 
+    wanted &= ~APR_FINFO_NOSYNC; /* only a hint for unix statx() */
+
     getcwdpath(NULL, &pathCtx, CTX_ACTUAL_CWD);
 #ifdef APR_HAS_PSA
 	srv = getstat(pathCtx, (char*)fname, &info, ST_STAT_BITS|ST_NAME_BIT);
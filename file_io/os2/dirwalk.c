@@ -0,0 +1 @@
+#include "../unix/dirwalk.c"
@@ -90,6 +90,8 @@ APR_DECLARE(apr_status_t) apr_file_info_get(apr_finfo_t *finfo, apr_int32_t want
     ULONG rc;
     FILESTATUS3 fstatus;
 
+    wanted &= ~APR_FINFO_NOSYNC; /* only a hint for unix statx() */
+
     if (thefile->isopen) {
         if (thefile->buffered) {
             apr_status_t rv = apr_file_flush(thefile);
@@ -134,6 +136,8 @@ APR_DECLARE(apr_status_t) apr_stat(apr_finfo_t *finfo, const char *fname,
     ULONG rc;
     FILESTATUS3 fstatus;
 
+    wanted &= ~APR_FINFO_NOSYNC; /* only a hint for unix statx() */
+
     finfo->protection = 0;
     finfo->filetype = APR_NOFILE;
     finfo->name = NULL;
@@ -0,0 +1 @@
+#include "../unix/groupcommit.c"
@@ -0,0 +1 @@
+#include "../unix/lineiter.c"
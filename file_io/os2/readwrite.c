@@ -409,6 +409,122 @@ apr_status_t apr_file_check_read(apr_file_t *fd)
 
 
 
+/* Seek there and back under the mutex of APR_FOPEN_XTHREAD files */
+static apr_status_t file_io_at(apr_file_t *thefile, int writing,
+                               const struct iovec *vec, apr_size_t nvec,
+                               apr_off_t offset, apr_size_t *nbytes)
+{
+    ULONG pos, newpos, done;
+    apr_status_t rv;
+    apr_size_t i;
+    int rc;
+
+    *nbytes = 0;
+
+    rv = apr_file_flush(thefile);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    if (thefile->mutex) {
+        apr_thread_mutex_lock(thefile->mutex);
+    }
+
+    rc = DosSetFilePtr(thefile->filedes, 0, FILE_CURRENT, &pos);
+
+    if (rc == 0) {
+        rc = DosSetFilePtr(thefile->filedes, offset, FILE_BEGIN, &newpos);
+    }
+
+    for (i = 0; rc == 0 && i < nvec; i++) {
+        done = 0;
+
+        if (writing) {
+            rc = DosWrite(thefile->filedes, vec[i].iov_base, vec[i].iov_len,
+                          &done);
+        } else {
+            rc = DosRead(thefile->filedes, vec[i].iov_base, vec[i].iov_len,
+                         &done);
+        }
+
+        if (rc == 0) {
+            *nbytes += done;
+
+            if (done < vec[i].iov_len) {
+                break;
+            }
+        }
+    }
+
+    if (rc && *nbytes) {
+        rc = 0;
+    }
+
+    DosSetFilePtr(thefile->filedes, pos, FILE_BEGIN, &newpos);
+
+    if (thefile->mutex) {
+        apr_thread_mutex_unlock(thefile->mutex);
+    }
+
+    if (rc) {
+        return APR_FROM_OS_ERROR(rc);
+    }
+
+    if (!writing && *nbytes == 0) {
+        for (i = 0; i < nvec; i++) {
+            if (vec[i].iov_len) {
+                return APR_EOF;
+            }
+        }
+    }
+
+    return APR_SUCCESS;
+}
+
+
+
+APR_DECLARE(apr_status_t) apr_file_read_at(apr_file_t *thefile, apr_off_t offset,
+                                           void *buf, apr_size_t *nbytes)
+{
+    struct iovec vec;
+
+    vec.iov_base = buf;
+    vec.iov_len = *nbytes;
+    return file_io_at(thefile, 0, &vec, 1, offset, nbytes);
+}
+
+
+
+APR_DECLARE(apr_status_t) apr_file_write_at(apr_file_t *thefile, apr_off_t offset,
+                                            const void *buf, apr_size_t *nbytes)
+{
+    struct iovec vec;
+
+    vec.iov_base = (void *)buf;
+    vec.iov_len = *nbytes;
+    return file_io_at(thefile, 1, &vec, 1, offset, nbytes);
+}
+
+
+
+APR_DECLARE(apr_status_t) apr_file_readv_at(apr_file_t *thefile, apr_off_t offset,
+                                            const struct iovec *vec,
+                                            apr_size_t nvec, apr_size_t *nbytes)
+{
+    return file_io_at(thefile, 0, vec, nvec, offset, nbytes);
+}
+
+
+
+APR_DECLARE(apr_status_t) apr_file_writev_at(apr_file_t *thefile, apr_off_t offset,
+                                             const struct iovec *vec,
+                                             apr_size_t nvec, apr_size_t *nbytes)
+{
+    return file_io_at(thefile, 1, vec, nvec, offset, nbytes);
+}
+
+
+
 APR_DECLARE(apr_status_t) apr_file_pipe_wait(apr_file_t *pipe, apr_wait_type_t direction)
 {
     int rc;
@@ -0,0 +1 @@
+#include "../unix/splice.c"
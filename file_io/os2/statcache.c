@@ -0,0 +1 @@
+#include "../unix/statcache.c"
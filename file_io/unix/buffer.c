@@ -18,6 +18,9 @@
 #include "apr_pools.h"
 #include "apr_thread_mutex.h"
 
+apr_size_t apr_file_default_bufsize = APR_FILE_DEFAULT_BUFSIZE;
+apr_size_t apr_file_max_bufsize = 0;
+
 APR_DECLARE(apr_status_t) apr_file_buffer_set(apr_file_t *file,
                                               char * buffer,
                                               apr_size_t bufsize)
@@ -37,6 +40,7 @@ APR_DECLARE(apr_status_t) apr_file_buffer_set(apr_file_t *file,
 
     file->buffer = buffer;
     file->bufsize = bufsize;
+    file->bufgrow = 0;
     file->buffered = 1;
     file->bufpos = 0;
     file->direction = 0;
@@ -58,3 +62,104 @@ APR_DECLARE(apr_size_t) apr_file_buffer_size_get(apr_file_t *file)
 {
     return file->bufsize;
 }
+
+APR_DECLARE(void) apr_file_buffer_default_set(apr_size_t bufsize,
+                                              apr_size_t maxsize)
+{
+    apr_file_default_bufsize = bufsize ? bufsize : APR_FILE_DEFAULT_BUFSIZE;
+    apr_file_max_bufsize = maxsize;
+}
+
+APR_DECLARE(void) apr_file_buffer_default_get(apr_size_t *bufsize,
+                                              apr_size_t *maxsize)
+{
+    *bufsize = apr_file_default_bufsize;
+    *maxsize = apr_file_max_bufsize;
+}
+
+/* Double the empty buffer of a file accessed sequentially, up to the
+ * maximum size; called with the file locked.  The old buffer stays in
+ * the pool, which bounds the waste to the final size.
+ */
+void apr_file_buffer_grow(apr_file_t *file)
+{
+    apr_size_t bufsize = file->bufsize * 2;
+
+    if (bufsize >= apr_file_max_bufsize || bufsize < file->bufsize) {
+        bufsize = apr_file_max_bufsize;
+        file->bufgrow = 0;
+    }
+    if (bufsize > file->bufsize) {
+        file->buffer = apr_palloc(file->pool, bufsize);
+        file->bufsize = bufsize;
+    }
+}
+
+static apr_status_t file_stages_cleanup(void *data)
+{
+    apr_file_t *file = data;
+
+    /* Before the mutexes of the stages are destroyed */
+    if (file->stages) {
+        apr_file_stages_flush(file);
+        file->stages = NULL;
+    }
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_file_append_stages_set(apr_file_t *file,
+                                                     apr_uint32_t nstages,
+                                                     apr_size_t stagesize,
+                                                     apr_interval_time_t max_age)
+{
+#if APR_HAS_THREADS
+    apr_file_stages_t *stages;
+    apr_status_t rv;
+    apr_uint32_t i;
+
+    if ((file->flags & (APR_FOPEN_APPEND | APR_FOPEN_XTHREAD))
+            != (APR_FOPEN_APPEND | APR_FOPEN_XTHREAD) || !file->buffered) {
+        return APR_EINVAL;
+    }
+
+    file_lock(file);
+
+    rv = apr_file_flush_locked(file);
+    if (rv != APR_SUCCESS) {
+        file_unlock(file);
+        return rv;
+    }
+    if (file->stages) {
+        /* Flushed, the stages stay in the pool */
+        apr_pool_cleanup_kill(file->pool, file, file_stages_cleanup);
+        file->stages = NULL;
+    }
+    if (nstages) {
+        stages = apr_palloc(file->pool, sizeof(*stages));
+        stages->nstages = nstages;
+        stages->size = stagesize ? stagesize : file->bufsize;
+        stages->max_age = max_age;
+        stages->stage = apr_pcalloc(file->pool,
+                                    nstages * sizeof(*stages->stage));
+        for (i = 0; i < nstages; i++) {
+            rv = apr_thread_mutex_create(&stages->stage[i].lock,
+                                         APR_THREAD_MUTEX_DEFAULT,
+                                         file->pool);
+            if (rv != APR_SUCCESS) {
+                file_unlock(file);
+                return rv;
+            }
+            stages->stage[i].buf = apr_palloc(file->pool, stages->size);
+        }
+        apr_pool_cleanup_register(file->pool, file, file_stages_cleanup,
+                                  apr_pool_cleanup_null);
+        file->stages = stages;
+    }
+
+    file_unlock(file);
+
+    return APR_SUCCESS;
+#else
+    return APR_ENOTIMPL;
+#endif
+}
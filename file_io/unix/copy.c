@@ -17,13 +17,239 @@
 #include "apr_arch_file_io.h"
 #include "apr_file_io.h"
 
+/* Large enough for the system calls to stop showing, allocated from a
+ * subpool rather than taken from the stack.
+ */
+#define COPY_BUFSIZ (128 * 1024)
+
+#if defined(__linux__)
+#define COPY_IN_KERNEL 1
+#endif
+
+#ifdef COPY_IN_KERNEL
+
+#ifdef HAVE_SYS_IOCTL_H
+#include <sys/ioctl.h>
+#endif
+#ifdef HAVE_LINUX_FS_H
+#include <linux/fs.h>
+#endif
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+
+/* The most handed to the kernel per call */
+#define COPY_CHUNK 0x40000000
+
+/* The method does not apply to these files (file system, special files,
+ * append mode...), the next one is tried.
+ */
+#define COPY_UNSUPPORTED(e) ((e) == ENOSYS || (e) == EXDEV || (e) == EINVAL \
+                             || (e) == EBADF || (e) == EOPNOTSUPP \
+                             || (e) == ENOTTY)
+
+/* Share the data of the source file (reflink) */
+static apr_status_t copy_clone(int sfd, int dfd, int *done)
+{
+#ifdef FICLONE
+    if (ioctl(dfd, FICLONE, sfd) == 0) {
+        *done = 1;
+        return APR_SUCCESS;
+    }
+    if (!COPY_UNSUPPORTED(errno)) {
+        return errno;
+    }
+#endif
+    return APR_SUCCESS;
+}
+
+/* Copy from the offsets of the files, up to len bytes or the end of the
+ * source file if len is negative
+ */
+static apr_status_t copy_stream(int sfd, int dfd, apr_off_t len,
+                                apr_pool_t *scratch, char **buf)
+{
+    apr_ssize_t n;
+
+#if defined(HAVE_COPY_FILE_RANGE) || defined(HAVE_SYS_SENDFILE_H)
+    int copied;
+#endif
+
+#ifdef HAVE_COPY_FILE_RANGE
+    copied = 0;
+    do {
+        n = copy_file_range(sfd, NULL, dfd, NULL, len < 0 || len > COPY_CHUNK
+                                                  ? COPY_CHUNK : len, 0);
+        if (n > 0) {
+            copied = 1;
+            if (len > 0) {
+                len -= n;
+            }
+        }
+    } while ((n > 0 && len) || (n < 0 && errno == EINTR));
+    /* Nothing at all may be a file whose size means nothing, as in /proc */
+    if (n > 0 || (n == 0 && copied) || !len) {
+        return APR_SUCCESS;
+    }
+    if (n < 0 && !COPY_UNSUPPORTED(errno)) {
+        return errno;
+    }
+#endif
+#ifdef HAVE_SYS_SENDFILE_H
+    copied = 0;
+    do {
+        n = sendfile(dfd, sfd, NULL, len < 0 || len > COPY_CHUNK
+                                     ? COPY_CHUNK : len);
+        if (n > 0) {
+            copied = 1;
+            if (len > 0) {
+                len -= n;
+            }
+        }
+    } while ((n > 0 && len) || (n < 0 && errno == EINTR));
+    if (n > 0 || (n == 0 && copied) || !len) {
+        return APR_SUCCESS;
+    }
+    if (n < 0 && !COPY_UNSUPPORTED(errno)) {
+        return errno;
+    }
+#endif
+
+    if (!*buf) {
+        *buf = apr_palloc(scratch, COPY_BUFSIZ);
+    }
+    while (len) {
+        apr_ssize_t w, off = 0;
+
+        do {
+            n = read(sfd, *buf, len < 0 || len > COPY_BUFSIZ
+                                ? COPY_BUFSIZ : len);
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0) {
+            return n < 0 ? errno : APR_SUCCESS;
+        }
+        if (len > 0) {
+            len -= n;
+        }
+        while (off < n) {
+            do {
+                w = write(dfd, *buf + off, n - off);
+            } while (w < 0 && errno == EINTR);
+            if (w < 0) {
+                return errno;
+            }
+            off += w;
+        }
+    }
+    return APR_SUCCESS;
+}
+
+/* Copy the data segments of the source file only, at their offsets */
+static apr_status_t copy_sparse(int sfd, int dfd, apr_off_t size,
+                                apr_pool_t *scratch, char **buf, int *done)
+{
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    apr_off_t data, hole = 0;
+    apr_status_t rv;
+
+    for (;;) {
+        if ((data = lseek(sfd, hole, SEEK_DATA)) < 0) {
+            if (errno == ENXIO) {
+                /* Only a hole left */
+                break;
+            }
+            if (hole == 0 && COPY_UNSUPPORTED(errno)) {
+                return APR_SUCCESS;
+            }
+            return errno;
+        }
+        if ((hole = lseek(sfd, data, SEEK_HOLE)) < 0) {
+            return errno;
+        }
+        if (lseek(sfd, data, SEEK_SET) < 0
+            || lseek(dfd, data, SEEK_SET) < 0) {
+            return errno;
+        }
+        if ((rv = copy_stream(sfd, dfd, hole - data, scratch,
+                              buf)) != APR_SUCCESS) {
+            return rv;
+        }
+    }
+    if (ftruncate(dfd, size) < 0) {
+        return errno;
+    }
+    *done = 1;
+#endif
+    return APR_SUCCESS;
+}
+
+#endif /* COPY_IN_KERNEL */
+
+static apr_status_t copy_contents(apr_file_t *s, apr_file_t *d,
+                                  apr_int32_t flags, apr_int32_t copy_flags,
+                                  apr_pool_t *scratch)
+{
+    char *buf = NULL;
+#ifdef COPY_IN_KERNEL
+    apr_status_t status = APR_SUCCESS;
+    int done = 0;
+
+    /* Appending does not start from the beginning of the destination */
+    if (!(flags & APR_FOPEN_APPEND)) {
+        status = copy_clone(s->filedes, d->filedes, &done);
+        if (status == APR_SUCCESS && !done
+            && (copy_flags & APR_FILE_COPY_SPARSE)) {
+            apr_finfo_t finfo;
+
+            status = apr_file_info_get(&finfo, APR_FINFO_SIZE, s);
+            if (status == APR_SUCCESS) {
+                status = copy_sparse(s->filedes, d->filedes, finfo.size,
+                                     scratch, &buf, &done);
+            }
+        }
+    }
+    if (status != APR_SUCCESS || done) {
+        return status;
+    }
+    return copy_stream(s->filedes, d->filedes, -1, scratch, &buf);
+#else
+    buf = apr_palloc(scratch, COPY_BUFSIZ);
+
+    /* Copy bytes till the cows come home. */
+    while (1) {
+        apr_size_t bytes_this_time = COPY_BUFSIZ;
+        apr_status_t read_err;
+        apr_status_t write_err;
+
+        /* Read 'em. */
+        read_err = apr_file_read(s, buf, &bytes_this_time);
+        if (read_err && !APR_STATUS_IS_EOF(read_err)) {
+            return read_err;
+        }
+
+        /* Write 'em. */
+        write_err = apr_file_write_full(d, buf, bytes_this_time, NULL);
+        if (write_err) {
+            return write_err;
+        }
+
+        if (read_err && APR_STATUS_IS_EOF(read_err)) {
+            return APR_SUCCESS;
+        }
+    }
+    /* NOTREACHED */
+#endif
+}
+
 static apr_status_t apr_file_transfer_contents(const char *from_path,
                                                const char *to_path,
                                                apr_int32_t flags,
                                                apr_fileperms_t to_perms,
+                                               apr_int32_t copy_flags,
                                                apr_pool_t *pool)
 {
     apr_file_t *s, *d;
+    apr_pool_t *scratch;
     apr_status_t status;
     apr_finfo_t finfo;
     apr_fileperms_t perms;
@@ -53,47 +279,25 @@ static apr_status_t apr_file_transfer_contents(const char *from_path,
         return status;
     }
 
-#if BUFSIZ > APR_FILE_DEFAULT_BUFSIZE
-#define COPY_BUFSIZ BUFSIZ
-#else
-#define COPY_BUFSIZ APR_FILE_DEFAULT_BUFSIZE
-#endif
-
-    /* Copy bytes till the cows come home. */
-    while (1) {
-        char buf[COPY_BUFSIZ];
-        apr_size_t bytes_this_time = sizeof(buf);
-        apr_status_t read_err;
-        apr_status_t write_err;
-
-        /* Read 'em. */
-        read_err = apr_file_read(s, buf, &bytes_this_time);
-        if (read_err && !APR_STATUS_IS_EOF(read_err)) {
-            apr_file_close(s);  /* toss any error */
-            apr_file_close(d);  /* toss any error */
-            return read_err;
-        }
-
-        /* Write 'em. */
-        write_err = apr_file_write_full(d, buf, bytes_this_time, NULL);
-        if (write_err) {
-            apr_file_close(s);  /* toss any error */
-            apr_file_close(d);  /* toss any error */
-            return write_err;
-        }
-
-        if (read_err && APR_STATUS_IS_EOF(read_err)) {
-            status = apr_file_close(s);
-            if (status) {
-                apr_file_close(d);  /* toss any error */
-                return status;
-            }
+    status = apr_pool_create(&scratch, pool);
+    if (status == APR_SUCCESS) {
+        status = copy_contents(s, d, flags, copy_flags, scratch);
+        apr_pool_destroy(scratch);
+    }
+    if (status) {
+        apr_file_close(s);  /* toss any error */
+        apr_file_close(d);  /* toss any error */
+        return status;
+    }
 
-            /* return the results of this close: an error, or success */
-            return apr_file_close(d);
-        }
+    status = apr_file_close(s);
+    if (status) {
+        apr_file_close(d);  /* toss any error */
+        return status;
     }
-    /* NOTREACHED */
+
+    /* return the results of this close: an error, or success */
+    return apr_file_close(d);
 }
 
 APR_DECLARE(apr_status_t) apr_file_copy(const char *from_path,
@@ -103,7 +307,19 @@ APR_DECLARE(apr_status_t) apr_file_copy(const char *from_path,
 {
     return apr_file_transfer_contents(from_path, to_path,
                                       (APR_FOPEN_WRITE | APR_FOPEN_CREATE | APR_FOPEN_TRUNCATE),
-                                      perms,
+                                      perms, 0,
+                                      pool);
+}
+
+APR_DECLARE(apr_status_t) apr_file_copy_ex(const char *from_path,
+                                           const char *to_path,
+                                           apr_fileperms_t perms,
+                                           apr_int32_t flags,
+                                           apr_pool_t *pool)
+{
+    return apr_file_transfer_contents(from_path, to_path,
+                                      (APR_FOPEN_WRITE | APR_FOPEN_CREATE | APR_FOPEN_TRUNCATE),
+                                      perms, flags,
                                       pool);
 }
 
@@ -114,6 +330,6 @@ APR_DECLARE(apr_status_t) apr_file_append(const char *from_path,
 {
     return apr_file_transfer_contents(from_path, to_path,
                                       (APR_FOPEN_WRITE | APR_FOPEN_CREATE | APR_FOPEN_APPEND),
-                                      perms,
+                                      perms, 0,
                                       pool);
 }
@@ -28,6 +28,11 @@
 #define NAME_MAX 255
 #endif
 
+/* Stat the entries relative to the directory, without their path */
+#if defined(HAVE_DIRFD) && (defined(HAVE_STATX) || defined(HAVE_FSTATAT))
+#define DIR_STAT_AT
+#endif
+
 static apr_status_t dir_cleanup(void *thedir)
 {
     apr_dir_t *dir = thedir;
@@ -240,6 +245,11 @@ apr_status_t apr_dir_read(apr_finfo_t *finfo, apr_int32_t wanted,
 
     if (wanted)
     {
+#ifdef DIR_STAT_AT
+        ret = apr_unix_stat_at(finfo, dirfd(thedir->dirstruct),
+                               thedir->entry->d_name, APR_FINFO_LINK | wanted,
+                               thedir->pool);
+#else
         char fspec[APR_PATH_MAX];
         char *end;
 
@@ -254,6 +264,7 @@ apr_status_t apr_dir_read(apr_finfo_t *finfo, apr_int32_t wanted,
         ret = apr_stat(finfo, fspec, APR_FINFO_LINK | wanted, thedir->pool);
         /* We passed a stack name that will disappear */
         finfo->fname = NULL;
+#endif
     }
 
     if (wanted && (ret == APR_SUCCESS || ret == APR_INCOMPLETE)) {
@@ -288,6 +299,32 @@ apr_status_t apr_dir_read(apr_finfo_t *finfo, apr_int32_t wanted,
     return APR_SUCCESS;
 }
 
+apr_status_t apr_dir_read_batch(apr_finfo_t *finfo,
+                                apr_size_t nelts,
+                                apr_size_t *nread,
+                                apr_int32_t wanted,
+                                apr_dir_t *thedir)
+{
+    apr_status_t rv = APR_SUCCESS, ret;
+    apr_size_t n;
+
+    for (n = 0; n < nelts; n++) {
+        ret = apr_dir_read(&finfo[n], wanted, thedir);
+        if (ret == APR_INCOMPLETE) {
+            rv = APR_INCOMPLETE;
+        }
+        else if (ret != APR_SUCCESS) {
+            if (n == 0) {
+                rv = ret;
+            }
+            break;
+        }
+    }
+
+    *nread = n;
+    return rv;
+}
+
 apr_status_t apr_dir_rewind(apr_dir_t *thedir)
 {
     rewinddir(thedir->dirstruct);
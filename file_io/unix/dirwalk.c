@@ -0,0 +1,383 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_dir_walk.h"
+#include "apr_file_io.h"
+#include "apr_strings.h"
+#include "apr_allocator.h"
+#include "apr_thread_mutex.h"
+#include "apr_thread_cond.h"
+#include "apr_thread_pool.h"
+
+/* The entries read per apr_dir_read_batch() */
+#define WALK_BATCH 64
+
+typedef struct walk_t walk_t;
+typedef struct walk_dir_t walk_dir_t;
+
+/*
+ * A directory to walk.  It holds a reference on its parent until it has
+ * been walked, so a directory is done (and reported last with
+ * APR_DIR_WALK_POSTORDER) once its own read and all its subdirectories
+ * are done.
+ */
+struct walk_dir_t {
+    walk_t *walk;
+    walk_dir_t *parent;
+    apr_pool_t *pool;
+    const char *path;
+    apr_finfo_t finfo;
+    apr_uint32_t refs;
+    walk_dir_t *next;
+};
+
+struct walk_t {
+    apr_pool_t *pool;
+    apr_int32_t wanted;
+    apr_uint32_t flags;
+    apr_dir_walk_cb_t func;
+    void *baton;
+#if APR_HAS_THREADS
+    apr_thread_pool_t *tp;
+    /* Protects the refs of the directories, pending and status */
+    apr_thread_mutex_t *lock;
+    apr_thread_mutex_t *func_lock;
+    apr_thread_cond_t *cond;
+#endif
+    /* The directories to read without a thread pool */
+    walk_dir_t *queue;
+    apr_size_t pending;
+    apr_status_t status;
+};
+
+#if APR_HAS_THREADS
+#define walk_lock(w)   if ((w)->lock) apr_thread_mutex_lock((w)->lock)
+#define walk_unlock(w) if ((w)->lock) apr_thread_mutex_unlock((w)->lock)
+#else
+#define walk_lock(w)
+#define walk_unlock(w)
+#endif
+
+static int walk_stopped(walk_t *w)
+{
+    int stopped;
+
+    walk_lock(w);
+    stopped = (w->status != APR_SUCCESS);
+    walk_unlock(w);
+
+    return stopped;
+}
+
+static void walk_fail(walk_t *w, apr_status_t rv)
+{
+    walk_lock(w);
+    if (w->status == APR_SUCCESS) {
+        w->status = rv;
+    }
+    walk_unlock(w);
+}
+
+static void walk_call(walk_t *w, const char *path, const apr_finfo_t *finfo,
+                      apr_pool_t *pool)
+{
+    apr_status_t rv;
+
+    if (walk_stopped(w)) {
+        return;
+    }
+#if APR_HAS_THREADS
+    if (w->func_lock) {
+        apr_thread_mutex_lock(w->func_lock);
+    }
+#endif
+    rv = w->func(w->baton, path, finfo, pool);
+#if APR_HAS_THREADS
+    if (w->func_lock) {
+        apr_thread_mutex_unlock(w->func_lock);
+    }
+#endif
+    if (rv != APR_SUCCESS) {
+        walk_fail(w, rv);
+    }
+}
+
+static apr_status_t walk_dir_make(walk_dir_t **new_d, walk_t *w,
+                                  walk_dir_t *parent, const char *path,
+                                  const apr_finfo_t *finfo)
+{
+    walk_dir_t *d;
+    apr_pool_t *pool;
+    apr_status_t rv;
+
+    rv = apr_pool_create(&pool, parent ? parent->pool : w->pool);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    d = apr_pcalloc(pool, sizeof(*d));
+    d->walk = w;
+    d->parent = parent;
+    d->pool = pool;
+    d->path = apr_pstrdup(pool, path);
+    d->finfo = *finfo;
+    d->finfo.fname = d->path;
+    d->refs = 1;
+
+    walk_lock(w);
+    if (parent) {
+        parent->refs++;
+    }
+    w->pending++;
+    walk_unlock(w);
+
+    *new_d = d;
+    return APR_SUCCESS;
+}
+
+/* Drop a reference on a directory, and on its parents once done */
+static void walk_release(walk_dir_t *d)
+{
+    walk_t *w = d->walk;
+
+    while (d) {
+        walk_dir_t *parent = d->parent;
+        apr_uint32_t refs;
+
+        walk_lock(w);
+        refs = --d->refs;
+        walk_unlock(w);
+        if (refs) {
+            break;
+        }
+
+        if (w->flags & APR_DIR_WALK_POSTORDER) {
+            walk_call(w, d->path, &d->finfo, d->pool);
+        }
+        /* The pools of the subdirectories are gone already */
+        apr_pool_destroy(d->pool);
+
+        walk_lock(w);
+        if (--w->pending == 0) {
+#if APR_HAS_THREADS
+            if (w->cond) {
+                apr_thread_cond_signal(w->cond);
+            }
+#endif
+        }
+        walk_unlock(w);
+
+        d = parent;
+    }
+}
+
+static void walk_read(walk_dir_t *d);
+
+#if APR_HAS_THREADS
+static void *APR_THREAD_FUNC walk_task(apr_thread_t *thd, void *param)
+{
+    walk_dir_t *d = param;
+
+    walk_read(d);
+    walk_release(d);
+    return NULL;
+}
+#endif
+
+static void walk_push(walk_dir_t *d)
+{
+    walk_t *w = d->walk;
+
+#if APR_HAS_THREADS
+    if (w->tp) {
+        apr_status_t rv;
+
+        rv = apr_thread_pool_push(w->tp, walk_task, d,
+                                  APR_THREAD_TASK_PRIORITY_NORMAL, w);
+        if (rv != APR_SUCCESS) {
+            walk_fail(w, rv);
+            walk_release(d);
+        }
+        return;
+    }
+#endif
+    d->next = w->queue;
+    w->queue = d;
+}
+
+static void walk_read(walk_dir_t *d)
+{
+    walk_t *w = d->walk;
+    apr_finfo_t finfo[WALK_BATCH];
+    apr_size_t len = strlen(d->path), n, i;
+    int sep = (len && d->path[len - 1] != '/');
+    apr_dir_t *dir;
+    apr_status_t rv;
+
+    if (walk_stopped(w)) {
+        return;
+    }
+    rv = apr_dir_open(&dir, d->path, d->pool);
+    if (rv != APR_SUCCESS) {
+        if (!(d->parent && APR_STATUS_IS_ENOENT(rv))) {
+            walk_fail(w, rv);
+        }
+        return;
+    }
+
+    while (!walk_stopped(w)) {
+        rv = apr_dir_read_batch(finfo, WALK_BATCH, &n, w->wanted, dir);
+        if (APR_STATUS_IS_ENOENT(rv)) {
+            break;
+        }
+        if (rv != APR_SUCCESS && rv != APR_INCOMPLETE) {
+            walk_fail(w, rv);
+            break;
+        }
+        for (i = 0; i < n; i++) {
+            const char *name = finfo[i].name;
+            const char *path;
+
+            if (name[0] == '.'
+                && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            path = apr_pstrcat(d->pool, d->path, sep ? "/" : "", name, NULL);
+            finfo[i].fname = path;
+
+            if ((finfo[i].valid & APR_FINFO_TYPE)
+                && finfo[i].filetype == APR_DIR) {
+                walk_dir_t *child;
+
+                rv = walk_dir_make(&child, w, d, path, &finfo[i]);
+                if (rv != APR_SUCCESS) {
+                    walk_fail(w, rv);
+                    break;
+                }
+                if (!(w->flags & APR_DIR_WALK_POSTORDER)) {
+                    walk_call(w, child->path, &child->finfo, child->pool);
+                }
+                walk_push(child);
+            }
+            else {
+                walk_call(w, path, &finfo[i], d->pool);
+            }
+        }
+    }
+
+    apr_dir_close(dir);
+}
+
+APR_DECLARE(apr_status_t) apr_dir_walk(const char *root, apr_int32_t wanted,
+                                       apr_uint32_t flags,
+                                       apr_dir_walk_cb_t func, void *baton,
+                                       struct apr_thread_pool *tp,
+                                       apr_pool_t *p)
+{
+    apr_allocator_t *allocator;
+    apr_finfo_t finfo;
+    walk_dir_t *d;
+    walk_t *w;
+    apr_pool_t *pool;
+    apr_status_t rv;
+
+#if !APR_HAS_THREADS
+    if (tp) {
+        return APR_ENOTIMPL;
+    }
+#endif
+
+    wanted |= APR_FINFO_TYPE;
+    rv = apr_stat(&finfo, root, wanted, p);
+    if (rv != APR_SUCCESS && rv != APR_INCOMPLETE) {
+        return rv;
+    }
+    if (!(finfo.valid & APR_FINFO_TYPE) || finfo.filetype != APR_DIR) {
+        return func(baton, root, &finfo, p);
+    }
+
+    /* Directories are created and destroyed by the threads of tp */
+    if ((rv = apr_allocator_create(&allocator)) != APR_SUCCESS) {
+        return rv;
+    }
+    if ((rv = apr_pool_create_ex(&pool, p, NULL, allocator)) != APR_SUCCESS) {
+        apr_allocator_destroy(allocator);
+        return rv;
+    }
+    apr_allocator_owner_set(allocator, pool);
+    apr_pool_tag(pool, "apr_dir_walk");
+
+    w = apr_pcalloc(pool, sizeof(*w));
+    w->pool = pool;
+    w->wanted = wanted;
+    w->flags = flags;
+    w->func = func;
+    w->baton = baton;
+
+#if APR_HAS_THREADS
+    if (tp) {
+        apr_thread_mutex_t *mutex;
+
+        w->tp = tp;
+        if ((rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT,
+                                          pool)) != APR_SUCCESS
+            || (rv = apr_thread_mutex_create(&w->lock,
+                                             APR_THREAD_MUTEX_DEFAULT,
+                                             pool)) != APR_SUCCESS
+            || (rv = apr_thread_cond_create(&w->cond, pool)) != APR_SUCCESS) {
+            apr_pool_destroy(pool);
+            return rv;
+        }
+        apr_allocator_mutex_set(allocator, mutex);
+        if ((flags & APR_DIR_WALK_SERIAL)
+            && (rv = apr_thread_mutex_create(&w->func_lock,
+                                             APR_THREAD_MUTEX_DEFAULT,
+                                             pool)) != APR_SUCCESS) {
+            apr_pool_destroy(pool);
+            return rv;
+        }
+    }
+#endif
+
+    rv = walk_dir_make(&d, w, NULL, root, &finfo);
+    if (rv != APR_SUCCESS) {
+        apr_pool_destroy(pool);
+        return rv;
+    }
+    if (!(flags & APR_DIR_WALK_POSTORDER)) {
+        walk_call(w, d->path, &d->finfo, d->pool);
+    }
+    walk_push(d);
+
+#if APR_HAS_THREADS
+    if (w->tp) {
+        apr_thread_mutex_lock(w->lock);
+        while (w->pending) {
+            apr_thread_cond_wait(w->cond, w->lock);
+        }
+        apr_thread_mutex_unlock(w->lock);
+    }
+#endif
+    /* Depth first, without a thread pool */
+    while ((d = w->queue)) {
+        w->queue = d->next;
+        walk_read(d);
+        walk_release(d);
+    }
+
+    rv = w->status;
+    apr_pool_destroy(pool);
+    return rv;
+}
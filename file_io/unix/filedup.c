@@ -60,7 +60,25 @@ static apr_status_t file_dup(apr_file_t **new_file,
         }
 #endif
     } else {
+        /* Not inherited until apr_file_inherit_set(), like the files
+         * opened by apr_file_open()
+         */
+#ifdef F_DUPFD_CLOEXEC
+        rv = fcntl(old_file->filedes, F_DUPFD_CLOEXEC, 0);
+#else
         rv = dup(old_file->filedes);
+        if (rv != -1) {
+            int flags;
+
+            if ((flags = fcntl(rv, F_GETFD)) == -1
+                || fcntl(rv, F_SETFD, flags | FD_CLOEXEC) == -1) {
+                apr_status_t status = errno;
+
+                close(rv);
+                return status;
+            }
+        }
+#endif
     }
 
     if (rv == -1)
@@ -91,6 +109,7 @@ static apr_status_t file_dup(apr_file_t **new_file,
     if ((*new_file)->buffered && !(*new_file)->buffer) {
         (*new_file)->buffer = apr_palloc(p, old_file->bufsize);
         (*new_file)->bufsize = old_file->bufsize;
+        (*new_file)->bufgrow = old_file->bufgrow;
     }
 
     /* this is the way dup() works */
@@ -156,8 +175,13 @@ APR_DECLARE(apr_status_t) apr_file_setaside(apr_file_t **new_file,
                                             apr_file_t *old_file,
                                             apr_pool_t *p)
 {
+    if (old_file->stages) {
+        /* The stages belong to the old pool, the new file is buffered */
+        apr_file_flush(old_file);
+    }
     *new_file = (apr_file_t *)apr_pmemdup(p, old_file, sizeof(apr_file_t));
     (*new_file)->pool = p;
+    (*new_file)->stages = NULL;
     if (old_file->buffered) {
         (*new_file)->buffer = apr_palloc(p, old_file->bufsize);
         (*new_file)->bufsize = old_file->bufsize;
@@ -78,19 +78,49 @@ APR_DECLARE(apr_status_t) apr_filepath_root(const char **rootpath,
     return APR_ERELATIVE;
 }
 
-APR_DECLARE(apr_status_t) apr_filepath_merge(char **newpath,
-                                             const char *rootpath,
-                                             const char *addpath,
-                                             apr_int32_t flags,
-                                             apr_pool_t *p)
+/* Whether addpath has no empty, "." nor ".." segment, so that it can be
+ * appended as is.  The slashes are found by memchr(), which the C
+ * libraries vectorize.
+ */
+static int filepath_is_canonical(const char *addpath, apr_size_t len)
+{
+    const char *end = addpath + len, *slash;
+    apr_size_t seglen;
+
+    for (;;) {
+        slash = memchr(addpath, '/', end - addpath);
+        seglen = (slash ? slash : end) - addpath;
+        if (slash && seglen == 0) {
+            return 0;
+        }
+        if (addpath[0] == '.'
+            && (seglen == 1 || (seglen == 2 && addpath[1] == '.'))) {
+            return 0;
+        }
+        if (!slash) {
+            return 1;
+        }
+        addpath = slash + 1;
+    }
+}
+
+/* Merge into buf (of size bytes), or into a buffer allocated from p if
+ * buf is NULL.
+ */
+static apr_status_t filepath_merge(char **newpath, char *buf,
+                                   apr_size_t size,
+                                   const char *rootpath,
+                                   const char *addpath,
+                                   apr_int32_t flags, apr_pool_t *p)
 {
     char *path;
+    char cwd[APR_PATH_MAX];
     apr_size_t rootlen; /* is the length of the src rootpath */
+    apr_size_t addlen;  /* is the length of the addpath */
     apr_size_t maxlen;  /* maximum total path length */
     apr_size_t keptlen; /* is the length of the retained rootpath */
     apr_size_t pathlen; /* is the length of the result path */
     apr_size_t seglen;  /* is the end of the current segment */
-    apr_status_t rv;
 
     /* Treat null as an empty path.
      */
@@ -129,16 +159,14 @@ APR_DECLARE(apr_status_t) apr_filepath_merge(char **newpath,
     }
 
     if (!rootpath) {
-        /* Start with the current working path.  This is bass akwards,
-         * but required since the compiler (at least vc) doesn't like
-         * passing the address of a char const* for a char** arg.
+        /* Start with the current working path, like apr_filepath_get()
+         * but with no allocation.
          */
-        char *getpath;
-        rv = apr_filepath_get(&getpath, flags, p);
-        if (rv != APR_SUCCESS)
-            return errno;
+        if (!getcwd(cwd, sizeof(cwd))) {
+            return errno == ERANGE ? APR_ENAMETOOLONG : errno;
+        }
 
-        rootpath = getpath;
+        rootpath = cwd;
         /* XXX: Any kernel subject to goofy, uncanonical results
          * must run the rootpath against the user's given flags.
          * Simplest would be a recursive call to apr_filepath_merge
@@ -147,13 +175,14 @@ APR_DECLARE(apr_status_t) apr_filepath_merge(char **newpath,
     }
 
     rootlen = strlen(rootpath);
-    maxlen = rootlen + strlen(addpath) + 4; /* 4 for slashes at start, after
-                                             * root, and at end, plus trailing
-                                             * null */
-    if (maxlen > APR_PATH_MAX) {
+    addlen = strlen(addpath);
+    maxlen = rootlen + addlen + 4; /* 4 for slashes at start, after
+                                    * root, and at end, plus trailing
+                                    * null */
+    if (maxlen > APR_PATH_MAX || maxlen > size) {
         return APR_ENAMETOOLONG;
     }
-    path = (char *)apr_palloc(p, maxlen);
+    path = buf ? buf : (char *)apr_palloc(p, maxlen);
 
     if (addpath[0] == '/') {
         /* Ignore the given root path, strip off leading
@@ -161,8 +190,10 @@ APR_DECLARE(apr_status_t) apr_filepath_merge(char **newpath,
          * and leave addpath at the first non-'/' character.
          */
         keptlen = 0;
-        while (addpath[0] == '/')
+        while (addpath[0] == '/') {
             ++addpath;
+            --addlen;
+        }
         path[0] = '/';
         pathlen = 1;
     }
@@ -185,6 +216,13 @@ APR_DECLARE(apr_status_t) apr_filepath_merge(char **newpath,
         pathlen = keptlen;
     }
 
+    /* The usual case, nothing to resolve: take it all at once */
+    if (filepath_is_canonical(addpath, addlen)) {
+        memcpy(path + pathlen, addpath, addlen);
+        pathlen += addlen;
+        addpath += addlen;
+    }
+
     while (*addpath) {
         /* Parse each segment, find the closing '/'
          */
@@ -289,6 +327,27 @@ APR_DECLARE(apr_status_t) apr_filepath_merge(char **newpath,
     return APR_SUCCESS;
 }
 
+APR_DECLARE(apr_status_t) apr_filepath_merge(char **newpath,
+                                             const char *rootpath,
+                                             const char *addpath,
+                                             apr_int32_t flags,
+                                             apr_pool_t *p)
+{
+    return filepath_merge(newpath, NULL, APR_PATH_MAX, rootpath, addpath,
+                          flags, p);
+}
+
+APR_DECLARE(apr_status_t) apr_filepath_merge_buf(char *buf, apr_size_t size,
+                                                 const char *rootpath,
+                                                 const char *addpath,
+                                                 apr_int32_t flags,
+                                                 apr_pool_t *p)
+{
+    char *path;
+
+    return filepath_merge(&path, buf, size, rootpath, addpath, flags, NULL);
+}
+
 APR_DECLARE(apr_status_t) apr_filepath_encoding(int *style, apr_pool_t *p)
 {
 #if defined(DARWIN)
@@ -20,6 +20,7 @@
 #include "apr_want.h"
 #include "apr_file_info.h"
 #include "apr_errno.h"
+#include "apr_hash.h"
 #include "apr_pools.h"
 #include "apr_strings.h"
 #include "apr_tables.h"
@@ -113,3 +114,183 @@ APR_DECLARE(apr_status_t) apr_filepath_list_merge(char **liststr,
     *path = '\0';
     return APR_SUCCESS;
 }
+
+
+/* The cached merges: the key (rootpath and addpath, NUL terminated) and
+ * the result share the buffer of each entry, so the longer paths are not
+ * cached.  The entries are chained by index in their bucket, and in the
+ * order of their use.
+ */
+#define FILEPATH_CACHE_BUF 512
+
+typedef struct filepath_cache_entry_t {
+    unsigned int hash;
+    apr_int32_t flags;
+    int bucket_next;
+    int lru_prev;
+    int lru_next;
+    apr_size_t rootlen;
+    apr_size_t addlen;
+    apr_size_t pathlen;
+    char buf[FILEPATH_CACHE_BUF];
+} filepath_cache_entry_t;
+
+struct apr_filepath_cache_t {
+    filepath_cache_entry_t *entries;
+    int *buckets;
+    unsigned int mask;
+    int size;
+    int used;
+    int lru_first;  /* the most recently used */
+    int lru_last;   /* the least recently used */
+};
+
+APR_DECLARE(apr_status_t) apr_filepath_cache_create(
+                                                apr_filepath_cache_t **cache,
+                                                int size, apr_pool_t *p)
+{
+    apr_filepath_cache_t *c;
+    unsigned int nbuckets = 1;
+    unsigned int i;
+
+    if (size < 1) {
+        return APR_EINVAL;
+    }
+    while (nbuckets < (unsigned int)size) {
+        nbuckets <<= 1;
+    }
+
+    c = apr_palloc(p, sizeof(*c));
+    c->entries = apr_palloc(p, size * sizeof(filepath_cache_entry_t));
+    c->buckets = apr_palloc(p, nbuckets * sizeof(int));
+    for (i = 0; i < nbuckets; i++) {
+        c->buckets[i] = -1;
+    }
+    c->mask = nbuckets - 1;
+    c->size = size;
+    c->used = 0;
+    c->lru_first = c->lru_last = -1;
+
+    *cache = c;
+    return APR_SUCCESS;
+}
+
+static void filepath_cache_unlink(apr_filepath_cache_t *c, int i)
+{
+    filepath_cache_entry_t *e = &c->entries[i];
+
+    if (e->lru_prev >= 0) {
+        c->entries[e->lru_prev].lru_next = e->lru_next;
+    }
+    else {
+        c->lru_first = e->lru_next;
+    }
+    if (e->lru_next >= 0) {
+        c->entries[e->lru_next].lru_prev = e->lru_prev;
+    }
+    else {
+        c->lru_last = e->lru_prev;
+    }
+}
+
+static void filepath_cache_use(apr_filepath_cache_t *c, int i)
+{
+    filepath_cache_entry_t *e = &c->entries[i];
+
+    e->lru_prev = -1;
+    e->lru_next = c->lru_first;
+    if (c->lru_first >= 0) {
+        c->entries[c->lru_first].lru_prev = i;
+    }
+    else {
+        c->lru_last = i;
+    }
+    c->lru_first = i;
+}
+
+APR_DECLARE(apr_status_t) apr_filepath_merge_cached(char **newpath,
+                                               apr_filepath_cache_t *cache,
+                                               const char *rootpath,
+                                               const char *addpath,
+                                               apr_int32_t flags,
+                                               apr_pool_t *p)
+{
+    char path[FILEPATH_CACHE_BUF];
+    filepath_cache_entry_t *e;
+    apr_ssize_t rootlen, addlen;
+    apr_size_t keylen, pathlen;
+    unsigned int hash;
+    apr_status_t rv;
+    int i, *link;
+
+    if (!addpath) {
+        addpath = "";
+    }
+    /* The current working path may change */
+    if (!rootpath) {
+        return apr_filepath_merge(newpath, rootpath, addpath, flags, p);
+    }
+
+    rootlen = APR_HASH_KEY_STRING;
+    addlen = APR_HASH_KEY_STRING;
+    hash = apr_hashfunc_default(rootpath, &rootlen) * 33;
+    hash ^= apr_hashfunc_default(addpath, &addlen);
+    hash ^= (unsigned int)flags;
+    keylen = rootlen + addlen + 2;
+
+    for (i = cache->buckets[hash & cache->mask]; i >= 0;
+         i = cache->entries[i].bucket_next) {
+        e = &cache->entries[i];
+        if (e->hash == hash && e->flags == flags
+            && e->rootlen == (apr_size_t)rootlen
+            && e->addlen == (apr_size_t)addlen
+            && !memcmp(e->buf, rootpath, rootlen)
+            && !memcmp(e->buf + rootlen + 1, addpath, addlen)) {
+            filepath_cache_unlink(cache, i);
+            filepath_cache_use(cache, i);
+            *newpath = apr_pstrmemdup(p, e->buf + keylen, e->pathlen);
+            return APR_SUCCESS;
+        }
+    }
+
+    if (keylen >= FILEPATH_CACHE_BUF) {
+        return apr_filepath_merge(newpath, rootpath, addpath, flags, p);
+    }
+    rv = apr_filepath_merge_buf(path, FILEPATH_CACHE_BUF - keylen, rootpath,
+                                addpath, flags, p);
+    if (rv != APR_SUCCESS) {
+        /* Too long to be cached, or failed (possibly with a result) */
+        return apr_filepath_merge(newpath, rootpath, addpath, flags, p);
+    }
+    pathlen = strlen(path);
+
+    /* Take a new entry, or replace the least recently used one */
+    if (cache->used < cache->size) {
+        i = cache->used++;
+    }
+    else {
+        i = cache->lru_last;
+        e = &cache->entries[i];
+        for (link = &cache->buckets[e->hash & cache->mask]; *link != i;
+             link = &cache->entries[*link].bucket_next) {
+            /* find the link to the entry */
+        }
+        *link = e->bucket_next;
+        filepath_cache_unlink(cache, i);
+    }
+    e = &cache->entries[i];
+    e->hash = hash;
+    e->flags = flags;
+    e->rootlen = rootlen;
+    e->addlen = addlen;
+    e->pathlen = pathlen;
+    memcpy(e->buf, rootpath, rootlen + 1);
+    memcpy(e->buf + rootlen + 1, addpath, addlen + 1);
+    memcpy(e->buf + keylen, path, pathlen + 1);
+    e->bucket_next = cache->buckets[hash & cache->mask];
+    cache->buckets[hash & cache->mask] = i;
+    filepath_cache_use(cache, i);
+
+    *newpath = apr_pstrmemdup(p, e->buf + keylen, pathlen);
+    return APR_SUCCESS;
+}
@@ -23,6 +23,9 @@
 #ifdef HAVE_UTIME
 #include <utime.h>
 #endif
+#ifdef HAVE_SYS_SYSMACROS_H
+#include <sys/sysmacros.h> /* for makedev() */
+#endif
 
 static apr_filetype_e filetype_from_mode(mode_t mode)
 {
@@ -126,49 +129,171 @@ static void fill_out_finfo(apr_finfo_t *finfo, struct_stat *info,
 #endif
 }
 
-apr_status_t apr_file_info_get_locked(apr_finfo_t *finfo, apr_int32_t wanted,
-                                      apr_file_t *thefile)
+#ifdef HAVE_STATX
+/* The fields of statx() needed for each of the wanted ones */
+static const struct {
+    apr_int32_t wanted;
+    unsigned int mask;
+} statx_fields[] = {
+    { APR_FINFO_TYPE,  STATX_TYPE },
+    { APR_FINFO_PROT,  STATX_MODE },
+    { APR_FINFO_USER,  STATX_UID },
+    { APR_FINFO_GROUP, STATX_GID },
+    { APR_FINFO_NLINK, STATX_NLINK },
+    { APR_FINFO_INODE, STATX_INO },
+    { APR_FINFO_SIZE,  STATX_SIZE },
+    { APR_FINFO_CSIZE, STATX_BLOCKS },
+    { APR_FINFO_ATIME, STATX_ATIME },
+    { APR_FINFO_MTIME, STATX_MTIME },
+    { APR_FINFO_CTIME, STATX_CTIME }
+};
+
+/* Stat with statx(), asking only for the wanted fields so that the
+ * filesystems which have to fetch them (e.g. network ones) do not fetch
+ * the others, and answering from their caches with APR_FINFO_NOSYNC.
+ * Returns 0 or -1 and errno like stat(), with ENOSYS if statx() is not
+ * supported by the kernel, to fall back to the usual calls.
+ */
+static int finfo_statx(apr_finfo_t *finfo, int dirfd, const char *name,
+                       int flags, apr_int32_t wanted)
 {
     struct_stat info;
+    struct statx stx;
+    unsigned int mask = 0;
+    apr_size_t i;
 
-    if (thefile->buffered) {
-        apr_status_t rv = apr_file_flush_locked(thefile);
-        if (rv != APR_SUCCESS)
-            return rv;
+    for (i = 0; i < sizeof(statx_fields) / sizeof(statx_fields[0]); i++) {
+        if (wanted & statx_fields[i].wanted) {
+            mask |= statx_fields[i].mask;
+        }
+    }
+    if (wanted & APR_FINFO_NOSYNC) {
+        flags |= AT_STATX_DONT_SYNC;
+    }
+    if (statx(dirfd, name, flags, mask, &stx)) {
+        return -1;
     }
 
-    if (fstat(thefile->filedes, &info) == 0) {
-        finfo->pool = thefile->pool;
-        finfo->fname = thefile->fname;
+    memset(&info, 0, sizeof(info));
+    info.st_mode = stx.stx_mode;
+    info.st_uid = stx.stx_uid;
+    info.st_gid = stx.stx_gid;
+    info.st_nlink = stx.stx_nlink;
+    info.st_ino = stx.stx_ino;
+    info.st_dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+    info.st_size = stx.stx_size;
+#ifdef HAVE_STRUCT_STAT_ST_BLOCKS
+    info.st_blocks = stx.stx_blocks;
+#endif
+    info.st_atime = stx.stx_atime.tv_sec;
+    info.st_mtime = stx.stx_mtime.tv_sec;
+    info.st_ctime = stx.stx_ctime.tv_sec;
+#ifdef HAVE_STRUCT_STAT_ST_ATIM_TV_NSEC
+    info.st_atim.tv_nsec = stx.stx_atime.tv_nsec;
+    info.st_mtim.tv_nsec = stx.stx_mtime.tv_nsec;
+    info.st_ctim.tv_nsec = stx.stx_ctime.tv_nsec;
+#endif
+    fill_out_finfo(finfo, &info, wanted);
+    for (i = 0; i < sizeof(statx_fields) / sizeof(statx_fields[0]); i++) {
+        if (!(stx.stx_mask & statx_fields[i].mask)) {
+            finfo->valid &= ~statx_fields[i].wanted;
+        }
+    }
+    return 0;
+}
+#endif /* HAVE_STATX */
+
+static APR_INLINE apr_status_t finfo_status(const apr_finfo_t *finfo,
+                                            apr_int32_t wanted)
+{
+    wanted &= ~(APR_FINFO_LINK | APR_FINFO_NOSYNC);
+    return (wanted & ~finfo->valid) ? APR_INCOMPLETE : APR_SUCCESS;
+}
+
+#if defined(HAVE_STATX) || defined(HAVE_FSTATAT)
+/* Stat a directory entry without building its path, with statx() asking
+ * only for the wanted fields where available.
+ */
+apr_status_t apr_unix_stat_at(apr_finfo_t *finfo, int dirfd,
+                              const char *name, apr_int32_t wanted,
+                              apr_pool_t *pool)
+{
+    int srv = -1;
+
+#ifdef HAVE_STATX
+    srv = finfo_statx(finfo, dirfd, name,
+                      AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, wanted);
+    if (srv && errno != ENOSYS) {
+        return errno;
+    }
+#endif
+#ifdef HAVE_FSTATAT
+    if (srv) {
+        struct_stat info;
+
+        if (fstatat(dirfd, name, &info, AT_SYMLINK_NOFOLLOW)) {
+            return errno;
+        }
         fill_out_finfo(finfo, &info, wanted);
-        return (wanted & ~finfo->valid) ? APR_INCOMPLETE : APR_SUCCESS;
+        srv = 0;
     }
-    else {
+#endif
+    if (srv) {
+        return APR_ENOTIMPL;
+    }
+    finfo->pool = pool;
+    finfo->fname = NULL;
+    return finfo_status(finfo, wanted);
+}
+#endif /* HAVE_STATX || HAVE_FSTATAT */
+
+static apr_status_t file_info_get(apr_finfo_t *finfo, apr_int32_t wanted,
+                                  apr_file_t *thefile)
+{
+    int srv = -1;
+
+#ifdef HAVE_STATX
+    srv = finfo_statx(finfo, thefile->filedes, "", AT_EMPTY_PATH, wanted);
+    if (srv && errno != ENOSYS) {
         return errno;
     }
+#endif
+    if (srv) {
+        struct_stat info;
+
+        if (fstat(thefile->filedes, &info)) {
+            return errno;
+        }
+        fill_out_finfo(finfo, &info, wanted);
+    }
+    finfo->pool = thefile->pool;
+    finfo->fname = thefile->fname;
+    return finfo_status(finfo, wanted);
+}
+
+apr_status_t apr_file_info_get_locked(apr_finfo_t *finfo, apr_int32_t wanted,
+                                      apr_file_t *thefile)
+{
+    if (thefile->buffered) {
+        apr_status_t rv = apr_file_flush_locked(thefile);
+        if (rv != APR_SUCCESS)
+            return rv;
+    }
+
+    return file_info_get(finfo, wanted, thefile);
 }
 
 APR_DECLARE(apr_status_t) apr_file_info_get(apr_finfo_t *finfo,
                                             apr_int32_t wanted,
                                             apr_file_t *thefile)
 {
-    struct_stat info;
-
     if (thefile->buffered) {
         apr_status_t rv = apr_file_flush(thefile);
         if (rv != APR_SUCCESS)
             return rv;
     }
 
-    if (fstat(thefile->filedes, &info) == 0) {
-        finfo->pool = thefile->pool;
-        finfo->fname = thefile->fname;
-        fill_out_finfo(finfo, &info, wanted);
-        return (wanted & ~finfo->valid) ? APR_INCOMPLETE : APR_SUCCESS;
-    }
-    else {
-        return errno;
-    }
+    return file_info_get(finfo, wanted, thefile);
 }
 
 APR_DECLARE(apr_status_t) apr_file_perms_set(const char *fname,
@@ -286,20 +411,29 @@ APR_DECLARE(apr_status_t) apr_stat(apr_finfo_t *finfo,
                                    apr_int32_t wanted, apr_pool_t *pool)
 {
     struct_stat info;
-    int srv;
-
-    if (wanted & APR_FINFO_LINK)
-        srv = lstat(fname, &info);
-    else
-        srv = stat(fname, &info);
+    int srv = -1;
+
+#ifdef HAVE_STATX
+    /* Like stat() and lstat(), which do not trigger the automounts */
+    srv = finfo_statx(finfo, AT_FDCWD, fname,
+                      AT_NO_AUTOMOUNT | ((wanted & APR_FINFO_LINK)
+                                         ? AT_SYMLINK_NOFOLLOW : 0),
+                      wanted);
+    if (srv && errno == ENOSYS)
+#endif
+    {
+        if (wanted & APR_FINFO_LINK)
+            srv = lstat(fname, &info);
+        else
+            srv = stat(fname, &info);
+        if (srv == 0)
+            fill_out_finfo(finfo, &info, wanted);
+    }
 
     if (srv == 0) {
         finfo->pool = pool;
         finfo->fname = fname;
-        fill_out_finfo(finfo, &info, wanted);
-        if (wanted & APR_FINFO_LINK)
-            wanted &= ~APR_FINFO_LINK;
-        return (wanted & ~finfo->valid) ? APR_INCOMPLETE : APR_SUCCESS;
+        return finfo_status(finfo, wanted);
     }
     else {
 #if !defined(ENOENT) || !defined(ENOTDIR)
@@ -0,0 +1,201 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_file_io.h"
+#include "apr_thread_mutex.h"
+#include "apr_thread_cond.h"
+
+/*
+ * Group commit: the tickets are numbered in the order of the writes, and
+ * a sync started once ticket N was issued makes tickets 1..N durable.
+ * The first waiter finding no sync running leads one for all the tickets
+ * issued so far, the others wait for it and lead the next one if theirs
+ * was issued after it started.
+ */
+struct apr_file_group_commit_t {
+    apr_pool_t *pool;
+    apr_file_t *file;
+    apr_interval_time_t delay;
+    apr_uint32_t flags;
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *lock;
+    apr_thread_cond_t *cond;
+#endif
+    /* The last ticket issued, and the last one durable */
+    apr_uint64_t issued;
+    apr_uint64_t synced;
+    /* The tickets (failed_from, failed_to] of the last failed sync */
+    apr_uint64_t failed_from;
+    apr_uint64_t failed_to;
+    apr_status_t failed_rv;
+    int syncing;
+};
+
+#if APR_HAS_THREADS
+#define gc_lock(gc)   apr_thread_mutex_lock((gc)->lock)
+#define gc_unlock(gc) apr_thread_mutex_unlock((gc)->lock)
+#else
+#define gc_lock(gc)
+#define gc_unlock(gc)
+#endif
+
+APR_DECLARE(apr_status_t) apr_file_group_commit_create(
+                                            apr_file_group_commit_t **gc,
+                                            apr_file_t *file,
+                                            apr_interval_time_t delay,
+                                            apr_uint32_t flags,
+                                            apr_pool_t *p)
+{
+    apr_file_group_commit_t *new_gc;
+#if APR_HAS_THREADS
+    apr_status_t rv;
+#endif
+
+    new_gc = apr_pcalloc(p, sizeof(*new_gc));
+    new_gc->pool = p;
+    new_gc->file = file;
+    new_gc->delay = delay;
+    new_gc->flags = flags;
+
+#if APR_HAS_THREADS
+    rv = apr_thread_mutex_create(&new_gc->lock, APR_THREAD_MUTEX_DEFAULT, p);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    rv = apr_thread_cond_create(&new_gc->cond, p);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+#endif
+
+    *gc = new_gc;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_file_group_commit_write(
+                                            apr_file_group_commit_t *gc,
+                                            const void *buf,
+                                            apr_size_t nbytes,
+                                            apr_uint64_t *ticket)
+{
+    apr_status_t rv;
+
+    gc_lock(gc);
+    rv = apr_file_write_full(gc->file, buf, nbytes, NULL);
+    if (rv == APR_SUCCESS) {
+        *ticket = ++gc->issued;
+    }
+    gc_unlock(gc);
+
+    return rv;
+}
+
+APR_DECLARE(apr_uint64_t) apr_file_group_commit_ticket(
+                                            apr_file_group_commit_t *gc)
+{
+    apr_uint64_t ticket;
+
+    gc_lock(gc);
+    ticket = ++gc->issued;
+    gc_unlock(gc);
+
+    return ticket;
+}
+
+/* Called with the lock held, returns with it held */
+static apr_status_t gc_sync(apr_file_group_commit_t *gc)
+{
+    apr_uint64_t from = gc->synced, to;
+    apr_status_t rv;
+
+    gc->syncing = 1;
+
+    if (gc->delay > 0) {
+        /* Let more writers join this sync */
+        gc_unlock(gc);
+        apr_sleep(gc->delay);
+        gc_lock(gc);
+    }
+
+    /* The writes of the tickets issued so far are all done, get them
+     * out of the buffer before letting the writers in again.
+     */
+    to = gc->issued;
+    rv = apr_file_flush(gc->file);
+    gc_unlock(gc);
+
+    if (rv == APR_SUCCESS) {
+        if (gc->flags & APR_FILE_GROUP_COMMIT_FULLSYNC) {
+            rv = apr_file_sync(gc->file);
+        }
+        else {
+            rv = apr_file_datasync(gc->file);
+        }
+    }
+
+    gc_lock(gc);
+    if (rv == APR_SUCCESS) {
+        gc->synced = to;
+    }
+    else {
+        gc->failed_from = from;
+        gc->failed_to = to;
+        gc->failed_rv = rv;
+    }
+    gc->syncing = 0;
+#if APR_HAS_THREADS
+    apr_thread_cond_broadcast(gc->cond);
+#endif
+
+    return rv;
+}
+
+APR_DECLARE(apr_status_t) apr_file_group_commit_wait(
+                                            apr_file_group_commit_t *gc,
+                                            apr_uint64_t ticket)
+{
+    apr_status_t rv = APR_SUCCESS;
+
+    if (ticket == 0) {
+        return APR_EINVAL;
+    }
+
+    gc_lock(gc);
+    if (ticket > gc->issued) {
+        gc_unlock(gc);
+        return APR_EINVAL;
+    }
+    for (;;) {
+        if (ticket > gc->failed_from && ticket <= gc->failed_to) {
+            rv = gc->failed_rv;
+            break;
+        }
+        if (ticket <= gc->synced) {
+            rv = APR_SUCCESS;
+            break;
+        }
+        if (!gc->syncing) {
+            gc_sync(gc);
+            continue;
+        }
+#if APR_HAS_THREADS
+        apr_thread_cond_wait(gc->cond, gc->lock);
+#endif
+    }
+    gc_unlock(gc);
+
+    return rv;
+}
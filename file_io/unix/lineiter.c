@@ -0,0 +1,121 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_file_io.h"
+
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+#define LINE_ITER_BUFSIZE (64 * 1024)
+
+struct apr_file_line_iter_t {
+    apr_pool_t *pool;
+    apr_file_t *file;
+    char *buf;
+    apr_size_t size;
+    /* The data not returned yet is buf[pos, end), without a newline in
+     * its first scanned bytes.
+     */
+    apr_size_t pos;
+    apr_size_t end;
+    apr_size_t scanned;
+    int eof;
+};
+
+APR_DECLARE(apr_status_t) apr_file_line_iter_create(
+                                            apr_file_line_iter_t **iter,
+                                            apr_file_t *thefile,
+                                            apr_size_t bufsize,
+                                            apr_pool_t *p)
+{
+    apr_file_line_iter_t *it;
+
+    it = apr_pcalloc(p, sizeof(*it));
+    it->pool = p;
+    it->file = thefile;
+    it->size = bufsize ? bufsize : LINE_ITER_BUFSIZE;
+    it->buf = apr_palloc(p, it->size);
+
+    *iter = it;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_file_line_iter_next(apr_file_line_iter_t *iter,
+                                                  const char **line,
+                                                  apr_size_t *len)
+{
+    for (;;) {
+        apr_size_t avail = iter->end - iter->pos;
+        apr_size_t n;
+        apr_status_t rv;
+
+        /* memchr() is the vectorized search of the C library */
+        if (avail > iter->scanned) {
+            const char *start = iter->buf + iter->pos;
+            const char *nl = memchr(start + iter->scanned, '\n',
+                                    avail - iter->scanned);
+
+            if (nl) {
+                *line = start;
+                *len = nl - start + 1;
+                iter->pos += *len;
+                iter->scanned = 0;
+                return APR_SUCCESS;
+            }
+            iter->scanned = avail;
+        }
+
+        if (iter->eof) {
+            if (avail) {
+                *line = iter->buf + iter->pos;
+                *len = avail;
+                iter->pos = iter->end;
+                iter->scanned = 0;
+                return APR_SUCCESS;
+            }
+            *line = NULL;
+            *len = 0;
+            return APR_EOF;
+        }
+
+        /* Keep the start of a line straddling the end of the buffer,
+         * doubling the buffer for a line longer than it.
+         */
+        if (iter->pos) {
+            memmove(iter->buf, iter->buf + iter->pos, avail);
+            iter->pos = 0;
+            iter->end = avail;
+        }
+        if (iter->end == iter->size) {
+            char *buf = apr_palloc(iter->pool, iter->size * 2);
+
+            memcpy(buf, iter->buf, iter->end);
+            iter->buf = buf;
+            iter->size *= 2;
+        }
+
+        n = iter->size - iter->end;
+        rv = apr_file_read(iter->file, iter->buf + iter->end, &n);
+        if (rv == APR_EOF) {
+            iter->eof = 1;
+        }
+        else if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        iter->end += n;
+    }
+}
@@ -217,8 +217,9 @@ APR_DECLARE(apr_status_t) apr_file_open(apr_file_t **new,
     (*new)->buffered = (flag & APR_FOPEN_BUFFERED) > 0;
 
     if ((*new)->buffered) {
-        (*new)->buffer = apr_palloc(pool, APR_FILE_DEFAULT_BUFSIZE);
-        (*new)->bufsize = APR_FILE_DEFAULT_BUFSIZE;
+        (*new)->buffer = apr_palloc(pool, apr_file_default_bufsize);
+        (*new)->bufsize = apr_file_default_bufsize;
+        (*new)->bufgrow = apr_file_max_bufsize > apr_file_default_bufsize;
     }
     else {
         (*new)->buffer = NULL;
@@ -332,8 +333,9 @@ APR_DECLARE(apr_status_t) apr_os_file_put(apr_file_t **file,
 #endif
 
     if ((*file)->buffered) {
-        (*file)->buffer = apr_palloc(pool, APR_FILE_DEFAULT_BUFSIZE);
-        (*file)->bufsize = APR_FILE_DEFAULT_BUFSIZE;
+        (*file)->buffer = apr_palloc(pool, apr_file_default_bufsize);
+        (*file)->bufsize = apr_file_default_bufsize;
+        (*file)->bufgrow = apr_file_max_bufsize > apr_file_default_bufsize;
 #if APR_HAS_THREADS
         if ((*file)->flags & APR_FOPEN_XTHREAD) {
             apr_status_t rv;
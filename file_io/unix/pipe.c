@@ -133,6 +133,46 @@ APR_DECLARE(apr_status_t) apr_file_pipe_timeout_get(apr_file_t *thepipe, apr_int
     return APR_EINVAL;
 }
 
+APR_DECLARE(apr_status_t) apr_file_pipe_size_set(apr_file_t *thepipe,
+                                                 apr_size_t size)
+{
+    if (thepipe->is_pipe != 1) {
+        return APR_EINVAL;
+    }
+#ifdef F_SETPIPE_SZ
+    if (size > APR_INT32_MAX) {
+        return APR_EINVAL;
+    }
+    if (fcntl(thepipe->filedes, F_SETPIPE_SZ, (int)size) < 0) {
+        return errno;
+    }
+    return APR_SUCCESS;
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
+APR_DECLARE(apr_status_t) apr_file_pipe_size_get(apr_file_t *thepipe,
+                                                 apr_size_t *size)
+{
+    if (thepipe->is_pipe != 1) {
+        return APR_EINVAL;
+    }
+#ifdef F_GETPIPE_SZ
+    {
+        int rc = fcntl(thepipe->filedes, F_GETPIPE_SZ);
+
+        if (rc < 0) {
+            return errno;
+        }
+        *size = rc;
+        return APR_SUCCESS;
+    }
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
 APR_DECLARE(apr_status_t) apr_os_pipe_put_ex(apr_file_t **file,
                                              apr_os_file_t *thefile,
                                              int register_cleanup,
@@ -20,6 +20,9 @@
 #include "apr_support.h"
 #include "apr_time.h"
 #include "apr_file_info.h"
+#include "apr_hash.h"
+#include "apr_portable.h"
+#include "apr_metrics.h"
 
 /* The only case where we don't use wait_for_io_or_timeout is on
  * pre-BONE BeOS, so this check should be sufficient and simpler */
@@ -54,7 +57,13 @@ static apr_status_t file_read_buffered(apr_file_t *thefile, void *buf,
     }
     while (rv == 0 && size > 0) {
         if (thefile->bufpos >= thefile->dataRead) {
-            int bytesread = read(thefile->filedes, thefile->buffer,
+            int bytesread;
+
+            /* The whole buffer read, sequentially */
+            if (thefile->bufgrow && thefile->dataRead == thefile->bufsize) {
+                apr_file_buffer_grow(thefile);
+            }
+            bytesread = read(thefile->filedes, thefile->buffer,
                                  thefile->bufsize);
             if (bytesread == 0) {
                 thefile->eof_hit = TRUE;
@@ -223,6 +232,136 @@ APR_DECLARE(apr_status_t) apr_file_rotating_manual_check(apr_file_t *thefile, ap
     return APR_SUCCESS;
 }
 
+/* Write a record in full, whatever the size of the vector; with
+ * O_APPEND each writev() lands at the end of the file at once.
+ */
+static apr_status_t stage_writev(int fd, const struct iovec *vec,
+                                 apr_size_t nvec)
+{
+    struct iovec iov[APR_MAX_IOVEC_SIZE];
+    apr_size_t i, n;
+    apr_ssize_t rc;
+
+    while (nvec) {
+        n = nvec > APR_MAX_IOVEC_SIZE ? APR_MAX_IOVEC_SIZE : nvec;
+        memcpy(iov, vec, n * sizeof(*iov));
+        vec += n;
+        nvec -= n;
+        i = 0;
+        while (i < n) {
+            do {
+#ifdef HAVE_WRITEV
+                rc = writev(fd, iov + i, (int)(n - i));
+#else
+                rc = write(fd, iov[i].iov_base, iov[i].iov_len);
+#endif
+            } while (rc < 0 && errno == EINTR);
+            if (rc < 0) {
+                return errno;
+            }
+            while (i < n && (apr_size_t)rc >= iov[i].iov_len) {
+                rc -= iov[i++].iov_len;
+            }
+            if (i < n) {
+                iov[i].iov_base = (char *)iov[i].iov_base + rc;
+                iov[i].iov_len -= rc;
+            }
+        }
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t stage_flush(apr_file_t *thefile, apr_file_stage_t *stage)
+{
+    struct iovec iov;
+    apr_status_t rv;
+
+    if (!stage->len) {
+        return APR_SUCCESS;
+    }
+    iov.iov_base = stage->buf;
+    iov.iov_len = stage->len;
+    rv = stage_writev(thefile->filedes, &iov, 1);
+    stage->len = 0;
+    return rv;
+}
+
+/* Stage a record in the buffer of the calling thread, without the file
+ * lock: the threads only share a stage when they hash to it.
+ */
+static apr_status_t file_writev_staged(apr_file_t *thefile,
+                                       const struct iovec *vec,
+                                       apr_size_t nvec, apr_size_t *nbytes)
+{
+    apr_file_stages_t *stages = thefile->stages;
+    apr_file_stage_t *stage;
+    apr_os_thread_t self = apr_os_thread_current();
+    apr_ssize_t klen = sizeof(self);
+    apr_size_t total = 0, i;
+    apr_time_t now = 0;
+    apr_status_t rv = APR_SUCCESS;
+
+    for (i = 0; i < nvec; i++) {
+        total += vec[i].iov_len;
+    }
+    stage = &stages->stage[apr_hashfunc_default((const char *)&self, &klen)
+                           % stages->nstages];
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(stage->lock);
+#endif
+    if (stages->max_age > 0) {
+        now = apr_time_now();
+    }
+    if (stage->len && (stage->len + total > stages->size
+                       || (stages->max_age > 0
+                           && now - stage->first >= stages->max_age))) {
+        rv = stage_flush(thefile, stage);
+    }
+    if (rv == APR_SUCCESS) {
+        if (total > stages->size) {
+            rv = stage_writev(thefile->filedes, vec, nvec);
+        }
+        else {
+            if (!stage->len) {
+                stage->first = now;
+            }
+            for (i = 0; i < nvec; i++) {
+                memcpy(stage->buf + stage->len, vec[i].iov_base,
+                       vec[i].iov_len);
+                stage->len += vec[i].iov_len;
+            }
+        }
+    }
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(stage->lock);
+#endif
+
+    *nbytes = rv == APR_SUCCESS ? total : 0;
+    return rv;
+}
+
+apr_status_t apr_file_stages_flush(apr_file_t *thefile)
+{
+    apr_file_stages_t *stages = thefile->stages;
+    apr_status_t rv = APR_SUCCESS, rv2;
+    apr_uint32_t i;
+
+    for (i = 0; i < stages->nstages; i++) {
+#if APR_HAS_THREADS
+        apr_thread_mutex_lock(stages->stage[i].lock);
+#endif
+        rv2 = stage_flush(thefile, &stages->stage[i]);
+#if APR_HAS_THREADS
+        apr_thread_mutex_unlock(stages->stage[i].lock);
+#endif
+        if (rv == APR_SUCCESS) {
+            rv = rv2;
+        }
+    }
+    return rv;
+}
+
 APR_DECLARE(apr_status_t) apr_file_write(apr_file_t *thefile, const void *buf, apr_size_t *nbytes)
 {
     apr_size_t rv;
@@ -232,6 +371,14 @@ APR_DECLARE(apr_status_t) apr_file_write(apr_file_t *thefile, const void *buf, a
         return rv;
     }
 
+    if (thefile->stages) {
+        struct iovec vec;
+
+        vec.iov_base = (void *)buf;
+        vec.iov_len = *nbytes;
+        return file_writev_staged(thefile, &vec, 1, nbytes);
+    }
+
     if (thefile->buffered) {
         char *pos = (char *)buf;
         int blocksize;
@@ -253,8 +400,12 @@ APR_DECLARE(apr_status_t) apr_file_write(apr_file_t *thefile, const void *buf, a
         }
 
         while (rv == APR_SUCCESS && size > 0) {
-            if (thefile->bufpos == thefile->bufsize)   /* write buffer is full*/
+            if (thefile->bufpos == thefile->bufsize) { /* write buffer is full*/
                 rv = apr_file_flush_locked(thefile);
+                if (rv == APR_SUCCESS && thefile->bufgrow) {
+                    apr_file_buffer_grow(thefile);
+                }
+            }
 
             blocksize = size > thefile->bufsize - thefile->bufpos ?
                         thefile->bufsize - thefile->bufpos : size;
@@ -315,6 +466,14 @@ APR_DECLARE(apr_status_t) apr_file_writev(apr_file_t *thefile, const struct iove
     apr_status_t rv;
     apr_ssize_t bytes;
 
+    if (thefile->stages) {
+        rv = file_rotating_check(thefile);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        return file_writev_staged(thefile, vec, nvec, nbytes);
+    }
+
     if (thefile->buffered) {
         file_lock(thefile);
 
@@ -399,13 +558,29 @@ APR_DECLARE(apr_status_t) apr_file_puts(const char *str, apr_file_t *thefile)
     return apr_file_write_full(thefile, str, strlen(str), NULL);
 }
 
+/* Writes of the buffers, registered by the first one */
+static apr_metric_t *flushes_metric = NULL;
+
 apr_status_t apr_file_flush_locked(apr_file_t *thefile)
 {
     apr_status_t rv = APR_SUCCESS;
 
+    if (thefile->stages) {
+        return apr_file_stages_flush(thefile);
+    }
+
     if (thefile->direction == 1 && thefile->bufpos) {
         apr_ssize_t written = 0, ret;
 
+        if (!flushes_metric) {
+            apr_metric_register(&flushes_metric, "apr_file_flushes_total",
+                                "Writes of the buffered files' buffers",
+                                APR_METRIC_COUNTER);
+        }
+        if (flushes_metric) {
+            apr_metric_add(flushes_metric, 1);
+        }
+
         do {
             ret = write(thefile->filedes, thefile->buffer + written,
                         thefile->bufpos - written);
@@ -534,14 +709,30 @@ APR_DECLARE(apr_status_t) apr_file_gets(char *str, int len, apr_file_t *thefile)
             /* Force ungetc leftover to call apr_file_read. */
             if (thefile->bufpos < thefile->dataRead &&
                 thefile->ungetchar == -1) {
-                *str = thefile->buffer[thefile->bufpos++];
-            }
-            else {
-                nbytes = 1;
-                rv = file_read_buffered(thefile, str, &nbytes);
-                if (rv != APR_SUCCESS) {
+                /* Copy up to the newline from the buffer at once */
+                const char *start = thefile->buffer + thefile->bufpos;
+                const char *nl;
+
+                nbytes = thefile->dataRead - thefile->bufpos;
+                if (nbytes > (apr_size_t)(final - str)) {
+                    nbytes = final - str;
+                }
+                nl = memchr(start, '\n', nbytes);
+                if (nl) {
+                    nbytes = nl - start + 1;
+                }
+                memcpy(str, start, nbytes);
+                thefile->bufpos += nbytes;
+                str += nbytes;
+                if (nl) {
                     break;
                 }
+                continue;
+            }
+            nbytes = 1;
+            rv = file_read_buffered(thefile, str, &nbytes);
+            if (rv != APR_SUCCESS) {
+                break;
             }
             if (*str == '\n') {
                 ++str;
@@ -581,6 +772,173 @@ APR_DECLARE(apr_status_t) apr_file_gets(char *str, int len, apr_file_t *thefile)
 
 
 
+#if defined(HAVE_PREAD) && defined(HAVE_PWRITE) \
+    && APR_HAS_LARGE_FILES && defined(_LARGEFILE64_SOURCE)
+#define pread(f,b,n,o) pread64(f,b,n,o)
+#define pwrite(f,b,n,o) pwrite64(f,b,n,o)
+#endif
+#if defined(HAVE_PREADV) && defined(HAVE_PWRITEV) \
+    && APR_HAS_LARGE_FILES && defined(_LARGEFILE64_SOURCE)
+#define preadv(f,v,n,o) preadv64(f,v,n,o)
+#define pwritev(f,v,n,o) pwritev64(f,v,n,o)
+#endif
+
+/* Read or write at an offset, leaving the file pointer alone.  Data
+ * buffered for writing is flushed first so that it is seen at its
+ * offset; data buffered for reading is kept.
+ */
+static apr_status_t file_io_at(apr_file_t *thefile, int writing,
+                               const struct iovec *vec, apr_size_t nvec,
+                               apr_off_t offset, apr_size_t *nbytes)
+{
+    apr_status_t rv = APR_SUCCESS;
+    apr_ssize_t n;
+    apr_size_t i;
+#if !defined(HAVE_PREAD) || !defined(HAVE_PWRITE)
+    apr_off_t pos;
+#endif
+
+    *nbytes = 0;
+
+    if (thefile->buffered || thefile->stages) {
+        file_lock(thefile);
+        if (thefile->direction == 1 || thefile->stages) {
+            rv = apr_file_flush_locked(thefile);
+        }
+        file_unlock(thefile);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+    }
+
+#if defined(HAVE_PREADV) && defined(HAVE_PWRITEV)
+    do {
+        if (writing) {
+            n = pwritev(thefile->filedes, vec, nvec, offset);
+        }
+        else {
+            n = preadv(thefile->filedes, vec, nvec, offset);
+        }
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        return errno;
+    }
+    *nbytes = n;
+#elif defined(HAVE_PREAD) && defined(HAVE_PWRITE)
+    /* One call for each vector, up to the first short one */
+    for (i = 0; i < nvec; i++) {
+        do {
+            if (writing) {
+                n = pwrite(thefile->filedes, vec[i].iov_base,
+                           vec[i].iov_len, offset);
+            }
+            else {
+                n = pread(thefile->filedes, vec[i].iov_base,
+                          vec[i].iov_len, offset);
+            }
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) {
+            if (*nbytes == 0) {
+                return errno;
+            }
+            break;
+        }
+        *nbytes += n;
+        offset += n;
+        if ((apr_size_t)n < vec[i].iov_len) {
+            break;
+        }
+    }
+#else
+    /* Seek there and back under the file lock, which only serializes
+     * the threads of APR_FOPEN_XTHREAD files.
+     */
+    file_lock(thefile);
+    pos = lseek(thefile->filedes, 0, SEEK_CUR);
+    if (pos == -1 || lseek(thefile->filedes, offset, SEEK_SET) == -1) {
+        file_unlock(thefile);
+        return errno;
+    }
+    for (i = 0; i < nvec; i++) {
+        do {
+            if (writing) {
+                n = write(thefile->filedes, vec[i].iov_base, vec[i].iov_len);
+            }
+            else {
+                n = read(thefile->filedes, vec[i].iov_base, vec[i].iov_len);
+            }
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) {
+            if (*nbytes == 0) {
+                rv = errno;
+            }
+            break;
+        }
+        *nbytes += n;
+        if ((apr_size_t)n < vec[i].iov_len) {
+            break;
+        }
+    }
+    if (lseek(thefile->filedes, pos, SEEK_SET) == -1 && rv == APR_SUCCESS) {
+        rv = errno;
+    }
+    file_unlock(thefile);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+#endif
+
+    if (!writing && *nbytes == 0) {
+        for (i = 0; i < nvec; i++) {
+            if (vec[i].iov_len) {
+                return APR_EOF;
+            }
+        }
+    }
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_file_read_at(apr_file_t *thefile,
+                                           apr_off_t offset, void *buf,
+                                           apr_size_t *nbytes)
+{
+    struct iovec vec;
+
+    vec.iov_base = buf;
+    vec.iov_len = *nbytes;
+    return file_io_at(thefile, 0, &vec, 1, offset, nbytes);
+}
+
+APR_DECLARE(apr_status_t) apr_file_write_at(apr_file_t *thefile,
+                                            apr_off_t offset,
+                                            const void *buf,
+                                            apr_size_t *nbytes)
+{
+    struct iovec vec;
+
+    vec.iov_base = (void *)buf;
+    vec.iov_len = *nbytes;
+    return file_io_at(thefile, 1, &vec, 1, offset, nbytes);
+}
+
+APR_DECLARE(apr_status_t) apr_file_readv_at(apr_file_t *thefile,
+                                            apr_off_t offset,
+                                            const struct iovec *vec,
+                                            apr_size_t nvec,
+                                            apr_size_t *nbytes)
+{
+    return file_io_at(thefile, 0, vec, nvec, offset, nbytes);
+}
+
+APR_DECLARE(apr_status_t) apr_file_writev_at(apr_file_t *thefile,
+                                             apr_off_t offset,
+                                             const struct iovec *vec,
+                                             apr_size_t nvec,
+                                             apr_size_t *nbytes)
+{
+    return file_io_at(thefile, 1, vec, nvec, offset, nbytes);
+}
+
 APR_DECLARE(apr_status_t) apr_file_pipe_wait(apr_file_t *thepipe, apr_wait_type_t direction)
 {
     return apr_wait_for_io_or_timeout(thepipe, NULL, direction == APR_WAIT_READ);
@@ -0,0 +1,127 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_arch_file_io.h"
+#include "apr_file_io.h"
+
+#ifdef HAVE_SPLICE
+#include "apr_support.h"
+#if APR_HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#if APR_HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#endif
+
+/* The most copied at once through userspace, when splice() cannot be used */
+#define SPLICE_COPY_BUFSIZE 8192
+
+#ifdef HAVE_SPLICE
+/* Wait for f to be ready, with its timeout (APR_EAGAIN if none) */
+static apr_status_t splice_wait(apr_file_t *f, int for_read)
+{
+    if (f->timeout == 0) {
+        return APR_EAGAIN;
+    }
+    return apr_wait_for_io_or_timeout(f, NULL, for_read);
+}
+
+/* splice() or tee() once, APR_ENOTIMPL if the files do not allow it */
+static apr_status_t file_splice(apr_file_t *in, apr_file_t *out,
+                                apr_size_t *len, apr_int32_t flags)
+{
+    unsigned int sflags = SPLICE_F_MOVE;
+    apr_status_t rv;
+    ssize_t n;
+
+    if (flags & APR_FILE_SPLICE_MORE) {
+        sflags |= SPLICE_F_MORE;
+    }
+    for (;;) {
+        if (flags & APR_FILE_SPLICE_TEE) {
+            n = tee(in->filedes, out->filedes, *len, sflags);
+        }
+        else {
+            n = splice(in->filedes, NULL, out->filedes, NULL, *len, sflags);
+        }
+        if (n > 0) {
+            *len = n;
+            return APR_SUCCESS;
+        }
+        if (n == 0) {
+            *len = 0;
+            in->eof_hit = 1;
+            return APR_EOF;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EINVAL || errno == ENOSYS) {
+            /* Neither is a pipe, or some file does not support it */
+            return APR_ENOTIMPL;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            *len = 0;
+            return errno;
+        }
+        /* Either end may be the one not ready */
+        if (in->is_pipe && (rv = splice_wait(in, 1)) != APR_SUCCESS) {
+            *len = 0;
+            return rv;
+        }
+        if (out->is_pipe && (rv = splice_wait(out, 0)) != APR_SUCCESS) {
+            *len = 0;
+            return rv;
+        }
+    }
+}
+#endif /* HAVE_SPLICE */
+
+APR_DECLARE(apr_status_t) apr_file_splice(apr_file_t *in, apr_file_t *out,
+                                          apr_size_t *len, apr_int32_t flags)
+{
+    char buf[SPLICE_COPY_BUFSIZE];
+    apr_size_t n;
+    apr_status_t rv;
+
+    if (!*len) {
+        return APR_SUCCESS;
+    }
+
+#ifdef HAVE_SPLICE
+    /* What is in the buffers (or ungot) has to go first, through them */
+    if (!in->buffered && !out->buffered && in->ungetchar == -1) {
+        rv = file_splice(in, out, len, flags);
+        if (rv != APR_ENOTIMPL) {
+            return rv;
+        }
+    }
+#endif
+    if (flags & APR_FILE_SPLICE_TEE) {
+        /* Copying would consume the data */
+        *len = 0;
+        return APR_ENOTIMPL;
+    }
+
+    n = *len < sizeof(buf) ? *len : sizeof(buf);
+    *len = 0;
+    rv = apr_file_read(in, buf, &n);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    return apr_file_write_full(out, buf, n, len);
+}
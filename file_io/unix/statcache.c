@@ -0,0 +1,383 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr.h"
+#include "apr_private.h"
+#include "apr_file_info.h"
+#include "apr_hash.h"
+#include "apr_strings.h"
+#include "apr_time.h"
+
+#if APR_HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+#if APR_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_INOTIFY
+#include <sys/inotify.h>
+#endif
+
+/* The cached stats: the path (NUL terminated) with the result of its
+ * apr_stat() for all the APR_FINFO_NORM fields, until it expires.  The
+ * entries are chained by index in their bucket, and in the LRU order,
+ * like those of apr_filepath_merge_cached().
+ *
+ * With inotify, the stated files are watched (with the same watch for
+ * the same inode) and the entries of a watch expire as soon as its events
+ * are read, which is done before each lookup.  The TTL still bounds what
+ * the watches miss, like a renamed parent directory, and the failures
+ * (e.g. ENOENT) which have nothing to watch.
+ */
+
+#define STAT_CACHE_BUF 256
+
+#ifdef HAVE_INOTIFY
+#define STAT_CACHE_EVENTS (IN_ATTRIB | IN_MODIFY | IN_MOVE_SELF \
+                           | IN_DELETE_SELF | IN_CREATE | IN_DELETE \
+                           | IN_MOVED_FROM | IN_MOVED_TO)
+#endif
+
+typedef struct stat_cache_entry_t {
+    unsigned int hash;
+    apr_int32_t link;
+    int bucket_next;
+    int lru_prev;
+    int lru_next;
+    int wd;
+    apr_time_t expires;
+    apr_status_t rv;
+    apr_finfo_t finfo;
+    apr_size_t len;
+    char path[STAT_CACHE_BUF];
+} stat_cache_entry_t;
+
+struct apr_stat_cache_t {
+    stat_cache_entry_t *entries;
+    int *buckets;
+    unsigned int mask;
+    int size;
+    int used;
+    int lru_first;  /* the most recently used */
+    int lru_last;   /* the least recently used */
+    apr_interval_time_t ttl;
+    apr_pool_t *pool;
+    int fd;         /* the inotify descriptor, or -1 */
+    int watches;
+};
+
+#ifdef HAVE_INOTIFY
+static apr_status_t stat_cache_cleanup(void *data)
+{
+    apr_stat_cache_t *c = data;
+
+    if (c->fd >= 0) {
+        close(c->fd);
+        c->fd = -1;
+    }
+    return APR_SUCCESS;
+}
+#endif
+
+APR_DECLARE(apr_status_t) apr_stat_cache_create(apr_stat_cache_t **cache,
+                                                int size,
+                                                apr_interval_time_t ttl,
+                                                apr_pool_t *p)
+{
+    apr_stat_cache_t *c;
+    unsigned int nbuckets = 1;
+    unsigned int i;
+
+    if (size < 1 || ttl <= 0) {
+        return APR_EINVAL;
+    }
+    while (nbuckets < (unsigned int)size) {
+        nbuckets <<= 1;
+    }
+
+    c = apr_palloc(p, sizeof(*c));
+    c->entries = apr_palloc(p, size * sizeof(stat_cache_entry_t));
+    c->buckets = apr_palloc(p, nbuckets * sizeof(int));
+    for (i = 0; i < nbuckets; i++) {
+        c->buckets[i] = -1;
+    }
+    c->mask = nbuckets - 1;
+    c->size = size;
+    c->used = 0;
+    c->lru_first = c->lru_last = -1;
+    c->ttl = ttl;
+    c->pool = p;
+    c->fd = -1;
+    c->watches = 0;
+
+#ifdef HAVE_INOTIFY
+    /* Without inotify (e.g. no more instances allowed), the TTL only */
+    c->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (c->fd >= 0) {
+        apr_pool_cleanup_register(p, c, stat_cache_cleanup,
+                                  apr_pool_cleanup_null);
+    }
+#endif
+
+    *cache = c;
+    return APR_SUCCESS;
+}
+
+static void stat_cache_unlink(apr_stat_cache_t *c, int i)
+{
+    stat_cache_entry_t *e = &c->entries[i];
+
+    if (e->lru_prev >= 0) {
+        c->entries[e->lru_prev].lru_next = e->lru_next;
+    }
+    else {
+        c->lru_first = e->lru_next;
+    }
+    if (e->lru_next >= 0) {
+        c->entries[e->lru_next].lru_prev = e->lru_prev;
+    }
+    else {
+        c->lru_last = e->lru_prev;
+    }
+}
+
+static void stat_cache_use(apr_stat_cache_t *c, int i)
+{
+    stat_cache_entry_t *e = &c->entries[i];
+
+    e->lru_prev = -1;
+    e->lru_next = c->lru_first;
+    if (c->lru_first >= 0) {
+        c->entries[c->lru_first].lru_prev = i;
+    }
+    else {
+        c->lru_last = i;
+    }
+    c->lru_first = i;
+}
+
+#ifdef HAVE_INOTIFY
+/* Expire the entries of the watches which had events */
+static void stat_cache_events(apr_stat_cache_t *c)
+{
+    union {
+        struct inotify_event ev;
+        char buf[4096];
+    } u;
+    ssize_t n;
+    int i;
+
+    while ((n = read(c->fd, u.buf, sizeof(u.buf))) > 0) {
+        char *pos = u.buf, *end = u.buf + n;
+
+        while (pos < end) {
+            struct inotify_event *ev = (struct inotify_event *)pos;
+            int found = 0;
+
+            for (i = 0; i < c->used; i++) {
+                stat_cache_entry_t *e = &c->entries[i];
+
+                if (e->wd == ev->wd) {
+                    e->expires = 0;
+                    if (ev->mask & IN_IGNORED) {
+                        /* The watch is gone with its inode */
+                        e->wd = -1;
+                    }
+                    found = 1;
+                }
+            }
+            if (found && (ev->mask & IN_IGNORED)) {
+                c->watches--;
+            }
+            pos += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+}
+
+/* Stop watching an inode, unless an entry still has it */
+static void stat_cache_release(apr_stat_cache_t *c, int wd)
+{
+    int j;
+
+    if (wd < 0) {
+        return;
+    }
+    for (j = 0; j < c->used; j++) {
+        if (c->entries[j].wd == wd) {
+            return;
+        }
+    }
+    inotify_rm_watch(c->fd, wd);
+    c->watches--;
+}
+
+/* Watch the inode of an entry, the same inode having the same watch */
+static void stat_cache_watch(apr_stat_cache_t *c, int i)
+{
+    stat_cache_entry_t *e = &c->entries[i];
+    int wd, j;
+
+    wd = inotify_add_watch(c->fd, e->path,
+                           STAT_CACHE_EVENTS | (e->link ? IN_DONT_FOLLOW : 0));
+    if (wd < 0) {
+        return;
+    }
+    for (j = 0; j < c->used; j++) {
+        if (c->entries[j].wd == wd) {
+            break;
+        }
+    }
+    if (j == c->used) {
+        c->watches++;
+    }
+    e->wd = wd;
+}
+#endif /* HAVE_INOTIFY */
+
+static int stat_cache_rooted(const char *fname)
+{
+#if defined(WIN32) || defined(OS2) || defined(NETWARE)
+    return fname[0] == '/' || fname[0] == '\\'
+           || (fname[0] && fname[1] == ':'
+               && (fname[2] == '/' || fname[2] == '\\'));
+#else
+    return fname[0] == '/';
+#endif
+}
+
+static apr_status_t stat_cache_result(apr_finfo_t *finfo,
+                                      const stat_cache_entry_t *e,
+                                      const char *fname,
+                                      apr_int32_t wanted, apr_pool_t *pool)
+{
+    if (e->rv != APR_SUCCESS && e->rv != APR_INCOMPLETE) {
+        return e->rv;
+    }
+    *finfo = e->finfo;
+    finfo->pool = pool;
+    finfo->fname = fname;
+    finfo->name = NULL;
+    finfo->filehand = NULL;
+    wanted &= ~(APR_FINFO_LINK | APR_FINFO_NOSYNC);
+    return (wanted & ~finfo->valid) ? APR_INCOMPLETE : APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_stat_cached(apr_finfo_t *finfo,
+                                          apr_stat_cache_t *cache,
+                                          const char *fname,
+                                          apr_int32_t wanted,
+                                          apr_pool_t *pool)
+{
+    stat_cache_entry_t *e;
+    apr_ssize_t len = APR_HASH_KEY_STRING;
+    apr_int32_t link = wanted & APR_FINFO_LINK;
+    apr_time_t now;
+    unsigned int hash;
+    int i, *ref;
+#ifdef HAVE_INOTIFY
+    int wd;
+#endif
+
+    /* The names are allocated, the relative paths depend on the current
+     * working directory
+     */
+    if ((wanted & APR_FINFO_NAME) || !stat_cache_rooted(fname)) {
+        return apr_stat(finfo, fname, wanted, pool);
+    }
+
+#ifdef HAVE_INOTIFY
+    if (cache->watches) {
+        stat_cache_events(cache);
+    }
+#endif
+
+    hash = apr_hashfunc_default(fname, &len) ^ (unsigned int)link;
+    now = apr_time_now();
+
+    for (i = cache->buckets[hash & cache->mask]; i >= 0;
+         i = cache->entries[i].bucket_next) {
+        e = &cache->entries[i];
+        if (e->hash == hash && e->link == link
+            && e->len == (apr_size_t)len && !memcmp(e->path, fname, len)) {
+            break;
+        }
+    }
+
+    if (i < 0) {
+        if ((apr_size_t)len >= STAT_CACHE_BUF) {
+            return apr_stat(finfo, fname, wanted, pool);
+        }
+
+        /* Take a new entry, or replace the least recently used one */
+        if (cache->used < cache->size) {
+            i = cache->used++;
+        }
+        else {
+            i = cache->lru_last;
+            e = &cache->entries[i];
+            for (ref = &cache->buckets[e->hash & cache->mask]; *ref != i;
+                 ref = &cache->entries[*ref].bucket_next) {
+                /* find the link to the entry */
+            }
+            *ref = e->bucket_next;
+            stat_cache_unlink(cache, i);
+#ifdef HAVE_INOTIFY
+            wd = e->wd;
+            e->wd = -1;
+            stat_cache_release(cache, wd);
+#endif
+        }
+        e = &cache->entries[i];
+        e->hash = hash;
+        e->link = link;
+        e->len = len;
+        e->wd = -1;
+        e->expires = 0;
+        memcpy(e->path, fname, len + 1);
+        e->bucket_next = cache->buckets[hash & cache->mask];
+        cache->buckets[hash & cache->mask] = i;
+    }
+    else {
+        stat_cache_unlink(cache, i);
+    }
+    stat_cache_use(cache, i);
+
+    if (e->expires <= now) {
+#ifdef HAVE_INOTIFY
+        /* The watch is added first, not to miss a change after the stat,
+         * and a replaced file has another inode so another watch.
+         */
+        if (cache->fd >= 0) {
+            wd = e->wd;
+            e->wd = -1;
+            stat_cache_watch(cache, i);
+            if (wd != e->wd) {
+                stat_cache_release(cache, wd);
+            }
+        }
+#endif
+        memset(&e->finfo, 0, sizeof(e->finfo));
+        e->rv = apr_stat(&e->finfo, e->path, APR_FINFO_NORM | link
+                                             | (wanted & APR_FINFO_NOSYNC),
+                         cache->pool);
+        e->expires = now + cache->ttl;
+    }
+
+    return stat_cache_result(finfo, e, fname, wanted, pool);
+}
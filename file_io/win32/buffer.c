@@ -17,6 +17,9 @@
 #include "apr_arch_file_io.h"
 #include "apr_thread_mutex.h"
 
+apr_size_t apr_file_default_bufsize = APR_FILE_DEFAULT_BUFSIZE;
+apr_size_t apr_file_max_bufsize = 0;
+
 APR_DECLARE(apr_status_t) apr_file_buffer_set(apr_file_t *file,
                                               char * buffer,
                                               apr_size_t bufsize)
@@ -63,3 +66,26 @@ APR_DECLARE(apr_size_t) apr_file_buffer_size_get(apr_file_t *file)
 {
     return file->bufsize;
 }
+
+APR_DECLARE(void) apr_file_buffer_default_set(apr_size_t bufsize,
+                                              apr_size_t maxsize)
+{
+    apr_file_default_bufsize = bufsize ? bufsize : APR_FILE_DEFAULT_BUFSIZE;
+    /* The buffers do not grow here */
+    apr_file_max_bufsize = maxsize;
+}
+
+APR_DECLARE(void) apr_file_buffer_default_get(apr_size_t *bufsize,
+                                              apr_size_t *maxsize)
+{
+    *bufsize = apr_file_default_bufsize;
+    *maxsize = apr_file_max_bufsize;
+}
+
+APR_DECLARE(apr_status_t) apr_file_append_stages_set(apr_file_t *file,
+                                                     apr_uint32_t nstages,
+                                                     apr_size_t stagesize,
+                                                     apr_interval_time_t max_age)
+{
+    return APR_ENOTIMPL;
+}
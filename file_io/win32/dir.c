@@ -182,6 +182,32 @@ APR_DECLARE(apr_status_t) apr_dir_read(apr_finfo_t *finfo, apr_int32_t wanted,
     return APR_SUCCESS;
 }
 
+APR_DECLARE(apr_status_t) apr_dir_read_batch(apr_finfo_t *finfo,
+                                             apr_size_t nelts,
+                                             apr_size_t *nread,
+                                             apr_int32_t wanted,
+                                             apr_dir_t *thedir)
+{
+    apr_status_t rv = APR_SUCCESS, ret;
+    apr_size_t n;
+
+    for (n = 0; n < nelts; n++) {
+        ret = apr_dir_read(&finfo[n], wanted, thedir);
+        if (ret == APR_INCOMPLETE) {
+            rv = APR_INCOMPLETE;
+        }
+        else if (ret != APR_SUCCESS) {
+            if (n == 0) {
+                rv = ret;
+            }
+            break;
+        }
+    }
+
+    *nread = n;
+    return rv;
+}
+
 APR_DECLARE(apr_status_t) apr_dir_rewind(apr_dir_t *dir)
 {
     apr_status_t rv;
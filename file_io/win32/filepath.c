@@ -975,6 +975,29 @@ APR_DECLARE(apr_status_t) apr_filepath_merge(char **newpath,
 }
 
 
+/* The merge needs the pool here, for the true names and the cwd */
+APR_DECLARE(apr_status_t) apr_filepath_merge_buf(char *buf, apr_size_t size,
+                                                 const char *basepath,
+                                                 const char *addpath,
+                                                 apr_int32_t flags,
+                                                 apr_pool_t *p)
+{
+    char *newpath;
+    apr_size_t len;
+    apr_status_t rv;
+
+    rv = apr_filepath_merge(&newpath, basepath, addpath, flags, p);
+    if (rv == APR_SUCCESS) {
+        len = strlen(newpath);
+        if (len >= size) {
+            return APR_ENAMETOOLONG;
+        }
+        memcpy(buf, newpath, len + 1);
+    }
+    return rv;
+}
+
+
 APR_DECLARE(apr_status_t) apr_filepath_encoding(int *style, apr_pool_t *p)
 {
     *style = APR_FILEPATH_ENCODING_UTF8;
@@ -451,6 +451,8 @@ APR_DECLARE(apr_status_t) apr_file_info_get(apr_finfo_t *finfo, apr_int32_t want
 {
     BY_HANDLE_FILE_INFORMATION FileInfo;
 
+    wanted &= ~APR_FINFO_NOSYNC; /* only a hint for unix statx() */
+
     if (thefile->buffered) {
         /* XXX: flush here is not mutex protected */
         apr_status_t rv = apr_file_flush(thefile);
@@ -599,6 +601,8 @@ APR_DECLARE(apr_status_t) apr_stat(apr_finfo_t *finfo, const char *fname,
     } FileInfo;
     int finddata = 0;
 
+    wanted &= ~APR_FINFO_NOSYNC; /* only a hint for unix statx() */
+
     /* Catch fname length == MAX_PATH since GetFileAttributesEx fails
      * with PATH_NOT_FOUND.  We would rather indicate length error than
      * 'not found'
@@ -372,8 +372,8 @@ APR_DECLARE(apr_status_t) apr_file_open(apr_file_t **new, const char *fname,
     }
     if (flag & APR_FOPEN_BUFFERED) {
         (*new)->buffered = 1;
-        (*new)->buffer = apr_palloc(pool, APR_FILE_DEFAULT_BUFSIZE);
-        (*new)->bufsize = APR_FILE_DEFAULT_BUFSIZE;
+        (*new)->buffer = apr_palloc(pool, apr_file_default_bufsize);
+        (*new)->bufsize = apr_file_default_bufsize;
     }
     /* Need the mutex to share an apr_file_t across multiple threads */
     if (flag & APR_FOPEN_XTHREAD) {
@@ -508,8 +508,8 @@ APR_DECLARE(apr_status_t) apr_os_file_put(apr_file_t **file,
     }
     if (flags & APR_FOPEN_BUFFERED) {
         (*file)->buffered = 1;
-        (*file)->buffer = apr_palloc(pool, APR_FILE_DEFAULT_BUFSIZE);
-        (*file)->bufsize = APR_FILE_DEFAULT_BUFSIZE;
+        (*file)->buffer = apr_palloc(pool, apr_file_default_bufsize);
+        (*file)->bufsize = apr_file_default_bufsize;
     }
     if (flags & APR_FOPEN_XTHREAD) {
         apr_status_t rv;
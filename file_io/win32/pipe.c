@@ -245,6 +245,18 @@ APR_DECLARE(apr_status_t) apr_file_namedpipe_create(const char *filename,
  * would be to handle stdio-style or blocking pipes.  Win32 doesn't have
  * select() blocking for pipes anyways :(
  */
+APR_DECLARE(apr_status_t) apr_file_pipe_size_set(apr_file_t *thepipe,
+                                                 apr_size_t size)
+{
+    return APR_ENOTIMPL;
+}
+
+APR_DECLARE(apr_status_t) apr_file_pipe_size_get(apr_file_t *thepipe,
+                                                 apr_size_t *size)
+{
+    return APR_ENOTIMPL;
+}
+
 APR_DECLARE(apr_status_t) apr_os_pipe_put_ex(apr_file_t **file,
                                              apr_os_file_t *thefile,
                                              int register_cleanup,
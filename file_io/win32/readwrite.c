@@ -812,6 +812,150 @@ APR_DECLARE_NONSTD(int) apr_file_printf(apr_file_t *fptr,
     return count;
 }
 
+/* Read or write at an offset with an OVERLAPPED of our own, so that
+ * threads sharing an APR_FOPEN_XTHREAD file do not share its event.
+ * Handles opened without FILE_FLAG_OVERLAPPED move their file pointer,
+ * which is put back afterwards.
+ */
+static apr_status_t file_io_at(apr_file_t *thefile, int writing,
+                               const struct iovec *vec, apr_size_t nvec,
+                               apr_off_t offset, apr_size_t *nbytes)
+{
+    int overlapped = (thefile->flags & APR_FOPEN_XTHREAD) != 0;
+    LARGE_INTEGER pos, zero;
+    OVERLAPPED ov;
+    DWORD done;
+    apr_status_t rv = APR_SUCCESS;
+    apr_size_t i;
+
+    *nbytes = 0;
+
+    if (thefile->buffered && thefile->direction == 1) {
+        if (thefile->flags & APR_FOPEN_XTHREAD) {
+            apr_thread_mutex_lock(thefile->mutex);
+        }
+        rv = apr_file_flush(thefile);
+        if (thefile->flags & APR_FOPEN_XTHREAD) {
+            apr_thread_mutex_unlock(thefile->mutex);
+        }
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+    }
+
+    memset(&ov, 0, sizeof(ov));
+    if (overlapped) {
+        ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+        if (!ov.hEvent) {
+            return apr_get_os_error();
+        }
+    }
+    else {
+        zero.QuadPart = 0;
+        if (!SetFilePointerEx(thefile->filehand, zero, &pos, FILE_CURRENT)) {
+            return apr_get_os_error();
+        }
+    }
+
+    for (i = 0; i < nvec; i++) {
+        BOOL ok;
+
+        ov.Offset     = (DWORD)offset;
+        ov.OffsetHigh = (DWORD)(offset >> 32);
+        done = 0;
+        if (writing) {
+            ok = WriteFile(thefile->filehand, vec[i].iov_base,
+                           (DWORD)vec[i].iov_len, &done, &ov);
+        }
+        else {
+            ok = ReadFile(thefile->filehand, vec[i].iov_base,
+                          (DWORD)vec[i].iov_len, &done, &ov);
+        }
+        if (!ok) {
+            rv = apr_get_os_error();
+            if (overlapped && rv == APR_FROM_OS_ERROR(ERROR_IO_PENDING)) {
+                rv = APR_SUCCESS;
+                if (!GetOverlappedResult(thefile->filehand, &ov, &done,
+                                         TRUE)) {
+                    rv = apr_get_os_error();
+                }
+            }
+            if (rv == APR_FROM_OS_ERROR(ERROR_HANDLE_EOF)) {
+                rv = APR_SUCCESS;
+                done = 0;
+            }
+            if (rv != APR_SUCCESS) {
+                if (*nbytes) {
+                    rv = APR_SUCCESS;
+                }
+                break;
+            }
+        }
+        *nbytes += done;
+        offset += done;
+        if (done < vec[i].iov_len) {
+            break;
+        }
+    }
+
+    if (overlapped) {
+        CloseHandle(ov.hEvent);
+    }
+    else if (!SetFilePointerEx(thefile->filehand, pos, NULL, FILE_BEGIN)
+             && rv == APR_SUCCESS) {
+        rv = apr_get_os_error();
+    }
+    if (rv == APR_SUCCESS && !writing && *nbytes == 0) {
+        for (i = 0; i < nvec; i++) {
+            if (vec[i].iov_len) {
+                return APR_EOF;
+            }
+        }
+    }
+    return rv;
+}
+
+APR_DECLARE(apr_status_t) apr_file_read_at(apr_file_t *thefile,
+                                           apr_off_t offset, void *buf,
+                                           apr_size_t *nbytes)
+{
+    struct iovec vec;
+
+    vec.iov_base = buf;
+    vec.iov_len = *nbytes;
+    return file_io_at(thefile, 0, &vec, 1, offset, nbytes);
+}
+
+APR_DECLARE(apr_status_t) apr_file_write_at(apr_file_t *thefile,
+                                            apr_off_t offset,
+                                            const void *buf,
+                                            apr_size_t *nbytes)
+{
+    struct iovec vec;
+
+    vec.iov_base = (void *)buf;
+    vec.iov_len = *nbytes;
+    return file_io_at(thefile, 1, &vec, 1, offset, nbytes);
+}
+
+APR_DECLARE(apr_status_t) apr_file_readv_at(apr_file_t *thefile,
+                                            apr_off_t offset,
+                                            const struct iovec *vec,
+                                            apr_size_t nvec,
+                                            apr_size_t *nbytes)
+{
+    return file_io_at(thefile, 0, vec, nvec, offset, nbytes);
+}
+
+APR_DECLARE(apr_status_t) apr_file_writev_at(apr_file_t *thefile,
+                                             apr_off_t offset,
+                                             const struct iovec *vec,
+                                             apr_size_t nvec,
+                                             apr_size_t *nbytes)
+{
+    return file_io_at(thefile, 1, vec, nvec, offset, nbytes);
+}
+
 APR_DECLARE(apr_status_t) apr_file_pipe_wait(apr_file_t *thepipe,
                                              apr_wait_type_t direction)
 {
@@ -18,11 +18,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "apr_private.h"
+#include "apr_atomic.h"
 #include "apr_pools.h"
 #include "apr_tables.h"
 #include "apr.h"
+#include "apr_general.h" /* for APR_ALIGN */
+#include "apr_time.h"
 #include "apr_hooks.h"
 #include "apr_hash.h"
+#include "apr_strings.h"
 #include "apr_optional_hooks.h"
 #include "apr_optional.h"
 #define APR_WANT_MEMFUNC
@@ -36,6 +41,7 @@
 APR_DECLARE_DATA apr_pool_t *apr_hook_global_pool = NULL;
 APR_DECLARE_DATA int apr_hook_debug_enabled = 0;
 APR_DECLARE_DATA const char *apr_hook_debug_current = NULL;
+APR_DECLARE_DATA int apr_hook_profile_enabled = 0;
 
 /** @deprecated @see apr_hook_global_pool */
 APR_DECLARE_DATA apr_pool_t *apr_global_hook_pool = NULL;
@@ -56,6 +62,9 @@ typedef struct
     int nOrder;
 } TSortData;
 
+/* Assumed size of a cache line, for the frozen hooks */
+#define HOOK_CACHE_LINE 64
+
 typedef struct tsort_
 {
     void *pData;
@@ -64,8 +73,11 @@ typedef struct tsort_
     struct tsort_ *pNext;
 } TSort;
 
+#if APR_HAVE_TIME_H
+#include <time.h>       /* for clock_gettime */
+#endif
+
 #ifdef NETWARE
-#include "apr_private.h"
 #define get_apd                 APP_DATA* apd = (APP_DATA*)get_app_data(gLibId);
 #define s_aHooksToSort          ((apr_array_header_t *)(apd->gs_aHooksToSort))
 #define s_phOptionalHooks       ((apr_hash_t *)(apd->gs_phOptionalHooks))
@@ -224,10 +236,18 @@ typedef struct
 {
     const char *szHookName;
     apr_array_header_t **paHooks;
+    const apr_hook_frozen_t **paFrozen;
 } HookSortEntry;
 
 APR_DECLARE(void) apr_hook_sort_register(const char *szHookName,
                                         apr_array_header_t **paHooks)
+{
+    apr_hook_sort_register_frozen(szHookName, paHooks, NULL);
+}
+
+APR_DECLARE(void) apr_hook_sort_register_frozen(const char *szHookName,
+                                               apr_array_header_t **paHooks,
+                                               const apr_hook_frozen_t **paFrozen)
 {
 #ifdef NETWARE
     get_apd
@@ -239,6 +259,78 @@ APR_DECLARE(void) apr_hook_sort_register(const char *szHookName,
     pEntry=apr_array_push(s_aHooksToSort);
     pEntry->szHookName=szHookName;
     pEntry->paHooks=paHooks;
+    pEntry->paFrozen=paFrozen;
+}
+
+/* The profiles of the hooked functions, by ProfileKey */
+#ifndef NETWARE
+static apr_hash_t *s_phProfiles;
+static apr_array_header_t *s_aProfiles;
+#endif
+
+typedef struct
+{
+    const char *szHookName;
+    const char *szName;
+    apr_hook_fn_t *pFunc;
+} ProfileKey;
+
+static apr_hook_profile_t *get_profile(const char *szHookName,
+                                       const TSortData *pHook)
+{
+#ifdef NETWARE
+    get_apd
+#endif
+    apr_hook_profile_t *pProfile;
+    ProfileKey *pKey;
+    ProfileKey key;
+
+    /* The hooked functions keep their profile when frozen again */
+    memset(&key, 0, sizeof key);
+    key.szHookName=szHookName;
+    key.szName=pHook->szName;
+    key.pFunc=(apr_hook_fn_t *)pHook->dummy;
+
+    if(!s_phProfiles) {
+        s_phProfiles=apr_hash_make(apr_hook_global_pool);
+        s_aProfiles=apr_array_make(apr_hook_global_pool,16,
+                                   sizeof(apr_hook_profile_t *));
+    }
+    pProfile=apr_hash_get(s_phProfiles,&key,sizeof key);
+    if(!pProfile) {
+        pKey=apr_pmemdup(apr_hook_global_pool,&key,sizeof key);
+        pProfile=apr_pcalloc(apr_hook_global_pool,sizeof *pProfile);
+        pProfile->hook=szHookName;
+        pProfile->module=pHook->szName;
+        pProfile->func=pKey->pFunc;
+        apr_hash_set(s_phProfiles,pKey,sizeof *pKey,pProfile);
+        *(apr_hook_profile_t **)apr_array_push(s_aProfiles)=pProfile;
+    }
+
+    return pProfile;
+}
+
+APR_DECLARE(const apr_hook_frozen_t *) apr_hook_freeze(const char *szHookName,
+                                                       const apr_array_header_t *pHooks)
+{
+    const TSortData *pData=(const TSortData *)pHooks->elts;
+    apr_hook_frozen_t *pFrozen;
+    char *pMem;
+    int n;
+
+    pMem=apr_palloc(apr_hook_global_pool,
+                    (pHooks->nelts + 1) * sizeof *pFrozen + HOOK_CACHE_LINE - 1);
+    pFrozen=(apr_hook_frozen_t *)APR_ALIGN((apr_uintptr_t)pMem, HOOK_CACHE_LINE);
+    for(n=0 ; n < pHooks->nelts ; ++n) {
+        pFrozen[n].pFunc=(apr_hook_fn_t *)pData[n].dummy;
+        pFrozen[n].szName=pData[n].szName;
+        pFrozen[n].pProfile=get_profile(szHookName,&pData[n]);
+    }
+    pFrozen[n].pFunc=NULL;
+    pFrozen[n].szName=NULL;
+    pFrozen[n].pProfile=NULL;
+
+    return pFrozen;
 }
 
 APR_DECLARE(void) apr_hook_sort_all(void)
@@ -255,6 +347,9 @@ APR_DECLARE(void) apr_hook_sort_all(void)
     for(n=0 ; n < s_aHooksToSort->nelts ; ++n) {
         HookSortEntry *pEntry=&((HookSortEntry *)s_aHooksToSort->elts)[n];
         *pEntry->paHooks=sort_hook(*pEntry->paHooks,pEntry->szHookName);
+        if(pEntry->paFrozen)
+            *pEntry->paFrozen=apr_hook_freeze(pEntry->szHookName,
+                                              *pEntry->paHooks);
     }
 }
 
@@ -277,10 +372,100 @@ APR_DECLARE(void) apr_hook_deregister_all(void)
     for(n=0 ; n < s_aHooksToSort->nelts ; ++n) {
         HookSortEntry *pEntry=&((HookSortEntry *)s_aHooksToSort->elts)[n];
         *pEntry->paHooks=NULL;
+        if(pEntry->paFrozen)
+            *pEntry->paFrozen=NULL;
     }
     s_aHooksToSort=NULL;
     s_phOptionalHooks=NULL;
     s_phOptionalFunctions=NULL;
+    s_phProfiles=NULL;
+    s_aProfiles=NULL;
+}
+
+APR_DECLARE(apr_uint64_t) apr_hook_profile_clock(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+        return (apr_uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+#endif
+    return (apr_uint64_t)apr_time_monotonic() * 1000;
+}
+
+APR_DECLARE(void) apr_hook_profile_record(apr_hook_profile_t *pProfile,
+                                          apr_uint64_t nStart)
+{
+    apr_uint64_t nTime=apr_hook_profile_clock() - nStart;
+    apr_uint64_t nMax;
+
+    apr_atomic_inc64(&pProfile->calls);
+    apr_atomic_add64(&pProfile->total_ns,nTime);
+    while((nMax=apr_atomic_read64(&pProfile->max_ns)) < nTime
+          && apr_atomic_cas64(&pProfile->max_ns,nTime,nMax) != nMax)
+        ;
+}
+
+static int profile_order(const void *a_,const void *b_)
+{
+    const apr_hook_profile_t *a=a_;
+    const apr_hook_profile_t *b=b_;
+
+    return (a->total_ns < b->total_ns) - (a->total_ns > b->total_ns);
+}
+
+APR_DECLARE(int) apr_hook_profile_do(apr_hook_profile_cb_t *cb, void *baton)
+{
+#ifdef NETWARE
+    get_apd
+#endif
+    apr_hook_profile_t *pProfiles;
+    int n,nProfiles;
+    int rv=1;
+
+    if(!s_aProfiles || !s_aProfiles->nelts)
+        return 1;
+
+    nProfiles=s_aProfiles->nelts;
+    if((pProfiles=malloc(nProfiles * sizeof *pProfiles)) == NULL)
+        return 0;
+    for(n=0 ; n < nProfiles ; ++n) {
+        apr_hook_profile_t *pProfile=APR_ARRAY_IDX(s_aProfiles,n,
+                                                   apr_hook_profile_t *);
+
+        pProfiles[n]=*pProfile;
+        pProfiles[n].calls=apr_atomic_read64(&pProfile->calls);
+        pProfiles[n].total_ns=apr_atomic_read64(&pProfile->total_ns);
+        pProfiles[n].max_ns=apr_atomic_read64(&pProfile->max_ns);
+    }
+    qsort(pProfiles,nProfiles,sizeof *pProfiles,profile_order);
+
+    for(n=0 ; n < nProfiles && rv ; ++n)
+        rv=cb(baton,&pProfiles[n]);
+    free(pProfiles);
+
+    return rv;
+}
+
+APR_DECLARE(void) apr_hook_profile_reset(void)
+{
+#ifdef NETWARE
+    get_apd
+#endif
+    int n;
+
+    if(!s_aProfiles)
+        return;
+
+    for(n=0 ; n < s_aProfiles->nelts ; ++n) {
+        apr_hook_profile_t *pProfile=APR_ARRAY_IDX(s_aProfiles,n,
+                                                   apr_hook_profile_t *);
+
+        apr_atomic_set64(&pProfile->calls,0);
+        apr_atomic_set64(&pProfile->total_ns,0);
+        apr_atomic_set64(&pProfile->max_ns,0);
+    }
 }
 
 APR_DECLARE(void) apr_hook_debug_show(const char *szName,
@@ -0,0 +1,355 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_AIO_H
+#define APR_AIO_H
+/**
+ * @file apr_aio.h
+ * @brief APR Asynchronous I/O Completion interface
+ */
+#include "apr.h"
+#include "apr_pools.h"
+#include "apr_errno.h"
+#include "apr_time.h"
+#include "apr_file_io.h"
+#include "apr_network_io.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * @defgroup apr_aio Asynchronous I/O Completion Routines
+ * @ingroup APR
+ *
+ * An apr_aio_ring_t runs socket and file operations in the background
+ * and reports their completion: the caller queues operations on the
+ * ring, and reaps the completed ones in batches with apr_aio_ring_reap(),
+ * from a single thread.  Where Linux io_uring is available the kernel
+ * runs the operations; elsewhere they run on a pool of threads.
+ * @{
+ */
+
+/**
+ * @defgroup aioflags AIO Ring Flags
+ * @ingroup apr_aio
+ * @{
+ */
+#define APR_AIO_NODEFAULT      0x010 /**< Do not try to use the default method if
+                                      * the specified non-default method cannot be
+                                      * used
+                                      */
+/** @} */
+
+/**
+ * AIO Ring Methods
+ */
+typedef enum {
+    APR_AIO_DEFAULT,        /**< Platform default aio method */
+    APR_AIO_IO_URING,       /**< Operations run by Linux io_uring */
+    APR_AIO_THREADPOOL      /**< Operations run by a pool of threads */
+} apr_aio_method_e;
+
+/**
+ * AIO Operations
+ */
+typedef enum {
+    APR_AIO_OP_RECV,        /**< apr_socket_recv() */
+    APR_AIO_OP_SEND,        /**< apr_socket_send() */
+    APR_AIO_OP_ACCEPT,      /**< apr_socket_accept() */
+    APR_AIO_OP_CONNECT,     /**< apr_socket_connect() */
+    APR_AIO_OP_READ,        /**< apr_file_read() at an offset */
+    APR_AIO_OP_WRITE,       /**< apr_file_write() at an offset */
+    APR_AIO_OP_SYNC         /**< apr_file_sync() */
+} apr_aio_opcode_e;
+
+/** Opaque structure used for the aio ring API */
+typedef struct apr_aio_ring_t apr_aio_ring_t;
+
+/** @see apr_aio_op_t */
+typedef struct apr_aio_op_t apr_aio_op_t;
+
+/**
+ * Completion callback, run by apr_aio_ring_reap()
+ * @param op The completed operation
+ */
+typedef void (apr_aio_cb_t)(apr_aio_op_t *op);
+
+/**
+ * An asynchronous operation.  The structure is owned by the caller and
+ * filled in by the apr_aio_socket_* and apr_aio_file_* functions; it,
+ * and the buffer it refers to, must stay valid and untouched until the
+ * operation is reaped.
+ */
+struct apr_aio_op_t {
+    /** The operation */
+    apr_aio_opcode_e opcode;
+    /** The socket, for the socket operations */
+    apr_socket_t *sock;
+    /** The file, for the file operations */
+    apr_file_t *file;
+    /** The data to send or write, or the buffer to receive or read in */
+    void *buf;
+    /** The length of buf */
+    apr_size_t len;
+    /** The file offset to read or write at */
+    apr_off_t offset;
+    /** The address to connect to */
+    apr_sockaddr_t *sa;
+    /** The pool of the accepted socket */
+    apr_pool_t *pool;
+    /** The completion callback, or NULL to return the operation from
+     * apr_aio_ring_reap() */
+    apr_aio_cb_t *cb;
+    /** Caller data */
+    void *data;
+
+    /** Result: the status of the operation, APR_EOF when a receive or
+     * read hit the end of the stream */
+    apr_status_t status;
+    /** Result: the number of bytes transferred */
+    apr_size_t nbytes;
+    /** Result: the accepted socket */
+    apr_socket_t *accepted;
+
+    /** Private: the method's state for the operation */
+    void *ctx;
+    /** Private: the ring's link */
+    apr_aio_op_t *next;
+};
+
+/**
+ * Set up an aio ring, using the default method
+ * @param ring The pointer in which to return the newly created ring
+ * @param size The maximum number of operations in flight
+ * @param p The pool from which to allocate the ring
+ * @param flags Optional flags to modify the operation of the ring.
+ * @remark Destroying the pool destroys the ring; operations still in
+ *         flight are cancelled, or waited for when they already run.
+ */
+APR_DECLARE(apr_status_t) apr_aio_ring_create(apr_aio_ring_t **ring,
+                                              apr_uint32_t size,
+                                              apr_pool_t *p,
+                                              apr_uint32_t flags);
+
+/**
+ * Set up an aio ring
+ * @param ring The pointer in which to return the newly created ring
+ * @param size The maximum number of operations in flight
+ * @param p The pool from which to allocate the ring
+ * @param flags Optional flags to modify the operation of the ring.
+ * @param method AIO method to use. See #apr_aio_method_e.  If this
+ *         method cannot be used, the default method will be used unless the
+ *         APR_AIO_NODEFAULT flag has been specified.
+ * @remark APR_AIO_IO_URING requires Linux 5.11 or later.  The kernel
+ *         ignores the socket timeouts of apr_socket_timeout_set(), and
+ *         like apr_pollset_t of APR_POLLSET_IO_URING, destroying the ring
+ *         may make the next blocking system call of the thread that used
+ *         it fail with APR_EINTR.
+ * @remark APR_AIO_THREADPOOL runs each operation with the blocking APR
+ *         call, on up to size threads.  Without APR_HAS_THREADS the
+ *         operations run one by one in apr_aio_ring_reap().
+ */
+APR_DECLARE(apr_status_t) apr_aio_ring_create_ex(apr_aio_ring_t **ring,
+                                                 apr_uint32_t size,
+                                                 apr_pool_t *p,
+                                                 apr_uint32_t flags,
+                                                 apr_aio_method_e method);
+
+/**
+ * Destroy an aio ring
+ * @param ring The ring to destroy
+ */
+APR_DECLARE(apr_status_t) apr_aio_ring_destroy(apr_aio_ring_t *ring);
+
+/**
+ * Return a printable representation of the aio method.
+ * @param ring The ring to use
+ */
+APR_DECLARE(const char *) apr_aio_ring_method_name(apr_aio_ring_t *ring);
+
+/**
+ * Queue a receive from a socket, as apr_socket_recv()
+ * @param ring The ring to queue on
+ * @param op The operation to fill in
+ * @param sock The socket to receive from
+ * @param buf The buffer to receive in
+ * @param len The length of buf
+ * @param cb The completion callback, or NULL
+ * @param data Caller data for the operation
+ * @return APR_EAGAIN if size operations are already queued or in flight
+ * @remark The operations are queued until apr_aio_ring_submit() or
+ *         apr_aio_ring_reap() is called.
+ */
+APR_DECLARE(apr_status_t) apr_aio_socket_recv(apr_aio_ring_t *ring,
+                                              apr_aio_op_t *op,
+                                              apr_socket_t *sock,
+                                              char *buf, apr_size_t len,
+                                              apr_aio_cb_t *cb, void *data);
+
+/**
+ * Queue a send to a socket, as apr_socket_send()
+ * @param ring The ring to queue on
+ * @param op The operation to fill in
+ * @param sock The socket to send to
+ * @param buf The data to send
+ * @param len The length of buf
+ * @param cb The completion callback, or NULL
+ * @param data Caller data for the operation
+ * @return APR_EAGAIN if size operations are already queued or in flight
+ * @remark Like apr_socket_send(), the operation may send less than len
+ *         bytes.
+ */
+APR_DECLARE(apr_status_t) apr_aio_socket_send(apr_aio_ring_t *ring,
+                                              apr_aio_op_t *op,
+                                              apr_socket_t *sock,
+                                              const char *buf, apr_size_t len,
+                                              apr_aio_cb_t *cb, void *data);
+
+/**
+ * Queue an accept on a listening socket, as apr_socket_accept()
+ * @param ring The ring to queue on
+ * @param op The operation to fill in
+ * @param sock The listening socket
+ * @param pool The pool of the accepted socket, returned in op->accepted
+ * @param cb The completion callback, or NULL
+ * @param data Caller data for the operation
+ * @return APR_EAGAIN if size operations are already queued or in flight
+ * @remark The pool must not be used until the operation is reaped, the
+ *         APR_AIO_THREADPOOL method allocates from it in another thread.
+ */
+APR_DECLARE(apr_status_t) apr_aio_socket_accept(apr_aio_ring_t *ring,
+                                                apr_aio_op_t *op,
+                                                apr_socket_t *sock,
+                                                apr_pool_t *pool,
+                                                apr_aio_cb_t *cb, void *data);
+
+/**
+ * Queue a connect of a socket, as apr_socket_connect()
+ * @param ring The ring to queue on
+ * @param op The operation to fill in
+ * @param sock The socket to connect
+ * @param sa The address to connect to
+ * @param cb The completion callback, or NULL
+ * @param data Caller data for the operation
+ * @return APR_EAGAIN if size operations are already queued or in flight
+ */
+APR_DECLARE(apr_status_t) apr_aio_socket_connect(apr_aio_ring_t *ring,
+                                                 apr_aio_op_t *op,
+                                                 apr_socket_t *sock,
+                                                 apr_sockaddr_t *sa,
+                                                 apr_aio_cb_t *cb, void *data);
+
+/**
+ * Queue a read from a file at an offset
+ * @param ring The ring to queue on
+ * @param op The operation to fill in
+ * @param file The file to read from
+ * @param buf The buffer to read in
+ * @param len The length of buf
+ * @param offset The file offset to read at
+ * @param cb The completion callback, or NULL
+ * @param data Caller data for the operation
+ * @return APR_EAGAIN if size operations are already queued or in flight,
+ *         APR_EINVAL if the file was opened with APR_FOPEN_BUFFERED
+ * @remark The file pointer may be moved by the operation only when the
+ *         system has no pread(); the operation may read less than len
+ *         bytes.
+ */
+APR_DECLARE(apr_status_t) apr_aio_file_read(apr_aio_ring_t *ring,
+                                            apr_aio_op_t *op,
+                                            apr_file_t *file,
+                                            void *buf, apr_size_t len,
+                                            apr_off_t offset,
+                                            apr_aio_cb_t *cb, void *data);
+
+/**
+ * Queue a write to a file at an offset
+ * @param ring The ring to queue on
+ * @param op The operation to fill in
+ * @param file The file to write to
+ * @param buf The data to write
+ * @param len The length of buf
+ * @param offset The file offset to write at
+ * @param cb The completion callback, or NULL
+ * @param data Caller data for the operation
+ * @return APR_EAGAIN if size operations are already queued or in flight,
+ *         APR_EINVAL if the file was opened with APR_FOPEN_BUFFERED
+ * @remark The file pointer may be moved by the operation only when the
+ *         system has no pwrite(); the operation may write less than len
+ *         bytes.
+ */
+APR_DECLARE(apr_status_t) apr_aio_file_write(apr_aio_ring_t *ring,
+                                             apr_aio_op_t *op,
+                                             apr_file_t *file,
+                                             const void *buf, apr_size_t len,
+                                             apr_off_t offset,
+                                             apr_aio_cb_t *cb, void *data);
+
+/**
+ * Queue a sync of a file, as apr_file_sync()
+ * @param ring The ring to queue on
+ * @param op The operation to fill in
+ * @param file The file to sync
+ * @param cb The completion callback, or NULL
+ * @param data Caller data for the operation
+ * @return APR_EAGAIN if size operations are already queued or in flight,
+ *         APR_EINVAL if the file was opened with APR_FOPEN_BUFFERED
+ * @remark The operations are not ordered: queue the sync once the writes
+ *         it should cover are reaped.
+ */
+APR_DECLARE(apr_status_t) apr_aio_file_sync(apr_aio_ring_t *ring,
+                                            apr_aio_op_t *op,
+                                            apr_file_t *file,
+                                            apr_aio_cb_t *cb, void *data);
+
+/**
+ * Start the queued operations
+ * @param ring The ring to submit
+ * @remark apr_aio_ring_reap() submits the queued operations too, so this
+ *         is only needed to start them before reaping.
+ */
+APR_DECLARE(apr_status_t) apr_aio_ring_submit(apr_aio_ring_t *ring);
+
+/**
+ * Submit the queued operations and reap the completed ones
+ * @param ring The ring to reap
+ * @param timeout The amount of time in microseconds to wait for a first
+ *                completion.  This is a maximum, not a minimum.  If
+ *                negative, wait until an operation completes.
+ * @param ops Array in which to return the completed operations that have
+ *            no callback, or NULL if they all have one
+ * @param max The maximum number of operations to reap, the size of ops
+ * @param num The number of operations returned in ops
+ * @return APR_SUCCESS if operations were reaped, APR_TIMEUP if none
+ *         completed in time or none was in flight, APR_EINTR if a signal
+ *         interrupted the wait
+ * @remark The callbacks of the reaped operations run before this returns,
+ *         in the order of completion; they may queue new operations.
+ */
+APR_DECLARE(apr_status_t) apr_aio_ring_reap(apr_aio_ring_t *ring,
+                                            apr_interval_time_t timeout,
+                                            apr_aio_op_t **ops,
+                                            apr_int32_t max,
+                                            apr_int32_t *num);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* ! APR_AIO_H */
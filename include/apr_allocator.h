@@ -74,6 +74,40 @@ struct apr_memnode_t {
 APR_DECLARE(apr_status_t) apr_allocator_create(apr_allocator_t **allocator)
                           __attribute__((nonnull(1)));
 
+/** @see apr_allocator_create_ex() */
+#define APR_ALLOCATOR_HUGE_PAGES   0x01 /**< Back the memory with huge pages */
+#define APR_ALLOCATOR_NUMA_BIND    0x02 /**< Bind the memory to a NUMA node */
+
+/** The NUMA node of the calling thread, @see apr_allocator_create_ex() */
+#define APR_ALLOCATOR_NUMA_CURRENT (-1)
+
+/**
+ * Create a new allocator with memory attributes
+ * @param allocator The allocator we have just created.
+ * @param flags A combination of:
+ * <PRE>
+ *           APR_ALLOCATOR_HUGE_PAGES   Use (2MB) huge pages, or transparent
+ *                                      huge pages if none are reserved
+ *           APR_ALLOCATOR_NUMA_BIND    Bind the memory to @a numa_node
+ * </PRE>
+ * @param numa_node The NUMA node to bind the memory to, or
+ *        APR_ALLOCATOR_NUMA_CURRENT for the node of the calling thread.
+ *        Ignored without APR_ALLOCATOR_NUMA_BIND.
+ * @return APR_SUCCESS, APR_EINVAL for unknown flags or an invalid node, or
+ *         APR_ENOTIMPL if the attributes are not supported on this platform.
+ * @remark With any of the flags set, the memnodes are carved out of large
+ *         slabs instead of being allocated one by one. The memory of these
+ *         slabs is not given back to the system before the allocator is
+ *         destroyed (the apr_allocator_max_free_set() threshold applies to
+ *         big nodes only), and memnodes still in use when the allocator is
+ *         destroyed are unmapped too.
+ * @remark With no flags this is the same as apr_allocator_create().
+ */
+APR_DECLARE(apr_status_t) apr_allocator_create_ex(apr_allocator_t **allocator,
+                                                  apr_uint32_t flags,
+                                                  int numa_node)
+                          __attribute__((nonnull(1)));
+
 /**
  * Destroy an allocator
  * @param allocator The allocator to be destroyed
@@ -185,6 +219,46 @@ APR_DECLARE(apr_thread_mutex_t *) apr_allocator_mutex_get(
 
 #endif /* APR_HAS_THREADS */
 
+/**
+ * Enable per-thread caches of free memnodes in front of the allocator.
+ * Each thread using the allocator keeps up to @a max_nodes free nodes
+ * of each (small) size, which it can allocate and free again without
+ * taking the allocator's mutex. When a cache is full, half of it is
+ * given back to the allocator at once.
+ * @param allocator The allocator
+ * @param max_nodes The maximum number of nodes per size to keep in each
+ *        thread's cache, 0 to stop caching.
+ * @return APR_SUCCESS, or APR_ENOTIMPL if thread-specific data is not
+ *         supported on this platform.
+ * @remark The nodes cached by a thread are given back to the allocator
+ *         when the thread exits, or freed when the allocator is destroyed.
+ *         Stopping caching does not give them back before then.
+ * @remark Each allocator with caches enabled uses a thread-specific data
+ *         key, so this is meant for a few long-lived allocators shared
+ *         by many threads. Should be called before the allocator is used
+ *         by multiple threads.
+ */
+APR_DECLARE(apr_status_t) apr_allocator_thread_cache_set(
+                                          apr_allocator_t *allocator,
+                                          apr_size_t max_nodes)
+                          __attribute__((nonnull(1)));
+
+/**
+ * Get the hit/miss counters of the allocator's per-thread caches.
+ * @param allocator The allocator
+ * @param hits The number of allocations served by the caches
+ * @param misses The number of allocations the caches could not serve
+ * @return APR_SUCCESS, or APR_ENOTIMPL if the per-thread caches are not
+ *         supported on this platform.
+ * @remark The counters of the threads still running are approximate.
+ * @see apr_allocator_thread_cache_set()
+ */
+APR_DECLARE(apr_status_t) apr_allocator_thread_cache_stats(
+                                          apr_allocator_t *allocator,
+                                          apr_uint64_t *hits,
+                                          apr_uint64_t *misses)
+                          __attribute__((nonnull(1,2,3)));
+
 /** @} */
 
 #ifdef __cplusplus
@@ -113,6 +113,48 @@ APR_DECLARE(apr_uint32_t) apr_atomic_cas32(volatile apr_uint32_t *mem, apr_uint3
  */
 APR_DECLARE(apr_uint32_t) apr_atomic_xchg32(volatile apr_uint32_t *mem, apr_uint32_t val);
 
+/**
+ * atomically AND 'val' into an apr_uint32_t
+ * @param mem pointer to the object
+ * @param val the mask to AND
+ * @return old value pointed to by mem
+ */
+APR_DECLARE(apr_uint32_t) apr_atomic_and32(volatile apr_uint32_t *mem, apr_uint32_t val);
+
+/**
+ * atomically OR 'val' into an apr_uint32_t
+ * @param mem pointer to the object
+ * @param val the mask to OR
+ * @return old value pointed to by mem
+ */
+APR_DECLARE(apr_uint32_t) apr_atomic_or32(volatile apr_uint32_t *mem, apr_uint32_t val);
+
+/**
+ * atomically XOR 'val' into an apr_uint32_t
+ * @param mem pointer to the object
+ * @param val the mask to XOR
+ * @return old value pointed to by mem
+ */
+APR_DECLARE(apr_uint32_t) apr_atomic_xor32(volatile apr_uint32_t *mem, apr_uint32_t val);
+
+/**
+ * atomically read an apr_uint32_t from memory, with acquire semantics only
+ * @param mem the pointer
+ * @remark No later memory access is reordered before this read; this is
+ *         the cheaper half of apr_atomic_read32() to pair with
+ *         apr_atomic_set32_release().
+ */
+APR_DECLARE(apr_uint32_t) apr_atomic_read32_acquire(volatile apr_uint32_t *mem);
+
+/**
+ * atomically set an apr_uint32_t in memory, with release semantics only
+ * @param mem pointer to the object
+ * @param val value that the object will assume
+ * @remark No earlier memory access is reordered after this write, e.g.
+ *         to publish data initialized before setting a flag.
+ */
+APR_DECLARE(void) apr_atomic_set32_release(volatile apr_uint32_t *mem, apr_uint32_t val);
+
 /*
  * Atomic operations on 64-bit values
  * Note: Each of these functions internally implements a memory barrier
@@ -180,6 +222,48 @@ APR_DECLARE(apr_uint64_t) apr_atomic_cas64(volatile apr_uint64_t *mem, apr_uint6
  */
 APR_DECLARE(apr_uint64_t) apr_atomic_xchg64(volatile apr_uint64_t *mem, apr_uint64_t val);
 
+/**
+ * atomically AND 'val' into an apr_uint64_t
+ * @param mem pointer to the object
+ * @param val the mask to AND
+ * @return old value pointed to by mem
+ */
+APR_DECLARE(apr_uint64_t) apr_atomic_and64(volatile apr_uint64_t *mem, apr_uint64_t val);
+
+/**
+ * atomically OR 'val' into an apr_uint64_t
+ * @param mem pointer to the object
+ * @param val the mask to OR
+ * @return old value pointed to by mem
+ */
+APR_DECLARE(apr_uint64_t) apr_atomic_or64(volatile apr_uint64_t *mem, apr_uint64_t val);
+
+/**
+ * atomically XOR 'val' into an apr_uint64_t
+ * @param mem pointer to the object
+ * @param val the mask to XOR
+ * @return old value pointed to by mem
+ */
+APR_DECLARE(apr_uint64_t) apr_atomic_xor64(volatile apr_uint64_t *mem, apr_uint64_t val);
+
+/**
+ * atomically read an apr_uint64_t from memory, with acquire semantics only
+ * @param mem the pointer
+ * @remark No later memory access is reordered before this read; this is
+ *         the cheaper half of apr_atomic_read64() to pair with
+ *         apr_atomic_set64_release().
+ */
+APR_DECLARE(apr_uint64_t) apr_atomic_read64_acquire(volatile apr_uint64_t *mem);
+
+/**
+ * atomically set an apr_uint64_t in memory, with release semantics only
+ * @param mem pointer to the object
+ * @param val value that the object will assume
+ * @remark No earlier memory access is reordered after this write, e.g.
+ *         to publish data initialized before setting a flag.
+ */
+APR_DECLARE(void) apr_atomic_set64_release(volatile apr_uint64_t *mem, apr_uint64_t val);
+
 /**
  * compare the pointer's value with cmp.
  * If they are the same swap the value with 'with'
@@ -198,6 +282,46 @@ APR_DECLARE(void*) apr_atomic_casptr(void *volatile *mem, void *with, const void
  */
 APR_DECLARE(void*) apr_atomic_xchgptr(void *volatile *mem, void *with);
 
+/**
+ * A pointer with a tag, compared and swapped together by
+ * apr_atomic_cas_tagptr().  Changing the tag with each swap of the
+ * pointer protects lock-free structures from the ABA problem.
+ */
+typedef struct apr_atomic_tagptr_t {
+    /** The pointer */
+    void *ptr;
+    /** The tag, usually a generation counter */
+    apr_uintptr_t tag;
+} apr_atomic_tagptr_t;
+
+/**
+ * compare a tagged pointer with 'cmp', both the pointer and the tag.
+ * If they are the same swap the tagged pointer with 'with'
+ * @param mem pointer to the tagged pointer
+ * @param cmp the value to compare it to, set to the old value of *mem
+ *        when they differ
+ * @param with what to swap it with
+ * @return non-zero if swapped, zero otherwise
+ * @remark @a mem must be aligned on sizeof(apr_atomic_tagptr_t), which
+ *         apr_palloc() does not guarantee on 64-bit platforms.  Where the
+ *         processor has no double-width compare-and-swap, the operation
+ *         is serialized with internal spinlocks.
+ */
+APR_DECLARE(int) apr_atomic_cas_tagptr(volatile apr_atomic_tagptr_t *mem,
+                                       apr_atomic_tagptr_t *cmp,
+                                       apr_atomic_tagptr_t with);
+
+/**
+ * issue a full memory barrier: no memory access is reordered across it
+ */
+APR_DECLARE(void) apr_atomic_fence(void);
+
+/**
+ * hint to the processor that the caller is spinning on a shared value,
+ * e.g. between the attempts of a busy-wait loop
+ */
+APR_DECLARE(void) apr_atomic_pause(void);
+
 /** @} */
 
 #ifdef __cplusplus
@@ -32,6 +32,8 @@
 #include "apr_mmap.h"
 #include "apr_errno.h"
 #include "apr_ring.h"
+#include "apr_strmatch.h"
+#include "apr_encode.h"
 #include "apr.h"
 #if APR_HAVE_SYS_UIO_H
 #include <sys/uio.h>	/* for struct iovec */
@@ -58,6 +60,17 @@ extern "C" {
  */
 #define APR_BUCKETS_STRING -1
 
+/** if passed to apr_brigade_write_socket(), more data will follow the
+ * brigade: the socket is left corked (APR_TCP_NOPUSH)
+ */
+#define APR_BRIGADE_WRITE_MORE 0x1
+
+/** if passed to apr_brigade_write_socket(), the pipe and socket buckets
+ * are moved to the socket by the kernel (splice(2)) where supported,
+ * rather than read into memory
+ */
+#define APR_BRIGADE_WRITE_SPLICE 0x2
+
 /** Determines how a bucket or brigade should be read */
 typedef enum {
     APR_BLOCK_READ,   /**< block until data becomes available */
@@ -278,6 +291,11 @@ struct apr_bucket_brigade {
     APR_RING_HEAD(apr_bucket_list, apr_bucket) list;
     /** The freelist from which this bucket was allocated */
     apr_bucket_alloc_t *bucket_alloc;
+    /** The length of the buckets when tracked and known, else -1
+     *  @see apr_brigade_length_track() */
+    apr_off_t length;
+    /** Whether the length is tracked */
+    int length_tracked;
 };
 
 
@@ -286,6 +304,12 @@ struct apr_bucket_brigade {
  */
 typedef apr_status_t (*apr_brigade_flush)(apr_bucket_brigade *bb, void *ctx);
 
+/**
+ * A writer coalescing the small writes to a brigade
+ * @see apr_brigade_writer_create()
+ */
+typedef struct apr_brigade_writer_t apr_brigade_writer_t;
+
 /*
  * define APR_BUCKET_DEBUG if you want your brigades to be checked for
  * validity at every possible instant.  this will slow your code down
@@ -358,6 +382,42 @@ typedef apr_status_t (*apr_brigade_flush)(apr_bucket_brigade *bb, void *ctx);
  */
 #define APR_BRIGADE_LAST(b)	APR_RING_LAST(&(b)->list)
 
+/**
+ * Forget the tracked length of a brigade, to be recomputed by the next
+ * apr_brigade_length(), after its buckets were removed, inserted or
+ * resized other than by the APR_BRIGADE_* macros or apr_brigade_*
+ * functions.
+ * @param b The brigade
+ * @see apr_brigade_length_track()
+ */
+#define APR_BRIGADE_LENGTH_INVALIDATE(b) ((b)->length = -1)
+
+/**
+ * Account for a bucket of length len added to a brigade
+ * @param b The brigade
+ * @param len The length of the bucket, maybe (apr_size_t)(-1)
+ */
+#define APR_BRIGADE_LENGTH_ADD(b, len) do {				\
+        if ((b)->length >= 0) {						\
+            apr_size_t ap__len = (len);					\
+            (b)->length = ap__len == (apr_size_t)(-1)			\
+                          ? -1 : (b)->length + (apr_off_t)ap__len;	\
+        }								\
+    } while (0)
+
+/**
+ * Account for the buckets of brigade b moved (all) to brigade a
+ * @param a The brigade added to
+ * @param b The brigade emptied
+ */
+#define APR_BRIGADE_LENGTH_MOVE(a, b) do {				\
+        if ((a)->length >= 0) {						\
+            (a)->length = (b)->length >= 0 ? (a)->length + (b)->length	\
+                                           : -1;			\
+        }								\
+        (b)->length = (b)->length_tracked ? 0 : -1;			\
+    } while (0)
+
 /**
  * Insert a single bucket at the front of a brigade
  * @param b The brigade to add to
@@ -366,6 +426,7 @@ typedef apr_status_t (*apr_brigade_flush)(apr_bucket_brigade *bb, void *ctx);
 #define APR_BRIGADE_INSERT_HEAD(b, e) do {				\
 	apr_bucket *ap__b = (e);                                        \
 	APR_RING_INSERT_HEAD(&(b)->list, ap__b, apr_bucket, link);	\
+        APR_BRIGADE_LENGTH_ADD((b), ap__b->length);			\
         APR_BRIGADE_CHECK_CONSISTENCY((b));				\
     } while (0)
 
@@ -377,6 +438,7 @@ typedef apr_status_t (*apr_brigade_flush)(apr_bucket_brigade *bb, void *ctx);
 #define APR_BRIGADE_INSERT_TAIL(b, e) do {				\
 	apr_bucket *ap__b = (e);					\
 	APR_RING_INSERT_TAIL(&(b)->list, ap__b, apr_bucket, link);	\
+        APR_BRIGADE_LENGTH_ADD((b), ap__b->length);			\
         APR_BRIGADE_CHECK_CONSISTENCY((b));				\
     } while (0)
 
@@ -387,6 +449,7 @@ typedef apr_status_t (*apr_brigade_flush)(apr_bucket_brigade *bb, void *ctx);
  */
 #define APR_BRIGADE_CONCAT(a, b) do {					\
         APR_RING_CONCAT(&(a)->list, &(b)->list, apr_bucket, link);	\
+        APR_BRIGADE_LENGTH_MOVE((a), (b));				\
         APR_BRIGADE_CHECK_CONSISTENCY((a));				\
     } while (0)
 
@@ -397,6 +460,7 @@ typedef apr_status_t (*apr_brigade_flush)(apr_bucket_brigade *bb, void *ctx);
  */
 #define APR_BRIGADE_PREPEND(a, b) do {					\
         APR_RING_PREPEND(&(a)->list, &(b)->list, apr_bucket, link);	\
+        APR_BRIGADE_LENGTH_MOVE((a), (b));				\
         APR_BRIGADE_CHECK_CONSISTENCY((a));				\
     } while (0)
 
@@ -485,6 +549,12 @@ typedef apr_status_t (*apr_brigade_flush)(apr_bucket_brigade *bb, void *ctx);
  * @return true or false
  */
 #define APR_BUCKET_IS_SOCKET(e)      ((e)->type == &apr_bucket_type_socket)
+/**
+ * Determine if a bucket is a DIGEST bucket
+ * @param e The bucket to inspect
+ * @return true or false
+ */
+#define APR_BUCKET_IS_DIGEST(e)      ((e)->type == &apr_bucket_type_digest)
 /**
  * Determine if a bucket is a HEAP bucket
  * @param e The bucket to inspect
@@ -632,6 +702,10 @@ struct apr_bucket_file {
     apr_pool_t *readpool;
     /** File read block size */
     apr_size_t read_size;
+    /** The size of the read ahead window, zero for none */
+    apr_size_t read_ahead;
+    /** The end of the data the kernel was advised to read ahead */
+    apr_off_t read_ahead_off;
 };
 
 /** @see apr_bucket_structs */
@@ -750,12 +824,30 @@ APR_DECLARE(apr_status_t) apr_brigade_partition(apr_bucket_brigade *b,
  * @param length Returns the length of the brigade (up to the end, or up
  *               to a bucket read error), or -1 if the brigade has buckets
  *               of indeterminate length and read_all is 0.
+ * @remark The length of a tracked brigade is returned at once when known.
+ * @see apr_brigade_length_track()
  */
 APR_DECLARE(apr_status_t) apr_brigade_length(apr_bucket_brigade *bb,
                                              int read_all,
                                              apr_off_t *length)
                           __attribute__((nonnull(1,3)));
 
+/**
+ * Track the length of a brigade, so that apr_brigade_length() returns it
+ * without walking the buckets while it is known.
+ * @param bb The brigade
+ * @param on Non-zero to track the length, zero to stop
+ * @remark The length is updated by the APR_BRIGADE_* macros and the
+ *         apr_brigade_* functions only, and is unknown (until the next
+ *         apr_brigade_length()) while the brigade has a bucket of
+ *         indeterminate length.  After the buckets of a tracked brigade
+ *         are modified otherwise (e.g. APR_BUCKET_REMOVE(),
+ *         apr_bucket_delete(), APR_BUCKET_INSERT_BEFORE() or a change of
+ *         their length), APR_BRIGADE_LENGTH_INVALIDATE() must be called.
+ */
+APR_DECLARE(void) apr_brigade_length_track(apr_bucket_brigade *bb, int on)
+                          __attribute__((nonnull(1)));
+
 /**
  * Take a bucket brigade and store the data in a flat char*
  * @param bb The bucket brigade to create the char* from
@@ -781,6 +873,28 @@ APR_DECLARE(apr_status_t) apr_brigade_pflatten(apr_bucket_brigade *bb,
                                                apr_pool_t *pool)
                           __attribute__((nonnull(1,2,3,4)));
 
+/**
+ * Get the data of a bucket brigade as a flat char array, copying it only
+ * if it is not contiguous already.
+ * @param bb The bucket brigade to get the data of
+ * @param data On return, the flat char array (not NUL terminated).
+ * @param len On return, the length of the char array.
+ * @param pool The pool to allocate the copy from, or NULL to not copy.
+ * @return APR_SUCCESS, APR_INCOMPLETE if the data is not contiguous and
+ *         @a pool is NULL, or an error reading the buckets.
+ * @remark The data is contiguous when a single bucket has data, or when
+ *         the data of the buckets follow each other in memory (as do those
+ *         of the buckets split from one); @a data then points to the data
+ *         of the buckets, and is valid until they are modified or deleted.
+ * @remark The buckets are read as with apr_brigade_pflatten(), any file
+ *         or pipe is read into memory.
+ */
+APR_DECLARE(apr_status_t) apr_brigade_peek_contiguous(apr_bucket_brigade *bb,
+                                                      const char **data,
+                                                      apr_size_t *len,
+                                                      apr_pool_t *pool)
+                          __attribute__((nonnull(1,2,3)));
+
 /**
  * Split a brigade to represent one LF line.
  * @param bbOut The bucket brigade that will have the LF line appended to.
@@ -827,6 +941,82 @@ APR_DECLARE(apr_status_t) apr_brigade_split_boundary(apr_bucket_brigade *bbOut,
                                                      apr_off_t maxbytes)
                           __attribute__((nonnull(1,2)));
 
+/**
+ * Find the first match of a pattern in a brigade, without copying nor
+ * splitting its buckets.
+ *
+ * The match may span several buckets, and the metadata buckets are
+ * skipped.
+ *
+ * @param bb The bucket brigade to search.
+ * @param pattern The pattern to find.
+ * @param block The blocking mode to be used to read the buckets.
+ * @param bucket Where to return the bucket where the match starts.
+ * @param offset Where to return the offset of the match in that bucket.
+ * @return APR_SUCCESS if a match was found, APR_NOTFOUND if not, or the
+ *         error reading a bucket (like APR_EAGAIN with APR_NONBLOCK_READ).
+ * @remark Use apr_brigade_partition() or apr_bucket_split() to put the
+ *         match at the start of a bucket.
+ */
+APR_DECLARE(apr_status_t) apr_brigade_find(apr_bucket_brigade *bb,
+                                           const apr_strmatch_pattern *pattern,
+                                           apr_read_type_e block,
+                                           apr_bucket **bucket,
+                                           apr_size_t *offset)
+                          __attribute__((nonnull(1,2,4,5)));
+
+/**
+ * Encode or decode the data of a brigade in place, with a stream of
+ * apr_encode_stream_init() or apr_decode_stream_init().
+ *
+ * Each data bucket is read and replaced by a heap bucket of its result,
+ * or removed when the stream holds it all.  The metadata buckets stay.
+ * An EOS bucket finishes the stream, its result is inserted before it.
+ * Without one, the result of the brigades that come next continues the
+ * stream, until apr_encode_stream_final() or an EOS.
+ *
+ * @param bb The bucket brigade.
+ * @param st The stream.
+ * @return APR_SUCCESS, the error reading a bucket, or the error of the
+ *         decoding (see apr_encode_stream()), the brigade being converted
+ *         up to where it happened.
+ */
+APR_DECLARE(apr_status_t) apr_brigade_encode(apr_bucket_brigade *bb,
+                                             apr_encode_stream_t *st)
+                          __attribute__((nonnull(1,2)));
+
+/**
+ * The digests that apr_brigade_digest() and the DIGEST buckets update.
+ */
+typedef enum {
+    APR_BRIGADE_DIGEST_MD5,     /**< an apr_md5_ctx_t */
+    APR_BRIGADE_DIGEST_SHA1,    /**< an apr_sha1_ctx_t */
+    APR_BRIGADE_DIGEST_CRYPTO   /**< an apr_crypto_digest_t */
+} apr_brigade_digest_e;
+
+/**
+ * Add the data of a brigade to a digest, leaving the buckets in place.
+ *
+ * Each data bucket is read (with APR_BLOCK_READ) and its data given to
+ * the update function of the digest as is, without copy.  The metadata
+ * buckets are skipped.
+ *
+ * @param bb The bucket brigade.
+ * @param type The type of the digest.
+ * @param ctx The digest context, initialised (apr_md5_init(),
+ *        apr_sha1_init() or apr_crypto_digest_init()) and still to be
+ *        finalised by the caller.
+ * @return APR_SUCCESS, the error reading a bucket, or the error of the
+ *         digest (APR_ENOTIMPL for APR_BRIGADE_DIGEST_CRYPTO without
+ *         the crypto support).
+ * @remark Like any read, reading the pipe, socket or file buckets turns
+ *         them into memory buckets of what was read.
+ */
+APR_DECLARE(apr_status_t) apr_brigade_digest(apr_bucket_brigade *bb,
+                                             apr_brigade_digest_e type,
+                                             void *ctx)
+                          __attribute__((nonnull(1,3)));
+
 /**
  * Create an iovec of the elements in a bucket_brigade... return number
  * of elements used.  This is useful for writing to a file or to the
@@ -840,6 +1030,40 @@ APR_DECLARE(apr_status_t) apr_brigade_to_iovec(apr_bucket_brigade *b,
                                                struct iovec *vec, int *nvec)
                           __attribute__((nonnull(1,2,3)));
 
+/**
+ * Write the data of a bucket brigade to a socket, deleting the buckets
+ * once written.
+ * @param bb The bucket brigade to write
+ * @param sock The socket to write to
+ * @param flags Zero, or a combination of APR_BRIGADE_WRITE_MORE if more
+ *        data will follow and APR_BRIGADE_WRITE_SPLICE.
+ * @return APR_SUCCESS when the brigade is empty, otherwise the error
+ *         reading the buckets or writing to the socket, the brigade then
+ *         holding what was not written yet (APR_EAGAIN for instance with
+ *         a non-blocking socket).
+ * @remark The memory buckets are written in batches of up to
+ *         APR_MAX_IOVEC_SIZE with apr_socket_sendv(), and the file buckets
+ *         (of files opened with APR_FOPEN_SENDFILE_ENABLED) with
+ *         apr_socket_sendfile(), the buckets around them as headers and
+ *         trailers.  The buckets of indeterminate length are read with
+ *         APR_BLOCK_READ, and metadata buckets are deleted as passed.
+ * @remark When it takes more than one write, the socket is corked
+ *         (APR_TCP_NOPUSH) meanwhile, so that the data is sent in full
+ *         packets; it is uncorked before returning, pushing the last
+ *         of the data, unless APR_BRIGADE_WRITE_MORE is given.
+ * @remark With APR_BRIGADE_WRITE_SPLICE, the pipe and socket buckets are
+ *         spliced to the socket up to their end (Linux), through a pipe
+ *         for the socket buckets, without the data being copied to user
+ *         space.  The data taken from a socket bucket but not written yet
+ *         when returning an error is put back in the brigade as a heap
+ *         bucket.  Where the descriptors cannot be spliced, the buckets
+ *         are read as without the flag.
+ */
+APR_DECLARE(apr_status_t) apr_brigade_write_socket(apr_bucket_brigade *bb,
+                                                   apr_socket_t *sock,
+                                                   apr_int32_t flags)
+                          __attribute__((nonnull(1,2)));
+
 /**
  * This function writes a list of strings into a bucket brigade.
  * @param b The bucket brigade to add to
@@ -974,6 +1198,103 @@ APR_DECLARE(apr_status_t) apr_brigade_vprintf(apr_bucket_brigade *b,
                                               const char *fmt, va_list va)
                           __attribute__((nonnull(1,4)));
 
+/**
+ * Create a writer coalescing the small writes to a brigade.  The data is
+ * written in a buffer of the bucket allocator, which gets appended to
+ * the brigade as a heap bucket (without copying it) when it is full or
+ * flushed.
+ * @param w The new writer, allocated from the pool of the brigade
+ * @param bb The brigade to write to
+ * @param size The size of the buffer, the writes of at least this size
+ *        not being coalesced (zero for APR_BUCKET_BUFF_SIZE).
+ * @param flush The flush function to call when the buffer is full (and
+ *        appended to the brigade), or NULL.
+ * @param ctx The structure to pass to the flush function
+ * @return APR_SUCCESS
+ * @remark The data not flushed when the pool of the brigade is cleared
+ *         is discarded.
+ * @remark The writer must be flushed before the brigade is written to (or
+ *         passed on) otherwise, for the data to remain in order.
+ */
+APR_DECLARE(apr_status_t) apr_brigade_writer_create(apr_brigade_writer_t **w,
+                                                    apr_bucket_brigade *bb,
+                                                    apr_size_t size,
+                                                    apr_brigade_flush flush,
+                                                    void *ctx)
+                          __attribute__((nonnull(1,2)));
+
+/**
+ * Write data with a brigade writer.
+ * @param w The writer
+ * @param str The data to write
+ * @param nbyte The number of bytes to write
+ * @return APR_SUCCESS, or the error of the flush function.
+ * @remark The data of at least the size of the buffer is appended to the
+ *         brigade (after the buffer) as in apr_brigade_write(), that is
+ *         in a transient bucket followed by a call of the flush function
+ *         if any, or copied in a heap bucket otherwise.
+ */
+APR_DECLARE(apr_status_t) apr_brigade_writer_write(apr_brigade_writer_t *w,
+                                                   const char *str,
+                                                   apr_size_t nbyte)
+                          __attribute__((nonnull(1,2)));
+
+/**
+ * Write a string with a brigade writer.
+ * @param w The writer
+ * @param str The string to write
+ * @return APR_SUCCESS, or the error of the flush function.
+ */
+APR_DECLARE(apr_status_t) apr_brigade_writer_puts(apr_brigade_writer_t *w,
+                                                  const char *str)
+                          __attribute__((nonnull(1,2)));
+
+/**
+ * Write a character with a brigade writer.
+ * @param w The writer
+ * @param c The character to write
+ * @return APR_SUCCESS, or the error of the flush function.
+ */
+APR_DECLARE(apr_status_t) apr_brigade_writer_putc(apr_brigade_writer_t *w,
+                                                  const char c)
+                          __attribute__((nonnull(1)));
+
+/**
+ * Evaluate a printf with a brigade writer, formatting in its buffer
+ * directly.
+ * @param w The writer
+ * @param fmt The format of the string to write
+ * @param ... The arguments to fill out the format
+ * @return APR_SUCCESS, or the error of the flush function.
+ */
+APR_DECLARE_NONSTD(apr_status_t) apr_brigade_writer_printf(
+                                                      apr_brigade_writer_t *w,
+                                                      const char *fmt, ...)
+                          __attribute__((format(printf,2,3)))
+                          __attribute__((nonnull(1,2)));
+
+/**
+ * Evaluate a printf with a brigade writer, formatting in its buffer
+ * directly.
+ * @param w The writer
+ * @param fmt The format of the string to write
+ * @param va The arguments to fill out the format
+ * @return APR_SUCCESS, or the error of the flush function.
+ */
+APR_DECLARE(apr_status_t) apr_brigade_writer_vprintf(apr_brigade_writer_t *w,
+                                                     const char *fmt,
+                                                     va_list va)
+                          __attribute__((nonnull(1,2)));
+
+/**
+ * Append the data buffered by a brigade writer to its brigade, and call
+ * the flush function if any.
+ * @param w The writer
+ * @return APR_SUCCESS, or the error of the flush function.
+ */
+APR_DECLARE(apr_status_t) apr_brigade_writer_flush(apr_brigade_writer_t *w)
+                          __attribute__((nonnull(1)));
+
 /**
  * Utility function to insert a file (or a segment of a file) onto the
  * end of the brigade.  The file is split into multiple buckets if it
@@ -1058,6 +1379,85 @@ APR_DECLARE_NONSTD(void *) apr_bucket_alloc(apr_size_t size,
 APR_DECLARE_NONSTD(void) apr_bucket_free(void *block)
                          __attribute__((nonnull(1)));
 
+/**
+ * Make the calling thread the owner of a bucket allocator, such that the
+ * memory freed by the other threads (with apr_bucket_free(), thus the
+ * buckets destroyed there) is queued lock-free and taken back by the
+ * owner on its next allocation.  This allows a brigade to be handed to
+ * another thread without copying its buckets.
+ * @param list The bucket allocator
+ * @param owned Non-zero to make the calling thread the owner, zero to stop
+ *        queuing the frees.
+ * @return APR_SUCCESS, or APR_ENOTIMPL if @a owned is non-zero and APR is
+ *         built without threads.
+ * @remark Only the frees may happen in the other threads, the allocator is
+ *         still used (allocations, brigades and bucket operations) by its
+ *         owner.  The buckets sharing a resource (e.g. split or copied heap
+ *         buckets) must all be handed to the same thread, since the count
+ *         of their references is not atomic.
+ * @remark This must be called by the thread which is to own the allocator,
+ *         so when the allocator itself is handed over to another thread,
+ *         that thread calls it again.
+ */
+APR_DECLARE_NONSTD(apr_status_t) apr_bucket_alloc_owner_set(
+                                             apr_bucket_alloc_t *list,
+                                             int owned)
+                         __attribute__((nonnull(1)));
+
+/**
+ * The statistics of a size class of a bucket allocator.
+ * @see apr_bucket_alloc_stats_get()
+ */
+typedef struct apr_bucket_alloc_stats_t {
+    /** The (usable) size of the allocations of the class, APR_SIZE_MAX
+     *  for the allocations larger than the largest class */
+    apr_size_t size;
+    /** The maximum number of free allocations kept by the class,
+     *  APR_SIZE_MAX if they are all kept */
+    apr_size_t max_free;
+    /** The number of free allocations currently kept by the class */
+    apr_size_t nfree;
+    /** The number of allocations from the class */
+    apr_uint64_t nalloc;
+    /** The number of those served from the free allocations */
+    apr_uint64_t nreuse;
+} apr_bucket_alloc_stats_t;
+
+/**
+ * Set the maximum number of free allocations a bucket allocator keeps
+ * for the size class of the given size, those freed beyond it being
+ * given back to the apr_allocator_t.
+ * @param list The bucket allocator
+ * @param size The size of an allocation of the class.
+ * @param max_free The maximum number of free allocations to keep, zero
+ *        to keep none.
+ * @return APR_SUCCESS, or APR_EINVAL if @a size is not that of a class
+ *         whose free allocations can be given back (the smaller classes
+ *         are carved from shared blocks and always kept).
+ * @remark The classes of @a size up to 64K (less the overheads) are the
+ *         ones of the allocator's memnodes, by default they keep up to
+ *         64K of free allocations each.
+ */
+APR_DECLARE_NONSTD(apr_status_t) apr_bucket_alloc_max_free_set(
+                                             apr_bucket_alloc_t *list,
+                                             apr_size_t size,
+                                             apr_size_t max_free)
+                         __attribute__((nonnull(1)));
+
+/**
+ * Get the statistics of the size classes of a bucket allocator.
+ * @param list The bucket allocator
+ * @param stats The array to fill, by increasing class size, the last
+ *        entry being for the allocations larger than any class.
+ * @param nstats The number of entries of @a stats
+ * @return The number of entries available, which may be more than
+ *         @a nstats.
+ */
+APR_DECLARE_NONSTD(int) apr_bucket_alloc_stats_get(apr_bucket_alloc_t *list,
+                                              apr_bucket_alloc_stats_t *stats,
+                                              int nstats)
+                        __attribute__((nonnull(1)));
+
 
 /*  *****  Bucket Functions  *****  */
 /**
@@ -1290,7 +1690,11 @@ APR_DECLARE_DATA extern const apr_bucket_type_t apr_bucket_type_pipe;
 /**
  * The IMMORTAL bucket type.  This bucket represents a segment of data that
  * the creator is willing to take responsibility for.  The core will do
- * nothing with the data in an immortal bucket
+ * nothing with the data in an immortal bucket: there is no reference count
+ * nor free function, splitting or copying the bucket is a copy of the
+ * apr_bucket only, and setting it aside is a noop.  This is the type
+ * to use for the static data served many times (e.g. pre-built responses
+ * or cached contents in a long-lived pool).
  */
 APR_DECLARE_DATA extern const apr_bucket_type_t apr_bucket_type_immortal;
 /**
@@ -1303,6 +1707,11 @@ APR_DECLARE_DATA extern const apr_bucket_type_t apr_bucket_type_transient;
  * The SOCKET bucket type.  This bucket represents a socket to another machine
  */
 APR_DECLARE_DATA extern const apr_bucket_type_t apr_bucket_type_socket;
+/**
+ * The DIGEST bucket type.  This bucket wraps a data bucket, and adds its
+ * data to a digest when it is read (see apr_bucket_digest_create()).
+ */
+APR_DECLARE_DATA extern const apr_bucket_type_t apr_bucket_type_digest;
 
 
 /*  *****  Simple buckets  *****  */
@@ -1444,6 +1853,7 @@ APR_DECLARE(apr_bucket *) apr_bucket_flush_make(apr_bucket *b)
 
 /**
  * Create a bucket referring to long-lived data.
+ * @see apr_bucket_type_immortal
  * @param buf The data to insert into the bucket
  * @param nbyte The size of the data to insert.
  * @param list The freelist from which this bucket should be allocated
@@ -1682,6 +2092,62 @@ APR_DECLARE(apr_status_t) apr_bucket_file_enable_mmap(apr_bucket *b,
 APR_DECLARE(apr_status_t) apr_bucket_file_set_buf_size(apr_bucket *b,
                                                        apr_size_t size);
 
+/**
+ * Set the read ahead window of a FILE bucket, for the data to be read from
+ * the disk before it is needed when the file is not in the page cache.
+ * @param b The bucket
+ * @param size The size of the window, up to which the kernel is asked to
+ *        read past the data read (or zero to stop asking).
+ * @return APR_SUCCESS normally, or APR_ENOTIMPL if the platform has no
+ *         way to advise the kernel.
+ * @remark The file is advised as read sequentially (posix_fadvise()) and
+ *         the next @a size bytes as soon needed, again each time half of
+ *         the window is read.  When the bucket is memory-mapped the mapping
+ *         is advised the same way (madvise()), with huge pages if possible.
+ * @remark Along with apr_bucket_file_set_buf_size(), e.g. with buffers of a
+ *         few hundred KB and a window of 1MB, this helps the throughput of
+ *         sequential reads of cold files.
+ */
+APR_DECLARE(apr_status_t) apr_bucket_file_set_read_ahead(apr_bucket *b,
+                                                         apr_size_t size);
+
+/**
+ * Create a bucket wrapping a data bucket, which adds the data to a digest
+ * as it is read.
+ * @param e The data bucket to wrap, not in a brigade
+ * @param type The type of the digest
+ * @param ctx The digest context (see apr_brigade_digest())
+ * @param list The freelist from which this bucket should be allocated
+ * @return The new bucket, or NULL if allocation failed
+ * @remark Once read, the bucket becomes the bucket of the data read (of
+ *         the type of @a e), whose data is given to the digest as is,
+ *         without copy.  The rest of the data that the read or a split
+ *         leaves is wrapped in DIGEST buckets too, inserted after it.
+ * @remark The data is added to the digest in the order the buckets are
+ *         read, so they must be read in the order of the brigade, as the
+ *         filters and apr_brigade_write_socket() do.  The data of a bucket
+ *         destroyed unread is not in the digest, and the bucket cannot be
+ *         copied.
+ */
+APR_DECLARE(apr_bucket *) apr_bucket_digest_create(apr_bucket *e,
+                                                   apr_brigade_digest_e type,
+                                                   void *ctx,
+                                                   apr_bucket_alloc_t *list)
+                          __attribute__((nonnull(1,3,4)));
+
+/**
+ * Make the data bucket passed in a DIGEST bucket wrapping its data, in
+ * place (see apr_bucket_digest_create()).
+ * @param b The data bucket to make into a DIGEST bucket
+ * @param type The type of the digest
+ * @param ctx The digest context (see apr_brigade_digest())
+ * @return The new bucket, or NULL if allocation failed
+ */
+APR_DECLARE(apr_bucket *) apr_bucket_digest_make(apr_bucket *b,
+                                                 apr_brigade_digest_e type,
+                                                 void *ctx)
+                          __attribute__((nonnull(1,3)));
+
 /** @} */
 #ifdef __cplusplus
 }
@@ -0,0 +1,223 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_CHASH_H
+#define APR_CHASH_H
+
+/**
+ * @file apr_chash.h
+ * @brief APR Concurrent Hash Tables
+ */
+
+#include "apr.h"
+#include "apr_errno.h"
+#include "apr_pools.h"
+#include "apr_hash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup apr_chash Concurrent Hash Tables
+ * @ingroup APR
+ *
+ * A hash table which can be used by many threads at once, for read-mostly
+ * tables. Lookups and iterations take no lock and write no shared cache
+ * line but a per-thread (hashed) reader count, writers lock one of a few
+ * stripes of the buckets. The entries removed or replaced are freed once
+ * no reader may still see them, without writers ever waiting for readers.
+ *
+ * The API is that of @ref apr_hash, except that the keys are copied in the
+ * table and the memory of the entries is given back (to an allocator of
+ * the table) when they are removed.
+ * @{
+ */
+
+/**
+ * Abstract type for concurrent hash tables.
+ */
+typedef struct apr_chash_t apr_chash_t;
+
+/**
+ * Abstract type for scanning concurrent hash tables.
+ */
+typedef struct apr_chash_index_t apr_chash_index_t;
+
+/**
+ * Create a concurrent hash table.
+ * @param ht The hash table just created
+ * @param hash_func NULL for apr_hashfunc_default(), or a custom hash
+ *        function (called concurrently).
+ * @param pool The pool whose lifetime the hash table has; the entries are
+ *        allocated from an allocator of the table.
+ * @return APR_SUCCESS, or an error creating the allocator or the locks.
+ */
+APR_DECLARE(apr_status_t) apr_chash_create(apr_chash_t **ht,
+                                           apr_hashfunc_t hash_func,
+                                           apr_pool_t *pool);
+
+/**
+ * Destroy a concurrent hash table before its pool is.
+ * @param ht The hash table
+ * @remark No other thread may be using the table.
+ */
+APR_DECLARE(void) apr_chash_destroy(apr_chash_t *ht);
+
+/**
+ * Associate a value with a key in a concurrent hash table.
+ * @param ht The hash table
+ * @param key Pointer to the key
+ * @param klen Length of the key. Can be APR_HASH_KEY_STRING to use the
+ *        string length.
+ * @param val Value to associate with the key
+ * @return APR_SUCCESS, or APR_ENOMEM if the entry can't be allocated.
+ * @remark If the value is NULL the hash entry is deleted. The key is copied
+ *         (and NUL terminated).
+ * @remark The values are stored as is, a value replaced or deleted may
+ *         still be returned to the threads looking it up meanwhile.
+ */
+APR_DECLARE(apr_status_t) apr_chash_set(apr_chash_t *ht, const void *key,
+                                        apr_ssize_t klen, const void *val);
+
+/**
+ * Look up the value associated with a key in a concurrent hash table.
+ * @param ht The hash table
+ * @param key Pointer to the key
+ * @param klen Length of the key. Can be APR_HASH_KEY_STRING to use the
+ *        string length.
+ * @return Returns NULL if the key is not present.
+ */
+APR_DECLARE(void *) apr_chash_get(apr_chash_t *ht, const void *key,
+                                  apr_ssize_t klen);
+
+/**
+ * Look up the value associated with a key in a concurrent hash table, or
+ * if none exists associate a value.
+ * @param ht The hash table
+ * @param key Pointer to the key
+ * @param klen Length of the key. Can be APR_HASH_KEY_STRING to use the
+ *        string length.
+ * @param val Value to associate with the key (if none exists).
+ * @return Returns the existing value if any, the given value otherwise,
+ *         or NULL if the entry can't be allocated.
+ * @remark If the given value is NULL and a hash entry exists, nothing is
+ *         done.
+ */
+APR_DECLARE(void *) apr_chash_get_or_set(apr_chash_t *ht, const void *key,
+                                         apr_ssize_t klen, const void *val);
+
+/**
+ * Get the number of key/value pairs in a concurrent hash table.
+ * @param ht The hash table
+ * @return The number of key/value pairs in the hash table.
+ */
+APR_DECLARE(unsigned int) apr_chash_count(apr_chash_t *ht);
+
+/**
+ * Clear any key/value pairs in a concurrent hash table.
+ * @param ht The hash table
+ */
+APR_DECLARE(void) apr_chash_clear(apr_chash_t *ht);
+
+/**
+ * Start iterating over the entries in a concurrent hash table.
+ * @param p The pool to allocate the apr_chash_index_t iterator.
+ * @param ht The hash table
+ * @return The iteration state, or NULL if the table is empty.
+ * @remark The iteration runs without a lock, entries may be added and
+ *         deleted meanwhile (by any thread). It sees the entries which
+ *         were in the table all along, those added or deleted meanwhile
+ *         may or may not be seen.
+ * @remark Like lookups, the iteration keeps the entries it may still see
+ *         from being freed, so it should be short-lived: either run to its
+ *         end (apr_chash_next() returning NULL), or ended with
+ *         apr_chash_stop().
+ */
+APR_DECLARE(apr_chash_index_t *) apr_chash_first(apr_pool_t *p,
+                                                 apr_chash_t *ht);
+
+/**
+ * Continue iterating over the entries in a concurrent hash table.
+ * @param hi The iteration state
+ * @return a pointer to the updated iteration state.  NULL if there are no
+ *         more entries.
+ */
+APR_DECLARE(apr_chash_index_t *) apr_chash_next(apr_chash_index_t *hi);
+
+/**
+ * End an iteration before apr_chash_next() returns NULL.
+ * @param hi The iteration state
+ * @remark Nothing is done if the iteration has already ended.
+ */
+APR_DECLARE(void) apr_chash_stop(apr_chash_index_t *hi);
+
+/**
+ * Get the current entry's details from the iteration state.
+ * @param hi The iteration state
+ * @param key Return pointer for the pointer to the key.
+ * @param klen Return pointer for the key length.
+ * @param val Return pointer for the associated value.
+ * @remark The return pointers should point to a variable that will be set
+ *         to the corresponding data, or they may be NULL if the data isn't
+ *         interesting. The key is valid until the iteration ends.
+ */
+APR_DECLARE(void) apr_chash_this(apr_chash_index_t *hi, const void **key,
+                                 apr_ssize_t *klen, void **val);
+
+/**
+ * Get the current entry's key from the iteration state.
+ * @param hi The iteration state
+ * @return The pointer to the key
+ */
+APR_DECLARE(const void *) apr_chash_this_key(apr_chash_index_t *hi);
+
+/**
+ * Get the current entry's key length from the iteration state.
+ * @param hi The iteration state
+ * @return The key length
+ */
+APR_DECLARE(apr_ssize_t) apr_chash_this_key_len(apr_chash_index_t *hi);
+
+/**
+ * Get the current entry's value from the iteration state.
+ * @param hi The iteration state
+ * @return The value
+ */
+APR_DECLARE(void *) apr_chash_this_val(apr_chash_index_t *hi);
+
+/**
+ * Iterate over a concurrent hash table running the provided function once
+ * for every element in the hash table. The @a comp function will be
+ * invoked for every element in the hash table.
+ *
+ * @param comp The function to run
+ * @param rec The data to pass as the first argument to the function
+ * @param ht The hash table to iterate over
+ * @return FALSE if one of the comp() iterations returned zero; TRUE if all
+ *            iterations returned non-zero
+ * @see apr_hash_do_callback_fn_t
+ */
+APR_DECLARE(int) apr_chash_do(apr_hash_do_callback_fn_t *comp,
+                              void *rec, apr_chash_t *ht);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* !APR_CHASH_H */
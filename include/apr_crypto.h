@@ -117,8 +117,9 @@ typedef enum
     APR_KEY_NONE, APR_KEY_3DES_192, /** 192 bit (3-Key) 3DES */
     APR_KEY_AES_128, /** 128 bit AES */
     APR_KEY_AES_192, /** 192 bit AES */
-    APR_KEY_AES_256
-/** 256 bit AES */
+    APR_KEY_AES_256, /** 256 bit AES */
+    APR_KEY_CHACHA20
+/** 256 bit ChaCha20, with APR_MODE_POLY1305 */
 } apr_crypto_block_key_type_e;
 
 /**
@@ -128,10 +129,22 @@ typedef enum
 {
     APR_MODE_NONE, /** An error condition */
     APR_MODE_ECB, /** Electronic Code Book */
-    APR_MODE_CBC
-/** Cipher Block Chaining */
+    APR_MODE_CBC, /** Cipher Block Chaining */
+    APR_MODE_GCM, /** Galois/Counter Mode (AES), AEAD */
+    APR_MODE_POLY1305
+/** Poly1305 authenticator (ChaCha20), AEAD */
 } apr_crypto_block_key_mode_e;
 
+/**
+ * The size of the initialisation vector (nonce) of the AEAD modes.
+ */
+#define APR_CRYPTO_AEAD_IVSIZE 12
+
+/**
+ * The size of the full authentication tag of the AEAD modes.
+ */
+#define APR_CRYPTO_AEAD_TAGSIZE 16
+
 /**
  * Types of digests supported by the apr_crypto_key() function.
  */
@@ -731,6 +744,58 @@ APR_DECLARE(apr_status_t) apr_crypto_passphrase(apr_crypto_key_t **key,
         const apr_crypto_block_key_mode_e mode, const int doPad,
         const int iterations, const apr_crypto_t *f, apr_pool_t *p);
 
+/** @see apr_crypto_key_cache_create */
+typedef struct apr_crypto_key_cache_t apr_crypto_key_cache_t;
+
+/**
+ * @brief Create a cache of the keys derived from passphrases, for the
+ *        services which derive the same keys repeatedly (e.g. per request
+ *        from a configured passphrase).
+ * @param cache The new cache.
+ * @param size The number of keys kept, the least recently used being
+ *             replaced first.
+ * @param f The context to derive the keys with.
+ * @param p The pool to allocate the cache and its keys from.
+ * @return APR_EINVAL if size is not positive, APR_ENOTIMPL if random bytes
+ *         cannot be generated on this platform.
+ * @remark The cache is not thread safe, each thread should have its own.
+ */
+APR_DECLARE(apr_status_t) apr_crypto_key_cache_create(
+        apr_crypto_key_cache_t **cache, int size, const apr_crypto_t *f,
+        apr_pool_t *p);
+
+/**
+ * @brief Get the key of a passphrase like apr_crypto_passphrase(), but
+ *        looking up the key derived with the same passphrase, salt, type,
+ *        mode, padding and iterations in a cache first.
+ * @param key The key returned, owned by the cache.
+ * @param ivSize The size of the initialisation vector will be returned, based
+ *               on whether an IV is relevant for this type of crypto.
+ * @param cache The cache created by apr_crypto_key_cache_create().
+ * @param pass The passphrase to use.
+ * @param passLen The passphrase length in bytes
+ * @param salt The salt to use.
+ * @param saltLen The salt length in bytes
+ * @param type 3DES_192, AES_128, AES_192, AES_256.
+ * @param mode Electronic Code Book / Cipher Block Chaining.
+ * @param doPad Pad if necessary.
+ * @param iterations Number of iterations to use in algorithm
+ * @return The errors of apr_crypto_passphrase(), which are not cached.
+ * @remark The cache does not keep the passphrase but authenticates it with
+ *         SipHash-2-4 (128 bits) under random keys of the cache, as
+ *         apr_password_validate_cached() does.
+ * @remark The key remains valid until the cache replaces it, so when
+ *         another key is derived with the cache full.  A cache of at least
+ *         the number of passphrases used never replaces one.
+ */
+APR_DECLARE(apr_status_t) apr_crypto_passphrase_cached(
+        const apr_crypto_key_t **key, apr_size_t *ivSize,
+        apr_crypto_key_cache_t *cache, const char *pass, apr_size_t passLen,
+        const unsigned char *salt, apr_size_t saltLen,
+        const apr_crypto_block_key_type_e type,
+        const apr_crypto_block_key_mode_e mode, const int doPad,
+        const int iterations);
+
 /**
  * @brief Initialise a context for encrypting arbitrary data using the given key.
  * @note If *ctx is NULL, a apr_crypto_block_t will be created from a pool. If
@@ -868,6 +933,155 @@ APR_DECLARE(apr_status_t) apr_crypto_block_decrypt_finish(unsigned char *out,
  */
 APR_DECLARE(apr_status_t) apr_crypto_block_cleanup(apr_crypto_block_t *ctx);
 
+/**
+ * @brief Encrypt and authenticate data in one go with a key of an AEAD
+ *        mode (APR_MODE_GCM or APR_MODE_POLY1305), into a buffer of the
+ *        caller.
+ * @note Nothing is allocated from a pool: the backend context is set up
+ *       with the key once and cached in it, then only reset with the IV
+ *       of each call.  Concurrent calls with the same key are safe.
+ * @param out The buffer to write the encrypted data to, of @a inlen bytes.
+ *            It can be @a in to encrypt in place.
+ * @param tag The buffer to write the authentication tag to.
+ * @param taglen The size of the tag, up to APR_CRYPTO_AEAD_TAGSIZE (the
+ *               default and recommended size).
+ * @param in The data to encrypt.
+ * @param inlen The length of the data.
+ * @param aad Additional data to authenticate but not encrypt (e.g. a
+ *            header), or NULL.
+ * @param aadlen The length of the additional data.
+ * @param iv The initialisation vector (nonce), of APR_CRYPTO_AEAD_IVSIZE
+ *           bytes, which must never be used twice with the same key.
+ * @param key The key structure to use.
+ * @return APR_SUCCESS if successful.
+ * @return APR_ENOIV if no initialisation vector is given.
+ * @return APR_ECRYPT if an error occurred.
+ * @return APR_ENOTIMPL if not implemented.
+ * @return APR_EINVAL if the key is not of an AEAD mode or the tag size is
+ *         invalid.
+ */
+APR_DECLARE(apr_status_t) apr_crypto_aead_encrypt(unsigned char *out,
+        unsigned char *tag, apr_size_t taglen, const unsigned char *in,
+        apr_size_t inlen, const unsigned char *aad, apr_size_t aadlen,
+        const unsigned char *iv, const apr_crypto_key_t *key);
+
+/**
+ * @brief Verify and decrypt data in one go with a key of an AEAD mode,
+ *        into a buffer of the caller (see apr_crypto_aead_encrypt()).
+ * @param out The buffer to write the decrypted data to, of @a inlen bytes.
+ *            It can be @a in to decrypt in place.
+ * @param tag The authentication tag to verify.
+ * @param taglen The size of the tag, as given to apr_crypto_aead_encrypt().
+ * @param in The data to decrypt.
+ * @param inlen The length of the data.
+ * @param aad The additional data authenticated, or NULL.
+ * @param aadlen The length of the additional data.
+ * @param iv The initialisation vector (nonce) of the encryption.
+ * @param key The key structure to use.
+ * @return APR_SUCCESS if successful.
+ * @return APR_ENOVERIFY if the data, the additional data or the tag is not
+ *         authentic, @a out then being zeroed.
+ * @return APR_ENOIV if no initialisation vector is given.
+ * @return APR_ECRYPT if an error occurred.
+ * @return APR_ENOTIMPL if not implemented.
+ * @return APR_EINVAL if the key is not of an AEAD mode or the tag size is
+ *         invalid.
+ */
+APR_DECLARE(apr_status_t) apr_crypto_aead_decrypt(unsigned char *out,
+        const unsigned char *tag, apr_size_t taglen, const unsigned char *in,
+        apr_size_t inlen, const unsigned char *aad, apr_size_t aadlen,
+        const unsigned char *iv, const apr_crypto_key_t *key);
+
+/**
+ * The size of the nonce prefix of the STREAM encryption.
+ */
+#define APR_CRYPTO_STREAM_PREFIXSIZE 7
+
+struct apr_thread_pool;
+
+/**
+ * @brief Encrypt a large payload as a STREAM of chunks authenticated each,
+ *        in parallel.
+ *
+ *        The data is cut in chunks of @a chunksize bytes (the last one can
+ *        be shorter, or empty with no data), each encrypted with
+ *        apr_crypto_aead_encrypt() with a nonce of the prefix, the index
+ *        of the chunk (32 bit, big endian) and a byte flagging the last
+ *        chunk.  The encrypted chunks follow each other, their tag of
+ *        APR_CRYPTO_AEAD_TAGSIZE bytes after them, so that the chunks can
+ *        be decrypted independently (apr_crypto_stream_decrypt_chunk()),
+ *        and truncating, reordering or mixing them is detected.
+ * @note The threads of @a tp, up to its maximum, help the calling thread
+ *       with the chunks; it waits for them before returning.
+ * @param out The buffer to write the result to, not overlapping @a in, or
+ *            NULL to get its size only.
+ * @param outlen The size of the result is written here.
+ * @param in The data to encrypt.
+ * @param inlen The length of the data.
+ * @param chunksize The size of the chunks, e.g. 64KB.
+ * @param prefix The nonce prefix of APR_CRYPTO_STREAM_PREFIXSIZE bytes,
+ *               which must never be used twice with the same key.
+ * @param key An AEAD key (see apr_crypto_aead_encrypt()).
+ * @param tp The thread pool to use, or NULL to do it all in the calling
+ *           thread.
+ * @return APR_SUCCESS if successful.
+ * @return APR_EINVAL if @a chunksize is zero or too small for the data
+ *         (more than 2^32 chunks), or the error of apr_crypto_aead_encrypt().
+ */
+APR_DECLARE(apr_status_t) apr_crypto_stream_encrypt(unsigned char *out,
+        apr_size_t *outlen, const unsigned char *in, apr_size_t inlen,
+        apr_size_t chunksize, const unsigned char *prefix,
+        const apr_crypto_key_t *key, struct apr_thread_pool *tp);
+
+/**
+ * @brief Verify and decrypt a STREAM of apr_crypto_stream_encrypt(), in
+ *        parallel.
+ * @param out The buffer to write the result to, not overlapping @a in, or
+ *            NULL to get its size only.
+ * @param outlen The size of the result is written here.
+ * @param in The data to decrypt.
+ * @param inlen The length of the data.
+ * @param chunksize The size of the chunks given to the encryption.
+ * @param prefix The nonce prefix given to the encryption.
+ * @param key The key.
+ * @param tp The thread pool to use, or NULL.
+ * @return APR_SUCCESS if successful.
+ * @return APR_ENOVERIFY if a chunk is not authentic, @a out then being
+ *         zeroed.
+ * @return APR_EINVAL if @a inlen cannot be a STREAM with these chunks, or
+ *         the error of apr_crypto_aead_decrypt().
+ */
+APR_DECLARE(apr_status_t) apr_crypto_stream_decrypt(unsigned char *out,
+        apr_size_t *outlen, const unsigned char *in, apr_size_t inlen,
+        apr_size_t chunksize, const unsigned char *prefix,
+        const apr_crypto_key_t *key, struct apr_thread_pool *tp);
+
+/**
+ * @brief Verify and decrypt a single chunk of a STREAM, for a random
+ *        access to the data.
+ * @note Only the bytes of the chunk are read from @a in, which can be a
+ *       mapping of the whole encrypted file for instance.  The data of the
+ *       chunk starts at @a index * @a chunksize in the decrypted data.
+ * @param out The buffer to write the chunk to, of up to @a chunksize
+ *            bytes, or NULL to get its size only.
+ * @param outlen The size of the chunk is written here.
+ * @param in The whole STREAM.
+ * @param inlen The length of the STREAM.
+ * @param chunksize The size of the chunks given to the encryption.
+ * @param index The index of the chunk, from 0.
+ * @param prefix The nonce prefix given to the encryption.
+ * @param key The key.
+ * @return APR_SUCCESS if successful.
+ * @return APR_ENOVERIFY if the chunk is not authentic, @a out then being
+ *         zeroed.
+ * @return APR_EINVAL if @a index is past the last chunk, or as
+ *         apr_crypto_stream_decrypt().
+ */
+APR_DECLARE(apr_status_t) apr_crypto_stream_decrypt_chunk(unsigned char *out,
+        apr_size_t *outlen, const unsigned char *in, apr_size_t inlen,
+        apr_size_t chunksize, apr_size_t index, const unsigned char *prefix,
+        const apr_crypto_key_t *key);
+
 /**
  * @brief Initialise a context for hashing, signing or verifying arbitrary
  *        data.
@@ -998,6 +1212,8 @@ APR_DECLARE(apr_status_t) apr_crypto_shutdown(
  *
  * This CPRNG is fast, based on a stream cipher, and will never block besides
  * the initial seed or any reseed if it depends on the system entropy.
+ * ChaCha20 (the default) is built-in and vectorized where possible, other
+ * ciphers are provided by the crypto driver.
  *
  * Finally, it can be used either globally (locked in multithread environment),
  * per-thread (a lock free instance is automatically created for each thread on
@@ -1053,6 +1269,9 @@ APR_DECLARE(apr_status_t) apr_crypto_random_bytes(void *buf, apr_size_t len);
  * @brief Generate cryptographically secure random bytes from the CPRNG of
  *        the current thread.
  *
+ * The per-thread CPRNGs are lock free, buffering their random bytes by
+ * batches of 4KB.
+ *
  * @param buf The destination buffer
  * @param len The destination length
  * @return APR_EINIT if \ref apr_crypto_prng_init() was not called or
@@ -124,6 +124,66 @@ APR_DECLARE(int) apr_cstr_match_list(const char *str,
  */
 APR_DECLARE(char *) apr_cstr_tokenize(const char *sep, char **str);
 
+/** Remove the leading and trailing whitespace of the tokens */
+#define APR_CSTR_TOK_TRIM   0x01
+/** Return the empty tokens too (between two separators) */
+#define APR_CSTR_TOK_EMPTY  0x02
+/** Double quoted strings (with backslash escapes) are not split */
+#define APR_CSTR_TOK_QUOTED 0x04
+
+/** The number of separators (and quote) searched 16 octets at a time */
+#define APR_CSTR_TOK_FAST 4
+
+/**
+ * An iterator over the tokens of a string, see apr_cstr_tokiter_init().
+ * It is usually on the stack, its fields are private.
+ */
+typedef struct apr_cstr_tokiter_t {
+    /** Where the next token starts, NULL when there is none left */
+    const char *next;
+    /** The end of the input */
+    const char *end;
+    /** The APR_CSTR_TOK_* flags */
+    int flags;
+    /** The number of stop characters below, zero if there are more */
+    int nfast;
+    /** The (first) stop characters, for the vectorized search */
+    char fast[APR_CSTR_TOK_FAST];
+    /** The stop characters, as a bitmap */
+    unsigned char stops[32];
+} apr_cstr_tokiter_t;
+
+/**
+ * Start iterating over the tokens of @a input separated by any char from
+ * @a sep_chars, like apr_cstr_split() but without modifying @a input nor
+ * allocating anything: the tokens are returned as pointer/length pairs
+ * into @a input by apr_cstr_tokiter_next().
+ *
+ * @param it The iterator to initialize
+ * @param input The string to split, which must stay valid while iterating
+ * @param len The length of @a input, or -1 if it is NUL terminated
+ * @param sep_chars The separators, e.g. "," for the lists of HTTP headers
+ * @param flags A combination of APR_CSTR_TOK_TRIM, APR_CSTR_TOK_EMPTY
+ *        (the empty tokens are skipped otherwise) and APR_CSTR_TOK_QUOTED
+ * @remark With APR_CSTR_TOK_QUOTED, the tokens keep their quotes and
+ *         escapes, e.g. for the parameters of a header.
+ * @since New in 2.0.
+ */
+APR_DECLARE(void) apr_cstr_tokiter_init(apr_cstr_tokiter_t *it,
+                                        const char *input, apr_ssize_t len,
+                                        const char *sep_chars, int flags);
+
+/**
+ * Get the next token of an iterator.
+ * @param it The iterator, initialized by apr_cstr_tokiter_init()
+ * @param token Set to the start of the token (not NUL terminated)
+ * @param len Set to the length of the token
+ * @return Non-zero if a token is returned, zero when there are no more.
+ * @since New in 2.0.
+ */
+APR_DECLARE(int) apr_cstr_tokiter_next(apr_cstr_tokiter_t *it,
+                                       const char **token, apr_size_t *len);
+
 /**
  * Return the number of line breaks in @a msg, allowing any kind of newline
  * termination (CR, LF, CRLF, or LFCR), even inconsistent.
@@ -176,6 +236,20 @@ APR_DECLARE(int) apr_cstr_casecmpn(const char *str1,
                                    const char *str2,
                                    apr_size_t n);
 
+/**
+ * Convert the 26 standard C/POSIX upper case alphabetic characters of
+ * @a str to lower case, in place. Other octets are left as they are,
+ * irrespective of the current locale.
+ */
+APR_DECLARE(void) apr_cstr_tolower(char *str);
+
+/**
+ * Convert the 26 standard C/POSIX lower case alphabetic characters of
+ * @a str to upper case, in place. Other octets are left as they are,
+ * irrespective of the current locale.
+ */
+APR_DECLARE(void) apr_cstr_toupper(char *str);
+
 /**
  * Parse the C string @a str into a 64 bit number, and return it in @a *n.
  * Assume that the number is represented in base @a base.
@@ -23,6 +23,7 @@
 
 #include "apu.h"
 #include "apr_pools.h"
+#include "apr_network_io.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -86,6 +87,10 @@ typedef struct apr_dbd_results_t apr_dbd_results_t;
 typedef struct apr_dbd_row_t apr_dbd_row_t;
 typedef struct apr_dbd_prepared_t apr_dbd_prepared_t;
 
+/* These ones are common to all the backends */
+typedef struct apr_dbd_batch_t apr_dbd_batch_t;
+typedef struct apr_dbd_bulk_t apr_dbd_bulk_t;
+
 /** apr_dbd_init: perform once-only initialisation.  Call once only.
  *
  *  @param pool - pool to register any shutdown cleanups, etc
@@ -333,6 +338,53 @@ APR_DECLARE(int) apr_dbd_get_row(const apr_dbd_driver_t *driver, apr_pool_t *poo
 APR_DECLARE(const char*) apr_dbd_get_entry(const apr_dbd_driver_t *driver,
                                            apr_dbd_row_t *row, int col);
 
+/** apr_dbd_batch_create: create a batch of rows, reusable to fetch any
+ *  result set by columns with apr_dbd_get_batch()
+ *
+ *  @param batch - pointer to the created batch
+ *  @param size - maximum number of rows per batch
+ *  @param pool - pool to allocate the batch and its values
+ *  @return APR_SUCCESS, or APR_EINVAL if size is not positive
+ */
+APR_DECLARE(apr_status_t) apr_dbd_batch_create(apr_dbd_batch_t **batch,
+                                               int size, apr_pool_t *pool);
+
+/** apr_dbd_get_batch: get the next rows from a result set, in columns
+ *
+ *  The values of the previous batch are overwritten, no allocation
+ *  happens once the batch has grown to hold the largest values, and
+ *  the result set may be sequential (faster) or random.
+ *
+ *  @param driver - the driver
+ *  @param res - result set pointer
+ *  @param batch - the batch to fill with up to its size rows
+ *  @return 0 for success, -1 for data finished, or error code
+ */
+APR_DECLARE(int) apr_dbd_get_batch(const apr_dbd_driver_t *driver,
+                                   apr_dbd_results_t *res,
+                                   apr_dbd_batch_t *batch);
+
+/** apr_dbd_batch_nrows: get the number of rows in a batch
+ *
+ *  @param batch - the batch
+ *  @return number of rows fetched by the last apr_dbd_get_batch()
+ */
+APR_DECLARE(int) apr_dbd_batch_nrows(const apr_dbd_batch_t *batch);
+
+/** apr_dbd_batch_column: get a column of a batch
+ *
+ *  @param batch - the batch
+ *  @param col - entry number
+ *  @param values - the apr_dbd_batch_nrows() values of the column, NULL
+ *                  ones for SQL NULL, valid until the next batch
+ *  @param lengths - the lengths of the values
+ *  @return APR_SUCCESS, or APR_EINVAL if col is out of bounds
+ */
+APR_DECLARE(apr_status_t) apr_dbd_batch_column(const apr_dbd_batch_t *batch,
+                                               int col,
+                                               const char *const **values,
+                                               const apr_size_t **lengths);
+
 /** apr_dbd_get_name: get an entry name from a result set
  *
  *  @param driver - the driver
@@ -530,6 +582,130 @@ APR_DECLARE_NONSTD(int) apr_dbd_pvbselect(const apr_dbd_driver_t *driver,
                                           apr_dbd_prepared_t *statement,
                                           int random, ...);
 
+/** apr_dbd_pipeline_begin: enter the pipeline mode, where the queries
+ *  of apr_dbd_pipeline_pquery() and apr_dbd_pipeline_pbquery() are sent
+ *  without waiting for the result of each, saving the round trips
+ *
+ *  @param driver - the driver
+ *  @param pool - working pool
+ *  @param handle - the connection
+ *  @return 0 for success, APR_ENOTIMPL if the driver does not support it,
+ *          or error code
+ *  @remark No other query can be run on the connection until the
+ *          pipeline is ended by apr_dbd_pipeline_end().
+ */
+APR_DECLARE(int) apr_dbd_pipeline_begin(const apr_dbd_driver_t *driver,
+                                        apr_pool_t *pool, apr_dbd_t *handle);
+
+/** apr_dbd_pipeline_pquery: queue a query using a prepared statement
+ *
+ *  @param driver - the driver
+ *  @param pool - working pool
+ *  @param handle - the connection
+ *  @param statement - the prepared statement to execute
+ *  @param nargs - ignored (for backward compatibility only)
+ *  @param args - args to prepared statement
+ *  @return 0 for success or error code
+ */
+APR_DECLARE(int) apr_dbd_pipeline_pquery(const apr_dbd_driver_t *driver,
+                                         apr_pool_t *pool, apr_dbd_t *handle,
+                                         apr_dbd_prepared_t *statement,
+                                         int nargs, const char **args);
+
+/** apr_dbd_pipeline_pbquery: queue a query using a prepared statement
+ *  and binary arguments
+ *
+ *  @param driver - the driver
+ *  @param pool - working pool
+ *  @param handle - the connection
+ *  @param statement - the prepared statement to execute
+ *  @param args - binary args to prepared statement
+ *  @return 0 for success or error code
+ */
+APR_DECLARE(int) apr_dbd_pipeline_pbquery(const apr_dbd_driver_t *driver,
+                                          apr_pool_t *pool, apr_dbd_t *handle,
+                                          apr_dbd_prepared_t *statement,
+                                          const void **args);
+
+/** apr_dbd_pipeline_end: wait for the results of the queued queries and
+ *  leave the pipeline mode
+ *
+ *  The queries following a failed one are not executed.  With reqevents
+ *  not NULL the call does not block: APR_EAGAIN is returned until all
+ *  the results are in, and *reqevents is set to the events (APR_POLLIN
+ *  and/or APR_POLLOUT) to wait for on the apr_dbd_socket_get() socket,
+ *  e.g. with an apr_pollset_t, before calling again.
+ *
+ *  @param driver - the driver
+ *  @param pool - working pool
+ *  @param handle - the connection
+ *  @param nrows - number of rows affected by all the queries
+ *  @param reqevents - NULL to block, else the events to poll for
+ *  @return 0 for success, APR_EAGAIN if not done yet, or the error code
+ *          of the first failed query
+ */
+APR_DECLARE(int) apr_dbd_pipeline_end(const apr_dbd_driver_t *driver,
+                                      apr_pool_t *pool, apr_dbd_t *handle,
+                                      int *nrows, apr_int16_t *reqevents);
+
+/** apr_dbd_socket_get: get the socket of a connection, to poll it
+ *
+ *  @param driver - the driver
+ *  @param pool - pool to allocate the socket
+ *  @param handle - the connection
+ *  @param sock - the socket, owned by the connection (not to be closed)
+ *  @return APR_SUCCESS, APR_ENOTIMPL if the driver does not support it,
+ *          or error code
+ */
+APR_DECLARE(apr_status_t) apr_dbd_socket_get(const apr_dbd_driver_t *driver,
+                                             apr_pool_t *pool,
+                                             apr_dbd_t *handle,
+                                             apr_socket_t **sock);
+
+/** apr_dbd_bulk_begin: start loading rows into a table, at the native
+ *  bulk load speed of the driver (COPY FROM STDIN for pgsql, a single
+ *  transaction with a reused statement for sqlite3, parameter arrays for
+ *  odbc, or multi-row INSERTs for the others)
+ *
+ *  @param driver - the driver
+ *  @param pool - pool to allocate the load from
+ *  @param handle - the connection
+ *  @param bulk - the load
+ *  @param table - the table, as an SQL identifier
+ *  @param ncols - number of columns
+ *  @param columns - the columns, as SQL identifiers
+ *  @return 0 for success or error code
+ *  @remark The table and columns are not escaped.  No other query can be
+ *          run on the connection until apr_dbd_bulk_end() is called.
+ *  @remark The load is atomic with pgsql and sqlite3, other drivers need
+ *          a transaction for that.
+ */
+APR_DECLARE(int) apr_dbd_bulk_begin(const apr_dbd_driver_t *driver,
+                                    apr_pool_t *pool, apr_dbd_t *handle,
+                                    apr_dbd_bulk_t **bulk, const char *table,
+                                    int ncols, const char *const *columns);
+
+/** apr_dbd_bulk_row: load a row
+ *
+ *  @param driver - the driver
+ *  @param bulk - the load
+ *  @param values - the text values of the columns, NULL for SQL NULL
+ *  @return 0 for success, or the error code of the load
+ */
+APR_DECLARE(int) apr_dbd_bulk_row(const apr_dbd_driver_t *driver,
+                                  apr_dbd_bulk_t *bulk,
+                                  const char *const *values);
+
+/** apr_dbd_bulk_end: end a load
+ *
+ *  @param driver - the driver
+ *  @param bulk - the load
+ *  @param nrows - number of rows loaded
+ *  @return 0 for success, or the first error code of the load
+ */
+APR_DECLARE(int) apr_dbd_bulk_end(const apr_dbd_driver_t *driver,
+                                  apr_dbd_bulk_t *bulk, int *nrows);
+
 /** apr_dbd_datum_get: get a binary entry from a row
  *
  *  @param driver - the driver
@@ -92,6 +92,7 @@ APR_DECLARE(apr_status_t) apr_dbm_get_driver(const apr_dbm_driver_t **driver,
  *  gdbm for GDBM files
  *  ndbm for NDBM files
  *  sdbm for SDBM files (always available)
+ *  lsm  for append-only log structured files (always available)
  *  default for the default DBM type
  *  </pre>
  * @param name The dbm file name to open
@@ -106,6 +107,10 @@ APR_DECLARE(apr_status_t) apr_dbm_get_driver(const apr_dbm_driver_t **driver,
  * @param cntxt The pool to use when creating the dbm
  * @remark The dbm name may not be a true file name, as many dbm packages
  * append suffixes for seperate data and index files.
+ * @remark The lsm driver appends the changes to a log, written to sorted
+ * runs in the background: it suits heavy writes.  One process at a time
+ * may open it for writing, readers see the database as it was when they
+ * opened it.
  * @bug In apr-util 0.9 and 1.x, the type arg was case insensitive.  This
  * was highly inefficient, and as of 2.x the dbm name must be provided in
  * the correct case (lower case for all bundled providers)
@@ -172,6 +177,23 @@ APR_DECLARE(void) apr_dbm_close(apr_dbm_t *dbm);
  */
 APR_DECLARE(apr_status_t) apr_dbm_fetch(apr_dbm_t *dbm, apr_datum_t key,
                                         apr_datum_t *pvalue);
+/**
+ * Fetch several dbm record values by key
+ * @param dbm The database
+ * @param keys The key datums of the records
+ * @param nkeys The number of keys
+ * @param values The nkeys value datums retrieved, with a NULL dptr for
+ * the records that do not exist
+ * @param pool The pool the values are copied into
+ * @remark The sdbm driver looks the keys up grouped by page, the others
+ * one after the other.
+ */
+APR_DECLARE(apr_status_t) apr_dbm_fetch_multi(apr_dbm_t *dbm,
+                                              const apr_datum_t *keys,
+                                              apr_size_t nkeys,
+                                              apr_datum_t *values,
+                                              apr_pool_t *pool);
+
 /**
  * Store a dbm record value by key
  * @param dbm The database
@@ -210,6 +232,29 @@ APR_DECLARE(apr_status_t) apr_dbm_firstkey(apr_dbm_t *dbm, apr_datum_t *pkey);
  */
 APR_DECLARE(apr_status_t) apr_dbm_nextkey(apr_dbm_t *dbm, apr_datum_t *pkey);
 
+/**
+ * Callback of apr_dbm_iterate
+ * @param baton The baton given to apr_dbm_iterate
+ * @param key The key datum of the record
+ * @param value The value datum of the record
+ * @return 0 to stop the iteration, non-zero to continue
+ */
+typedef int (apr_dbm_iterate_cb_t)(void *baton, apr_datum_t key,
+                                   apr_datum_t value);
+
+/**
+ * Call a function for each record of a dbm, with its key and value
+ * @param dbm The database
+ * @param cb The function called for each record
+ * @param baton The baton passed to cb
+ * @remark The key and value are valid until cb returns, which must not
+ * change the database.  The sdbm and db drivers read them together,
+ * the others fetch the value of each key.
+ */
+APR_DECLARE(apr_status_t) apr_dbm_iterate(apr_dbm_t *dbm,
+                                          apr_dbm_iterate_cb_t *cb,
+                                          void *baton);
+
 /**
  * Proactively toss any memory associated with the apr_datum_t.
  * @param dbm The database
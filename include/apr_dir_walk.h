@@ -0,0 +1,113 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_DIR_WALK_H
+#define APR_DIR_WALK_H
+/**
+ * @file apr_dir_walk.h
+ * @brief APR Directory Tree Walker
+ */
+#include "apr.h"
+#include "apr_pools.h"
+#include "apr_errno.h"
+#include "apr_file_info.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * @defgroup apr_dir_walk Directory Tree Walker
+ * @ingroup APR
+ *
+ * apr_dir_walk() calls a function for every file of a directory tree,
+ * reading the directories one at a time in the calling thread, or in
+ * parallel on the threads of an apr_thread_pool_t.  Each directory has
+ * a pool of its own, destroyed once its entries and subdirectories have
+ * been walked, so the memory used grows with the directories pending and
+ * not with the size of the tree.
+ * @{
+ */
+
+/**
+ * @defgroup dirwalkflags Directory Walk Flags
+ * @ingroup apr_dir_walk
+ * @{
+ */
+#define APR_DIR_WALK_POSTORDER 0x001 /**< Call the function for a
+                                      * directory after its entries and
+                                      * subdirectories, rather than before
+                                      */
+#define APR_DIR_WALK_SERIAL    0x002 /**< Never call the function from two
+                                      * threads at the same time
+                                      */
+/** @} */
+
+/* The apr_thread_pool_t of apr_thread_pool.h, when threads are available */
+struct apr_thread_pool;
+
+/**
+ * Function called by apr_dir_walk() for each file
+ * @param baton The baton of apr_dir_walk()
+ * @param path The path of the file, starting with the root of the walk
+ * @param finfo The information about the file, whose valid fields must
+ *              be checked: they may be fewer than wanted if the file
+ *              could not be stat'ed
+ * @param pool A pool living until the directory of the file has been
+ *             walked
+ * @return APR_SUCCESS to continue the walk, anything else to stop it
+ */
+typedef apr_status_t (*apr_dir_walk_cb_t)(void *baton, const char *path,
+                                          const apr_finfo_t *finfo,
+                                          apr_pool_t *pool);
+
+/**
+ * Walk a directory tree
+ * @param root The directory to walk, reported first (or last with
+ *             #APR_DIR_WALK_POSTORDER); if it is not a directory, the
+ *             function is called for it only
+ * @param wanted The apr_finfo_t fields wanted for each file, as for
+ *               apr_dir_read(); APR_FINFO_TYPE is always added
+ * @param flags Zero or more of the @ref dirwalkflags OR'ed together
+ * @param func The function called for each file
+ * @param baton The baton of func
+ * @param tp The thread pool reading the directories, or NULL to read them
+ *           in the calling thread
+ * @param p The pool to use
+ * @return The first error of the walk, the status returned by func if it
+ *         stopped the walk, or APR_ENOTIMPL if tp is given and threads
+ *         are not available.
+ * @remark Subdirectories removed during the walk are skipped.  Symbolic
+ *         links are reported and not followed.
+ * @remark With a thread pool, the entries of a directory are reported in
+ *         the order they are read, but the directories are walked in no
+ *         particular order and func may be called from several threads
+ *         at once, unless #APR_DIR_WALK_SERIAL is given.  The calling
+ *         thread must not be one of the thread pool.
+ */
+APR_DECLARE(apr_status_t) apr_dir_walk(const char *root, apr_int32_t wanted,
+                                       apr_uint32_t flags,
+                                       apr_dir_walk_cb_t func, void *baton,
+                                       struct apr_thread_pool *tp,
+                                       apr_pool_t *p);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* ! APR_DIR_WALK_H */
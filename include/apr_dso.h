@@ -53,12 +53,36 @@ typedef void *                        apr_dso_handle_sym_t;
  * @param res_handle Location to store new handle for the DSO.
  * @param path Path to the DSO library
  * @param ctx Pool to use.
- * @bug We aught to provide an alternative to RTLD_GLOBAL, which
- * is the only supported method of loading DSOs today.
+ * @remark See apr_dso_load_ex() to load a DSO lazily or locally.
  */
 APR_DECLARE(apr_status_t) apr_dso_load(apr_dso_handle_t **res_handle,
                                        const char *path, apr_pool_t *ctx);
 
+/** Bind the functions of the DSO when they are first called, rather than
+ *  all of them when it is loaded (faster to load, but a missing symbol
+ *  fails the call instead of the load)
+ */
+#define APR_DSO_LAZY    0x0001
+/** Do not make the symbols of the DSO available to the ones loaded
+ *  later (the default is to make them global)
+ */
+#define APR_DSO_LOCAL   0x0002
+
+/**
+ * Load a DSO library, with options.
+ * @param res_handle Location to store new handle for the DSO.
+ * @param path Path to the DSO library
+ * @param flags APR_DSO_LAZY and/or APR_DSO_LOCAL, or 0 as apr_dso_load()
+ * @param ctx Pool to use.
+ * @remark The flags are hints, ignored where the platform has no such
+ *         options.  Setting LD_BIND_NOW in the environment still binds
+ *         everything at load time with APR_DSO_LAZY on glibc.
+ */
+APR_DECLARE(apr_status_t) apr_dso_load_ex(apr_dso_handle_t **res_handle,
+                                          const char *path,
+                                          apr_int32_t flags,
+                                          apr_pool_t *ctx);
+
 /**
  * Close a DSO library.
  * @param handle handle to close.
@@ -642,6 +642,99 @@ APR_DECLARE(const unsigned char *)apr_pdecode_base16_binary(apr_pool_t * p,
         const char *src, apr_ssize_t slen, int flags, apr_size_t * len)
         __attribute__((nonnull(1)));
 
+/**
+ * The codecs of the streams.
+ */
+typedef enum {
+    APR_ENCODE_CODEC_BASE64, /**< base64 and base64url */
+    APR_ENCODE_CODEC_BASE32, /**< base32 and base32hex */
+    APR_ENCODE_CODEC_BASE16  /**< base16 */
+} apr_encode_codec_e;
+
+/**
+ * The state of an encoding or decoding done in chunks, so that neither
+ * the whole source nor the whole result have to be in memory.
+ *
+ * A stream holds the bytes (or characters) of an incomplete group, up
+ * to the 5 bytes or 8 characters of base32, until the next chunk or the
+ * end of the stream.  The results are those of the function converting
+ * the whole source at once, with the same flags.
+ *
+ * The struct is public so that it can live on the stack, it is set up
+ * by apr_encode_stream_init() or apr_decode_stream_init().
+ */
+typedef struct apr_encode_stream_t {
+    apr_encode_codec_e codec; /**< The codec */
+    int flags;                /**< The APR_ENCODE_* flags */
+    int decode;               /**< Decoding rather than encoding */
+    int done;                 /**< The decoding met the padding, or an
+                               *   invalid character when relaxed */
+    apr_status_t status;      /**< The error of the decoding, if any */
+    apr_size_t count;         /**< The bytes encoded so far */
+    apr_size_t nheld;         /**< The length of held */
+    unsigned char held[8];    /**< The incomplete group */
+} apr_encode_stream_t;
+
+/**
+ * Set up a stream encoding to base64, base32 or base16.
+ * @param st The stream.
+ * @param codec The codec.
+ * @param flags The flags of apr_encode_base64_binary(),
+ *  apr_encode_base32_binary() or apr_encode_base16_binary().
+ * @return APR_SUCCESS, or APR_EINVAL for an unknown codec.
+ */
+APR_DECLARE(apr_status_t) apr_encode_stream_init(apr_encode_stream_t *st,
+        apr_encode_codec_e codec, int flags)
+        __attribute__((nonnull(1)));
+
+/**
+ * Set up a stream decoding from base64, base32 or base16.
+ * @param st The stream.
+ * @param codec The codec.
+ * @param flags The flags of apr_decode_base64_binary(),
+ *  apr_decode_base32_binary() or apr_decode_base16_binary().
+ * @return APR_SUCCESS, or APR_EINVAL for an unknown codec.
+ */
+APR_DECLARE(apr_status_t) apr_decode_stream_init(apr_encode_stream_t *st,
+        apr_encode_codec_e codec, int flags)
+        __attribute__((nonnull(1)));
+
+/**
+ * Encode or decode the next chunk of a stream.
+ * @param st The stream.
+ * @param dest The destination buffer, can be NULL to output in \c len the
+ *  maximum length this chunk can produce.
+ * @param src The chunk, bytes to encode or characters to decode.
+ * @param slen The length of the chunk.
+ * @param len Outputs the maximum length if \c dest is NULL, or else the
+ *  length written to \c dest, which is not NUL terminated.
+ * @return APR_SUCCESS, or when decoding APR_BADCH or APR_EINCOMPLETE like
+ *  the functions decoding at once.  An error sticks to the stream.
+ * @remark The bytes of an incomplete group are held by the stream, not
+ *  written, so \c len can be zero.
+ * @remark When decoding with APR_ENCODE_RELAXED, the characters after the
+ *  first invalid one are ignored, up to the end of the stream.
+ */
+APR_DECLARE(apr_status_t) apr_encode_stream(apr_encode_stream_t *st,
+        char *dest, const char *src, apr_size_t slen, apr_size_t *len)
+        __attribute__((nonnull(1,5)));
+
+/**
+ * Finish a stream, encoding or decoding what it holds.
+ * @param st The stream.
+ * @param dest The destination buffer, can be NULL to output in \c len the
+ *  maximum length needed.
+ * @param len Outputs the maximum length if \c dest is NULL, or else the
+ *  length written to \c dest, which is not NUL terminated.
+ * @return APR_SUCCESS, or when decoding APR_BADCH or APR_EINCOMPLETE like
+ *  the functions decoding at once.
+ * @remark The padding is written here when encoding, unless
+ *  APR_ENCODE_NOPADDING.  The stream can be reused once set up again.
+ */
+APR_DECLARE(apr_status_t) apr_encode_stream_final(apr_encode_stream_t *st,
+        char *dest, apr_size_t *len)
+        __attribute__((nonnull(1,3)));
+
 /** @} */
 #ifdef __cplusplus
 }
@@ -143,6 +143,7 @@ typedef dev_t                     apr_dev_t;
 typedef struct apr_finfo_t        apr_finfo_t;
 
 #define APR_FINFO_LINK   0x00000001 /**< Stat the link not the file itself if it is a link */
+#define APR_FINFO_NOSYNC 0x00000002 /**< Network filesystems may answer from their attribute caches */
 #define APR_FINFO_MTIME  0x00000010 /**< Modification Time */
 #define APR_FINFO_CTIME  0x00000020 /**< Creation or inode-changed time */
 #define APR_FINFO_ATIME  0x00000040 /**< Access Time */
@@ -225,10 +226,53 @@ struct apr_finfo_t {
  * @note If @c APR_INCOMPLETE is returned all the fields in @a finfo may
  *       not be filled in, and you need to check the @c finfo->valid bitmask
  *       to verify that what you're looking for is there.
+ * @remark Where statx() is available only the @a wanted fields are
+ *         asked for, and with @c APR_FINFO_NOSYNC a network filesystem
+ *         may answer from its cache (like for apr_file_info_get()).
  */
 APR_DECLARE(apr_status_t) apr_stat(apr_finfo_t *finfo, const char *fname,
                                    apr_int32_t wanted, apr_pool_t *pool);
 
+/** @see apr_stat_cache_create */
+typedef struct apr_stat_cache_t apr_stat_cache_t;
+
+/**
+ * Create a cache of the results of apr_stat(), for the files stated
+ * repeatedly (e.g. those of the static files of a server).
+ * @param cache the new cache
+ * @param size the number of results kept, the least recently used
+ *        being replaced first
+ * @param ttl how long a result is kept at most, which must be positive
+ * @param p the pool to allocate the cache from
+ * @remark Where inotify is available, the cached files are watched and
+ *         their results dropped when they change, otherwise a result
+ *         may be as old as @a ttl.
+ * @remark The cache is not thread safe, each thread should have its own.
+ */
+APR_DECLARE(apr_status_t) apr_stat_cache_create(apr_stat_cache_t **cache,
+                                                int size,
+                                                apr_interval_time_t ttl,
+                                                apr_pool_t *p);
+
+/**
+ * Get the specified file's stats like apr_stat(), but looking up the
+ * result in a cache first.
+ * @param finfo Where to store the information about the file, which is
+ * never touched if the call fails.
+ * @param cache the cache created by apr_stat_cache_create()
+ * @param fname The name of the file to stat.
+ * @param wanted The desired apr_finfo_t fields, as a bit flag of APR_FINFO_
+ *        values
+ * @param pool the pool to use for @a finfo
+ * @remark Only the absolute paths are cached, the failures included,
+ *         and not with APR_FINFO_NAME.
+ */
+APR_DECLARE(apr_status_t) apr_stat_cached(apr_finfo_t *finfo,
+                                          apr_stat_cache_t *cache,
+                                          const char *fname,
+                                          apr_int32_t wanted,
+                                          apr_pool_t *pool);
+
 /** @} */
 /**
  * @defgroup apr_dir Directory Manipulation Functions
@@ -267,6 +311,32 @@ APR_DECLARE(apr_status_t) apr_dir_close(apr_dir_t *thedir);
 APR_DECLARE(apr_status_t) apr_dir_read(apr_finfo_t *finfo, apr_int32_t wanted,
                                        apr_dir_t *thedir);
 
+/**
+ * Read the next entries from the specified directory.
+ * @param finfo the array of file info structures filled in
+ * @param nelts the number of elements of finfo
+ * @param nread the number of entries read
+ * @param wanted The desired apr_finfo_t fields, as a bit flag of APR_FINFO_
+ *               values
+ * @param thedir the directory descriptor returned from apr_dir_open
+ * @remark The entries are read as by apr_dir_read().  Fields known from
+ *         the directory entries themselves (the name, and on most Unixes
+ *         the type and inode) cost no stat, the others are obtained on
+ *         Unix relative to the directory, with statx() asking for the
+ *         wanted fields only where available.
+ *
+ * @note @c APR_INCOMPLETE is returned when any of the entries read is
+ *       incomplete, as for apr_dir_read().  Fewer than @a nelts entries
+ *       are read at the end of the directory or on error; an error is
+ *       returned once no entry could be read, APR_ENOENT when no more
+ *       entries are available.
+ */
+APR_DECLARE(apr_status_t) apr_dir_read_batch(apr_finfo_t *finfo,
+                                             apr_size_t nelts,
+                                             apr_size_t *nread,
+                                             apr_int32_t wanted,
+                                             apr_dir_t *thedir);
+
 /**
  * Rewind the directory to the first entry.
  * @param thedir the directory descriptor to rewind.
@@ -357,6 +427,63 @@ APR_DECLARE(apr_status_t) apr_filepath_merge(char **newpath,
                                              apr_int32_t flags,
                                              apr_pool_t *p);
 
+/**
+ * Merge additional file path onto the previously processed rootpath,
+ * like apr_filepath_merge() but into the given buffer.
+ * @param buf the buffer for the merged paths
+ * @param size the size of @a buf, APR_PATH_MAX being always enough
+ * @param rootpath the root file path (NULL uses the current working path)
+ * @param addpath the path to add to the root path
+ * @param flags the desired APR_FILEPATH_ rules to apply when merging
+ * @param p the pool for the platforms needing some working storage (not
+ *          Unix, where nothing is allocated)
+ * @return APR_ENAMETOOLONG if @a buf cannot hold the lengths of
+ *         @a rootpath and @a addpath plus four, otherwise as
+ *         apr_filepath_merge().
+ */
+APR_DECLARE(apr_status_t) apr_filepath_merge_buf(char *buf, apr_size_t size,
+                                                 const char *rootpath,
+                                                 const char *addpath,
+                                                 apr_int32_t flags,
+                                                 apr_pool_t *p);
+
+/** @see apr_filepath_cache_create */
+typedef struct apr_filepath_cache_t apr_filepath_cache_t;
+
+/**
+ * Create a cache of the results of apr_filepath_merge(), for the paths
+ * merged repeatedly (e.g. those of the static files of a server).
+ * @param cache the new cache
+ * @param size the number of results kept, the least recently used
+ *        being replaced first
+ * @param p the pool to allocate the cache from
+ * @remark The cache is not thread safe, each thread should have its own.
+ */
+APR_DECLARE(apr_status_t) apr_filepath_cache_create(
+                                                apr_filepath_cache_t **cache,
+                                                int size, apr_pool_t *p);
+
+/**
+ * Merge additional file path onto the previously processed rootpath,
+ * like apr_filepath_merge() but looking up the result in a cache first.
+ * @param newpath the merged paths returned
+ * @param cache the cache created by apr_filepath_cache_create()
+ * @param rootpath the root file path (NULL uses the current working path,
+ *        and the cache is not used then)
+ * @param addpath the path to add to the root path
+ * @param flags the desired APR_FILEPATH_ rules to apply when merging
+ * @param p the pool to allocate the new path string from
+ * @remark Only the successful merges of short enough paths are cached,
+ *         so APR_FILEPATH_TRUENAME should not be used if the files may
+ *         change.
+ */
+APR_DECLARE(apr_status_t) apr_filepath_merge_cached(char **newpath,
+                                               apr_filepath_cache_t *cache,
+                                               const char *rootpath,
+                                               const char *addpath,
+                                               apr_int32_t flags,
+                                               apr_pool_t *p);
+
 /**
  * Split a search path into separate components
  * @param pathelts the returned components of the search path
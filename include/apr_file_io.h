@@ -314,6 +314,35 @@ APR_DECLARE(apr_status_t) apr_file_copy(const char *from_path,
                                         apr_fileperms_t perms,
                                         apr_pool_t *pool);
 
+/**
+ * @defgroup apr_file_copy_flags File Copy Flags
+ * @{
+ */
+#define APR_FILE_COPY_SPARSE  0x0001 /**< Keep the holes of the source
+                                      * file, where the system can find
+                                      * them (SEEK_DATA and SEEK_HOLE)
+                                      */
+/** @} */
+
+/**
+ * Copy the specified file to another file, with flags.
+ * @param from_path The full path to the original file (using / on all systems)
+ * @param to_path The full path to the new file (using / on all systems)
+ * @param perms Access permissions for the new file if it is created, as
+ *     for apr_file_copy()
+ * @param flags Zero or APR_FILE_COPY_SPARSE
+ * @param pool The pool to use.
+ * @remark Like apr_file_copy(), which uses no flags.  The data is shared
+ * with the source file (reflink) or copied in the kernel where the system
+ * allows it.
+ * @warning If the new file already exists, its contents will be overwritten.
+ */
+APR_DECLARE(apr_status_t) apr_file_copy_ex(const char *from_path,
+                                           const char *to_path,
+                                           apr_fileperms_t perms,
+                                           apr_int32_t flags,
+                                           apr_pool_t *pool);
+
 /**
  * Append the specified file to another file.
  * @param from_path The full path to the source file (use / on all systems)
@@ -566,6 +595,83 @@ APR_DECLARE(apr_status_t) apr_file_writev_full(apr_file_t *thefile,
                                                const struct iovec *vec,
                                                apr_size_t nvec,
                                                apr_size_t *nbytes);
+
+/**
+ * Read data from the specified file at an offset, without using or
+ * moving the file pointer.
+ * @param thefile The file descriptor to read from.
+ * @param offset The offset in the file to read from.
+ * @param buf The buffer to store the data to.
+ * @param nbytes On entry, the number of bytes to read; on exit, the number
+ *               of bytes read.
+ *
+ * @remark Threads may share one file to read and write at their own
+ * offsets with these functions, which do not go through the buffer of
+ * APR_FOPEN_BUFFERED files: data buffered for writing is flushed first,
+ * but data buffered for reading is not updated by apr_file_write_at().
+ * Where the system has no pread() (OS/2), the file pointer is moved
+ * there and back, holding the lock of APR_FOPEN_XTHREAD files.
+ *
+ * @remark apr_file_read_at() will return #APR_EOF if no data is available
+ * at that offset.
+ */
+APR_DECLARE(apr_status_t) apr_file_read_at(apr_file_t *thefile,
+                                           apr_off_t offset, void *buf,
+                                           apr_size_t *nbytes);
+
+/**
+ * Write data to the specified file at an offset, without using or moving
+ * the file pointer.
+ * @param thefile The file descriptor to write to.
+ * @param offset The offset in the file to write to.
+ * @param buf The buffer which contains the data.
+ * @param nbytes On entry, the number of bytes to write; on exit, the number
+ *               of bytes written.
+ *
+ * @remark See apr_file_read_at().  Some systems (Linux) append the data
+ * of files opened with APR_FOPEN_APPEND regardless of the offset.
+ */
+APR_DECLARE(apr_status_t) apr_file_write_at(apr_file_t *thefile,
+                                            apr_off_t offset,
+                                            const void *buf,
+                                            apr_size_t *nbytes);
+
+/**
+ * Read data from the specified file at an offset into an iovec array,
+ * without using or moving the file pointer.
+ * @param thefile The file descriptor to read from.
+ * @param offset The offset in the file to read from.
+ * @param vec The array of buffers to fill, in order.
+ * @param nvec The number of elements in the struct iovec array.
+ * @param nbytes The number of bytes read.
+ *
+ * @remark See apr_file_read_at().  Without preadv(), the buffers are read
+ * one at a time and the read stops at the first short one.
+ */
+APR_DECLARE(apr_status_t) apr_file_readv_at(apr_file_t *thefile,
+                                            apr_off_t offset,
+                                            const struct iovec *vec,
+                                            apr_size_t nvec,
+                                            apr_size_t *nbytes);
+
+/**
+ * Write data from an iovec array to the specified file at an offset,
+ * without using or moving the file pointer.
+ * @param thefile The file descriptor to write to.
+ * @param offset The offset in the file to write to.
+ * @param vec The array from which to get the data to write to the file.
+ * @param nvec The number of elements in the struct iovec array.
+ * @param nbytes The number of bytes written.
+ *
+ * @remark See apr_file_write_at().  Without pwritev(), the buffers are
+ * written one at a time and the write stops at the first short one.
+ */
+APR_DECLARE(apr_status_t) apr_file_writev_at(apr_file_t *thefile,
+                                             apr_off_t offset,
+                                             const struct iovec *vec,
+                                             apr_size_t nvec,
+                                             apr_size_t *nbytes);
+
 /**
  * Write a character into the specified file.
  * @param ch The character to write.
@@ -598,6 +704,40 @@ APR_DECLARE(apr_status_t) apr_file_ungetc(char ch, apr_file_t *thefile);
 APR_DECLARE(apr_status_t) apr_file_gets(char *str, int len,
                                         apr_file_t *thefile);
 
+/** Structure for iterating over the lines of a file */
+typedef struct apr_file_line_iter_t apr_file_line_iter_t;
+
+/**
+ * Create an iterator returning the lines of a file without copying them.
+ * @param iter The iterator created
+ * @param thefile The file to read from, from its current offset
+ * @param bufsize The size of the buffer of the iterator, which grows to
+ *                hold lines longer than that
+ * @param p The pool to allocate the iterator from
+ * @remark The iterator reads ahead of the lines it returned: the offset
+ *         of the file is not the end of the last line returned.  Files
+ *         opened without APR_FOPEN_BUFFERED are read directly into the
+ *         buffer of the iterator.
+ */
+APR_DECLARE(apr_status_t) apr_file_line_iter_create(
+                                            apr_file_line_iter_t **iter,
+                                            apr_file_t *thefile,
+                                            apr_size_t bufsize,
+                                            apr_pool_t *p);
+
+/**
+ * Get the next line of a file.
+ * @param iter The iterator
+ * @param line The line, in the buffer of the iterator and valid until the
+ *             next call; it is not NUL-terminated
+ * @param len The length of the line, including its newline
+ * @remark The newline at the end of the line is not stripped; the last
+ *         line may have none.  APR_EOF is returned after the last line.
+ */
+APR_DECLARE(apr_status_t) apr_file_line_iter_next(apr_file_line_iter_t *iter,
+                                                  const char **line,
+                                                  apr_size_t *len);
+
 /**
  * Write the string into the specified file.
  * @param str The string to write.
@@ -633,6 +773,77 @@ APR_DECLARE(apr_status_t) apr_file_sync(apr_file_t *thefile);
  */
 APR_DECLARE(apr_status_t) apr_file_datasync(apr_file_t *thefile);
 
+/**
+ * @defgroup apr_file_group_commit Group Commit
+ * @{
+ */
+
+/** Sync with apr_file_sync() instead of apr_file_datasync() */
+#define APR_FILE_GROUP_COMMIT_FULLSYNC 0x1
+
+/** Structure for sharing the syncs of a file between its writers */
+typedef struct apr_file_group_commit_t apr_file_group_commit_t;
+
+/**
+ * Create a group commit for a file, so that the writers waiting for
+ * their data to be durable share the syncs of the file, instead of
+ * syncing it once each.
+ * @param gc The group commit created
+ * @param file The file, opened with APR_FOPEN_XTHREAD if it is buffered
+ *             and used by several threads
+ * @param delay How long a sync waits for more writers before it starts,
+ *              or zero
+ * @param flags Zero or #APR_FILE_GROUP_COMMIT_FULLSYNC
+ * @param p The pool to allocate the group commit from
+ */
+APR_DECLARE(apr_status_t) apr_file_group_commit_create(
+                                            apr_file_group_commit_t **gc,
+                                            apr_file_t *file,
+                                            apr_interval_time_t delay,
+                                            apr_uint32_t flags,
+                                            apr_pool_t *p);
+
+/**
+ * Write all the data to the file of a group commit, and get a ticket for
+ * apr_file_group_commit_wait().
+ * @param gc The group commit
+ * @param buf The data to write
+ * @param nbytes The number of bytes to write
+ * @param ticket The ticket of the data, set on success only
+ * @remark The writes of the group commit are serialized, so a record is
+ *         not interleaved with the records of other threads.
+ */
+APR_DECLARE(apr_status_t) apr_file_group_commit_write(
+                                            apr_file_group_commit_t *gc,
+                                            const void *buf,
+                                            apr_size_t nbytes,
+                                            apr_uint64_t *ticket);
+
+/**
+ * Get a ticket for the data already written to the file of a group
+ * commit by the caller.
+ * @param gc The group commit
+ * @return The ticket, for apr_file_group_commit_wait()
+ */
+APR_DECLARE(apr_uint64_t) apr_file_group_commit_ticket(
+                                            apr_file_group_commit_t *gc);
+
+/**
+ * Wait for the data of a ticket, and of all the tickets before it, to be
+ * durable.
+ * @param gc The group commit
+ * @param ticket The ticket
+ * @return The status of the sync covering the ticket, or #APR_EINVAL if
+ *         the ticket was not issued.
+ * @remark The first waiter finding no sync running syncs the file for all
+ *         the tickets issued so far, the others wait for it.
+ */
+APR_DECLARE(apr_status_t) apr_file_group_commit_wait(
+                                            apr_file_group_commit_t *gc,
+                                            apr_uint64_t ticket);
+
+/** @} */
+
 /**
  * Duplicate the specified file descriptor.
  * @param new_file The structure to duplicate into.
@@ -692,6 +903,55 @@ APR_DECLARE(apr_status_t) apr_file_buffer_set(apr_file_t *thefile,
  */
 APR_DECLARE(apr_size_t) apr_file_buffer_size_get(apr_file_t *thefile);
 
+/**
+ * Set the size of the buffers of the files opened with #APR_FOPEN_BUFFERED
+ * @param bufsize The size of the buffers, zero for the default of 4096
+ * @param maxsize The size up to which a buffer doubles each time it is
+ *                filled or drained sequentially, zero (or not more than
+ *                bufsize) for buffers of a fixed size
+ * @remark This is process wide and not synchronized, set it before opening
+ *         the files.  The buffers given by apr_file_buffer_set() are never
+ *         replaced.  Buffers only grow on Unix.
+ */
+APR_DECLARE(void) apr_file_buffer_default_set(apr_size_t bufsize,
+                                              apr_size_t maxsize);
+
+/**
+ * Get the sizes set by apr_file_buffer_default_set()
+ * @param bufsize The size of the buffers
+ * @param maxsize The size up to which the buffers grow
+ */
+APR_DECLARE(void) apr_file_buffer_default_get(apr_size_t *bufsize,
+                                              apr_size_t *maxsize);
+
+/**
+ * Stage the writes of the threads sharing an appended file, instead of
+ * serializing them on the lock of the file
+ * @param thefile The file, opened with #APR_FOPEN_APPEND,
+ *                #APR_FOPEN_BUFFERED and #APR_FOPEN_XTHREAD
+ * @param nstages The number of staging buffers, each used by the threads
+ *                hashing to it; zero to go back to the buffer of the file
+ * @param stagesize The size of each buffer, zero for the size of the
+ *                  buffer of the file
+ * @param max_age How long the oldest record of a buffer may wait before
+ *                the buffer is written, checked by the writes to it;
+ *                zero or negative for no limit
+ * @remark Each apr_file_write() or apr_file_writev() is a record, which
+ *         is written to the file with the other records of its buffer by
+ *         a single system call, or alone if larger than the buffer: the
+ *         records never interleave.  The records of a thread keep their
+ *         order, those of different threads are only ordered by the
+ *         flushes of their buffers, on a full buffer, on max_age, and by
+ *         apr_file_flush() and apr_file_close() for all of them.
+ * @remark Call it before the file is shared by the threads.
+ * @return APR_EINVAL if the file was not opened with the flags above,
+ *         APR_ENOTIMPL where not supported.
+ */
+APR_DECLARE(apr_status_t) apr_file_append_stages_set(apr_file_t *thefile,
+                                                     apr_uint32_t nstages,
+                                                     apr_size_t stagesize,
+                                                     apr_interval_time_t max_age);
+
 /**
  * Move the read/write file offset to a specified byte within a file.
  * @param thefile The file descriptor
@@ -803,6 +1063,60 @@ APR_DECLARE(apr_status_t) apr_file_pipe_timeout_get(apr_file_t *thepipe,
 APR_DECLARE(apr_status_t) apr_file_pipe_timeout_set(apr_file_t *thepipe,
                                                   apr_interval_time_t timeout);
 
+/**
+ * Set the capacity of a pipe, i.e. how much can be written to it before
+ * it is read.
+ * @param thepipe Either end of the pipe.
+ * @param size The capacity in bytes, which the system may round up (to
+ *        a power of two number of pages on Linux) and limit for the
+ *        unprivileged processes.
+ * @return APR_ENOTIMPL where the capacity cannot be changed.
+ * @remark A larger capacity makes for less context switches between a
+ *         writer and a reader of large amounts of data, like a child
+ *         process set up with apr_procattr_io_set() and its parent.
+ */
+APR_DECLARE(apr_status_t) apr_file_pipe_size_set(apr_file_t *thepipe,
+                                                 apr_size_t size);
+
+/**
+ * Get the capacity of a pipe.
+ * @param thepipe Either end of the pipe.
+ * @param size The capacity in bytes.
+ * @return APR_ENOTIMPL where the capacity is not known.
+ */
+APR_DECLARE(apr_status_t) apr_file_pipe_size_get(apr_file_t *thepipe,
+                                                 apr_size_t *size);
+
+/**
+ * @defgroup apr_file_splice_flags File Splice Flags
+ * @{
+ */
+#define APR_FILE_SPLICE_MORE 0x0001 /**< More data will be written to the
+                                     * output (a hint for sockets)
+                                     */
+#define APR_FILE_SPLICE_TEE  0x0002 /**< Copy the data from pipe to pipe
+                                     * without consuming it
+                                     */
+/** @} */
+
+/**
+ * Move data from a file to another, like apr_file_read() then
+ * apr_file_write_full(), but without copying it to userspace where the
+ * system allows it (splice() from or to a pipe on Linux).
+ * @param in The file to read from.
+ * @param out The file to write to.
+ * @param len On entry, the most bytes to move; on return, the number of
+ *        bytes moved.
+ * @param flags Zero or more of the APR_FILE_SPLICE_* flags.
+ * @return APR_EOF when nothing is left to read, and APR_ENOTIMPL with
+ *         #APR_FILE_SPLICE_TEE where the data cannot be copied in place.
+ * @remark Like apr_file_read(), less than @a len bytes may be moved at
+ *         once, and the pipe timeouts apply.  The files opened with
+ *         #APR_FOPEN_BUFFERED are read or written through their buffers.
+ */
+APR_DECLARE(apr_status_t) apr_file_splice(apr_file_t *in, apr_file_t *out,
+                                          apr_size_t *len, apr_int32_t flags);
+
 /** file (un)locking functions. */
 
 /**
@@ -0,0 +1,134 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_FLATMAP_H
+#define APR_FLATMAP_H
+
+/**
+ * @file apr_flatmap.h
+ * @brief APR Flat Maps
+ */
+
+#include "apr.h"
+#include "apr_errno.h"
+#include "apr_pools.h"
+#include "apr_tables.h"
+#include "apr_hash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup apr_flatmap Flat Maps
+ * @ingroup APR
+ *
+ * An immutable map, built once from key/value pairs, for the lookup data
+ * which is only read after startup.  The map is a single block of memory
+ * (keys included) where the entries are sorted in an implicit search tree
+ * (Eytzinger layout), so lookups are a short run of mostly branch free
+ * comparisons down cache friendly memory.  Since it is never modified, a
+ * map can be shared by many threads without a lock.
+ * @{
+ */
+
+/**
+ * Abstract type for flat maps.
+ */
+typedef struct apr_flatmap_t apr_flatmap_t;
+
+/**
+ * The key/value pairs flat maps are built from.
+ */
+typedef struct apr_flatmap_pair_t {
+    /** The key */
+    const void *key;
+    /** The length of the key, or APR_HASH_KEY_STRING */
+    apr_ssize_t klen;
+    /** The value */
+    const void *val;
+} apr_flatmap_pair_t;
+
+/**
+ * Build a flat map.
+ * @param fm The flat map just built
+ * @param pairs An array of apr_flatmap_pair_t.
+ * @param p The pool to allocate the flat map from.
+ * @return APR_SUCCESS, APR_EINVAL if the elements of @a pairs are not
+ *         apr_flatmap_pair_t, or APR_ENOMEM.
+ * @remark The keys are copied in the map (and NUL terminated), the values
+ *         are stored as is.  When a key is given more than once, the last
+ *         value is kept.
+ */
+APR_DECLARE(apr_status_t) apr_flatmap_make(apr_flatmap_t **fm,
+                                           const apr_array_header_t *pairs,
+                                           apr_pool_t *p);
+
+/**
+ * Copy a flat map into another pool.
+ * @param p The pool to allocate the copy from.
+ * @param fm The flat map to copy
+ * @return The copy, a single memcpy() of the map.
+ */
+APR_DECLARE(apr_flatmap_t *) apr_flatmap_copy(apr_pool_t *p,
+                                              const apr_flatmap_t *fm);
+
+/**
+ * Look up the value associated with a key in a flat map.
+ * @param fm The flat map
+ * @param key Pointer to the key
+ * @param klen Length of the key. Can be APR_HASH_KEY_STRING to use the
+ *        string length.
+ * @return Returns NULL if the key is not present.
+ */
+APR_DECLARE(void *) apr_flatmap_get(const apr_flatmap_t *fm, const void *key,
+                                    apr_ssize_t klen);
+
+/**
+ * Get the number of key/value pairs in a flat map.
+ * @param fm The flat map
+ * @return The number of key/value pairs in the flat map.
+ */
+APR_DECLARE(unsigned int) apr_flatmap_count(const apr_flatmap_t *fm);
+
+/**
+ * Get the size of the memory block of a flat map.
+ * @param fm The flat map
+ * @return The size in bytes, keys included.
+ */
+APR_DECLARE(apr_size_t) apr_flatmap_size(const apr_flatmap_t *fm);
+
+/**
+ * Iterate over a flat map running the provided function once for every
+ * element, in the order of the keys (bytewise, shorter first).
+ *
+ * @param comp The function to run
+ * @param rec The data to pass as the first argument to the function
+ * @param fm The flat map to iterate over
+ * @return FALSE if one of the comp() iterations returned zero; TRUE if all
+ *            iterations returned non-zero
+ * @see apr_hash_do_callback_fn_t
+ */
+APR_DECLARE(int) apr_flatmap_do(apr_hash_do_callback_fn_t *comp,
+                                void *rec, const apr_flatmap_t *fm);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* !APR_FLATMAP_H */
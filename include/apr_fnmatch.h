@@ -120,6 +120,59 @@ extern "C" {
 APR_DECLARE(apr_status_t) apr_fnmatch(const char *pattern,
                                       const char *strings, int flags);
 
+/**
+ * A pattern compiled by apr_fnmatch_compile()
+ */
+typedef struct apr_fnmatch_t apr_fnmatch_t;
+
+/**
+ * Compile a pattern for apr_fnmatch_match(), which tests its literal
+ * prefix, suffix and longest literal in between before matching
+ * @param p The pool from which to allocate the compiled pattern
+ * @param pattern The pattern, see apr_fnmatch()
+ * @param flags The flags of the matches, see apr_fnmatch()
+ * @return The compiled pattern
+ */
+APR_DECLARE(const apr_fnmatch_t *) apr_fnmatch_compile(apr_pool_t *p,
+                                                       const char *pattern,
+                                                       int flags);
+
+/**
+ * Try to match the string to a compiled pattern
+ * @param fnm The compiled pattern
+ * @param string The string we are trying to match
+ * @return APR_SUCCESS if match, else APR_FNM_NOMATCH, like apr_fnmatch()
+ *         with the pattern and flags of apr_fnmatch_compile()
+ */
+APR_DECLARE(int) apr_fnmatch_match(const apr_fnmatch_t *fnm,
+                                   const char *string);
+
+/**
+ * A set of compiled patterns, see apr_fnmatch_set_make()
+ */
+typedef struct apr_fnmatch_set_t apr_fnmatch_set_t;
+
+/**
+ * Make a set of compiled patterns for apr_fnmatch_set_match(), which
+ * searches the string for the literals of all of them in a single pass
+ * @param p The pool from which to allocate the set
+ * @param fnms The compiled patterns (the array is copied)
+ * @param nfnms The number of patterns
+ * @return The set, or NULL if it cannot be made
+ */
+APR_DECLARE(const apr_fnmatch_set_t *) apr_fnmatch_set_make(apr_pool_t *p,
+                                           const apr_fnmatch_t * const *fnms,
+                                           int nfnms);
+
+/**
+ * Find the first pattern of a set matching the string
+ * @param set The set of compiled patterns
+ * @param string The string we are trying to match
+ * @return The index of the first pattern matching, or -1 if none does
+ */
+APR_DECLARE(int) apr_fnmatch_set_match(const apr_fnmatch_set_t *set,
+                                       const char *string);
+
 /**
  * Determine if the given pattern is a regular expression.
  * @param pattern The pattern to search for glob characters.
@@ -66,6 +66,7 @@ typedef struct apr_global_mutex_t apr_global_mutex_t;
  *            APR_LOCK_SYSVSEM
  *            APR_LOCK_POSIXSEM
  *            APR_LOCK_PROC_PTHREAD
+ *            APR_LOCK_FUTEX
  *            APR_LOCK_DEFAULT     pick the default mechanism for the platform
  *            APR_LOCK_DEFAULT_TIMED pick the default timed mechanism
  * </PRE>
@@ -159,6 +160,18 @@ APR_DECLARE(const char *) apr_global_mutex_name(apr_global_mutex_t *mutex);
  */
 APR_PERMS_SET_IMPLEMENT(global_mutex);
 
+/**
+ * Tag a global mutex for the lock contention profiling.
+ * @param mutex The mutex to tag.
+ * @param tag The tag, not copied.
+ * @return APR_ENOTIMPL if APR_HAS_LOCK_PROFILE is 0.
+ * @remark The profile is kept in the memory of each process, inherited
+ *         by the children.
+ * @see apr_lock_profile.h
+ */
+APR_DECLARE(apr_status_t) apr_global_mutex_tag(apr_global_mutex_t *mutex,
+                                               const char *tag);
+
 /**
  * Get the pool used by this global_mutex.
  * @return apr_pool_t the pool
@@ -184,6 +197,7 @@ APR_POOL_DECLARE_ACCESSOR(global_mutex);
 #define apr_global_mutex_name       apr_proc_mutex_name
 #define apr_global_mutex_perms_set  apr_proc_mutex_perms_set
 #define apr_global_mutex_pool_get   apr_proc_mutex_pool_get
+#define apr_global_mutex_tag        apr_proc_mutex_tag
 
 #endif
 
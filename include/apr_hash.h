@@ -70,6 +70,15 @@ typedef unsigned int (*apr_hashfunc_t)(const char *key, apr_ssize_t *klen);
 APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_default(const char *key,
                                                       apr_ssize_t *klen);
 
+/**
+ * A faster hash function for longer keys, mixing them 8 bytes at a time.
+ * @remark Unlike the hash tables created with APR_HASH_FAST_HASH, this
+ *         function is not seeded, so its values can be stored and compared
+ *         across processes.
+ */
+APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_fast(const char *key,
+                                                   apr_ssize_t *klen);
+
 /**
  * Create a hash table.
  * @param pool The pool to allocate the hash table out of
@@ -86,6 +95,66 @@ APR_DECLARE(apr_hash_t *) apr_hash_make(apr_pool_t *pool);
 APR_DECLARE(apr_hash_t *) apr_hash_make_custom(apr_pool_t *pool,
                                                apr_hashfunc_t hash_func);
 
+/** Store the entries inline with open addressing,
+ *  @see apr_hash_make_ex() */
+#define APR_HASH_OPEN_ADDRESSING 0x01
+/** Use (a seeded) apr_hashfunc_fast() by default,
+ *  @see apr_hash_make_ex() */
+#define APR_HASH_FAST_HASH 0x02
+/** Expand the table a few buckets at a time,
+ *  @see apr_hash_make_ex() */
+#define APR_HASH_INCREMENTAL 0x04
+
+/**
+ * Create a hash table, with flags
+ * @param pool The pool to allocate the hash table out of
+ * @param hash_func NULL, or a custom hash function.
+ * @param flags 0 or a combination of:
+ * <PRE>
+ *         APR_HASH_OPEN_ADDRESSING  Store the entries inline in an array
+ *                                   probed from the hash of the key (with
+ *                                   a packed array of bytes to tell which
+ *                                   slots are used and part of their hash),
+ *                                   rather than in lists of entries
+ *                                   allocated from the pool. Lookups touch
+ *                                   less memory, and deleted entries don't
+ *                                   keep memory once the table is rebuilt.
+ *         APR_HASH_FAST_HASH        Without @a hash_func, hash the keys
+ *                                   like apr_hashfunc_fast() but with the
+ *                                   table's random seed, rather than like
+ *                                   apr_hashfunc_default(). This is as fast
+ *                                   for short keys and much faster for
+ *                                   longer ones.
+ *         APR_HASH_INCREMENTAL      When the table grows, move its entries
+ *                                   to the larger array a few buckets per
+ *                                   entry added rather than all at once,
+ *                                   so that no single addition takes time
+ *                                   proportional to the size of the table.
+ *                                   Lookups check both arrays meanwhile.
+ *                                   This has no effect with
+ *                                   APR_HASH_OPEN_ADDRESSING.
+ * </PRE>
+ * @return The hash table just created
+ * @remark Both kinds of hash tables have the same API and iteration
+ *         behaviour, notably the current entry of an iteration can be
+ *         deleted, but adding entries while iterating is not supported.
+ *         Copies are of the same kind, merges of the kind of the base.
+ */
+APR_DECLARE(apr_hash_t *) apr_hash_make_ex(apr_pool_t *pool,
+                                           apr_hashfunc_t hash_func,
+                                           apr_uint32_t flags);
+
+/**
+ * Make room in a hash table for a number of entries.
+ * @param ht The hash table
+ * @param n The number of entries the table will hold
+ * @remark The table is resized at once if needed, and then won't be
+ *         until it holds more than @a n entries. Deleted entries may still
+ *         cause a table created with APR_HASH_OPEN_ADDRESSING to be
+ *         rebuilt at the same size. Tables are never shrunk.
+ */
+APR_DECLARE(void) apr_hash_reserve(apr_hash_t *ht, unsigned int n);
+
 /**
  * Make a copy of a hash table
  * @param pool The pool from which to allocate the new hash table
@@ -283,6 +352,58 @@ typedef int (apr_hash_do_callback_fn_t)(void *rec, const void *key,
 APR_DECLARE(int) apr_hash_do(apr_hash_do_callback_fn_t *comp,
                              void *rec, const apr_hash_t *ht);
 
+struct apr_thread_pool;
+
+/**
+ * Iterate over a hash table like apr_hash_do(), in parallel.
+ *
+ * The buckets are cut in chunks, which the threads of @a tp, up to its
+ * maximum, take with the calling thread; it waits for them before
+ * returning.
+ *
+ * @param comp The function to run, called concurrently from the threads
+ * @param rec The data to pass as the first argument to the function
+ * @param ht The hash table to iterate over, not modified meanwhile
+ * @param tp The thread pool to use, or NULL to do it all in the calling
+ *           thread
+ * @return FALSE if one of the comp() iterations returned zero, the chunks
+ *         not started yet being skipped then; TRUE if all iterations
+ *         returned non-zero
+ * @remark The order of the calls is unspecified.
+ */
+APR_DECLARE(int) apr_hash_do_parallel(apr_hash_do_callback_fn_t *comp,
+                                      void *rec, const apr_hash_t *ht,
+                                      struct apr_thread_pool *tp);
+
+/**
+ * Set many keys of a hash table at once, hashing them in parallel.
+ *
+ * The result is the same as apr_hash_set() for each key in turn, so the
+ * last value of a duplicate key wins.
+ *
+ * @param ht The hash table, usually empty
+ * @param keys The keys, which must live as long as the table
+ * @param klens The lengths of the keys, or NULL for all of them being
+ *              APR_HASH_KEY_STRING
+ * @param vals The values, none of them NULL
+ * @param n The number of keys
+ * @param tp The thread pool to use, or NULL to do it all in the calling
+ *           thread
+ * @return APR_SUCCESS, or APR_EINVAL if a value is NULL (the table is
+ *         then unchanged)
+ * @remark The table is reserved for the keys first (apr_hash_reserve()).
+ * With chaining, the keys are then added by ranges of buckets, each range
+ * by a single thread. With open addressing only the hashing is parallel.
+ * @remark The hash function of the table is called concurrently from the
+ * threads.
+ */
+APR_DECLARE(apr_status_t) apr_hash_build_parallel(apr_hash_t *ht,
+                                                  const void * const *keys,
+                                                  const apr_ssize_t *klens,
+                                                  const void * const *vals,
+                                                  unsigned int n,
+                                                  struct apr_thread_pool *tp);
+
 /**
  * Get a pointer to the pool which the hash table was created in
  */
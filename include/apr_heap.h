@@ -0,0 +1,145 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_HEAP_H
+#define APR_HEAP_H
+
+/**
+ * @file apr_heap.h
+ * @brief APR Heaps (Priority Queues)
+ */
+
+#include "apr.h"
+#include "apr_errno.h"
+#include "apr_pools.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup apr_heap Heaps
+ * @ingroup APR
+ *
+ * A priority queue of elements kept in a contiguous array (as a 4-ary
+ * min-heap), for the users of @ref apr_skiplist which only insert, peek
+ * and pop.  An element can be given a handle when inserted, to update its
+ * place after its priority changed or to remove it.
+ * @{
+ */
+
+/**
+ * Abstract type for heaps.
+ */
+typedef struct apr_heap_t apr_heap_t;
+
+/**
+ * Abstract type for the handles of the elements in heaps.
+ */
+typedef struct apr_heap_node_t apr_heap_node_t;
+
+/**
+ * Callback functions for comparing the elements of heaps.
+ * @param a The first element
+ * @param b The second element
+ * @return Less than zero if @a a comes out of the heap before @a b, more
+ *         than zero if it comes out after, zero if they have the same
+ *         priority.
+ */
+typedef int (apr_heap_compare_fn_t)(const void *a, const void *b);
+
+/**
+ * Create a heap.
+ * @param heap The heap just created
+ * @param nalloc The number of elements to allocate room for, or zero.
+ * @param compare The function comparing the elements.
+ * @param pool The pool whose lifetime the heap has; the array of the
+ *        elements is allocated from its allocator, and given back when
+ *        the heap grows.
+ * @return APR_SUCCESS, APR_EINVAL if @a compare is NULL, or APR_ENOMEM.
+ */
+APR_DECLARE(apr_status_t) apr_heap_create(apr_heap_t **heap,
+                                          apr_size_t nalloc,
+                                          apr_heap_compare_fn_t *compare,
+                                          apr_pool_t *pool);
+
+/**
+ * Insert an element in a heap.
+ * @param heap The heap
+ * @param data The element
+ * @param node If not NULL, the handle of the element is returned there.
+ * @return APR_SUCCESS or APR_ENOMEM.
+ * @remark The handles are only needed for apr_heap_update() and
+ *         apr_heap_remove(), no memory is allocated for the elements
+ *         inserted without.
+ */
+APR_DECLARE(apr_status_t) apr_heap_insert(apr_heap_t *heap, void *data,
+                                          apr_heap_node_t **node);
+
+/**
+ * Get the first element of a heap, leaving it in the heap.
+ * @param heap The heap
+ * @return The element, or NULL if the heap is empty.
+ */
+APR_DECLARE(void *) apr_heap_peek(const apr_heap_t *heap);
+
+/**
+ * Remove the first element of a heap.
+ * @param heap The heap
+ * @return The element, or NULL if the heap is empty.
+ * @remark The order in which the elements of the same priority come out
+ *         is unspecified.
+ * @remark The handle of the element, if any, is no longer valid.
+ */
+APR_DECLARE(void *) apr_heap_pop(apr_heap_t *heap);
+
+/**
+ * Move an element of a heap to its place after its priority changed
+ * (decreased or increased).
+ * @param heap The heap
+ * @param node The handle of the element
+ */
+APR_DECLARE(void) apr_heap_update(apr_heap_t *heap, apr_heap_node_t *node);
+
+/**
+ * Remove an element from a heap.
+ * @param heap The heap
+ * @param node The handle of the element, which is no longer valid.
+ * @return The element.
+ */
+APR_DECLARE(void *) apr_heap_remove(apr_heap_t *heap, apr_heap_node_t *node);
+
+/**
+ * Get the number of elements in a heap.
+ * @param heap The heap
+ * @return The number of elements.
+ */
+APR_DECLARE(apr_size_t) apr_heap_size(const apr_heap_t *heap);
+
+/**
+ * Remove all the elements from a heap.
+ * @param heap The heap
+ * @remark The handles of the elements are no longer valid.
+ */
+APR_DECLARE(void) apr_heap_clear(apr_heap_t *heap);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* !APR_HEAP_H */
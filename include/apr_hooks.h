@@ -110,6 +110,53 @@ extern "C" {
 
 /** @} */
 
+/**
+ * The generic type of the functions in a frozen hook.
+ */
+typedef void apr_hook_fn_t(void);
+
+/**
+ * The profile of a hooked function, @see apr_hook_profile_enabled
+ */
+typedef struct apr_hook_profile_t {
+    /** The name of the hook */
+    const char *hook;
+    /** The value of apr_hook_debug_current when the function was hooked */
+    const char *module;
+    /** The hooked function */
+    apr_hook_fn_t *func;
+    /** Number of calls */
+    apr_uint64_t calls;
+    /** Time spent in the calls, in nanoseconds */
+    apr_uint64_t total_ns;
+    /** Longest call, in nanoseconds */
+    apr_uint64_t max_ns;
+} apr_hook_profile_t;
+
+/**
+ * An entry of a frozen hook, the last one having a NULL pFunc.
+ * @see apr_hook_freeze()
+ */
+typedef struct apr_hook_frozen_t {
+    /** The hook function, to be cast to the hook's type */
+    apr_hook_fn_t *pFunc;
+    /** The value of apr_hook_debug_current when it was hooked */
+    const char *szName;
+    /** Where the calls are accounted when profiling */
+    apr_hook_profile_t *pProfile;
+} apr_hook_frozen_t;
+
+/** internal implementation detail to time the hook functions when
+ * apr_hook_profile_enabled is set
+ */
+#define APR_HOOK_INT_PROFILE_START(t) \
+    t=apr_hook_profile_enabled ? apr_hook_profile_clock() : 0
+/** internal implementation detail to account the call timed by
+ * APR_HOOK_INT_PROFILE_START()
+ */
+#define APR_HOOK_INT_PROFILE_END(t,pHook) \
+    if(t) apr_hook_profile_record((pHook)->pProfile,t)
+
 /** macro to return the prototype of the hook function */
 #define APR_IMPLEMENT_HOOK_GET_PROTO(ns,link,name) \
 link##_DECLARE(apr_array_header_t *) ns##_hook_get_##name(void)
@@ -137,7 +184,15 @@ static struct { members } _hooks;
 
 /** macro to link the hook structure */
 #define APR_HOOK_LINK(name) \
-    apr_array_header_t *link_##name;
+    apr_array_header_t *link_##name; \
+    const apr_hook_frozen_t *frozen_##name;
+
+/**
+ * macro to tell whether no function is hooked, usable in the file that
+ * implements the hook
+ */
+#define APR_HOOK_IS_EMPTY(name) \
+    (!_hooks.frozen_##name || !_hooks.frozen_##name->pFunc)
 
 /** macro to implement the hook */
 #define APR_IMPLEMENT_EXTERNAL_HOOK_BASE(ns,link,name) \
@@ -148,7 +203,8 @@ link##_DECLARE(void) ns##_hook_##name(ns##_HOOK_##name##_t *pf,const char * cons
     if(!_hooks.link_##name) \
     { \
         _hooks.link_##name=apr_array_make(apr_hook_global_pool,1,sizeof(ns##_LINK_##name##_t)); \
-        apr_hook_sort_register(#name,&_hooks.link_##name); \
+        apr_hook_sort_register_frozen(#name,&_hooks.link_##name, \
+                                      &_hooks.frozen_##name); \
     } \
     pHook=apr_array_push(_hooks.link_##name); \
     pHook->pFunc=pf; \
@@ -156,6 +212,7 @@ link##_DECLARE(void) ns##_hook_##name(ns##_HOOK_##name##_t *pf,const char * cons
     pHook->aszSuccessors=aszSucc; \
     pHook->nOrder=nOrder; \
     pHook->szName=apr_hook_debug_current; \
+    _hooks.frozen_##name=apr_hook_freeze(#name,_hooks.link_##name); \
     if(apr_hook_debug_enabled) \
         apr_hook_debug_show(#name,aszPre,aszSucc); \
     } \
@@ -180,20 +237,21 @@ link##_DECLARE(void) ns##_hook_##name(ns##_HOOK_##name##_t *pf,const char * cons
 APR_IMPLEMENT_EXTERNAL_HOOK_BASE(ns,link,name) \
 link##_DECLARE(void) ns##_run_##name args_decl \
     { \
-    ns##_LINK_##name##_t *pHook; \
-    int n; \
+    const apr_hook_frozen_t *pHook; \
+    apr_uint64_t tHook; \
     APR_HOOK_INT_DCL_UD; \
 \
     APR_HOOK_PROBE_ENTRY(ud, ns, name, args_use); \
 \
-    if(_hooks.link_##name) \
+    if((pHook=_hooks.frozen_##name) != NULL) \
         { \
-        pHook=(ns##_LINK_##name##_t *)_hooks.link_##name->elts; \
-        for(n=0 ; n < _hooks.link_##name->nelts ; ++n) \
+        for( ; pHook->pFunc ; ++pHook) \
             { \
-                APR_HOOK_PROBE_INVOKE(ud, ns, name, (char *)pHook[n].szName, args_use); \
-                pHook[n].pFunc args_use; \
-                APR_HOOK_PROBE_COMPLETE(ud, ns, name, (char *)pHook[n].szName, 0, args_use); \
+                APR_HOOK_PROBE_INVOKE(ud, ns, name, (char *)pHook->szName, args_use); \
+                APR_HOOK_INT_PROFILE_START(tHook); \
+                ((ns##_HOOK_##name##_t *)pHook->pFunc) args_use; \
+                APR_HOOK_INT_PROFILE_END(tHook, pHook); \
+                APR_HOOK_PROBE_COMPLETE(ud, ns, name, (char *)pHook->szName, 0, args_use); \
             } \
         } \
 \
@@ -223,21 +281,22 @@ link##_DECLARE(void) ns##_run_##name args_decl \
 APR_IMPLEMENT_EXTERNAL_HOOK_BASE(ns,link,name) \
 link##_DECLARE(ret) ns##_run_##name args_decl \
     { \
-    ns##_LINK_##name##_t *pHook; \
-    int n; \
+    const apr_hook_frozen_t *pHook; \
+    apr_uint64_t tHook; \
     ret rv = ok; \
     APR_HOOK_INT_DCL_UD; \
 \
     APR_HOOK_PROBE_ENTRY(ud, ns, name, args_use); \
 \
-    if(_hooks.link_##name) \
+    if((pHook=_hooks.frozen_##name) != NULL) \
         { \
-        pHook=(ns##_LINK_##name##_t *)_hooks.link_##name->elts; \
-        for(n=0 ; n < _hooks.link_##name->nelts ; ++n) \
+        for( ; pHook->pFunc ; ++pHook) \
             { \
-            APR_HOOK_PROBE_INVOKE(ud, ns, name, (char *)pHook[n].szName, args_use); \
-            rv=pHook[n].pFunc args_use; \
-            APR_HOOK_PROBE_COMPLETE(ud, ns, name, (char *)pHook[n].szName, rv, args_use); \
+            APR_HOOK_PROBE_INVOKE(ud, ns, name, (char *)pHook->szName, args_use); \
+            APR_HOOK_INT_PROFILE_START(tHook); \
+            rv=((ns##_HOOK_##name##_t *)pHook->pFunc) args_use; \
+            APR_HOOK_INT_PROFILE_END(tHook, pHook); \
+            APR_HOOK_PROBE_COMPLETE(ud, ns, name, (char *)pHook->szName, rv, args_use); \
             if(rv != ok && rv != decline) \
                 break; \
             rv = ok; \
@@ -268,21 +327,22 @@ link##_DECLARE(ret) ns##_run_##name args_decl \
 APR_IMPLEMENT_EXTERNAL_HOOK_BASE(ns,link,name) \
 link##_DECLARE(ret) ns##_run_##name args_decl \
     { \
-    ns##_LINK_##name##_t *pHook; \
-    int n; \
+    const apr_hook_frozen_t *pHook; \
+    apr_uint64_t tHook; \
     ret rv = decline; \
     APR_HOOK_INT_DCL_UD; \
 \
     APR_HOOK_PROBE_ENTRY(ud, ns, name, args_use); \
 \
-    if(_hooks.link_##name) \
+    if((pHook=_hooks.frozen_##name) != NULL) \
         { \
-        pHook=(ns##_LINK_##name##_t *)_hooks.link_##name->elts; \
-        for(n=0 ; n < _hooks.link_##name->nelts ; ++n) \
+        for( ; pHook->pFunc ; ++pHook) \
             { \
-            APR_HOOK_PROBE_INVOKE(ud, ns, name, (char *)pHook[n].szName, args_use); \
-            rv=pHook[n].pFunc args_use; \
-            APR_HOOK_PROBE_COMPLETE(ud, ns, name, (char *)pHook[n].szName, rv, args_use); \
+            APR_HOOK_PROBE_INVOKE(ud, ns, name, (char *)pHook->szName, args_use); \
+            APR_HOOK_INT_PROFILE_START(tHook); \
+            rv=((ns##_HOOK_##name##_t *)pHook->pFunc) args_use; \
+            APR_HOOK_INT_PROFILE_END(tHook, pHook); \
+            APR_HOOK_PROBE_COMPLETE(ud, ns, name, (char *)pHook->szName, rv, args_use); \
 \
             if(rv != decline) \
                 break; \
@@ -329,6 +389,80 @@ APR_DECLARE_DATA extern const char *apr_hook_debug_current;
  */
 APR_DECLARE(void) apr_hook_sort_register(const char *szHookName,
                                         apr_array_header_t **aHooks);
+
+/**
+ * Register a hook function to be sorted, and frozen once sorted.
+ * @param szHookName The name of the Hook the function is registered for
+ * @param aHooks The array which stores all of the functions for this hook
+ * @param aFrozen Where to store the functions for this hook as returned
+ * by apr_hook_freeze(), after apr_hook_sort_all()
+ */
+APR_DECLARE(void) apr_hook_sort_register_frozen(const char *szHookName,
+                                               apr_array_header_t **aHooks,
+                                               const apr_hook_frozen_t **aFrozen);
+
+/**
+ * Copy the functions of a hook into a contiguous, cache line aligned
+ * vector, which is what the hook's run function walks.
+ * @param szHookName The name of the Hook, for the profiles
+ * @param aHooks The array which stores all of the functions for this hook
+ * @return The vector, terminated by an entry with a NULL pFunc
+ * @note The vector is allocated from apr_hook_global_pool, and must not
+ * be modified; the hook implementation macros freeze the hook again
+ * whenever a function is added.
+ */
+APR_DECLARE(const apr_hook_frozen_t *) apr_hook_freeze(const char *szHookName,
+                                                       const apr_array_header_t *aHooks);
+
+/**
+ * A global variable to turn the profiling of the hook functions on (when
+ * non-zero) or off, recording the number of calls and their durations
+ * per hooked function.
+ * @remark Turning it off keeps the profiles recorded so far.
+ * @see apr_hook_profile_do()
+ */
+APR_DECLARE_DATA extern int apr_hook_profile_enabled;
+
+/**
+ * Callback for apr_hook_profile_do()
+ * @param baton The baton given to apr_hook_profile_do()
+ * @param profile The profile of a hooked function
+ * @return Non-zero to continue, zero to stop the iteration
+ */
+typedef int (apr_hook_profile_cb_t)(void *baton,
+                                    const apr_hook_profile_t *profile);
+
+/**
+ * Iterate over the profiles of the hooked functions, by decreasing time
+ * spent in the calls.
+ * @param cb The callback run for each profile
+ * @param baton The baton passed to @a cb
+ * @return Zero if the iteration was stopped by @a cb (or could not be
+ *         run), non-zero otherwise.
+ * @remark @a cb is run on a snapshot of the profiles.
+ * @remark The functions hooked again after apr_hook_deregister_all() get
+ *         new profiles.
+ */
+APR_DECLARE(int) apr_hook_profile_do(apr_hook_profile_cb_t *cb, void *baton);
+
+/**
+ * Forget the calls recorded so far by the profiles.
+ */
+APR_DECLARE(void) apr_hook_profile_reset(void);
+
+/**
+ * Internal to the hook implementation macros
+ * @return The current time in nanoseconds, from a monotonic clock
+ */
+APR_DECLARE(apr_uint64_t) apr_hook_profile_clock(void);
+
+/**
+ * Internal to the hook implementation macros, account a call
+ * @param profile The profile of the called function
+ * @param start The value of apr_hook_profile_clock() before the call
+ */
+APR_DECLARE(void) apr_hook_profile_record(apr_hook_profile_t *profile,
+                                          apr_uint64_t start);
 /**
  * Sort all of the registered functions for a given hook.
  */
@@ -455,6 +455,11 @@ extern "C" {
  */
 typedef struct apr_jose_t apr_jose_t;
 
+/**
+ * Opaque cache of the verified signatures, see apr_jose_decode_cached().
+ */
+typedef struct apr_jose_cache_t apr_jose_cache_t;
+
 /**
  * Enum that represents the type of JOSE object.
  */
@@ -1162,6 +1167,74 @@ APR_DECLARE(apr_status_t) apr_jose_decode(apr_jose_t **jose, const char *typ,
         apr_pool_t *pool)
         __attribute__((nonnull(1, 3, 7)));
 
+/**
+ * Create a cache of the verified signatures of compact JWS/JWT, for
+ * apr_jose_decode_cached().
+ *
+ * The tokens are identified by the SHA-256 of their whole compact
+ * serialization, and kept until their "exp" (Expiration Time) claim, or
+ * until another token takes their place; tokens with no "exp" claim are
+ * never cached. The cache can be shared by multiple threads.
+ * @param cache The cache created.
+ * @param max The number of tokens in the cache (rounded up to a power of
+ *   two).
+ * @param pool The pool to allocate the cache from.
+ * @return APR_SUCCESS, or APR_EINVAL if max is zero or too large.
+ */
+APR_DECLARE(apr_status_t) apr_jose_cache_create(apr_jose_cache_t **cache,
+        apr_size_t max, apr_pool_t *pool)
+        __attribute__((nonnull(1, 3)));
+
+/**
+ * Forget all the verified signatures, e.g. after the keys known to the
+ * verify callback have changed.
+ * @param cache The cache.
+ */
+APR_DECLARE(void) apr_jose_cache_clear(apr_jose_cache_t *cache)
+        __attribute__((nonnull(1)));
+
+/**
+ * Decode, decrypt and verify the utf8-encoded JOSE string into apr_jose_t,
+ * like apr_jose_decode(), but without calling the verify callback again
+ * for a compact JWS/JWT whose signature was verified already and has not
+ * expired.
+ *
+ * The payload is always decoded, and the returned claims still need to be
+ * validated by the caller.
+ * @param jose If jose points at NULL, a JOSE structure will be
+ *   created. If the jose pointer is not NULL, the structure will
+ *   be reused.
+ * @param typ content type of this object.
+ * @param brigade the JOSE structure to decode.
+ * @param cb callbacks for verify and decrypt.
+ * @param cache the cache of the verified signatures.
+ * @param level depth limit of JOSE and JSON nesting.
+ * @param flags APR_JOSE_FLAG_NONE to return payload only. APR_JOSE_FLAG_DECODE_ALL
+ *   to return the full JWS/JWE structure.
+ * @param pool pool used to allocate the result from.
+ */
+APR_DECLARE(apr_status_t) apr_jose_decode_cached(apr_jose_t **jose,
+        const char *typ, apr_bucket_brigade *brigade, apr_jose_cb_t *cb,
+        apr_jose_cache_t *cache, int level, int flags, apr_pool_t *pool)
+        __attribute__((nonnull(1, 3, 5, 8)));
+
+/**
+ * Decode the "alg" and "kid" Header Parameters of a compact JWS/JWE only,
+ * so that a token with an unsupported algorithm or an unknown key can be
+ * rejected before its payload is decoded and its signature verified.
+ *
+ * Nothing is verified here, the token still needs apr_jose_decode().
+ * @param alg The algorithm is returned here.
+ * @param kid The key ID is returned here, NULL if missing. May be NULL.
+ * @param brigade the compact JOSE structure.
+ * @param pool pool used to allocate the result from.
+ * @return APR_SUCCESS, APR_BADCH if the header is not valid base64url, or
+ *   APR_EINVAL if it is not a JSON object with an "alg" string.
+ */
+APR_DECLARE(apr_status_t) apr_jose_decode_alg(const char **alg,
+        const char **kid, apr_bucket_brigade *brigade, apr_pool_t *pool)
+        __attribute__((nonnull(1, 3, 4)));
+
 
 #ifdef __cplusplus
 }
@@ -82,6 +82,11 @@ extern "C" {
  */
 #define APR_JSON_FLAGS_STRICT 2
 
+/**
+ * Flag indicating decode strings in place, in the JSON text.
+ */
+#define APR_JSON_FLAGS_INSITU 4
+
 /**
  * A structure to hold a JSON object.
  */
@@ -168,8 +173,13 @@ typedef struct apr_json_kv_t {
 struct apr_json_object_t {
     /** The key value pairs in the object are in this list */
     APR_RING_HEAD(apr_json_object_list_t, apr_json_kv_t) list;
-    /** JSON object */
+    /** Index of the key value pairs, NULL until the object has more than
+     *  a few of them, searched linearly in the list until then */
     apr_hash_t *hash;
+    /** The number of key value pairs in the list */
+    apr_size_t count;
+    /** The pool to allocate the index from */
+    apr_pool_t *pool;
 };
 
 /**
@@ -390,19 +400,160 @@ APR_DECLARE(apr_json_value_t *) apr_json_array_next(const apr_json_value_t *arr,
  * @param size length of the input string.
  * @param offset number of characters processed.
  * @param flags set to APR_JSON_FLAGS_WHITESPACE to preserve whitespace,
- *   or APR_JSON_FLAGS_NONE to filter whitespace.
+ *   or APR_JSON_FLAGS_NONE to filter whitespace. Add APR_JSON_FLAGS_INSITU
+ *   to unescape the strings in place rather than copying them, the strings
+ *   then pointing into the JSON text.
  * @param level maximum nesting level we are prepared to decode.
  * @param pool pool used to allocate the result from.
  * @return APR_SUCCESS on success, APR_EOF if the JSON text is truncated.
  *   APR_BADCH when a decoding error has occurred (the location of the error
  *   is at offset), APR_EINVAL if the level has been exceeded, or
  *   APR_ENOTIMPL on platforms where not implemented.
+ * @remark With APR_JSON_FLAGS_INSITU, the JSON text must be writable and
+ *   live as long as the result. It is overwritten, also on error, and
+ *   can not be decoded again.
  */
 APR_DECLARE(apr_status_t) apr_json_decode(apr_json_value_t ** retval,
         const char *injson, apr_ssize_t size, apr_off_t * offset,
         int flags, int level, apr_pool_t * pool)
         __attribute__((nonnull(1, 2, 7)));
 
+/**
+ * Decode only the values at the given RFC 6901 JSON pointers from a
+ * JSON text.
+ *
+ * The text is checked as apr_json_decode() does, but only the values
+ * pointed to are decoded and allocated. The other values are skipped once
+ * their structure has been checked.
+ *
+ * @param results the values decoded, one per pointer, NULL where absent.
+ * @param injson utf8-encoded JSON string.
+ * @param size length of the input string.
+ * @param offset number of characters processed.
+ * @param paths the JSON pointers, such as "/header/alg" or "/items/0",
+ *   "" for the whole text.
+ * @param npaths the number of pointers.
+ * @param flags set to APR_JSON_FLAGS_WHITESPACE to preserve whitespace,
+ *   or APR_JSON_FLAGS_NONE to filter whitespace, as apr_json_decode().
+ * @param level maximum nesting level we are prepared to decode.
+ * @param pool pool used to allocate the result from.
+ * @return APR_SUCCESS on success, APR_EINVAL if a pointer is invalid, or
+ *   as apr_json_decode().
+ * @remark As apr_json_decode() does, later duplicate keys replace the
+ *   earlier ones.
+ */
+APR_DECLARE(apr_status_t) apr_json_extract(apr_json_value_t **results,
+        const char *injson, apr_ssize_t size, apr_off_t * offset,
+        const char * const *paths, int npaths, int flags, int level,
+        apr_pool_t * pool) __attribute__((nonnull(1, 2, 5, 9)));
+
+/**
+ * A JSON pull reader, decoding a stream of JSON text one token at a time.
+ */
+typedef struct apr_json_reader_t apr_json_reader_t;
+
+/**
+ * Enum that represents the type of a token returned by a JSON reader.
+ */
+typedef enum apr_json_token_e {
+    /** The start of an object, '{' */
+    APR_JSON_TOKEN_OBJECT_START,
+    /** The end of an object, '}' */
+    APR_JSON_TOKEN_OBJECT_END,
+    /** The start of an array, '[' */
+    APR_JSON_TOKEN_ARRAY_START,
+    /** The end of an array, ']' */
+    APR_JSON_TOKEN_ARRAY_END,
+    /** An object key, always a string value */
+    APR_JSON_TOKEN_KEY,
+    /** A string, number, boolean or null value */
+    APR_JSON_TOKEN_VALUE
+} apr_json_token_e;
+
+/**
+ * A structure to hold a token returned by a JSON reader.
+ */
+typedef struct apr_json_token_t {
+    /** The type of the token */
+    apr_json_token_e type;
+    /** The nesting level of the token, zero at the top level. The start
+     *  and end of a container have the level of the container itself */
+    int level;
+    /** The key or value, for APR_JSON_TOKEN_KEY and APR_JSON_TOKEN_VALUE.
+     *  Strings are valid until the next call to apr_json_reader_next() */
+    apr_json_value_t value;
+} apr_json_token_t;
+
+/**
+ * Create a JSON pull reader.
+ *
+ * The input is passed in pieces with apr_json_reader_write() or
+ * apr_json_reader_brigade(), and only the part of it holding the token
+ * being decoded is kept, so that a long stream of values such as an
+ * array or newline delimited JSON is decoded in constant memory. The
+ * text may contain any number of top level values.
+ * @param reader The reader created.
+ * @param level maximum nesting level we are prepared to decode.
+ * @param pool pool used to allocate the reader from.
+ * @return APR_SUCCESS on success, or APR_ENOTIMPL on platforms where not
+ *   implemented.
+ */
+APR_DECLARE(apr_status_t) apr_json_reader_create(apr_json_reader_t **reader,
+        int level, apr_pool_t *pool) __attribute__((nonnull(1, 3)));
+
+/**
+ * Pass more JSON text to a reader.
+ * @param reader The JSON reader.
+ * @param buf The text, copied as needed.
+ * @param len The length of the text.
+ * @return APR_SUCCESS, or APR_EOF once apr_json_reader_eos() was called.
+ */
+APR_DECLARE(apr_status_t) apr_json_reader_write(apr_json_reader_t *reader,
+        const char *buf, apr_size_t len) __attribute__((nonnull(1)));
+
+/**
+ * Mark the end of the JSON text passed to a reader.
+ * @param reader The JSON reader.
+ */
+APR_DECLARE(void) apr_json_reader_eos(apr_json_reader_t *reader)
+        __attribute__((nonnull(1)));
+
+/**
+ * Read the JSON text from a brigade, as the tokens need it.
+ *
+ * Once the text passed to the reader is used up, apr_json_reader_next()
+ * reads and deletes the buckets at the head of the brigade one at a
+ * time, blocking if needed, and an EOS bucket marks the end of the text.
+ * More buckets may be added to the brigade later on.
+ * @param reader The JSON reader.
+ * @param bb The brigade to read from, or NULL to stop reading from it.
+ */
+APR_DECLARE(void) apr_json_reader_brigade(apr_json_reader_t *reader,
+        apr_bucket_brigade *bb) __attribute__((nonnull(1)));
+
+/**
+ * Decode the next token from a JSON reader.
+ * @param reader The JSON reader.
+ * @param token The token decoded.
+ * @return APR_SUCCESS on success, APR_EAGAIN if more text is needed to
+ *   decode the token, APR_EOF at the end of the text after a complete top
+ *   level value, APR_INCOMPLETE if the text ends within a value, APR_BADCH
+ *   when a decoding error has occurred (the location of the error is at
+ *   apr_json_reader_offset()), or APR_EINVAL if the level has been
+ *   exceeded. Other errors are those reading from the brigade. Errors
+ *   are final, returned again by later calls.
+ */
+APR_DECLARE(apr_status_t) apr_json_reader_next(apr_json_reader_t *reader,
+        apr_json_token_t *token) __attribute__((nonnull(1, 2)));
+
+/**
+ * Return the number of characters a JSON reader decoded so far.
+ * @param reader The JSON reader.
+ * @return The offset in the JSON text, of the error if any.
+ */
+APR_DECLARE(apr_off_t) apr_json_reader_offset(const apr_json_reader_t *reader)
+        __attribute__((nonnull(1)));
+
 /**
  * Encode data represented as apr_json_value_t to utf8-encoded JSON string
  * and append it to the specified brigade.
@@ -411,6 +562,9 @@ APR_DECLARE(apr_status_t) apr_json_decode(apr_json_value_t ** retval,
  * and if found invalid sequences are replaced with the replacement
  * character "�" (U+FFFD).
  *
+ * The result is appended as one heap bucket or, with a flush function,
+ * as a few large ones passed to it along the way.
+ *
  * @param brigade brigade the result will be appended to.
  * @param flush optional flush function for the brigade. Can be NULL.
  * @param ctx optional contaxt for the flush function. Can be NULL.
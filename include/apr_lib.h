@@ -27,6 +27,7 @@
 
 #include "apr.h"
 #include "apr_errno.h"
+#include "apr_pools.h"
 
 #if APR_HAVE_CTYPE_H
 #include <ctype.h>
@@ -175,6 +176,32 @@ APR_DECLARE(int) apr_vformatter(int (*flush_func)(apr_vformatter_buff_t *b),
 			        apr_vformatter_buff_t *c, const char *fmt,
 			        va_list ap);
 
+/** @see apr_format_compile */
+typedef struct apr_format_t apr_format_t;
+
+/**
+ * Compile a format for apr_format_vformatter() and the like, which then
+ * need not parse it again
+ * @param p The pool from which to allocate the compiled format
+ * @param fmt The format, see apr_vformatter()
+ * @return The compiled format
+ */
+APR_DECLARE(const apr_format_t *) apr_format_compile(apr_pool_t *p,
+                                                     const char *fmt);
+
+/**
+ * apr_vformatter() with a compiled format
+ * @param flush_func The function to call when the buffer is full
+ * @param c The buffer to write to
+ * @param format The format compiled by apr_format_compile()
+ * @param ap The arguments to use to fill out the format
+ * @return The number of characters written, or -1, like apr_vformatter()
+ */
+APR_DECLARE(int) apr_format_vformatter(int (*flush_func)(apr_vformatter_buff_t *b),
+                                       apr_vformatter_buff_t *c,
+                                       const apr_format_t *format,
+                                       va_list ap);
+
 /**
  * Display a prompt and read in the password from stdin.
  * @param prompt The prompt to display
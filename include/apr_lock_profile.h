@@ -0,0 +1,131 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_LOCK_PROFILE_H
+#define APR_LOCK_PROFILE_H
+
+/**
+ * @file apr_lock_profile.h
+ * @brief APR Lock Contention Profiling
+ */
+
+#include "apr.h"
+#include "apr_pools.h"
+#include "apr_errno.h"
+#include "apr_tables.h"
+#include "apr_time.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * @defgroup apr_lock_profile Lock Contention Profiling
+ * @ingroup APR
+ * @{
+ *
+ * The locks tagged with apr_thread_mutex_tag(), apr_thread_rwlock_tag(),
+ * apr_proc_mutex_tag(), apr_global_mutex_tag() or apr_proc_rwlock_tag()
+ * are profiled while profiling is started with apr_lock_profile_set(), and
+ * untagged locks never are.  When stopped, profiling costs a test per
+ * lock operation, and nothing at all if APR was configured with
+ * --disable-lock-profile (APR_HAS_LOCK_PROFILE is 0 then).
+ *
+ * A contended acquisition is detected by a failed non-blocking attempt
+ * before the blocking one, and its wait time measured around the latter.
+ * The counters are kept in the memory of each process, including for the
+ * process locks.
+ */
+
+/** The lock types which can be profiled */
+typedef enum {
+    APR_LOCK_PROFILE_THREAD_MUTEX,  /**< apr_thread_mutex_t */
+    APR_LOCK_PROFILE_THREAD_RWLOCK, /**< apr_thread_rwlock_t */
+    APR_LOCK_PROFILE_PROC_MUTEX,    /**< apr_proc_mutex_t */
+    APR_LOCK_PROFILE_GLOBAL_MUTEX,  /**< apr_global_mutex_t */
+    APR_LOCK_PROFILE_PROC_RWLOCK    /**< apr_proc_rwlock_t */
+} apr_lock_profile_type_e;
+
+/** The profile of a tagged lock */
+typedef struct apr_lock_profile_t {
+    /** The tag of the lock */
+    const char *tag;
+    /** The type of the lock */
+    apr_lock_profile_type_e type;
+    /** Number of successful acquisitions */
+    apr_uint64_t acquired;
+    /** Number of acquisitions (successful or timed out) which waited */
+    apr_uint64_t contended;
+    /** Total time spent waiting for the lock */
+    apr_interval_time_t wait_time;
+    /** Longest single wait for the lock */
+    apr_interval_time_t max_wait_time;
+    /** Total time the lock was held exclusively (mutexes and writers) */
+    apr_interval_time_t hold_time;
+} apr_lock_profile_t;
+
+/**
+ * Start or stop profiling the tagged locks, process wide.
+ * @param enabled Non-zero to start profiling, zero to stop.
+ * @return APR_SUCCESS, or APR_ENOTIMPL if APR_HAS_LOCK_PROFILE is 0.
+ * @remark Profiling is stopped initially, and stopping it keeps the
+ *         profiles recorded so far.
+ */
+APR_DECLARE(apr_status_t) apr_lock_profile_set(int enabled);
+
+/**
+ * Reset the profiles of all the tagged locks.
+ */
+APR_DECLARE(void) apr_lock_profile_reset(void);
+
+/**
+ * Callback for apr_lock_profile_do()
+ * @param baton The baton given to apr_lock_profile_do()
+ * @param profile The profile of a lock
+ * @return Non-zero to continue, zero to stop the iteration
+ */
+typedef int (apr_lock_profile_cb_t)(void *baton,
+                                    const apr_lock_profile_t *profile);
+
+/**
+ * Iterate over the profiles of the tagged locks.
+ * @param cb The callback run for each profile
+ * @param baton The baton passed to @a cb
+ * @return Zero if the iteration was stopped by @a cb (or could not be
+ *         run), non-zero otherwise.
+ * @remark @a cb is run on a snapshot of the profiles, thus can use the
+ *         locks.
+ */
+APR_DECLARE(int) apr_lock_profile_do(apr_lock_profile_cb_t *cb, void *baton);
+
+/**
+ * Snapshot the profiles of the tagged locks.
+ * @param profiles The array of the apr_lock_profile_t, allocated from
+ *        @a pool.
+ * @param pool The pool to allocate from.
+ * @return APR_SUCCESS, or APR_ENOTIMPL if APR_HAS_LOCK_PROFILE is 0.
+ */
+APR_DECLARE(apr_status_t) apr_lock_profile_snapshot(
+                                              apr_array_header_t **profiles,
+                                              apr_pool_t *pool);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* ! APR_LOCK_PROFILE_H */
@@ -49,6 +49,7 @@
 
 #include "apu.h"
 #include "apr_xlate.h"
+#include "apr_time.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -129,6 +130,21 @@ APR_DECLARE(apr_status_t) apr_md5(unsigned char digest[APR_MD5_DIGESTSIZE],
                                   const void *input,
                                   apr_size_t inputLen);
 
+/**
+ * MD5 of several independent messages at once
+ * @param digests The final MD5 digests, one for each message
+ * @param inputs The messages
+ * @param lens The lengths of the messages
+ * @param n The number of messages
+ * @remark As with apr_md5(), the messages are hashed without any
+ * character set conversion.  Where the compiler supports it, the
+ * messages are hashed eight at a time in vector lanes, so messages of
+ * similar lengths are best passed together.
+ */
+APR_DECLARE(apr_status_t) apr_md5_multi(unsigned char (*digests)[APR_MD5_DIGESTSIZE],
+                                        const void *const *inputs,
+                                        const apr_size_t *lens, int n);
+
 /**
  * Encode a password using an MD5 algorithm
  * @param pw The password to encode
@@ -167,6 +183,44 @@ APR_DECLARE(apr_status_t) apr_bcrypt_encode(const char *pw,
 APR_DECLARE(apr_status_t) apr_password_validate(const char *passwd,
                                                 const char *hash);
 
+/** @see apr_password_cache_create */
+typedef struct apr_password_cache_t apr_password_cache_t;
+
+/**
+ * Create a cache of the successful apr_password_validate() results, for
+ * the same passwords validated repeatedly against expensive hashes (e.g.
+ * bcrypt for each request with basic authentication).
+ * @param cache The new cache
+ * @param size The number of results kept, the least recently used being
+ *        replaced first
+ * @param ttl How long a result is kept at most, which must be positive
+ * @param p The pool to allocate the cache from
+ * @return APR_EINVAL if size or ttl is not positive, APR_ENOTIMPL if
+ *         random bytes cannot be generated on this platform
+ * @remark The passwords are not kept but authenticated with SipHash-2-4
+ *         (128 bits) under random keys of the cache, and the results are
+ *         wiped when replaced or when the pool is cleaned up.
+ * @remark The cache is not thread safe, each thread should have its own.
+ */
+APR_DECLARE(apr_status_t) apr_password_cache_create(
+                                                apr_password_cache_t **cache,
+                                                int size,
+                                                apr_interval_time_t ttl,
+                                                apr_pool_t *p);
+
+/**
+ * Validate a password like apr_password_validate(), but looking up a
+ * previous success with the same password and hash in a cache first.
+ * @param cache The cache created by apr_password_cache_create()
+ * @param passwd The password to validate
+ * @param hash The password to validate against
+ * @remark A password which does not match is always validated again.
+ */
+APR_DECLARE(apr_status_t) apr_password_validate_cached(
+                                                apr_password_cache_t *cache,
+                                                const char *passwd,
+                                                const char *hash);
+
 
 /** @} */
 #ifdef __cplusplus
@@ -55,6 +55,12 @@ typedef enum
 /** Opaque memcache client connection object */
 typedef struct apr_memcache_conn_t apr_memcache_conn_t;
 
+/** Opaque client side metrics of a server, see apr_memcache_server_metrics() */
+typedef struct apr_memcache_counters_t apr_memcache_counters_t;
+
+/** Opaque background prober of the dead servers */
+typedef struct apr_memcache_prober_t apr_memcache_prober_t;
+
 /** Memcache Server Info Object */
 typedef struct apr_memcache_server_t apr_memcache_server_t;
 struct apr_memcache_server_t
@@ -71,7 +77,9 @@ struct apr_memcache_server_t
 #if APR_HAS_THREADS
     apr_thread_mutex_t *lock;
 #endif
-    apr_time_t btime;
+    apr_time_t btime; /**< Last death or retry, apr_time_monotonic() */
+    apr_uint32_t weight; /**< Share of the keys on a ketama ring, 1 by default */
+    apr_memcache_counters_t *counters; /**< Client side metrics */
 };
 
 /* Custom hash callback function prototype, user for server selection.
@@ -85,6 +93,27 @@ typedef apr_uint32_t (*apr_memcache_hash_func)(void *baton,
 
 typedef struct apr_memcache_t apr_memcache_t;
 
+/** Opaque ketama ring of the servers */
+typedef struct apr_memcache_ring_t apr_memcache_ring_t;
+
+/** Opaque in-process cache of the values */
+typedef struct apr_memcache_near_cache_t apr_memcache_near_cache_t;
+
+/** Opaque reusable states of apr_memcache_multgetp() */
+typedef struct apr_memcache_mget_cache_t apr_memcache_mget_cache_t;
+
+/**
+ * apr_memcache_create() flag: select the servers on a ketama ring
+ * @see apr_memcache_find_server_hash_ketama
+ */
+#define APR_MC_FLAG_KETAMA 0x1
+
+/**
+ * apr_memcache_create() flag: select the servers with the jump hash
+ * @see apr_memcache_find_server_hash_jump
+ */
+#define APR_MC_FLAG_JUMP   0x2
+
 /* Custom Server Select callback function prototype.
 * @param baton user selected baton
 * @param mc memcache instance, use mc->live_servers to select a node
@@ -94,10 +123,37 @@ typedef apr_memcache_server_t* (*apr_memcache_server_func)(void *baton,
                                                  apr_memcache_t *mc,
                                                  const apr_uint32_t hash);
 
+/**
+ * server selection on a ketama ring: each server owns 160 points per unit
+ * of weight on a circle of hashes, and a key goes to the owner of the
+ * first point at or after its hash.  Adding or removing a server only
+ * moves the keys of its own points, and a dead server's keys go to the
+ * owners of the next points.
+ * @remark The ring is built by apr_memcache_add_server() on the client
+ *         objects created with APR_MC_FLAG_KETAMA, NULL is returned for
+ *         the others.
+ */
+APR_DECLARE(apr_memcache_server_t *)
+apr_memcache_find_server_hash_ketama(void *baton,
+                                     apr_memcache_t *mc,
+                                     const apr_uint32_t hash);
+
+/**
+ * server selection with the jump consistent hash: growing the servers
+ * from n to n + 1 only moves the keys going to the new server.
+ * @remark Servers can only be added or removed at the end of the list,
+ *         and the weights are ignored.  A dead server's keys go to the
+ *         next live server.
+ */
+APR_DECLARE(apr_memcache_server_t *)
+apr_memcache_find_server_hash_jump(void *baton,
+                                   apr_memcache_t *mc,
+                                   const apr_uint32_t hash);
+
 /** Container for a set of memcached servers */
 struct apr_memcache_t
 {
-    apr_uint32_t flags; /**< Flags, Not currently used */
+    apr_uint32_t flags; /**< Flags given to apr_memcache_create() */
     apr_uint16_t nalloc; /**< Number of Servers Allocated */
     apr_uint16_t ntotal; /**< Number of Servers Added */
     apr_memcache_server_t **live_servers; /**< Array of Servers */
@@ -106,6 +162,10 @@ struct apr_memcache_t
     apr_memcache_hash_func hash_func;
     void *server_baton;
     apr_memcache_server_func server_func;
+    apr_memcache_ring_t *ring; /**< Ketama ring, with APR_MC_FLAG_KETAMA */
+    apr_memcache_near_cache_t *near_cache; /**< See apr_memcache_near_cache_create() */
+    apr_memcache_prober_t *prober; /**< See apr_memcache_prober_start() */
+    apr_memcache_mget_cache_t *mget; /**< Reusable multiget states */
 };
 
 /** Returned Data from a multiple get */
@@ -227,14 +287,56 @@ APR_DECLARE(apr_status_t) apr_memcache_server_create(apr_pool_t *p,
  * Creates a new memcached client object
  * @param p Pool to use
  * @param max_servers maximum number of servers
- * @param flags Not currently used
+ * @param flags APR_MC_FLAG_KETAMA or APR_MC_FLAG_JUMP to select the
+ *        servers with a consistent hash, or 0 for the default selection
  * @param mc   location of the new memcache client object
+ * @remark With a consistent hash, the keys are hashed with the pure crc32
+ *         hash by default.  A custom hash_func or server_func set
+ *         afterwards still takes precedence.
  */
 APR_DECLARE(apr_status_t) apr_memcache_create(apr_pool_t *p,
                                               apr_uint16_t max_servers,
                                               apr_uint32_t flags,
                                               apr_memcache_t **mc);
 
+/**
+ * Probe the dead servers in a background thread
+ * @param mc client to use
+ * @param interval The delay before the first probe of a server gone dead
+ * @param max_interval The maximum delay between two probes of a server,
+ *        the delay doubling after each failed probe
+ * @return APR_SUCCESS, APR_EEXIST if already started, APR_EINVAL for bad
+ *         intervals, or APR_ENOTIMPL without APR_HAS_THREADS
+ * @remark Otherwise a request finding a dead server probes it itself,
+ *         every 5 seconds, and waits for the connect timeout when it is
+ *         still dead.  With the prober started, the requests only ever
+ *         see the live or dead state of the servers.
+ * @remark The prober stops when the pool of @a mc is cleared.
+ */
+APR_DECLARE(apr_status_t) apr_memcache_prober_start(apr_memcache_t *mc,
+                                                    apr_interval_time_t interval,
+                                                    apr_interval_time_t max_interval);
+
+/**
+ * Put an in-process cache of the values in front of apr_memcache_getp()
+ * @param mc client to use
+ * @param max_items The maximum number of values kept, the least recently
+ *        used ones being evicted first
+ * @param max_size The maximum size of a value kept
+ * @param ttl How long a value is kept
+ * @remark The concurrent misses on a key are coalesced: one thread gets
+ *         the value from the server while the others wait for it.
+ * @remark The sets, adds, replaces, deletes, increments and decrements
+ *         through @a mc invalidate the values of their keys, but changes
+ *         by other clients are seen after up to @a ttl only.
+ * @remark apr_memcache_multgetp() and apr_memcache_meta_get() do not use
+ *         the cache.
+ */
+APR_DECLARE(apr_status_t) apr_memcache_near_cache_create(apr_memcache_t *mc,
+                                                         apr_uint32_t max_items,
+                                                         apr_size_t max_size,
+                                                         apr_interval_time_t ttl);
+
 /**
  * Gets a value from the server, allocating the value out of p
  * @param mc client to use
@@ -274,6 +376,8 @@ APR_DECLARE(void) apr_memcache_add_multget_key(apr_pool_t *data_pool,
  * @param values hash of apr_memcache_value_t keyed by strings, contains the
  *        result of the multiget call.
  * @return
+ * @remark The pollset and the queries are kept by @a mc for the next calls
+ *         (of any thread), rather than created for each.
  */
 APR_DECLARE(apr_status_t) apr_memcache_multgetp(apr_memcache_t *mc,
                                                 apr_pool_t *temp_pool,
@@ -434,6 +538,203 @@ APR_DECLARE(apr_status_t) apr_memcache_stats(apr_memcache_server_t *ms,
                                              apr_pool_t *p,
                                              apr_memcache_stats_t **stats);
 
+/** Number of buckets of an apr_memcache_latency_t */
+#define APR_MC_LATENCY_BUCKETS 128
+
+/**
+ * Client side latency histogram, in microseconds.
+ *
+ * The buckets are log-linear like those of HDR histograms: each power of
+ * two is split in 4 buckets of equal width, so a bucket spans a quarter
+ * of its lower bound at most.  See apr_memcache_latency_bucket_limit()
+ * for the bounds.
+ */
+typedef struct
+{
+    /** Number of latencies recorded */
+    apr_uint64_t count;
+    /** Sum of the latencies recorded */
+    apr_uint64_t sum;
+    /** Highest latency recorded */
+    apr_uint64_t max;
+    /** Number of latencies recorded per bucket */
+    apr_uint64_t buckets[APR_MC_LATENCY_BUCKETS];
+} apr_memcache_latency_t;
+
+/**
+ * Client side metrics of a server, recorded by the client itself whatever
+ * the server reports with apr_memcache_stats().
+ *
+ * The latencies of a request are measured from the acquisition of its
+ * connection: to the end of the request write (when the reply starts to
+ * be waited for), to the reception of the first reply line, and to the
+ * release of the connection.  The requests which fail on a broken
+ * connection are counted as errors, not in the histograms.
+ */
+typedef struct
+{
+    /** Number of requests (connections acquired) */
+    apr_uint64_t requests;
+    /** Number of requests failed on a connection found broken */
+    apr_uint64_t errors;
+    /** Number of connections established */
+    apr_uint64_t connects;
+    /** Number of connections which could not be established */
+    apr_uint64_t connect_errors;
+    /** Number of connections established to replace a broken one */
+    apr_uint64_t reconnects;
+    /** Number of times the server was marked dead */
+    apr_uint64_t deaths;
+    /** Total time the server was dead, including the current period */
+    apr_interval_time_t dead_time;
+    /** Time to establish a connection */
+    apr_memcache_latency_t connect;
+    /** Time to write a request */
+    apr_memcache_latency_t send;
+    /** Time to the first line of a reply */
+    apr_memcache_latency_t first_byte;
+    /** Time to complete a request */
+    apr_memcache_latency_t total;
+} apr_memcache_metrics_t;
+
+/**
+ * Read the client side metrics of a server
+ * @param ms      server to read the metrics of
+ * @param metrics location to copy the metrics to
+ * @remark The counters are updated atomically but read one by one, so
+ *         requests running concurrently may be partly accounted for.
+ */
+APR_DECLARE(apr_status_t) apr_memcache_server_metrics(apr_memcache_server_t *ms,
+                                                      apr_memcache_metrics_t *metrics);
+
+/**
+ * Reset the client side metrics of a server
+ * @param ms server to reset the metrics of
+ */
+APR_DECLARE(void) apr_memcache_server_metrics_reset(apr_memcache_server_t *ms);
+
+/**
+ * Get the (exclusive) upper bound of a latency histogram bucket
+ * @param bucket index of the bucket, below APR_MC_LATENCY_BUCKETS
+ * @return The lowest latency counted by the next bucket, or -1 for the
+ *         last bucket which counts all the higher latencies
+ */
+APR_DECLARE(apr_interval_time_t) apr_memcache_latency_bucket_limit(int bucket);
+
+/**
+ * Estimate a percentile of a latency histogram
+ * @param lat        the histogram
+ * @param percentile the percentile, between 0 and 100
+ * @return The upper bound of the bucket holding the percentile, capped by
+ *         the highest latency recorded, or 0 if nothing was recorded
+ */
+APR_DECLARE(apr_interval_time_t) apr_memcache_latency_percentile(const apr_memcache_latency_t *lat,
+                                                                 double percentile);
+
+
+/**
+ * @defgroup APR_MC_META Meta commands
+ * @{
+ *
+ * The meta commands (mg, ms and md, memcached 1.6 and later) of an array
+ * of items are pipelined per server in quiet mode: only the hits of the
+ * gets and the failures of the sets and deletes are replied to, matched
+ * with their item by an opaque token, and one round trip per server
+ * completes the whole array.
+ */
+
+/** The item should be recached by this client (W flag) */
+#define APR_MC_META_WIN   0x1
+/** The item is stale, served while being recached (X flag) */
+#define APR_MC_META_STALE 0x2
+/** Another client already won the recache of the item (Z flag) */
+#define APR_MC_META_WON   0x4
+
+/** An item of the meta commands */
+typedef struct apr_memcache_meta_t
+{
+    /** The key, null terminated */
+    const char *key;
+    /** APR_SUCCESS, APR_NOTFOUND for a miss (or the delete of none),
+     * APR_EEXIST for a set not stored (or a cas mismatch), or the error
+     * of the server of the item */
+    apr_status_t status;
+    /** The value, set or got (then allocated from the data pool) */
+    char *data;
+    /** The length of the value */
+    apr_size_t len;
+    /** The client flags, set or got */
+    apr_uint16_t flags;
+    /** The time to live to set, or the remaining one got (-1 if none) */
+    apr_int32_t ttl;
+    /** The cas value got, or compared by a set or delete if not zero */
+    apr_uint64_t cas;
+    /** For a get, create an empty item on a miss, with this time to live,
+     * and win its recache (zero to not) */
+    apr_uint32_t vivify;
+    /** For a get, win the recache of the item if its remaining time to
+     * live is lower than this (zero to not) */
+    apr_uint32_t recache;
+    /** The APR_MC_META_* state of the item got */
+    apr_uint32_t state;
+} apr_memcache_meta_t;
+
+/**
+ * Get the values of an array of items, with their client flags, time to
+ * live and cas value.
+ * @param mc client to use
+ * @param temp_pool Pool used for temporary allocations
+ * @param data_pool Pool used to allocate the values
+ * @param items The items, whose key, vivify and recache are used
+ * @param nitems The number of items
+ * @return APR_SUCCESS, or the first error of a server, the status of each
+ *         item being set anyway.
+ * @remark For stampede protection, a client getting a miss or a stale item
+ *         with APR_MC_META_WIN recaches it while the others get
+ *         APR_MC_META_WON, along with the stale value if any.
+ */
+APR_DECLARE(apr_status_t) apr_memcache_meta_get(apr_memcache_t *mc,
+                                                apr_pool_t *temp_pool,
+                                                apr_pool_t *data_pool,
+                                                apr_memcache_meta_t *items,
+                                                int nitems);
+
+/**
+ * Set the values of an array of items.
+ * @param mc client to use
+ * @param temp_pool Pool used for temporary allocations
+ * @param items The items, whose key, data, len, flags, ttl and cas are used
+ * @param nitems The number of items
+ * @param invalidate With a cas, mark the item stale (rather than failing)
+ *        if the cas is older than the item's
+ * @return APR_SUCCESS, or the first error of a server, the status of each
+ *         item being set anyway.
+ */
+APR_DECLARE(apr_status_t) apr_memcache_meta_set(apr_memcache_t *mc,
+                                                apr_pool_t *temp_pool,
+                                                apr_memcache_meta_t *items,
+                                                int nitems,
+                                                int invalidate);
+
+/**
+ * Delete, or invalidate, an array of items.
+ * @param mc client to use
+ * @param temp_pool Pool used for temporary allocations
+ * @param items The items, whose key, ttl and cas are used
+ * @param nitems The number of items
+ * @param invalidate Mark the items stale with their time to live, to be
+ *        recached by the next get, rather than deleting them
+ * @return APR_SUCCESS, or the first error of a server, the status of each
+ *         item being set anyway.
+ */
+APR_DECLARE(apr_status_t) apr_memcache_meta_delete(apr_memcache_t *mc,
+                                                   apr_pool_t *temp_pool,
+                                                   apr_memcache_meta_t *items,
+                                                   int nitems,
+                                                   int invalidate);
+
+/** @} */
+
 
 /** @} */
 
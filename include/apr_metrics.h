@@ -0,0 +1,157 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_METRICS_H
+#define APR_METRICS_H
+/**
+ * @file apr_metrics.h
+ * @brief APR Runtime Metrics
+ */
+#include "apr.h"
+#include "apr_errno.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * @defgroup apr_metrics Runtime Metrics
+ * @ingroup APR
+ *
+ * A process wide registry of counters, gauges and histograms, which APR
+ * subsystems and applications update, and which can be walked to export
+ * them (to Prometheus for instance).  The counters and histograms are
+ * sharded per thread, so updating them takes an uncontended atomic add.
+ *
+ * The metrics registered by APR itself are:
+ * - apr_pools_created_total: pools created,
+ * - apr_pollset_polls_total: apr_pollset_poll() calls,
+ * - apr_pollset_poll_events: histogram of the events they returned,
+ * - apr_file_flushes_total: writes of the buffered files' buffers,
+ * - apr_thread_pool_tasks_total: tasks run by the thread pools.
+ * @{
+ */
+
+/** Opaque metric structure */
+typedef struct apr_metric_t apr_metric_t;
+
+/** The types of metrics */
+typedef enum {
+    APR_METRIC_COUNTER,         /**< Value only going up */
+    APR_METRIC_GAUGE,           /**< Value going up and down */
+    APR_METRIC_HISTOGRAM        /**< Distribution of observed values */
+} apr_metric_type_e;
+
+/**
+ * Number of buckets of the histograms.  They are log-linear: values 0
+ * to 3 have their own bucket, then each power of two is split in four
+ * buckets, up to 2^40 (the last bucket counts all the bigger values).
+ */
+#define APR_METRIC_BUCKETS 160
+
+/**
+ * The snapshot of a metric, as given to apr_metrics_do()
+ */
+typedef struct apr_metric_value_t {
+    /** The name of the metric */
+    const char *name;
+    /** The description of the metric */
+    const char *help;
+    /** The type of the metric */
+    apr_metric_type_e type;
+    /** The value of a counter or a gauge */
+    apr_int64_t value;
+    /** The number of values observed by a histogram */
+    apr_uint64_t count;
+    /** The sum of the values observed by a histogram */
+    apr_uint64_t sum;
+    /** The number of values observed by a histogram in each bucket (not
+     *  cumulative), see apr_metric_bucket_bound() */
+    apr_uint64_t buckets[APR_METRIC_BUCKETS];
+} apr_metric_value_t;
+
+/**
+ * Register a metric, or get the one registered with that name already.
+ * @param metric The metric
+ * @param name The name of the metric, copied
+ * @param help A description of the metric, copied
+ * @param type The type of the metric
+ * @return APR_SUCCESS, APR_EEXIST if a metric of another type has that
+ *         name already, or APR_ENOMEM.
+ * @remark Metrics live as long as the process, so a metric can be kept
+ *         in a static variable and shared by any number of objects.
+ *         There can't be more than 1024 of them.
+ */
+APR_DECLARE(apr_status_t) apr_metric_register(apr_metric_t **metric,
+                                              const char *name,
+                                              const char *help,
+                                              apr_metric_type_e type);
+
+/**
+ * Add to a counter or a gauge.
+ * @param metric The metric
+ * @param delta The number to add, it must not be negative for a counter
+ */
+APR_DECLARE(void) apr_metric_add(apr_metric_t *metric, apr_int64_t delta);
+
+/**
+ * Set a gauge.
+ * @param metric The metric
+ * @param value The value of the gauge
+ */
+APR_DECLARE(void) apr_metric_set(apr_metric_t *metric, apr_int64_t value);
+
+/**
+ * Observe a value with a histogram.
+ * @param metric The metric
+ * @param value The value observed
+ */
+APR_DECLARE(void) apr_metric_observe(apr_metric_t *metric,
+                                     apr_uint64_t value);
+
+/**
+ * Get the largest value counted by a bucket of the histograms.
+ * @param bucket The bucket, from 0 to APR_METRIC_BUCKETS - 1
+ * @return The largest value counted, APR_UINT64_MAX for the last bucket.
+ */
+APR_DECLARE(apr_uint64_t) apr_metric_bucket_bound(int bucket);
+
+/**
+ * Callback for apr_metrics_do()
+ * @param baton The baton given to apr_metrics_do()
+ * @param value The snapshot of a metric
+ * @return Non-zero to continue, zero to stop the iteration
+ */
+typedef int (apr_metrics_cb_t)(void *baton, const apr_metric_value_t *value);
+
+/**
+ * Iterate over the metrics, in the order of their registration.
+ * @param cb The callback run for each metric
+ * @param baton The baton passed to @a cb
+ * @return Zero if the iteration was stopped by @a cb (or could not be
+ *         run), non-zero otherwise.
+ * @remark Each snapshot is consistent for that metric only, since the
+ *         shards are read one after the other while they may be updated.
+ */
+APR_DECLARE(int) apr_metrics_do(apr_metrics_cb_t *cb, void *baton);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !APR_METRICS_H */
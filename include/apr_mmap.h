@@ -50,6 +50,9 @@ extern "C" {
 /** @see apr_mmap_t */
 typedef struct apr_mmap_t            apr_mmap_t;
 
+/** @see apr_mmap_cache_create() */
+typedef struct apr_mmap_cache_t      apr_mmap_cache_t;
+
 /**
  * @remark
  * As far as I can tell the only really sane way to store an MMAP is as a
@@ -72,6 +75,9 @@ struct apr_mmap_t {
     void *mv;
 #else
     apr_off_t poffset;
+    /** The entry of the apr_mmap_cache_t the region belongs to, NULL
+     * unless the mmap comes from apr_mmap_cache_get() */
+    struct apr_mmap_cache_entry_t *centry;
 #endif
     /** The start of the memory mapped area */
     void *mm;
@@ -157,6 +163,44 @@ APR_DECLARE(apr_status_t) apr_mmap_delete(apr_mmap_t *mm);
 APR_DECLARE(apr_status_t) apr_mmap_offset(void **addr, apr_mmap_t *mm,
                                           apr_off_t offset);
 
+/**
+ * Create a cache of read-only mappings, shared by the threads, so that
+ * mapping the same region of an unchanged file again reuses the existing
+ * mapping rather than creating (and later unmapping) a new one.
+ * @param cache The newly created cache.
+ * @param max_bytes The total size of the mappings kept while unused,
+ *        the least recently used ones being unmapped beyond it.
+ * @param pool The pool to use for the cache.
+ * @remark The mmaps obtained from the cache must be deleted (or their
+ *         pools cleared) before @a pool is.
+ * @return APR_ENOTIMPL where not supported.
+ */
+APR_DECLARE(apr_status_t) apr_mmap_cache_create(apr_mmap_cache_t **cache,
+                                                apr_size_t max_bytes,
+                                                apr_pool_t *pool);
+
+/**
+ * Get a read-only mmap of a file region from the cache, or map it.
+ * @param newmmap The mmap, allocated from @a pool.
+ * @param cache The cache.
+ * @param file The file to map.
+ * @param offset The offset into the file to start the data pointer at.
+ * @param size The size of the region.
+ * @param pool The pool to use for @a newmmap.
+ * @remark The mappings are identified by the file's device, inode and
+ *         modification time, and by the region, so a modified file is
+ *         mapped afresh (with the same caveats as apr_mmap_create() for
+ *         a file truncated while mapped).
+ * @remark @a newmmap is released by apr_mmap_delete() or when @a pool is
+ *         cleaned up, and can be duplicated by apr_mmap_dup().
+ */
+APR_DECLARE(apr_status_t) apr_mmap_cache_get(apr_mmap_t **newmmap,
+                                             apr_mmap_cache_t *cache,
+                                             apr_file_t *file,
+                                             apr_off_t offset,
+                                             apr_size_t size,
+                                             apr_pool_t *pool);
+
 #endif /* APR_HAS_MMAP */
 
 /** @} */
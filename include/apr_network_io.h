@@ -108,6 +108,32 @@ extern "C" {
 #define APR_SO_FREEBIND     131072 /**< Allow binding to addresses not owned
                                     * by any interface
                                     */
+#define APR_SO_REUSEPORT    262144 /**< Allow several sockets to bind the
+                                    * same address and port, the connections
+                                    * being balanced between them
+                                    * @see apr_socket_reuseport_group
+                                    */
+#define APR_SO_UDP_GRO      524288 /**< Receive the datagrams of a flow
+                                    * coalesced, with their segment size
+                                    * @see apr_socket_recvmmsg
+                                    */
+#define APR_SO_ZEROCOPY    1048576 /**< Send without copying the data, which
+                                    * must be kept until the send completes
+                                    * @see apr_socket_zerocopy_reap
+                                    */
+#define APR_SO_KERNEL_TIMEOUT 2097152 /**< Implement the timeout with a
+                                    * blocking descriptor and SO_RCVTIMEO/
+                                    * SO_SNDTIMEO, a single system call per
+                                    * operation rather than a non-blocking
+                                    * one followed by poll() on EAGAIN
+                                    * @see apr_socket_timeout_set
+                                    */
+#define APR_SO_ADAPTIVE_WAIT 4194304 /**< Have apr_socket_send(),
+                                    * apr_socket_sendv() and apr_socket_recv()
+                                    * wait first rather than try the system
+                                    * call when the previous one returned
+                                    * EAGAIN, like with APR_INCOMPLETE_READ
+                                    */
 
 /** @} */
 
@@ -278,6 +304,11 @@ struct apr_sockaddr_t {
         struct sockaddr_un unx;
 #endif
     } sa;
+    /** The text form of the IP address, computed by apr_sockaddr_ip_get()
+     *  on first use (private) */
+    char ipstr[64];
+    /** The IP address, scope and family which ipstr is for (private) */
+    volatile apr_uint32_t ipstr_key[6];
 };
 
 #if APR_HAS_SENDFILE
@@ -356,6 +387,38 @@ APR_DECLARE(apr_status_t) apr_socket_bind(apr_socket_t *sock,
 APR_DECLARE(apr_status_t) apr_socket_listen(apr_socket_t *sock,
                                             apr_int32_t backlog);
 
+#define APR_REUSEPORT_STEER_CPU 0x1 /**< Hand the connections to the
+                                     * listener of the CPU receiving them
+                                     * @see apr_socket_reuseport_group
+                                     */
+
+/**
+ * Create a group of sockets bound to the same address and port, with
+ * APR_SO_REUSEPORT, the kernel balancing the connections or datagrams
+ * between them.  Each one may then be polled or accepted on by its own
+ * thread or process, without them contending on a single queue.
+ * @param socks The array of num sockets created
+ * @param num The number of sockets in the group
+ * @param sa The address to bind to, if its port is zero the first socket
+ *           gets an ephemeral port which the others then bind to.
+ * @param type The type of the sockets (e.g., SOCK_STREAM)
+ * @param protocol The protocol of the sockets (e.g., APR_PROTO_TCP)
+ * @param backlog The listen backlog of each socket, for SOCK_STREAM types
+ * @param flags Zero or APR_REUSEPORT_STEER_CPU, to select the socket from
+ *              the CPU handling the packet (the socket at index
+ *              cpu % num), rather than from a hash of the addresses
+ * @param p The pool for the sockets
+ * @return APR_ENOTIMPL if APR_SO_REUSEPORT, or the steering requested,
+ *         is not supported.  On failure no socket is left open.
+ */
+APR_DECLARE(apr_status_t) apr_socket_reuseport_group(apr_socket_t **socks,
+                                                     int num,
+                                                     apr_sockaddr_t *sa,
+                                                     int type, int protocol,
+                                                     apr_int32_t backlog,
+                                                     apr_int32_t flags,
+                                                     apr_pool_t *p);
+
 /**
  * Accept a new connection request
  * @param new_sock A copy of the socket that is connected to the socket that
@@ -371,6 +434,27 @@ APR_DECLARE(apr_status_t) apr_socket_accept(apr_socket_t **new_sock,
                                             apr_socket_t *sock,
                                             apr_pool_t *connection_pool);
 
+/**
+ * Accept the connection requests pending on a socket, up to a number
+ * @param new_socks The array of the sockets accepted
+ * @param num (input)  - The number of elements of new_socks and
+ *                       connection_pools
+ *            (output) - The number of connections accepted
+ * @param sock The socket we are listening on.
+ * @param connection_pools The pools of the new sockets, one per connection
+ *                         as for apr_socket_accept()
+ * @remark This stops at the first connection request not yet pending,
+ *         returning APR_SUCCESS if some were accepted, the status of
+ *         apr_socket_accept() otherwise.  A blocking socket (negative
+ *         timeout) only waits for the first one, and accepts one per call
+ *         then, use APR_SO_NONBLOCK and poll it for readability to drain
+ *         the pending requests.
+ */
+APR_DECLARE(apr_status_t) apr_socket_accept_batch(apr_socket_t **new_socks,
+                                                  apr_int32_t *num,
+                                                  apr_socket_t *sock,
+                                                  apr_pool_t **connection_pools);
+
 /**
  * Issue a connection request to a socket either on the same machine
  * or a different one.
@@ -380,6 +464,33 @@ APR_DECLARE(apr_status_t) apr_socket_accept(apr_socket_t **new_sock,
 APR_DECLARE(apr_status_t) apr_socket_connect(apr_socket_t *sock,
                                              apr_sockaddr_t *sa);
 
+/**
+ * Connect to the first address of a list that answers, racing the
+ * attempts as in RFC 8305 ("Happy Eyeballs")
+ * @param new_sock The socket connected, created from p
+ * @param sa The addresses, as returned by apr_sockaddr_info_get()
+ * @param type The type of the sockets to create
+ * @param protocol The protocol of the sockets to create
+ * @param timeout How long to wait for a connection overall, negative to
+ *                wait forever
+ * @param stagger How long to wait for an attempt before starting the next
+ *                one, RFC 8305 recommends 250 milliseconds; an attempt
+ *                failing starts the next one at once
+ * @param p The pool for the sockets
+ * @remark The addresses are tried alternating their families, from the
+ *         family of the first one.  The other attempts are closed once one
+ *         succeeds.  The socket returned is blocking, as from
+ *         apr_socket_create().
+ * @return APR_TIMEUP once the timeout expired, the status of the last
+ *         attempt when they all failed.
+ */
+APR_DECLARE(apr_status_t) apr_socket_connect_any(apr_socket_t **new_sock,
+                                                 apr_sockaddr_t *sa,
+                                                 int type, int protocol,
+                                                 apr_interval_time_t timeout,
+                                                 apr_interval_time_t stagger,
+                                                 apr_pool_t *p);
+
 /**
  * Determine whether the receive part of the socket has been closed by
  * the peer (such that a subsequent call to apr_socket_read would
@@ -613,6 +724,121 @@ APR_DECLARE(apr_status_t) apr_socket_recvfrom(apr_sockaddr_t *from,
                                               apr_int32_t flags, char *buf,
                                               apr_size_t *len);
 
+/** A datagram sent by apr_socket_sendmmsg() or received by
+ * apr_socket_recvmmsg()
+ */
+typedef struct apr_socket_msg_t {
+    /** The address the datagram is sent to, or updated with the address
+     *  it was received from, NULL for a connected socket */
+    apr_sockaddr_t *addr;
+    /** The buffers of the datagram */
+    struct iovec *vec;
+    /** The number of buffers */
+    apr_int32_t nvec;
+    /** The number of bytes sent or received (output) */
+    apr_size_t len;
+    /** The size of the segments the datagram is sent as, or was coalesced
+     *  from with APR_SO_UDP_GRO, zero for a single datagram */
+    apr_uint16_t segment_size;
+} apr_socket_msg_t;
+
+/**
+ * Send several datagrams from a socket, in as few system calls as possible
+ * @param sock The socket to send from
+ * @param msgs The datagrams to send
+ * @param nmsgs (input)  - The number of datagrams in msgs
+ *              (output) - The number of datagrams sent
+ * @param flags The flags to use
+ * @remark On Linux the datagrams are sent by sendmmsg(), and a non-zero
+ *         segment_size has the kernel split the datagram in segments of
+ *         that size (UDP_SEGMENT).  Elsewhere they are sent one by one,
+ *         and APR_ENOTIMPL is returned for a segment_size that cannot be
+ *         honoured.
+ * @remark An error is only returned if no datagram could be sent, the
+ *         datagrams following the ones sent were not.
+ */
+APR_DECLARE(apr_status_t) apr_socket_sendmmsg(apr_socket_t *sock,
+                                              apr_socket_msg_t *msgs,
+                                              apr_int32_t *nmsgs,
+                                              apr_int32_t flags);
+
+/**
+ * Receive several datagrams from a socket, in as few system calls as
+ * possible
+ * @param sock The socket to receive from
+ * @param msgs The buffers for the datagrams received
+ * @param nmsgs (input)  - The number of datagrams in msgs
+ *              (output) - The number of datagrams received
+ * @param flags The flags to use
+ * @remark This waits for one datagram at most (the timeout of the socket),
+ *         then returns it along with the others already received.
+ * @remark With APR_SO_UDP_GRO the datagrams of a flow may be received
+ *         coalesced in one message, segment_size being the size of each
+ *         of them but the last one.
+ */
+APR_DECLARE(apr_status_t) apr_socket_recvmmsg(apr_socket_t *sock,
+                                              apr_socket_msg_t *msgs,
+                                              apr_int32_t *nmsgs,
+                                              apr_int32_t flags);
+
+/** The most descriptors passed by apr_socket_send_descriptors() at once */
+#define APR_SOCKET_MAX_DESCRIPTORS 16
+
+/** A descriptor passed by apr_socket_send_descriptors() or received by
+ * apr_socket_recv_descriptors(), one of sock and file being set
+ */
+typedef struct apr_socket_descriptor_t {
+    /** The socket passed or received, or NULL */
+    apr_socket_t *sock;
+    /** The file (or pipe) passed or received, or NULL */
+    apr_file_t *file;
+} apr_socket_descriptor_t;
+
+/**
+ * Send data along with sockets or files to another process over an
+ * APR_UNIX socket, the receiver getting descriptors of its own for them
+ * @param sock The APR_UNIX socket to send from
+ * @param buf The data to send, at least one byte
+ * @param len (input)  - The number of bytes to send
+ *            (output) - The number of bytes sent
+ * @param descs The sockets or files to pass
+ * @param ndescs The number of descriptors, up to APR_SOCKET_MAX_DESCRIPTORS
+ * @remark The descriptors are attached to the first byte sent, what a
+ *         partial send leaves needs no resending along with them.  The
+ *         sender keeps its own copies, which it may close once sent.
+ * @remark A listening socket passed keeps its accept queue, so it can be
+ *         handed over to a new process without dropping connections.
+ * @remark APR_ENOTIMPL is returned where descriptors cannot be passed.
+ */
+APR_DECLARE(apr_status_t) apr_socket_send_descriptors(apr_socket_t *sock,
+                                   const char *buf, apr_size_t *len,
+                                   const apr_socket_descriptor_t *descs,
+                                   int ndescs);
+
+/**
+ * Receive data along with the sockets or files passed by
+ * apr_socket_send_descriptors()
+ * @param sock The APR_UNIX socket to receive from
+ * @param buf The buffer for the data
+ * @param len (input)  - The length of the buffer
+ *            (output) - The number of bytes received
+ * @param descs The descriptors received
+ * @param ndescs (input)  - The number of descriptors in descs
+ *               (output) - The number of descriptors received
+ * @param pool The pool to allocate the sockets and files from, they are
+ *             closed when it is cleared
+ * @remark A socket is received with its family, type and addresses, and
+ *         with APR_SO_NONBLOCK set and no timeout if the sender had made
+ *         it non-blocking (this is shared by both processes).
+ * @remark APR_ENOSPC is returned, along with the data and the descriptors
+ *         that fit, if more descriptors than ndescs were passed; the
+ *         others are closed.
+ */
+APR_DECLARE(apr_status_t) apr_socket_recv_descriptors(apr_socket_t *sock,
+                                   char *buf, apr_size_t *len,
+                                   apr_socket_descriptor_t *descs,
+                                   int *ndescs, apr_pool_t *pool);
+
 #if APR_HAS_SENDFILE || defined(DOXYGEN)
 
 /**
@@ -633,6 +859,8 @@ APR_DECLARE(apr_status_t) apr_socket_recvfrom(apr_sockaddr_t *from,
  * The offset parameter is passed by reference for no reason; its
  * value will never be modified by the apr_socket_sendfile() function.
  * It is possible for both bytes to be sent and an error to be returned.
+ * @remark On a socket given to apr_socket_ktls_enable() the file is still
+ *         sent by the kernel, which encrypts it.
  */
 APR_DECLARE(apr_status_t) apr_socket_sendfile(apr_socket_t *sock,
                                               apr_file_t *file,
@@ -695,6 +923,14 @@ APR_DECLARE(apr_status_t) apr_socket_wait(apr_socket_t *sock,
  *            APR_SO_SNDBUF     --  Set the SendBufferSize
  *            APR_SO_RCVBUF     --  Set the ReceiveBufferSize
  *            APR_SO_FREEBIND   --  Allow binding to non-local IP address.
+ *            APR_SO_REUSEPORT  --  Allow several sockets to bind the same
+ *                                  address and port.
+ *            APR_SO_UDP_GRO    --  Receive the datagrams of a flow coalesced.
+ *            APR_SO_ZEROCOPY   --  Send without copying the data.
+ *            APR_SO_KERNEL_TIMEOUT -- Have the kernel implement the
+ *                                  timeout on a blocking descriptor.
+ *            APR_SO_ADAPTIVE_WAIT -- Wait before the system call when the
+ *                                  previous one would have blocked.
  * </PRE>
  * @param on Value for the option.
  */
@@ -711,6 +947,10 @@ APR_DECLARE(apr_status_t) apr_socket_opt_set(apr_socket_t *sock,
  *   t == 0 -- read and write calls never block
  *   t < 0  -- read and write calls block
  * </PRE>
+ * @remark With APR_SO_KERNEL_TIMEOUT and t > 0, the timeout applies to
+ *         each system call (a write returns what it sent so far when
+ *         it expires),
+ *         and apr_socket_accept() waits up to the timeout too.
  */
 APR_DECLARE(apr_status_t) apr_socket_timeout_set(apr_socket_t *sock,
                                                  apr_interval_time_t t);
@@ -745,6 +985,69 @@ APR_DECLARE(apr_status_t) apr_socket_opt_get(apr_socket_t *sock,
 APR_DECLARE(apr_status_t) apr_socket_timeout_get(apr_socket_t *sock,
                                                  apr_interval_time_t *t);
 
+/**
+ * Callback of apr_socket_zerocopy_reap()
+ * @param baton The baton of apr_socket_zerocopy_reap()
+ * @param first The number of the first send completed
+ * @param last The number of the last send completed
+ * @param copied Whether the kernel copied the data of these sends anyway,
+ *               in which case APR_SO_ZEROCOPY is not worth it for the
+ *               socket
+ * @return An error stops apr_socket_zerocopy_reap(), which returns it
+ */
+typedef apr_status_t (*apr_socket_zerocopy_cb_t)(void *baton,
+                                                 apr_uint32_t first,
+                                                 apr_uint32_t last,
+                                                 int copied);
+
+/**
+ * Get the number of the next send of a socket with APR_SO_ZEROCOPY
+ * @param sock The socket to query
+ * @param seq The number of the next apr_socket_send() or apr_socket_sendv()
+ *            call sending data without copying it, they are numbered from
+ *            zero when APR_SO_ZEROCOPY is set the first time
+ */
+APR_DECLARE(apr_status_t) apr_socket_zerocopy_seq(apr_socket_t *sock,
+                                                  apr_uint32_t *seq);
+
+/**
+ * Handle the sends of a socket with APR_SO_ZEROCOPY which have completed
+ * @param sock The socket
+ * @param func Called for each range of sends completed, whose data may
+ *             be released or reused then
+ * @param baton The baton of func
+ * @remark The completions are queued on the error queue of the socket,
+ *         which is signalled by APR_POLLERR when polling it.  This does
+ *         not block, it returns APR_SUCCESS once the queue is empty.
+ * @remark Zero copy is not worth it for small sends: the data of a send
+ *         is pinned until acknowledged by the peer.
+ */
+APR_DECLARE(apr_status_t) apr_socket_zerocopy_reap(apr_socket_t *sock,
+                                                   apr_socket_zerocopy_cb_t func,
+                                                   void *baton);
+
+#define APR_KTLS_TX 0x1 /**< Encrypt by the kernel what is sent */
+#define APR_KTLS_RX 0x2 /**< Decrypt by the kernel what is received */
+
+/**
+ * Hand the record layer of a TLS connection to the kernel (Linux kTLS),
+ * once the handshake has been done by a TLS library
+ * @param sock The connected socket
+ * @param flags APR_KTLS_TX and/or APR_KTLS_RX
+ * @param crypto_info The keys and sequence numbers of the connection, as
+ *                    the struct tls12_crypto_info_* of the cipher
+ *                    negotiated, given by the TLS library
+ * @param len The size of crypto_info
+ * @remark Afterwards apr_socket_send() and apr_socket_sendfile() send
+ *         plain data which is encrypted by the kernel, so that files are
+ *         still sent without being read in user space.
+ * @return APR_ENOTIMPL if kTLS is not supported.
+ */
+APR_DECLARE(apr_status_t) apr_socket_ktls_enable(apr_socket_t *sock,
+                                                 apr_int32_t flags,
+                                                 const void *crypto_info,
+                                                 apr_size_t len);
+
 /**
  * Query the specified socket if at the OOB/Urgent data mark
  * @param sock The socket to query
@@ -768,10 +1071,11 @@ APR_DECLARE(apr_status_t) apr_socket_addr_get(apr_sockaddr_t **sa,
 
 /**
  * Return the IP address (in numeric address string format) in
- * an APR socket address.  APR will allocate storage for the IP address
- * string from the pool of the apr_sockaddr_t.
+ * an APR socket address.
  * @param addr The IP address.
  * @param sockaddr The socket address to reference.
+ * @remark The string is computed once and kept in @a sockaddr, it must
+ *         not be modified and it is valid until the address changes.
  */
 APR_DECLARE(apr_status_t) apr_sockaddr_ip_get(char **addr,
                                               apr_sockaddr_t *sockaddr);
@@ -844,6 +1148,40 @@ APR_DECLARE(apr_status_t) apr_ipsubnet_create(apr_ipsubnet_t **ipsub,
  */
 APR_DECLARE(int) apr_ipsubnet_test(apr_ipsubnet_t *ipsub, apr_sockaddr_t *sa);
 
+/** A set of IP subnets, tested at once */
+typedef struct apr_ipsubnet_set_t apr_ipsubnet_set_t;
+
+/**
+ * Create an empty set of ip-subnets.
+ * @param set The new set
+ * @param p The pool to allocate from
+ */
+APR_DECLARE(apr_status_t) apr_ipsubnet_set_create(apr_ipsubnet_set_t **set,
+                                                  apr_pool_t *p);
+
+/**
+ * Add an ip-subnet to a set.
+ * @param set The set
+ * @param ipsub The ip-subnet created by apr_ipsubnet_create(), which must
+ *        live as long as the set
+ */
+APR_DECLARE(apr_status_t) apr_ipsubnet_set_add(apr_ipsubnet_set_t *set,
+                                               apr_ipsubnet_t *ipsub);
+
+/**
+ * Test the IP address in an apr_sockaddr_t against all the ip-subnets
+ * of a set, like apr_ipsubnet_test() for each of them.
+ * @param set The set
+ * @param sa The socket address to test
+ * @return non-zero if the socket address is within one of the subnets,
+ *         0 otherwise
+ * @remark The subnets are in a prefix tree, so the test is done in at
+ *         most as many steps as there are bits in the address, whatever
+ *         the number of subnets (but those with a non-contiguous mask).
+ */
+APR_DECLARE(int) apr_ipsubnet_set_test(const apr_ipsubnet_set_t *set,
+                                       apr_sockaddr_t *sa);
+
 #if APR_HAS_SO_ACCEPTFILTER || defined(DOXYGEN)
 /**
  * Set an OS level accept filter.
@@ -26,6 +26,7 @@
 #include "apr_inherit.h"
 #include "apr_file_io.h"
 #include "apr_network_io.h"
+#include "apr_thread_proc.h"
 
 #if APR_HAVE_NETINET_IN_H
 #include <netinet/in.h>
@@ -53,6 +54,8 @@ extern "C" {
 #define APR_POLLHUP   0x020     /**< Hangup occurred */
 #define APR_POLLNVAL  0x040     /**< Descriptor invalid */
 #define APR_POLLEXCL  0x080     /**< Exclusive wake up */
+#define APR_POLLET    0x100     /**< Edge-triggered (reqevents only) */
+#define APR_POLLONESHOT 0x200   /**< Disabled once signalled (reqevents only) */
 /** @} */
 
 /**
@@ -85,7 +88,8 @@ typedef enum {
     APR_POLLSET_PORT,           /**< Poll uses Solaris event port method */
     APR_POLLSET_EPOLL,          /**< Poll uses epoll method */
     APR_POLLSET_POLL,           /**< Poll uses poll method */
-    APR_POLLSET_AIO_MSGQ        /**< Poll uses z/OS asio method */
+    APR_POLLSET_AIO_MSGQ,       /**< Poll uses z/OS asio method */
+    APR_POLLSET_IO_URING        /**< Poll uses Linux io_uring method */
 } apr_pollset_method_e;
 
 /** Used in apr_pollfd_t to determine what the apr_descriptor is */
@@ -93,7 +97,10 @@ typedef enum {
     APR_NO_DESC,                /**< nothing here */
     APR_POLL_SOCKET,            /**< descriptor refers to a socket */
     APR_POLL_FILE,              /**< descriptor refers to a file */
-    APR_POLL_LASTDESC           /**< @deprecated descriptor is the last one in the list */
+    APR_POLL_LASTDESC,          /**< @deprecated descriptor is the last one in the list */
+    APR_POLL_SIGNAL,            /**< file from apr_poll_signal_create() */
+    APR_POLL_PROC,              /**< file from apr_poll_proc_create() */
+    APR_POLL_TIMER              /**< file from apr_poll_timer_create() */
 } apr_datatype_e ;
 
 /** Union of either an APR file or socket. */
@@ -188,6 +195,16 @@ APR_DECLARE(apr_status_t) apr_pollset_create(apr_pollset_t **pollset,
  *         the size parameter controls the maximum number of
  *         descriptors that will be returned by a single call to
  *         apr_pollset_poll().
+ * @remark With APR_POLLSET_IO_URING (Linux 5.18 or later), the errors of
+ *         apr_pollset_add() are reported by apr_pollset_poll(), as
+ *         APR_POLLNVAL or APR_POLLERR events, and the file of a
+ *         descriptor closed while in the pollset stays open until the
+ *         descriptor is removed.  apr_pollset_remove() releases it at
+ *         once, so a descriptor removed then closed can be reopened
+ *         (e.g. a listening address bound again) as with the other
+ *         methods.  The wakeup does not use a pipe.  Destroying the pollset may
+ *         interrupt (EINTR) the next blocking call of the threads that
+ *         used it.
  */
 APR_DECLARE(apr_status_t) apr_pollset_create_ex(apr_pollset_t **pollset,
                                                 apr_uint32_t size,
@@ -251,6 +268,26 @@ APR_DECLARE(apr_status_t) apr_pollset_add(apr_pollset_t *pollset,
 APR_DECLARE(apr_status_t) apr_pollset_remove(apr_pollset_t *pollset,
                                              const apr_pollfd_t *descriptor);
 
+/**
+ * Re-enable a descriptor added with APR_POLLONESHOT to a pollset
+ * @param pollset The pollset to which the descriptor was added
+ * @param descriptor The descriptor to re-enable
+ * @remark Once signalled, a descriptor added with APR_POLLONESHOT in its
+ *         reqevents is not polled anymore until it is rearmed, which costs
+ *         less than removing and adding it again.  The reqevents field must
+ *         contain the same value as when adding.
+ * @remark APR_POLLONESHOT and APR_POLLET are not implemented by all the
+ *         methods, apr_pollset_add() returns APR_ENOTIMPL for them then.
+ *         APR_POLLET is implemented by the epoll and kqueue methods, and
+ *         APR_POLLONESHOT by the epoll, kqueue, port and io_uring methods.
+ * @remark If the descriptor is not found, APR_NOTFOUND is returned.  With
+ *         APR_POLLSET_NOCOPY the descriptor which was added is rearmed
+ *         without looking it up in the pollset by the epoll and kqueue
+ *         methods.
+ */
+APR_DECLARE(apr_status_t) apr_pollset_rearm(apr_pollset_t *pollset,
+                                            const apr_pollfd_t *descriptor);
+
 /**
  * Block for activity on the descriptor(s) in a pollset
  * @param pollset The pollset to use
@@ -274,6 +311,32 @@ APR_DECLARE(apr_status_t) apr_pollset_poll(apr_pollset_t *pollset,
                                            apr_int32_t *num,
                                            const apr_pollfd_t **descriptors);
 
+/**
+ * Block for activity on the descriptor(s) in a pollset, returning at most
+ * maxevents signalled descriptors in an array provided by the caller
+ * @param pollset The pollset to use
+ * @param timeout The amount of time in microseconds to wait, as for
+ *                apr_pollset_poll()
+ * @param maxevents The number of elements of descriptors, greater than zero
+ * @param num Number of signalled descriptors (output parameter)
+ * @param descriptors Array of maxevents elements where the signalled
+ *                    descriptors are copied (output parameter)
+ * @remark Unlike apr_pollset_poll(), the pollset does not need an array
+ *         of its size for the results, so a large pollset can be polled
+ *         a few events at a time.  The descriptors not returned stay
+ *         signalled for the next call, as they would be if they were
+ *         signalled just after this one.
+ * @remark The epoll method waits in the descriptors array directly.  The
+ *         other methods return APR_ENOTIMPL if maxevents is less than the
+ *         size of the pollset, the events beyond maxevents could be lost
+ *         otherwise.
+ */
+APR_DECLARE(apr_status_t) apr_pollset_poll_ex(apr_pollset_t *pollset,
+                                              apr_interval_time_t timeout,
+                                              apr_int32_t maxevents,
+                                              apr_int32_t *num,
+                                              apr_pollfd_t *descriptors);
+
 /**
  * Interrupt the blocked apr_pollset_poll() call.
  * @param pollset The pollset to use
@@ -390,6 +453,16 @@ APR_DECLARE(apr_status_t) apr_pollcb_add(apr_pollcb_t *pollcb,
 APR_DECLARE(apr_status_t) apr_pollcb_remove(apr_pollcb_t *pollcb,
                                             apr_pollfd_t *descriptor);
 
+/**
+ * Re-enable a descriptor added with APR_POLLONESHOT to a pollcb
+ * @param pollcb The pollcb to which the descriptor was added
+ * @param descriptor The descriptor to re-enable, as passed to apr_pollcb_add()
+ * @remark See apr_pollset_rearm() for the semantics and the methods which
+ *         implement APR_POLLONESHOT and APR_POLLET.
+ */
+APR_DECLARE(apr_status_t) apr_pollcb_rearm(apr_pollcb_t *pollcb,
+                                           apr_pollfd_t *descriptor);
+
 /**
  * Function prototype for pollcb handlers
  * @param baton Opaque baton passed into apr_pollcb_poll()
@@ -437,6 +510,104 @@ APR_DECLARE(apr_status_t) apr_pollcb_wakeup(apr_pollcb_t *pollcb);
  */
 APR_DECLARE(const char *) apr_pollcb_method_name(apr_pollcb_t *pollcb);
 
+/**
+ * @defgroup apr_poll_sources Signal, process and timer sources
+ *
+ * Descriptors becoming readable when a signal is delivered, a child
+ * process exits or a timer expires, to be added to a pollset or a pollcb
+ * (or given to apr_poll()) like any other, so that a single event loop
+ * handles them with the I/O, without a dedicated thread or a poll
+ * timeout.  They are implemented with signalfd(), pidfd_open() and
+ * timerfd_create() on Linux, and not implemented elsewhere for now.
+ *
+ * Each create function fills an apr_pollfd_t with the new descriptor
+ * (an apr_file_t in the desc.f field, closed when @a p is cleared) and
+ * APR_POLLIN in reqevents; the client_data field is left untouched.
+ * @{
+ */
+
+/**
+ * Create a descriptor readable while some signals are pending.
+ * @param pfd The descriptor to fill
+ * @param signums The signals to wait for
+ * @param nsignums The number of signals in @a signums
+ * @param p The pool to use
+ * @return APR_SUCCESS, or APR_ENOTIMPL if not available on this platform.
+ * @remark The signals are blocked in the calling thread, and must be
+ *         blocked in all the other threads of the process too (e.g. with
+ *         apr_setup_signal_thread() or by calling this function before
+ *         creating them), otherwise they may be delivered the usual way.
+ */
+APR_DECLARE(apr_status_t) apr_poll_signal_create(apr_pollfd_t *pfd,
+                                                 const int *signums,
+                                                 int nsignums,
+                                                 apr_pool_t *p);
+
+/**
+ * Consume one of the pending signals of a signal descriptor.
+ * @param pfd The descriptor filled by apr_poll_signal_create()
+ * @param signum The number of the signal
+ * @return APR_SUCCESS, or APR_EAGAIN if no signal is pending.
+ */
+APR_DECLARE(apr_status_t) apr_poll_signal_read(const apr_pollfd_t *pfd,
+                                               int *signum);
+
+/**
+ * Create a descriptor readable once a child process has exited.
+ * @param pfd The descriptor to fill
+ * @param proc The child process, which must not be waited for yet
+ * @param p The pool to use
+ * @return APR_SUCCESS, or APR_ENOTIMPL if not available on this platform
+ *         or with the running kernel.
+ * @remark The child still has to be reaped, with apr_proc_wait() and
+ *         APR_NOWAIT which then won't block, or apr_proc_other_child_alert().
+ */
+APR_DECLARE(apr_status_t) apr_poll_proc_create(apr_pollfd_t *pfd,
+                                               const apr_proc_t *proc,
+                                               apr_pool_t *p);
+
+/**
+ * Create a descriptor readable once a timer has expired.
+ * @param pfd The descriptor to fill
+ * @param initial The time before the first expiration, zero for a timer
+ *                disarmed until apr_poll_timer_set()
+ * @param interval The time between the next expirations, zero for a one
+ *                 shot timer
+ * @param p The pool to use
+ * @return APR_SUCCESS, or APR_ENOTIMPL if not available on this platform.
+ * @remark The timer is based on the monotonic clock, it expires at the
+ *         same (relative) time whatever the changes of the system time.
+ */
+APR_DECLARE(apr_status_t) apr_poll_timer_create(apr_pollfd_t *pfd,
+                                                apr_interval_time_t initial,
+                                                apr_interval_time_t interval,
+                                                apr_pool_t *p);
+
+/**
+ * Rearm (or disarm) a timer descriptor.
+ * @param pfd The descriptor filled by apr_poll_timer_create()
+ * @param initial The time before the next expiration, zero to disarm the
+ *                timer
+ * @param interval The time between the next expirations, zero for a one
+ *                 shot timer
+ * @return APR_SUCCESS, or APR_ENOTIMPL if not available on this platform.
+ * @remark The pending expirations are discarded.
+ */
+APR_DECLARE(apr_status_t) apr_poll_timer_set(const apr_pollfd_t *pfd,
+                                             apr_interval_time_t initial,
+                                             apr_interval_time_t interval);
+
+/**
+ * Consume the expirations of a timer descriptor.
+ * @param pfd The descriptor filled by apr_poll_timer_create()
+ * @param expirations The number of expirations since the last read
+ * @return APR_SUCCESS, or APR_EAGAIN if the timer has not expired.
+ */
+APR_DECLARE(apr_status_t) apr_poll_timer_read(const apr_pollfd_t *pfd,
+                                              apr_uint64_t *expirations);
+
+/** @} */
+
 /** @} */
 
 #ifdef __cplusplus
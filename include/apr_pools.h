@@ -388,6 +388,22 @@ APR_DECLARE(void) apr_pool_destroy_debug(apr_pool_t *p,
     apr_pool_destroy_debug(p, APR_POOL__FILE_LINE__)
 #endif
 
+/**
+ * Set the number of destroyed subpools a pool keeps to recycle, so that
+ * creating a subpool takes one of them rather than a new memnode from
+ * the allocator.
+ * @param p The parent pool
+ * @param max The maximum number of subpools kept, zero (the default) to
+ *        not recycle them
+ * @remark The subpools created afterwards inherit @a max, for their own
+ *         subpools.  Only the subpools using the allocator of @a p are
+ *         recycled, with the first memnode they allocated (the others go
+ *         back to the allocator), and they are given back to the allocator
+ *         when @a p is destroyed.  This is a noop with APR_POOL_DEBUG.
+ */
+APR_DECLARE(void) apr_pool_recycle_max_set(apr_pool_t *p, apr_size_t max)
+                  __attribute__((nonnull(1)));
+
 
 /*
  * Memory allocation
@@ -425,6 +441,39 @@ APR_DECLARE(void *) apr_palloc_debug(apr_pool_t *p, apr_size_t size,
     apr_palloc_debug(p, size, APR_POOL__FILE_LINE__)
 #endif
 
+/**
+ * Allocate a block of memory from a pool, inlining the common case where
+ * it fits in the pool's active block (a bump of its first free byte).
+ * Anything else is handled by apr_palloc().
+ * @param p The pool to allocate from
+ * @param size The amount of memory to allocate
+ * @return The allocated memory
+ * @remark Meant for hot paths making many small allocations. The inlined
+ *         case skips the valgrind redzones and the pool concurrency checks
+ *         (when APR is built with them), so use apr_palloc() for such
+ *         debugging. With APR_POOL_DEBUG this is apr_palloc().
+ */
+#if APR_POOL_DEBUG || defined(DOXYGEN)
+#define apr_palloc_inline(p, size) apr_palloc(p, size)
+#else
+static APR_INLINE void *apr_palloc_inline(apr_pool_t *p, apr_size_t size)
+{
+    /* The active memnode is the first member of the pool structure */
+    apr_memnode_t *active = *(apr_memnode_t **)p;
+    /* APR_ALIGN_DEFAULT(), which apr_general.h defines after including us */
+    apr_size_t aligned = (size + 7) & ~(apr_size_t)7;
+
+    if (aligned >= size
+        && aligned <= (apr_size_t)(active->endp - active->first_avail)) {
+        void *mem = active->first_avail;
+        active->first_avail += aligned;
+        return mem;
+    }
+
+    return apr_palloc(p, size);
+}
+#endif
+
 /**
  * Allocate a block of memory from a pool and set all of the memory to 0
  * @param p The pool to allocate from
@@ -454,6 +503,67 @@ APR_DECLARE(void *) apr_pcalloc_debug(apr_pool_t *p, apr_size_t size,
     apr_pcalloc_debug(p, size, APR_POOL__FILE_LINE__)
 #endif
 
+/**
+ * Resize in place a block of memory allocated from a pool
+ * @param p The pool the block was allocated from
+ * @param mem The block of memory
+ * @param size The size the block was allocated (or last resized) with
+ * @param new_size The new size of the block
+ * @return Non-zero if the block now holds @a new_size bytes, zero if
+ *         it could not grow (and is left unchanged).
+ * @remark Only the last block allocated from the pool can grow, and only
+ *         up to the end of the pool's active memnode. Shrinking always
+ *         succeeds, and gives the memory back to the pool when the block
+ *         is the last allocated.
+ * @remark Growing always fails with APR_POOL_DEBUG or under valgrind.
+ */
+APR_DECLARE(int) apr_presize(apr_pool_t *p, void *mem, apr_size_t size,
+                             apr_size_t new_size)
+                 __attribute__((nonnull(1)));
+
+/**
+ * The state of a pool saved by apr_pool_mark(), to be restored by
+ * apr_pool_rewind().  Its fields are private.
+ */
+typedef struct apr_pool_mark_t {
+    /** The node allocated from at the time of the mark */
+    void *node;
+    /** Its first free byte */
+    char *avail;
+    /** Its allocation count (APR_POOL_DEBUG) */
+    apr_size_t index;
+    /** The number of marks of the pool before this one */
+    apr_uint32_t depth;
+} apr_pool_mark_t;
+
+/**
+ * Mark a pool, for apr_pool_rewind() to release what is allocated from
+ * it afterwards, without the cost of a subpool.
+ * @param p The pool to mark
+ * @param mark The mark, usually on the stack
+ * @remark Marks nest, a rewind to a mark releasing the inner ones.  While
+ *         a pool is marked, it does not reuse the free space of the
+ *         memnodes it had before the mark, nor the structures of the
+ *         cleanups killed.
+ */
+APR_DECLARE(void) apr_pool_mark(apr_pool_t *p, apr_pool_mark_t *mark)
+                  __attribute__((nonnull(1,2)));
+
+/**
+ * Release what was allocated from a pool after a mark, and run the
+ * cleanups registered since, in the reverse order of their registration
+ * (the pre cleanups first).  The memnodes allocated since the mark go back
+ * to the pool's allocator, and the mark with the inner ones are released.
+ * @param p The pool given to apr_pool_mark()
+ * @param mark The mark
+ * @remark Neither the subpools created nor the user data or subprocesses
+ *         set since the mark are rewound, so apr_pool_userdata_set(),
+ *         apr_pool_note_subprocess() and apr_presize() of a block allocated
+ *         before the mark must not be used between the two calls.
+ */
+APR_DECLARE(void) apr_pool_rewind(apr_pool_t *p, apr_pool_mark_t *mark)
+                  __attribute__((nonnull(1,2)));
+
 
 /*
  * Pool Properties
@@ -610,6 +720,32 @@ APR_DECLARE(void) apr_pool_cleanup_register(
                             apr_status_t (*child_cleanup)(void *))
                   __attribute__((nonnull(3,4)));
 
+/** Opaque handle of a registered cleanup */
+typedef struct apr_pool_cleanup_t apr_pool_cleanup_t;
+
+/**
+ * Register a function to be called when a pool is cleared or destroyed,
+ * like apr_pool_cleanup_register(), and get a handle for it.
+ * @param p The pool to register the cleanup with
+ * @param data The data to pass to the cleanup function.
+ * @param plain_cleanup The function to call when the pool is cleared
+ *                      or destroyed
+ * @param child_cleanup The function to call when a child process is about
+ *                      to exec - this function is called in the child, obviously!
+ * @return The handle of the cleanup, for apr_pool_cleanup_kill_ex() or
+ *         apr_pool_cleanup_run_ex() to remove it without searching the
+ *         cleanups of @a p.
+ * @remark The handle is valid until the cleanup is removed (including by
+ *         apr_pool_cleanup_kill() or apr_pool_cleanup_run()), or run by
+ *         the pool; it must not be used afterwards, the pool reusing the
+ *         cleanup for the next ones registered.
+ */
+APR_DECLARE(apr_pool_cleanup_t *) apr_pool_cleanup_register_ex(
+                            apr_pool_t *p, const void *data,
+                            apr_status_t (*plain_cleanup)(void *),
+                            apr_status_t (*child_cleanup)(void *))
+                  __attribute__((nonnull(3,4)));
+
 /**
  * Register a function to be called when a pool is cleared or destroyed.
  *
@@ -643,6 +779,16 @@ APR_DECLARE(void) apr_pool_cleanup_kill(apr_pool_t *p, const void *data,
                                         apr_status_t (*cleanup)(void *))
                   __attribute__((nonnull(3)));
 
+/**
+ * Remove a cleanup registered with apr_pool_cleanup_register_ex(), in
+ * constant time.
+ * @param p The pool the cleanup is registered with
+ * @param cleanup The handle of the cleanup
+ */
+APR_DECLARE(void) apr_pool_cleanup_kill_ex(apr_pool_t *p,
+                                           apr_pool_cleanup_t *cleanup)
+                  __attribute__((nonnull(1,2)));
+
 /**
  * Replace the child cleanup function of a previously registered cleanup.
  *
@@ -676,6 +822,17 @@ APR_DECLARE(apr_status_t) apr_pool_cleanup_run(apr_pool_t *p, void *data,
                                                apr_status_t (*cleanup)(void *))
                           __attribute__((nonnull(3)));
 
+/**
+ * Remove a cleanup registered with apr_pool_cleanup_register_ex(), in
+ * constant time, and run its plain cleanup function.
+ * @param p The pool the cleanup is registered with
+ * @param cleanup The handle of the cleanup
+ * @return The value returned by the cleanup function
+ */
+APR_DECLARE(apr_status_t) apr_pool_cleanup_run_ex(apr_pool_t *p,
+                                                  apr_pool_cleanup_t *cleanup)
+                          __attribute__((nonnull(1,2)));
+
 /**
  * An empty cleanup function.
  *
@@ -783,6 +940,83 @@ APR_DECLARE(void) apr_pool_lock(apr_pool_t *pool, int flag);
 
 /** @} */
 
+/**
+ * @defgroup PoolProfile Pool Allocation Profiling
+ *
+ * A sampling profiler of the pools' allocations, aggregated by pool tag
+ * (see apr_pool_tag()), for production builds.
+ * @{
+ */
+
+/** Number of buckets of the apr_pool_profile_t size histogram */
+#define APR_POOL_PROFILE_BUCKETS 24
+
+/**
+ * The profile of the pools sharing a tag, made of the sampled events.
+ */
+typedef struct apr_pool_profile_t {
+    /** The tag of the pools, NULL for untagged pools */
+    const char *tag;
+    /** Number of allocations */
+    apr_uint64_t allocs;
+    /** Number of bytes requested by the allocations */
+    apr_uint64_t alloc_bytes;
+    /** Histogram of the allocation sizes, sizes[n] counts the
+     *  allocations of 2^n to 2^(n+1)-1 bytes (the last bucket counts
+     *  all the bigger ones too) */
+    apr_uint64_t sizes[APR_POOL_PROFILE_BUCKETS];
+    /** Number of pool lifetimes (clears and destroys) */
+    apr_uint64_t lifetimes;
+    /** Sum of the memnodes used by the pools at the end of their
+     *  lifetimes, divide by lifetimes for the average */
+    apr_uint64_t nodes;
+    /** Maximum number of memnodes used in a lifetime */
+    apr_size_t max_nodes;
+    /** Maximum number of bytes used in a lifetime */
+    apr_size_t peak_bytes;
+} apr_pool_profile_t;
+
+/**
+ * Start, tune or stop profiling the pools' allocations.
+ * @param sample_rate Sample one event (allocation, clear or destroy)
+ *        out of @a sample_rate, per thread, 1 to record them all or 0
+ *        to stop profiling.
+ * @return APR_SUCCESS, APR_ENOMEM, or APR_ENOTIMPL with APR_POOL_DEBUG.
+ * @remark Stopping profiling keeps the profiles recorded so far.
+ * @remark The allocations made by apr_palloc_inline()'s fast path are
+ *         not sampled.
+ * @remark Up to 256 tags are profiled separately, the following ones are
+ *         accounted to a single "(other)" profile.
+ */
+APR_DECLARE(apr_status_t) apr_pool_profile_set(apr_uint32_t sample_rate);
+
+/**
+ * Forget all the profiles recorded so far.
+ */
+APR_DECLARE(void) apr_pool_profile_reset(void);
+
+/**
+ * Callback for apr_pool_profile_do()
+ * @param baton The baton given to apr_pool_profile_do()
+ * @param profile The profile of a tag
+ * @return Non-zero to continue, zero to stop the iteration
+ */
+typedef int (apr_pool_profile_cb_t)(void *baton,
+                                    const apr_pool_profile_t *profile);
+
+/**
+ * Iterate over the profiles recorded so far.
+ * @param cb The callback run for each profile
+ * @param baton The baton passed to @a cb
+ * @return Zero if the iteration was stopped by @a cb (or could not be
+ *         run), non-zero otherwise.
+ * @remark @a cb is run on a snapshot of the profiles, thus can allocate
+ *         from pools.
+ */
+APR_DECLARE(int) apr_pool_profile_do(apr_pool_profile_cb_t *cb, void *baton);
+
+/** @} */
+
 /** @} */
 
 #ifdef __cplusplus
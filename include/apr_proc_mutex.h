@@ -50,7 +50,10 @@ typedef enum {
     APR_LOCK_PROC_PTHREAD,  /**< POSIX pthread process-based locking */
     APR_LOCK_POSIXSEM,      /**< POSIX semaphore process-based locking */
     APR_LOCK_DEFAULT,       /**< Use the default process lock */
-    APR_LOCK_DEFAULT_TIMED  /**< Use the default process timed lock */
+    APR_LOCK_DEFAULT_TIMED, /**< Use the default process timed lock */
+    APR_LOCK_FUTEX          /**< Linux futex in shared memory, locked in
+                             *   userspace when uncontended and recovered
+                             *   when its owner process dies */
 } apr_lockmech_e;
 
 /** Opaque structure representing a process mutex. */
@@ -72,6 +75,7 @@ typedef struct apr_proc_mutex_t apr_proc_mutex_t;
  *            APR_LOCK_SYSVSEM
  *            APR_LOCK_POSIXSEM
  *            APR_LOCK_PROC_PTHREAD
+ *            APR_LOCK_FUTEX
  *            APR_LOCK_DEFAULT     pick the default mechanism for the platform
  * </PRE>
  * @param pool the pool from which to allocate the mutex.
@@ -177,6 +181,18 @@ APR_DECLARE(const char *) apr_proc_mutex_defname(void);
  */
 APR_PERMS_SET_IMPLEMENT(proc_mutex);
 
+/**
+ * Tag a process mutex for the lock contention profiling.
+ * @param mutex The mutex to tag.
+ * @param tag The tag, not copied.
+ * @return APR_ENOTIMPL if APR_HAS_LOCK_PROFILE is 0.
+ * @remark The profile is kept in the memory of each process, inherited
+ *         by the children.
+ * @see apr_lock_profile.h
+ */
+APR_DECLARE(apr_status_t) apr_proc_mutex_tag(apr_proc_mutex_t *mutex,
+                                             const char *tag);
+
 /**
  * Get the pool used by this proc_mutex.
  * @return apr_pool_t the pool
@@ -0,0 +1,166 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_PROC_RWLOCK_H
+#define APR_PROC_RWLOCK_H
+
+/**
+ * @file apr_proc_rwlock.h
+ * @brief APR Process Reader/Writer Lock Routines
+ */
+
+#include "apr.h"
+#include "apr_pools.h"
+#include "apr_errno.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * @defgroup apr_proc_rwlock Process Reader/Writer Lock Routines
+ * @ingroup APR
+ * @{
+ */
+
+/** Opaque structure representing a process read-write lock. */
+typedef struct apr_proc_rwlock_t apr_proc_rwlock_t;
+
+/*   Function definitions */
+
+/**
+ * Create and initialize a read-write lock that can be used to synchronize
+ * processes, for data in shared memory read by many and written by few.
+ * The lock lives in memory inherited by the children forked afterwards,
+ * and also synchronizes the threads of each process.
+ * @param rwlock the memory address where the newly created lock will be
+ *        stored.
+ * @param fname A file name to use if the lock mechanism requires one.  The
+ *        process-shared pthread read-write lock doesn't, so it may be NULL.
+ * @param pool the pool from which to allocate the lock.
+ * @return APR_ENOTIMPL if the platform has no process-shared read-write
+ *         locks.
+ * @warning Unlike the robust mutexes, the lock is not recovered when a
+ *          process dies while holding it.
+ */
+APR_DECLARE(apr_status_t) apr_proc_rwlock_create(apr_proc_rwlock_t **rwlock,
+                                                 const char *fname,
+                                                 apr_pool_t *pool);
+
+/**
+ * Re-open a read-write lock in a child process.
+ * @param rwlock The newly re-opened lock structure.
+ * @param fname A file name to use if the lock mechanism requires one.  This
+ *              argument should be the same as the one passed to
+ *              apr_proc_rwlock_create().
+ * @param pool The pool to operate on.
+ * @remark This function must be called to maintain portability, even
+ *         if the underlying lock mechanism does not require it.
+ */
+APR_DECLARE(apr_status_t) apr_proc_rwlock_child_init(
+                                                  apr_proc_rwlock_t **rwlock,
+                                                  const char *fname,
+                                                  apr_pool_t *pool);
+
+/**
+ * Acquire a shared-read lock on the given read-write lock, sleeping while
+ * a writer holds it.
+ * @param rwlock the read-write lock on which to acquire the shared read.
+ */
+APR_DECLARE(apr_status_t) apr_proc_rwlock_rdlock(apr_proc_rwlock_t *rwlock);
+
+/**
+ * Attempt to acquire the shared-read lock on the given read-write lock.
+ * If a writer holds it, the call returns immediately with APR_EBUSY, to be
+ * checked with the APR_STATUS_IS_EBUSY(s) macro for portability.
+ * @param rwlock the read-write lock on which to attempt the shared read.
+ */
+APR_DECLARE(apr_status_t) apr_proc_rwlock_tryrdlock(
+                                                  apr_proc_rwlock_t *rwlock);
+
+/**
+ * Acquire an exclusive-write lock on the given read-write lock, sleeping
+ * while readers or another writer hold it.
+ * @param rwlock the read-write lock on which to acquire the exclusive write.
+ */
+APR_DECLARE(apr_status_t) apr_proc_rwlock_wrlock(apr_proc_rwlock_t *rwlock);
+
+/**
+ * Attempt to acquire the exclusive-write lock on the given read-write lock.
+ * If readers or a writer hold it, the call returns immediately with
+ * APR_EBUSY, to be checked with the APR_STATUS_IS_EBUSY(s) macro for
+ * portability.
+ * @param rwlock the read-write lock on which to attempt the exclusive write.
+ */
+APR_DECLARE(apr_status_t) apr_proc_rwlock_trywrlock(
+                                                  apr_proc_rwlock_t *rwlock);
+
+/**
+ * Release either the read or write lock currently held by the calling
+ * thread on the given read-write lock.
+ * @param rwlock the read-write lock to be released (unlocked).
+ */
+APR_DECLARE(apr_status_t) apr_proc_rwlock_unlock(apr_proc_rwlock_t *rwlock);
+
+/**
+ * Destroy the read-write lock and free the associated memory, the last
+ * process referencing it destroying the lock itself.
+ * @param rwlock the read-write lock to destroy.
+ */
+APR_DECLARE(apr_status_t) apr_proc_rwlock_destroy(apr_proc_rwlock_t *rwlock);
+
+/**
+ * Tag a process read-write lock for the lock contention profiling.
+ * @param rwlock The read-write lock to tag.
+ * @param tag The tag, not copied.
+ * @return APR_ENOTIMPL if APR_HAS_LOCK_PROFILE is 0.
+ * @remark The profile is kept in the memory of each process, inherited
+ *         by the children.
+ * @see apr_lock_profile.h
+ */
+APR_DECLARE(apr_status_t) apr_proc_rwlock_tag(apr_proc_rwlock_t *rwlock,
+                                              const char *tag);
+
+/**
+ * Get the pool used by this proc_rwlock.
+ * @return apr_pool_t the pool
+ */
+APR_POOL_DECLARE_ACCESSOR(proc_rwlock);
+
+/* Since the process read-write locks also synchronize the threads, they
+ * are global locks too, like the process mutexes of APR_PROC_MUTEX_IS_GLOBAL
+ * platforms.
+ */
+
+#define apr_global_rwlock_t          apr_proc_rwlock_t
+#define apr_global_rwlock_create     apr_proc_rwlock_create
+#define apr_global_rwlock_child_init apr_proc_rwlock_child_init
+#define apr_global_rwlock_rdlock     apr_proc_rwlock_rdlock
+#define apr_global_rwlock_tryrdlock  apr_proc_rwlock_tryrdlock
+#define apr_global_rwlock_wrlock     apr_proc_rwlock_wrlock
+#define apr_global_rwlock_trywrlock  apr_proc_rwlock_trywrlock
+#define apr_global_rwlock_unlock     apr_proc_rwlock_unlock
+#define apr_global_rwlock_destroy    apr_proc_rwlock_destroy
+#define apr_global_rwlock_pool_get   apr_proc_rwlock_pool_get
+#define apr_global_rwlock_tag        apr_proc_rwlock_tag
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* ! APR_PROC_RWLOCK_H */
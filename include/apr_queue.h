@@ -57,6 +57,30 @@ APR_DECLARE(apr_status_t) apr_queue_create(apr_queue_t **queue,
                                            unsigned int queue_capacity,
                                            apr_pool_t *a);
 
+/** Use a lock-free ring, @see apr_queue_create_ex() */
+#define APR_QUEUE_LOCKFREE 0x01
+
+/**
+ * create a FIFO queue, with flags
+ * @param queue The new queue
+ * @param queue_capacity maximum size of the queue
+ * @param flags 0 or APR_QUEUE_LOCKFREE to push and pop the elements
+ *        through a bounded lock-free ring, where the threads block
+ *        (on the queue's mutex and condition variables) only when the
+ *        queue is full or empty
+ * @param a pool to allocate queue from
+ * @returns APR_EINVAL for unknown flags, or a lock-free queue of a
+ *          capacity below 2
+ * @remark The lock-free queue relies on the 64-bit apr_atomic functions,
+ *         it is of no benefit on platforms where they are mutex based.
+ * @remark apr_queue_size() of a lock-free queue includes the elements
+ *         being pushed or popped.
+ */
+APR_DECLARE(apr_status_t) apr_queue_create_ex(apr_queue_t **queue,
+                                              unsigned int queue_capacity,
+                                              apr_uint32_t flags,
+                                              apr_pool_t *a);
+
 /**
  * push/add an object to the queue, blocking if the queue is already full
  *
@@ -135,6 +159,114 @@ APR_DECLARE(apr_status_t) apr_queue_timedpush(apr_queue_t *queue, void *data,
 APR_DECLARE(apr_status_t) apr_queue_timedpop(apr_queue_t *queue, void **data,
                                              apr_interval_time_t timeout);
 
+/**
+ * push/add objects to the queue, blocking while the queue is full
+ *
+ * @param queue the queue
+ * @param data the objects
+ * @param n the number of objects
+ * @param pushed the number of objects pushed, the first ones of @a data
+ *        which there was room for (at least one unless @a n is 0)
+ * @returns APR_EINTR the blocking was interrupted (try again)
+ * @returns APR_EOF the queue has been terminated
+ * @returns APR_SUCCESS on a successful push
+ * @remark The objects are pushed at once, waking up as many consumers.
+ */
+APR_DECLARE(apr_status_t) apr_queue_push_n(apr_queue_t *queue, void **data,
+                                           unsigned int n,
+                                           unsigned int *pushed);
+
+/**
+ * push/add objects to the queue, returning immediately if the queue is full
+ *
+ * @param queue the queue
+ * @param data the objects
+ * @param n the number of objects
+ * @param pushed the number of objects pushed, the first ones of @a data
+ * @returns APR_EINTR the blocking operation was interrupted (try again)
+ * @returns APR_EAGAIN the queue is full
+ * @returns APR_EOF the queue has been terminated
+ * @returns APR_SUCCESS on a successful push
+ */
+APR_DECLARE(apr_status_t) apr_queue_trypush_n(apr_queue_t *queue,
+                                              void **data, unsigned int n,
+                                              unsigned int *pushed);
+
+/**
+ * push/add objects to the queue, waiting a maximum of timeout microseconds
+ * before returning if the queue is full
+ *
+ * @param queue the queue
+ * @param data the objects
+ * @param n the number of objects
+ * @param pushed the number of objects pushed, the first ones of @a data
+ * @param timeout the timeout
+ * @returns APR_EINTR the blocking operation was interrupted (try again)
+ * @returns APR_EAGAIN the queue is full and timeout is 0
+ * @returns APR_TIMEUP the queue is full and the timeout expired
+ * @returns APR_EOF the queue has been terminated
+ * @returns APR_SUCCESS on a successful push
+ */
+APR_DECLARE(apr_status_t) apr_queue_timedpush_n(apr_queue_t *queue,
+                                                void **data, unsigned int n,
+                                                unsigned int *pushed,
+                                                apr_interval_time_t timeout);
+
+/**
+ * pop/get all the objects available in the queue (up to max), blocking
+ * while the queue is empty
+ *
+ * @param queue the queue
+ * @param data where to put the objects, in their order in the queue
+ * @param max the maximum number of objects
+ * @param popped the number of objects popped (at least one unless @a max
+ *        is 0)
+ * @returns APR_EINTR the blocking was interrupted (try again)
+ * @returns APR_EOF if the queue has been terminated
+ * @returns APR_SUCCESS on a successful pop
+ * @remark The objects are popped at once, waking up as many producers.
+ */
+APR_DECLARE(apr_status_t) apr_queue_pop_n(apr_queue_t *queue, void **data,
+                                          unsigned int max,
+                                          unsigned int *popped);
+
+/**
+ * pop/get all the objects available in the queue (up to max), returning
+ * immediately if the queue is empty
+ *
+ * @param queue the queue
+ * @param data where to put the objects, in their order in the queue
+ * @param max the maximum number of objects
+ * @param popped the number of objects popped
+ * @returns APR_EINTR the blocking operation was interrupted (try again)
+ * @returns APR_EAGAIN the queue is empty
+ * @returns APR_EOF the queue has been terminated
+ * @returns APR_SUCCESS on a successful pop
+ */
+APR_DECLARE(apr_status_t) apr_queue_trypop_n(apr_queue_t *queue, void **data,
+                                             unsigned int max,
+                                             unsigned int *popped);
+
+/**
+ * pop/get all the objects available in the queue (up to max), waiting a
+ * maximum of timeout microseconds before returning if the queue is empty
+ *
+ * @param queue the queue
+ * @param data where to put the objects, in their order in the queue
+ * @param max the maximum number of objects
+ * @param popped the number of objects popped
+ * @param timeout the timeout
+ * @returns APR_EINTR the blocking operation was interrupted (try again)
+ * @returns APR_EAGAIN the queue is empty and timeout is 0
+ * @returns APR_TIMEUP the queue is empty and the timeout expired
+ * @returns APR_EOF the queue has been terminated
+ * @returns APR_SUCCESS on a successful pop
+ */
+APR_DECLARE(apr_status_t) apr_queue_timedpop_n(apr_queue_t *queue,
+                                               void **data, unsigned int max,
+                                               unsigned int *popped,
+                                               apr_interval_time_t timeout);
+
 /**
  * returns the size of the queue.
  *
@@ -33,6 +33,8 @@
 #include "apr_buckets.h"
 #include "apr_reslist.h"
 #include "apr_hash.h"
+#include "apr_poll.h"
+#include "apr_tables.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -70,6 +72,12 @@ typedef enum
 /** Opaque redis client connection object */
 typedef struct apr_redis_conn_t apr_redis_conn_t;
 
+/** Opaque client side metrics of a server, see apr_redis_server_metrics() */
+typedef struct apr_redis_counters_t apr_redis_counters_t;
+
+/** Opaque background prober of the dead servers */
+typedef struct apr_redis_prober_t apr_redis_prober_t;
+
 /** Redis Server Info Object */
 typedef struct apr_redis_server_t apr_redis_server_t;
 struct apr_redis_server_t
@@ -86,8 +94,10 @@ struct apr_redis_server_t
 #if APR_HAS_THREADS
     apr_thread_mutex_t *lock;
 #endif
-    apr_time_t btime;
+    apr_time_t btime; /**< Last death or retry, apr_time_monotonic() */
     apr_uint32_t rwto;
+    apr_uint32_t weight; /**< Share of the keys on a ketama ring, 1 by default */
+    apr_redis_counters_t *counters; /**< Client side metrics */
     struct
     {
         int major;
@@ -99,6 +109,24 @@ struct apr_redis_server_t
 
 typedef struct apr_redis_t apr_redis_t;
 
+/** Opaque ketama ring of the servers */
+typedef struct apr_redis_ring_t apr_redis_ring_t;
+
+/** Opaque in-process cache of the values */
+typedef struct apr_redis_near_cache_t apr_redis_near_cache_t;
+
+/**
+ * apr_redis_create() flag: select the servers on a ketama ring
+ * @see apr_redis_find_server_hash_ketama
+ */
+#define APR_RC_FLAG_KETAMA 0x1
+
+/**
+ * apr_redis_create() flag: select the servers with the jump hash
+ * @see apr_redis_find_server_hash_jump
+ */
+#define APR_RC_FLAG_JUMP   0x2
+
 /* Custom hash callback function prototype, user for server selection.
 * @param baton user selected baton
 * @param data data to hash
@@ -119,7 +147,7 @@ typedef apr_redis_server_t* (*apr_redis_server_func)(void *baton,
 /** Container for a set of redis servers */
 struct apr_redis_t
 {
-    apr_uint32_t flags; /**< Flags, Not currently used */
+    apr_uint32_t flags; /**< Flags given to apr_redis_create() */
     apr_uint16_t nalloc; /**< Number of Servers Allocated */
     apr_uint16_t ntotal; /**< Number of Servers Added */
     apr_redis_server_t **live_servers; /**< Array of Servers */
@@ -128,6 +156,9 @@ struct apr_redis_t
     apr_redis_hash_func hash_func;
     void *server_baton;
     apr_redis_server_func server_func;
+    apr_redis_ring_t *ring; /**< Ketama ring, with APR_RC_FLAG_KETAMA */
+    apr_redis_near_cache_t *near_cache; /**< See apr_redis_near_cache_create() */
+    apr_redis_prober_t *prober; /**< See apr_redis_prober_start() */
 };
 
 /**
@@ -173,6 +204,31 @@ APR_DECLARE(apr_redis_server_t *) apr_redis_find_server_hash_default(void *baton
                                                                       apr_redis_t *rc,
                                                                       const apr_uint32_t hash);
 
+/**
+ * server selection on a ketama ring: each server owns 160 points per unit
+ * of weight on a circle of hashes, and a key goes to the owner of the
+ * first point at or after its hash.  Adding or removing a server only
+ * moves the keys of its own points, and a dead server's keys go to the
+ * owners of the next points.
+ * @remark The ring is built by apr_redis_add_server() on the client
+ *         objects created with APR_RC_FLAG_KETAMA, NULL is returned for
+ *         the others.
+ */
+APR_DECLARE(apr_redis_server_t *) apr_redis_find_server_hash_ketama(void *baton,
+                                                                     apr_redis_t *rc,
+                                                                     const apr_uint32_t hash);
+
+/**
+ * server selection with the jump consistent hash: growing the servers
+ * from n to n + 1 only moves the keys going to the new server.
+ * @remark Servers can only be added or removed at the end of the list,
+ *         and the weights are ignored.  A dead server's keys go to the
+ *         next live server.
+ */
+APR_DECLARE(apr_redis_server_t *) apr_redis_find_server_hash_jump(void *baton,
+                                                                   apr_redis_t *rc,
+                                                                   const apr_uint32_t hash);
+
 /**
  * Adds a server to a client object
  * @param rc The redis client object to use
@@ -240,14 +296,56 @@ APR_DECLARE(apr_status_t) apr_redis_server_create(apr_pool_t *p,
  * Creates a new redisd client object
  * @param p Pool to use
  * @param max_servers maximum number of servers
- * @param flags Not currently used
+ * @param flags APR_RC_FLAG_KETAMA or APR_RC_FLAG_JUMP to select the
+ *        servers with a consistent hash, or 0 for the default selection
  * @param rc   location of the new redis client object
+ * @remark With a consistent hash, the keys are hashed with the pure crc32
+ *         hash by default.  A custom hash_func or server_func set
+ *         afterwards still takes precedence.
  */
 APR_DECLARE(apr_status_t) apr_redis_create(apr_pool_t *p,
                                            apr_uint16_t max_servers,
                                            apr_uint32_t flags,
                                            apr_redis_t **rc);
 
+/**
+ * Probe the dead servers in a background thread
+ * @param rc client to use
+ * @param interval The delay before the first probe of a server gone dead
+ * @param max_interval The maximum delay between two probes of a server,
+ *        the delay doubling after each failed probe
+ * @return APR_SUCCESS, APR_EEXIST if already started, APR_EINVAL for bad
+ *         intervals, or APR_ENOTIMPL without APR_HAS_THREADS
+ * @remark Otherwise a request finding a dead server probes it itself,
+ *         every 5 seconds, and waits for the connect timeout when it is
+ *         still dead.  With the prober started, the requests only ever
+ *         see the live or dead state of the servers.
+ * @remark The prober stops when the pool of @a rc is cleared.
+ */
+APR_DECLARE(apr_status_t) apr_redis_prober_start(apr_redis_t *rc,
+                                                 apr_interval_time_t interval,
+                                                 apr_interval_time_t max_interval);
+
+/**
+ * Put an in-process cache of the values in front of apr_redis_getp()
+ * @param rc client to use
+ * @param max_items The maximum number of values kept, the least recently
+ *        used ones being evicted first
+ * @param max_size The maximum size of a value kept
+ * @param ttl How long a value is kept
+ * @remark The concurrent misses on a key are coalesced: one thread gets
+ *         the value from the server while the others wait for it.
+ * @remark The sets, deletes, increments and decrements through @a rc
+ *         (pipelined or not) invalidate the values of their keys, but
+ *         changes by other clients are seen after up to @a ttl only.
+ * @remark apr_redis_multgetp() and the pipelined gets do not use the
+ *         cache.
+ */
+APR_DECLARE(apr_status_t) apr_redis_near_cache_create(apr_redis_t *rc,
+                                                      apr_uint32_t max_items,
+                                                      apr_size_t max_size,
+                                                      apr_interval_time_t ttl);
+
 /**
  * Gets a value from the server, allocating the value out of p
  * @param rc client to use
@@ -355,6 +453,17 @@ APR_DECLARE(apr_status_t) apr_redis_decr(apr_redis_t *rc,
  */
 APR_DECLARE(apr_status_t) apr_redis_ping(apr_redis_server_t *rs);
 
+/**
+ * Add a key to a hash for a multiget query
+ *  if the hash (*value) is NULL it will be created
+ * @param data_pool pool from where the hash and their items are created from
+ * @param key null terminated string containing the key
+ * @param values hash of keys and values that this key will be added to
+ */
+APR_DECLARE(void) apr_redis_add_multget_key(apr_pool_t *data_pool,
+                                            const char *key,
+                                            apr_hash_t **values);
+
 /**
  * Gets multiple values from the server, allocating the values out of p
  * @param rc client to use
@@ -363,7 +472,16 @@ APR_DECLARE(apr_status_t) apr_redis_ping(apr_redis_server_t *rs);
  * @param data_pool Pool used to allocate data for the returned values.
  * @param values hash of apr_redis_value_t keyed by strings, contains the
  *        result of the multiget call.
- * @return
+ * @return APR_SUCCESS if all the servers returned their values, else the
+ *         error of one which did not
+ * @remark The keys are sent with one MGET per server, all the servers
+ *         being sent to before any reply is read.
+ * @remark The values added by apr_redis_add_multget_key() are updated in
+ *         place: a found key gets a '$' value with its (null terminated)
+ *         data, a missing one a '$' value with NULL data, and one whose
+ *         server replied with an error a '-' value with the message.  The
+ *         type of the values of the servers which did not reply stays
+ *         zero.
  */
 APR_DECLARE(apr_status_t) apr_redis_multgetp(apr_redis_t *rc,
                                              apr_pool_t *temp_pool,
@@ -450,6 +568,333 @@ APR_DECLARE(apr_status_t) apr_redis_stats(apr_redis_server_t *rs,
                                           apr_pool_t *p,
                                           apr_redis_stats_t **stats);
 
+/** Number of buckets of an apr_redis_latency_t */
+#define APR_RC_LATENCY_BUCKETS 128
+
+/**
+ * Client side latency histogram, in microseconds.
+ *
+ * The buckets are log-linear like those of HDR histograms: each power of
+ * two is split in 4 buckets of equal width, so a bucket spans a quarter
+ * of its lower bound at most.  See apr_redis_latency_bucket_limit()
+ * for the bounds.
+ */
+typedef struct
+{
+    /** Number of latencies recorded */
+    apr_uint64_t count;
+    /** Sum of the latencies recorded */
+    apr_uint64_t sum;
+    /** Highest latency recorded */
+    apr_uint64_t max;
+    /** Number of latencies recorded per bucket */
+    apr_uint64_t buckets[APR_RC_LATENCY_BUCKETS];
+} apr_redis_latency_t;
+
+/**
+ * Client side metrics of a server, recorded by the client itself whatever
+ * the server reports with apr_redis_stats().
+ *
+ * The latencies of a request are measured from the acquisition of its
+ * connection: to the end of the request write (when the reply starts to
+ * be waited for), to the reception of the first reply line, and to the
+ * release of the connection.  The requests which fail on a broken
+ * connection are counted as errors, not in the histograms.
+ */
+typedef struct
+{
+    /** Number of requests (connections acquired) */
+    apr_uint64_t requests;
+    /** Number of requests failed on a connection found broken */
+    apr_uint64_t errors;
+    /** Number of connections established */
+    apr_uint64_t connects;
+    /** Number of connections which could not be established */
+    apr_uint64_t connect_errors;
+    /** Number of connections established to replace a broken one */
+    apr_uint64_t reconnects;
+    /** Number of times the server was marked dead */
+    apr_uint64_t deaths;
+    /** Total time the server was dead, including the current period */
+    apr_interval_time_t dead_time;
+    /** Time to establish a connection */
+    apr_redis_latency_t connect;
+    /** Time to write a request */
+    apr_redis_latency_t send;
+    /** Time to the first line of a reply */
+    apr_redis_latency_t first_byte;
+    /** Time to complete a request */
+    apr_redis_latency_t total;
+} apr_redis_metrics_t;
+
+/**
+ * Read the client side metrics of a server
+ * @param rs      server to read the metrics of
+ * @param metrics location to copy the metrics to
+ * @remark The counters are updated atomically but read one by one, so
+ *         requests running concurrently may be partly accounted for.
+ */
+APR_DECLARE(apr_status_t) apr_redis_server_metrics(apr_redis_server_t *rs,
+                                                   apr_redis_metrics_t *metrics);
+
+/**
+ * Reset the client side metrics of a server
+ * @param rs server to reset the metrics of
+ */
+APR_DECLARE(void) apr_redis_server_metrics_reset(apr_redis_server_t *rs);
+
+/**
+ * Get the (exclusive) upper bound of a latency histogram bucket
+ * @param bucket index of the bucket, below APR_RC_LATENCY_BUCKETS
+ * @return The lowest latency counted by the next bucket, or -1 for the
+ *         last bucket which counts all the higher latencies
+ */
+APR_DECLARE(apr_interval_time_t) apr_redis_latency_bucket_limit(int bucket);
+
+/**
+ * Estimate a percentile of a latency histogram
+ * @param lat        the histogram
+ * @param percentile the percentile, between 0 and 100
+ * @return The upper bound of the bucket holding the percentile, capped by
+ *         the highest latency recorded, or 0 if nothing was recorded
+ */
+APR_DECLARE(apr_interval_time_t) apr_redis_latency_percentile(const apr_redis_latency_t *lat,
+                                                              double percentile);
+
+/** Opaque pipeline of redis commands */
+typedef struct apr_redis_pipeline_t apr_redis_pipeline_t;
+
+/** The reply to a pipelined command */
+typedef struct apr_redis_reply_t
+{
+    /** APR_SUCCESS, APR_NOTFOUND for a GET of a missing key or the DEL
+     * of none, APR_EEXIST for a SET not done, APR_EGENERAL for an error
+     * reply, or the error which prevented the command from completing */
+    apr_status_t status;
+    /** The RESP type of the reply: '+', '-', ':', '$' or '*', or zero
+     * when no reply was received */
+    char type;
+    /** The key of the command */
+    const char *key;
+    /** The (null terminated) string of a '+', '-' or '$' reply, or NULL
+     * for a nil bulk string */
+    const char *data;
+    /** The length of data */
+    apr_size_t len;
+    /** The value of a ':' reply, or the number of elements of a '*' one
+     * (the elements themselves are not returned) */
+    apr_int64_t integer;
+} apr_redis_reply_t;
+
+/**
+ * Callback completing a pipelined command
+ * @param baton The baton given with the command
+ * @param reply The reply, which (with its data) is valid during the
+ *        call only
+ */
+typedef void (apr_redis_reply_cb_t)(void *baton,
+                                    const apr_redis_reply_t *reply);
+
+/**
+ * Create a pipeline, where the commands are queued per server until
+ * sent altogether, with one write per connection.
+ * @param pl The location of the new pipeline
+ * @param rc The client to use
+ * @param p The pool to allocate from, which must outlive the commands
+ * @remark A pipeline is not thread safe, but can be reused once all the
+ *         replies of its commands are received.
+ */
+APR_DECLARE(apr_status_t) apr_redis_pipeline_create(apr_redis_pipeline_t **pl,
+                                                    apr_redis_t *rc,
+                                                    apr_pool_t *p);
+
+/**
+ * Queue a command in a pipeline
+ * @param pl The pipeline
+ * @param key The key selecting the server, usually one of the arguments
+ * @param argc The number of arguments, starting with the command name
+ * @param argv The arguments
+ * @param argvlen The lengths of the arguments, or NULL for null
+ *        terminated arguments
+ * @param cb The callback run with the reply, or NULL
+ * @param baton The baton passed to @a cb
+ * @remark The key and the arguments are not copied, thus must stay valid
+ *         until the commands are sent.
+ */
+APR_DECLARE(apr_status_t) apr_redis_pipeline_command(apr_redis_pipeline_t *pl,
+                                                     const char *key,
+                                                     int argc,
+                                                     const char **argv,
+                                                     const apr_size_t *argvlen,
+                                                     apr_redis_reply_cb_t *cb,
+                                                     void *baton);
+
+/**
+ * Queue a GET in a pipeline
+ * @see apr_redis_pipeline_command
+ */
+APR_DECLARE(apr_status_t) apr_redis_pipeline_get(apr_redis_pipeline_t *pl,
+                                                 const char *key,
+                                                 apr_redis_reply_cb_t *cb,
+                                                 void *baton);
+
+/**
+ * Queue a SET, or a SETEX if @a timeout is not zero, in a pipeline
+ * @see apr_redis_pipeline_command
+ */
+APR_DECLARE(apr_status_t) apr_redis_pipeline_set(apr_redis_pipeline_t *pl,
+                                                 const char *key,
+                                                 const char *data,
+                                                 apr_size_t data_size,
+                                                 apr_uint32_t timeout,
+                                                 apr_redis_reply_cb_t *cb,
+                                                 void *baton);
+
+/**
+ * Queue a DEL in a pipeline
+ * @see apr_redis_pipeline_command
+ */
+APR_DECLARE(apr_status_t) apr_redis_pipeline_delete(apr_redis_pipeline_t *pl,
+                                                    const char *key,
+                                                    apr_redis_reply_cb_t *cb,
+                                                    void *baton);
+
+/**
+ * Send the queued commands and wait for all their replies.
+ * @param pl The pipeline
+ * @return APR_SUCCESS, or the first error of a connection, whose
+ *         commands are completed with that error.
+ */
+APR_DECLARE(apr_status_t) apr_redis_pipeline_exec(apr_redis_pipeline_t *pl);
+
+/**
+ * Send the queued commands, with one write per connection, without
+ * waiting for the replies.
+ * @param pl The pipeline
+ * @param pollset If not NULL, where the connections waiting for replies
+ *        are added (APR_POLLIN), with @a pl as client_data
+ * @return APR_SUCCESS, or the first error of a connection, whose
+ *         commands are completed with that error.
+ * @remark The replies are then received with apr_redis_pipeline_process()
+ *         or apr_redis_pipeline_exec().
+ */
+APR_DECLARE(apr_status_t) apr_redis_pipeline_send(apr_redis_pipeline_t *pl,
+                                                  apr_pollset_t *pollset);
+
+/**
+ * Receive the replies available on a connection of a pipeline, without
+ * blocking, and run the callbacks of the completed commands.
+ * @param pl The pipeline
+ * @param pfd The descriptor signaled by apr_pollset_poll(), whose
+ *        client_data is @a pl
+ * @return APR_EAGAIN while replies are missing on this connection, or
+ *         APR_SUCCESS once all of them were received (the connection is
+ *         removed from the pollset then), or an error.
+ */
+APR_DECLARE(apr_status_t) apr_redis_pipeline_process(apr_redis_pipeline_t *pl,
+                                                     const apr_pollfd_t *pfd);
+
+/**
+ * The number of commands of a pipeline waiting to be sent or replied to
+ * @param pl The pipeline
+ */
+APR_DECLARE(apr_size_t) apr_redis_pipeline_pending(apr_redis_pipeline_t *pl);
+
+/** A RESP2 or RESP3 value, as replied by a server */
+typedef struct apr_redis_value_t apr_redis_value_t;
+
+struct apr_redis_value_t
+{
+    /** The RESP type of the value: '+', '-', ':', '$' or '*' (RESP2), or
+     * '_', ',', '#', '!', '=', '(', '%', '~' or '>' (RESP3) */
+    char type;
+    /** The (null terminated) string of a '+', '-', ',' or '(' value, or
+     * of a '$', '!' or '=' one not longer than the flatten_max given,
+     * else NULL (notably for a nil '$') */
+    const char *data;
+    /** The contents of a '$', '!' or '=' value longer than the
+     * flatten_max given, else NULL */
+    apr_bucket_brigade *bb;
+    /** The length of data or bb */
+    apr_size_t len;
+    /** The value of a ':' value, or of a '#' one (1 or 0) */
+    apr_int64_t integer;
+    /** The elements (apr_redis_value_t) of a '*', '~' or '>' value, or
+     * the keys and values in turn of a '%' one, or NULL for a nil '*' */
+    apr_array_header_t *elts;
+    /** The attributes ('|') preceding the value, or NULL */
+    apr_redis_value_t *attributes;
+};
+
+/**
+ * Read a value from a brigade
+ * @param bb The brigade, whose buckets are read (blocking) as needed and
+ *        removed up to the end of the value
+ * @param p The pool to allocate the value from
+ * @param flatten_max The length up to which the '$', '!' and '=' strings
+ *        are copied in the value's data, the longer ones being moved (not
+ *        copied) out of @a bb to the value's bb
+ * @param value The location of the value read
+ * @return APR_SUCCESS, APR_INCOMPLETE if @a bb ended before the value,
+ *         APR_EGENERAL for a malformed value, APR_ENOTIMPL for a RESP3
+ *         streamed string or aggregate, or the error reading @a bb
+ * @remark On error, @a bb is left in an undefined state.
+ * @remark The verbatim strings ('=') start with their format, like
+ *         "txt:".
+ */
+APR_DECLARE(apr_status_t) apr_redis_value_read(apr_bucket_brigade *bb,
+                                               apr_pool_t *p,
+                                               apr_size_t flatten_max,
+                                               apr_redis_value_t **value);
+
+/**
+ * Run a command and read its reply
+ * @param rc The client to use
+ * @param key The key selecting the server, usually one of the arguments
+ * @param argc The number of arguments, starting with the command name
+ * @param argv The arguments
+ * @param argvlen The lengths of the arguments, or NULL for null
+ *        terminated arguments
+ * @param p The pool to allocate the reply from
+ * @param ba The allocator of the reply's brigades, thus of the buffers
+ *        the reply is received in
+ * @param flatten_max See apr_redis_value_read()
+ * @param reply The location of the reply
+ * @return APR_SUCCESS with the reply, including an error one ('-' or '!'),
+ *         or the error of the server
+ * @remark The reply is read directly in buffers from @a ba, and the long
+ *         strings are returned with these buffers, thus without a copy.
+ * @remark Any aggregate is returned whole, like the reply of an MGET
+ *         (whose keys must all be on the server of @a key) or of an
+ *         HGETALL.
+ */
+APR_DECLARE(apr_status_t) apr_redis_command(apr_redis_t *rc,
+                                            const char *key,
+                                            int argc,
+                                            const char **argv,
+                                            const apr_size_t *argvlen,
+                                            apr_pool_t *p,
+                                            apr_bucket_alloc_t *ba,
+                                            apr_size_t flatten_max,
+                                            apr_redis_value_t **reply);
+
+/**
+ * Get a value as a brigade
+ * @param rc The client to use
+ * @param key null terminated string containing the key
+ * @param bb The brigade where the value is appended, with buffers from
+ *        its allocator (its buckets being allocated from its pool)
+ * @param len The location of the length of the value, or NULL
+ * @return APR_SUCCESS, APR_NOTFOUND if the key does not exist, or an error
+ * @remark Unlike apr_redis_getp(), the value is not copied once received,
+ *         so large values can be forwarded as they are.  The near cache
+ *         is not used.
+ */
+APR_DECLARE(apr_status_t) apr_redis_getb(apr_redis_t *rc,
+                                         const char *key,
+                                         apr_bucket_brigade *bb,
+                                         apr_size_t *len);
+
 /** @} */
 
 #ifdef __cplusplus
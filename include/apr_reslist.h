@@ -136,6 +136,25 @@ APR_DECLARE(apr_status_t) apr_reslist_acquire_ex(apr_reslist_t *reslist,
 APR_DECLARE(apr_status_t) apr_reslist_acquire(apr_reslist_t *reslist,
                                               void **resource);
 
+/**
+ * Retrieve several resources from the list at once, locking it once.
+ * Either all @a n resources are acquired, or none.
+ * @param reslist The resource list.
+ * @param resources The array where the pointers to the @a n resources
+ *                  will be stored.
+ * @param n The number of resources to acquire, up to the hard maximum.
+ * @param flags Bitmask of APR_RESLIST_ACQUIRE_* flags.
+ * @remark If we meet our maximum number of resources, we will block
+ *         until enough become available, holding those acquired so far,
+ *         so the concurrent batches had better use a timeout (see
+ *         apr_reslist_timeout_set()).
+ * @remark The stashed resources (see apr_reslist_affinity_set()) are not
+ *         used unless the maximum is met.
+ */
+APR_DECLARE(apr_status_t) apr_reslist_acquire_batch(apr_reslist_t *reslist,
+                                                    void **resources, int n,
+                                                    int flags);
+
 /**
  * Return a resource back to the list of available resources.
  * @param reslist The resource list.
@@ -176,6 +195,49 @@ APR_DECLARE(apr_status_t) apr_reslist_invalidate(apr_reslist_t *reslist,
  */
 APR_DECLARE(apr_status_t) apr_reslist_maintain(apr_reslist_t *reslist);
 
+/**
+ * Keep the released resources in per-thread stashes, so that a thread
+ * acquiring and releasing a resource usually does not lock the list.
+ * @param reslist The resource list.
+ * @param stash The number of idle resources each stash can hold.
+ * @return APR_SUCCESS, APR_EINVAL if @a stash is not positive, APR_EEXIST
+ *         if already set, or APR_ENOTIMPL without threads or thread local
+ *         storage.
+ * @remark The threads share a fixed number of stashes, round robin.  A
+ *         thread acquires from its stash first, LIFO (APR_RESLIST_ACQUIRE_FIFO
+ *         always uses the list), and releases to it unless it is full.
+ *         An acquirer blocked by the hard maximum takes all the stashed
+ *         resources, and nothing is stashed until it gets one.
+ * @remark The stashed resources expire (reach their ttl) only when found
+ *         by an acquirer, and are not destroyed by the reslist maintenance.
+ * @remark Must be called before the reslist is used by several threads.
+ */
+APR_DECLARE(apr_status_t) apr_reslist_affinity_set(apr_reslist_t *reslist,
+                                                   int stash);
+
+/**
+ * Construct the resources in a background thread rather than in the
+ * acquiring threads.
+ * @param reslist The resource list.
+ * @param interval The period over which the acquisitions finding no
+ *                 available resource are counted.
+ * @return APR_SUCCESS, APR_EINVAL if @a interval is not positive,
+ *         APR_EEXIST if already started, or APR_ENOTIMPL without threads.
+ * @remark The replenisher keeps the available resources above the
+ *         minimum plus a moving average of the acquisitions per interval
+ *         which found none, within the hard maximum.  An acquirer finding
+ *         no available resource waits for one (up to the timeout set by
+ *         apr_reslist_timeout_set()), and fails with the status of the
+ *         constructor if a construction fails meanwhile.
+ * @remark The constructor is then called without the reslist lock, thus
+ *         concurrently with the other calls to the reslist.  It must not
+ *         allocate from the reslist's pool, but may create a subpool of
+ *         it if the pool's allocator has a mutex.
+ * @remark The replenisher stops when the reslist is destroyed.
+ */
+APR_DECLARE(apr_status_t) apr_reslist_replenish_start(apr_reslist_t *reslist,
+                                                      apr_interval_time_t interval);
+
 /**
  * Set reslist cleanup order.
  * @param reslist The resource list.
@@ -0,0 +1,171 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_RESOLVER_H
+#define APR_RESOLVER_H
+/**
+ * @file apr_resolver.h
+ * @brief APR Caching and Asynchronous Name Resolver
+ */
+#include "apr.h"
+#include "apr_pools.h"
+#include "apr_errno.h"
+#include "apr_time.h"
+#include "apr_network_io.h"
+#include "apr_poll.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * @defgroup apr_resolver Caching and Asynchronous Name Resolver
+ * @ingroup APR
+ *
+ * An apr_resolver_t resolves host names with apr_sockaddr_info_get() and
+ * caches the results, successful or not, for a configured time.  It can
+ * be shared by the threads of a process: apr_resolver_lookup() blocks the
+ * calling thread on a cache miss, while apr_resolver_resolve() has the
+ * name resolved by the threads of the resolver and a callback called by
+ * apr_resolver_process(), once the descriptor of the resolver polls as
+ * readable.  Concurrent requests for the same name share one resolution.
+ * @{
+ */
+
+/**
+ * @defgroup resolverflags Resolver Flags
+ * @ingroup apr_resolver
+ * @{
+ */
+#define APR_RESOLVER_HAPPY_EYEBALLS 0x001 /**< Return the addresses of the
+                                           * two families interleaved, the
+                                           * family of the first one first
+                                           * (RFC 8305)
+                                           */
+/** @} */
+
+/** Opaque structure used for the resolver API */
+typedef struct apr_resolver_t apr_resolver_t;
+
+/**
+ * Callback of apr_resolver_resolve(), called by apr_resolver_process()
+ * @param baton The baton of apr_resolver_resolve()
+ * @param status The status of apr_sockaddr_info_get()
+ * @param sa The addresses, allocated from the pool of
+ *           apr_resolver_resolve(), NULL on failure
+ */
+typedef void (*apr_resolver_cb_t)(void *baton, apr_status_t status,
+                                  apr_sockaddr_t *sa);
+
+/**
+ * Create a resolver
+ * @param resolver The resolver created
+ * @param nthreads The number of threads resolving the names of
+ *                 apr_resolver_resolve(), zero to resolve them in the
+ *                 calling thread
+ * @param ttl How long a successful resolution is cached
+ * @param negative_ttl How long a failed resolution is cached
+ * @param flags Zero or APR_RESOLVER_HAPPY_EYEBALLS
+ * @param p The pool of the resolver, destroying it stops the threads
+ *          once they have finished their current resolution
+ * @return APR_ENOTIMPL if nthreads is not zero and threads are not
+ *         available.
+ */
+APR_DECLARE(apr_status_t) apr_resolver_create(apr_resolver_t **resolver,
+                                              apr_int32_t nthreads,
+                                              apr_interval_time_t ttl,
+                                              apr_interval_time_t negative_ttl,
+                                              apr_uint32_t flags,
+                                              apr_pool_t *p);
+
+/**
+ * Resolve a host name, from the cache of the resolver if possible
+ * @param sa The addresses, allocated from p
+ * @param resolver The resolver
+ * @param hostname The host name, as for apr_sockaddr_info_get()
+ * @param family The address family, as for apr_sockaddr_info_get()
+ * @param port The port of the addresses
+ * @param flags The flags of apr_sockaddr_info_get()
+ * @param p The pool for the addresses
+ * @remark The port is not part of the cache key, the names are resolved
+ *         without a port and the port is set on the copy returned.
+ */
+APR_DECLARE(apr_status_t) apr_resolver_lookup(apr_sockaddr_t **sa,
+                                              apr_resolver_t *resolver,
+                                              const char *hostname,
+                                              apr_int32_t family,
+                                              apr_port_t port,
+                                              apr_int32_t flags,
+                                              apr_pool_t *p);
+
+/**
+ * Resolve a host name without blocking
+ * @param resolver The resolver
+ * @param hostname The host name, as for apr_sockaddr_info_get()
+ * @param family The address family, as for apr_sockaddr_info_get()
+ * @param port The port of the addresses
+ * @param flags The flags of apr_sockaddr_info_get()
+ * @param func The callback, called by apr_resolver_process() even for a
+ *             name found in the cache
+ * @param baton The baton of func
+ * @param p The pool for the request and the addresses, which must live
+ *          until func is called and be usable by the thread calling
+ *          apr_resolver_process()
+ */
+APR_DECLARE(apr_status_t) apr_resolver_resolve(apr_resolver_t *resolver,
+                                               const char *hostname,
+                                               apr_int32_t family,
+                                               apr_port_t port,
+                                               apr_int32_t flags,
+                                               apr_resolver_cb_t func,
+                                               void *baton,
+                                               apr_pool_t *p);
+
+/**
+ * Get the descriptor of a resolver, to add to an apr_pollset_t
+ * @param pfd The descriptor, which polls as readable (APR_POLLIN) when
+ *            there are callbacks for apr_resolver_process() to call.  Its
+ *            client_data is the resolver.
+ * @param resolver The resolver
+ */
+APR_DECLARE(apr_status_t) apr_resolver_pollfd_get(const apr_pollfd_t **pfd,
+                                                  apr_resolver_t *resolver);
+
+/**
+ * Call the callbacks of the resolutions completed
+ * @param resolver The resolver
+ * @param num The number of callbacks called, may be NULL
+ * @remark Callbacks may call apr_resolver_resolve() again, their calls
+ *         are made by the next apr_resolver_process().
+ */
+APR_DECLARE(apr_status_t) apr_resolver_process(apr_resolver_t *resolver,
+                                               apr_int32_t *num);
+
+/**
+ * Remove all the names from the cache of a resolver
+ * @param resolver The resolver
+ * @remark The resolutions running still complete the requests waiting
+ *         for them.
+ */
+APR_DECLARE(void) apr_resolver_clear(apr_resolver_t *resolver);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* ! APR_RESOLVER_H */
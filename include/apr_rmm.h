@@ -57,6 +57,42 @@ APR_DECLARE(apr_status_t) apr_rmm_init(apr_rmm_t **rmm, apr_anylock_t *lock,
                                        void *membuf, apr_size_t memsize,
                                        apr_pool_t *cont);
 
+/**
+ * @defgroup apr_rmm_flags RMM Flags
+ * @{
+ */
+#define APR_RMM_CACHE 0x01 /**< Keep the small blocks freed by this process
+                            * in a cache of its own, reused without taking
+                            * the locks of the arenas */
+/** @} */
+
+/**
+ * Initialize a relocatable memory block split in arenas, each with a lock
+ * of its own.
+ * @param rmm The relocatable memory block
+ * @param locks An array of narenas apr_anylock_t, one per arena, or NULL
+ *              if no locking is required.
+ * @param narenas The number of arenas
+ * @param membuf The block of relocatable memory to be managed
+ * @param memsize The size of relocatable memory block to be managed
+ * @param flags Zero or more of the @ref apr_rmm_flags OR'ed together
+ * @param cont The pool to use for local storage and management
+ * @remark Allocations are served by the arena that served the previous
+ * one, or by the first arena whose lock isn't busy, so processes
+ * allocating at the same time spread over the arenas.  An allocation
+ * never spans two arenas, which each get an even share of memsize.
+ * @remark The blocks kept by the cache of #APR_RMM_CACHE remain in use
+ * for the other processes until apr_rmm_cache_flush() or
+ * apr_rmm_detach() gives them back.
+ */
+APR_DECLARE(apr_status_t) apr_rmm_init_ex(apr_rmm_t **rmm,
+                                          apr_anylock_t *locks,
+                                          int narenas,
+                                          void *membuf,
+                                          apr_size_t memsize,
+                                          apr_uint32_t flags,
+                                          apr_pool_t *cont);
+
 /**
  * Destroy a managed memory block.
  * @param rmm The relocatable memory block to destroy
@@ -73,12 +109,35 @@ APR_DECLARE(apr_status_t) apr_rmm_destroy(apr_rmm_t *rmm);
 APR_DECLARE(apr_status_t) apr_rmm_attach(apr_rmm_t **rmm, apr_anylock_t *lock,
                                          void *membuf, apr_pool_t *cont);
 
+/**
+ * Attach to a relocatable memory block initialized by apr_rmm_init_ex().
+ * @param rmm The relocatable memory block
+ * @param locks An array of narenas apr_anylock_t, one per arena, or NULL
+ * @param narenas The number of arenas, as given to apr_rmm_init_ex()
+ * @param membuf The block of relocatable memory already under management
+ * @param flags Zero or more of the @ref apr_rmm_flags OR'ed together
+ * @param cont The pool to use for local storage and management
+ * @return APR_EINVAL if membuf isn't managed with narenas arenas
+ */
+APR_DECLARE(apr_status_t) apr_rmm_attach_ex(apr_rmm_t **rmm,
+                                            apr_anylock_t *locks,
+                                            int narenas,
+                                            void *membuf,
+                                            apr_uint32_t flags,
+                                            apr_pool_t *cont);
+
 /**
  * Detach from the managed block of memory.
  * @param rmm The relocatable memory block to detach from
  */
 APR_DECLARE(apr_status_t) apr_rmm_detach(apr_rmm_t *rmm);
 
+/**
+ * Give the blocks of the cache of #APR_RMM_CACHE back to their arenas.
+ * @param rmm The relocatable memory block
+ */
+APR_DECLARE(apr_status_t) apr_rmm_cache_flush(apr_rmm_t *rmm);
+
 /**
  * Allocate memory from the block of relocatable memory.
  * @param rmm The relocatable memory block
@@ -126,6 +185,7 @@ APR_DECLARE(apr_rmm_off_t) apr_rmm_offset_get(apr_rmm_t *rmm, void *entity);
 /**
  * Compute the required overallocation of memory needed to fit n allocs
  * @param n The number of alloc/calloc regions desired
+ * @remark This is for a single arena, as initialized by apr_rmm_init().
  */
 APR_DECLARE(apr_size_t) apr_rmm_overhead_get(int n);
 
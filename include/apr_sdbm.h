@@ -59,6 +59,8 @@ typedef struct {
 #define APR_SDBM_DIRFEXT	".dir"
 /** SDBM page file extension */
 #define APR_SDBM_PAGFEXT	".pag"
+/** SDBM overflow file extension, for the large values (apr_sdbm_open_ex) */
+#define APR_SDBM_OVFFEXT	".ovf"
 
 /* flags to sdbm_store */
 #define APR_SDBM_INSERT     0   /**< Insert */
@@ -83,11 +85,38 @@ typedef struct {
  * @param p The pool to use when creating the sdbm
  * @remark The sdbm name is not a true file name, as sdbm appends suffixes
  * for seperate data and index files.
+ * @remark An sdbm opened read-only without APR_FOPEN_SHARELOCK holds its
+ * shared lock until closed, so it is memory mapped where supported and
+ * apr_sdbm_fetch() can then be called from multiple threads at once.
  */
 APR_DECLARE(apr_status_t) apr_sdbm_open(apr_sdbm_t **db, const char *name,
                                         apr_int32_t mode,
                                         apr_fileperms_t perms, apr_pool_t *p);
 
+/**
+ * Open an sdbm database by file name, with a given page size if created
+ * @param db The newly opened database
+ * @param name The sdbm file to open
+ * @param mode The flag values, as for apr_sdbm_open()
+ * @param perms Permissions to apply to if created
+ * @param pagesize The page size of a new database, a power of two from
+ * 1024 to 16384, or 0 for the format of apr_sdbm_open()
+ * @param p The pool to use when creating the sdbm
+ * @remark An existing database keeps the page size it was created with,
+ * whatever pagesize.
+ * @remark A database created with a page size has a header in its
+ * directory file, and stores the values larger than an eighth of a page
+ * in a third file (APR_SDBM_OVFFEXT), whose blocks are reused once freed.
+ * The keys can then be nearly pagesize bytes long, and the values of any
+ * size.
+ * @return APR_EINVAL for an invalid pagesize.
+ */
+APR_DECLARE(apr_status_t) apr_sdbm_open_ex(apr_sdbm_t **db, const char *name,
+                                           apr_int32_t mode,
+                                           apr_fileperms_t perms,
+                                           apr_size_t pagesize,
+                                           apr_pool_t *p);
+
 /**
  * Close an sdbm file previously opened by apr_sdbm_open
  * @param db The database to close
@@ -122,6 +151,9 @@ APR_DECLARE(apr_status_t) apr_sdbm_unlock(apr_sdbm_t *db);
  * @param db The database
  * @param value The value datum retrieved for this record
  * @param key The key datum to find this record
+ * @remark The value points into the database: it is overwritten by the
+ * next call, unless the database is memory mapped (see apr_sdbm_open),
+ * where it is valid until the database is closed.
  */
 APR_DECLARE(apr_status_t) apr_sdbm_fetch(apr_sdbm_t *db,
                                          apr_sdbm_datum_t *value,
@@ -141,6 +173,21 @@ APR_DECLARE(apr_status_t) apr_sdbm_fetch(apr_sdbm_t *db,
 APR_DECLARE(apr_status_t) apr_sdbm_store(apr_sdbm_t *db, apr_sdbm_datum_t key,
                                          apr_sdbm_datum_t value, int opt);
 
+/**
+ * Fetch several sdbm record values by key
+ * @param db The database
+ * @param values The nkeys value datums retrieved, with a NULL dptr for
+ * the records that do not exist
+ * @param keys The key datums of the records
+ * @param nkeys The number of keys
+ * @param pool The pool the values are copied into
+ * @remark The keys are looked up grouped by page, under a single lock.
+ */
+APR_DECLARE(apr_status_t) apr_sdbm_fetch_multi(apr_sdbm_t *db,
+                                               apr_sdbm_datum_t *values,
+                                               const apr_sdbm_datum_t *keys,
+                                               int nkeys, apr_pool_t *pool);
+
 /**
  * Delete an sdbm record value by key
  * @param db The database
@@ -168,10 +215,58 @@ APR_DECLARE(apr_status_t) apr_sdbm_firstkey(apr_sdbm_t *db, apr_sdbm_datum_t *ke
  */
 APR_DECLARE(apr_status_t) apr_sdbm_nextkey(apr_sdbm_t *db, apr_sdbm_datum_t *key);
 
+/**
+ * Callback of apr_sdbm_iterate
+ * @param baton The baton given to apr_sdbm_iterate
+ * @param key The key datum of the record
+ * @param value The value datum of the record
+ * @return 0 to stop the iteration, non-zero to continue
+ */
+typedef int (apr_sdbm_iterate_cb_t)(void *baton, apr_sdbm_datum_t key,
+                                    apr_sdbm_datum_t value);
+
+/**
+ * Call a function for each record of an sdbm, page by page
+ * @param db The database
+ * @param cb The function called with the key and value of each record
+ * @param baton The baton passed to cb
+ * @remark The key and value are read without a lookup per key, and are
+ * valid until cb returns or fetches a record.  cb must not store or
+ * delete records: the database is locked for reading while iterating.
+ */
+APR_DECLARE(apr_status_t) apr_sdbm_iterate(apr_sdbm_t *db,
+                                           apr_sdbm_iterate_cb_t *cb,
+                                           void *baton);
+
 /**
  * Returns true if the sdbm database opened for read-only access
  * @param db The database to test
  */
 APR_DECLARE(int) apr_sdbm_rdonly(apr_sdbm_t *db);
+
+/**
+ * Set the number of pages, and of directory blocks, an sdbm caches
+ * @param db The database
+ * @param nblocks The number of blocks of each cached, from 0 (the
+ * default, only the current page and directory block) to 65536
+ * @remark The least recently used blocks are evicted first.  The blocks
+ * changed by apr_sdbm_store and apr_sdbm_delete are only written when
+ * evicted or when the lock is released, by the last apr_sdbm_unlock or
+ * by apr_sdbm_close.  A database opened for writing without
+ * APR_FOPEN_SHARELOCK holds its lock until closed.  The cache is emptied
+ * whenever the lock is taken again.
+ */
+APR_DECLARE(apr_status_t) apr_sdbm_cache_set(apr_sdbm_t *db,
+                                             apr_size_t nblocks);
+
+/**
+ * Get the hits and misses of an sdbm cache, to size it
+ * @param db The database
+ * @param hits The number of blocks found in the cache, if not NULL
+ * @param misses The number of blocks read from the files, if not NULL
+ * @remark The counts accumulate from the first apr_sdbm_cache_set.
+ */
+APR_DECLARE(void) apr_sdbm_cache_stats(apr_sdbm_t *db, apr_size_t *hits,
+                                       apr_size_t *misses);
 /** @} */
 #endif /* APR_SDBM_H */
@@ -114,6 +114,21 @@ APR_DECLARE(void) apr_sha1_update_binary(apr_sha1_ctx_t *context,
 APR_DECLARE(void) apr_sha1_final(unsigned char digest[APR_SHA1_DIGESTSIZE],
                                apr_sha1_ctx_t *context);
 
+/**
+ * Compute the SHA1 digests of several independent messages at once
+ * @param digests The output buffers, one for each message
+ * @param inputs The messages
+ * @param lens The lengths of the messages
+ * @param n The number of messages
+ * @remark As with apr_sha1_update_binary(), the messages are hashed
+ * without any character set conversion.  Without SHA instructions in
+ * the CPU, the messages are hashed four at a time in vector lanes, so
+ * messages of similar lengths are best passed together.
+ */
+APR_DECLARE(void) apr_sha1_multi(unsigned char (*digests)[APR_SHA1_DIGESTSIZE],
+                                 const unsigned char *const *inputs,
+                                 const apr_size_t *lens, int n);
+
 #ifdef __cplusplus
 }
 #endif
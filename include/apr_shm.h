@@ -86,6 +86,21 @@ APR_DECLARE(apr_status_t) apr_shm_create(apr_shm_t **m,
                                * segment in the "Global" namespace on
                                * Windows.  (Ignored on other platforms.)
                                */
+#define APR_SHM_HUGE_PAGES  4 /* Back the segment with reserved huge pages
+                               * (MAP_HUGETLB, SHM_HUGETLB) when there
+                               * are enough of them, or else ask for
+                               * transparent huge pages.  (Ignored where
+                               * unsupported.)
+                               */
+#define APR_SHM_POPULATE    8 /* Fault the whole segment in when creating
+                               * or attaching to it, rather than on first
+                               * touch.  (Ignored where unsupported.)
+                               */
+#define APR_SHM_NUMA_INTERLEAVE 16 /* Interleave the pages of the segment
+                                    * over the NUMA nodes allowed, when
+                                    * creating it.  (Ignored where
+                                    * unsupported.)
+                                    */
 
 /**
  * Create and make accessible a shared memory segment with platform-
@@ -0,0 +1,153 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_SHM_HASH_H
+#define APR_SHM_HASH_H
+/**
+ * @file apr_shm_hash.h
+ * @brief APR Shared Memory Hash Tables
+ */
+#include "apr.h"
+#include "apr_pools.h"
+#include "apr_errno.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * @defgroup apr_shm_hash Shared Memory Hash Tables
+ * @ingroup APR
+ *
+ * A fixed capacity hash table of fixed size keys and values, stored in a
+ * block of memory shared by processes (such as an apr_shm_t segment) at
+ * any address, since it holds no pointers.  Lookups take no lock: they
+ * copy the entries under per slot sequence counters and retry when a
+ * writer changed them meanwhile.  Writers of the same key are serialized
+ * by spinlocks taken with apr_atomic_cas32(), and writers of different
+ * keys only contend on the slots they change.
+ * @{
+ */
+
+/** Opaque shared memory hash table structure */
+typedef struct apr_shm_hash_t apr_shm_hash_t;
+
+/**
+ * @defgroup apr_shm_hash_flags Shared Memory Hash Table Flags
+ * @{
+ */
+#define APR_SHM_HASH_EVICT 0x01 /**< When a key has no room left, replace
+                                 * an entry not looked up recently
+                                 * (clock eviction) rather than failing */
+/** @} */
+
+/**
+ * Compute the size of the memory needed by a table
+ * @param capacity The number of entries, rounded up to a power of two
+ * @param key_size The maximum length of the keys
+ * @param val_size The maximum length of the values
+ */
+APR_DECLARE(apr_size_t) apr_shm_hash_size_get(apr_uint32_t capacity,
+                                              apr_size_t key_size,
+                                              apr_size_t val_size);
+
+/**
+ * Create a table in a block of memory
+ * @param ht The table created
+ * @param membuf The memory block, aligned with APR_ALIGN_DEFAULT
+ * @param memsize The size of the memory block, at least what
+ *                apr_shm_hash_size_get() returns for the other arguments
+ * @param capacity The number of entries, rounded up to a power of two
+ * @param key_size The maximum length of the keys
+ * @param val_size The maximum length of the values
+ * @param flags Zero or more of the @ref apr_shm_hash_flags OR'ed together
+ * @param p The pool for the local view of the table
+ */
+APR_DECLARE(apr_status_t) apr_shm_hash_create(apr_shm_hash_t **ht,
+                                              void *membuf,
+                                              apr_size_t memsize,
+                                              apr_uint32_t capacity,
+                                              apr_size_t key_size,
+                                              apr_size_t val_size,
+                                              apr_uint32_t flags,
+                                              apr_pool_t *p);
+
+/**
+ * Attach to a table created by another process
+ * @param ht The table attached
+ * @param membuf The memory block of the table, mapped at any address
+ * @param p The pool for the local view of the table
+ * @return APR_EINVAL if membuf doesn't hold a table
+ */
+APR_DECLARE(apr_status_t) apr_shm_hash_attach(apr_shm_hash_t **ht,
+                                              void *membuf,
+                                              apr_pool_t *p);
+
+/**
+ * Look up a key
+ * @param ht The table
+ * @param key The key
+ * @param klen The length of the key
+ * @param val The buffer receiving the value, of the table's val_size
+ * @param vlen If not NULL, receives the length of the value
+ * @return APR_SUCCESS, or APR_NOTFOUND
+ */
+APR_DECLARE(apr_status_t) apr_shm_hash_get(apr_shm_hash_t *ht,
+                                           const void *key,
+                                           apr_size_t klen,
+                                           void *val,
+                                           apr_size_t *vlen);
+
+/**
+ * Add or replace the value of a key
+ * @param ht The table
+ * @param key The key
+ * @param klen The length of the key
+ * @param val The value
+ * @param vlen The length of the value
+ * @return APR_SUCCESS, APR_EINVAL if the key or value is too long, or
+ *         APR_ENOSPC if the table is full, without #APR_SHM_HASH_EVICT
+ */
+APR_DECLARE(apr_status_t) apr_shm_hash_set(apr_shm_hash_t *ht,
+                                           const void *key,
+                                           apr_size_t klen,
+                                           const void *val,
+                                           apr_size_t vlen);
+
+/**
+ * Remove a key
+ * @param ht The table
+ * @param key The key
+ * @param klen The length of the key
+ * @return APR_SUCCESS, or APR_NOTFOUND
+ */
+APR_DECLARE(apr_status_t) apr_shm_hash_remove(apr_shm_hash_t *ht,
+                                              const void *key,
+                                              apr_size_t klen);
+
+/**
+ * Get the number of entries of a table
+ * @param ht The table
+ */
+APR_DECLARE(apr_uint32_t) apr_shm_hash_count(apr_shm_hash_t *ht);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* ! APR_SHM_HASH_H */
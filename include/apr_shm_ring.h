@@ -0,0 +1,153 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef APR_SHM_RING_H
+#define APR_SHM_RING_H
+/**
+ * @file apr_shm_ring.h
+ * @brief APR Shared Memory Ring Buffers
+ */
+#include "apr.h"
+#include "apr_pools.h"
+#include "apr_errno.h"
+#include "apr_file_io.h"
+#include "apr_time.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * @defgroup apr_shm_ring Shared Memory Ring Buffers
+ * @ingroup APR
+ *
+ * A ring buffer of variable length messages, stored in a block of memory
+ * shared by processes (such as an apr_shm_t segment) at any address,
+ * since it holds no pointers.  Any number of producers push messages,
+ * which a single consumer pops in the order the producers reserved their
+ * room.  Pushing and popping take no lock and make no system call, but
+ * to wake up a consumer waiting for messages, with a futex where
+ * available, or a write to the file given to apr_shm_ring_notify_set()
+ * so that the consumer can poll it with an apr_pollset_t.
+ * @{
+ */
+
+/** Opaque shared memory ring buffer structure */
+typedef struct apr_shm_ring_t apr_shm_ring_t;
+
+/**
+ * Compute the size of the memory needed by a ring buffer
+ * @param capacity The number of bytes for the messages, rounded up to a
+ *                 power of two
+ */
+APR_DECLARE(apr_size_t) apr_shm_ring_size_get(apr_size_t capacity);
+
+/**
+ * Create a ring buffer in a block of memory
+ * @param ring The ring buffer created
+ * @param membuf The memory block, aligned with APR_ALIGN_DEFAULT
+ * @param memsize The size of the memory block, at least what
+ *                apr_shm_ring_size_get() returns for @a capacity
+ * @param capacity The number of bytes for the messages, rounded up to a
+ *                 power of two, at most 1GB
+ * @param p The pool for the local view of the ring buffer
+ * @remark Each message takes its length rounded up to 8 bytes, plus 8
+ *         bytes, and can be at most apr_shm_ring_max_get() long.
+ */
+APR_DECLARE(apr_status_t) apr_shm_ring_create(apr_shm_ring_t **ring,
+                                              void *membuf,
+                                              apr_size_t memsize,
+                                              apr_size_t capacity,
+                                              apr_pool_t *p);
+
+/**
+ * Attach to a ring buffer created by another process
+ * @param ring The ring buffer attached
+ * @param membuf The memory block of the ring buffer, mapped at any address
+ * @param p The pool for the local view of the ring buffer
+ * @return APR_EINVAL if membuf doesn't hold a ring buffer
+ */
+APR_DECLARE(apr_status_t) apr_shm_ring_attach(apr_shm_ring_t **ring,
+                                              void *membuf,
+                                              apr_pool_t *p);
+
+/**
+ * Get the maximum length of the messages of a ring buffer
+ * @param ring The ring buffer
+ */
+APR_DECLARE(apr_size_t) apr_shm_ring_max_get(apr_shm_ring_t *ring);
+
+/**
+ * Push a message, from any producer
+ * @param ring The ring buffer
+ * @param data The message
+ * @param len The length of the message
+ * @return APR_SUCCESS, APR_EAGAIN if the ring buffer has no room left
+ *         for the message, or APR_EINVAL if it is too long
+ * @remark A producer dying while it pushes a message blocks the next
+ *         producers, and the consumer, for good.
+ */
+APR_DECLARE(apr_status_t) apr_shm_ring_push(apr_shm_ring_t *ring,
+                                            const void *data,
+                                            apr_size_t len);
+
+/**
+ * Pop the oldest message, from the single consumer
+ * @param ring The ring buffer
+ * @param buf The buffer receiving the message
+ * @param len The size of @a buf on input, the length of the message on
+ *            output
+ * @return APR_SUCCESS, APR_EAGAIN if the ring buffer is empty, or
+ *         APR_ENOSPC if the message is longer than @a buf, the message
+ *         being left in the ring buffer and its length set in @a len
+ */
+APR_DECLARE(apr_status_t) apr_shm_ring_pop(apr_shm_ring_t *ring,
+                                           void *buf,
+                                           apr_size_t *len);
+
+/**
+ * Wait for a message to pop, from the single consumer
+ * @param ring The ring buffer
+ * @param timeout The maximum time to wait, negative to wait forever, or
+ *                zero to return at once after having asked the next
+ *                producer to notify the consumer
+ * @return APR_SUCCESS when a message can be popped, or APR_TIMEUP
+ * @remark Without futexes, the wait polls the ring buffer every
+ *         millisecond.
+ */
+APR_DECLARE(apr_status_t) apr_shm_ring_wait(apr_shm_ring_t *ring,
+                                            apr_interval_time_t timeout);
+
+/**
+ * Set the file that the producers using this local view of the ring
+ * buffer write a byte to, when the consumer waits for messages
+ * @param ring The ring buffer
+ * @param notify The file, usually the non-blocking write end of a pipe
+ *               whose read end the consumer polls, or NULL
+ * @remark The consumer must call apr_shm_ring_wait() with a zero timeout,
+ *         and get APR_TIMEUP, before it polls.
+ */
+APR_DECLARE(void) apr_shm_ring_notify_set(apr_shm_ring_t *ring,
+                                          apr_file_t *notify);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* ! APR_SHM_RING_H */
@@ -46,7 +46,8 @@ extern "C" {
  *        c is the number of compression rounds, d the number of finalization
  *        rounds; we also define fast implementations for c = 2 with d = 4 (aka
  *        siphash-2-4), and c = 4 with d = 8 (aka siphash-4-8), as recommended
- *        parameters per the authors.
+ *        parameters per the authors, and c = 1 with d = 3 (aka siphash-1-3)
+ *        for hash tables.
  */
 
 /** size of the siphash digest */
@@ -140,6 +141,73 @@ APR_DECLARE(void) apr_siphash48_auth(unsigned char out[APR_SIPHASH_DSIZE],
                                      const void *src, apr_size_t len,
                                const unsigned char key[APR_SIPHASH_KSIZE]);
 
+/**
+ * @brief Computes SipHash-1-3, producing a 64bit (APR_SIPHASH_DSIZE) hash
+ * from a message and a 128bit (APR_SIPHASH_KSIZE) secret key.
+ * @param src The message
+ * @param len The length of the message
+ * @param key The secret key
+ * @return The hash value as a 64bit unsigned integer
+ * @remark SipHash-1-3 is faster than SipHash-2-4 and still resists the
+ *         flooding of hash tables with colliding keys, but is not meant to
+ *         be used as a MAC.
+ */
+APR_DECLARE(apr_uint64_t) apr_siphash13(const void *src, apr_size_t len,
+                               const unsigned char key[APR_SIPHASH_KSIZE]);
+
+/**
+ * @brief Computes SipHash-1-3, producing a 64bit (APR_SIPHASH_DSIZE) hash
+ * from a message and a 128bit (APR_SIPHASH_KSIZE) secret key, into a possibly
+ * unaligned buffer (using the little endian representation as defined by the
+ * authors for interoperabilty).
+ * @param out The output buffer
+ * @param src The message
+ * @param len The length of the message
+ * @param key The secret key
+ */
+APR_DECLARE(void) apr_siphash13_auth(unsigned char out[APR_SIPHASH_DSIZE],
+                                     const void *src, apr_size_t len,
+                               const unsigned char key[APR_SIPHASH_KSIZE]);
+
+/**
+ * @brief Computes SipHash-1-3 of several independent messages at once,
+ * with the same 128bit (APR_SIPHASH_KSIZE) secret key.
+ * @param hashes The hash values, one for each message
+ * @param srcs The messages
+ * @param lens The lengths of the messages
+ * @param n The number of messages
+ * @param key The secret key
+ * @remark Where the CPU supports it (AVX2), the messages are hashed four
+ *         at a time in vector lanes, which pays off from a few words long,
+ *         so messages of similar lengths are best passed together.
+ */
+APR_DECLARE(void) apr_siphash13_multi(apr_uint64_t *hashes,
+                                      const void *const *srcs,
+                                      const apr_size_t *lens, int n,
+                               const unsigned char key[APR_SIPHASH_KSIZE]);
+
+/**
+ * @brief A hash function for apr_hash_make_custom() or apr_hash_make_ex(),
+ * computing SipHash-1-3 with the process wide key.
+ * @param key The key
+ * @param klen The length of the key, or APR_HASH_KEY_STRING to use the
+ *             string length, in which case it returns the actual length.
+ * @return The hash value
+ * @see apr_hashfunc_siphash13_key()
+ */
+APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_siphash13(const char *key,
+                                                        apr_ssize_t *klen);
+
+/**
+ * @brief Set the process wide key of apr_hashfunc_siphash13().
+ * @param key The secret key
+ * @remark apr_initialize() sets a random key where random bytes are
+ *         available.  The key must not be changed while hash tables use
+ *         apr_hashfunc_siphash13(), whose entries would not be found.
+ */
+APR_DECLARE(void) apr_hashfunc_siphash13_key(
+                               const unsigned char key[APR_SIPHASH_KSIZE]);
+
 #ifdef __cplusplus
 }
 #endif
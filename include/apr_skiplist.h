@@ -240,6 +240,40 @@ APR_DECLARE(apr_skiplistnode *) apr_skiplist_add_compare(apr_skiplist *sl,
  */
 APR_DECLARE(apr_skiplistnode *) apr_skiplist_add(apr_skiplist* sl, void *data);
 
+/**
+ * Build the skip list from sorted elements, in one linear pass.
+ * @param sl The skip list, which must be empty
+ * @param elems The elements, sorted according to the existing comparison
+ * function (duplicates are added, in the given order, like with
+ * apr_skiplist_add())
+ * @param n The number of elements
+ * @return APR_SUCCESS, APR_EINVAL if the skip list is not empty, if it has no
+ * comparison function or if the elements are not sorted, or APR_ENOMEM.
+ * @remark The height of the towers is not random but balanced: every other
+ * element is one level tall, every other one of the others two levels tall,
+ * and so on.
+ * @remark If APR_ENOMEM is returned, the skip list contains the elements
+ * added until then.
+ */
+APR_DECLARE(apr_status_t) apr_skiplist_build_sorted(apr_skiplist *sl,
+                                                   void **elems, size_t n);
+
+/**
+ * Insert a run of sorted elements into the skip list using the existing
+ * comparison function, each one if it does not already exist (like with
+ * apr_skiplist_insert()).
+ * @param sl The skip list
+ * @param elems The elements, sorted according to the comparison function
+ * @param n The number of elements
+ * @return APR_SUCCESS, APR_EINVAL if the skip list has no comparison function,
+ * or APR_ENOMEM.
+ * @remark Each element is searched for from the place of the previous one,
+ * so the cost depends on the distance between them rather than on the size
+ * of the skip list. An element out of order is searched for from the start.
+ */
+APR_DECLARE(apr_status_t) apr_skiplist_insert_batch(apr_skiplist *sl,
+                                                   void **elems, size_t n);
+
 /**
  * Add an element into the skip list using the specified comparison function
  * removing the existing duplicates.
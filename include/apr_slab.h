@@ -0,0 +1,129 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_SLAB_H
+#define APR_SLAB_H
+
+/**
+ * @file apr_slab.h
+ * @brief APR Fixed-Size Object Caches
+ */
+
+#include "apr.h"
+#include "apr_errno.h"
+#include "apr_pools.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup apr_slab Fixed-Size Object Caches
+ * @ingroup APR
+ *
+ * A slab hands out objects of a single size, carved out of the memnodes
+ * of its pool's allocator. Unlike the pool's memory, the objects can be
+ * freed (and reused) one by one, in constant time.
+ * @{
+ */
+
+/** Opaque slab structure */
+typedef struct apr_slab_t apr_slab_t;
+
+/** @see apr_slab_create() */
+#define APR_SLAB_CACHE_ALIGN  0x01 /**< Align the objects on cache lines */
+#define APR_SLAB_THREAD_SAFE  0x02 /**< Use the slab from multiple threads */
+#define APR_SLAB_MAGAZINES    0x04 /**< Per-thread magazines of objects */
+
+/**
+ * Create a slab of fixed-size objects
+ * @param slab The new slab
+ * @param size The size of the objects
+ * @param flags A combination of:
+ * <PRE>
+ *           APR_SLAB_CACHE_ALIGN   Round up the size to and align the
+ *                                  objects on (64 bytes) cache lines, so
+ *                                  that no two objects share a cache line
+ *           APR_SLAB_THREAD_SAFE   Protect the slab with a mutex
+ *           APR_SLAB_MAGAZINES     Keep per-thread magazines of free
+ *                                  objects in front of the slab, so that
+ *                                  most allocations and frees don't need
+ *                                  the mutex (implies APR_SLAB_THREAD_SAFE)
+ * </PRE>
+ * @param pool The pool whose allocator the memory comes from, and whose
+ *        lifetime the slab has.
+ * @return APR_SUCCESS, APR_EINVAL for unknown flags or a zero @a size, or
+ *         APR_ENOTIMPL if the requested thread support is not available
+ *         on this platform.
+ * @remark The objects are aligned at least on APR_ALIGN_DEFAULT.
+ * @remark Each slab with magazines uses a thread-specific data key, so
+ *         this is meant for a few long-lived slabs shared by many threads.
+ *         The magazine of a thread is given back to the slab when the
+ *         thread exits.
+ */
+APR_DECLARE(apr_status_t) apr_slab_create(apr_slab_t **slab,
+                                          apr_size_t size,
+                                          apr_uint32_t flags,
+                                          apr_pool_t *pool)
+                          __attribute__((nonnull(1,4)));
+
+/**
+ * Allocate an object from the slab
+ * @param slab The slab
+ * @return The object, or NULL if out of memory
+ */
+APR_DECLARE(void *) apr_slab_alloc(apr_slab_t *slab)
+                    __attribute__((nonnull(1)));
+
+/**
+ * Allocate an object from the slab, and set all of its bytes to 0
+ * @param slab The slab
+ * @return The object, or NULL if out of memory
+ */
+APR_DECLARE(void *) apr_slab_calloc(apr_slab_t *slab)
+                    __attribute__((nonnull(1)));
+
+/**
+ * Give an object back to the slab
+ * @param slab The slab the object was allocated from
+ * @param obj The object
+ */
+APR_DECLARE(void) apr_slab_free(apr_slab_t *slab, void *obj)
+                  __attribute__((nonnull(1,2)));
+
+/**
+ * Get the (rounded up) size of the slab's objects
+ * @param slab The slab
+ */
+APR_DECLARE(apr_size_t) apr_slab_object_size(const apr_slab_t *slab)
+                        __attribute__((nonnull(1)));
+
+/**
+ * Destroy the slab now, rather than when its pool is cleared or destroyed
+ * @param slab The slab
+ * @remark All the objects of the slab, allocated or not, are invalidated
+ *         and their memory is given back to the allocator.
+ */
+APR_DECLARE(void) apr_slab_destroy(apr_slab_t *slab)
+                  __attribute__((nonnull(1)));
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !APR_SLAB_H */
@@ -0,0 +1,135 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_STRBUF_H
+#define APR_STRBUF_H
+
+/**
+ * @file apr_strbuf.h
+ * @brief APR String Builders
+ */
+
+#include "apr.h"
+#include "apr_pools.h"
+
+#include <stdarg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup apr_strbuf String Builders
+ * @ingroup apr_strings
+ *
+ * A string builder appends to a string allocated from a pool, doubling
+ * its size as needed. While the string is the last block allocated from
+ * the pool, it grows in place into the rest of the pool's active memnode
+ * rather than being copied, and apr_strbuf_finish() gives the unused
+ * space back.
+ * @{
+ */
+
+/** A string builder, usually on the stack */
+typedef struct apr_strbuf_t {
+    /** The pool the string is allocated from */
+    apr_pool_t *pool;
+    /** The string, always NUL terminated */
+    char *data;
+    /** The length of the string */
+    apr_size_t len;
+    /** The allocated size of @a data, including the NUL */
+    apr_size_t size;
+} apr_strbuf_t;
+
+/**
+ * Initialize a string builder with an empty string
+ * @param sb The string builder
+ * @param p The pool to allocate from
+ * @param size The initial size to allocate, zero to allocate nothing
+ *        until the first append
+ */
+APR_DECLARE(void) apr_strbuf_init(apr_strbuf_t *sb, apr_pool_t *p,
+                                  apr_size_t size);
+
+/**
+ * Make room for appending bytes to a string builder
+ * @param sb The string builder
+ * @param len The number of bytes to make room for
+ * @return Where to write them, the caller then adding @a len (or less)
+ *         to sb->len and writing the NUL at sb->data[sb->len]
+ */
+APR_DECLARE(char *) apr_strbuf_reserve(apr_strbuf_t *sb, apr_size_t len);
+
+/**
+ * Append bytes to a string builder
+ * @param sb The string builder
+ * @param str The bytes to append
+ * @param len The number of bytes
+ */
+APR_DECLARE(void) apr_strbuf_append(apr_strbuf_t *sb, const char *str,
+                                    apr_size_t len);
+
+/**
+ * Append a NUL terminated string to a string builder
+ * @param sb The string builder
+ * @param str The string to append
+ */
+APR_DECLARE(void) apr_strbuf_appendstr(apr_strbuf_t *sb, const char *str);
+
+/**
+ * Append a character to a string builder
+ * @param sb The string builder
+ * @param c The character to append
+ */
+APR_DECLARE(void) apr_strbuf_appendc(apr_strbuf_t *sb, char c);
+
+/**
+ * Append a formatted string to a string builder
+ * @param sb The string builder
+ * @param fmt The format of the string, see apr_vformatter()
+ * @param ap The arguments to use while printing the data
+ */
+APR_DECLARE(void) apr_strbuf_vappendf(apr_strbuf_t *sb, const char *fmt,
+                                      va_list ap);
+
+/**
+ * Append a formatted string to a string builder
+ * @param sb The string builder
+ * @param fmt The format of the string, see apr_vformatter()
+ * @param ... The arguments to use while printing the data
+ */
+APR_DECLARE_NONSTD(void) apr_strbuf_appendf(apr_strbuf_t *sb,
+                                            const char *fmt, ...)
+        __attribute__((format(printf,2,3)));
+
+/**
+ * Finish a string builder
+ * @param sb The string builder
+ * @param len If not NULL, the length of the string is stored here
+ * @return The string, allocated from the pool of @a sb
+ * @remark The string is not copied. The string builder is then empty,
+ *         as if initialized with a zero size.
+ */
+APR_DECLARE(char *) apr_strbuf_finish(apr_strbuf_t *sb, apr_size_t *len);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !APR_STRBUF_H */
@@ -48,6 +48,7 @@
 #include "apr.h"
 #include "apr_errno.h"
 #include "apr_pools.h"
+#include "apr_lib.h"
 #define APR_WANT_IOVEC
 #include "apr_want.h"
 
@@ -182,6 +183,28 @@ APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *p, const char *fmt, va_list ap);
 APR_DECLARE_NONSTD(char *) apr_psprintf(apr_pool_t *p, const char *fmt, ...)
         __attribute__((format(printf,2,3)));
 
+/**
+ * apr_pvsprintf() with a compiled format
+ * @param p The pool to allocate out of
+ * @param format The format compiled by apr_format_compile()
+ * @param ap The arguments to use while printing the data
+ * @return The new string
+ */
+APR_DECLARE(char *) apr_format_pvsprintf(apr_pool_t *p,
+                                         const apr_format_t *format,
+                                         va_list ap);
+
+/**
+ * apr_psprintf() with a compiled format
+ * @param p The pool to allocate out of
+ * @param format The format compiled by apr_format_compile()
+ * @param ... The arguments to use while printing the data
+ * @return The new string
+ */
+APR_DECLARE_NONSTD(char *) apr_format_psprintf(apr_pool_t *p,
+                                               const apr_format_t *format,
+                                               ...);
+
 /**
  * zero out the buffer provided, without being optimized out by
  * the compiler.
@@ -300,6 +323,26 @@ APR_DECLARE_NONSTD(int) apr_snprintf(char *buf, apr_size_t len,
  */
 APR_DECLARE(int) apr_vsnprintf(char *buf, apr_size_t len, const char *format,
                                va_list ap);
+
+/**
+ * apr_snprintf() with a compiled format
+ * @param buf The buffer to write to
+ * @param len The size of the buffer
+ * @param format The format compiled by apr_format_compile()
+ * @param ... The arguments to use to fill out the format string.
+ */
+APR_DECLARE_NONSTD(int) apr_format_snprintf(char *buf, apr_size_t len,
+                                            const apr_format_t *format, ...);
+
+/**
+ * apr_vsnprintf() with a compiled format
+ * @param buf The buffer to write to
+ * @param len The size of the buffer
+ * @param format The format compiled by apr_format_compile()
+ * @param ap The arguments to use to fill out the format string.
+ */
+APR_DECLARE(int) apr_format_vsnprintf(char *buf, apr_size_t len,
+                                      const apr_format_t *format, va_list ap);
 /** @} */
 
 /**
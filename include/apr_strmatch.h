@@ -73,6 +73,162 @@ APR_DECLARE(const char *) apr_strmatch(const apr_strmatch_pattern *pattern,
  */
 APR_DECLARE(const apr_strmatch_pattern *) apr_strmatch_precompile(apr_pool_t *p, const char *s, int case_sensitive);
 
+/**
+ * Search of a pattern across strings, like the buckets of a brigade
+ * @see apr_strmatch_stream_create
+ */
+typedef struct apr_strmatch_stream_t {
+    const apr_strmatch_pattern *pattern; /**< The pattern */
+    char *held;             /**< The last bytes searched, which may begin
+                             * a match, then room for as many of the next */
+    apr_size_t nheld;       /**< The number of bytes held */
+    apr_off_t offset;       /**< The bytes searched, held ones included */
+} apr_strmatch_stream_t;
+
+/**
+ * The size of the buffer of a stream searching for a (non empty) pattern
+ * @see apr_strmatch_stream_init
+ */
+#define APR_STRMATCH_STREAM_BUFSIZE(pattern) (2 * ((pattern)->length - 1))
+
+/**
+ * Create a stream searching for a pattern
+ * @param p The pool from which to allocate the stream
+ * @param pattern The pattern
+ * @return a pointer to the stream, or NULL for an empty pattern
+ * @remark The stream holds back the pattern's length minus one of the
+ *         bytes searched, which may begin a match.
+ */
+APR_DECLARE(apr_strmatch_stream_t *) apr_strmatch_stream_create(
+                                         apr_pool_t *p,
+                                         const apr_strmatch_pattern *pattern);
+
+/**
+ * Initialize a stream searching for a pattern, in the given memory
+ * @param stream The stream
+ * @param pattern The (non empty) pattern
+ * @param buf The buffer of the stream, of
+ *        APR_STRMATCH_STREAM_BUFSIZE(pattern) bytes
+ */
+APR_DECLARE(void) apr_strmatch_stream_init(apr_strmatch_stream_t *stream,
+                                           const apr_strmatch_pattern *pattern,
+                                           char *buf);
+
+/**
+ * Restart a stream, forgetting the bytes searched so far
+ * @param stream The stream
+ */
+APR_DECLARE(void) apr_strmatch_stream_reset(apr_strmatch_stream_t *stream);
+
+/**
+ * Search the next string of a stream for the pattern
+ * @param stream The stream
+ * @param s The string, following the previous ones of the stream
+ * @param slen The length of s
+ * @param offset Where to return the offset of the match from the start
+ *        of the stream, the match possibly starting in a previous string
+ * @param used Where to return the number of bytes of s searched: up to
+ *        the end of the match if found, else slen
+ * @return APR_SUCCESS if a match was found, else APR_NOTFOUND
+ * @remark The search resumes after the end of a match, with the rest of
+ *         s, so the matches reported do not overlap.
+ */
+APR_DECLARE(apr_status_t) apr_strmatch_stream(apr_strmatch_stream_t *stream,
+                                              const char *s,
+                                              apr_size_t slen,
+                                              apr_off_t *offset,
+                                              apr_size_t *used);
+
+/**
+ * Precompiled set of search patterns
+ * @see apr_strmatch_multi_precompile
+ */
+typedef struct apr_strmatch_multi_t apr_strmatch_multi_t;
+
+/** Match the patterns of an apr_strmatch_multi_t case-insensitively */
+#define APR_STRMATCH_MULTI_NOCASE 0x1
+
+/**
+ * The state of a (possibly incremental) search for a set of patterns
+ */
+typedef struct apr_strmatch_multi_state_t {
+    const apr_strmatch_multi_t *multi; /**< The patterns */
+    apr_uint32_t node;                 /**< The automaton state */
+    apr_off_t offset;                  /**< The number of bytes scanned */
+} apr_strmatch_multi_state_t;
+
+/**
+ * Callback called for a match of apr_strmatch_multi_scan()
+ * @param baton The baton given to apr_strmatch_multi_scan()
+ * @param pattern The index of the pattern matched
+ * @param offset The offset of the match from the start of the search,
+ *        which may be in a previous string
+ * @return zero to continue the search, or else to stop it
+ */
+typedef int (apr_strmatch_multi_cb_t)(void *baton, int pattern,
+                                      apr_off_t offset);
+
+/**
+ * Precompile a set of patterns for matching all of them in one pass,
+ * using the Aho-Corasick algorithm
+ * @param p The pool from which to allocate the patterns
+ * @param patterns The pattern strings, which are not copied
+ * @param npatterns The number of patterns
+ * @param flags Zero, or APR_STRMATCH_MULTI_NOCASE
+ * @return a pointer to the compiled patterns, or NULL if compilation fails
+ *         (no patterns, or an empty one)
+ * @remark The automaton is a transition table over the byte classes of
+ *         the patterns when it is small enough, else the (slower) trie
+ *         with failure links.  The patterns repeated are matched as the
+ *         first one.
+ */
+APR_DECLARE(const apr_strmatch_multi_t *) apr_strmatch_multi_precompile(
+                                              apr_pool_t *p,
+                                              const char * const *patterns,
+                                              int npatterns, int flags);
+
+/**
+ * Start a search for a set of patterns
+ * @param multi The patterns
+ * @param state The state of the search to initialize
+ */
+APR_DECLARE(void) apr_strmatch_multi_init(const apr_strmatch_multi_t *multi,
+                                          apr_strmatch_multi_state_t *state);
+
+/**
+ * Search a string for a set of patterns, following the previous strings
+ * searched with the same state, like the buckets of a brigade
+ * @param state The state of the search
+ * @param s The string to search
+ * @param slen The length of s
+ * @param cb The callback called for each match, in the order of their
+ *        ends (the longest first for the same end)
+ * @param baton The baton passed to @a cb
+ * @return zero once @a s is entirely searched, or the value returned by
+ *         @a cb to stop the search
+ * @remark When stopped, the search can be resumed with the rest of @a s,
+ *         from state->offset, but will not report the other matches
+ *         ending at the same place.
+ */
+APR_DECLARE(int) apr_strmatch_multi_scan(apr_strmatch_multi_state_t *state,
+                                         const char *s, apr_size_t slen,
+                                         apr_strmatch_multi_cb_t *cb,
+                                         void *baton);
+
+/**
+ * Search a string for the first match of a set of patterns
+ * @param multi The patterns
+ * @param s The string in which to search for the patterns
+ * @param slen The length of s (excluding null terminator)
+ * @param pattern If not NULL, where to return the index of the pattern
+ *        matched
+ * @return A pointer to the match which ends first in s (the longest if
+ *         several end there), or NULL if none is found
+ */
+APR_DECLARE(const char *) apr_strmatch_multi(const apr_strmatch_multi_t *multi,
+                                             const char *s, apr_size_t slen,
+                                             int *pattern);
+
 /** @} */
 #ifdef __cplusplus
 }
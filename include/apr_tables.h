@@ -130,6 +130,54 @@ APR_DECLARE(apr_array_header_t *) apr_array_make(apr_pool_t *p,
  */
 APR_DECLARE(void *) apr_array_push(apr_array_header_t *arr);
 
+/**
+ * Add new elements to an array (as a first-in, last-out stack).
+ * @param arr The array to add the elements to.
+ * @param nelts The number of elements to add.
+ * @return Location for the first new element in the array, the others
+ *         following it.
+ * @remark The new elements are zeroed when the array grows, like with
+ *         apr_array_push().
+ */
+APR_DECLARE(void *) apr_array_push_n(apr_array_header_t *arr, int nelts);
+
+/**
+ * Make sure that an array can hold a number of elements without growing.
+ * @param arr The array to reserve space in.
+ * @param nelts The number of elements (in total) the array should hold.
+ * @remark The array grows in place when it is the last block allocated
+ *         from its pool, otherwise its elements are copied once.
+ */
+APR_DECLARE(void) apr_array_reserve(apr_array_header_t *arr, int nelts);
+
+/**
+ * Give the unused space of an array back to its pool.
+ * @param arr The array to shrink.
+ * @remark This is only possible when the array is the last block
+ *         allocated from its pool, the array is left as is otherwise.
+ */
+APR_DECLARE(void) apr_array_shrink_to_fit(apr_array_header_t *arr);
+
+/**
+ * Declaration prototype for the comparison function of apr_array_sort(),
+ * the same as qsort()'s.
+ * @param a The first element to compare
+ * @param b The second element to compare
+ * @return Less than, equal to or greater than zero if @a a is
+ *         respectively less than, equal to or greater than @a b.
+ * @remark On Win32 it must be declared in the _NONSTD convention.
+ */
+typedef int (apr_array_cmp_fn_t)(const void *a, const void *b);
+
+/**
+ * Sort the elements of an array in place.
+ * @param arr The array to sort.
+ * @param cmp The function comparing two elements.
+ * @remark The sort is not stable.
+ */
+APR_DECLARE(void) apr_array_sort(apr_array_header_t *arr,
+                                 apr_array_cmp_fn_t *cmp);
+
 /** A helper macro for accessing a member of an APR array.
  *
  * @param ary the array
@@ -241,6 +289,22 @@ APR_DECLARE(apr_table_t *) apr_table_make(apr_pool_t *p, int nelts);
 APR_DECLARE(apr_table_t *) apr_table_copy(apr_pool_t *p,
                                           const apr_table_t *t);
 
+/**
+ * Create a new table and copy another table into it, lazily.
+ * @param p The pool to allocate the new table out of
+ * @param t The table to copy
+ * @return A copy of the table passed in
+ * @warning The table keys and respective values are not copied
+ * @remark When the pool of @a t is an ancestor of @a p (or @a p itself),
+ * the entries are shared by both tables until either of them changes
+ * through the apr_table_* functions, so this is O(1) for the tables which
+ * are only read.  The entries written in place through apr_table_elts()
+ * are hence seen by all the copies sharing them.  Otherwise this is the
+ * same as apr_table_copy().
+ */
+APR_DECLARE(apr_table_t *) apr_table_copy_cow(apr_pool_t *p,
+                                              const apr_table_t *t);
+
 /**
  * Create a new table whose contents are deep copied from the given
  * table. A deep copy operation copies all fields, and makes copies
@@ -495,6 +559,8 @@ APR_DECLARE(void) apr_table_overlap(apr_table_t *a, const apr_table_t *b,
  *              APR_OVERLAP_TABLES_ADD to add
  * @remark When merging duplicates, the two values are concatenated,
  *         separated by the string ", ".
+ * @remark The table is compressed in place, keeping the order of the
+ *         entries: only the merged values are allocated.
  */
 APR_DECLARE(void) apr_table_compress(apr_table_t *t, unsigned flags);
 
@@ -44,11 +44,23 @@ typedef struct apr_thread_mutex_t apr_thread_mutex_t;
 #define APR_THREAD_MUTEX_NESTED   0x1   /**< enable nested (recursive) locks */
 #define APR_THREAD_MUTEX_UNNESTED 0x2   /**< disable nested locks */
 #define APR_THREAD_MUTEX_TIMED    0x4   /**< enable timed locks */
+#define APR_THREAD_MUTEX_ADAPTIVE 0x8   /**< spin briefly before sleeping */
+#define APR_THREAD_MUTEX_STATS    0x10  /**< record contention statistics */
 
 /* Delayed the include to avoid a circular reference */
 #include "apr_pools.h"
 #include "apr_time.h"
 
+/** Contention statistics of a mutex created with APR_THREAD_MUTEX_STATS */
+typedef struct apr_thread_mutex_stats_t {
+    /** The number of times the mutex was acquired */
+    apr_uint64_t acquired;
+    /** The number of those acquisitions which found it already locked */
+    apr_uint64_t contended;
+    /** The total time spent waiting for it by contended acquisitions */
+    apr_interval_time_t wait_time;
+} apr_thread_mutex_stats_t;
+
 /**
  * Create and initialize a mutex that can be used to synchronize threads.
  * @param mutex the memory address where the newly created mutex will be
@@ -58,6 +70,13 @@ typedef struct apr_thread_mutex_t apr_thread_mutex_t;
  *           APR_THREAD_MUTEX_DEFAULT   platform-optimal lock behavior.
  *           APR_THREAD_MUTEX_NESTED    enable nested (recursive) locks.
  *           APR_THREAD_MUTEX_UNNESTED  disable nested locks (non-recursive).
+ *           APR_THREAD_MUTEX_TIMED     enable timed locks.
+ *           APR_THREAD_MUTEX_ADAPTIVE  spin for a while on a locked mutex
+ *                                      before sleeping, for short critical
+ *                                      sections.
+ *           APR_THREAD_MUTEX_STATS     count the acquisitions and the time
+ *                                      spent waiting, see
+ *                                      apr_thread_mutex_stats_get().
  * </PRE>
  * @param pool the pool from which to allocate the mutex.
  * @warning Be cautious in using APR_THREAD_MUTEX_DEFAULT.  While this is the
@@ -106,6 +125,29 @@ APR_DECLARE(apr_status_t) apr_thread_mutex_unlock(apr_thread_mutex_t *mutex);
  */
 APR_DECLARE(apr_status_t) apr_thread_mutex_destroy(apr_thread_mutex_t *mutex);
 
+/**
+ * Get the contention statistics of a mutex.
+ * @param mutex the mutex created with APR_THREAD_MUTEX_STATS.
+ * @param stats the statistics retrieved.
+ * @return APR_EINVAL if the mutex was created without APR_THREAD_MUTEX_STATS,
+ *         or APR_ENOTIMPL if the platform doesn't record them.
+ * @note The statistics are updated by the lock holder and read without
+ *       locking, so they may lag behind while the mutex is in use.
+ */
+APR_DECLARE(apr_status_t) apr_thread_mutex_stats_get(
+                                              apr_thread_mutex_t *mutex,
+                                              apr_thread_mutex_stats_t *stats);
+
+/**
+ * Tag a thread mutex for the lock contention profiling.
+ * @param mutex The mutex to tag.
+ * @param tag The tag, not copied.
+ * @return APR_ENOTIMPL if APR_HAS_LOCK_PROFILE is 0.
+ * @see apr_lock_profile.h
+ */
+APR_DECLARE(apr_status_t) apr_thread_mutex_tag(apr_thread_mutex_t *mutex,
+                                               const char *tag);
+
 /**
  * Get the pool used by this thread_mutex.
  * @return apr_pool_t the pool
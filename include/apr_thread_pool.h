@@ -79,6 +79,62 @@ APR_DECLARE(apr_status_t) apr_thread_pool_create(apr_thread_pool_t **me,
                                                  apr_size_t max_threads,
                                                  apr_pool_t *pool);
 
+/** Schedule the tasks with per-thread deques and work stealing,
+ *  @see apr_thread_pool_create_ex() */
+#define APR_THREAD_POOL_WORK_STEALING 0x01
+/** Pin each thread to one CPU, filling the cores (and their siblings) of
+ *  a package before the next one, @see apr_thread_pool_create_ex() */
+#define APR_THREAD_POOL_AFFINITY_COMPACT 0x02
+/** Pin each thread to one CPU, spreading the threads over the packages
+ *  and cores before using their siblings, @see apr_thread_pool_create_ex() */
+#define APR_THREAD_POOL_AFFINITY_SCATTER 0x04
+
+/**
+ * Create a thread pool, with flags
+ * @param me The pointer in which to return the newly created apr_thread_pool
+ * object, or NULL if thread pool creation fails.
+ * @param init_threads The number of threads to be created initially, this number
+ * will also be used as the initial value for the maximum number of idle threads.
+ * @param max_threads The maximum number of threads that can be created
+ * @param flags 0 or a combination of:
+ * <PRE>
+ *           APR_THREAD_POOL_WORK_STEALING     The tasks pushed (or topped)
+ *                                             by the pool's own threads go
+ *                                             to a deque of the pushing
+ *                                             thread, which runs them
+ *                                             without locking the whole
+ *                                             pool, and the threads with
+ *                                             nothing to do steal tasks from
+ *                                             the others' deques.
+ *           APR_THREAD_POOL_AFFINITY_COMPACT  Pin the threads to one CPU
+ *           APR_THREAD_POOL_AFFINITY_SCATTER  each, in turn, in this order.
+ * </PRE>
+ * @param attr NULL, or the attributes of the threads (e.g. their stack
+ * size), which must live as long as the thread pool and not be detached.
+ * @param cpus NULL, or the CPUs to run the threads on, in which case the
+ * threads are pinned to one of them each with an affinity flag, or allowed
+ * to run on all of them without. By default, the affinity flags use the
+ * CPUs the calling thread can run on.
+ * @param ncpus The number of @a cpus
+ * @param pool The pool to use
+ * @return APR_SUCCESS if the thread pool was created successfully,
+ * APR_EINVAL for unknown or conflicting flags, a detached @a attr or no
+ * @a ncpus, APR_ENOTIMPL if work stealing or CPU affinity is not
+ * supported on this platform, or another error code.
+ * @remark With work stealing, the priorities are honoured within each
+ * deque and within the shared queue (fed by the other threads), not
+ * across them. apr_thread_pool_tasks_cancel() still cancels the tasks in
+ * the deques.
+ */
+APR_DECLARE(apr_status_t) apr_thread_pool_create_ex(apr_thread_pool_t **me,
+                                                    apr_size_t init_threads,
+                                                    apr_size_t max_threads,
+                                                    apr_uint32_t flags,
+                                                    apr_threadattr_t *attr,
+                                                    const int *cpus,
+                                                    apr_size_t ncpus,
+                                                    apr_pool_t *pool);
+
 /**
  * Destroy the thread pool and stop all the threads
  * @return APR_SUCCESS if all threads are stopped.
@@ -99,6 +155,59 @@ APR_DECLARE(apr_status_t) apr_thread_pool_push(apr_thread_pool_t *me,
                                                void *param,
                                                apr_byte_t priority,
                                                void *owner);
+
+/** Opaque latch structure, counting the tasks pushed with it that are
+ *  not done yet, @see apr_thread_pool_push_batch() */
+typedef struct apr_thread_pool_latch apr_thread_pool_latch_t;
+
+/**
+ * Create a latch to wait for batches of tasks
+ * @param latch The pointer in which to return the newly created latch
+ * @param pool The pool to use
+ * @return APR_SUCCESS if the latch was created successfully. Otherwise,
+ * the error code.
+ * @remark A latch can be used with any number of batches, and again once
+ * they are done.
+ */
+APR_DECLARE(apr_status_t)
+    apr_thread_pool_latch_create(apr_thread_pool_latch_t **latch,
+                                 apr_pool_t *pool);
+
+/**
+ * Wait for all the tasks pushed with the latch to be done (run or
+ * cancelled)
+ * @param latch The latch
+ * @param timeout The maximum time to wait in microseconds, 0 to not wait,
+ * or a negative value to wait as long as needed.
+ * @return APR_SUCCESS if all the tasks are done, or APR_TIMEUP.
+ * @note Like apr_thread_pool_tasks_cancel(), this should not be called by
+ * the tasks being waited for.
+ */
+APR_DECLARE(apr_status_t)
+    apr_thread_pool_latch_wait(apr_thread_pool_latch_t *latch,
+                               apr_interval_time_t timeout);
+
+/**
+ * Schedule tasks to the bottom of the tasks of same priority, at once.
+ * @param me The thread pool
+ * @param n The number of tasks
+ * @param funcs The @a n task functions
+ * @param params The @a n parameters for the task functions
+ * @param priority The priority of the tasks.
+ * @param owner Owner of the tasks.
+ * @param latch NULL, or the latch which counts the tasks until they are
+ * done, @see apr_thread_pool_latch_wait().
+ * @return APR_SUCCESS if the tasks had been scheduled successfully. On
+ * failure, none of them is.
+ * @remark Unlike @a n calls to apr_thread_pool_push(), this takes the
+ * pool's lock once and wakes up no more than @a n idle threads.
+ */
+APR_DECLARE(apr_status_t)
+    apr_thread_pool_push_batch(apr_thread_pool_t *me, apr_size_t n,
+                               apr_thread_start_t *funcs, void *const *params,
+                               apr_byte_t priority, void *owner,
+                               apr_thread_pool_latch_t *latch);
+
 /**
  * Schedule a task to be run after a delay
  * @param me The thread pool
@@ -218,6 +327,49 @@ APR_DECLARE(apr_size_t)
 APR_DECLARE(apr_size_t)
     apr_thread_pool_threads_idle_timeout_count(apr_thread_pool_t * me);
 
+/** Number of buckets of the apr_thread_pool_latency_t histogram */
+#define APR_THREAD_POOL_LATENCY_BUCKETS 32
+
+/**
+ * The latencies of the tasks of a priority range, either the time they
+ * waited to be run (from their push, or from their due time for the
+ * scheduled ones) or the time they ran.
+ */
+typedef struct apr_thread_pool_latency_t {
+    /** Number of tasks measured */
+    apr_uint64_t count;
+    /** Sum of the latencies in microseconds, divide by count for the
+     *  average */
+    apr_uint64_t total;
+    /** Largest latency in microseconds */
+    apr_uint64_t max;
+    /** Histogram of the latencies, buckets[0] counts the tasks of less
+     *  than a microsecond and buckets[n] those of 2^(n-1) to 2^n-1
+     *  microseconds (the last bucket counts all the longer ones too) */
+    apr_uint64_t buckets[APR_THREAD_POOL_LATENCY_BUCKETS];
+} apr_thread_pool_latency_t;
+
+/**
+ * Get the latencies of the tasks run so far with a priority
+ * @param me The thread pool
+ * @param priority The priority, the tasks of the same range of 64 (as
+ *        that of APR_THREAD_TASK_PRIORITY_NORMAL for instance) are
+ *        accounted together
+ * @param wait Set to the queue wait latencies, unless NULL
+ * @param run Set to the run latencies, unless NULL
+ * @remark The scheduled tasks have the priority 0.
+ */
+APR_DECLARE(void) apr_thread_pool_latency_get(apr_thread_pool_t *me,
+                                              apr_byte_t priority,
+                                              apr_thread_pool_latency_t *wait,
+                                              apr_thread_pool_latency_t *run);
+
+/**
+ * Forget the latencies of all the tasks run so far
+ * @param me The thread pool
+ */
+APR_DECLARE(void) apr_thread_pool_latency_reset(apr_thread_pool_t *me);
+
 /**
  * Access function for the maximum number of idle threads
  * @param me The thread pool
@@ -289,6 +441,19 @@ APR_DECLARE(apr_size_t) apr_thread_pool_threshold_get(apr_thread_pool_t * me);
 APR_DECLARE(apr_status_t) apr_thread_pool_task_owner_get(apr_thread_t *thd,
                                                          void **owner);
 
+/**
+ * Get the pool of the thread executing a task, for the task's own
+ * allocations.
+ * @param thd The thread is executing a task
+ * @param pool Pointer to receive the pool
+ * @return APR_SUCCESS if the pool is retrieved successfully
+ * @remark The pool is created on first use and cleared after each task, so
+ * it can't be used by other threads nor outlive the task. It saves
+ * creating and destroying a pool in each task.
+ */
+APR_DECLARE(apr_status_t) apr_thread_pool_task_pool_get(apr_thread_t *thd,
+                                                        apr_pool_t **pool);
+
 /** @} */
 
 #ifdef __cplusplus
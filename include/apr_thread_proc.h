@@ -192,6 +192,9 @@ typedef struct apr_threadkey_t        apr_threadkey_t;
 /** Opaque record of child process. */
 typedef struct apr_other_child_rec_t  apr_other_child_rec_t;
 
+/** Opaque helper process creating the children of others. */
+typedef struct apr_proc_spawner_t     apr_proc_spawner_t;
+
 /**
  * The prototype for any APR thread worker functions.
  */
@@ -610,7 +613,8 @@ APR_DECLARE(apr_status_t) apr_procattr_limit_set(apr_procattr_t *attr,
  *         on platforms where fork() is used.  It will never be called on other
  *         platforms, on those platforms apr_proc_create() will return the error
  *         in the parent process rather than invoke the callback in the now-forked
- *         child process.
+ *         child process.  This includes the processes created with
+ *         posix_spawn(), see apr_proc_create().
  */
 APR_DECLARE(apr_status_t) apr_procattr_child_errfn_set(apr_procattr_t *attr,
                                                        apr_child_errfn_t *errfn);
@@ -640,6 +644,20 @@ APR_DECLARE(apr_status_t) apr_procattr_error_check_set(apr_procattr_t *attr,
 APR_DECLARE(apr_status_t) apr_procattr_addrspace_set(apr_procattr_t *attr,
                                                        apr_int32_t addrspace);
 
+/**
+ * Determine if the child may be created with posix_spawn(), without copying
+ * the address space of the parent, rather than with fork() and exec.
+ * @param attr The procattr we care about.
+ * @param spawn Should the child be spawned where possible?  Default is no.
+ * @remark The child cleanups of the pools are not run for a spawned child,
+ *         so the caller must make sure that the descriptors it should not
+ *         inherit are close-on-exec.  This flag is ignored where
+ *         posix_spawn() is not available, and on the platforms not using
+ *         fork().
+ */
+APR_DECLARE(apr_status_t) apr_procattr_spawn_set(apr_procattr_t *attr,
+                                                 apr_int32_t spawn);
+
 /**
  * Set the username used for running process
  * @param attr The procattr we care about.
@@ -700,6 +718,12 @@ APR_DECLARE(apr_status_t) apr_proc_fork(apr_proc_t *proc, apr_pool_t *cont);
  * @param pool The pool to use.
  * @note This function returns without waiting for the new process to terminate;
  * use apr_proc_wait for that.
+ * @remark On Unix, when apr_procattr_spawn_set() allows it, the process is
+ * created with posix_spawn() where available, without copying the address
+ * space of the caller, unless it must be detached, limited, switched to
+ * another user or group, or (without posix_spawn_file_actions_addchdir_np())
+ * run in another directory.  The child cleanups of the pools are not run
+ * then.
  */
 APR_DECLARE(apr_status_t) apr_proc_create(apr_proc_t *new_proc,
                                           const char *progname,
@@ -770,6 +794,69 @@ APR_DECLARE(apr_status_t) apr_proc_wait_all_procs(apr_proc_t *proc,
                                                   apr_wait_how_e waithow,
                                                   apr_pool_t *p);
 
+#if APR_HAS_FORK
+/**
+ * Fork a small helper process to create the children of this process
+ * and of its forked children, which then never need to copy their address
+ * space to run a program.
+ * @param spawner The resulting spawner.
+ * @param pool The pool to use, the helper exits when it is cleared and the
+ *             forked children using it are gone.
+ * @remark Create it early, before the process grows or starts threads: the
+ * helper is forked then, and keeps the credentials, the environment, the
+ * working directory, the standard descriptors and the inherited descriptors
+ * of the process at that time.  The children are created from there, the
+ * relative paths resolved against that working directory.
+ */
+APR_DECLARE(apr_status_t) apr_proc_spawner_create(apr_proc_spawner_t **spawner,
+                                                  apr_pool_t *pool);
+
+/**
+ * Create a new process through a spawner, as apr_proc_create() does.
+ * @param spawner The spawner to create it.
+ * @param new_proc The resulting process handle.
+ * @param progname The program to run
+ * @param args the arguments to pass to the new program.  The first
+ *             one should be the program name.
+ * @param env The new environment table for the new process, or NULL.  This
+ *            is ignored for APR_PROGRAM_ENV, APR_PROGRAM_PATH, and
+ *            APR_SHELLCMD_ENV types of commands, for which the environment
+ *            of the spawner is used.
+ * @param attr the procattr we should use to determine how to create the new
+ *         process
+ * @param pool The pool to use.
+ * @remark The child descriptors of attr are passed to the helper, the
+ * parent ones stay with the caller.  The errfn is not called, and
+ * APR_ENOTIMPL is returned for the perms_set callbacks.
+ * @remark The new process is a child of the helper: wait for it with
+ * apr_proc_spawner_wait(), not apr_proc_wait().
+ */
+APR_DECLARE(apr_status_t) apr_proc_spawner_proc_create(apr_proc_spawner_t *spawner,
+                                                       apr_proc_t *new_proc,
+                                                       const char *progname,
+                                                       const char * const *args,
+                                                       const char * const *env,
+                                                       apr_procattr_t *attr,
+                                                       apr_pool_t *pool);
+
+/**
+ * Wait for a process created by a spawner to die, as apr_proc_wait() does.
+ * @param spawner The spawner that created it.
+ * @param proc The process handle of apr_proc_spawner_proc_create().
+ * @param exitcode The returned exit status of the child, or the signal that
+ *                 caused it to die.
+ * @param exitwhy Why the child died, see apr_proc_wait().
+ * @param waithow APR_WAIT or APR_NOWAIT.
+ * @return APR_CHILD_DONE or APR_CHILD_NOTDONE, or an error.  Only the
+ * process that created a child can wait for it.
+ */
+APR_DECLARE(apr_status_t) apr_proc_spawner_wait(apr_proc_spawner_t *spawner,
+                                                apr_proc_t *proc,
+                                                int *exitcode,
+                                                apr_exit_why_e *exitwhy,
+                                                apr_wait_how_e waithow);
+#endif
+
 #define APR_PROC_DETACH_FOREGROUND 0    /**< Do not detach */
 #define APR_PROC_DETACH_DAEMONIZE 1     /**< Detach */
 
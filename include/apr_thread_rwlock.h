@@ -59,6 +59,35 @@ typedef struct apr_thread_rwlock_t apr_thread_rwlock_t;
  */
 APR_DECLARE(apr_status_t) apr_thread_rwlock_create(apr_thread_rwlock_t **rwlock,
                                                    apr_pool_t *pool);
+
+#define APR_THREAD_RWLOCK_DEFAULT     0x0 /**< platform's read-write lock */
+#define APR_THREAD_RWLOCK_DISTRIBUTED 0x1 /**< per CPU reader counts */
+
+/**
+ * Create and initialize a read-write lock that can be used to synchronize
+ * threads, with flags.
+ * @param rwlock the memory address where the newly created readwrite lock
+ *        will be stored.
+ * @param flags Or'ed value of:
+ * <PRE>
+ *           APR_THREAD_RWLOCK_DEFAULT      the platform's read-write lock.
+ *           APR_THREAD_RWLOCK_DISTRIBUTED  a big-reader lock for read-mostly
+ *                                          data: readers only write their
+ *                                          own cache line, so they scale
+ *                                          with the number of CPUs, while
+ *                                          writers are more expensive and
+ *                                          have priority over new readers.
+ * </PRE>
+ * @param pool the pool from which to allocate the mutex.
+ * @remark Where APR_THREAD_RWLOCK_DISTRIBUTED is not implemented, the
+ *         platform's read-write lock is created instead.
+ * @warning With APR_THREAD_RWLOCK_DISTRIBUTED, a thread taking a read lock
+ *          it already holds can deadlock with a waiting writer.
+ */
+APR_DECLARE(apr_status_t) apr_thread_rwlock_create_ex(
+                                                 apr_thread_rwlock_t **rwlock,
+                                                 unsigned int flags,
+                                                 apr_pool_t *pool);
 /**
  * Acquire a shared-read lock on the given read-write lock. This will allow
  * multiple threads to enter the same critical section while they have acquired
@@ -112,6 +141,16 @@ APR_DECLARE(apr_status_t) apr_thread_rwlock_unlock(apr_thread_rwlock_t *rwlock);
  */
 APR_DECLARE(apr_status_t) apr_thread_rwlock_destroy(apr_thread_rwlock_t *rwlock);
 
+/**
+ * Tag a read-write lock for the lock contention profiling.
+ * @param rwlock The read-write lock to tag.
+ * @param tag The tag, not copied.
+ * @return APR_ENOTIMPL if APR_HAS_LOCK_PROFILE is 0.
+ * @see apr_lock_profile.h
+ */
+APR_DECLARE(apr_status_t) apr_thread_rwlock_tag(apr_thread_rwlock_t *rwlock,
+                                                const char *tag);
+
 /**
  * Get the pool used by this thread_rwlock.
  * @return apr_pool_t the pool
@@ -86,6 +86,22 @@ typedef apr_int32_t apr_short_interval_time_t;
  */
 APR_DECLARE(apr_time_t) apr_time_now(void);
 
+/**
+ * @return the current time, possibly read at the granularity of the
+ * system tick (a few milliseconds) in exchange for a cheaper call.
+ * Falls back to apr_time_now() where no coarse clock exists.
+ */
+APR_DECLARE(apr_time_t) apr_time_now_coarse(void);
+
+/**
+ * @return microseconds elapsed since an unspecified starting point,
+ * from a clock that is not affected by changes to the system time.
+ * Only differences between two values are meaningful; use it for
+ * timeouts and elapsed times, never as a date.  Falls back to
+ * apr_time_now() where no monotonic clock exists.
+ */
+APR_DECLARE(apr_time_t) apr_time_monotonic(void);
+
 /** @see apr_time_exp_t */
 typedef struct apr_time_exp_t apr_time_exp_t;
 
@@ -52,6 +52,34 @@ typedef struct {
  */
 APR_DECLARE(void) apr_uuid_get(apr_uuid_t *uuid);
 
+/**
+ * Generate several (new) UUIDs at once
+ * @param uuids The array receiving the UUIDs
+ * @param n The number of UUIDs to generate
+ * @remark Without an OS UUID generator, the UUIDs are version 1, and
+ * the timestamps of the whole batch are reserved in one step.
+ * apr_uuid_get() and apr_uuid_get_batch() are safe to call from several
+ * threads at once and never return the same UUID twice in a process.
+ */
+APR_DECLARE(void) apr_uuid_get_batch(apr_uuid_t *uuids, apr_size_t n);
+
+/**
+ * Generate and return a (new) version 7 UUID, time-ordered and random
+ * @param uuid The resulting UUID
+ * @remark Version 7 UUIDs (RFC 9562) hold the Unix time in milliseconds
+ * followed by its sub-millisecond fraction and 62 random bits.  Within
+ * a process they never repeat, and sort in the order they were made.
+ */
+APR_DECLARE(void) apr_uuid_get_v7(apr_uuid_t *uuid);
+
+/**
+ * Generate several (new) version 7 UUIDs at once
+ * @param uuids The array receiving the UUIDs, in increasing order
+ * @param n The number of UUIDs to generate
+ * @see apr_uuid_get_v7
+ */
+APR_DECLARE(void) apr_uuid_get_v7_batch(apr_uuid_t *uuids, apr_size_t n);
+
 /**
  * Format a UUID into a string, following the standard format
  * @param buffer The buffer to place the formatted UUID string into. It must
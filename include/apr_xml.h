@@ -214,6 +214,69 @@ typedef struct apr_xml_parser apr_xml_parser;
  */
 APR_DECLARE(apr_xml_parser *) apr_xml_parser_create(apr_pool_t *pool);
 
+/**
+ * Callback for each element of a streaming parser
+ * @param baton The baton given to apr_xml_parser_create_stream().
+ * @param doc The document being parsed, for its namespaces.
+ * @param elem The element, with its name, namespace, lang and attributes.
+ * @see apr_xml_parser_create_stream
+ */
+typedef void (apr_xml_elem_fn_t)(void *baton, const apr_xml_doc *doc,
+                                 apr_xml_elem *elem);
+
+/**
+ * Create a streaming XML parser, building only the subtrees asked for
+ * with apr_xml_parser_keep()
+ * @param pool The pool for allocating the parser and the kept subtrees.
+ * @param start_func Called after each start tag, or NULL.
+ * @param end_func Called at each end tag, or NULL.
+ * @param baton Passed to the callbacks.
+ * @return The new parser.
+ * @remark Elements outside the kept subtrees come from a pool per depth
+ * that is cleared when their end tag has been handled, and have no
+ * children nor cdata, so the memory used is bounded by the nesting
+ * depth rather than the document size.
+ * @remark At the end tag of an element in a kept subtree, the element is
+ * complete and stays in @a pool. The parent of the root of a kept subtree
+ * is reset to NULL once its end_func returns.
+ * @remark The document returned by apr_xml_parser_done() has a root only
+ * when the root element is kept.
+ */
+APR_DECLARE(apr_xml_parser *) apr_xml_parser_create_stream(apr_pool_t *pool,
+                                             apr_xml_elem_fn_t *start_func,
+                                             apr_xml_elem_fn_t *end_func,
+                                             void *baton);
+
+/**
+ * Have a streaming parser build the subtrees of the elements with the
+ * given namespace and name
+ * @param parser The parser from apr_xml_parser_create_stream().
+ * @param uri The (quoted) namespace URI, "" for no namespace or NULL for
+ *            any.
+ * @param name The local name of the element.
+ * @return APR_EINVAL if the parser is not streaming, else APR_SUCCESS.
+ * @remark Call before feeding the parser. Elements matching within a
+ * kept subtree are part of it, and are not kept again on their own.
+ */
+APR_DECLARE(apr_status_t) apr_xml_parser_keep(apr_xml_parser *parser,
+                                              const char *uri,
+                                              const char *name);
+
+/**
+ * Return the copy of a name that the parser gives to all the elements
+ * and attributes with this name
+ * @param parser The XML parser.
+ * @param name The name, local (without prefix) for namespaced names.
+ * @return The interned name, which lives as long as the parser's pool.
+ * @remark Once interned, a name is the same pointer as the names of the
+ * elements and attributes parsed afterwards with it, so the callbacks of
+ * a streaming parser can compare them with ==. Otherwise a streaming
+ * parser interns a bounded number of names, beyond which the names of
+ * the elements not kept are copied in their scratch pool.
+ */
+APR_DECLARE(const char *) apr_xml_parser_intern(apr_xml_parser *parser,
+                                                const char *name);
+
 /**
  * Parse a File, producing a xml_doc
  * @param p      The pool for allocating the parse results.
@@ -74,6 +74,10 @@
 /* For backwards compat */
 #define APR_FILE_BUFSIZE APR_FILE_DEFAULT_BUFSIZE
 
+/* The sizes of apr_file_buffer_default_set(), for APR_FOPEN_BUFFERED */
+extern apr_size_t apr_file_default_bufsize;
+extern apr_size_t apr_file_max_bufsize;
+
 #if APR_HAS_THREADS
 #define file_lock(f)   do { \
                            if ((f)->thlock) \
@@ -104,6 +108,25 @@ typedef struct apr_rotating_info_t {
     apr_fileperms_t perm;
 } apr_rotating_info_t;
 
+/* The buffers of apr_file_append_stages_set(), each used by the threads
+ * hashing to it and flushed with a single write() of whole records
+ */
+typedef struct apr_file_stage_t {
+#if APR_HAS_THREADS
+    struct apr_thread_mutex_t *lock;
+#endif
+    char *buf;
+    apr_size_t len;
+    apr_time_t first;         /* when the oldest record was staged */
+} apr_file_stage_t;
+
+typedef struct apr_file_stages_t {
+    apr_file_stage_t *stage;
+    apr_uint32_t nstages;
+    apr_size_t size;
+    apr_interval_time_t max_age;
+} apr_file_stages_t;
+
 struct apr_file_t {
     apr_pool_t *pool;
     int filedes;
@@ -123,6 +146,7 @@ struct apr_file_t {
     char *buffer;
     apr_size_t bufpos;    /* Read/Write position in buffer */
     apr_size_t bufsize;   /* The buffer size */
+    int bufgrow;          /* buffer allocated here, may double */
     apr_off_t dataRead;   /* amount of valid data read into buffer */
     int direction;            /* buffer being used for 0 = read, 1 = write */
     apr_off_t filePtr;    /* position in file of handle */
@@ -130,6 +154,7 @@ struct apr_file_t {
     struct apr_thread_mutex_t *thlock;
 #endif
     apr_rotating_info_t *rotating;
+    apr_file_stages_t *stages;
 };
 
 struct apr_dir_t {
@@ -180,6 +205,8 @@ mode_t apr_unix_perms2mode(apr_fileperms_t perms);
 apr_fileperms_t apr_unix_mode2perms(mode_t mode);
 
 apr_status_t apr_file_flush_locked(apr_file_t *thefile);
+void apr_file_buffer_grow(apr_file_t *thefile);
+apr_status_t apr_file_stages_flush(apr_file_t *thefile);
 apr_status_t apr_file_info_get_locked(apr_finfo_t *finfo, apr_int32_t wanted,
                                       apr_file_t *thefile);
 
@@ -34,6 +34,10 @@
 #define APR_FILE_DEFAULT_BUFSIZE 4096
 #define APR_FILE_BUFSIZE APR_FILE_DEFAULT_BUFSIZE
 
+/* The sizes of apr_file_buffer_default_set(), for APR_FOPEN_BUFFERED */
+extern apr_size_t apr_file_default_bufsize;
+extern apr_size_t apr_file_max_bufsize;
+
 struct apr_file_t {
     apr_pool_t *pool;
     HFILE filedes;
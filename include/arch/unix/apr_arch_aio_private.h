@@ -0,0 +1,56 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_ARCH_AIO_PRIVATE_H
+#define APR_ARCH_AIO_PRIVATE_H
+
+#include "apr.h"
+#include "apr_private.h"
+#include "apr_aio.h"
+
+typedef struct apr_aio_ring_private_t apr_aio_ring_private_t;
+typedef struct apr_aio_provider_t apr_aio_provider_t;
+
+struct apr_aio_ring_t
+{
+    apr_pool_t *pool;
+    apr_uint32_t size;
+    apr_uint32_t flags;
+    /* Operations queued or in flight */
+    apr_uint32_t count;
+    /* The operations completed by the provider's reap */
+    apr_aio_op_t **done;
+    apr_aio_ring_private_t *p;
+    const apr_aio_provider_t *provider;
+};
+
+struct apr_aio_provider_t {
+    apr_status_t (*create)(apr_aio_ring_t *, apr_uint32_t, apr_pool_t *,
+                           apr_uint32_t);
+    /* Queue the filled in operation, there is room for it */
+    apr_status_t (*queue)(apr_aio_ring_t *, apr_aio_op_t *);
+    /* Start the queued operations */
+    apr_status_t (*submit)(apr_aio_ring_t *);
+    /* Submit and return up to max completed operations, with their
+     * results set, or APR_TIMEUP
+     */
+    apr_status_t (*reap)(apr_aio_ring_t *, apr_interval_time_t,
+                         apr_aio_op_t **, apr_uint32_t, apr_uint32_t *);
+    apr_status_t (*cleanup)(apr_aio_ring_t *);
+    const char *name;
+};
+
+#endif /* APR_ARCH_AIO_PRIVATE_H */
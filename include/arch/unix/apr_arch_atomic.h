@@ -53,6 +53,19 @@
 #   define USE_ATOMICS_GENERIC
 #endif
 
+/* The spin-wait hint of the processor, for apr_atomic_pause() */
+#if defined(__GNUC__) && !defined(__STRICT_ANSI__) \
+    && (defined(__i386__) || defined(__x86_64__))
+#   define APR__ATOMIC_PAUSE() asm volatile ("pause" : : : "memory")
+#elif defined(__GNUC__) && !defined(__STRICT_ANSI__) \
+    && (defined(__powerpc__) || defined(__PPC__) || defined(__ppc__))
+#   define APR__ATOMIC_PAUSE() asm volatile ("or 27,27,27" : : : "memory")
+#elif defined(__GNUC__) && !defined(__STRICT_ANSI__) && defined(__aarch64__)
+#   define APR__ATOMIC_PAUSE() asm volatile ("yield" : : : "memory")
+#else
+#   define APR__ATOMIC_PAUSE() do { } while (0)
+#endif
+
 #if defined(USE_ATOMICS_GENERIC) || defined (NEED_ATOMICS_GENERIC64)
 apr_status_t apr__atomic_generic64_init(apr_pool_t *p);
 #endif
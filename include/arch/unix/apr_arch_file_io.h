@@ -92,6 +92,10 @@
 /* For backwards-compat */
 #define APR_FILE_BUFSIZE  APR_FILE_DEFAULT_BUFSIZE
 
+/* The sizes of apr_file_buffer_default_set(), for APR_FOPEN_BUFFERED */
+extern apr_size_t apr_file_default_bufsize;
+extern apr_size_t apr_file_max_bufsize;
+
 typedef struct apr_rotating_info_t {
     apr_finfo_t finfo;
     apr_interval_time_t timeout;
@@ -101,6 +105,25 @@ typedef struct apr_rotating_info_t {
     apr_fileperms_t perm;
 } apr_rotating_info_t;
 
+/* The buffers of apr_file_append_stages_set(), each used by the threads
+ * hashing to it and flushed with a single write() of whole records
+ */
+typedef struct apr_file_stage_t {
+#if APR_HAS_THREADS
+    struct apr_thread_mutex_t *lock;
+#endif
+    char *buf;
+    apr_size_t len;
+    apr_time_t first;         /* when the oldest record was staged */
+} apr_file_stage_t;
+
+typedef struct apr_file_stages_t {
+    apr_file_stage_t *stage;
+    apr_uint32_t nstages;
+    apr_size_t size;
+    apr_interval_time_t max_age;
+} apr_file_stages_t;
+
 struct apr_file_t {
     apr_pool_t *pool;
     int filedes;
@@ -120,6 +143,7 @@ struct apr_file_t {
     char *buffer;
     apr_size_t bufpos;        /* Read/Write position in buffer */
     apr_size_t bufsize;       /* The size of the buffer */
+    int bufgrow;              /* buffer allocated here, may double */
     unsigned long dataRead;   /* amount of valid data read into buffer */
     int direction;            /* buffer being used for 0 = read, 1 = write */
     apr_off_t filePtr;        /* position in file of handle */
@@ -127,6 +151,7 @@ struct apr_file_t {
     struct apr_thread_mutex_t *thlock;
 #endif
     apr_rotating_info_t *rotating;
+    apr_file_stages_t *stages;
 };
 
 #if APR_HAS_THREADS
@@ -147,6 +172,7 @@ struct apr_file_t {
 #define stat(f,b) stat64(f,b)
 #define lstat(f,b) lstat64(f,b)
 #define fstat(f,b) fstat64(f,b)
+#define fstatat(d,f,b,l) fstatat64(d,f,b,l)
 #define lseek(f,o,w) lseek64(f,o,w)
 #define ftruncate(f,l) ftruncate64(f,l)
 typedef struct stat64 struct_stat;
@@ -178,6 +204,13 @@ mode_t apr_unix_perms2mode(apr_fileperms_t perms);
 apr_fileperms_t apr_unix_mode2perms(mode_t mode);
 
 apr_status_t apr_file_flush_locked(apr_file_t *thefile);
+void apr_file_buffer_grow(apr_file_t *thefile);
+apr_status_t apr_file_stages_flush(apr_file_t *thefile);
+#if defined(HAVE_STATX) || defined(HAVE_FSTATAT)
+apr_status_t apr_unix_stat_at(apr_finfo_t *finfo, int dirfd,
+                              const char *name, apr_int32_t wanted,
+                              apr_pool_t *pool);
+#endif
 apr_status_t apr_file_info_get_locked(apr_finfo_t *finfo, apr_int32_t wanted,
                                       apr_file_t *thefile);
 
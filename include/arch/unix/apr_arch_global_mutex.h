@@ -24,6 +24,7 @@
 #include "apr_global_mutex.h"
 #include "apr_arch_proc_mutex.h"
 #include "apr_arch_thread_mutex.h"
+#include "apr_arch_lock_profile.h"
 
 struct apr_global_mutex_t {
     apr_pool_t *pool;
@@ -31,6 +32,9 @@ struct apr_global_mutex_t {
 #if APR_HAS_THREADS
     apr_thread_mutex_t *thread_mutex;
 #endif /* APR_HAS_THREADS */
+    apr_lock_profile_rec_t *profile;
+    /* trylocks of the proc_mutex before blocking, see global_mutex_lock() */
+    int spins;
 };
 
 #endif  /* GLOBAL_MUTEX_H */
@@ -0,0 +1,81 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LOCK_PROFILE_H
+#define LOCK_PROFILE_H
+
+#include "apr.h"
+#include "apr_private.h"
+#include "apr_lock_profile.h"
+
+typedef struct apr_lock_profile_rec_t apr_lock_profile_rec_t;
+
+#if APR_HAS_LOCK_PROFILE
+
+/* The profile of a tagged lock, linked in the process' list of profiles
+ * until the pool of the lock is cleared.
+ */
+struct apr_lock_profile_rec_t {
+    const char *tag;
+    apr_lock_profile_type_e type;
+    volatile apr_uint64_t acquired;
+    volatile apr_uint64_t contended;
+    volatile apr_uint64_t wait_time;
+    volatile apr_uint64_t max_wait_time;
+    volatile apr_uint64_t hold_time;
+    apr_time_t since;           /* start of the exclusive hold, or zero */
+    apr_lock_profile_rec_t *next, **ref;
+};
+
+extern volatile apr_uint32_t apr_unix_lock_profile_on;
+
+/* Whether the lock operations on the lock of this profile are profiled */
+#define APR_LOCK_PROFILED(prof) \
+    ((prof) != NULL && apr_unix_lock_profile_on)
+
+/* Acquire a profiled lock, measuring the wait when the non-blocking
+ * tryacquire expression returns APR_EBUSY and the (blocking or timed)
+ * acquire expression is evaluated.
+ */
+#define APR_LOCK_PROFILE_ACQUIRE(rv, prof, exclusive, tryacquire, acquire) \
+    do { \
+        (rv) = (tryacquire); \
+        if (APR_STATUS_IS_EBUSY(rv)) { \
+            apr_time_t lock_profile_start = apr_time_now(); \
+            (rv) = (acquire); \
+            apr_unix_lock_profile_waited((prof), lock_profile_start); \
+        } \
+        if ((rv) == APR_SUCCESS) { \
+            apr_unix_lock_profile_acquired((prof), (exclusive)); \
+        } \
+    } while (0)
+
+apr_status_t apr_unix_lock_profile_tag(apr_lock_profile_rec_t **prof,
+                                       apr_lock_profile_type_e type,
+                                       const char *tag, apr_pool_t *pool);
+
+void apr_unix_lock_profile_waited(apr_lock_profile_rec_t *prof,
+                                  apr_time_t start);
+
+void apr_unix_lock_profile_acquired(apr_lock_profile_rec_t *prof,
+                                    int exclusive);
+
+/* To be called with the lock still held, profiling enabled or not */
+void apr_unix_lock_profile_released(apr_lock_profile_rec_t *prof);
+
+#endif /* APR_HAS_LOCK_PROFILE */
+
+#endif  /* LOCK_PROFILE_H */
@@ -61,6 +61,9 @@
 #if APR_HAVE_NETINET_IN_H
 #include <netinet/in.h>
 #endif
+#ifdef HAVE_NETINET_UDP_H
+#include <netinet/udp.h>
+#endif
 #if APR_HAVE_ARPA_INET_H
 #include <arpa/inet.h>
 #endif
@@ -119,6 +122,8 @@ struct apr_socket_t {
     int remote_addr_unknown;
     apr_int32_t options;
     apr_int32_t inherit;
+    /* The number of the next send with APR_SO_ZEROCOPY */
+    apr_uint32_t zerocopy_seq;
     sock_userdata_t *userdata;
 #ifndef WAITIO_USES_POLL
     /* if there is a timeout set, then this pollset is used */
@@ -130,6 +135,14 @@ const char *apr_inet_ntop(int af, const void *src, char *dst, apr_size_t size);
 int apr_inet_pton(int af, const char *src, void *dst);
 void apr_sockaddr_vars_set(apr_sockaddr_t *, int, apr_port_t);
 
+/* Set up *new for the descriptor s accepted from sock, from the peer
+ * address sa: the second half of apr_socket_accept(), shared with the
+ * asynchronous accept of apr_aio.  s is closed on failure.
+ */
+apr_status_t apr_socket_accepted(apr_socket_t **new, apr_socket_t *sock,
+                                 int s, const apr_sockaddr_t *sa,
+                                 apr_pool_t *connection_context);
+
 #define apr_is_option_set(skt, option)  \
     (((skt)->options & (option)) == (option))
 
@@ -141,5 +154,14 @@ void apr_sockaddr_vars_set(apr_sockaddr_t *, int, apr_port_t);
             (skt)->options &= ~(option);        \
     } while (0)
 
+/* Whether the timeout is implemented by polling the non-blocking
+ * descriptor, rather than by the kernel with APR_SO_KERNEL_TIMEOUT */
+#define apr_socket_timeout_polled(skt)  \
+    ((skt)->timeout > 0 && !apr_is_option_set(skt, APR_SO_KERNEL_TIMEOUT))
+
+/* Set the SO_RCVTIMEO and SO_SNDTIMEO of the descriptor sd, disabled
+ * for t <= 0 */
+apr_status_t apr_socket_kernel_timeout_set(int sd, apr_interval_time_t t);
+
 #endif  /* ! NETWORK_IO_H */
 
@@ -126,7 +126,7 @@ struct apr_pollset_t
     apr_uint32_t nelts;
     apr_uint32_t nalloc;
     apr_uint32_t flags;
-    /* Pipe descriptors used for wakeup */
+    /* Pipe descriptors used for wakeup, only [0] for an eventfd */
 #if WAKEUP_USES_PIPE
     apr_file_t *wakeup_pipe[2];
 #else
@@ -150,6 +150,9 @@ typedef union {
 #endif
 #if defined(HAVE_POLL)
     struct pollfd *ps;
+#endif
+#if defined(HAVE_IO_URING)
+    apr_pollset_private_t *uring;
 #endif
     void *undef;
 } apr_pollcb_pset;
@@ -159,7 +162,7 @@ struct apr_pollcb_t {
     apr_uint32_t nelts;
     apr_uint32_t nalloc;
     apr_uint32_t flags;
-    /* Pipe descriptors used for wakeup */
+    /* Pipe descriptors used for wakeup, only [0] for an eventfd */
 #if WAKEUP_USES_PIPE
     apr_file_t *wakeup_pipe[2];
 #else
@@ -180,6 +183,15 @@ struct apr_pollset_provider_t {
     apr_status_t (*poll)(apr_pollset_t *, apr_interval_time_t, apr_int32_t *, const apr_pollfd_t **);
     apr_status_t (*cleanup)(apr_pollset_t *);
     const char *name;
+    /* Wake up the poll without the wakeup pipe, NULL to use the pipe */
+    apr_status_t (*wakeup)(apr_pollset_t *);
+    /* Re-enable an APR_POLLONESHOT descriptor, NULL if neither APR_POLLET
+     * nor APR_POLLONESHOT are implemented
+     */
+    apr_status_t (*rearm)(apr_pollset_t *, const apr_pollfd_t *);
+    /* Poll into an array of the caller, NULL to copy the results of poll */
+    apr_status_t (*poll_ex)(apr_pollset_t *, apr_interval_time_t, apr_int32_t,
+                            apr_int32_t *, apr_pollfd_t *);
 };
 
 struct apr_pollcb_provider_t {
@@ -189,6 +201,12 @@ struct apr_pollcb_provider_t {
     apr_status_t (*poll)(apr_pollcb_t *, apr_interval_time_t, apr_pollcb_cb_t, void *);
     apr_status_t (*cleanup)(apr_pollcb_t *);
     const char *name;
+    /* Wake up the poll without the wakeup pipe, NULL to use the pipe */
+    apr_status_t (*wakeup)(apr_pollcb_t *);
+    /* Re-enable an APR_POLLONESHOT descriptor, NULL if neither APR_POLLET
+     * nor APR_POLLONESHOT are implemented
+     */
+    apr_status_t (*rearm)(apr_pollcb_t *, apr_pollfd_t *);
 };
 
 /*
@@ -199,6 +217,7 @@ struct apr_pollcb_provider_t {
 apr_status_t apr_poll_create_wakeup_pipe(apr_pool_t *pool, apr_pollfd_t *pfd,
                                          apr_file_t **wakeup_pipe);
 apr_status_t apr_poll_close_wakeup_pipe(apr_file_t **wakeup_pipe);
+apr_status_t apr_poll_send_wakeup_pipe(apr_file_t **wakeup_pipe);
 void apr_poll_drain_wakeup_pipe(volatile apr_uint32_t *wakeup_set, apr_file_t **wakeup_pipe);
 #else
 apr_status_t apr_poll_create_wakeup_socket(apr_pool_t *pool, apr_pollfd_t *pfd,
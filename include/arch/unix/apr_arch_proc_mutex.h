@@ -27,6 +27,7 @@
 #include "apr_file_io.h"
 #include "apr_arch_file_io.h"
 #include "apr_time.h"
+#include "apr_arch_lock_profile.h"
 
 /* System headers required by Locks library */
 #if APR_HAVE_SYS_TYPES_H
@@ -63,6 +64,14 @@
 #if APR_HAVE_PTHREAD_H
 #include <pthread.h>
 #endif
+#if APR_HAS_FUTEX_SERIALIZE
+#if APR_HAVE_SIGNAL_H
+#include <signal.h>
+#endif
+#include <errno.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
 /* End System Headers */
 
 struct apr_proc_mutex_unix_lock_methods_t {
@@ -82,6 +91,8 @@ typedef struct apr_proc_mutex_unix_lock_methods_t apr_proc_mutex_unix_lock_metho
 
 /* bit values for flags field in apr_unix_lock_methods_t */
 #define APR_PROCESS_LOCK_MECH_IS_GLOBAL          1
+/* tryacquire stays in user space, so a global mutex can spin on it */
+#define APR_PROCESS_LOCK_MECH_CAN_SPIN           2
 
 #if !APR_HAVE_UNION_SEMUN && defined(APR_HAS_SYSVSEM_SERIALIZE)
 union semun {
@@ -98,6 +109,7 @@ struct apr_proc_mutex_t {
     char *fname;
 
     apr_os_proc_mutex_t os;     /* Native mutex holder. */
+    apr_lock_profile_rec_t *profile;
 
 #if APR_HAS_FCNTL_SERIALIZE || APR_HAS_FLOCK_SERIALIZE
     apr_file_t *interproc;      /* For apr_file_ calls on native fd. */
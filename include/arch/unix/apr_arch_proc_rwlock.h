@@ -0,0 +1,62 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROC_RWLOCK_H
+#define PROC_RWLOCK_H
+
+#include "apr.h"
+#include "apr_private.h"
+#include "apr_proc_rwlock.h"
+#include "apr_arch_lock_profile.h"
+
+#if APR_HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#if APR_HAS_THREADS && defined(HAVE_PTHREAD_RWLOCKS) \
+    && defined(HAVE_PTHREAD_RWLOCKATTR_SETPSHARED) && defined(HAVE_MMAP)
+#define PROC_RWLOCK_IS_PTHREAD 1
+#else
+#define PROC_RWLOCK_IS_PTHREAD 0
+#endif
+
+#if PROC_RWLOCK_IS_PTHREAD
+
+/* The mmap()ed lock is the native pthread_rwlock_t followed by a refcounter
+ * of the processes using it, so that the last one destroys it (see the
+ * pthread process mutexes for why).
+ */
+typedef struct {
+    pthread_rwlock_t rwlock;
+    apr_uint32_t refcount;
+} proc_rwlock_shared_t;
+
+struct apr_proc_rwlock_t {
+    apr_pool_t *pool;
+    proc_rwlock_shared_t *shared;
+    apr_lock_profile_rec_t *profile;
+};
+
+#else
+
+struct apr_proc_rwlock_t {
+    apr_pool_t *pool;
+    apr_lock_profile_rec_t *profile;
+};
+
+#endif /* PROC_RWLOCK_IS_PTHREAD */
+
+#endif  /* PROC_RWLOCK_H */
@@ -24,6 +24,7 @@
 #include "apr_thread_cond.h"
 #include "apr_portable.h"
 #include "apr_atomic.h"
+#include "apr_arch_lock_profile.h"
 
 #if APR_HAVE_PTHREAD_H
 #include <pthread.h>
@@ -33,6 +34,10 @@
 struct apr_thread_mutex_t {
     apr_pool_t *pool;
     pthread_mutex_t mutex;
+    unsigned int flags;
+    int spins;      /* trylock attempts before blocking, if adaptive */
+    apr_thread_mutex_stats_t stats;
+    apr_lock_profile_rec_t *profile;
 #ifndef HAVE_PTHREAD_MUTEX_TIMEDLOCK
     apr_thread_cond_t *cond;
     int locked, num_waiters;
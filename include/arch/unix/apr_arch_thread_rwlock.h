@@ -22,6 +22,7 @@
 #include "apr_general.h"
 #include "apr_thread_rwlock.h"
 #include "apr_pools.h"
+#include "apr_arch_lock_profile.h"
 
 #if APR_HAVE_PTHREAD_H
 /* this gives us pthread_rwlock_t */
@@ -34,12 +35,16 @@
 struct apr_thread_rwlock_t {
     apr_pool_t *pool;
     pthread_rwlock_t rwlock;
+    /* The big-reader lock used instead of rwlock, if not NULL */
+    struct thread_rwlock_br_t *br;
+    apr_lock_profile_rec_t *profile;
 };
 
 #else
 
 struct apr_thread_rwlock_t {
     apr_pool_t *pool;
+    apr_lock_profile_rec_t *profile;
 };
 #endif
 
@@ -43,6 +43,9 @@
 #ifdef HAVE_SCHED_H
 #include <sched.h>
 #endif
+#ifdef HAVE_SPAWN_H
+#include <spawn.h>
+#endif
 /* End System Headers */
 
 
@@ -115,7 +118,14 @@ struct apr_procattr_t {
     apr_uid_t   uid;
     apr_gid_t   gid;
     apr_procattr_pscb_t *perms_set_callbacks;
+    apr_int32_t spawn;
 };
 
+/* The exit code and reason of a waitpid() status, APR_CHILD_DONE or
+ * APR_EGENERAL if it did not end.
+ */
+apr_status_t apr_unix_proc_exit_status(int exit_int, int *exitcode,
+                                       apr_exit_why_e *exitwhy);
+
 #endif  /* ! THREAD_PROC_H */
 
@@ -0,0 +1,109 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_ARCH_URING_H
+#define APR_ARCH_URING_H
+
+#include "apr.h"
+#include "apr_private.h"
+#include "apr_errno.h"
+#include "apr_time.h"
+#include "apr_atomic.h"
+
+#if defined(HAVE_IO_URING)
+
+#include <linux/io_uring.h>
+
+/*
+ * A Linux io_uring, set up with the raw system calls, shared by the
+ * io_uring pollset and aio ring.  The submission queue has a single
+ * producer (the callers serialize apr_uring_get_sqe() and
+ * apr_uring_commit_sqe()) and the completion queue a single consumer.
+ */
+typedef struct apr_uring_t {
+    int fd;
+    unsigned sq_entries;
+    unsigned sq_mask;
+    unsigned sq_tail;
+    volatile unsigned *sq_khead;
+    volatile unsigned *sq_ktail;
+    struct io_uring_sqe *sqes;
+    unsigned cq_mask;
+    volatile unsigned *cq_khead;
+    volatile unsigned *cq_ktail;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    apr_size_t sq_ring_len;
+    void *cq_ring;
+    apr_size_t cq_ring_len;
+    apr_size_t sqes_len;
+} apr_uring_t;
+
+/* Set up a ring of at least entries, APR_ENOTIMPL if io_uring is not
+ * available or lacks the IORING_FEAT_EXT_ARG of Linux 5.11.
+ */
+apr_status_t apr_uring_setup(apr_uring_t *ring, apr_uint32_t entries);
+void apr_uring_close(apr_uring_t *ring);
+/* Whether the kernel supports the IORING_OP_* op */
+int apr_uring_supports(apr_uring_t *ring, int op);
+/* io_uring_enter(), waiting with a timeout (negative: none) for
+ * IORING_ENTER_GETEVENTS.
+ */
+int apr_uring_enter(apr_uring_t *ring, unsigned to_submit,
+                    unsigned min_complete, unsigned flags,
+                    apr_interval_time_t timeout);
+/* Get a zeroed SQE, submitting the queued ones if the queue is full */
+struct io_uring_sqe *apr_uring_get_sqe(apr_uring_t *ring, apr_status_t *rv);
+/* Submit all the queued SQEs */
+apr_status_t apr_uring_submit(apr_uring_t *ring);
+
+/* The number of queued SQEs that the kernel did not take yet */
+static APR_INLINE unsigned apr_uring_sq_pending(apr_uring_t *ring)
+{
+    return ring->sq_tail - apr_atomic_read32((volatile apr_uint32_t *)
+                                             ring->sq_khead);
+}
+
+/* Make the SQE got by apr_uring_get_sqe() visible to the kernel */
+static APR_INLINE void apr_uring_commit_sqe(apr_uring_t *ring)
+{
+    ring->sq_tail++;
+    apr_atomic_set32((volatile apr_uint32_t *)ring->sq_ktail, ring->sq_tail);
+}
+
+static APR_INLINE int apr_uring_cq_ready(apr_uring_t *ring)
+{
+    return *ring->cq_khead
+           != apr_atomic_read32((volatile apr_uint32_t *)ring->cq_ktail);
+}
+
+/* Pop a completion into *cqe, 0 if there is none */
+static APR_INLINE int apr_uring_get_cqe(apr_uring_t *ring,
+                                        struct io_uring_cqe *cqe)
+{
+    unsigned head = *ring->cq_khead;
+
+    if (head == apr_atomic_read32((volatile apr_uint32_t *)ring->cq_ktail)) {
+        return 0;
+    }
+    *cqe = ring->cqes[head & ring->cq_mask];
+    apr_atomic_set32((volatile apr_uint32_t *)ring->cq_khead, head + 1);
+    return 1;
+}
+
+#endif /* HAVE_IO_URING */
+
+#endif /* APR_ARCH_URING_H */
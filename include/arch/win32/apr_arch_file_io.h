@@ -86,6 +86,10 @@ void *res_name_from_filename(const char *file, int global, apr_pool_t *pool);
 /* For backwards-compat */
 #define APR_FILE_BUFSIZE APR_FILE_DEFAULT_BUFSIZE
 
+/* The sizes of apr_file_buffer_default_set(), for APR_FOPEN_BUFFERED */
+extern apr_size_t apr_file_default_bufsize;
+extern apr_size_t apr_file_max_bufsize;
+
 /* obscure ommissions from msvc's sys/stat.h */
 #ifdef _MSC_VER
 #define S_IFIFO        _S_IFIFO /* pipe */
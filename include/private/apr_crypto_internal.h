@@ -400,6 +400,43 @@ struct apr_crypto_driver_t {
     apr_status_t (*cprng_stream_ctx_bytes)(cprng_stream_ctx_t **pctx, unsigned char *key,
             unsigned char *to, apr_size_t n, const unsigned char *z);
 
+    /**
+     * @brief Encrypt and authenticate in one go with an AEAD key.
+     * @param out The buffer of inlen bytes for the encrypted data.
+     * @param tag The buffer for the authentication tag.
+     * @param taglen The size of the tag, up to APR_CRYPTO_AEAD_TAGSIZE.
+     * @param in The data to encrypt.
+     * @param inlen The length of the data.
+     * @param aad The additional data authenticated, not encrypted.
+     * @param aadlen The length of the additional data.
+     * @param iv The initialisation vector (nonce), of APR_CRYPTO_AEAD_IVSIZE.
+     * @param key The key.
+     * @return APR_EINVAL if the key is not AEAD. NULL if not implemented.
+     */
+    apr_status_t (*aead_encrypt)(unsigned char *out, unsigned char *tag,
+            apr_size_t taglen, const unsigned char *in, apr_size_t inlen,
+            const unsigned char *aad, apr_size_t aadlen,
+            const unsigned char *iv, const apr_crypto_key_t *key);
+
+    /**
+     * @brief Verify and decrypt in one go with an AEAD key.
+     * @param out The buffer of inlen bytes for the decrypted data.
+     * @param tag The authentication tag to verify.
+     * @param taglen The size of the tag, up to APR_CRYPTO_AEAD_TAGSIZE.
+     * @param in The data to decrypt.
+     * @param inlen The length of the data.
+     * @param aad The additional data authenticated, not encrypted.
+     * @param aadlen The length of the additional data.
+     * @param iv The initialisation vector (nonce), of APR_CRYPTO_AEAD_IVSIZE.
+     * @param key The key.
+     * @return APR_ENOVERIFY if the data is not authentic, APR_EINVAL if
+     *         the key is not AEAD. NULL if not implemented.
+     */
+    apr_status_t (*aead_decrypt)(unsigned char *out, const unsigned char *tag,
+            apr_size_t taglen, const unsigned char *in, apr_size_t inlen,
+            const unsigned char *aad, apr_size_t aadlen,
+            const unsigned char *iv, const apr_crypto_key_t *key);
+
 };
 
 #endif
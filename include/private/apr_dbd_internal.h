@@ -349,6 +349,90 @@ struct apr_dbd_driver_t {
      */
     apr_status_t (*datum_get)(const apr_dbd_row_t *row, int col,
                               apr_dbd_type_e type, void *data);
+
+    /* The below are optional, NULL if not supported by the driver */
+
+    /** pipeline_begin: send the next queries without waiting for their
+     *  results
+     *
+     *  @param pool - working pool
+     *  @param handle - the connection
+     *  @return 0 for success or error code
+     */
+    int (*pipeline_begin)(apr_pool_t *pool, apr_dbd_t *handle);
+
+    /** pipeline_pquery: queue a query using a prepared statement + args
+     *
+     *  @param pool - working pool
+     *  @param handle - the connection
+     *  @param statement - the prepared statement to execute
+     *  @param args - args to prepared statement
+     *  @return 0 for success or error code
+     */
+    int (*pipeline_pquery)(apr_pool_t *pool, apr_dbd_t *handle,
+                           apr_dbd_prepared_t *statement, const char **args);
+
+    /** pipeline_pbquery: queue a query using a prepared statement + binary
+     *  args
+     *
+     *  @param pool - working pool
+     *  @param handle - the connection
+     *  @param statement - the prepared statement to execute
+     *  @param args - binary args to prepared statement
+     *  @return 0 for success or error code
+     */
+    int (*pipeline_pbquery)(apr_pool_t *pool, apr_dbd_t *handle,
+                            apr_dbd_prepared_t *statement, const void **args);
+
+    /** pipeline_end: wait for the results of the queued queries
+     *
+     *  @param pool - working pool
+     *  @param handle - the connection
+     *  @param nrows - number of rows affected by all the queries
+     *  @param reqevents - NULL to block, else the events to poll for
+     *  @return 0 for success, APR_EAGAIN if not done yet, or error code
+     */
+    int (*pipeline_end)(apr_pool_t *pool, apr_dbd_t *handle, int *nrows,
+                        apr_int16_t *reqevents);
+
+    /** socket_get: get the socket of the connection, to poll it
+     *
+     *  @param pool - pool to allocate the socket
+     *  @param handle - the connection
+     *  @param sock - the socket, not to be closed
+     *  @return APR_SUCCESS or error code
+     */
+    apr_status_t (*socket_get)(apr_pool_t *pool, apr_dbd_t *handle,
+                               apr_socket_t **sock);
+
+    /** bulk_begin: start loading rows into a table
+     *
+     *  @param pool - pool to allocate the load from
+     *  @param handle - the connection
+     *  @param table - the table
+     *  @param ncols - number of columns
+     *  @param columns - the columns
+     *  @param bulk - the driver's load
+     *  @return 0 for success or error code
+     */
+    int (*bulk_begin)(apr_pool_t *pool, apr_dbd_t *handle, const char *table,
+                      int ncols, const char *const *columns, void **bulk);
+
+    /** bulk_row: load a row
+     *
+     *  @param bulk - the driver's load
+     *  @param values - the values of the columns, NULL for SQL NULL
+     *  @return 0 for success or error code
+     */
+    int (*bulk_row)(void *bulk, const char *const *values);
+
+    /** bulk_end: end a load
+     *
+     *  @param bulk - the driver's load
+     *  @param nrows - number of rows loaded
+     *  @return 0 for success or error code
+     */
+    int (*bulk_end)(void *bulk, int *nrows);
 };
 
 /* Export mutex lock/unlock for drivers that need it
@@ -84,6 +84,15 @@ struct apr_dbm_driver_t {
                          const char **used1,
                          const char **used2);
 
+    /** Fetch several dbm record values by key, NULL if not supported */
+    apr_status_t (*fetch_multi)(apr_dbm_t *dbm, const apr_datum_t *keys,
+                                apr_size_t nkeys, apr_datum_t *values,
+                                apr_pool_t *pool);
+
+    /** Call a function for each record of a dbm, NULL if not supported */
+    apr_status_t (*iterate)(apr_dbm_t *dbm, apr_dbm_iterate_cb_t *cb,
+                            void *baton);
+
 };
 
 
@@ -113,6 +122,7 @@ APR_MODULE_DECLARE_DATA extern const apr_dbm_driver_t apr_dbm_type_sdbm;
 APR_MODULE_DECLARE_DATA extern const apr_dbm_driver_t apr_dbm_type_gdbm;
 APR_MODULE_DECLARE_DATA extern const apr_dbm_driver_t apr_dbm_type_ndbm;
 APR_MODULE_DECLARE_DATA extern const apr_dbm_driver_t apr_dbm_type_db;
+APR_MODULE_DECLARE_DATA extern const apr_dbm_driver_t apr_dbm_type_lsm;
 
 #ifdef __cplusplus
 }
@@ -81,6 +81,49 @@ static unsigned char convert_e2a[256] = {
 
 #endif /* !APR_CHARSET_EBCDIC */
 
+/* Vectors of 16 bytes with a byte shuffle: SSSE3 on x86-64, detected at
+ * run time by HAVE_ENCODE_SIMD() and enabled by ENCODE_SIMD_TARGET on the
+ * functions using it, or NEON on AArch64.
+ */
+#if !APR_CHARSET_EBCDIC
+#if defined(__GNUC__) && defined(__x86_64__) \
+    && (defined(__clang__) || __GNUC__ >= 5)
+#include <tmmintrin.h>
+#define ENCODE_SSSE3
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define ENCODE_NEON
+#endif
+#endif /* !APR_CHARSET_EBCDIC */
+
+#if defined(ENCODE_SSSE3)
+
+#define ENCODE_SIMD_TARGET __attribute__((target("ssse3")))
+
+static APR_INLINE int have_ssse3(void)
+{
+    static int ssse3 = -1;
+
+    if (ssse3 < 0) {
+        unsigned int eax = 1, ebx, ecx, edx;
+
+        __asm__ __volatile__ ("cpuid"
+                              : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+        ssse3 = (ecx >> 9) & 1;
+    }
+    return ssse3;
+}
+
+#define HAVE_ENCODE_SIMD() have_ssse3()
+
+#elif defined(ENCODE_NEON)
+
+#define ENCODE_SIMD_TARGET
+
+#define HAVE_ENCODE_SIMD() 1
+
+#endif
+
 /** @} */
 #ifdef __cplusplus
 }
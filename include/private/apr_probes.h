@@ -0,0 +1,72 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_PROBES_H
+#define APR_PROBES_H
+
+/**
+ * @file apr_probes.h
+ * @brief APR static tracepoints
+ *
+ * USDT probes of the "apr" provider, compiled in when <sys/sdt.h> is
+ * found (unless --disable-usdt), for SystemTap, DTrace or bpftrace to
+ * attach to, e.g. "bpftrace -e 'usdt:libapr-2.so:apr:pool__create {...}'".
+ * A probe is a nop instruction until a tracer enables it, but its
+ * arguments are still evaluated, so they must be cheap to compute.
+ *
+ * The probes are named after what they trace, with "__" as separator
+ * (shown as "-" by the tracers):
+ *   pool__create(pool, parent), pool__clear(pool), pool__destroy(pool),
+ *   allocator__alloc(allocator, node, size),
+ *   allocator__free(allocator, nodes) with the list of nodes given back,
+ *   thread_pool__push(task, func, param),
+ *   thread_pool__start(pool, task, usecs waited since the push),
+ *   thread_pool__finish(pool, task),
+ *   pollset__enter(pollset, timeout), pollset__exit(pollset, rv, num),
+ *   pollcb__enter(pollcb, timeout), pollcb__exit(pollcb, rv),
+ *   socket__send(sock, len), socket__recv(sock, len) and
+ *   socket__sendv(sock, len) when successful,
+ *   socket__sendfile(sock, file, rv, len),
+ *   thread_mutex__block(mutex) when a mutex is contended, and
+ *   thread_mutex__acquire(mutex, rv) once it is acquired.
+ */
+
+#include "apr.h"
+#include "apr_private.h"
+
+#if APR_USE_USDT_PROBES
+
+#include <sys/sdt.h>
+
+#define APR_HAS_PROBES 1
+
+#define APR_PROBE1(name, a)             DTRACE_PROBE1(apr, name, a)
+#define APR_PROBE2(name, a, b)          DTRACE_PROBE2(apr, name, a, b)
+#define APR_PROBE3(name, a, b, c)       DTRACE_PROBE3(apr, name, a, b, c)
+#define APR_PROBE4(name, a, b, c, d)    DTRACE_PROBE4(apr, name, a, b, c, d)
+
+#else
+
+#define APR_HAS_PROBES 0
+
+#define APR_PROBE1(name, a)             do { } while (0)
+#define APR_PROBE2(name, a, b)          do { } while (0)
+#define APR_PROBE3(name, a, b, c)       do { } while (0)
+#define APR_PROBE4(name, a, b, c, d)    do { } while (0)
+
+#endif /* APR_USE_USDT_PROBES */
+
+#endif /* APR_PROBES_H */
@@ -0,0 +1,87 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file apr_sha_private.h
+ * @brief APR-UTIL SHA-1/SHA-256 Private
+ */
+#ifndef APR_SHA_PRIVATE_H
+#define APR_SHA_PRIVATE_H
+
+#include "apr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup APR_Util_SHA_Private
+ * @ingroup APR_Util
+ * @{
+ */
+
+/* The x86 SHA extensions (SHA-NI), detected at run time by HAVE_SHA_NI()
+ * and enabled by SHA_NI_TARGET on the functions using them.  The block
+ * functions also need SSSE3 for the byte shuffles and SSE4.1 for the
+ * blends and extracts, which every CPU with SHA-NI has.
+ */
+#if defined(__GNUC__) && defined(__x86_64__) \
+    && (defined(__clang__) || __GNUC__ >= 5)
+#include <immintrin.h>
+#define SHA_NI
+
+#define SHA_NI_TARGET __attribute__((target("sha,ssse3,sse4.1")))
+
+static APR_INLINE int have_sha_ni(void)
+{
+    static int sha_ni = -1;
+
+    if (sha_ni < 0) {
+        unsigned int eax = 0, ebx, ecx, edx;
+        unsigned int max, features;
+
+        __asm__ __volatile__ ("cpuid"
+                              : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+        max = eax;
+
+        eax = 1;
+        __asm__ __volatile__ ("cpuid"
+                              : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+        features = ecx;
+
+        sha_ni = 0;
+        if (max >= 7 && (features & (1u << 9)) && (features & (1u << 19))) {
+            eax = 7;
+            ecx = 0;
+            __asm__ __volatile__ ("cpuid"
+                                  : "+a" (eax), "=b" (ebx), "+c" (ecx),
+                                    "=d" (edx));
+            sha_ni = (ebx >> 29) & 1;
+        }
+    }
+    return sha_ni;
+}
+
+#define HAVE_SHA_NI() have_sha_ni()
+
+#endif
+
+/** @} */
+#ifdef __cplusplus
+}
+#endif
+
+#endif                          /* !APR_SHA_PRIVATE_H */
@@ -17,6 +17,147 @@
 #include "apr_jose.h"
 #include "apr_lib.h"
 #include "apr_encode.h"
+#include "apr_random.h"
+#include "apr_time.h"
+#include "apr_thread_mutex.h"
+
+/* The signature was verified already (cache hit), internal only */
+#define APR_JOSE_FLAG_VERIFIED    0x10000
+
+#define APR_JOSE_CACHE_DIGEST_SIZE 32
+
+typedef struct apr_jose_cache_entry_t {
+    unsigned char digest[APR_JOSE_CACHE_DIGEST_SIZE];
+    apr_time_t expires;
+} apr_jose_cache_entry_t;
+
+/* Direct mapped by the SHA-256 of the whole token */
+struct apr_jose_cache_t {
+    apr_jose_cache_entry_t *entries;
+    apr_size_t mask;
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex;
+#endif
+};
+
+APR_DECLARE(apr_status_t) apr_jose_cache_create(apr_jose_cache_t **cache,
+        apr_size_t max, apr_pool_t *pool)
+{
+    apr_jose_cache_t *c;
+    apr_size_t n = 1;
+
+    *cache = NULL;
+
+    if (!max || max > APR_SIZE_MAX / 2 / sizeof(apr_jose_cache_entry_t)) {
+        return APR_EINVAL;
+    }
+    while (n < max) {
+        n <<= 1;
+    }
+
+    c = apr_pcalloc(pool, sizeof(*c));
+    c->entries = apr_pcalloc(pool, n * sizeof(apr_jose_cache_entry_t));
+    c->mask = n - 1;
+#if APR_HAS_THREADS
+    {
+        apr_status_t rv = apr_thread_mutex_create(&c->mutex,
+                APR_THREAD_MUTEX_DEFAULT, pool);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+    }
+#endif
+
+    *cache = c;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(void) apr_jose_cache_clear(apr_jose_cache_t *cache)
+{
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(cache->mutex);
+#endif
+    memset(cache->entries, 0,
+           (cache->mask + 1) * sizeof(apr_jose_cache_entry_t));
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(cache->mutex);
+#endif
+}
+
+static apr_jose_cache_entry_t *apr_jose_cache_slot(apr_jose_cache_t *cache,
+        const unsigned char *digest)
+{
+    apr_size_t h = (apr_size_t)digest[0] | (apr_size_t)digest[1] << 8
+            | (apr_size_t)digest[2] << 16 | (apr_size_t)digest[3] << 24;
+
+    return &cache->entries[h & cache->mask];
+}
+
+static int apr_jose_cache_lookup(apr_jose_cache_t *cache,
+        const unsigned char *digest)
+{
+    apr_jose_cache_entry_t *entry = apr_jose_cache_slot(cache, digest);
+    int found;
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(cache->mutex);
+#endif
+    found = !memcmp(entry->digest, digest, APR_JOSE_CACHE_DIGEST_SIZE)
+            && entry->expires > apr_time_now();
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(cache->mutex);
+#endif
+
+    return found;
+}
+
+static void apr_jose_cache_store(apr_jose_cache_t *cache,
+        const unsigned char *digest, apr_jose_t *jose)
+{
+    apr_jose_cache_entry_t *entry;
+    apr_json_kv_t *kv = NULL;
+    apr_time_t expires;
+
+    /* the claims of the verified JWT, if any */
+    while (jose && jose->type == APR_JOSE_TYPE_JWS && jose->jose.jws) {
+        jose = jose->jose.jws->payload;
+    }
+    if (jose && jose->type == APR_JOSE_TYPE_JWT && jose->jose.jwt) {
+        kv = apr_json_object_get(jose->jose.jwt->claims,
+                APR_JOSE_JWT_EXPIRATION_TIME, APR_JSON_VALUE_STRING);
+    }
+
+    /* tokens are cached until they expire, never without an expiry */
+    if (!kv) {
+        return;
+    }
+    if (kv->v->type == APR_JSON_LONG
+            && kv->v->value.lnumber > 0
+            && kv->v->value.lnumber < APR_INT64_MAX / APR_USEC_PER_SEC) {
+        expires = apr_time_from_sec(kv->v->value.lnumber);
+    }
+    else if (kv->v->type == APR_JSON_DOUBLE
+            && kv->v->value.dnumber > 0
+            && kv->v->value.dnumber < APR_INT64_MAX / APR_USEC_PER_SEC) {
+        expires = apr_time_from_sec((apr_int64_t)kv->v->value.dnumber);
+    }
+    else {
+        return;
+    }
+    if (expires <= apr_time_now()) {
+        return;
+    }
+
+    entry = apr_jose_cache_slot(cache, digest);
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(cache->mutex);
+#endif
+    memcpy(entry->digest, digest, APR_JOSE_CACHE_DIGEST_SIZE);
+    entry->expires = expires;
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(cache->mutex);
+#endif
+}
 
 static
 apr_status_t apr_jose_flatten(apr_bucket_brigade *bb, apr_jose_text_t *in,
@@ -270,6 +411,11 @@ apr_status_t apr_jose_decode_jws_signature(apr_jose_t **jose,
      * FIXME fill in from RFC
      */
 
+    /* verified already, the very same token */
+    if (*flags & APR_JOSE_FLAG_VERIFIED) {
+        return APR_SUCCESS;
+    }
+
     status = cb->verify(bb, *jose, signature, cb->ctx, flags, pool);
 
     return status;
@@ -407,7 +553,7 @@ apr_status_t apr_jose_decode_compact_jws(apr_jose_t **jose,
     const char *dot;
     apr_bucket *e;
     apr_status_t status = APR_EINVAL;
-    int vflags = APR_JOSE_FLAG_NONE;
+    int vflags = flags & APR_JOSE_FLAG_VERIFIED;
 
     if (!cb || !cb->verify) {
         apr_errprintf(&(*jose)->result, pool, NULL, 0,
@@ -644,9 +790,10 @@ apr_status_t apr_jose_decode_compact_jwe(apr_jose_t **jose, const char *left,
 
 static
 apr_status_t apr_jose_decode_compact(apr_jose_t **jose, const char *typ,
-        apr_bucket_brigade *brigade, apr_jose_cb_t *cb, int level, int flags,
-        apr_pool_t *pool)
+        apr_bucket_brigade *brigade, apr_jose_cb_t *cb,
+        apr_jose_cache_t *cache, int level, int flags, apr_pool_t *pool)
 {
+    unsigned char digest[APR_JOSE_CACHE_DIGEST_SIZE];
     apr_bucket_brigade *bb;
     apr_jose_text_t in;
     apr_jose_text_t ph64;
@@ -774,12 +921,26 @@ apr_status_t apr_jose_decode_compact(apr_jose_t **jose, const char *typ,
     kv = apr_json_object_get(header, APR_JOSE_JWE_ENCRYPTION,
             APR_JSON_VALUE_STRING);
     if (kv) {
+        /* only the signatures are cached */
+        cache = NULL;
         status = apr_jose_decode_compact_jwe(jose, left, right, header, kv->v,
                 typ, cty, &ph64, cb, level, flags, pool, bb);
     } else {
+        if (cache) {
+            apr_crypto_hash_t *h = apr_crypto_sha256_new(pool);
+
+            h->init(h);
+            h->add(h, in.text, in.len);
+            h->finish(h, digest);
+            if (apr_jose_cache_lookup(cache, digest)) {
+                flags |= APR_JOSE_FLAG_VERIFIED;
+                cache = NULL;
+            }
+        }
         status = apr_jose_decode_compact_jws(jose, left, right, header, typ, cty, &in, &ph64,
                 cb, level, flags, pool, bb);
     }
+    flags &= ~APR_JOSE_FLAG_VERIFIED;
 
     if (APR_SUCCESS == status) {
 
@@ -819,6 +980,10 @@ apr_status_t apr_jose_decode_compact(apr_jose_t **jose, const char *typ,
                     level, flags, pool);
         }
 
+        if (APR_SUCCESS == status && cache) {
+            apr_jose_cache_store(cache, digest, *jose);
+        }
+
     }
 
     return status;
@@ -1681,10 +1846,10 @@ apr_status_t apr_jose_decode_json(apr_jose_t **jose, const char *typ,
     return status;
 }
 
-APR_DECLARE(apr_status_t) apr_jose_decode(apr_jose_t **jose, const char *typ,
-                                          apr_bucket_brigade *brigade,
-                                          apr_jose_cb_t *cb, int level,
-                                          int flags, apr_pool_t *pool)
+static
+apr_status_t apr_jose_decode_ex(apr_jose_t **jose, const char *typ,
+        apr_bucket_brigade *brigade, apr_jose_cb_t *cb,
+        apr_jose_cache_t *cache, int level, int flags, apr_pool_t *pool)
 {
 
     /* handle JOSE and JOSE+JSON */
@@ -1698,10 +1863,10 @@ APR_DECLARE(apr_status_t) apr_jose_decode(apr_jose_t **jose, const char *typ,
 
                 if (!strcasecmp(sub, "jwt")) {
                     return apr_jose_decode_compact(jose, typ, brigade, cb,
-                            level, flags, pool);
+                            cache, level, flags, pool);
                 } else if (!strcasecmp(sub, "jose")) {
                     return apr_jose_decode_compact(jose, NULL, brigade, cb,
-                            level, flags, pool);
+                            cache, level, flags, pool);
                 } else if (!strcasecmp(sub, "jose+json")) {
                     return apr_jose_decode_json(jose, NULL, brigade, cb, level,
                             flags, pool);
@@ -1721,11 +1886,11 @@ APR_DECLARE(apr_status_t) apr_jose_decode(apr_jose_t **jose, const char *typ,
         case 'j': {
 
             if (!strcasecmp(typ, "JWT")) {
-                return apr_jose_decode_compact(jose, typ, brigade, cb, level, flags,
-                        pool);
+                return apr_jose_decode_compact(jose, typ, brigade, cb, cache,
+                        level, flags, pool);
             } else if (!strcasecmp(typ, "JOSE")) {
-                return apr_jose_decode_compact(jose, NULL, brigade, cb, level,
-                        flags, pool);
+                return apr_jose_decode_compact(jose, NULL, brigade, cb, cache,
+                        level, flags, pool);
             } else if (!strcasecmp(typ, "JOSE+JSON")) {
                 return apr_jose_decode_json(jose, NULL, brigade, cb, level, flags,
                         pool);
@@ -1744,3 +1909,98 @@ APR_DECLARE(apr_status_t) apr_jose_decode(apr_jose_t **jose, const char *typ,
 
     return apr_jose_decode_data(jose, typ, brigade, cb, level, flags, pool);
 }
+
+APR_DECLARE(apr_status_t) apr_jose_decode(apr_jose_t **jose, const char *typ,
+                                          apr_bucket_brigade *brigade,
+                                          apr_jose_cb_t *cb, int level,
+                                          int flags, apr_pool_t *pool)
+{
+    return apr_jose_decode_ex(jose, typ, brigade, cb, NULL, level, flags,
+            pool);
+}
+
+APR_DECLARE(apr_status_t) apr_jose_decode_cached(apr_jose_t **jose,
+        const char *typ, apr_bucket_brigade *brigade, apr_jose_cb_t *cb,
+        apr_jose_cache_t *cache, int level, int flags, apr_pool_t *pool)
+{
+    return apr_jose_decode_ex(jose, typ, brigade, cb, cache, level, flags,
+            pool);
+}
+
+APR_DECLARE(apr_status_t) apr_jose_decode_alg(const char **alg,
+        const char **kid, apr_bucket_brigade *brigade, apr_pool_t *pool)
+{
+    apr_bucket *e;
+    apr_json_value_t *header;
+    apr_json_kv_t *kv;
+    const char *ph64, *phs, *dot;
+    apr_size_t ph64len, phlen;
+    apr_off_t offset;
+    apr_status_t status;
+
+    *alg = NULL;
+    if (kid) {
+        *kid = NULL;
+    }
+
+    /*
+     * The Encoded JOSE Header is the portion before the first period,
+     * usually in the first bucket; the rest is not even flattened.
+     */
+    e = APR_BRIGADE_FIRST(brigade);
+    if (e == APR_BRIGADE_SENTINEL(brigade)) {
+        return APR_EINVAL;
+    }
+    status = apr_bucket_read(e, &ph64, &ph64len, APR_BLOCK_READ);
+    if (APR_SUCCESS != status) {
+        return status;
+    }
+    dot = memchr(ph64, '.', ph64len);
+    if (!dot) {
+        apr_jose_text_t in;
+
+        status = apr_jose_flatten(brigade, &in, pool);
+        if (APR_SUCCESS != status) {
+            return status;
+        }
+        ph64 = in.text;
+        dot = memchr(ph64, '.', in.len);
+        if (!dot) {
+            return APR_BADCH;
+        }
+    }
+    ph64len = dot - ph64;
+
+    phs = apr_pdecode_base64(pool, ph64, ph64len, APR_ENCODE_BASE64URL,
+            &phlen);
+    if (!phs) {
+        return APR_BADCH;
+    }
+
+    status = apr_json_decode(&header, phs, phlen, &offset,
+            APR_JSON_FLAGS_WHITESPACE, 10, pool);
+    if (APR_SUCCESS != status) {
+        return status;
+    }
+    if (header->type != APR_JSON_OBJECT) {
+        return APR_EINVAL;
+    }
+
+    kv = apr_json_object_get(header, APR_JOSE_JWKSE_ALGORITHM,
+            APR_JSON_VALUE_STRING);
+    if (!kv || kv->v->type != APR_JSON_STRING) {
+        return APR_EINVAL;
+    }
+    *alg = apr_pstrndup(pool, kv->v->value.string.p, kv->v->value.string.len);
+
+    if (kid) {
+        kv = apr_json_object_get(header, APR_JOSE_JWKSE_KEYID,
+                APR_JSON_VALUE_STRING);
+        if (kv && kv->v->type == APR_JSON_STRING) {
+            *kid = apr_pstrndup(pool, kv->v->value.string.p,
+                    kv->v->value.string.len);
+        }
+    }
+
+    return APR_SUCCESS;
+}
@@ -25,6 +25,9 @@
         APR_RING_CHECK_CONSISTENCY(&(o)->list, apr_json_kv_t, link);                             \
     } while (0)
 
+/* Objects with fewer key value pairs are searched linearly */
+#define JSON_OBJECT_HASH_MIN 8
+
 #define APR_JSON_ARRAY_INSERT_TAIL(o, e) do {                              \
         apr_json_value_t *ap__b = (e);                                        \
         APR_RING_INSERT_TAIL(&(o)->list, ap__b, apr_json_value_t, link);      \
@@ -45,11 +48,60 @@ APR_DECLARE(apr_json_value_t *) apr_json_object_create(apr_pool_t *pool)
     json->type = APR_JSON_OBJECT;
     json->value.object = object = apr_pcalloc(pool, sizeof(apr_json_object_t));
     APR_RING_INIT(&object->list, apr_json_kv_t, link);
-    object->hash = apr_hash_make(pool);
+    object->pool = pool;
 
     return json;
 }
 
+/* The hash of the object, once it has enough key value pairs for one */
+static apr_hash_t *json_object_index(apr_json_object_t *object)
+{
+    if (!object->hash && object->count >= JSON_OBJECT_HASH_MIN
+            && object->pool) {
+        apr_json_kv_t *kv;
+
+        object->hash = apr_hash_make(object->pool);
+        for (kv = APR_RING_FIRST(&object->list);
+             kv != APR_RING_SENTINEL(&object->list, apr_json_kv_t, link);
+             kv = APR_RING_NEXT(kv, link)) {
+            apr_hash_set(object->hash, kv->k->value.string.p,
+                    kv->k->value.string.len, kv);
+        }
+    }
+
+    return object->hash;
+}
+
+static apr_json_kv_t *json_object_find(apr_json_object_t *object,
+        const char *key, apr_ssize_t klen)
+{
+    apr_hash_t *hash = json_object_index(object);
+    apr_json_kv_t *kv;
+
+    if (hash) {
+        return apr_hash_get(hash, key, klen);
+    }
+
+    if (klen == APR_JSON_VALUE_STRING) {
+        klen = strlen(key);
+    }
+    for (kv = APR_RING_FIRST(&object->list);
+         kv != APR_RING_SENTINEL(&object->list, apr_json_kv_t, link);
+         kv = APR_RING_NEXT(kv, link)) {
+        const apr_json_string_t *k = &kv->k->value.string;
+        apr_ssize_t len = k->len;
+
+        if (len == APR_JSON_VALUE_STRING) {
+            len = strlen(k->p);
+        }
+        if (len == klen && !memcmp(k->p, key, klen)) {
+            return kv;
+        }
+    }
+
+    return NULL;
+}
+
 APR_DECLARE(apr_json_value_t *) apr_json_string_create(apr_pool_t *pool,
                                                        const char *val,
                                                        apr_ssize_t len)
@@ -135,9 +187,6 @@ APR_DECLARE(apr_status_t) apr_json_object_set(apr_json_value_t *object,
         const char *key, apr_ssize_t klen, apr_json_value_t *val,
         apr_pool_t *pool)
 {
-    apr_json_kv_t *kv;
-    apr_hash_t *hash;
-
     if (object->type != APR_JSON_OBJECT) {
         return APR_EINVAL;
     }
@@ -146,64 +195,59 @@ APR_DECLARE(apr_status_t) apr_json_object_set(apr_json_value_t *object,
         klen = strlen(key);
     }
 
-    hash = object->value.object->hash;
-
-    kv = apr_hash_get(hash, key, klen);
-
-    if (!val) {
-        if (kv) {
-            apr_hash_set(hash, key, klen, NULL);
-            APR_RING_REMOVE((kv), link);
-        }
-        return APR_SUCCESS;
-    }
-
-    if (!kv) {
-        kv = apr_palloc(pool, sizeof(apr_json_kv_t));
-        APR_RING_ELEM_INIT(kv, link);
-        APR_JSON_OBJECT_INSERT_TAIL(object->value.object, kv);
-        apr_hash_set(hash, key, klen,
-                kv);
-    }
-
-    kv->k = apr_json_string_create(pool, key, klen);
-    kv->v = val;
-
-    return APR_SUCCESS;
+    return apr_json_object_set_ex(object,
+            apr_json_string_create(pool, key, klen), val, pool);
 }
 
-APR_DECLARE(apr_status_t) apr_json_object_set_ex(apr_json_value_t *object,
+APR_DECLARE(apr_status_t) apr_json_object_set_ex(apr_json_value_t *obj,
                                                  apr_json_value_t *key,
                                                  apr_json_value_t *val,
                                                  apr_pool_t *pool)
 {
-    apr_json_kv_t *kv;
+    apr_json_object_t *object;
+    apr_json_kv_t *kv, *kv_new = NULL;
     apr_hash_t *hash;
 
-    if (object->type != APR_JSON_OBJECT
+    if (obj->type != APR_JSON_OBJECT
             || key->type != APR_JSON_STRING) {
         return APR_EINVAL;
     }
 
-    hash = object->value.object->hash;
-
-    kv = apr_hash_get(hash, key->value.string.p, key->value.string.len);
+    object = obj->value.object;
 
     if (!val) {
+        kv = json_object_find(object, key->value.string.p,
+                key->value.string.len);
         if (kv) {
-            apr_hash_set(hash, key->value.string.p, key->value.string.len,
-                    NULL);
+            if (object->hash) {
+                apr_hash_set(object->hash, key->value.string.p,
+                        key->value.string.len, NULL);
+            }
             APR_RING_REMOVE((kv), link);
+            object->count--;
         }
         return APR_SUCCESS;
     }
 
-    if (!kv) {
-        kv = apr_palloc(pool, sizeof(apr_json_kv_t));
+    hash = json_object_index(object);
+    if (hash) {
+        /* Hash the key once, whether new or not */
+        kv_new = apr_palloc(pool, sizeof(apr_json_kv_t));
+        kv = apr_hash_get_or_set(hash, key->value.string.p,
+                key->value.string.len, kv_new);
+    }
+    else {
+        kv = json_object_find(object, key->value.string.p,
+                key->value.string.len);
+        if (!kv) {
+            kv = kv_new = apr_palloc(pool, sizeof(apr_json_kv_t));
+        }
+    }
+
+    if (kv == kv_new) {
         APR_RING_ELEM_INIT(kv, link);
-        APR_JSON_OBJECT_INSERT_TAIL(object->value.object, kv);
-        apr_hash_set(hash, key->value.string.p, key->value.string.len,
-                kv);
+        APR_JSON_OBJECT_INSERT_TAIL(object, kv);
+        object->count++;
     }
 
     kv->k = key;
@@ -220,7 +264,7 @@ APR_DECLARE(apr_json_kv_t *) apr_json_object_get(apr_json_value_t *object,
         return NULL;
     }
 
-    return apr_hash_get(object->value.object->hash, key, klen);
+    return json_object_find(object->value.object, key, klen);
 }
 
 APR_DECLARE(apr_json_kv_t *) apr_json_object_first(apr_json_value_t *obj)
@@ -336,7 +380,7 @@ APR_DECLARE(apr_json_value_t *) apr_json_overlay(apr_pool_t *p,
 {
     apr_json_value_t *res;
     apr_json_kv_t *kv;
-    int oc, bc;
+    apr_size_t oc, bc;
 
     if (!base || base->type != APR_JSON_OBJECT) {
         return overlay;
@@ -348,11 +392,11 @@ APR_DECLARE(apr_json_value_t *) apr_json_overlay(apr_pool_t *p,
         return overlay;
     }
 
-    oc = apr_hash_count(overlay->value.object->hash);
+    oc = overlay->value.object->count;
     if (!oc) {
         return base;
     }
-    bc = apr_hash_count(base->value.object->hash);
+    bc = base->value.object->count;
     if (!bc) {
         return overlay;
     }
@@ -363,7 +407,7 @@ APR_DECLARE(apr_json_value_t *) apr_json_overlay(apr_pool_t *p,
          kv != APR_RING_SENTINEL(&(base->value.object)->list, apr_json_kv_t, link);
          kv = APR_RING_NEXT((kv), link)) {
 
-        if (!apr_hash_get(overlay->value.object->hash, kv->k->value.string.p,
+        if (!apr_json_object_get(overlay, kv->k->value.string.p,
                 kv->k->value.string.len)) {
 
             apr_json_object_set_ex(res, kv->k, kv->v, p);
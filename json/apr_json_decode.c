@@ -39,6 +39,115 @@ static apr_status_t apr_json_decode_space(apr_json_scanner_t * self,
 static apr_status_t apr_json_decode_value(apr_json_scanner_t * self,
                                           apr_json_value_t ** retval);
 
+/*
+ * Most of the input is in the runs of string characters (up to a '"',
+ * a '\\' or, when copying, a non-ASCII octet to validate) and of white
+ * space, skipped by 16 octets with SSE2 or NEON.
+ */
+#if defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#define JSON_SSE2
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define JSON_NEON
+#endif
+
+#if defined(JSON_NEON)
+/* The first index flagged (0xff) in m, or 16: four bits per octet */
+static APR_INLINE int json_first(uint8x16_t m)
+{
+    apr_uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(
+                            vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+
+    return bits ? __builtin_ctzll(bits) >> 2 : 16;
+}
+#endif
+
+/* The first '"' or '\\' (or non-ASCII octet with high) in [p, e), or e */
+static const char *json_string_run(const char *p, const char *e, int high)
+{
+#if defined(JSON_SSE2)
+    const __m128i quote = _mm_set1_epi8('"'), bslash = _mm_set1_epi8('\\');
+
+    while (e - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        unsigned int m = (unsigned int)_mm_movemask_epi8(
+                             _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                                          _mm_cmpeq_epi8(v, bslash)));
+
+        if (high) {
+            m |= (unsigned int)_mm_movemask_epi8(v);
+        }
+        if (m) {
+            return p + __builtin_ctz(m);
+        }
+        p += 16;
+    }
+#elif defined(JSON_NEON)
+    const uint8x16_t quote = vdupq_n_u8('"'), bslash = vdupq_n_u8('\\');
+
+    while (e - p >= 16) {
+        uint8x16_t v = vld1q_u8((const unsigned char *)p);
+        uint8x16_t m = vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, bslash));
+        int i;
+
+        if (high) {
+            m = vorrq_u8(m, vcgeq_u8(v, vdupq_n_u8(0x80)));
+        }
+        i = json_first(m);
+        if (i < 16) {
+            return p + i;
+        }
+        p += 16;
+    }
+#endif
+    while (p < e && *p != '"' && *p != '\\'
+           && !(high && (*(const unsigned char *)p & 0x80))) {
+        p++;
+    }
+    return p;
+}
+
+/* The first non white space octet in [p, e), or e */
+static const char *json_skip_space(const char *p, const char *e)
+{
+#if defined(JSON_SSE2)
+    while (e - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        /* ' ', or '\t' to '\r' shifted to the bottom of the signed octets */
+        __m128i sp = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                         _mm_cmplt_epi8(_mm_add_epi8(v,
+                                            _mm_set1_epi8((char)(0x80 - 9))),
+                                        _mm_set1_epi8((char)(0x80 + 5))));
+        unsigned int m = (unsigned int)_mm_movemask_epi8(sp) ^ 0xffff;
+
+        if (m) {
+            p += __builtin_ctz(m);
+            break;
+        }
+        p += 16;
+    }
+#elif defined(JSON_NEON)
+    while (e - p >= 16) {
+        uint8x16_t v = vld1q_u8((const unsigned char *)p);
+        uint8x16_t sp = vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')),
+                                 vcltq_u8(vsubq_u8(v, vdupq_n_u8(9)),
+                                          vdupq_n_u8(5)));
+        int i = json_first(vmvnq_u8(sp));
+
+        p += i;
+        if (i < 16) {
+            break;
+        }
+    }
+#endif
+    /* and whatever else the locale has for space */
+    while (p < e && isspace(*(const unsigned char *)p)) {
+        p++;
+    }
+    return p;
+}
+
 /* stolen from mod_mime_magic.c :) */
 /* Single hex char to int; -1 if not a hex char. */
 static int hex_to_int(int c)
@@ -98,9 +207,13 @@ static apr_status_t apr_json_decode_string(apr_json_scanner_t * self, apr_json_s
     /* advance past the \ " */
     len = 0;
     for (p = self->p, e = self->e; p < e;) {
-        if (*p == '"')
+        const char *r = json_string_run(p, e, 0);
+
+        len += r - p;
+        p = r;
+        if (p >= e || *p == '"')
             break;
-        else if (*p == '\\') {
+        else {
             p++;
             if (p >= e) {
                 status = APR_EOF;
@@ -119,13 +232,20 @@ static apr_status_t apr_json_decode_string(apr_json_scanner_t * self, apr_json_s
                 p++;
             }
         }
-        else {
-            len++;
-            p++;
-        }
+    }
+    if (p >= e) {
+        /* no trailing '"' */
+        status = APR_EOF;
+        goto out;
     }
 
-    string.p = q = apr_pcalloc(self->pool, len + 1);
+    if (self->flags & APR_JSON_FLAGS_INSITU) {
+        /* Unescaping never makes the string longer */
+        string.p = q = (char *)self->p;
+    }
+    else {
+        string.p = q = apr_palloc(self->pool, len + 1);
+    }
     e = p;
 
 #define VALIDATE_UTF8_SUCCEEDING_BYTE(p) \
@@ -135,6 +255,17 @@ static apr_status_t apr_json_decode_string(apr_json_scanner_t * self, apr_json_s
     }
 
     for (p = self->p; p < e;) {
+        const char *r = json_string_run(p, e, 1);
+
+        if (r > p) {
+            if (q != p) {
+                memmove(q, p, r - p);
+            }
+            q += r - p;
+            p = r;
+            if (p >= e)
+                break;
+        }
         switch (*(unsigned char *)p) {
         case '\\':
             p++;
@@ -413,14 +544,19 @@ static apr_status_t apr_json_decode_array(apr_json_scanner_t * self,
     }
 
     {
-        apr_json_value_t *element = apr_json_array_first(array);
+        apr_json_value_t *element;
+        apr_json_value_t **elts;
+
         array->value.array->array = apr_array_make(self->pool, count,
                                                    sizeof(apr_json_value_t *));
-        while (element) {
-            *((apr_json_value_t **) (apr_array_push(array->value.array->array))) =
-                    element;
-            element = apr_json_array_next(array, element);
+        elts = (apr_json_value_t **)array->value.array->array->elts;
+        for (element = APR_RING_FIRST(&array->value.array->list);
+             element != APR_RING_SENTINEL(&array->value.array->list,
+                                          apr_json_value_t, link);
+             element = APR_RING_NEXT(element, link)) {
+            *elts++ = element;
         }
+        array->value.array->array->nelts = count;
     }
 
     self->level++;
@@ -436,7 +572,7 @@ static apr_status_t apr_json_decode_object(apr_json_scanner_t * self,
     apr_json_object_t *object = apr_pcalloc(self->pool,
             sizeof(apr_json_object_t));
     APR_RING_INIT(&object->list, apr_json_kv_t, link);
-    object->hash = apr_hash_make(self->pool);
+    object->pool = self->pool;
 
     *retval = object;
 
@@ -504,6 +640,7 @@ static apr_status_t apr_json_decode_object(apr_json_scanner_t * self,
         if ((status = apr_json_decode_value(self, &value)))
             goto out;
 
+        /* Later duplicate keys replace the value in place */
         apr_json_object_set_ex(json, key, value, self->pool);
 
         if (self->p == self->e) {
@@ -687,34 +824,25 @@ static apr_status_t apr_json_decode_null(apr_json_scanner_t * self)
 static apr_status_t apr_json_decode_space(apr_json_scanner_t * self,
         const char **space)
 {
-    const char *p = self->p;
+    const char *p;
     char *s;
-    int len = 0;
+    apr_size_t len;
 
     *space = NULL;
 
-    if (self->p >= self->e) {
+    if (self->p >= self->e || !isspace(*(const unsigned char *)self->p)) {
         return APR_SUCCESS;
     }
 
-    while (p < self->e && isspace(*(unsigned char *)p)) {
-        p++;
-        len++;
-    }
-
-    if (self->flags & APR_JSON_FLAGS_WHITESPACE) {
-        if (len) {
-            *space = s = apr_palloc(self->pool, len + 1);
-
-            while (self->p < self->e && isspace(*(unsigned char *) self->p)) {
-                *s++ = *self->p++;
-            }
-            *s = 0;
+    p = json_skip_space(self->p, self->e);
+    len = p - self->p;
 
-        }
-    } else {
-        self->p = p;
+    if ((self->flags & APR_JSON_FLAGS_WHITESPACE) && len) {
+        *space = s = apr_palloc(self->pool, len + 1);
+        memcpy(s, self->p, len);
+        s[len] = 0;
     }
+    self->p = p;
 
     return APR_SUCCESS;
 }
@@ -809,6 +937,812 @@ APR_DECLARE(apr_status_t) apr_json_decode(apr_json_value_t ** retval,
     return status;
 }
 
+/* An RFC 6901 JSON pointer, unescaped */
+typedef struct json_pointer_t {
+    int ntokens;
+    const char **tokens;
+    apr_size_t *lens;
+    /* the array index of each token, or -1 */
+    apr_ssize_t *indexes;
+} json_pointer_t;
+
+static apr_status_t json_pointer_parse(json_pointer_t *ptr,
+        const char *path, apr_pool_t *pool)
+{
+    const char *p, *s, *end;
+    int i;
+
+    if (*path && *path != '/') {
+        return APR_EINVAL;
+    }
+
+    ptr->ntokens = 0;
+    for (p = path; *p; p++) {
+        if (*p == '/') {
+            ptr->ntokens++;
+        }
+    }
+    ptr->tokens = apr_palloc(pool, ptr->ntokens * sizeof(const char *));
+    ptr->lens = apr_palloc(pool, ptr->ntokens * sizeof(apr_size_t));
+    ptr->indexes = apr_palloc(pool, ptr->ntokens * sizeof(apr_ssize_t));
+
+    for (i = 0, p = path; i < ptr->ntokens; i++, p = end) {
+        apr_ssize_t index = 0;
+        char *q, *t;
+
+        s = p + 1;
+        end = strchr(s, '/');
+        if (!end) {
+            end = s + strlen(s);
+        }
+
+        ptr->tokens[i] = t = q = apr_palloc(pool, end - s + 1);
+        for (; s < end; s++) {
+            if (*s != '~') {
+                *q++ = *s;
+            }
+            else if (s[1] == '0') {
+                *q++ = '~';
+                s++;
+            }
+            else if (s[1] == '1') {
+                *q++ = '/';
+                s++;
+            }
+            else {
+                return APR_EINVAL;
+            }
+        }
+        *q = '\0';
+        ptr->lens[i] = q - t;
+
+        /* digits, without leading zeros */
+        if (q == t || (t[0] == '0' && q - t > 1)) {
+            index = -1;
+        }
+        for (; t < q && index >= 0; t++) {
+            if (!isdigit(*(unsigned char *)t) || index > APR_INT32_MAX / 10) {
+                index = -1;
+            }
+            else {
+                index = index * 10 + (*t - '0');
+            }
+        }
+        ptr->indexes[i] = index;
+    }
+
+    return APR_SUCCESS;
+}
+
+/* The value at the rest of the pointer, in a decoded value */
+static apr_json_value_t *json_pointer_get(apr_json_value_t *json,
+        const json_pointer_t *ptr, int depth)
+{
+    for (; json && depth < ptr->ntokens; depth++) {
+        if (json->type == APR_JSON_OBJECT) {
+            apr_json_kv_t *kv = apr_json_object_get(json, ptr->tokens[depth],
+                                                    ptr->lens[depth]);
+            json = kv ? kv->v : NULL;
+        }
+        else if (json->type == APR_JSON_ARRAY && ptr->indexes[depth] >= 0
+                 && ptr->indexes[depth] < json->value.array->array->nelts) {
+            json = apr_json_array_get(json, (int)ptr->indexes[depth]);
+        }
+        else {
+            json = NULL;
+        }
+    }
+    return json;
+}
+
+static apr_status_t json_skip_value(apr_json_scanner_t * self);
+
+static apr_status_t json_skip_string(apr_json_scanner_t * self)
+{
+    const char *p = json_string_run(self->p + 1, self->e, 1);
+    apr_json_string_t string;
+
+    if (p < self->e && *p == '"') {
+        self->p = p + 1;
+        return APR_SUCCESS;
+    }
+
+    /* Escapes and UTF-8 are checked (and failed) where decoding does */
+    return apr_json_decode_string(self, &string);
+}
+
+/* What apr_json_decode_array() and _object() accept, keeping nothing */
+static apr_status_t json_skip_container(apr_json_scanner_t * self)
+{
+    apr_status_t status;
+    char close = *self->p == '{' ? '}' : ']';
+
+    if (self->level <= 0) {
+        return APR_EINVAL;
+    }
+    self->level--;
+
+    self->p++;
+
+    for (;;) {
+        if (self->p == self->e) {
+            return APR_EOF;
+        }
+        if (*self->p == close) {
+            self->p++;
+            break;
+        }
+
+        if (close == '}') {
+            self->p = json_skip_space(self->p, self->e);
+            if (self->p == self->e) {
+                return APR_EOF;
+            }
+            if (*self->p != '"') {
+                return APR_BADCH;
+            }
+            if ((status = json_skip_string(self))) {
+                return status;
+            }
+            self->p = json_skip_space(self->p, self->e);
+            if (self->p == self->e) {
+                return APR_EOF;
+            }
+            if (*self->p != ':') {
+                return APR_BADCH;
+            }
+            self->p++;
+            if (self->p == self->e) {
+                return APR_EOF;
+            }
+        }
+
+        if ((status = json_skip_value(self))) {
+            return status;
+        }
+
+        if (self->p == self->e) {
+            return APR_EOF;
+        }
+        if (*self->p == ',') {
+            self->p++;
+        }
+        else if (*self->p != close) {
+            return APR_BADCH;
+        }
+    }
+
+    self->level++;
+
+    return APR_SUCCESS;
+}
+
+/* What apr_json_decode_value() accepts, keeping nothing */
+static apr_status_t json_skip_value(apr_json_scanner_t * self)
+{
+    apr_json_value_t value;
+    apr_status_t status;
+
+    self->p = json_skip_space(self->p, self->e);
+    if (self->p == self->e) {
+        return APR_EOF;
+    }
+
+    switch (*(unsigned char *) self->p) {
+    case '"':
+        status = json_skip_string(self);
+        break;
+    case '[':
+    case '{':
+        status = json_skip_container(self);
+        break;
+    case 'n':
+        status = apr_json_decode_null(self);
+        break;
+    case 't':
+    case 'f':
+        status = apr_json_decode_boolean(self, &value.value.boolean);
+        break;
+    case '-':
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+        status = apr_json_decode_number(self, &value);
+        break;
+    default:
+        status = APR_BADCH;
+    }
+
+    if (status == APR_SUCCESS) {
+        self->p = json_skip_space(self->p, self->e);
+    }
+    return status;
+}
+
+static apr_status_t json_extract_value(apr_json_scanner_t * self,
+        const json_pointer_t *ptrs, const int *active, int nactive,
+        int depth, apr_json_value_t **results);
+
+/* The members of an object or array on the path of the active pointers */
+static apr_status_t json_extract_container(apr_json_scanner_t * self,
+        const json_pointer_t *ptrs, const int *active, int nactive,
+        int depth, apr_json_value_t **results)
+{
+    apr_status_t status;
+    char close = *self->p == '{' ? '}' : ']';
+    int *next = apr_palloc(self->pool, nactive * sizeof(int));
+    apr_ssize_t count = 0;
+
+    if (self->level <= 0) {
+        return APR_EINVAL;
+    }
+    self->level--;
+
+    self->p++;
+
+    for (;; count++) {
+        int i, nnext = 0;
+
+        if (self->p == self->e) {
+            return APR_EOF;
+        }
+        if (*self->p == close) {
+            self->p++;
+            break;
+        }
+
+        if (close == '}') {
+            apr_json_string_t key;
+            const char *k, *r;
+
+            self->p = json_skip_space(self->p, self->e);
+            if (self->p == self->e) {
+                return APR_EOF;
+            }
+            if (*self->p != '"') {
+                return APR_BADCH;
+            }
+
+            /* Compare the key as is, unless escaped or not ASCII */
+            k = self->p + 1;
+            r = json_string_run(k, self->e, 1);
+            if (r < self->e && *r == '"') {
+                key.p = k;
+                key.len = r - k;
+                self->p = r + 1;
+            }
+            else if ((status = apr_json_decode_string(self, &key))) {
+                return status;
+            }
+
+            for (i = 0; i < nactive; i++) {
+                const json_pointer_t *ptr = &ptrs[active[i]];
+
+                if (ptr->lens[depth] == (apr_size_t)key.len
+                        && !memcmp(ptr->tokens[depth], key.p, key.len)) {
+                    next[nnext++] = active[i];
+                }
+            }
+
+            self->p = json_skip_space(self->p, self->e);
+            if (self->p == self->e) {
+                return APR_EOF;
+            }
+            if (*self->p != ':') {
+                return APR_BADCH;
+            }
+            self->p++;
+            if (self->p == self->e) {
+                return APR_EOF;
+            }
+        }
+        else {
+            for (i = 0; i < nactive; i++) {
+                if (ptrs[active[i]].indexes[depth] == count) {
+                    next[nnext++] = active[i];
+                }
+            }
+        }
+
+        if (nnext) {
+            /* A later duplicate key replaces the earlier values */
+            for (i = 0; i < nnext; i++) {
+                results[next[i]] = NULL;
+            }
+            status = json_extract_value(self, ptrs, next, nnext, depth + 1,
+                                        results);
+        }
+        else {
+            status = json_skip_value(self);
+        }
+        if (status) {
+            return status;
+        }
+
+        if (self->p == self->e) {
+            return APR_EOF;
+        }
+        if (*self->p == ',') {
+            self->p++;
+        }
+        else if (*self->p != close) {
+            return APR_BADCH;
+        }
+    }
+
+    self->level++;
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t json_extract_value(apr_json_scanner_t * self,
+        const json_pointer_t *ptrs, const int *active, int nactive,
+        int depth, apr_json_value_t **results)
+{
+    apr_status_t status;
+    int i;
+
+    /* A pointer ends here, then decode it all */
+    for (i = 0; i < nactive; i++) {
+        if (ptrs[active[i]].ntokens == depth) {
+            apr_json_value_t *json;
+
+            if ((status = apr_json_decode_value(self, &json))) {
+                return status;
+            }
+            for (i = 0; i < nactive; i++) {
+                results[active[i]] = json_pointer_get(json, &ptrs[active[i]],
+                                                      depth);
+            }
+            return APR_SUCCESS;
+        }
+    }
+
+    self->p = json_skip_space(self->p, self->e);
+    if (self->p == self->e) {
+        return APR_EOF;
+    }
+    if (*self->p != '{' && *self->p != '[') {
+        return json_skip_value(self);
+    }
+
+    status = json_extract_container(self, ptrs, active, nactive, depth,
+                                    results);
+    if (status == APR_SUCCESS) {
+        self->p = json_skip_space(self->p, self->e);
+    }
+    return status;
+}
+
+APR_DECLARE(apr_status_t) apr_json_extract(apr_json_value_t **results,
+        const char *injson, apr_ssize_t injson_size, apr_off_t * offset,
+        const char * const *paths, int npaths, int flags, int level,
+        apr_pool_t * pool)
+{
+    apr_status_t status;
+    apr_json_scanner_t scanner;
+    json_pointer_t *ptrs;
+    int *active;
+    int i;
+
+    ptrs = apr_palloc(pool, npaths * sizeof(json_pointer_t));
+    active = apr_palloc(pool, npaths * sizeof(int));
+    for (i = 0; i < npaths; i++) {
+        if ((status = json_pointer_parse(&ptrs[i], paths[i], pool))) {
+            if (offset) {
+                *offset = 0;
+            }
+            return status;
+        }
+        active[i] = i;
+        results[i] = NULL;
+    }
+
+    scanner.p = injson;
+    scanner.e = injson
+            + (injson_size == APR_JSON_VALUE_STRING ? strlen(injson) : injson_size);
+    scanner.pool = pool;
+    scanner.flags = flags;
+    scanner.level = level;
+
+    if (APR_SUCCESS == (status = json_extract_value(&scanner, ptrs, active,
+                                                    npaths, 0, results))) {
+        if (scanner.p != scanner.e) {
+            /* trailing craft */
+            status = APR_BADCH;
+        }
+    }
+
+    if (offset) {
+        *offset = scanner.p - injson;
+    }
+
+    return status;
+}
+
+/* The first buffer of a reader */
+#define JSON_READER_MIN_SIZE 4096
+
+/* Until something is written, never written to */
+static char json_reader_empty[1];
+
+/* What the reader expects next */
+typedef enum {
+    JSON_READER_TOP,            /* a top level value, or the end */
+    JSON_READER_VALUE,          /* a value */
+    JSON_READER_ARRAY_FIRST,    /* a value or ']' */
+    JSON_READER_OBJECT_FIRST,   /* a key or '}' */
+    JSON_READER_KEY,            /* a key */
+    JSON_READER_COLON,          /* ':' */
+    JSON_READER_NEXT            /* ',' or the end of the container */
+} json_reader_state_e;
+
+struct apr_json_reader_t {
+    apr_pool_t *pool;
+    /* The token strings, cleared for each token */
+    apr_pool_t *tpool;
+    apr_bucket_brigade *bb;
+    /* The text not decoded yet is [buf + pos, buf + len), NUL terminated */
+    char *buf;
+    apr_size_t pos;
+    apr_size_t len;
+    apr_size_t size;
+    /* The offset of buf in the text */
+    apr_off_t offset;
+    /* How much of the string being decoded was scanned */
+    apr_size_t scanned;
+    /* '{' or '[' for each container being decoded */
+    char *stack;
+    int depth;
+    int level;
+    json_reader_state_e state;
+    apr_status_t status;
+    int eos;
+    /* Whether tpool has strings to clear */
+    int strings;
+};
+
+APR_DECLARE(apr_status_t) apr_json_reader_create(apr_json_reader_t **reader,
+        int level, apr_pool_t *pool)
+{
+    apr_json_reader_t *r;
+    apr_status_t status;
+
+    r = apr_pcalloc(pool, sizeof(apr_json_reader_t));
+    if ((status = apr_pool_create(&r->tpool, pool))) {
+        return status;
+    }
+    r->pool = pool;
+    r->level = level > 0 ? level : 0;
+    r->stack = apr_palloc(pool, r->level + 1);
+    r->state = JSON_READER_TOP;
+    r->buf = json_reader_empty;
+
+    *reader = r;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_json_reader_write(apr_json_reader_t *reader,
+        const char *buf, apr_size_t len)
+{
+    if (reader->eos) {
+        return APR_EOF;
+    }
+    if (!len) {
+        return APR_SUCCESS;
+    }
+
+    /* Keep only what was not decoded yet, at the front */
+    if (reader->len + len >= reader->size) {
+        apr_size_t left = reader->len - reader->pos;
+
+        if (left + len >= reader->size) {
+            apr_size_t size = reader->size * 2;
+            char *nbuf;
+
+
+            if (size <= left + len) {
+                size = left + len + 1;
+            }
+            if (size < JSON_READER_MIN_SIZE) {
+                size = JSON_READER_MIN_SIZE;
+            }
+            nbuf = apr_palloc(reader->pool, size);
+            memcpy(nbuf, reader->buf + reader->pos, left);
+            reader->buf = nbuf;
+            reader->size = size;
+        }
+        else {
+            memmove(reader->buf, reader->buf + reader->pos, left);
+        }
+        reader->offset += reader->pos;
+        reader->pos = 0;
+        reader->len = left;
+    }
+
+    memcpy(reader->buf + reader->len, buf, len);
+    reader->len += len;
+    reader->buf[reader->len] = '\0';
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(void) apr_json_reader_eos(apr_json_reader_t *reader)
+{
+    reader->eos = 1;
+}
+
+APR_DECLARE(void) apr_json_reader_brigade(apr_json_reader_t *reader,
+        apr_bucket_brigade *bb)
+{
+    reader->bb = bb;
+}
+
+APR_DECLARE(apr_off_t) apr_json_reader_offset(const apr_json_reader_t *reader)
+{
+    return reader->offset + reader->pos;
+}
+
+/* More text for the reader, APR_EAGAIN if none yet */
+static apr_status_t json_reader_fill(apr_json_reader_t *reader)
+{
+    apr_size_t left = reader->len - reader->pos;
+
+    while (reader->bb && !APR_BRIGADE_EMPTY(reader->bb) && !reader->eos) {
+        apr_bucket *b = APR_BRIGADE_FIRST(reader->bb);
+
+        if (APR_BUCKET_IS_EOS(b)) {
+            reader->eos = 1;
+        }
+        else if (!APR_BUCKET_IS_METADATA(b)) {
+            const char *data;
+            apr_size_t dlen;
+            apr_status_t status;
+
+            status = apr_bucket_read(b, &data, &dlen, APR_BLOCK_READ);
+            if (status != APR_SUCCESS) {
+                return status;
+            }
+            apr_json_reader_write(reader, data, dlen);
+        }
+        apr_bucket_delete(b);
+
+        if (reader->len - reader->pos > left) {
+            return APR_SUCCESS;
+        }
+    }
+
+    return reader->eos ? APR_EOF : APR_EAGAIN;
+}
+
+/* A string, number, boolean or null, complete in the buffer */
+static apr_status_t json_reader_scalar(apr_json_reader_t *reader,
+        apr_json_value_t *value)
+{
+    apr_json_scanner_t scanner;
+    const char *start = reader->buf + reader->pos;
+    const char *e = reader->buf + reader->len;
+    const char *q;
+    apr_status_t status;
+
+    scanner.pool = reader->tpool;
+    scanner.p = start;
+    scanner.e = e;
+    scanner.flags = APR_JSON_FLAGS_NONE;
+    scanner.level = 0;
+
+    memset(value, 0, sizeof(*value));
+
+    switch (*start) {
+    case '"':
+        /* Find the closing quote, resuming where the last text ended */
+        q = start + 1 + reader->scanned;
+        for (;;) {
+            q = json_string_run(q, e, 0);
+            if (q >= e || (*q == '\\' && q + 1 >= e)) {
+                reader->scanned = q - start - 1;
+                return APR_EAGAIN;
+            }
+            if (*q == '"') {
+                break;
+            }
+            q += 2;
+        }
+        reader->scanned = 0;
+        reader->strings = 1;
+        scanner.e = q + 1;
+        value->type = APR_JSON_STRING;
+        status = apr_json_decode_string(&scanner, &value->value.string);
+        break;
+    case 't':
+    case 'f':
+    case 'n':
+        q = *start == 'f' ? "false" : *start == 't' ? "true" : "null";
+        if ((apr_size_t)(e - start) < strlen(q)) {
+            if (strncmp(q, start, e - start)) {
+                return APR_BADCH;
+            }
+            return APR_EAGAIN;
+        }
+        if (*start == 'n') {
+            value->type = APR_JSON_NULL;
+            status = apr_json_decode_null(&scanner);
+        }
+        else {
+            value->type = APR_JSON_BOOLEAN;
+            status = apr_json_decode_boolean(&scanner, &value->value.boolean);
+        }
+        break;
+    default:
+        /* A number needs what follows it */
+        for (q = start; q < e; q++) {
+            if (!isdigit(*(const unsigned char *)q)
+                    && (!*q || !strchr("-+.eE", *q))) {
+                break;
+            }
+        }
+        if (q == e && !reader->eos) {
+            return APR_EAGAIN;
+        }
+        status = apr_json_decode_number(&scanner, value);
+        break;
+    }
+
+    if (status == APR_EOF) {
+        status = reader->eos ? APR_INCOMPLETE : APR_EAGAIN;
+    }
+    if (status == APR_SUCCESS || status == APR_BADCH) {
+        reader->pos = scanner.p - reader->buf;
+    }
+
+    return status;
+}
+
+APR_DECLARE(apr_status_t) apr_json_reader_next(apr_json_reader_t *reader,
+        apr_json_token_t *token)
+{
+    apr_status_t status;
+    const char *p;
+    char c;
+
+    if (reader->status) {
+        return reader->status;
+    }
+
+    if (reader->strings) {
+        apr_pool_clear(reader->tpool);
+        reader->strings = 0;
+    }
+
+    for (;;) {
+
+        /* White space is not kept, nor the text before it */
+        p = json_skip_space(reader->buf + reader->pos,
+                            reader->buf + reader->len);
+        reader->pos = p - reader->buf;
+
+        if (reader->pos == reader->len) {
+            status = json_reader_fill(reader);
+            if (status == APR_SUCCESS) {
+                continue;
+            }
+            if (status == APR_EOF && reader->state != JSON_READER_TOP) {
+                status = APR_INCOMPLETE;
+            }
+            if (status != APR_EAGAIN) {
+                reader->status = status;
+            }
+            return status;
+        }
+
+        c = *p;
+        token->level = reader->depth;
+
+        switch (reader->state) {
+        case JSON_READER_COLON:
+            if (c != ':') {
+                return reader->status = APR_BADCH;
+            }
+            reader->pos++;
+            reader->state = JSON_READER_VALUE;
+            continue;
+
+        case JSON_READER_NEXT:
+            if (c == ',') {
+                reader->pos++;
+                reader->state = reader->stack[reader->depth - 1] == '{'
+                        ? JSON_READER_KEY : JSON_READER_VALUE;
+                continue;
+            }
+            if (c != (reader->stack[reader->depth - 1] == '{' ? '}' : ']')) {
+                return reader->status = APR_BADCH;
+            }
+            break;
+
+        case JSON_READER_OBJECT_FIRST:
+            if (c == '}') {
+                break;
+            }
+            /* fall through */
+        case JSON_READER_KEY:
+            if (c != '"') {
+                return reader->status = APR_BADCH;
+            }
+            break;
+
+        case JSON_READER_ARRAY_FIRST:
+            if (c == ']') {
+                break;
+            }
+            /* fall through */
+        default:
+            if (c == '{' || c == '[') {
+                if (reader->depth >= reader->level) {
+                    return reader->status = APR_EINVAL;
+                }
+                reader->stack[reader->depth++] = c;
+                reader->pos++;
+                reader->state = c == '{' ? JSON_READER_OBJECT_FIRST
+                                         : JSON_READER_ARRAY_FIRST;
+                token->type = c == '{' ? APR_JSON_TOKEN_OBJECT_START
+                                       : APR_JSON_TOKEN_ARRAY_START;
+                return APR_SUCCESS;
+            }
+            if (c == '}' || c == ']' || c == ',' || c == ':') {
+                return reader->status = APR_BADCH;
+            }
+            break;
+        }
+
+        if (c == '}' || c == ']') {
+            reader->pos++;
+            reader->depth--;
+            token->level = reader->depth;
+            token->type = c == '}' ? APR_JSON_TOKEN_OBJECT_END
+                                   : APR_JSON_TOKEN_ARRAY_END;
+        }
+        else {
+            status = json_reader_scalar(reader, &token->value);
+            if (status == APR_EAGAIN) {
+                /* Wait for more text, keeping the start of the token */
+                status = json_reader_fill(reader);
+                if (status == APR_SUCCESS) {
+                    continue;
+                }
+                if (status == APR_EOF) {
+                    status = json_reader_scalar(reader, &token->value);
+                    if (status == APR_EAGAIN) {
+                        status = APR_INCOMPLETE;
+                    }
+                }
+            }
+            if (status != APR_SUCCESS) {
+                if (status != APR_EAGAIN) {
+                    reader->status = status;
+                }
+                return status;
+            }
+            if (reader->state == JSON_READER_OBJECT_FIRST
+                    || reader->state == JSON_READER_KEY) {
+                token->type = APR_JSON_TOKEN_KEY;
+                reader->state = JSON_READER_COLON;
+                return APR_SUCCESS;
+            }
+            token->type = APR_JSON_TOKEN_VALUE;
+        }
+
+        reader->state = reader->depth ? JSON_READER_NEXT : JSON_READER_TOP;
+        return APR_SUCCESS;
+    }
+}
+
 #else
 /* we do not yet support JSON on EBCDIC platforms, but will do in future */
 apr_status_t apr_json_decode(apr_json_value_t ** retval, const char *injson,
@@ -816,4 +1750,44 @@ apr_status_t apr_json_decode(apr_json_value_t ** retval, const char *injson,
 {
     return APR_ENOTIMPL;
 }
+
+APR_DECLARE(apr_status_t) apr_json_extract(apr_json_value_t **results,
+        const char *injson, apr_ssize_t injson_size, apr_off_t * offset,
+        const char * const *paths, int npaths, int flags, int level,
+        apr_pool_t * pool)
+{
+    return APR_ENOTIMPL;
+}
+
+APR_DECLARE(apr_status_t) apr_json_reader_create(apr_json_reader_t **reader,
+        int level, apr_pool_t *pool)
+{
+    return APR_ENOTIMPL;
+}
+
+APR_DECLARE(apr_status_t) apr_json_reader_write(apr_json_reader_t *reader,
+        const char *buf, apr_size_t len)
+{
+    return APR_ENOTIMPL;
+}
+
+APR_DECLARE(void) apr_json_reader_eos(apr_json_reader_t *reader)
+{
+}
+
+APR_DECLARE(void) apr_json_reader_brigade(apr_json_reader_t *reader,
+        apr_bucket_brigade *bb)
+{
+}
+
+APR_DECLARE(apr_status_t) apr_json_reader_next(apr_json_reader_t *reader,
+        apr_json_token_t *token)
+{
+    return APR_ENOTIMPL;
+}
+
+APR_DECLARE(apr_off_t) apr_json_reader_offset(const apr_json_reader_t *reader)
+{
+    return 0;
+}
 #endif
@@ -18,151 +18,326 @@
 
 #if !APR_CHARSET_EBCDIC
 
+/*
+ * The output is written to a buffer from the bucket allocator, given to
+ * the brigade as one heap bucket at the end, or by pieces of at least
+ * JSON_FLUSH_SIZE when there is a flush function.
+ */
+#define JSON_BUFFER_SIZE APR_BUCKET_BUFF_SIZE
+#define JSON_FLUSH_SIZE (8 * APR_BUCKET_BUFF_SIZE)
+
+/*
+ * Most of a string is in the runs of characters needing neither escaping
+ * nor UTF-8 validation, found by 16 octets with SSE2 or NEON.
+ */
+#if defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#define JSON_SSE2
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define JSON_NEON
+#endif
+
 typedef struct apr_json_serializer_t {
     apr_pool_t *pool;
     apr_bucket_brigade *brigade;
     apr_brigade_flush flush;
     void *ctx;
     int flags;
+    char *buf;
+    apr_size_t len;
+    apr_size_t size;
 } apr_json_serializer_t;
 
 static apr_status_t apr_json_encode_value(apr_json_serializer_t * self,
                                             const apr_json_value_t * value);
 
-static apr_status_t apr_json_brigade_write(apr_json_serializer_t * self,
-               const char *chunk, apr_size_t chunk_len, const char *escaped)
+/* Give the buffer to the brigade, flushing it if asked to */
+static apr_status_t apr_json_brigade_pass(apr_json_serializer_t * self,
+                                          int flush)
 {
-    apr_status_t status;
+    if (self->len) {
+        apr_bucket *b = apr_bucket_heap_create(self->buf, self->len,
+                apr_bucket_free, self->brigade->bucket_alloc);
 
-    status = apr_brigade_write(self->brigade, self->flush, self->ctx, chunk, chunk_len);
-    if (APR_SUCCESS == status) {
-        status = apr_brigade_puts(self->brigade, self->flush, self->ctx, escaped);
+        APR_BRIGADE_INSERT_TAIL(self->brigade, b);
+    }
+    else if (self->buf) {
+        apr_bucket_free(self->buf);
     }
+    self->buf = NULL;
+    self->len = self->size = 0;
 
-    return status;
+    if (flush && self->flush) {
+        return self->flush(self->brigade, self->ctx);
+    }
+    return APR_SUCCESS;
 }
 
-static apr_status_t apr_json_brigade_printf(apr_json_serializer_t * self,
-               const char *chunk, apr_size_t chunk_len, const char *fmt, ...)
+/* Make room for len more octets */
+static apr_status_t apr_json_brigade_grow(apr_json_serializer_t * self,
+                                          apr_size_t len)
 {
-    va_list ap;
-    apr_status_t status;
+    apr_size_t size;
+    char *buf;
 
-    status = apr_brigade_write(self->brigade, self->flush, self->ctx, chunk,
-            chunk_len);
-    if (APR_SUCCESS == status) {
-        va_start(ap, fmt);
-        status = apr_brigade_vprintf(self->brigade, self->flush, self->ctx, fmt,
-                ap);
-        va_end(ap);
+    if (self->flush && self->len >= JSON_FLUSH_SIZE) {
+        apr_status_t status = apr_json_brigade_pass(self, 1);
+        if (APR_SUCCESS != status) {
+            return status;
+        }
+        if (len <= self->size) {
+            return APR_SUCCESS;
+        }
     }
 
-    return status;
+    size = self->size * 2;
+    if (size < self->len + len) {
+        size = self->len + len;
+    }
+    if (size < JSON_BUFFER_SIZE) {
+        size = JSON_BUFFER_SIZE;
+    }
+
+    buf = apr_bucket_alloc(size, self->brigade->bucket_alloc);
+    if (!buf) {
+        return APR_ENOMEM;
+    }
+    if (self->buf) {
+        memcpy(buf, self->buf, self->len);
+        apr_bucket_free(self->buf);
+    }
+    self->buf = buf;
+    self->size = size;
+
+    return APR_SUCCESS;
+}
+
+static APR_INLINE apr_status_t apr_json_brigade_write(apr_json_serializer_t * self,
+               const char *chunk, apr_size_t chunk_len)
+{
+    if (self->size - self->len < chunk_len) {
+        apr_status_t status = apr_json_brigade_grow(self, chunk_len);
+        if (APR_SUCCESS != status) {
+            return status;
+        }
+    }
+    memcpy(self->buf + self->len, chunk, chunk_len);
+    self->len += chunk_len;
+
+    return APR_SUCCESS;
+}
+
+static APR_INLINE apr_status_t apr_json_brigade_putc(apr_json_serializer_t * self,
+                                                     char c)
+{
+    if (self->size == self->len) {
+        apr_status_t status = apr_json_brigade_grow(self, 1);
+        if (APR_SUCCESS != status) {
+            return status;
+        }
+    }
+    self->buf[self->len++] = c;
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t apr_json_brigade_puts(apr_json_serializer_t * self,
+                                          const char *str)
+{
+    return apr_json_brigade_write(self, str, strlen(str));
+}
+
+/* The first control, '"', '\\' or non-ASCII octet in [p, e), or e */
+static const char *json_plain_run(const char *p, const char *e)
+{
+#if defined(JSON_SSE2)
+    const __m128i quote = _mm_set1_epi8('"'), bslash = _mm_set1_epi8('\\');
+    const __m128i space = _mm_set1_epi8(' ');
+
+    while (e - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        /* signed, the non-ASCII octets are below ' ' too */
+        unsigned int m = (unsigned int)_mm_movemask_epi8(
+                             _mm_or_si128(_mm_cmplt_epi8(v, space),
+                                 _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                                              _mm_cmpeq_epi8(v, bslash))));
+
+        if (m) {
+            return p + __builtin_ctz(m);
+        }
+        p += 16;
+    }
+#elif defined(JSON_NEON)
+    const uint8x16_t quote = vdupq_n_u8('"'), bslash = vdupq_n_u8('\\');
+
+    while (e - p >= 16) {
+        uint8x16_t v = vld1q_u8((const unsigned char *)p);
+        uint8x16_t m = vorrq_u8(vcltq_s8(vreinterpretq_s8_u8(v),
+                                         vdupq_n_s8(' ')),
+                                vorrq_u8(vceqq_u8(v, quote),
+                                         vceqq_u8(v, bslash)));
+        apr_uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(
+                                vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+
+        if (bits) {
+            return p + (__builtin_ctzll(bits) >> 2);
+        }
+        p += 16;
+    }
+#endif
+    while (p < e && *(const unsigned char *)p >= ' '
+           && *(const unsigned char *)p < 0x80 && *p != '"' && *p != '\\') {
+        p++;
+    }
+    return p;
+}
+
+#define UTF8_TAIL(c) (((c) & 0xc0) == 0x80)
+
+/* The length of the UTF-8 character at p, or zero if invalid (RFC 3629) */
+static apr_size_t json_utf8_len(const unsigned char *p, apr_size_t left)
+{
+    unsigned char c = p[0];
+
+    if (c < 0xc2) {
+        /* continuation, or overlong */
+        return 0;
+    }
+    if (c < 0xe0) {
+        return (left >= 2 && UTF8_TAIL(p[1])) ? 2 : 0;
+    }
+    if (c < 0xf0) {
+        if (left < 3 || !UTF8_TAIL(p[1]) || !UTF8_TAIL(p[2])
+                || (c == 0xe0 && p[1] < 0xa0)       /* overlong */
+                || (c == 0xed && p[1] >= 0xa0)) {   /* surrogate */
+            return 0;
+        }
+        return 3;
+    }
+    if (c < 0xf5) {
+        if (left < 4 || !UTF8_TAIL(p[1]) || !UTF8_TAIL(p[2])
+                || !UTF8_TAIL(p[3])
+                || (c == 0xf0 && p[1] < 0x90)       /* overlong */
+                || (c == 0xf4 && p[1] >= 0x90)) {   /* above U+10FFFF */
+            return 0;
+        }
+        return 4;
+    }
+    return 0;
 }
 
 static apr_status_t apr_json_encode_string(apr_json_serializer_t * self,
         const apr_json_string_t * string)
 {
     apr_status_t status;
-    const char *p, *e, *chunk;
+    const char *p, *e, *r;
     const char invalid[4] = { 0xEF, 0xBF, 0xBD, 0x00 };
     unsigned char c;
 
-    status = apr_brigade_putc(self->brigade, self->flush, self->ctx, '\"');
+    status = apr_json_brigade_putc(self, '\"');
     if (APR_SUCCESS != status) {
         return status;
     }
 
-    for (p = chunk = string->p, e = string->p
+    for (p = string->p, e = string->p
             + (APR_JSON_VALUE_STRING == string->len ?
-                    strlen(string->p) : string->len); p < e; p++) {
-        switch (*p) {
+                    strlen(string->p) : string->len); p < e; ) {
+        r = json_plain_run(p, e);
+        if (r > p) {
+            status = apr_json_brigade_write(self, p, r - p);
+            if (APR_SUCCESS != status) {
+                return status;
+            }
+            p = r;
+            if (p >= e) {
+                break;
+            }
+        }
+
+        c = (unsigned char)(*p);
+        switch (c) {
         case '\n':
-            status = apr_json_brigade_write(self, chunk, p - chunk, "\\n");
-            chunk = p + 1;
+            status = apr_json_brigade_write(self, "\\n", 2);
             break;
         case '\r':
-            status = apr_json_brigade_write(self, chunk, p - chunk, "\\r");
-            chunk = p + 1;
+            status = apr_json_brigade_write(self, "\\r", 2);
             break;
         case '\t':
-            status = apr_json_brigade_write(self, chunk, p - chunk, "\\t");
-            chunk = p + 1;
+            status = apr_json_brigade_write(self, "\\t", 2);
             break;
         case '\b':
-            status = apr_json_brigade_write(self, chunk, p - chunk, "\\b");
-            chunk = p + 1;
+            status = apr_json_brigade_write(self, "\\b", 2);
             break;
         case '\f':
-            status = apr_json_brigade_write(self, chunk, p - chunk, "\\f");
-            chunk = p + 1;
+            status = apr_json_brigade_write(self, "\\f", 2);
             break;
         case '\\':
-            status = apr_json_brigade_write(self, chunk, p - chunk, "\\\\");
-            chunk = p + 1;
+            status = apr_json_brigade_write(self, "\\\\", 2);
             break;
         case '"':
-            status = apr_json_brigade_write(self, chunk, p - chunk, "\\\"");
-            chunk = p + 1;
+            status = apr_json_brigade_write(self, "\\\"", 2);
             break;
         default:
-            c = (unsigned char)(*p);
-            apr_size_t left = e - p;
             if (c < 0x20) {
-                status = apr_json_brigade_printf(self, chunk, p - chunk,
-                        "\\u%04x", c);
-                chunk = p + 1;
-            }
-            else if (((c >> 7) == 0x00)) {
-                /* 1 byte */
-            }
-            else if (left > 1 && ((c >> 5) == 0x06) && p[1]) {
-                /* 2 bytes */
-                if (left < 2 || (p[1] >> 6) != 0x02) {
-                    status = apr_json_brigade_write(self, chunk, p - chunk,
-                            invalid);
-                    chunk = p + 1;
-                }
+                char u[6] = { '\\', 'u', '0', '0' };
+
+                u[4] = "0123456789abcdef"[c >> 4];
+                u[5] = "0123456789abcdef"[c & 0xf];
+                status = apr_json_brigade_write(self, u, 6);
             }
-            else if (((c >> 4) == 0x0E)) {
-                /* 3 bytes */
-                if (left < 3 || (p[1] >> 6) != 0x02 || (p[2] >> 6) != 0x02) {
-                    status = apr_json_brigade_write(self, chunk, p - chunk,
-                            invalid);
-                    chunk = p + 1;
+            else {
+                apr_size_t len = json_utf8_len((const unsigned char *)p,
+                                               e - p);
+
+                if (len) {
+                    status = apr_json_brigade_write(self, p, len);
+                    p += len - 1;
                 }
-            }
-            else if ((c >> 3) == 0x1E) {
-                /* 4 bytes */
-                if (left < 4 || (p[1] >> 6) != 0x02 || (p[2] >> 6) != 0x02 || (p[3] >> 6) != 0x02) {
-                    status = apr_json_brigade_write(self, chunk, p - chunk,
-                            invalid);
-                    chunk = p + 1;
+                else {
+                    status = apr_json_brigade_write(self, invalid, 3);
                 }
             }
-            else {
-                status = apr_json_brigade_write(self, chunk, p - chunk,
-                        invalid);
-                chunk = p + 1;
-            }
             break;
         }
+        p++;
 
         if (APR_SUCCESS != status) {
             return status;
         }
     }
 
-    if (chunk < p) {
-        status = apr_brigade_write(self->brigade, self->flush, self->ctx, chunk, p - chunk);
-        if (APR_SUCCESS != status) {
-            return status;
-        }
+    return apr_json_brigade_putc(self, '\"');
+}
+
+static apr_status_t apr_json_encode_long(apr_json_serializer_t * self,
+                                         apr_int64_t lnumber)
+{
+    char buf[24], *p = buf + sizeof(buf);
+    apr_uint64_t u = lnumber < 0 ? 0 - (apr_uint64_t)lnumber : lnumber;
+
+    do {
+        *--p = '0' + (char)(u % 10);
+        u /= 10;
+    } while (u);
+    if (lnumber < 0) {
+        *--p = '-';
     }
 
-    return apr_brigade_putc(self->brigade, self->flush, self->ctx, '\"');
+    return apr_json_brigade_write(self, p, buf + sizeof(buf) - p);
 }
 
+static apr_status_t apr_json_encode_double(apr_json_serializer_t * self,
+                                           double dnumber)
+{
+    /* what apr_vformatter() gives at most for a number */
+    char buf[512 + 1];
+    int len;
+
+    len = apr_snprintf(buf, sizeof(buf), "%lf", dnumber);
+
+    return apr_json_brigade_write(self, buf, len);
+}
 
 static apr_status_t apr_json_encode_array(apr_json_serializer_t * self,
         const apr_json_value_t * array)
@@ -171,7 +346,7 @@ static apr_status_t apr_json_encode_array(apr_json_serializer_t * self,
     apr_json_value_t *val;
     apr_size_t count = 0;
 
-    status = apr_brigade_putc(self->brigade, self->flush, self->ctx, '[');
+    status = apr_json_brigade_putc(self, '[');
     if (APR_SUCCESS != status) {
         return status;
     }
@@ -180,7 +355,7 @@ static apr_status_t apr_json_encode_array(apr_json_serializer_t * self,
     while (val) {
 
         if (count > 0) {
-            status = apr_brigade_putc(self->brigade, self->flush, self->ctx, ',');
+            status = apr_json_brigade_putc(self, ',');
             if (APR_SUCCESS != status) {
                 return status;
             }
@@ -195,7 +370,7 @@ static apr_status_t apr_json_encode_array(apr_json_serializer_t * self,
         count++;
     }
 
-    return apr_brigade_putc(self->brigade, self->flush, self->ctx, ']');
+    return apr_json_brigade_putc(self, ']');
 }
 
 static apr_status_t apr_json_encode_object(apr_json_serializer_t * self, apr_json_object_t * object)
@@ -203,7 +378,7 @@ static apr_status_t apr_json_encode_object(apr_json_serializer_t * self, apr_jso
     apr_status_t status;
     apr_json_kv_t *kv;
     int first = 1;
-    status = apr_brigade_putc(self->brigade, self->flush, self->ctx, '{');
+    status = apr_json_brigade_putc(self, '{');
     if (APR_SUCCESS != status) {
         return status;
     }
@@ -213,7 +388,7 @@ static apr_status_t apr_json_encode_object(apr_json_serializer_t * self, apr_jso
          kv = APR_RING_NEXT((kv), link)) {
 
         if (!first) {
-            status = apr_brigade_putc(self->brigade, self->flush, self->ctx, ',');
+            status = apr_json_brigade_putc(self, ',');
             if (APR_SUCCESS != status) {
                 return status;
             }
@@ -225,7 +400,7 @@ static apr_status_t apr_json_encode_object(apr_json_serializer_t * self, apr_jso
                 return status;
             }
 
-            status = apr_brigade_putc(self->brigade, self->flush, self->ctx, ':');
+            status = apr_json_brigade_putc(self, ':');
             if (APR_SUCCESS != status) {
                 return status;
             }
@@ -237,7 +412,7 @@ static apr_status_t apr_json_encode_object(apr_json_serializer_t * self, apr_jso
         }
         first = 0;
     }
-    return apr_brigade_putc(self->brigade, self->flush, self->ctx, '}');
+    return apr_json_brigade_putc(self, '}');
 }
 
 static apr_status_t apr_json_encode_value(apr_json_serializer_t * self, const apr_json_value_t * value)
@@ -245,8 +420,7 @@ static apr_status_t apr_json_encode_value(apr_json_serializer_t * self, const ap
     apr_status_t status = APR_SUCCESS;
 
     if (value->pre && (self->flags & APR_JSON_FLAGS_WHITESPACE)) {
-        status = apr_brigade_puts(self->brigade, self->flush, self->ctx,
-                value->pre);
+        status = apr_json_brigade_puts(self, value->pre);
     }
 
     if (APR_SUCCESS == status) {
@@ -255,20 +429,18 @@ static apr_status_t apr_json_encode_value(apr_json_serializer_t * self, const ap
             status = apr_json_encode_string(self, &value->value.string);
             break;
         case APR_JSON_LONG:
-            status = apr_brigade_printf(self->brigade, self->flush, self->ctx,
-                    "%" APR_INT64_T_FMT, value->value.lnumber);
+            status = apr_json_encode_long(self, value->value.lnumber);
             break;
         case APR_JSON_DOUBLE:
-            status = apr_brigade_printf(self->brigade, self->flush, self->ctx,
-                    "%lf", value->value.dnumber);
+            status = apr_json_encode_double(self, value->value.dnumber);
             break;
         case APR_JSON_BOOLEAN:
-            status = apr_brigade_puts(self->brigade, self->flush, self->ctx,
-                    value->value.boolean ? "true" : "false");
+            status = value->value.boolean
+                    ? apr_json_brigade_write(self, "true", 4)
+                    : apr_json_brigade_write(self, "false", 5);
             break;
         case APR_JSON_NULL:
-            status = apr_brigade_puts(self->brigade, self->flush, self->ctx,
-                    "null");
+            status = apr_json_brigade_write(self, "null", 4);
             break;
         case APR_JSON_OBJECT:
             status = apr_json_encode_object(self, value->value.object);
@@ -283,8 +455,7 @@ static apr_status_t apr_json_encode_value(apr_json_serializer_t * self, const ap
 
     if (APR_SUCCESS == status && value->post
             && (self->flags & APR_JSON_FLAGS_WHITESPACE)) {
-        status = apr_brigade_puts(self->brigade, self->flush, self->ctx,
-                value->post);
+        status = apr_json_brigade_puts(self, value->post);
     }
 
     return status;
@@ -296,7 +467,14 @@ APR_DECLARE(apr_status_t) apr_json_encode(apr_bucket_brigade * brigade,
                                           int flags, apr_pool_t * pool)
 {
     apr_json_serializer_t serializer = {pool, brigade, flush, ctx, flags};
-    return apr_json_encode_value(&serializer, json);
+    apr_status_t status;
+
+    status = apr_json_encode_value(&serializer, json);
+
+    /* What was written so far, also on error */
+    apr_json_brigade_pass(&serializer, 0);
+
+    return status;
 }
 
 #else
@@ -198,5 +198,12 @@ APR_DECLARE(apr_status_t) apr_thread_mutex_destroy(apr_thread_mutex_t *mutex)
     return stat;
 }
 
+APR_DECLARE(apr_status_t) apr_thread_mutex_stats_get(
+                                              apr_thread_mutex_t *mutex,
+                                              apr_thread_mutex_stats_t *stats)
+{
+    return APR_ENOTIMPL;
+}
+
 APR_POOL_IMPLEMENT_ACCESSOR(thread_mutex)
 
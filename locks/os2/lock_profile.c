@@ -0,0 +1 @@
+#include "../unix/lock_profile.c"
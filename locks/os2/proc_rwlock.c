@@ -0,0 +1 @@
+#include "../unix/proc_rwlock.c"
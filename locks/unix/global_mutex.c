@@ -21,6 +21,12 @@
 #include "apr_proc_mutex.h"
 #include "apr_thread_mutex.h"
 #include "apr_portable.h"
+#include "apr_atomic.h"
+
+/* The number of times the proc mutex is tried before blocking, when it
+ * excludes the threads too and its trylock stays in user space.
+ */
+#define GLOBAL_MUTEX_SPINS 100
 
 static apr_status_t global_mutex_cleanup(void *data)
 {
@@ -53,6 +59,8 @@ APR_DECLARE(apr_status_t) apr_global_mutex_create(apr_global_mutex_t **mutex,
 
     m = (apr_global_mutex_t *)apr_palloc(pool, sizeof(*m));
     m->pool = pool;
+    m->profile = NULL;
+    m->spins = 0;
 
     rv = apr_proc_mutex_create(&m->proc_mutex, fname, mech, m->pool);
     if (rv != APR_SUCCESS) {
@@ -62,6 +70,9 @@ APR_DECLARE(apr_status_t) apr_global_mutex_create(apr_global_mutex_t **mutex,
 #if APR_HAS_THREADS
     if (m->proc_mutex->meth->flags & APR_PROCESS_LOCK_MECH_IS_GLOBAL) {
         m->thread_mutex = NULL; /* We don't need a thread lock. */
+        if (m->proc_mutex->meth->flags & APR_PROCESS_LOCK_MECH_CAN_SPIN) {
+            m->spins = GLOBAL_MUTEX_SPINS;
+        }
     }
     else {
         rv = apr_thread_mutex_create(&m->thread_mutex,
@@ -90,11 +101,28 @@ APR_DECLARE(apr_status_t) apr_global_mutex_child_init(
     return rv;
 }
 
-APR_DECLARE(apr_status_t) apr_global_mutex_lock(apr_global_mutex_t *mutex)
+static apr_status_t global_mutex_lock(apr_global_mutex_t *mutex)
 {
     apr_status_t rv;
 
 #if APR_HAS_THREADS
+    /* Without a thread mutex, the contended proc mutex is tried again a
+     * few times before sleeping in the kernel
+     */
+    if (mutex->spins) {
+        int spins = mutex->spins;
+
+        rv = apr_proc_mutex_trylock(mutex->proc_mutex);
+        while (APR_STATUS_IS_EBUSY(rv) && spins-- > 0) {
+            apr_atomic_pause();
+            rv = apr_proc_mutex_trylock(mutex->proc_mutex);
+        }
+        if (!APR_STATUS_IS_EBUSY(rv)) {
+            return rv;
+        }
+        return apr_proc_mutex_lock(mutex->proc_mutex);
+    }
+
     if (mutex->thread_mutex) {
         rv = apr_thread_mutex_lock(mutex->thread_mutex);
         if (rv != APR_SUCCESS) {
@@ -116,7 +144,7 @@ APR_DECLARE(apr_status_t) apr_global_mutex_lock(apr_global_mutex_t *mutex)
     return rv;
 }
 
-APR_DECLARE(apr_status_t) apr_global_mutex_trylock(apr_global_mutex_t *mutex)
+static apr_status_t global_mutex_trylock(apr_global_mutex_t *mutex)
 {
     apr_status_t rv;
 
@@ -142,8 +170,8 @@ APR_DECLARE(apr_status_t) apr_global_mutex_trylock(apr_global_mutex_t *mutex)
     return rv;
 }
 
-APR_DECLARE(apr_status_t) apr_global_mutex_timedlock(apr_global_mutex_t *mutex,
-                                                 apr_interval_time_t timeout)
+static apr_status_t global_mutex_timedlock(apr_global_mutex_t *mutex,
+                                           apr_interval_time_t timeout)
 {
     apr_status_t rv;
 
@@ -151,14 +179,14 @@ APR_DECLARE(apr_status_t) apr_global_mutex_timedlock(apr_global_mutex_t *mutex,
     if (mutex->thread_mutex) {
         apr_time_t expiry = 0;
         if (timeout > 0) {
-            expiry = apr_time_now() + timeout;
+            expiry = apr_time_monotonic() + timeout;
         }
         rv = apr_thread_mutex_timedlock(mutex->thread_mutex, timeout);
         if (rv != APR_SUCCESS) {
             return rv;
         }
         if (expiry) {
-            timeout = expiry - apr_time_now();
+            timeout = expiry - apr_time_monotonic();
             if (timeout < 0) {
                 timeout = 0;
             }
@@ -179,7 +207,7 @@ APR_DECLARE(apr_status_t) apr_global_mutex_timedlock(apr_global_mutex_t *mutex,
     return rv;
 }
 
-APR_DECLARE(apr_status_t) apr_global_mutex_unlock(apr_global_mutex_t *mutex)
+static apr_status_t global_mutex_unlock(apr_global_mutex_t *mutex)
 {
     apr_status_t rv;
 
@@ -197,6 +225,59 @@ APR_DECLARE(apr_status_t) apr_global_mutex_unlock(apr_global_mutex_t *mutex)
     return rv;
 }
 
+APR_DECLARE(apr_status_t) apr_global_mutex_lock(apr_global_mutex_t *mutex)
+{
+#if APR_HAS_LOCK_PROFILE
+    if (APR_LOCK_PROFILED(mutex->profile)) {
+        apr_status_t rv;
+
+        APR_LOCK_PROFILE_ACQUIRE(rv, mutex->profile, 1,
+                                 global_mutex_trylock(mutex),
+                                 global_mutex_lock(mutex));
+        return rv;
+    }
+#endif
+    return global_mutex_lock(mutex);
+}
+
+APR_DECLARE(apr_status_t) apr_global_mutex_trylock(apr_global_mutex_t *mutex)
+{
+    apr_status_t rv = global_mutex_trylock(mutex);
+
+#if APR_HAS_LOCK_PROFILE
+    if (rv == APR_SUCCESS && APR_LOCK_PROFILED(mutex->profile)) {
+        apr_unix_lock_profile_acquired(mutex->profile, 1);
+    }
+#endif
+    return rv;
+}
+
+APR_DECLARE(apr_status_t) apr_global_mutex_timedlock(apr_global_mutex_t *mutex,
+                                                 apr_interval_time_t timeout)
+{
+#if APR_HAS_LOCK_PROFILE
+    if (APR_LOCK_PROFILED(mutex->profile)) {
+        apr_status_t rv;
+
+        APR_LOCK_PROFILE_ACQUIRE(rv, mutex->profile, 1,
+                                 global_mutex_trylock(mutex),
+                                 global_mutex_timedlock(mutex, timeout));
+        return rv;
+    }
+#endif
+    return global_mutex_timedlock(mutex, timeout);
+}
+
+APR_DECLARE(apr_status_t) apr_global_mutex_unlock(apr_global_mutex_t *mutex)
+{
+#if APR_HAS_LOCK_PROFILE
+    if (mutex->profile) {
+        apr_unix_lock_profile_released(mutex->profile);
+    }
+#endif
+    return global_mutex_unlock(mutex);
+}
+
 APR_DECLARE(apr_status_t) apr_os_global_mutex_get(apr_os_global_mutex_t *ospmutex,
                                                 apr_global_mutex_t *pmutex)
 {
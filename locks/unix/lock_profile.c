@@ -0,0 +1,317 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_arch_lock_profile.h"
+#include "apr_thread_mutex.h"
+#include "apr_thread_rwlock.h"
+#include "apr_proc_mutex.h"
+#include "apr_global_mutex.h"
+#include "apr_proc_rwlock.h"
+
+#if APR_HAS_LOCK_PROFILE
+
+#include "apr_arch_thread_mutex.h"
+#include "apr_arch_thread_rwlock.h"
+#include "apr_arch_proc_mutex.h"
+#include "apr_arch_global_mutex.h"
+#include "apr_arch_proc_rwlock.h"
+#include "apr_atomic.h"
+#include "apr_strings.h"
+
+volatile apr_uint32_t apr_unix_lock_profile_on = 0;
+
+/* The profiles of the tagged locks, protected by profiles_mutex */
+static apr_lock_profile_rec_t *lock_profiles = NULL;
+
+#if APR_HAS_THREADS
+static pthread_mutex_t profiles_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define PROFILES_LOCK()   pthread_mutex_lock(&profiles_mutex)
+#define PROFILES_UNLOCK() pthread_mutex_unlock(&profiles_mutex)
+#else
+#define PROFILES_LOCK()
+#define PROFILES_UNLOCK()
+#endif
+
+static apr_status_t lock_profile_cleanup(void *data)
+{
+    apr_lock_profile_rec_t *prof = data;
+
+    PROFILES_LOCK();
+    *prof->ref = prof->next;
+    if (prof->next) {
+        prof->next->ref = prof->ref;
+    }
+    PROFILES_UNLOCK();
+
+    return APR_SUCCESS;
+}
+
+apr_status_t apr_unix_lock_profile_tag(apr_lock_profile_rec_t **pprof,
+                                       apr_lock_profile_type_e type,
+                                       const char *tag, apr_pool_t *pool)
+{
+    apr_lock_profile_rec_t *prof = *pprof;
+
+    if (prof) {
+        PROFILES_LOCK();
+        prof->tag = tag;
+        PROFILES_UNLOCK();
+        return APR_SUCCESS;
+    }
+
+    prof = apr_pcalloc(pool, sizeof(*prof));
+    prof->tag = tag;
+    prof->type = type;
+
+    PROFILES_LOCK();
+    prof->next = lock_profiles;
+    if (lock_profiles) {
+        lock_profiles->ref = &prof->next;
+    }
+    prof->ref = &lock_profiles;
+    lock_profiles = prof;
+    PROFILES_UNLOCK();
+
+    /* Registered after the lock's own cleanup, so run before it */
+    apr_pool_cleanup_register(pool, prof, lock_profile_cleanup,
+                              apr_pool_cleanup_null);
+
+    *pprof = prof;
+    return APR_SUCCESS;
+}
+
+void apr_unix_lock_profile_waited(apr_lock_profile_rec_t *prof,
+                                  apr_time_t start)
+{
+    apr_time_t now = apr_time_now();
+    apr_uint64_t wait, max;
+
+    wait = (now > start) ? (apr_uint64_t)(now - start) : 0;
+    apr_atomic_inc64(&prof->contended);
+    apr_atomic_add64(&prof->wait_time, wait);
+    do {
+        max = apr_atomic_read64(&prof->max_wait_time);
+    } while (wait > max
+             && apr_atomic_cas64(&prof->max_wait_time, wait, max) != max);
+}
+
+void apr_unix_lock_profile_acquired(apr_lock_profile_rec_t *prof,
+                                    int exclusive)
+{
+    apr_atomic_inc64(&prof->acquired);
+    if (exclusive) {
+        prof->since = apr_time_now();
+    }
+}
+
+void apr_unix_lock_profile_released(apr_lock_profile_rec_t *prof)
+{
+    /* Only the exclusive holder may have set (and thus reset) since */
+    if (prof->since) {
+        apr_time_t now = apr_time_now();
+
+        if (now > prof->since) {
+            apr_atomic_add64(&prof->hold_time, now - prof->since);
+        }
+        prof->since = 0;
+    }
+}
+
+static void lock_profile_copy(apr_lock_profile_t *profile,
+                              apr_lock_profile_rec_t *prof)
+{
+    profile->tag = prof->tag;
+    profile->type = prof->type;
+    profile->acquired = apr_atomic_read64(&prof->acquired);
+    profile->contended = apr_atomic_read64(&prof->contended);
+    profile->wait_time = apr_atomic_read64(&prof->wait_time);
+    profile->max_wait_time = apr_atomic_read64(&prof->max_wait_time);
+    profile->hold_time = apr_atomic_read64(&prof->hold_time);
+}
+
+APR_DECLARE(apr_status_t) apr_lock_profile_set(int enabled)
+{
+    apr_atomic_set32(&apr_unix_lock_profile_on, enabled != 0);
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(void) apr_lock_profile_reset(void)
+{
+    apr_lock_profile_rec_t *prof;
+
+    PROFILES_LOCK();
+    for (prof = lock_profiles; prof; prof = prof->next) {
+        apr_atomic_set64(&prof->acquired, 0);
+        apr_atomic_set64(&prof->contended, 0);
+        apr_atomic_set64(&prof->wait_time, 0);
+        apr_atomic_set64(&prof->max_wait_time, 0);
+        apr_atomic_set64(&prof->hold_time, 0);
+    }
+    PROFILES_UNLOCK();
+}
+
+APR_DECLARE(apr_status_t) apr_lock_profile_snapshot(
+                                              apr_array_header_t **profiles,
+                                              apr_pool_t *pool)
+{
+    apr_array_header_t *arr;
+    apr_lock_profile_rec_t *prof;
+
+    arr = apr_array_make(pool, 8, sizeof(apr_lock_profile_t));
+
+    PROFILES_LOCK();
+    for (prof = lock_profiles; prof; prof = prof->next) {
+        apr_lock_profile_t *profile = apr_array_push(arr);
+
+        lock_profile_copy(profile, prof);
+        /* The lock may be gone before the snapshot */
+        profile->tag = apr_pstrdup(pool, profile->tag);
+    }
+    PROFILES_UNLOCK();
+
+    *profiles = arr;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(int) apr_lock_profile_do(apr_lock_profile_cb_t *cb, void *baton)
+{
+    apr_array_header_t *arr;
+    apr_pool_t *pool;
+    int i, rv = 1;
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS) {
+        return 0;
+    }
+    apr_pool_tag(pool, "apr_lock_profile_do");
+
+    apr_lock_profile_snapshot(&arr, pool);
+    for (i = 0; i < arr->nelts; ++i) {
+        if (!cb(baton, &APR_ARRAY_IDX(arr, i, apr_lock_profile_t))) {
+            rv = 0;
+            break;
+        }
+    }
+
+    apr_pool_destroy(pool);
+    return rv;
+}
+
+#if APR_HAS_THREADS
+
+APR_DECLARE(apr_status_t) apr_thread_mutex_tag(apr_thread_mutex_t *mutex,
+                                               const char *tag)
+{
+    return apr_unix_lock_profile_tag(&mutex->profile,
+                                     APR_LOCK_PROFILE_THREAD_MUTEX,
+                                     tag, mutex->pool);
+}
+
+APR_DECLARE(apr_status_t) apr_thread_rwlock_tag(apr_thread_rwlock_t *rwlock,
+                                                const char *tag)
+{
+    return apr_unix_lock_profile_tag(&rwlock->profile,
+                                     APR_LOCK_PROFILE_THREAD_RWLOCK,
+                                     tag, rwlock->pool);
+}
+
+#endif /* APR_HAS_THREADS */
+
+APR_DECLARE(apr_status_t) apr_proc_mutex_tag(apr_proc_mutex_t *mutex,
+                                             const char *tag)
+{
+    return apr_unix_lock_profile_tag(&mutex->profile,
+                                     APR_LOCK_PROFILE_PROC_MUTEX,
+                                     tag, mutex->pool);
+}
+
+#if !APR_PROC_MUTEX_IS_GLOBAL
+APR_DECLARE(apr_status_t) apr_global_mutex_tag(apr_global_mutex_t *mutex,
+                                               const char *tag)
+{
+    return apr_unix_lock_profile_tag(&mutex->profile,
+                                     APR_LOCK_PROFILE_GLOBAL_MUTEX,
+                                     tag, mutex->pool);
+}
+#endif
+
+APR_DECLARE(apr_status_t) apr_proc_rwlock_tag(apr_proc_rwlock_t *rwlock,
+                                              const char *tag)
+{
+    return apr_unix_lock_profile_tag(&rwlock->profile,
+                                     APR_LOCK_PROFILE_PROC_RWLOCK,
+                                     tag, rwlock->pool);
+}
+
+#else /* APR_HAS_LOCK_PROFILE */
+
+APR_DECLARE(apr_status_t) apr_lock_profile_set(int enabled)
+{
+    return APR_ENOTIMPL;
+}
+
+APR_DECLARE(void) apr_lock_profile_reset(void)
+{
+}
+
+APR_DECLARE(int) apr_lock_profile_do(apr_lock_profile_cb_t *cb, void *baton)
+{
+    return 0;
+}
+
+APR_DECLARE(apr_status_t) apr_lock_profile_snapshot(
+                                              apr_array_header_t **profiles,
+                                              apr_pool_t *pool)
+{
+    return APR_ENOTIMPL;
+}
+
+#if APR_HAS_THREADS
+
+APR_DECLARE(apr_status_t) apr_thread_mutex_tag(apr_thread_mutex_t *mutex,
+                                               const char *tag)
+{
+    return APR_ENOTIMPL;
+}
+
+APR_DECLARE(apr_status_t) apr_thread_rwlock_tag(apr_thread_rwlock_t *rwlock,
+                                                const char *tag)
+{
+    return APR_ENOTIMPL;
+}
+
+#endif /* APR_HAS_THREADS */
+
+APR_DECLARE(apr_status_t) apr_proc_mutex_tag(apr_proc_mutex_t *mutex,
+                                             const char *tag)
+{
+    return APR_ENOTIMPL;
+}
+
+#if !APR_PROC_MUTEX_IS_GLOBAL
+APR_DECLARE(apr_status_t) apr_global_mutex_tag(apr_global_mutex_t *mutex,
+                                               const char *tag)
+{
+    return APR_ENOTIMPL;
+}
+#endif
+
+APR_DECLARE(apr_status_t) apr_proc_rwlock_tag(apr_proc_rwlock_t *rwlock,
+                                              const char *tag)
+{
+    return APR_ENOTIMPL;
+}
+
+#endif /* APR_HAS_LOCK_PROFILE */
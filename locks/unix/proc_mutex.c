@@ -40,7 +40,8 @@ static apr_status_t proc_mutex_no_child_init(apr_proc_mutex_t **mutex,
 }
 #endif
 
-#if APR_HAS_POSIXSEM_SERIALIZE || APR_HAS_PROC_PTHREAD_SERIALIZE
+#if APR_HAS_POSIXSEM_SERIALIZE || APR_HAS_PROC_PTHREAD_SERIALIZE || \
+    APR_HAS_FUTEX_SERIALIZE
 static apr_status_t proc_mutex_no_perms_set(apr_proc_mutex_t *mutex,
                                             apr_fileperms_t perms,
                                             apr_uid_t uid,
@@ -910,7 +911,7 @@ static apr_status_t proc_mutex_pthread_release(apr_proc_mutex_t *mutex)
 
 static const apr_proc_mutex_unix_lock_methods_t mutex_proc_pthread_methods =
 {
-    APR_PROCESS_LOCK_MECH_IS_GLOBAL,
+    APR_PROCESS_LOCK_MECH_IS_GLOBAL | APR_PROCESS_LOCK_MECH_CAN_SPIN,
     proc_mutex_pthread_create,
     proc_mutex_pthread_acquire,
     proc_mutex_pthread_tryacquire,
@@ -972,7 +973,7 @@ static apr_status_t proc_mutex_pthread_cond_create(apr_proc_mutex_t *new_mutex,
 
 static const apr_proc_mutex_unix_lock_methods_t mutex_proc_pthread_cond_methods =
 {
-    APR_PROCESS_LOCK_MECH_IS_GLOBAL,
+    APR_PROCESS_LOCK_MECH_IS_GLOBAL | APR_PROCESS_LOCK_MECH_CAN_SPIN,
     proc_mutex_pthread_cond_create,
     proc_mutex_pthread_acquire,
     proc_mutex_pthread_tryacquire,
@@ -988,6 +989,252 @@ static const apr_proc_mutex_unix_lock_methods_t mutex_proc_pthread_cond_methods
 
 #endif
 
+#if APR_HAS_FUTEX_SERIALIZE
+
+/* The futex word is 0 when unlocked, otherwise the pid of the owner,
+ * flagged with PROC_FUTEX_WAITERS when some process may sleep on it.
+ * Locking and unlocking is a compare-and-swap in userspace; the kernel
+ * is called only to sleep and to wake up the sleepers.  The sleepers
+ * wake up every PROC_FUTEX_CHECK to test whether the owner died, taking
+ * the mutex over when so, like the robust pthread mutexes.  A locked
+ * mutex is spun on PROC_FUTEX_SPINS times before sleeping, unless there
+ * are sleepers already.
+ */
+#define PROC_FUTEX_WAITERS 0x80000000
+#define PROC_FUTEX_CHECK apr_time_from_msec(100)
+#define PROC_FUTEX_SPINS 100
+
+static volatile apr_uint32_t proc_futex_pid = 0;
+
+#if APR_HAS_THREADS
+static volatile apr_uint32_t proc_futex_atfork = 0;
+
+static void proc_futex_reset_pid(void)
+{
+    proc_futex_pid = 0;
+}
+#endif
+
+/* getpid(), cached until the next fork() */
+static APR_INLINE apr_uint32_t proc_futex_self(void)
+{
+    apr_uint32_t pid = proc_futex_pid;
+
+    if (!pid) {
+        pid = (apr_uint32_t)getpid();
+#if APR_HAS_THREADS
+        if (!apr_atomic_read32(&proc_futex_atfork)) {
+            return pid;
+        }
+#endif
+        proc_futex_pid = pid;
+    }
+    return pid;
+}
+
+static int proc_futex_owner_dead(apr_uint32_t word)
+{
+    pid_t owner = (pid_t)(word & ~PROC_FUTEX_WAITERS);
+
+    return kill(owner, 0) < 0 && errno == ESRCH;
+}
+
+static int proc_futex_wait(volatile apr_uint32_t *word, apr_uint32_t val,
+                           apr_interval_time_t timeout)
+{
+    struct timespec reltime;
+
+    reltime.tv_sec = apr_time_sec(timeout);
+    reltime.tv_nsec = apr_time_usec(timeout) * 1000; /* nanoseconds */
+
+    if (syscall(SYS_futex, word, FUTEX_WAIT, val, &reltime, NULL, 0) < 0) {
+        return errno;
+    }
+    return 0;
+}
+
+static apr_status_t proc_mutex_futex_cleanup(void *mutex_)
+{
+    apr_proc_mutex_t *mutex = mutex_;
+    apr_status_t rv;
+
+    if (mutex->curr_locked == 1) {
+        if ((rv = apr_proc_mutex_unlock(mutex))) {
+            return rv;
+        }
+    }
+    if (munmap(mutex->os.futex_interproc, sizeof(apr_uint32_t))) {
+        return errno;
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t proc_mutex_futex_create(apr_proc_mutex_t *new_mutex,
+                                            const char *fname)
+{
+    void *word;
+
+    word = mmap(NULL, sizeof(apr_uint32_t), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANON, -1, 0);
+    if (word == MAP_FAILED) {
+        return errno;
+    }
+    new_mutex->os.futex_interproc = word;
+    new_mutex->curr_locked = 0;
+
+#if APR_HAS_THREADS
+    /* The cached pid is reset by the children at fork() */
+    if (!apr_atomic_read32(&proc_futex_atfork)
+            && apr_atomic_cas32(&proc_futex_atfork, 1, 0) == 0) {
+        if (pthread_atfork(NULL, NULL, proc_futex_reset_pid)) {
+            apr_atomic_set32(&proc_futex_atfork, 0);
+        }
+    }
+#endif
+
+    apr_pool_cleanup_register(new_mutex->pool,
+                              (void *)new_mutex,
+                              apr_proc_mutex_cleanup,
+                              apr_pool_cleanup_null);
+    return APR_SUCCESS;
+}
+
+static apr_status_t proc_mutex_futex_child_init(apr_proc_mutex_t **mutex,
+                                                apr_pool_t *pool,
+                                                const char *fname)
+{
+    (*mutex)->curr_locked = 0;
+    return APR_SUCCESS;
+}
+
+static apr_status_t proc_mutex_futex_acquire_ex(apr_proc_mutex_t *mutex,
+                                                apr_interval_time_t timeout)
+{
+    volatile apr_uint32_t *word = mutex->os.futex_interproc;
+    apr_uint32_t self = proc_futex_self();
+    apr_time_t deadline = 0;
+    int check_owner, spins = PROC_FUTEX_SPINS;
+    apr_uint32_t val;
+
+    val = apr_atomic_cas32(word, self, 0);
+    if (val) {
+        if (timeout > 0) {
+            deadline = apr_time_monotonic() + timeout;
+        }
+
+        /* The owner is checked for a trylock, and when waiting timed out */
+        check_owner = (timeout == 0);
+        for (;;) {
+            apr_interval_time_t wait;
+
+            /* Since others may sleep, take the mutex with the flag */
+            if (!val) {
+                val = apr_atomic_cas32(word, self | PROC_FUTEX_WAITERS, 0);
+                if (!val) {
+                    break;
+                }
+                continue;
+            }
+            if (check_owner && proc_futex_owner_dead(val)) {
+                apr_uint32_t old;
+
+                old = apr_atomic_cas32(word, self | PROC_FUTEX_WAITERS, val);
+                if (old == val) {
+                    break;
+                }
+                val = old;
+                continue;
+            }
+            if (!timeout) {
+                return APR_TIMEUP;
+            }
+
+            /* Spin a while first, unless others sleep already */
+            if (spins > 0 && !(val & PROC_FUTEX_WAITERS)) {
+                spins--;
+                apr_atomic_pause();
+                val = apr_atomic_read32(word);
+                continue;
+            }
+
+            if (!(val & PROC_FUTEX_WAITERS)) {
+                apr_uint32_t old;
+
+                old = apr_atomic_cas32(word, val | PROC_FUTEX_WAITERS, val);
+                if (old != val) {
+                    val = old;
+                    continue;
+                }
+                val |= PROC_FUTEX_WAITERS;
+            }
+
+            wait = PROC_FUTEX_CHECK;
+            if (deadline) {
+                apr_interval_time_t left = deadline - apr_time_monotonic();
+                if (left <= 0) {
+                    return APR_TIMEUP;
+                }
+                if (wait > left) {
+                    wait = left;
+                }
+            }
+            check_owner = (proc_futex_wait(word, val, wait) == ETIMEDOUT);
+
+            val = apr_atomic_read32(word);
+        }
+    }
+
+    mutex->curr_locked = 1;
+    return APR_SUCCESS;
+}
+
+static apr_status_t proc_mutex_futex_acquire(apr_proc_mutex_t *mutex)
+{
+    return proc_mutex_futex_acquire_ex(mutex, -1);
+}
+
+static apr_status_t proc_mutex_futex_tryacquire(apr_proc_mutex_t *mutex)
+{
+    apr_status_t rv = proc_mutex_futex_acquire_ex(mutex, 0);
+    return (rv == APR_TIMEUP) ? APR_EBUSY : rv;
+}
+
+static apr_status_t proc_mutex_futex_timedacquire(apr_proc_mutex_t *mutex,
+                                                apr_interval_time_t timeout)
+{
+    return proc_mutex_futex_acquire_ex(mutex, (timeout <= 0) ? 0 : timeout);
+}
+
+static apr_status_t proc_mutex_futex_release(apr_proc_mutex_t *mutex)
+{
+    volatile apr_uint32_t *word = mutex->os.futex_interproc;
+
+    mutex->curr_locked = 0;
+    if (apr_atomic_xchg32(word, 0) & PROC_FUTEX_WAITERS) {
+        if (syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0) < 0) {
+            return errno;
+        }
+    }
+    return APR_SUCCESS;
+}
+
+static const apr_proc_mutex_unix_lock_methods_t mutex_futex_methods =
+{
+    APR_PROCESS_LOCK_MECH_IS_GLOBAL,
+    proc_mutex_futex_create,
+    proc_mutex_futex_acquire,
+    proc_mutex_futex_tryacquire,
+    proc_mutex_futex_timedacquire,
+    proc_mutex_futex_release,
+    proc_mutex_futex_cleanup,
+    proc_mutex_futex_child_init,
+    proc_mutex_no_perms_set,
+    APR_LOCK_FUTEX,
+    "futex"
+};
+
+#endif /* futex implementation */
+
 #if APR_HAS_FCNTL_SERIALIZE
 
 static struct flock proc_mutex_lock_it;
@@ -1347,6 +1594,9 @@ static apr_status_t proc_mutex_choose_method(apr_proc_mutex_t *new_mutex,
 #if APR_HAS_POSIXSEM_SERIALIZE
     new_mutex->os.psem_interproc = NULL;
 #endif
+#if APR_HAS_FUTEX_SERIALIZE
+    new_mutex->os.futex_interproc = NULL;
+#endif
 #if APR_HAS_SYSVSEM_SERIALIZE || APR_HAS_FCNTL_SERIALIZE || APR_HAS_FLOCK_SERIALIZE
     new_mutex->os.crossproc = -1;
 
@@ -1420,6 +1670,19 @@ static apr_status_t proc_mutex_choose_method(apr_proc_mutex_t *new_mutex,
         }
 #else
         return APR_ENOTIMPL;
+#endif
+        break;
+    case APR_LOCK_FUTEX:
+#if APR_HAS_FUTEX_SERIALIZE
+        new_mutex->meth = &mutex_futex_methods;
+        if (ospmutex) {
+            if (ospmutex->futex_interproc == NULL) {
+                return APR_EINVAL;
+            }
+            new_mutex->os.futex_interproc = ospmutex->futex_interproc;
+        }
+#else
+        return APR_ENOTIMPL;
 #endif
         break;
     case APR_LOCK_DEFAULT_TIMED:
@@ -1565,22 +1828,54 @@ APR_DECLARE(apr_status_t) apr_proc_mutex_child_init(apr_proc_mutex_t **mutex,
 
 APR_DECLARE(apr_status_t) apr_proc_mutex_lock(apr_proc_mutex_t *mutex)
 {
+#if APR_HAS_LOCK_PROFILE
+    if (APR_LOCK_PROFILED(mutex->profile)) {
+        apr_status_t rv;
+
+        APR_LOCK_PROFILE_ACQUIRE(rv, mutex->profile, 1,
+                                 mutex->meth->tryacquire(mutex),
+                                 mutex->meth->acquire(mutex));
+        return rv;
+    }
+#endif
     return mutex->meth->acquire(mutex);
 }
 
 APR_DECLARE(apr_status_t) apr_proc_mutex_trylock(apr_proc_mutex_t *mutex)
 {
-    return mutex->meth->tryacquire(mutex);
+    apr_status_t rv = mutex->meth->tryacquire(mutex);
+
+#if APR_HAS_LOCK_PROFILE
+    if (rv == APR_SUCCESS && APR_LOCK_PROFILED(mutex->profile)) {
+        apr_unix_lock_profile_acquired(mutex->profile, 1);
+    }
+#endif
+    return rv;
 }
 
 APR_DECLARE(apr_status_t) apr_proc_mutex_timedlock(apr_proc_mutex_t *mutex,
                                                apr_interval_time_t timeout)
 {
+#if APR_HAS_LOCK_PROFILE
+    if (APR_LOCK_PROFILED(mutex->profile)) {
+        apr_status_t rv;
+
+        APR_LOCK_PROFILE_ACQUIRE(rv, mutex->profile, 1,
+                                 mutex->meth->tryacquire(mutex),
+                                 mutex->meth->timedacquire(mutex, timeout));
+        return rv;
+    }
+#endif
     return mutex->meth->timedacquire(mutex, timeout);
 }
 
 APR_DECLARE(apr_status_t) apr_proc_mutex_unlock(apr_proc_mutex_t *mutex)
 {
+#if APR_HAS_LOCK_PROFILE
+    if (mutex->profile) {
+        apr_unix_lock_profile_released(mutex->profile);
+    }
+#endif
     return mutex->meth->release(mutex);
 }
 
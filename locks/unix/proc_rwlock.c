@@ -0,0 +1,328 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_arch_proc_rwlock.h"
+#include "apr_atomic.h"
+
+#if APR_HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#if APR_HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#if APR_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#if PROC_RWLOCK_IS_PTHREAD
+
+static apr_status_t proc_rwlock_unref(void *rwlock_)
+{
+    apr_proc_rwlock_t *rwlock = rwlock_;
+    apr_status_t rv;
+
+    if (!apr_atomic_dec32(&rwlock->shared->refcount)) {
+        if ((rv = pthread_rwlock_destroy(&rwlock->shared->rwlock))) {
+#ifdef HAVE_ZOS_PTHREADS
+            rv = errno;
+#endif
+            return rv;
+        }
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t proc_rwlock_cleanup(void *rwlock_)
+{
+    apr_proc_rwlock_t *rwlock = rwlock_;
+    apr_status_t rv;
+
+    rv = proc_rwlock_unref(rwlock);
+    if (munmap((void *)rwlock->shared, sizeof(proc_rwlock_shared_t))
+            && rv == APR_SUCCESS) {
+        rv = errno;
+    }
+    return rv;
+}
+
+APR_DECLARE(apr_status_t) apr_proc_rwlock_create(apr_proc_rwlock_t **rwlock,
+                                                 const char *fname,
+                                                 apr_pool_t *pool)
+{
+    apr_proc_rwlock_t *new_rwlock;
+    pthread_rwlockattr_t attr;
+    apr_status_t rv;
+    void *shared;
+    int fd;
+
+    fd = open("/dev/zero", O_RDWR);
+    if (fd < 0) {
+        return errno;
+    }
+    shared = mmap(NULL, sizeof(proc_rwlock_shared_t), PROT_READ | PROT_WRITE,
+                  MAP_SHARED, fd, 0);
+    if (shared == MAP_FAILED) {
+        rv = errno;
+        close(fd);
+        return rv;
+    }
+    close(fd);
+
+    new_rwlock = apr_palloc(pool, sizeof(*new_rwlock));
+    new_rwlock->pool = pool;
+    new_rwlock->shared = shared;
+    new_rwlock->profile = NULL;
+
+    if ((rv = pthread_rwlockattr_init(&attr))) {
+#ifdef HAVE_ZOS_PTHREADS
+        rv = errno;
+#endif
+        munmap(shared, sizeof(proc_rwlock_shared_t));
+        return rv;
+    }
+    rv = pthread_rwlockattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    if (!rv) {
+        rv = pthread_rwlock_init(&new_rwlock->shared->rwlock, &attr);
+    }
+    if (rv) {
+#ifdef HAVE_ZOS_PTHREADS
+        rv = errno;
+#endif
+        pthread_rwlockattr_destroy(&attr);
+        munmap(shared, sizeof(proc_rwlock_shared_t));
+        return rv;
+    }
+    pthread_rwlockattr_destroy(&attr);
+
+    new_rwlock->shared->refcount = 1; /* first/parent reference */
+
+    apr_pool_cleanup_register(new_rwlock->pool, new_rwlock,
+                              proc_rwlock_cleanup, apr_pool_cleanup_null);
+
+    *rwlock = new_rwlock;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_proc_rwlock_child_init(
+                                                  apr_proc_rwlock_t **rwlock,
+                                                  const char *fname,
+                                                  apr_pool_t *pool)
+{
+    apr_atomic_inc32(&(*rwlock)->shared->refcount);
+    apr_pool_cleanup_register(pool, *rwlock, proc_rwlock_unref,
+                              apr_pool_cleanup_null);
+    return APR_SUCCESS;
+}
+
+static apr_status_t proc_rwlock_rdlock(apr_proc_rwlock_t *rwlock)
+{
+    apr_status_t rv;
+
+    rv = pthread_rwlock_rdlock(&rwlock->shared->rwlock);
+#ifdef HAVE_ZOS_PTHREADS
+    if (rv) {
+        rv = errno;
+    }
+#endif
+    return rv;
+}
+
+static apr_status_t proc_rwlock_tryrdlock(apr_proc_rwlock_t *rwlock)
+{
+    apr_status_t rv;
+
+    rv = pthread_rwlock_tryrdlock(&rwlock->shared->rwlock);
+#ifdef HAVE_ZOS_PTHREADS
+    if (rv) {
+        rv = errno;
+    }
+#endif
+    /* Normalize the return code. */
+    if (rv == EBUSY)
+        rv = APR_EBUSY;
+    return rv;
+}
+
+static apr_status_t proc_rwlock_wrlock(apr_proc_rwlock_t *rwlock)
+{
+    apr_status_t rv;
+
+    rv = pthread_rwlock_wrlock(&rwlock->shared->rwlock);
+#ifdef HAVE_ZOS_PTHREADS
+    if (rv) {
+        rv = errno;
+    }
+#endif
+    return rv;
+}
+
+static apr_status_t proc_rwlock_trywrlock(apr_proc_rwlock_t *rwlock)
+{
+    apr_status_t rv;
+
+    rv = pthread_rwlock_trywrlock(&rwlock->shared->rwlock);
+#ifdef HAVE_ZOS_PTHREADS
+    if (rv) {
+        rv = errno;
+    }
+#endif
+    /* Normalize the return code. */
+    if (rv == EBUSY)
+        rv = APR_EBUSY;
+    return rv;
+}
+
+static apr_status_t proc_rwlock_unlock(apr_proc_rwlock_t *rwlock)
+{
+    apr_status_t rv;
+
+    rv = pthread_rwlock_unlock(&rwlock->shared->rwlock);
+#ifdef HAVE_ZOS_PTHREADS
+    if (rv) {
+        rv = errno;
+    }
+#endif
+    return rv;
+}
+
+APR_DECLARE(apr_status_t) apr_proc_rwlock_rdlock(apr_proc_rwlock_t *rwlock)
+{
+#if APR_HAS_LOCK_PROFILE
+    if (APR_LOCK_PROFILED(rwlock->profile)) {
+        apr_status_t rv;
+
+        APR_LOCK_PROFILE_ACQUIRE(rv, rwlock->profile, 0,
+                                 proc_rwlock_tryrdlock(rwlock),
+                                 proc_rwlock_rdlock(rwlock));
+        return rv;
+    }
+#endif
+    return proc_rwlock_rdlock(rwlock);
+}
+
+APR_DECLARE(apr_status_t) apr_proc_rwlock_tryrdlock(
+                                                  apr_proc_rwlock_t *rwlock)
+{
+    apr_status_t rv = proc_rwlock_tryrdlock(rwlock);
+
+#if APR_HAS_LOCK_PROFILE
+    if (rv == APR_SUCCESS && APR_LOCK_PROFILED(rwlock->profile)) {
+        apr_unix_lock_profile_acquired(rwlock->profile, 0);
+    }
+#endif
+    return rv;
+}
+
+APR_DECLARE(apr_status_t) apr_proc_rwlock_wrlock(apr_proc_rwlock_t *rwlock)
+{
+#if APR_HAS_LOCK_PROFILE
+    if (APR_LOCK_PROFILED(rwlock->profile)) {
+        apr_status_t rv;
+
+        APR_LOCK_PROFILE_ACQUIRE(rv, rwlock->profile, 1,
+                                 proc_rwlock_trywrlock(rwlock),
+                                 proc_rwlock_wrlock(rwlock));
+        return rv;
+    }
+#endif
+    return proc_rwlock_wrlock(rwlock);
+}
+
+APR_DECLARE(apr_status_t) apr_proc_rwlock_trywrlock(
+                                                  apr_proc_rwlock_t *rwlock)
+{
+    apr_status_t rv = proc_rwlock_trywrlock(rwlock);
+
+#if APR_HAS_LOCK_PROFILE
+    if (rv == APR_SUCCESS && APR_LOCK_PROFILED(rwlock->profile)) {
+        apr_unix_lock_profile_acquired(rwlock->profile, 1);
+    }
+#endif
+    return rv;
+}
+
+APR_DECLARE(apr_status_t) apr_proc_rwlock_unlock(apr_proc_rwlock_t *rwlock)
+{
+#if APR_HAS_LOCK_PROFILE
+    if (rwlock->profile) {
+        apr_unix_lock_profile_released(rwlock->profile);
+    }
+#endif
+    return proc_rwlock_unlock(rwlock);
+}
+
+APR_DECLARE(apr_status_t) apr_proc_rwlock_destroy(apr_proc_rwlock_t *rwlock)
+{
+    return apr_pool_cleanup_run(rwlock->pool, rwlock, proc_rwlock_cleanup);
+}
+
+APR_POOL_IMPLEMENT_ACCESSOR(proc_rwlock)
+
+#else /* PROC_RWLOCK_IS_PTHREAD */
+
+APR_DECLARE(apr_status_t) apr_proc_rwlock_create(apr_proc_rwlock_t **rwlock,
+                                                 const char *fname,
+                                                 apr_pool_t *pool)
+{
+    return APR_ENOTIMPL;
+}
+
+APR_DECLARE(apr_status_t) apr_proc_rwlock_child_init(
+                                                  apr_proc_rwlock_t **rwlock,
+                                                  const char *fname,
+                                                  apr_pool_t *pool)
+{
+    return APR_ENOTIMPL;
+}
+
+APR_DECLARE(apr_status_t) apr_proc_rwlock_rdlock(apr_proc_rwlock_t *rwlock)
+{
+    return APR_ENOTIMPL;
+}
+
+APR_DECLARE(apr_status_t) apr_proc_rwlock_tryrdlock(
+                                                  apr_proc_rwlock_t *rwlock)
+{
+    return APR_ENOTIMPL;
+}
+
+APR_DECLARE(apr_status_t) apr_proc_rwlock_wrlock(apr_proc_rwlock_t *rwlock)
+{
+    return APR_ENOTIMPL;
+}
+
+APR_DECLARE(apr_status_t) apr_proc_rwlock_trywrlock(
+                                                  apr_proc_rwlock_t *rwlock)
+{
+    return APR_ENOTIMPL;
+}
+
+APR_DECLARE(apr_status_t) apr_proc_rwlock_unlock(apr_proc_rwlock_t *rwlock)
+{
+    return APR_ENOTIMPL;
+}
+
+APR_DECLARE(apr_status_t) apr_proc_rwlock_destroy(apr_proc_rwlock_t *rwlock)
+{
+    return APR_ENOTIMPL;
+}
+
+APR_POOL_IMPLEMENT_ACCESSOR(proc_rwlock)
+
+#endif /* PROC_RWLOCK_IS_PTHREAD */
@@ -15,11 +15,25 @@
  */
 
 #include "apr_arch_thread_mutex.h"
+#include "apr_probes.h"
 #define APR_WANT_MEMFUNC
 #include "apr_want.h"
 
 #if APR_HAS_THREADS
 
+/* The number of times an adaptive mutex is tried before sleeping, when the
+ * pthread library can't spin by itself.
+ */
+#define THREAD_MUTEX_SPINS 100
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define THREAD_MUTEX_CPU_RELAX() __asm__ __volatile__("pause" ::: "memory")
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define THREAD_MUTEX_CPU_RELAX() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define THREAD_MUTEX_CPU_RELAX()
+#endif
+
 static apr_status_t thread_mutex_cleanup(void *data)
 {
     apr_thread_mutex_t *mutex = data;
@@ -49,6 +63,7 @@ APR_DECLARE(apr_status_t) apr_thread_mutex_create(apr_thread_mutex_t **mutex,
 
     new_mutex = apr_pcalloc(pool, sizeof(apr_thread_mutex_t));
     new_mutex->pool = pool;
+    new_mutex->flags = flags;
 
 #ifdef HAVE_PTHREAD_MUTEX_RECURSIVE
     if (flags & APR_THREAD_MUTEX_NESTED) {
@@ -66,6 +81,28 @@ APR_DECLARE(apr_status_t) apr_thread_mutex_create(apr_thread_mutex_t **mutex,
         rv = pthread_mutex_init(&new_mutex->mutex, &mattr);
 
         pthread_mutexattr_destroy(&mattr);
+
+        if (flags & APR_THREAD_MUTEX_ADAPTIVE) {
+            new_mutex->spins = THREAD_MUTEX_SPINS;
+        }
+    } else
+#endif
+#if defined(HAVE_PTHREAD_MUTEX_ADAPTIVE_NP) && !defined(APR_THREAD_DEBUG)
+    if (flags & APR_THREAD_MUTEX_ADAPTIVE) {
+        pthread_mutexattr_t mattr;
+
+        rv = pthread_mutexattr_init(&mattr);
+        if (rv) return rv;
+
+        rv = pthread_mutexattr_settype(&mattr, PTHREAD_MUTEX_ADAPTIVE_NP);
+        if (rv) {
+            pthread_mutexattr_destroy(&mattr);
+            return rv;
+        }
+
+        rv = pthread_mutex_init(&new_mutex->mutex, &mattr);
+
+        pthread_mutexattr_destroy(&mattr);
     } else
 #endif
     {
@@ -87,6 +124,10 @@ APR_DECLARE(apr_status_t) apr_thread_mutex_create(apr_thread_mutex_t **mutex,
 #else
         rv = pthread_mutex_init(&new_mutex->mutex, NULL);
 #endif
+
+        if (flags & APR_THREAD_MUTEX_ADAPTIVE) {
+            new_mutex->spins = THREAD_MUTEX_SPINS;
+        }
     }
 
     if (rv) {
@@ -117,7 +158,75 @@ APR_DECLARE(apr_status_t) apr_thread_mutex_create(apr_thread_mutex_t **mutex,
     return APR_SUCCESS;
 }
 
-APR_DECLARE(apr_status_t) apr_thread_mutex_lock(apr_thread_mutex_t *mutex)
+/* Called with the mutex held, start being when a contended acquisition
+ * began waiting.
+ */
+static APR_INLINE void thread_mutex_account(apr_thread_mutex_t *mutex,
+                                            int contended, apr_time_t start)
+{
+    mutex->stats.acquired++;
+    if (contended) {
+        mutex->stats.contended++;
+        mutex->stats.wait_time += apr_time_monotonic() - start;
+    }
+}
+
+/* Lock an adaptive mutex, or one recording statistics: the mutex is tried
+ * first to know whether the acquisition is contended, then again for
+ * mutex->spins times before blocking.
+ */
+static apr_status_t thread_mutex_spinlock(apr_thread_mutex_t *mutex)
+{
+    apr_time_t start = 0;
+    int contended = 0;
+    apr_status_t rv;
+
+    rv = pthread_mutex_trylock(&mutex->mutex);
+#ifdef HAVE_ZOS_PTHREADS
+    if (rv) {
+        rv = errno;
+    }
+#endif
+    if (rv == EBUSY) {
+        int spins = mutex->spins;
+
+        contended = 1;
+        APR_PROBE1(thread_mutex__block, mutex);
+        if (mutex->flags & APR_THREAD_MUTEX_STATS) {
+            start = apr_time_monotonic();
+        }
+
+        while (spins-- > 0) {
+            THREAD_MUTEX_CPU_RELAX();
+            rv = pthread_mutex_trylock(&mutex->mutex);
+#ifdef HAVE_ZOS_PTHREADS
+            if (rv) {
+                rv = errno;
+            }
+#endif
+            if (rv != EBUSY) {
+                break;
+            }
+        }
+
+        if (rv == EBUSY) {
+            rv = pthread_mutex_lock(&mutex->mutex);
+#ifdef HAVE_ZOS_PTHREADS
+            if (rv) {
+                rv = errno;
+            }
+#endif
+        }
+        APR_PROBE2(thread_mutex__acquire, mutex, rv);
+    }
+
+    if (rv == APR_SUCCESS && (mutex->flags & APR_THREAD_MUTEX_STATS)) {
+        thread_mutex_account(mutex, contended, start);
+    }
+    return rv;
+}
+
+static apr_status_t thread_mutex_lock(apr_thread_mutex_t *mutex)
 {
     apr_status_t rv;
 
@@ -134,12 +243,25 @@ APR_DECLARE(apr_status_t) apr_thread_mutex_lock(apr_thread_mutex_t *mutex)
         }
 
         if (mutex->locked) {
+            apr_time_t start = 0;
+
+            if (mutex->flags & APR_THREAD_MUTEX_STATS) {
+                start = apr_time_monotonic();
+            }
+            APR_PROBE1(thread_mutex__block, mutex);
             mutex->num_waiters++;
             rv = apr_thread_cond_wait(mutex->cond, mutex);
             mutex->num_waiters--;
+            APR_PROBE2(thread_mutex__acquire, mutex, rv);
+            if (!rv && (mutex->flags & APR_THREAD_MUTEX_STATS)) {
+                thread_mutex_account(mutex, 1, start);
+            }
         }
         else {
             mutex->locked = 1;
+            if (mutex->flags & APR_THREAD_MUTEX_STATS) {
+                thread_mutex_account(mutex, 0, 0);
+            }
         }
 
         rv2 = pthread_mutex_unlock(&mutex->mutex);
@@ -155,6 +277,12 @@ APR_DECLARE(apr_status_t) apr_thread_mutex_lock(apr_thread_mutex_t *mutex)
     }
 #endif
 
+    /* The contention is only seen by trying first, which the probes need */
+    if (APR_HAS_PROBES
+            || mutex->spins || (mutex->flags & APR_THREAD_MUTEX_STATS)) {
+        return thread_mutex_spinlock(mutex);
+    }
+
     rv = pthread_mutex_lock(&mutex->mutex);
 #ifdef HAVE_ZOS_PTHREADS
     if (rv) {
@@ -165,7 +293,7 @@ APR_DECLARE(apr_status_t) apr_thread_mutex_lock(apr_thread_mutex_t *mutex)
     return rv;
 }
 
-APR_DECLARE(apr_status_t) apr_thread_mutex_trylock(apr_thread_mutex_t *mutex)
+static apr_status_t thread_mutex_trylock(apr_thread_mutex_t *mutex)
 {
     apr_status_t rv;
 
@@ -186,6 +314,9 @@ APR_DECLARE(apr_status_t) apr_thread_mutex_trylock(apr_thread_mutex_t *mutex)
         }
         else {
             mutex->locked = 1;
+            if (mutex->flags & APR_THREAD_MUTEX_STATS) {
+                thread_mutex_account(mutex, 0, 0);
+            }
         }
 
         rv2 = pthread_mutex_unlock(&mutex->mutex);
@@ -209,11 +340,14 @@ APR_DECLARE(apr_status_t) apr_thread_mutex_trylock(apr_thread_mutex_t *mutex)
         return (rv == EBUSY) ? APR_EBUSY : rv;
     }
 
+    if (mutex->flags & APR_THREAD_MUTEX_STATS) {
+        thread_mutex_account(mutex, 0, 0);
+    }
     return APR_SUCCESS;
 }
 
-APR_DECLARE(apr_status_t) apr_thread_mutex_timedlock(apr_thread_mutex_t *mutex,
-                                                 apr_interval_time_t timeout)
+static apr_status_t thread_mutex_timedlock(apr_thread_mutex_t *mutex,
+                                           apr_interval_time_t timeout)
 {
     apr_status_t rv = APR_ENOTIMPL;
 
@@ -228,28 +362,54 @@ APR_DECLARE(apr_status_t) apr_thread_mutex_timedlock(apr_thread_mutex_t *mutex,
                 rv = APR_TIMEUP;
             }
         }
+        else if (mutex->flags & APR_THREAD_MUTEX_STATS) {
+            thread_mutex_account(mutex, 0, 0);
+        }
     }
     else {
-        struct timespec abstime;
+        apr_time_t now = apr_time_now(), start = 0;
+        int contended = 1;
+
+        if (mutex->flags & APR_THREAD_MUTEX_STATS) {
+            start = apr_time_monotonic();
+            rv = pthread_mutex_trylock(&mutex->mutex);
+#ifdef HAVE_ZOS_PTHREADS
+            if (rv) {
+                rv = errno;
+            }
+#endif
+            contended = (rv == EBUSY);
+        }
 
-        timeout += apr_time_now();
-        abstime.tv_sec = apr_time_sec(timeout);
-        abstime.tv_nsec = apr_time_usec(timeout) * 1000; /* nanoseconds */
+        if (contended) {
+            struct timespec abstime;
 
-        rv = pthread_mutex_timedlock(&mutex->mutex, &abstime);
-        if (rv) {
+            timeout += now;
+            abstime.tv_sec = apr_time_sec(timeout);
+            abstime.tv_nsec = apr_time_usec(timeout) * 1000; /* nanoseconds */
+
+            rv = pthread_mutex_timedlock(&mutex->mutex, &abstime);
+            if (rv) {
 #ifdef HAVE_ZOS_PTHREADS
-            rv = errno;
+                rv = errno;
 #endif
-            if (rv == ETIMEDOUT) {
-                rv = APR_TIMEUP;
+                if (rv == ETIMEDOUT) {
+                    rv = APR_TIMEUP;
+                }
             }
         }
+
+        if (rv == APR_SUCCESS && (mutex->flags & APR_THREAD_MUTEX_STATS)) {
+            thread_mutex_account(mutex, contended, start);
+        }
     }
 
 #else /* HAVE_PTHREAD_MUTEX_TIMEDLOCK */
 
     if (mutex->cond) {
+        apr_time_t start = 0;
+        int contended;
+
         rv = pthread_mutex_lock(&mutex->mutex);
         if (rv) {
 #ifdef HAVE_ZOS_PTHREADS
@@ -258,7 +418,11 @@ APR_DECLARE(apr_status_t) apr_thread_mutex_timedlock(apr_thread_mutex_t *mutex,
             return rv;
         }
 
-        if (mutex->locked) {
+        if (mutex->flags & APR_THREAD_MUTEX_STATS) {
+            start = apr_time_monotonic();
+        }
+        contended = mutex->locked;
+        if (contended) {
             if (timeout <= 0) {
                 rv = APR_TIMEUP;
             }
@@ -283,6 +447,9 @@ APR_DECLARE(apr_status_t) apr_thread_mutex_timedlock(apr_thread_mutex_t *mutex,
         }
 
         mutex->locked = 1;
+        if (mutex->flags & APR_THREAD_MUTEX_STATS) {
+            thread_mutex_account(mutex, contended, start);
+        }
 
         rv = pthread_mutex_unlock(&mutex->mutex);
         if (rv) {
@@ -298,7 +465,7 @@ APR_DECLARE(apr_status_t) apr_thread_mutex_timedlock(apr_thread_mutex_t *mutex,
     return rv;
 }
 
-APR_DECLARE(apr_status_t) apr_thread_mutex_unlock(apr_thread_mutex_t *mutex)
+static apr_status_t thread_mutex_unlock(apr_thread_mutex_t *mutex)
 {
     apr_status_t status;
 
@@ -337,6 +504,59 @@ APR_DECLARE(apr_status_t) apr_thread_mutex_unlock(apr_thread_mutex_t *mutex)
     return status;
 }
 
+APR_DECLARE(apr_status_t) apr_thread_mutex_lock(apr_thread_mutex_t *mutex)
+{
+#if APR_HAS_LOCK_PROFILE
+    if (APR_LOCK_PROFILED(mutex->profile)) {
+        apr_status_t rv;
+
+        APR_LOCK_PROFILE_ACQUIRE(rv, mutex->profile, 1,
+                                 thread_mutex_trylock(mutex),
+                                 thread_mutex_lock(mutex));
+        return rv;
+    }
+#endif
+    return thread_mutex_lock(mutex);
+}
+
+APR_DECLARE(apr_status_t) apr_thread_mutex_trylock(apr_thread_mutex_t *mutex)
+{
+    apr_status_t rv = thread_mutex_trylock(mutex);
+
+#if APR_HAS_LOCK_PROFILE
+    if (rv == APR_SUCCESS && APR_LOCK_PROFILED(mutex->profile)) {
+        apr_unix_lock_profile_acquired(mutex->profile, 1);
+    }
+#endif
+    return rv;
+}
+
+APR_DECLARE(apr_status_t) apr_thread_mutex_timedlock(apr_thread_mutex_t *mutex,
+                                                 apr_interval_time_t timeout)
+{
+#if APR_HAS_LOCK_PROFILE
+    if (APR_LOCK_PROFILED(mutex->profile)) {
+        apr_status_t rv;
+
+        APR_LOCK_PROFILE_ACQUIRE(rv, mutex->profile, 1,
+                                 thread_mutex_trylock(mutex),
+                                 thread_mutex_timedlock(mutex, timeout));
+        return rv;
+    }
+#endif
+    return thread_mutex_timedlock(mutex, timeout);
+}
+
+APR_DECLARE(apr_status_t) apr_thread_mutex_unlock(apr_thread_mutex_t *mutex)
+{
+#if APR_HAS_LOCK_PROFILE
+    if (mutex->profile) {
+        apr_unix_lock_profile_released(mutex->profile);
+    }
+#endif
+    return thread_mutex_unlock(mutex);
+}
+
 APR_DECLARE(apr_status_t) apr_thread_mutex_destroy(apr_thread_mutex_t *mutex)
 {
     apr_status_t rv, rv2 = APR_SUCCESS;
@@ -355,6 +575,18 @@ APR_DECLARE(apr_status_t) apr_thread_mutex_destroy(apr_thread_mutex_t *mutex)
     return rv;
 }
 
+APR_DECLARE(apr_status_t) apr_thread_mutex_stats_get(
+                                              apr_thread_mutex_t *mutex,
+                                              apr_thread_mutex_stats_t *stats)
+{
+    if (!(mutex->flags & APR_THREAD_MUTEX_STATS)) {
+        return APR_EINVAL;
+    }
+
+    *stats = mutex->stats;
+    return APR_SUCCESS;
+}
+
 APR_POOL_IMPLEMENT_ACCESSOR(thread_mutex)
 
 #endif /* APR_HAS_THREADS */
@@ -16,11 +16,215 @@
 
 #include "apr_arch_thread_rwlock.h"
 #include "apr_private.h"
+#include "apr_atomic.h"
+#include "apr_thread_proc.h" /* for APR_THREAD_LOCAL */
+
+#if APR_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 
 #if APR_HAS_THREADS
 
 #ifdef HAVE_PTHREAD_RWLOCKS
 
+/* The rwlock must be initialized but not locked by any thread when
+ * cleanup is called. */
+/*
+ * The big-reader lock (APR_THREAD_RWLOCK_DISTRIBUTED).
+ *
+ * Each reader counts itself in a slot of its own cache line, assigned to
+ * its thread once, and then only reads the shared writer state, so readers
+ * don't bounce a cache line between CPUs.  A writer announces itself in
+ * the writer state, then waits for the readers of all the slots to drain;
+ * readers finding a writer announced back off until it is done, which
+ * gives writers priority.  Both sides use sequentially consistent atomics,
+ * so that either the reader sees the writer or the writer sees the reader.
+ * Sleeping and wake ups go through the mutex and the condition variable.
+ */
+#if APR_HAS_THREAD_LOCAL
+
+#define BR_CACHE_LINE 64
+#define BR_MAX_SLOTS 256
+
+#define BR_NO_WRITER 0
+#define BR_WRITER_PENDING 1
+#define BR_WRITER_HELD 2
+
+typedef struct br_slot_t {
+    volatile apr_uint32_t readers;
+    char pad[BR_CACHE_LINE - sizeof(apr_uint32_t)];
+} br_slot_t;
+
+struct thread_rwlock_br_t {
+    br_slot_t *slots;
+    apr_uint32_t nslots; /* a power of two */
+    volatile apr_uint32_t writer;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+/* Threads take the slots round robin, slot being 1 + the thread's index */
+static volatile apr_uint32_t br_next_slot = 0;
+static APR_THREAD_LOCAL apr_uint32_t br_thread_slot;
+
+static APR_INLINE
+volatile apr_uint32_t *br_readers(struct thread_rwlock_br_t *br)
+{
+    apr_uint32_t slot = br_thread_slot;
+
+    if (!slot) {
+        slot = (apr_atomic_inc32(&br_next_slot) & 0x7fffffff) + 1;
+        br_thread_slot = slot;
+    }
+    return &br->slots[(slot - 1) & (br->nslots - 1)].readers;
+}
+
+static int br_has_readers(struct thread_rwlock_br_t *br)
+{
+    apr_uint32_t i;
+
+    for (i = 0; i < br->nslots; i++) {
+        if (apr_atomic_read32(&br->slots[i].readers)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static apr_status_t br_create(struct thread_rwlock_br_t **pbr,
+                              apr_pool_t *pool)
+{
+    struct thread_rwlock_br_t *br;
+    apr_uint32_t ncpus = 16;
+    apr_status_t stat;
+
+#ifdef _SC_NPROCESSORS_ONLN
+    {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        if (n > 0) {
+            ncpus = (n < BR_MAX_SLOTS) ? (apr_uint32_t)n : BR_MAX_SLOTS;
+        }
+    }
+#endif
+
+    br = apr_pcalloc(pool, sizeof(*br));
+    br->nslots = 1;
+    while (br->nslots < ncpus) {
+        br->nslots <<= 1;
+    }
+    br->slots = apr_pcalloc(pool, (br->nslots + 1) * sizeof(br_slot_t));
+    br->slots = (br_slot_t *)APR_ALIGN((apr_uintptr_t)br->slots,
+                                       BR_CACHE_LINE);
+
+    if ((stat = pthread_mutex_init(&br->mutex, NULL))) {
+        return stat;
+    }
+    if ((stat = pthread_cond_init(&br->cond, NULL))) {
+        pthread_mutex_destroy(&br->mutex);
+        return stat;
+    }
+
+    *pbr = br;
+    return APR_SUCCESS;
+}
+
+/* Wake up the waiters, under the mutex so that none misses it */
+static apr_status_t br_wakeup(struct thread_rwlock_br_t *br)
+{
+    apr_status_t stat;
+
+    if ((stat = pthread_mutex_lock(&br->mutex))) {
+        return stat;
+    }
+    pthread_cond_broadcast(&br->cond);
+    return pthread_mutex_unlock(&br->mutex);
+}
+
+static apr_status_t br_rdlock(struct thread_rwlock_br_t *br, int try)
+{
+    volatile apr_uint32_t *readers = br_readers(br);
+    apr_status_t stat;
+
+    for (;;) {
+        apr_atomic_inc32(readers);
+        if (apr_atomic_read32(&br->writer) == BR_NO_WRITER) {
+            return APR_SUCCESS;
+        }
+
+        /* Back off, the writer may be waiting for this slot to drain */
+        apr_atomic_dec32(readers);
+        if (try) {
+            stat = br_wakeup(br);
+            return stat ? stat : APR_EBUSY;
+        }
+
+        if ((stat = pthread_mutex_lock(&br->mutex))) {
+            return stat;
+        }
+        pthread_cond_broadcast(&br->cond);
+        while (apr_atomic_read32(&br->writer) != BR_NO_WRITER) {
+            pthread_cond_wait(&br->cond, &br->mutex);
+        }
+        if ((stat = pthread_mutex_unlock(&br->mutex))) {
+            return stat;
+        }
+    }
+}
+
+static apr_status_t br_wrlock(struct thread_rwlock_br_t *br, int try)
+{
+    apr_status_t stat;
+
+    if ((stat = pthread_mutex_lock(&br->mutex))) {
+        return stat;
+    }
+
+    while (apr_atomic_read32(&br->writer) != BR_NO_WRITER) {
+        if (try) {
+            pthread_mutex_unlock(&br->mutex);
+            return APR_EBUSY;
+        }
+        pthread_cond_wait(&br->cond, &br->mutex);
+    }
+
+    apr_atomic_set32(&br->writer, BR_WRITER_PENDING);
+    while (br_has_readers(br)) {
+        if (try) {
+            apr_atomic_set32(&br->writer, BR_NO_WRITER);
+            pthread_cond_broadcast(&br->cond);
+            pthread_mutex_unlock(&br->mutex);
+            return APR_EBUSY;
+        }
+        pthread_cond_wait(&br->cond, &br->mutex);
+    }
+    apr_atomic_set32(&br->writer, BR_WRITER_HELD);
+
+    return pthread_mutex_unlock(&br->mutex);
+}
+
+static apr_status_t br_unlock(struct thread_rwlock_br_t *br)
+{
+    apr_status_t stat;
+
+    /* The writer can't be held while the caller holds a read lock */
+    if (apr_atomic_read32(&br->writer) == BR_WRITER_HELD) {
+        if ((stat = pthread_mutex_lock(&br->mutex))) {
+            return stat;
+        }
+        apr_atomic_set32(&br->writer, BR_NO_WRITER);
+        pthread_cond_broadcast(&br->cond);
+        return pthread_mutex_unlock(&br->mutex);
+    }
+
+    apr_atomic_dec32(br_readers(br));
+    if (apr_atomic_read32(&br->writer) != BR_NO_WRITER) {
+        return br_wakeup(br);
+    }
+    return APR_SUCCESS;
+}
+
+#endif /* APR_HAS_THREAD_LOCAL */
+
 /* The rwlock must be initialized but not locked by any thread when
  * cleanup is called. */
 static apr_status_t thread_rwlock_cleanup(void *data)
@@ -28,6 +232,13 @@ static apr_status_t thread_rwlock_cleanup(void *data)
     apr_thread_rwlock_t *rwlock = (apr_thread_rwlock_t *)data;
     apr_status_t stat;
 
+#if APR_HAS_THREAD_LOCAL
+    if (rwlock->br) {
+        pthread_cond_destroy(&rwlock->br->cond);
+        return pthread_mutex_destroy(&rwlock->br->mutex);
+    }
+#endif
+
     stat = pthread_rwlock_destroy(&rwlock->rwlock);
 #ifdef HAVE_ZOS_PTHREADS
     if (stat) {
@@ -39,13 +250,32 @@ static apr_status_t thread_rwlock_cleanup(void *data)
 
 APR_DECLARE(apr_status_t) apr_thread_rwlock_create(apr_thread_rwlock_t **rwlock,
                                                    apr_pool_t *pool)
+{
+    return apr_thread_rwlock_create_ex(rwlock, APR_THREAD_RWLOCK_DEFAULT,
+                                       pool);
+}
+
+APR_DECLARE(apr_status_t) apr_thread_rwlock_create_ex(
+                                                 apr_thread_rwlock_t **rwlock,
+                                                 unsigned int flags,
+                                                 apr_pool_t *pool)
 {
     apr_thread_rwlock_t *new_rwlock;
     apr_status_t stat;
 
     new_rwlock = apr_palloc(pool, sizeof(apr_thread_rwlock_t));
     new_rwlock->pool = pool;
+    new_rwlock->br = NULL;
+    new_rwlock->profile = NULL;
 
+#if APR_HAS_THREAD_LOCAL
+    if (flags & APR_THREAD_RWLOCK_DISTRIBUTED) {
+        if ((stat = br_create(&new_rwlock->br, pool))) {
+            return stat;
+        }
+    }
+    else
+#endif
     if ((stat = pthread_rwlock_init(&new_rwlock->rwlock, NULL))) {
 #ifdef HAVE_ZOS_PTHREADS
         stat = errno;
@@ -61,10 +291,16 @@ APR_DECLARE(apr_status_t) apr_thread_rwlock_create(apr_thread_rwlock_t **rwlock,
     return APR_SUCCESS;
 }
 
-APR_DECLARE(apr_status_t) apr_thread_rwlock_rdlock(apr_thread_rwlock_t *rwlock)
+static apr_status_t thread_rwlock_rdlock(apr_thread_rwlock_t *rwlock)
 {
     apr_status_t stat;
 
+#if APR_HAS_THREAD_LOCAL
+    if (rwlock->br) {
+        return br_rdlock(rwlock->br, 0);
+    }
+#endif
+
     stat = pthread_rwlock_rdlock(&rwlock->rwlock);
 #ifdef HAVE_ZOS_PTHREADS
     if (stat) {
@@ -74,10 +310,16 @@ APR_DECLARE(apr_status_t) apr_thread_rwlock_rdlock(apr_thread_rwlock_t *rwlock)
     return stat;
 }
 
-APR_DECLARE(apr_status_t) apr_thread_rwlock_tryrdlock(apr_thread_rwlock_t *rwlock)
+static apr_status_t thread_rwlock_tryrdlock(apr_thread_rwlock_t *rwlock)
 {
     apr_status_t stat;
 
+#if APR_HAS_THREAD_LOCAL
+    if (rwlock->br) {
+        return br_rdlock(rwlock->br, 1);
+    }
+#endif
+
     stat = pthread_rwlock_tryrdlock(&rwlock->rwlock);
 #ifdef HAVE_ZOS_PTHREADS
     if (stat) {
@@ -90,10 +332,16 @@ APR_DECLARE(apr_status_t) apr_thread_rwlock_tryrdlock(apr_thread_rwlock_t *rwloc
     return stat;
 }
 
-APR_DECLARE(apr_status_t) apr_thread_rwlock_wrlock(apr_thread_rwlock_t *rwlock)
+static apr_status_t thread_rwlock_wrlock(apr_thread_rwlock_t *rwlock)
 {
     apr_status_t stat;
 
+#if APR_HAS_THREAD_LOCAL
+    if (rwlock->br) {
+        return br_wrlock(rwlock->br, 0);
+    }
+#endif
+
     stat = pthread_rwlock_wrlock(&rwlock->rwlock);
 #ifdef HAVE_ZOS_PTHREADS
     if (stat) {
@@ -103,10 +351,16 @@ APR_DECLARE(apr_status_t) apr_thread_rwlock_wrlock(apr_thread_rwlock_t *rwlock)
     return stat;
 }
 
-APR_DECLARE(apr_status_t) apr_thread_rwlock_trywrlock(apr_thread_rwlock_t *rwlock)
+static apr_status_t thread_rwlock_trywrlock(apr_thread_rwlock_t *rwlock)
 {
     apr_status_t stat;
 
+#if APR_HAS_THREAD_LOCAL
+    if (rwlock->br) {
+        return br_wrlock(rwlock->br, 1);
+    }
+#endif
+
     stat = pthread_rwlock_trywrlock(&rwlock->rwlock);
 #ifdef HAVE_ZOS_PTHREADS
     if (stat) {
@@ -119,10 +373,16 @@ APR_DECLARE(apr_status_t) apr_thread_rwlock_trywrlock(apr_thread_rwlock_t *rwloc
     return stat;
 }
 
-APR_DECLARE(apr_status_t) apr_thread_rwlock_unlock(apr_thread_rwlock_t *rwlock)
+static apr_status_t thread_rwlock_unlock(apr_thread_rwlock_t *rwlock)
 {
     apr_status_t stat;
 
+#if APR_HAS_THREAD_LOCAL
+    if (rwlock->br) {
+        return br_unlock(rwlock->br);
+    }
+#endif
+
     stat = pthread_rwlock_unlock(&rwlock->rwlock);
 #ifdef HAVE_ZOS_PTHREADS
     if (stat) {
@@ -132,6 +392,70 @@ APR_DECLARE(apr_status_t) apr_thread_rwlock_unlock(apr_thread_rwlock_t *rwlock)
     return stat;
 }
 
+APR_DECLARE(apr_status_t) apr_thread_rwlock_rdlock(apr_thread_rwlock_t *rwlock)
+{
+#if APR_HAS_LOCK_PROFILE
+    if (APR_LOCK_PROFILED(rwlock->profile)) {
+        apr_status_t rv;
+
+        APR_LOCK_PROFILE_ACQUIRE(rv, rwlock->profile, 0,
+                                 thread_rwlock_tryrdlock(rwlock),
+                                 thread_rwlock_rdlock(rwlock));
+        return rv;
+    }
+#endif
+    return thread_rwlock_rdlock(rwlock);
+}
+
+APR_DECLARE(apr_status_t) apr_thread_rwlock_tryrdlock(apr_thread_rwlock_t *rwlock)
+{
+    apr_status_t rv = thread_rwlock_tryrdlock(rwlock);
+
+#if APR_HAS_LOCK_PROFILE
+    if (rv == APR_SUCCESS && APR_LOCK_PROFILED(rwlock->profile)) {
+        apr_unix_lock_profile_acquired(rwlock->profile, 0);
+    }
+#endif
+    return rv;
+}
+
+APR_DECLARE(apr_status_t) apr_thread_rwlock_wrlock(apr_thread_rwlock_t *rwlock)
+{
+#if APR_HAS_LOCK_PROFILE
+    if (APR_LOCK_PROFILED(rwlock->profile)) {
+        apr_status_t rv;
+
+        APR_LOCK_PROFILE_ACQUIRE(rv, rwlock->profile, 1,
+                                 thread_rwlock_trywrlock(rwlock),
+                                 thread_rwlock_wrlock(rwlock));
+        return rv;
+    }
+#endif
+    return thread_rwlock_wrlock(rwlock);
+}
+
+APR_DECLARE(apr_status_t) apr_thread_rwlock_trywrlock(apr_thread_rwlock_t *rwlock)
+{
+    apr_status_t rv = thread_rwlock_trywrlock(rwlock);
+
+#if APR_HAS_LOCK_PROFILE
+    if (rv == APR_SUCCESS && APR_LOCK_PROFILED(rwlock->profile)) {
+        apr_unix_lock_profile_acquired(rwlock->profile, 1);
+    }
+#endif
+    return rv;
+}
+
+APR_DECLARE(apr_status_t) apr_thread_rwlock_unlock(apr_thread_rwlock_t *rwlock)
+{
+#if APR_HAS_LOCK_PROFILE
+    if (rwlock->profile) {
+        apr_unix_lock_profile_released(rwlock->profile);
+    }
+#endif
+    return thread_rwlock_unlock(rwlock);
+}
+
 APR_DECLARE(apr_status_t) apr_thread_rwlock_destroy(apr_thread_rwlock_t *rwlock)
 {
     return apr_pool_cleanup_run(rwlock->pool, rwlock, thread_rwlock_cleanup);
@@ -145,6 +469,14 @@ APR_DECLARE(apr_status_t) apr_thread_rwlock_create(apr_thread_rwlock_t **rwlock,
     return APR_ENOTIMPL;
 }
 
+APR_DECLARE(apr_status_t) apr_thread_rwlock_create_ex(
+                                                 apr_thread_rwlock_t **rwlock,
+                                                 unsigned int flags,
+                                                 apr_pool_t *pool)
+{
+    return APR_ENOTIMPL;
+}
+
 APR_DECLARE(apr_status_t) apr_thread_rwlock_rdlock(apr_thread_rwlock_t *rwlock)
 {
     return APR_ENOTIMPL;
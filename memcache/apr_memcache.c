@@ -17,6 +17,11 @@
 #include "apr_memcache.h"
 #include "apr_poll.h"
 #include "apr_version.h"
+#include "apr_md5.h"
+#include "apr_lib.h"
+#include "apr_thread_cond.h"
+#include "apr_thread_proc.h"
+#include "apr_atomic.h"
 #include <stdlib.h>
 
 #define BUFFER_SIZE 512
@@ -25,11 +30,14 @@ struct apr_memcache_conn_t
     char *buffer;
     apr_size_t blen;
     apr_pool_t *p;
-    apr_pool_t *tp;
     apr_socket_t *sock;
+    apr_bucket_alloc_t *ba;
     apr_bucket_brigade *bb;
     apr_bucket_brigade *tb;
     apr_memcache_server_t *ms;
+    apr_time_t start;  /* acquisition of the connection for a request */
+    apr_time_t sent;   /* the request written, or 0 */
+    apr_time_t fbtime; /* the first reply line read, or 0 */
 };
 
 /* Strings for Client Commands */
@@ -102,20 +110,190 @@ struct apr_memcache_conn_t
 /** Server and Query Structure for a multiple get */
 struct cache_server_query_t {
     apr_memcache_server_t* ms;
-    apr_memcache_conn_t* conn;
+    apr_memcache_conn_t* conn; /* NULL once done */
     struct iovec* query_vec;
     apr_int32_t query_vec_count;
+    apr_status_t rv;
+    int polled;
 };
 
 #define MULT_GET_TIMEOUT 50000
 
+/* The client side metrics of a server, all updated atomically */
+struct apr_memcache_counters_t
+{
+    apr_uint64_t requests;
+    apr_uint64_t errors;
+    apr_uint64_t connects;
+    apr_uint64_t connect_errors;
+    apr_uint64_t reconnects;
+    apr_uint64_t deaths;
+    apr_uint64_t dead_time;
+    apr_uint64_t dead_since;  /* start of the current dead period, or 0 */
+    apr_uint32_t broken;      /* connections invalidated, not replaced yet */
+    apr_memcache_latency_t connect;
+    apr_memcache_latency_t send;
+    apr_memcache_latency_t first_byte;
+    apr_memcache_latency_t total;
+};
+
+static int latency_bucket(apr_uint64_t v)
+{
+    apr_uint64_t x;
+    int msb = 0, i;
+
+    if (v < 4) {
+        return (int)v;
+    }
+    for (x = v; x >>= 1; ) {
+        msb++;
+    }
+    /* 4 buckets per power of two, indexed by the 2 bits after the msb */
+    i = (msb - 1) * 4 + (int)((v >> (msb - 2)) & 3);
+    return i < APR_MC_LATENCY_BUCKETS ? i : APR_MC_LATENCY_BUCKETS - 1;
+}
+
+static void latency_record(apr_memcache_latency_t *lat,
+                           apr_time_t from, apr_time_t to)
+{
+    apr_uint64_t v = to > from ? (apr_uint64_t)(to - from) : 0, max;
+
+    apr_atomic_inc64(&lat->buckets[latency_bucket(v)]);
+    apr_atomic_add64(&lat->sum, v);
+    apr_atomic_inc64(&lat->count);
+    do {
+        max = apr_atomic_read64(&lat->max);
+    } while (v > max && apr_atomic_cas64(&lat->max, v, max) != max);
+}
+
+static void latency_copy(apr_memcache_latency_t *to,
+                         apr_memcache_latency_t *from)
+{
+    int i;
+
+    to->count = apr_atomic_read64(&from->count);
+    to->sum = apr_atomic_read64(&from->sum);
+    to->max = apr_atomic_read64(&from->max);
+    for (i = 0; i < APR_MC_LATENCY_BUCKETS; i++) {
+        to->buckets[i] = apr_atomic_read64(&from->buckets[i]);
+    }
+}
+
+static void latency_reset(apr_memcache_latency_t *lat)
+{
+    int i;
+
+    apr_atomic_set64(&lat->count, 0);
+    apr_atomic_set64(&lat->sum, 0);
+    apr_atomic_set64(&lat->max, 0);
+    for (i = 0; i < APR_MC_LATENCY_BUCKETS; i++) {
+        apr_atomic_set64(&lat->buckets[i], 0);
+    }
+}
+
+APR_DECLARE(apr_interval_time_t) apr_memcache_latency_bucket_limit(int bucket)
+{
+    int next = bucket + 1;
+
+    if (next >= APR_MC_LATENCY_BUCKETS) {
+        return -1;
+    }
+    if (next < 4) {
+        return next;
+    }
+    return (apr_interval_time_t)(4 + next % 4) << (next / 4 - 1);
+}
+
+APR_DECLARE(apr_interval_time_t) apr_memcache_latency_percentile(const apr_memcache_latency_t *lat,
+                                                                 double percentile)
+{
+    apr_uint64_t rank, seen = 0;
+    apr_interval_time_t limit;
+    int i;
+
+    if (lat->count == 0) {
+        return 0;
+    }
+    if (percentile >= 100) {
+        return lat->max;
+    }
+    rank = percentile > 0 ? (apr_uint64_t)(lat->count * percentile / 100) : 0;
+    for (i = 0; i < APR_MC_LATENCY_BUCKETS - 1; i++) {
+        seen += lat->buckets[i];
+        if (seen > rank) {
+            break;
+        }
+    }
+    limit = apr_memcache_latency_bucket_limit(i);
+    if (limit < 0 || (apr_uint64_t)limit - 1 > lat->max) {
+        return lat->max;
+    }
+    return limit - 1;
+}
+
+APR_DECLARE(apr_status_t) apr_memcache_server_metrics(apr_memcache_server_t *ms,
+                                                      apr_memcache_metrics_t *metrics)
+{
+    apr_memcache_counters_t *c = ms->counters;
+    apr_uint64_t since;
+
+    metrics->requests = apr_atomic_read64(&c->requests);
+    metrics->errors = apr_atomic_read64(&c->errors);
+    metrics->connects = apr_atomic_read64(&c->connects);
+    metrics->connect_errors = apr_atomic_read64(&c->connect_errors);
+    metrics->reconnects = apr_atomic_read64(&c->reconnects);
+    metrics->deaths = apr_atomic_read64(&c->deaths);
+    metrics->dead_time = apr_atomic_read64(&c->dead_time);
+    since = apr_atomic_read64(&c->dead_since);
+    if (since) {
+        apr_time_t now = apr_time_monotonic();
+
+        if (now > (apr_time_t)since) {
+            metrics->dead_time += now - since;
+        }
+    }
+    latency_copy(&metrics->connect, &c->connect);
+    latency_copy(&metrics->send, &c->send);
+    latency_copy(&metrics->first_byte, &c->first_byte);
+    latency_copy(&metrics->total, &c->total);
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(void) apr_memcache_server_metrics_reset(apr_memcache_server_t *ms)
+{
+    apr_memcache_counters_t *c = ms->counters;
+
+    apr_atomic_set64(&c->requests, 0);
+    apr_atomic_set64(&c->errors, 0);
+    apr_atomic_set64(&c->connects, 0);
+    apr_atomic_set64(&c->connect_errors, 0);
+    apr_atomic_set64(&c->reconnects, 0);
+    apr_atomic_set64(&c->deaths, 0);
+    apr_atomic_set64(&c->dead_time, 0);
+    /* a current dead period is accounted from now on */
+    if (apr_atomic_read64(&c->dead_since)) {
+        apr_atomic_set64(&c->dead_since, apr_time_monotonic());
+    }
+    latency_reset(&c->connect);
+    latency_reset(&c->send);
+    latency_reset(&c->first_byte);
+    latency_reset(&c->total);
+}
+
 static apr_status_t make_server_dead(apr_memcache_t *mc, apr_memcache_server_t *ms)
 {
+    apr_time_t now = apr_time_monotonic();
+
 #if APR_HAS_THREADS
     apr_thread_mutex_lock(ms->lock);
 #endif
+    if (ms->status != APR_MC_SERVER_DEAD) {
+        apr_atomic_inc64(&ms->counters->deaths);
+        apr_atomic_set64(&ms->counters->dead_since, now);
+    }
     ms->status = APR_MC_SERVER_DEAD;
-    ms->btime = apr_time_now();
+    ms->btime = now;
 #if APR_HAS_THREADS
     apr_thread_mutex_unlock(ms->lock);
 #endif
@@ -124,11 +302,24 @@ static apr_status_t make_server_dead(apr_memcache_t *mc, apr_memcache_server_t *
 
 static apr_status_t make_server_live(apr_memcache_t *mc, apr_memcache_server_t *ms)
 {
+    apr_uint64_t since = apr_atomic_xchg64(&ms->counters->dead_since, 0);
+
+    if (since) {
+        apr_time_t now = apr_time_monotonic();
+
+        if (now > (apr_time_t)since) {
+            apr_atomic_add64(&ms->counters->dead_time, now - since);
+        }
+    }
     ms->status = APR_MC_SERVER_LIVE;
     return APR_SUCCESS;
 }
 
 
+static void ring_build(apr_memcache_t *mc);
+static void near_cache_invalidate(apr_memcache_t *mc, const char *key);
+static apr_status_t mget_cache_create(apr_memcache_t *mc);
+
 APR_DECLARE(apr_status_t) apr_memcache_add_server(apr_memcache_t *mc, apr_memcache_server_t *ms)
 {
     apr_status_t rv = APR_SUCCESS;
@@ -140,6 +331,9 @@ APR_DECLARE(apr_status_t) apr_memcache_add_server(apr_memcache_t *mc, apr_memcac
     mc->live_servers[mc->ntotal] = ms;
     mc->ntotal++;
     make_server_live(mc, ms);
+    if (mc->ring) {
+        ring_build(mc);
+    }
     return rv;
 }
 
@@ -156,55 +350,202 @@ apr_memcache_find_server_hash(apr_memcache_t *mc, const apr_uint32_t hash)
     }
 }
 
+/* Whether the server is live, or was dead long enough to be tried again
+ * and came back.
+ */
+static int server_usable(apr_memcache_t *mc, apr_memcache_server_t *ms,
+                         apr_time_t *curtime)
+{
+    int live = 0;
+
+    if (ms->status == APR_MC_SERVER_LIVE) {
+        return 1;
+    }
+    if (mc->prober) {
+        return 0;
+    }
+
+    if (*curtime == 0) {
+        *curtime = apr_time_monotonic();
+    }
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(ms->lock);
+#endif
+    /* Try the dead server, every 5 seconds */
+    if (*curtime - ms->btime > apr_time_from_sec(5)) {
+        ms->btime = *curtime;
+        if (mc_version_ping(ms) == APR_SUCCESS) {
+            make_server_live(mc, ms);
+            live = 1;
+        }
+    }
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(ms->lock);
+#endif
+
+    return live;
+}
+
+/* The first usable server from the h'th on, wrapping around */
+static apr_memcache_server_t *find_server_from(apr_memcache_t *mc, apr_uint32_t h)
+{
+    apr_time_t curtime = 0;
+    apr_uint32_t i;
+
+    for (i = 0; i < mc->ntotal; i++, h++) {
+        apr_memcache_server_t *ms = mc->live_servers[h % mc->ntotal];
+
+        if (server_usable(mc, ms, &curtime)) {
+            return ms;
+        }
+    }
+
+    return NULL;
+}
+
 APR_DECLARE(apr_memcache_server_t *)
 apr_memcache_find_server_hash_default(void *baton, apr_memcache_t *mc,
                                       const apr_uint32_t hash)
 {
-    apr_memcache_server_t *ms = NULL;
-    apr_uint32_t h = hash ? hash : 1;
-    apr_uint32_t i = 0;
+    if (mc->ntotal == 0) {
+        return NULL;
+    }
+
+    return find_server_from(mc, hash ? hash : 1);
+}
+
+/* The ketama ring: KETAMA_POINTS points per unit of weight of each
+ * server, sorted, four of them taken from the md5 of "host:port-n".
+ */
+#define KETAMA_POINTS 160
+
+typedef struct {
+    apr_uint32_t point;
+    apr_memcache_server_t *ms;
+} ring_point_t;
+
+struct apr_memcache_ring_t {
+    ring_point_t *points;
+    apr_size_t npoints;
+};
+
+static int ring_point_cmp(const void *a, const void *b)
+{
+    apr_uint32_t pa = ((const ring_point_t *)a)->point;
+    apr_uint32_t pb = ((const ring_point_t *)b)->point;
+
+    return (pa > pb) - (pa < pb);
+}
+
+static void ring_build(apr_memcache_t *mc)
+{
+    apr_memcache_ring_t *ring = mc->ring;
+    apr_size_t n = 0;
+    apr_uint32_t i, j, k;
+
+    for (i = 0; i < mc->ntotal; i++) {
+        n += (apr_size_t)KETAMA_POINTS * mc->live_servers[i]->weight;
+    }
+
+    /* Servers are added at startup, the previous rings are not reused */
+    ring->points = apr_palloc(mc->p, n * sizeof(ring_point_t));
+    ring->npoints = 0;
+
+    for (i = 0; i < mc->ntotal; i++) {
+        apr_memcache_server_t *ms = mc->live_servers[i];
+
+        for (j = 0; j < KETAMA_POINTS / 4 * ms->weight; j++) {
+            unsigned char digest[APR_MD5_DIGESTSIZE];
+            char id[512];
+            apr_size_t len;
+
+            len = apr_snprintf(id, sizeof(id), "%s:%hu-%u",
+                               ms->host, ms->port, j);
+            apr_md5(digest, id, len);
+
+            for (k = 0; k < 4; k++) {
+                ring_point_t *pt = &ring->points[ring->npoints++];
+
+                pt->point = ((apr_uint32_t)digest[k * 4 + 3] << 24)
+                          | ((apr_uint32_t)digest[k * 4 + 2] << 16)
+                          | ((apr_uint32_t)digest[k * 4 + 1] << 8)
+                          | digest[k * 4];
+                pt->ms = ms;
+            }
+        }
+    }
+
+    qsort(ring->points, ring->npoints, sizeof(ring_point_t), ring_point_cmp);
+}
+
+APR_DECLARE(apr_memcache_server_t *)
+apr_memcache_find_server_hash_ketama(void *baton, apr_memcache_t *mc,
+                                     const apr_uint32_t hash)
+{
+    apr_memcache_ring_t *ring = mc->ring;
+    apr_memcache_server_t *tried = NULL;
     apr_time_t curtime = 0;
+    apr_size_t lo = 0, hi, i;
 
-    if(mc->ntotal == 0) {
+    if (!ring || !ring->npoints) {
         return NULL;
     }
 
-    do {
-        ms = mc->live_servers[h % mc->ntotal];
-        if(ms->status == APR_MC_SERVER_LIVE) {
-            break;
+    /* The first point at or after the hash */
+    hi = ring->npoints;
+    while (lo < hi) {
+        apr_size_t mid = lo + (hi - lo) / 2;
+
+        if (ring->points[mid].point < hash) {
+            lo = mid + 1;
         }
         else {
-            if (curtime == 0) {
-                curtime = apr_time_now();
-            }
-#if APR_HAS_THREADS
-            apr_thread_mutex_lock(ms->lock);
-#endif
-            /* Try the dead server, every 5 seconds */
-            if (curtime - ms->btime >  apr_time_from_sec(5)) {
-                ms->btime = curtime;
-                if (mc_version_ping(ms) == APR_SUCCESS) {
-                    make_server_live(mc, ms);
-#if APR_HAS_THREADS
-                    apr_thread_mutex_unlock(ms->lock);
-#endif
-                    break;
-                }
+            hi = mid;
+        }
+    }
+
+    /* Then the next points (of another server) while dead */
+    for (i = 0; i < ring->npoints; i++) {
+        apr_memcache_server_t *ms = ring->points[(lo + i) % ring->npoints].ms;
+
+        if (ms != tried) {
+            if (server_usable(mc, ms, &curtime)) {
+                return ms;
             }
-#if APR_HAS_THREADS
-            apr_thread_mutex_unlock(ms->lock);
-#endif
+            tried = ms;
         }
-        h++;
-        i++;
-    } while(i < mc->ntotal);
+    }
+
+    return NULL;
+}
+
+/* Jump consistent hash, from "A Fast, Minimal Memory, Consistent Hash
+ * Algorithm" (Lamping and Veach).
+ */
+static apr_uint32_t jump_hash(apr_uint64_t key, apr_uint32_t nbuckets)
+{
+    apr_int64_t b = -1, j = 0;
 
-    if (i == mc->ntotal) {
-        ms = NULL;
+    while (j < (apr_int64_t)nbuckets) {
+        b = j;
+        key = key * APR_UINT64_C(2862933555777941757) + 1;
+        j = (apr_int64_t)((double)(b + 1)
+                          * ((double)(APR_INT64_C(1) << 31)
+                             / (double)((key >> 33) + 1)));
     }
 
-    return ms;
+    return (apr_uint32_t)b;
+}
+
+APR_DECLARE(apr_memcache_server_t *)
+apr_memcache_find_server_hash_jump(void *baton, apr_memcache_t *mc,
+                                   const apr_uint32_t hash)
+{
+    if (mc->ntotal == 0) {
+        return NULL;
+    }
+
+    return find_server_from(mc, jump_hash(hash, mc->ntotal));
 }
 
 APR_DECLARE(apr_memcache_server_t *) apr_memcache_find_server(apr_memcache_t *mc, const char *host, apr_port_t port)
@@ -225,7 +566,6 @@ APR_DECLARE(apr_memcache_server_t *) apr_memcache_find_server(apr_memcache_t *mc
 static apr_status_t ms_find_conn(apr_memcache_server_t *ms, apr_memcache_conn_t **conn)
 {
     apr_status_t rv;
-    apr_bucket_alloc_t *balloc;
     apr_bucket *e;
 
 #if APR_HAS_THREADS
@@ -239,18 +579,22 @@ static apr_status_t ms_find_conn(apr_memcache_server_t *ms, apr_memcache_conn_t
         return rv;
     }
 
-    balloc = apr_bucket_alloc_create((*conn)->tp);
-    (*conn)->bb = apr_brigade_create((*conn)->tp, balloc);
-    (*conn)->tb = apr_brigade_create((*conn)->tp, balloc);
-
-    e = apr_bucket_socket_create((*conn)->sock, balloc);
+    /* The brigades live with the connection, emptied on release */
+    e = apr_bucket_socket_create((*conn)->sock, (*conn)->ba);
     APR_BRIGADE_INSERT_TAIL((*conn)->bb, e);
 
+    (*conn)->start = apr_time_monotonic();
+    (*conn)->sent = 0;
+    (*conn)->fbtime = 0;
+    apr_atomic_inc64(&ms->counters->requests);
+
     return rv;
 }
 
 static apr_status_t ms_bad_conn(apr_memcache_server_t *ms, apr_memcache_conn_t *conn)
 {
+    apr_atomic_inc64(&ms->counters->errors);
+    apr_atomic_inc32(&ms->counters->broken);
 #if APR_HAS_THREADS
     return apr_reslist_invalidate(ms->conns, conn);
 #else
@@ -260,7 +604,18 @@ static apr_status_t ms_bad_conn(apr_memcache_server_t *ms, apr_memcache_conn_t *
 
 static apr_status_t ms_release_conn(apr_memcache_server_t *ms, apr_memcache_conn_t *conn)
 {
-    apr_pool_clear(conn->tp);
+    apr_time_t now = apr_time_monotonic();
+
+    if (conn->sent) {
+        latency_record(&ms->counters->send, conn->start, conn->sent);
+    }
+    if (conn->fbtime) {
+        latency_record(&ms->counters->first_byte, conn->start, conn->fbtime);
+    }
+    latency_record(&ms->counters->total, conn->start, now);
+
+    apr_brigade_cleanup(conn->bb);
+    apr_brigade_cleanup(conn->tb);
 #if APR_HAS_THREADS
     return apr_reslist_release(ms->conns, conn);
 #else
@@ -268,6 +623,168 @@ static apr_status_t ms_release_conn(apr_memcache_server_t *ms, apr_memcache_conn
 #endif
 }
 
+#if APR_HAS_THREADS
+/* The background prober of the dead servers: each is probed after the
+ * interval, then after twice the previous delay (up to max_interval)
+ * until it answers.  The delays are indexed like mc->live_servers.
+ */
+struct apr_memcache_prober_t
+{
+    apr_memcache_t *mc;
+    apr_interval_time_t interval;
+    apr_interval_time_t max_interval;
+    apr_interval_time_t *delay;
+    apr_time_t *next; /* time of the next probe, or 0 if live */
+    apr_thread_mutex_t *lock;
+    apr_thread_cond_t *cond;
+    apr_thread_t *thread;
+    int stop;
+};
+
+static void * APR_THREAD_FUNC prober_thread(apr_thread_t *thd, void *data)
+{
+    apr_memcache_prober_t *pr = data;
+    apr_memcache_t *mc = pr->mc;
+
+    apr_thread_mutex_lock(pr->lock);
+    while (!pr->stop) {
+        apr_time_t now = apr_time_monotonic();
+        apr_time_t wake = now + pr->max_interval;
+        apr_uint32_t i;
+
+        for (i = 0; i < mc->ntotal && !pr->stop; i++) {
+            apr_memcache_server_t *ms = mc->live_servers[i];
+
+            if (ms->status == APR_MC_SERVER_LIVE) {
+                pr->next[i] = 0;
+                continue;
+            }
+            if (pr->next[i] == 0) {
+                /* newly dead */
+                pr->delay[i] = pr->interval;
+                pr->next[i] = now + pr->delay[i];
+            }
+            else if (pr->next[i] <= now) {
+                apr_status_t rv;
+
+                /* don't hold up apr_memcache_disable_server() or the stop */
+                apr_thread_mutex_unlock(pr->lock);
+                rv = mc_version_ping(ms);
+                apr_thread_mutex_lock(pr->lock);
+
+                now = apr_time_monotonic();
+                if (rv == APR_SUCCESS) {
+                    make_server_live(mc, ms);
+                    pr->next[i] = 0;
+                    continue;
+                }
+                pr->delay[i] *= 2;
+                if (pr->delay[i] > pr->max_interval) {
+                    pr->delay[i] = pr->max_interval;
+                }
+                pr->next[i] = now + pr->delay[i];
+            }
+            if (pr->next[i] < wake) {
+                wake = pr->next[i];
+            }
+        }
+        if (!pr->stop && wake > now) {
+            apr_thread_cond_timedwait(pr->cond, pr->lock, wake - now);
+        }
+    }
+    apr_thread_mutex_unlock(pr->lock);
+
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static apr_status_t prober_cleanup(void *data)
+{
+    apr_memcache_prober_t *pr = data;
+    apr_status_t rv;
+
+    apr_thread_mutex_lock(pr->lock);
+    pr->stop = 1;
+    apr_thread_cond_signal(pr->cond);
+    apr_thread_mutex_unlock(pr->lock);
+
+    apr_thread_join(&rv, pr->thread);
+    pr->mc->prober = NULL;
+
+    return APR_SUCCESS;
+}
+
+static void prober_wake(apr_memcache_t *mc)
+{
+    apr_memcache_prober_t *pr = mc->prober;
+
+    if (pr) {
+        apr_thread_mutex_lock(pr->lock);
+        apr_thread_cond_signal(pr->cond);
+        apr_thread_mutex_unlock(pr->lock);
+    }
+}
+
+APR_DECLARE(apr_status_t) apr_memcache_prober_start(apr_memcache_t *mc,
+                                                    apr_interval_time_t interval,
+                                                    apr_interval_time_t max_interval)
+{
+    apr_memcache_prober_t *pr;
+    apr_status_t rv;
+
+    if (mc->prober) {
+        return APR_EEXIST;
+    }
+    if (interval <= 0 || max_interval < interval) {
+        return APR_EINVAL;
+    }
+
+    pr = apr_pcalloc(mc->p, sizeof(apr_memcache_prober_t));
+    pr->mc = mc;
+    pr->interval = interval;
+    pr->max_interval = max_interval;
+    pr->delay = apr_pcalloc(mc->p, mc->nalloc * sizeof(apr_interval_time_t));
+    pr->next = apr_pcalloc(mc->p, mc->nalloc * sizeof(apr_time_t));
+
+    rv = apr_thread_mutex_create(&pr->lock, APR_THREAD_MUTEX_DEFAULT, mc->p);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    rv = apr_thread_cond_create(&pr->cond, mc->p);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    /* from now on, the requests only see the live or dead state */
+    mc->prober = pr;
+
+    rv = apr_thread_create(&pr->thread, NULL, prober_thread, pr, mc->p);
+    if (rv != APR_SUCCESS) {
+        mc->prober = NULL;
+        return rv;
+    }
+
+    /* joined before the servers' (sub)pools go away */
+    apr_pool_pre_cleanup_register(mc->p, pr, prober_cleanup);
+
+    return APR_SUCCESS;
+}
+
+#else /* APR_HAS_THREADS */
+
+static void prober_wake(apr_memcache_t *mc)
+{
+}
+
+APR_DECLARE(apr_status_t) apr_memcache_prober_start(apr_memcache_t *mc,
+                                                    apr_interval_time_t interval,
+                                                    apr_interval_time_t max_interval)
+{
+    return APR_ENOTIMPL;
+}
+
+#endif /* APR_HAS_THREADS */
+
 APR_DECLARE(apr_status_t) apr_memcache_enable_server(apr_memcache_t *mc, apr_memcache_server_t *ms)
 {
     apr_status_t rv = APR_SUCCESS;
@@ -282,7 +799,10 @@ APR_DECLARE(apr_status_t) apr_memcache_enable_server(apr_memcache_t *mc, apr_mem
 
 APR_DECLARE(apr_status_t) apr_memcache_disable_server(apr_memcache_t *mc, apr_memcache_server_t *ms)
 {
-    return make_server_dead(mc, ms);
+    apr_status_t rv = make_server_dead(mc, ms);
+
+    prober_wake(mc);
+    return rv;
 }
 
 static apr_status_t conn_connect(apr_memcache_conn_t *conn)
@@ -325,7 +845,6 @@ mc_conn_construct(void **conn_, void *params, apr_pool_t *pool)
     apr_status_t rv = APR_SUCCESS;
     apr_memcache_conn_t *conn;
     apr_pool_t *np;
-    apr_pool_t *tp;
     apr_memcache_server_t *ms = params;
 #if APR_HAVE_SOCKADDR_UN
     apr_int32_t family = ms->host[0] != '/' ? APR_UNSPEC : APR_UNIX;
@@ -338,16 +857,9 @@ mc_conn_construct(void **conn_, void *params, apr_pool_t *pool)
         return rv;
     }
 
-    rv = apr_pool_create(&tp, np);
-    if (rv != APR_SUCCESS) {
-        apr_pool_destroy(np);
-        return rv;
-    }
-
     conn = apr_palloc(np, sizeof( apr_memcache_conn_t ));
 
     conn->p = np;
-    conn->tp = tp;
 
     rv = apr_socket_create(&conn->sock, family, SOCK_STREAM, 0, np);
 
@@ -358,13 +870,30 @@ mc_conn_construct(void **conn_, void *params, apr_pool_t *pool)
 
     conn->buffer = apr_palloc(conn->p, BUFFER_SIZE + 1);
     conn->blen = 0;
+    conn->ba = apr_bucket_alloc_create(np);
+    conn->bb = apr_brigade_create(np, conn->ba);
+    conn->tb = apr_brigade_create(np, conn->ba);
     conn->ms = ms;
+    conn->start = apr_time_monotonic();
 
     rv = conn_connect(conn);
     if (rv != APR_SUCCESS) {
+        apr_atomic_inc64(&ms->counters->connect_errors);
         apr_pool_destroy(np);
     }
     else {
+        apr_uint32_t broken;
+
+        latency_record(&ms->counters->connect, conn->start, apr_time_monotonic());
+        apr_atomic_inc64(&ms->counters->connects);
+        /* replacing a broken connection? */
+        while ((broken = apr_atomic_read32(&ms->counters->broken)) != 0) {
+            if (apr_atomic_cas32(&ms->counters->broken, broken - 1,
+                                 broken) == broken) {
+                apr_atomic_inc64(&ms->counters->reconnects);
+                break;
+            }
+        }
         *conn_ = conn;
     }
 
@@ -416,7 +945,9 @@ APR_DECLARE(apr_status_t) apr_memcache_server_create(apr_pool_t *p,
     server->p = np;
     server->host = apr_pstrdup(np, host);
     server->port = port;
+    server->weight = 1;
     server->status = APR_MC_SERVER_DEAD;
+    server->counters = apr_pcalloc(np, sizeof(apr_memcache_counters_t));
 #if APR_HAS_THREADS
     rv = apr_thread_mutex_create(&server->lock, APR_THREAD_MUTEX_DEFAULT, np);
     if (rv != APR_SUCCESS) {
@@ -464,6 +995,26 @@ APR_DECLARE(apr_status_t) apr_memcache_create(apr_pool_t *p,
     mc->hash_baton = NULL;
     mc->server_func = NULL;
     mc->server_baton = NULL;
+    mc->flags = flags;
+    mc->ring = NULL;
+    mc->near_cache = NULL;
+    mc->prober = NULL;
+    mc->mget = NULL;
+    if (flags & APR_MC_FLAG_KETAMA) {
+        mc->ring = apr_pcalloc(p, sizeof(apr_memcache_ring_t));
+        mc->server_func = apr_memcache_find_server_hash_ketama;
+    }
+    else if (flags & APR_MC_FLAG_JUMP) {
+        mc->server_func = apr_memcache_find_server_hash_jump;
+    }
+    if (mc->server_func) {
+        /* The default hash has 15 bits only, too few for a ring */
+        mc->hash_func = apr_memcache_hash_crc32;
+    }
+    rv = mget_cache_create(mc);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
     *memcache = mc;
     return rv;
 }
@@ -583,12 +1134,21 @@ static apr_status_t get_server_line(apr_memcache_conn_t *conn)
     apr_size_t bsize = BUFFER_SIZE;
     apr_status_t rv = APR_SUCCESS;
 
+    /* the request is written once its reply is waited for */
+    if (!conn->sent) {
+        conn->sent = apr_time_monotonic();
+    }
+
     rv = apr_brigade_split_line(conn->tb, conn->bb, APR_BLOCK_READ, BUFFER_SIZE);
 
     if (rv != APR_SUCCESS) {
         return rv;
     }
 
+    if (!conn->fbtime) {
+        conn->fbtime = apr_time_monotonic();
+    }
+
     rv = apr_brigade_flatten(conn->tb, conn->buffer, &bsize);
 
     if (rv != APR_SUCCESS) {
@@ -620,6 +1180,8 @@ static apr_status_t storage_cmd_write(apr_memcache_t *mc,
 
     apr_size_t key_size = strlen(key);
 
+    near_cache_invalidate(mc, key);
+
     hash = apr_memcache_hash(mc, key, key_size);
 
     ms = apr_memcache_find_server_hash(mc, hash);
@@ -751,13 +1313,12 @@ static int parse_size(const char *size_str, apr_size_t *size)
     return 1;
 }
 
-APR_DECLARE(apr_status_t)
-apr_memcache_getp(apr_memcache_t *mc,
-                  apr_pool_t *p,
-                  const char *key,
-                  char **baton,
-                  apr_size_t *new_length,
-                  apr_uint16_t *flags_)
+static apr_status_t memcache_getp(apr_memcache_t *mc,
+                                  apr_pool_t *p,
+                                  const char *key,
+                                  char **baton,
+                                  apr_size_t *new_length,
+                                  apr_uint16_t *flags_)
 {
     apr_status_t rv;
     apr_memcache_server_t *ms;
@@ -836,7 +1397,7 @@ apr_memcache_getp(apr_memcache_t *mc,
                 return rv;
             }
 
-            bbb = apr_brigade_split(conn->bb, e);
+            bbb = apr_brigade_split_ex(conn->bb, e, conn->tb);
 
             rv = apr_brigade_pflatten(conn->bb, baton, &len, p);
             if (rv != APR_SUCCESS) {
@@ -844,12 +1405,13 @@ apr_memcache_getp(apr_memcache_t *mc,
                 return rv;
             }
 
-            rv = apr_brigade_destroy(conn->bb);
+            rv = apr_brigade_cleanup(conn->bb);
             if (rv != APR_SUCCESS) {
                 ms_bad_conn(ms, conn);
                 return rv;
             }
 
+            conn->tb = conn->bb;
             conn->bb = bbb;
 
             *new_length = len - 2;
@@ -883,6 +1445,338 @@ apr_memcache_getp(apr_memcache_t *mc,
     return rv;
 }
 
+/*
+ * Near cache
+ */
+
+#define NEAR_CACHE_SHARDS 16
+
+#define NEAR_FETCHING 0
+#define NEAR_READY    1
+
+typedef struct near_entry_t near_entry_t;
+struct near_entry_t {
+    char *key;
+    apr_size_t klen;
+    char *data;
+    apr_size_t len;
+    apr_uint16_t flags;
+    apr_status_t status;        /* the result of the fetch */
+    apr_time_t expires;
+    int state;
+    int referenced;             /* CLOCK bit */
+    int invalidated;            /* the fetch result must not be kept */
+    int waiters;                /* threads waiting for the fetch */
+    apr_uint32_t slot;
+};
+
+typedef struct near_shard_t {
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *lock;
+    apr_thread_cond_t *fetched;
+#endif
+    apr_hash_t *entries;
+    near_entry_t **slots;       /* the CLOCK, NULL slots are free */
+    apr_uint32_t hand;
+} near_shard_t;
+
+struct apr_memcache_near_cache_t {
+    apr_uint32_t nslots;        /* per shard */
+    apr_size_t max_size;
+    apr_interval_time_t ttl;
+    near_shard_t shards[NEAR_CACHE_SHARDS];
+};
+
+#if APR_HAS_THREADS
+#define NEAR_LOCK(s)    apr_thread_mutex_lock((s)->lock)
+#define NEAR_UNLOCK(s)  apr_thread_mutex_unlock((s)->lock)
+#else
+#define NEAR_LOCK(s)
+#define NEAR_UNLOCK(s)
+#endif
+
+static void near_entry_free(near_shard_t *shard, near_entry_t *e)
+{
+    apr_hash_set(shard->entries, e->key, e->klen, NULL);
+    shard->slots[e->slot] = NULL;
+    free(e->data);
+    free(e->key);
+    free(e);
+}
+
+static apr_status_t near_cache_cleanup(void *data)
+{
+    apr_memcache_near_cache_t *nc = data;
+    apr_uint32_t i, j;
+
+    for (i = 0; i < NEAR_CACHE_SHARDS; i++) {
+        near_shard_t *shard = &nc->shards[i];
+
+        for (j = 0; j < nc->nslots; j++) {
+            if (shard->slots[j]) {
+                near_entry_free(shard, shard->slots[j]);
+            }
+        }
+    }
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t)
+apr_memcache_near_cache_create(apr_memcache_t *mc,
+                               apr_uint32_t max_items,
+                               apr_size_t max_size,
+                               apr_interval_time_t ttl)
+{
+    apr_memcache_near_cache_t *nc;
+    apr_status_t rv;
+    int i;
+
+    if (mc->near_cache || max_items == 0) {
+        return APR_EINVAL;
+    }
+
+    nc = apr_pcalloc(mc->p, sizeof(*nc));
+    nc->nslots = (max_items + NEAR_CACHE_SHARDS - 1) / NEAR_CACHE_SHARDS;
+    nc->max_size = max_size;
+    nc->ttl = ttl;
+
+    for (i = 0; i < NEAR_CACHE_SHARDS; i++) {
+        near_shard_t *shard = &nc->shards[i];
+
+#if APR_HAS_THREADS
+        rv = apr_thread_mutex_create(&shard->lock, APR_THREAD_MUTEX_DEFAULT,
+                                     mc->p);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        rv = apr_thread_cond_create(&shard->fetched, mc->p);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+#endif
+        shard->entries = apr_hash_make(mc->p);
+        shard->slots = apr_pcalloc(mc->p, nc->nslots * sizeof(near_entry_t *));
+    }
+
+    /* Registered after the locks', so run before they are gone */
+    apr_pool_cleanup_register(mc->p, nc, near_cache_cleanup,
+                              apr_pool_cleanup_null);
+
+    mc->near_cache = nc;
+    return APR_SUCCESS;
+}
+
+static near_shard_t *near_cache_shard(apr_memcache_near_cache_t *nc,
+                                      const char *key, apr_size_t klen)
+{
+    return &nc->shards[apr_memcache_hash_crc32(NULL, key, klen)
+                       % NEAR_CACHE_SHARDS];
+}
+
+/* Find a slot for a new entry, evicting the first unreferenced entry
+ * under the CLOCK hand, or return -1 if all the entries are busy.
+ */
+static int near_cache_slot(apr_memcache_near_cache_t *nc,
+                           near_shard_t *shard, apr_uint32_t *slot)
+{
+    apr_uint32_t n;
+
+    for (n = 0; n < 2 * nc->nslots; n++) {
+        near_entry_t *e = shard->slots[shard->hand];
+        apr_uint32_t i = shard->hand;
+
+        shard->hand = (shard->hand + 1) % nc->nslots;
+        if (e == NULL) {
+            *slot = i;
+            return 0;
+        }
+        if (e->state == NEAR_FETCHING || e->waiters) {
+            continue;
+        }
+        if (e->referenced) {
+            e->referenced = 0;
+            continue;
+        }
+        near_entry_free(shard, e);
+        *slot = i;
+        return 0;
+    }
+
+    return -1;
+}
+
+static void near_cache_copy(near_entry_t *e, apr_pool_t *p, char **baton,
+                            apr_size_t *new_length, apr_uint16_t *flags)
+{
+    *baton = apr_palloc(p, e->len + 1);
+    memcpy(*baton, e->data, e->len);
+    (*baton)[e->len] = '\0';
+    *new_length = e->len;
+    if (flags) {
+        *flags = e->flags;
+    }
+}
+
+static void near_cache_invalidate(apr_memcache_t *mc, const char *key)
+{
+    apr_memcache_near_cache_t *nc = mc->near_cache;
+    apr_size_t klen;
+    near_shard_t *shard;
+    near_entry_t *e;
+
+    if (nc == NULL) {
+        return;
+    }
+
+    klen = strlen(key);
+    shard = near_cache_shard(nc, key, klen);
+
+    NEAR_LOCK(shard);
+    e = apr_hash_get(shard->entries, key, klen);
+    if (e) {
+        if (e->state == NEAR_FETCHING || e->waiters) {
+            /* the fetching and waiting threads still need it */
+            e->invalidated = 1;
+        }
+        else {
+            near_entry_free(shard, e);
+        }
+    }
+    NEAR_UNLOCK(shard);
+}
+
+static apr_status_t near_cache_getp(apr_memcache_t *mc,
+                                    apr_pool_t *p,
+                                    const char *key,
+                                    char **baton,
+                                    apr_size_t *new_length,
+                                    apr_uint16_t *flags)
+{
+    apr_memcache_near_cache_t *nc = mc->near_cache;
+    apr_size_t klen = strlen(key);
+    near_shard_t *shard = near_cache_shard(nc, key, klen);
+    near_entry_t *e;
+    apr_uint32_t slot;
+    apr_uint16_t fflags = 0;
+    apr_status_t rv;
+
+    NEAR_LOCK(shard);
+
+    e = apr_hash_get(shard->entries, key, klen);
+    if (e && e->state == NEAR_READY && !e->invalidated
+          && e->status == APR_SUCCESS && apr_time_monotonic() < e->expires) {
+        e->referenced = 1;
+        near_cache_copy(e, p, baton, new_length, flags);
+        NEAR_UNLOCK(shard);
+        return APR_SUCCESS;
+    }
+
+#if APR_HAS_THREADS
+    if (e && e->state == NEAR_FETCHING) {
+        /* coalesce with the fetch in progress, and share its result */
+        e->waiters++;
+        do {
+            apr_thread_cond_wait(shard->fetched, shard->lock);
+        } while (e->state == NEAR_FETCHING);
+        e->waiters--;
+
+        rv = e->status;
+        if (rv == APR_SUCCESS) {
+            near_cache_copy(e, p, baton, new_length, flags);
+        }
+        if (!e->waiters && (rv != APR_SUCCESS || e->invalidated)) {
+            near_entry_free(shard, e);
+        }
+        NEAR_UNLOCK(shard);
+        return rv;
+    }
+#endif
+
+    /* claim the fetch, in a new entry or in the stale one */
+    if (e && e->waiters == 0) {
+        near_entry_free(shard, e);
+        e = NULL;
+    }
+    if (e || near_cache_slot(nc, shard, &slot) < 0) {
+        /* the stale entry is still read, or the cache is all busy */
+        NEAR_UNLOCK(shard);
+        return memcache_getp(mc, p, key, baton, new_length, flags);
+    }
+
+    e = calloc(1, sizeof(*e));
+    if (e) {
+        e->key = malloc(klen + 1);
+    }
+    if (!e || !e->key) {
+        free(e);
+        NEAR_UNLOCK(shard);
+        return APR_ENOMEM;
+    }
+    memcpy(e->key, key, klen + 1);
+    e->klen = klen;
+    e->slot = slot;
+    e->state = NEAR_FETCHING;
+    shard->slots[slot] = e;
+    apr_hash_set(shard->entries, e->key, klen, e);
+
+    NEAR_UNLOCK(shard);
+
+    rv = memcache_getp(mc, p, key, baton, new_length, &fflags);
+    if (rv == APR_SUCCESS && flags) {
+        *flags = fflags;
+    }
+
+    NEAR_LOCK(shard);
+
+    e->status = rv;
+    if (rv == APR_SUCCESS) {
+        if (*new_length > nc->max_size) {
+            /* too big to be kept, but not for the waiters */
+            e->invalidated = 1;
+        }
+        if (e->waiters || !e->invalidated) {
+            e->data = malloc(*new_length ? *new_length : 1);
+            if (e->data) {
+                memcpy(e->data, *baton, *new_length);
+                e->len = *new_length;
+                e->flags = fflags;
+            }
+            else {
+                e->status = APR_ENOMEM;
+            }
+        }
+    }
+    e->expires = apr_time_monotonic() + nc->ttl;
+    e->state = NEAR_READY;
+
+    if (e->waiters) {
+#if APR_HAS_THREADS
+        apr_thread_cond_broadcast(shard->fetched);
+#endif
+    }
+    else if (e->status != APR_SUCCESS || e->invalidated) {
+        near_entry_free(shard, e);
+    }
+
+    NEAR_UNLOCK(shard);
+    return rv;
+}
+
+APR_DECLARE(apr_status_t)
+apr_memcache_getp(apr_memcache_t *mc,
+                  apr_pool_t *p,
+                  const char *key,
+                  char **baton,
+                  apr_size_t *new_length,
+                  apr_uint16_t *flags_)
+{
+    if (mc->near_cache) {
+        return near_cache_getp(mc, p, key, baton, new_length, flags_);
+    }
+    return memcache_getp(mc, p, key, baton, new_length, flags_);
+}
+
 APR_DECLARE(apr_status_t)
 apr_memcache_delete(apr_memcache_t *mc,
                     const char *key,
@@ -896,6 +1790,8 @@ apr_memcache_delete(apr_memcache_t *mc,
     struct iovec vec[3];
     apr_size_t klen = strlen(key);
 
+    near_cache_invalidate(mc, key);
+
     hash = apr_memcache_hash(mc, key, klen);
     ms = apr_memcache_find_server_hash(mc, hash);
     if (ms == NULL)
@@ -965,6 +1861,8 @@ static apr_status_t num_cmd_write(apr_memcache_t *mc,
     struct iovec vec[3];
     apr_size_t klen = strlen(key);
 
+    near_cache_invalidate(mc, key);
+
     hash = apr_memcache_hash(mc, key, klen);
     ms = apr_memcache_find_server_hash(mc, hash);
     if (ms == NULL)
@@ -1158,6 +2056,127 @@ apr_memcache_add_multget_key(apr_pool_t *data_pool,
     apr_hash_set(*values, value->key, klen, value);
 }
 
+/* A reusable state of apr_memcache_multgetp(): the pollset and queries
+ * for all the servers, and the iovecs and keys for up to nkeys keys.
+ */
+typedef struct mget_state_t {
+    struct mget_state_t *next;
+    apr_pollset_t *pollset;
+    struct cache_server_query_t *queries;
+    apr_pollfd_t *pollfds;
+    struct iovec *vec;
+    apr_memcache_value_t **keys;
+    apr_uint16_t *key_query;
+    apr_uint32_t nkeys;
+} mget_state_t;
+
+/* The states not in use, allocated from their own pool since shared */
+struct apr_memcache_mget_cache_t {
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *lock;
+#endif
+    apr_pool_t *pool;
+    mget_state_t *free;
+};
+
+static apr_status_t mget_cache_cleanup(void *data)
+{
+    apr_memcache_mget_cache_t *cache = data;
+
+    apr_pool_destroy(cache->pool);
+    return APR_SUCCESS;
+}
+
+static apr_status_t mget_cache_create(apr_memcache_t *mc)
+{
+    apr_memcache_mget_cache_t *cache;
+    apr_status_t rv;
+
+    cache = apr_pcalloc(mc->p, sizeof(*cache));
+#if APR_HAS_THREADS
+    rv = apr_thread_mutex_create(&cache->lock, APR_THREAD_MUTEX_DEFAULT,
+                                 mc->p);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+#endif
+    rv = apr_pool_create_unmanaged_ex(&cache->pool, NULL, NULL);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    apr_pool_tag(cache->pool, "apr_memcache_multgetp");
+    apr_pool_cleanup_register(mc->p, cache, mget_cache_cleanup,
+                              apr_pool_cleanup_null);
+
+    mc->mget = cache;
+    return APR_SUCCESS;
+}
+
+/* Take a state with room for nkeys keys, the last used first */
+static apr_status_t mget_state_get(apr_memcache_t *mc, apr_uint32_t nkeys,
+                                   mget_state_t **state)
+{
+    apr_memcache_mget_cache_t *cache = mc->mget;
+    apr_uint32_t nservers = mc->nalloc ? mc->nalloc : 1;
+    apr_status_t rv = APR_SUCCESS;
+    mget_state_t *st;
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(cache->lock);
+#endif
+    st = cache->free;
+    if (st) {
+        cache->free = st->next;
+    }
+    else {
+        st = apr_pcalloc(cache->pool, sizeof(*st));
+        rv = apr_pollset_create(&st->pollset, nservers, cache->pool,
+                                APR_POLLSET_NOCOPY);
+        if (rv == APR_SUCCESS) {
+            st->queries = apr_palloc(cache->pool,
+                                     nservers * sizeof(*st->queries));
+            st->pollfds = apr_pcalloc(cache->pool,
+                                      nservers * sizeof(*st->pollfds));
+        }
+    }
+    if (rv == APR_SUCCESS && st->nkeys < nkeys) {
+        /* Grown by doubling, so that the pool is not used up */
+        while (st->nkeys < nkeys) {
+            st->nkeys = st->nkeys ? st->nkeys * 2 : 64;
+        }
+        st->vec = apr_palloc(cache->pool, (2 * st->nkeys + nservers)
+                                          * sizeof(struct iovec));
+        st->keys = apr_palloc(cache->pool,
+                              st->nkeys * sizeof(apr_memcache_value_t *));
+        st->key_query = apr_palloc(cache->pool,
+                                   st->nkeys * sizeof(apr_uint16_t));
+    }
+    if (rv != APR_SUCCESS) {
+        /* Dropped, the pool is cleaned up with the client only */
+        st = NULL;
+    }
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(cache->lock);
+#endif
+
+    *state = st;
+    return rv;
+}
+
+static void mget_state_put(apr_memcache_t *mc, mget_state_t *st)
+{
+    apr_memcache_mget_cache_t *cache = mc->mget;
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(cache->lock);
+#endif
+    st->next = cache->free;
+    cache->free = st;
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(cache->lock);
+#endif
+}
+
 static void mget_conn_result(int serverup,
                              int connup,
                              apr_status_t rv,
@@ -1165,13 +2184,12 @@ static void mget_conn_result(int serverup,
                              apr_memcache_server_t *ms,
                              apr_memcache_conn_t *conn,
                              struct cache_server_query_t *server_query,
-                             apr_hash_t *values,
-                             apr_hash_t *server_queries)
+                             apr_hash_t *values)
 {
     apr_int32_t j;
     apr_memcache_value_t* value;
 
-    apr_hash_set(server_queries, &ms, sizeof(ms), NULL);
+    server_query->conn = NULL;
 
     if (connup) {
         ms_release_conn(ms, conn);
@@ -1211,24 +2229,26 @@ apr_memcache_multgetp(apr_memcache_t *mc,
     apr_memcache_value_t* value;
     apr_hash_index_t* value_hash_index;
 
-    /* this is a little over aggresive, but beats multiple loops
-     * to figure out how long each vector needs to be per-server.
-     */
-    apr_int32_t veclen = 2 + 2 * apr_hash_count(values) - 1; /* get <key>[<space><key>...]\r\n */
     apr_int32_t i, j;
+    apr_int32_t nkeys, nqueries;
     apr_int32_t queries_sent;
     apr_int32_t queries_recvd;
 
-    apr_hash_t * server_queries = apr_hash_make(temp_pool);
+    mget_state_t *state;
     struct cache_server_query_t* server_query;
-    apr_hash_index_t * query_hash_index;
+    struct iovec *vec;
 
     apr_pollset_t* pollset;
     const apr_pollfd_t* activefds;
-    apr_pollfd_t* pollfds;
 
+    rv = mget_state_get(mc, apr_hash_count(values), &state);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    pollset = state->pollset;
 
-    /* build all the queries */
+    /* find the server (and a connection) of each key */
+    nkeys = nqueries = 0;
     value_hash_index = apr_hash_first(temp_pool, values);
     while (value_hash_index) {
         void *v;
@@ -1243,108 +2263,110 @@ apr_memcache_multgetp(apr_memcache_t *mc,
             continue;
         }
 
-        server_query = apr_hash_get(server_queries, &ms, sizeof(ms));
-
-        if (!server_query) {
-            rv = ms_find_conn(ms, &conn);
-
-            if (rv != APR_SUCCESS) {
-                apr_memcache_disable_server(mc, ms);
-                value->status = rv;
-                continue;
+        for (i = 0; i < nqueries; i++) {
+            if (state->queries[i].ms == ms) {
+                break;
             }
+        }
+        server_query = &state->queries[i];
 
-            server_query = apr_pcalloc(temp_pool,sizeof(struct cache_server_query_t));
-
-            apr_hash_set(server_queries, &ms, sizeof(ms), server_query);
-
+        if (i == nqueries) {
+            nqueries++;
             server_query->ms = ms;
-            server_query->conn = conn;
-            server_query->query_vec = apr_pcalloc(temp_pool, sizeof(struct iovec)*veclen);
+            server_query->query_vec_count = 0;
+            server_query->polled = 0;
+            server_query->rv = ms_find_conn(ms, &server_query->conn);
 
-            /* set up the first key */
-            server_query->query_vec[0].iov_base = MC_GET;
-            server_query->query_vec[0].iov_len  = MC_GET_LEN;
+            if (server_query->rv != APR_SUCCESS) {
+                apr_memcache_disable_server(mc, ms);
+                server_query->conn = NULL;
+            }
+        }
+        if (server_query->conn == NULL) {
+            value->status = server_query->rv;
+            continue;
+        }
 
-            server_query->query_vec[1].iov_base = (void*)(value->key);
-            server_query->query_vec[1].iov_len  = klen;
+        /* get <key>[<space><key>...]\r\n */
+        server_query->query_vec_count += 2;
+        state->keys[nkeys] = value;
+        state->key_query[nkeys] = (apr_uint16_t)i;
+        nkeys++;
+    }
 
-            server_query->query_vec[2].iov_base = MC_EOL;
-            server_query->query_vec[2].iov_len  = MC_EOL_LEN;
+    /* build all the queries, each in its own part of the iovecs */
+    vec = state->vec;
+    for (i = 0; i < nqueries; i++) {
+        server_query = &state->queries[i];
+        server_query->query_vec = vec;
+        if (server_query->conn) {
+            vec += server_query->query_vec_count + 1;
+        }
+        server_query->query_vec_count = 0;
+    }
+    for (i = 0; i < nkeys; i++) {
+        server_query = &state->queries[state->key_query[i]];
+        j = server_query->query_vec_count;
 
-            server_query->query_vec_count = 3;
+        if (j == 0) {
+            server_query->query_vec[j].iov_base = MC_GET;
+            server_query->query_vec[j].iov_len  = MC_GET_LEN;
         }
         else {
-            j = server_query->query_vec_count - 1;
-
             server_query->query_vec[j].iov_base = MC_WS;
             server_query->query_vec[j].iov_len  = MC_WS_LEN;
-            j++;
-
-            server_query->query_vec[j].iov_base = (void*)(value->key);
-            server_query->query_vec[j].iov_len  = klen;
-            j++;
-
-            server_query->query_vec[j].iov_base = MC_EOL;
-            server_query->query_vec[j].iov_len  = MC_EOL_LEN;
-            j++;
-
-           server_query->query_vec_count = j;
         }
-    }
+        j++;
 
-    /* create polling structures */
-    pollfds = apr_pcalloc(temp_pool, apr_hash_count(server_queries) * sizeof(apr_pollfd_t));
-
-    rv = apr_pollset_create(&pollset, apr_hash_count(server_queries), temp_pool,
-                            APR_POLLSET_NOCOPY);
-
-    if (rv != APR_SUCCESS) {
-        query_hash_index = apr_hash_first(temp_pool, server_queries);
-
-        while (query_hash_index) {
-            void *v;
-            apr_hash_this(query_hash_index, NULL, NULL, &v);
-            server_query = v;
-            query_hash_index = apr_hash_next(query_hash_index);
-
-            mget_conn_result(TRUE, TRUE, rv, mc, server_query->ms, server_query->conn,
-                             server_query, values, server_queries);
-        }
+        server_query->query_vec[j].iov_base = (void*)(state->keys[i]->key);
+        server_query->query_vec[j].iov_len  = strlen(state->keys[i]->key);
+        j++;
 
-        return rv;
+        server_query->query_vec_count = j;
     }
 
     /* send all the queries */
     queries_sent = 0;
-    query_hash_index = apr_hash_first(temp_pool, server_queries);
-
-    while (query_hash_index) {
-        void *v;
-        apr_hash_this(query_hash_index, NULL, NULL, &v);
-        server_query = v;
-        query_hash_index = apr_hash_next(query_hash_index);
-
+    for (i = 0; i < nqueries; i++) {
+        server_query = &state->queries[i];
         conn = server_query->conn;
         ms = server_query->ms;
 
-        for (i = 0, rv = APR_SUCCESS; i < veclen && rv == APR_SUCCESS; i += APR_MAX_IOVEC_SIZE) {
-            rv = apr_socket_sendv(conn->sock, &(server_query->query_vec[i]),
-                                  veclen-i>APR_MAX_IOVEC_SIZE ? APR_MAX_IOVEC_SIZE : veclen-i , &written);
+        if (conn == NULL) {
+            continue;
+        }
+
+        j = server_query->query_vec_count;
+        server_query->query_vec[j].iov_base = MC_EOL;
+        server_query->query_vec[j].iov_len  = MC_EOL_LEN;
+        server_query->query_vec_count = ++j;
+
+        for (j = 0, rv = APR_SUCCESS;
+             j < server_query->query_vec_count && rv == APR_SUCCESS;
+             j += APR_MAX_IOVEC_SIZE) {
+            apr_int32_t n = server_query->query_vec_count - j;
+
+            rv = apr_socket_sendv(conn->sock, &(server_query->query_vec[j]),
+                                  n > APR_MAX_IOVEC_SIZE ? APR_MAX_IOVEC_SIZE : n,
+                                  &written);
         }
 
         if (rv != APR_SUCCESS) {
             mget_conn_result(FALSE, FALSE, rv, mc, ms, conn,
-                             server_query, values, server_queries);
+                             server_query, values);
             continue;
         }
-
-        pollfds[queries_sent].desc_type = APR_POLL_SOCKET;
-        pollfds[queries_sent].reqevents = APR_POLLIN;
-        pollfds[queries_sent].p = temp_pool;
-        pollfds[queries_sent].desc.s = conn->sock;
-        pollfds[queries_sent].client_data = (void *)server_query;
-        apr_pollset_add (pollset, &pollfds[queries_sent]);
+        conn->sent = apr_time_monotonic();
+
+        state->pollfds[i].desc_type = APR_POLL_SOCKET;
+        state->pollfds[i].reqevents = APR_POLLIN;
+        state->pollfds[i].rtnevents = 0;
+        state->pollfds[i].p = temp_pool;
+        state->pollfds[i].desc.s = conn->sock;
+        state->pollfds[i].client_data = (void *)server_query;
+        if (apr_pollset_add(pollset, &state->pollfds[i]) == APR_SUCCESS) {
+            server_query->polled = 1;
+        }
 
         queries_sent++;
     }
@@ -1366,8 +2388,9 @@ apr_memcache_multgetp(apr_memcache_t *mc,
 
            if (rv != APR_SUCCESS) {
                apr_pollset_remove (pollset, &activefds[i]);
+               server_query->polled = 0;
                mget_conn_result(FALSE, FALSE, rv, mc, ms, conn,
-                                server_query, values, server_queries);
+                                server_query, values);
                queries_sent--;
                continue;
            }
@@ -1395,8 +2418,9 @@ apr_memcache_multgetp(apr_memcache_t *mc,
                }
                if (rv != APR_SUCCESS) {
                    apr_pollset_remove (pollset, &activefds[i]);
+                   server_query->polled = 0;
                    mget_conn_result(TRUE, FALSE, rv, mc, ms, conn,
-                                    server_query, values, server_queries);
+                                    server_query, values);
                    queries_sent--;
                    continue;
                }
@@ -1405,26 +2429,29 @@ apr_memcache_multgetp(apr_memcache_t *mc,
                if (value) {
                    apr_bucket_brigade *bbb;
 
-                   bbb = apr_brigade_split(conn->bb, e);
+                   bbb = apr_brigade_split_ex(conn->bb, e, conn->tb);
 
                    rv = apr_brigade_pflatten(conn->bb, &data, &len, data_pool);
                    if (rv != APR_SUCCESS) {
                        apr_pollset_remove (pollset, &activefds[i]);
+                       server_query->polled = 0;
                        mget_conn_result(TRUE, FALSE, rv, mc, ms, conn,
-                                        server_query, values, server_queries);
+                                        server_query, values);
                        queries_sent--;
                        continue;
                    }
 
-                   rv = apr_brigade_destroy(conn->bb);
+                   rv = apr_brigade_cleanup(conn->bb);
                    if (rv != APR_SUCCESS) {
                        apr_pollset_remove (pollset, &activefds[i]);
+                       server_query->polled = 0;
                        mget_conn_result(TRUE, FALSE, rv, mc, ms, conn,
-                                        server_query, values, server_queries);
+                                        server_query, values);
                        queries_sent--;
                        continue;
                    }
 
+                   conn->tb = conn->bb;
                    conn->bb = bbb;
 
                    value->len = len - 2;
@@ -1446,8 +2473,9 @@ apr_memcache_multgetp(apr_memcache_t *mc,
            else if (strncmp(MS_END, conn->buffer, MS_END_LEN) == 0) {
                /* this connection is done */
                apr_pollset_remove (pollset, &activefds[i]);
+               server_query->polled = 0;
                ms_release_conn(ms, conn);
-               apr_hash_set(server_queries, &ms, sizeof(ms), NULL);
+               server_query->conn = NULL;
                queries_sent--;
            }
            else {
@@ -1456,29 +2484,30 @@ apr_memcache_multgetp(apr_memcache_t *mc,
            }
            if (rv != APR_SUCCESS) {
                apr_pollset_remove (pollset, &activefds[i]);
+               server_query->polled = 0;
                mget_conn_result(TRUE, FALSE, rv, mc, ms, conn,
-                                server_query, values, server_queries);
+                                server_query, values);
                queries_sent--;
            }
         } /* /for */
     } /* /while */
 
-    query_hash_index = apr_hash_first(temp_pool, server_queries);
-    while (query_hash_index) {
-        void *v;
-        apr_hash_this(query_hash_index, NULL, NULL, &v);
-        server_query = v;
-        query_hash_index = apr_hash_next(query_hash_index);
+    for (i = 0; i < nqueries; i++) {
+        server_query = &state->queries[i];
 
-        conn = server_query->conn;
-        ms = server_query->ms;
-
-        mget_conn_result(TRUE, (rv == APR_SUCCESS), rv, mc, ms, conn,
-                         server_query, values, server_queries);
-        continue;
+        /* the pollset is reused, the sockets must not stay in */
+        if (server_query->polled) {
+            apr_pollset_remove(pollset, &state->pollfds[i]);
+            server_query->polled = 0;
+        }
+        if (server_query->conn) {
+            mget_conn_result(TRUE, (rv == APR_SUCCESS), rv, mc,
+                             server_query->ms, server_query->conn,
+                             server_query, values);
+        }
     }
 
-    apr_pollset_destroy(pollset);
+    mget_state_put(mc, state);
     apr_pool_clear(temp_pool);
     return APR_SUCCESS;
 
@@ -1486,6 +2515,407 @@ apr_memcache_multgetp(apr_memcache_t *mc,
 
 
 
+/*
+ * Meta commands
+ */
+
+#define MC_META_GET    "mg "
+#define MC_META_SET    "ms "
+#define MC_META_DELETE "md "
+
+#define MC_META_NOOP "mn" MC_EOL
+#define MC_META_NOOP_LEN (sizeof(MC_META_NOOP)-1)
+
+#define MS_META_VALUE "VA"
+#define MS_META_NOOP "MN"
+
+/** Server and commands of the meta items */
+struct meta_query_t {
+    apr_memcache_server_t *ms;
+    apr_memcache_conn_t *conn;
+    apr_array_header_t *vec;
+    apr_status_t rv;
+};
+
+static void meta_vec_push(struct meta_query_t *mq, const void *base,
+                          apr_size_t len)
+{
+    struct iovec *v = apr_array_push(mq->vec);
+
+    v->iov_base = (void *)base;
+    v->iov_len = len;
+}
+
+static apr_status_t meta_sendv(apr_socket_t *sock, struct iovec *vec, int n)
+{
+    apr_status_t rv;
+
+    while (n > 0) {
+        apr_size_t written = 0;
+
+        rv = apr_socket_sendv(sock, vec,
+                              n > APR_MAX_IOVEC_SIZE ? APR_MAX_IOVEC_SIZE : n,
+                              &written);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+
+        /* skip what was written, then resume within a partial iovec */
+        while (n > 0 && written >= vec->iov_len) {
+            written -= vec->iov_len;
+            vec++;
+            n--;
+        }
+        if (n > 0) {
+            vec->iov_base = (char *)vec->iov_base + written;
+            vec->iov_len -= written;
+        }
+    }
+
+    return APR_SUCCESS;
+}
+
+static apr_uint64_t meta_parse_u64(const char *str)
+{
+    apr_uint64_t n = 0;
+
+    while (apr_isdigit(*str)) {
+        n = n * 10 + (*str++ - '0');
+    }
+    return n;
+}
+
+/* Read a reply line of the meta commands and complete its item, setting
+ * *done on the final noop's.
+ */
+static apr_status_t meta_read_reply(apr_memcache_conn_t *conn,
+                                    apr_pool_t *data_pool,
+                                    apr_memcache_meta_t *items,
+                                    int nitems, int *done)
+{
+    apr_memcache_meta_t *item = NULL;
+    apr_status_t rv, status;
+    apr_size_t len = 0;
+    char *code, *tok, *last;
+    apr_uint16_t flags = 0;
+    apr_int32_t ttl = -1;
+    apr_uint64_t cas = 0;
+    apr_uint32_t state = 0;
+    int has_value;
+
+    rv = get_server_line(conn);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    code = apr_strtok(conn->buffer, " " MC_EOL, &last);
+    if (code == NULL) {
+        return APR_EGENERAL;
+    }
+    if (strcmp(code, MS_META_NOOP) == 0) {
+        *done = 1;
+        return APR_SUCCESS;
+    }
+
+    /* VA <size> <flags>*, or <code> <flags>* */
+    has_value = (strcmp(code, MS_META_VALUE) == 0);
+    if (has_value) {
+        tok = apr_strtok(NULL, " " MC_EOL, &last);
+        if (!tok || !apr_isdigit(*tok)) {
+            return APR_EGENERAL;
+        }
+        len = (apr_size_t)meta_parse_u64(tok);
+        status = APR_SUCCESS;
+    }
+    else if (strcmp(code, "HD") == 0) {
+        status = APR_SUCCESS;
+    }
+    else if (strcmp(code, "EN") == 0 || strcmp(code, "NF") == 0) {
+        status = APR_NOTFOUND;
+    }
+    else if (strcmp(code, "NS") == 0 || strcmp(code, "EX") == 0) {
+        status = APR_EEXIST;
+    }
+    else {
+        /* ERROR, CLIENT_ERROR or SERVER_ERROR */
+        return APR_EGENERAL;
+    }
+
+    while ((tok = apr_strtok(NULL, " " MC_EOL, &last)) != NULL) {
+        switch (tok[0]) {
+        case 'O': {
+            int i = atoi(tok + 1);
+
+            if (i >= 0 && i < nitems) {
+                item = &items[i];
+            }
+            break;
+        }
+        case 'f':
+            flags = (apr_uint16_t)atoi(tok + 1);
+            break;
+        case 't':
+            ttl = atoi(tok + 1);
+            break;
+        case 'c':
+            cas = meta_parse_u64(tok + 1);
+            break;
+        case 'W':
+            state |= APR_MC_META_WIN;
+            break;
+        case 'X':
+            state |= APR_MC_META_STALE;
+            break;
+        case 'Z':
+            state |= APR_MC_META_WON;
+            break;
+        }
+    }
+    if (item == NULL) {
+        /* a reply to an item we did not send */
+        return APR_EGENERAL;
+    }
+
+    item->status = status;
+    item->state = state;
+    if (has_value) {
+        apr_bucket_brigade *bbb;
+        apr_bucket *e;
+
+        /* eat the trailing \r\n */
+        rv = apr_brigade_partition(conn->bb, len + 2, &e);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+
+        bbb = apr_brigade_split_ex(conn->bb, e, conn->tb);
+
+        len += 2;
+        rv = apr_brigade_pflatten(conn->bb, &item->data, &len, data_pool);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+
+        rv = apr_brigade_cleanup(conn->bb);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+
+        conn->tb = conn->bb;
+        conn->bb = bbb;
+
+        item->len = len - 2;
+        item->data[item->len] = '\0';
+        item->flags = flags;
+        item->ttl = ttl;
+        item->cas = cas;
+    }
+
+    return APR_SUCCESS;
+}
+
+#define META_GET    0
+#define META_SET    1
+#define META_DELETE 2
+
+static apr_status_t meta_cmd(apr_memcache_t *mc,
+                             apr_pool_t *temp_pool,
+                             apr_pool_t *data_pool,
+                             apr_memcache_meta_t *items,
+                             int nitems,
+                             int cmd,
+                             int invalidate)
+{
+    apr_hash_t *server_queries = apr_hash_make(temp_pool);
+    apr_array_header_t *queries;
+    struct meta_query_t **item_queries, *mq;
+    apr_status_t rv, status = APR_SUCCESS;
+    int i, done;
+
+    queries = apr_array_make(temp_pool, mc->ntotal ? mc->ntotal : 1,
+                             sizeof(struct meta_query_t *));
+    item_queries = apr_pcalloc(temp_pool, nitems * sizeof(*item_queries));
+
+    /* build all the commands, in quiet mode, with the item's index as
+     * opaque token
+     */
+    for (i = 0; i < nitems; i++) {
+        apr_memcache_meta_t *item = &items[i];
+        apr_size_t klen = strlen(item->key);
+        apr_memcache_server_t *ms;
+        char *args;
+
+        item->status = (cmd == META_GET) ? APR_NOTFOUND : APR_SUCCESS;
+        item->state = 0;
+        if (cmd != META_GET) {
+            near_cache_invalidate(mc, item->key);
+        }
+
+        ms = apr_memcache_find_server_hash(mc,
+                                           apr_memcache_hash(mc, item->key,
+                                                             klen));
+        if (ms == NULL) {
+            item->status = APR_NOTFOUND;
+            continue;
+        }
+
+        mq = apr_hash_get(server_queries, &ms, sizeof(ms));
+        if (!mq) {
+            mq = apr_pcalloc(temp_pool, sizeof(*mq));
+            mq->ms = ms;
+            mq->vec = apr_array_make(temp_pool, 16, sizeof(struct iovec));
+            mq->rv = ms_find_conn(ms, &mq->conn);
+            if (mq->rv != APR_SUCCESS) {
+                apr_memcache_disable_server(mc, ms);
+            }
+            apr_hash_set(server_queries, &mq->ms, sizeof(ms), mq);
+            APR_ARRAY_PUSH(queries, struct meta_query_t *) = mq;
+        }
+        item_queries[i] = mq;
+        if (mq->rv != APR_SUCCESS) {
+            continue;
+        }
+
+        switch (cmd) {
+        case META_GET:
+            /* mg <key> v f t c q O<opaque>[ N<vivify>][ R<recache>]\r\n */
+            meta_vec_push(mq, MC_META_GET, sizeof(MC_META_GET) - 1);
+            meta_vec_push(mq, item->key, klen);
+            args = apr_psprintf(temp_pool, " v f t c q O%d", i);
+            if (item->vivify) {
+                args = apr_psprintf(temp_pool, "%s N%u", args, item->vivify);
+            }
+            if (item->recache) {
+                args = apr_psprintf(temp_pool, "%s R%u", args,
+                                    item->recache);
+            }
+            meta_vec_push(mq, args, strlen(args));
+            meta_vec_push(mq, MC_EOL, MC_EOL_LEN);
+            break;
+
+        case META_SET:
+            /* ms <key> <size> T<ttl> F<flags> q O<opaque>[ C<cas>[ I]]\r\n
+             * <data>\r\n
+             */
+            meta_vec_push(mq, MC_META_SET, sizeof(MC_META_SET) - 1);
+            meta_vec_push(mq, item->key, klen);
+            args = apr_psprintf(temp_pool,
+                                " %" APR_SIZE_T_FMT " T%d F%u q O%d",
+                                item->len, item->ttl, item->flags, i);
+            if (item->cas) {
+                args = apr_psprintf(temp_pool, "%s C%" APR_UINT64_T_FMT "%s",
+                                    args, item->cas, invalidate ? " I" : "");
+            }
+            meta_vec_push(mq, args, strlen(args));
+            meta_vec_push(mq, MC_EOL, MC_EOL_LEN);
+            meta_vec_push(mq, item->data, item->len);
+            meta_vec_push(mq, MC_EOL, MC_EOL_LEN);
+            break;
+
+        default:
+            /* md <key> q O<opaque>[ C<cas>][ I T<ttl>]\r\n */
+            meta_vec_push(mq, MC_META_DELETE, sizeof(MC_META_DELETE) - 1);
+            meta_vec_push(mq, item->key, klen);
+            args = apr_psprintf(temp_pool, " q O%d", i);
+            if (item->cas) {
+                args = apr_psprintf(temp_pool, "%s C%" APR_UINT64_T_FMT,
+                                    args, item->cas);
+            }
+            if (invalidate) {
+                args = apr_psprintf(temp_pool, "%s I T%d", args, item->ttl);
+            }
+            meta_vec_push(mq, args, strlen(args));
+            meta_vec_push(mq, MC_EOL, MC_EOL_LEN);
+            break;
+        }
+    }
+
+    /* send all the commands, terminated by a noop whose reply tells that
+     * all the (quiet) replies were received
+     */
+    for (i = 0; i < queries->nelts; i++) {
+        mq = APR_ARRAY_IDX(queries, i, struct meta_query_t *);
+        if (mq->rv != APR_SUCCESS) {
+            continue;
+        }
+
+        meta_vec_push(mq, MC_META_NOOP, MC_META_NOOP_LEN);
+        mq->rv = meta_sendv(mq->conn->sock, (struct iovec *)mq->vec->elts,
+                            mq->vec->nelts);
+        if (mq->rv != APR_SUCCESS) {
+            ms_bad_conn(mq->ms, mq->conn);
+            apr_memcache_disable_server(mc, mq->ms);
+        }
+    }
+
+    for (i = 0; i < queries->nelts; i++) {
+        mq = APR_ARRAY_IDX(queries, i, struct meta_query_t *);
+        if (mq->rv != APR_SUCCESS) {
+            continue;
+        }
+
+        done = 0;
+        do {
+            rv = meta_read_reply(mq->conn, data_pool, items, nitems, &done);
+        } while (rv == APR_SUCCESS && !done);
+
+        if (rv != APR_SUCCESS) {
+            mq->rv = rv;
+            ms_bad_conn(mq->ms, mq->conn);
+            apr_memcache_disable_server(mc, mq->ms);
+        }
+        else {
+            ms_release_conn(mq->ms, mq->conn);
+        }
+    }
+
+    /* the items of the failed servers fail with them */
+    for (i = 0; i < nitems; i++) {
+        mq = item_queries[i];
+        if (mq && mq->rv != APR_SUCCESS) {
+            items[i].status = mq->rv;
+            if (status == APR_SUCCESS) {
+                status = mq->rv;
+            }
+        }
+    }
+
+    return status;
+}
+
+APR_DECLARE(apr_status_t)
+apr_memcache_meta_get(apr_memcache_t *mc,
+                      apr_pool_t *temp_pool,
+                      apr_pool_t *data_pool,
+                      apr_memcache_meta_t *items,
+                      int nitems)
+{
+    return meta_cmd(mc, temp_pool, data_pool, items, nitems, META_GET, 0);
+}
+
+APR_DECLARE(apr_status_t)
+apr_memcache_meta_set(apr_memcache_t *mc,
+                      apr_pool_t *temp_pool,
+                      apr_memcache_meta_t *items,
+                      int nitems,
+                      int invalidate)
+{
+    return meta_cmd(mc, temp_pool, NULL, items, nitems, META_SET,
+                    invalidate);
+}
+
+APR_DECLARE(apr_status_t)
+apr_memcache_meta_delete(apr_memcache_t *mc,
+                         apr_pool_t *temp_pool,
+                         apr_memcache_meta_t *items,
+                         int nitems,
+                         int invalidate)
+{
+    return meta_cmd(mc, temp_pool, NULL, items, nitems, META_DELETE,
+                    invalidate);
+}
+
+
 /**
  * Define all of the strings for stats
  */
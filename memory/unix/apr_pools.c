@@ -25,12 +25,15 @@
 #include "apr_allocator.h"
 #include "apr_lib.h"
 #include "apr_thread_mutex.h"
+#include "apr_thread_proc.h" /* for apr_thread_yield and APR_THREAD_LOCAL */
 #include "apr_hash.h"
 #include "apr_time.h"
 #include "apr_support.h"
 #define APR_WANT_MEMFUNC
 #include "apr_want.h"
 #include "apr_env.h"
+#include "apr_metrics.h"
+#include "apr_probes.h"
 
 #if APR_HAVE_STDLIB_H
 #include <stdlib.h>     /* for malloc, free and abort */
@@ -44,10 +47,45 @@
 #define APR_ALLOCATOR_USES_MMAP   1
 #endif
 
-#if APR_ALLOCATOR_USES_MMAP
+#if APR_ALLOCATOR_USES_MMAP || HAVE_SYS_MMAN_H
 #include <sys/mman.h>
 #endif
 
+/*
+ * Allocators created with huge-pages or NUMA attributes carve their nodes
+ * out of large mmap()ed slabs.
+ */
+#if HAVE_SYS_MMAN_H && HAVE_MMAP && defined(MAP_ANON) \
+    && !APR_ALLOCATOR_GUARD_PAGES
+#define ALLOCATOR_SLABS 1
+#if HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+#if defined(SYS_mbind) && defined(SYS_getcpu)
+#define ALLOCATOR_NUMA 1
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+#else
+#define ALLOCATOR_NUMA 0
+#endif
+#else
+#define ALLOCATOR_SLABS 0
+#define ALLOCATOR_NUMA 0
+#endif
+
+/*
+ * The per-thread allocator caches need thread-specific data with a
+ * destructor (to give the cached nodes back when a thread exits), and
+ * a way to drop the key when the allocator is destroyed.
+ */
+#if APR_HAS_THREADS && APR_HAVE_PTHREAD_H && defined(HAVE_PTHREAD_KEY_DELETE)
+#include <pthread.h>
+#define ALLOCATOR_TCACHE 1
+#else
+#define ALLOCATOR_TCACHE 0
+#endif
+
 #if HAVE_VALGRIND
 #define REDZONE APR_ALIGN_DEFAULT(8)
 int apr_running_on_valgrind = 0;
@@ -105,6 +143,63 @@ static unsigned int boundary_size;
 #define TIMEOUT_USECS    3000000
 #define TIMEOUT_INTERVAL   46875
 
+/*
+ * Only nodes of index below TCACHE_MAX_INDEX are kept in the per-thread
+ * caches, bigger ones always go to the allocator.
+ */
+#define TCACHE_MAX_INDEX 8
+
+#if ALLOCATOR_SLABS
+/*
+ * Size of the slabs (a huge page on most systems), nodes bigger than
+ * SLAB_MAX_NODE are mmap()ed on their own.
+ */
+#define SLAB_SIZE     (2 * 1024 * 1024)
+#define SLAB_MAX_NODE (SLAB_SIZE / 4)
+
+typedef struct allocator_slab_t allocator_slab_t;
+
+struct allocator_slab_t {
+    allocator_slab_t *next;
+    char             *base;
+};
+#endif /* ALLOCATOR_SLABS */
+
+#if ALLOCATOR_TCACHE
+typedef struct allocator_tcache_t allocator_tcache_t;
+
+/*
+ * Per-thread cache of free nodes, only ever accessed by its thread (except
+ * when the allocator is destroyed). The links are protected by the
+ * allocator's mutex.
+ */
+struct allocator_tcache_t {
+    apr_allocator_t     *allocator;
+    allocator_tcache_t  *next;
+    allocator_tcache_t **ref;
+    apr_uint64_t         hits;
+    apr_uint64_t         misses;
+    apr_size_t           count[TCACHE_MAX_INDEX];
+    apr_memnode_t       *free[TCACHE_MAX_INDEX];
+};
+
+#if APR_HAS_THREAD_LOCAL
+/*
+ * The cache of the last allocator used by the calling thread, so that
+ * looking it up is a TLS load instead of a pthread_getspecific() until
+ * another allocator is used. The allocators are told apart by their
+ * tcache_id, an allocator destroyed and another one created at the same
+ * address won't match.
+ */
+static APR_THREAD_LOCAL struct {
+    apr_uint64_t        id;
+    allocator_tcache_t *tcache;
+} tcache_last;
+#endif
+
+static volatile apr_uint64_t tcache_ids = 0;
+#endif /* ALLOCATOR_TCACHE */
+
 /*
  * Allocator
  *
@@ -142,6 +237,35 @@ struct apr_allocator_t {
      * slot 20: nodes larger than 81920
      */
     apr_memnode_t      *free[MAX_INDEX + 1];
+#if ALLOCATOR_TCACHE
+    /** Maximum number of nodes per index kept by each thread's cache,
+     * zero when the caches are disabled.
+     * @see apr_allocator_thread_cache_set().
+     */
+    apr_size_t          tcache_max;
+    /** Whether tcache_key is valid */
+    int                 tcache_key_set;
+    pthread_key_t       tcache_key;
+    /** Never reused identifier of the key, @see tcache_last */
+    apr_uint64_t        tcache_id;
+    /** The caches of all the threads using this allocator */
+    allocator_tcache_t *tcaches;
+    /** Counters of the caches whose thread has exited */
+    apr_uint64_t        tcache_hits;
+    apr_uint64_t        tcache_misses;
+#endif /* ALLOCATOR_TCACHE */
+#if ALLOCATOR_SLABS
+    /** APR_ALLOCATOR_HUGE_PAGES and/or APR_ALLOCATOR_NUMA_BIND,
+     * @see apr_allocator_create_ex().
+     */
+    apr_uint32_t        flags;
+    /** The NUMA node to bind the memory to, if APR_ALLOCATOR_NUMA_BIND */
+    int                 numa_node;
+    /** The slabs nodes are carved out of, the current one first */
+    allocator_slab_t   *slabs;
+    char               *slab_pos;
+    char               *slab_end;
+#endif /* ALLOCATOR_SLABS */
 };
 
 #define SIZEOF_ALLOCATOR_T  APR_ALIGN_DEFAULT(sizeof(apr_allocator_t))
@@ -169,6 +293,154 @@ void allocator_unlock(apr_allocator_t *allocator)
 #endif /* APR_HAS_THREADS */
 }
 
+#if ALLOCATOR_SLABS
+/* Whether the node of the given index would be carved out of a slab */
+#define node_in_slab(allocator, index) \
+    ((allocator)->flags && ((apr_size_t)(index) + 1) << BOUNDARY_INDEX \
+                                             <= SLAB_MAX_NODE)
+
+/* mmap() some memory according to the allocator's attributes */
+static void *slab_mmap(apr_allocator_t *allocator, apr_size_t size)
+{
+    char *mem = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    if ((allocator->flags & APR_ALLOCATOR_HUGE_PAGES)
+        && size % SLAB_SIZE == 0) {
+        mem = mmap(NULL, size, PROT_READ|PROT_WRITE,
+                   MAP_PRIVATE|MAP_ANON|MAP_HUGETLB, -1, 0);
+    }
+#endif
+    if (mem == MAP_FAILED) {
+        if ((allocator->flags & APR_ALLOCATOR_HUGE_PAGES)
+            && size % SLAB_SIZE == 0) {
+            char *base, *aligned;
+
+            /* No reserved huge pages, so map twice the size to trim it
+             * to a huge page boundary and let transparent huge pages
+             * (if any) kick in.
+             */
+            base = mmap(NULL, size + SLAB_SIZE, PROT_READ|PROT_WRITE,
+                        MAP_PRIVATE|MAP_ANON, -1, 0);
+            if (base == MAP_FAILED) {
+                return NULL;
+            }
+            aligned = (char *)APR_ALIGN((apr_uintptr_t)base, SLAB_SIZE);
+            if (aligned != base) {
+                munmap(base, aligned - base);
+            }
+            munmap(aligned + size, SLAB_SIZE - (aligned - base));
+            mem = aligned;
+#if HAVE_MADVISE && defined(MADV_HUGEPAGE)
+            madvise(mem, size, MADV_HUGEPAGE);
+#endif
+        }
+        else {
+            mem = mmap(NULL, size, PROT_READ|PROT_WRITE,
+                       MAP_PRIVATE|MAP_ANON, -1, 0);
+            if (mem == MAP_FAILED) {
+                return NULL;
+            }
+        }
+    }
+
+#if ALLOCATOR_NUMA
+    /* Bind before the memory is touched, so the pages get faulted in
+     * on the requested node.
+     */
+    if (allocator->flags & APR_ALLOCATOR_NUMA_BIND) {
+        unsigned long nodemask[4] = { 0 };
+        unsigned long bits = 8 * sizeof(nodemask[0]);
+
+        nodemask[allocator->numa_node / bits] |=
+            1UL << (allocator->numa_node % bits);
+        if (syscall(SYS_mbind, mem, size, MPOL_BIND, nodemask,
+                    8 * sizeof(nodemask), 0) != 0) {
+            munmap(mem, size);
+            return NULL;
+        }
+    }
+#endif
+
+    return mem;
+}
+
+/* Get a node from the current slab, or from a new one. Called with the
+ * allocator locked.
+ */
+static apr_memnode_t *slab_alloc(apr_allocator_t *allocator, apr_size_t size)
+{
+    apr_memnode_t *node;
+    allocator_slab_t *slab;
+    char *base;
+
+    if (size > (apr_size_t)(allocator->slab_end - allocator->slab_pos)) {
+        if ((slab = malloc(sizeof(*slab))) == NULL) {
+            return NULL;
+        }
+        if ((base = slab_mmap(allocator, SLAB_SIZE)) == NULL) {
+            free(slab);
+            return NULL;
+        }
+
+        /* What's left of the current slab becomes a free node */
+        if (allocator->slab_pos != allocator->slab_end) {
+            apr_size_t index;
+
+            node = (apr_memnode_t *)allocator->slab_pos;
+            node->endp = allocator->slab_end;
+            index = ((node->endp - (char *)node) >> BOUNDARY_INDEX) - 1;
+            node->index = (apr_uint32_t)index;
+            if (index < MAX_INDEX) {
+                node->next = allocator->free[index];
+                allocator->free[index] = node;
+                if (index > allocator->max_index) {
+                    allocator->max_index = index;
+                }
+            }
+            else {
+                node->next = allocator->free[MAX_INDEX];
+                allocator->free[MAX_INDEX] = node;
+            }
+        }
+
+        slab->base = base;
+        slab->next = allocator->slabs;
+        allocator->slabs = slab;
+        allocator->slab_pos = base;
+        allocator->slab_end = base + SLAB_SIZE;
+    }
+
+    node = (apr_memnode_t *)allocator->slab_pos;
+    allocator->slab_pos += size;
+
+    return node;
+}
+#endif /* ALLOCATOR_SLABS */
+
+/* Give the node back to the system */
+static APR_INLINE
+void memnode_release(apr_allocator_t *allocator, apr_memnode_t *node)
+{
+#if ALLOCATOR_SLABS
+    if (allocator->flags) {
+        /* Nodes carved out of a slab go with the slab */
+        if (!node_in_slab(allocator, node->index)) {
+            munmap(node, (node->index+1) << BOUNDARY_INDEX);
+        }
+        return;
+    }
+#else
+    (void)allocator;
+#endif
+#if APR_ALLOCATOR_USES_MMAP
+    munmap((char *)node - GUARDPAGE_SIZE,
+           2 * GUARDPAGE_SIZE + ((node->index+1) << BOUNDARY_INDEX));
+#else
+    free(node);
+#endif
+}
+
 APR_DECLARE(apr_status_t) apr_allocator_create(apr_allocator_t **allocator)
 {
     apr_allocator_t *new_allocator;
@@ -186,24 +458,114 @@ APR_DECLARE(apr_status_t) apr_allocator_create(apr_allocator_t **allocator)
     return APR_SUCCESS;
 }
 
+APR_DECLARE(apr_status_t) apr_allocator_create_ex(apr_allocator_t **allocator,
+                                                  apr_uint32_t flags,
+                                                  int numa_node)
+{
+    apr_status_t rv;
+
+    *allocator = NULL;
+
+    if (flags & ~(APR_ALLOCATOR_HUGE_PAGES | APR_ALLOCATOR_NUMA_BIND)) {
+        return APR_EINVAL;
+    }
+#if ALLOCATOR_SLABS
+#if ALLOCATOR_NUMA
+    if (flags & APR_ALLOCATOR_NUMA_BIND) {
+        unsigned int cpu, node;
+
+        if (numa_node == APR_ALLOCATOR_NUMA_CURRENT) {
+            if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0) {
+                return errno;
+            }
+            numa_node = (int)node;
+        }
+        if (numa_node < 0 || numa_node >= 4 * 8 * (int)sizeof(long)) {
+            return APR_EINVAL;
+        }
+    }
+#else
+    if (flags & APR_ALLOCATOR_NUMA_BIND) {
+        return APR_ENOTIMPL;
+    }
+#endif /* ALLOCATOR_NUMA */
+
+    if ((rv = apr_allocator_create(allocator)) != APR_SUCCESS) {
+        return rv;
+    }
+    (*allocator)->flags = flags;
+    (*allocator)->numa_node = numa_node;
+
+#if ALLOCATOR_NUMA
+    /* Fail early if the node can't be bound to */
+    if (flags & APR_ALLOCATOR_NUMA_BIND) {
+        void *mem = slab_mmap(*allocator, BOUNDARY_SIZE);
+
+        if (mem == NULL) {
+            rv = errno ? errno : APR_ENOMEM;
+            apr_allocator_destroy(*allocator);
+            *allocator = NULL;
+            return rv;
+        }
+        munmap(mem, BOUNDARY_SIZE);
+    }
+#endif /* ALLOCATOR_NUMA */
+
+    return APR_SUCCESS;
+#else
+    if (flags) {
+        return APR_ENOTIMPL;
+    }
+    (void)numa_node;
+    rv = apr_allocator_create(allocator);
+    return rv;
+#endif /* ALLOCATOR_SLABS */
+}
+
 APR_DECLARE(void) apr_allocator_destroy(apr_allocator_t *allocator)
 {
     apr_size_t index;
     apr_memnode_t *node, **ref;
 
+#if ALLOCATOR_TCACHE
+    if (allocator->tcache_key_set) {
+        allocator_tcache_t *tcache;
+
+        /* No thread can use the allocator anymore, so we can take
+         * the nodes back from all the caches.
+         */
+        pthread_key_delete(allocator->tcache_key);
+        while ((tcache = allocator->tcaches) != NULL) {
+            allocator->tcaches = tcache->next;
+            for (index = 0; index < TCACHE_MAX_INDEX; index++) {
+                while ((node = tcache->free[index]) != NULL) {
+                    tcache->free[index] = node->next;
+                    memnode_release(allocator, node);
+                }
+            }
+            free(tcache);
+        }
+    }
+#endif /* ALLOCATOR_TCACHE */
+
     for (index = 0; index <= MAX_INDEX; index++) {
         ref = &allocator->free[index];
         while ((node = *ref) != NULL) {
             *ref = node->next;
-#if APR_ALLOCATOR_USES_MMAP
-            munmap((char *)node - GUARDPAGE_SIZE,
-                   2 * GUARDPAGE_SIZE + ((node->index+1) << BOUNDARY_INDEX));
-#else
-            free(node);
-#endif
+            memnode_release(allocator, node);
         }
     }
 
+#if ALLOCATOR_SLABS
+    while (allocator->slabs) {
+        allocator_slab_t *slab = allocator->slabs;
+
+        allocator->slabs = slab->next;
+        munmap(slab->base, SLAB_SIZE);
+        free(slab);
+    }
+#endif /* ALLOCATOR_SLABS */
+
     free(allocator);
 }
 
@@ -276,6 +638,161 @@ APR_DECLARE(apr_size_t) apr_allocator_align(apr_allocator_t *allocator,
     return allocator_align(size);
 }
 
+#if ALLOCATOR_TCACHE
+/*
+ * Per-thread caches
+ */
+
+static APR_INLINE
+void allocator_free_nodes(apr_allocator_t *allocator, apr_memnode_t *node);
+
+/* Keep the first (most recently freed) 'keep' nodes of the cache at
+ * 'index', and prepend the other ones to 'list'.
+ */
+static APR_INLINE
+apr_memnode_t *tcache_trim(allocator_tcache_t *tcache, apr_size_t index,
+                           apr_size_t keep, apr_memnode_t *list)
+{
+    apr_memnode_t *first, *node, **ref;
+    apr_size_t n;
+
+    ref = &tcache->free[index];
+    for (n = 0; n < keep && *ref != NULL; n++) {
+        ref = &(*ref)->next;
+    }
+    if ((first = *ref) != NULL) {
+        *ref = NULL;
+        tcache->count[index] = n;
+
+        node = first;
+        while (node->next != NULL) {
+            node = node->next;
+        }
+        node->next = list;
+        list = first;
+    }
+
+    return list;
+}
+
+static void tcache_destructor(void *data)
+{
+    allocator_tcache_t *tcache = data;
+    apr_allocator_t *allocator = tcache->allocator;
+    apr_memnode_t *list = NULL;
+    apr_size_t index;
+
+    for (index = 0; index < TCACHE_MAX_INDEX; index++) {
+        list = tcache_trim(tcache, index, 0, list);
+    }
+
+#if APR_HAS_THREAD_LOCAL
+    /* The other destructors may still use the allocator */
+    if (tcache_last.tcache == tcache) {
+        tcache_last.id = 0;
+        tcache_last.tcache = NULL;
+    }
+#endif
+
+    allocator_lock(allocator);
+
+    if ((*tcache->ref = tcache->next) != NULL)
+        tcache->next->ref = tcache->ref;
+    allocator->tcache_hits += tcache->hits;
+    allocator->tcache_misses += tcache->misses;
+
+    allocator_unlock(allocator);
+
+    if (list) {
+        allocator_free_nodes(allocator, list);
+    }
+    free(tcache);
+}
+
+/* Get (or create) the cache of the calling thread */
+static APR_INLINE
+allocator_tcache_t *tcache_get(apr_allocator_t *allocator)
+{
+    allocator_tcache_t *tcache;
+
+#if APR_HAS_THREAD_LOCAL
+    if (tcache_last.id == allocator->tcache_id) {
+        return tcache_last.tcache;
+    }
+#endif
+
+    tcache = pthread_getspecific(allocator->tcache_key);
+    if (tcache == NULL) {
+        if ((tcache = calloc(1, sizeof(*tcache))) == NULL) {
+            return NULL;
+        }
+        if (pthread_setspecific(allocator->tcache_key, tcache)) {
+            free(tcache);
+            return NULL;
+        }
+        tcache->allocator = allocator;
+
+        allocator_lock(allocator);
+
+        if ((tcache->next = allocator->tcaches) != NULL)
+            tcache->next->ref = &tcache->next;
+        allocator->tcaches = tcache;
+        tcache->ref = &allocator->tcaches;
+
+        allocator_unlock(allocator);
+    }
+
+#if APR_HAS_THREAD_LOCAL
+    tcache_last.id = allocator->tcache_id;
+    tcache_last.tcache = tcache;
+#endif
+
+    return tcache;
+}
+
+/* Put the submitted nodes in the calling thread's cache, and return
+ * the ones which should go to the allocator.
+ */
+static APR_INLINE
+apr_memnode_t *tcache_free(apr_allocator_t *allocator, apr_memnode_t *node)
+{
+    allocator_tcache_t *tcache;
+    apr_memnode_t *next, *list = NULL;
+    apr_size_t index, max = allocator->tcache_max;
+
+    if ((tcache = tcache_get(allocator)) == NULL) {
+        return node;
+    }
+
+    do {
+        next = node->next;
+        index = node->index;
+
+        if (index >= TCACHE_MAX_INDEX) {
+            node->next = list;
+            list = node;
+            continue;
+        }
+
+        /* When the cache is full, hand half of it back at once so that
+         * the allocator is not locked for each free.
+         */
+        if (tcache->count[index] >= max) {
+            list = tcache_trim(tcache, index, max / 2, list);
+        }
+
+        APR_VALGRIND_NOACCESS((char *)node + APR_MEMNODE_T_SIZE,
+                              (node->index+1) << BOUNDARY_INDEX);
+
+        node->next = tcache->free[index];
+        tcache->free[index] = node;
+        tcache->count[index]++;
+    } while ((node = next) != NULL);
+
+    return list;
+}
+#endif /* ALLOCATOR_TCACHE */
+
 static APR_INLINE
 apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
 {
@@ -300,6 +817,24 @@ apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
         return NULL;
     }
 
+#if ALLOCATOR_TCACHE
+    /* Try the calling thread's cache first, without locking */
+    if (allocator->tcache_max && index < TCACHE_MAX_INDEX) {
+        allocator_tcache_t *tcache = tcache_get(allocator);
+
+        if (tcache) {
+            if ((node = tcache->free[index]) != NULL) {
+                tcache->free[index] = node->next;
+                tcache->count[index]--;
+                tcache->hits++;
+
+                goto have_node;
+            }
+            tcache->misses++;
+        }
+    }
+#endif /* ALLOCATOR_TCACHE */
+
     /* First see if there are any nodes in the area we know
      * our node will fit into.
      */
@@ -389,6 +924,22 @@ apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
     /* If we haven't got a suitable node, malloc a new one
      * and initialize it.
      */
+#if ALLOCATOR_SLABS
+    if (allocator->flags) {
+        if (node_in_slab(allocator, index)) {
+            allocator_lock(allocator);
+            node = slab_alloc(allocator, size);
+            allocator_unlock(allocator);
+        }
+        else {
+            node = slab_mmap(allocator, size);
+        }
+        if (node == NULL) {
+            return NULL;
+        }
+    }
+    else
+#endif /* ALLOCATOR_SLABS */
 #if APR_ALLOCATOR_GUARD_PAGES
     if ((node = mmap(NULL, size + 2 * GUARDPAGE_SIZE, PROT_NONE,
                      MAP_PRIVATE|MAP_ANON, -1, 0)) == MAP_FAILED)
@@ -416,11 +967,13 @@ have_node:
 
     APR_VALGRIND_UNDEFINED(node->first_avail, size - APR_MEMNODE_T_SIZE);
 
+    APR_PROBE3(allocator__alloc, allocator, node, size);
+
     return node;
 }
 
 static APR_INLINE
-void allocator_free(apr_allocator_t *allocator, apr_memnode_t *node)
+void allocator_free_nodes(apr_allocator_t *allocator, apr_memnode_t *node)
 {
     apr_memnode_t *next, *freelist = NULL;
     apr_size_t index, max_index;
@@ -443,7 +996,11 @@ void allocator_free(apr_allocator_t *allocator, apr_memnode_t *node)
                               (node->index+1) << BOUNDARY_INDEX);
 
         if (max_free_index != APR_ALLOCATOR_MAX_FREE_UNLIMITED
-            && index + 1 > current_free_index) {
+            && index + 1 > current_free_index
+#if ALLOCATOR_SLABS
+            && !node_in_slab(allocator, index)
+#endif
+            ) {
             node->next = freelist;
             freelist = node;
         }
@@ -482,13 +1039,24 @@ void allocator_free(apr_allocator_t *allocator, apr_memnode_t *node)
     while (freelist != NULL) {
         node = freelist;
         freelist = node->next;
-#if APR_ALLOCATOR_USES_MMAP
-        munmap((char *)node - GUARDPAGE_SIZE,
-               2 * GUARDPAGE_SIZE + ((node->index+1) << BOUNDARY_INDEX));
-#else
-        free(node);
-#endif
+        memnode_release(allocator, node);
+    }
+}
+
+static APR_INLINE
+void allocator_free(apr_allocator_t *allocator, apr_memnode_t *node)
+{
+    APR_PROBE2(allocator__free, allocator, node);
+
+#if ALLOCATOR_TCACHE
+    if (allocator->tcache_max) {
+        if ((node = tcache_free(allocator, node)) == NULL) {
+            return;
+        }
     }
+#endif /* ALLOCATOR_TCACHE */
+
+    allocator_free_nodes(allocator, node);
 }
 
 APR_DECLARE(apr_memnode_t *) apr_allocator_alloc(apr_allocator_t *allocator,
@@ -503,6 +1071,61 @@ APR_DECLARE(void) apr_allocator_free(apr_allocator_t *allocator,
     allocator_free(allocator, node);
 }
 
+APR_DECLARE(apr_status_t) apr_allocator_thread_cache_set(
+                                  apr_allocator_t *allocator,
+                                  apr_size_t max_nodes)
+{
+#if ALLOCATOR_TCACHE
+    if (!allocator->tcache_key_set) {
+        apr_status_t rv;
+
+        if (!max_nodes) {
+            return APR_SUCCESS;
+        }
+        rv = pthread_key_create(&allocator->tcache_key, tcache_destructor);
+        if (rv) {
+            return rv;
+        }
+        allocator->tcache_id = apr_atomic_inc64(&tcache_ids) + 1;
+        allocator->tcache_key_set = 1;
+    }
+    allocator->tcache_max = max_nodes;
+
+    return APR_SUCCESS;
+#else
+    (void)allocator;
+    (void)max_nodes;
+    return APR_ENOTIMPL;
+#endif /* ALLOCATOR_TCACHE */
+}
+
+APR_DECLARE(apr_status_t) apr_allocator_thread_cache_stats(
+                                  apr_allocator_t *allocator,
+                                  apr_uint64_t *hits,
+                                  apr_uint64_t *misses)
+{
+#if ALLOCATOR_TCACHE
+    allocator_tcache_t *tcache;
+
+    allocator_lock(allocator);
+
+    *hits = allocator->tcache_hits;
+    *misses = allocator->tcache_misses;
+    for (tcache = allocator->tcaches; tcache; tcache = tcache->next) {
+        *hits += tcache->hits;
+        *misses += tcache->misses;
+    }
+
+    allocator_unlock(allocator);
+
+    return APR_SUCCESS;
+#else
+    (void)allocator;
+    *hits = *misses = 0;
+    return APR_ENOTIMPL;
+#endif /* ALLOCATOR_TCACHE */
+}
+
 APR_DECLARE(apr_size_t) apr_allocator_page_size(void)
 {
     return boundary_size;
@@ -536,7 +1159,7 @@ APR_DECLARE(apr_status_t) apr_allocator_min_order_set(unsigned int order)
  * Structures
  */
 
-typedef struct cleanup_t cleanup_t;
+typedef struct apr_pool_cleanup_t cleanup_t;
 
 /** A list of processes */
 struct process_chain {
@@ -570,6 +1193,10 @@ struct debug_node_t {
  * to see how it is used.
  */
 struct apr_pool_t {
+#if !APR_POOL_DEBUG
+    /* Must be first, see apr_palloc_inline() */
+    apr_memnode_t        *active;
+#endif /* !APR_POOL_DEBUG */
     apr_pool_t           *parent;
     apr_pool_t           *child;
     apr_pool_t           *sibling;
@@ -583,9 +1210,12 @@ struct apr_pool_t {
     const char           *tag;
 
 #if !APR_POOL_DEBUG
-    apr_memnode_t        *active;
     apr_memnode_t        *self; /* The node containing the pool itself */
     char                 *self_first_avail;
+    /* The self nodes of destroyed subpools, to recycle */
+    apr_memnode_t        *recycled;
+    apr_size_t            recycled_count;
+    apr_size_t            recycled_max;
 
 #else /* APR_POOL_DEBUG */
     apr_pool_t           *joined; /* the caller has guaranteed that this pool
@@ -605,6 +1235,7 @@ struct apr_pool_t {
     apr_os_proc_t         owner_proc;
 #endif /* defined(NETWARE) */
     cleanup_t            *pre_cleanups;
+    apr_uint32_t          marks; /* apr_pool_mark()s not rewound */
 #if APR_POOL_CONCURRENCY_CHECK
 
 #define                   IDLE        0
@@ -637,20 +1268,267 @@ static apr_status_t apr_pool_cleanup_file_stderr(void *data)
     return APR_SUCCESS;
 }
 
-#endif /* (APR_POOL_DEBUG & APR_POOL_DEBUG_VERBOSE_ALL) */
+#endif /* (APR_POOL_DEBUG & APR_POOL_DEBUG_VERBOSE_ALL) */
+
+/*
+ * Local functions
+ */
+
+static void run_cleanups(cleanup_t **c);
+static void free_proc_chain(struct process_chain *procs);
+
+#if APR_POOL_DEBUG
+static void pool_destroy_debug(apr_pool_t *pool, const char *file_line);
+#endif
+
+#if !APR_POOL_DEBUG
+/*
+ * Profiling
+ */
+
+/* Number of tags the profiler keeps track of (a power of two), the
+ * pools with more tags are accounted to the "(other)" entry.
+ */
+#define PROFILE_TAGS 256
+#define PROFILE_OTHER_TAG "(other)"
+
+typedef struct profile_entry_t {
+    apr_pool_profile_t profile;
+    int used;
+} profile_entry_t;
+
+/* Pools created, NULL if it could not be registered */
+static apr_metric_t *pools_metric = NULL;
+
+/* One sample every profile_rate events, 0 when disabled */
+static volatile apr_uint32_t profile_rate = 0;
+static profile_entry_t *profile_table = NULL;
+static volatile apr_uint32_t profile_lock = 0;
+#if APR_HAS_THREAD_LOCAL
+static APR_THREAD_LOCAL apr_uint32_t profile_countdown;
+#else
+static apr_uint32_t profile_countdown;
+#endif
+
+/* Whether this (allocation, clear or destroy) event should be sampled */
+static APR_INLINE int profile_sample(void)
+{
+    apr_uint32_t rate = profile_rate;
+
+    if (!rate) {
+        return 0;
+    }
+    if (profile_countdown) {
+        profile_countdown--;
+        return 0;
+    }
+    profile_countdown = rate - 1;
+    return 1;
+}
+
+static void profile_acquire(void)
+{
+    while (apr_atomic_cas32(&profile_lock, 1, 0) != 0) {
+#if APR_HAS_THREADS
+        apr_thread_yield();
+#endif
+    }
+}
+
+static void profile_release(void)
+{
+    apr_atomic_set32(&profile_lock, 0);
+}
+
+/* Find (or add) the entry of the tag, with the profile lock held */
+static apr_pool_profile_t *profile_find(const char *tag)
+{
+    profile_entry_t *entry;
+    apr_size_t hash = 0, i, n;
+    const char *c;
+
+    if (tag) {
+        for (c = tag; *c; c++) {
+            hash = hash * 33 + (unsigned char)*c;
+        }
+    }
+
+    for (n = 0, i = hash & (PROFILE_TAGS - 1); n < PROFILE_TAGS;
+         n++, i = (i + 1) & (PROFILE_TAGS - 1)) {
+        entry = &profile_table[i];
+        if (!entry->used) {
+            if (tag && (entry->profile.tag = strdup(tag)) == NULL) {
+                break;
+            }
+            entry->used = 1;
+            return &entry->profile;
+        }
+        if (entry->profile.tag == tag
+            || (tag && entry->profile.tag
+                && strcmp(entry->profile.tag, tag) == 0)) {
+            return &entry->profile;
+        }
+    }
+
+    /* Full, the last entry is for all the others */
+    entry = &profile_table[PROFILE_TAGS];
+    entry->used = 1;
+    return &entry->profile;
+}
+
+static void profile_alloc(apr_pool_t *pool, apr_size_t size)
+{
+    apr_pool_profile_t *profile;
+    apr_size_t bucket = 0;
+
+    while ((size >> bucket) > 1 && bucket < APR_POOL_PROFILE_BUCKETS - 1) {
+        bucket++;
+    }
+
+    profile_acquire();
+
+    if (profile_table) {
+        profile = profile_find(pool->tag);
+        profile->allocs++;
+        profile->alloc_bytes += size;
+        profile->sizes[bucket]++;
+    }
+
+    profile_release();
+}
+
+/* Account for the pool's block before it gets cleared or destroyed */
+static void profile_lifetime(apr_pool_t *pool)
+{
+    apr_pool_profile_t *profile;
+    apr_memnode_t *node;
+    apr_size_t nodes = 0, bytes = 0;
+
+    node = pool->active;
+    do {
+        nodes++;
+        bytes += node->first_avail - ((char *)node + APR_MEMNODE_T_SIZE);
+        node = node->next;
+    } while (node != pool->active);
+
+    profile_acquire();
+
+    if (profile_table) {
+        profile = profile_find(pool->tag);
+        profile->lifetimes++;
+        profile->nodes += nodes;
+        if (nodes > profile->max_nodes)
+            profile->max_nodes = nodes;
+        if (bytes > profile->peak_bytes)
+            profile->peak_bytes = bytes;
+    }
+
+    profile_release();
+}
+
+static void profile_clear_table(void)
+{
+    apr_size_t i;
+
+    for (i = 0; i < PROFILE_TAGS; i++) {
+        free((char *)profile_table[i].profile.tag);
+    }
+    memset(profile_table, 0, (PROFILE_TAGS + 1) * sizeof(*profile_table));
+    profile_table[PROFILE_TAGS].profile.tag = PROFILE_OTHER_TAG;
+}
+
+APR_DECLARE(apr_status_t) apr_pool_profile_set(apr_uint32_t sample_rate)
+{
+    profile_acquire();
+
+    if (sample_rate && !profile_table) {
+        profile_table = malloc((PROFILE_TAGS + 1) * sizeof(*profile_table));
+        if (!profile_table) {
+            profile_release();
+            return APR_ENOMEM;
+        }
+        memset(profile_table, 0, (PROFILE_TAGS + 1) * sizeof(*profile_table));
+        profile_clear_table();
+    }
+    profile_rate = sample_rate;
+
+    profile_release();
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(void) apr_pool_profile_reset(void)
+{
+    profile_acquire();
+
+    if (profile_table) {
+        profile_clear_table();
+    }
+
+    profile_release();
+}
+
+APR_DECLARE(int) apr_pool_profile_do(apr_pool_profile_cb_t *cb, void *baton)
+{
+    apr_pool_profile_t *profiles;
+    char **copies;
+    apr_size_t i, n = 0;
+    int rv = 1;
+
+    /* Work on a snapshot, so that the callback can allocate, with the
+     * copies of the tags to free (not "(other)")
+     */
+    profiles = malloc((PROFILE_TAGS + 1) * sizeof(*profiles));
+    copies = malloc((PROFILE_TAGS + 1) * sizeof(*copies));
+    if (!profiles || !copies) {
+        free(profiles);
+        free(copies);
+        return 0;
+    }
 
-/*
- * Local functions
- */
+    profile_acquire();
+
+    if (profile_table) {
+        for (i = 0; i <= PROFILE_TAGS; i++) {
+            if (profile_table[i].used) {
+                profiles[n] = profile_table[i].profile;
+                copies[n] = NULL;
+                if (profiles[n].tag && i < PROFILE_TAGS) {
+                    copies[n] = strdup(profiles[n].tag);
+                    if (!copies[n]) {
+                        rv = 0;
+                    }
+                    profiles[n].tag = copies[n];
+                }
+                n++;
+            }
+        }
+    }
 
-static void run_cleanups(cleanup_t **c);
-static void free_proc_chain(struct process_chain *procs);
+    profile_release();
 
-#if APR_POOL_DEBUG
-static void pool_destroy_debug(apr_pool_t *pool, const char *file_line);
-#endif
+    for (i = 0; i < n; i++) {
+        if (rv) {
+            rv = cb(baton, &profiles[i]);
+        }
+        free(copies[i]);
+    }
+    free(copies);
+    free(profiles);
+
+    return rv;
+}
+
+static void profile_terminate(void)
+{
+    profile_rate = 0;
+    if (profile_table) {
+        profile_clear_table();
+        free(profile_table);
+        profile_table = NULL;
+    }
+}
 
-#if !APR_POOL_DEBUG
 /*
  * Initialization
  */
@@ -695,6 +1573,11 @@ APR_DECLARE(apr_status_t) apr_pool_initialize(void)
 
     apr_pool_tag(global_pool, "apr_global_pool");
 
+    if (!pools_metric) {
+        apr_metric_register(&pools_metric, "apr_pools_created_total",
+                            "Pools created", APR_METRIC_COUNTER);
+    }
+
     /* This has to happen here because mutexes might be backed by
      * atomics.  It used to be snug and safe in apr_initialize().
      *
@@ -736,6 +1619,8 @@ APR_DECLARE(void) apr_pool_terminate(void)
     global_pool = NULL;
 
     global_allocator = NULL;
+
+    profile_terminate();
 }
 
 
@@ -829,6 +1714,9 @@ APR_DECLARE(void *) apr_palloc(apr_pool_t *pool, apr_size_t in_size)
     void *mem;
     apr_size_t size, free_index;
 
+    if (profile_sample())
+        profile_alloc(pool, in_size);
+
     pool_concurrency_set_used(pool);
     size = APR_ALIGN_DEFAULT(in_size);
 #if HAVE_VALGRIND
@@ -852,7 +1740,7 @@ APR_DECLARE(void *) apr_palloc(apr_pool_t *pool, apr_size_t in_size)
     }
 
     node = active->next;
-    if (size <= node_free_space(node)) {
+    if (!pool->marks && size <= node_free_space(node)) {
         list_remove(node);
     }
     else {
@@ -874,6 +1762,12 @@ APR_DECLARE(void *) apr_palloc(apr_pool_t *pool, apr_size_t in_size)
 
     pool->active = node;
 
+    /* While marked, the nodes allocated since the (first) mark are kept
+     * in front of its node, see pool_mark_release().
+     */
+    if (pool->marks)
+        goto have_mem;
+
     free_index = (APR_ALIGN(active->endp - active->first_avail + 1,
                             BOUNDARY_SIZE) - BOUNDARY_SIZE) >> BOUNDARY_INDEX;
 
@@ -908,6 +1802,41 @@ have_mem:
 #endif
 }
 
+APR_DECLARE(int) apr_presize(apr_pool_t *pool, void *mem, apr_size_t size,
+                             apr_size_t new_size)
+{
+    apr_memnode_t *active;
+    apr_size_t aligned, new_aligned;
+
+#if HAVE_VALGRIND
+    /* The redzones are not ours to move */
+    if (apr_running_on_valgrind)
+        return new_size <= size;
+#endif
+
+    aligned = APR_ALIGN_DEFAULT(size);
+    new_aligned = APR_ALIGN_DEFAULT(new_size);
+    if (new_aligned < new_size)
+        return 0;
+
+    pool_concurrency_set_used(pool);
+    active = pool->active;
+    if (mem == NULL || (char *)mem + aligned != active->first_avail) {
+        /* Not the last block */
+        pool_concurrency_set_idle(pool);
+        return new_size <= size;
+    }
+    if (new_aligned > aligned
+        && new_aligned - aligned > node_free_space(active)) {
+        pool_concurrency_set_idle(pool);
+        return 0;
+    }
+    active->first_avail = (char *)mem + new_aligned;
+    pool_concurrency_set_idle(pool);
+
+    return 1;
+}
+
 /* Provide an implementation of apr_pcalloc for backward compatibility
  * with code built before apr_pcalloc was a macro
  */
@@ -928,15 +1857,116 @@ APR_DECLARE(void *) apr_pcalloc(apr_pool_t *pool, apr_size_t size)
     return mem;
 }
 
+/*
+ * Marks
+ */
+
+APR_DECLARE(void) apr_pool_mark(apr_pool_t *pool, apr_pool_mark_t *mark)
+{
+    mark->node = pool->active;
+    mark->avail = pool->active->first_avail;
+    mark->index = 0;
+    mark->depth = pool->marks++;
+}
+
+/* Whether mem was allocated after the mark */
+static int pool_mark_owns(apr_pool_t *pool, const apr_pool_mark_t *mark,
+                          const void *mem)
+{
+    apr_memnode_t *node;
+    const char *p = mem;
+
+    for (node = pool->active; node != mark->node; node = node->next) {
+        if (p >= (char *)node && p < node->endp)
+            return 1;
+    }
+
+    return p >= mark->avail && p < node->endp;
+}
+
+static void pool_mark_release(apr_pool_t *pool, const apr_pool_mark_t *mark)
+{
+    apr_memnode_t *node = mark->node, *first = pool->active;
+
+    /* The nodes allocated since the mark are the ones before its node,
+     * unlink them and give them back to the allocator.
+     */
+    if (first != node) {
+        *node->ref = NULL;
+        node->ref = first->ref;
+        *node->ref = node;
+        allocator_free(pool->allocator, first);
+    }
+
+    node->first_avail = mark->avail;
+    pool->active = node;
+}
+
 
 /*
  * Pool creation/destruction
  */
 
+/* Give the recycled subpools' nodes back to the allocator */
+static void pool_recycled_free(apr_pool_t *pool)
+{
+    if (pool->recycled) {
+        allocator_free(pool->allocator, pool->recycled);
+        pool->recycled = NULL;
+        pool->recycled_count = 0;
+    }
+}
+
+/* Take the node of a destroyed subpool of parent, if any */
+static apr_memnode_t *pool_recycled_get(apr_pool_t *parent)
+{
+    apr_memnode_t *node;
+
+    /* Not recycling (the default), without locking */
+    if (!parent->recycled_max)
+        return NULL;
+
+    allocator_lock(parent->allocator);
+    if ((node = parent->recycled) != NULL) {
+        parent->recycled = node->next;
+        parent->recycled_count--;
+    }
+    allocator_unlock(parent->allocator);
+
+    if (node) {
+        node->first_avail = (char *)node + APR_MEMNODE_T_SIZE;
+        APR_VALGRIND_UNDEFINED(node->first_avail,
+                               node->endp - node->first_avail);
+    }
+    return node;
+}
+
+APR_DECLARE(void) apr_pool_recycle_max_set(apr_pool_t *pool, apr_size_t max)
+{
+    apr_memnode_t *node = NULL, **ref = &pool->recycled;
+
+    /* Drop the extra ones */
+    allocator_lock(pool->allocator);
+    pool->recycled_max = max;
+    if (pool->recycled_count > max) {
+        while (max--)
+            ref = &(*ref)->next;
+        node = *ref;
+        *ref = NULL;
+        pool->recycled_count = pool->recycled_max;
+    }
+    allocator_unlock(pool->allocator);
+
+    if (node)
+        allocator_free(pool->allocator, node);
+}
+
 APR_DECLARE(void) apr_pool_clear(apr_pool_t *pool)
 {
     apr_memnode_t *active;
 
+    APR_PROBE1(pool__clear, pool);
+
     /* Run pre destroy cleanups */
     run_cleanups(&pool->pre_cleanups);
 
@@ -956,6 +1986,7 @@ APR_DECLARE(void) apr_pool_clear(apr_pool_t *pool)
     pool_concurrency_set_used(pool);
     pool->cleanups = NULL;
     pool->free_cleanups = NULL;
+    pool->marks = 0;
 
     /* Free subprocesses */
     free_proc_chain(pool->subprocesses);
@@ -964,6 +1995,9 @@ APR_DECLARE(void) apr_pool_clear(apr_pool_t *pool)
     /* Clear the user data. */
     pool->user_data = NULL;
 
+    if (profile_sample())
+        profile_lifetime(pool);
+
     /* Find the node attached to the pool structure, reset it, make
      * it the active node and free the rest of the nodes.
      */
@@ -989,6 +2023,9 @@ APR_DECLARE(void) apr_pool_destroy(apr_pool_t *pool)
 {
     apr_memnode_t *active;
     apr_allocator_t *allocator;
+    apr_pool_t *parent;
+
+    APR_PROBE1(pool__destroy, pool);
 
     /* Run pre destroy cleanups */
     run_cleanups(&pool->pre_cleanups);
@@ -1007,18 +2044,14 @@ APR_DECLARE(void) apr_pool_destroy(apr_pool_t *pool)
     run_cleanups(&pool->cleanups);
     pool_concurrency_set_destroyed(pool);
 
+    if (profile_sample())
+        profile_lifetime(pool);
+
     /* Free subprocesses */
     free_proc_chain(pool->subprocesses);
 
-    /* Remove the pool from the parents child list */
-    if (pool->parent) {
-        allocator_lock(pool->parent->allocator);
-
-        if ((*pool->ref = pool->sibling) != NULL)
-            pool->sibling->ref = pool->ref;
-
-        allocator_unlock(pool->parent->allocator);
-    }
+    /* Free the subpools kept for recycling */
+    pool_recycled_free(pool);
 
     /* Find the block attached to the pool structure.  Save a copy of the
      * allocator pointer, because the pool struct soon will be no more.
@@ -1027,6 +2060,41 @@ APR_DECLARE(void) apr_pool_destroy(apr_pool_t *pool)
     active = pool->self;
     *active->ref = NULL;
 
+    /* Remove the pool from the parents child list, and give it the node
+     * holding the pool struct to recycle if it has room for it.  The
+     * pool struct may be reused as soon as the lock is released.
+     */
+    if ((parent = pool->parent) != NULL) {
+        apr_memnode_t *rest = active->next;
+        int recycle;
+
+        recycle = (parent->allocator == allocator
+                   && apr_allocator_owner_get(allocator) != pool);
+
+        allocator_lock(parent->allocator);
+
+        if ((*pool->ref = pool->sibling) != NULL)
+            pool->sibling->ref = pool->ref;
+
+        if (recycle && parent->recycled_count < parent->recycled_max) {
+            APR_IF_VALGRIND(VALGRIND_DESTROY_MEMPOOL(pool));
+            active->next = parent->recycled;
+            parent->recycled = active;
+            parent->recycled_count++;
+        }
+        else {
+            recycle = 0;
+        }
+
+        allocator_unlock(parent->allocator);
+
+        if (recycle) {
+            if (rest)
+                allocator_free(allocator, rest);
+            return;
+        }
+    }
+
 #if APR_HAS_THREADS
     if (apr_allocator_owner_get(allocator) == pool) {
         /* Make sure to remove the lock, since it is highly likely to
@@ -1075,8 +2143,11 @@ APR_DECLARE(apr_status_t) apr_pool_create_ex(apr_pool_t **newpool,
     if (allocator == NULL)
         allocator = parent->allocator;
 
-    if ((node = allocator_alloc(allocator,
-                                MIN_ALLOC - APR_MEMNODE_T_SIZE)) == NULL) {
+    /* Recycle a subpool of the parent, or allocate */
+    if ((!parent || parent->allocator != allocator
+         || (node = pool_recycled_get(parent)) == NULL)
+        && (node = allocator_alloc(allocator,
+                                   MIN_ALLOC - APR_MEMNODE_T_SIZE)) == NULL) {
         if (abort_fn)
             abort_fn(APR_ENOMEM);
 
@@ -1111,9 +2182,13 @@ APR_DECLARE(apr_status_t) apr_pool_create_ex(apr_pool_t **newpool,
     pool->cleanups = NULL;
     pool->free_cleanups = NULL;
     pool->pre_cleanups = NULL;
+    pool->marks = 0;
     pool->subprocesses = NULL;
     pool->user_data = NULL;
     pool->tag = NULL;
+    pool->recycled = NULL;
+    pool->recycled_count = 0;
+    pool->recycled_max = parent ? parent->recycled_max : 0;
 
 #ifdef NETWARE
     pool->owner_proc = (apr_os_proc_t)getnlmhandle();
@@ -1137,6 +2212,11 @@ APR_DECLARE(apr_status_t) apr_pool_create_ex(apr_pool_t **newpool,
 
     pool_concurrency_init(pool);
 
+    if (pools_metric)
+        apr_metric_add(pools_metric, 1);
+
+    APR_PROBE2(pool__create, pool, parent);
+
     *newpool = pool;
 
     return APR_SUCCESS;
@@ -1192,9 +2272,13 @@ APR_DECLARE(apr_status_t) apr_pool_create_unmanaged_ex(apr_pool_t **newpool,
     pool->cleanups = NULL;
     pool->free_cleanups = NULL;
     pool->pre_cleanups = NULL;
+    pool->marks = 0;
     pool->subprocesses = NULL;
     pool->user_data = NULL;
     pool->tag = NULL;
+    pool->recycled = NULL;
+    pool->recycled_count = 0;
+    pool->recycled_max = 0;
     pool->parent = NULL;
     pool->sibling = NULL;
     pool->ref = NULL;
@@ -1263,7 +2347,8 @@ static int psprintf_flush(apr_vformatter_buff_t *vbuff)
         size = APR_PSPRINTF_MIN_STRINGSIZE;
 
     node = active->next;
-    if (!ps->got_a_new_node && size <= node_free_space(node)) {
+    if (!ps->got_a_new_node && !pool->marks
+        && size <= node_free_space(node)) {
 
         list_remove(node);
         list_insert(node, active);
@@ -1343,7 +2428,8 @@ static int add_redzone(int (*flush_func)(apr_vformatter_buff_t *b),
 }
 #endif
 
-APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
+static char *pvsprintf(apr_pool_t *pool, const char *fmt,
+                       const apr_format_t *format, va_list ap)
 {
     struct psprintf_data ps;
     char *strp;
@@ -1380,7 +2466,9 @@ APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
     }
 #endif /* HAVE_VALGRIND */
 
-    if (apr_vformatter(psprintf_flush, &ps.vbuff, fmt, ap) == -1)
+    if ((fmt ? apr_vformatter(psprintf_flush, &ps.vbuff, fmt, ap)
+             : apr_format_vformatter(psprintf_flush, &ps.vbuff, format, ap))
+            == -1)
         goto error;
 
     *ps.vbuff.curpos++ = '\0';
@@ -1405,6 +2493,8 @@ APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
 #endif
 
     size = ps.vbuff.curpos - ps.node->first_avail;
+    if (profile_sample())
+        profile_alloc(pool, size);
     size = APR_ALIGN_DEFAULT(size);
     ps.node->first_avail += size;
 
@@ -1428,6 +2518,11 @@ APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
 
     pool->active = node;
 
+    if (pool->marks) {
+        pool_concurrency_set_idle(pool);
+        return strp;
+    }
+
     free_index = (APR_ALIGN(active->endp - active->first_avail + 1,
                             BOUNDARY_SIZE) - BOUNDARY_SIZE) >> BOUNDARY_INDEX;
 
@@ -1834,6 +2929,15 @@ APR_DECLARE(void *) apr_palloc_debug(apr_pool_t *pool, apr_size_t size,
     return mem;
 }
 
+APR_DECLARE(int) apr_presize(apr_pool_t *pool, void *mem, apr_size_t size,
+                             apr_size_t new_size)
+{
+    /* Each block is malloc()ed on its own */
+    apr_pool_check_integrity(pool);
+
+    return new_size <= size;
+}
+
 APR_DECLARE(void *) apr_pcalloc_debug(apr_pool_t *pool, apr_size_t size,
                                       const char *file_line)
 {
@@ -1853,11 +2957,78 @@ APR_DECLARE(void *) apr_pcalloc_debug(apr_pool_t *pool, apr_size_t size,
 
 
 /*
- * Pool creation/destruction (debug)
+ * Marks (debug)
  */
 
 #define POOL_POISON_BYTE 'A'
 
+APR_DECLARE(void) apr_pool_mark(apr_pool_t *pool, apr_pool_mark_t *mark)
+{
+    apr_pool_check_integrity(pool);
+
+    mark->node = pool->nodes;
+    mark->avail = NULL;
+    mark->index = pool->nodes ? pool->nodes->index : 0;
+    mark->depth = pool->marks++;
+}
+
+/* Whether mem was allocated after the mark */
+static int pool_mark_owns(apr_pool_t *pool, const apr_pool_mark_t *mark,
+                          const void *mem)
+{
+    debug_node_t *node;
+    apr_size_t index;
+
+    for (node = pool->nodes; node; node = node->next) {
+        index = node == mark->node ? mark->index : 0;
+        for (; index < node->index; index++) {
+            if (mem >= node->beginp[index] && mem < node->endp[index])
+                return 1;
+        }
+        if (node == mark->node)
+            break;
+    }
+
+    return 0;
+}
+
+static void pool_mark_release(apr_pool_t *pool, const apr_pool_mark_t *mark)
+{
+    debug_node_t *node;
+    apr_size_t index;
+
+    /* Free the blocks allocated since the mark, scribbling over them
+     * first like pool_clear_debug() */
+    while ((node = pool->nodes) != NULL) {
+        index = node == mark->node ? mark->index : 0;
+        for (; index < node->index; index++) {
+            memset(node->beginp[index], POOL_POISON_BYTE,
+                   (char *)node->endp[index] - (char *)node->beginp[index]);
+            free(node->beginp[index]);
+            pool->stat_alloc--;
+        }
+        if (node == mark->node) {
+            node->index = mark->index;
+            break;
+        }
+
+        pool->nodes = node->next;
+        memset(node, POOL_POISON_BYTE, SIZEOF_DEBUG_NODE_T);
+        free(node);
+    }
+}
+
+APR_DECLARE(void) apr_pool_recycle_max_set(apr_pool_t *pool, apr_size_t max)
+{
+    /* The debug pools are malloc()ed, nothing to recycle */
+    apr_pool_check_integrity(pool);
+}
+
+
+/*
+ * Pool creation/destruction (debug)
+ */
+
 static void pool_clear_debug(apr_pool_t *pool, const char *file_line)
 {
     debug_node_t *node;
@@ -1883,6 +3054,7 @@ static void pool_clear_debug(apr_pool_t *pool, const char *file_line)
     run_cleanups(&pool->cleanups);
     pool->free_cleanups = NULL;
     pool->cleanups = NULL;
+    pool->marks = 0;
 
     /* If new child pools showed up, this is a reason to raise a flag */
     if (pool->child)
@@ -2208,7 +3380,8 @@ static int psprintf_flush(apr_vformatter_buff_t *vbuff)
     return 0;
 }
 
-APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
+static char *pvsprintf(apr_pool_t *pool, const char *fmt,
+                       const apr_format_t *format, va_list ap)
 {
     struct psprintf_data ps;
     debug_node_t *node;
@@ -2222,7 +3395,9 @@ APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
     /* Save a byte for the NUL terminator */
     ps.vbuff.endpos = ps.mem + ps.size - 1;
 
-    if (apr_vformatter(psprintf_flush, &ps.vbuff, fmt, ap) == -1) {
+    if ((fmt ? apr_vformatter(psprintf_flush, &ps.vbuff, fmt, ap)
+             : apr_format_vformatter(psprintf_flush, &ps.vbuff, format, ap))
+            == -1) {
         if (pool->abort_fn)
             pool->abort_fn(APR_ENOMEM);
 
@@ -2367,13 +3542,38 @@ void netware_pool_proc_cleanup ()
  * "Print" functions (common)
  */
 
+APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *p, const char *fmt, va_list ap)
+{
+    return pvsprintf(p, fmt, NULL, ap);
+}
+
 APR_DECLARE_NONSTD(char *) apr_psprintf(apr_pool_t *p, const char *fmt, ...)
 {
     va_list ap;
     char *res;
 
     va_start(ap, fmt);
-    res = apr_pvsprintf(p, fmt, ap);
+    res = pvsprintf(p, fmt, NULL, ap);
+    va_end(ap);
+    return res;
+}
+
+APR_DECLARE(char *) apr_format_pvsprintf(apr_pool_t *p,
+                                         const apr_format_t *format,
+                                         va_list ap)
+{
+    return pvsprintf(p, NULL, format, ap);
+}
+
+APR_DECLARE_NONSTD(char *) apr_format_psprintf(apr_pool_t *p,
+                                               const apr_format_t *format,
+                                               ...)
+{
+    va_list ap;
+    char *res;
+
+    va_start(ap, format);
+    res = pvsprintf(p, NULL, format, ap);
     va_end(ap);
     return res;
 }
@@ -2517,16 +3717,42 @@ APR_DECLARE(apr_status_t) apr_pool_userdata_get(void **data, const char *key,
  * Cleanup
  */
 
-struct cleanup_t {
-    struct cleanup_t *next;
+struct apr_pool_cleanup_t {
+    struct apr_pool_cleanup_t *next;
+    /* The pointer to this cleanup in its list, NULL once removed (or in
+     * the free list), for apr_pool_cleanup_kill_ex() to unlink it */
+    struct apr_pool_cleanup_t **ref;
     const void *data;
     apr_status_t (*plain_cleanup_fn)(void *data);
     apr_status_t (*child_cleanup_fn)(void *data);
 };
 
+static APR_INLINE void cleanup_link(cleanup_t *c, cleanup_t **head)
+{
+    if ((c->next = *head) != NULL)
+        c->next->ref = &c->next;
+    c->ref = head;
+    *head = c;
+}
+
+static APR_INLINE void cleanup_unlink(cleanup_t *c)
+{
+    if ((*c->ref = c->next) != NULL)
+        c->next->ref = c->ref;
+    c->ref = NULL;
+}
+
 APR_DECLARE(void) apr_pool_cleanup_register(apr_pool_t *p, const void *data,
                       apr_status_t (*plain_cleanup_fn)(void *data),
                       apr_status_t (*child_cleanup_fn)(void *data))
+{
+    apr_pool_cleanup_register_ex(p, data, plain_cleanup_fn, child_cleanup_fn);
+}
+
+APR_DECLARE(apr_pool_cleanup_t *) apr_pool_cleanup_register_ex(
+                      apr_pool_t *p, const void *data,
+                      apr_status_t (*plain_cleanup_fn)(void *data),
+                      apr_status_t (*child_cleanup_fn)(void *data))
 {
     cleanup_t *c = NULL;
 
@@ -2535,7 +3761,7 @@ APR_DECLARE(void) apr_pool_cleanup_register(apr_pool_t *p, const void *data,
 #endif /* APR_POOL_DEBUG */
 
     if (p != NULL) {
-        if (p->free_cleanups) {
+        if (p->free_cleanups && !p->marks) {
             /* reuse a cleanup structure */
             c = p->free_cleanups;
             p->free_cleanups = c->next;
@@ -2545,8 +3771,7 @@ APR_DECLARE(void) apr_pool_cleanup_register(apr_pool_t *p, const void *data,
         c->data = data;
         c->plain_cleanup_fn = plain_cleanup_fn;
         c->child_cleanup_fn = child_cleanup_fn;
-        c->next = p->cleanups;
-        p->cleanups = c;
+        cleanup_link(c, &p->cleanups);
     }
 
 #if APR_POOL_DEBUG
@@ -2554,6 +3779,8 @@ APR_DECLARE(void) apr_pool_cleanup_register(apr_pool_t *p, const void *data,
         abort();
     }
 #endif /* APR_POOL_DEBUG */
+
+    return c;
 }
 
 APR_DECLARE(void) apr_pool_pre_cleanup_register(apr_pool_t *p, const void *data,
@@ -2566,7 +3793,7 @@ APR_DECLARE(void) apr_pool_pre_cleanup_register(apr_pool_t *p, const void *data,
 #endif /* APR_POOL_DEBUG */
 
     if (p != NULL) {
-        if (p->free_cleanups) {
+        if (p->free_cleanups && !p->marks) {
             /* reuse a cleanup structure */
             c = p->free_cleanups;
             p->free_cleanups = c->next;
@@ -2575,8 +3802,7 @@ APR_DECLARE(void) apr_pool_pre_cleanup_register(apr_pool_t *p, const void *data,
         }
         c->data = data;
         c->plain_cleanup_fn = plain_cleanup_fn;
-        c->next = p->pre_cleanups;
-        p->pre_cleanups = c;
+        cleanup_link(c, &p->pre_cleanups);
     }
 
 #if APR_POOL_DEBUG
@@ -2589,7 +3815,7 @@ APR_DECLARE(void) apr_pool_pre_cleanup_register(apr_pool_t *p, const void *data,
 APR_DECLARE(void) apr_pool_cleanup_kill(apr_pool_t *p, const void *data,
                       apr_status_t (*cleanup_fn)(void *))
 {
-    cleanup_t *c, **lastp;
+    cleanup_t *c;
 
 #if APR_POOL_DEBUG
     apr_pool_check_integrity(p);
@@ -2599,7 +3825,6 @@ APR_DECLARE(void) apr_pool_cleanup_kill(apr_pool_t *p, const void *data,
         return;
 
     c = p->cleanups;
-    lastp = &p->cleanups;
     while (c) {
 #if APR_POOL_DEBUG
         /* Some cheap loop detection to catch a corrupt list: */
@@ -2611,20 +3836,18 @@ APR_DECLARE(void) apr_pool_cleanup_kill(apr_pool_t *p, const void *data,
 #endif
 
         if (c->data == data && c->plain_cleanup_fn == cleanup_fn) {
-            *lastp = c->next;
+            cleanup_unlink(c);
             /* move to freelist */
             c->next = p->free_cleanups;
             p->free_cleanups = c;
             break;
         }
 
-        lastp = &c->next;
         c = c->next;
     }
 
     /* Remove any pre-cleanup as well */
     c = p->pre_cleanups;
-    lastp = &p->pre_cleanups;
     while (c) {
 #if APR_POOL_DEBUG
         /* Some cheap loop detection to catch a corrupt list: */
@@ -2636,19 +3859,34 @@ APR_DECLARE(void) apr_pool_cleanup_kill(apr_pool_t *p, const void *data,
 #endif
 
         if (c->data == data && c->plain_cleanup_fn == cleanup_fn) {
-            *lastp = c->next;
+            cleanup_unlink(c);
             /* move to freelist */
             c->next = p->free_cleanups;
             p->free_cleanups = c;
             break;
         }
 
-        lastp = &c->next;
         c = c->next;
     }
 
 }
 
+APR_DECLARE(void) apr_pool_cleanup_kill_ex(apr_pool_t *p,
+                                           apr_pool_cleanup_t *cleanup)
+{
+#if APR_POOL_DEBUG
+    apr_pool_check_integrity(p);
+#endif /* APR_POOL_DEBUG */
+
+    /* Unless already removed */
+    if (cleanup->ref) {
+        cleanup_unlink(cleanup);
+        /* move to freelist */
+        cleanup->next = p->free_cleanups;
+        p->free_cleanups = cleanup;
+    }
+}
+
 APR_DECLARE(void) apr_pool_child_cleanup_set(apr_pool_t *p, const void *data,
                       apr_status_t (*plain_cleanup_fn)(void *),
                       apr_status_t (*child_cleanup_fn)(void *))
@@ -2680,17 +3918,67 @@ APR_DECLARE(apr_status_t) apr_pool_cleanup_run(apr_pool_t *p, void *data,
     return (*cleanup_fn)(data);
 }
 
+APR_DECLARE(apr_status_t) apr_pool_cleanup_run_ex(apr_pool_t *p,
+                                                  apr_pool_cleanup_t *cleanup)
+{
+    apr_status_t (*cleanup_fn)(void *) = cleanup->plain_cleanup_fn;
+    void *data = (void *)cleanup->data;
+
+    apr_pool_cleanup_kill_ex(p, cleanup);
+    return (*cleanup_fn)(data);
+}
+
 static void run_cleanups(cleanup_t **cref)
 {
     cleanup_t *c = *cref;
 
     while (c) {
-        *cref = c->next;
+        cleanup_unlink(c);
+        (*c->plain_cleanup_fn)((void *)c->data);
+        c = *cref;
+    }
+}
+
+/* Run the cleanups registered since the mark, which are the first ones of
+ * the list and were allocated after it (cleanups are not reused while the
+ * pool is marked).
+ */
+static void run_mark_cleanups(apr_pool_t *pool, const apr_pool_mark_t *mark,
+                              cleanup_t **cref)
+{
+    cleanup_t *c = *cref;
+
+    while (c && pool_mark_owns(pool, mark, c)) {
+        cleanup_unlink(c);
         (*c->plain_cleanup_fn)((void *)c->data);
         c = *cref;
     }
 }
 
+APR_DECLARE(void) apr_pool_rewind(apr_pool_t *pool, apr_pool_mark_t *mark)
+{
+    cleanup_t *c, **lastp;
+
+#if APR_POOL_DEBUG
+    apr_pool_check_integrity(pool);
+#endif /* APR_POOL_DEBUG */
+
+    run_mark_cleanups(pool, mark, &pool->pre_cleanups);
+    run_mark_cleanups(pool, mark, &pool->cleanups);
+
+    /* Forget the cleanups killed which are to be released */
+    lastp = &pool->free_cleanups;
+    while ((c = *lastp) != NULL) {
+        if (pool_mark_owns(pool, mark, c))
+            *lastp = c->next;
+        else
+            lastp = &c->next;
+    }
+
+    pool_mark_release(pool, mark);
+    pool->marks = mark->depth;
+}
+
 #if !defined(WIN32) && !defined(OS2)
 
 static void run_child_cleanups(cleanup_t **cref)
@@ -2698,7 +3986,7 @@ static void run_child_cleanups(cleanup_t **cref)
     cleanup_t *c = *cref;
 
     while (c) {
-        *cref = c->next;
+        cleanup_unlink(c);
         (*c->child_cleanup_fn)((void *)c->data);
         c = *cref;
     }
@@ -2934,6 +4222,24 @@ APR_DECLARE(void) apr_pool_lock(apr_pool_t *pool, int flag)
 
 #else /* APR_POOL_DEBUG */
 
+/*
+ * The profiler is for the production pools only.
+ */
+
+APR_DECLARE(apr_status_t) apr_pool_profile_set(apr_uint32_t sample_rate)
+{
+    return APR_ENOTIMPL;
+}
+
+APR_DECLARE(void) apr_pool_profile_reset(void)
+{
+}
+
+APR_DECLARE(int) apr_pool_profile_do(apr_pool_profile_cb_t *cb, void *baton)
+{
+    return 1;
+}
+
 #undef apr_palloc
 APR_DECLARE(void *) apr_palloc(apr_pool_t *pool, apr_size_t size);
 
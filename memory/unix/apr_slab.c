@@ -0,0 +1,449 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr.h"
+#include "apr_private.h"
+
+#include "apr_slab.h"
+#include "apr_allocator.h"
+#include "apr_atomic.h"
+#include "apr_thread_mutex.h"
+#include "apr_thread_proc.h" /* for APR_THREAD_LOCAL */
+#define APR_WANT_MEMFUNC
+#include "apr_want.h"
+
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>     /* for calloc and free */
+#endif
+
+/*
+ * Like the allocator's per-thread caches, the magazines need thread-specific
+ * data with a destructor, and a way to drop the key with the slab.
+ */
+#if APR_HAS_THREADS && APR_HAVE_PTHREAD_H && defined(HAVE_PTHREAD_KEY_DELETE)
+#include <pthread.h>
+#define SLAB_MAGAZINES 1
+#else
+#define SLAB_MAGAZINES 0
+#endif
+
+/*
+ * Magic numbers
+ */
+
+/* Assumed size of a cache line, for APR_SLAB_CACHE_ALIGN */
+#define SLAB_CACHELINE_SIZE 64
+
+/* Minimum number of objects carved out of each memnode, and minimum
+ * size of the memnodes (the allocator's smallest ones).
+ */
+#define SLAB_MIN_OBJECTS    16
+#define SLAB_MIN_NODE_SIZE  (8192 - APR_MEMNODE_T_SIZE)
+
+/* Number of objects a magazine holds, half of it is moved at once
+ * between the magazine and the slab.
+ */
+#define SLAB_MAGAZINE_SIZE  32
+
+#define SLAB_FLAGS (APR_SLAB_CACHE_ALIGN | APR_SLAB_THREAD_SAFE | \
+                    APR_SLAB_MAGAZINES)
+
+/*
+ * Structures
+ */
+
+/* Free objects are linked through their first bytes */
+typedef struct slab_object_t slab_object_t;
+struct slab_object_t {
+    slab_object_t *next;
+};
+
+#if SLAB_MAGAZINES
+typedef struct slab_magazine_t slab_magazine_t;
+
+struct slab_magazine_t {
+    apr_slab_t       *slab;
+    slab_magazine_t  *next;
+    slab_magazine_t **ref;
+    apr_size_t        count;
+    void             *objs[SLAB_MAGAZINE_SIZE];
+};
+
+#if APR_HAS_THREAD_LOCAL
+/* The magazine of the last slab used by the calling thread, the slabs
+ * being told apart by their (never reused) magazine_id.
+ */
+static APR_THREAD_LOCAL struct {
+    apr_uint64_t     id;
+    slab_magazine_t *mag;
+} magazine_last;
+#endif
+
+static volatile apr_uint64_t magazine_ids = 0;
+#endif /* SLAB_MAGAZINES */
+
+struct apr_slab_t {
+    apr_pool_t         *pool;
+    apr_allocator_t    *allocator;
+    apr_size_t          size;
+    apr_size_t          align;
+    /** The memnodes the objects are carved out of */
+    apr_memnode_t      *nodes;
+    /** The next never allocated object of the current node, and its end */
+    char               *pos;
+    char               *end;
+    /** The freed objects */
+    slab_object_t      *free;
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex;
+#endif
+#if SLAB_MAGAZINES
+    /** Whether magazine_key is valid */
+    int                 magazine_key_set;
+    pthread_key_t       magazine_key;
+    /** Never reused identifier of the key, @see magazine_last */
+    apr_uint64_t        magazine_id;
+    /** The magazines of all the threads using this slab */
+    slab_magazine_t    *magazines;
+#endif
+};
+
+
+/*
+ * Slab
+ */
+
+static APR_INLINE void slab_lock(apr_slab_t *slab)
+{
+#if APR_HAS_THREADS
+    if (slab->mutex)
+        apr_thread_mutex_lock(slab->mutex);
+#endif
+}
+
+static APR_INLINE void slab_unlock(apr_slab_t *slab)
+{
+#if APR_HAS_THREADS
+    if (slab->mutex)
+        apr_thread_mutex_unlock(slab->mutex);
+#endif
+}
+
+/* Get an object, with the slab locked */
+static APR_INLINE void *slab_get(apr_slab_t *slab)
+{
+    apr_memnode_t *node;
+    apr_size_t size;
+    void *obj;
+
+    if (slab->free) {
+        obj = slab->free;
+        slab->free = slab->free->next;
+        return obj;
+    }
+
+    if (slab->pos + slab->size > slab->end) {
+        size = SLAB_MIN_OBJECTS * slab->size + slab->align;
+        if (size < SLAB_MIN_NODE_SIZE) {
+            size = SLAB_MIN_NODE_SIZE;
+        }
+        if ((node = apr_allocator_alloc(slab->allocator, size)) == NULL) {
+            return NULL;
+        }
+        node->next = slab->nodes;
+        slab->nodes = node;
+
+        slab->pos = (char *)APR_ALIGN((apr_uintptr_t)node->first_avail,
+                                      slab->align);
+        slab->end = node->endp;
+    }
+
+    obj = slab->pos;
+    slab->pos += slab->size;
+    return obj;
+}
+
+/* Put an object back, with the slab locked */
+static APR_INLINE void slab_put(apr_slab_t *slab, void *obj)
+{
+    slab_object_t *o = obj;
+
+    o->next = slab->free;
+    slab->free = o;
+}
+
+#if SLAB_MAGAZINES
+/*
+ * Per-thread magazines
+ */
+
+/* Move the objects of the magazine above 'keep' to the slab, with
+ * the slab locked.
+ */
+static APR_INLINE void magazine_trim(slab_magazine_t *mag, apr_size_t keep)
+{
+    while (mag->count > keep) {
+        slab_put(mag->slab, mag->objs[--mag->count]);
+    }
+}
+
+static void magazine_destructor(void *data)
+{
+    slab_magazine_t *mag = data;
+    apr_slab_t *slab = mag->slab;
+
+#if APR_HAS_THREAD_LOCAL
+    if (magazine_last.mag == mag) {
+        magazine_last.id = 0;
+        magazine_last.mag = NULL;
+    }
+#endif
+
+    slab_lock(slab);
+
+    magazine_trim(mag, 0);
+    if ((*mag->ref = mag->next) != NULL)
+        mag->next->ref = mag->ref;
+
+    slab_unlock(slab);
+
+    free(mag);
+}
+
+/* Get (or create) the magazine of the calling thread */
+static APR_INLINE slab_magazine_t *magazine_get(apr_slab_t *slab)
+{
+    slab_magazine_t *mag;
+
+#if APR_HAS_THREAD_LOCAL
+    if (magazine_last.id == slab->magazine_id) {
+        return magazine_last.mag;
+    }
+#endif
+
+    mag = pthread_getspecific(slab->magazine_key);
+    if (mag == NULL) {
+        if ((mag = calloc(1, sizeof(*mag))) == NULL) {
+            return NULL;
+        }
+        if (pthread_setspecific(slab->magazine_key, mag)) {
+            free(mag);
+            return NULL;
+        }
+        mag->slab = slab;
+
+        slab_lock(slab);
+
+        if ((mag->next = slab->magazines) != NULL)
+            mag->next->ref = &mag->next;
+        slab->magazines = mag;
+        mag->ref = &slab->magazines;
+
+        slab_unlock(slab);
+    }
+
+#if APR_HAS_THREAD_LOCAL
+    magazine_last.id = slab->magazine_id;
+    magazine_last.mag = mag;
+#endif
+
+    return mag;
+}
+#endif /* SLAB_MAGAZINES */
+
+static apr_status_t slab_cleanup(void *data)
+{
+    apr_slab_t *slab = data;
+
+#if SLAB_MAGAZINES
+    if (slab->magazine_key_set) {
+        slab_magazine_t *mag;
+
+        /* The magazines' objects are in the nodes freed below */
+        pthread_key_delete(slab->magazine_key);
+        while ((mag = slab->magazines) != NULL) {
+            slab->magazines = mag->next;
+            free(mag);
+        }
+        slab->magazine_key_set = 0;
+    }
+#endif
+
+    if (slab->nodes) {
+        apr_allocator_free(slab->allocator, slab->nodes);
+        slab->nodes = NULL;
+    }
+    slab->pos = slab->end = NULL;
+    slab->free = NULL;
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_slab_create(apr_slab_t **newslab,
+                                          apr_size_t size,
+                                          apr_uint32_t flags,
+                                          apr_pool_t *pool)
+{
+    apr_slab_t *slab;
+
+    *newslab = NULL;
+
+    if (!size || (flags & ~SLAB_FLAGS)) {
+        return APR_EINVAL;
+    }
+    if (flags & APR_SLAB_MAGAZINES) {
+#if !SLAB_MAGAZINES
+        return APR_ENOTIMPL;
+#endif
+        flags |= APR_SLAB_THREAD_SAFE;
+    }
+#if !APR_HAS_THREADS
+    if (flags & APR_SLAB_THREAD_SAFE) {
+        return APR_ENOTIMPL;
+    }
+#endif
+
+    slab = apr_pcalloc(pool, sizeof(*slab));
+    slab->pool = pool;
+    slab->allocator = apr_pool_allocator_get(pool);
+
+    slab->align = (flags & APR_SLAB_CACHE_ALIGN) ? SLAB_CACHELINE_SIZE
+                                                 : APR_ALIGN_DEFAULT(1);
+    if (size < sizeof(slab_object_t)) {
+        size = sizeof(slab_object_t);
+    }
+    slab->size = APR_ALIGN(size, slab->align);
+    if (slab->size < size) {
+        return APR_EINVAL;
+    }
+
+#if APR_HAS_THREADS
+    if (flags & APR_SLAB_THREAD_SAFE) {
+        apr_status_t rv;
+
+        /* Created before the cleanup is registered, so that it outlives
+         * slab_cleanup().
+         */
+        rv = apr_thread_mutex_create(&slab->mutex, APR_THREAD_MUTEX_DEFAULT,
+                                     pool);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+    }
+#endif
+
+#if SLAB_MAGAZINES
+    if (flags & APR_SLAB_MAGAZINES) {
+        apr_status_t rv;
+
+        rv = pthread_key_create(&slab->magazine_key, magazine_destructor);
+        if (rv) {
+            return rv;
+        }
+        slab->magazine_id = apr_atomic_inc64(&magazine_ids) + 1;
+        slab->magazine_key_set = 1;
+    }
+#endif
+
+    apr_pool_cleanup_register(pool, slab, slab_cleanup,
+                              apr_pool_cleanup_null);
+
+    *newslab = slab;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(void *) apr_slab_alloc(apr_slab_t *slab)
+{
+    void *obj;
+
+#if SLAB_MAGAZINES
+    if (slab->magazine_key_set) {
+        slab_magazine_t *mag = magazine_get(slab);
+
+        if (mag) {
+            if (mag->count) {
+                return mag->objs[--mag->count];
+            }
+
+            /* Refill half of the magazine at once */
+            slab_lock(slab);
+
+            obj = slab_get(slab);
+            while (obj && mag->count < SLAB_MAGAZINE_SIZE / 2) {
+                void *more = slab_get(slab);
+                if (!more) {
+                    break;
+                }
+                mag->objs[mag->count++] = more;
+            }
+
+            slab_unlock(slab);
+
+            return obj;
+        }
+    }
+#endif
+
+    slab_lock(slab);
+    obj = slab_get(slab);
+    slab_unlock(slab);
+
+    return obj;
+}
+
+APR_DECLARE(void *) apr_slab_calloc(apr_slab_t *slab)
+{
+    void *obj = apr_slab_alloc(slab);
+
+    if (obj) {
+        memset(obj, 0, slab->size);
+    }
+    return obj;
+}
+
+APR_DECLARE(void) apr_slab_free(apr_slab_t *slab, void *obj)
+{
+#if SLAB_MAGAZINES
+    if (slab->magazine_key_set) {
+        slab_magazine_t *mag = magazine_get(slab);
+
+        if (mag) {
+            if (mag->count >= SLAB_MAGAZINE_SIZE) {
+                /* Hand half of the magazine back at once */
+                slab_lock(slab);
+                magazine_trim(mag, SLAB_MAGAZINE_SIZE / 2);
+                slab_unlock(slab);
+            }
+            mag->objs[mag->count++] = obj;
+            return;
+        }
+    }
+#endif
+
+    slab_lock(slab);
+    slab_put(slab, obj);
+    slab_unlock(slab);
+}
+
+APR_DECLARE(apr_size_t) apr_slab_object_size(const apr_slab_t *slab)
+{
+    return slab->size;
+}
+
+APR_DECLARE(void) apr_slab_destroy(apr_slab_t *slab)
+{
+    apr_pool_cleanup_run(slab->pool, slab, slab_cleanup);
+}
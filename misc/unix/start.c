@@ -19,6 +19,7 @@
 #include "apr_pools.h"
 #include "apr_signal.h"
 #include "apr_atomic.h"
+#include "apr_siphash.h"
 
 #include "apr_arch_proc_mutex.h" /* for apr_proc_mutex_unix_setup_lock() */
 #include "apr_arch_internal_time.h"
@@ -70,6 +71,16 @@ APR_DECLARE(apr_status_t) apr_initialize(void)
 
     apr_signal_init(pool);
 
+#if APR_HAS_RANDOM
+    {
+        unsigned char key[APR_SIPHASH_KSIZE];
+
+        if (apr_generate_random_bytes(key, sizeof(key)) == APR_SUCCESS) {
+            apr_hashfunc_siphash13_key(key);
+        }
+    }
+#endif
+
     return APR_SUCCESS;
 }
 
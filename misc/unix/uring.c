@@ -0,0 +1,236 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_arch_uring.h"
+
+#if defined(HAVE_IO_URING)
+
+#define APR_WANT_MEMFUNC
+#include "apr_want.h"
+
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#if APR_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <errno.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+int apr_uring_enter(apr_uring_t *ring, unsigned to_submit,
+                    unsigned min_complete, unsigned flags,
+                    apr_interval_time_t timeout)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+
+    if (!(flags & IORING_ENTER_GETEVENTS)) {
+        return syscall(__NR_io_uring_enter, ring->fd, to_submit, 0, flags,
+                       NULL, 0);
+    }
+
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    if (timeout >= 0) {
+        ts.tv_sec = apr_time_sec(timeout);
+        ts.tv_nsec = apr_time_usec(timeout) * 1000;
+        arg.ts = (apr_uint64_t)(apr_uintptr_t)&ts;
+    }
+    return syscall(__NR_io_uring_enter, ring->fd, to_submit, min_complete,
+                   flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+void apr_uring_close(apr_uring_t *ring)
+{
+    if (ring->sqes) {
+        munmap(ring->sqes, ring->sqes_len);
+    }
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_len);
+    }
+    if (ring->sq_ring) {
+        munmap(ring->sq_ring, ring->sq_ring_len);
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+    }
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+int apr_uring_supports(apr_uring_t *ring, int op)
+{
+    struct io_uring_probe *probe;
+    int rv = 0;
+
+    probe = calloc(1, sizeof(*probe) + 256 * sizeof(probe->ops[0]));
+    if (probe) {
+        if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE,
+                    probe, 256) >= 0) {
+            rv = op < probe->ops_len
+                 && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+        }
+        free(probe);
+    }
+    return rv;
+}
+
+apr_status_t apr_uring_setup(apr_uring_t *ring, apr_uint32_t entries)
+{
+    struct io_uring_params params;
+    unsigned *array;
+    unsigned i;
+    apr_status_t rv;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CLAMP;
+#ifdef IORING_SETUP_COOP_TASKRUN
+    /* The completions are run when waiting for them, rather than by
+     * interrupting the thread (which makes the other blocking calls fail
+     * with EINTR)
+     */
+    params.flags |= IORING_SETUP_COOP_TASKRUN;
+#endif
+
+    ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+#ifdef IORING_SETUP_COOP_TASKRUN
+    if (ring->fd < 0 && errno == EINVAL) {
+        /* Before Linux 5.19 */
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CLAMP;
+        ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+    }
+#endif
+    if (ring->fd < 0) {
+        rv = errno;
+        ring->fd = -1;
+        /* Old kernels, or io_uring disabled (kernel.io_uring_disabled,
+         * seccomp)
+         */
+        if (rv == ENOSYS || rv == EPERM || rv == EINVAL) {
+            return APR_ENOTIMPL;
+        }
+        return rv;
+    }
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+        apr_uring_close(ring);
+        return APR_ENOTIMPL;
+    }
+
+    ring->sq_ring_len = params.sq_off.array
+                        + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_len = params.cq_off.cqes
+                        + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_len > ring->sq_ring_len) {
+            ring->sq_ring_len = ring->cq_ring_len;
+        }
+        ring->cq_ring_len = ring->sq_ring_len;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd,
+                         IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        ring->sq_ring = NULL;
+        goto failed;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    }
+    else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_len, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, ring->fd,
+                             IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            ring->cq_ring = NULL;
+            goto failed;
+        }
+    }
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        goto failed;
+    }
+
+    ring->sq_entries = params.sq_entries;
+    ring->sq_mask = *(unsigned *)((char *)ring->sq_ring
+                                  + params.sq_off.ring_mask);
+    ring->sq_khead = (unsigned *)((char *)ring->sq_ring + params.sq_off.head);
+    ring->sq_ktail = (unsigned *)((char *)ring->sq_ring + params.sq_off.tail);
+    ring->sq_tail = *ring->sq_ktail;
+    ring->cq_mask = *(unsigned *)((char *)ring->cq_ring
+                                  + params.cq_off.ring_mask);
+    ring->cq_khead = (unsigned *)((char *)ring->cq_ring + params.cq_off.head);
+    ring->cq_ktail = (unsigned *)((char *)ring->cq_ring + params.cq_off.tail);
+    ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ring
+                                         + params.cq_off.cqes);
+
+    /* The SQEs are used in order, so the indirection array is fixed */
+    array = (unsigned *)((char *)ring->sq_ring + params.sq_off.array);
+    for (i = 0; i < ring->sq_entries; i++) {
+        array[i] = i;
+    }
+
+    return APR_SUCCESS;
+
+failed:
+    rv = errno;
+    apr_uring_close(ring);
+    return rv;
+}
+
+struct io_uring_sqe *apr_uring_get_sqe(apr_uring_t *ring, apr_status_t *rv)
+{
+    struct io_uring_sqe *sqe;
+    unsigned pending;
+
+    while ((pending = apr_uring_sq_pending(ring)) >= ring->sq_entries) {
+        if (apr_uring_enter(ring, pending, 0, 0, 0) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            *rv = errno;
+            return NULL;
+        }
+    }
+
+    sqe = &ring->sqes[ring->sq_tail & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+apr_status_t apr_uring_submit(apr_uring_t *ring)
+{
+    unsigned pending;
+
+    while ((pending = apr_uring_sq_pending(ring))) {
+        if (apr_uring_enter(ring, pending, 0, 0, 0) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+    }
+    return APR_SUCCESS;
+}
+
+#endif /* HAVE_IO_URING */
@@ -22,6 +22,9 @@
 #include "apr_strings.h"
 #include "apr_mmap.h"
 #include "apr_errno.h"
+#include "apr_hash.h"
+#include "apr_ring.h"
+#include "apr_thread_mutex.h"
 #include "apr_arch_file_io.h"
 #include "apr_portable.h"
 
@@ -35,6 +38,9 @@
 #if APR_HAVE_STDIO_H
 #include <stdio.h>
 #endif
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>  /* for calloc() and free() */
+#endif
 #if APR_HAVE_UNISTD_H
 #include <unistd.h>  /* for sysconf() */
 #endif
@@ -47,6 +53,10 @@
 
 #if APR_HAS_MMAP || defined(BEOS)
 
+#ifndef BEOS
+static void cache_release(struct apr_mmap_cache_entry_t *entry);
+#endif
+
 static apr_status_t mmap_cleanup(void *themmap)
 {
     apr_mmap_t *mm = themmap;
@@ -63,6 +73,15 @@ static apr_status_t mmap_cleanup(void *themmap)
         return APR_SUCCESS;
     }
 
+#ifndef BEOS
+    if (mm->centry) {
+        /* the region is the cache's */
+        cache_release(mm->centry);
+        mm->mm = (void *)-1;
+        return APR_SUCCESS;
+    }
+#endif
+
 #ifdef BEOS
     rv = delete_area(mm->area);
 #else
@@ -76,20 +95,18 @@ static apr_status_t mmap_cleanup(void *themmap)
     return errno;
 }
 
-APR_DECLARE(apr_status_t) apr_mmap_create(apr_mmap_t **new,
-                                          apr_file_t *file, apr_off_t offset,
-                                          apr_size_t size, apr_int32_t flag,
-                                          apr_pool_t *cont)
+#ifndef BEOS
+/* Map the region, returning the start of the data and its offset in the
+ * first page.
+ */
+static apr_status_t map_region(void **mmp, apr_off_t *poffsetp,
+                               apr_file_t *file, apr_off_t offset,
+                               apr_size_t size, apr_int32_t flag)
 {
-    void *mm;
-#ifdef BEOS
-    area_id aid = -1;
-    uint32 pages = 0;
-#else
     static long psize;
+    void *mm;
     apr_off_t poffset = 0;
     apr_int32_t native_flags = 0;
-#endif
 
 #if APR_HAS_LARGE_FILES && defined(HAVE_MMAP64)
 #define mmap mmap64
@@ -99,6 +116,51 @@ APR_DECLARE(apr_status_t) apr_mmap_create(apr_mmap_t **new,
         return APR_EINVAL;
 #endif
 
+    if (flag & APR_MMAP_WRITE) {
+        native_flags |= PROT_WRITE;
+    }
+    if (flag & APR_MMAP_READ) {
+        native_flags |= PROT_READ;
+    }
+
+#if defined(_SC_PAGESIZE)
+    if (psize == 0) {
+        psize = sysconf(_SC_PAGESIZE);
+        /* the page size should be a power of two */
+        assert(psize > 0 && (psize & (psize - 1)) == 0);
+    }
+    poffset = offset & (apr_off_t)(psize - 1);
+#endif
+
+    mm = mmap(NULL, size + poffset,
+              native_flags, MAP_SHARED,
+              file->filedes, offset - poffset);
+
+    if (mm == (void *)-1) {
+        /* we failed to get an mmap'd file... */
+        return errno;
+    }
+
+    *mmp = (char *)mm + poffset;
+    *poffsetp = poffset;
+    return APR_SUCCESS;
+}
+#endif /* !BEOS */
+
+APR_DECLARE(apr_status_t) apr_mmap_create(apr_mmap_t **new,
+                                          apr_file_t *file, apr_off_t offset,
+                                          apr_size_t size, apr_int32_t flag,
+                                          apr_pool_t *cont)
+{
+    void *mm;
+#ifdef BEOS
+    area_id aid = -1;
+    uint32 pages = 0;
+#else
+    apr_off_t poffset;
+    apr_status_t rv;
+#endif
+
     if (size == 0)
         return APR_EINVAL;
 
@@ -130,34 +192,12 @@ APR_DECLARE(apr_status_t) apr_mmap_create(apr_mmap_t **new,
     (*new)->area = aid;
 #else
 
-    if (flag & APR_MMAP_WRITE) {
-        native_flags |= PROT_WRITE;
-    }
-    if (flag & APR_MMAP_READ) {
-        native_flags |= PROT_READ;
-    }
-
-#if defined(_SC_PAGESIZE)
-    if (psize == 0) {
-        psize = sysconf(_SC_PAGESIZE);
-        /* the page size should be a power of two */
-        assert(psize > 0 && (psize & (psize - 1)) == 0);
-    }
-    poffset = offset & (apr_off_t)(psize - 1);
-    (*new)->poffset = poffset;
-#endif
-
-    mm = mmap(NULL, size + poffset,
-              native_flags, MAP_SHARED,
-              file->filedes, offset - poffset);
-
-    if (mm == (void *)-1) {
-        /* we failed to get an mmap'd file... */
+    rv = map_region(&mm, &poffset, file, offset, size, flag);
+    if (rv != APR_SUCCESS) {
         *new = NULL;
-        return errno;
+        return rv;
     }
-
-    mm = (char *)mm + poffset;
+    (*new)->poffset = poffset;
 #endif
 
     (*new)->mm = mm;
@@ -190,4 +230,249 @@ APR_DECLARE(apr_status_t) apr_mmap_delete(apr_mmap_t *mm)
     return apr_pool_cleanup_run(mm->cntxt, mm, mmap_cleanup);
 }
 
+#ifndef BEOS
+/*
+ * Cache of mappings
+ */
+
+typedef struct cache_key_t {
+    apr_dev_t device;
+    apr_ino_t inode;
+    apr_time_t mtime;
+    apr_off_t offset;
+    apr_size_t size;
+} cache_key_t;
+
+struct apr_mmap_cache_entry_t {
+    APR_RING_ENTRY(apr_mmap_cache_entry_t) link;
+    apr_mmap_cache_t *cache;
+    cache_key_t key;
+    void *mm;
+    apr_off_t poffset;
+    /** Number of rings of apr_mmap_t using the region */
+    apr_size_t refs;
+    /** Whether the entry was evicted, and unmapped once unreferenced */
+    int evicted;
+};
+
+struct apr_mmap_cache_t {
+    apr_pool_t *pool;
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex;
+#endif
+    /** The entries by key */
+    apr_hash_t *entries;
+    /** The unreferenced entries, the least recently used last */
+    APR_RING_HEAD(cache_lru_t, apr_mmap_cache_entry_t) lru;
+    /** Total and maximum size of the unreferenced entries */
+    apr_size_t lru_bytes;
+    apr_size_t max_bytes;
+};
+
+static APR_INLINE void cache_lock(apr_mmap_cache_t *cache)
+{
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(cache->mutex);
+#endif
+}
+
+static APR_INLINE void cache_unlock(apr_mmap_cache_t *cache)
+{
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(cache->mutex);
+#endif
+}
+
+static void entry_unmap(struct apr_mmap_cache_entry_t *entry)
+{
+    munmap((char *)entry->mm - entry->poffset,
+           entry->key.size + entry->poffset);
+    free(entry);
+}
+
+/* Evict the least recently used entries beyond max_bytes, with the cache
+ * locked.
+ */
+static void cache_trim(apr_mmap_cache_t *cache)
+{
+    struct apr_mmap_cache_entry_t *entry;
+
+    while (cache->lru_bytes > cache->max_bytes) {
+        entry = APR_RING_LAST(&cache->lru);
+        APR_RING_REMOVE(entry, link);
+        cache->lru_bytes -= entry->key.size;
+        apr_hash_set(cache->entries, &entry->key, sizeof(entry->key), NULL);
+        entry_unmap(entry);
+    }
+}
+
+static void cache_release(struct apr_mmap_cache_entry_t *entry)
+{
+    apr_mmap_cache_t *cache = entry->cache;
+
+    cache_lock(cache);
+
+    if (--entry->refs == 0) {
+        if (entry->evicted) {
+            entry_unmap(entry);
+        }
+        else {
+            APR_RING_INSERT_HEAD(&cache->lru, entry,
+                                 apr_mmap_cache_entry_t, link);
+            cache->lru_bytes += entry->key.size;
+            cache_trim(cache);
+        }
+    }
+
+    cache_unlock(cache);
+}
+
+static apr_status_t cache_cleanup(void *data)
+{
+    apr_mmap_cache_t *cache = data;
+    struct apr_mmap_cache_entry_t *entry;
+    apr_hash_index_t *hi;
+
+    /* The referenced entries are unmapped when released */
+    for (hi = apr_hash_first(NULL, cache->entries); hi;
+         hi = apr_hash_next(hi)) {
+        entry = apr_hash_this_val(hi);
+        entry->evicted = 1;
+    }
+    while (!APR_RING_EMPTY(&cache->lru, apr_mmap_cache_entry_t, link)) {
+        entry = APR_RING_FIRST(&cache->lru);
+        APR_RING_REMOVE(entry, link);
+        entry_unmap(entry);
+    }
+    cache->lru_bytes = 0;
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_mmap_cache_create(apr_mmap_cache_t **newcache,
+                                                apr_size_t max_bytes,
+                                                apr_pool_t *pool)
+{
+    apr_mmap_cache_t *cache;
+
+    cache = apr_pcalloc(pool, sizeof(*cache));
+    cache->pool = pool;
+#if APR_HAS_THREADS
+    {
+        apr_status_t rv = apr_thread_mutex_create(&cache->mutex,
+                                                  APR_THREAD_MUTEX_DEFAULT,
+                                                  pool);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+    }
+#endif
+    cache->entries = apr_hash_make(pool);
+    APR_RING_INIT(&cache->lru, apr_mmap_cache_entry_t, link);
+    cache->max_bytes = max_bytes;
+
+    apr_pool_cleanup_register(pool, cache, cache_cleanup,
+                              apr_pool_cleanup_null);
+
+    *newcache = cache;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_mmap_cache_get(apr_mmap_t **new,
+                                             apr_mmap_cache_t *cache,
+                                             apr_file_t *file,
+                                             apr_off_t offset,
+                                             apr_size_t size,
+                                             apr_pool_t *pool)
+{
+    struct apr_mmap_cache_entry_t *entry;
+    apr_finfo_t finfo;
+    cache_key_t key;
+    apr_status_t rv;
+
+    if (size == 0)
+        return APR_EINVAL;
+
+    if (file == NULL || file->filedes == -1 || file->buffered)
+        return APR_EBADF;
+
+    rv = apr_file_info_get(&finfo, APR_FINFO_IDENT | APR_FINFO_MTIME, file);
+    if (rv != APR_SUCCESS && rv != APR_INCOMPLETE) {
+        return rv;
+    }
+    if ((finfo.valid & (APR_FINFO_IDENT | APR_FINFO_MTIME))
+        != (APR_FINFO_IDENT | APR_FINFO_MTIME)) {
+        return apr_mmap_create(new, file, offset, size, APR_MMAP_READ, pool);
+    }
+
+    memset(&key, 0, sizeof(key));
+    key.device = finfo.device;
+    key.inode = finfo.inode;
+    key.mtime = finfo.mtime;
+    key.offset = offset;
+    key.size = size;
+
+    cache_lock(cache);
+
+    entry = apr_hash_get(cache->entries, &key, sizeof(key));
+    if (entry == NULL) {
+        entry = calloc(1, sizeof(*entry));
+        if (entry == NULL) {
+            cache_unlock(cache);
+            return APR_ENOMEM;
+        }
+        rv = map_region(&entry->mm, &entry->poffset, file, offset, size,
+                        APR_MMAP_READ);
+        if (rv != APR_SUCCESS) {
+            cache_unlock(cache);
+            free(entry);
+            return rv;
+        }
+        entry->cache = cache;
+        entry->key = key;
+        apr_hash_set(cache->entries, &entry->key, sizeof(entry->key), entry);
+    }
+    else if (entry->refs == 0) {
+        /* in use again */
+        APR_RING_REMOVE(entry, link);
+        cache->lru_bytes -= size;
+    }
+    entry->refs++;
+
+    cache_unlock(cache);
+
+    (*new) = apr_pcalloc(pool, sizeof(apr_mmap_t));
+    (*new)->poffset = entry->poffset;
+    (*new)->centry = entry;
+    (*new)->mm = entry->mm;
+    (*new)->size = size;
+    (*new)->cntxt = pool;
+    APR_RING_ELEM_INIT(*new, link);
+
+    apr_pool_cleanup_register(pool, *new, mmap_cleanup,
+                              apr_pool_cleanup_null);
+    return APR_SUCCESS;
+}
+
+#else /* BEOS */
+
+APR_DECLARE(apr_status_t) apr_mmap_cache_create(apr_mmap_cache_t **newcache,
+                                                apr_size_t max_bytes,
+                                                apr_pool_t *pool)
+{
+    return APR_ENOTIMPL;
+}
+
+APR_DECLARE(apr_status_t) apr_mmap_cache_get(apr_mmap_t **new,
+                                             apr_mmap_cache_t *cache,
+                                             apr_file_t *file,
+                                             apr_off_t offset,
+                                             apr_size_t size,
+                                             apr_pool_t *pool)
+{
+    return APR_ENOTIMPL;
+}
+
+#endif /* BEOS */
+
 #endif
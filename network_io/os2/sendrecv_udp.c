@@ -114,3 +114,99 @@ APR_DECLARE(apr_status_t) apr_socket_recvfrom(apr_sockaddr_t *from,
         }
     } while (1);
 }
+
+
+/* Without a batched system call the datagrams are sent one by one, and
+ * one is received at most since the next one could block.  They must
+ * have a single buffer and no segments.
+ */
+static int mmsg_supported(const apr_socket_msg_t *msg)
+{
+    return msg->nvec == 1 && !msg->segment_size;
+}
+
+
+static apr_status_t mmsg_one(apr_socket_t *sock, apr_socket_msg_t *msg,
+                             apr_int32_t flags, int sending)
+{
+    msg->len = msg->vec[0].iov_len;
+    if (sending) {
+        if (!msg->addr) {
+            return apr_socket_send(sock, msg->vec[0].iov_base, &msg->len);
+        }
+        return apr_socket_sendto(sock, msg->addr, flags,
+                                 msg->vec[0].iov_base, &msg->len);
+    }
+    if (!msg->addr) {
+        return apr_socket_recv(sock, msg->vec[0].iov_base, &msg->len);
+    }
+    return apr_socket_recvfrom(msg->addr, sock, flags,
+                               msg->vec[0].iov_base, &msg->len);
+}
+
+
+APR_DECLARE(apr_status_t) apr_socket_sendmmsg(apr_socket_t *sock,
+                                              apr_socket_msg_t *msgs,
+                                              apr_int32_t *nmsgs,
+                                              apr_int32_t flags)
+{
+    apr_int32_t i;
+    apr_status_t rv = APR_SUCCESS;
+
+    for (i = 0; i < *nmsgs; i++) {
+        if (!mmsg_supported(&msgs[i])) {
+            *nmsgs = 0;
+            return APR_ENOTIMPL;
+        }
+    }
+    for (i = 0; i < *nmsgs; i++) {
+        rv = mmsg_one(sock, &msgs[i], flags, 1);
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+    }
+    *nmsgs = i;
+    return i ? APR_SUCCESS : rv;
+}
+
+
+APR_DECLARE(apr_status_t) apr_socket_recvmmsg(apr_socket_t *sock,
+                                              apr_socket_msg_t *msgs,
+                                              apr_int32_t *nmsgs,
+                                              apr_int32_t flags)
+{
+    apr_status_t rv;
+
+    if (*nmsgs <= 0) {
+        *nmsgs = 0;
+        return APR_SUCCESS;
+    }
+    if (!mmsg_supported(&msgs[0])) {
+        *nmsgs = 0;
+        return APR_ENOTIMPL;
+    }
+    rv = mmsg_one(sock, &msgs[0], flags, 0);
+    *nmsgs = (rv == APR_SUCCESS);
+    return rv;
+}
+
+
+APR_DECLARE(apr_status_t) apr_socket_send_descriptors(apr_socket_t *sock,
+                                   const char *buf, apr_size_t *len,
+                                   const apr_socket_descriptor_t *descs,
+                                   int ndescs)
+{
+    *len = 0;
+    return APR_ENOTIMPL;
+}
+
+
+APR_DECLARE(apr_status_t) apr_socket_recv_descriptors(apr_socket_t *sock,
+                                   char *buf, apr_size_t *len,
+                                   apr_socket_descriptor_t *descs,
+                                   int *ndescs, apr_pool_t *pool)
+{
+    *len = 0;
+    *ndescs = 0;
+    return APR_ENOTIMPL;
+}
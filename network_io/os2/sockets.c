@@ -164,6 +164,18 @@ APR_DECLARE(apr_status_t) apr_socket_listen(apr_socket_t *sock,
         return APR_SUCCESS;
 }
 
+APR_DECLARE(apr_status_t) apr_socket_reuseport_group(apr_socket_t **socks,
+                                                     int num,
+                                                     apr_sockaddr_t *sa,
+                                                     int type, int protocol,
+                                                     apr_int32_t backlog,
+                                                     apr_int32_t flags,
+                                                     apr_pool_t *p)
+{
+    /* No SO_REUSEPORT load balancing */
+    return APR_ENOTIMPL;
+}
+
 APR_DECLARE(apr_status_t) apr_socket_accept(apr_socket_t **new,
                                             apr_socket_t *sock,
                                             apr_pool_t *connection_context)
@@ -196,6 +208,23 @@ APR_DECLARE(apr_status_t) apr_socket_accept(apr_socket_t **new,
     return APR_SUCCESS;
 }
 
+APR_DECLARE(apr_status_t) apr_socket_accept_batch(apr_socket_t **new_socks,
+                                                  apr_int32_t *num,
+                                                  apr_socket_t *sock,
+                                                  apr_pool_t **connection_pools)
+{
+    apr_status_t rv;
+
+    /* One connection per call */
+    if (*num <= 0) {
+        *num = 0;
+        return APR_SUCCESS;
+    }
+    rv = apr_socket_accept(&new_socks[0], sock, connection_pools[0]);
+    *num = (rv == APR_SUCCESS);
+    return rv;
+}
+
 APR_DECLARE(apr_status_t) apr_socket_connect(apr_socket_t *sock,
                                              apr_sockaddr_t *sa)
 {
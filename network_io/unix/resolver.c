@@ -0,0 +1,596 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr.h"
+#include "apr_resolver.h"
+#include "apr_hash.h"
+#include "apr_strings.h"
+#include "apr_atomic.h"
+#include "apr_allocator.h"
+#include "apr_thread_pool.h"
+#include "apr_thread_mutex.h"
+#include "apr_thread_cond.h"
+#include "apr_arch_networkio.h"
+#include "apr_arch_poll_private.h"
+
+/*
+ * The cache maps family, flags and host name to a cache entry, which owns
+ * a subpool of the resolver holding the addresses of apr_sockaddr_info_get(),
+ * resolved without a port.  Entries are reference counted: by the cache,
+ * by a resolution running and by each request completed but not processed
+ * yet, so that an entry removed from the cache stays valid for them.
+ *
+ * The resolver has its own allocator, with a mutex, since the subpools are
+ * used by the threads of the resolver; they are created and destroyed with
+ * the resolver lock held.
+ */
+
+#if APR_HAS_THREADS
+#define resolver_lock(r)   apr_thread_mutex_lock((r)->lock)
+#define resolver_unlock(r) apr_thread_mutex_unlock((r)->lock)
+#else
+#define resolver_lock(r)
+#define resolver_unlock(r)
+#endif
+
+typedef struct resolver_entry_t resolver_entry_t;
+typedef struct resolver_req_t resolver_req_t;
+
+struct resolver_entry_t {
+    apr_pool_t *pool;
+    const char *key;
+    const char *hostname;
+    apr_int32_t family;
+    apr_int32_t flags;
+    apr_uint32_t refs;
+    /* In the cache */
+    int cached;
+    /* Being resolved, the requests waiting for it */
+    int resolving;
+    resolver_req_t *waiting;
+    resolver_req_t **waiting_tail;
+    apr_status_t status;
+    apr_sockaddr_t *sa;
+    apr_time_t expires;
+};
+
+struct resolver_req_t {
+    resolver_req_t *next;
+    resolver_entry_t *entry;
+    apr_port_t port;
+    apr_resolver_cb_t func;
+    void *baton;
+    apr_pool_t *pool;
+};
+
+struct apr_resolver_t {
+    apr_pool_t *pool;
+    apr_hash_t *cache;
+    apr_interval_time_t ttl;
+    apr_interval_time_t negative_ttl;
+    apr_uint32_t flags;
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *lock;
+    /* Signaled when a resolution completes */
+    apr_thread_cond_t *cond;
+    apr_thread_pool_t *tp;
+#endif
+    /* Completed, not processed yet */
+    resolver_req_t *done;
+    resolver_req_t **done_tail;
+#if WAKEUP_USES_PIPE
+    apr_file_t *wakeup_pipe[2];
+#else
+    apr_socket_t *wakeup_socket[2];
+#endif
+    apr_pollfd_t wakeup_pfd;
+    volatile apr_uint32_t wakeup_set;
+};
+
+static apr_status_t resolver_cleanup(void *data)
+{
+    apr_resolver_t *resolver = data;
+
+#if APR_HAS_THREADS
+    /* Cancels the resolutions not started, and waits for the others */
+    if (resolver->tp) {
+        apr_thread_pool_destroy(resolver->tp);
+        resolver->tp = NULL;
+    }
+#endif
+#if WAKEUP_USES_PIPE
+    apr_poll_close_wakeup_pipe(resolver->wakeup_pipe);
+#else
+    apr_poll_close_wakeup_socket(resolver->wakeup_socket);
+#endif
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_resolver_create(apr_resolver_t **ret_resolver,
+                                              apr_int32_t nthreads,
+                                              apr_interval_time_t ttl,
+                                              apr_interval_time_t negative_ttl,
+                                              apr_uint32_t flags,
+                                              apr_pool_t *p)
+{
+    apr_resolver_t *resolver;
+    apr_allocator_t *allocator;
+    apr_pool_t *pool;
+    apr_status_t rv;
+
+    *ret_resolver = NULL;
+    if (nthreads < 0) {
+        return APR_EINVAL;
+    }
+#if !APR_HAS_THREADS
+    if (nthreads) {
+        return APR_ENOTIMPL;
+    }
+#endif
+
+    if ((rv = apr_allocator_create(&allocator)) != APR_SUCCESS) {
+        return rv;
+    }
+    if ((rv = apr_pool_create_ex(&pool, p, NULL, allocator)) != APR_SUCCESS) {
+        apr_allocator_destroy(allocator);
+        return rv;
+    }
+    apr_allocator_owner_set(allocator, pool);
+    apr_pool_tag(pool, "apr_resolver");
+
+    resolver = apr_pcalloc(pool, sizeof(*resolver));
+    resolver->pool = pool;
+    resolver->cache = apr_hash_make(pool);
+    resolver->ttl = ttl;
+    resolver->negative_ttl = negative_ttl;
+    resolver->flags = flags;
+    resolver->done_tail = &resolver->done;
+
+#if APR_HAS_THREADS
+    {
+        apr_thread_mutex_t *mutex;
+
+        if ((rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT,
+                                          pool)) != APR_SUCCESS) {
+            apr_pool_destroy(pool);
+            return rv;
+        }
+        apr_allocator_mutex_set(allocator, mutex);
+    }
+    if ((rv = apr_thread_mutex_create(&resolver->lock,
+                                      APR_THREAD_MUTEX_DEFAULT,
+                                      pool)) != APR_SUCCESS
+        || (rv = apr_thread_cond_create(&resolver->cond,
+                                        pool)) != APR_SUCCESS) {
+        apr_pool_destroy(pool);
+        return rv;
+    }
+    if (nthreads) {
+        if ((rv = apr_thread_pool_create(&resolver->tp, 0, nthreads,
+                                         pool)) != APR_SUCCESS) {
+            apr_pool_destroy(pool);
+            return rv;
+        }
+    }
+#endif
+
+#if WAKEUP_USES_PIPE
+    rv = apr_poll_create_wakeup_pipe(pool, &resolver->wakeup_pfd,
+                                     resolver->wakeup_pipe);
+#else
+    rv = apr_poll_create_wakeup_socket(pool, &resolver->wakeup_pfd,
+                                       resolver->wakeup_socket);
+#endif
+    if (rv != APR_SUCCESS) {
+        apr_pool_destroy(pool);
+        return rv;
+    }
+    resolver->wakeup_pfd.client_data = resolver;
+
+    /* Before the subpools of the entries are destroyed */
+    apr_pool_pre_cleanup_register(pool, resolver, resolver_cleanup);
+
+    *ret_resolver = resolver;
+    return APR_SUCCESS;
+}
+
+/* Called with the lock held */
+static void entry_release(resolver_entry_t *entry)
+{
+    if (--entry->refs == 0) {
+        apr_pool_destroy(entry->pool);
+    }
+}
+
+/* Called with the lock held */
+static void entry_uncache(apr_resolver_t *resolver, resolver_entry_t *entry)
+{
+    if (entry->cached) {
+        apr_hash_set(resolver->cache, entry->key, APR_HASH_KEY_STRING, NULL);
+        entry->cached = 0;
+        entry_release(entry);
+    }
+}
+
+/* Find a usable entry in the cache, called with the lock held */
+static resolver_entry_t *entry_find(apr_resolver_t *resolver,
+                                    const char *key)
+{
+    resolver_entry_t *entry;
+
+    entry = apr_hash_get(resolver->cache, key, APR_HASH_KEY_STRING);
+    if (entry && !entry->resolving && entry->expires <= apr_time_now()) {
+        entry_uncache(resolver, entry);
+        entry = NULL;
+    }
+    return entry;
+}
+
+/* Create a resolving entry in the cache, with a reference for the
+ * resolution; called with the lock held
+ */
+static apr_status_t entry_create(resolver_entry_t **ret_entry,
+                                 apr_resolver_t *resolver, const char *key,
+                                 const char *hostname, apr_int32_t family,
+                                 apr_int32_t flags)
+{
+    resolver_entry_t *entry;
+    apr_pool_t *pool;
+    apr_status_t rv;
+
+    if ((rv = apr_pool_create(&pool, resolver->pool)) != APR_SUCCESS) {
+        return rv;
+    }
+    entry = apr_pcalloc(pool, sizeof(*entry));
+    entry->pool = pool;
+    entry->key = apr_pstrdup(pool, key);
+    entry->hostname = apr_pstrdup(pool, hostname);
+    entry->family = family;
+    entry->flags = flags;
+    entry->refs = 2;
+    entry->cached = 1;
+    entry->resolving = 1;
+    entry->waiting_tail = &entry->waiting;
+    apr_hash_set(resolver->cache, entry->key, APR_HASH_KEY_STRING, entry);
+
+    *ret_entry = entry;
+    return APR_SUCCESS;
+}
+
+/* Called with the lock held */
+static void req_complete(apr_resolver_t *resolver, resolver_req_t *req)
+{
+    req->entry->refs++;
+    req->next = NULL;
+    *resolver->done_tail = req;
+    resolver->done_tail = &req->next;
+
+    if (apr_atomic_cas32(&resolver->wakeup_set, 1, 0) == 0) {
+#if WAKEUP_USES_PIPE
+        apr_poll_send_wakeup_pipe(resolver->wakeup_pipe);
+#else
+        apr_size_t len = 1;
+        apr_socket_send(resolver->wakeup_socket[1], "\1", &len);
+#endif
+    }
+}
+
+/* Record the result of a resolution, complete the requests waiting for it
+ * and drop the reference of the resolution
+ */
+static void entry_resolved(apr_resolver_t *resolver, resolver_entry_t *entry,
+                           apr_status_t status, apr_sockaddr_t *sa)
+{
+    resolver_req_t *req;
+
+    resolver_lock(resolver);
+    entry->status = status;
+    entry->sa = status == APR_SUCCESS ? sa : NULL;
+    entry->expires = apr_time_now()
+        + (status == APR_SUCCESS ? resolver->ttl : resolver->negative_ttl);
+    entry->resolving = 0;
+    while ((req = entry->waiting) != NULL) {
+        entry->waiting = req->next;
+        req_complete(resolver, req);
+    }
+    entry->waiting_tail = &entry->waiting;
+#if APR_HAS_THREADS
+    apr_thread_cond_broadcast(resolver->cond);
+#endif
+    entry_release(entry);
+    resolver_unlock(resolver);
+}
+
+static void entry_resolve(apr_resolver_t *resolver, resolver_entry_t *entry)
+{
+    apr_sockaddr_t *sa = NULL;
+    apr_status_t rv;
+
+    rv = apr_sockaddr_info_get(&sa, entry->hostname, entry->family, 0,
+                               entry->flags, entry->pool);
+    entry_resolved(resolver, entry, rv, sa);
+}
+
+#if APR_HAS_THREADS
+typedef struct resolver_task_t {
+    apr_resolver_t *resolver;
+    resolver_entry_t *entry;
+} resolver_task_t;
+
+static void *APR_THREAD_FUNC resolver_task(apr_thread_t *thd, void *data)
+{
+    resolver_task_t *task = data;
+
+    entry_resolve(task->resolver, task->entry);
+    return NULL;
+}
+#endif
+
+/* Order the addresses by alternating their families, from the family of
+ * the first one (RFC 8305 section 4)
+ */
+static apr_sockaddr_t *interleave_families(apr_sockaddr_t *sa)
+{
+    apr_sockaddr_t *first = NULL, **first_tail = &first;
+    apr_sockaddr_t *other = NULL, **other_tail = &other;
+    apr_sockaddr_t *head = NULL, **tail = &head;
+    apr_int32_t family = sa->family;
+
+    while (sa) {
+        apr_sockaddr_t *next = sa->next;
+
+        sa->next = NULL;
+        if (sa->family == family) {
+            *first_tail = sa;
+            first_tail = &sa->next;
+        }
+        else {
+            *other_tail = sa;
+            other_tail = &sa->next;
+        }
+        sa = next;
+    }
+    while (first || other) {
+        if (first) {
+            *tail = first;
+            tail = &first->next;
+            first = first->next;
+        }
+        if (other) {
+            *tail = other;
+            tail = &other->next;
+            other = other->next;
+        }
+    }
+    *tail = NULL;
+    return head;
+}
+
+/* Copy the addresses of a resolved entry, with the port of the request */
+static apr_status_t entry_copy(apr_sockaddr_t **ret_sa,
+                               apr_resolver_t *resolver,
+                               resolver_entry_t *entry, apr_port_t port,
+                               apr_pool_t *p)
+{
+    apr_sockaddr_t *sa, *cur;
+    apr_status_t rv;
+
+    *ret_sa = NULL;
+    if (entry->status != APR_SUCCESS) {
+        return entry->status;
+    }
+    if ((rv = apr_sockaddr_info_copy(&sa, entry->sa, p)) != APR_SUCCESS) {
+        return rv;
+    }
+    for (cur = sa; cur; cur = cur->next) {
+#if APR_HAVE_SOCKADDR_UN
+        if (cur->family == APR_UNIX) {
+            continue;
+        }
+#endif
+        apr_sockaddr_vars_set(cur, cur->family, port);
+    }
+    if (resolver->flags & APR_RESOLVER_HAPPY_EYEBALLS) {
+        sa = interleave_families(sa);
+    }
+
+    *ret_sa = sa;
+    return APR_SUCCESS;
+}
+
+static const char *cache_key(apr_pool_t *p, const char *hostname,
+                             apr_int32_t family, apr_int32_t flags)
+{
+    return apr_psprintf(p, "%d/%d/%s", family, flags,
+                        hostname ? hostname : "");
+}
+
+APR_DECLARE(apr_status_t) apr_resolver_lookup(apr_sockaddr_t **sa,
+                                              apr_resolver_t *resolver,
+                                              const char *hostname,
+                                              apr_int32_t family,
+                                              apr_port_t port,
+                                              apr_int32_t flags,
+                                              apr_pool_t *p)
+{
+    const char *key = cache_key(p, hostname, family, flags);
+    resolver_entry_t *entry;
+    apr_status_t rv;
+
+    resolver_lock(resolver);
+    entry = entry_find(resolver, key);
+    if (entry) {
+        entry->refs++;
+#if APR_HAS_THREADS
+        /* Wait for the resolution running */
+        while (entry->resolving) {
+            apr_thread_cond_wait(resolver->cond, resolver->lock);
+        }
+#endif
+        resolver_unlock(resolver);
+    }
+    else {
+        rv = entry_create(&entry, resolver, key, hostname, family, flags);
+        if (rv != APR_SUCCESS) {
+            resolver_unlock(resolver);
+            return rv;
+        }
+        /* One more reference, for this lookup */
+        entry->refs++;
+        resolver_unlock(resolver);
+
+        entry_resolve(resolver, entry);
+    }
+
+    rv = entry_copy(sa, resolver, entry, port, p);
+
+    resolver_lock(resolver);
+    entry_release(entry);
+    resolver_unlock(resolver);
+
+    return rv;
+}
+
+APR_DECLARE(apr_status_t) apr_resolver_resolve(apr_resolver_t *resolver,
+                                               const char *hostname,
+                                               apr_int32_t family,
+                                               apr_port_t port,
+                                               apr_int32_t flags,
+                                               apr_resolver_cb_t func,
+                                               void *baton,
+                                               apr_pool_t *p)
+{
+    const char *key = cache_key(p, hostname, family, flags);
+    resolver_entry_t *entry;
+    resolver_req_t *req;
+    apr_status_t rv;
+
+    req = apr_palloc(p, sizeof(*req));
+    req->port = port;
+    req->func = func;
+    req->baton = baton;
+    req->pool = p;
+
+    resolver_lock(resolver);
+    entry = entry_find(resolver, key);
+    if (entry) {
+        req->entry = entry;
+        if (entry->resolving) {
+            req->next = NULL;
+            *entry->waiting_tail = req;
+            entry->waiting_tail = &req->next;
+        }
+        else {
+            req_complete(resolver, req);
+        }
+        resolver_unlock(resolver);
+        return APR_SUCCESS;
+    }
+
+    rv = entry_create(&entry, resolver, key, hostname, family, flags);
+    if (rv != APR_SUCCESS) {
+        resolver_unlock(resolver);
+        return rv;
+    }
+    req->entry = entry;
+    req->next = NULL;
+    *entry->waiting_tail = req;
+    entry->waiting_tail = &req->next;
+
+#if APR_HAS_THREADS
+    if (resolver->tp) {
+        resolver_task_t *task = apr_palloc(entry->pool, sizeof(*task));
+
+        task->resolver = resolver;
+        task->entry = entry;
+        rv = apr_thread_pool_push(resolver->tp, resolver_task, task,
+                                  APR_THREAD_TASK_PRIORITY_NORMAL, resolver);
+        resolver_unlock(resolver);
+        if (rv != APR_SUCCESS) {
+            /* Processed as failed */
+            entry_resolved(resolver, entry, rv, NULL);
+        }
+        return APR_SUCCESS;
+    }
+#endif
+    resolver_unlock(resolver);
+
+    /* No threads, resolved here and processed as usual */
+    entry_resolve(resolver, entry);
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_resolver_pollfd_get(const apr_pollfd_t **pfd,
+                                                  apr_resolver_t *resolver)
+{
+    *pfd = &resolver->wakeup_pfd;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_resolver_process(apr_resolver_t *resolver,
+                                               apr_int32_t *num)
+{
+    resolver_req_t *req, *done;
+    apr_int32_t n = 0;
+
+    if (apr_atomic_read32(&resolver->wakeup_set)) {
+#if WAKEUP_USES_PIPE
+        apr_poll_drain_wakeup_pipe(&resolver->wakeup_set,
+                                   resolver->wakeup_pipe);
+#else
+        apr_poll_drain_wakeup_socket(&resolver->wakeup_set,
+                                     resolver->wakeup_socket);
+#endif
+    }
+
+    resolver_lock(resolver);
+    done = resolver->done;
+    resolver->done = NULL;
+    resolver->done_tail = &resolver->done;
+    resolver_unlock(resolver);
+
+    while ((req = done) != NULL) {
+        apr_sockaddr_t *sa;
+        apr_status_t rv;
+
+        done = req->next;
+        rv = entry_copy(&sa, resolver, req->entry, req->port, req->pool);
+
+        resolver_lock(resolver);
+        entry_release(req->entry);
+        resolver_unlock(resolver);
+
+        req->func(req->baton, rv, sa);
+        n++;
+    }
+
+    if (num) {
+        *num = n;
+    }
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(void) apr_resolver_clear(apr_resolver_t *resolver)
+{
+    apr_hash_index_t *hi;
+
+    resolver_lock(resolver);
+    for (hi = apr_hash_first(NULL, resolver->cache); hi;
+         hi = apr_hash_next(hi)) {
+        entry_uncache(resolver, apr_hash_this_val(hi));
+    }
+    resolver_unlock(resolver);
+}
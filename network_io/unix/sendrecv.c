@@ -16,21 +16,88 @@
 
 #include "apr_arch_networkio.h"
 #include "apr_support.h"
+#include "apr_probes.h"
 
-#if APR_HAS_SENDFILE
 /* This file is needed to allow us access to the apr_file_t internals. */
 #include "apr_arch_file_io.h"
-#endif /* APR_HAS_SENDFILE */
+#include "apr_portable.h"
 
 /* osreldate.h is only needed on FreeBSD for sendfile detection */
 #if defined(__FreeBSD__)
 #include <osreldate.h>
 #endif
 
+#ifdef HAVE_LINUX_ERRQUEUE_H
+#include <linux/errqueue.h>
+#endif
+
+#if defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define SEND_ZEROCOPY 1
+#endif
+
+/* write() and writev(), with MSG_ZEROCOPY for APR_SO_ZEROCOPY */
+static apr_ssize_t sock_write(apr_socket_t *sock, const char *buf,
+                              apr_size_t len)
+{
+#ifdef SEND_ZEROCOPY
+    if (apr_is_option_set(sock, APR_SO_ZEROCOPY)) {
+        apr_ssize_t rv = send(sock->socketdes, buf, len, MSG_ZEROCOPY);
+        if (rv > 0) {
+            sock->zerocopy_seq++;
+        }
+        return rv;
+    }
+#endif
+    return write(sock->socketdes, buf, len);
+}
+
+#ifdef HAVE_WRITEV
+static apr_ssize_t sock_writev(apr_socket_t *sock, const struct iovec *vec,
+                               apr_int32_t nvec)
+{
+#ifdef SEND_ZEROCOPY
+    if (apr_is_option_set(sock, APR_SO_ZEROCOPY)) {
+        struct msghdr msg;
+        apr_ssize_t rv;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = (struct iovec *)vec;
+        msg.msg_iovlen = nvec;
+        rv = sendmsg(sock->socketdes, &msg, MSG_ZEROCOPY);
+        if (rv > 0) {
+            sock->zerocopy_seq++;
+        }
+        return rv;
+    }
+#endif
+    return writev(sock->socketdes, vec, nvec);
+}
+#endif
+
+/* Wait for the socket after EAGAIN, which with APR_SO_KERNEL_TIMEOUT
+ * means that the system call timed out already (the descriptor is
+ * blocking, and the APR_INCOMPLETE_* flags are never set).
+ */
+static APR_INLINE apr_status_t sock_wait(apr_socket_t *sock, int for_read)
+{
+    if (apr_is_option_set(sock, APR_SO_KERNEL_TIMEOUT)) {
+        return APR_TIMEUP;
+    }
+    return apr_wait_for_io_or_timeout(NULL, sock, for_read);
+}
+
+/* Whether the next call should wait first, after a partial transfer or
+ * with APR_SO_ADAPTIVE_WAIT when this one returned EAGAIN */
+#define sock_wait_next(sock, partial, waited) \
+    (apr_socket_timeout_polled(sock) \
+     && ((partial) || ((waited) \
+                       && apr_is_option_set(sock, APR_SO_ADAPTIVE_WAIT))))
+
 apr_status_t apr_socket_send(apr_socket_t *sock, const char *buf,
                              apr_size_t *len)
 {
     apr_ssize_t rv;
+    int waited = 0;
 
     if (sock->options & APR_INCOMPLETE_WRITE) {
         sock->options &= ~APR_INCOMPLETE_WRITE;
@@ -38,21 +105,25 @@ apr_status_t apr_socket_send(apr_socket_t *sock, const char *buf,
     }
 
     do {
-        rv = write(sock->socketdes, buf, (*len));
+        rv = sock_write(sock, buf, (*len));
     } while (rv == -1 && errno == EINTR);
 
     while (rv == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)
                     && (sock->timeout > 0)) {
         apr_status_t arv;
+        waited = 1;
 do_select:
-        arv = apr_wait_for_io_or_timeout(NULL, sock, 0);
+        arv = sock_wait(sock, 0);
         if (arv != APR_SUCCESS) {
+            if (sock_wait_next(sock, 0, waited)) {
+                sock->options |= APR_INCOMPLETE_WRITE;
+            }
             *len = 0;
             return arv;
         }
         else {
             do {
-                rv = write(sock->socketdes, buf, (*len));
+                rv = sock_write(sock, buf, (*len));
             } while (rv == -1 && errno == EINTR);
         }
     }
@@ -60,10 +131,11 @@ do_select:
         *len = 0;
         return errno;
     }
-    if ((sock->timeout > 0) && (rv < *len)) {
+    if (sock_wait_next(sock, rv < *len, waited)) {
         sock->options |= APR_INCOMPLETE_WRITE;
     }
     (*len) = rv;
+    APR_PROBE2(socket__send, sock, rv);
     return APR_SUCCESS;
 }
 
@@ -71,6 +143,7 @@ apr_status_t apr_socket_recv(apr_socket_t *sock, char *buf, apr_size_t *len)
 {
     apr_ssize_t rv;
     apr_status_t arv;
+    int waited = 0;
 
     if (sock->options & APR_INCOMPLETE_READ) {
         sock->options &= ~APR_INCOMPLETE_READ;
@@ -83,9 +156,13 @@ apr_status_t apr_socket_recv(apr_socket_t *sock, char *buf, apr_size_t *len)
 
     while ((rv == -1) && (errno == EAGAIN || errno == EWOULDBLOCK)
                       && (sock->timeout > 0)) {
+        waited = 1;
 do_select:
-        arv = apr_wait_for_io_or_timeout(NULL, sock, 1);
+        arv = sock_wait(sock, 1);
         if (arv != APR_SUCCESS) {
+            if (sock_wait_next(sock, 0, waited)) {
+                sock->options |= APR_INCOMPLETE_READ;
+            }
             *len = 0;
             return arv;
         }
@@ -99,10 +176,11 @@ do_select:
         (*len) = 0;
         return errno;
     }
-    if ((sock->timeout > 0) && (rv < *len)) {
+    if (sock_wait_next(sock, rv < *len, waited)) {
         sock->options |= APR_INCOMPLETE_READ;
     }
     (*len) = rv;
+    APR_PROBE2(socket__recv, sock, rv);
     if (rv == 0) {
         return APR_EOF;
     }
@@ -123,7 +201,7 @@ apr_status_t apr_socket_sendto(apr_socket_t *sock, apr_sockaddr_t *where,
 
     while ((rv == -1) && (errno == EAGAIN || errno == EWOULDBLOCK)
                       && (sock->timeout > 0)) {
-        apr_status_t arv = apr_wait_for_io_or_timeout(NULL, sock, 0);
+        apr_status_t arv = sock_wait(sock, 0);
         if (arv != APR_SUCCESS) {
             *len = 0;
             return arv;
@@ -158,7 +236,7 @@ apr_status_t apr_socket_recvfrom(apr_sockaddr_t *from, apr_socket_t *sock,
 
     while ((rv == -1) && (errno == EAGAIN || errno == EWOULDBLOCK)
                       && (sock->timeout > 0)) {
-        apr_status_t arv = apr_wait_for_io_or_timeout(NULL, sock, 1);
+        apr_status_t arv = sock_wait(sock, 1);
         if (arv != APR_SUCCESS) {
             *len = 0;
             return arv;
@@ -191,12 +269,227 @@ apr_status_t apr_socket_recvfrom(apr_sockaddr_t *from, apr_socket_t *sock,
     return APR_SUCCESS;
 }
 
+#if defined(HAVE_SENDMMSG) && defined(HAVE_RECVMMSG)
+#define MMSG_SYSCALLS 1
+#define MMSG_HDR struct mmsghdr
+#else
+/* The datagrams are sent or received one by one with sendmsg()/recvmsg() */
+typedef struct {
+    struct msghdr msg_hdr;
+    unsigned int msg_len;
+} mmsg_hdr_t;
+#define MMSG_HDR mmsg_hdr_t
+#endif
+
+/* The number of datagrams sent or received by a system call at most */
+#define MMSG_BATCH 32
+
+#if defined(UDP_SEGMENT) || defined(UDP_GRO)
+#define MMSG_SEGMENT 1
+/* The control message of a segment size, an apr_uint16_t for UDP_SEGMENT
+ * and an int for UDP_GRO
+ */
+typedef union {
+    char buf[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+} mmsg_cmsg_t;
+#endif
+
+static int mmsg_call(apr_socket_t *sock, MMSG_HDR *hdrs, unsigned int n,
+                     int flags, int sending)
+{
+#ifdef MMSG_SYSCALLS
+    if (sending) {
+        return sendmmsg(sock->socketdes, hdrs, n, flags);
+    }
+    return recvmmsg(sock->socketdes, hdrs, n, flags, NULL);
+#else
+    unsigned int i;
+    apr_ssize_t rv;
+
+    for (i = 0; i < n; i++) {
+        if (sending) {
+            rv = sendmsg(sock->socketdes, &hdrs[i].msg_hdr, flags);
+        }
+        else {
+            rv = recvmsg(sock->socketdes, &hdrs[i].msg_hdr, flags);
+        }
+        if (rv == -1) {
+            if (i == 0) {
+                return -1;
+            }
+            break;
+        }
+        hdrs[i].msg_len = rv;
+        /* Like MSG_WAITFORONE */
+        flags |= MSG_DONTWAIT;
+    }
+    return i;
+#endif
+}
+
+/* Send or receive a batch of datagrams, waiting for the first one with a
+ * timeout only
+ */
+static apr_status_t mmsg_batch(apr_socket_t *sock, apr_socket_msg_t *msgs,
+                               apr_int32_t *nmsgs, apr_int32_t flags,
+                               int sending, int wait)
+{
+    MMSG_HDR hdrs[MMSG_BATCH];
+#ifdef MMSG_SEGMENT
+    mmsg_cmsg_t cmsgs[MMSG_BATCH];
+    struct cmsghdr *cmsg;
+#endif
+    unsigned int i, n = *nmsgs;
+    int rv;
+
+    memset(hdrs, 0, n * sizeof(MMSG_HDR));
+    for (i = 0; i < n; i++) {
+        struct msghdr *hdr = &hdrs[i].msg_hdr;
+
+        if (msgs[i].addr) {
+            hdr->msg_name = &msgs[i].addr->sa;
+            hdr->msg_namelen = sending ? msgs[i].addr->salen
+                                       : sizeof(msgs[i].addr->sa);
+        }
+        hdr->msg_iov = msgs[i].vec;
+        hdr->msg_iovlen = msgs[i].nvec;
+        if (sending && msgs[i].segment_size) {
+#ifdef UDP_SEGMENT
+            hdr->msg_control = cmsgs[i].buf;
+            hdr->msg_controllen = CMSG_SPACE(sizeof(apr_uint16_t));
+            cmsg = CMSG_FIRSTHDR(hdr);
+            cmsg->cmsg_level = IPPROTO_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(apr_uint16_t));
+            memcpy(CMSG_DATA(cmsg), &msgs[i].segment_size,
+                   sizeof(apr_uint16_t));
+#else
+            *nmsgs = 0;
+            return APR_ENOTIMPL;
+#endif
+        }
+#ifdef UDP_GRO
+        else if (!sending && apr_is_option_set(sock, APR_SO_UDP_GRO)) {
+            hdr->msg_control = cmsgs[i].buf;
+            hdr->msg_controllen = sizeof(cmsgs[i].buf);
+        }
+#endif
+    }
+
+#if defined(MMSG_SYSCALLS) && defined(MSG_WAITFORONE)
+    if (!sending) {
+        flags |= MSG_WAITFORONE;
+    }
+#endif
+    if (!wait) {
+        flags |= MSG_DONTWAIT;
+    }
+
+    do {
+        rv = mmsg_call(sock, hdrs, n, flags, sending);
+    } while (rv == -1 && errno == EINTR);
+
+    while (wait && rv == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)
+                && (sock->timeout > 0)) {
+        apr_status_t arv = sock_wait(sock, !sending);
+        if (arv != APR_SUCCESS) {
+            *nmsgs = 0;
+            return arv;
+        }
+        else {
+            do {
+                rv = mmsg_call(sock, hdrs, n, flags, sending);
+            } while (rv == -1 && errno == EINTR);
+        }
+    }
+    if (rv == -1) {
+        *nmsgs = 0;
+        return errno;
+    }
+
+    for (i = 0; i < (unsigned int)rv; i++) {
+        msgs[i].len = hdrs[i].msg_len;
+        if (sending) {
+            continue;
+        }
+        msgs[i].segment_size = 0;
+#ifdef UDP_GRO
+        for (cmsg = CMSG_FIRSTHDR(&hdrs[i].msg_hdr); cmsg;
+             cmsg = CMSG_NXTHDR(&hdrs[i].msg_hdr, cmsg)) {
+            if (cmsg->cmsg_level == IPPROTO_UDP
+                && cmsg->cmsg_type == UDP_GRO) {
+                int size;
+
+                memcpy(&size, CMSG_DATA(cmsg), sizeof(int));
+                msgs[i].segment_size = size;
+            }
+        }
+#endif
+        /* As recvfrom(), the address may not be filled in */
+        if (msgs[i].addr) {
+            apr_sockaddr_t *from = msgs[i].addr;
+
+            from->salen = hdrs[i].msg_hdr.msg_namelen;
+            if (from->salen > APR_OFFSETOF(struct sockaddr_in, sin_port)) {
+                apr_sockaddr_vars_set(from, from->sa.sin.sin_family,
+                                      ntohs(from->sa.sin.sin_port));
+            }
+        }
+    }
+    *nmsgs = rv;
+    return APR_SUCCESS;
+}
+
+static apr_status_t mmsg_all(apr_socket_t *sock, apr_socket_msg_t *msgs,
+                             apr_int32_t *nmsgs, apr_int32_t flags,
+                             int sending)
+{
+    apr_int32_t done = 0, n;
+    apr_status_t rv;
+
+    while (done < *nmsgs) {
+        n = *nmsgs - done;
+        if (n > MMSG_BATCH) {
+            n = MMSG_BATCH;
+        }
+        /* Only the first batch waits, the others take what is ready */
+        rv = mmsg_batch(sock, msgs + done, &n, flags, sending, done == 0);
+        if (rv != APR_SUCCESS) {
+            if (done == 0) {
+                *nmsgs = 0;
+                return rv;
+            }
+            break;
+        }
+        done += n;
+        if (n < MMSG_BATCH) {
+            break;
+        }
+    }
+    *nmsgs = done;
+    return APR_SUCCESS;
+}
+
+apr_status_t apr_socket_sendmmsg(apr_socket_t *sock, apr_socket_msg_t *msgs,
+                                 apr_int32_t *nmsgs, apr_int32_t flags)
+{
+    return mmsg_all(sock, msgs, nmsgs, flags, 1);
+}
+
+apr_status_t apr_socket_recvmmsg(apr_socket_t *sock, apr_socket_msg_t *msgs,
+                                 apr_int32_t *nmsgs, apr_int32_t flags)
+{
+    return mmsg_all(sock, msgs, nmsgs, flags, 0);
+}
+
 apr_status_t apr_socket_sendv(apr_socket_t * sock, const struct iovec *vec,
                               apr_int32_t nvec, apr_size_t *len)
 {
 #ifdef HAVE_WRITEV
     apr_ssize_t rv;
     apr_int32_t i;
+    int waited = 0;
 
     if (sock->options & APR_INCOMPLETE_WRITE) {
         sock->options &= ~APR_INCOMPLETE_WRITE;
@@ -204,21 +497,25 @@ apr_status_t apr_socket_sendv(apr_socket_t * sock, const struct iovec *vec,
     }
 
     do {
-        rv = writev(sock->socketdes, vec, nvec);
+        rv = sock_writev(sock, vec, nvec);
     } while (rv == -1 && errno == EINTR);
 
     while ((rv == -1) && (errno == EAGAIN || errno == EWOULDBLOCK)
                       && (sock->timeout > 0)) {
         apr_status_t arv;
+        waited = 1;
 do_select:
-        arv = apr_wait_for_io_or_timeout(NULL, sock, 0);
+        arv = sock_wait(sock, 0);
         if (arv != APR_SUCCESS) {
+            if (sock_wait_next(sock, 0, waited)) {
+                sock->options |= APR_INCOMPLETE_WRITE;
+            }
             *len = 0;
             return arv;
         }
         else {
             do {
-                rv = writev(sock->socketdes, vec, nvec);
+                rv = sock_writev(sock, vec, nvec);
             } while (rv == -1 && errno == EINTR);
         }
     }
@@ -226,7 +523,7 @@ do_select:
         *len = 0;
         return errno;
     }
-    if (sock->timeout > 0) {
+    if (apr_socket_timeout_polled(sock)) {
         apr_size_t rv_len = rv;
         for (i = 0; i < nvec; ++i) {
             apr_size_t iov_len = vec[i].iov_len;
@@ -236,8 +533,12 @@ do_select:
             }
             rv_len -= iov_len;
         }
+        if (sock_wait_next(sock, 0, waited)) {
+            sock->options |= APR_INCOMPLETE_WRITE;
+        }
     }
     (*len) = rv;
+    APR_PROBE2(socket__sendv, sock, rv);
     return APR_SUCCESS;
 #else
     *len = vec[0].iov_len;
@@ -245,6 +546,361 @@ do_select:
 #endif
 }
 
+#ifdef SCM_RIGHTS
+
+#ifdef MSG_CMSG_CLOEXEC
+#define DESC_CMSG_CLOEXEC MSG_CMSG_CLOEXEC
+#else
+#define DESC_CMSG_CLOEXEC 0
+#define DESC_SET_CLOEXEC 1
+#endif
+
+/* The control message of the descriptors passed */
+typedef union {
+    char buf[CMSG_SPACE(sizeof(int) * APR_SOCKET_MAX_DESCRIPTORS)];
+    struct cmsghdr align;
+} desc_cmsg_t;
+
+apr_status_t apr_socket_send_descriptors(apr_socket_t *sock,
+                                         const char *buf, apr_size_t *len,
+                                         const apr_socket_descriptor_t *descs,
+                                         int ndescs)
+{
+    desc_cmsg_t control;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    int fds[APR_SOCKET_MAX_DESCRIPTORS];
+    apr_ssize_t rv;
+    int i;
+
+    /* Nothing would carry the descriptors without a byte of data */
+    if (*len == 0 || ndescs < 0 || ndescs > APR_SOCKET_MAX_DESCRIPTORS) {
+        *len = 0;
+        return APR_EINVAL;
+    }
+    for (i = 0; i < ndescs; i++) {
+        if (descs[i].sock) {
+            fds[i] = descs[i].sock->socketdes;
+        }
+        else if (descs[i].file) {
+            fds[i] = descs[i].file->filedes;
+        }
+        else {
+            *len = 0;
+            return APR_EINVAL;
+        }
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = (void *)buf;
+    iov.iov_len = *len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (ndescs) {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * ndescs);
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * ndescs);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * ndescs);
+    }
+
+    do {
+        rv = sendmsg(sock->socketdes, &msg, 0);
+    } while (rv == -1 && errno == EINTR);
+
+    while (rv == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)
+                    && (sock->timeout > 0)) {
+        apr_status_t arv = sock_wait(sock, 0);
+        if (arv != APR_SUCCESS) {
+            *len = 0;
+            return arv;
+        }
+        else {
+            do {
+                rv = sendmsg(sock->socketdes, &msg, 0);
+            } while (rv == -1 && errno == EINTR);
+        }
+    }
+    if (rv == -1) {
+        *len = 0;
+        return errno;
+    }
+    *len = rv;
+    return APR_SUCCESS;
+}
+
+/* An apr_socket_t for a socket received, as it is in the sender */
+static apr_status_t desc_socket_make(apr_socket_t **new, int fd,
+                                     apr_pool_t *p)
+{
+    apr_sockaddr_t local, remote;
+    apr_os_sock_info_t info;
+    apr_socklen_t optlen;
+    int type, protocol = 0, flags;
+
+    memset(&info, 0, sizeof(info));
+    optlen = sizeof(type);
+    if (getsockopt(fd, SOL_SOCKET, SO_TYPE, (void *)&type, &optlen) == -1) {
+        return errno;
+    }
+#ifdef SO_PROTOCOL
+    optlen = sizeof(protocol);
+    if (getsockopt(fd, SOL_SOCKET, SO_PROTOCOL, (void *)&protocol,
+                   &optlen) == -1) {
+        protocol = 0;
+    }
+#endif
+    optlen = sizeof(local.sa);
+    if (getsockname(fd, (struct sockaddr *)&local.sa, &optlen) == -1) {
+        return errno;
+    }
+    info.local = (struct sockaddr *)&local.sa;
+    info.family = local.sa.sin.sin_family;
+    optlen = sizeof(remote.sa);
+    if (getpeername(fd, (struct sockaddr *)&remote.sa, &optlen) == 0) {
+        info.remote = (struct sockaddr *)&remote.sa;
+    }
+    info.os_sock = &fd;
+    info.type = type;
+    info.protocol = protocol;
+
+    apr_os_sock_make(new, &info, p);
+
+    /* The file status is shared with the sender, the socket keeps it */
+    flags = fcntl(fd, F_GETFL);
+    if (flags != -1 && (flags & O_NONBLOCK)) {
+        apr_set_option(*new, APR_SO_NONBLOCK, 1);
+        (*new)->timeout = 0;
+    }
+    return APR_SUCCESS;
+}
+
+/* An apr_file_t for a file received, readable and writable as it is in
+ * the sender
+ */
+static apr_status_t desc_file_make(apr_file_t **new, int fd, apr_pool_t *p)
+{
+    apr_int32_t aflags = 0;
+    apr_status_t rv;
+    int flags;
+
+    flags = fcntl(fd, F_GETFL);
+    if (flags == -1) {
+        return errno;
+    }
+    switch (flags & O_ACCMODE) {
+    case O_RDONLY:
+        aflags = APR_FOPEN_READ;
+        break;
+    case O_WRONLY:
+        aflags = APR_FOPEN_WRITE;
+        break;
+    default:
+        aflags = APR_FOPEN_READ | APR_FOPEN_WRITE;
+        break;
+    }
+    if (flags & O_APPEND) {
+        aflags |= APR_FOPEN_APPEND;
+    }
+
+    rv = apr_os_file_put(new, &fd, aflags, p);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    (*new)->flags &= ~APR_FOPEN_NOCLEANUP;
+    apr_pool_cleanup_register(p, (void *)(*new), apr_unix_file_cleanup,
+                              apr_unix_child_file_cleanup);
+    return APR_SUCCESS;
+}
+
+apr_status_t apr_socket_recv_descriptors(apr_socket_t *sock,
+                                         char *buf, apr_size_t *len,
+                                         apr_socket_descriptor_t *descs,
+                                         int *ndescs, apr_pool_t *pool)
+{
+    desc_cmsg_t control;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    apr_ssize_t rv;
+    apr_status_t status = APR_SUCCESS;
+    int max = *ndescs, n = 0;
+
+    *ndescs = 0;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = buf;
+    iov.iov_len = *len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    do {
+        rv = recvmsg(sock->socketdes, &msg, DESC_CMSG_CLOEXEC);
+    } while (rv == -1 && errno == EINTR);
+
+    while (rv == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)
+                    && (sock->timeout > 0)) {
+        apr_status_t arv = sock_wait(sock, 1);
+        if (arv != APR_SUCCESS) {
+            *len = 0;
+            return arv;
+        }
+        else {
+            do {
+                rv = recvmsg(sock->socketdes, &msg, DESC_CMSG_CLOEXEC);
+            } while (rv == -1 && errno == EINTR);
+        }
+    }
+    if (rv == -1) {
+        *len = 0;
+        return errno;
+    }
+
+    if (msg.msg_flags & MSG_CTRUNC) {
+        status = APR_ENOSPC;
+    }
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        int i, count;
+
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        count = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        for (i = 0; i < count; i++) {
+            struct stat st;
+            apr_status_t arv;
+            int fd;
+
+            memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            if (n == max) {
+                close(fd);
+                status = APR_ENOSPC;
+                continue;
+            }
+#ifdef DESC_SET_CLOEXEC
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+#endif
+            descs[n].sock = NULL;
+            descs[n].file = NULL;
+            if (fstat(fd, &st) == 0 && S_ISSOCK(st.st_mode)) {
+                arv = desc_socket_make(&descs[n].sock, fd, pool);
+            }
+            else {
+                arv = desc_file_make(&descs[n].file, fd, pool);
+            }
+            if (arv != APR_SUCCESS) {
+                close(fd);
+                if (status == APR_SUCCESS) {
+                    status = arv;
+                }
+                continue;
+            }
+            n++;
+        }
+    }
+    *ndescs = n;
+
+    *len = rv;
+    if (rv == 0 && n == 0 && sock->type == SOCK_STREAM) {
+        return APR_EOF;
+    }
+    return status;
+}
+
+#else /* !SCM_RIGHTS */
+
+apr_status_t apr_socket_send_descriptors(apr_socket_t *sock,
+                                         const char *buf, apr_size_t *len,
+                                         const apr_socket_descriptor_t *descs,
+                                         int ndescs)
+{
+    *len = 0;
+    return APR_ENOTIMPL;
+}
+
+apr_status_t apr_socket_recv_descriptors(apr_socket_t *sock,
+                                         char *buf, apr_size_t *len,
+                                         apr_socket_descriptor_t *descs,
+                                         int *ndescs, apr_pool_t *pool)
+{
+    *len = 0;
+    *ndescs = 0;
+    return APR_ENOTIMPL;
+}
+
+#endif /* SCM_RIGHTS */
+
+apr_status_t apr_socket_zerocopy_seq(apr_socket_t *sock, apr_uint32_t *seq)
+{
+    *seq = sock->zerocopy_seq;
+    return APR_SUCCESS;
+}
+
+apr_status_t apr_socket_zerocopy_reap(apr_socket_t *sock,
+                                      apr_socket_zerocopy_cb_t func,
+                                      void *baton)
+{
+#ifdef SEND_ZEROCOPY
+    union {
+        char buf[CMSG_SPACE(sizeof(struct sock_extended_err))
+                 + CMSG_SPACE(sizeof(struct sockaddr_in6))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    struct sock_extended_err *serr;
+    apr_status_t rv;
+
+    for (;;) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        if (recvmsg(sock->socketdes, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return APR_SUCCESS;
+            }
+            return errno;
+        }
+
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+             cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (!((cmsg->cmsg_level == IPPROTO_IP
+                   && cmsg->cmsg_type == IP_RECVERR)
+#if APR_HAVE_IPV6
+                  || (cmsg->cmsg_level == IPPROTO_IPV6
+                      && cmsg->cmsg_type == IPV6_RECVERR)
+#endif
+                  )) {
+                continue;
+            }
+            serr = (struct sock_extended_err *)CMSG_DATA(cmsg);
+            if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            if (serr->ee_errno != 0) {
+                return serr->ee_errno;
+            }
+            rv = func(baton, serr->ee_info, serr->ee_data,
+                      (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0);
+            if (rv != APR_SUCCESS) {
+                return rv;
+            }
+        }
+    }
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
 apr_status_t apr_socket_wait(apr_socket_t *sock, apr_wait_type_t direction)
 {
     return apr_wait_for_io_or_timeout(NULL, sock, direction == APR_WAIT_READ);
@@ -262,9 +918,9 @@ static apr_hdtr_t no_hdtr;
 
 #if (defined(__linux__) || defined(__GNU__)) && defined(HAVE_WRITEV)
 
-apr_status_t apr_socket_sendfile(apr_socket_t *sock, apr_file_t *file,
-                                 apr_hdtr_t *hdtr, apr_off_t *offset,
-                                 apr_size_t *len, apr_int32_t flags)
+static apr_status_t socket_sendfile(apr_socket_t *sock, apr_file_t *file,
+                                    apr_hdtr_t *hdtr, apr_off_t *offset,
+                                    apr_size_t *len, apr_int32_t flags)
 {
     int nopush_set = 0, rv, i;
     apr_size_t bytes_to_send = *len;
@@ -356,7 +1012,7 @@ apr_status_t apr_socket_sendfile(apr_socket_t *sock, apr_file_t *file,
     while ((rv == -1) && (errno == EAGAIN || errno == EWOULDBLOCK)
                       && (sock->timeout > 0)) {
 do_select:
-        arv = apr_wait_for_io_or_timeout(NULL, sock, 0);
+        arv = sock_wait(sock, 0);
         if (arv != APR_SUCCESS) {
             return arv;
         }
@@ -393,7 +1049,7 @@ do_select:
              * partial byte count;  this is a non-blocking socket.
              */
 
-            if (sock->timeout > 0) {
+            if (apr_socket_timeout_polled(sock)) {
                 sock->options |= APR_INCOMPLETE_WRITE;
             }
             return arv;
@@ -426,9 +1082,9 @@ do_select:
 #elif defined(DARWIN)
 
 /* OS/X Release 10.5 or greater */
-apr_status_t apr_socket_sendfile(apr_socket_t *sock, apr_file_t *file,
-                                 apr_hdtr_t *hdtr, apr_off_t *offset,
-                                 apr_size_t *len, apr_int32_t flags)
+static apr_status_t socket_sendfile(apr_socket_t *sock, apr_file_t *file,
+                                    apr_hdtr_t *hdtr, apr_off_t *offset,
+                                    apr_size_t *len, apr_int32_t flags)
 {
     apr_off_t nbytes = 0;
     apr_size_t bytes_to_send = *len;
@@ -476,7 +1132,7 @@ apr_status_t apr_socket_sendfile(apr_socket_t *sock, apr_file_t *file,
         }
         if (sock->options & APR_INCOMPLETE_WRITE) {
             sock->options &= ~APR_INCOMPLETE_WRITE;
-            arv = apr_wait_for_io_or_timeout(NULL, sock, 0);
+            arv = sock_wait(sock, 0);
             if (arv != APR_SUCCESS) {
                 return arv;
             }
@@ -492,7 +1148,7 @@ apr_status_t apr_socket_sendfile(apr_socket_t *sock, apr_file_t *file,
 
         if (rv == -1) {
             if (errno == EAGAIN) {
-                if (sock->timeout > 0) {
+                if (apr_socket_timeout_polled(sock)) {
                     sock->options |= APR_INCOMPLETE_WRITE;
                 }
                 /* BSD's sendfile can return -1/EAGAIN even if it
@@ -540,9 +1196,9 @@ apr_status_t apr_socket_sendfile(apr_socket_t *sock, apr_file_t *file,
 #elif defined(__FreeBSD__) || defined(__DragonFly__)
 
 /* Release 3.1 or greater */
-apr_status_t apr_socket_sendfile(apr_socket_t * sock, apr_file_t * file,
-                                 apr_hdtr_t * hdtr, apr_off_t * offset,
-                                 apr_size_t * len, apr_int32_t flags)
+static apr_status_t socket_sendfile(apr_socket_t * sock, apr_file_t * file,
+                                    apr_hdtr_t * hdtr, apr_off_t * offset,
+                                    apr_size_t * len, apr_int32_t flags)
 {
     off_t nbytes = 0;
     int rv;
@@ -588,7 +1244,7 @@ apr_status_t apr_socket_sendfile(apr_socket_t * sock, apr_file_t * file,
     do {
         if (sock->options & APR_INCOMPLETE_WRITE) {
             sock->options &= ~APR_INCOMPLETE_WRITE;
-            arv = apr_wait_for_io_or_timeout(NULL, sock, 0);
+            arv = sock_wait(sock, 0);
             if (arv != APR_SUCCESS) {
                 return arv;
             }
@@ -608,7 +1264,7 @@ apr_status_t apr_socket_sendfile(apr_socket_t * sock, apr_file_t * file,
 
             if (rv == -1) {
                 if (errno == EAGAIN) {
-                    if (sock->timeout > 0) {
+                    if (apr_socket_timeout_polled(sock)) {
                         sock->options |= APR_INCOMPLETE_WRITE;
                     }
                     /* FreeBSD's sendfile can return -1/EAGAIN even if it
@@ -646,7 +1302,7 @@ apr_status_t apr_socket_sendfile(apr_socket_t * sock, apr_file_t * file,
                 *len += rv;
             }
             else if (rv == -1 && errno == EAGAIN) {
-                if (sock->timeout > 0) {
+                if (apr_socket_timeout_polled(sock)) {
                     sock->options |= APR_INCOMPLETE_WRITE;
                 }
                 else {
@@ -677,9 +1333,9 @@ apr_status_t apr_socket_sendfile(apr_socket_t * sock, apr_file_t * file,
  * if nbytes == 0, the rest of the file (from offset) is sent
  */
 
-apr_status_t apr_socket_sendfile(apr_socket_t *sock, apr_file_t *file,
-                                 apr_hdtr_t *hdtr, apr_off_t *offset,
-                                 apr_size_t *len, apr_int32_t flags)
+static apr_status_t socket_sendfile(apr_socket_t *sock, apr_file_t *file,
+                                    apr_hdtr_t *hdtr, apr_off_t *offset,
+                                    apr_size_t *len, apr_int32_t flags)
 {
     int i;
     apr_ssize_t rc;
@@ -782,7 +1438,7 @@ apr_status_t apr_socket_sendfile(apr_socket_t *sock, apr_file_t *file,
 
     while ((rc == -1) && (errno == EAGAIN || errno == EWOULDBLOCK)
                       && (sock->timeout > 0)) {
-        apr_status_t arv = apr_wait_for_io_or_timeout(NULL, sock, 0);
+        apr_status_t arv = sock_wait(sock, 0);
 
         if (arv != APR_SUCCESS) {
             *len = 0;
@@ -825,9 +1481,9 @@ apr_status_t apr_socket_sendfile(apr_socket_t *sock, apr_file_t *file,
  * AIX -  version 4.3.2 with APAR IX85388, or version 4.3.3 and above
  * OS/390 - V2R7 and above
  */
-apr_status_t apr_socket_sendfile(apr_socket_t * sock, apr_file_t * file,
-                                 apr_hdtr_t * hdtr, apr_off_t * offset,
-                                 apr_size_t * len, apr_int32_t flags)
+static apr_status_t socket_sendfile(apr_socket_t * sock, apr_file_t * file,
+                                    apr_hdtr_t * hdtr, apr_off_t * offset,
+                                    apr_size_t * len, apr_int32_t flags)
 {
     int i, ptr, rv = 0;
     void * hbuf=NULL, * tbuf=NULL;
@@ -930,7 +1586,7 @@ apr_status_t apr_socket_sendfile(apr_socket_t * sock, apr_file_t * file,
     while ((rv == -1) && (errno == EAGAIN || errno == EWOULDBLOCK)
                       && (sock->timeout > 0)) {
 do_select:
-        arv = apr_wait_for_io_or_timeout(NULL, sock, 0);
+        arv = sock_wait(sock, 0);
         if (arv != APR_SUCCESS) {
             *len = 0;
             return arv;
@@ -956,7 +1612,7 @@ do_select:
         return errno;
     }
 
-    if ((sock->timeout > 0)
+    if (apr_socket_timeout_polled(sock)
           && (parms.bytes_sent
                 < (parms.file_bytes + parms.header_length + parms.trailer_length))) {
         sock->options |= APR_INCOMPLETE_WRITE;
@@ -987,9 +1643,9 @@ do_select:
 #define sendfilev sendfilev64
 #endif
 
-apr_status_t apr_socket_sendfile(apr_socket_t *sock, apr_file_t *file,
-                                 apr_hdtr_t *hdtr, apr_off_t *offset,
-                                 apr_size_t *len, apr_int32_t flags)
+static apr_status_t socket_sendfile(apr_socket_t *sock, apr_file_t *file,
+                                    apr_hdtr_t *hdtr, apr_off_t *offset,
+                                    apr_size_t *len, apr_int32_t flags)
 {
     apr_status_t rv, arv;
     apr_size_t nbytes;
@@ -1050,7 +1706,7 @@ apr_status_t apr_socket_sendfile(apr_socket_t *sock, apr_file_t *file,
      */
     if (sock->options & APR_INCOMPLETE_WRITE) {
         sock->options &= ~APR_INCOMPLETE_WRITE;
-        arv = apr_wait_for_io_or_timeout(NULL, sock, 0);
+        arv = sock_wait(sock, 0);
         if (arv != APR_SUCCESS) {
             *len = 0;
             return arv;
@@ -1080,7 +1736,7 @@ apr_status_t apr_socket_sendfile(apr_socket_t *sock, apr_file_t *file,
                 rv = 0;
             }
             else if (!arv && (sock->timeout > 0)) {
-                apr_status_t t = apr_wait_for_io_or_timeout(NULL, sock, 0);
+                apr_status_t t = sock_wait(sock, 0);
 
                 if (t != APR_SUCCESS) {
                     *len = 0;
@@ -1108,7 +1764,7 @@ apr_status_t apr_socket_sendfile(apr_socket_t *sock, apr_file_t *file,
         return APR_EOF;
     }
 
-    if ((sock->timeout > 0) && (*len < requested_len)) {
+    if (apr_socket_timeout_polled(sock) && (*len < requested_len)) {
         sock->options |= APR_INCOMPLETE_WRITE;
     }
     return APR_SUCCESS;
@@ -1120,4 +1776,15 @@ apr_status_t apr_socket_sendfile(apr_socket_t *sock, apr_file_t *file,
 #endif /* __linux__, __FreeBSD__, __DragonFly__, __HPUX__, _AIX, __MVS__,
       Tru64/OSF1 */
 
+apr_status_t apr_socket_sendfile(apr_socket_t *sock, apr_file_t *file,
+                                 apr_hdtr_t *hdtr, apr_off_t *offset,
+                                 apr_size_t *len, apr_int32_t flags)
+{
+    apr_status_t rv;
+
+    rv = socket_sendfile(sock, file, hdtr, offset, len, flags);
+    APR_PROBE4(socket__sendfile, sock, file, rv, *len);
+    return rv;
+}
+
 #endif /* APR_HAS_SENDFILE */
@@ -20,6 +20,7 @@
 #include "apr_lib.h"
 #include "apr_strings.h"
 #include "apr_private.h"
+#include "apr_atomic.h"
 
 #if APR_HAVE_STDLIB_H
 #include <stdlib.h>
@@ -105,66 +106,224 @@ static apr_status_t get_remote_addr(apr_socket_t *sock)
     }
 }
 
-APR_DECLARE(apr_status_t) apr_sockaddr_ip_getbuf(char *buf, apr_size_t buflen,
-                                                 apr_sockaddr_t *sockaddr)
+static char *ipv4_text(char *p, const unsigned char *a)
 {
-#if APR_HAVE_SOCKADDR_UN
-    if (sockaddr->family == APR_UNIX) {
-        const char *ptr = sockaddr->ipaddr_ptr;
-        apr_size_t len = apr_cpystrn(buf, ptr, buflen) - buf;
-        /* assumes that sockaddr->ipaddr_ptr is nul terminated */
-        return ptr[len] ? APR_ENOSPC : APR_SUCCESS;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        unsigned int n = a[i];
+
+        if (i) {
+            *p++ = '.';
+        }
+        if (n >= 100) {
+            *p++ = '0' + n / 100;
+            n %= 100;
+            *p++ = '0' + n / 10;
+            n %= 10;
+        }
+        else if (n >= 10) {
+            *p++ = '0' + n / 10;
+            n %= 10;
+        }
+        *p++ = '0' + n;
     }
-#endif
+    return p;
+}
 
-    if (!apr_inet_ntop(sockaddr->family, sockaddr->ipaddr_ptr, buf, buflen)) {
-        return APR_ENOSPC;
+#if APR_HAVE_IPV6
+/* Like apr_inet_ntop(AF_INET6), with the longest run of zeros (the first
+ * one of the longest) shortened to "::", and the IPv4-compatible and
+ * IPv4-mapped addresses ending with their IPv4 form.
+ */
+static char *ipv6_text(char *p, const unsigned char *a)
+{
+    static const char hex[] = "0123456789abcdef";
+    unsigned int words[8];
+    int i, base = -1, len = 0, cur = -1;
+
+    for (i = 0; i < 8; i++) {
+        words[i] = (a[2 * i] << 8) | a[2 * i + 1];
+        if (words[i] == 0) {
+            if (cur < 0) {
+                cur = i;
+            }
+            if (i - cur + 1 > len) {
+                base = cur;
+                len = i - cur + 1;
+            }
+        }
+        else {
+            cur = -1;
+        }
     }
+    if (len < 2) {
+        base = -1;
+    }
+
+    for (i = 0; i < 8; i++) {
+        unsigned int w = words[i];
 
+        if (i == base) {
+            *p++ = ':';
+            i += len - 1;
+            if (i == 7) {
+                *p++ = ':';
+            }
+            continue;
+        }
+        if (i) {
+            *p++ = ':';
+        }
+        if (i == 6 && base == 0 && (len == 6 || (len == 5 && words[5] == 0xffff))) {
+            return ipv4_text(p, a + 12);
+        }
+        if (w >= 0x1000) {
+            *p++ = hex[w >> 12];
+        }
+        if (w >= 0x100) {
+            *p++ = hex[(w >> 8) & 0xf];
+        }
+        if (w >= 0x10) {
+            *p++ = hex[(w >> 4) & 0xf];
+        }
+        *p++ = hex[w & 0xf];
+    }
+    return p;
+}
+#endif /* APR_HAVE_IPV6 */
+
+/* The key of the text form of the IP address in sockaddr */
+static int sockaddr_ip_key(const apr_sockaddr_t *sockaddr, apr_uint32_t *key)
+{
+    memset(key, 0, 6 * sizeof(*key));
+    if (sockaddr->family == APR_INET) {
+        memcpy(key, &sockaddr->sa.sin.sin_addr, 4);
+    }
 #if APR_HAVE_IPV6
-    if (sockaddr->family == AF_INET6
-        && IN6_IS_ADDR_V4MAPPED((struct in6_addr *)sockaddr->ipaddr_ptr)
-        && buflen > strlen("::ffff:")) {
-        /* This is an IPv4-mapped IPv6 address; drop the leading
-         * part of the address string so we're left with the familiar
-         * IPv4 format.
-         */
-        memmove(buf, buf + strlen("::ffff:"),
-                strlen(buf + strlen("::ffff:"))+1);
+    else if (sockaddr->family == APR_INET6) {
+        memcpy(key, &sockaddr->sa.sin6.sin6_addr, 16);
+        key[4] = sockaddr->sa.sin6.sin6_scope_id;
+    }
+#endif
+    else {
+        return 0;
     }
+    key[5] = sockaddr->family;
+    return 1;
+}
 
-    /* ensure NUL termination if the buffer is too short */
-    buf[buflen-1] = '\0';
+/* Format the IP address of sockaddr (but APR_UNIX) to buf, which must be
+ * as large as sockaddr->ipstr, returning its length or 0 if the family is
+ * not supported.
+ */
+static apr_size_t sockaddr_ip_format(char *buf, const apr_sockaddr_t *sockaddr)
+{
+    char *p = buf;
 
+    if (sockaddr->family == APR_INET) {
+        p = ipv4_text(p, (const unsigned char *)&sockaddr->sa.sin.sin_addr);
+    }
+#if APR_HAVE_IPV6
+    else if (sockaddr->family == APR_INET6) {
+        const struct in6_addr *addr = &sockaddr->sa.sin6.sin6_addr;
+
+        if (IN6_IS_ADDR_V4MAPPED(addr)) {
+            /* The familiar IPv4 format for an IPv4-mapped address */
+            p = ipv4_text(p, (const unsigned char *)addr + 12);
+        }
+        else {
+            p = ipv6_text(p, (const unsigned char *)addr);
+        }
 #ifdef HAVE_IF_INDEXTONAME
-    /* Append scope name for link-local addresses. */
-    if (sockaddr->family == AF_INET6
-        && IN6_IS_ADDR_LINKLOCAL((struct in6_addr *)sockaddr->ipaddr_ptr)) {
-        char scbuf[IF_NAMESIZE], *p = buf + strlen(buf);
-
-        if (if_indextoname(sockaddr->sa.sin6.sin6_scope_id, scbuf) == scbuf) {
-            /* Space check, need room for buf + '%' + scope + '\0'.
-             * Assert: buflen >= strlen(buf) + strlen(scbuf) + 2
-             * Equiv:  buflen >= (p-buf) + strlen(buf) + 2
-             * Thus, fail in inverse condition: */
-            if (buflen < strlen(scbuf) + (p - buf) + 2) {
-                return APR_ENOSPC;
+        /* Append scope name for link-local addresses. */
+        if (IN6_IS_ADDR_LINKLOCAL(addr)) {
+            char scbuf[IF_NAMESIZE];
+
+            if (if_indextoname(sockaddr->sa.sin6.sin6_scope_id,
+                               scbuf) == scbuf) {
+                apr_size_t sclen = strlen(scbuf);
+
+                *p++ = '%';
+                memcpy(p, scbuf, sclen);
+                p += sclen;
             }
-            *p++ = '%';
-            memcpy(p, scbuf, strlen(scbuf) + 1);
         }
-    }
 #endif /* HAVE_IF_INDEXTONAME */
+    }
 #endif /* APR_HAVE_IPV6 */
+    else {
+        return 0;
+    }
+    *p = '\0';
+    return p - buf;
+}
 
-    return APR_SUCCESS;
+/* The text form of the IP address of sockaddr, cached in it: a reader
+ * finds the family of the key set (last) only once the text is there.
+ */
+static const char *sockaddr_ip_text(apr_sockaddr_t *sockaddr)
+{
+    apr_uint32_t key[6];
+
+    if (!sockaddr_ip_key(sockaddr, key)) {
+        return NULL;
+    }
+    if (apr_atomic_read32_acquire(&sockaddr->ipstr_key[5]) == key[5]
+        && !memcmp((const void *)sockaddr->ipstr_key, key,
+                   5 * sizeof(*key))) {
+        return sockaddr->ipstr;
+    }
+
+    apr_atomic_set32_release(&sockaddr->ipstr_key[5], 0);
+    sockaddr_ip_format(sockaddr->ipstr, sockaddr);
+    memcpy((void *)sockaddr->ipstr_key, key, 5 * sizeof(*key));
+    apr_atomic_set32_release(&sockaddr->ipstr_key[5], key[5]);
+    return sockaddr->ipstr;
+}
+
+APR_DECLARE(apr_status_t) apr_sockaddr_ip_getbuf(char *buf, apr_size_t buflen,
+                                                 apr_sockaddr_t *sockaddr)
+{
+    const char *text;
+
+#if APR_HAVE_SOCKADDR_UN
+    if (sockaddr->family == APR_UNIX) {
+        const char *ptr = sockaddr->ipaddr_ptr;
+        apr_size_t len = apr_cpystrn(buf, ptr, buflen) - buf;
+        /* assumes that sockaddr->ipaddr_ptr is nul terminated */
+        return ptr[len] ? APR_ENOSPC : APR_SUCCESS;
+    }
+#endif
+
+    text = sockaddr_ip_text(sockaddr);
+    if (!text || !buflen) {
+        return APR_ENOSPC;
+    }
+    return text[apr_cpystrn(buf, text, buflen) - buf] ? APR_ENOSPC
+                                                      : APR_SUCCESS;
 }
 
 APR_DECLARE(apr_status_t) apr_sockaddr_ip_get(char **addr,
                                               apr_sockaddr_t *sockaddr)
 {
-    *addr = apr_palloc(sockaddr->pool, sockaddr->addr_str_len);
-    return apr_sockaddr_ip_getbuf(*addr, sockaddr->addr_str_len, sockaddr);
+    const char *text;
+
+#if APR_HAVE_SOCKADDR_UN
+    if (sockaddr->family == APR_UNIX) {
+        *addr = apr_palloc(sockaddr->pool, sockaddr->addr_str_len);
+        return apr_sockaddr_ip_getbuf(*addr, sockaddr->addr_str_len,
+                                      sockaddr);
+    }
+#endif
+
+    text = sockaddr_ip_text(sockaddr);
+    if (!text) {
+        *addr = apr_pcalloc(sockaddr->pool, 1);
+        return APR_ENOSPC;
+    }
+    *addr = (char *)text;
+    return APR_SUCCESS;
 }
 
 void apr_sockaddr_vars_set(apr_sockaddr_t *addr, int family, apr_port_t port)
@@ -938,6 +1097,9 @@ APR_DECLARE(apr_status_t) apr_getservbyname(apr_sockaddr_t *sockaddr,
 APR_DECLARE(int) apr_sockaddr_equal(const apr_sockaddr_t *addr1,
                                     const apr_sockaddr_t *addr2)
 {
+    if (addr1->family == APR_INET && addr2->family == APR_INET) {
+        return addr1->sa.sin.sin_addr.s_addr == addr2->sa.sin.sin_addr.s_addr;
+    }
     if (addr1->ipaddr_len == addr2->ipaddr_len
         && !memcmp(addr1->ipaddr_ptr, addr2->ipaddr_ptr, addr1->ipaddr_len)
         && SCOPE_OR_ZERO(addr1) == SCOPE_OR_ZERO(addr2)) {
@@ -1220,6 +1382,157 @@ APR_DECLARE(int) apr_ipsubnet_test(apr_ipsubnet_t *ipsub, apr_sockaddr_t *sa)
     return 0; /* no match */
 }
 
+/* The subnets of a set are in a binary trie by family, the nodes at the
+ * end of their prefixes (from the most significant bit) matching all the
+ * addresses below them; the few subnets with a non-contiguous mask are
+ * tested one by one.
+ */
+typedef struct ipsubnet_node_t ipsubnet_node_t;
+struct ipsubnet_node_t {
+    ipsubnet_node_t *child[2];
+    int match;
+};
+
+struct apr_ipsubnet_set_t {
+    apr_pool_t *pool;
+    ipsubnet_node_t *root4;
+#if APR_HAVE_IPV6
+    ipsubnet_node_t *root6;
+#endif
+    apr_array_header_t *others;
+};
+
+#define IPSUBNET_BIT(a, i) (((a)[(i) >> 3] >> (7 - ((i) & 7))) & 1)
+
+/* The number of bits of the mask, or -1 if it is not contiguous */
+static int ipsubnet_prefix(const unsigned char *mask, int nbits)
+{
+    int i, bits;
+
+    for (bits = 0; bits < nbits && IPSUBNET_BIT(mask, bits); bits++) {
+        /* count the leading ones */
+    }
+    for (i = bits; i < nbits; i++) {
+        if (IPSUBNET_BIT(mask, i)) {
+            return -1;
+        }
+    }
+    return bits;
+}
+
+static int ipsubnet_node_test(const ipsubnet_node_t *node,
+                              const unsigned char *addr, int nbits)
+{
+    int i;
+
+    for (i = 0; node; i++) {
+        if (node->match) {
+            return 1;
+        }
+        if (i == nbits) {
+            break;
+        }
+        node = node->child[IPSUBNET_BIT(addr, i)];
+    }
+    return 0;
+}
+
+APR_DECLARE(apr_status_t) apr_ipsubnet_set_create(apr_ipsubnet_set_t **set,
+                                                  apr_pool_t *p)
+{
+    *set = apr_pcalloc(p, sizeof(apr_ipsubnet_set_t));
+    (*set)->pool = p;
+    (*set)->others = apr_array_make(p, 0, sizeof(apr_ipsubnet_t *));
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_ipsubnet_set_add(apr_ipsubnet_set_t *set,
+                                               apr_ipsubnet_t *ipsub)
+{
+    ipsubnet_node_t **node;
+    const unsigned char *sub = (const unsigned char *)ipsub->sub;
+    int i, bits, nbits;
+
+    if (ipsub->family == AF_INET) {
+        node = &set->root4;
+        nbits = 32;
+    }
+#if APR_HAVE_IPV6
+    else if (ipsub->family == AF_INET6) {
+        node = &set->root6;
+        nbits = 128;
+    }
+#endif
+    else {
+        return APR_EINVAL;
+    }
+
+    bits = ipsubnet_prefix((const unsigned char *)ipsub->mask, nbits);
+    if (bits < 0) {
+        APR_ARRAY_PUSH(set->others, apr_ipsubnet_t *) = ipsub;
+        return APR_SUCCESS;
+    }
+    for (i = 0; ; i++) {
+        if (!*node) {
+            *node = apr_pcalloc(set->pool, sizeof(ipsubnet_node_t));
+        }
+        if ((*node)->match) {
+            /* Already in a larger subnet */
+            return APR_SUCCESS;
+        }
+        if (i == bits) {
+            break;
+        }
+        node = &(*node)->child[IPSUBNET_BIT(sub, i)];
+    }
+    /* What is below matches now */
+    (*node)->match = 1;
+    (*node)->child[0] = (*node)->child[1] = NULL;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(int) apr_ipsubnet_set_test(const apr_ipsubnet_set_t *set,
+                                       apr_sockaddr_t *sa)
+{
+    int i;
+
+#if APR_HAVE_IPV6
+    if (sa->family == AF_INET) {
+        if (ipsubnet_node_test(set->root4,
+                               (const unsigned char *)&sa->sa.sin.sin_addr,
+                               32)) {
+            return 1;
+        }
+    }
+    else if (IN6_IS_ADDR_V4MAPPED((struct in6_addr *)sa->ipaddr_ptr)) {
+        if (ipsubnet_node_test(set->root4,
+                               (const unsigned char *)sa->ipaddr_ptr + 12,
+                               32)) {
+            return 1;
+        }
+    }
+    else if (sa->family == AF_INET6) {
+        if (ipsubnet_node_test(set->root6,
+                               (const unsigned char *)sa->ipaddr_ptr, 128)) {
+            return 1;
+        }
+    }
+#else
+    if (ipsubnet_node_test(set->root4,
+                           (const unsigned char *)&sa->sa.sin.sin_addr, 32)) {
+        return 1;
+    }
+#endif /* APR_HAVE_IPV6 */
+
+    for (i = 0; i < set->others->nelts; i++) {
+        if (apr_ipsubnet_test(APR_ARRAY_IDX(set->others, i, apr_ipsubnet_t *),
+                              sa)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 APR_DECLARE(apr_status_t) apr_sockaddr_zone_set(apr_sockaddr_t *sa,
                                                 const char *zone_id)
 {
@@ -16,6 +16,7 @@
 
 #include "apr_network_io.h"
 #include "apr_poll.h"
+#include "apr_time.h"
 
 APR_DECLARE(apr_status_t) apr_socket_atreadeof(apr_socket_t *sock, int *atreadeof)
 {
@@ -73,3 +74,166 @@ APR_DECLARE(apr_status_t) apr_socket_atreadeof(apr_socket_t *sock, int *atreadeo
     return APR_EGENERAL;
 }
 
+
+#define CONNECT_PENDING(rv) \
+    (APR_STATUS_IS_EINPROGRESS(rv) || APR_STATUS_IS_EALREADY(rv))
+
+/* Start a non-blocking connection attempt, closing the socket if it
+ * fails at once
+ */
+static apr_status_t connect_start(apr_socket_t **sock, apr_sockaddr_t *sa,
+                                  int type, int protocol, apr_pool_t *p)
+{
+    apr_status_t rv;
+
+    if ((rv = apr_socket_create(sock, sa->family, type, protocol,
+                                p)) != APR_SUCCESS) {
+        return rv;
+    }
+    if ((rv = apr_socket_timeout_set(*sock, 0)) == APR_SUCCESS) {
+        rv = apr_socket_connect(*sock, sa);
+    }
+    if (rv != APR_SUCCESS && !CONNECT_PENDING(rv)) {
+        apr_socket_close(*sock);
+    }
+    return rv;
+}
+
+APR_DECLARE(apr_status_t) apr_socket_connect_any(apr_socket_t **new_sock,
+                                                 apr_sockaddr_t *sa,
+                                                 int type, int protocol,
+                                                 apr_interval_time_t timeout,
+                                                 apr_interval_time_t stagger,
+                                                 apr_pool_t *p)
+{
+    apr_sockaddr_t **byfamily, **order, *cur;
+    apr_pollfd_t *pfds;
+    apr_socket_t *sock = NULL;
+    apr_int32_t n = 0, nfirst, started = 0, npending = 0, nsignaled;
+    apr_int32_t i, j, k;
+    apr_time_t now, deadline, next_start;
+    apr_status_t rv = APR_EINVAL;
+
+    *new_sock = NULL;
+    for (cur = sa; cur; cur = cur->next) {
+        n++;
+    }
+    if (!n) {
+        return APR_EINVAL;
+    }
+
+    /* Alternate the families, from the family of the first address */
+    byfamily = apr_palloc(p, 2 * n * sizeof(*order));
+    order = byfamily + n;
+    for (cur = sa, i = 0; cur; cur = cur->next) {
+        if (cur->family == sa->family) {
+            byfamily[i++] = cur;
+        }
+    }
+    nfirst = i;
+    for (cur = sa; cur; cur = cur->next) {
+        if (cur->family != sa->family) {
+            byfamily[i++] = cur;
+        }
+    }
+    for (i = 0, j = nfirst, k = 0; k < n; ) {
+        if (i < nfirst) {
+            order[k++] = byfamily[i++];
+        }
+        if (j < n) {
+            order[k++] = byfamily[j++];
+        }
+    }
+
+    pfds = apr_pcalloc(p, n * sizeof(*pfds));
+    now = apr_time_now();
+    deadline = now + timeout;
+    next_start = now;
+
+    for (;;) {
+        now = apr_time_now();
+
+        if (started < n && (!npending || now >= next_start)) {
+            cur = order[started++];
+            rv = connect_start(&sock, cur, type, protocol, p);
+            if (rv == APR_SUCCESS) {
+                break;
+            }
+            if (CONNECT_PENDING(rv)) {
+                pfds[npending].p = p;
+                pfds[npending].desc_type = APR_POLL_SOCKET;
+                pfds[npending].reqevents = APR_POLLOUT;
+                pfds[npending].desc.s = sock;
+                pfds[npending].client_data = cur;
+                npending++;
+                next_start = now + stagger;
+            }
+            sock = NULL;
+            continue;
+        }
+        if (!npending) {
+            /* All failed, with the status of the last one */
+            break;
+        }
+
+        {
+            apr_interval_time_t wait = -1;
+
+            if (timeout >= 0) {
+                if ((wait = deadline - now) <= 0) {
+                    rv = APR_TIMEUP;
+                    break;
+                }
+            }
+            if (started < n && (wait < 0 || next_start - now < wait)) {
+                wait = next_start - now;
+            }
+            for (i = 0; i < npending; i++) {
+                pfds[i].rtnevents = 0;
+            }
+            rv = apr_poll(pfds, npending, &nsignaled, wait);
+        }
+        if (APR_STATUS_IS_TIMEUP(rv) || APR_STATUS_IS_EINTR(rv)) {
+            continue;
+        }
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+
+        for (i = 0; i < npending && !sock; ) {
+            if (!pfds[i].rtnevents) {
+                i++;
+                continue;
+            }
+            rv = apr_socket_connect(pfds[i].desc.s, pfds[i].client_data);
+            if (rv == APR_SUCCESS) {
+                sock = pfds[i].desc.s;
+            }
+            else if (CONNECT_PENDING(rv)) {
+                i++;
+                continue;
+            }
+            else {
+                apr_socket_close(pfds[i].desc.s);
+                /* The next attempt starts at once */
+                next_start = now;
+            }
+            pfds[i] = pfds[--npending];
+        }
+        if (sock) {
+            break;
+        }
+    }
+
+    /* Close the losers */
+    for (i = 0; i < npending; i++) {
+        apr_socket_close(pfds[i].desc.s);
+    }
+    if (!sock) {
+        return rv;
+    }
+
+    apr_socket_timeout_set(sock, -1);
+    *new_sock = sock;
+    return APR_SUCCESS;
+}
@@ -21,6 +21,10 @@
 #include "apr_portable.h"
 #include "apr_arch_inherit.h"
 
+#if defined(HAVE_LINUX_FILTER_H)
+#include <linux/filter.h>
+#endif
+
 #ifdef BEOS_R5
 #undef close
 #define close closesocket
@@ -89,15 +93,22 @@ static void set_socket_vars(apr_socket_t *sock, int family, int type, int protoc
 #endif
 }
 
+/* The socket and its addresses, allocated at once */
+typedef struct {
+    apr_socket_t sock;
+    apr_sockaddr_t local_addr;
+    apr_sockaddr_t remote_addr;
+} socket_block_t;
+
 static void alloc_socket(apr_socket_t **new, apr_pool_t *p)
 {
-    *new = (apr_socket_t *)apr_pcalloc(p, sizeof(apr_socket_t));
+    socket_block_t *block = apr_pcalloc(p, sizeof(socket_block_t));
+
+    *new = &block->sock;
     (*new)->pool = p;
-    (*new)->local_addr = (apr_sockaddr_t *)apr_pcalloc((*new)->pool,
-                                                       sizeof(apr_sockaddr_t));
+    (*new)->local_addr = &block->local_addr;
     (*new)->local_addr->pool = p;
-    (*new)->remote_addr = (apr_sockaddr_t *)apr_pcalloc((*new)->pool,
-                                                        sizeof(apr_sockaddr_t));
+    (*new)->remote_addr = &block->remote_addr;
     (*new)->remote_addr->pool = p;
     (*new)->remote_addr_unknown = 1;
 #ifndef WAITIO_USES_POLL
@@ -244,13 +255,85 @@ apr_status_t apr_socket_listen(apr_socket_t *sock, apr_int32_t backlog)
         return APR_SUCCESS;
 }
 
-apr_status_t apr_socket_accept(apr_socket_t **new, apr_socket_t *sock,
-                               apr_pool_t *connection_context)
+static apr_status_t reuseport_steer_cpu(apr_socket_t *sock, int num)
 {
-    int s;
-    apr_sockaddr_t sa;
+#if defined(HAVE_LINUX_FILTER_H) && defined(SO_ATTACH_REUSEPORT_CBPF)
+    /* Returns the index of the socket in the group: cpu % num */
+    struct sock_filter code[] = {
+        { BPF_LD  | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU },
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, 0 },
+        { BPF_RET | BPF_A, 0, 0, 0 }
+    };
+    struct sock_fprog prog;
+
+    code[1].k = num;
+    prog.len = sizeof(code) / sizeof(code[0]);
+    prog.filter = code;
+    if (setsockopt(sock->socketdes, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                   &prog, sizeof(prog)) == -1) {
+        return errno;
+    }
+    return APR_SUCCESS;
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
+apr_status_t apr_socket_reuseport_group(apr_socket_t **socks, int num,
+                                        apr_sockaddr_t *sa, int type,
+                                        int protocol, apr_int32_t backlog,
+                                        apr_int32_t flags, apr_pool_t *p)
+{
+    apr_sockaddr_t *bind_sa = sa;
+    apr_status_t rv = APR_SUCCESS;
+    int i;
+
+    if (num <= 0) {
+        return APR_EINVAL;
+    }
 
-    sa.salen = sizeof(sa.sa);
+    for (i = 0; i < num; i++) {
+        rv = apr_socket_create(&socks[i], sa->family, type, protocol, p);
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+        rv = apr_socket_opt_set(socks[i], APR_SO_REUSEPORT, 1);
+        if (rv == APR_SUCCESS) {
+            rv = apr_socket_bind(socks[i], bind_sa);
+        }
+        if (rv == APR_SUCCESS && i == 0 && sa->port == 0) {
+            /* The others bind to the ephemeral port of the first */
+            rv = apr_socket_addr_get(&bind_sa, APR_LOCAL, socks[0]);
+        }
+        if (rv == APR_SUCCESS && type == SOCK_STREAM) {
+            rv = apr_socket_listen(socks[i], backlog);
+        }
+        if (rv != APR_SUCCESS) {
+            apr_socket_close(socks[i]);
+            break;
+        }
+    }
+
+    /* The program applies to the whole group, once complete */
+    if (rv == APR_SUCCESS && (flags & APR_REUSEPORT_STEER_CPU)) {
+        rv = reuseport_steer_cpu(socks[0], num);
+    }
+
+    if (rv != APR_SUCCESS) {
+        while (i-- > 0) {
+            apr_socket_close(socks[i]);
+        }
+        return rv;
+    }
+    return APR_SUCCESS;
+}
+
+/* Accept a descriptor, with the flags of the new socket set at once by
+ * accept4() where available
+ */
+static int accept_fd(apr_socket_t *sock, apr_sockaddr_t *sa)
+{
+    sa->salen = sizeof(sa->sa);
 
 #ifdef HAVE_ACCEPT4
     {
@@ -265,12 +348,21 @@ apr_status_t apr_socket_accept(apr_socket_t **new, apr_socket_t *sock,
             flags |= SOCK_NONBLOCK;
         }
 #endif
-        s = accept4(sock->socketdes, (struct sockaddr *)&sa.sa, &sa.salen, flags);
+        return accept4(sock->socketdes, (struct sockaddr *)&sa->sa,
+                       &sa->salen, flags);
     }
 #else
-    s = accept(sock->socketdes, (struct sockaddr *)&sa.sa, &sa.salen);
+    return accept(sock->socketdes, (struct sockaddr *)&sa->sa, &sa->salen);
 #endif
+}
 
+apr_status_t apr_socket_accept(apr_socket_t **new, apr_socket_t *sock,
+                               apr_pool_t *connection_context)
+{
+    int s;
+    apr_sockaddr_t sa;
+
+    s = accept_fd(sock, &sa);
     if (s < 0) {
         return errno;
     }
@@ -280,6 +372,52 @@ apr_status_t apr_socket_accept(apr_socket_t **new, apr_socket_t *sock,
         return APR_EINTR;
     }
 #endif
+    return apr_socket_accepted(new, sock, s, &sa, connection_context);
+}
+
+apr_status_t apr_socket_accept_batch(apr_socket_t **new_socks,
+                                     apr_int32_t *num, apr_socket_t *sock,
+                                     apr_pool_t **connection_pools)
+{
+    apr_int32_t i;
+    apr_status_t rv = APR_SUCCESS;
+    apr_sockaddr_t sa;
+    int s;
+
+    for (i = 0; i < *num; i++) {
+        /* A blocking listener would block for the next connection */
+        if (i > 0 && sock->timeout < 0) {
+            break;
+        }
+        s = accept_fd(sock, &sa);
+        if (s < 0) {
+            rv = errno;
+            break;
+        }
+#ifdef TPF
+        if (s == 0) {
+            rv = APR_EINTR;
+            break;
+        }
+#endif
+        rv = apr_socket_accepted(&new_socks[i], sock, s, &sa,
+                                 connection_pools[i]);
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+    }
+
+    /* Once some connections are accepted the error which stopped the batch
+     * is dropped, the next call returns it if it persists
+     */
+    *num = i;
+    return i ? APR_SUCCESS : rv;
+}
+
+apr_status_t apr_socket_accepted(apr_socket_t **new, apr_socket_t *sock,
+                                 int s, const apr_sockaddr_t *sa,
+                                 apr_pool_t *connection_context)
+{
     alloc_socket(new, connection_context);
 
     /* Set up socket variables -- note that it may be possible for
@@ -287,7 +425,7 @@ apr_status_t apr_socket_accept(apr_socket_t **new, apr_socket_t *sock,
      * dual-stack configurations, so ensure that the remote_/local_addr
      * structures are adjusted for the family of the accepted
      * socket: */
-    set_socket_vars(*new, sa.sa.sin.sin_family, SOCK_STREAM, sock->protocol);
+    set_socket_vars(*new, sa->sa.sin.sin_family, SOCK_STREAM, sock->protocol);
 
 #ifndef HAVE_POLL
     (*new)->connected = 1;
@@ -299,8 +437,8 @@ apr_status_t apr_socket_accept(apr_socket_t **new, apr_socket_t *sock,
     (*new)->socketdes = s;
 
     /* Copy in peer's address. */
-    (*new)->remote_addr->sa = sa.sa;
-    (*new)->remote_addr->salen = sa.salen;
+    (*new)->remote_addr->sa = sa->sa;
+    (*new)->remote_addr->salen = sa->salen;
 
     *(*new)->local_addr = *sock->local_addr;
 
@@ -343,6 +481,15 @@ apr_status_t apr_socket_accept(apr_socket_t **new, apr_socket_t *sock,
         apr_set_option(*new, APR_SO_NONBLOCK, 1);
     }
 #endif /* APR_O_NONBLOCK_INHERITED */
+    if (apr_is_option_set(sock, APR_SO_KERNEL_TIMEOUT) && sock->timeout > 0) {
+        /* The kernel timeouts may be inherited, and the new socket has none */
+        apr_status_t rv = apr_socket_kernel_timeout_set(s, 0);
+        if (rv != APR_SUCCESS) {
+            close(s);
+            (*new)->socketdes = -1;
+            return rv;
+        }
+    }
 
     if (sock->local_interface_unknown ||
         !memcmp(sock->local_addr->ipaddr_ptr,
@@ -400,6 +547,10 @@ apr_status_t apr_socket_connect(apr_socket_t *sock, apr_sockaddr_t *sa)
      */
     if ((rc == -1) && (errno == EINPROGRESS || errno == EALREADY)
                    && (sock->timeout > 0)) {
+        /* A blocking connect() gives up with the kernel timeout */
+        if (apr_is_option_set(sock, APR_SO_KERNEL_TIMEOUT)) {
+            return APR_TIMEUP;
+        }
         rc = apr_wait_for_io_or_timeout(NULL, sock, 0);
         if (rc != APR_SUCCESS) {
             return rc;
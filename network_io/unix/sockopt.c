@@ -17,6 +17,10 @@
 #include "apr_arch_networkio.h"
 #include "apr_strings.h"
 
+#ifdef HAVE_LINUX_TLS_H
+#include <linux/tls.h>
+#endif
+
 
 static apr_status_t soblock(int sd)
 {
@@ -71,11 +75,58 @@ static apr_status_t sononblock(int sd)
     return APR_SUCCESS;
 }
 
+apr_status_t apr_socket_kernel_timeout_set(int sd, apr_interval_time_t t)
+{
+#if defined(SO_RCVTIMEO) && defined(SO_SNDTIMEO)
+    struct timeval tv;
+
+    tv.tv_sec = t > 0 ? apr_time_sec(t) : 0;
+    tv.tv_usec = t > 0 ? apr_time_usec(t) : 0;
+    if (setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, (void *)&tv, sizeof(tv)) == -1
+        || setsockopt(sd, SOL_SOCKET, SO_SNDTIMEO, (void *)&tv,
+                      sizeof(tv)) == -1) {
+        return errno;
+    }
+    return APR_SUCCESS;
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
+/* The timeout with APR_SO_KERNEL_TIMEOUT: only t == 0 needs a
+ * non-blocking descriptor, the kernel times out the others */
+static apr_status_t sokerneltimeout(apr_socket_t *sock, apr_interval_time_t t,
+                                    apr_interval_time_t old)
+{
+    apr_status_t stat;
+    int nonblock = (t == 0);
+
+    if (apr_is_option_set(sock, APR_SO_NONBLOCK) != nonblock) {
+        stat = nonblock ? sononblock(sock->socketdes)
+                        : soblock(sock->socketdes);
+        if (stat != APR_SUCCESS) {
+            return stat;
+        }
+        apr_set_option(sock, APR_SO_NONBLOCK, nonblock);
+    }
+    if (t != old && (t > 0 || old > 0)) {
+        return apr_socket_kernel_timeout_set(sock->socketdes, t);
+    }
+    return APR_SUCCESS;
+}
 
 apr_status_t apr_socket_timeout_set(apr_socket_t *sock, apr_interval_time_t t)
 {
     apr_status_t stat;
 
+    if (apr_is_option_set(sock, APR_SO_KERNEL_TIMEOUT)) {
+        if ((stat = sokerneltimeout(sock, t, sock->timeout)) != APR_SUCCESS) {
+            return stat;
+        }
+        sock->timeout = t;
+        return APR_SUCCESS;
+    }
+
     /* If our new timeout is non-negative and our old timeout was
      * negative, then we need to ensure that we are non-blocking.
      * Conversely, if our new timeout is negative and we had
@@ -313,7 +364,36 @@ apr_status_t apr_socket_opt_set(apr_socket_t *sock,
 #endif
         break;
     case APR_INCOMPLETE_READ:
-        apr_set_option(sock, APR_INCOMPLETE_READ, on);
+        /* Nothing to wait for first on a blocking descriptor */
+        if (!apr_is_option_set(sock, APR_SO_KERNEL_TIMEOUT)) {
+            apr_set_option(sock, APR_INCOMPLETE_READ, on);
+        }
+        break;
+    case APR_SO_KERNEL_TIMEOUT:
+#if defined(SO_RCVTIMEO) && defined(SO_SNDTIMEO)
+        if (on != apr_is_option_set(sock, APR_SO_KERNEL_TIMEOUT)) {
+            if (on) {
+                if ((rv = sokerneltimeout(sock, sock->timeout, 0))) {
+                    return rv;
+                }
+                sock->options &= ~(APR_INCOMPLETE_READ | APR_INCOMPLETE_WRITE);
+            }
+            else if (sock->timeout > 0) {
+                /* Back to polling the non-blocking descriptor */
+                if ((rv = apr_socket_kernel_timeout_set(sock->socketdes, 0))
+                        || (rv = sononblock(sock->socketdes))) {
+                    return rv;
+                }
+                apr_set_option(sock, APR_SO_NONBLOCK, 1);
+            }
+            apr_set_option(sock, APR_SO_KERNEL_TIMEOUT, on);
+        }
+#else
+        return APR_ENOTIMPL;
+#endif
+        break;
+    case APR_SO_ADAPTIVE_WAIT:
+        apr_set_option(sock, APR_SO_ADAPTIVE_WAIT, on);
         break;
     case APR_IPV6_V6ONLY:
 #if APR_HAVE_IPV6 && defined(IPV6_V6ONLY)
@@ -342,6 +422,47 @@ apr_status_t apr_socket_opt_set(apr_socket_t *sock,
          * options, IP_BINDANY vs IPV6_BINDANY */
 #else
         return APR_ENOTIMPL;
+#endif
+        break;
+    case APR_SO_REUSEPORT:
+#ifdef SO_REUSEPORT
+        if (on != apr_is_option_set(sock, APR_SO_REUSEPORT)) {
+            if (setsockopt(sock->socketdes, SOL_SOCKET, SO_REUSEPORT, (void *)&one, sizeof(int)) == -1) {
+                return errno;
+            }
+            apr_set_option(sock, APR_SO_REUSEPORT, on);
+        }
+#else
+        return APR_ENOTIMPL;
+#endif
+        break;
+    case APR_SO_UDP_GRO:
+#ifdef UDP_GRO
+        if (on != apr_is_option_set(sock, APR_SO_UDP_GRO)) {
+            if (setsockopt(sock->socketdes, IPPROTO_UDP, UDP_GRO, (void *)&one, sizeof(int)) == -1) {
+                return errno;
+            }
+            apr_set_option(sock, APR_SO_UDP_GRO, on);
+        }
+#else
+        return APR_ENOTIMPL;
+#endif
+        break;
+    case APR_SO_ZEROCOPY:
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+        /* Once set SO_ZEROCOPY only allows MSG_ZEROCOPY, which is used
+         * according to the option of the socket
+         */
+        if (on && !apr_is_option_set(sock, APR_SO_ZEROCOPY)) {
+            if (setsockopt(sock->socketdes, SOL_SOCKET, SO_ZEROCOPY, (void *)&one, sizeof(int)) == -1) {
+                /* Not supported by the kernel or the protocol */
+                return (errno == ENOPROTOOPT || errno == EOPNOTSUPP)
+                       ? APR_ENOTIMPL : errno;
+            }
+        }
+        apr_set_option(sock, APR_SO_ZEROCOPY, on);
+#else
+        return APR_ENOTIMPL;
 #endif
         break;
     default:
@@ -439,6 +560,36 @@ apr_status_t apr_socket_accept_filter(apr_socket_t *sock, const char *name,
 }
 #endif
 
+apr_status_t apr_socket_ktls_enable(apr_socket_t *sock, apr_int32_t flags,
+                                    const void *crypto_info, apr_size_t len)
+{
+#if defined(HAVE_LINUX_TLS_H) && defined(TCP_ULP) && defined(SOL_TLS)
+    if (!(flags & (APR_KTLS_TX | APR_KTLS_RX))) {
+        return APR_EINVAL;
+    }
+
+    /* Already attached when enabling the other direction */
+    if (setsockopt(sock->socketdes, IPPROTO_TCP, TCP_ULP, "tls",
+                   sizeof("tls")) == -1 && errno != EEXIST) {
+        return (errno == ENOENT || errno == ENOPROTOOPT) ? APR_ENOTIMPL
+                                                         : errno;
+    }
+    if ((flags & APR_KTLS_TX)
+        && setsockopt(sock->socketdes, SOL_TLS, TLS_TX, crypto_info,
+                      len) == -1) {
+        return errno;
+    }
+    if ((flags & APR_KTLS_RX)
+        && setsockopt(sock->socketdes, SOL_TLS, TLS_RX, crypto_info,
+                      len) == -1) {
+        return errno;
+    }
+    return APR_SUCCESS;
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
 APR_PERMS_SET_IMPLEMENT(socket)
 {
 #if APR_HAVE_SOCKADDR_UN
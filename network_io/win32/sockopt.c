@@ -286,6 +286,31 @@ APR_DECLARE(apr_status_t) apr_socket_atmark(apr_socket_t *sock, int *atmark)
 }
 
 
+APR_DECLARE(apr_status_t) apr_socket_zerocopy_seq(apr_socket_t *sock,
+                                                  apr_uint32_t *seq)
+{
+    *seq = 0;
+    return APR_ENOTIMPL;
+}
+
+
+APR_DECLARE(apr_status_t) apr_socket_zerocopy_reap(apr_socket_t *sock,
+                                                   apr_socket_zerocopy_cb_t func,
+                                                   void *baton)
+{
+    return APR_ENOTIMPL;
+}
+
+
+APR_DECLARE(apr_status_t) apr_socket_ktls_enable(apr_socket_t *sock,
+                                                 apr_int32_t flags,
+                                                 const void *crypto_info,
+                                                 apr_size_t len)
+{
+    return APR_ENOTIMPL;
+}
+
+
 APR_DECLARE(apr_status_t) apr_gethostname(char *buf, int len,
                                           apr_pool_t *cont)
 {
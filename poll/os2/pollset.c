@@ -118,6 +118,10 @@ APR_DECLARE(apr_status_t) apr_pollset_destroy(apr_pollset_t *pollset)
 APR_DECLARE(apr_status_t) apr_pollset_add(apr_pollset_t *pollset,
                                           const apr_pollfd_t *descriptor)
 {
+    if (descriptor->reqevents & (APR_POLLET | APR_POLLONESHOT)) {
+        return APR_ENOTIMPL;
+    }
+
     if (pollset->nelts == pollset->nalloc) {
         return APR_ENOMEM;
     }
@@ -168,6 +172,14 @@ APR_DECLARE(apr_status_t) apr_pollset_remove(apr_pollset_t *pollset,
 
 
 
+APR_DECLARE(apr_status_t) apr_pollset_rearm(apr_pollset_t *pollset,
+                                            const apr_pollfd_t *descriptor)
+{
+    return APR_ENOTIMPL;
+}
+
+
+
 static void make_pollset(apr_pollset_t *pollset)
 {
     int i;
@@ -293,6 +305,30 @@ APR_DECLARE(apr_status_t) apr_pollset_poll(apr_pollset_t *pollset,
 
 
 
+APR_DECLARE(apr_status_t) apr_pollset_poll_ex(apr_pollset_t *pollset,
+                                              apr_interval_time_t timeout,
+                                              apr_int32_t maxevents,
+                                              apr_int32_t *num,
+                                              apr_pollfd_t *descriptors)
+{
+    const apr_pollfd_t *result;
+    apr_status_t rv;
+
+    *num = 0;
+    if (maxevents <= 0) {
+        return APR_EINVAL;
+    }
+    if ((apr_uint32_t)maxevents < pollset->nalloc) {
+        return APR_ENOTIMPL;
+    }
+    rv = apr_pollset_poll(pollset, timeout, num, &result);
+    if (*num > 0) {
+        memcpy(descriptors, result, *num * sizeof(apr_pollfd_t));
+    }
+    return rv;
+}
+
+
 APR_DECLARE(apr_status_t) apr_pollset_wakeup(apr_pollset_t *pollset)
 {
     if (!pollset->wake_sender)
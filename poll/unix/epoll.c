@@ -18,6 +18,7 @@
 #include "apr_poll.h"
 #include "apr_time.h"
 #include "apr_portable.h"
+#include "apr_atomic.h"
 #include "apr_arch_file_io.h"
 #include "apr_arch_networkio.h"
 #include "apr_arch_poll_private.h"
@@ -39,6 +40,10 @@ static unsigned get_epoll_event(apr_int16_t event)
     if (event & APR_POLLEXCL)
         rv |= EPOLLEXCLUSIVE;
 #endif
+    if (event & APR_POLLET)
+        rv |= EPOLLET;
+    if (event & APR_POLLONESHOT)
+        rv |= EPOLLONESHOT;
     /* APR_POLLNVAL is not handled by epoll.  EPOLLERR and EPOLLHUP are return-only */
 
     return rv;
@@ -63,24 +68,204 @@ static apr_int16_t get_epoll_revent(unsigned event)
     return rv;
 }
 
+/*
+ * Without APR_POLLSET_NOCOPY the descriptors are copied into elements,
+ * whose address is the data of their epoll event.  None of add, remove
+ * and poll takes a lock, except to allocate memory:
+ *
+ * - The elements are found by their file descriptor in a table of pages,
+ *   a page is allocated the first time one of its descriptors is added.
+ * - The removed elements go to the dead list, and the dead list goes to
+ *   the free list once no poll and no pop of the free list is running,
+ *   since a poll may still be copying a removed element and a pop may
+ *   still be reading the next of an element (ABA).
+ *
+ * Both lists are stacks updated with apr_atomic_casptr().
+ */
+
+#define EPOLL_PAGE_BITS 10
+#define EPOLL_PAGE_SIZE (1 << EPOLL_PAGE_BITS)
+
+typedef struct epoll_elem_t epoll_elem_t;
+
+struct epoll_elem_t {
+    epoll_elem_t *next;
+    apr_pollfd_t pfd;
+};
+
+typedef struct epoll_page_t {
+    epoll_elem_t *volatile elem[EPOLL_PAGE_SIZE];
+} epoll_page_t;
+
+typedef struct epoll_table_t {
+    apr_size_t npages;
+    epoll_page_t *volatile page[1];
+} epoll_table_t;
+
 struct apr_pollset_private_t
 {
     int epoll_fd;
+    /* The arrays of apr_pollset_poll(), allocated by its first call since
+     * apr_pollset_poll_ex() does not need them
+     */
     struct epoll_event *pollset;
-    apr_pollfd_t *result_set;
+    apr_pollfd_t *volatile result_set;
 #if APR_HAS_THREADS
-    /* A thread mutex to protect operations on the rings */
+    /* A thread mutex to protect the allocation of the elements, the pages
+     * and the arrays of apr_pollset_poll()
+     */
     apr_thread_mutex_t *ring_lock;
 #endif
-    /* A ring containing all of the pollfd_t that are active */
-    APR_RING_HEAD(pfd_query_ring_t, pfd_elem_t) query_ring;
-    /* A ring of pollfd_t that have been used, and then _remove()'d */
-    APR_RING_HEAD(pfd_free_ring_t, pfd_elem_t) free_ring;
-    /* A ring of pollfd_t where rings that have been _remove()`ed but
-        might still be inside a _poll() */
-    APR_RING_HEAD(pfd_dead_ring_t, pfd_elem_t) dead_ring;
+    /* The elements of the added descriptors, by file descriptor */
+    epoll_table_t *volatile table;
+    /* The elements which can be reused */
+    epoll_elem_t *volatile free_list;
+    /* The removed elements which might still be used by a poll */
+    epoll_elem_t *volatile dead_list;
+    /* The number of polls and pops of the free list running */
+    volatile apr_uint32_t active;
 };
 
+static void epoll_push(epoll_elem_t *volatile *list, epoll_elem_t *first,
+                       epoll_elem_t *last)
+{
+    epoll_elem_t *head;
+
+    do {
+        head = *list;
+        last->next = head;
+    } while (apr_atomic_casptr((void *volatile *)list, first, head) != head);
+}
+
+static void epoll_enter(apr_pollset_private_t *p)
+{
+    apr_atomic_inc32(&p->active);
+}
+
+/* The dead elements are taken before leaving, they were removed before
+ * any poll or pop still running when active drops to zero
+ */
+static void epoll_leave(apr_pollset_private_t *p)
+{
+    epoll_elem_t *dead = NULL, *last;
+
+    if (apr_atomic_read32(&p->active) == 1 && p->dead_list) {
+        dead = apr_atomic_xchgptr((void *volatile *)&p->dead_list, NULL);
+    }
+    if (!dead) {
+        apr_atomic_dec32(&p->active);
+        return;
+    }
+
+    for (last = dead; last->next; last = last->next)
+        ;
+    if (!apr_atomic_dec32(&p->active)) {
+        epoll_push(&p->free_list, dead, last);
+    }
+    else {
+        /* Entered meanwhile, reclaimed by the last one leaving */
+        epoll_push(&p->dead_list, dead, last);
+    }
+}
+
+static epoll_elem_t *epoll_elem_get(apr_pollset_t *pollset)
+{
+    apr_pollset_private_t *p = pollset->p;
+    epoll_elem_t *elem, *next;
+
+    epoll_enter(p);
+    do {
+        elem = p->free_list;
+        if (!elem) {
+            break;
+        }
+        next = elem->next;
+    } while (apr_atomic_casptr((void *volatile *)&p->free_list, next,
+                               elem) != elem);
+    epoll_leave(p);
+
+    if (!elem) {
+        pollset_lock_rings();
+        elem = apr_palloc(pollset->pool, sizeof(epoll_elem_t));
+        pollset_unlock_rings();
+    }
+    return elem;
+}
+
+/* Return the slot of the descriptor in the table, created if asked to */
+static epoll_elem_t *volatile *epoll_slot(apr_pollset_t *pollset,
+                                          const apr_pollfd_t *descriptor,
+                                          int create)
+{
+    apr_pollset_private_t *p = pollset->p;
+    epoll_table_t *table;
+    apr_size_t fd, n;
+
+    if (descriptor->desc_type == APR_POLL_SOCKET) {
+        fd = descriptor->desc.s->socketdes;
+    }
+    else {
+        fd = descriptor->desc.f->filedes;
+    }
+    n = fd >> EPOLL_PAGE_BITS;
+
+    table = p->table;
+    if (!table || n >= table->npages || !table->page[n]) {
+        if (!create) {
+            return NULL;
+        }
+
+        /* Readers may still use the previous table, which stays valid:
+         * a page never moves once allocated
+         */
+        pollset_lock_rings();
+        table = p->table;
+        if (!table || n >= table->npages) {
+            epoll_table_t *grown;
+            apr_size_t npages = table ? table->npages * 2 : 1;
+
+            if (npages <= n) {
+                npages = n + 1;
+            }
+            grown = apr_pcalloc(pollset->pool, sizeof(epoll_table_t)
+                                + (npages - 1) * sizeof(epoll_page_t *));
+            grown->npages = npages;
+            if (table) {
+                memcpy((void *)grown->page, (void *)table->page,
+                       table->npages * sizeof(epoll_page_t *));
+            }
+            apr_atomic_xchgptr((void *volatile *)&p->table, grown);
+            table = grown;
+        }
+        if (!table->page[n]) {
+            apr_atomic_xchgptr((void *volatile *)&table->page[n],
+                               apr_pcalloc(pollset->pool,
+                                           sizeof(epoll_page_t)));
+        }
+        pollset_unlock_rings();
+    }
+
+    return &table->page[n]->elem[fd & (EPOLL_PAGE_SIZE - 1)];
+}
+
+/* Find the element of an added descriptor */
+static epoll_elem_t *epoll_elem_find(apr_pollset_t *pollset,
+                                     const apr_pollfd_t *descriptor,
+                                     epoll_elem_t *volatile **slot)
+{
+    epoll_elem_t *elem;
+
+    *slot = epoll_slot(pollset, descriptor, 0);
+    if (!*slot) {
+        return NULL;
+    }
+    elem = **slot;
+    if (!elem || elem->pfd.desc.s != descriptor->desc.s) {
+        return NULL;
+    }
+    return elem;
+}
+
 static apr_status_t impl_pollset_cleanup(apr_pollset_t *pollset)
 {
     close(pollset->p->epoll_fd);
@@ -130,7 +315,6 @@ static apr_status_t impl_pollset_create(apr_pollset_t *pollset,
     pollset->p = apr_pcalloc(p, sizeof(apr_pollset_private_t));
 #if APR_HAS_THREADS
     if ((flags & APR_POLLSET_THREADSAFE) &&
-        !(flags & APR_POLLSET_NOCOPY) &&
         ((rv = apr_thread_mutex_create(&pollset->p->ring_lock,
                                        APR_THREAD_MUTEX_DEFAULT,
                                        p)) != APR_SUCCESS)) {
@@ -146,14 +330,6 @@ static apr_status_t impl_pollset_create(apr_pollset_t *pollset,
     }
 #endif
     pollset->p->epoll_fd = fd;
-    pollset->p->pollset = apr_palloc(p, size * sizeof(struct epoll_event));
-    pollset->p->result_set = apr_palloc(p, size * sizeof(apr_pollfd_t));
-
-    if (!(flags & APR_POLLSET_NOCOPY)) {
-        APR_RING_INIT(&pollset->p->query_ring, pfd_elem_t, link);
-        APR_RING_INIT(&pollset->p->free_ring, pfd_elem_t, link);
-        APR_RING_INIT(&pollset->p->dead_ring, pfd_elem_t, link);
-    }
     return APR_SUCCESS;
 }
 
@@ -162,7 +338,8 @@ static apr_status_t impl_pollset_add(apr_pollset_t *pollset,
 {
     struct epoll_event ev = {0};
     int ret;
-    pfd_elem_t *elem = NULL;
+    epoll_elem_t *elem = NULL, *stale;
+    epoll_elem_t *volatile *slot;
     apr_status_t rv = APR_SUCCESS;
 
     ev.events = get_epoll_event(descriptor->reqevents);
@@ -171,16 +348,7 @@ static apr_status_t impl_pollset_add(apr_pollset_t *pollset,
         ev.data.ptr = (void *)descriptor;
     }
     else {
-        pollset_lock_rings();
-
-        if (!APR_RING_EMPTY(&(pollset->p->free_ring), pfd_elem_t, link)) {
-            elem = APR_RING_FIRST(&(pollset->p->free_ring));
-            APR_RING_REMOVE(elem, link);
-        }
-        else {
-            elem = (pfd_elem_t *) apr_palloc(pollset->pool, sizeof(pfd_elem_t));
-            APR_RING_ELEM_INIT(elem, link);
-        }
+        elem = epoll_elem_get(pollset);
         elem->pfd = *descriptor;
         ev.data.ptr = elem;
     }
@@ -199,12 +367,21 @@ static apr_status_t impl_pollset_add(apr_pollset_t *pollset,
 
     if (!(pollset->flags & APR_POLLSET_NOCOPY)) {
         if (rv != APR_SUCCESS) {
-            APR_RING_INSERT_TAIL(&(pollset->p->free_ring), elem, pfd_elem_t, link);
+            /* Not pushed back to the free list directly, a pop may be
+             * reading it
+             */
+            epoll_push(&pollset->p->dead_list, elem, elem);
         }
         else {
-            APR_RING_INSERT_TAIL(&(pollset->p->query_ring), elem, pfd_elem_t, link);
+            /* The element of a descriptor closed without being removed
+             * may still be there
+             */
+            slot = epoll_slot(pollset, descriptor, 1);
+            stale = apr_atomic_xchgptr((void *volatile *)slot, elem);
+            if (stale) {
+                epoll_push(&pollset->p->dead_list, stale, stale);
+            }
         }
-        pollset_unlock_rings();
     }
 
     return rv;
@@ -213,7 +390,8 @@ static apr_status_t impl_pollset_add(apr_pollset_t *pollset,
 static apr_status_t impl_pollset_remove(apr_pollset_t *pollset,
                                         const apr_pollfd_t *descriptor)
 {
-    pfd_elem_t *ep;
+    epoll_elem_t *elem;
+    epoll_elem_t *volatile *slot;
     apr_status_t rv = APR_SUCCESS;
     struct epoll_event ev = {0}; /* ignored, but must be passed with
                                   * kernel < 2.6.9
@@ -233,31 +411,64 @@ static apr_status_t impl_pollset_remove(apr_pollset_t *pollset,
     }
 
     if (!(pollset->flags & APR_POLLSET_NOCOPY)) {
-        pollset_lock_rings();
+        elem = epoll_elem_find(pollset, descriptor, &slot);
+        if (elem && apr_atomic_casptr((void *volatile *)slot, NULL,
+                                      elem) == elem) {
+            epoll_push(&pollset->p->dead_list, elem, elem);
+        }
+    }
 
-        for (ep = APR_RING_FIRST(&(pollset->p->query_ring));
-             ep != APR_RING_SENTINEL(&(pollset->p->query_ring),
-                                     pfd_elem_t, link);
-             ep = APR_RING_NEXT(ep, link)) {
+    return rv;
+}
 
-            if (descriptor->desc.s == ep->pfd.desc.s) {
-                APR_RING_REMOVE(ep, link);
-                APR_RING_INSERT_TAIL(&(pollset->p->dead_ring),
-                                     ep, pfd_elem_t, link);
-                break;
-            }
+static apr_status_t impl_pollset_rearm(apr_pollset_t *pollset,
+                                       const apr_pollfd_t *descriptor)
+{
+    struct epoll_event ev = {0};
+    epoll_elem_t *volatile *slot;
+    int ret;
+    apr_status_t rv = APR_SUCCESS;
+
+    ev.events = get_epoll_event(descriptor->reqevents);
+
+    if (pollset->flags & APR_POLLSET_NOCOPY) {
+        ev.data.ptr = (void *)descriptor;
+    }
+    else {
+        /* The event must point to the copy */
+        ev.data.ptr = epoll_elem_find(pollset, descriptor, &slot);
+        if (!ev.data.ptr) {
+            return APR_NOTFOUND;
         }
+    }
 
-        pollset_unlock_rings();
+    if (descriptor->desc_type == APR_POLL_SOCKET) {
+        ret = epoll_ctl(pollset->p->epoll_fd, EPOLL_CTL_MOD,
+                        descriptor->desc.s->socketdes, &ev);
+    }
+    else {
+        ret = epoll_ctl(pollset->p->epoll_fd, EPOLL_CTL_MOD,
+                        descriptor->desc.f->filedes, &ev);
+    }
+    if (ret < 0) {
+        rv = apr_get_netos_error();
+        if (APR_STATUS_IS_ENOENT(rv)) {
+            rv = APR_NOTFOUND;
+        }
     }
 
     return rv;
 }
 
-static apr_status_t impl_pollset_poll(apr_pollset_t *pollset,
-                                           apr_interval_time_t timeout,
-                                           apr_int32_t *num,
-                                           const apr_pollfd_t **descriptors)
+/* Wait for at most maxevents events, the results being copied in order
+ * while the events are read, so that results may overlap the end of events
+ */
+static apr_status_t epoll_pollset_wait(apr_pollset_t *pollset,
+                                       apr_interval_time_t timeout,
+                                       struct epoll_event *events,
+                                       apr_int32_t maxevents,
+                                       apr_int32_t *num,
+                                       apr_pollfd_t *results)
 {
     int ret;
     apr_status_t rv = APR_SUCCESS;
@@ -268,8 +479,12 @@ static apr_status_t impl_pollset_poll(apr_pollset_t *pollset,
         timeout = (timeout + 999) / 1000;
     }
 
-    ret = epoll_wait(pollset->p->epoll_fd, pollset->p->pollset, pollset->nalloc,
-                     timeout);
+    /* The elements removed while waiting are not reused before leaving */
+    if (!(pollset->flags & APR_POLLSET_NOCOPY)) {
+        epoll_enter(pollset->p);
+    }
+
+    ret = epoll_wait(pollset->p->epoll_fd, events, maxevents, timeout);
     if (ret < 0) {
         rv = apr_get_netos_error();
     }
@@ -279,14 +494,16 @@ static apr_status_t impl_pollset_poll(apr_pollset_t *pollset,
     else {
         int i, j;
         const apr_pollfd_t *fdptr;
+        apr_int16_t rtnevents;
 
         for (i = 0, j = 0; i < ret; i++) {
             if (pollset->flags & APR_POLLSET_NOCOPY) {
-                fdptr = (apr_pollfd_t *)(pollset->p->pollset[i].data.ptr);
+                fdptr = (apr_pollfd_t *)(events[i].data.ptr);
             }
             else {
-                fdptr = &(((pfd_elem_t *) (pollset->p->pollset[i].data.ptr))->pfd);
+                fdptr = &(((epoll_elem_t *) (events[i].data.ptr))->pfd);
             }
+            rtnevents = get_epoll_revent(events[i].events);
             /* Check if the polled descriptor is our
              * wakeup pipe. In that case do not put it result set.
              */
@@ -297,40 +514,79 @@ static apr_status_t impl_pollset_poll(apr_pollset_t *pollset,
                 rv = APR_EINTR;
             }
             else {
-                pollset->p->result_set[j] = *fdptr;
-                pollset->p->result_set[j].rtnevents =
-                    get_epoll_revent(pollset->p->pollset[i].events);
+                results[j] = *fdptr;
+                results[j].rtnevents = rtnevents;
                 j++;
             }
         }
         if (((*num) = j)) { /* any event besides wakeup pipe? */
             rv = APR_SUCCESS;
-
-            if (descriptors) {
-                *descriptors = pollset->p->result_set;
-            }
         }
     }
 
     if (!(pollset->flags & APR_POLLSET_NOCOPY)) {
-        pollset_lock_rings();
+        epoll_leave(pollset->p);
+    }
 
-        /* Shift all PFDs in the Dead Ring to the Free Ring */
-        APR_RING_CONCAT(&(pollset->p->free_ring), &(pollset->p->dead_ring), pfd_elem_t, link);
+    return rv;
+}
 
+static apr_status_t impl_pollset_poll(apr_pollset_t *pollset,
+                                           apr_interval_time_t timeout,
+                                           apr_int32_t *num,
+                                           const apr_pollfd_t **descriptors)
+{
+    apr_pollset_private_t *p = pollset->p;
+    apr_status_t rv;
+
+    if (!p->result_set) {
+        pollset_lock_rings();
+        if (!p->result_set) {
+            p->pollset = apr_palloc(pollset->pool, pollset->nalloc
+                                                   * sizeof(struct epoll_event));
+            apr_atomic_xchgptr((void *volatile *)&p->result_set,
+                               apr_palloc(pollset->pool, pollset->nalloc
+                                                         * sizeof(apr_pollfd_t)));
+        }
         pollset_unlock_rings();
     }
 
+    rv = epoll_pollset_wait(pollset, timeout, p->pollset, pollset->nalloc,
+                            num, p->result_set);
+    if (*num && descriptors) {
+        *descriptors = p->result_set;
+    }
     return rv;
 }
 
+static apr_status_t impl_pollset_poll_ex(apr_pollset_t *pollset,
+                                         apr_interval_time_t timeout,
+                                         apr_int32_t maxevents,
+                                         apr_int32_t *num,
+                                         apr_pollfd_t *descriptors)
+{
+    /* The events are received at the end of the descriptors: the result j
+     * copied from the event i >= j ends before the event i + 1 starts
+     */
+    struct epoll_event *events = (struct epoll_event *)
+        ((char *)descriptors + (apr_size_t)maxevents
+                               * (sizeof(apr_pollfd_t)
+                                  - sizeof(struct epoll_event)));
+
+    return epoll_pollset_wait(pollset, timeout, events, maxevents,
+                              num, descriptors);
+}
+
 static const apr_pollset_provider_t impl = {
     impl_pollset_create,
     impl_pollset_add,
     impl_pollset_remove,
     impl_pollset_poll,
     impl_pollset_cleanup,
-    "epoll"
+    "epoll",
+    NULL,
+    impl_pollset_rearm,
+    impl_pollset_poll_ex
 };
 
 const apr_pollset_provider_t *const apr_pollset_provider_epoll = &impl;
@@ -436,6 +692,31 @@ static apr_status_t impl_pollcb_remove(apr_pollcb_t *pollcb,
     return rv;
 }
 
+static apr_status_t impl_pollcb_rearm(apr_pollcb_t *pollcb,
+                                      apr_pollfd_t *descriptor)
+{
+    struct epoll_event ev = { 0 };
+    int ret;
+
+    ev.events = get_epoll_event(descriptor->reqevents);
+    ev.data.ptr = (void *) descriptor;
+
+    if (descriptor->desc_type == APR_POLL_SOCKET) {
+        ret = epoll_ctl(pollcb->fd, EPOLL_CTL_MOD,
+                        descriptor->desc.s->socketdes, &ev);
+    }
+    else {
+        ret = epoll_ctl(pollcb->fd, EPOLL_CTL_MOD,
+                        descriptor->desc.f->filedes, &ev);
+    }
+
+    if (ret == -1) {
+        apr_status_t rv = apr_get_netos_error();
+        return APR_STATUS_IS_ENOENT(rv) ? APR_NOTFOUND : rv;
+    }
+
+    return APR_SUCCESS;
+}
 
 static apr_status_t impl_pollcb_poll(apr_pollcb_t *pollcb,
                                      apr_interval_time_t timeout,
@@ -486,7 +767,9 @@ static const apr_pollcb_provider_t impl_cb = {
     impl_pollcb_remove,
     impl_pollcb_poll,
     impl_pollcb_cleanup,
-    "epoll"
+    "epoll",
+    NULL,
+    impl_pollcb_rearm
 };
 
 const apr_pollcb_provider_t *const apr_pollcb_provider_epoll = &impl_cb;
@@ -0,0 +1,761 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr.h"
+#include "apr_poll.h"
+#include "apr_time.h"
+#include "apr_portable.h"
+#include "apr_atomic.h"
+#include "apr_ring.h"
+#include "apr_arch_file_io.h"
+#include "apr_arch_networkio.h"
+#include "apr_arch_poll_private.h"
+#include "apr_arch_inherit.h"
+
+#if defined(HAVE_IO_URING)
+
+#include "apr_arch_uring.h"
+
+#if APR_HAS_THREADS
+#include "apr_thread_mutex.h"
+#endif
+
+/*
+ * The descriptors are polled with one-shot IORING_OP_POLL_ADD requests,
+ * whose user_data is the element of the descriptor.  A request that
+ * completes is not re-armed right away but at the next poll, so that the
+ * descriptors stay level-triggered as with the other methods: a multishot
+ * poll would only report new events.  The requests queued by add, remove
+ * and the re-arming are submitted by the io_uring_enter() which waits for
+ * the completions, so a poll is a single system call.
+ *
+ * An APR_POLLONESHOT descriptor is simply not re-armed until rearm is
+ * called, while APR_POLLET would need a multishot poll and is not
+ * implemented.
+ *
+ * The wakeup is an IORING_MSG_DATA message posted to the ring by a second
+ * ring of one entry, hence no pipe.
+ */
+
+#define URING_USER_DATA_IGNORE (0)
+#define URING_USER_DATA_WAKEUP (1)
+
+#define URING_MIN_ENTRIES (16)
+
+typedef struct uring_elem_t uring_elem_t;
+
+struct uring_elem_t {
+    APR_RING_ENTRY(uring_elem_t) link;
+    /* Link in the ring of the elements to (re-)arm at the next poll */
+    APR_RING_ENTRY(uring_elem_t) pending_link;
+    apr_pollfd_t pfd;
+    /* The polled descriptor, &pfd for a pollset and the caller's for a
+     * pollcb
+     */
+    apr_pollfd_t *pollfd;
+    /* A poll request is queued or in the kernel */
+    int armed;
+    /* On the pending ring */
+    int pending;
+    /* Removed while armed, on the dead ring */
+    int removed;
+};
+
+struct apr_pollset_private_t
+{
+    apr_uring_t ring;
+    apr_uring_t wakeup_ring;
+    apr_pool_t *pool;
+    apr_uint32_t flags;
+    apr_pollfd_t *result_set;
+#if APR_HAS_THREADS
+    /* A thread mutex to protect the rings and the submission queue */
+    apr_thread_mutex_t *ring_lock;
+    /* A thread mutex to protect the submission queue of the wakeup ring */
+    apr_thread_mutex_t *wakeup_lock;
+#endif
+    /* A ring containing all of the elements that are active */
+    APR_RING_HEAD(uring_query_ring_t, uring_elem_t) query_ring;
+    /* A ring of the active elements which are not armed */
+    APR_RING_HEAD(uring_pending_ring_t, uring_elem_t) pending_ring;
+    /* A ring of elements that have been used, and then _remove()'d */
+    APR_RING_HEAD(uring_free_ring_t, uring_elem_t) free_ring;
+    /* A ring of elements that have been _remove()'d but still have a
+     * poll request in the kernel
+     */
+    APR_RING_HEAD(uring_dead_ring_t, uring_elem_t) dead_ring;
+};
+
+typedef struct apr_pollset_private_t uring_set_t;
+
+#if APR_HAS_THREADS
+#define uring_lock(u) \
+    if ((u)->ring_lock) \
+        apr_thread_mutex_lock((u)->ring_lock);
+#define uring_unlock(u) \
+    if ((u)->ring_lock) \
+        apr_thread_mutex_unlock((u)->ring_lock);
+#else
+#define uring_lock(u)
+#define uring_unlock(u)
+#endif
+
+static apr_uint32_t get_uring_event(apr_int16_t event)
+{
+    apr_uint32_t rv = 0;
+
+    if (event & APR_POLLIN)
+        rv |= POLLIN;
+    if (event & APR_POLLPRI)
+        rv |= POLLPRI;
+    if (event & APR_POLLOUT)
+        rv |= POLLOUT;
+    /* POLLERR and POLLHUP are always polled for */
+
+#if APR_IS_BIGENDIAN
+    /* poll32_events is word-swapped on big-endian */
+    rv = (rv << 16) | (rv >> 16);
+#endif
+    return rv;
+}
+
+static apr_int16_t get_uring_revent(apr_uint32_t event)
+{
+    apr_int16_t rv = 0;
+
+    if (event & POLLIN)
+        rv |= APR_POLLIN;
+    if (event & POLLPRI)
+        rv |= APR_POLLPRI;
+    if (event & POLLOUT)
+        rv |= APR_POLLOUT;
+    if (event & POLLERR)
+        rv |= APR_POLLERR;
+    if (event & POLLHUP)
+        rv |= APR_POLLHUP;
+    if (event & POLLNVAL)
+        rv |= APR_POLLNVAL;
+
+    return rv;
+}
+
+static apr_status_t uring_arm(uring_set_t *u, uring_elem_t *elem)
+{
+    struct io_uring_sqe *sqe;
+    apr_status_t rv = APR_SUCCESS;
+    const apr_pollfd_t *pollfd = elem->pollfd;
+
+    sqe = apr_uring_get_sqe(&u->ring, &rv);
+    if (!sqe) {
+        return rv;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    if (pollfd->desc_type == APR_POLL_SOCKET) {
+        sqe->fd = pollfd->desc.s->socketdes;
+    }
+    else {
+        sqe->fd = pollfd->desc.f->filedes;
+    }
+    sqe->poll32_events = get_uring_event(pollfd->reqevents);
+    sqe->user_data = (apr_uint64_t)(apr_uintptr_t)elem;
+    apr_uring_commit_sqe(&u->ring);
+
+    elem->armed = 1;
+    return APR_SUCCESS;
+}
+
+static apr_status_t uring_disarm(uring_set_t *u, uring_elem_t *elem)
+{
+    struct io_uring_sqe *sqe;
+    apr_status_t rv = APR_SUCCESS;
+
+    sqe = apr_uring_get_sqe(&u->ring, &rv);
+    if (!sqe) {
+        return rv;
+    }
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->addr = (apr_uint64_t)(apr_uintptr_t)elem;
+    sqe->user_data = URING_USER_DATA_IGNORE;
+    apr_uring_commit_sqe(&u->ring);
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t uring_cleanup(uring_set_t *u)
+{
+    apr_uring_close(&u->ring);
+    apr_uring_close(&u->wakeup_ring);
+    return APR_SUCCESS;
+}
+
+static apr_status_t uring_create(uring_set_t **ret_u, apr_uint32_t size,
+                                 apr_pool_t *p, apr_uint32_t flags)
+{
+    uring_set_t *u;
+    apr_status_t rv;
+
+#if !APR_HAS_THREADS
+    if (flags & APR_POLLSET_THREADSAFE) {
+        return APR_ENOTIMPL;
+    }
+#endif
+
+    u = apr_pcalloc(p, sizeof(*u));
+    u->pool = p;
+    u->flags = flags;
+    u->wakeup_ring.fd = -1;
+
+    rv = apr_uring_setup(&u->ring, size < URING_MIN_ENTRIES ? URING_MIN_ENTRIES
+                                                            : size);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    if (flags & APR_POLLSET_WAKEABLE) {
+        if (!apr_uring_supports(&u->ring, IORING_OP_MSG_RING)) {
+            /* Before Linux 5.18 */
+            uring_cleanup(u);
+            return APR_ENOTIMPL;
+        }
+        rv = apr_uring_setup(&u->wakeup_ring, 1);
+        if (rv != APR_SUCCESS) {
+            uring_cleanup(u);
+            return rv;
+        }
+    }
+#if APR_HAS_THREADS
+    if ((flags & APR_POLLSET_THREADSAFE)
+        && (rv = apr_thread_mutex_create(&u->ring_lock,
+                                         APR_THREAD_MUTEX_DEFAULT,
+                                         p)) != APR_SUCCESS) {
+        uring_cleanup(u);
+        return rv;
+    }
+    if ((flags & APR_POLLSET_WAKEABLE)
+        && (rv = apr_thread_mutex_create(&u->wakeup_lock,
+                                         APR_THREAD_MUTEX_DEFAULT,
+                                         p)) != APR_SUCCESS) {
+        uring_cleanup(u);
+        return rv;
+    }
+#endif
+
+    APR_RING_INIT(&u->query_ring, uring_elem_t, link);
+    APR_RING_INIT(&u->pending_ring, uring_elem_t, pending_link);
+    APR_RING_INIT(&u->free_ring, uring_elem_t, link);
+    APR_RING_INIT(&u->dead_ring, uring_elem_t, link);
+
+    *ret_u = u;
+    return APR_SUCCESS;
+}
+
+static apr_status_t uring_add(uring_set_t *u, apr_pollfd_t *descriptor,
+                              int copy)
+{
+    uring_elem_t *elem;
+    apr_status_t rv = APR_SUCCESS;
+
+    if (descriptor->reqevents & APR_POLLET) {
+        return APR_ENOTIMPL;
+    }
+
+    uring_lock(u);
+
+    if (!APR_RING_EMPTY(&u->free_ring, uring_elem_t, link)) {
+        elem = APR_RING_FIRST(&u->free_ring);
+        APR_RING_REMOVE(elem, link);
+    }
+    else {
+        elem = apr_palloc(u->pool, sizeof(uring_elem_t));
+        APR_RING_ELEM_INIT(elem, link);
+    }
+    if (copy) {
+        elem->pfd = *descriptor;
+        elem->pollfd = &elem->pfd;
+    }
+    else {
+        elem->pollfd = descriptor;
+    }
+    elem->armed = 0;
+    elem->removed = 0;
+    APR_RING_INSERT_TAIL(&u->query_ring, elem, uring_elem_t, link);
+
+    if (u->flags & APR_POLLSET_THREADSAFE) {
+        /* Poll it now, a poll may be waiting in another thread */
+        elem->pending = 0;
+        rv = uring_arm(u, elem);
+        if (rv == APR_SUCCESS) {
+            rv = apr_uring_submit(&u->ring);
+        }
+        if (rv != APR_SUCCESS && !elem->armed) {
+            APR_RING_REMOVE(elem, link);
+            APR_RING_INSERT_TAIL(&u->free_ring, elem, uring_elem_t, link);
+        }
+    }
+    else {
+        elem->pending = 1;
+        APR_RING_INSERT_TAIL(&u->pending_ring, elem, uring_elem_t,
+                             pending_link);
+    }
+
+    uring_unlock(u);
+
+    return rv;
+}
+
+static apr_status_t uring_remove(uring_set_t *u,
+                                 const apr_pollfd_t *descriptor)
+{
+    uring_elem_t *elem;
+    apr_status_t rv = APR_NOTFOUND;
+
+    uring_lock(u);
+
+    for (elem = APR_RING_FIRST(&u->query_ring);
+         elem != APR_RING_SENTINEL(&u->query_ring, uring_elem_t, link);
+         elem = APR_RING_NEXT(elem, link)) {
+
+        if (descriptor->desc.s == elem->pollfd->desc.s) {
+            APR_RING_REMOVE(elem, link);
+            if (elem->pending) {
+                APR_RING_REMOVE(elem, pending_link);
+                elem->pending = 0;
+            }
+            rv = APR_SUCCESS;
+            if (elem->armed) {
+                /* The element is freed when its poll request completes */
+                elem->removed = 1;
+                APR_RING_INSERT_TAIL(&u->dead_ring, elem, uring_elem_t,
+                                     link);
+                /* Submitted now whatever the flags, the poll request
+                 * holding a reference to the file until it is cancelled
+                 */
+                rv = uring_disarm(u, elem);
+                if (rv == APR_SUCCESS) {
+                    rv = apr_uring_submit(&u->ring);
+                }
+            }
+            else {
+                APR_RING_INSERT_TAIL(&u->free_ring, elem, uring_elem_t,
+                                     link);
+            }
+            break;
+        }
+    }
+
+    uring_unlock(u);
+
+    return rv;
+}
+
+static apr_status_t uring_rearm(uring_set_t *u,
+                                const apr_pollfd_t *descriptor)
+{
+    uring_elem_t *elem;
+    apr_status_t rv = APR_NOTFOUND;
+
+    uring_lock(u);
+
+    for (elem = APR_RING_FIRST(&u->query_ring);
+         elem != APR_RING_SENTINEL(&u->query_ring, uring_elem_t, link);
+         elem = APR_RING_NEXT(elem, link)) {
+
+        if (descriptor->desc.s == elem->pollfd->desc.s) {
+            rv = APR_SUCCESS;
+            if (elem->armed || elem->pending) {
+                /* Not signalled yet, or already rearmed */
+                break;
+            }
+            if (u->flags & APR_POLLSET_THREADSAFE) {
+                rv = uring_arm(u, elem);
+                if (rv == APR_SUCCESS) {
+                    rv = apr_uring_submit(&u->ring);
+                }
+            }
+            else {
+                elem->pending = 1;
+                APR_RING_INSERT_TAIL(&u->pending_ring, elem, uring_elem_t,
+                                     pending_link);
+            }
+            break;
+        }
+    }
+
+    uring_unlock(u);
+
+    return rv;
+}
+
+/* Handle the completion of the poll request of an element, returns 1 and
+ * a copy of the descriptor in ev for an event
+ */
+static int uring_complete(uring_set_t *u, const struct io_uring_cqe *cqe,
+                          apr_pollfd_t **pollfd, apr_pollfd_t *ev)
+{
+    uring_elem_t *elem = (uring_elem_t *)(apr_uintptr_t)cqe->user_data;
+
+    elem->armed = 0;
+    if (elem->removed) {
+        return 0;
+    }
+    if (cqe->res == -ECANCELED) {
+        /* Cancelled by the exit of the thread which submitted it */
+        elem->pending = 1;
+        APR_RING_INSERT_TAIL(&u->pending_ring, elem, uring_elem_t,
+                             pending_link);
+        return 0;
+    }
+
+    if (cqe->res < 0) {
+        /* Not re-armed, the descriptor needs to be removed */
+        elem->pollfd->rtnevents = cqe->res == -EBADF ? APR_POLLNVAL
+                                                     : APR_POLLERR;
+    }
+    else {
+        elem->pollfd->rtnevents = get_uring_revent(cqe->res);
+        if (!(elem->pollfd->reqevents & APR_POLLONESHOT)) {
+            elem->pending = 1;
+            APR_RING_INSERT_TAIL(&u->pending_ring, elem, uring_elem_t,
+                                 pending_link);
+        }
+    }
+
+    if (elem->pollfd == &elem->pfd) {
+        /* The element may be reused once unlocked */
+        *ev = elem->pfd;
+        *pollfd = ev;
+    }
+    else {
+        *pollfd = elem->pollfd;
+    }
+    return 1;
+}
+
+/* Arm the pending elements, submit them along with the removals and wait
+ * for the completions, which are passed to func() up to max of them.
+ */
+static apr_status_t uring_poll(uring_set_t *u, apr_interval_time_t timeout,
+                               volatile apr_uint32_t *wakeup_set,
+                               apr_uint32_t max, apr_pollcb_cb_t func,
+                               void *baton)
+{
+    struct io_uring_cqe cqe;
+    uring_elem_t *elem, *next;
+    apr_pollfd_t *pollfd, ev;
+    apr_time_t deadline = 0;
+    apr_uint32_t num = 0;
+    apr_status_t rv = APR_SUCCESS;
+    int woken = 0;
+
+    if (timeout > 0) {
+        deadline = apr_time_monotonic() + timeout;
+    }
+
+    uring_lock(u);
+    while (!APR_RING_EMPTY(&u->pending_ring, uring_elem_t, pending_link)) {
+        elem = APR_RING_FIRST(&u->pending_ring);
+        if ((rv = uring_arm(u, elem)) != APR_SUCCESS) {
+            break;
+        }
+        APR_RING_REMOVE(elem, pending_link);
+        elem->pending = 0;
+    }
+    uring_unlock(u);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    for (;;) {
+        unsigned to_submit, wait;
+        int ret;
+
+        uring_lock(u);
+        to_submit = apr_uring_sq_pending(&u->ring);
+        uring_unlock(u);
+
+        /* Submit and wait in the same call */
+        wait = (timeout != 0 && !apr_uring_cq_ready(&u->ring));
+        ret = apr_uring_enter(&u->ring, to_submit, wait,
+                          IORING_ENTER_GETEVENTS, timeout);
+        rv = ret < 0 ? errno : APR_SUCCESS;
+        if (rv != APR_SUCCESS && rv != ETIME && rv != EINTR
+            && rv != EAGAIN && rv != EBUSY) {
+            return rv;
+        }
+
+        while (num < max && apr_uring_get_cqe(&u->ring, &cqe)) {
+            if (cqe.user_data == URING_USER_DATA_IGNORE) {
+                continue;
+            }
+            if (cqe.user_data == URING_USER_DATA_WAKEUP) {
+                apr_atomic_set32(wakeup_set, 0);
+                woken = 1;
+                continue;
+            }
+
+            uring_lock(u);
+            ret = uring_complete(u, &cqe, &pollfd, &ev);
+            uring_unlock(u);
+
+            if (ret) {
+                num++;
+                rv = func(baton, pollfd);
+                if (rv != APR_SUCCESS) {
+                    return rv;
+                }
+            }
+        }
+
+        if (num || woken) {
+            break;
+        }
+        if (rv == EINTR) {
+            return APR_EINTR;
+        }
+        if (timeout == 0) {
+            return APR_TIMEUP;
+        }
+        if (timeout > 0) {
+            timeout = deadline - apr_time_monotonic();
+            if (timeout <= 0) {
+                return APR_TIMEUP;
+            }
+        }
+    }
+
+    /* Recycle the removed elements whose poll request completed */
+    uring_lock(u);
+    for (elem = APR_RING_FIRST(&u->dead_ring);
+         elem != APR_RING_SENTINEL(&u->dead_ring, uring_elem_t, link);
+         elem = next) {
+        next = APR_RING_NEXT(elem, link);
+        if (!elem->armed) {
+            APR_RING_REMOVE(elem, link);
+            APR_RING_INSERT_TAIL(&u->free_ring, elem, uring_elem_t, link);
+        }
+    }
+    uring_unlock(u);
+
+    return num ? APR_SUCCESS : APR_EINTR;
+}
+
+static apr_status_t uring_wakeup(uring_set_t *u,
+                                 volatile apr_uint32_t *wakeup_set)
+{
+    apr_uring_t *ring = &u->wakeup_ring;
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe cqe;
+    apr_status_t rv = APR_SUCCESS;
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(u->wakeup_lock);
+#endif
+
+    sqe = apr_uring_get_sqe(ring, &rv);
+    if (sqe) {
+        sqe->opcode = IORING_OP_MSG_RING;
+        sqe->fd = u->ring.fd;
+        sqe->addr = IORING_MSG_DATA;
+        sqe->off = URING_USER_DATA_WAKEUP;
+        sqe->user_data = URING_USER_DATA_IGNORE;
+        apr_uring_commit_sqe(ring);
+
+        while (apr_uring_enter(ring, apr_uring_sq_pending(ring), 1,
+                           IORING_ENTER_GETEVENTS, -1) < 0) {
+            if (errno != EINTR) {
+                rv = errno;
+                break;
+            }
+        }
+        while (apr_uring_get_cqe(ring, &cqe)) {
+            if (cqe.res < 0) {
+                rv = -cqe.res;
+            }
+        }
+    }
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(u->wakeup_lock);
+#endif
+
+    if (rv != APR_SUCCESS) {
+        apr_atomic_set32(wakeup_set, 0);
+    }
+    return rv;
+}
+
+static apr_status_t impl_pollset_create(apr_pollset_t *pollset,
+                                        apr_uint32_t size,
+                                        apr_pool_t *p,
+                                        apr_uint32_t flags)
+{
+    apr_status_t rv;
+
+    rv = uring_create(&pollset->p, size, p, flags);
+    if (rv != APR_SUCCESS) {
+        pollset->p = NULL;
+        return rv;
+    }
+    pollset->p->result_set = apr_palloc(p, size * sizeof(apr_pollfd_t));
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t impl_pollset_add(apr_pollset_t *pollset,
+                                     const apr_pollfd_t *descriptor)
+{
+    return uring_add(pollset->p, (apr_pollfd_t *)descriptor, 1);
+}
+
+static apr_status_t impl_pollset_remove(apr_pollset_t *pollset,
+                                        const apr_pollfd_t *descriptor)
+{
+    return uring_remove(pollset->p, descriptor);
+}
+
+static apr_status_t impl_pollset_rearm(apr_pollset_t *pollset,
+                                       const apr_pollfd_t *descriptor)
+{
+    return uring_rearm(pollset->p, descriptor);
+}
+
+typedef struct pollset_result_t {
+    apr_pollfd_t *result_set;
+    apr_int32_t num;
+} pollset_result_t;
+
+static apr_status_t pollset_result(void *baton, apr_pollfd_t *descriptor)
+{
+    pollset_result_t *result = baton;
+
+    result->result_set[result->num++] = *descriptor;
+    return APR_SUCCESS;
+}
+
+static apr_status_t impl_pollset_poll(apr_pollset_t *pollset,
+                                      apr_interval_time_t timeout,
+                                      apr_int32_t *num,
+                                      const apr_pollfd_t **descriptors)
+{
+    pollset_result_t result;
+    apr_status_t rv;
+
+    result.result_set = pollset->p->result_set;
+    result.num = 0;
+    rv = uring_poll(pollset->p, timeout, &pollset->wakeup_set,
+                    pollset->nalloc, pollset_result, &result);
+
+    (*num) = result.num;
+    if (result.num) {
+        rv = APR_SUCCESS;
+        if (descriptors) {
+            *descriptors = pollset->p->result_set;
+        }
+    }
+
+    return rv;
+}
+
+static apr_status_t impl_pollset_cleanup(apr_pollset_t *pollset)
+{
+    return uring_cleanup(pollset->p);
+}
+
+static apr_status_t impl_pollset_wakeup(apr_pollset_t *pollset)
+{
+    return uring_wakeup(pollset->p, &pollset->wakeup_set);
+}
+
+static const apr_pollset_provider_t impl = {
+    impl_pollset_create,
+    impl_pollset_add,
+    impl_pollset_remove,
+    impl_pollset_poll,
+    impl_pollset_cleanup,
+    "io_uring",
+    impl_pollset_wakeup,
+    impl_pollset_rearm
+};
+
+const apr_pollset_provider_t *const apr_pollset_provider_io_uring = &impl;
+
+static apr_status_t impl_pollcb_create(apr_pollcb_t *pollcb,
+                                       apr_uint32_t size,
+                                       apr_pool_t *p,
+                                       apr_uint32_t flags)
+{
+    apr_status_t rv;
+
+    rv = uring_create(&pollcb->pollset.uring, size, p, flags);
+    if (rv != APR_SUCCESS) {
+        pollcb->fd = -1;
+        return rv;
+    }
+    pollcb->fd = pollcb->pollset.uring->ring.fd;
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t impl_pollcb_add(apr_pollcb_t *pollcb,
+                                    apr_pollfd_t *descriptor)
+{
+    return uring_add(pollcb->pollset.uring, descriptor, 0);
+}
+
+static apr_status_t impl_pollcb_remove(apr_pollcb_t *pollcb,
+                                       apr_pollfd_t *descriptor)
+{
+    return uring_remove(pollcb->pollset.uring, descriptor);
+}
+
+static apr_status_t impl_pollcb_rearm(apr_pollcb_t *pollcb,
+                                      apr_pollfd_t *descriptor)
+{
+    return uring_rearm(pollcb->pollset.uring, descriptor);
+}
+
+static apr_status_t impl_pollcb_poll(apr_pollcb_t *pollcb,
+                                     apr_interval_time_t timeout,
+                                     apr_pollcb_cb_t func,
+                                     void *baton)
+{
+    return uring_poll(pollcb->pollset.uring, timeout, &pollcb->wakeup_set,
+                      APR_UINT32_MAX, func, baton);
+}
+
+static apr_status_t impl_pollcb_cleanup(apr_pollcb_t *pollcb)
+{
+    return uring_cleanup(pollcb->pollset.uring);
+}
+
+static apr_status_t impl_pollcb_wakeup(apr_pollcb_t *pollcb)
+{
+    return uring_wakeup(pollcb->pollset.uring, &pollcb->wakeup_set);
+}
+
+static const apr_pollcb_provider_t impl_cb = {
+    impl_pollcb_create,
+    impl_pollcb_add,
+    impl_pollcb_remove,
+    impl_pollcb_poll,
+    impl_pollcb_cleanup,
+    "io_uring",
+    impl_pollcb_wakeup,
+    impl_pollcb_rearm
+};
+
+const apr_pollcb_provider_t *const apr_pollcb_provider_io_uring = &impl_cb;
+
+#endif /* HAVE_IO_URING */
@@ -18,6 +18,7 @@
 #include "apr_poll.h"
 #include "apr_time.h"
 #include "apr_portable.h"
+#include "apr_atomic.h"
 #include "apr_arch_file_io.h"
 #include "apr_arch_networkio.h"
 #include "apr_arch_poll_private.h"
@@ -25,6 +26,37 @@
 
 #ifdef HAVE_KQUEUE
 
+#ifdef EVFILT_USER
+/* The wakeup is an EVFILT_USER event rather than the wakeup pipe */
+#define KQUEUE_WAKEUP_IDENT 0
+
+static apr_status_t kqueue_wakeup_add(int kqueue_fd)
+{
+    struct kevent ev;
+
+    EV_SET(&ev, KQUEUE_WAKEUP_IDENT, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0,
+           NULL);
+    if (kevent(kqueue_fd, &ev, 1, NULL, 0, NULL) == -1) {
+        return apr_get_netos_error();
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t kqueue_wakeup_trigger(int kqueue_fd,
+                                          volatile apr_uint32_t *wakeup_set)
+{
+    struct kevent ev;
+
+    EV_SET(&ev, KQUEUE_WAKEUP_IDENT, EVFILT_USER, 0, NOTE_TRIGGER, 0, NULL);
+    if (kevent(kqueue_fd, &ev, 1, NULL, 0, NULL) == -1) {
+        apr_status_t rv = apr_get_netos_error();
+        apr_atomic_set32(wakeup_set, 0);
+        return rv;
+    }
+    return APR_SUCCESS;
+}
+#endif
+
 static apr_int16_t get_kqueue_revent(apr_int16_t event, apr_int16_t flags)
 {
     apr_int16_t rv = 0;
@@ -43,6 +75,56 @@ static apr_int16_t get_kqueue_revent(apr_int16_t event, apr_int16_t flags)
     return rv;
 }
 
+static apr_uint16_t get_kqueue_flags(apr_int16_t reqevents)
+{
+    apr_uint16_t rv = EV_ADD;
+
+    if (reqevents & APR_POLLET)
+        rv |= EV_CLEAR;
+#ifdef EV_DISPATCH
+    /* Disabled once signalled, EV_ADD enables it again */
+    if (reqevents & APR_POLLONESHOT)
+        rv |= EV_DISPATCH;
+#endif
+    return rv;
+}
+
+/* Re-enable the filters of a descriptor added with APR_POLLONESHOT, each
+ * filter is disabled on its own when signalled
+ */
+static apr_status_t kqueue_rearm(int kqueue_fd,
+                                 const apr_pollfd_t *descriptor, void *udata)
+{
+    apr_os_sock_t fd;
+    struct kevent ev;
+    apr_uint16_t flags = get_kqueue_flags(descriptor->reqevents);
+
+    if (descriptor->desc_type == APR_POLL_SOCKET) {
+        fd = descriptor->desc.s->socketdes;
+    }
+    else {
+        fd = descriptor->desc.f->filedes;
+    }
+
+    if (descriptor->reqevents & APR_POLLIN) {
+        EV_SET(&ev, fd, EVFILT_READ, flags, 0, 0, udata);
+
+        if (kevent(kqueue_fd, &ev, 1, NULL, 0, NULL) == -1) {
+            return apr_get_netos_error();
+        }
+    }
+
+    if (descriptor->reqevents & APR_POLLOUT) {
+        EV_SET(&ev, fd, EVFILT_WRITE, flags, 0, 0, udata);
+
+        if (kevent(kqueue_fd, &ev, 1, NULL, 0, NULL) == -1) {
+            return apr_get_netos_error();
+        }
+    }
+
+    return APR_SUCCESS;
+}
+
 struct apr_pollset_private_t
 {
     int kqueue_fd;
@@ -129,6 +211,15 @@ static apr_status_t impl_pollset_create(apr_pollset_t *pollset,
         }
     }
 
+#ifdef EVFILT_USER
+    if ((flags & APR_POLLSET_WAKEABLE)
+        && (rv = kqueue_wakeup_add(pollset->p->kqueue_fd)) != APR_SUCCESS) {
+        close(pollset->p->kqueue_fd);
+        pollset->p = NULL;
+        return rv;
+    }
+#endif
+
     pollset->p->result_set = apr_palloc(p, pollset->p->setsize * sizeof(apr_pollfd_t));
 
     if (!(flags & APR_POLLSET_NOCOPY)) {
@@ -145,8 +236,15 @@ static apr_status_t impl_pollset_add(apr_pollset_t *pollset,
 {
     apr_os_sock_t fd;
     pfd_elem_t *elem = NULL;
+    apr_uint16_t flags = get_kqueue_flags(descriptor->reqevents);
     apr_status_t rv = APR_SUCCESS;
 
+#ifndef EV_DISPATCH
+    if (descriptor->reqevents & APR_POLLONESHOT) {
+        return APR_ENOTIMPL;
+    }
+#endif
+
     if (!(pollset->flags & APR_POLLSET_NOCOPY)) {
         pollset_lock_rings();
 
@@ -170,11 +268,11 @@ static apr_status_t impl_pollset_add(apr_pollset_t *pollset,
 
     if (descriptor->reqevents & APR_POLLIN) {
         if (pollset->flags & APR_POLLSET_NOCOPY) {
-            EV_SET(&pollset->p->kevent, fd, EVFILT_READ, EV_ADD, 0, 0,
+            EV_SET(&pollset->p->kevent, fd, EVFILT_READ, flags, 0, 0,
                    (void *)descriptor);
         }
         else {
-            EV_SET(&pollset->p->kevent, fd, EVFILT_READ, EV_ADD, 0, 0,
+            EV_SET(&pollset->p->kevent, fd, EVFILT_READ, flags, 0, 0,
                    elem);
         }
 
@@ -186,11 +284,11 @@ static apr_status_t impl_pollset_add(apr_pollset_t *pollset,
 
     if (descriptor->reqevents & APR_POLLOUT && rv == APR_SUCCESS) {
         if (pollset->flags & APR_POLLSET_NOCOPY) {
-            EV_SET(&pollset->p->kevent, fd, EVFILT_WRITE, EV_ADD, 0, 0,
+            EV_SET(&pollset->p->kevent, fd, EVFILT_WRITE, flags, 0, 0,
                    (void *)descriptor);
         }
         else {
-            EV_SET(&pollset->p->kevent, fd, EVFILT_WRITE, EV_ADD, 0, 0,
+            EV_SET(&pollset->p->kevent, fd, EVFILT_WRITE, flags, 0, 0,
                    elem);
         }
 
@@ -270,6 +368,38 @@ static apr_status_t impl_pollset_remove(apr_pollset_t *pollset,
     return rv;
 }
 
+static apr_status_t impl_pollset_rearm(apr_pollset_t *pollset,
+                                       const apr_pollfd_t *descriptor)
+{
+    pfd_elem_t *ep;
+    void *udata = NULL;
+
+    if (pollset->flags & APR_POLLSET_NOCOPY) {
+        return kqueue_rearm(pollset->p->kqueue_fd, descriptor,
+                            (void *)descriptor);
+    }
+
+    pollset_lock_rings();
+
+    for (ep = APR_RING_FIRST(&(pollset->p->query_ring));
+         ep != APR_RING_SENTINEL(&(pollset->p->query_ring),
+                                 pfd_elem_t, link);
+         ep = APR_RING_NEXT(ep, link)) {
+
+        if (descriptor->desc.s == ep->pfd.desc.s) {
+            udata = ep;
+            break;
+        }
+    }
+
+    pollset_unlock_rings();
+
+    if (!udata) {
+        return APR_NOTFOUND;
+    }
+    return kqueue_rearm(pollset->p->kqueue_fd, descriptor, udata);
+}
+
 static apr_status_t impl_pollset_poll(apr_pollset_t *pollset,
                                       apr_interval_time_t timeout,
                                       apr_int32_t *num,
@@ -303,6 +433,13 @@ static apr_status_t impl_pollset_poll(apr_pollset_t *pollset,
         const apr_pollfd_t *fd;
 
         for (i = 0, j = 0; i < ret; i++) {
+#ifdef EVFILT_USER
+            if (pollset->p->ke_set[i].filter == EVFILT_USER) {
+                apr_atomic_set32(&pollset->wakeup_set, 0);
+                rv = APR_EINTR;
+                continue;
+            }
+#endif
             if (pollset->flags & APR_POLLSET_NOCOPY) {
                 fd = (apr_pollfd_t *)pollset->p->ke_set[i].udata;
             }
@@ -345,13 +482,26 @@ static apr_status_t impl_pollset_poll(apr_pollset_t *pollset,
     return rv;
 }
 
+#ifdef EVFILT_USER
+static apr_status_t impl_pollset_wakeup(apr_pollset_t *pollset)
+{
+    return kqueue_wakeup_trigger(pollset->p->kqueue_fd, &pollset->wakeup_set);
+}
+#endif
+
 static const apr_pollset_provider_t impl = {
     impl_pollset_create,
     impl_pollset_add,
     impl_pollset_remove,
     impl_pollset_poll,
     impl_pollset_cleanup,
-    "kqueue"
+    "kqueue",
+#ifdef EVFILT_USER
+    impl_pollset_wakeup,
+#else
+    NULL,
+#endif
+    impl_pollset_rearm
 };
 
 const apr_pollset_provider_t *apr_pollset_provider_kqueue = &impl;
@@ -394,6 +544,17 @@ static apr_status_t impl_pollcb_create(apr_pollcb_t *pollcb,
         }
     }
 
+#ifdef EVFILT_USER
+    if (flags & APR_POLLSET_WAKEABLE) {
+        apr_status_t rv = kqueue_wakeup_add(fd);
+        if (rv != APR_SUCCESS) {
+            close(fd);
+            pollcb->fd = -1;
+            return rv;
+        }
+    }
+#endif
+
     pollcb->fd = fd;
     pollcb->pollset.ke = (struct kevent *) apr_pcalloc(p, 2 * size * sizeof(struct kevent));
 
@@ -405,8 +566,15 @@ static apr_status_t impl_pollcb_add(apr_pollcb_t *pollcb,
 {
     apr_os_sock_t fd;
     struct kevent ev;
+    apr_uint16_t flags = get_kqueue_flags(descriptor->reqevents);
     apr_status_t rv = APR_SUCCESS;
 
+#ifndef EV_DISPATCH
+    if (descriptor->reqevents & APR_POLLONESHOT) {
+        return APR_ENOTIMPL;
+    }
+#endif
+
     if (descriptor->desc_type == APR_POLL_SOCKET) {
         fd = descriptor->desc.s->socketdes;
     }
@@ -415,7 +583,7 @@ static apr_status_t impl_pollcb_add(apr_pollcb_t *pollcb,
     }
 
     if (descriptor->reqevents & APR_POLLIN) {
-        EV_SET(&ev, fd, EVFILT_READ, EV_ADD, 0, 0, descriptor);
+        EV_SET(&ev, fd, EVFILT_READ, flags, 0, 0, descriptor);
 
         if (kevent(pollcb->fd, &ev, 1, NULL, 0, NULL) == -1) {
             rv = apr_get_netos_error();
@@ -423,7 +591,7 @@ static apr_status_t impl_pollcb_add(apr_pollcb_t *pollcb,
     }
 
     if (descriptor->reqevents & APR_POLLOUT && rv == APR_SUCCESS) {
-        EV_SET(&ev, fd, EVFILT_WRITE, EV_ADD, 0, 0, descriptor);
+        EV_SET(&ev, fd, EVFILT_WRITE, flags, 0, 0, descriptor);
 
         if (kevent(pollcb->fd, &ev, 1, NULL, 0, NULL) == -1) {
             rv = apr_get_netos_error();
@@ -468,6 +636,12 @@ static apr_status_t impl_pollcb_remove(apr_pollcb_t *pollcb,
 }
 
 
+static apr_status_t impl_pollcb_rearm(apr_pollcb_t *pollcb,
+                                      apr_pollfd_t *descriptor)
+{
+    return kqueue_rearm(pollcb->fd, descriptor, descriptor);
+}
+
 static apr_status_t impl_pollcb_poll(apr_pollcb_t *pollcb,
                                      apr_interval_time_t timeout,
                                      apr_pollcb_cb_t func,
@@ -499,6 +673,12 @@ static apr_status_t impl_pollcb_poll(apr_pollcb_t *pollcb,
         for (i = 0; i < ret; i++) {
             apr_pollfd_t *pollfd = (apr_pollfd_t *)(pollcb->pollset.ke[i].udata);
 
+#ifdef EVFILT_USER
+            if (pollcb->pollset.ke[i].filter == EVFILT_USER) {
+                apr_atomic_set32(&pollcb->wakeup_set, 0);
+                return APR_EINTR;
+            }
+#endif
             if ((pollcb->flags & APR_POLLSET_WAKEABLE) &&
                 pollfd->desc_type == APR_POLL_FILE &&
                 pollfd->desc.f == pollcb->wakeup_pipe[0]) {
@@ -520,13 +700,26 @@ static apr_status_t impl_pollcb_poll(apr_pollcb_t *pollcb,
     return rv;
 }
 
+#ifdef EVFILT_USER
+static apr_status_t impl_pollcb_wakeup(apr_pollcb_t *pollcb)
+{
+    return kqueue_wakeup_trigger(pollcb->fd, &pollcb->wakeup_set);
+}
+#endif
+
 static const apr_pollcb_provider_t impl_cb = {
     impl_pollcb_create,
     impl_pollcb_add,
     impl_pollcb_remove,
     impl_pollcb_poll,
     impl_pollcb_cleanup,
-    "kqueue"
+    "kqueue",
+#ifdef EVFILT_USER
+    impl_pollcb_wakeup,
+#else
+    NULL,
+#endif
+    impl_pollcb_rearm
 };
 
 const apr_pollcb_provider_t *apr_pollcb_provider_kqueue = &impl_cb;
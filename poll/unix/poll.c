@@ -103,7 +103,8 @@ APR_DECLARE(apr_status_t) apr_poll(apr_pollfd_t *aprset, apr_int32_t num,
         if (aprset[i].desc_type == APR_POLL_SOCKET) {
             pollset[i].fd = aprset[i].desc.s->socketdes;
         }
-        else if (aprset[i].desc_type == APR_POLL_FILE) {
+        else if (aprset[i].desc_type == APR_POLL_FILE
+                 || aprset[i].desc_type >= APR_POLL_SIGNAL) {
             pollset[i].fd = aprset[i].desc.f->filedes;
         }
         else {
@@ -24,6 +24,7 @@
 #include "apr_time.h"
 #include "apr_portable.h"
 #include "apr_atomic.h"
+#include "apr_probes.h"
 #include "apr_arch_file_io.h"
 #include "apr_arch_networkio.h"
 #include "apr_arch_poll_private.h"
@@ -38,6 +39,9 @@ extern const apr_pollcb_provider_t *apr_pollcb_provider_port;
 #if defined(HAVE_EPOLL)
 extern const apr_pollcb_provider_t *apr_pollcb_provider_epoll;
 #endif
+#if defined(HAVE_IO_URING)
+extern const apr_pollcb_provider_t *apr_pollcb_provider_io_uring;
+#endif
 #if defined(HAVE_POLL)
 extern const apr_pollcb_provider_t *apr_pollcb_provider_poll;
 #endif
@@ -59,6 +63,11 @@ static const apr_pollcb_provider_t *pollcb_provider(apr_pollset_method_e method)
         case APR_POLLSET_EPOLL:
 #if defined(HAVE_EPOLL)
             provider = apr_pollcb_provider_epoll;
+#endif
+        break;
+        case APR_POLLSET_IO_URING:
+#if defined(HAVE_IO_URING)
+            provider = apr_pollcb_provider_io_uring;
 #endif
         break;
         case APR_POLLSET_POLL:
@@ -81,7 +90,7 @@ static apr_status_t pollcb_cleanup(void *p)
     if (pollcb->provider->cleanup) {
         (*pollcb->provider->cleanup)(pollcb);
     }
-    if (pollcb->flags & APR_POLLSET_WAKEABLE) {
+    if ((pollcb->flags & APR_POLLSET_WAKEABLE) && !pollcb->provider->wakeup) {
 #if WAKEUP_USES_PIPE
         apr_poll_close_wakeup_pipe(pollcb->wakeup_pipe);
 #else
@@ -166,7 +175,7 @@ APR_DECLARE(apr_status_t) apr_pollcb_create_ex(apr_pollcb_t **ret_pollcb,
         return rv;
     }
 
-    if (flags & APR_POLLSET_WAKEABLE) {
+    if ((flags & APR_POLLSET_WAKEABLE) && !provider->wakeup) {
 #if WAKEUP_USES_PIPE
         /* Create wakeup pipe */
         if ((rv = apr_poll_create_wakeup_pipe(pollcb->pool, &pollcb->wakeup_pfd,
@@ -207,6 +216,10 @@ APR_DECLARE(apr_status_t) apr_pollcb_create(apr_pollcb_t **pollcb,
 APR_DECLARE(apr_status_t) apr_pollcb_add(apr_pollcb_t *pollcb,
                                          apr_pollfd_t *descriptor)
 {
+    if ((descriptor->reqevents & (APR_POLLET | APR_POLLONESHOT))
+        && !pollcb->provider->rearm) {
+        return APR_ENOTIMPL;
+    }
     return (*pollcb->provider->add)(pollcb, descriptor);
 }
 
@@ -216,13 +229,27 @@ APR_DECLARE(apr_status_t) apr_pollcb_remove(apr_pollcb_t *pollcb,
     return (*pollcb->provider->remove)(pollcb, descriptor);
 }
 
+APR_DECLARE(apr_status_t) apr_pollcb_rearm(apr_pollcb_t *pollcb,
+                                           apr_pollfd_t *descriptor)
+{
+    if (!pollcb->provider->rearm) {
+        return APR_ENOTIMPL;
+    }
+    return (*pollcb->provider->rearm)(pollcb, descriptor);
+}
+
 
 APR_DECLARE(apr_status_t) apr_pollcb_poll(apr_pollcb_t *pollcb,
                                           apr_interval_time_t timeout,
                                           apr_pollcb_cb_t func,
                                           void *baton)
 {
-    return (*pollcb->provider->poll)(pollcb, timeout, func, baton);
+    apr_status_t rv;
+
+    APR_PROBE2(pollcb__enter, pollcb, timeout);
+    rv = (*pollcb->provider->poll)(pollcb, timeout, func, baton);
+    APR_PROBE2(pollcb__exit, pollcb, rv);
+    return rv;
 }
 
 APR_DECLARE(apr_status_t) apr_pollcb_wakeup(apr_pollcb_t *pollcb)
@@ -231,8 +258,11 @@ APR_DECLARE(apr_status_t) apr_pollcb_wakeup(apr_pollcb_t *pollcb)
         return APR_EINIT;
 
     if (apr_atomic_cas32(&pollcb->wakeup_set, 1, 0) == 0) {
+        if (pollcb->provider->wakeup) {
+            return (*pollcb->provider->wakeup)(pollcb);
+        }
 #if WAKEUP_USES_PIPE
-        return apr_file_putc(1, pollcb->wakeup_pipe[1]);
+        return apr_poll_send_wakeup_pipe(pollcb->wakeup_pipe);
 #else
         apr_size_t len = 1;
         return apr_socket_send(pollcb->wakeup_socket[1], "\1", &len);
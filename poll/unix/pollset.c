@@ -24,6 +24,8 @@
 #include "apr_time.h"
 #include "apr_portable.h"
 #include "apr_atomic.h"
+#include "apr_metrics.h"
+#include "apr_probes.h"
 #include "apr_arch_file_io.h"
 #include "apr_arch_networkio.h"
 #include "apr_arch_poll_private.h"
@@ -31,13 +33,17 @@
 
 static apr_pollset_method_e pollset_default_method = POLLSET_DEFAULT_METHOD;
 
+/* Registered by the first apr_pollset_create_ex() */
+static apr_metric_t *polls_metric = NULL;
+static apr_metric_t *events_metric = NULL;
+
 static apr_status_t pollset_cleanup(void *p)
 {
     apr_pollset_t *pollset = (apr_pollset_t *) p;
     if (pollset->provider->cleanup) {
         (*pollset->provider->cleanup)(pollset);
     }
-    if (pollset->flags & APR_POLLSET_WAKEABLE) {
+    if ((pollset->flags & APR_POLLSET_WAKEABLE) && !pollset->provider->wakeup) {
 #if WAKEUP_USES_PIPE
         apr_poll_close_wakeup_pipe(pollset->wakeup_pipe);
 #else
@@ -60,6 +66,9 @@ extern const apr_pollset_provider_t *apr_pollset_provider_epoll;
 #if defined(HAVE_AIO_MSGQ)
 extern const apr_pollset_provider_t *apr_pollset_provider_aio_msgq;
 #endif
+#if defined(HAVE_IO_URING)
+extern const apr_pollset_provider_t *apr_pollset_provider_io_uring;
+#endif
 #if defined(HAVE_POLL)
 extern const apr_pollset_provider_t *apr_pollset_provider_poll;
 #endif
@@ -87,6 +96,11 @@ static const apr_pollset_provider_t *pollset_provider(apr_pollset_method_e metho
         case APR_POLLSET_AIO_MSGQ:
 #if defined(HAVE_AIO_MSGQ)
             provider = apr_pollset_provider_aio_msgq;
+#endif
+        break;
+        case APR_POLLSET_IO_URING:
+#if defined(HAVE_IO_URING)
+            provider = apr_pollset_provider_io_uring;
 #endif
         break;
         case APR_POLLSET_POLL:
@@ -115,6 +129,15 @@ APR_DECLARE(apr_status_t) apr_pollset_create_ex(apr_pollset_t **ret_pollset,
 
     *ret_pollset = NULL;
 
+    if (!polls_metric) {
+        apr_metric_register(&events_metric, "apr_pollset_poll_events",
+                            "Events returned by apr_pollset_poll()",
+                            APR_METRIC_HISTOGRAM);
+        apr_metric_register(&polls_metric, "apr_pollset_polls_total",
+                            "Calls to apr_pollset_poll()",
+                            APR_METRIC_COUNTER);
+    }
+
  #ifdef WIN32
     /* Favor WSAPoll. */
     if (method == APR_POLLSET_DEFAULT) {
@@ -165,7 +188,7 @@ APR_DECLARE(apr_status_t) apr_pollset_create_ex(apr_pollset_t **ret_pollset,
     else if (rv != APR_SUCCESS) {
         return rv;
     }
-    if (flags & APR_POLLSET_WAKEABLE) {
+    if ((flags & APR_POLLSET_WAKEABLE) && !provider->wakeup) {
 #if WAKEUP_USES_PIPE
         /* Create wakeup pipe */
         if ((rv = apr_poll_create_wakeup_pipe(pollset->pool, &pollset->wakeup_pfd,
@@ -234,8 +257,11 @@ APR_DECLARE(apr_status_t) apr_pollset_wakeup(apr_pollset_t *pollset)
         return APR_EINIT;
 
     if (apr_atomic_cas32(&pollset->wakeup_set, 1, 0) == 0) {
+        if (pollset->provider->wakeup) {
+            return (*pollset->provider->wakeup)(pollset);
+        }
 #if WAKEUP_USES_PIPE
-        return apr_file_putc(1, pollset->wakeup_pipe[1]);
+        return apr_poll_send_wakeup_pipe(pollset->wakeup_pipe);
 #else
         apr_size_t len = 1;
         return apr_socket_send(pollset->wakeup_socket[1], "\1", &len);
@@ -248,6 +274,10 @@ APR_DECLARE(apr_status_t) apr_pollset_wakeup(apr_pollset_t *pollset)
 APR_DECLARE(apr_status_t) apr_pollset_add(apr_pollset_t *pollset,
                                           const apr_pollfd_t *descriptor)
 {
+    if ((descriptor->reqevents & (APR_POLLET | APR_POLLONESHOT))
+        && !pollset->provider->rearm) {
+        return APR_ENOTIMPL;
+    }
     return (*pollset->provider->add)(pollset, descriptor);
 }
 
@@ -257,10 +287,60 @@ APR_DECLARE(apr_status_t) apr_pollset_remove(apr_pollset_t *pollset,
     return (*pollset->provider->remove)(pollset, descriptor);
 }
 
+APR_DECLARE(apr_status_t) apr_pollset_rearm(apr_pollset_t *pollset,
+                                            const apr_pollfd_t *descriptor)
+{
+    if (!pollset->provider->rearm) {
+        return APR_ENOTIMPL;
+    }
+    return (*pollset->provider->rearm)(pollset, descriptor);
+}
+
 APR_DECLARE(apr_status_t) apr_pollset_poll(apr_pollset_t *pollset,
                                            apr_interval_time_t timeout,
                                            apr_int32_t *num,
                                            const apr_pollfd_t **descriptors)
 {
-    return (*pollset->provider->poll)(pollset, timeout, num, descriptors);
+    apr_status_t rv;
+
+    APR_PROBE2(pollset__enter, pollset, timeout);
+    rv = (*pollset->provider->poll)(pollset, timeout, num, descriptors);
+    APR_PROBE3(pollset__exit, pollset, rv, rv == APR_SUCCESS ? *num : 0);
+    if (polls_metric) {
+        apr_metric_add(polls_metric, 1);
+        if (events_metric) {
+            apr_metric_observe(events_metric,
+                               rv == APR_SUCCESS ? *num : 0);
+        }
+    }
+    return rv;
+}
+
+APR_DECLARE(apr_status_t) apr_pollset_poll_ex(apr_pollset_t *pollset,
+                                              apr_interval_time_t timeout,
+                                              apr_int32_t maxevents,
+                                              apr_int32_t *num,
+                                              apr_pollfd_t *descriptors)
+{
+    const apr_pollfd_t *result;
+    apr_status_t rv;
+
+    *num = 0;
+    if (maxevents <= 0) {
+        return APR_EINVAL;
+    }
+    if (pollset->provider->poll_ex) {
+        return (*pollset->provider->poll_ex)(pollset, timeout, maxevents,
+                                             num, descriptors);
+    }
+
+    /* The results of the provider may not all fit otherwise */
+    if ((apr_uint32_t)maxevents < pollset->nalloc) {
+        return APR_ENOTIMPL;
+    }
+    rv = (*pollset->provider->poll)(pollset, timeout, num, &result);
+    if (*num > 0) {
+        memcpy(descriptors, result, *num * sizeof(apr_pollfd_t));
+    }
+    return rv;
 }
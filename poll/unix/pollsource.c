@@ -0,0 +1,230 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr.h"
+#include "apr_poll.h"
+#include "apr_portable.h"
+#include "apr_private.h"
+
+#if APR_HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#if APR_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if APR_HAVE_SIGNAL_H
+#include <signal.h>
+#endif
+#if APR_HAS_THREADS && APR_HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#ifdef HAVE_SIGNALFD
+#include <sys/signalfd.h>
+#endif
+#ifdef HAVE_TIMERFD
+#include <sys/timerfd.h>
+#endif
+#ifdef HAVE_PIDFD_OPEN
+#include <sys/syscall.h>
+#endif
+
+/* The sources are plain descriptors, wrapped in apr_file_t's like the
+ * eventfd of the wakeup pipe, so that all the pollset and pollcb methods
+ * handle them as files.
+ */
+
+#if defined(HAVE_SIGNALFD) || defined(HAVE_TIMERFD) || defined(HAVE_PIDFD_OPEN)
+static apr_status_t source_put(apr_pollfd_t *pfd, apr_datatype_e type,
+                               int fd, apr_pool_t *p)
+{
+    apr_file_t *file;
+    apr_status_t rv;
+
+    if ((rv = apr_os_pipe_put_ex(&file, &fd, 1, p))) {
+        close(fd);
+        return rv;
+    }
+    pfd->p = p;
+    pfd->desc_type = type;
+    pfd->desc.f = file;
+    pfd->reqevents = APR_POLLIN;
+    pfd->rtnevents = 0;
+    return APR_SUCCESS;
+}
+
+static apr_status_t source_read(const apr_pollfd_t *pfd, apr_datatype_e type,
+                                void *buf, apr_size_t len)
+{
+    apr_os_file_t fd;
+    ssize_t rc;
+
+    if (pfd->desc_type != type) {
+        return APR_EINVAL;
+    }
+    apr_os_file_get(&fd, pfd->desc.f);
+    do {
+        rc = read(fd, buf, len);
+    } while (rc < 0 && errno == EINTR);
+    if (rc < 0) {
+        return errno;
+    }
+    return (apr_size_t)rc == len ? APR_SUCCESS : APR_EGENERAL;
+}
+#endif
+
+APR_DECLARE(apr_status_t) apr_poll_signal_create(apr_pollfd_t *pfd,
+                                                 const int *signums,
+                                                 int nsignums,
+                                                 apr_pool_t *p)
+{
+#ifdef HAVE_SIGNALFD
+    sigset_t set;
+    int i, fd, rc;
+
+    sigemptyset(&set);
+    for (i = 0; i < nsignums; i++) {
+        if (sigaddset(&set, signums[i])) {
+            return errno;
+        }
+    }
+    /* Block them first, so that none is delivered the usual way */
+#if APR_HAS_THREADS && APR_HAVE_PTHREAD_H
+    if ((rc = pthread_sigmask(SIG_BLOCK, &set, NULL))) {
+        return rc;
+    }
+#else
+    if ((rc = sigprocmask(SIG_BLOCK, &set, NULL))) {
+        return errno;
+    }
+#endif
+    if ((fd = signalfd(-1, &set, SFD_CLOEXEC | SFD_NONBLOCK)) < 0) {
+        return errno;
+    }
+    return source_put(pfd, APR_POLL_SIGNAL, fd, p);
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
+APR_DECLARE(apr_status_t) apr_poll_signal_read(const apr_pollfd_t *pfd,
+                                               int *signum)
+{
+#ifdef HAVE_SIGNALFD
+    struct signalfd_siginfo info;
+    apr_status_t rv;
+
+    rv = source_read(pfd, APR_POLL_SIGNAL, &info, sizeof(info));
+    if (rv == APR_SUCCESS) {
+        *signum = (int)info.ssi_signo;
+    }
+    return rv;
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
+APR_DECLARE(apr_status_t) apr_poll_proc_create(apr_pollfd_t *pfd,
+                                               const apr_proc_t *proc,
+                                               apr_pool_t *p)
+{
+#ifdef HAVE_PIDFD_OPEN
+    int fd;
+
+    /* Always close-on-exec */
+    if ((fd = (int)syscall(SYS_pidfd_open, proc->pid, 0)) < 0) {
+        return errno == ENOSYS ? APR_ENOTIMPL : errno;
+    }
+    return source_put(pfd, APR_POLL_PROC, fd, p);
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
+#ifdef HAVE_TIMERFD
+static void timer_spec(struct itimerspec *spec, apr_interval_time_t initial,
+                       apr_interval_time_t interval)
+{
+    spec->it_value.tv_sec = initial > 0 ? apr_time_sec(initial) : 0;
+    spec->it_value.tv_nsec = initial > 0 ? apr_time_usec(initial) * 1000 : 0;
+    spec->it_interval.tv_sec = interval > 0 ? apr_time_sec(interval) : 0;
+    spec->it_interval.tv_nsec = interval > 0 ? apr_time_usec(interval) * 1000
+                                             : 0;
+}
+#endif
+
+APR_DECLARE(apr_status_t) apr_poll_timer_create(apr_pollfd_t *pfd,
+                                                apr_interval_time_t initial,
+                                                apr_interval_time_t interval,
+                                                apr_pool_t *p)
+{
+#ifdef HAVE_TIMERFD
+    struct itimerspec spec;
+    int fd;
+
+    if ((fd = timerfd_create(CLOCK_MONOTONIC,
+                             TFD_CLOEXEC | TFD_NONBLOCK)) < 0) {
+        return errno;
+    }
+    timer_spec(&spec, initial, interval);
+    if (timerfd_settime(fd, 0, &spec, NULL)) {
+        apr_status_t rv = errno;
+        close(fd);
+        return rv;
+    }
+    return source_put(pfd, APR_POLL_TIMER, fd, p);
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
+APR_DECLARE(apr_status_t) apr_poll_timer_set(const apr_pollfd_t *pfd,
+                                             apr_interval_time_t initial,
+                                             apr_interval_time_t interval)
+{
+#ifdef HAVE_TIMERFD
+    struct itimerspec spec;
+    apr_os_file_t fd;
+
+    if (pfd->desc_type != APR_POLL_TIMER) {
+        return APR_EINVAL;
+    }
+    apr_os_file_get(&fd, pfd->desc.f);
+    timer_spec(&spec, initial, interval);
+    if (timerfd_settime(fd, 0, &spec, NULL)) {
+        return errno;
+    }
+    return APR_SUCCESS;
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
+APR_DECLARE(apr_status_t) apr_poll_timer_read(const apr_pollfd_t *pfd,
+                                              apr_uint64_t *expirations)
+{
+#ifdef HAVE_TIMERFD
+    apr_uint64_t count;
+    apr_status_t rv;
+
+    rv = source_read(pfd, APR_POLL_TIMER, &count, sizeof(count));
+    if (rv == APR_SUCCESS) {
+        *expirations = count;
+    }
+    return rv;
+#else
+    return APR_ENOTIMPL;
+#endif
+}
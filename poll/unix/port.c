@@ -222,6 +222,11 @@ static apr_status_t impl_pollset_add(apr_pollset_t *pollset,
     int res;
     apr_status_t rv = APR_SUCCESS;
 
+    /* Event ports are one-shot, APR_POLLET cannot be emulated */
+    if (descriptor->reqevents & APR_POLLET) {
+        return APR_ENOTIMPL;
+    }
+
     pollset_lock_rings();
 
     if (!APR_RING_EMPTY(&(pollset->p->free_ring), pfd_elem_t, link)) {
@@ -424,8 +429,9 @@ static apr_status_t impl_pollset_poll(apr_pollset_t *pollset,
          * to the add ring for re-association with the event port
          * later.  (It may have already been moved to the dead ring
          * by a call to pollset_remove on another thread.)
+         * An APR_POLLONESHOT element stays there until it is rearmed.
          */
-        if (ep->on_query_ring) {
+        if (ep->on_query_ring && !(ep->pfd.reqevents & APR_POLLONESHOT)) {
             APR_RING_REMOVE(ep, link);
             ep->on_query_ring = 0;
             APR_RING_INSERT_TAIL(&(pollset->p->add_ring), ep,
@@ -447,13 +453,78 @@ static apr_status_t impl_pollset_poll(apr_pollset_t *pollset,
     return rv;
 }
 
+static apr_status_t impl_pollset_rearm(apr_pollset_t *pollset,
+                                       const apr_pollfd_t *descriptor)
+{
+    apr_os_sock_t fd;
+    pfd_elem_t *ep;
+    apr_status_t rv = APR_NOTFOUND;
+
+    pollset_lock_rings();
+
+    for (ep = APR_RING_FIRST(&(pollset->p->query_ring));
+         ep != APR_RING_SENTINEL(&(pollset->p->query_ring),
+                                 pfd_elem_t, link);
+         ep = APR_RING_NEXT(ep, link)) {
+
+        if (descriptor->desc.s == ep->pfd.desc.s) {
+            rv = APR_SUCCESS;
+            break;
+        }
+    }
+
+    if (rv == APR_SUCCESS) {
+        /* Like apr_pollset_add(), associate it now if another thread is
+         * polling, otherwise at the next call to apr_pollset_poll().
+         */
+        if (apr_atomic_read32(&pollset->p->waiting)) {
+            if (ep->pfd.desc_type == APR_POLL_SOCKET) {
+                fd = ep->pfd.desc.s->socketdes;
+            }
+            else {
+                fd = ep->pfd.desc.f->filedes;
+            }
+            if (port_associate(pollset->p->port_fd, PORT_SOURCE_FD, fd,
+                               get_event(ep->pfd.reqevents),
+                               (void *)ep) < 0) {
+                rv = apr_get_netos_error();
+            }
+        }
+        else {
+            APR_RING_REMOVE(ep, link);
+            ep->on_query_ring = 0;
+            APR_RING_INSERT_TAIL(&(pollset->p->add_ring), ep,
+                                 pfd_elem_t, link);
+        }
+    }
+    else {
+        /* Not signalled yet, or already rearmed */
+        for (ep = APR_RING_FIRST(&(pollset->p->add_ring));
+             ep != APR_RING_SENTINEL(&(pollset->p->add_ring),
+                                     pfd_elem_t, link);
+             ep = APR_RING_NEXT(ep, link)) {
+
+            if (descriptor->desc.s == ep->pfd.desc.s) {
+                rv = APR_SUCCESS;
+                break;
+            }
+        }
+    }
+
+    pollset_unlock_rings();
+
+    return rv;
+}
+
 static const apr_pollset_provider_t impl = {
     impl_pollset_create,
     impl_pollset_add,
     impl_pollset_remove,
     impl_pollset_poll,
     impl_pollset_cleanup,
-    "port"
+    "port",
+    NULL,
+    impl_pollset_rearm
 };
 
 const apr_pollset_provider_t *apr_pollset_provider_port = &impl;
@@ -505,6 +576,11 @@ static apr_status_t impl_pollcb_add(apr_pollcb_t *pollcb,
 {
     int ret, fd;
 
+    /* Event ports are one-shot, APR_POLLET cannot be emulated */
+    if (descriptor->reqevents & APR_POLLET) {
+        return APR_ENOTIMPL;
+    }
+
     if (descriptor->desc_type == APR_POLL_SOCKET) {
         fd = descriptor->desc.s->socketdes;
     }
@@ -573,7 +649,9 @@ static apr_status_t impl_pollcb_poll(apr_pollcb_t *pollcb,
             if (rv) {
                 return rv;
             }
-            rv = apr_pollcb_add(pollcb, pollfd);
+            if (!(pollfd->reqevents & APR_POLLONESHOT)) {
+                rv = apr_pollcb_add(pollcb, pollfd);
+            }
         }
     }
 
@@ -586,7 +664,9 @@ static const apr_pollcb_provider_t impl_cb = {
     impl_pollcb_remove,
     impl_pollcb_poll,
     impl_pollcb_cleanup,
-    "port"
+    "port",
+    NULL,
+    impl_pollcb_add /* associating it again rearms it */
 };
 
 const apr_pollcb_provider_t *apr_pollcb_provider_port = &impl_cb;
@@ -85,7 +85,8 @@ APR_DECLARE(apr_status_t) apr_poll(apr_pollfd_t *aprset, int num,
 #endif
             fd = aprset[i].desc.s->socketdes;
         }
-        else if (aprset[i].desc_type == APR_POLL_FILE) {
+        else if (aprset[i].desc_type == APR_POLL_FILE
+                 || aprset[i].desc_type >= APR_POLL_SIGNAL) {
 #if !APR_FILES_AS_SOCKETS
             return APR_EBADF;
 #else
@@ -153,7 +154,8 @@ APR_DECLARE(apr_status_t) apr_poll(apr_pollfd_t *aprset, int num,
         if (aprset[i].desc_type == APR_POLL_SOCKET) {
             fd = aprset[i].desc.s->socketdes;
         }
-        else if (aprset[i].desc_type == APR_POLL_FILE) {
+        else if (aprset[i].desc_type == APR_POLL_FILE
+                 || aprset[i].desc_type >= APR_POLL_SIGNAL) {
 #if !APR_FILES_AS_SOCKETS
             return APR_EBADF;
 #else
@@ -24,6 +24,10 @@
 #include "apr_arch_poll_private.h"
 #include "apr_arch_inherit.h"
 
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+
 #if !APR_FILES_AS_SOCKETS
 
 #ifdef WIN32
@@ -81,6 +85,28 @@ apr_status_t apr_poll_create_wakeup_pipe(apr_pool_t *pool, apr_pollfd_t *pfd,
 {
     apr_status_t rv;
 
+#ifdef HAVE_EVENTFD
+    {
+        /* A single descriptor, both read and written */
+        int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+        if (fd >= 0) {
+            if ((rv = apr_os_pipe_put_ex(&wakeup_pipe[0], &fd, 1, pool))) {
+                close(fd);
+                return rv;
+            }
+            wakeup_pipe[1] = NULL;
+
+            pfd->p = pool;
+            pfd->reqevents = APR_POLLIN;
+            pfd->desc_type = APR_POLL_FILE;
+            pfd->desc.f = wakeup_pipe[0];
+            return APR_SUCCESS;
+        }
+        /* Not supported by the running kernel, fall back to a pipe */
+    }
+#endif
+
     /* Read end of the pipe is non-blocking */
     if ((rv = apr_file_pipe_create_ex(&wakeup_pipe[0], &wakeup_pipe[1],
                                       APR_WRITE_BLOCK, pool)))
@@ -135,13 +161,46 @@ apr_status_t apr_poll_close_wakeup_pipe(apr_file_t **wakeup_pipe)
 #endif /* APR_FILES_AS_SOCKETS */
 
 #if WAKEUP_USES_PIPE
+/* Write to the wakeup pipe.  The callers write once until it is drained,
+ * so the poll is woken up by a single system call.
+ */
+apr_status_t apr_poll_send_wakeup_pipe(apr_file_t **wakeup_pipe)
+{
+#ifdef HAVE_EVENTFD
+    if (!wakeup_pipe[1]) {
+        apr_uint64_t one = 1;
+        int rc;
+
+        do {
+            rc = write(wakeup_pipe[0]->filedes, &one, sizeof(one));
+        } while (rc < 0 && errno == EINTR);
+        return rc < 0 ? errno : APR_SUCCESS;
+    }
+#endif
+    return apr_file_putc(1, wakeup_pipe[1]);
+}
+
 /* Read and discard whatever is in the wakeup pipe.
  */
 void apr_poll_drain_wakeup_pipe(volatile apr_uint32_t *wakeup_set, apr_file_t **wakeup_pipe)
 {
-    char ch;
+#ifdef HAVE_EVENTFD
+    if (!wakeup_pipe[1]) {
+        apr_uint64_t count;
+        int rc;
+
+        /* Resets the counter */
+        do {
+            rc = read(wakeup_pipe[0]->filedes, &count, sizeof(count));
+        } while (rc < 0 && errno == EINTR);
+    }
+    else
+#endif
+    {
+        char ch;
 
-    (void)apr_file_getc(&ch, wakeup_pipe[0]);
+        (void)apr_file_getc(&ch, wakeup_pipe[0]);
+    }
     apr_atomic_set32(wakeup_set, 0);
 }
 #else
@@ -23,6 +23,7 @@
 #include <string.h>     /* memcpy()/memset() or bcopy()/bzero() */
 #include <assert.h>     /* assert() */
 #include "sha2.h"
+#include "apr_sha_private.h"
 
 /*
  * ASSERT NOTE:
@@ -238,7 +239,7 @@ void apr__SHA256_Init(SHA256_CTX* context) {
         (h) = T1 + Sigma0_256(a) + Maj((a), (b), (c)); \
         j++
 
-void apr__SHA256_Transform(SHA256_CTX* context, const sha2_word32* data) {
+static void SHA256_Transform_C(SHA256_CTX* context, const sha2_word32* data) {
         sha2_word32     a, b, c, d, e, f, g, h, s0, s1;
         sha2_word32     T1, *W256;
         int             j;
@@ -296,7 +297,7 @@ void apr__SHA256_Transform(SHA256_CTX* context, const sha2_word32* data) {
 
 #else /* SHA2_UNROLL_TRANSFORM */
 
-void apr__SHA256_Transform(SHA256_CTX* context, const sha2_word32* data) {
+static void SHA256_Transform_C(SHA256_CTX* context, const sha2_word32* data) {
         sha2_word32     a, b, c, d, e, f, g, h, s0, s1;
         sha2_word32     T1, T2, *W256;
         int             j;
@@ -376,6 +377,81 @@ void apr__SHA256_Transform(SHA256_CTX* context, const sha2_word32* data) {
 
 #endif /* SHA2_UNROLL_TRANSFORM */
 
+#ifdef SHA_NI
+/*
+ * Four rounds of SHA-NI, the s-th of the sixteen, on the message words
+ * in M[s % 4], scheduling the words of the rounds to come as it goes.
+ */
+#define SHA256_NI_STEP(s) \
+        MSG = _mm_add_epi32(M[(s) % 4], \
+                            _mm_loadu_si128((const __m128i*)&K256[4 * (s)])); \
+        STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG); \
+        if ((s) >= 3 && (s) <= 14) { \
+                TMP = _mm_alignr_epi8(M[(s) % 4], M[((s) + 3) % 4], 4); \
+                M[((s) + 1) % 4] = _mm_add_epi32(M[((s) + 1) % 4], TMP); \
+                M[((s) + 1) % 4] = _mm_sha256msg2_epu32(M[((s) + 1) % 4], \
+                                                        M[(s) % 4]); \
+        } \
+        MSG = _mm_shuffle_epi32(MSG, 0x0E); \
+        STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG); \
+        if ((s) >= 1 && (s) <= 12) { \
+                M[((s) + 3) % 4] = _mm_sha256msg1_epu32(M[((s) + 3) % 4], \
+                                                        M[(s) % 4]); \
+        }
+
+SHA_NI_TARGET
+static void SHA256_Transform_NI(SHA256_CTX* context, const sha2_byte* data) {
+        const __m128i   mask = _mm_set_epi64x(APR_INT64_C(0x0c0d0e0f08090a0b),
+                                              APR_INT64_C(0x0405060700010203));
+        __m128i         STATE0, STATE1, ABEF_SAVE, CDGH_SAVE;
+        __m128i         MSG, TMP, M[4];
+        int             j;
+
+        /* Load the state as ABEF and CDGH, the order of the instructions */
+        TMP = _mm_loadu_si128((const __m128i*)&context->state[0]);
+        STATE1 = _mm_loadu_si128((const __m128i*)&context->state[4]);
+        TMP = _mm_shuffle_epi32(TMP, 0xB1);
+        STATE1 = _mm_shuffle_epi32(STATE1, 0x1B);
+        STATE0 = _mm_alignr_epi8(TMP, STATE1, 8);
+        STATE1 = _mm_blend_epi16(STATE1, TMP, 0xF0);
+        ABEF_SAVE = STATE0;
+        CDGH_SAVE = STATE1;
+
+        for (j = 0; j < 4; j++) {
+                M[j] = _mm_shuffle_epi8(
+                        _mm_loadu_si128((const __m128i*)(data + 16 * j)), mask);
+        }
+
+        SHA256_NI_STEP(0)  SHA256_NI_STEP(1)  SHA256_NI_STEP(2)
+        SHA256_NI_STEP(3)  SHA256_NI_STEP(4)  SHA256_NI_STEP(5)
+        SHA256_NI_STEP(6)  SHA256_NI_STEP(7)  SHA256_NI_STEP(8)
+        SHA256_NI_STEP(9)  SHA256_NI_STEP(10) SHA256_NI_STEP(11)
+        SHA256_NI_STEP(12) SHA256_NI_STEP(13) SHA256_NI_STEP(14)
+        SHA256_NI_STEP(15)
+
+        STATE0 = _mm_add_epi32(STATE0, ABEF_SAVE);
+        STATE1 = _mm_add_epi32(STATE1, CDGH_SAVE);
+
+        /* Store the state back as ABCD and EFGH */
+        TMP = _mm_shuffle_epi32(STATE0, 0x1B);
+        STATE1 = _mm_shuffle_epi32(STATE1, 0xB1);
+        STATE0 = _mm_blend_epi16(TMP, STATE1, 0xF0);
+        STATE1 = _mm_alignr_epi8(STATE1, TMP, 8);
+        _mm_storeu_si128((__m128i*)&context->state[0], STATE0);
+        _mm_storeu_si128((__m128i*)&context->state[4], STATE1);
+}
+#endif /* SHA_NI */
+
+void apr__SHA256_Transform(SHA256_CTX* context, const sha2_word32* data) {
+#ifdef SHA_NI
+        if (HAVE_SHA_NI()) {
+                SHA256_Transform_NI(context, (const sha2_byte*)data);
+                return;
+        }
+#endif
+        SHA256_Transform_C(context, data);
+}
+
 void apr__SHA256_Update(SHA256_CTX* context, const sha2_byte *data, size_t len) {
         unsigned int    freespace, usedspace;
 
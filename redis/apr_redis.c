@@ -17,6 +17,10 @@
 #include "apr_redis.h"
 #include "apr_poll.h"
 #include "apr_version.h"
+#include "apr_md5.h"
+#include "apr_thread_cond.h"
+#include "apr_thread_proc.h"
+#include "apr_atomic.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -27,11 +31,14 @@ struct apr_redis_conn_t
     char *buffer;
     apr_size_t blen;
     apr_pool_t *p;
-    apr_pool_t *tp;
     apr_socket_t *sock;
+    apr_bucket_alloc_t *ba;
     apr_bucket_brigade *bb;
     apr_bucket_brigade *tb;
     apr_redis_server_t *rs;
+    apr_time_t start;  /* acquisition of the connection for a request */
+    apr_time_t sent;   /* the request written, or 0 */
+    apr_time_t fbtime; /* the first reply line read, or 0 */
 };
 
 /* Strings for Client Commands */
@@ -119,14 +126,182 @@ struct apr_redis_conn_t
 #define RS_END "\r\n"
 #define RS_END_LEN (sizeof(RS_END)-1)
 
+/* The client side metrics of a server, all updated atomically */
+struct apr_redis_counters_t
+{
+    apr_uint64_t requests;
+    apr_uint64_t errors;
+    apr_uint64_t connects;
+    apr_uint64_t connect_errors;
+    apr_uint64_t reconnects;
+    apr_uint64_t deaths;
+    apr_uint64_t dead_time;
+    apr_uint64_t dead_since;  /* start of the current dead period, or 0 */
+    apr_uint32_t broken;      /* connections invalidated, not replaced yet */
+    apr_redis_latency_t connect;
+    apr_redis_latency_t send;
+    apr_redis_latency_t first_byte;
+    apr_redis_latency_t total;
+};
+
+static int latency_bucket(apr_uint64_t v)
+{
+    apr_uint64_t x;
+    int msb = 0, i;
+
+    if (v < 4) {
+        return (int)v;
+    }
+    for (x = v; x >>= 1; ) {
+        msb++;
+    }
+    /* 4 buckets per power of two, indexed by the 2 bits after the msb */
+    i = (msb - 1) * 4 + (int)((v >> (msb - 2)) & 3);
+    return i < APR_RC_LATENCY_BUCKETS ? i : APR_RC_LATENCY_BUCKETS - 1;
+}
+
+static void latency_record(apr_redis_latency_t *lat,
+                           apr_time_t from, apr_time_t to)
+{
+    apr_uint64_t v = to > from ? (apr_uint64_t)(to - from) : 0, max;
+
+    apr_atomic_inc64(&lat->buckets[latency_bucket(v)]);
+    apr_atomic_add64(&lat->sum, v);
+    apr_atomic_inc64(&lat->count);
+    do {
+        max = apr_atomic_read64(&lat->max);
+    } while (v > max && apr_atomic_cas64(&lat->max, v, max) != max);
+}
+
+static void latency_copy(apr_redis_latency_t *to,
+                         apr_redis_latency_t *from)
+{
+    int i;
+
+    to->count = apr_atomic_read64(&from->count);
+    to->sum = apr_atomic_read64(&from->sum);
+    to->max = apr_atomic_read64(&from->max);
+    for (i = 0; i < APR_RC_LATENCY_BUCKETS; i++) {
+        to->buckets[i] = apr_atomic_read64(&from->buckets[i]);
+    }
+}
+
+static void latency_reset(apr_redis_latency_t *lat)
+{
+    int i;
+
+    apr_atomic_set64(&lat->count, 0);
+    apr_atomic_set64(&lat->sum, 0);
+    apr_atomic_set64(&lat->max, 0);
+    for (i = 0; i < APR_RC_LATENCY_BUCKETS; i++) {
+        apr_atomic_set64(&lat->buckets[i], 0);
+    }
+}
+
+APR_DECLARE(apr_interval_time_t) apr_redis_latency_bucket_limit(int bucket)
+{
+    int next = bucket + 1;
+
+    if (next >= APR_RC_LATENCY_BUCKETS) {
+        return -1;
+    }
+    if (next < 4) {
+        return next;
+    }
+    return (apr_interval_time_t)(4 + next % 4) << (next / 4 - 1);
+}
+
+APR_DECLARE(apr_interval_time_t) apr_redis_latency_percentile(const apr_redis_latency_t *lat,
+                                                              double percentile)
+{
+    apr_uint64_t rank, seen = 0;
+    apr_interval_time_t limit;
+    int i;
+
+    if (lat->count == 0) {
+        return 0;
+    }
+    if (percentile >= 100) {
+        return lat->max;
+    }
+    rank = percentile > 0 ? (apr_uint64_t)(lat->count * percentile / 100) : 0;
+    for (i = 0; i < APR_RC_LATENCY_BUCKETS - 1; i++) {
+        seen += lat->buckets[i];
+        if (seen > rank) {
+            break;
+        }
+    }
+    limit = apr_redis_latency_bucket_limit(i);
+    if (limit < 0 || (apr_uint64_t)limit - 1 > lat->max) {
+        return lat->max;
+    }
+    return limit - 1;
+}
+
+APR_DECLARE(apr_status_t) apr_redis_server_metrics(apr_redis_server_t *rs,
+                                                   apr_redis_metrics_t *metrics)
+{
+    apr_redis_counters_t *c = rs->counters;
+    apr_uint64_t since;
+
+    metrics->requests = apr_atomic_read64(&c->requests);
+    metrics->errors = apr_atomic_read64(&c->errors);
+    metrics->connects = apr_atomic_read64(&c->connects);
+    metrics->connect_errors = apr_atomic_read64(&c->connect_errors);
+    metrics->reconnects = apr_atomic_read64(&c->reconnects);
+    metrics->deaths = apr_atomic_read64(&c->deaths);
+    metrics->dead_time = apr_atomic_read64(&c->dead_time);
+    since = apr_atomic_read64(&c->dead_since);
+    if (since) {
+        apr_time_t now = apr_time_monotonic();
+
+        if (now > (apr_time_t)since) {
+            metrics->dead_time += now - since;
+        }
+    }
+    latency_copy(&metrics->connect, &c->connect);
+    latency_copy(&metrics->send, &c->send);
+    latency_copy(&metrics->first_byte, &c->first_byte);
+    latency_copy(&metrics->total, &c->total);
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(void) apr_redis_server_metrics_reset(apr_redis_server_t *rs)
+{
+    apr_redis_counters_t *c = rs->counters;
+
+    apr_atomic_set64(&c->requests, 0);
+    apr_atomic_set64(&c->errors, 0);
+    apr_atomic_set64(&c->connects, 0);
+    apr_atomic_set64(&c->connect_errors, 0);
+    apr_atomic_set64(&c->reconnects, 0);
+    apr_atomic_set64(&c->deaths, 0);
+    apr_atomic_set64(&c->dead_time, 0);
+    /* a current dead period is accounted from now on */
+    if (apr_atomic_read64(&c->dead_since)) {
+        apr_atomic_set64(&c->dead_since, apr_time_monotonic());
+    }
+    latency_reset(&c->connect);
+    latency_reset(&c->send);
+    latency_reset(&c->first_byte);
+    latency_reset(&c->total);
+}
+
 static apr_status_t make_server_dead(apr_redis_t *rc,
                                      apr_redis_server_t *rs)
 {
+    apr_time_t now = apr_time_monotonic();
+
 #if APR_HAS_THREADS
     apr_thread_mutex_lock(rs->lock);
 #endif
+    if (rs->status != APR_RC_SERVER_DEAD) {
+        apr_atomic_inc64(&rs->counters->deaths);
+        apr_atomic_set64(&rs->counters->dead_since, now);
+    }
     rs->status = APR_RC_SERVER_DEAD;
-    rs->btime = apr_time_now();
+    rs->btime = now;
 #if APR_HAS_THREADS
     apr_thread_mutex_unlock(rs->lock);
 #endif
@@ -136,10 +311,22 @@ static apr_status_t make_server_dead(apr_redis_t *rc,
 static apr_status_t make_server_live(apr_redis_t *rc,
                                      apr_redis_server_t *rs)
 {
+    apr_uint64_t since = apr_atomic_xchg64(&rs->counters->dead_since, 0);
+
+    if (since) {
+        apr_time_t now = apr_time_monotonic();
+
+        if (now > (apr_time_t)since) {
+            apr_atomic_add64(&rs->counters->dead_time, now - since);
+        }
+    }
     rs->status = APR_RC_SERVER_LIVE;
     return APR_SUCCESS;
 }
 
+static void ring_build(apr_redis_t *rc);
+static void near_cache_invalidate(apr_redis_t *rc, const char *key);
+
 APR_DECLARE(apr_status_t) apr_redis_add_server(apr_redis_t *rc,
                                                apr_redis_server_t *rs)
 {
@@ -151,6 +338,9 @@ APR_DECLARE(apr_status_t) apr_redis_add_server(apr_redis_t *rc,
     rc->live_servers[rc->ntotal] = rs;
     rc->ntotal++;
     make_server_live(rc, rs);
+    if (rc->ring) {
+        ring_build(rc);
+    }
     return rv;
 }
 
@@ -165,55 +355,202 @@ apr_redis_find_server_hash(apr_redis_t *rc, const apr_uint32_t hash)
     }
 }
 
+/* Whether the server is live, or was dead long enough to be tried again
+ * and came back.
+ */
+static int server_usable(apr_redis_t *rc, apr_redis_server_t *rs,
+                         apr_time_t *curtime)
+{
+    int live = 0;
+
+    if (rs->status == APR_RC_SERVER_LIVE) {
+        return 1;
+    }
+    if (rc->prober) {
+        return 0;
+    }
+
+    if (*curtime == 0) {
+        *curtime = apr_time_monotonic();
+    }
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(rs->lock);
+#endif
+    /* Try the dead server, every 5 seconds */
+    if (*curtime - rs->btime > apr_time_from_sec(5)) {
+        rs->btime = *curtime;
+        if (apr_redis_ping(rs) == APR_SUCCESS) {
+            make_server_live(rc, rs);
+            live = 1;
+        }
+    }
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(rs->lock);
+#endif
+
+    return live;
+}
+
+/* The first usable server from the h'th on, wrapping around */
+static apr_redis_server_t *find_server_from(apr_redis_t *rc, apr_uint32_t h)
+{
+    apr_time_t curtime = 0;
+    apr_uint32_t i;
+
+    for (i = 0; i < rc->ntotal; i++, h++) {
+        apr_redis_server_t *rs = rc->live_servers[h % rc->ntotal];
+
+        if (server_usable(rc, rs, &curtime)) {
+            return rs;
+        }
+    }
+
+    return NULL;
+}
+
 APR_DECLARE(apr_redis_server_t *)
 apr_redis_find_server_hash_default(void *baton, apr_redis_t *rc,
                                    const apr_uint32_t hash)
 {
-    apr_redis_server_t *rs = NULL;
-    apr_uint32_t h = hash ? hash : 1;
-    apr_uint32_t i = 0;
+    if (rc->ntotal == 0) {
+        return NULL;
+    }
+
+    return find_server_from(rc, hash ? hash : 1);
+}
+
+/* The ketama ring: KETAMA_POINTS points per unit of weight of each
+ * server, sorted, four of them taken from the md5 of "host:port-n".
+ */
+#define KETAMA_POINTS 160
+
+typedef struct {
+    apr_uint32_t point;
+    apr_redis_server_t *rs;
+} ring_point_t;
+
+struct apr_redis_ring_t {
+    ring_point_t *points;
+    apr_size_t npoints;
+};
+
+static int ring_point_cmp(const void *a, const void *b)
+{
+    apr_uint32_t pa = ((const ring_point_t *)a)->point;
+    apr_uint32_t pb = ((const ring_point_t *)b)->point;
+
+    return (pa > pb) - (pa < pb);
+}
+
+static void ring_build(apr_redis_t *rc)
+{
+    apr_redis_ring_t *ring = rc->ring;
+    apr_size_t n = 0;
+    apr_uint32_t i, j, k;
+
+    for (i = 0; i < rc->ntotal; i++) {
+        n += (apr_size_t)KETAMA_POINTS * rc->live_servers[i]->weight;
+    }
+
+    /* Servers are added at startup, the previous rings are not reused */
+    ring->points = apr_palloc(rc->p, n * sizeof(ring_point_t));
+    ring->npoints = 0;
+
+    for (i = 0; i < rc->ntotal; i++) {
+        apr_redis_server_t *rs = rc->live_servers[i];
+
+        for (j = 0; j < KETAMA_POINTS / 4 * rs->weight; j++) {
+            unsigned char digest[APR_MD5_DIGESTSIZE];
+            char id[512];
+            apr_size_t len;
+
+            len = apr_snprintf(id, sizeof(id), "%s:%hu-%u",
+                               rs->host, rs->port, j);
+            apr_md5(digest, id, len);
+
+            for (k = 0; k < 4; k++) {
+                ring_point_t *pt = &ring->points[ring->npoints++];
+
+                pt->point = ((apr_uint32_t)digest[k * 4 + 3] << 24)
+                          | ((apr_uint32_t)digest[k * 4 + 2] << 16)
+                          | ((apr_uint32_t)digest[k * 4 + 1] << 8)
+                          | digest[k * 4];
+                pt->rs = rs;
+            }
+        }
+    }
+
+    qsort(ring->points, ring->npoints, sizeof(ring_point_t), ring_point_cmp);
+}
+
+APR_DECLARE(apr_redis_server_t *)
+apr_redis_find_server_hash_ketama(void *baton, apr_redis_t *rc,
+                                  const apr_uint32_t hash)
+{
+    apr_redis_ring_t *ring = rc->ring;
+    apr_redis_server_t *tried = NULL;
     apr_time_t curtime = 0;
+    apr_size_t lo = 0, hi, i;
 
-    if (rc->ntotal == 0) {
+    if (!ring || !ring->npoints) {
         return NULL;
     }
 
-    do {
-        rs = rc->live_servers[h % rc->ntotal];
-        if (rs->status == APR_RC_SERVER_LIVE) {
-            break;
+    /* The first point at or after the hash */
+    hi = ring->npoints;
+    while (lo < hi) {
+        apr_size_t mid = lo + (hi - lo) / 2;
+
+        if (ring->points[mid].point < hash) {
+            lo = mid + 1;
         }
         else {
-            if (curtime == 0) {
-                curtime = apr_time_now();
-            }
-#if APR_HAS_THREADS
-            apr_thread_mutex_lock(rs->lock);
-#endif
-            /* Try the dead server, every 5 seconds */
-            if (curtime - rs->btime > apr_time_from_sec(5)) {
-                rs->btime = curtime;
-                if (apr_redis_ping(rs) == APR_SUCCESS) {
-                    make_server_live(rc, rs);
-#if APR_HAS_THREADS
-                    apr_thread_mutex_unlock(rs->lock);
-#endif
-                    break;
-                }
+            hi = mid;
+        }
+    }
+
+    /* Then the next points (of another server) while dead */
+    for (i = 0; i < ring->npoints; i++) {
+        apr_redis_server_t *rs = ring->points[(lo + i) % ring->npoints].rs;
+
+        if (rs != tried) {
+            if (server_usable(rc, rs, &curtime)) {
+                return rs;
             }
-#if APR_HAS_THREADS
-            apr_thread_mutex_unlock(rs->lock);
-#endif
+            tried = rs;
         }
-        h++;
-        i++;
-    } while (i < rc->ntotal);
+    }
+
+    return NULL;
+}
+
+/* Jump consistent hash, from "A Fast, Minimal Memory, Consistent Hash
+ * Algorithm" (Lamping and Veach).
+ */
+static apr_uint32_t jump_hash(apr_uint64_t key, apr_uint32_t nbuckets)
+{
+    apr_int64_t b = -1, j = 0;
+
+    while (j < (apr_int64_t)nbuckets) {
+        b = j;
+        key = key * APR_UINT64_C(2862933555777941757) + 1;
+        j = (apr_int64_t)((double)(b + 1)
+                          * ((double)(APR_INT64_C(1) << 31)
+                             / (double)((key >> 33) + 1)));
+    }
+
+    return (apr_uint32_t)b;
+}
 
-    if (i == rc->ntotal) {
-        rs = NULL;
+APR_DECLARE(apr_redis_server_t *)
+apr_redis_find_server_hash_jump(void *baton, apr_redis_t *rc,
+                                const apr_uint32_t hash)
+{
+    if (rc->ntotal == 0) {
+        return NULL;
     }
 
-    return rs;
+    return find_server_from(rc, jump_hash(hash, rc->ntotal));
 }
 
 APR_DECLARE(apr_redis_server_t *) apr_redis_find_server(apr_redis_t *rc,
@@ -237,7 +574,6 @@ static apr_status_t rs_find_conn(apr_redis_server_t *rs,
                                  apr_redis_conn_t ** conn)
 {
     apr_status_t rv;
-    apr_bucket_alloc_t *balloc;
     apr_bucket *e;
 
 #if APR_HAS_THREADS
@@ -251,19 +587,23 @@ static apr_status_t rs_find_conn(apr_redis_server_t *rs,
         return rv;
     }
 
-    balloc = apr_bucket_alloc_create((*conn)->tp);
-    (*conn)->bb = apr_brigade_create((*conn)->tp, balloc);
-    (*conn)->tb = apr_brigade_create((*conn)->tp, balloc);
-
-    e = apr_bucket_socket_create((*conn)->sock, balloc);
+    /* The brigades live with the connection, emptied on release */
+    e = apr_bucket_socket_create((*conn)->sock, (*conn)->ba);
     APR_BRIGADE_INSERT_TAIL((*conn)->bb, e);
 
+    (*conn)->start = apr_time_monotonic();
+    (*conn)->sent = 0;
+    (*conn)->fbtime = 0;
+    apr_atomic_inc64(&rs->counters->requests);
+
     return rv;
 }
 
 static apr_status_t rs_bad_conn(apr_redis_server_t *rs,
                                 apr_redis_conn_t *conn)
 {
+    apr_atomic_inc64(&rs->counters->errors);
+    apr_atomic_inc32(&rs->counters->broken);
 #if APR_HAS_THREADS
     return apr_reslist_invalidate(rs->conns, conn);
 #else
@@ -274,7 +614,18 @@ static apr_status_t rs_bad_conn(apr_redis_server_t *rs,
 static apr_status_t rs_release_conn(apr_redis_server_t *rs,
                                     apr_redis_conn_t *conn)
 {
-    apr_pool_clear(conn->tp);
+    apr_time_t now = apr_time_monotonic();
+
+    if (conn->sent) {
+        latency_record(&rs->counters->send, conn->start, conn->sent);
+    }
+    if (conn->fbtime) {
+        latency_record(&rs->counters->first_byte, conn->start, conn->fbtime);
+    }
+    latency_record(&rs->counters->total, conn->start, now);
+
+    apr_brigade_cleanup(conn->bb);
+    apr_brigade_cleanup(conn->tb);
 #if APR_HAS_THREADS
     return apr_reslist_release(rs->conns, conn);
 #else
@@ -282,6 +633,168 @@ static apr_status_t rs_release_conn(apr_redis_server_t *rs,
 #endif
 }
 
+#if APR_HAS_THREADS
+/* The background prober of the dead servers: each is probed after the
+ * interval, then after twice the previous delay (up to max_interval)
+ * until it answers.  The delays are indexed like rc->live_servers.
+ */
+struct apr_redis_prober_t
+{
+    apr_redis_t *rc;
+    apr_interval_time_t interval;
+    apr_interval_time_t max_interval;
+    apr_interval_time_t *delay;
+    apr_time_t *next; /* time of the next probe, or 0 if live */
+    apr_thread_mutex_t *lock;
+    apr_thread_cond_t *cond;
+    apr_thread_t *thread;
+    int stop;
+};
+
+static void * APR_THREAD_FUNC prober_thread(apr_thread_t *thd, void *data)
+{
+    apr_redis_prober_t *pr = data;
+    apr_redis_t *rc = pr->rc;
+
+    apr_thread_mutex_lock(pr->lock);
+    while (!pr->stop) {
+        apr_time_t now = apr_time_monotonic();
+        apr_time_t wake = now + pr->max_interval;
+        apr_uint32_t i;
+
+        for (i = 0; i < rc->ntotal && !pr->stop; i++) {
+            apr_redis_server_t *rs = rc->live_servers[i];
+
+            if (rs->status == APR_RC_SERVER_LIVE) {
+                pr->next[i] = 0;
+                continue;
+            }
+            if (pr->next[i] == 0) {
+                /* newly dead */
+                pr->delay[i] = pr->interval;
+                pr->next[i] = now + pr->delay[i];
+            }
+            else if (pr->next[i] <= now) {
+                apr_status_t rv;
+
+                /* don't hold up apr_redis_disable_server() or the stop */
+                apr_thread_mutex_unlock(pr->lock);
+                rv = apr_redis_ping(rs);
+                apr_thread_mutex_lock(pr->lock);
+
+                now = apr_time_monotonic();
+                if (rv == APR_SUCCESS) {
+                    make_server_live(rc, rs);
+                    pr->next[i] = 0;
+                    continue;
+                }
+                pr->delay[i] *= 2;
+                if (pr->delay[i] > pr->max_interval) {
+                    pr->delay[i] = pr->max_interval;
+                }
+                pr->next[i] = now + pr->delay[i];
+            }
+            if (pr->next[i] < wake) {
+                wake = pr->next[i];
+            }
+        }
+        if (!pr->stop && wake > now) {
+            apr_thread_cond_timedwait(pr->cond, pr->lock, wake - now);
+        }
+    }
+    apr_thread_mutex_unlock(pr->lock);
+
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static apr_status_t prober_cleanup(void *data)
+{
+    apr_redis_prober_t *pr = data;
+    apr_status_t rv;
+
+    apr_thread_mutex_lock(pr->lock);
+    pr->stop = 1;
+    apr_thread_cond_signal(pr->cond);
+    apr_thread_mutex_unlock(pr->lock);
+
+    apr_thread_join(&rv, pr->thread);
+    pr->rc->prober = NULL;
+
+    return APR_SUCCESS;
+}
+
+static void prober_wake(apr_redis_t *rc)
+{
+    apr_redis_prober_t *pr = rc->prober;
+
+    if (pr) {
+        apr_thread_mutex_lock(pr->lock);
+        apr_thread_cond_signal(pr->cond);
+        apr_thread_mutex_unlock(pr->lock);
+    }
+}
+
+APR_DECLARE(apr_status_t) apr_redis_prober_start(apr_redis_t *rc,
+                                                 apr_interval_time_t interval,
+                                                 apr_interval_time_t max_interval)
+{
+    apr_redis_prober_t *pr;
+    apr_status_t rv;
+
+    if (rc->prober) {
+        return APR_EEXIST;
+    }
+    if (interval <= 0 || max_interval < interval) {
+        return APR_EINVAL;
+    }
+
+    pr = apr_pcalloc(rc->p, sizeof(apr_redis_prober_t));
+    pr->rc = rc;
+    pr->interval = interval;
+    pr->max_interval = max_interval;
+    pr->delay = apr_pcalloc(rc->p, rc->nalloc * sizeof(apr_interval_time_t));
+    pr->next = apr_pcalloc(rc->p, rc->nalloc * sizeof(apr_time_t));
+
+    rv = apr_thread_mutex_create(&pr->lock, APR_THREAD_MUTEX_DEFAULT, rc->p);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    rv = apr_thread_cond_create(&pr->cond, rc->p);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    /* from now on, the requests only see the live or dead state */
+    rc->prober = pr;
+
+    rv = apr_thread_create(&pr->thread, NULL, prober_thread, pr, rc->p);
+    if (rv != APR_SUCCESS) {
+        rc->prober = NULL;
+        return rv;
+    }
+
+    /* joined before the servers' (sub)pools go away */
+    apr_pool_pre_cleanup_register(rc->p, pr, prober_cleanup);
+
+    return APR_SUCCESS;
+}
+
+#else /* APR_HAS_THREADS */
+
+static void prober_wake(apr_redis_t *rc)
+{
+}
+
+APR_DECLARE(apr_status_t) apr_redis_prober_start(apr_redis_t *rc,
+                                                 apr_interval_time_t interval,
+                                                 apr_interval_time_t max_interval)
+{
+    return APR_ENOTIMPL;
+}
+
+#endif /* APR_HAS_THREADS */
+
 APR_DECLARE(apr_status_t) apr_redis_enable_server(apr_redis_t *rc,
                                                   apr_redis_server_t *rs)
 {
@@ -297,7 +810,10 @@ APR_DECLARE(apr_status_t) apr_redis_enable_server(apr_redis_t *rc,
 APR_DECLARE(apr_status_t) apr_redis_disable_server(apr_redis_t *rc,
                                                    apr_redis_server_t *rs)
 {
-    return make_server_dead(rc, rs);
+    apr_status_t rv = make_server_dead(rc, rs);
+
+    prober_wake(rc);
+    return rv;
 }
 
 static apr_status_t conn_connect(apr_redis_conn_t *conn)
@@ -341,7 +857,6 @@ rc_conn_construct(void **conn_, void *params, apr_pool_t *pool)
     apr_status_t rv = APR_SUCCESS;
     apr_redis_conn_t *conn;
     apr_pool_t *np;
-    apr_pool_t *tp;
     apr_redis_server_t *rs = params;
 #if APR_HAVE_SOCKADDR_UN
     apr_int32_t family = rs->host[0] != '/' ? APR_INET : APR_UNIX;
@@ -354,16 +869,9 @@ rc_conn_construct(void **conn_, void *params, apr_pool_t *pool)
         return rv;
     }
 
-    rv = apr_pool_create(&tp, np);
-    if (rv != APR_SUCCESS) {
-        apr_pool_destroy(np);
-        return rv;
-    }
-
     conn = apr_palloc(np, sizeof(apr_redis_conn_t));
 
     conn->p = np;
-    conn->tp = tp;
 
     rv = apr_socket_create(&conn->sock, family, SOCK_STREAM, 0, np);
 
@@ -374,13 +882,30 @@ rc_conn_construct(void **conn_, void *params, apr_pool_t *pool)
 
     conn->buffer = apr_palloc(conn->p, BUFFER_SIZE + 1);
     conn->blen = 0;
+    conn->ba = apr_bucket_alloc_create(np);
+    conn->bb = apr_brigade_create(np, conn->ba);
+    conn->tb = apr_brigade_create(np, conn->ba);
     conn->rs = rs;
+    conn->start = apr_time_monotonic();
 
     rv = conn_connect(conn);
     if (rv != APR_SUCCESS) {
+        apr_atomic_inc64(&rs->counters->connect_errors);
         apr_pool_destroy(np);
     }
     else {
+        apr_uint32_t broken;
+
+        latency_record(&rs->counters->connect, conn->start, apr_time_monotonic());
+        apr_atomic_inc64(&rs->counters->connects);
+        /* replacing a broken connection? */
+        while ((broken = apr_atomic_read32(&rs->counters->broken)) != 0) {
+            if (apr_atomic_cas32(&rs->counters->broken, broken - 1,
+                                 broken) == broken) {
+                apr_atomic_inc64(&rs->counters->reconnects);
+                break;
+            }
+        }
         *conn_ = conn;
     }
 
@@ -443,7 +968,9 @@ APR_DECLARE(apr_status_t) apr_redis_server_create(apr_pool_t *p,
     server->p = np;
     server->host = apr_pstrdup(np, host);
     server->port = port;
+    server->weight = 1;
     server->status = APR_RC_SERVER_DEAD;
+    server->counters = apr_pcalloc(np, sizeof(apr_redis_counters_t));
     server->rwto = rwto;
     server->version.major = 0;
     server->version.minor = 0;
@@ -498,6 +1025,21 @@ APR_DECLARE(apr_status_t) apr_redis_create(apr_pool_t *p,
     rc->hash_baton = NULL;
     rc->server_func = NULL;
     rc->server_baton = NULL;
+    rc->flags = flags;
+    rc->ring = NULL;
+    rc->near_cache = NULL;
+    rc->prober = NULL;
+    if (flags & APR_RC_FLAG_KETAMA) {
+        rc->ring = apr_pcalloc(p, sizeof(apr_redis_ring_t));
+        rc->server_func = apr_redis_find_server_hash_ketama;
+    }
+    else if (flags & APR_RC_FLAG_JUMP) {
+        rc->server_func = apr_redis_find_server_hash_jump;
+    }
+    if (rc->server_func) {
+        /* The default hash has 15 bits only, too few for a ring */
+        rc->hash_func = apr_redis_hash_crc32;
+    }
     *redis = rc;
     return rv;
 }
@@ -617,6 +1159,11 @@ static apr_status_t get_server_line(apr_redis_conn_t *conn)
     apr_size_t bsize = BUFFER_SIZE;
     apr_status_t rv = APR_SUCCESS;
 
+    /* the request is written once its reply is waited for */
+    if (!conn->sent) {
+        conn->sent = apr_time_monotonic();
+    }
+
     rv = apr_brigade_split_line(conn->tb, conn->bb, APR_BLOCK_READ,
             BUFFER_SIZE);
 
@@ -624,6 +1171,10 @@ static apr_status_t get_server_line(apr_redis_conn_t *conn)
         return rv;
     }
 
+    if (!conn->fbtime) {
+        conn->fbtime = apr_time_monotonic();
+    }
+
     rv = apr_brigade_flatten(conn->tb, conn->buffer, &bsize);
 
     if (rv != APR_SUCCESS) {
@@ -653,6 +1204,7 @@ APR_DECLARE(apr_status_t) apr_redis_set(apr_redis_t *rc,
     apr_size_t len, klen;
 
     klen = strlen(key);
+    near_cache_invalidate(rc, key);
     hash = apr_redis_hash(rc, key, klen);
 
     rs = apr_redis_find_server_hash(rc, hash);
@@ -758,6 +1310,7 @@ APR_DECLARE(apr_status_t) apr_redis_setex(apr_redis_t *rc,
 
 
     klen = strlen(key);
+    near_cache_invalidate(rc, key);
     hash = apr_redis_hash(rc, key, klen);
 
     rs = apr_redis_find_server_hash(rc, hash);
@@ -886,7 +1439,7 @@ static apr_status_t grab_bulk_resp(apr_redis_server_t *rs, apr_redis_t *rc,
             return rv;
         }
 
-        bbb = apr_brigade_split(conn->bb, e);
+        bbb = apr_brigade_split_ex(conn->bb, e, conn->tb);
 
         rv = apr_brigade_pflatten(conn->bb, baton, &len, p);
 
@@ -897,7 +1450,7 @@ static apr_status_t grab_bulk_resp(apr_redis_server_t *rs, apr_redis_t *rc,
             return rv;
         }
 
-        rv = apr_brigade_destroy(conn->bb);
+        rv = apr_brigade_cleanup(conn->bb);
         if (rv != APR_SUCCESS) {
             rs_bad_conn(rs, conn);
             if (rc)
@@ -905,6 +1458,7 @@ static apr_status_t grab_bulk_resp(apr_redis_server_t *rs, apr_redis_t *rc,
             return rv;
         }
 
+        conn->tb = conn->bb;
         conn->bb = bbb;
 
         *new_length = len - 2;
@@ -914,12 +1468,12 @@ static apr_status_t grab_bulk_resp(apr_redis_server_t *rs, apr_redis_t *rc,
 
 }
 
-APR_DECLARE(apr_status_t) apr_redis_getp(apr_redis_t *rc,
-                                         apr_pool_t *p,
-                                         const char *key,
-                                         char **baton,
-                                         apr_size_t *new_length,
-                                         apr_uint16_t *flags)
+static apr_status_t redis_getp(apr_redis_t *rc,
+                               apr_pool_t *p,
+                               const char *key,
+                               char **baton,
+                               apr_size_t *new_length,
+                               apr_uint16_t *flags)
 {
     apr_status_t rv;
     apr_redis_server_t *rs;
@@ -1001,6 +1555,337 @@ APR_DECLARE(apr_status_t) apr_redis_getp(apr_redis_t *rc,
     return rv;
 }
 
+/*
+ * Near cache
+ */
+
+#define NEAR_CACHE_SHARDS 16
+
+#define NEAR_FETCHING 0
+#define NEAR_READY    1
+
+typedef struct near_entry_t near_entry_t;
+struct near_entry_t {
+    char *key;
+    apr_size_t klen;
+    char *data;
+    apr_size_t len;
+    apr_uint16_t flags;
+    apr_status_t status;        /* the result of the fetch */
+    apr_time_t expires;
+    int state;
+    int referenced;             /* CLOCK bit */
+    int invalidated;            /* the fetch result must not be kept */
+    int waiters;                /* threads waiting for the fetch */
+    apr_uint32_t slot;
+};
+
+typedef struct near_shard_t {
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *lock;
+    apr_thread_cond_t *fetched;
+#endif
+    apr_hash_t *entries;
+    near_entry_t **slots;       /* the CLOCK, NULL slots are free */
+    apr_uint32_t hand;
+} near_shard_t;
+
+struct apr_redis_near_cache_t {
+    apr_uint32_t nslots;        /* per shard */
+    apr_size_t max_size;
+    apr_interval_time_t ttl;
+    near_shard_t shards[NEAR_CACHE_SHARDS];
+};
+
+#if APR_HAS_THREADS
+#define NEAR_LOCK(s)    apr_thread_mutex_lock((s)->lock)
+#define NEAR_UNLOCK(s)  apr_thread_mutex_unlock((s)->lock)
+#else
+#define NEAR_LOCK(s)
+#define NEAR_UNLOCK(s)
+#endif
+
+static void near_entry_free(near_shard_t *shard, near_entry_t *e)
+{
+    apr_hash_set(shard->entries, e->key, e->klen, NULL);
+    shard->slots[e->slot] = NULL;
+    free(e->data);
+    free(e->key);
+    free(e);
+}
+
+static apr_status_t near_cache_cleanup(void *data)
+{
+    apr_redis_near_cache_t *nc = data;
+    apr_uint32_t i, j;
+
+    for (i = 0; i < NEAR_CACHE_SHARDS; i++) {
+        near_shard_t *shard = &nc->shards[i];
+
+        for (j = 0; j < nc->nslots; j++) {
+            if (shard->slots[j]) {
+                near_entry_free(shard, shard->slots[j]);
+            }
+        }
+    }
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_redis_near_cache_create(apr_redis_t *rc,
+                                                      apr_uint32_t max_items,
+                                                      apr_size_t max_size,
+                                                      apr_interval_time_t ttl)
+{
+    apr_redis_near_cache_t *nc;
+    apr_status_t rv;
+    int i;
+
+    if (rc->near_cache || max_items == 0) {
+        return APR_EINVAL;
+    }
+
+    nc = apr_pcalloc(rc->p, sizeof(*nc));
+    nc->nslots = (max_items + NEAR_CACHE_SHARDS - 1) / NEAR_CACHE_SHARDS;
+    nc->max_size = max_size;
+    nc->ttl = ttl;
+
+    for (i = 0; i < NEAR_CACHE_SHARDS; i++) {
+        near_shard_t *shard = &nc->shards[i];
+
+#if APR_HAS_THREADS
+        rv = apr_thread_mutex_create(&shard->lock, APR_THREAD_MUTEX_DEFAULT,
+                                     rc->p);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        rv = apr_thread_cond_create(&shard->fetched, rc->p);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+#endif
+        shard->entries = apr_hash_make(rc->p);
+        shard->slots = apr_pcalloc(rc->p, nc->nslots * sizeof(near_entry_t *));
+    }
+
+    /* Registered after the locks', so run before they are gone */
+    apr_pool_cleanup_register(rc->p, nc, near_cache_cleanup,
+                              apr_pool_cleanup_null);
+
+    rc->near_cache = nc;
+    return APR_SUCCESS;
+}
+
+static near_shard_t *near_cache_shard(apr_redis_near_cache_t *nc,
+                                      const char *key, apr_size_t klen)
+{
+    return &nc->shards[apr_redis_hash_crc32(NULL, key, klen)
+                       % NEAR_CACHE_SHARDS];
+}
+
+/* Find a slot for a new entry, evicting the first unreferenced entry
+ * under the CLOCK hand, or return -1 if all the entries are busy.
+ */
+static int near_cache_slot(apr_redis_near_cache_t *nc,
+                           near_shard_t *shard, apr_uint32_t *slot)
+{
+    apr_uint32_t n;
+
+    for (n = 0; n < 2 * nc->nslots; n++) {
+        near_entry_t *e = shard->slots[shard->hand];
+        apr_uint32_t i = shard->hand;
+
+        shard->hand = (shard->hand + 1) % nc->nslots;
+        if (e == NULL) {
+            *slot = i;
+            return 0;
+        }
+        if (e->state == NEAR_FETCHING || e->waiters) {
+            continue;
+        }
+        if (e->referenced) {
+            e->referenced = 0;
+            continue;
+        }
+        near_entry_free(shard, e);
+        *slot = i;
+        return 0;
+    }
+
+    return -1;
+}
+
+static void near_cache_copy(near_entry_t *e, apr_pool_t *p, char **baton,
+                            apr_size_t *new_length, apr_uint16_t *flags)
+{
+    *baton = apr_palloc(p, e->len + 1);
+    memcpy(*baton, e->data, e->len);
+    (*baton)[e->len] = '\0';
+    *new_length = e->len;
+    if (flags) {
+        *flags = e->flags;
+    }
+}
+
+static void near_cache_invalidate(apr_redis_t *rc, const char *key)
+{
+    apr_redis_near_cache_t *nc = rc->near_cache;
+    apr_size_t klen;
+    near_shard_t *shard;
+    near_entry_t *e;
+
+    if (nc == NULL) {
+        return;
+    }
+
+    klen = strlen(key);
+    shard = near_cache_shard(nc, key, klen);
+
+    NEAR_LOCK(shard);
+    e = apr_hash_get(shard->entries, key, klen);
+    if (e) {
+        if (e->state == NEAR_FETCHING || e->waiters) {
+            /* the fetching and waiting threads still need it */
+            e->invalidated = 1;
+        }
+        else {
+            near_entry_free(shard, e);
+        }
+    }
+    NEAR_UNLOCK(shard);
+}
+
+static apr_status_t near_cache_getp(apr_redis_t *rc,
+                                    apr_pool_t *p,
+                                    const char *key,
+                                    char **baton,
+                                    apr_size_t *new_length,
+                                    apr_uint16_t *flags)
+{
+    apr_redis_near_cache_t *nc = rc->near_cache;
+    apr_size_t klen = strlen(key);
+    near_shard_t *shard = near_cache_shard(nc, key, klen);
+    near_entry_t *e;
+    apr_uint32_t slot;
+    apr_uint16_t fflags = 0;
+    apr_status_t rv;
+
+    NEAR_LOCK(shard);
+
+    e = apr_hash_get(shard->entries, key, klen);
+    if (e && e->state == NEAR_READY && !e->invalidated
+          && e->status == APR_SUCCESS && apr_time_monotonic() < e->expires) {
+        e->referenced = 1;
+        near_cache_copy(e, p, baton, new_length, flags);
+        NEAR_UNLOCK(shard);
+        return APR_SUCCESS;
+    }
+
+#if APR_HAS_THREADS
+    if (e && e->state == NEAR_FETCHING) {
+        /* coalesce with the fetch in progress, and share its result */
+        e->waiters++;
+        do {
+            apr_thread_cond_wait(shard->fetched, shard->lock);
+        } while (e->state == NEAR_FETCHING);
+        e->waiters--;
+
+        rv = e->status;
+        if (rv == APR_SUCCESS) {
+            near_cache_copy(e, p, baton, new_length, flags);
+        }
+        if (!e->waiters && (rv != APR_SUCCESS || e->invalidated)) {
+            near_entry_free(shard, e);
+        }
+        NEAR_UNLOCK(shard);
+        return rv;
+    }
+#endif
+
+    /* claim the fetch, in a new entry or in the stale one */
+    if (e && e->waiters == 0) {
+        near_entry_free(shard, e);
+        e = NULL;
+    }
+    if (e || near_cache_slot(nc, shard, &slot) < 0) {
+        /* the stale entry is still read, or the cache is all busy */
+        NEAR_UNLOCK(shard);
+        return redis_getp(rc, p, key, baton, new_length, flags);
+    }
+
+    e = calloc(1, sizeof(*e));
+    if (e) {
+        e->key = malloc(klen + 1);
+    }
+    if (!e || !e->key) {
+        free(e);
+        NEAR_UNLOCK(shard);
+        return APR_ENOMEM;
+    }
+    memcpy(e->key, key, klen + 1);
+    e->klen = klen;
+    e->slot = slot;
+    e->state = NEAR_FETCHING;
+    shard->slots[slot] = e;
+    apr_hash_set(shard->entries, e->key, klen, e);
+
+    NEAR_UNLOCK(shard);
+
+    rv = redis_getp(rc, p, key, baton, new_length, &fflags);
+    if (rv == APR_SUCCESS && flags) {
+        *flags = fflags;
+    }
+
+    NEAR_LOCK(shard);
+
+    e->status = rv;
+    if (rv == APR_SUCCESS) {
+        if (*new_length > nc->max_size) {
+            /* too big to be kept, but not for the waiters */
+            e->invalidated = 1;
+        }
+        if (e->waiters || !e->invalidated) {
+            e->data = malloc(*new_length ? *new_length : 1);
+            if (e->data) {
+                memcpy(e->data, *baton, *new_length);
+                e->len = *new_length;
+                e->flags = fflags;
+            }
+            else {
+                e->status = APR_ENOMEM;
+            }
+        }
+    }
+    e->expires = apr_time_monotonic() + nc->ttl;
+    e->state = NEAR_READY;
+
+    if (e->waiters) {
+#if APR_HAS_THREADS
+        apr_thread_cond_broadcast(shard->fetched);
+#endif
+    }
+    else if (e->status != APR_SUCCESS || e->invalidated) {
+        near_entry_free(shard, e);
+    }
+
+    NEAR_UNLOCK(shard);
+    return rv;
+}
+
+APR_DECLARE(apr_status_t) apr_redis_getp(apr_redis_t *rc,
+                                         apr_pool_t *p,
+                                         const char *key,
+                                         char **baton,
+                                         apr_size_t *new_length,
+                                         apr_uint16_t *flags)
+{
+    if (rc->near_cache) {
+        return near_cache_getp(rc, p, key, baton, new_length, flags);
+    }
+    return redis_getp(rc, p, key, baton, new_length, flags);
+}
+
+
 APR_DECLARE(apr_status_t)
     apr_redis_delete(apr_redis_t *rc, const char *key, apr_uint32_t timeout)
 {
@@ -1014,6 +1899,7 @@ APR_DECLARE(apr_status_t)
     char keysize_str[LILBUFF_SIZE];
 
     klen = strlen(key);
+    near_cache_invalidate(rc, key);
     hash = apr_redis_hash(rc, key, klen);
     rs = apr_redis_find_server_hash(rc, hash);
     if (rs == NULL)
@@ -1249,6 +2135,7 @@ static apr_status_t plus_minus(apr_redis_t *rc,
     int i = 0;
 
     klen = strlen(key);
+    near_cache_invalidate(rc, key);
     hash = apr_redis_hash(rc, key, klen);
     rs = apr_redis_find_server_hash(rc, hash);
     if (rs == NULL)
@@ -1373,15 +2260,6 @@ apr_redis_decr(apr_redis_t *rc, const char *key, apr_int32_t inc, apr_uint32_t *
     return plus_minus(rc, 0, key, inc, new_value);
 }
 
-APR_DECLARE(apr_status_t)
-apr_redis_multgetp(apr_redis_t *rc,
-                   apr_pool_t *temp_pool,
-                   apr_pool_t *data_pool,
-                   apr_hash_t *values)
-{
-    return APR_ENOTIMPL;
-}
-
 /**
  * Define all of the strings for stats
  */
@@ -1546,3 +2424,1212 @@ apr_redis_stats(apr_redis_server_t *rs,
 
     return APR_SUCCESS;
 }
+
+/* Pipelines */
+
+#define PIPELINE_BUFFER_SIZE 8192
+
+#define PIPELINE_CMD_OTHER 0
+#define PIPELINE_CMD_GET   1
+#define PIPELINE_CMD_SET   2
+#define PIPELINE_CMD_DEL   3
+#define PIPELINE_CMD_MGET  4
+
+typedef struct pipeline_cmd_t
+{
+    int kind;
+    const char *key;
+    apr_redis_reply_cb_t *cb;
+    void *baton;
+} pipeline_cmd_t;
+
+/* The commands of a pipeline for a server, and their connection */
+typedef struct pipeline_conn_t
+{
+    apr_redis_server_t *rs;
+    apr_redis_conn_t *conn;     /* NULL while no command is queued */
+    apr_array_header_t *vec;    /* the iovecs not sent yet */
+    apr_array_header_t *cmds;   /* the commands not completed yet */
+    int nsent;                  /* the commands sent, in cmds */
+    int nreplied;               /* the commands completed, in cmds */
+    char *buf;                  /* the replies received */
+    apr_size_t bsize, bstart, bend;
+    apr_pollset_t *pollset;     /* where conn is polled, or NULL */
+    apr_pollfd_t pfd;
+} pipeline_conn_t;
+
+struct apr_redis_pipeline_t
+{
+    apr_redis_t *rc;
+    apr_pool_t *p;
+    apr_array_header_t *conns;  /* the pipeline_conn_t * of the servers */
+};
+
+APR_DECLARE(apr_status_t) apr_redis_pipeline_create(apr_redis_pipeline_t **pl,
+                                                    apr_redis_t *rc,
+                                                    apr_pool_t *p)
+{
+    apr_redis_pipeline_t *pipeline = apr_pcalloc(p, sizeof(*pipeline));
+
+    pipeline->rc = rc;
+    pipeline->p = p;
+    pipeline->conns = apr_array_make(p, rc->ntotal ? rc->ntotal : 1,
+                                     sizeof(pipeline_conn_t *));
+    *pl = pipeline;
+    return APR_SUCCESS;
+}
+
+static apr_status_t pipeline_conn_get(apr_redis_pipeline_t *pl,
+                                      const char *key,
+                                      pipeline_conn_t **ppc)
+{
+    apr_redis_server_t *rs;
+    pipeline_conn_t *pc = NULL;
+    apr_status_t rv;
+    int i;
+
+    rs = apr_redis_find_server_hash(pl->rc,
+                                    apr_redis_hash(pl->rc, key, strlen(key)));
+    if (rs == NULL)
+        return APR_NOTFOUND;
+
+    for (i = 0; i < pl->conns->nelts; i++) {
+        if (APR_ARRAY_IDX(pl->conns, i, pipeline_conn_t *)->rs == rs) {
+            pc = APR_ARRAY_IDX(pl->conns, i, pipeline_conn_t *);
+            break;
+        }
+    }
+    if (pc == NULL) {
+        /* Allocated apart, the callbacks may queue (thus push) */
+        pc = apr_pcalloc(pl->p, sizeof(*pc));
+        APR_ARRAY_PUSH(pl->conns, pipeline_conn_t *) = pc;
+        pc->rs = rs;
+        pc->vec = apr_array_make(pl->p, 16, sizeof(struct iovec));
+        pc->cmds = apr_array_make(pl->p, 4, sizeof(pipeline_cmd_t));
+    }
+
+    if (pc->conn == NULL) {
+        rv = rs_find_conn(rs, &pc->conn);
+        if (rv != APR_SUCCESS) {
+            pc->conn = NULL;
+            apr_redis_disable_server(pl->rc, rs);
+            return rv;
+        }
+    }
+
+    *ppc = pc;
+    return APR_SUCCESS;
+}
+
+static void pipeline_vec_push(pipeline_conn_t *pc, const void *base,
+                              apr_size_t len)
+{
+    struct iovec *v = apr_array_push(pc->vec);
+
+    v->iov_base = (void *) base;
+    v->iov_len = len;
+}
+
+static apr_status_t pipeline_queue(apr_redis_pipeline_t *pl, int kind,
+                                   const char *key, int argc,
+                                   const char **argv,
+                                   const apr_size_t *argvlen,
+                                   apr_redis_reply_cb_t *cb, void *baton)
+{
+    pipeline_conn_t *pc;
+    pipeline_cmd_t *cmd;
+    char *size_str;
+    apr_status_t rv;
+    int i;
+
+    rv = pipeline_conn_get(pl, key, &pc);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    /*
+     * RESP Command:
+     *   *<argc>
+     *   $<arglen>
+     *   arg
+     *   ...
+     */
+    size_str = apr_psprintf(pl->p, "*%d\r\n", argc);
+    pipeline_vec_push(pc, size_str, strlen(size_str));
+    for (i = 0; i < argc; i++) {
+        apr_size_t len = argvlen ? argvlen[i] : strlen(argv[i]);
+
+        size_str = apr_psprintf(pl->p, "$%" APR_SIZE_T_FMT "\r\n", len);
+        pipeline_vec_push(pc, size_str, strlen(size_str));
+        pipeline_vec_push(pc, argv[i], len);
+        pipeline_vec_push(pc, RC_EOL, RC_EOL_LEN);
+    }
+
+    cmd = apr_array_push(pc->cmds);
+    cmd->kind = kind;
+    cmd->key = key;
+    cmd->cb = cb;
+    cmd->baton = baton;
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_redis_pipeline_command(apr_redis_pipeline_t *pl,
+                                                     const char *key,
+                                                     int argc,
+                                                     const char **argv,
+                                                     const apr_size_t *argvlen,
+                                                     apr_redis_reply_cb_t *cb,
+                                                     void *baton)
+{
+    return pipeline_queue(pl, PIPELINE_CMD_OTHER, key, argc, argv, argvlen,
+                          cb, baton);
+}
+
+APR_DECLARE(apr_status_t) apr_redis_pipeline_get(apr_redis_pipeline_t *pl,
+                                                 const char *key,
+                                                 apr_redis_reply_cb_t *cb,
+                                                 void *baton)
+{
+    const char *argv[2];
+
+    argv[0] = "GET";
+    argv[1] = key;
+    return pipeline_queue(pl, PIPELINE_CMD_GET, key, 2, argv, NULL,
+                          cb, baton);
+}
+
+APR_DECLARE(apr_status_t) apr_redis_pipeline_set(apr_redis_pipeline_t *pl,
+                                                 const char *key,
+                                                 const char *data,
+                                                 apr_size_t data_size,
+                                                 apr_uint32_t timeout,
+                                                 apr_redis_reply_cb_t *cb,
+                                                 void *baton)
+{
+    const char *argv[4];
+    apr_size_t argvlen[4];
+
+    near_cache_invalidate(pl->rc, key);
+
+    if (timeout) {
+        argv[0] = "SETEX";
+        argv[1] = key;
+        argv[2] = apr_psprintf(pl->p, "%u", timeout);
+        argv[3] = data;
+        argvlen[0] = RC_SETEX_LEN - RC_EOL_LEN;
+        argvlen[1] = strlen(key);
+        argvlen[2] = strlen(argv[2]);
+        argvlen[3] = data_size;
+        return pipeline_queue(pl, PIPELINE_CMD_SET, key, 4, argv, argvlen,
+                              cb, baton);
+    }
+
+    argv[0] = "SET";
+    argv[1] = key;
+    argv[2] = data;
+    argvlen[0] = RC_SET_LEN - RC_EOL_LEN;
+    argvlen[1] = strlen(key);
+    argvlen[2] = data_size;
+    return pipeline_queue(pl, PIPELINE_CMD_SET, key, 3, argv, argvlen,
+                          cb, baton);
+}
+
+APR_DECLARE(apr_status_t) apr_redis_pipeline_delete(apr_redis_pipeline_t *pl,
+                                                    const char *key,
+                                                    apr_redis_reply_cb_t *cb,
+                                                    void *baton)
+{
+    const char *argv[2];
+
+    near_cache_invalidate(pl->rc, key);
+
+    argv[0] = "DEL";
+    argv[1] = key;
+    return pipeline_queue(pl, PIPELINE_CMD_DEL, key, 2, argv, NULL,
+                          cb, baton);
+}
+
+/* Parse the reply at the start of buf, returning APR_INCOMPLETE if it
+ * was not fully received.  The strings of a complete reply are null
+ * terminated in place when terminate is set, the elements of an array
+ * are skipped.
+ */
+static apr_status_t pipeline_parse(char *buf, apr_size_t len,
+                                   apr_size_t *used,
+                                   apr_redis_reply_t *reply, int terminate)
+{
+    char *eol;
+    apr_size_t llen;
+
+    eol = memchr(buf, '\n', len);
+    if (eol == NULL) {
+        return APR_INCOMPLETE;
+    }
+    if (eol == buf || eol[-1] != '\r') {
+        return APR_EGENERAL;
+    }
+    llen = eol + 1 - buf;
+
+    reply->type = buf[0];
+    reply->data = NULL;
+    reply->len = 0;
+    reply->integer = 0;
+
+    switch (buf[0]) {
+    case '+':
+    case '-':
+        reply->data = buf + 1;
+        reply->len = llen - 1 - RC_EOL_LEN;
+        if (terminate) {
+            eol[-1] = '\0';
+        }
+        *used = llen;
+        return APR_SUCCESS;
+
+    case ':':
+        reply->integer = apr_atoi64(buf + 1);
+        *used = llen;
+        return APR_SUCCESS;
+
+    case '$': {
+        apr_int64_t n = apr_atoi64(buf + 1);
+
+        if (n < 0) {
+            *used = llen;
+            return APR_SUCCESS;
+        }
+        if (len - llen < (apr_uint64_t)n + RC_EOL_LEN) {
+            return APR_INCOMPLETE;
+        }
+        reply->data = buf + llen;
+        reply->len = (apr_size_t)n;
+        if (terminate) {
+            buf[llen + n] = '\0';
+        }
+        *used = llen + (apr_size_t)n + RC_EOL_LEN;
+        return APR_SUCCESS;
+    }
+
+    case '*': {
+        apr_int64_t i, n = apr_atoi64(buf + 1);
+        apr_redis_reply_t elt;
+        apr_size_t eused;
+        apr_status_t rv;
+
+        reply->integer = n;
+        for (i = 0; i < n; i++) {
+            rv = pipeline_parse(buf + llen, len - llen, &eused, &elt, 0);
+            if (rv != APR_SUCCESS) {
+                return rv;
+            }
+            llen += eused;
+        }
+        *used = llen;
+        return APR_SUCCESS;
+    }
+
+    default:
+        return APR_EGENERAL;
+    }
+}
+
+static apr_status_t pipeline_status(int kind, const apr_redis_reply_t *reply)
+{
+    if (reply->type == '-') {
+        return APR_EGENERAL;
+    }
+
+    switch (kind) {
+    case PIPELINE_CMD_GET:
+        if (reply->type == '$') {
+            return reply->data ? APR_SUCCESS : APR_NOTFOUND;
+        }
+        return APR_EGENERAL;
+    case PIPELINE_CMD_SET:
+        if (reply->type == '+') {
+            return APR_SUCCESS;
+        }
+        return reply->type == '$' && !reply->data ? APR_EEXIST : APR_EGENERAL;
+    case PIPELINE_CMD_DEL:
+        if (reply->type == ':') {
+            return reply->integer > 0 ? APR_SUCCESS : APR_NOTFOUND;
+        }
+        return APR_EGENERAL;
+    default:
+        return APR_SUCCESS;
+    }
+}
+
+/* The keys of an apr_redis_multgetp() for a server, and their values */
+typedef struct mget_server_t
+{
+    apr_redis_server_t *rs;
+    apr_array_header_t *keys;   /* the const char * sent */
+    apr_array_header_t *values; /* their apr_redis_value_t * */
+    apr_pool_t *p;              /* the pool of the values' data */
+    apr_status_t status;
+} mget_server_t;
+
+/* Fill in the values from the elements of a complete MGET reply (raw) */
+static void mget_reply(mget_server_t *ms, const apr_redis_reply_t *reply,
+                       char *raw, apr_size_t rawlen)
+{
+    apr_redis_value_t *value;
+    apr_redis_reply_t elt;
+    apr_size_t pos, used;
+    apr_status_t rv;
+    int i;
+
+    if (reply->type == '-') {
+        for (i = 0; i < ms->values->nelts; i++) {
+            value = APR_ARRAY_IDX(ms->values, i, apr_redis_value_t *);
+            value->type = '-';
+            value->data = apr_pstrmemdup(ms->p, reply->data, reply->len);
+            value->len = reply->len;
+        }
+        ms->status = APR_EGENERAL;
+        return;
+    }
+    if (reply->type != '*' || reply->integer != ms->values->nelts) {
+        ms->status = APR_EGENERAL;
+        return;
+    }
+
+    pos = (char *)memchr(raw, '\n', rawlen) + 1 - raw;
+    for (i = 0; i < ms->values->nelts; i++) {
+        rv = pipeline_parse(raw + pos, rawlen - pos, &used, &elt, 1);
+        if (rv != APR_SUCCESS) {
+            ms->status = rv;
+            return;
+        }
+        pos += used;
+
+        value = APR_ARRAY_IDX(ms->values, i, apr_redis_value_t *);
+        value->type = elt.type;
+        value->data = elt.data ? apr_pstrmemdup(ms->p, elt.data, elt.len)
+                               : NULL;
+        value->len = elt.len;
+        value->integer = elt.integer;
+    }
+}
+
+/* Complete the reply (raw, of rawlen bytes) to the next command */
+static void pipeline_reply(pipeline_conn_t *pc, apr_redis_reply_t *reply,
+                           char *raw, apr_size_t rawlen)
+{
+    pipeline_cmd_t *cmd = &APR_ARRAY_IDX(pc->cmds, pc->nreplied,
+                                         pipeline_cmd_t);
+    apr_redis_reply_cb_t *cb = cmd->cb;
+    void *baton = cmd->baton;
+
+    reply->key = cmd->key;
+    reply->status = pipeline_status(cmd->kind, reply);
+    pc->nreplied++;
+
+    /* The callback may queue more commands (thus move cmds) */
+    if (cmd->kind == PIPELINE_CMD_MGET) {
+        mget_reply(baton, reply, raw, rawlen);
+    }
+    else if (cb) {
+        cb(baton, reply);
+    }
+}
+
+/* Back to the state of a new pipeline_conn_t, but for its arrays */
+static void pipeline_conn_reset(pipeline_conn_t *pc)
+{
+    if (pc->pollset) {
+        apr_pollset_remove(pc->pollset, &pc->pfd);
+        pc->pollset = NULL;
+    }
+    pc->conn = NULL;
+    pc->vec->nelts = 0;
+    pc->cmds->nelts = 0;
+    pc->nsent = pc->nreplied = 0;
+    pc->bstart = pc->bend = 0;
+}
+
+/* Complete with rv the commands not replied to on a failed connection */
+static void pipeline_conn_fail(apr_redis_pipeline_t *pl,
+                               pipeline_conn_t *pc, apr_status_t rv)
+{
+    apr_array_header_t *cmds = pc->cmds;
+    apr_redis_reply_t reply;
+    int i;
+
+    rs_bad_conn(pc->rs, pc->conn);
+    apr_redis_disable_server(pl->rc, pc->rs);
+
+    /* Detach the commands first, for the callbacks to queue new ones */
+    i = pc->nreplied;
+    pc->cmds = apr_array_make(pl->p, 4, sizeof(pipeline_cmd_t));
+    pipeline_conn_reset(pc);
+
+    for (; i < cmds->nelts; i++) {
+        pipeline_cmd_t *cmd = &APR_ARRAY_IDX(cmds, i, pipeline_cmd_t);
+
+        memset(&reply, 0, sizeof(reply));
+        reply.status = rv;
+        reply.key = cmd->key;
+        if (cmd->cb) {
+            cmd->cb(cmd->baton, &reply);
+        }
+    }
+}
+
+/* Release the connection once all its commands are completed */
+static void pipeline_conn_done(pipeline_conn_t *pc)
+{
+    if (pc->nreplied == pc->cmds->nelts) {
+        rs_release_conn(pc->rs, pc->conn);
+        pipeline_conn_reset(pc);
+    }
+    else if (pc->nreplied == pc->nsent && pc->pollset) {
+        apr_pollset_remove(pc->pollset, &pc->pfd);
+        pc->pollset = NULL;
+    }
+}
+
+/* Write all the iovecs, which are consumed */
+static apr_status_t rc_sendv_all(apr_socket_t *sock, struct iovec *vec,
+                                 int n)
+{
+    apr_status_t rv;
+
+    while (n > 0) {
+        apr_size_t written = 0;
+
+        rv = apr_socket_sendv(sock, vec,
+                              n > APR_MAX_IOVEC_SIZE ? APR_MAX_IOVEC_SIZE : n,
+                              &written);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+
+        /* Skip what was written, then resume within a partial iovec */
+        while (n > 0 && written >= vec->iov_len) {
+            written -= vec->iov_len;
+            vec++;
+            n--;
+        }
+        if (n > 0) {
+            vec->iov_base = (char *) vec->iov_base + written;
+            vec->iov_len -= written;
+        }
+    }
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t pipeline_conn_send(pipeline_conn_t *pc)
+{
+    apr_status_t rv;
+
+    rv = rc_sendv_all(pc->conn->sock, (struct iovec *) pc->vec->elts,
+                      pc->vec->nelts);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    pc->vec->nelts = 0;
+    pc->nsent = pc->cmds->nelts;
+    if (!pc->conn->sent) {
+        pc->conn->sent = apr_time_monotonic();
+    }
+    return APR_SUCCESS;
+}
+
+/* Receive and complete the replies to the commands sent, until the
+ * socket (timeout) says otherwise.
+ */
+static apr_status_t pipeline_conn_recv(apr_redis_pipeline_t *pl,
+                                       pipeline_conn_t *pc)
+{
+    apr_redis_reply_t reply;
+    apr_size_t len;
+    apr_status_t rv;
+
+    if (pc->buf == NULL) {
+        pc->bsize = PIPELINE_BUFFER_SIZE;
+        pc->buf = apr_palloc(pl->p, pc->bsize);
+    }
+
+    for (;;) {
+        while (pc->nreplied < pc->nsent) {
+            rv = pipeline_parse(pc->buf + pc->bstart, pc->bend - pc->bstart,
+                                &len, &reply, 1);
+            if (rv == APR_INCOMPLETE) {
+                break;
+            }
+            if (rv != APR_SUCCESS) {
+                return rv;
+            }
+            pipeline_reply(pc, &reply, pc->buf + pc->bstart, len);
+            pc->bstart += len;
+        }
+        if (pc->nreplied == pc->nsent) {
+            return APR_SUCCESS;
+        }
+
+        if (pc->bstart) {
+            memmove(pc->buf, pc->buf + pc->bstart, pc->bend - pc->bstart);
+            pc->bend -= pc->bstart;
+            pc->bstart = 0;
+        }
+        if (pc->bend == pc->bsize) {
+            char *buf = apr_palloc(pl->p, pc->bsize * 2);
+
+            memcpy(buf, pc->buf, pc->bend);
+            pc->buf = buf;
+            pc->bsize *= 2;
+        }
+
+        len = pc->bsize - pc->bend;
+        rv = apr_socket_recv(pc->conn->sock, pc->buf + pc->bend, &len);
+        pc->bend += len;
+        if (len && !pc->conn->fbtime) {
+            pc->conn->fbtime = apr_time_monotonic();
+        }
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+    }
+}
+
+APR_DECLARE(apr_status_t) apr_redis_pipeline_send(apr_redis_pipeline_t *pl,
+                                                  apr_pollset_t *pollset)
+{
+    apr_status_t rv, status = APR_SUCCESS;
+    int i;
+
+    for (i = 0; i < pl->conns->nelts; i++) {
+        pipeline_conn_t *pc = APR_ARRAY_IDX(pl->conns, i, pipeline_conn_t *);
+
+        if (pc->conn == NULL || pc->vec->nelts == 0) {
+            continue;
+        }
+
+        rv = pipeline_conn_send(pc);
+        if (rv != APR_SUCCESS) {
+            pipeline_conn_fail(pl, pc, rv);
+            if (status == APR_SUCCESS) {
+                status = rv;
+            }
+            continue;
+        }
+
+        if (pollset && !pc->pollset) {
+            pc->pfd.p = pl->p;
+            pc->pfd.desc_type = APR_POLL_SOCKET;
+            pc->pfd.reqevents = APR_POLLIN;
+            pc->pfd.rtnevents = 0;
+            pc->pfd.desc.s = pc->conn->sock;
+            pc->pfd.client_data = pl;
+            rv = apr_pollset_add(pollset, &pc->pfd);
+            if (rv != APR_SUCCESS) {
+                if (status == APR_SUCCESS) {
+                    status = rv;
+                }
+                continue;
+            }
+            pc->pollset = pollset;
+        }
+    }
+
+    return status;
+}
+
+APR_DECLARE(apr_status_t) apr_redis_pipeline_exec(apr_redis_pipeline_t *pl)
+{
+    apr_status_t rv, status;
+    int i;
+
+    status = apr_redis_pipeline_send(pl, NULL);
+
+    for (i = 0; i < pl->conns->nelts; i++) {
+        pipeline_conn_t *pc = APR_ARRAY_IDX(pl->conns, i, pipeline_conn_t *);
+
+        /* Replies' callbacks may queue more commands */
+        while (pc->conn != NULL) {
+            if (pc->vec->nelts) {
+                rv = pipeline_conn_send(pc);
+            }
+            else {
+                rv = pipeline_conn_recv(pl, pc);
+            }
+            if (rv != APR_SUCCESS) {
+                pipeline_conn_fail(pl, pc, rv);
+                if (status == APR_SUCCESS) {
+                    status = rv;
+                }
+                break;
+            }
+            pipeline_conn_done(pc);
+        }
+    }
+
+    return status;
+}
+
+APR_DECLARE(apr_status_t) apr_redis_pipeline_process(apr_redis_pipeline_t *pl,
+                                                     const apr_pollfd_t *pfd)
+{
+    pipeline_conn_t *pc = NULL;
+    apr_status_t rv;
+    int i;
+
+    for (i = 0; i < pl->conns->nelts; i++) {
+        pc = APR_ARRAY_IDX(pl->conns, i, pipeline_conn_t *);
+        if (pc->conn != NULL && pc->conn->sock == pfd->desc.s) {
+            break;
+        }
+        pc = NULL;
+    }
+    if (pc == NULL) {
+        return APR_EINVAL;
+    }
+
+    apr_socket_timeout_set(pc->conn->sock, 0);
+    rv = pipeline_conn_recv(pl, pc);
+    if (pc->conn != NULL) {
+        apr_socket_timeout_set(pc->conn->sock,
+                               pc->rs->rwto * APR_USEC_PER_SEC);
+    }
+
+    if (APR_STATUS_IS_EAGAIN(rv)) {
+        return APR_EAGAIN;
+    }
+    if (rv != APR_SUCCESS) {
+        pipeline_conn_fail(pl, pc, rv);
+        return rv;
+    }
+
+    pipeline_conn_done(pc);
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_size_t) apr_redis_pipeline_pending(apr_redis_pipeline_t *pl)
+{
+    apr_size_t n = 0;
+    int i;
+
+    for (i = 0; i < pl->conns->nelts; i++) {
+        pipeline_conn_t *pc = APR_ARRAY_IDX(pl->conns, i, pipeline_conn_t *);
+
+        n += pc->cmds->nelts - pc->nreplied;
+    }
+    return n;
+}
+
+APR_DECLARE(void)
+apr_redis_add_multget_key(apr_pool_t *data_pool,
+                          const char *key,
+                          apr_hash_t **values)
+{
+    apr_redis_value_t *value;
+
+    /* create the value hash if need be */
+    if (!*values) {
+        *values = apr_hash_make(data_pool);
+    }
+
+    /* no reply yet */
+    value = apr_pcalloc(data_pool, sizeof(apr_redis_value_t));
+
+    key = apr_pstrdup(data_pool, key);
+    apr_hash_set(*values, key, strlen(key), value);
+}
+
+/* A failed MGET (no reply) */
+static void mget_failed(void *baton, const apr_redis_reply_t *reply)
+{
+    mget_server_t *ms = baton;
+
+    ms->status = reply->status;
+}
+
+APR_DECLARE(apr_status_t)
+apr_redis_multgetp(apr_redis_t *rc,
+                   apr_pool_t *temp_pool,
+                   apr_pool_t *data_pool,
+                   apr_hash_t *values)
+{
+    apr_redis_pipeline_t *pl;
+    apr_array_header_t *servers;
+    apr_hash_index_t *hi;
+    apr_status_t rv, status = APR_SUCCESS;
+    mget_server_t *ms;
+    const char **argv;
+    int i, j;
+
+    /* Group the keys by server */
+    servers = apr_array_make(temp_pool, rc->ntotal ? rc->ntotal : 1,
+                             sizeof(mget_server_t *));
+    for (hi = apr_hash_first(temp_pool, values); hi; hi = apr_hash_next(hi)) {
+        const void *k;
+        apr_ssize_t klen;
+        void *v;
+        apr_redis_server_t *rs;
+
+        apr_hash_this(hi, &k, &klen, &v);
+        rs = apr_redis_find_server_hash(rc, apr_redis_hash(rc, k, klen));
+        if (rs == NULL) {
+            status = APR_NOTFOUND;
+            continue;
+        }
+
+        ms = NULL;
+        for (i = 0; i < servers->nelts; i++) {
+            if (APR_ARRAY_IDX(servers, i, mget_server_t *)->rs == rs) {
+                ms = APR_ARRAY_IDX(servers, i, mget_server_t *);
+                break;
+            }
+        }
+        if (ms == NULL) {
+            ms = apr_pcalloc(temp_pool, sizeof(*ms));
+            ms->rs = rs;
+            ms->keys = apr_array_make(temp_pool, 16, sizeof(const char *));
+            ms->values = apr_array_make(temp_pool, 16,
+                                        sizeof(apr_redis_value_t *));
+            ms->p = data_pool;
+            APR_ARRAY_PUSH(servers, mget_server_t *) = ms;
+        }
+        APR_ARRAY_PUSH(ms->keys, const char *) = k;
+        APR_ARRAY_PUSH(ms->values, apr_redis_value_t *) = v;
+    }
+
+    /* One MGET per server, all sent before any reply is read */
+    apr_redis_pipeline_create(&pl, rc, temp_pool);
+    for (i = 0; i < servers->nelts; i++) {
+        ms = APR_ARRAY_IDX(servers, i, mget_server_t *);
+
+        argv = apr_palloc(temp_pool, (ms->keys->nelts + 1) * sizeof(char *));
+        argv[0] = "MGET";
+        for (j = 0; j < ms->keys->nelts; j++) {
+            argv[j + 1] = APR_ARRAY_IDX(ms->keys, j, const char *);
+        }
+        rv = pipeline_queue(pl, PIPELINE_CMD_MGET, argv[1],
+                            ms->keys->nelts + 1, argv, NULL,
+                            mget_failed, ms);
+        if (rv != APR_SUCCESS) {
+            ms->status = rv;
+        }
+    }
+    apr_redis_pipeline_exec(pl);
+
+    for (i = 0; i < servers->nelts; i++) {
+        ms = APR_ARRAY_IDX(servers, i, mget_server_t *);
+        if (ms->status != APR_SUCCESS && status == APR_SUCCESS) {
+            status = ms->status;
+        }
+    }
+    return status;
+}
+
+/*
+ * RESP2/RESP3 values read from a brigade
+ */
+
+/* The longest line of a value, and the deepest nesting of aggregates */
+#define VALUE_LINE_MAX  (64 * 1024)
+#define VALUE_DEPTH_MAX 32
+
+typedef struct value_reader_t
+{
+    apr_bucket_brigade *bb;     /* what is read */
+    apr_bucket_brigade *tb;     /* a line, or a string to flatten */
+    apr_pool_t *p;
+    apr_size_t flatten_max;
+    int depth;
+} value_reader_t;
+
+/* Move the buckets of r->bb before e to the brigade to */
+static void value_move(value_reader_t *r, apr_bucket *e,
+                       apr_bucket_brigade *to)
+{
+    apr_bucket *b;
+
+    while ((b = APR_BRIGADE_FIRST(r->bb)) != e) {
+        APR_BUCKET_REMOVE(b);
+        APR_BRIGADE_INSERT_TAIL(to, b);
+    }
+}
+
+/* Read a line, returned null terminated without its CRLF */
+static apr_status_t value_line(value_reader_t *r, char **line,
+                               apr_size_t *len)
+{
+    apr_status_t rv;
+
+    rv = apr_brigade_split_line(r->tb, r->bb, APR_BLOCK_READ,
+                                VALUE_LINE_MAX);
+    if (rv == APR_SUCCESS) {
+        rv = apr_brigade_pflatten(r->tb, line, len, r->p);
+    }
+    apr_brigade_cleanup(r->tb);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    if (*len == 0 || (*line)[*len - 1] != '\n') {
+        /* too long, or ended early */
+        return *len >= VALUE_LINE_MAX ? APR_EGENERAL : APR_INCOMPLETE;
+    }
+    if (*len < RC_EOL_LEN || (*line)[*len - RC_EOL_LEN] != '\r') {
+        return APR_EGENERAL;
+    }
+    *len -= RC_EOL_LEN;
+    (*line)[*len] = '\0';
+    return APR_SUCCESS;
+}
+
+/* Read the n bytes of a string then its CRLF */
+static apr_status_t value_string(value_reader_t *r, apr_off_t n,
+                                 apr_redis_value_t *v)
+{
+    char eol[RC_EOL_LEN];
+    apr_size_t len;
+    apr_bucket *e;
+    apr_status_t rv;
+
+    rv = apr_brigade_partition(r->bb, n, &e);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    v->len = (apr_size_t)n;
+    if (v->len <= r->flatten_max) {
+        char *data = apr_palloc(r->p, v->len + 1);
+
+        value_move(r, e, r->tb);
+        len = v->len;
+        rv = apr_brigade_flatten(r->tb, data, &len);
+        apr_brigade_cleanup(r->tb);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        data[v->len] = '\0';
+        v->data = data;
+    }
+    else {
+        /* zero copy: the buckets are handed over */
+        v->bb = apr_brigade_create(r->p, r->bb->bucket_alloc);
+        value_move(r, e, v->bb);
+    }
+
+    rv = apr_brigade_partition(r->bb, RC_EOL_LEN, &e);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    value_move(r, e, r->tb);
+    len = RC_EOL_LEN;
+    rv = apr_brigade_flatten(r->tb, eol, &len);
+    apr_brigade_cleanup(r->tb);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    if (len != RC_EOL_LEN || memcmp(eol, RC_EOL, RC_EOL_LEN) != 0) {
+        return APR_EGENERAL;
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t value_read_elts(value_reader_t *r, const char *line,
+                                    apr_redis_value_t *v);
+
+static apr_status_t value_read(value_reader_t *r, apr_redis_value_t *v)
+{
+    apr_redis_value_t *attributes = NULL;
+    apr_int64_t n;
+    apr_size_t len;
+    char *line, *end;
+    apr_status_t rv;
+
+    for (;;) {
+        memset(v, 0, sizeof(*v));
+
+        rv = value_line(r, &line, &len);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        if (len == 0) {
+            return APR_EGENERAL;
+        }
+        v->type = line[0];
+
+        if (v->type != '|') {
+            break;
+        }
+
+        /* the attributes come before the value they are about */
+        if (attributes != NULL) {
+            return APR_EGENERAL;
+        }
+        attributes = apr_palloc(r->p, sizeof(*attributes));
+        v->type = '%';
+        r->depth++;
+        rv = value_read_elts(r, line, v);
+        r->depth--;
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        *attributes = *v;
+        attributes->type = '|';
+    }
+    v->attributes = attributes;
+
+    switch (v->type) {
+    case '+':
+    case '-':
+    case ',':
+    case '(':
+        v->data = line + 1;
+        v->len = len - 1;
+        return APR_SUCCESS;
+
+    case ':':
+        v->integer = apr_strtoi64(line + 1, &end, 10);
+        return (end == line + 1 || *end) ? APR_EGENERAL : APR_SUCCESS;
+
+    case '#':
+        if (len != 2 || (line[1] != 't' && line[1] != 'f')) {
+            return APR_EGENERAL;
+        }
+        v->integer = (line[1] == 't');
+        return APR_SUCCESS;
+
+    case '_':
+        return len == 1 ? APR_SUCCESS : APR_EGENERAL;
+
+    case '$':
+    case '!':
+    case '=':
+        if (line[1] == '?') {
+            return APR_ENOTIMPL;
+        }
+        n = apr_strtoi64(line + 1, &end, 10);
+        if (end == line + 1 || *end) {
+            return APR_EGENERAL;
+        }
+        if (n < 0) {
+            /* nil (RESP2) */
+            return v->type == '$' && n == -1 ? APR_SUCCESS : APR_EGENERAL;
+        }
+        return value_string(r, (apr_off_t)n, v);
+
+    case '*':
+    case '%':
+    case '~':
+    case '>':
+        r->depth++;
+        rv = value_read_elts(r, line, v);
+        r->depth--;
+        return rv;
+
+    default:
+        return APR_EGENERAL;
+    }
+}
+
+/* Read the elements of the aggregate whose line was read */
+static apr_status_t value_read_elts(value_reader_t *r, const char *line,
+                                    apr_redis_value_t *v)
+{
+    apr_int64_t i, n;
+    char *end;
+    apr_status_t rv;
+
+    if (line[1] == '?') {
+        return APR_ENOTIMPL;
+    }
+    n = apr_strtoi64(line + 1, &end, 10);
+    if (end == line + 1 || *end) {
+        return APR_EGENERAL;
+    }
+    if (n < 0) {
+        /* nil (RESP2) */
+        return v->type == '*' && n == -1 ? APR_SUCCESS : APR_EGENERAL;
+    }
+    if (r->depth > VALUE_DEPTH_MAX) {
+        return APR_EGENERAL;
+    }
+    if (v->type == '%') {
+        n *= 2;
+    }
+
+    /* grown as received, whatever the count announced */
+    v->elts = apr_array_make(r->p, n < 16 ? (int)n : 16,
+                             sizeof(apr_redis_value_t));
+    for (i = 0; i < n; i++) {
+        rv = value_read(r, apr_array_push(v->elts));
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+    }
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_redis_value_read(apr_bucket_brigade *bb,
+                                               apr_pool_t *p,
+                                               apr_size_t flatten_max,
+                                               apr_redis_value_t **value)
+{
+    value_reader_t r;
+    apr_status_t rv;
+
+    r.bb = bb;
+    r.tb = apr_brigade_create(p, bb->bucket_alloc);
+    r.p = p;
+    r.flatten_max = flatten_max;
+    r.depth = 0;
+
+    *value = apr_palloc(p, sizeof(apr_redis_value_t));
+    rv = value_read(&r, *value);
+
+    apr_brigade_destroy(r.tb);
+    return rv;
+}
+
+static apr_status_t redis_command(apr_redis_t *rc, const char *key,
+                                  int argc, const char **argv,
+                                  const apr_size_t *argvlen,
+                                  apr_pool_t *p, apr_bucket_alloc_t *ba,
+                                  apr_size_t flatten_max,
+                                  apr_redis_value_t **reply)
+{
+    apr_redis_server_t *rs;
+    apr_redis_conn_t *conn;
+    apr_bucket_brigade *bb;
+    apr_bucket *e;
+    struct iovec *vec;
+    const char *data;
+    apr_size_t len;
+    int i, nvec = 0;
+    apr_status_t rv;
+
+    rs = apr_redis_find_server_hash(rc, apr_redis_hash(rc, key, strlen(key)));
+    if (rs == NULL)
+        return APR_NOTFOUND;
+
+    rv = rs_find_conn(rs, &conn);
+    if (rv != APR_SUCCESS) {
+        apr_redis_disable_server(rc, rs);
+        return rv;
+    }
+
+    /*
+     * RESP Command:
+     *   *<argc>
+     *   $<arglen>
+     *   arg
+     *   ...
+     */
+    vec = apr_palloc(p, (1 + 3 * argc) * sizeof(struct iovec));
+    vec[nvec].iov_base = apr_psprintf(p, "*%d\r\n", argc);
+    vec[nvec].iov_len = strlen(vec[nvec].iov_base);
+    nvec++;
+    for (i = 0; i < argc; i++) {
+        apr_size_t len = argvlen ? argvlen[i] : strlen(argv[i]);
+
+        vec[nvec].iov_base = apr_psprintf(p, "$%" APR_SIZE_T_FMT "\r\n", len);
+        vec[nvec].iov_len = strlen(vec[nvec].iov_base);
+        nvec++;
+        vec[nvec].iov_base = (void *) argv[i];
+        vec[nvec].iov_len = len;
+        nvec++;
+        vec[nvec].iov_base = RC_EOL;
+        vec[nvec].iov_len = RC_EOL_LEN;
+        nvec++;
+    }
+
+    rv = rc_sendv_all(conn->sock, vec, nvec);
+    if (rv != APR_SUCCESS) {
+        rs_bad_conn(rs, conn);
+        apr_redis_disable_server(rc, rs);
+        return rv;
+    }
+    conn->sent = apr_time_monotonic();
+
+    /* The reply is received in the caller's buffers, rather than in the
+     * connection's which are reused by the next request.
+     */
+    bb = apr_brigade_create(p, ba);
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_socket_create(conn->sock, ba));
+
+    rv = apr_bucket_read(APR_BRIGADE_FIRST(bb), &data, &len, APR_BLOCK_READ);
+    if (rv == APR_SUCCESS) {
+        conn->fbtime = apr_time_monotonic();
+        rv = apr_redis_value_read(bb, p, flatten_max, reply);
+    }
+    if (rv != APR_SUCCESS) {
+        apr_brigade_destroy(bb);
+        rs_bad_conn(rs, conn);
+        apr_redis_disable_server(rc, rs);
+        return rv;
+    }
+
+    /* anything received past the reply would be lost */
+    for (e = APR_BRIGADE_FIRST(bb);
+         e != APR_BRIGADE_SENTINEL(bb) && e->length == 0;
+         e = APR_BUCKET_NEXT(e))
+        ;
+    if (e != APR_BRIGADE_SENTINEL(bb) && !APR_BUCKET_IS_SOCKET(e)) {
+        apr_brigade_destroy(bb);
+        rs_bad_conn(rs, conn);
+        return APR_SUCCESS;
+    }
+    apr_brigade_destroy(bb);
+
+    rs_release_conn(rs, conn);
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_redis_command(apr_redis_t *rc,
+                                            const char *key,
+                                            int argc,
+                                            const char **argv,
+                                            const apr_size_t *argvlen,
+                                            apr_pool_t *p,
+                                            apr_bucket_alloc_t *ba,
+                                            apr_size_t flatten_max,
+                                            apr_redis_value_t **reply)
+{
+    /* the command may well modify the key */
+    near_cache_invalidate(rc, key);
+
+    return redis_command(rc, key, argc, argv, argvlen, p, ba, flatten_max,
+                         reply);
+}
+
+APR_DECLARE(apr_status_t) apr_redis_getb(apr_redis_t *rc,
+                                         const char *key,
+                                         apr_bucket_brigade *bb,
+                                         apr_size_t *len)
+{
+    apr_redis_value_t *reply;
+    const char *argv[2];
+    apr_status_t rv;
+
+    argv[0] = "GET";
+    argv[1] = key;
+    rv = redis_command(rc, key, 2, argv, NULL, bb->p, bb->bucket_alloc, 0,
+                       &reply);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    if (reply->type != '$') {
+        return APR_EGENERAL;
+    }
+    if (reply->data == NULL && reply->bb == NULL) {
+        return APR_NOTFOUND;
+    }
+
+    if (reply->bb) {
+        APR_BRIGADE_CONCAT(bb, reply->bb);
+    }
+    if (len) {
+        *len = reply->len;
+    }
+    return APR_SUCCESS;
+}
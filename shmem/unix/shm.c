@@ -23,6 +23,105 @@
 #include "apr_strings.h"
 #include "apr_hash.h"
 
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+#if HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+#if HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef SYS_mbind
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
+#endif
+
+/* Where the kernel can't populate the mappings itself */
+#ifdef MAP_POPULATE
+#define SHM_MAP_POPULATE(flags) \
+    (((flags) & (APR_SHM_POPULATE | APR_SHM_NUMA_INTERLEAVE)) \
+     == APR_SHM_POPULATE ? MAP_POPULATE : 0)
+#else
+#define SHM_MAP_POPULATE(flags) 0
+#endif
+
+#if defined(MAP_HUGETLB) || defined(SHM_HUGETLB)
+/* The size of the reserved huge pages, 2MB unless told otherwise */
+static apr_size_t shm_huge_page_size(void)
+{
+    apr_size_t size = 2 * 1024 * 1024;
+    char buf[4096], *line;
+    ssize_t n;
+    int fd;
+
+    if ((fd = open("/proc/meminfo", O_RDONLY)) == -1) {
+        return size;
+    }
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n > 0) {
+        buf[n] = '\0';
+        if ((line = strstr(buf, "Hugepagesize:")) != NULL) {
+            apr_size_t kb = (apr_size_t)apr_atoi64(line + 13);
+
+            if (kb) {
+                size = kb * 1024;
+            }
+        }
+    }
+    return size;
+}
+#endif
+
+/*
+ * Apply the APR_SHM_* tuning flags to a new mapping, but those already
+ * done by the mapping itself: bind the memory to the NUMA policy before
+ * any page gets faulted in, then fault them all in.  The hints are only
+ * hints, failures are ignored.
+ */
+#define SHM_TUNED_HUGE     1
+#define SHM_TUNED_POPULATE 2
+
+static void shm_tune(void *base, apr_size_t size, apr_int32_t flags,
+                     int tuned)
+{
+#if HAVE_MADVISE && defined(MADV_HUGEPAGE)
+    if ((flags & APR_SHM_HUGE_PAGES) && !(tuned & SHM_TUNED_HUGE)) {
+        madvise(base, size, MADV_HUGEPAGE);
+    }
+#endif
+#ifdef SYS_mbind
+    if (flags & APR_SHM_NUMA_INTERLEAVE) {
+        unsigned long nodemask[16];
+
+        /* All the nodes, the kernel keeps those allowed */
+        memset(nodemask, 0xff, sizeof(nodemask));
+        syscall(SYS_mbind, base, size, MPOL_INTERLEAVE, nodemask,
+                8 * sizeof(nodemask), 0);
+    }
+#endif
+    if ((flags & APR_SHM_POPULATE) && !(tuned & SHM_TUNED_POPULATE)
+        && !SHM_MAP_POPULATE(flags)) {
+        volatile char *c = base;
+        apr_size_t pagesize = 4096, off;
+
+#if HAVE_MADVISE && defined(MADV_POPULATE_READ)
+        if (madvise(base, size, MADV_POPULATE_READ) == 0) {
+            return;
+        }
+#endif
+#ifdef _SC_PAGESIZE
+        pagesize = (apr_size_t)sysconf(_SC_PAGESIZE);
+#endif
+        /* Reading is enough for shared memory, and races no writer */
+        for (off = 0; off < size; off += pagesize) {
+            (void)c[off];
+        }
+    }
+}
+
 #if APR_USE_SHMEM_MMAP_SHM
 /*
  *   For portable use, a shared memory object should be identified by a name of
@@ -141,10 +240,11 @@ static apr_status_t shm_cleanup_owner(void *m_)
     }
 }
 
-APR_DECLARE(apr_status_t) apr_shm_create(apr_shm_t **m,
-                                         apr_size_t reqsize,
-                                         const char *filename,
-                                         apr_pool_t *pool)
+APR_DECLARE(apr_status_t) apr_shm_create_ex(apr_shm_t **m,
+                                            apr_size_t reqsize,
+                                            const char *filename,
+                                            apr_pool_t *pool,
+                                            apr_int32_t flags)
 {
     apr_shm_t *new_m;
     apr_status_t status;
@@ -187,7 +287,7 @@ APR_DECLARE(apr_status_t) apr_shm_create(apr_shm_t **m,
         }
 
         new_m->base = mmap(NULL, new_m->realsize, PROT_READ|PROT_WRITE,
-                           MAP_SHARED, tmpfd, 0);
+                           MAP_SHARED | SHM_MAP_POPULATE(flags), tmpfd, 0);
         if (new_m->base == (void *)MAP_FAILED) {
             return errno;
         }
@@ -196,6 +296,7 @@ APR_DECLARE(apr_status_t) apr_shm_create(apr_shm_t **m,
         if (status != APR_SUCCESS) {
             return status;
         }
+        shm_tune(new_m->base, new_m->realsize, flags, 0);
 
         /* store the real size in the metadata */
         *(apr_size_t*)(new_m->base) = new_m->realsize;
@@ -208,10 +309,35 @@ APR_DECLARE(apr_status_t) apr_shm_create(apr_shm_t **m,
         return APR_SUCCESS;
 
 #elif APR_USE_SHMEM_MMAP_ANON
-        new_m->base = mmap(NULL, new_m->realsize, PROT_READ|PROT_WRITE,
-                           MAP_ANON|MAP_SHARED, -1, 0);
-        if (new_m->base == (void *)MAP_FAILED) {
-            return errno;
+        {
+            int tuned = 0;
+
+            new_m->base = MAP_FAILED;
+#ifdef MAP_HUGETLB
+            /* Reserved huge pages if any, or else transparent ones */
+            if (flags & APR_SHM_HUGE_PAGES) {
+                apr_size_t size = APR_ALIGN(new_m->realsize,
+                                            shm_huge_page_size());
+
+                new_m->base = mmap(NULL, size, PROT_READ|PROT_WRITE,
+                                   MAP_ANON|MAP_SHARED|MAP_HUGETLB
+                                   | SHM_MAP_POPULATE(flags), -1, 0);
+                if (new_m->base != (void *)MAP_FAILED) {
+                    new_m->realsize = size;
+                    tuned |= SHM_TUNED_HUGE;
+                }
+            }
+#endif
+            if (new_m->base == (void *)MAP_FAILED) {
+                new_m->base = mmap(NULL, new_m->realsize,
+                                   PROT_READ|PROT_WRITE,
+                                   MAP_ANON|MAP_SHARED
+                                   | SHM_MAP_POPULATE(flags), -1, 0);
+            }
+            if (new_m->base == (void *)MAP_FAILED) {
+                return errno;
+            }
+            shm_tune(new_m->base, new_m->realsize, flags, tuned);
         }
 
         /* store the real size in the metadata */
@@ -232,8 +358,17 @@ APR_DECLARE(apr_status_t) apr_shm_create(apr_shm_t **m,
         new_m->realsize = reqsize;
         new_m->filename = NULL;
         new_m->shmkey = IPC_PRIVATE;
-        if ((new_m->shmid = shmget(new_m->shmkey, new_m->realsize,
-                                   SHM_R | SHM_W | IPC_CREAT)) < 0) {
+        new_m->shmid = -1;
+#ifdef SHM_HUGETLB
+        if (flags & APR_SHM_HUGE_PAGES) {
+            new_m->shmid = shmget(new_m->shmkey,
+                                  APR_ALIGN(reqsize, shm_huge_page_size()),
+                                  SHM_R | SHM_W | IPC_CREAT | SHM_HUGETLB);
+        }
+#endif
+        if (new_m->shmid < 0
+            && (new_m->shmid = shmget(new_m->shmkey, new_m->realsize,
+                                      SHM_R | SHM_W | IPC_CREAT)) < 0) {
             return errno;
         }
 
@@ -241,6 +376,7 @@ APR_DECLARE(apr_status_t) apr_shm_create(apr_shm_t **m,
             return errno;
         }
         new_m->usable = new_m->base;
+        shm_tune(new_m->base, new_m->realsize, flags, 0);
 
         if (shmctl(new_m->shmid, IPC_STAT, &shmbuf) == -1) {
             return errno;
@@ -310,7 +446,7 @@ APR_DECLARE(apr_status_t) apr_shm_create(apr_shm_t **m,
         }
 
         new_m->base = mmap(NULL, new_m->realsize, PROT_READ | PROT_WRITE,
-                           MAP_SHARED, tmpfd, 0);
+                           MAP_SHARED | SHM_MAP_POPULATE(flags), tmpfd, 0);
         /* FIXME: check for errors */
 
         status = apr_file_close(file);
@@ -335,7 +471,7 @@ APR_DECLARE(apr_status_t) apr_shm_create(apr_shm_t **m,
             return status;
         }
         new_m->base = mmap(NULL, new_m->realsize, PROT_READ | PROT_WRITE,
-                           MAP_SHARED, tmpfd, 0);
+                           MAP_SHARED | SHM_MAP_POPULATE(flags), tmpfd, 0);
         status = (new_m->base == (void *)-1) ? errno : APR_SUCCESS;
         /* fd no longer needed once the memory is mapped. */
         close(tmpfd);
@@ -344,6 +480,7 @@ APR_DECLARE(apr_status_t) apr_shm_create(apr_shm_t **m,
             return status;
         }
 #endif /* APR_USE_SHMEM_MMAP_SHM */
+        shm_tune(new_m->base, new_m->realsize, flags, 0);
 
         /* store the real size in the metadata */
         *(apr_size_t*)(new_m->base) = new_m->realsize;
@@ -374,8 +511,19 @@ APR_DECLARE(apr_status_t) apr_shm_create(apr_shm_t **m,
             return errno;
         }
 
-        if ((new_m->shmid = shmget(new_m->shmkey, new_m->realsize,
-                                   SHM_R | SHM_W | IPC_CREAT | IPC_EXCL)) < 0) {
+        new_m->shmid = -1;
+#ifdef SHM_HUGETLB
+        if (flags & APR_SHM_HUGE_PAGES) {
+            new_m->shmid = shmget(new_m->shmkey,
+                                  APR_ALIGN(reqsize, shm_huge_page_size()),
+                                  SHM_R | SHM_W | IPC_CREAT | IPC_EXCL
+                                  | SHM_HUGETLB);
+        }
+#endif
+        if (new_m->shmid < 0
+            && (new_m->shmid = shmget(new_m->shmkey, new_m->realsize,
+                                      SHM_R | SHM_W | IPC_CREAT
+                                      | IPC_EXCL)) < 0) {
             apr_file_close(file);
             return errno;
         }
@@ -385,6 +533,7 @@ APR_DECLARE(apr_status_t) apr_shm_create(apr_shm_t **m,
             return errno;
         }
         new_m->usable = new_m->base;
+        shm_tune(new_m->base, new_m->realsize, flags, 0);
 
         if (shmctl(new_m->shmid, IPC_STAT, &shmbuf) == -1) {
             apr_file_close(file);
@@ -421,13 +570,12 @@ APR_DECLARE(apr_status_t) apr_shm_create(apr_shm_t **m,
     }
 }
 
-APR_DECLARE(apr_status_t) apr_shm_create_ex(apr_shm_t **m,
-                                            apr_size_t reqsize,
-                                            const char *filename,
-                                            apr_pool_t *p,
-                                            apr_int32_t flags)
+APR_DECLARE(apr_status_t) apr_shm_create(apr_shm_t **m,
+                                         apr_size_t reqsize,
+                                         const char *filename,
+                                         apr_pool_t *p)
 {
-    return apr_shm_create(m, reqsize, filename, p);
+    return apr_shm_create_ex(m, reqsize, filename, p, 0);
 }
 
 APR_DECLARE(apr_status_t) apr_shm_remove(const char *filename,
@@ -529,10 +677,14 @@ static apr_status_t shm_cleanup_attach(void *m_)
     }
 }
 
-APR_DECLARE(apr_status_t) apr_shm_attach(apr_shm_t **m,
-                                         const char *filename,
-                                         apr_pool_t *pool)
+APR_DECLARE(apr_status_t) apr_shm_attach_ex(apr_shm_t **m,
+                                            const char *filename,
+                                            apr_pool_t *pool,
+                                            apr_int32_t flags)
 {
+    /* The NUMA policy of the segment was set at creation */
+    flags &= ~APR_SHM_NUMA_INTERLEAVE;
+
     if (filename == NULL) {
         /* It doesn't make sense to attach to a segment if you don't know
          * the filename. */
@@ -597,13 +749,14 @@ APR_DECLARE(apr_status_t) apr_shm_attach(apr_shm_t **m,
         new_m->reqsize = new_m->realsize - sizeof(apr_size_t);
 
         new_m->base = mmap(NULL, new_m->realsize, PROT_READ | PROT_WRITE,
-                           MAP_SHARED, tmpfd, 0);
+                           MAP_SHARED | SHM_MAP_POPULATE(flags), tmpfd, 0);
         /* FIXME: check for errors */
 
         status = apr_file_close(file);
         if (status != APR_SUCCESS) {
             return status;
         }
+        shm_tune(new_m->base, new_m->realsize, flags, 0);
 
         /* metadata isn't part of the usable segment */
         new_m->usable = (char *)new_m->base + APR_ALIGN_DEFAULT(sizeof(apr_size_t));
@@ -652,6 +805,7 @@ APR_DECLARE(apr_status_t) apr_shm_attach(apr_shm_t **m,
         }
         new_m->usable = new_m->base;
         new_m->realsize = new_m->reqsize;
+        shm_tune(new_m->base, new_m->realsize, flags, 0);
 
         apr_pool_cleanup_register(new_m->pool, new_m, shm_cleanup_attach,
                                   apr_pool_cleanup_null);
@@ -664,12 +818,11 @@ APR_DECLARE(apr_status_t) apr_shm_attach(apr_shm_t **m,
     }
 }
 
-APR_DECLARE(apr_status_t) apr_shm_attach_ex(apr_shm_t **m,
-                                            const char *filename,
-                                            apr_pool_t *pool,
-                                            apr_int32_t flags)
+APR_DECLARE(apr_status_t) apr_shm_attach(apr_shm_t **m,
+                                         const char *filename,
+                                         apr_pool_t *pool)
 {
-    return apr_shm_attach(m, filename, pool);
+    return apr_shm_attach_ex(m, filename, pool, 0);
 }
 
 APR_DECLARE(apr_status_t) apr_shm_detach(apr_shm_t *m)
@@ -33,34 +33,20 @@ APR_DECLARE(void) apr_cstr_split_append(apr_array_header_t *array,
                                         int chop_whitespace,
                                         apr_pool_t *pool)
 {
-  char *pats;
-  char *p;
-
-  pats = apr_pstrdup(pool, input);  /* strtok wants non-const data */
-  p = apr_cstr_tokenize(sep_chars, &pats);
-
-  while (p)
+  apr_cstr_tokiter_t it;
+  const char *token;
+  apr_size_t len;
+
+  /* A single copy, whose tokens are terminated in place: the end of
+   * each one is a separator (or whitespace) the iterator is past already.
+   */
+  apr_cstr_tokiter_init(&it, apr_pstrdup(pool, input), -1, sep_chars,
+                        chop_whitespace ? APR_CSTR_TOK_TRIM : 0);
+  while (apr_cstr_tokiter_next(&it, &token, &len))
     {
-      if (chop_whitespace)
-        {
-          while (apr_isspace(*p))
-            p++;
-
-          {
-            char *e = p + (strlen(p) - 1);
-            while ((e >= p) && (apr_isspace(*e)))
-              e--;
-            *(++e) = '\0';
-          }
-        }
-
-      if (p[0] != '\0')
-        APR_ARRAY_PUSH(array, const char *) = p;
-
-      p = apr_cstr_tokenize(sep_chars, &pats);
+      ((char *)token)[len] = '\0';
+      APR_ARRAY_PUSH(array, const char *) = token;
     }
-
-  return;
 }
 
 
@@ -280,16 +266,283 @@ static const unsigned char ucharmap[256] = {
 };
 #endif
 
+/*
+ * The ASCII case folding is done by 16 octets with SSE2 or NEON.  The
+ * strings' length being unknown, the loads may read past the NUL, but
+ * never across a page boundary (so they can't fault); that is left to
+ * the scalar code, like the EBCDIC builds and the address sanitizer's.
+ */
+#if APR_CHARSET_EBCDIC || defined(__SANITIZE_ADDRESS__)
+#elif defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#define CSTR_SSE2
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CSTR_NEON
+#endif
+
+#if defined(CSTR_SSE2) || defined(CSTR_NEON)
+
+#define CSTR_CHUNK 16
+#define CSTR_PAGE 4096
+/* Whether a chunk at u may cross a page boundary */
+#define CSTR_CROSSES(u) \
+    (((apr_uintptr_t)(u) & (CSTR_PAGE - 1)) > CSTR_PAGE - CSTR_CHUNK)
+
+#if defined(CSTR_SSE2)
+
+/* The octets from base to base + 25 of v, as 0xff */
+static APR_INLINE __m128i cstr_in_range(__m128i v, char base)
+{
+    /* Shift the range to the bottom of the signed octets */
+    __m128i t = _mm_add_epi8(v, _mm_set1_epi8((char)(0x80 - base)));
+    return _mm_cmplt_epi8(t, _mm_set1_epi8((char)(0x80 + 26)));
+}
+
+static APR_INLINE __m128i cstr_fold(__m128i v)
+{
+    return _mm_or_si128(v, _mm_and_si128(cstr_in_range(v, 'A'),
+                                         _mm_set1_epi8(0x20)));
+}
+
+/* The index of the first octet differing (but for the case) or NUL */
+static APR_INLINE int casecmp_chunk(const unsigned char *u1,
+                                    const unsigned char *u2)
+{
+    __m128i a = _mm_loadu_si128((const __m128i *)u1);
+    __m128i b = _mm_loadu_si128((const __m128i *)u2);
+    __m128i eq = _mm_cmpeq_epi8(cstr_fold(a), cstr_fold(b));
+    __m128i nul = _mm_cmpeq_epi8(a, _mm_setzero_si128());
+    unsigned int m = (unsigned int)_mm_movemask_epi8(_mm_andnot_si128(nul,
+                                                                      eq));
+
+    m ^= 0xffff;
+    return m ? __builtin_ctz(m) : CSTR_CHUNK;
+}
+
+/* Toggle the case of the octets from base to base + 25, unless there is
+ * a NUL (whose index is then returned, nothing being changed).
+ */
+static APR_INLINE int case_chunk(unsigned char *u, char base)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *)u);
+    unsigned int m = (unsigned int)_mm_movemask_epi8(
+                         _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+
+    if (m) {
+        return __builtin_ctz(m);
+    }
+    v = _mm_xor_si128(v, _mm_and_si128(cstr_in_range(v, base),
+                                       _mm_set1_epi8(0x20)));
+    _mm_storeu_si128((__m128i *)u, v);
+    return CSTR_CHUNK;
+}
+
+/* The index of the first of the n stop characters, or CSTR_CHUNK */
+static APR_INLINE int stops_chunk(const unsigned char *u, const char *stops,
+                                  int n)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *)u);
+    __m128i m = _mm_cmpeq_epi8(v, _mm_set1_epi8(stops[0]));
+    unsigned int bits;
+    int i;
+
+    for (i = 1; i < n; i++) {
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(stops[i])));
+    }
+    bits = (unsigned int)_mm_movemask_epi8(m);
+    return bits ? __builtin_ctz(bits) : CSTR_CHUNK;
+}
+
+#else /* CSTR_NEON */
+
+static APR_INLINE uint8x16_t cstr_in_range(uint8x16_t v, char base)
+{
+    return vcltq_u8(vsubq_u8(v, vdupq_n_u8((unsigned char)base)),
+                    vdupq_n_u8(26));
+}
+
+static APR_INLINE uint8x16_t cstr_fold(uint8x16_t v)
+{
+    return vorrq_u8(v, vandq_u8(cstr_in_range(v, 'A'), vdupq_n_u8(0x20)));
+}
+
+/* The first index flagged (0xff) in m, or 16: four bits per octet */
+static APR_INLINE int cstr_first(uint8x16_t m)
+{
+    apr_uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(
+                            vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+
+    return bits ? __builtin_ctzll(bits) >> 2 : CSTR_CHUNK;
+}
+
+static APR_INLINE int casecmp_chunk(const unsigned char *u1,
+                                    const unsigned char *u2)
+{
+    uint8x16_t a = vld1q_u8(u1);
+    uint8x16_t b = vld1q_u8(u2);
+    uint8x16_t ne = vmvnq_u8(vceqq_u8(cstr_fold(a), cstr_fold(b)));
+
+    return cstr_first(vorrq_u8(ne, vceqzq_u8(a)));
+}
+
+static APR_INLINE int case_chunk(unsigned char *u, char base)
+{
+    uint8x16_t v = vld1q_u8(u);
+    int nul = cstr_first(vceqzq_u8(v));
+
+    if (nul < CSTR_CHUNK) {
+        return nul;
+    }
+    vst1q_u8(u, veorq_u8(v, vandq_u8(cstr_in_range(v, base),
+                                     vdupq_n_u8(0x20))));
+    return CSTR_CHUNK;
+}
+
+static APR_INLINE int stops_chunk(const unsigned char *u, const char *stops,
+                                  int n)
+{
+    uint8x16_t v = vld1q_u8(u);
+    uint8x16_t m = vceqq_u8(v, vdupq_n_u8((unsigned char)stops[0]));
+    int i;
+
+    for (i = 1; i < n; i++) {
+        m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8((unsigned char)stops[i])));
+    }
+    return cstr_first(m);
+}
+
+#endif /* CSTR_NEON */
+
+#endif /* CSTR_SSE2 || CSTR_NEON */
+
+#define TOK_IS_STOP(it, c) ((it)->stops[(c) >> 3] & (1u << ((c) & 7)))
+
+static void tokiter_stop(apr_cstr_tokiter_t *it, unsigned char c)
+{
+    if (TOK_IS_STOP(it, c)) {
+        return;
+    }
+    it->stops[c >> 3] |= 1u << (c & 7);
+    if (it->nfast >= 0 && it->nfast < APR_CSTR_TOK_FAST) {
+        it->fast[it->nfast++] = (char)c;
+    }
+    else {
+        it->nfast = -1;
+    }
+}
+
+APR_DECLARE(void) apr_cstr_tokiter_init(apr_cstr_tokiter_t *it,
+                                        const char *input, apr_ssize_t len,
+                                        const char *sep_chars, int flags)
+{
+    const unsigned char *s;
+
+    it->next = input;
+    it->end = input + (len < 0 ? strlen(input) : (apr_size_t)len);
+    it->flags = flags;
+    it->nfast = 0;
+    memset(it->stops, 0, sizeof(it->stops));
+    for (s = (const unsigned char *)sep_chars; *s; s++) {
+        tokiter_stop(it, *s);
+    }
+    if (flags & APR_CSTR_TOK_QUOTED) {
+        tokiter_stop(it, '"');
+    }
+    if (it->nfast < 0) {
+        it->nfast = 0;
+    }
+}
+
+/* The first stop character from s, or the end.  The length being known,
+ * the chunks are never read past the end of the input.
+ */
+static APR_INLINE const char *tokiter_scan(const apr_cstr_tokiter_t *it,
+                                           const char *s)
+{
+    const unsigned char *u = (const unsigned char *)s;
+    const unsigned char *end = (const unsigned char *)it->end;
+
+#if defined(CSTR_SSE2) || defined(CSTR_NEON)
+    if (it->nfast) {
+        while (end - u >= CSTR_CHUNK) {
+            int i = stops_chunk(u, it->fast, it->nfast);
+            if (i < CSTR_CHUNK) {
+                return (const char *)u + i;
+            }
+            u += CSTR_CHUNK;
+        }
+    }
+#endif
+    while (u < end && !TOK_IS_STOP(it, *u)) {
+        u++;
+    }
+    return (const char *)u;
+}
+
+APR_DECLARE(int) apr_cstr_tokiter_next(apr_cstr_tokiter_t *it,
+                                       const char **token, apr_size_t *len)
+{
+    while (it->next) {
+        const char *p = it->next, *e = it->next;
+
+        for (;;) {
+            e = tokiter_scan(it, e);
+            if (e == it->end || *e != '"'
+                    || !(it->flags & APR_CSTR_TOK_QUOTED)) {
+                break;
+            }
+            /* Skip the quoted string, up to and including its end quote */
+            for (e++; e < it->end && *e != '"'; e++) {
+                if (*e == '\\' && e + 1 < it->end) {
+                    e++;
+                }
+            }
+            if (e < it->end) {
+                e++;
+            }
+        }
+        it->next = (e < it->end) ? e + 1 : NULL;
+
+        if (it->flags & APR_CSTR_TOK_TRIM) {
+            while (p < e && apr_isspace(*p)) {
+                p++;
+            }
+            while (e > p && apr_isspace(e[-1])) {
+                e--;
+            }
+        }
+        if (p < e || (it->flags & APR_CSTR_TOK_EMPTY)) {
+            *token = p;
+            *len = e - p;
+            return 1;
+        }
+    }
+    return 0;
+}
+
 APR_DECLARE(int) apr_cstr_casecmp(const char *s1, const char *s2)
 {
     const unsigned char *u1 = (const unsigned char *)s1;
     const unsigned char *u2 = (const unsigned char *)s2;
     for (;;) {
-        const int c2 = ucharmap[*u2++];
-        const int cmp = (int)ucharmap[*u1++] - c2;
-        /* Not necessary to test for !c1, this is caught by cmp */
-        if (cmp || !c2)
-            return cmp;
+#ifdef CSTR_CHUNK
+        if (!CSTR_CROSSES(u1) && !CSTR_CROSSES(u2)) {
+            int i = casecmp_chunk(u1, u2);
+            if (i < CSTR_CHUNK)
+                return (int)ucharmap[u1[i]] - ucharmap[u2[i]];
+            u1 += CSTR_CHUNK;
+            u2 += CSTR_CHUNK;
+        }
+        else
+#endif
+        {
+            const int c2 = ucharmap[*u2++];
+            const int cmp = (int)ucharmap[*u1++] - c2;
+            /* Not necessary to test for !c1, this is caught by cmp */
+            if (cmp || !c2)
+                return cmp;
+        }
     }
 }
 
@@ -298,6 +551,25 @@ APR_DECLARE(int) apr_cstr_casecmpn(const char *s1, const char *s2,
 {
     const unsigned char *u1 = (const unsigned char *)s1;
     const unsigned char *u2 = (const unsigned char *)s2;
+#ifdef CSTR_CHUNK
+    while (n >= CSTR_CHUNK) {
+        if (!CSTR_CROSSES(u1) && !CSTR_CROSSES(u2)) {
+            int i = casecmp_chunk(u1, u2);
+            if (i < CSTR_CHUNK)
+                return (int)ucharmap[u1[i]] - ucharmap[u2[i]];
+            u1 += CSTR_CHUNK;
+            u2 += CSTR_CHUNK;
+            n -= CSTR_CHUNK;
+        }
+        else {
+            const int c2 = ucharmap[*u2++];
+            const int cmp = (int)ucharmap[*u1++] - c2;
+            if (cmp || !c2)
+                return cmp;
+            n--;
+        }
+    }
+#endif
     while (n--) {
         const int c2 = ucharmap[*u2++];
         const int cmp = (int)ucharmap[*u1++] - c2;
@@ -308,6 +580,65 @@ APR_DECLARE(int) apr_cstr_casecmpn(const char *s1, const char *s2,
     return 0;
 }
 
+#if !APR_CHARSET_EBCDIC
+#define CSTR_TOLOWER(c) ((unsigned char)((c) - 'A') < 26 ? (c) | 0x20 : (c))
+#define CSTR_TOUPPER(c) ((unsigned char)((c) - 'a') < 26 ? (c) & ~0x20 : (c))
+#else
+#define CSTR_TOLOWER(c) apr_tolower(c)
+#define CSTR_TOUPPER(c) apr_toupper(c)
+#endif
+
+APR_DECLARE(void) apr_cstr_tolower(char *str)
+{
+    unsigned char *u = (unsigned char *)str;
+#ifdef CSTR_CHUNK
+    for (;;) {
+        if (!CSTR_CROSSES(u)) {
+            if (case_chunk(u, 'A') < CSTR_CHUNK) {
+                break;
+            }
+            u += CSTR_CHUNK;
+        }
+        else if (*u) {
+            *u = CSTR_TOLOWER(*u);
+            u++;
+        }
+        else {
+            return;
+        }
+    }
+#endif
+    /* The last chunk, with the NUL */
+    for (; *u; u++) {
+        *u = CSTR_TOLOWER(*u);
+    }
+}
+
+APR_DECLARE(void) apr_cstr_toupper(char *str)
+{
+    unsigned char *u = (unsigned char *)str;
+#ifdef CSTR_CHUNK
+    for (;;) {
+        if (!CSTR_CROSSES(u)) {
+            if (case_chunk(u, 'a') < CSTR_CHUNK) {
+                break;
+            }
+            u += CSTR_CHUNK;
+        }
+        else if (*u) {
+            *u = CSTR_TOUPPER(*u);
+            u++;
+        }
+        else {
+            return;
+        }
+    }
+#endif
+    for (; *u; u++) {
+        *u = CSTR_TOUPPER(*u);
+    }
+}
+
 APR_DECLARE(apr_status_t) apr_cstr_strtoui64(apr_uint64_t *n,
                                              const char *str,
                                              apr_uint64_t minval,
@@ -58,7 +58,10 @@
 #include "apr_tables.h"
 #include "apr_lib.h"
 #include "apr_strings.h"
+#include "apr_strmatch.h"
+#include "apr_cstr.h"
 #include <string.h>
+#include <stdlib.h>
 #if APR_HAVE_CTYPE_H
 # include <ctype.h>
 #endif
@@ -393,6 +396,274 @@ firstsegment:
 }
 
 
+/* The compiled patterns reject most strings with their literals before
+ * apr_fnmatch() is run: the string must be long enough, begin with the
+ * literal prefix of the pattern, end with its literal suffix and contain
+ * its longest literal in between (searched by apr_strmatch()).  The
+ * literals are the characters matching only themselves, the escaped ones
+ * and the '[' not opening a balanced bracket expression included.
+ */
+struct apr_fnmatch_t {
+    const char *pattern;
+    int flags;
+    int wild;                   /* a '*' in the pattern */
+    int literal;                /* nothing but literals in the pattern */
+    apr_size_t minlen;          /* the characters matched but by the '*' */
+    const char *prefix;
+    apr_size_t prefix_len;
+    const char *suffix;
+    apr_size_t suffix_len;
+    const char *middle;         /* the longest other literal, or NULL */
+    apr_size_t middle_len;
+    const apr_strmatch_pattern *middle_pattern;
+};
+
+APR_DECLARE(const apr_fnmatch_t *) apr_fnmatch_compile(apr_pool_t *p,
+                                                       const char *pattern,
+                                                       int flags)
+{
+    static const char dummystring[2] = {' ', 0};
+    const int escape = !(flags & APR_FNM_NOESCAPE);
+    apr_fnmatch_t *fnm = apr_pcalloc(p, sizeof(*fnm));
+    char *lits = apr_palloc(p, strlen(pattern) + 1);
+    const char *pat = pattern;
+    const char *dummyptr;
+    char *lit = lits, *end = lits;
+    int first = 1;
+
+    fnm->pattern = apr_pstrdup(p, pattern);
+    fnm->flags = flags;
+
+    for (;;) {
+        const char *next = pat;
+        int c = -1;
+
+        if (*pat == '*' || *pat == '?') {
+            fnm->wild |= (*pat == '*');
+            next = pat + 1;
+        }
+        else if (*pat == '[') {
+            /* Use a dummy fnmatch_ch() test to skip a "[range]" */
+            dummyptr = dummystring;
+            fnmatch_ch(&next, &dummyptr, flags);
+            if (next == pat + 1) {
+                c = '[';
+            }
+        }
+        else if (escape && (*pat == '\\') && pat[1]) {
+            c = pat[1];
+            next = pat + 2;
+        }
+        else if (*pat) {
+            c = *pat;
+            next = pat + 1;
+        }
+
+        if (c >= 0) {
+            *end++ = (char)c;
+            fnm->minlen++;
+            pat = next;
+            continue;
+        }
+
+        /* The end of a literal */
+        if (end > lit) {
+            if (first) {
+                fnm->prefix = lit;
+                fnm->prefix_len = end - lit;
+            }
+            else if (*pat && (apr_size_t)(end - lit) > fnm->middle_len) {
+                fnm->middle = lit;
+                fnm->middle_len = end - lit;
+            }
+            if (!*pat && !first) {
+                fnm->suffix = lit;
+                fnm->suffix_len = end - lit;
+            }
+            *end++ = '\0';
+            lit = end;
+        }
+        if (!*pat) {
+            break;
+        }
+        if (*pat != '*') {
+            fnm->minlen++;
+        }
+        first = 0;
+        pat = next;
+    }
+    fnm->literal = first;
+
+    if (fnm->middle_len > 1) {
+        fnm->middle_pattern = apr_strmatch_precompile(p, fnm->middle,
+                                     !(flags & APR_FNM_CASE_BLIND));
+    }
+
+    return fnm;
+}
+
+static APR_INLINE int fnmatch_literal_cmp(const apr_fnmatch_t *fnm,
+                                          const char *s, const char *lit,
+                                          apr_size_t len)
+{
+    if (fnm->flags & APR_FNM_CASE_BLIND) {
+        return apr_cstr_casecmpn(s, lit, len);
+    }
+    return memcmp(s, lit, len);
+}
+
+/* The literals test, all the compiled pattern needs for a literal one:
+ * APR_FNM_NOMATCH if the string can't match, else 0
+ */
+static int fnmatch_literals(const apr_fnmatch_t *fnm, const char *string,
+                            apr_size_t len, int middle)
+{
+    if (fnm->wild ? len < fnm->minlen : len != fnm->minlen) {
+        return APR_FNM_NOMATCH;
+    }
+    if (fnm->prefix_len
+        && fnmatch_literal_cmp(fnm, string, fnm->prefix, fnm->prefix_len)) {
+        return APR_FNM_NOMATCH;
+    }
+    if (fnm->suffix_len
+        && fnmatch_literal_cmp(fnm, string + len - fnm->suffix_len,
+                               fnm->suffix, fnm->suffix_len)) {
+        return APR_FNM_NOMATCH;
+    }
+    if (middle && fnm->middle_pattern
+        && !apr_strmatch(fnm->middle_pattern, string + fnm->prefix_len,
+                         len - fnm->prefix_len - fnm->suffix_len)) {
+        return APR_FNM_NOMATCH;
+    }
+    return 0;
+}
+
+APR_DECLARE(int) apr_fnmatch_match(const apr_fnmatch_t *fnm,
+                                   const char *string)
+{
+    if (fnmatch_literals(fnm, string, strlen(string), 1)) {
+        return APR_FNM_NOMATCH;
+    }
+    if (fnm->literal) {
+        return 0;
+    }
+    return apr_fnmatch(fnm->pattern, string, fnm->flags);
+}
+
+/* The longest literals of the patterns of a set are searched at once,
+ * with an Aho-Corasick automaton (case-insensitive, which may only let a
+ * few more of them through); the same literal of several patterns is
+ * searched once (the same case-insensitively).
+ */
+struct apr_fnmatch_set_t {
+    const apr_fnmatch_t **fnms;
+    int nfnms;
+    int *middle;                /* the literal of each pattern, or -1 */
+    int nmiddles;
+    const apr_strmatch_multi_t *multi;
+};
+
+APR_DECLARE(const apr_fnmatch_set_t *) apr_fnmatch_set_make(apr_pool_t *p,
+                                           const apr_fnmatch_t * const *fnms,
+                                           int nfnms)
+{
+    apr_fnmatch_set_t *set = apr_pcalloc(p, sizeof(*set));
+    const char **middles;
+    int i, j;
+
+    set->fnms = apr_pmemdup(p, fnms, nfnms * sizeof(*fnms));
+    set->nfnms = nfnms;
+    set->middle = apr_palloc(p, nfnms * sizeof(int));
+    middles = apr_palloc(p, nfnms * sizeof(char *));
+
+    for (i = 0; i < nfnms; i++) {
+        set->middle[i] = -1;
+        if (!fnms[i]->middle_pattern) {
+            continue;
+        }
+        for (j = 0; j < set->nmiddles; j++) {
+            if (!apr_cstr_casecmp(middles[j], fnms[i]->middle)) {
+                break;
+            }
+        }
+        if (j == set->nmiddles) {
+            middles[set->nmiddles++] = fnms[i]->middle;
+        }
+        set->middle[i] = j;
+    }
+
+    if (set->nmiddles) {
+        set->multi = apr_strmatch_multi_precompile(p, middles, set->nmiddles,
+                                                   APR_STRMATCH_MULTI_NOCASE);
+        if (!set->multi) {
+            return NULL;
+        }
+    }
+
+    return set;
+}
+
+#define FNMATCH_SET_BITS 32
+
+static int fnmatch_set_found(void *baton, int pattern, apr_off_t offset)
+{
+    apr_uint32_t *found = baton;
+
+    found[pattern / FNMATCH_SET_BITS] |= 1u << (pattern % FNMATCH_SET_BITS);
+    return 0;
+}
+
+APR_DECLARE(int) apr_fnmatch_set_match(const apr_fnmatch_set_t *set,
+                                       const char *string)
+{
+    apr_uint32_t found_stack[1024 / FNMATCH_SET_BITS];
+    apr_uint32_t *found = NULL;
+    apr_size_t len = strlen(string);
+    int i, match = -1;
+
+    for (i = 0; i < set->nfnms && match < 0; i++) {
+        const apr_fnmatch_t *fnm = set->fnms[i];
+        int m = set->middle[i];
+
+        if (fnmatch_literals(fnm, string, len, 0)) {
+            continue;
+        }
+        if (m >= 0) {
+            if (!found) {
+                /* The first pattern this far, search all the literals */
+                apr_size_t size = (set->nmiddles + FNMATCH_SET_BITS - 1)
+                                  / FNMATCH_SET_BITS * sizeof(apr_uint32_t);
+                apr_strmatch_multi_state_t state;
+
+                found = found_stack;
+                if (size > sizeof(found_stack)) {
+                    found = malloc(size);
+                    if (!found) {
+                        break;
+                    }
+                }
+                memset(found, 0, size);
+                apr_strmatch_multi_init(set->multi, &state);
+                apr_strmatch_multi_scan(&state, string, len,
+                                        fnmatch_set_found, found);
+            }
+            if (!(found[m / FNMATCH_SET_BITS]
+                  & (1u << (m % FNMATCH_SET_BITS)))) {
+                continue;
+            }
+        }
+        if (fnm->literal || !apr_fnmatch(fnm->pattern, string, fnm->flags)) {
+            match = i;
+        }
+    }
+
+    if (found && found != found_stack) {
+        free(found);
+    }
+    return match;
+}
+
+
 /* This function is an Apache addition
  * return non-zero if pattern has any glob chars in it
  * @bug Function does not distinguish for FNM_PATHNAME mode, which renders
@@ -256,6 +256,37 @@ static char *apr_gcvt(double number, int ndigit, char *buf, boolean_e altform)
     cc++;                                           \
 }
 
+/*
+ * The INS_STR macro inserts len characters of str at once, likewise
+ */
+#define INS_STR(str, len, sp, bep, cc)              \
+{                                                   \
+    const char *str_ = (str);                       \
+    apr_size_t len_ = (len);                        \
+                                                    \
+    cc += (int)len_;                                \
+    if (sp) {                                       \
+        while (len_) {                              \
+            apr_size_t n_;                          \
+                                                    \
+            if (sp >= bep) {                        \
+                vbuff->curpos = sp;                 \
+                if (flush_func(vbuff))              \
+                    return -1;                      \
+                sp = vbuff->curpos;                 \
+                bep = vbuff->endpos;                \
+            }                                       \
+            n_ = bep - sp;                          \
+            if (n_ > len_)                          \
+                n_ = len_;                          \
+            memcpy(sp, str_, n_);                   \
+            sp += n_;                               \
+            str_ += n_;                             \
+            len_ -= n_;                             \
+        }                                           \
+    }                                               \
+}
+
 #define NUM(c) (c - '0')
 
 #define STR_TO_DEC(str, num)                        \
@@ -310,6 +341,29 @@ while (width > len)
     has_prefix=YES;
 
 
+/*
+ * The two digits of 0 to 99, converting the numbers by pairs of digits
+ */
+static const char digits_100[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233"
+    "34353637383940414243444546474849505152535455565758596061626364656667"
+    "6869707172737475767778798081828384858687888990919293949596979899";
+
+#define CONV_10_DIGITS(magnitude, p, type)          \
+    while (magnitude >= 100) {                      \
+        type r_ = magnitude % 100;                  \
+        magnitude /= 100;                           \
+        p -= 2;                                     \
+        memcpy(p, &digits_100[r_ * 2], 2);          \
+    }                                               \
+    if (magnitude >= 10) {                          \
+        p -= 2;                                     \
+        memcpy(p, &digits_100[magnitude * 2], 2);   \
+    }                                               \
+    else {                                          \
+        *--p = (char) (magnitude + '0');            \
+    }
+
 /*
  * Convert num to its decimal format.
  * Return value:
@@ -355,15 +409,9 @@ static char *conv_10(register apr_int32_t num, register int is_unsigned,
     }
 
     /*
-     * We use a do-while loop so that we write at least 1 digit
+     * By pairs of digits, writing at least 1 digit
      */
-    do {
-        register apr_uint32_t new_magnitude = magnitude / 10;
-
-        *--p = (char) (magnitude - new_magnitude * 10 + '0');
-        magnitude = new_magnitude;
-    }
-    while (magnitude);
+    CONV_10_DIGITS(magnitude, p, apr_uint32_t);
 
     *len = buf_end - p;
     return (p);
@@ -407,15 +455,9 @@ static char *conv_10_quad(apr_int64_t num, register int is_unsigned,
     }
 
     /*
-     * We use a do-while loop so that we write at least 1 digit
+     * By pairs of digits, writing at least 1 digit
      */
-    do {
-        apr_uint64_t new_magnitude = magnitude / 10;
-
-        *--p = (char) (magnitude - new_magnitude * 10 + '0');
-        magnitude = new_magnitude;
-    }
-    while (magnitude);
+    CONV_10_DIGITS(magnitude, p, apr_uint64_t);
 
     *len = buf_end - p;
     return (p);
@@ -507,9 +549,31 @@ static char *conv_os_thread_t(apr_os_thread_t *tid, char *buf_end, apr_size_t *l
 
 
 
+/*
+ * The scales of the 'f' formats converted with the integers
+ */
+#define FIXED_FP_DIGITS 16
+#define FIXED_FP_EPSILON 2.3e-16 /* above 2^-52 */
+
+static const double fixed_fp_scales[FIXED_FP_DIGITS] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+    1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+};
+
+static const apr_uint64_t fixed_fp_iscales[FIXED_FP_DIGITS] = {
+    APR_UINT64_C(1), APR_UINT64_C(10), APR_UINT64_C(100),
+    APR_UINT64_C(1000), APR_UINT64_C(10000), APR_UINT64_C(100000),
+    APR_UINT64_C(1000000), APR_UINT64_C(10000000),
+    APR_UINT64_C(100000000), APR_UINT64_C(1000000000),
+    APR_UINT64_C(10000000000), APR_UINT64_C(100000000000),
+    APR_UINT64_C(1000000000000), APR_UINT64_C(10000000000000),
+    APR_UINT64_C(100000000000000), APR_UINT64_C(1000000000000000)
+};
+
 /*
  * Convert a floating point number to a string formats 'f', 'e' or 'E'.
- * The result is placed in buf, and len denotes the length of the string
+ * The result is placed in buf (of NUM_BUF_SIZE - 1 bytes) and returned,
+ * and len denotes the length of the string
  * The sign is returned in the is_negative argument (and is not placed
  * in buf).
  */
@@ -522,6 +586,50 @@ static char *conv_fp(register char format, register double num,
     int decimal_point;
     char buf1[NDIG];
 
+    /*
+     * The 'f' format of a number which scaled by the precision is below
+     * 2^53 from its rounded integer, unless the scaling (off by half an
+     * ulp at most) makes it too close to a half to tell how to round
+     */
+    if (format == 'f' && precision < FIXED_FP_DIGITS) {
+        double scaled = ((num < 0) ? -num : num) * fixed_fp_scales[precision];
+        apr_uint64_t r = 0;
+        double frac = 0.5;
+
+        if (scaled < 9007199254740992.0) {
+            r = (apr_uint64_t) scaled;
+            frac = scaled - (double) r;
+        }
+        if (frac - 0.5 > scaled * FIXED_FP_EPSILON
+            || 0.5 - frac > scaled * FIXED_FP_EPSILON) {
+            apr_uint64_t scale = fixed_fp_iscales[precision];
+            apr_uint64_t ipart, fpart;
+            char *e = buf + NUM_BUF_SIZE - 2;
+
+            if (frac > 0.5)
+                r++;
+            ipart = r / scale;
+            fpart = r % scale;
+
+            p = e;
+            if (precision > 0) {
+                char *f = e - precision;
+
+                CONV_10_DIGITS(fpart, p, apr_uint64_t);
+                while (p > f)
+                    *--p = '0';
+                *--p = '.';
+            }
+            else if (add_dp)
+                *--p = '.';
+            CONV_10_DIGITS(ipart, p, apr_uint64_t);
+
+            *is_negative = (num < 0);
+            *len = e - p;
+            return (p);
+        }
+    }
+
     if (format == 'f')
         p = apr_fcvt(num, precision, &decimal_point, is_negative, buf1);
     else /* either e or E format */
@@ -677,15 +785,213 @@ static char *conv_os_thread_t_hex(apr_os_thread_t *tid, char *buf_end, apr_size_
 #endif
 
 /*
- * Do format conversion placing the output in buffer
+ * A conversion specification, parsed from the format by format_parse()
  */
-APR_DECLARE(int) apr_vformatter(int (*flush_func)(apr_vformatter_buff_t *),
-    apr_vformatter_buff_t *vbuff, const char *fmt, va_list ap)
+typedef struct format_spec_t {
+    const char *conv;           /* the conversion character(s), or NULL */
+    apr_size_t min_width;
+    apr_size_t precision;
+    char adjust_left;
+    char alternate_form;
+    char print_sign;
+    char print_blank;
+    char pad_char;
+    char adjust_width;          /* NO, YES or FORMAT_ARG for '*' */
+    char adjust_precision;      /* likewise */
+    char var_type;
+} format_spec_t;
+
+#define FORMAT_ARG 2
+
+enum var_type_enum {
+        IS_QUAD, IS_LONG, IS_SHORT, IS_INT
+};
+
+/*
+ * Parse the specification following a '%' of the format, returning the
+ * conversion character
+ */
+static const char *format_parse(const char *fmt, format_spec_t *spec)
+{
+    spec->adjust_left = spec->alternate_form = NO;
+    spec->print_sign = spec->print_blank = NO;
+    spec->pad_char = ' ';
+    spec->min_width = spec->precision = 0;
+
+    /*
+     * Try to avoid checking for flags, width or precision
+     */
+    if (!apr_islower(*fmt)) {
+        /*
+         * Recognize flags: -, #, BLANK, +
+         */
+        for (;; fmt++) {
+            if (*fmt == '-')
+                spec->adjust_left = YES;
+            else if (*fmt == '+')
+                spec->print_sign = YES;
+            else if (*fmt == '#')
+                spec->alternate_form = YES;
+            else if (*fmt == ' ')
+                spec->print_blank = YES;
+            else if (*fmt == '0')
+                spec->pad_char = '0';
+            else
+                break;
+        }
+
+        /*
+         * Check if a width was specified
+         */
+        if (apr_isdigit(*fmt)) {
+            STR_TO_DEC(fmt, spec->min_width);
+            spec->adjust_width = YES;
+        }
+        else if (*fmt == '*') {
+            fmt++;
+            spec->adjust_width = FORMAT_ARG;
+        }
+        else
+            spec->adjust_width = NO;
+
+        /*
+         * Check if a precision was specified
+         */
+        if (*fmt == '.') {
+            spec->adjust_precision = YES;
+            fmt++;
+            if (apr_isdigit(*fmt)) {
+                STR_TO_DEC(fmt, spec->precision);
+            }
+            else if (*fmt == '*') {
+                fmt++;
+                spec->adjust_precision = FORMAT_ARG;
+            }
+            else
+                spec->precision = 0;
+        }
+        else
+            spec->adjust_precision = NO;
+    }
+    else
+        spec->adjust_precision = spec->adjust_width = NO;
+
+    /*
+     * Modifier check.  In same cases, APR_OFF_T_FMT can be
+     * "lld" and APR_INT64_T_FMT can be "ld" (that is, off_t is
+     * "larger" than int64). Check that case 1st.
+     * Note that if APR_OFF_T_FMT is "d",
+     * the first if condition is never true. If APR_INT64_T_FMT
+     * is "d' then the second if condition is never true.
+     */
+    if ((sizeof(APR_OFF_T_FMT) > sizeof(APR_INT64_T_FMT)) &&
+        ((sizeof(APR_OFF_T_FMT) == 4 &&
+         fmt[0] == APR_OFF_T_FMT[0] &&
+         fmt[1] == APR_OFF_T_FMT[1]) ||
+        (sizeof(APR_OFF_T_FMT) == 3 &&
+         fmt[0] == APR_OFF_T_FMT[0]) ||
+        (sizeof(APR_OFF_T_FMT) > 4 &&
+         strncmp(fmt, APR_OFF_T_FMT,
+                 sizeof(APR_OFF_T_FMT) - 2) == 0))) {
+        /* Need to account for trailing 'd' and null in sizeof() */
+        spec->var_type = IS_QUAD;
+        fmt += (sizeof(APR_OFF_T_FMT) - 2);
+    }
+    else if ((sizeof(APR_INT64_T_FMT) == 4 &&
+         fmt[0] == APR_INT64_T_FMT[0] &&
+         fmt[1] == APR_INT64_T_FMT[1]) ||
+        (sizeof(APR_INT64_T_FMT) == 3 &&
+         fmt[0] == APR_INT64_T_FMT[0]) ||
+        (sizeof(APR_INT64_T_FMT) > 4 &&
+         strncmp(fmt, APR_INT64_T_FMT,
+                 sizeof(APR_INT64_T_FMT) - 2) == 0)) {
+        /* Need to account for trailing 'd' and null in sizeof() */
+        spec->var_type = IS_QUAD;
+        fmt += (sizeof(APR_INT64_T_FMT) - 2);
+    }
+    else if (*fmt == 'q') {
+        spec->var_type = IS_QUAD;
+        fmt++;
+    }
+    else if (*fmt == 'l') {
+        spec->var_type = IS_LONG;
+        fmt++;
+    }
+    else if (*fmt == 'h') {
+        spec->var_type = IS_SHORT;
+        fmt++;
+    }
+    else {
+        spec->var_type = IS_INT;
+    }
+
+    spec->conv = fmt;
+    return fmt;
+}
+
+/*
+ * A format compiled by apr_format_compile(): for each conversion, the
+ * length of the characters before it and its parsed specification, then
+ * the length of the characters after the last one
+ */
+struct apr_format_t {
+    const char *fmt;
+    struct format_item_t {
+        apr_size_t len;
+        format_spec_t spec;
+    } *items;
+};
+
+APR_DECLARE(const apr_format_t *) apr_format_compile(apr_pool_t *p,
+                                                     const char *fmt)
+{
+    apr_format_t *format = apr_palloc(p, sizeof(*format));
+    const char *f;
+    int n, nitems = 1;
+
+    for (f = fmt; *f; f++) {
+        if (*f == '%') {
+            nitems++;
+        }
+    }
+    format->fmt = f = apr_pstrdup(p, fmt);
+    format->items = apr_palloc(p, nitems * sizeof(*format->items));
+
+    for (n = 0; ; n++) {
+        struct format_item_t *item = &format->items[n];
+        const char *conv;
+
+        item->len = strcspn(f, "%");
+        item->spec.conv = NULL;
+        f += item->len;
+        if (!*f) {
+            break;
+        }
+        conv = format_parse(f + 1, &item->spec);
+        if (!*conv) {
+            break;
+        }
+        /* the second character of the %p extensions */
+        if (*conv == 'p' && !*++conv) {
+            break;
+        }
+        f = conv + 1;
+    }
+
+    return format;
+}
+
+/*
+ * Do format conversion placing the output in buffer, from the format
+ * string or else from the compiled one
+ */
+static int vformatter(int (*flush_func)(apr_vformatter_buff_t *),
+    apr_vformatter_buff_t *vbuff, const char *fmt,
+    const apr_format_t *format, va_list ap)
 {
     register char *sp;
     register char *bep;
     register int cc = 0;
-    register apr_size_t i;
 
     register char *s = NULL;
     char *q;
@@ -708,10 +1014,10 @@ APR_DECLARE(int) apr_vformatter(int (*flush_func)(apr_vformatter_buff_t *),
     char num_buf[NUM_BUF_SIZE];
     char char_buf[2];                /* for printing %% and %<unknown> */
 
-    enum var_type_enum {
-            IS_QUAD, IS_LONG, IS_SHORT, IS_INT
-    };
     enum var_type_enum var_type = IS_INT;
+    const struct format_item_t *item = format ? format->items : NULL;
+    format_spec_t spec_buf;
+    const format_spec_t *spec;
 
     /*
      * Flag variables
@@ -726,135 +1032,63 @@ APR_DECLARE(int) apr_vformatter(int (*flush_func)(apr_vformatter_buff_t *),
     sp = vbuff->curpos;
     bep = vbuff->endpos;
 
+    if (format)
+        fmt = format->fmt;
+
     while (*fmt) {
         if (*fmt != '%') {
-            INS_CHAR(*fmt, sp, bep, cc);
+            /*
+             * The characters up to the next conversion at once
+             */
+            apr_size_t len = item ? item->len : strcspn(fmt, "%");
+
+            INS_STR(fmt, len, sp, bep, cc);
+            fmt += len;
+            continue;
         }
         else {
             /*
              * Default variable settings
              */
             boolean_e print_something = YES;
-            adjust = RIGHT;
-            alternate_form = print_sign = print_blank = NO;
-            pad_char = ' ';
             prefix_char = NUL;
 
-            fmt++;
+            if (item) {
+                spec = &(item++)->spec;
+            }
+            else {
+                format_parse(fmt + 1, &spec_buf);
+                spec = &spec_buf;
+            }
+            fmt = spec->conv;
+            adjust = spec->adjust_left ? LEFT : RIGHT;
+            alternate_form = spec->alternate_form;
+            print_sign = spec->print_sign;
+            print_blank = spec->print_blank;
+            pad_char = spec->pad_char;
+            min_width = spec->min_width;
+            precision = spec->precision;
+            adjust_width = spec->adjust_width;
+            adjust_precision = spec->adjust_precision;
+            var_type = spec->var_type;
 
             /*
-             * Try to avoid checking for flags, width or precision
+             * The width and precision given as arguments
              */
-            if (!apr_islower(*fmt)) {
-                /*
-                 * Recognize flags: -, #, BLANK, +
-                 */
-                for (;; fmt++) {
-                    if (*fmt == '-')
-                        adjust = LEFT;
-                    else if (*fmt == '+')
-                        print_sign = YES;
-                    else if (*fmt == '#')
-                        alternate_form = YES;
-                    else if (*fmt == ' ')
-                        print_blank = YES;
-                    else if (*fmt == '0')
-                        pad_char = '0';
-                    else
-                        break;
-                }
-
-                /*
-                 * Check if a width was specified
-                 */
-                if (apr_isdigit(*fmt)) {
-                    STR_TO_DEC(fmt, min_width);
-                    adjust_width = YES;
-                }
-                else if (*fmt == '*') {
-                    int v = va_arg(ap, int);
-                    fmt++;
-                    adjust_width = YES;
-                    if (v < 0) {
-                        adjust = LEFT;
-                        min_width = (apr_size_t)(-v);
-                    }
-                    else
-                        min_width = (apr_size_t)v;
-                }
-                else
-                    adjust_width = NO;
-
-                /*
-                 * Check if a precision was specified
-                 */
-                if (*fmt == '.') {
-                    adjust_precision = YES;
-                    fmt++;
-                    if (apr_isdigit(*fmt)) {
-                        STR_TO_DEC(fmt, precision);
-                    }
-                    else if (*fmt == '*') {
-                        int v = va_arg(ap, int);
-                        fmt++;
-                        precision = (v < 0) ? 0 : (apr_size_t)v;
-                    }
-                    else
-                        precision = 0;
+            if (adjust_width == FORMAT_ARG) {
+                int v = va_arg(ap, int);
+                adjust_width = YES;
+                if (v < 0) {
+                    adjust = LEFT;
+                    min_width = (apr_size_t)(-v);
                 }
                 else
-                    adjust_precision = NO;
-            }
-            else
-                adjust_precision = adjust_width = NO;
-
-            /*
-             * Modifier check.  In same cases, APR_OFF_T_FMT can be
-             * "lld" and APR_INT64_T_FMT can be "ld" (that is, off_t is
-             * "larger" than int64). Check that case 1st.
-             * Note that if APR_OFF_T_FMT is "d",
-             * the first if condition is never true. If APR_INT64_T_FMT
-             * is "d' then the second if condition is never true.
-             */
-            if ((sizeof(APR_OFF_T_FMT) > sizeof(APR_INT64_T_FMT)) &&
-                ((sizeof(APR_OFF_T_FMT) == 4 &&
-                 fmt[0] == APR_OFF_T_FMT[0] &&
-                 fmt[1] == APR_OFF_T_FMT[1]) ||
-                (sizeof(APR_OFF_T_FMT) == 3 &&
-                 fmt[0] == APR_OFF_T_FMT[0]) ||
-                (sizeof(APR_OFF_T_FMT) > 4 &&
-                 strncmp(fmt, APR_OFF_T_FMT,
-                         sizeof(APR_OFF_T_FMT) - 2) == 0))) {
-                /* Need to account for trailing 'd' and null in sizeof() */
-                var_type = IS_QUAD;
-                fmt += (sizeof(APR_OFF_T_FMT) - 2);
-            }
-            else if ((sizeof(APR_INT64_T_FMT) == 4 &&
-                 fmt[0] == APR_INT64_T_FMT[0] &&
-                 fmt[1] == APR_INT64_T_FMT[1]) ||
-                (sizeof(APR_INT64_T_FMT) == 3 &&
-                 fmt[0] == APR_INT64_T_FMT[0]) ||
-                (sizeof(APR_INT64_T_FMT) > 4 &&
-                 strncmp(fmt, APR_INT64_T_FMT,
-                         sizeof(APR_INT64_T_FMT) - 2) == 0)) {
-                /* Need to account for trailing 'd' and null in sizeof() */
-                var_type = IS_QUAD;
-                fmt += (sizeof(APR_INT64_T_FMT) - 2);
+                    min_width = (apr_size_t)v;
             }
-            else if (*fmt == 'q') {
-                var_type = IS_QUAD;
-                fmt++;
-            }
-            else if (*fmt == 'l') {
-                var_type = IS_LONG;
-                fmt++;
-            }
-            else if (*fmt == 'h') {
-                var_type = IS_SHORT;
-                fmt++;
-            }
-            else {
-                var_type = IS_INT;
+            if (adjust_precision == FORMAT_ARG) {
+                int v = va_arg(ap, int);
+                adjust_precision = YES;
+                precision = (v < 0) ? 0 : (apr_size_t)v;
             }
 
             /*
@@ -1326,10 +1560,7 @@ APR_DECLARE(int) apr_vformatter(int (*flush_func)(apr_vformatter_buff_t *),
              * Print the string s.
              */
             if (print_something == YES) {
-                for (i = s_len; i != 0; i--) {
-                    INS_CHAR(*s, sp, bep, cc);
-                    s++;
-                }
+                INS_STR(s, s_len, sp, bep, cc);
             }
 
             if (adjust_width && adjust == LEFT && min_width > s_len)
@@ -1342,6 +1573,19 @@ APR_DECLARE(int) apr_vformatter(int (*flush_func)(apr_vformatter_buff_t *),
     return cc;
 }
 
+APR_DECLARE(int) apr_vformatter(int (*flush_func)(apr_vformatter_buff_t *),
+    apr_vformatter_buff_t *vbuff, const char *fmt, va_list ap)
+{
+    return vformatter(flush_func, vbuff, fmt, NULL, ap);
+}
+
+APR_DECLARE(int) apr_format_vformatter(
+    int (*flush_func)(apr_vformatter_buff_t *),
+    apr_vformatter_buff_t *vbuff, const apr_format_t *format, va_list ap)
+{
+    return vformatter(flush_func, vbuff, NULL, format, ap);
+}
+
 
 static int snprintf_flush(apr_vformatter_buff_t *vbuff)
 {
@@ -1352,11 +1596,10 @@ static int snprintf_flush(apr_vformatter_buff_t *vbuff)
 }
 
 
-APR_DECLARE_NONSTD(int) apr_snprintf(char *buf, apr_size_t len,
-                                     const char *format, ...)
+static int do_vsnprintf(char *buf, apr_size_t len, const char *format,
+                        const apr_format_t *compiled, va_list ap)
 {
     int cc;
-    va_list ap;
     apr_vformatter_buff_t vbuff;
 
     if (len == 0) {
@@ -1374,9 +1617,7 @@ APR_DECLARE_NONSTD(int) apr_snprintf(char *buf, apr_size_t len,
         vbuff.curpos = buf;
         vbuff.endpos = buf + len - 1;
     }
-    va_start(ap, format);
-    cc = apr_vformatter(snprintf_flush, &vbuff, format, ap);
-    va_end(ap);
+    cc = vformatter(snprintf_flush, &vbuff, format, compiled, ap);
     if (len != 0) {
         *vbuff.curpos = '\0';
     }
@@ -1384,24 +1625,41 @@ APR_DECLARE_NONSTD(int) apr_snprintf(char *buf, apr_size_t len,
 }
 
 
+APR_DECLARE_NONSTD(int) apr_snprintf(char *buf, apr_size_t len,
+                                     const char *format, ...)
+{
+    int cc;
+    va_list ap;
+
+    va_start(ap, format);
+    cc = do_vsnprintf(buf, len, format, NULL, ap);
+    va_end(ap);
+    return cc;
+}
+
+
 APR_DECLARE(int) apr_vsnprintf(char *buf, apr_size_t len, const char *format,
                                va_list ap)
+{
+    return do_vsnprintf(buf, len, format, NULL, ap);
+}
+
+
+APR_DECLARE_NONSTD(int) apr_format_snprintf(char *buf, apr_size_t len,
+                                            const apr_format_t *format, ...)
 {
     int cc;
-    apr_vformatter_buff_t vbuff;
+    va_list ap;
 
-    if (len == 0) {
-        /* See above note */
-        vbuff.curpos = NULL;
-        vbuff.endpos = NULL;
-    } else {
-        /* save one byte for nul terminator */
-        vbuff.curpos = buf;
-        vbuff.endpos = buf + len - 1;
-    }
-    cc = apr_vformatter(snprintf_flush, &vbuff, format, ap);
-    if (len != 0) {
-        *vbuff.curpos = '\0';
-    }
-    return (cc == -1) ? (int)len - 1 : cc;
+    va_start(ap, format);
+    cc = do_vsnprintf(buf, len, NULL, format, ap);
+    va_end(ap);
+    return cc;
+}
+
+
+APR_DECLARE(int) apr_format_vsnprintf(char *buf, apr_size_t len,
+                                      const apr_format_t *format, va_list ap)
+{
+    return do_vsnprintf(buf, len, NULL, format, ap);
 }
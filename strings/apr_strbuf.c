@@ -0,0 +1,181 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr.h"
+#include "apr_lib.h"
+#include "apr_strbuf.h"
+#define APR_WANT_STRFUNC
+#define APR_WANT_MEMFUNC
+#include "apr_want.h"
+
+/* The first allocation, unless initialized with a size */
+#define STRBUF_MIN_SIZE 64
+
+/* Until something is allocated, never written to */
+static char strbuf_empty[1];
+
+/* Make sb->size at least need, doubling it */
+static void strbuf_grow(apr_strbuf_t *sb, apr_size_t need)
+{
+    apr_size_t size = sb->size * 2;
+    char *data;
+
+    if (size < need) {
+        size = need;
+    }
+    if (size < STRBUF_MIN_SIZE) {
+        size = STRBUF_MIN_SIZE;
+    }
+
+    if (sb->size) {
+        /* Still the last block of the pool? Then no copy, with the
+         * rest of the active memnode for the doubling or at least
+         * for what is needed now.
+         */
+        if (apr_presize(sb->pool, sb->data, sb->size, size)) {
+            sb->size = size;
+            return;
+        }
+        if (size > need && apr_presize(sb->pool, sb->data, sb->size, need)) {
+            sb->size = need;
+            return;
+        }
+    }
+
+    data = apr_palloc(sb->pool, size);
+    memcpy(data, sb->data, sb->len + 1);
+    sb->data = data;
+    sb->size = size;
+}
+
+APR_DECLARE(void) apr_strbuf_init(apr_strbuf_t *sb, apr_pool_t *p,
+                                  apr_size_t size)
+{
+    sb->pool = p;
+    sb->len = 0;
+    if (size) {
+        sb->data = apr_palloc(p, size);
+        sb->data[0] = '\0';
+        sb->size = size;
+    }
+    else {
+        sb->data = strbuf_empty;
+        sb->size = 0;
+    }
+}
+
+APR_DECLARE(char *) apr_strbuf_reserve(apr_strbuf_t *sb, apr_size_t len)
+{
+    if (sb->size - sb->len <= len) {
+        strbuf_grow(sb, sb->len + len + 1);
+    }
+    return sb->data + sb->len;
+}
+
+APR_DECLARE(void) apr_strbuf_append(apr_strbuf_t *sb, const char *str,
+                                    apr_size_t len)
+{
+    if (sb->size - sb->len <= len) {
+        strbuf_grow(sb, sb->len + len + 1);
+    }
+    memcpy(sb->data + sb->len, str, len);
+    sb->len += len;
+    sb->data[sb->len] = '\0';
+}
+
+APR_DECLARE(void) apr_strbuf_appendstr(apr_strbuf_t *sb, const char *str)
+{
+    apr_strbuf_append(sb, str, strlen(str));
+}
+
+APR_DECLARE(void) apr_strbuf_appendc(apr_strbuf_t *sb, char c)
+{
+    if (sb->size - sb->len <= 1) {
+        strbuf_grow(sb, sb->len + 2);
+    }
+    sb->data[sb->len++] = c;
+    sb->data[sb->len] = '\0';
+}
+
+struct strbuf_vbuff {
+    apr_vformatter_buff_t vbuff;
+    apr_strbuf_t *sb;
+};
+
+static int strbuf_flush(apr_vformatter_buff_t *vbuff)
+{
+    apr_strbuf_t *sb = ((struct strbuf_vbuff *)vbuff)->sb;
+
+    sb->len = vbuff->curpos - sb->data;
+    strbuf_grow(sb, sb->size + 1);
+    vbuff->curpos = sb->data + sb->len;
+    /* Save a byte for the NUL terminator */
+    vbuff->endpos = sb->data + sb->size - 1;
+
+    return 0;
+}
+
+APR_DECLARE(void) apr_strbuf_vappendf(apr_strbuf_t *sb, const char *fmt,
+                                      va_list ap)
+{
+    struct strbuf_vbuff v;
+
+    if (sb->size - sb->len <= 1) {
+        strbuf_grow(sb, sb->len + 2);
+    }
+    v.sb = sb;
+    v.vbuff.curpos = sb->data + sb->len;
+    v.vbuff.endpos = sb->data + sb->size - 1;
+
+    apr_vformatter(strbuf_flush, &v.vbuff, fmt, ap);
+
+    sb->len = v.vbuff.curpos - sb->data;
+    sb->data[sb->len] = '\0';
+}
+
+APR_DECLARE_NONSTD(void) apr_strbuf_appendf(apr_strbuf_t *sb,
+                                            const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    apr_strbuf_vappendf(sb, fmt, ap);
+    va_end(ap);
+}
+
+APR_DECLARE(char *) apr_strbuf_finish(apr_strbuf_t *sb, apr_size_t *len)
+{
+    char *str;
+
+    if (sb->size) {
+        /* Give the unused tail back, if still ours */
+        apr_presize(sb->pool, sb->data, sb->size, sb->len + 1);
+        str = sb->data;
+    }
+    else {
+        str = apr_palloc(sb->pool, 1);
+        str[0] = '\0';
+    }
+    if (len) {
+        *len = sb->len;
+    }
+
+    sb->data = strbuf_empty;
+    sb->len = 0;
+    sb->size = 0;
+
+    return str;
+}
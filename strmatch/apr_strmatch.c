@@ -22,6 +22,31 @@
 
 #define NUM_CHARS  256
 
+/* The shifts are capped to fit a byte, which only shortens the skips of
+ * the patterns longer than that.
+ */
+#define MAX_SHIFT  255
+
+/* Vectors of 16 bytes are available on all the x86-64 (SSE2) and the
+ * AArch64 (NEON) processors, and the mask of a compare of them has
+ * SIMD_MASK_BITS bits per byte.
+ */
+#if defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define STRMATCH_SSE2
+#define SIMD_MASK_BITS 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define STRMATCH_NEON
+#define SIMD_MASK_BITS 4
+#endif
+
+typedef struct strmatch_context {
+    unsigned char shift[NUM_CHARS];
+    const unsigned char *folded; /* the lowercased pattern, if nocase */
+} strmatch_context;
+
 /*
  * String searching functions
  */
@@ -36,7 +61,8 @@ static const char *match_boyer_moore_horspool(
                                const char *s, apr_size_t slen)
 {
     const char *s_end = s + slen;
-    apr_size_t *shift = (apr_size_t *)(this_pattern->context);
+    const unsigned char *shift =
+        ((const strmatch_context *)this_pattern->context)->shift;
     const char *s_next = s + this_pattern->length - 1;
     const char *p_start = this_pattern->pattern;
     const char *p_end = p_start + this_pattern->length - 1;
@@ -50,42 +76,169 @@ static const char *match_boyer_moore_horspool(
             }
             s_tmp--;
         }
-        s_next += shift[(int)*((const unsigned char *)s_next)];
+        s_next += shift[*(const unsigned char *)s_next];
     }
     return NULL;
 }
 
+/* The shifts of both cases are set, and the pattern is lowercased */
 static const char *match_boyer_moore_horspool_nocase(
                                const apr_strmatch_pattern *this_pattern,
                                const char *s, apr_size_t slen)
 {
+    const strmatch_context *ctx = this_pattern->context;
     const char *s_end = s + slen;
-    apr_size_t *shift = (apr_size_t *)(this_pattern->context);
+    const unsigned char *shift = ctx->shift;
     const char *s_next = s + this_pattern->length - 1;
-    const char *p_start = this_pattern->pattern;
-    const char *p_end = p_start + this_pattern->length - 1;
+    const unsigned char *p_start = ctx->folded;
+    const unsigned char *p_end = p_start + this_pattern->length - 1;
     while (s_next < s_end) {
         const char *s_tmp = s_next;
-        const char *p_tmp = p_end;
-        while (apr_tolower(*s_tmp) == apr_tolower(*p_tmp)) {
+        const unsigned char *p_tmp = p_end;
+        while (apr_tolower(*s_tmp) == *p_tmp) {
             p_tmp--;
             if (p_tmp < p_start) {
                 return s_tmp;
             }
             s_tmp--;
         }
-        s_next += shift[(unsigned char)apr_tolower(*s_next)];
+        s_next += shift[*(const unsigned char *)s_next];
     }
     return NULL;
 }
 
+static const char *match_memchr(const apr_strmatch_pattern *this_pattern,
+                                const char *s, apr_size_t slen)
+{
+    return memchr(s, *this_pattern->pattern, slen);
+}
+
+#ifdef SIMD_MASK_BITS
+
+/* The candidates, whose first and last bytes match, are compared 16 at a
+ * time, falling back to Boyer-Moore-Horspool for the last bytes.
+ */
+#ifdef STRMATCH_SSE2
+#define SIMD_DECLARE(v)      __m128i v
+#define SIMD_SET1(v, c)      ((v) = _mm_set1_epi8((char)(c)))
+#define SIMD_CANDIDATES(s, first, last, len) \
+    ((apr_uint64_t)_mm_movemask_epi8(_mm_and_si128( \
+        _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(s)), (first)), \
+        _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)((s) + (len) - 1)), \
+                       (last)))))
+#define SIMD_CANDIDATES_NOCASE(s, flo, fup, llo, lup, len) \
+    ((apr_uint64_t)_mm_movemask_epi8(_mm_and_si128( \
+        simd_eq2(_mm_loadu_si128((const __m128i *)(s)), (flo), (fup)), \
+        simd_eq2(_mm_loadu_si128((const __m128i *)((s) + (len) - 1)), \
+                 (llo), (lup)))))
+
+static APR_INLINE __m128i simd_eq2(__m128i v, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_cmpeq_epi8(v, a), _mm_cmpeq_epi8(v, b));
+}
+#else /* STRMATCH_NEON */
+#define SIMD_DECLARE(v)      uint8x16_t v
+#define SIMD_SET1(v, c)      ((v) = vdupq_n_u8((unsigned char)(c)))
+#define SIMD_CANDIDATES(s, first, last, len) \
+    simd_mask(vandq_u8( \
+        vceqq_u8(vld1q_u8((const uint8_t *)(s)), (first)), \
+        vceqq_u8(vld1q_u8((const uint8_t *)((s) + (len) - 1)), (last))))
+#define SIMD_CANDIDATES_NOCASE(s, flo, fup, llo, lup, len) \
+    simd_mask(vandq_u8( \
+        simd_eq2(vld1q_u8((const uint8_t *)(s)), (flo), (fup)), \
+        simd_eq2(vld1q_u8((const uint8_t *)((s) + (len) - 1)), \
+                 (llo), (lup))))
+
+static APR_INLINE uint8x16_t simd_eq2(uint8x16_t v, uint8x16_t a,
+                                      uint8x16_t b)
+{
+    return vorrq_u8(vceqq_u8(v, a), vceqq_u8(v, b));
+}
+
+/* 4 bits per byte, NEON having no movemask */
+static APR_INLINE apr_uint64_t simd_mask(uint8x16_t eq)
+{
+    return vget_lane_u64(vreinterpret_u64_u8(
+                         vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+}
+#endif
+
+#define SIMD_BYTE_MASK ((1u << SIMD_MASK_BITS) - 1)
+
+static const char *match_simd(const apr_strmatch_pattern *this_pattern,
+                              const char *s, apr_size_t slen)
+{
+    const char *p = this_pattern->pattern;
+    apr_size_t len = this_pattern->length;
+    apr_size_t i = 0;
+    SIMD_DECLARE(first);
+    SIMD_DECLARE(last);
+
+    SIMD_SET1(first, p[0]);
+    SIMD_SET1(last, p[len - 1]);
+    for (; i + 16 + len - 1 <= slen; i += 16) {
+        apr_uint64_t mask = SIMD_CANDIDATES(s + i, first, last, len);
+        apr_size_t j;
+
+        for (j = 0; mask; j++, mask >>= SIMD_MASK_BITS) {
+            if ((mask & SIMD_BYTE_MASK)
+                && memcmp(s + i + j + 1, p + 1, len - 2) == 0) {
+                return s + i + j;
+            }
+        }
+    }
+
+    return match_boyer_moore_horspool(this_pattern, s + i, slen - i);
+}
+
+static const char *match_simd_nocase(const apr_strmatch_pattern *this_pattern,
+                                     const char *s, apr_size_t slen)
+{
+    const unsigned char *p =
+        ((const strmatch_context *)this_pattern->context)->folded;
+    apr_size_t len = this_pattern->length;
+    apr_size_t i = 0;
+    SIMD_DECLARE(flo);
+    SIMD_DECLARE(fup);
+    SIMD_DECLARE(llo);
+    SIMD_DECLARE(lup);
+
+    SIMD_SET1(flo, p[0]);
+    SIMD_SET1(fup, apr_toupper(p[0]));
+    SIMD_SET1(llo, p[len - 1]);
+    SIMD_SET1(lup, apr_toupper(p[len - 1]));
+    for (; i + 16 + len - 1 <= slen; i += 16) {
+        apr_uint64_t mask = SIMD_CANDIDATES_NOCASE(s + i, flo, fup, llo, lup,
+                                                   len);
+        apr_size_t j, k;
+
+        for (j = 0; mask; j++, mask >>= SIMD_MASK_BITS) {
+            if (!(mask & SIMD_BYTE_MASK)) {
+                continue;
+            }
+            for (k = 1; k < len - 1; k++) {
+                if (apr_tolower(s[i + j + k]) != p[k]) {
+                    break;
+                }
+            }
+            if (k >= len - 1) {
+                return s + i + j;
+            }
+        }
+    }
+
+    return match_boyer_moore_horspool_nocase(this_pattern, s + i, slen - i);
+}
+
+#endif /* SIMD_MASK_BITS */
+
 APR_DECLARE(const apr_strmatch_pattern *) apr_strmatch_precompile(
                                               apr_pool_t *p, const char *s,
                                               int case_sensitive)
 {
     apr_strmatch_pattern *pattern;
+    strmatch_context *ctx;
     apr_size_t i;
-    apr_size_t *shift;
 
     pattern = apr_palloc(p, sizeof(*pattern));
     pattern->pattern = s;
@@ -96,23 +249,434 @@ APR_DECLARE(const apr_strmatch_pattern *) apr_strmatch_precompile(
         return pattern;
     }
 
-    shift = (apr_size_t *)apr_palloc(p, sizeof(apr_size_t) * NUM_CHARS);
-    for (i = 0; i < NUM_CHARS; i++) {
-        shift[i] = pattern->length;
-    }
+    ctx = apr_palloc(p, sizeof(*ctx));
+    memset(ctx->shift, pattern->length < MAX_SHIFT ? pattern->length
+                                                   : MAX_SHIFT,
+           NUM_CHARS);
+    ctx->folded = NULL;
     if (case_sensitive) {
         pattern->compare = match_boyer_moore_horspool;
         for (i = 0; i < pattern->length - 1; i++) {
-            shift[(unsigned char)s[i]] = pattern->length - i - 1;
+            apr_size_t shift = pattern->length - i - 1;
+
+            if (shift > MAX_SHIFT) {
+                shift = MAX_SHIFT;
+            }
+            ctx->shift[(unsigned char)s[i]] = (unsigned char)shift;
+        }
+        if (pattern->length == 1) {
+            pattern->compare = match_memchr;
+        }
+#ifdef SIMD_MASK_BITS
+        else {
+            pattern->compare = match_simd;
         }
+#endif
     }
     else {
+        unsigned char *folded = apr_palloc(p, pattern->length + 1);
+
+        for (i = 0; i < pattern->length; i++) {
+            folded[i] = apr_tolower(s[i]);
+        }
+        folded[i] = '\0';
+        ctx->folded = folded;
+
         pattern->compare = match_boyer_moore_horspool_nocase;
         for (i = 0; i < pattern->length - 1; i++) {
-            shift[(unsigned char)apr_tolower(s[i])] = pattern->length - i - 1;
+            apr_size_t shift = pattern->length - i - 1;
+
+            if (shift > MAX_SHIFT) {
+                shift = MAX_SHIFT;
+            }
+            ctx->shift[folded[i]] = (unsigned char)shift;
+            ctx->shift[(unsigned char)apr_toupper(folded[i])] =
+                (unsigned char)shift;
         }
+#ifdef SIMD_MASK_BITS
+        if (pattern->length > 1) {
+            pattern->compare = match_simd_nocase;
+        }
+#endif
     }
-    pattern->context = shift;
+    pattern->context = ctx;
 
     return pattern;
 }
+
+/*
+ * Search across strings
+ */
+
+APR_DECLARE(void) apr_strmatch_stream_init(apr_strmatch_stream_t *stream,
+                                           const apr_strmatch_pattern *pattern,
+                                           char *buf)
+{
+    stream->pattern = pattern;
+    stream->held = buf;
+    stream->nheld = 0;
+    stream->offset = 0;
+}
+
+APR_DECLARE(apr_strmatch_stream_t *) apr_strmatch_stream_create(
+                                         apr_pool_t *p,
+                                         const apr_strmatch_pattern *pattern)
+{
+    apr_strmatch_stream_t *stream;
+
+    if (pattern->length == 0) {
+        return NULL;
+    }
+
+    stream = apr_palloc(p, sizeof(*stream));
+    apr_strmatch_stream_init(stream, pattern,
+                             apr_palloc(p, APR_STRMATCH_STREAM_BUFSIZE(pattern)));
+    return stream;
+}
+
+APR_DECLARE(void) apr_strmatch_stream_reset(apr_strmatch_stream_t *stream)
+{
+    stream->nheld = 0;
+    stream->offset = 0;
+}
+
+/* Hold the last bytes of buf, which may begin a match */
+static void stream_hold(apr_strmatch_stream_t *stream, const char *buf,
+                        apr_size_t len)
+{
+    apr_size_t keep = stream->pattern->length - 1;
+
+    if (len < keep) {
+        keep = len;
+    }
+    memmove(stream->held, buf + len - keep, keep);
+    stream->nheld = keep;
+}
+
+APR_DECLARE(apr_status_t) apr_strmatch_stream(apr_strmatch_stream_t *stream,
+                                              const char *s,
+                                              apr_size_t slen,
+                                              apr_off_t *offset,
+                                              apr_size_t *used)
+{
+    const apr_strmatch_pattern *pattern = stream->pattern;
+    apr_size_t plen = pattern->length;
+    const char *match;
+
+    if (stream->nheld) {
+        /* The matches starting in the held bytes end in the first bytes
+         * of s, appended to them.
+         */
+        apr_size_t nheld = stream->nheld;
+        apr_size_t n = slen < plen - 1 ? slen : plen - 1;
+        apr_off_t start = stream->offset - nheld;
+
+        memcpy(stream->held + nheld, s, n);
+        match = apr_strmatch(pattern, stream->held, nheld + n);
+        if (match && (apr_size_t)(match - stream->held) < nheld) {
+            *offset = start + (match - stream->held);
+            *used = (match - stream->held) + plen - nheld;
+            stream->offset += *used;
+            stream->nheld = 0;
+            return APR_SUCCESS;
+        }
+        if (n == slen && slen < plen - 1) {
+            /* too short to hold back the held bytes */
+            stream->offset += slen;
+            stream_hold(stream, stream->held, nheld + n);
+            *used = slen;
+            return APR_NOTFOUND;
+        }
+    }
+
+    match = apr_strmatch(pattern, s, slen);
+    if (match) {
+        *offset = stream->offset + (match - s);
+        *used = (match - s) + plen;
+        stream->offset += *used;
+        stream->nheld = 0;
+        return APR_SUCCESS;
+    }
+
+    stream->offset += slen;
+    stream_hold(stream, s, slen);
+    *used = slen;
+    return APR_NOTFOUND;
+}
+
+/*
+ * Multiple patterns matching (Aho-Corasick)
+ */
+
+/* The largest transition table, in entries */
+#define MULTI_DENSE_MAX (1024 * 1024)
+
+typedef struct multi_node_t {
+    apr_uint32_t child;     /* first child, or 0 */
+    apr_uint32_t sibling;   /* next child of the parent, or 0 */
+    apr_uint32_t fail;      /* longest proper suffix in the trie */
+    apr_uint32_t dict;      /* longest proper suffix ending a pattern, or 0 */
+    int pattern;            /* the pattern ending here, or -1 */
+    apr_uint16_t cls;       /* class of the byte leading here */
+} multi_node_t;
+
+struct apr_strmatch_multi_t {
+    multi_node_t *nodes;
+    apr_uint32_t nnodes;
+    apr_size_t *lengths;        /* of the patterns */
+    apr_uint16_t cls[NUM_CHARS];/* 0 for the bytes of no pattern */
+    apr_uint32_t ncls;
+    apr_uint32_t *root;         /* the transitions of the root */
+    apr_uint32_t *delta;        /* nnodes x ncls transitions, or NULL */
+    int first;                  /* the first byte of all the patterns, or -1 */
+};
+
+static apr_uint32_t multi_child(const apr_strmatch_multi_t *multi,
+                                apr_uint32_t node, apr_uint32_t c)
+{
+    apr_uint32_t child;
+
+    for (child = multi->nodes[node].child; child;
+         child = multi->nodes[child].sibling) {
+        if (multi->nodes[child].cls == c) {
+            break;
+        }
+    }
+    return child;
+}
+
+static APR_INLINE apr_uint32_t multi_next(const apr_strmatch_multi_t *multi,
+                                          apr_uint32_t node, apr_uint32_t c)
+{
+    if (multi->delta) {
+        return multi->delta[node * multi->ncls + c];
+    }
+    if (c == 0) {
+        return 0;
+    }
+    while (node) {
+        apr_uint32_t child = multi_child(multi, node, c);
+
+        if (child) {
+            return child;
+        }
+        node = multi->nodes[node].fail;
+    }
+    return multi->root[c];
+}
+
+APR_DECLARE(const apr_strmatch_multi_t *) apr_strmatch_multi_precompile(
+                                              apr_pool_t *p,
+                                              const char * const *patterns,
+                                              int npatterns, int flags)
+{
+    apr_strmatch_multi_t *multi;
+    multi_node_t *nodes;
+    apr_uint32_t *queue;
+    apr_size_t total = 0;
+    apr_uint32_t n, head, tail;
+    int nocase = (flags & APR_STRMATCH_MULTI_NOCASE) != 0;
+    int i;
+
+    if (npatterns <= 0) {
+        return NULL;
+    }
+
+    multi = apr_pcalloc(p, sizeof(*multi));
+    multi->lengths = apr_palloc(p, npatterns * sizeof(apr_size_t));
+    multi->ncls = 1;
+    multi->first = nocase ? -1 : (unsigned char)patterns[0][0];
+    for (i = 0; i < npatterns; i++) {
+        const unsigned char *s = (const unsigned char *)patterns[i];
+
+        multi->lengths[i] = strlen(patterns[i]);
+        if (multi->lengths[i] == 0) {
+            return NULL;
+        }
+        total += multi->lengths[i];
+        if (s[0] != multi->first) {
+            multi->first = -1;
+        }
+        for (; *s; s++) {
+            unsigned char c = nocase ? apr_tolower(*s) : *s;
+
+            if (multi->cls[c] == 0) {
+                multi->cls[c] = multi->ncls++;
+            }
+        }
+    }
+    if (nocase) {
+        for (i = 0; i < NUM_CHARS; i++) {
+            multi->cls[i] = multi->cls[(unsigned char)apr_tolower(i)];
+        }
+    }
+    if (total >= APR_UINT32_MAX) {
+        return NULL;
+    }
+
+    /* The trie, with at most a node per byte */
+    nodes = apr_palloc(p, (total + 1) * sizeof(multi_node_t));
+    memset(&nodes[0], 0, sizeof(multi_node_t));
+    nodes[0].pattern = -1;
+    multi->nodes = nodes;
+    multi->nnodes = 1;
+    for (i = 0; i < npatterns; i++) {
+        const unsigned char *s = (const unsigned char *)patterns[i];
+        apr_uint32_t node = 0;
+
+        for (; *s; s++) {
+            apr_uint32_t c = multi->cls[*s];
+            apr_uint32_t child = multi_child(multi, node, c);
+
+            if (child == 0) {
+                child = multi->nnodes++;
+                nodes[child].child = 0;
+                nodes[child].sibling = nodes[node].child;
+                nodes[child].fail = 0;
+                nodes[child].dict = 0;
+                nodes[child].pattern = -1;
+                nodes[child].cls = (apr_uint16_t)c;
+                nodes[node].child = child;
+            }
+            node = child;
+        }
+        if (nodes[node].pattern < 0) {
+            nodes[node].pattern = i;
+        }
+    }
+
+    multi->root = apr_pcalloc(p, multi->ncls * sizeof(apr_uint32_t));
+    for (n = nodes[0].child; n; n = nodes[n].sibling) {
+        multi->root[nodes[n].cls] = n;
+    }
+
+    /* The failure links, breadth first */
+    queue = apr_palloc(p, multi->nnodes * sizeof(apr_uint32_t));
+    head = tail = 0;
+    queue[tail++] = 0;
+    while (head < tail) {
+        apr_uint32_t u = queue[head++];
+
+        for (n = nodes[u].child; n; n = nodes[n].sibling) {
+            if (u) {
+                apr_uint32_t f = nodes[u].fail, to;
+
+                while (f && !multi_child(multi, f, nodes[n].cls)) {
+                    f = nodes[f].fail;
+                }
+                to = f ? multi_child(multi, f, nodes[n].cls)
+                       : multi->root[nodes[n].cls];
+                nodes[n].fail = to;
+                nodes[n].dict = nodes[to].pattern >= 0 ? to : nodes[to].dict;
+            }
+            queue[tail++] = n;
+        }
+    }
+
+    /* The transition table, filled from the shallower failures */
+    if ((apr_uint64_t)multi->nnodes * multi->ncls <= MULTI_DENSE_MAX) {
+        apr_uint32_t *delta;
+
+        delta = apr_palloc(p, multi->nnodes * multi->ncls
+                              * sizeof(apr_uint32_t));
+        memcpy(delta, multi->root, multi->ncls * sizeof(apr_uint32_t));
+        for (head = 1; head < tail; head++) {
+            apr_uint32_t u = queue[head];
+            apr_uint32_t *row = delta + u * multi->ncls;
+
+            memcpy(row, delta + nodes[u].fail * multi->ncls,
+                   multi->ncls * sizeof(apr_uint32_t));
+            for (n = nodes[u].child; n; n = nodes[n].sibling) {
+                row[nodes[n].cls] = n;
+            }
+        }
+        multi->delta = delta;
+    }
+
+    return multi;
+}
+
+APR_DECLARE(void) apr_strmatch_multi_init(const apr_strmatch_multi_t *multi,
+                                          apr_strmatch_multi_state_t *state)
+{
+    state->multi = multi;
+    state->node = 0;
+    state->offset = 0;
+}
+
+APR_DECLARE(int) apr_strmatch_multi_scan(apr_strmatch_multi_state_t *state,
+                                         const char *s, apr_size_t slen,
+                                         apr_strmatch_multi_cb_t *cb,
+                                         void *baton)
+{
+    const apr_strmatch_multi_t *multi = state->multi;
+    const multi_node_t *nodes = multi->nodes;
+    const unsigned char *u = (const unsigned char *)s;
+    apr_uint32_t node = state->node;
+    apr_size_t i;
+
+    for (i = 0; i < slen; i++) {
+        if (node == 0 && multi->first >= 0) {
+            /* skip to where the patterns start */
+            const char *next = memchr(s + i, multi->first, slen - i);
+
+            if (next == NULL) {
+                break;
+            }
+            i = next - s;
+        }
+
+        node = multi_next(multi, node, multi->cls[u[i]]);
+        if (nodes[node].pattern >= 0 || nodes[node].dict) {
+            apr_off_t end = state->offset + i + 1;
+            apr_uint32_t n = nodes[node].pattern >= 0 ? node
+                                                      : nodes[node].dict;
+
+            for (; n; n = nodes[n].dict) {
+                int pattern = nodes[n].pattern;
+                int rv = cb(baton, pattern, end - multi->lengths[pattern]);
+
+                if (rv) {
+                    state->node = node;
+                    state->offset = end;
+                    return rv;
+                }
+            }
+        }
+    }
+
+    state->node = node;
+    state->offset += slen;
+    return 0;
+}
+
+typedef struct multi_first_t {
+    int pattern;
+    apr_off_t offset;
+} multi_first_t;
+
+static int multi_first_cb(void *baton, int pattern, apr_off_t offset)
+{
+    multi_first_t *first = baton;
+
+    first->pattern = pattern;
+    first->offset = offset;
+    return 1;
+}
+
+APR_DECLARE(const char *) apr_strmatch_multi(const apr_strmatch_multi_t *multi,
+                                             const char *s, apr_size_t slen,
+                                             int *pattern)
+{
+    apr_strmatch_multi_state_t state;
+    multi_first_t first;
+
+    apr_strmatch_multi_init(multi, &state);
+    if (!apr_strmatch_multi_scan(&state, s, slen, multi_first_cb, &first)) {
+        return NULL;
+    }
+    if (pattern) {
+        *pattern = first.pattern;
+    }
+    return s + first.offset;
+}
@@ -0,0 +1,754 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_private.h"
+
+#include "apr_chash.h"
+#include "apr_allocator.h"
+#include "apr_atomic.h"
+#include "apr_slab.h"
+#include "apr_thread_mutex.h"
+#include "apr_portable.h"
+#define APR_WANT_MEMFUNC
+#include "apr_want.h"
+
+/*
+ * The internal form of a concurrent hash table.
+ *
+ * Like apr_hash_t, an array of buckets with lists of entries hanging off
+ * them. Readers walk the lists without a lock, so the writers (locking
+ * the stripe of the bucket) publish the entries with atomic pointer
+ * stores, and never change them but for their value. Expanding the table
+ * builds a new array with copies of the entries, swapped for the current
+ * one by a writer holding all the stripes.
+ *
+ * The entries and arrays unlinked (retired) are freed after a grace
+ * period: the readers count themselves in one of two counters as per the
+ * parity of an epoch, each counter spread over CHASH_READERS cache lines
+ * picked by thread. Once the counters of the previous epoch are seen at
+ * zero, the epoch is flipped and the retired lists move one generation
+ * ahead. Those retired before the previous flip are then freed, both
+ * counters having been seen at zero since (a reader may have read the
+ * epoch before a flip and counted itself after the check, but it then
+ * can't have seen what was unlinked before the check).
+ * Writers only poll the counters, so reading and writing in the same
+ * thread (e.g. deleting while iterating) is fine.
+ */
+
+/* Tunables, powers of two */
+#define CHASH_STRIPES     16
+#define CHASH_READERS     64
+#define CHASH_INITIAL_MAX 15
+#define CHASH_CACHELINE   64
+
+/* Size classes of the entries (with their keys), from slabs */
+#define CHASH_CLASSES     5
+#define CHASH_MIN_CLASS   64
+
+typedef struct chash_node_t chash_node_t;
+typedef struct chash_table_t chash_table_t;
+
+struct chash_node_t {
+    chash_node_t *volatile next;
+    void *volatile         val;
+    /** The retired list, not walked by the readers */
+    chash_node_t          *retired;
+    /** From the allocator (larger keys), or NULL from a slab */
+    apr_memnode_t         *memnode;
+    apr_ssize_t            klen;
+    unsigned int           hash;
+    int                    size_class;
+    /* followed by the key */
+};
+
+#define NODE_KEY(node) \
+    ((char *)(node) + APR_ALIGN_DEFAULT(sizeof(chash_node_t)))
+
+struct chash_table_t {
+    chash_node_t *volatile *array;
+    unsigned int            max;
+    chash_table_t          *retired;
+    apr_memnode_t          *memnode;
+};
+
+typedef struct chash_reader_t {
+    volatile apr_uint32_t count[2];
+    char pad[CHASH_CACHELINE - 2 * sizeof(apr_uint32_t)];
+} chash_reader_t;
+
+typedef struct chash_retired_t {
+    chash_node_t  *nodes;
+    chash_table_t *tables;
+} chash_retired_t;
+
+struct apr_chash_t {
+    chash_reader_t         readers[CHASH_READERS];
+    chash_table_t *volatile table;
+    volatile apr_uint32_t   count;
+    volatile apr_uint32_t   epoch;
+    /** Whether there is anything retired, read without the lock */
+    volatile apr_uint32_t   retiring;
+    apr_hashfunc_t          hash_func;
+    apr_pool_t             *pool;
+    apr_allocator_t        *allocator;
+    apr_slab_t             *slabs[CHASH_CLASSES];
+    /** Generations of retired entries, the last one is freed next */
+    chash_retired_t         retired[2];
+#if APR_HAS_THREADS
+    apr_thread_mutex_t     *stripes[CHASH_STRIPES];
+    apr_thread_mutex_t     *retired_lock;
+#endif
+};
+
+/*
+ * Data structure for iterating through a concurrent hash table, in a
+ * read section from apr_chash_first() until the end.
+ */
+struct apr_chash_index_t {
+    apr_chash_t    *ht;
+    chash_table_t  *table;
+    chash_node_t   *this;
+    unsigned int    index;
+    chash_reader_t *reader;
+    apr_uint32_t    epoch;
+    int             reading;
+};
+
+
+/*
+ * Read sections
+ */
+
+static APR_INLINE chash_reader_t *read_begin(apr_chash_t *ht,
+                                             apr_uint32_t *epoch)
+{
+    chash_reader_t *reader;
+    unsigned long id = 0;
+
+#if APR_HAS_THREADS
+    id = (unsigned long)apr_os_thread_current();
+    id ^= id >> 12;
+    id ^= id >> 7;
+#endif
+    reader = &ht->readers[id & (CHASH_READERS - 1)];
+    *epoch = apr_atomic_read32(&ht->epoch) & 1;
+    /* A full barrier, before reading the table */
+    apr_atomic_inc32(&reader->count[*epoch]);
+    return reader;
+}
+
+static APR_INLINE void read_end(chash_reader_t *reader, apr_uint32_t epoch)
+{
+    apr_atomic_dec32(&reader->count[epoch]);
+}
+
+
+/*
+ * Memory
+ */
+
+static chash_node_t *node_alloc(apr_chash_t *ht, apr_size_t klen)
+{
+    apr_size_t size = APR_ALIGN_DEFAULT(sizeof(chash_node_t)) + klen + 1;
+    chash_node_t *node;
+    apr_memnode_t *memnode;
+    int size_class;
+
+    for (size_class = 0; size_class < CHASH_CLASSES; size_class++) {
+        if (size <= (apr_size_t)CHASH_MIN_CLASS << size_class) {
+            node = apr_slab_alloc(ht->slabs[size_class]);
+            if (node) {
+                node->memnode = NULL;
+                node->size_class = size_class;
+            }
+            return node;
+        }
+    }
+
+    memnode = apr_allocator_alloc(ht->allocator, size);
+    if (!memnode) {
+        return NULL;
+    }
+    node = (chash_node_t *)memnode->first_avail;
+    node->memnode = memnode;
+    node->size_class = -1;
+    return node;
+}
+
+static void node_free(apr_chash_t *ht, chash_node_t *node)
+{
+    if (node->memnode) {
+        apr_allocator_free(ht->allocator, node->memnode);
+    }
+    else {
+        apr_slab_free(ht->slabs[node->size_class], node);
+    }
+}
+
+static chash_node_t *node_make(apr_chash_t *ht, unsigned int hash,
+                               const void *key, apr_ssize_t klen,
+                               const void *val)
+{
+    chash_node_t *node = node_alloc(ht, klen);
+
+    if (node) {
+        node->next = NULL;
+        node->val = (void *)val;
+        node->retired = NULL;
+        node->hash = hash;
+        node->klen = klen;
+        memcpy(NODE_KEY(node), key, klen);
+        /* Like the string keys given to apr_hash_t */
+        NODE_KEY(node)[klen] = '\0';
+    }
+    return node;
+}
+
+static chash_table_t *table_alloc(apr_chash_t *ht, unsigned int max)
+{
+    apr_size_t size = APR_ALIGN_DEFAULT(sizeof(chash_table_t))
+                      + sizeof(chash_node_t *) * ((apr_size_t)max + 1);
+    apr_memnode_t *memnode;
+    chash_table_t *table;
+
+    memnode = apr_allocator_alloc(ht->allocator, size);
+    if (!memnode) {
+        return NULL;
+    }
+    table = (chash_table_t *)memnode->first_avail;
+    table->array = (chash_node_t *volatile *)
+        ((char *)table + APR_ALIGN_DEFAULT(sizeof(chash_table_t)));
+    memset((void *)table->array, 0, sizeof(chash_node_t *) * (max + 1));
+    table->max = max;
+    table->retired = NULL;
+    table->memnode = memnode;
+    return table;
+}
+
+/* Free the table, and the entries still in it */
+static void table_free(apr_chash_t *ht, chash_table_t *table)
+{
+    chash_node_t *node, *next;
+    unsigned int i;
+
+    for (i = 0; i <= table->max; i++) {
+        for (node = table->array[i]; node; node = next) {
+            next = node->next;
+            node_free(ht, node);
+        }
+    }
+    apr_allocator_free(ht->allocator, table->memnode);
+}
+
+
+/*
+ * Locking and reclamation
+ */
+
+static APR_INLINE void stripe_lock(apr_chash_t *ht, unsigned int hash)
+{
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(ht->stripes[hash & (CHASH_STRIPES - 1)]);
+#endif
+}
+
+static APR_INLINE void stripe_unlock(apr_chash_t *ht, unsigned int hash)
+{
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(ht->stripes[hash & (CHASH_STRIPES - 1)]);
+#endif
+}
+
+static void stripes_lock(apr_chash_t *ht)
+{
+    unsigned int i;
+
+    for (i = 0; i < CHASH_STRIPES; i++) {
+        stripe_lock(ht, i);
+    }
+}
+
+static void stripes_unlock(apr_chash_t *ht)
+{
+    unsigned int i;
+
+    for (i = CHASH_STRIPES; i > 0; i--) {
+        stripe_unlock(ht, i - 1);
+    }
+}
+
+/* Free the last generation if the readers of the previous epoch are gone,
+ * with the retired lock held.
+ */
+static void reclaim(apr_chash_t *ht)
+{
+    apr_uint32_t old = (apr_atomic_read32(&ht->epoch) & 1) ^ 1;
+    chash_retired_t done;
+    chash_node_t *node;
+    chash_table_t *table;
+    unsigned int i;
+
+    for (i = 0; i < CHASH_READERS; i++) {
+        if (apr_atomic_read32(&ht->readers[i].count[old])) {
+            return;
+        }
+    }
+
+    done = ht->retired[1];
+    ht->retired[1] = ht->retired[0];
+    ht->retired[0].nodes = NULL;
+    ht->retired[0].tables = NULL;
+    apr_atomic_inc32(&ht->epoch);
+
+    while ((node = done.nodes) != NULL) {
+        done.nodes = node->retired;
+        node_free(ht, node);
+    }
+    while ((table = done.tables) != NULL) {
+        done.tables = table->retired;
+        table_free(ht, table);
+    }
+
+    if (!ht->retired[1].nodes && !ht->retired[1].tables) {
+        apr_atomic_set32(&ht->retiring, 0);
+    }
+}
+
+/* Retire what's unlinked (either may be NULL) and reclaim what can be,
+ * called without the stripe locks.
+ */
+static void retire(apr_chash_t *ht, chash_node_t *node, chash_table_t *table)
+{
+    if (!node && !table && !apr_atomic_read32(&ht->retiring)) {
+        return;
+    }
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(ht->retired_lock);
+#endif
+
+    if (node) {
+        node->retired = ht->retired[0].nodes;
+        ht->retired[0].nodes = node;
+    }
+    if (table) {
+        table->retired = ht->retired[0].tables;
+        ht->retired[0].tables = table;
+    }
+    if (node || table) {
+        apr_atomic_set32(&ht->retiring, 1);
+    }
+    reclaim(ht);
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(ht->retired_lock);
+#endif
+}
+
+/* Double the table if it's fuller than one entry per bucket, returns the
+ * table to retire (if any).
+ */
+static chash_table_t *expand_table(apr_chash_t *ht)
+{
+    chash_table_t *old, *table;
+    chash_node_t *node, *copy;
+    unsigned int i, j;
+
+    stripes_lock(ht);
+
+    old = ht->table;
+    if (apr_atomic_read32(&ht->count) <= old->max
+        || old->max >= APR_UINT32_MAX / 4
+        || (table = table_alloc(ht, old->max * 2 + 1)) == NULL) {
+        stripes_unlock(ht);
+        return NULL;
+    }
+
+    /* The readers still walk the old entries, copy them */
+    for (i = 0; i <= old->max; i++) {
+        for (node = old->array[i]; node; node = node->next) {
+            copy = node_make(ht, node->hash, NODE_KEY(node), node->klen,
+                             node->val);
+            if (!copy) {
+                /* Try again next time */
+                table_free(ht, table);
+                stripes_unlock(ht);
+                return NULL;
+            }
+            j = node->hash & table->max;
+            copy->next = table->array[j];
+            table->array[j] = copy;
+        }
+    }
+    apr_atomic_xchgptr((void *volatile *)&ht->table, table);
+
+    stripes_unlock(ht);
+
+    return old;
+}
+
+
+/*
+ * Hash table functions
+ */
+
+/* Give all the memory back to the allocator (and the slabs, cleaned up
+ * after this), since it's destroyed with the pool.
+ */
+static apr_status_t chash_cleanup(void *data)
+{
+    apr_chash_t *ht = data;
+    chash_node_t *node;
+    chash_table_t *table;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        while ((node = ht->retired[i].nodes) != NULL) {
+            ht->retired[i].nodes = node->retired;
+            node_free(ht, node);
+        }
+        while ((table = ht->retired[i].tables) != NULL) {
+            ht->retired[i].tables = table->retired;
+            table_free(ht, table);
+        }
+    }
+    table_free(ht, ht->table);
+    ht->table = NULL;
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_chash_create(apr_chash_t **newht,
+                                           apr_hashfunc_t hash_func,
+                                           apr_pool_t *pool)
+{
+    apr_allocator_t *allocator;
+    apr_chash_t *ht;
+    apr_pool_t *p;
+    apr_status_t rv;
+    int i;
+
+    *newht = NULL;
+
+    rv = apr_allocator_create(&allocator);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    rv = apr_pool_create_ex(&p, pool, NULL, allocator);
+    if (rv != APR_SUCCESS) {
+        apr_allocator_destroy(allocator);
+        return rv;
+    }
+    apr_allocator_owner_set(allocator, p);
+    apr_pool_tag(p, "apr_chash");
+
+    ht = apr_pcalloc(p, sizeof(*ht));
+    ht->pool = p;
+    ht->allocator = allocator;
+    ht->hash_func = hash_func ? hash_func : apr_hashfunc_default;
+
+#if APR_HAS_THREADS
+    {
+        apr_thread_mutex_t *mutex;
+
+        /* The slabs and the tables share the allocator */
+        rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT, p);
+        if (rv != APR_SUCCESS) {
+            goto fail;
+        }
+        apr_allocator_mutex_set(allocator, mutex);
+    }
+    for (i = 0; i < CHASH_STRIPES; i++) {
+        rv = apr_thread_mutex_create(&ht->stripes[i],
+                                     APR_THREAD_MUTEX_DEFAULT, p);
+        if (rv != APR_SUCCESS) {
+            goto fail;
+        }
+    }
+    rv = apr_thread_mutex_create(&ht->retired_lock,
+                                 APR_THREAD_MUTEX_DEFAULT, p);
+    if (rv != APR_SUCCESS) {
+        goto fail;
+    }
+#endif
+
+    for (i = 0; i < CHASH_CLASSES; i++) {
+        rv = apr_slab_create(&ht->slabs[i], (apr_size_t)CHASH_MIN_CLASS << i,
+#if APR_HAS_THREADS
+                             APR_SLAB_THREAD_SAFE,
+#else
+                             0,
+#endif
+                             p);
+        if (rv != APR_SUCCESS) {
+            goto fail;
+        }
+    }
+
+    ht->table = table_alloc(ht, CHASH_INITIAL_MAX);
+    if (!ht->table) {
+        rv = APR_ENOMEM;
+        goto fail;
+    }
+    apr_pool_cleanup_register(p, ht, chash_cleanup, apr_pool_cleanup_null);
+
+    *newht = ht;
+    return APR_SUCCESS;
+
+fail:
+    apr_pool_destroy(p);
+    return rv;
+}
+
+APR_DECLARE(void) apr_chash_destroy(apr_chash_t *ht)
+{
+    apr_pool_destroy(ht->pool);
+}
+
+APR_DECLARE(void *) apr_chash_get(apr_chash_t *ht, const void *key,
+                                  apr_ssize_t klen)
+{
+    unsigned int hash = ht->hash_func(key, &klen);
+    chash_reader_t *reader;
+    chash_table_t *table;
+    chash_node_t *node;
+    apr_uint32_t epoch;
+    void *val = NULL;
+
+    reader = read_begin(ht, &epoch);
+
+    table = ht->table;
+    for (node = table->array[hash & table->max]; node; node = node->next) {
+        if (node->hash == hash
+            && node->klen == klen
+            && memcmp(NODE_KEY(node), key, klen) == 0) {
+            val = node->val;
+            break;
+        }
+    }
+
+    read_end(reader, epoch);
+
+    return val;
+}
+
+/*
+ * Set, or get or set, the value of the key, under the stripe lock.
+ */
+static void *chash_set(apr_chash_t *ht, const void *key, apr_ssize_t klen,
+                       const void *val, int get, apr_status_t *rv)
+{
+    unsigned int hash = ht->hash_func(key, &klen);
+    chash_node_t *volatile *prev, *node, *retired = NULL;
+    chash_table_t *table, *expanded = NULL;
+    unsigned int max;
+    void *ret = NULL;
+    int added = 0;
+
+    *rv = APR_SUCCESS;
+
+    stripe_lock(ht, hash);
+
+    /* Can't change while we hold a stripe */
+    table = ht->table;
+    max = table->max;
+    for (prev = &table->array[hash & max]; (node = *prev) != NULL;
+         prev = &node->next) {
+        if (node->hash == hash
+            && node->klen == klen
+            && memcmp(NODE_KEY(node), key, klen) == 0)
+            break;
+    }
+
+    if (node) {
+        if (get) {
+            ret = node->val;
+        }
+        else if (val) {
+            apr_atomic_xchgptr(&node->val, (void *)val);
+        }
+        else {
+            /* The readers on it keep walking from it */
+            apr_atomic_xchgptr((void *volatile *)prev, node->next);
+            apr_atomic_dec32(&ht->count);
+            retired = node;
+        }
+    }
+    else if (val) {
+        node = node_make(ht, hash, key, klen, val);
+        if (node) {
+            node->next = table->array[hash & max];
+            apr_atomic_xchgptr((void *volatile *)&table->array[hash & max],
+                               node);
+            apr_atomic_inc32(&ht->count);
+            ret = (void *)val;
+            added = 1;
+        }
+        else {
+            *rv = APR_ENOMEM;
+        }
+    }
+
+    stripe_unlock(ht, hash);
+
+    /* The table may be retired already, don't look at it anymore */
+    if (added && apr_atomic_read32(&ht->count) > max) {
+        expanded = expand_table(ht);
+    }
+    retire(ht, retired, expanded);
+
+    return ret;
+}
+
+APR_DECLARE(apr_status_t) apr_chash_set(apr_chash_t *ht, const void *key,
+                                        apr_ssize_t klen, const void *val)
+{
+    apr_status_t rv;
+
+    chash_set(ht, key, klen, val, 0, &rv);
+    return rv;
+}
+
+APR_DECLARE(void *) apr_chash_get_or_set(apr_chash_t *ht, const void *key,
+                                         apr_ssize_t klen, const void *val)
+{
+    apr_status_t rv;
+
+    return chash_set(ht, key, klen, val, 1, &rv);
+}
+
+APR_DECLARE(unsigned int) apr_chash_count(apr_chash_t *ht)
+{
+    return apr_atomic_read32(&ht->count);
+}
+
+static apr_chash_index_t *chash_first(apr_chash_index_t *hi,
+                                      apr_chash_t *ht);
+
+APR_DECLARE(void) apr_chash_clear(apr_chash_t *ht)
+{
+    chash_table_t *old, *table;
+
+    stripes_lock(ht);
+
+    old = ht->table;
+    table = table_alloc(ht, CHASH_INITIAL_MAX);
+    if (table) {
+        apr_atomic_xchgptr((void *volatile *)&ht->table, table);
+        apr_atomic_set32(&ht->count, 0);
+    }
+
+    stripes_unlock(ht);
+
+    if (table) {
+        retire(ht, NULL, old);
+    }
+    else {
+        /* No memory for a new table, delete the entries one by one */
+        apr_chash_index_t hix, *hi;
+
+        for (hi = chash_first(&hix, ht); hi; hi = apr_chash_next(hi)) {
+            apr_chash_set(ht, NODE_KEY(hi->this), hi->this->klen, NULL);
+        }
+    }
+}
+
+
+/*
+ * Iteration
+ */
+
+APR_DECLARE(apr_chash_index_t *) apr_chash_next(apr_chash_index_t *hi)
+{
+    if (!hi->reading) {
+        return NULL;
+    }
+
+    hi->this = hi->this ? hi->this->next : NULL;
+    while (!hi->this) {
+        if (hi->index > hi->table->max) {
+            apr_chash_stop(hi);
+            return NULL;
+        }
+        hi->this = hi->table->array[hi->index++];
+    }
+    return hi;
+}
+
+static apr_chash_index_t *chash_first(apr_chash_index_t *hi, apr_chash_t *ht)
+{
+    hi->ht = ht;
+    hi->reader = read_begin(ht, &hi->epoch);
+    hi->reading = 1;
+    hi->table = ht->table;
+    hi->index = 0;
+    hi->this = NULL;
+    return apr_chash_next(hi);
+}
+
+APR_DECLARE(apr_chash_index_t *) apr_chash_first(apr_pool_t *p,
+                                                 apr_chash_t *ht)
+{
+    return chash_first(apr_palloc(p, sizeof(apr_chash_index_t)), ht);
+}
+
+APR_DECLARE(void) apr_chash_stop(apr_chash_index_t *hi)
+{
+    if (hi->reading) {
+        hi->reading = 0;
+        hi->this = NULL;
+        read_end(hi->reader, hi->epoch);
+    }
+}
+
+APR_DECLARE(void) apr_chash_this(apr_chash_index_t *hi, const void **key,
+                                 apr_ssize_t *klen, void **val)
+{
+    if (key)  *key  = NODE_KEY(hi->this);
+    if (klen) *klen = hi->this->klen;
+    if (val)  *val  = hi->this->val;
+}
+
+APR_DECLARE(const void *) apr_chash_this_key(apr_chash_index_t *hi)
+{
+    return NODE_KEY(hi->this);
+}
+
+APR_DECLARE(apr_ssize_t) apr_chash_this_key_len(apr_chash_index_t *hi)
+{
+    return hi->this->klen;
+}
+
+APR_DECLARE(void *) apr_chash_this_val(apr_chash_index_t *hi)
+{
+    return hi->this->val;
+}
+
+APR_DECLARE(int) apr_chash_do(apr_hash_do_callback_fn_t *comp,
+                              void *rec, apr_chash_t *ht)
+{
+    apr_chash_index_t hix, *hi;
+    int rv = 1;
+
+    for (hi = chash_first(&hix, ht); hi; hi = apr_chash_next(hi)) {
+        rv = (*comp)(rec, NODE_KEY(hi->this), hi->this->klen, hi->this->val);
+        if (!rv) {
+            apr_chash_stop(hi);
+            return 0;
+        }
+    }
+    return rv;
+}
@@ -0,0 +1,283 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_private.h"
+
+#include "apr_flatmap.h"
+#include "apr_strings.h"
+#define APR_WANT_MEMFUNC
+#define APR_WANT_STRFUNC
+#include "apr_want.h"
+
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>     /* for qsort */
+#endif
+
+/*
+ * The entries are stored in the order of a breadth-first walk of the
+ * complete binary search tree of the sorted keys (Eytzinger layout):
+ * the children of the entry k (counting from 1) are 2k and 2k+1.  The top
+ * of the tree, which every lookup goes through, is thus packed in the
+ * first cache lines, and a lookup descends without testing for a match,
+ * going right when the entry is less than the key; the entry found is the
+ * last one it went left at.
+ *
+ * Each entry has the first bytes of its key as a big-endian integer, so
+ * most comparisons are a single integer one, without following the key.
+ *
+ * The whole map is one block (header, entries and keys) and the keys are
+ * referred to by their offset in it, so copying the map is a memcpy().
+ */
+
+typedef struct flatmap_entry_t {
+    apr_uint64_t prefix;
+    apr_size_t koff;
+    apr_size_t klen;
+    const void *val;
+} flatmap_entry_t;
+
+struct apr_flatmap_t {
+    apr_size_t size;
+    unsigned int count;
+    /* The entries follow, then the keys */
+};
+
+#define FLATMAP_ENTRIES_OFFSET APR_ALIGN_DEFAULT(sizeof(apr_flatmap_t))
+
+static APR_INLINE const flatmap_entry_t *flatmap_entries(const apr_flatmap_t *fm)
+{
+    return (const flatmap_entry_t *)((const char *)fm + FLATMAP_ENTRIES_OFFSET);
+}
+
+#define FLATMAP_KEY(fm, e) ((const char *)(fm) + (e)->koff)
+
+static APR_INLINE apr_uint64_t flatmap_prefix(const unsigned char *key,
+                                              apr_size_t klen)
+{
+    apr_uint64_t prefix = 0;
+    apr_size_t i;
+
+    for (i = 0; i < sizeof(prefix); i++) {
+        prefix = (prefix << 8) | (i < klen ? key[i] : 0);
+    }
+    return prefix;
+}
+
+static APR_INLINE int flatmap_keycmp(const void *k1, apr_size_t l1,
+                                     const void *k2, apr_size_t l2)
+{
+    int rv = memcmp(k1, k2, l1 < l2 ? l1 : l2);
+
+    if (!rv) {
+        rv = (l1 > l2) - (l1 < l2);
+    }
+    return rv;
+}
+
+/* The same as flatmap_keycmp(), the prefixes first.  The zero padding of
+ * the prefixes keeps their order that of the keys.
+ */
+static APR_INLINE int flatmap_compare(apr_uint64_t p1, const void *k1,
+                                      apr_size_t l1, apr_uint64_t p2,
+                                      const void *k2, apr_size_t l2)
+{
+    if (p1 != p2) {
+        return p1 < p2 ? -1 : 1;
+    }
+    return flatmap_keycmp(k1, l1, k2, l2);
+}
+
+typedef struct flatmap_sort_t {
+    const apr_flatmap_pair_t *pair;
+    apr_size_t klen;
+    apr_uint64_t prefix;
+    int n;
+} flatmap_sort_t;
+
+static int flatmap_sort_cmp(const void *a, const void *b)
+{
+    const flatmap_sort_t *s1 = a, *s2 = b;
+    int rv;
+
+    rv = flatmap_compare(s1->prefix, s1->pair->key, s1->klen,
+                         s2->prefix, s2->pair->key, s2->klen);
+    if (!rv) {
+        /* Keep the duplicates in the order they were given */
+        rv = (s1->n > s2->n) - (s1->n < s2->n);
+    }
+    return rv;
+}
+
+/* Fill the subtree of the entry k with the sorted elements from *i */
+static void flatmap_fill(apr_flatmap_t *fm, flatmap_entry_t *entries,
+                         const flatmap_sort_t *sorted, unsigned int *i,
+                         apr_size_t k, apr_size_t *koff)
+{
+    if (k <= fm->count) {
+        const flatmap_sort_t *s;
+        flatmap_entry_t *e = &entries[k - 1];
+
+        flatmap_fill(fm, entries, sorted, i, 2 * k, koff);
+
+        s = &sorted[(*i)++];
+        e->prefix = s->prefix;
+        e->klen = s->klen;
+        e->val = s->pair->val;
+        e->koff = *koff;
+        memcpy((char *)fm + *koff, s->pair->key, s->klen);
+        ((char *)fm)[*koff + s->klen] = '\0';
+        *koff += s->klen + 1;
+
+        flatmap_fill(fm, entries, sorted, i, 2 * k + 1, koff);
+    }
+}
+
+APR_DECLARE(apr_status_t) apr_flatmap_make(apr_flatmap_t **fm,
+                                           const apr_array_header_t *pairs,
+                                           apr_pool_t *p)
+{
+    const apr_flatmap_pair_t *elts;
+    flatmap_sort_t *sorted;
+    apr_flatmap_t *map;
+    apr_size_t size, koff;
+    unsigned int i, n;
+
+    if (pairs->elt_size != sizeof(apr_flatmap_pair_t)) {
+        return APR_EINVAL;
+    }
+    elts = (const apr_flatmap_pair_t *)pairs->elts;
+
+    sorted = malloc((pairs->nelts ? pairs->nelts : 1) * sizeof(*sorted));
+    if (!sorted) {
+        return APR_ENOMEM;
+    }
+    for (i = 0; i < (unsigned int)pairs->nelts; i++) {
+        sorted[i].pair = &elts[i];
+        sorted[i].klen = elts[i].klen == APR_HASH_KEY_STRING
+                         ? strlen(elts[i].key) : (apr_size_t)elts[i].klen;
+        sorted[i].prefix = flatmap_prefix(elts[i].key, sorted[i].klen);
+        sorted[i].n = i;
+    }
+    qsort(sorted, pairs->nelts, sizeof(*sorted), flatmap_sort_cmp);
+
+    /* Keep the last of the duplicates */
+    size = 0;
+    for (i = n = 0; i < (unsigned int)pairs->nelts; i++) {
+        if (i + 1 < (unsigned int)pairs->nelts
+            && !flatmap_keycmp(sorted[i].pair->key, sorted[i].klen,
+                               sorted[i + 1].pair->key, sorted[i + 1].klen)) {
+            continue;
+        }
+        sorted[n++] = sorted[i];
+        size += sorted[i].klen + 1;
+    }
+
+    koff = FLATMAP_ENTRIES_OFFSET + n * sizeof(flatmap_entry_t);
+    size += koff;
+    map = apr_palloc(p, size);
+    map->size = size;
+    map->count = n;
+    i = 0;
+    flatmap_fill(map, (flatmap_entry_t *)flatmap_entries(map), sorted, &i, 1,
+                 &koff);
+
+    free(sorted);
+    *fm = map;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_flatmap_t *) apr_flatmap_copy(apr_pool_t *p,
+                                              const apr_flatmap_t *fm)
+{
+    return apr_pmemdup(p, fm, fm->size);
+}
+
+APR_DECLARE(void *) apr_flatmap_get(const apr_flatmap_t *fm, const void *key,
+                                    apr_ssize_t klen)
+{
+    const flatmap_entry_t *entries = flatmap_entries(fm), *e;
+    apr_size_t len, k = 1, n = fm->count;
+    apr_uint64_t prefix;
+
+    len = klen == APR_HASH_KEY_STRING ? strlen(key) : (apr_size_t)klen;
+    prefix = flatmap_prefix(key, len);
+
+    while (k <= n) {
+        e = &entries[k - 1];
+        k = 2 * k + (flatmap_compare(e->prefix, FLATMAP_KEY(fm, e), e->klen,
+                                     prefix, key, len) < 0);
+    }
+    /* Back up to where it last went left (past the right turns) */
+    while (k & 1) {
+        k >>= 1;
+    }
+    k >>= 1;
+    if (!k) {
+        return NULL;
+    }
+
+    e = &entries[k - 1];
+    if (e->prefix != prefix || e->klen != len
+        || memcmp(FLATMAP_KEY(fm, e), key, len)) {
+        return NULL;
+    }
+    return (void *)e->val;
+}
+
+APR_DECLARE(unsigned int) apr_flatmap_count(const apr_flatmap_t *fm)
+{
+    return fm->count;
+}
+
+APR_DECLARE(apr_size_t) apr_flatmap_size(const apr_flatmap_t *fm)
+{
+    return fm->size;
+}
+
+APR_DECLARE(int) apr_flatmap_do(apr_hash_do_callback_fn_t *comp,
+                                void *rec, const apr_flatmap_t *fm)
+{
+    const flatmap_entry_t *entries = flatmap_entries(fm), *e;
+    apr_size_t k = 1, n = fm->count;
+
+    if (!n) {
+        return 1;
+    }
+
+    /* In-order walk of the tree, from the leftmost entry */
+    while (2 * k <= n) {
+        k = 2 * k;
+    }
+    while (k) {
+        e = &entries[k - 1];
+        if (!comp(rec, FLATMAP_KEY(fm, e), e->klen, e->val)) {
+            return 0;
+        }
+        if (2 * k + 1 <= n) {
+            k = 2 * k + 1;
+            while (2 * k <= n) {
+                k = 2 * k;
+            }
+        }
+        else {
+            while (k & 1) {
+                k >>= 1;
+            }
+            k >>= 1;
+        }
+    }
+    return 1;
+}
@@ -21,6 +21,9 @@
 #include "apr_time.h"
 
 #include "apr_hash.h"
+#include "apr_strings.h"
+#include "apr_atomic.h"
+#include "apr_thread_pool.h"
 
 #if APR_HAVE_STDLIB_H
 #include <stdlib.h>
@@ -52,16 +55,42 @@ struct apr_hash_entry_t {
     const void       *val;
 };
 
+/*
+ * With APR_HASH_OPEN_ADDRESSING, the entries are stored inline in an
+ * array of slots instead, probed linearly from the hash of the key. A
+ * parallel array of control bytes tells whether each slot is empty,
+ * deleted, or full, in which case it holds the top bits of the hash of
+ * the entry. Probing mostly reads the control bytes, which are packed
+ * together.
+ */
+
+typedef struct apr_hash_slot_t apr_hash_slot_t;
+
+struct apr_hash_slot_t {
+    unsigned int      hash;
+    const void       *key;
+    apr_ssize_t       klen;
+    const void       *val;
+};
+
+#define CTRL_EMPTY      0x80
+#define CTRL_DELETED    0xFE
+#define CTRL_FULL(c)    ((c) < 0x80)
+#define CTRL_HASH(hash) ((unsigned char)((hash) >> 25))
+
 /*
  * Data structure for iterating through a hash table.
  *
  * We keep a pointer to the next hash entry here to allow the current
  * hash entry to be freed or otherwise mangled between calls to
- * apr_hash_next().
+ * apr_hash_next(). The slots (and the entries of an incremental table
+ * being expanded) never move but when an entry is added, so the slot of
+ * the current entry can be deleted too.
  */
 struct apr_hash_index_t {
     apr_hash_t         *ht;
     apr_hash_entry_t   *this, *next;
+    apr_hash_slot_t    *slot;
     unsigned int        index;
 };
 
@@ -79,10 +108,33 @@ struct apr_hash_t {
     unsigned int         count, max, seed;
     apr_hashfunc_t       hash_func;
     apr_hash_entry_t    *free;  /* List of recycled entries */
+    apr_uint32_t         flags;
+    /* With APR_HASH_OPEN_ADDRESSING (ctrl != NULL), max + 1 slots and
+     * control bytes, and the number of deleted slots.
+     */
+    unsigned char       *ctrl;
+    apr_hash_slot_t     *slots;
+    unsigned int         deleted;
+    /* With APR_HASH_INCREMENTAL, while the array is expanded, the previous
+     * one whose buckets below moved have been moved to the new one. The
+     * buckets of the new array are not initialized until then.
+     */
+    apr_hash_entry_t   **old_array;
+    unsigned int         old_max, moved;
 };
 
 #define INITIAL_MAX 15 /* tunable == 2^n - 1 */
 
+/* The load factor (including the deleted slots) above which the open
+ * addressing table is rebuilt, in eighths.
+ */
+#define OPEN_MAX_LOAD 6
+
+/* The number of buckets moved to the expanded array of an incremental
+ * table per entry added.
+ */
+#define MOVE_BUCKETS 4
+
 
 /*
  * Hash creation functions.
@@ -93,7 +145,18 @@ static apr_hash_entry_t **alloc_array(apr_hash_t *ht, unsigned int max)
    return apr_pcalloc(ht->pool, sizeof(*ht->array) * (max + 1));
 }
 
-APR_DECLARE(apr_hash_t *) apr_hash_make(apr_pool_t *pool)
+static void alloc_slots(apr_hash_t *ht, unsigned int max)
+{
+    ht->ctrl = apr_palloc(ht->pool, max + 1);
+    memset(ht->ctrl, CTRL_EMPTY, max + 1);
+    ht->slots = apr_palloc(ht->pool, sizeof(*ht->slots) * (max + 1));
+    ht->max = max;
+    ht->deleted = 0;
+}
+
+APR_DECLARE(apr_hash_t *) apr_hash_make_ex(apr_pool_t *pool,
+                                           apr_hashfunc_t hash_func,
+                                           apr_uint32_t flags)
 {
     apr_hash_t *ht;
     apr_time_t now = apr_time_now();
@@ -101,22 +164,37 @@ APR_DECLARE(apr_hash_t *) apr_hash_make(apr_pool_t *pool)
     ht = apr_palloc(pool, sizeof(apr_hash_t));
     ht->pool = pool;
     ht->free = NULL;
+    ht->flags = flags;
     ht->count = 0;
     ht->max = INITIAL_MAX;
+    ht->old_array = NULL;
+    ht->old_max = ht->moved = 0;
     ht->seed = (unsigned int)((now >> 32) ^ now ^ (apr_uintptr_t)pool ^
                               (apr_uintptr_t)ht ^ (apr_uintptr_t)&now) - 1;
-    ht->array = alloc_array(ht, ht->max);
-    ht->hash_func = NULL;
+    if (flags & APR_HASH_OPEN_ADDRESSING) {
+        ht->array = NULL;
+        alloc_slots(ht, INITIAL_MAX);
+    }
+    else {
+        ht->array = alloc_array(ht, ht->max);
+        ht->ctrl = NULL;
+        ht->slots = NULL;
+        ht->deleted = 0;
+    }
+    ht->hash_func = hash_func;
 
     return ht;
 }
 
+APR_DECLARE(apr_hash_t *) apr_hash_make(apr_pool_t *pool)
+{
+    return apr_hash_make_ex(pool, NULL, 0);
+}
+
 APR_DECLARE(apr_hash_t *) apr_hash_make_custom(apr_pool_t *pool,
                                                apr_hashfunc_t hash_func)
 {
-    apr_hash_t *ht = apr_hash_make(pool);
-    ht->hash_func = hash_func;
-    return ht;
+    return apr_hash_make_ex(pool, hash_func, 0);
 }
 
 
@@ -124,14 +202,43 @@ APR_DECLARE(apr_hash_t *) apr_hash_make_custom(apr_pool_t *pool,
  * Hash iteration functions.
  */
 
+/* The number of buckets iterated, those of both arrays of an incremental
+ * table being expanded.
+ */
+static APR_INLINE unsigned int iter_size(const apr_hash_t *ht)
+{
+    return ht->max + 1 + (ht->old_array ? ht->old_max + 1 : 0);
+}
+
+/* The bucket at an index of the iteration, skipping those not moved to */
+static APR_INLINE apr_hash_entry_t *iter_bucket(const apr_hash_t *ht,
+                                                unsigned int i)
+{
+    if (i > ht->max)
+        return ht->old_array[i - ht->max - 1];
+    if (!ht->old_array || (i & ht->old_max) < ht->moved)
+        return ht->array[i];
+    return NULL;
+}
+
 APR_DECLARE(apr_hash_index_t *) apr_hash_next(apr_hash_index_t *hi)
 {
+    if (hi->ht->ctrl) {
+        while (hi->index <= hi->ht->max) {
+            if (CTRL_FULL(hi->ht->ctrl[hi->index])) {
+                hi->slot = &hi->ht->slots[hi->index++];
+                return hi;
+            }
+            hi->index++;
+        }
+        return NULL;
+    }
+
     hi->this = hi->next;
     while (!hi->this) {
-        if (hi->index > hi->ht->max)
+        if (hi->index >= iter_size(hi->ht))
             return NULL;
-
-        hi->this = hi->ht->array[hi->index++];
+        hi->this = iter_bucket(hi->ht, hi->index++);
     }
     hi->next = hi->this->next;
     return hi;
@@ -149,6 +256,7 @@ APR_DECLARE(apr_hash_index_t *) apr_hash_first(apr_pool_t *p, apr_hash_t *ht)
     hi->index = 0;
     hi->this = NULL;
     hi->next = NULL;
+    hi->slot = NULL;
     return apr_hash_next(hi);
 }
 
@@ -157,6 +265,12 @@ APR_DECLARE(void) apr_hash_this(apr_hash_index_t *hi,
                                 apr_ssize_t *klen,
                                 void **val)
 {
+    if (hi->slot) {
+        if (key)  *key  = hi->slot->key;
+        if (klen) *klen = hi->slot->klen;
+        if (val)  *val  = (void *)hi->slot->val;
+        return;
+    }
     if (key)  *key  = hi->this->key;
     if (klen) *klen = hi->this->klen;
     if (val)  *val  = (void *)hi->this->val;
@@ -190,23 +304,95 @@ APR_DECLARE(void *) apr_hash_this_val(apr_hash_index_t *hi)
  * Expanding a hash table
  */
 
-static void expand_array(apr_hash_t *ht)
+/*
+ * Move up to n buckets of the old array of an incremental table to the
+ * new one, each to the two buckets its entries may hash to.
+ */
+static void move_buckets(apr_hash_t *ht, unsigned int n)
 {
-    apr_hash_index_t *hi;
-    apr_hash_entry_t **new_array;
-    unsigned int new_max;
+    apr_hash_entry_t *he, *next;
+    unsigned int i;
+
+    while (n-- && ht->old_array) {
+        ht->array[ht->moved] = NULL;
+        ht->array[ht->moved + ht->old_max + 1] = NULL;
+        for (he = ht->old_array[ht->moved]; he; he = next) {
+            next = he->next;
+            i = he->hash & ht->max;
+            he->next = ht->array[i];
+            ht->array[i] = he;
+        }
+        ht->old_array[ht->moved] = NULL;
+        if (++ht->moved > ht->old_max) {
+            ht->old_array = NULL;
+            ht->old_max = ht->moved = 0;
+        }
+    }
+}
+
+/* The bucket of the hash, in the old array if not moved yet */
+static APR_INLINE apr_hash_entry_t **find_bucket(apr_hash_t *ht,
+                                                unsigned int hash)
+{
+    if (ht->old_array && (hash & ht->old_max) >= ht->moved)
+        return &ht->old_array[hash & ht->old_max];
+    return &ht->array[hash & ht->max];
+}
+
+static void resize_array(apr_hash_t *ht, unsigned int new_max)
+{
+    apr_hash_entry_t **new_array, *he, *next;
+    unsigned int i;
+
+    move_buckets(ht, ht->old_max + 1);
 
-    new_max = ht->max * 2 + 1;
     new_array = alloc_array(ht, new_max);
-    for (hi = apr_hash_first(NULL, ht); hi; hi = apr_hash_next(hi)) {
-        unsigned int i = hi->this->hash & new_max;
-        hi->this->next = new_array[i];
-        new_array[i] = hi->this;
+    for (i = 0; i <= ht->max; i++) {
+        for (he = ht->array[i]; he; he = next) {
+            next = he->next;
+            he->next = new_array[he->hash & new_max];
+            new_array[he->hash & new_max] = he;
+        }
     }
     ht->array = new_array;
     ht->max = new_max;
 }
 
+static void expand_array(apr_hash_t *ht)
+{
+    if (!(ht->flags & APR_HASH_INCREMENTAL)) {
+        resize_array(ht, ht->max * 2 + 1);
+        return;
+    }
+
+    /* Finish the previous expansion, then start moving the buckets to
+     * an array not initialized until then, so that no operation walks
+     * (or clears) the whole table.
+     */
+    move_buckets(ht, ht->old_max + 1);
+    ht->old_array = ht->array;
+    ht->old_max = ht->max;
+    ht->moved = 0;
+    ht->max = ht->max * 2 + 1;
+    ht->array = apr_palloc(ht->pool, sizeof(*ht->array) * (ht->max + 1));
+}
+
+/*
+ * After an entry was added: move some buckets if the table is being
+ * expanded, otherwise check that the collision rate isn't too high.
+ * Lookups, replacements and deletions don't move the entries, so they
+ * can be done while iterating.
+ */
+static APR_INLINE void entry_added(apr_hash_t *ht)
+{
+    if (ht->old_array) {
+        move_buckets(ht, MOVE_BUCKETS);
+    }
+    else if (ht->count > ht->max) {
+        expand_array(ht);
+    }
+}
+
 static unsigned int hashfunc_default(const char *char_key, apr_ssize_t *klen,
                                      unsigned int hash)
 {
@@ -273,6 +459,238 @@ APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_default(const char *char_key,
     return hashfunc_default(char_key, klen, 0);
 }
 
+/*
+ * A word at a time hash for longer keys, after wyhash by Wang Yi (public
+ * domain): 8 bytes are mixed at once by multiplying them (128 bits) with
+ * the constants and folding the product, which is both fast and seeded
+ * all along (not only at the start like the `times 33' loop).
+ */
+
+#define FAST_P0 APR_UINT64_C(0xa0761d6478bd642f)
+#define FAST_P1 APR_UINT64_C(0xe7037ed1a0b428db)
+#define FAST_P2 APR_UINT64_C(0x8ebc6af09c88c6e3)
+
+static APR_INLINE apr_uint64_t fast_mix(apr_uint64_t a, apr_uint64_t b)
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = (__uint128_t)a * b;
+    return (apr_uint64_t)r ^ (apr_uint64_t)(r >> 64);
+#else
+    apr_uint64_t ha = a >> 32, la = (apr_uint32_t)a;
+    apr_uint64_t hb = b >> 32, lb = (apr_uint32_t)b;
+    apr_uint64_t hh = ha * hb, hl = ha * lb, lh = la * hb, ll = la * lb;
+    apr_uint64_t t = ll + (hl << 32), lo, hi;
+
+    lo = t + (lh << 32);
+    hi = hh + (hl >> 32) + (lh >> 32) + (t < ll) + (lo < t);
+    return lo ^ hi;
+#endif
+}
+
+static APR_INLINE apr_uint64_t fast_read64(const unsigned char *p)
+{
+    apr_uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static APR_INLINE apr_uint64_t fast_read32(const unsigned char *p)
+{
+    apr_uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static unsigned int hashfunc_fast(const char *char_key, apr_ssize_t *klen,
+                                  unsigned int hash)
+{
+    const unsigned char *p = (const unsigned char *)char_key;
+    apr_uint64_t seed = hash ^ FAST_P0, a, b;
+    apr_size_t len, i;
+
+    if (*klen == APR_HASH_KEY_STRING) {
+        *klen = strlen(char_key);
+    }
+    len = *klen;
+
+    if (len <= 16) {
+        if (len >= 4) {
+            apr_size_t off = (len >> 3) << 2;
+            a = (fast_read32(p) << 32) | fast_read32(p + off);
+            b = (fast_read32(p + len - 4) << 32)
+                | fast_read32(p + len - 4 - off);
+        }
+        else if (len > 0) {
+            a = ((apr_uint64_t)p[0] << 16) | ((apr_uint64_t)p[len >> 1] << 8)
+                | p[len - 1];
+            b = 0;
+        }
+        else {
+            a = b = 0;
+        }
+    }
+    else {
+        for (i = len; i > 16; i -= 16, p += 16) {
+            seed = fast_mix(fast_read64(p) ^ FAST_P1,
+                            fast_read64(p + 8) ^ seed);
+        }
+        /* The last 16 bytes, possibly overlapping the mixed ones */
+        a = fast_read64(p + i - 16);
+        b = fast_read64(p + i - 8);
+    }
+
+    a = fast_mix(FAST_P1 ^ len, fast_mix(a ^ FAST_P1, b ^ seed ^ FAST_P2));
+    return (unsigned int)(a ^ (a >> 32));
+}
+
+APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_fast(const char *char_key,
+                                                   apr_ssize_t *klen)
+{
+    return hashfunc_fast(char_key, klen, 0);
+}
+
+static APR_INLINE unsigned int hash_key(const apr_hash_t *ht,
+                                        const void *key, apr_ssize_t *klen)
+{
+    if (ht->hash_func)
+        return ht->hash_func(key, klen);
+    else if (ht->flags & APR_HASH_FAST_HASH)
+        return hashfunc_fast(key, klen, ht->seed);
+    else
+        return hashfunc_default(key, klen, ht->seed);
+}
+
+/*
+ * Open addressing.
+ *
+ * Find the slot of the key, or return -1 and where to insert it in *ins
+ * (the first deleted or empty slot of the probe sequence). There is always
+ * an empty slot to end the probing.
+ */
+static int find_slot(const apr_hash_t *ht, const void *key,
+                     apr_ssize_t klen, unsigned int hash, unsigned int *ins)
+{
+    unsigned char h = CTRL_HASH(hash), c;
+    unsigned int i = hash & ht->max;
+    int found_ins = 0;
+
+    for (;;) {
+        c = ht->ctrl[i];
+        if (c == h) {
+            const apr_hash_slot_t *slot = &ht->slots[i];
+            if (slot->hash == hash
+                && slot->klen == klen
+                && memcmp(slot->key, key, klen) == 0)
+                return i;
+        }
+        else if (!CTRL_FULL(c)) {
+            if (!found_ins) {
+                *ins = i;
+                found_ins = 1;
+            }
+            if (c == CTRL_EMPTY)
+                return -1;
+        }
+        i = (i + 1) & ht->max;
+    }
+}
+
+static APR_INLINE void fill_slot(apr_hash_t *ht, unsigned int i,
+                                 unsigned int hash, const void *key,
+                                 apr_ssize_t klen, const void *val)
+{
+    apr_hash_slot_t *slot = &ht->slots[i];
+
+    if (ht->ctrl[i] == CTRL_DELETED)
+        ht->deleted--;
+    ht->ctrl[i] = CTRL_HASH(hash);
+    slot->hash = hash;
+    slot->key  = key;
+    slot->klen = klen;
+    slot->val  = val;
+    ht->count++;
+}
+
+/* Rebuild the slots, new_max + 1 of them */
+static void rehash_slots(apr_hash_t *ht, unsigned int new_max)
+{
+    unsigned char *old_ctrl = ht->ctrl;
+    apr_hash_slot_t *old_slots = ht->slots;
+    unsigned int i, j, old_max = ht->max;
+
+    alloc_slots(ht, new_max);
+    ht->count = 0;
+    for (i = 0; i <= old_max; i++) {
+        if (CTRL_FULL(old_ctrl[i])) {
+            const apr_hash_slot_t *slot = &old_slots[i];
+            for (j = slot->hash & new_max; ht->ctrl[j] != CTRL_EMPTY;
+                 j = (j + 1) & new_max)
+                ;
+            fill_slot(ht, j, slot->hash, slot->key, slot->klen, slot->val);
+        }
+    }
+}
+
+/* Add the entry which is not in the table yet */
+static void insert_slot(apr_hash_t *ht, unsigned int ins, unsigned int hash,
+                        const void *key, apr_ssize_t klen, const void *val)
+{
+    if (ht->ctrl[ins] == CTRL_EMPTY
+        && (ht->count + ht->deleted + 1) * 8 > (ht->max + 1) * OPEN_MAX_LOAD) {
+        /* Doubled unless mostly deleted */
+        rehash_slots(ht, ht->count * 2 >= ht->max + 1 ? ht->max * 2 + 1
+                                                       : ht->max);
+        for (ins = hash & ht->max; CTRL_FULL(ht->ctrl[ins]);
+             ins = (ins + 1) & ht->max)
+            ;
+    }
+    fill_slot(ht, ins, hash, key, klen, val);
+}
+
+/* Deleting a slot followed by an empty one can't break a probe sequence */
+static void delete_slot(apr_hash_t *ht, unsigned int i)
+{
+    if (ht->ctrl[(i + 1) & ht->max] == CTRL_EMPTY) {
+        ht->ctrl[i] = CTRL_EMPTY;
+    }
+    else {
+        ht->ctrl[i] = CTRL_DELETED;
+        ht->deleted++;
+    }
+    ht->count--;
+}
+
+#define OPEN_GET        0
+#define OPEN_SET        1
+#define OPEN_GET_OR_SET 2
+
+static void *open_find(apr_hash_t *ht, const void *key, apr_ssize_t klen,
+                       const void *val, int op)
+{
+    unsigned int hash, ins = 0;
+    int i;
+
+    hash = hash_key(ht, key, &klen);
+    i = find_slot(ht, key, klen, hash, &ins);
+    if (i >= 0) {
+        if (op != OPEN_SET) {
+            return (void *)ht->slots[i].val;
+        }
+        if (val) {
+            ht->slots[i].val = val;
+        }
+        else {
+            delete_slot(ht, i);
+        }
+        return NULL;
+    }
+    if (op == OPEN_GET || !val) {
+        return NULL;
+    }
+    insert_slot(ht, ins, hash, key, klen, val);
+    return (void *)val;
+}
+
 /*
  * This is where we keep the details of the hash function and control
  * the maximum collision rate.
@@ -290,13 +708,10 @@ static apr_hash_entry_t **find_entry(apr_hash_t *ht,
     apr_hash_entry_t **hep, *he;
     unsigned int hash;
 
-    if (ht->hash_func)
-        hash = ht->hash_func(key, &klen);
-    else
-        hash = hashfunc_default(key, &klen, ht->seed);
+    hash = hash_key(ht, key, &klen);
 
     /* scan linked list */
-    for (hep = &ht->array[hash & ht->max], he = *hep;
+    for (hep = find_bucket(ht, hash), he = *hep;
          he; hep = &he->next, he = *hep) {
         if (he->hash == hash
             && he->klen == klen
@@ -326,8 +741,19 @@ APR_DECLARE(apr_hash_t *) apr_hash_copy(apr_pool_t *pool,
 {
     apr_hash_t *ht;
     apr_hash_entry_t *new_vals;
+    apr_hash_index_t hix, *hi;
     unsigned int i, j;
 
+    if (orig->ctrl) {
+        ht = apr_palloc(pool, sizeof(apr_hash_t));
+        *ht = *orig;
+        ht->pool = pool;
+        ht->ctrl = apr_pmemdup(pool, orig->ctrl, orig->max + 1);
+        ht->slots = apr_pmemdup(pool, orig->slots,
+                                sizeof(*ht->slots) * (orig->max + 1));
+        return ht;
+    }
+
     ht = apr_palloc(pool, sizeof(apr_hash_t) +
                     sizeof(*ht->array) * (orig->max + 1) +
                     sizeof(apr_hash_entry_t) * orig->count);
@@ -337,24 +763,32 @@ APR_DECLARE(apr_hash_t *) apr_hash_copy(apr_pool_t *pool,
     ht->max = orig->max;
     ht->seed = orig->seed;
     ht->hash_func = orig->hash_func;
+    ht->flags = orig->flags;
+    ht->ctrl = NULL;
+    ht->slots = NULL;
+    ht->deleted = 0;
+    ht->old_array = NULL;
+    ht->old_max = ht->moved = 0;
     ht->array = (apr_hash_entry_t **)((char *)ht + sizeof(apr_hash_t));
+    memset(ht->array, 0, sizeof(*ht->array) * (ht->max + 1));
 
     new_vals = (apr_hash_entry_t *)((char *)(ht) + sizeof(apr_hash_t) +
                                     sizeof(*ht->array) * (orig->max + 1));
     j = 0;
-    for (i = 0; i <= ht->max; i++) {
-        apr_hash_entry_t **new_entry = &(ht->array[i]);
-        apr_hash_entry_t *orig_entry = orig->array[i];
-        while (orig_entry) {
-            *new_entry = &new_vals[j++];
-            (*new_entry)->hash = orig_entry->hash;
-            (*new_entry)->key = orig_entry->key;
-            (*new_entry)->klen = orig_entry->klen;
-            (*new_entry)->val = orig_entry->val;
-            new_entry = &((*new_entry)->next);
-            orig_entry = orig_entry->next;
-        }
-        *new_entry = NULL;
+    /* Iterated to get the entries of both arrays of an incremental table
+     * being expanded, the copy has moved them all.
+     */
+    memset(&hix, 0, sizeof(hix));
+    hix.ht = (apr_hash_t *)orig;
+    for (hi = apr_hash_next(&hix); hi; hi = apr_hash_next(hi)) {
+        apr_hash_entry_t *new_entry = &new_vals[j++];
+        i = hi->this->hash & ht->max;
+        new_entry->hash = hi->this->hash;
+        new_entry->key = hi->this->key;
+        new_entry->klen = hi->this->klen;
+        new_entry->val = hi->this->val;
+        new_entry->next = ht->array[i];
+        ht->array[i] = new_entry;
     }
     return ht;
 }
@@ -364,6 +798,10 @@ APR_DECLARE(void *) apr_hash_get(apr_hash_t *ht,
                                  apr_ssize_t klen)
 {
     apr_hash_entry_t *he;
+
+    if (ht->ctrl) {
+        return open_find(ht, key, klen, NULL, OPEN_GET);
+    }
     he = *find_entry(ht, key, klen, NULL);
     if (he)
         return (void *)he->val;
@@ -377,6 +815,12 @@ APR_DECLARE(void) apr_hash_set(apr_hash_t *ht,
                                const void *val)
 {
     apr_hash_entry_t **hep;
+    unsigned int count = ht->count;
+
+    if (ht->ctrl) {
+        open_find(ht, key, klen, val, OPEN_SET);
+        return;
+    }
     hep = find_entry(ht, key, klen, val);
     if (*hep) {
         if (!val) {
@@ -390,9 +834,8 @@ APR_DECLARE(void) apr_hash_set(apr_hash_t *ht,
         else {
             /* replace entry */
             (*hep)->val = val;
-            /* check that the collision rate isn't too high */
-            if (ht->count > ht->max) {
-                expand_array(ht);
+            if (ht->count != count) {
+                entry_added(ht);
             }
         }
     }
@@ -405,12 +848,16 @@ APR_DECLARE(void *) apr_hash_get_or_set(apr_hash_t *ht,
                                         const void *val)
 {
     apr_hash_entry_t **hep;
+    unsigned int count = ht->count;
+
+    if (ht->ctrl) {
+        return open_find(ht, key, klen, val, OPEN_GET_OR_SET);
+    }
     hep = find_entry(ht, key, klen, val);
     if (*hep) {
         val = (*hep)->val;
-        /* check that the collision rate isn't too high */
-        if (ht->count > ht->max) {
-            expand_array(ht);
+        if (ht->count != count) {
+            entry_added(ht);
         }
         return (void *)val;
     }
@@ -423,13 +870,88 @@ APR_DECLARE(unsigned int) apr_hash_count(apr_hash_t *ht)
     return ht->count;
 }
 
+APR_DECLARE(void) apr_hash_reserve(apr_hash_t *ht, unsigned int n)
+{
+    unsigned int new_max = ht->max;
+
+    if (ht->ctrl) {
+        /* As many slots as needed for n entries below the load factor */
+        while (new_max < APR_UINT32_MAX / 16
+               && (apr_uint64_t)n * 8 > (apr_uint64_t)(new_max + 1)
+                                        * OPEN_MAX_LOAD) {
+            new_max = new_max * 2 + 1;
+        }
+        if (new_max > ht->max) {
+            rehash_slots(ht, new_max);
+        }
+        return;
+    }
+
+    while (new_max < n && new_max < APR_UINT32_MAX / 16) {
+        new_max = new_max * 2 + 1;
+    }
+    if (new_max > ht->max) {
+        resize_array(ht, new_max);
+    }
+}
+
 APR_DECLARE(void) apr_hash_clear(apr_hash_t *ht)
 {
     apr_hash_index_t *hi;
+
+    if (ht->ctrl) {
+        memset(ht->ctrl, CTRL_EMPTY, ht->max + 1);
+        ht->count = 0;
+        ht->deleted = 0;
+        return;
+    }
     for (hi = apr_hash_first(NULL, ht); hi; hi = apr_hash_next(hi))
         apr_hash_set(ht, hi->this->key, hi->this->klen, NULL);
 }
 
+/*
+ * Merge tables of any kind, the result is of the kind of base.
+ */
+static apr_hash_t *merge_any(apr_pool_t *p, const apr_hash_t *overlay,
+                             const apr_hash_t *base,
+                             void * (*merger)(apr_pool_t *p,
+                                              const void *key,
+                                              apr_ssize_t klen,
+                                              const void *h1_val,
+                                              const void *h2_val,
+                                              const void *data),
+                             const void *data)
+{
+    apr_hash_t *res;
+    apr_hash_index_t hix, *hi;
+    const void *key, *val;
+    apr_ssize_t klen;
+    void *old;
+
+    res = apr_hash_make_ex(p, base->hash_func, base->flags);
+    res->seed = base->seed;
+
+    /* Not apr_hash_first(NULL, ...) which would change the tables */
+    memset(&hix, 0, sizeof(hix));
+    hix.ht = (apr_hash_t *)base;
+    for (hi = apr_hash_next(&hix); hi; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, &key, &klen, (void **)&val);
+        apr_hash_set(res, key, klen, val);
+    }
+
+    memset(&hix, 0, sizeof(hix));
+    hix.ht = (apr_hash_t *)overlay;
+    for (hi = apr_hash_next(&hix); hi; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, &key, &klen, (void **)&val);
+        if (merger && (old = apr_hash_get(res, key, klen)) != NULL) {
+            val = (*merger)(p, key, klen, val, old, data);
+        }
+        apr_hash_set(res, key, klen, val);
+    }
+
+    return res;
+}
+
 APR_DECLARE(apr_hash_t*) apr_hash_overlay(apr_pool_t *p,
                                           const apr_hash_t *overlay,
                                           const apr_hash_t *base)
@@ -452,7 +974,8 @@ APR_DECLARE(apr_hash_t *) apr_hash_merge(apr_pool_t *p,
     apr_hash_entry_t *new_vals = NULL;
     apr_hash_entry_t *iter;
     apr_hash_entry_t *ent;
-    unsigned int i, j, k, hash;
+    apr_hash_index_t hix, *hi;
+    unsigned int i, j, hash;
 
 #if APR_POOL_DEBUG
     /* we don't copy keys and values, so it's necessary that
@@ -471,10 +994,20 @@ APR_DECLARE(apr_hash_t *) apr_hash_merge(apr_pool_t *p,
     }
 #endif
 
+    if (base->ctrl || overlay->ctrl) {
+        return merge_any(p, overlay, base, merger, data);
+    }
+
     res = apr_palloc(p, sizeof(apr_hash_t));
     res->pool = p;
     res->free = NULL;
+    res->ctrl = NULL;
+    res->slots = NULL;
+    res->deleted = 0;
+    res->old_array = NULL;
+    res->old_max = res->moved = 0;
     res->hash_func = base->hash_func;
+    res->flags = base->flags;
     res->count = base->count;
     res->max = (overlay->max > base->max) ? overlay->max : base->max;
     if (base->count + overlay->count > res->max) {
@@ -487,51 +1020,53 @@ APR_DECLARE(apr_hash_t *) apr_hash_merge(apr_pool_t *p,
                               (base->count + overlay->count));
     }
     j = 0;
-    for (k = 0; k <= base->max; k++) {
-        for (iter = base->array[k]; iter; iter = iter->next) {
-            i = iter->hash & res->max;
+    /* Iterated to get the entries of both arrays of incremental tables
+     * being expanded.
+     */
+    memset(&hix, 0, sizeof(hix));
+    hix.ht = (apr_hash_t *)base;
+    for (hi = apr_hash_next(&hix); hi; hi = apr_hash_next(hi)) {
+        iter = hi->this;
+        i = iter->hash & res->max;
+        new_vals[j].klen = iter->klen;
+        new_vals[j].key = iter->key;
+        new_vals[j].val = iter->val;
+        new_vals[j].hash = iter->hash;
+        new_vals[j].next = res->array[i];
+        res->array[i] = &new_vals[j];
+        j++;
+    }
+
+    memset(&hix, 0, sizeof(hix));
+    hix.ht = (apr_hash_t *)overlay;
+    for (hi = apr_hash_next(&hix); hi; hi = apr_hash_next(hi)) {
+        iter = hi->this;
+        hash = hash_key(res, iter->key, &iter->klen);
+        i = hash & res->max;
+        for (ent = res->array[i]; ent; ent = ent->next) {
+            if ((ent->klen == iter->klen) &&
+                (memcmp(ent->key, iter->key, iter->klen) == 0)) {
+                if (merger) {
+                    ent->val = (*merger)(p, iter->key, iter->klen,
+                                         iter->val, ent->val, data);
+                }
+                else {
+                    ent->val = iter->val;
+                }
+                break;
+            }
+        }
+        if (!ent) {
             new_vals[j].klen = iter->klen;
             new_vals[j].key = iter->key;
             new_vals[j].val = iter->val;
-            new_vals[j].hash = iter->hash;
+            new_vals[j].hash = hash;
             new_vals[j].next = res->array[i];
             res->array[i] = &new_vals[j];
+            res->count++;
             j++;
         }
     }
-
-    for (k = 0; k <= overlay->max; k++) {
-        for (iter = overlay->array[k]; iter; iter = iter->next) {
-            if (res->hash_func)
-                hash = res->hash_func(iter->key, &iter->klen);
-            else
-                hash = hashfunc_default(iter->key, &iter->klen, res->seed);
-            i = hash & res->max;
-            for (ent = res->array[i]; ent; ent = ent->next) {
-                if ((ent->klen == iter->klen) &&
-                    (memcmp(ent->key, iter->key, iter->klen) == 0)) {
-                    if (merger) {
-                        ent->val = (*merger)(p, iter->key, iter->klen,
-                                             iter->val, ent->val, data);
-                    }
-                    else {
-                        ent->val = iter->val;
-                    }
-                    break;
-                }
-            }
-            if (!ent) {
-                new_vals[j].klen = iter->klen;
-                new_vals[j].key = iter->key;
-                new_vals[j].val = iter->val;
-                new_vals[j].hash = hash;
-                new_vals[j].next = res->array[i];
-                res->array[i] = &new_vals[j];
-                res->count++;
-                j++;
-            }
-        }
-    }
     return res;
 }
 
@@ -554,11 +1089,19 @@ APR_DECLARE(int) apr_hash_do(apr_hash_do_callback_fn_t *comp,
     hix.index = 0;
     hix.this  = NULL;
     hix.next  = NULL;
+    hix.slot  = NULL;
 
     if ((hi = apr_hash_next(&hix))) {
         /* Scan the entire table */
         do {
-            rv = (*comp)(rec, hi->this->key, hi->this->klen, hi->this->val);
+            if (hi->slot) {
+                rv = (*comp)(rec, hi->slot->key, hi->slot->klen,
+                             hi->slot->val);
+            }
+            else {
+                rv = (*comp)(rec, hi->this->key, hi->this->klen,
+                             hi->this->val);
+            }
         } while (rv && (hi = apr_hash_next(hi)));
 
         if (rv == 0) {
@@ -568,4 +1111,290 @@ APR_DECLARE(int) apr_hash_do(apr_hash_do_callback_fn_t *comp,
     return dorv;
 }
 
+/*
+ * Parallel operations: the work is cut in chunks, taken in turn by the
+ * calling thread and the threads of the pool helping it.
+ */
+
+#define PARALLEL_CHUNK 1024 /* buckets, slots or keys per chunk */
+#define PARALLEL_BITS  6    /* log2 of the bucket ranges of a build */
+
+typedef struct hash_parallel_t hash_parallel_t;
+
+struct hash_parallel_t {
+    apr_hash_t *ht;
+    void (*func)(hash_parallel_t *hp, unsigned int chunk);
+    unsigned int nchunks;
+    volatile apr_uint32_t next;
+    volatile apr_uint32_t stop;
+    /* apr_hash_do_parallel() */
+    apr_hash_do_callback_fn_t *comp;
+    void *rec;
+    unsigned int size;
+    /* apr_hash_build_parallel() */
+    const void * const *keys;
+    const apr_ssize_t *klens;
+    const void * const *vals;
+    unsigned int n;
+    unsigned int *hashes;
+    apr_ssize_t *lens;
+    unsigned int *order;
+    unsigned int *starts;
+    unsigned int *added;
+    unsigned int shift;
+    apr_hash_entry_t *entries;
+};
+
+static void parallel_run(hash_parallel_t *hp)
+{
+    apr_uint32_t i;
+
+    while (!apr_atomic_read32(&hp->stop)
+           && (i = apr_atomic_inc32(&hp->next)) < hp->nchunks) {
+        hp->func(hp, i);
+    }
+}
+
+#if APR_HAS_THREADS
+static void *APR_THREAD_FUNC parallel_task(apr_thread_t *thd, void *data)
+{
+    parallel_run(data);
+    return NULL;
+}
+#endif
+
+static void parallel_chunks(hash_parallel_t *hp,
+                            void (*func)(hash_parallel_t *hp,
+                                         unsigned int chunk),
+                            unsigned int nchunks,
+                            struct apr_thread_pool *tp)
+{
+#if APR_HAS_THREADS
+    apr_size_t n = 0;
+#endif
+
+    hp->func = func;
+    hp->nchunks = nchunks;
+    apr_atomic_set32(&hp->next, 0);
+
+#if APR_HAS_THREADS
+    /* the other threads help with the chunks, the first one is ours */
+    if (tp && nchunks > 1) {
+        apr_size_t ntasks = apr_thread_pool_thread_max_get(tp);
+
+        if (ntasks > nchunks - 1) {
+            ntasks = nchunks - 1;
+        }
+        for (; n < ntasks; n++) {
+            if (apr_thread_pool_push(tp, parallel_task, hp,
+                                     APR_THREAD_TASK_PRIORITY_HIGHEST,
+                                     hp) != APR_SUCCESS) {
+                break;
+            }
+        }
+    }
+#endif
+
+    parallel_run(hp);
+
+#if APR_HAS_THREADS
+    /* all the chunks are taken, the tasks not started yet are useless
+     * and the others finish theirs
+     */
+    if (n) {
+        apr_thread_pool_tasks_cancel(tp, hp);
+    }
+#endif
+}
+
+/* Call comp for the entries of a chunk of buckets (or slots) */
+static void do_chunk(hash_parallel_t *hp, unsigned int chunk)
+{
+    const apr_hash_t *ht = hp->ht;
+    const apr_hash_entry_t *he;
+    unsigned int i = chunk * PARALLEL_CHUNK, end = i + PARALLEL_CHUNK;
+
+    if (end > hp->size)
+        end = hp->size;
+
+    for (; i < end; i++) {
+        if (ht->ctrl) {
+            if (CTRL_FULL(ht->ctrl[i])
+                && !hp->comp(hp->rec, ht->slots[i].key, ht->slots[i].klen,
+                             ht->slots[i].val))
+                break;
+            continue;
+        }
+        for (he = iter_bucket(ht, i); he; he = he->next) {
+            if (!hp->comp(hp->rec, he->key, he->klen, he->val))
+                break;
+        }
+        if (he)
+            break;
+    }
+    if (i < end)
+        apr_atomic_set32(&hp->stop, 1);
+}
+
+APR_DECLARE(int) apr_hash_do_parallel(apr_hash_do_callback_fn_t *comp,
+                                      void *rec, const apr_hash_t *ht,
+                                      struct apr_thread_pool *tp)
+{
+    hash_parallel_t hp;
+
+    memset(&hp, 0, sizeof(hp));
+    hp.ht = (apr_hash_t *)ht;
+    hp.comp = comp;
+    hp.rec = rec;
+    hp.size = iter_size(ht);
+
+    parallel_chunks(&hp, do_chunk,
+                    (hp.size + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK, tp);
+
+    return !apr_atomic_read32(&hp.stop);
+}
+
+/* Hash a chunk of the keys, and check their values */
+static void hash_chunk(hash_parallel_t *hp, unsigned int chunk)
+{
+    unsigned int i = chunk * PARALLEL_CHUNK, end = i + PARALLEL_CHUNK;
+
+    if (end > hp->n)
+        end = hp->n;
+
+    for (; i < end; i++) {
+        if (!hp->vals[i]) {
+            apr_atomic_set32(&hp->stop, 1);
+            return;
+        }
+        hp->lens[i] = hp->klens ? hp->klens[i] : APR_HASH_KEY_STRING;
+        hp->hashes[i] = hash_key(hp->ht, hp->keys[i], &hp->lens[i]);
+    }
+}
+
+/* Add the keys of a range of buckets, in their order so the last wins */
+static void insert_chunk(hash_parallel_t *hp, unsigned int part)
+{
+    apr_hash_t *ht = hp->ht;
+    apr_hash_entry_t **bucket, *he;
+    unsigned int k, i;
+
+    for (k = hp->starts[part]; k < hp->starts[part + 1]; k++) {
+        i = hp->order[k];
+        bucket = &ht->array[hp->hashes[i] & ht->max];
+        for (he = *bucket; he; he = he->next) {
+            if (he->hash == hp->hashes[i]
+                && he->klen == hp->lens[i]
+                && memcmp(he->key, hp->keys[i], he->klen) == 0)
+                break;
+        }
+        if (he) {
+            he->val = hp->vals[i];
+            continue;
+        }
+        he = &hp->entries[i];
+        he->hash = hp->hashes[i];
+        he->key  = hp->keys[i];
+        he->klen = hp->lens[i];
+        he->val  = hp->vals[i];
+        he->next = *bucket;
+        *bucket = he;
+        hp->added[part]++;
+    }
+}
+
+APR_DECLARE(apr_status_t) apr_hash_build_parallel(apr_hash_t *ht,
+                                                  const void * const *keys,
+                                                  const apr_ssize_t *klens,
+                                                  const void * const *vals,
+                                                  unsigned int n,
+                                                  struct apr_thread_pool *tp)
+{
+    hash_parallel_t hp;
+    apr_pool_t *pool;
+    apr_status_t rv;
+    unsigned int i, nparts, bits;
+
+    if (n == 0)
+        return APR_SUCCESS;
+
+    rv = apr_pool_create(&pool, ht->pool);
+    if (rv != APR_SUCCESS)
+        return rv;
+
+    memset(&hp, 0, sizeof(hp));
+    hp.ht = ht;
+    hp.keys = keys;
+    hp.klens = klens;
+    hp.vals = vals;
+    hp.n = n;
+    hp.hashes = apr_palloc(pool, sizeof(*hp.hashes) * n);
+    hp.lens = apr_palloc(pool, sizeof(*hp.lens) * n);
+
+    /* The hashing is most of the work, and leaves the table as is when a
+     * value is missing.
+     */
+    parallel_chunks(&hp, hash_chunk, (n - 1) / PARALLEL_CHUNK + 1, tp);
+    if (apr_atomic_read32(&hp.stop)) {
+        apr_pool_destroy(pool);
+        return APR_EINVAL;
+    }
+
+    apr_hash_reserve(ht, ht->count < APR_UINT32_MAX - n ? ht->count + n
+                                                        : APR_UINT32_MAX);
+
+    if (ht->ctrl) {
+        /* The probe sequences cross any range of slots */
+        for (i = 0; i < n; i++) {
+            unsigned int ins = 0;
+            int j = find_slot(ht, keys[i], hp.lens[i], hp.hashes[i], &ins);
+
+            if (j >= 0)
+                ht->slots[j].val = vals[i];
+            else
+                insert_slot(ht, ins, hp.hashes[i], keys[i], hp.lens[i],
+                            vals[i]);
+        }
+        apr_pool_destroy(pool);
+        return APR_SUCCESS;
+    }
+
+    /* Finish an expansion, for the keys to go to the buckets of the array
+     * only, then sort them by range of buckets, each range being filled
+     * by a single thread.
+     */
+    move_buckets(ht, ht->old_max + 1);
+    for (bits = 0; (1U << bits) <= ht->max; bits++)
+        ;
+    hp.shift = bits > PARALLEL_BITS ? bits - PARALLEL_BITS : 0;
+    nparts = (ht->max >> hp.shift) + 1;
+
+    hp.order = apr_palloc(pool, sizeof(*hp.order) * n);
+    hp.starts = apr_pcalloc(pool, sizeof(*hp.starts) * (nparts + 1));
+    hp.added = apr_pcalloc(pool, sizeof(*hp.added) * nparts);
+    for (i = 0; i < n; i++) {
+        hp.starts[((hp.hashes[i] & ht->max) >> hp.shift) + 1]++;
+    }
+    for (i = 0; i < nparts; i++) {
+        hp.starts[i + 1] += hp.starts[i];
+    }
+    for (i = 0; i < n; i++) {
+        hp.order[hp.starts[(hp.hashes[i] & ht->max) >> hp.shift]++] = i;
+    }
+    for (i = nparts; i > 0; i--) {
+        hp.starts[i] = hp.starts[i - 1];
+    }
+    hp.starts[0] = 0;
+
+    /* The entries of the duplicates are not used */
+    hp.entries = apr_palloc(ht->pool, sizeof(*hp.entries) * n);
+    parallel_chunks(&hp, insert_chunk, nparts, tp);
+    for (i = 0; i < nparts; i++) {
+        ht->count += hp.added[i];
+    }
+
+    apr_pool_destroy(pool);
+    return APR_SUCCESS;
+}
+
 APR_POOL_IMPLEMENT_ACCESSOR(hash)
@@ -0,0 +1,291 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_private.h"
+
+#include "apr_heap.h"
+#include "apr_allocator.h"
+#define APR_WANT_MEMFUNC
+#include "apr_want.h"
+
+/*
+ * The elements are kept in an array as a 4-ary heap: the children of
+ * element i are elements 4i+1 to 4i+4, none of which comes out before
+ * it.  Four children per element make the heap half as deep as a binary
+ * one, and they share a cache line or two.
+ *
+ * The array holds the elements themselves (not their handles), so the
+ * comparisons need no indirection; the handles only follow the moves of
+ * their element.
+ */
+
+#define HEAP_ARITY 4
+#define HEAP_PARENT(i) (((i) - 1) / HEAP_ARITY)
+#define HEAP_FIRST_CHILD(i) ((i) * HEAP_ARITY + 1)
+
+#define HEAP_DEFAULT_NALLOC 64
+
+typedef struct heap_elt_t {
+    void *data;
+    apr_heap_node_t *node;
+} heap_elt_t;
+
+struct apr_heap_node_t {
+    union {
+        /* The offset of the element in the array */
+        apr_size_t pos;
+        /* Or, once recycled, the next free handle */
+        apr_heap_node_t *next;
+    } u;
+};
+
+struct apr_heap_t {
+    apr_pool_t *pool;
+    apr_allocator_t *allocator;
+    apr_heap_compare_fn_t *compare;
+    heap_elt_t *elts;
+    apr_size_t nelts;
+    apr_size_t nalloc;
+    /* The memory of the array */
+    apr_memnode_t *memnode;
+    apr_heap_node_t *free_nodes;
+};
+
+static apr_status_t heap_cleanup(void *data)
+{
+    apr_heap_t *heap = data;
+
+    if (heap->memnode) {
+        apr_allocator_free(heap->allocator, heap->memnode);
+        heap->memnode = NULL;
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t heap_grow(apr_heap_t *heap, apr_size_t nalloc)
+{
+    apr_memnode_t *memnode;
+
+    memnode = apr_allocator_alloc(heap->allocator,
+                                  nalloc * sizeof(heap_elt_t));
+    if (!memnode) {
+        return APR_ENOMEM;
+    }
+    /* The allocator rounds up the size, use it all */
+    nalloc = (memnode->endp - memnode->first_avail) / sizeof(heap_elt_t);
+    if (heap->nelts) {
+        memcpy(memnode->first_avail, heap->elts,
+               heap->nelts * sizeof(heap_elt_t));
+    }
+    if (heap->memnode) {
+        apr_allocator_free(heap->allocator, heap->memnode);
+    }
+    heap->memnode = memnode;
+    heap->elts = (heap_elt_t *)memnode->first_avail;
+    heap->nalloc = nalloc;
+    return APR_SUCCESS;
+}
+
+/* Place elt at i or above, moving down the parents coming out after it */
+static void heap_sift_up(apr_heap_t *heap, apr_size_t i, heap_elt_t elt)
+{
+    heap_elt_t *elts = heap->elts;
+
+    while (i > 0) {
+        apr_size_t parent = HEAP_PARENT(i);
+        if (heap->compare(elt.data, elts[parent].data) >= 0) {
+            break;
+        }
+        elts[i] = elts[parent];
+        if (elts[i].node) {
+            elts[i].node->u.pos = i;
+        }
+        i = parent;
+    }
+    elts[i] = elt;
+    if (elt.node) {
+        elt.node->u.pos = i;
+    }
+}
+
+/* Place elt at i or below, moving up the first of the children coming
+ * out before it
+ */
+static void heap_sift_down(apr_heap_t *heap, apr_size_t i, heap_elt_t elt)
+{
+    heap_elt_t *elts = heap->elts;
+    apr_size_t n = heap->nelts;
+
+    for (;;) {
+        apr_size_t child = HEAP_FIRST_CHILD(i), best, end;
+        if (child >= n) {
+            break;
+        }
+        end = (n - child > HEAP_ARITY) ? child + HEAP_ARITY : n;
+        for (best = child++; child < end; child++) {
+            if (heap->compare(elts[child].data, elts[best].data) < 0) {
+                best = child;
+            }
+        }
+        if (heap->compare(elts[best].data, elt.data) >= 0) {
+            break;
+        }
+        elts[i] = elts[best];
+        if (elts[i].node) {
+            elts[i].node->u.pos = i;
+        }
+        i = best;
+    }
+    elts[i] = elt;
+    if (elt.node) {
+        elt.node->u.pos = i;
+    }
+}
+
+/* Place elt at i, up or down */
+static void heap_place(apr_heap_t *heap, apr_size_t i, heap_elt_t elt)
+{
+    if (i > 0 && heap->compare(elt.data, heap->elts[HEAP_PARENT(i)].data) < 0) {
+        heap_sift_up(heap, i, elt);
+    }
+    else {
+        heap_sift_down(heap, i, elt);
+    }
+}
+
+static APR_INLINE void heap_put_node(apr_heap_t *heap, apr_heap_node_t *node)
+{
+    if (node) {
+        node->u.next = heap->free_nodes;
+        heap->free_nodes = node;
+    }
+}
+
+APR_DECLARE(apr_status_t) apr_heap_create(apr_heap_t **heap,
+                                          apr_size_t nalloc,
+                                          apr_heap_compare_fn_t *compare,
+                                          apr_pool_t *pool)
+{
+    apr_heap_t *h;
+    apr_status_t rv;
+
+    if (!compare) {
+        return APR_EINVAL;
+    }
+
+    h = apr_pcalloc(pool, sizeof(*h));
+    h->pool = pool;
+    h->allocator = apr_pool_allocator_get(pool);
+    h->compare = compare;
+    apr_pool_cleanup_register(pool, h, heap_cleanup, apr_pool_cleanup_null);
+    if (nalloc) {
+        rv = heap_grow(h, nalloc);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+    }
+
+    *heap = h;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_heap_insert(apr_heap_t *heap, void *data,
+                                          apr_heap_node_t **node)
+{
+    heap_elt_t elt;
+
+    if (heap->nelts == heap->nalloc) {
+        apr_status_t rv;
+        rv = heap_grow(heap, heap->nalloc ? heap->nalloc * 2
+                                          : HEAP_DEFAULT_NALLOC);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+    }
+
+    elt.data = data;
+    elt.node = NULL;
+    if (node) {
+        elt.node = heap->free_nodes;
+        if (elt.node) {
+            heap->free_nodes = elt.node->u.next;
+        }
+        else {
+            elt.node = apr_palloc(heap->pool, sizeof(apr_heap_node_t));
+        }
+        *node = elt.node;
+    }
+
+    heap_sift_up(heap, heap->nelts++, elt);
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(void *) apr_heap_peek(const apr_heap_t *heap)
+{
+    return heap->nelts ? heap->elts[0].data : NULL;
+}
+
+APR_DECLARE(void *) apr_heap_pop(apr_heap_t *heap)
+{
+    heap_elt_t *elts = heap->elts;
+    void *data;
+
+    if (!heap->nelts) {
+        return NULL;
+    }
+    data = elts[0].data;
+    heap_put_node(heap, elts[0].node);
+    if (--heap->nelts) {
+        heap_sift_down(heap, 0, elts[heap->nelts]);
+    }
+    return data;
+}
+
+APR_DECLARE(void) apr_heap_update(apr_heap_t *heap, apr_heap_node_t *node)
+{
+    apr_size_t i = node->u.pos;
+
+    heap_place(heap, i, heap->elts[i]);
+}
+
+APR_DECLARE(void *) apr_heap_remove(apr_heap_t *heap, apr_heap_node_t *node)
+{
+    heap_elt_t *elts = heap->elts;
+    apr_size_t i = node->u.pos;
+    void *data = elts[i].data;
+
+    heap_put_node(heap, node);
+    if (i < --heap->nelts) {
+        /* The last element takes the place */
+        heap_place(heap, i, elts[heap->nelts]);
+    }
+    return data;
+}
+
+APR_DECLARE(apr_size_t) apr_heap_size(const apr_heap_t *heap)
+{
+    return heap->nelts;
+}
+
+APR_DECLARE(void) apr_heap_clear(apr_heap_t *heap)
+{
+    apr_size_t i;
+
+    for (i = 0; i < heap->nelts; i++) {
+        heap_put_node(heap, heap->elts[i].node);
+    }
+    heap->nelts = 0;
+}
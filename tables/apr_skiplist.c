@@ -24,12 +24,23 @@
  */
 
 #include "apr_skiplist.h"
+#include "apr_general.h"
+#include "apr_slab.h"
+#include "apr_time.h"
 
-typedef struct {
-    apr_skiplistnode **data;
-    size_t size, pos;
-    apr_pool_t *p;
-} apr_skiplist_q;
+/* The maximum height of the towers, more than enough for any skiplist */
+#define SKIPLIST_MAX_HEIGHT 32
+
+/* Nodes are allocated from one slab per power of 2 height:
+ * 1, 2, 4, ..., 32 levels.
+ */
+#define SKIPLIST_NODE_CLASSES 6
+
+#if defined(__GNUC__) && __GNUC__ >= 4
+#define SKIPLIST_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define SKIPLIST_PREFETCH(p)
+#endif
 
 struct apr_skiplist {
     apr_skiplist_compare compare;
@@ -37,38 +48,67 @@ struct apr_skiplist {
     int height;
     int preheight;
     size_t size;
-    apr_skiplistnode *top;
-    apr_skiplistnode *bottom;
-    /* These two are needed for appending */
-    apr_skiplistnode *topend;
-    apr_skiplistnode *bottomend;
+    /* The head's tower is SKIPLIST_MAX_HEIGHT tall, the levels from
+     * height up are NULL.
+     */
+    apr_skiplistnode *head;
     apr_skiplist *index;
     apr_array_header_t *memlist;
-    apr_skiplist_q nodes_q,
-                   stack_q;
+    apr_slab_t *slabs[SKIPLIST_NODE_CLASSES];
     apr_pool_t *pool;
+    /* The state of the PRNG drawing the heights of the new nodes */
+    apr_uint64_t rand_state;
 };
 
+/* A node holds the whole tower of an element: its forward pointers for
+ * each level follow it, in the same allocation.  Only the bottom level is
+ * linked backward; the predecessor of a node at some level is the nearest
+ * previous node tall enough (or the head).
+ */
 struct apr_skiplistnode {
     void *data;
-    apr_skiplistnode *next;
     apr_skiplistnode *prev;
-    apr_skiplistnode *down;
-    apr_skiplistnode *up;
     apr_skiplistnode *previndex;
     apr_skiplistnode *nextindex;
     apr_skiplist *sl;
+    int height;
+    apr_skiplistnode *next[1];
 };
 
-static unsigned int get_b_rand(void)
+#define SKIPLIST_NODE_SIZE(height) \
+    (APR_OFFSETOF(apr_skiplistnode, next) \
+     + (height) * sizeof(apr_skiplistnode *))
+
+/* splitmix64, which is fast and good enough to draw heights, each
+ * skiplist having its own state.
+ */
+static APR_INLINE apr_uint64_t skiplist_rand(apr_skiplist *sl)
+{
+    apr_uint64_t z = (sl->rand_state += APR_UINT64_C(0x9e3779b97f4a7c15));
+
+    z = (z ^ (z >> 30)) * APR_UINT64_C(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * APR_UINT64_C(0x94d049bb133111eb);
+    return z ^ (z >> 31);
+}
+
+/* Number of trailing one bits of a draw, each bit being a coin flip */
+static APR_INLINE int skiplist_rand_ones(apr_uint64_t r)
 {
-    static unsigned int ph = 32;         /* More bits than we will ever use */
-    static unsigned int randseq;
-    if (ph > 31) {              /* Num bits in return of rand() */
-        ph = 0;
-        randseq = rand();
+    int n = 0;
+
+    r = ~r;
+    if (!r) {
+        return 64;
     }
-    return randseq & (1U << ph++);
+#if defined(__GNUC__) && __GNUC__ >= 4
+    n = __builtin_ctzll(r);
+#else
+    while (!(r & 1)) {
+        r >>= 1;
+        n++;
+    }
+#endif
+    return n;
 }
 
 typedef struct {
@@ -152,57 +192,46 @@ APR_DECLARE(void) apr_skiplist_free(apr_skiplist *sl, void *mem)
     }
 }
 
-static apr_status_t skiplist_qpush(apr_skiplist_q *q, apr_skiplistnode *m)
+static APR_INLINE int skiplist_node_class(int height)
 {
-    if (q->pos >= q->size) {
-        apr_skiplistnode **data;
-        size_t size = (q->pos) ? q->pos * 2 : 32;
-        if (q->p) {
-            data = apr_palloc(q->p, size * sizeof(*data));
-            if (data && q->data) {
-                memcpy(data, q->data, q->pos * sizeof(*data));
-            }
-        }
-        else {
-            data = realloc(q->data, size * sizeof(*data));
-        }
-        if (!data) {
-            return APR_ENOMEM;
-        }
-        q->data = data;
-        q->size = size;
+    int c = 0;
+    while ((1 << c) < height) {
+        c++;
     }
-    q->data[q->pos++] = m;
-    return APR_SUCCESS;
-}
-
-static APR_INLINE apr_skiplistnode *skiplist_qpop(apr_skiplist_q *q)
-{
-    return (q->pos > 0) ? q->data[--q->pos] : NULL;
+    return c;
 }
 
-static APR_INLINE void skiplist_qclear(apr_skiplist_q *q)
+static apr_skiplistnode *skiplist_new_node(apr_skiplist *sl, int height)
 {
-    q->pos = 0;
-}
-
-static apr_skiplistnode *skiplist_new_node(apr_skiplist *sl)
-{
-    apr_skiplistnode *m = skiplist_qpop(&sl->nodes_q);
-    if (!m) {
-        if (sl->pool) {
-            m = apr_palloc(sl->pool, sizeof *m);
-        }
-        else {
-            m = malloc(sizeof *m);
+    apr_skiplistnode *m;
+    if (sl->pool) {
+        int c = skiplist_node_class(height);
+        if (!sl->slabs[c]
+            && apr_slab_create(&sl->slabs[c],
+                               SKIPLIST_NODE_SIZE(1 << c), 0,
+                               sl->pool) != APR_SUCCESS) {
+            sl->slabs[c] = NULL;
+            return NULL;
         }
+        m = apr_slab_alloc(sl->slabs[c]);
+    }
+    else {
+        m = malloc(SKIPLIST_NODE_SIZE(height));
+    }
+    if (m) {
+        m->height = height;
     }
     return m;
 }
 
-static apr_status_t skiplist_put_node(apr_skiplist *sl, apr_skiplistnode *m)
+static void skiplist_put_node(apr_skiplist *sl, apr_skiplistnode *m)
 {
-    return skiplist_qpush(&sl->nodes_q, m);
+    if (sl->pool) {
+        apr_slab_free(sl->slabs[skiplist_node_class(m->height)], m);
+    }
+    else {
+        free(m);
+    }
 }
 
 static apr_status_t skiplisti_init(apr_skiplist **s, apr_pool_t *p)
@@ -211,14 +240,24 @@ static apr_status_t skiplisti_init(apr_skiplist **s, apr_pool_t *p)
     if (p) {
         sl = apr_pcalloc(p, sizeof(apr_skiplist));
         sl->memlist = apr_array_make(p, 20, sizeof(memlist_t));
-        sl->pool = sl->nodes_q.p = sl->stack_q.p = p;
+        sl->pool = p;
+        sl->head = apr_pcalloc(p, SKIPLIST_NODE_SIZE(SKIPLIST_MAX_HEIGHT));
     }
     else {
         sl = calloc(1, sizeof(apr_skiplist));
         if (!sl) {
             return APR_ENOMEM;
         }
+        sl->head = calloc(1, SKIPLIST_NODE_SIZE(SKIPLIST_MAX_HEIGHT));
+        if (!sl->head) {
+            free(sl);
+            return APR_ENOMEM;
+        }
     }
+    sl->head->height = SKIPLIST_MAX_HEIGHT;
+    sl->head->sl = sl;
+    sl->rand_state = (apr_uint64_t)apr_time_now()
+                     ^ (apr_uint64_t)(apr_uintptr_t)sl;
     *s = sl;
     return APR_SUCCESS;
 }
@@ -291,7 +330,7 @@ APR_DECLARE(void) apr_skiplist_add_index(apr_skiplist *sl,
         icount++;
     }
     for (m = apr_skiplist_getlist(sl); m; apr_skiplist_next(sl, &m)) {
-        int j = icount - 1;
+        int j = icount;
         apr_skiplistnode *nsln;
         nsln = apr_skiplist_insert(ni, m->data);
         /* skip from main index down list */
@@ -314,37 +353,34 @@ static int skiplisti_find_compare(apr_skiplist *sl, void *data,
                                   apr_skiplist_compare comp,
                                   int last)
 {
-    int count = 0;
-    apr_skiplistnode *m, *found = NULL;
-    for (m = sl->top; m; count++) {
-        if (m->next) {
-            int compared = comp(data, m->next->data);
+    int count = 0, level;
+    apr_skiplistnode *m = sl->head, *n, *found = NULL;
+    for (level = sl->height - 1; level >= 0; level--, count++) {
+        while ((n = m->next[level])) {
+            int compared;
+            /* Fetch the next node of this level while comparing */
+            SKIPLIST_PREFETCH(n->next[level]);
+            compared = comp(data, n->data);
             if (compared == 0) {
-                found = m = m->next;
+                found = m = n;
                 if (!last) {
-                    break;
+                    *ret = found;
+                    return count;
                 }
+                count++;
                 continue;
             }
             if (compared > 0) {
-                m = m->next;
+                m = n;
+                count++;
                 continue;
             }
+            break;
         }
-        m = m->down;
-    }
-    if (found) {
-        while (found->down) {
-            found = found->down;
-        }
-        *ret = found;
-    }
-    else {
-        *ret = NULL;
     }
+    *ret = found;
     return count;
 }
-
 static void *find_compare(apr_skiplist *sli, void *data,
                           apr_skiplistnode **iter,
                           apr_skiplist_compare comp,
@@ -406,10 +442,7 @@ APR_DECLARE(void *) apr_skiplist_last(apr_skiplist *sl, void *data,
 
 APR_DECLARE(apr_skiplistnode *) apr_skiplist_getlist(apr_skiplist *sl)
 {
-    if (!sl->bottom) {
-        return NULL;
-    }
-    return sl->bottom->next;
+    return sl->head->next[0];
 }
 
 APR_DECLARE(void *) apr_skiplist_next(apr_skiplist *sl, apr_skiplistnode **iter)
@@ -417,7 +450,7 @@ APR_DECLARE(void *) apr_skiplist_next(apr_skiplist *sl, apr_skiplistnode **iter)
     if (!*iter) {
         return NULL;
     }
-    *iter = (*iter)->next;
+    *iter = (*iter)->next[0];
     return (*iter) ? ((*iter)->data) : NULL;
 }
 
@@ -448,144 +481,126 @@ static APR_INLINE int skiplist_height(const apr_skiplist *sl)
     return sl->height ? sl->height : 1;
 }
 
+static int skiplist_new_height(apr_skiplist *sl)
+{
+    int max, nh;
+
+    /* One level more than the current height at most, unless preheight */
+    max = sl->preheight ? sl->preheight : skiplist_height(sl) + 1;
+    if (max > SKIPLIST_MAX_HEIGHT) {
+        max = SKIPLIST_MAX_HEIGHT;
+    }
+    nh = 1 + skiplist_rand_ones(skiplist_rand(sl));
+    return nh < max ? nh : max;
+}
+
+/* Link a new node of height nh after the update[] nodes of its levels */
+static apr_skiplistnode *skiplist_link(apr_skiplist *sl, void *data, int nh,
+                                       apr_skiplistnode **update)
+{
+    apr_skiplistnode *ret;
+    int level;
+
+    ret = skiplist_new_node(sl, nh);
+    if (!ret) {
+        return NULL;
+    }
+    ret->data = data;
+    ret->sl = sl;
+    ret->nextindex = ret->previndex = NULL;
+    for (level = 0; level < nh; level++) {
+        ret->next[level] = update[level]->next[level];
+        update[level]->next[level] = ret;
+    }
+    ret->prev = (update[0] != sl->head) ? update[0] : NULL;
+    if (ret->next[0]) {
+        ret->next[0]->prev = ret;
+    }
+    if (sl->height < nh) {
+        sl->height = nh;
+    }
+    sl->size++;
+    return ret;
+}
+
+static apr_skiplistnode *insert_compare(apr_skiplist *sl, void *data,
+                                        apr_skiplist_compare comp, int add,
+                                        apr_skiplist_freefunc myfree);
+
+/* Insert a new main list node into each index */
+static void skiplist_insert_indexes(apr_skiplist *sl, apr_skiplistnode *ret)
+{
+    apr_skiplistnode *p, *ni, *li;
+    li = ret;
+    for (p = apr_skiplist_getlist(sl->index); p; apr_skiplist_next(sl->index, &p)) {
+        apr_skiplist *sli = (apr_skiplist *)p->data;
+        ni = insert_compare(sli, ret->data, sli->compare, 1, NULL);
+        li->nextindex = ni;
+        ni->previndex = li;
+        li = ni;
+    }
+}
+
 static apr_skiplistnode *insert_compare(apr_skiplist *sl, void *data,
                                         apr_skiplist_compare comp, int add,
                                         apr_skiplist_freefunc myfree)
 {
-    apr_skiplistnode *m, *p, *tmp, *ret = NULL;
-    int ch, top_nh, nh = 1;
+    apr_skiplistnode *update[SKIPLIST_MAX_HEIGHT];
+    apr_skiplistnode *m, *n, *ret;
+    int level, nh;
 
-    ch = skiplist_height(sl);
-    if (sl->preheight) {
-        while (nh < sl->preheight && get_b_rand()) {
-            nh++;
-        }
-    }
-    else {
-        while (nh <= ch && get_b_rand()) {
-            nh++;
-        }
-    }
-    top_nh = nh;
+    nh = skiplist_new_height(sl);
 
-    /* Now we have in nh the height at which we wish to insert our new node,
-     * and in ch the current height: don't create skip paths to the inserted
-     * element until the walk down through the tree (which decrements ch)
-     * reaches nh. From there, any walk down pushes the current node on a
-     * stack (the node(s) after which we would insert) to pop back through
-     * for insertion later.
+    /* Now we have in nh the height at which we wish to insert our new node:
+     * walk down through the levels, remembering at each one the node after
+     * which we would insert. The levels above the current height (if the
+     * new node is taller) are empty, so it goes after the head there.
      */
-    m = sl->top;
-    while (m) {
-        /*
-         * To maintain stability, dups (compared == 0) must be added
-         * AFTER each other.
-         */
-        if (m->next) {
-            int compared = comp(data, m->next->data);
+    for (level = sl->height; level < nh; level++) {
+        update[level] = sl->head;
+    }
+    m = sl->head;
+    for (level = sl->height - 1; level >= 0; level--) {
+        while ((n = m->next[level])) {
+            int compared;
+            SKIPLIST_PREFETCH(n->next[level]);
+            compared = comp(data, n->data);
+            /*
+             * To maintain stability, dups (compared == 0) must be added
+             * AFTER each other.
+             */
             if (compared == 0) {
                 if (!add) {
                     /* Keep the existing element(s) */
-                    skiplist_qclear(&sl->stack_q);
                     return NULL;
                 }
                 if (add < 0) {
                     /* Remove this element and continue with the next node
-                     * or the new top if the current one is also removed.
+                     * of this level (the levels emptied above are those
+                     * of the nodes we already passed, so m is still the
+                     * node to insert after there).
                      */
-                    apr_skiplistnode *top = sl->top;
-                    skiplisti_remove(sl, m->next, myfree);
-                    if (top != sl->top) {
-                        m = sl->top;
-                        skiplist_qclear(&sl->stack_q);
-                        ch = skiplist_height(sl);
-                        nh = top_nh;
-                    }
+                    skiplisti_remove(sl, n, myfree);
                     continue;
                 }
             }
             if (compared >= 0) {
-                m = m->next;
+                m = n;
                 continue;
             }
+            break;
         }
-        if (ch <= nh) {
-            /* push on stack */
-            skiplist_qpush(&sl->stack_q, m);
-        }
-        m = m->down;
-        ch--;
-    }
-    /* Pop the stack and insert nodes */
-    p = NULL;
-    while ((m = skiplist_qpop(&sl->stack_q))) {
-        tmp = skiplist_new_node(sl);
-        tmp->next = m->next;
-        if (m->next) {
-            m->next->prev = tmp;
-        }
-        m->next = tmp;
-        tmp->prev = m;
-        tmp->up = NULL;
-        tmp->nextindex = tmp->previndex = NULL;
-        tmp->down = p;
-        if (p) {
-            p->up = tmp;
-        }
-        else {
-            /* This sets ret to the bottom-most node we are inserting */
-            ret = tmp;
-        }
-        tmp->data = data;
-        tmp->sl = sl;
-        p = tmp;
-    }
-
-    /* Now we are sure the node is inserted, grow our tree to 'nh' tall */
-    for (; sl->height < nh; sl->height++) {
-        m = skiplist_new_node(sl);
-        tmp = skiplist_new_node(sl);
-        m->up = m->prev = m->nextindex = m->previndex = NULL;
-        m->next = tmp;
-        m->down = sl->top;
-        m->data = NULL;
-        m->sl = sl;
-        if (sl->top) {
-            sl->top->up = m;
-        }
-        else {
-            sl->bottom = sl->bottomend = m;
-        }
-        sl->top = sl->topend = tmp->prev = m;
-        tmp->up = tmp->next = tmp->nextindex = tmp->previndex = NULL;
-        tmp->down = p;
-        tmp->data = data;
-        tmp->sl = sl;
-        if (p) {
-            p->up = tmp;
-        }
-        else {
-            /* This sets ret to the bottom-most node we are inserting */
-            ret = tmp;
-        }
-        p = tmp;
+        update[level] = m;
     }
-    if (sl->index != NULL) {
+
+    ret = skiplist_link(sl, data, nh, update);
+    if (ret && sl->index != NULL) {
         /*
          * this is a external insertion, we must insert into each index as
          * well
          */
-        apr_skiplistnode *ni, *li;
-        li = ret;
-        for (p = apr_skiplist_getlist(sl->index); p; apr_skiplist_next(sl->index, &p)) {
-            apr_skiplist *sli = (apr_skiplist *)p->data;
-            ni = insert_compare(sli, ret->data, sli->compare, 1, NULL);
-            li->nextindex = ni;
-            ni->previndex = li;
-            li = ni;
-        }
+        skiplist_insert_indexes(sl, ret);
     }
-    sl->size++;
     return ret;
 }
 
@@ -633,21 +648,148 @@ APR_DECLARE(apr_skiplistnode *) apr_skiplist_replace(apr_skiplist *sl,
     return apr_skiplist_replace_compare(sl, data, myfree, sl->compare);
 }
 
+APR_DECLARE(apr_status_t) apr_skiplist_build_sorted(apr_skiplist *sl,
+                                                   void **elems, size_t n)
+{
+    apr_skiplistnode *tails[SKIPLIST_MAX_HEIGHT];
+    apr_skiplistnode *m;
+    int level, nh, max_height;
+    size_t i;
+
+    if (sl->size || !sl->compare) {
+        return APR_EINVAL;
+    }
+    for (i = 1; i < n; i++) {
+        if (sl->compare(elems[i], elems[i - 1]) < 0) {
+            return APR_EINVAL;
+        }
+    }
+
+    max_height = SKIPLIST_MAX_HEIGHT;
+    if (sl->preheight && sl->preheight < max_height) {
+        max_height = sl->preheight;
+    }
+    for (level = 0; level < max_height; level++) {
+        tails[level] = sl->head;
+    }
+
+    /* Append the towers, the (i + 1)th one being as tall as the number
+     * of trailing zero bits of i + 1, plus one.
+     */
+    for (i = 0; i < n; i++) {
+        for (nh = 1; nh < max_height && !((i + 1) & ((size_t)1 << (nh - 1)));
+             nh++)
+            ;
+        m = skiplist_link(sl, elems[i], nh, tails);
+        if (!m) {
+            return APR_ENOMEM;
+        }
+        for (level = 0; level < nh; level++) {
+            tails[level] = m;
+        }
+        if (sl->index != NULL) {
+            skiplist_insert_indexes(sl, m);
+        }
+    }
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_skiplist_insert_batch(apr_skiplist *sl,
+                                                   void **elems, size_t n)
+{
+    /* The last nodes of each level before the previous element (or the
+     * element itself for its levels), the finger to search the next one
+     * from.
+     */
+    apr_skiplistnode *update[SKIPLIST_MAX_HEIGHT];
+    apr_skiplistnode *m, *p;
+    apr_skiplist_compare comp = sl->compare;
+    int level, top, nh, found;
+    size_t i;
+
+    if (!comp) {
+        return APR_EINVAL;
+    }
+    for (level = 0; level < SKIPLIST_MAX_HEIGHT; level++) {
+        update[level] = sl->head;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (i) {
+            int compared = comp(elems[i], elems[i - 1]);
+            if (compared == 0) {
+                continue;       /* Inserted or kept already */
+            }
+            if (compared < 0) {
+                /* Out of order, search from the start */
+                for (level = 0; level < sl->height; level++) {
+                    update[level] = sl->head;
+                }
+            }
+        }
+
+        /* Climb until the next node of the level is not before the
+         * element: the next nodes of the levels above aren't either, so
+         * the finger is right there.
+         */
+        for (top = 0; top < sl->height; top++) {
+            p = update[top]->next[top];
+            if (!p || comp(elems[i], p->data) <= 0) {
+                break;
+            }
+        }
+        if (top == sl->height) {
+            top--;
+        }
+
+        /* And walk down from there */
+        found = 0;
+        m = (top >= 0) ? update[top] : sl->head;
+        for (level = top; level >= 0; level--) {
+            found = 0;
+            while ((p = m->next[level])) {
+                int compared;
+                SKIPLIST_PREFETCH(p->next[level]);
+                compared = comp(elems[i], p->data);
+                if (compared <= 0) {
+                    found = (compared == 0);
+                    break;
+                }
+                m = p;
+            }
+            update[level] = m;
+        }
+        if (found) {
+            continue;           /* Keep the existing element */
+        }
+
+        nh = skiplist_new_height(sl);
+        m = skiplist_link(sl, elems[i], nh, update);
+        if (!m) {
+            return APR_ENOMEM;
+        }
+        for (level = 0; level < nh; level++) {
+            update[level] = m;
+        }
+        if (sl->index != NULL) {
+            skiplist_insert_indexes(sl, m);
+        }
+    }
+    return APR_SUCCESS;
+}
+
 #if 0
 void skiplist_print_struct(apr_skiplist * sl, char *prefix)
 {
-    apr_skiplistnode *p, *q;
+    apr_skiplistnode *p;
+    int level;
     fprintf(stderr, "Skiplist Structure (height: %d)\n", sl->height);
-    p = sl->bottom;
-    while (p) {
-        q = p;
+    for (p = sl->head->next[0]; p; p = p->next[0]) {
         fprintf(stderr, prefix);
-        while (q) {
-            fprintf(stderr, "%p ", q->data);
-            q = q->up;
+        for (level = 0; level < p->height; level++) {
+            fprintf(stderr, "%p ", p->data);
         }
         fprintf(stderr, "\n");
-        p = p->next;
     }
 }
 #endif
@@ -656,44 +798,35 @@ static int skiplisti_remove(apr_skiplist *sl, apr_skiplistnode *m,
                             apr_skiplist_freefunc myfree)
 {
     apr_skiplistnode *p;
+    int level;
     if (!m) {
         return 0;
     }
     if (m->nextindex) {
         skiplisti_remove(m->nextindex->sl, m->nextindex, NULL);
     }
-    while (m->up) {
-        m = m->up;
-    }
-    do {
-        p = m;
-        /* take me out of the list */
-        p->prev->next = p->next;
-        if (p->next) {
-            p->next->prev = p->prev;
-        }
-        m = m->down;
-        /* This only frees the actual data in the bottom one */
-        if (!m && myfree && p->data) {
-            myfree(p->data);
+    /* take me out of the list, at each level after the nearest previous
+     * node tall enough
+     */
+    p = m->prev;
+    for (level = 0; level < m->height; level++) {
+        while (p && p->height <= level) {
+            p = p->prev;
         }
-        skiplist_put_node(sl, p);
-    } while (m);
+        (p ? p : sl->head)->next[level] = m->next[level];
+    }
+    if (m->next[0]) {
+        m->next[0]->prev = m->prev;
+    }
+    if (myfree && m->data) {
+        myfree(m->data);
+    }
+    skiplist_put_node(sl, m);
     sl->size--;
-    while (sl->top && sl->top->next == NULL) {
-        /* While the row is empty and we are not on the bottom row */
-        p = sl->top;
-        sl->top = sl->top->down;/* Move top down one */
-        if (sl->top) {
-            sl->top->up = NULL; /* Make it think its the top */
-        }
-        skiplist_put_node(sl, p);
+    while (sl->height && sl->head->next[sl->height - 1] == NULL) {
+        /* While the top level is empty */
         sl->height--;
     }
-    if (!sl->top) {
-        sl->bottom = sl->bottomend = NULL;
-        sl->topend = NULL;
-    }
     return skiplist_height(sl);
 }
 
@@ -705,9 +838,6 @@ APR_DECLARE(int) apr_skiplist_remove_node(apr_skiplist *sl,
     if (!m) {
         return 0;
     }
-    while (m->down) {
-        m = m->down;
-    }
     while (m->previndex) {
         m = m->previndex;
     }
@@ -750,27 +880,20 @@ APR_DECLARE(int) apr_skiplist_remove(apr_skiplist *sl, void *data, apr_skiplist_
 
 APR_DECLARE(void) apr_skiplist_remove_all(apr_skiplist *sl, apr_skiplist_freefunc myfree)
 {
-    /*
-     * This must remove even the place holder nodes (bottom though top)
-     * because we specify in the API that one can free the Skiplist after
-     * making this call without memory leaks
-     */
-    apr_skiplistnode *m, *p, *u;
-    m = sl->bottom;
+    apr_skiplistnode *m, *p;
+    int level;
+    m = sl->head->next[0];
     while (m) {
-        p = m->next;
-        if (myfree && p && p->data) {
-            myfree(p->data);
+        p = m->next[0];
+        if (myfree && m->data) {
+            myfree(m->data);
         }
-        do {
-            u = m->up;
-            skiplist_put_node(sl, m);
-            m = u;
-        } while (m);
+        skiplist_put_node(sl, m);
         m = p;
     }
-    sl->top = sl->bottom = NULL;
-    sl->topend = sl->bottomend = NULL;
+    for (level = 0; level < sl->height; level++) {
+        sl->head->next[level] = NULL;
+    }
     sl->height = 0;
     sl->size = 0;
 }
@@ -824,14 +947,16 @@ static void skiplisti_destroy(void *vsl)
 
 APR_DECLARE(void) apr_skiplist_destroy(apr_skiplist *sl, apr_skiplist_freefunc myfree)
 {
-    while (apr_skiplist_pop(sl->index, skiplisti_destroy) != NULL)
-        ;
+    if (sl->index) {
+        while (apr_skiplist_pop(sl->index, skiplisti_destroy) != NULL)
+            ;
+    }
     apr_skiplist_remove_all(sl, myfree);
     if (!sl->pool) {
-        while (sl->nodes_q.pos)
-            free(sl->nodes_q.data[--sl->nodes_q.pos]);
-        free(sl->nodes_q.data);
-        free(sl->stack_q.data);
+        if (sl->index) {
+            apr_skiplist_destroy(sl->index, NULL);
+        }
+        free(sl->head);
         free(sl);
     }
 }
@@ -841,7 +966,7 @@ APR_DECLARE(apr_skiplist *) apr_skiplist_merge(apr_skiplist *sl1, apr_skiplist *
     /* Check integrity! */
     apr_skiplist temp;
     struct apr_skiplistnode *b2;
-    if (sl1->bottomend == NULL || sl1->bottomend->prev == NULL) {
+    if (sl1->size == 0) {
         apr_skiplist_remove_all(sl1, NULL);
         temp = *sl1;
         *sl1 = *sl2;
@@ -849,7 +974,7 @@ APR_DECLARE(apr_skiplist *) apr_skiplist_merge(apr_skiplist *sl1, apr_skiplist *
         /* swap them so that sl2 can be freed normally upon return. */
         return sl1;
     }
-    if(sl2->bottom == NULL || sl2->bottom->next == NULL) {
+    if (sl2->size == 0) {
         apr_skiplist_remove_all(sl2, NULL);
         return sl1;
     }
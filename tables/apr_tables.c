@@ -28,6 +28,8 @@
 #include "apr_tables.h"
 #include "apr_strings.h"
 #include "apr_lib.h"
+#include "apr_cstr.h"
+#include "apr_atomic.h"
 #if APR_HAVE_STDLIB_H
 #include <stdlib.h>
 #endif
@@ -104,19 +106,64 @@ APR_DECLARE(void *) apr_array_pop(apr_array_header_t *arr)
     return arr->elts + (arr->elt_size * (--arr->nelts));
 }
 
-APR_DECLARE(void *) apr_array_push(apr_array_header_t *arr)
+/* Make room for nalloc elements in arr, up to want when the block can
+ * grow in place, which copies nothing and wastes no memory (the old
+ * block stays in the pool otherwise).  A header copied by
+ * apr_array_copy_hdr() may only think it is the last block if its
+ * size is not aligned, the source array having some more elements
+ * allocated up to the alignment, so only aligned sizes are grown.
+ */
+static void array_grow(apr_array_header_t *arr, int nalloc, int want,
+                       int clear)
 {
-    if (arr->nelts == arr->nalloc) {
-        int new_size = (arr->nalloc <= 0) ? 1 : arr->nalloc * 2;
-        char *new_data;
+    apr_size_t elt_size = arr->elt_size;
+    apr_size_t size = arr->nalloc * elt_size;
+    char *new_data;
+
+    if (arr->nalloc > 0 && size == APR_ALIGN_DEFAULT(size)) {
+        if (want > nalloc
+                && apr_presize(arr->pool, arr->elts, size, want * elt_size)) {
+            nalloc = want;
+            goto grown;
+        }
+        if (apr_presize(arr->pool, arr->elts, size, nalloc * elt_size)) {
+            goto grown;
+        }
+    }
+    if (want > nalloc) {
+        nalloc = want;
+    }
+    new_data = apr_palloc(arr->pool, elt_size * nalloc);
+    if (arr->nalloc > 0) {
+        memcpy(new_data, arr->elts, size);
+    }
+    arr->elts = new_data;
 
-        new_data = apr_palloc(arr->pool, arr->elt_size * new_size);
+grown:
+    if (clear && arr->nalloc < nalloc) {
+        int old = arr->nalloc > 0 ? arr->nalloc : 0;
 
-        memcpy(new_data, arr->elts, arr->nalloc * arr->elt_size);
-        memset(new_data + arr->nalloc * arr->elt_size, 0,
-               arr->elt_size * (new_size - arr->nalloc));
-        arr->elts = new_data;
-        arr->nalloc = new_size;
+        memset(arr->elts + old * elt_size, 0, elt_size * (nalloc - old));
+    }
+    arr->nalloc = nalloc;
+}
+
+/* Grow arr by doubling its size, for nelts elements at least */
+static APR_INLINE void array_grow_double(apr_array_header_t *arr, int nelts,
+                                         int clear)
+{
+    int new_size = (arr->nalloc <= 0) ? 1 : arr->nalloc * 2;
+
+    while (nelts > new_size) {
+        new_size *= 2;
+    }
+    array_grow(arr, nelts, new_size, clear);
+}
+
+APR_DECLARE(void *) apr_array_push(apr_array_header_t *arr)
+{
+    if (arr->nelts == arr->nalloc) {
+        array_grow_double(arr, arr->nelts + 1, 1);
     }
 
     ++arr->nelts;
@@ -126,38 +173,60 @@ APR_DECLARE(void *) apr_array_push(apr_array_header_t *arr)
 static void *apr_array_push_noclear(apr_array_header_t *arr)
 {
     if (arr->nelts == arr->nalloc) {
-        int new_size = (arr->nalloc <= 0) ? 1 : arr->nalloc * 2;
-        char *new_data;
-
-        new_data = apr_palloc(arr->pool, arr->elt_size * new_size);
-
-        memcpy(new_data, arr->elts, arr->nalloc * arr->elt_size);
-        arr->elts = new_data;
-        arr->nalloc = new_size;
+        array_grow_double(arr, arr->nelts + 1, 0);
     }
 
     ++arr->nelts;
     return arr->elts + (arr->elt_size * (arr->nelts - 1));
 }
 
+APR_DECLARE(void *) apr_array_push_n(apr_array_header_t *arr, int nelts)
+{
+    if (nelts <= 0) {
+        return arr->elts + (arr->elt_size * arr->nelts);
+    }
+    if (arr->nelts + nelts > arr->nalloc) {
+        array_grow_double(arr, arr->nelts + nelts, 1);
+    }
+
+    arr->nelts += nelts;
+    return arr->elts + (arr->elt_size * (arr->nelts - nelts));
+}
+
+APR_DECLARE(void) apr_array_reserve(apr_array_header_t *arr, int nelts)
+{
+    if (nelts > arr->nalloc) {
+        array_grow(arr, nelts, nelts, 1);
+    }
+}
+
+APR_DECLARE(void) apr_array_shrink_to_fit(apr_array_header_t *arr)
+{
+    int nalloc = (arr->nelts < 1) ? 1 : arr->nelts;
+
+    if (arr->nalloc > nalloc
+            && apr_presize(arr->pool, arr->elts,
+                           (apr_size_t)arr->nalloc * arr->elt_size,
+                           (apr_size_t)nalloc * arr->elt_size)) {
+        arr->nalloc = nalloc;
+    }
+}
+
+APR_DECLARE(void) apr_array_sort(apr_array_header_t *arr,
+                                 apr_array_cmp_fn_t *cmp)
+{
+    if (arr->nelts > 1) {
+        qsort(arr->elts, arr->nelts, arr->elt_size, cmp);
+    }
+}
+
 APR_DECLARE(void) apr_array_cat(apr_array_header_t *dst,
 			       const apr_array_header_t *src)
 {
     int elt_size = dst->elt_size;
 
     if (dst->nelts + src->nelts > dst->nalloc) {
-	int new_size = (dst->nalloc <= 0) ? 1 : dst->nalloc * 2;
-	char *new_data;
-
-	while (dst->nelts + src->nelts > new_size) {
-	    new_size *= 2;
-	}
-
-	new_data = apr_pcalloc(dst->pool, elt_size * new_size);
-	memcpy(new_data, dst->elts, dst->nalloc * elt_size);
-
-	dst->elts = new_data;
-	dst->nalloc = new_size;
+        array_grow_double(dst, dst->nelts + src->nelts, 1);
     }
 
     memcpy(dst->elts + dst->nelts * elt_size, src->elts,
@@ -299,11 +368,14 @@ APR_DECLARE(char *) apr_array_pstrcat(apr_pool_t *p,
 #define TABLE_INDEX_IS_INITIALIZED(t, i) ((t)->index_initialized & (1u << (i)))
 #define TABLE_SET_INDEX_INITIALIZED(t, i) ((t)->index_initialized |= (1u << (i)))
 
+/* Tables with this many entries get a full hash index, see below */
+#define TABLE_HINDEX_MIN 16
+
 /* Compute the "checksum" for a key, consisting of the first
  * 4 bytes, normalized for case-insensitivity and packed into
  * an int...this checksum allows us to do a single integer
  * comparison as a fast check to determine whether we can
- * skip a strcasecmp
+ * skip an apr_cstr_casecmp
  */
 #define COMPUTE_KEY_CHECKSUM(key, checksum)    \
 {                                              \
@@ -355,6 +427,27 @@ struct apr_table_t {
     apr_uint32_t index_initialized;
     int index_first[TABLE_HASH_SIZE];
     int index_last[TABLE_HASH_SIZE];
+    /* Keys starting with the same character (e.g. "Accept-*" or
+     * "Content-*") all land in the same slot of the above index, so
+     * once the table has TABLE_HINDEX_MIN entries it also gets a full
+     * (case-insensitive) hash index:
+     *   - hindex_last[table_hindex_hash(key) & hindex_max] is the offset
+     *     of the last entry whose key hashes to that slot, or -1
+     *   - hindex_prev[i] is the offset of the previous entry in the slot
+     *     of entry i, or -1
+     * Since the entries only ever link to lower offsets, the ones before
+     * a change of the table never need to be relinked.  The index of the
+     * first character is still maintained, for the tables being merged.
+     */
+    int *hindex_last;
+    int *hindex_prev;
+    int hindex_max;
+    int hindex_nalloc;
+    /* Set when the entries and the hash index are shared with other
+     * tables (apr_table_copy_cow() does not copy them), in which case the
+     * table gets its own copy before any change, see table_own().
+     */
+    volatile apr_uint32_t shared;
 };
 
 /* keep state for apr_table_getm() */
@@ -406,9 +499,39 @@ APR_DECLARE(apr_table_t *) apr_table_make(apr_pool_t *p, int nelts)
     t->creator = __builtin_return_address(0);
 #endif
     t->index_initialized = 0;
+    t->hindex_last = NULL;
+    t->hindex_prev = NULL;
+    t->hindex_max = 0;
+    t->hindex_nalloc = 0;
+    t->shared = 0;
     return t;
 }
 
+/* Copy the entries and the hash index of a shared table, before it
+ * is changed */
+static void table_own(apr_table_t *t)
+{
+    char *elts;
+
+    if (!t->shared) {
+        return;
+    }
+    elts = apr_palloc(t->a.pool, t->a.nalloc * sizeof(apr_table_entry_t));
+    memcpy(elts, t->a.elts, t->a.nelts * sizeof(apr_table_entry_t));
+    t->a.elts = elts;
+    if (t->hindex_last) {
+        int *last = apr_palloc(t->a.pool, sizeof(int) * (t->hindex_max + 1));
+        int *prev = apr_palloc(t->a.pool, sizeof(int) * t->a.nalloc);
+
+        memcpy(last, t->hindex_last, sizeof(int) * (t->hindex_max + 1));
+        memcpy(prev, t->hindex_prev, sizeof(int) * t->a.nelts);
+        t->hindex_last = last;
+        t->hindex_prev = prev;
+        t->hindex_nalloc = t->a.nalloc;
+    }
+    t->shared = 0;
+}
+
 APR_DECLARE(apr_table_t *) apr_table_copy(apr_pool_t *p, const apr_table_t *t)
 {
     apr_table_t *new = apr_palloc(p, sizeof(apr_table_t));
@@ -428,6 +551,53 @@ APR_DECLARE(apr_table_t *) apr_table_copy(apr_pool_t *p, const apr_table_t *t)
     memcpy(new->index_first, t->index_first, sizeof(int) * TABLE_HASH_SIZE);
     memcpy(new->index_last, t->index_last, sizeof(int) * TABLE_HASH_SIZE);
     new->index_initialized = t->index_initialized;
+    if (t->hindex_last) {
+        new->hindex_max = t->hindex_max;
+        new->hindex_last = apr_palloc(p, sizeof(int) * (t->hindex_max + 1));
+        memcpy(new->hindex_last, t->hindex_last,
+               sizeof(int) * (t->hindex_max + 1));
+        new->hindex_nalloc = new->a.nalloc;
+        new->hindex_prev = apr_palloc(p, sizeof(int) * new->hindex_nalloc);
+        memcpy(new->hindex_prev, t->hindex_prev, sizeof(int) * t->a.nelts);
+    }
+    else {
+        new->hindex_last = NULL;
+        new->hindex_prev = NULL;
+        new->hindex_max = 0;
+        new->hindex_nalloc = 0;
+    }
+    new->shared = 0;
+    return new;
+}
+
+APR_DECLARE(apr_table_t *) apr_table_copy_cow(apr_pool_t *p,
+                                              const apr_table_t *t)
+{
+    apr_table_t *new;
+
+    if (!apr_pool_is_ancestor(t->a.pool, p)) {
+        return apr_table_copy(p, t);
+    }
+
+    /* The entries and the hash index of t live as long as p, so share
+     * them until either table changes, both being marked.  Threads may
+     * copy a table they only read concurrently, hence t is marked
+     * atomically, and only once.
+     */
+    new = apr_palloc(p, sizeof(apr_table_t));
+    new->a = t->a;
+    new->a.pool = p;
+    memcpy(new->index_first, t->index_first, sizeof(int) * TABLE_HASH_SIZE);
+    memcpy(new->index_last, t->index_last, sizeof(int) * TABLE_HASH_SIZE);
+    new->index_initialized = t->index_initialized;
+    new->hindex_last = t->hindex_last;
+    new->hindex_prev = t->hindex_prev;
+    new->hindex_max = t->hindex_max;
+    new->hindex_nalloc = t->hindex_nalloc;
+    new->shared = 1;
+    if (!apr_atomic_read32(&((apr_table_t *)t)->shared)) {
+        apr_atomic_set32(&((apr_table_t *)t)->shared, 1);
+    }
     return new;
 }
 
@@ -445,7 +615,95 @@ APR_DECLARE(apr_table_t *) apr_table_clone(apr_pool_t *p, const apr_table_t *t)
     return new;
 }
 
-static void table_reindex(apr_table_t *t)
+/* Like CASE_MASK, the hash of the keys equal but for the case is the same */
+static unsigned int table_hindex_hash(const char *key)
+{
+    const unsigned char *k = (const unsigned char *)key;
+    unsigned int hash = 0;
+
+    for (; *k; k++) {
+        hash = hash * 33 + (*k & (unsigned char)CASE_MASK);
+    }
+    return hash ^ (hash >> 16);
+}
+
+/* Link the entries from offset start to the end of the table in the
+ * hash index, the entries before being linked already.  The index is
+ * built (or resized) as needed, relinking all the entries then.
+ */
+static void table_hindex_link(apr_table_t *t, int start)
+{
+    apr_table_entry_t *elts = (apr_table_entry_t *) t->a.elts;
+    int i, slot;
+
+    if (!t->hindex_last) {
+        if (t->a.nelts < TABLE_HINDEX_MIN) {
+            return;
+        }
+        t->hindex_max = TABLE_HINDEX_MIN * 2 - 1;
+    }
+    else if (t->a.nelts > t->hindex_max + 1) {
+        t->hindex_last = NULL;
+    }
+    if (!t->hindex_last) {
+        /* Keep at most one entry per slot on average */
+        while (t->a.nelts > t->hindex_max + 1) {
+            t->hindex_max = t->hindex_max * 2 + 1;
+        }
+        t->hindex_last = apr_palloc(t->a.pool,
+                                    sizeof(int) * (t->hindex_max + 1));
+        for (slot = 0; slot <= t->hindex_max; slot++) {
+            t->hindex_last[slot] = -1;
+        }
+        start = 0;
+    }
+    if (t->a.nelts > t->hindex_nalloc) {
+        int *prev = apr_palloc(t->a.pool, sizeof(int) * t->a.nalloc);
+        if (start) {
+            memcpy(prev, t->hindex_prev, sizeof(int) * start);
+        }
+        t->hindex_prev = prev;
+        t->hindex_nalloc = t->a.nalloc;
+    }
+
+    for (i = start; i < t->a.nelts; i++) {
+        slot = table_hindex_hash(elts[i].key) & t->hindex_max;
+        t->hindex_prev[i] = t->hindex_last[slot];
+        t->hindex_last[slot] = i;
+    }
+}
+
+/* Find the offsets of the first and last entries with the given key.
+ * Without a hash index these are only the bounds of its first character's
+ * entries; returns zero if the key is known not to be in the table.
+ */
+static int table_index_range(const apr_table_t *t, const char *key,
+                             int hash, apr_uint32_t checksum,
+                             int *first, int *last)
+{
+    if (t->hindex_last) {
+        apr_table_entry_t *elts = (apr_table_entry_t *) t->a.elts;
+        int i = t->hindex_last[table_hindex_hash(key) & t->hindex_max];
+
+        *last = -1;
+        for (; i >= 0; i = t->hindex_prev[i]) {
+            if ((checksum == elts[i].key_checksum) &&
+                !apr_cstr_casecmp(elts[i].key, key)) {
+                if (*last < 0) {
+                    *last = i;
+                }
+                *first = i;
+            }
+        }
+        return *last >= 0;
+    }
+    *first = t->index_first[hash];
+    *last = t->index_last[hash];
+    return 1;
+}
+
+/* Reindex the table after the entries from offset start were moved */
+static void table_reindex(apr_table_t *t, int start)
 {
     int i;
     int hash;
@@ -460,12 +718,31 @@ static void table_reindex(apr_table_t *t)
             TABLE_SET_INDEX_INITIALIZED(t, hash);
         }
     }
+
+    if (t->hindex_last) {
+        /* Unlink the entries from start: the links of the moved entries
+         * are still those of their former offsets, all of them at
+         * least start too.
+         */
+        for (hash = 0; hash <= t->hindex_max; hash++) {
+            i = t->hindex_last[hash];
+            while (i >= start) {
+                i = t->hindex_prev[i];
+            }
+            t->hindex_last[hash] = i;
+        }
+    }
+    table_hindex_link(t, start);
 }
 
 APR_DECLARE(void) apr_table_clear(apr_table_t *t)
 {
+    table_own(t);
     t->a.nelts = 0;
     t->index_initialized = 0;
+    if (t->hindex_last) {
+        table_reindex(t, 0);
+    }
 }
 
 APR_DECLARE(const char *) apr_table_get(const apr_table_t *t, const char *key)
@@ -474,6 +751,7 @@ APR_DECLARE(const char *) apr_table_get(const apr_table_t *t, const char *key)
     apr_table_entry_t *end_elt;
     apr_uint32_t checksum;
     int hash;
+    int first, last;
 
     if (key == NULL) {
 	return NULL;
@@ -484,12 +762,15 @@ APR_DECLARE(const char *) apr_table_get(const apr_table_t *t, const char *key)
         return NULL;
     }
     COMPUTE_KEY_CHECKSUM(key, checksum);
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
-    end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
+    if (!table_index_range(t, key, hash, checksum, &first, &last)) {
+        return NULL;
+    }
+    next_elt = ((apr_table_entry_t *) t->a.elts) + first;
+    end_elt = ((apr_table_entry_t *) t->a.elts) + last;
 
     for (; next_elt <= end_elt; next_elt++) {
 	if ((checksum == next_elt->key_checksum) &&
-            !strcasecmp(next_elt->key, key)) {
+            !apr_cstr_casecmp(next_elt->key, key)) {
 	    return next_elt->val;
 	}
     }
@@ -505,21 +786,26 @@ APR_DECLARE(void) apr_table_set(apr_table_t *t, const char *key,
     apr_table_entry_t *table_end;
     apr_uint32_t checksum;
     int hash;
+    int first, last;
 
     COMPUTE_KEY_CHECKSUM(key, checksum);
+    table_own(t);
     hash = TABLE_HASH(key);
     if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
         t->index_first[hash] = t->a.nelts;
         TABLE_SET_INDEX_INITIALIZED(t, hash);
         goto add_new_elt;
     }
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
-    end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
+    if (!table_index_range(t, key, hash, checksum, &first, &last)) {
+        goto add_new_elt;
+    }
+    next_elt = ((apr_table_entry_t *) t->a.elts) + first;
+    end_elt = ((apr_table_entry_t *) t->a.elts) + last;
     table_end =((apr_table_entry_t *) t->a.elts) + t->a.nelts;
 
     for (; next_elt <= end_elt; next_elt++) {
 	if ((checksum == next_elt->key_checksum) &&
-            !strcasecmp(next_elt->key, key)) {
+            !apr_cstr_casecmp(next_elt->key, key)) {
 
             /* Found an existing entry with the same key, so overwrite it */
 
@@ -531,7 +817,7 @@ APR_DECLARE(void) apr_table_set(apr_table_t *t, const char *key,
             /* Remove any other instances of this key */
             for (next_elt++; next_elt <= end_elt; next_elt++) {
                 if ((checksum == next_elt->key_checksum) &&
-                    !strcasecmp(next_elt->key, key)) {
+                    !apr_cstr_casecmp(next_elt->key, key)) {
                     t->a.nelts--;
                     if (!dst_elt) {
                         dst_elt = next_elt;
@@ -555,7 +841,7 @@ APR_DECLARE(void) apr_table_set(apr_table_t *t, const char *key,
                 must_reindex = 1;
             }
             if (must_reindex) {
-                table_reindex(t);
+                table_reindex(t, first);
             }
             return;
         }
@@ -567,6 +853,7 @@ add_new_elt:
     next_elt->key = apr_pstrdup(t->a.pool, key);
     next_elt->val = apr_pstrdup(t->a.pool, val);
     next_elt->key_checksum = checksum;
+    table_hindex_link(t, t->a.nelts - 1);
 }
 
 APR_DECLARE(void) apr_table_setn(apr_table_t *t, const char *key,
@@ -577,21 +864,26 @@ APR_DECLARE(void) apr_table_setn(apr_table_t *t, const char *key,
     apr_table_entry_t *table_end;
     apr_uint32_t checksum;
     int hash;
+    int first, last;
 
     COMPUTE_KEY_CHECKSUM(key, checksum);
+    table_own(t);
     hash = TABLE_HASH(key);
     if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
         t->index_first[hash] = t->a.nelts;
         TABLE_SET_INDEX_INITIALIZED(t, hash);
         goto add_new_elt;
     }
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
-    end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
+    if (!table_index_range(t, key, hash, checksum, &first, &last)) {
+        goto add_new_elt;
+    }
+    next_elt = ((apr_table_entry_t *) t->a.elts) + first;
+    end_elt = ((apr_table_entry_t *) t->a.elts) + last;
     table_end =((apr_table_entry_t *) t->a.elts) + t->a.nelts;
 
     for (; next_elt <= end_elt; next_elt++) {
 	if ((checksum == next_elt->key_checksum) &&
-            !strcasecmp(next_elt->key, key)) {
+            !apr_cstr_casecmp(next_elt->key, key)) {
 
             /* Found an existing entry with the same key, so overwrite it */
 
@@ -603,7 +895,7 @@ APR_DECLARE(void) apr_table_setn(apr_table_t *t, const char *key,
             /* Remove any other instances of this key */
             for (next_elt++; next_elt <= end_elt; next_elt++) {
                 if ((checksum == next_elt->key_checksum) &&
-                    !strcasecmp(next_elt->key, key)) {
+                    !apr_cstr_casecmp(next_elt->key, key)) {
                     t->a.nelts--;
                     if (!dst_elt) {
                         dst_elt = next_elt;
@@ -627,7 +919,7 @@ APR_DECLARE(void) apr_table_setn(apr_table_t *t, const char *key,
                 must_reindex = 1;
             }
             if (must_reindex) {
-                table_reindex(t);
+                table_reindex(t, first);
             }
             return;
         }
@@ -639,6 +931,7 @@ add_new_elt:
     next_elt->key = (char *)key;
     next_elt->val = (char *)val;
     next_elt->key_checksum = checksum;
+    table_hindex_link(t, t->a.nelts - 1);
 }
 
 APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
@@ -648,6 +941,7 @@ APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
     apr_table_entry_t *dst_elt;
     apr_uint32_t checksum;
     int hash;
+    int first, last;
     int must_reindex;
 
     hash = TABLE_HASH(key);
@@ -655,12 +949,16 @@ APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
         return;
     }
     COMPUTE_KEY_CHECKSUM(key, checksum);
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];
-    end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
+    if (!table_index_range(t, key, hash, checksum, &first, &last)) {
+        return;
+    }
+    table_own(t);
+    next_elt = ((apr_table_entry_t *) t->a.elts) + first;
+    end_elt = ((apr_table_entry_t *) t->a.elts) + last;
     must_reindex = 0;
     for (; next_elt <= end_elt; next_elt++) {
 	if ((checksum == next_elt->key_checksum) &&
-            !strcasecmp(next_elt->key, key)) {
+            !apr_cstr_casecmp(next_elt->key, key)) {
 
             /* Found a match: remove this entry, plus any additional
              * matches for the same key that might follow
@@ -671,7 +969,7 @@ APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
             dst_elt = next_elt;
             for (next_elt++; next_elt <= end_elt; next_elt++) {
                 if ((checksum == next_elt->key_checksum) &&
-                    !strcasecmp(next_elt->key, key)) {
+                    !apr_cstr_casecmp(next_elt->key, key)) {
                     t->a.nelts--;
                 }
                 else {
@@ -691,7 +989,7 @@ APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
         }
     }
     if (must_reindex) {
-        table_reindex(t);
+        table_reindex(t, first);
     }
 }
 
@@ -702,20 +1000,25 @@ APR_DECLARE(void) apr_table_merge(apr_table_t *t, const char *key,
     apr_table_entry_t *end_elt;
     apr_uint32_t checksum;
     int hash;
+    int first, last;
 
     COMPUTE_KEY_CHECKSUM(key, checksum);
+    table_own(t);
     hash = TABLE_HASH(key);
     if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
         t->index_first[hash] = t->a.nelts;
         TABLE_SET_INDEX_INITIALIZED(t, hash);
         goto add_new_elt;
     }
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];
-    end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
+    if (!table_index_range(t, key, hash, checksum, &first, &last)) {
+        goto add_new_elt;
+    }
+    next_elt = ((apr_table_entry_t *) t->a.elts) + first;
+    end_elt = ((apr_table_entry_t *) t->a.elts) + last;
 
     for (; next_elt <= end_elt; next_elt++) {
 	if ((checksum == next_elt->key_checksum) &&
-            !strcasecmp(next_elt->key, key)) {
+            !apr_cstr_casecmp(next_elt->key, key)) {
 
             /* Found an existing entry with the same key, so merge with it */
 	    next_elt->val = apr_pstrcat(t->a.pool, next_elt->val, ", ",
@@ -730,6 +1033,7 @@ add_new_elt:
     next_elt->key = apr_pstrdup(t->a.pool, key);
     next_elt->val = apr_pstrdup(t->a.pool, val);
     next_elt->key_checksum = checksum;
+    table_hindex_link(t, t->a.nelts - 1);
 }
 
 APR_DECLARE(void) apr_table_mergen(apr_table_t *t, const char *key,
@@ -739,6 +1043,7 @@ APR_DECLARE(void) apr_table_mergen(apr_table_t *t, const char *key,
     apr_table_entry_t *end_elt;
     apr_uint32_t checksum;
     int hash;
+    int first, last;
 
 #if APR_POOL_DEBUG
     {
@@ -759,18 +1064,22 @@ APR_DECLARE(void) apr_table_mergen(apr_table_t *t, const char *key,
 #endif
 
     COMPUTE_KEY_CHECKSUM(key, checksum);
+    table_own(t);
     hash = TABLE_HASH(key);
     if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
         t->index_first[hash] = t->a.nelts;
         TABLE_SET_INDEX_INITIALIZED(t, hash);
         goto add_new_elt;
     }
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
-    end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
+    if (!table_index_range(t, key, hash, checksum, &first, &last)) {
+        goto add_new_elt;
+    }
+    next_elt = ((apr_table_entry_t *) t->a.elts) + first;
+    end_elt = ((apr_table_entry_t *) t->a.elts) + last;
 
     for (; next_elt <= end_elt; next_elt++) {
 	if ((checksum == next_elt->key_checksum) &&
-            !strcasecmp(next_elt->key, key)) {
+            !apr_cstr_casecmp(next_elt->key, key)) {
 
             /* Found an existing entry with the same key, so merge with it */
 	    next_elt->val = apr_pstrcat(t->a.pool, next_elt->val, ", ",
@@ -785,6 +1094,7 @@ add_new_elt:
     next_elt->key = (char *)key;
     next_elt->val = (char *)val;
     next_elt->key_checksum = checksum;
+    table_hindex_link(t, t->a.nelts - 1);
 }
 
 APR_DECLARE(void) apr_table_add(apr_table_t *t, const char *key,
@@ -794,6 +1104,7 @@ APR_DECLARE(void) apr_table_add(apr_table_t *t, const char *key,
     apr_uint32_t checksum;
     int hash;
 
+    table_own(t);
     hash = TABLE_HASH(key);
     t->index_last[hash] = t->a.nelts;
     if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
@@ -805,6 +1116,7 @@ APR_DECLARE(void) apr_table_add(apr_table_t *t, const char *key,
     elts->key = apr_pstrdup(t->a.pool, key);
     elts->val = apr_pstrdup(t->a.pool, val);
     elts->key_checksum = checksum;
+    table_hindex_link(t, t->a.nelts - 1);
 }
 
 APR_DECLARE(void) apr_table_addn(apr_table_t *t, const char *key,
@@ -827,6 +1139,7 @@ APR_DECLARE(void) apr_table_addn(apr_table_t *t, const char *key,
     }
 #endif
 
+    table_own(t);
     hash = TABLE_HASH(key);
     t->index_last[hash] = t->a.nelts;
     if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
@@ -838,6 +1151,7 @@ APR_DECLARE(void) apr_table_addn(apr_table_t *t, const char *key,
     elts->key = (char *)key;
     elts->val = (char *)val;
     elts->key_checksum = checksum;
+    table_hindex_link(t, t->a.nelts - 1);
 }
 
 APR_DECLARE(apr_table_t *) apr_table_overlay(apr_pool_t *p,
@@ -868,7 +1182,21 @@ APR_DECLARE(apr_table_t *) apr_table_overlay(apr_pool_t *p,
     res->a.pool = p;
     copy_array_hdr_core(&res->a, &overlay->a);
     apr_array_cat(&res->a, &base->a);
-    table_reindex(res);
+    res->hindex_last = NULL;
+    res->hindex_prev = NULL;
+    res->hindex_max = 0;
+    res->hindex_nalloc = 0;
+    res->shared = 0;
+    /* With an empty base the entries of overlay are not copied yet, and
+     * may be shared with its copies made by apr_table_copy_cow()
+     */
+    if (res->a.elts == overlay->a.elts) {
+        char *elts = apr_palloc(p, res->a.nalloc * sizeof(apr_table_entry_t));
+
+        memcpy(elts, res->a.elts, res->a.nelts * sizeof(apr_table_entry_t));
+        res->a.elts = elts;
+    }
+    table_reindex(res, 0);
     return res;
 }
 
@@ -971,13 +1299,14 @@ APR_DECLARE(int) apr_table_vdo(apr_table_do_callback_fn_t *comp,
         if (argp) {
             /* Scan for entries that match the next key */
             int hash = TABLE_HASH(argp);
-            if (TABLE_INDEX_IS_INITIALIZED(t, hash)) {
-                apr_uint32_t checksum;
-                COMPUTE_KEY_CHECKSUM(argp, checksum);
-                for (i = t->index_first[hash];
-                     rv && (i <= t->index_last[hash]); ++i) {
+            int first, last;
+            apr_uint32_t checksum;
+            COMPUTE_KEY_CHECKSUM(argp, checksum);
+            if (TABLE_INDEX_IS_INITIALIZED(t, hash) &&
+                table_index_range(t, argp, hash, checksum, &first, &last)) {
+                for (i = first; rv && (i <= last); ++i) {
                     if (elts[i].key && (checksum == elts[i].key_checksum) &&
-                                        !strcasecmp(elts[i].key, argp)) {
+                                        !apr_cstr_casecmp(elts[i].key, argp)) {
                         rv = (*comp) (rec, elts[i].key, elts[i].val);
                     }
                 }
@@ -999,109 +1328,35 @@ APR_DECLARE(int) apr_table_vdo(apr_table_do_callback_fn_t *comp,
     return vdorv;
 }
 
-static apr_table_entry_t **table_mergesort(apr_pool_t *pool,
-                                           apr_table_entry_t **values,
-                                           apr_size_t n)
+/* The offsets of the entries possibly having the key of entry i are
+ * walked from the last one down, either through the hash index or the
+ * range of the key's first character.
+ */
+static int table_dup_last(const apr_table_t *t, int i)
 {
-    /* Bottom-up mergesort, based on design in Sedgewick's "Algorithms
-     * in C," chapter 8
-     */
-    apr_table_entry_t **values_tmp =
-        (apr_table_entry_t **)apr_palloc(pool, n * sizeof(apr_table_entry_t*));
-    apr_size_t i;
-    apr_size_t blocksize;
-
-    /* First pass: sort pairs of elements (blocksize=1) */
-    for (i = 0; i + 1 < n; i += 2) {
-        if (strcasecmp(values[i]->key, values[i + 1]->key) > 0) {
-            apr_table_entry_t *swap = values[i];
-            values[i] = values[i + 1];
-            values[i + 1] = swap;
-        }
-    }
-
-    /* Merge successively larger blocks */
-    blocksize = 2;
-    while (blocksize < n) {
-        apr_table_entry_t **dst = values_tmp;
-        apr_size_t next_start;
-        apr_table_entry_t **swap;
-
-        /* Merge consecutive pairs blocks of the next blocksize.
-         * Within a block, elements are in sorted order due to
-         * the previous iteration.
-         */
-        for (next_start = 0; next_start + blocksize < n;
-             next_start += (blocksize + blocksize)) {
-
-            apr_size_t block1_start = next_start;
-            apr_size_t block2_start = block1_start + blocksize;
-            apr_size_t block1_end = block2_start;
-            apr_size_t block2_end = block2_start + blocksize;
-            if (block2_end > n) {
-                /* The last block may be smaller than blocksize */
-                block2_end = n;
-            }
-            for (;;) {
-
-                /* Merge the next two blocks:
-                 * Pick the smaller of the next element from
-                 * block 1 and the next element from block 2.
-                 * Once either of the blocks is emptied, copy
-                 * over all the remaining elements from the
-                 * other block
-                 */
-                if (block1_start == block1_end) {
-                    for (; block2_start < block2_end; block2_start++) {
-                        *dst++ = values[block2_start];
-                    }
-                    break;
-                }
-                else if (block2_start == block2_end) {
-                    for (; block1_start < block1_end; block1_start++) {
-                        *dst++ = values[block1_start];
-                    }
-                    break;
-                }
-                if (strcasecmp(values[block1_start]->key,
-                               values[block2_start]->key) > 0) {
-                    *dst++ = values[block2_start++];
-                }
-                else {
-                    *dst++ = values[block1_start++];
-                }
-            }
-        }
-
-        /* If n is not a multiple of 2*blocksize, some elements
-         * will be left over at the end of the array.
-         */
-        for (i = dst - values_tmp; i < n; i++) {
-            values_tmp[i] = values[i];
-        }
-
-        /* The output array of this pass becomes the input
-         * array of the next pass, and vice versa
-         */
-        swap = values_tmp;
-        values_tmp = values;
-        values = swap;
+    apr_table_entry_t *elts = (apr_table_entry_t *) t->a.elts;
 
-        blocksize += blocksize;
+    if (t->hindex_last) {
+        return t->hindex_last[table_hindex_hash(elts[i].key)
+                              & t->hindex_max];
     }
+    return t->index_last[TABLE_HASH(elts[i].key)];
+}
 
-    return values;
+static APR_INLINE int table_dup_prev(const apr_table_t *t, int j)
+{
+    return t->hindex_last ? t->hindex_prev[j] : j - 1;
 }
 
+#define TABLE_IS_DUP(elts, i, j) ((elts)[j].key &&                     \
+    ((elts)[j].key_checksum == (elts)[i].key_checksum) &&              \
+    !apr_cstr_casecmp((elts)[j].key, (elts)[i].key))
+
 APR_DECLARE(void) apr_table_compress(apr_table_t *t, unsigned flags)
 {
-    apr_table_entry_t **sort_array;
-    apr_table_entry_t **sort_next;
-    apr_table_entry_t **sort_end;
-    apr_table_entry_t *table_next;
-    apr_table_entry_t **last;
-    int i;
-    int dups_found;
+    apr_table_entry_t *elts = (apr_table_entry_t *) t->a.elts;
+    int i, j;
+    int first_dup;
 
     if (flags == APR_OVERLAP_TABLES_ADD) {
         return;
@@ -1110,98 +1365,87 @@ APR_DECLARE(void) apr_table_compress(apr_table_t *t, unsigned flags)
     if (t->a.nelts <= 1) {
         return;
     }
+    table_own(t);
+    elts = (apr_table_entry_t *) t->a.elts;
 
-    /* Copy pointers to all the table elements into an
-     * array and sort to allow for easy detection of
-     * duplicate keys
+    /* Merge the duplicates of each key into its first entry, in place:
+     * the hash index (built here if the table is big enough but has
+     * none) finds them, so that no scratch space is needed.
      */
-    sort_array = (apr_table_entry_t **)
-        apr_palloc(t->a.pool, t->a.nelts * sizeof(apr_table_entry_t*));
-    sort_next = sort_array;
-    table_next = (apr_table_entry_t *)t->a.elts;
-    i = t->a.nelts;
-    do {
-        *sort_next++ = table_next++;
-    } while (--i);
+    if (!t->hindex_last) {
+        table_hindex_link(t, 0);
+    }
 
-    /* Note: the merge is done with mergesort instead of quicksort
-     * because mergesort is a stable sort and runs in n*log(n)
-     * time regardless of its inputs (quicksort is quadratic in
-     * the worst case)
-     */
-    sort_array = table_mergesort(t->a.pool, sort_array, t->a.nelts);
-
-    /* Process any duplicate keys */
-    dups_found = 0;
-    sort_next = sort_array;
-    sort_end = sort_array + t->a.nelts;
-    last = sort_next++;
-    while (sort_next < sort_end) {
-        if (((*sort_next)->key_checksum == (*last)->key_checksum) &&
-            !strcasecmp((*sort_next)->key, (*last)->key)) {
-            apr_table_entry_t **dup_last = sort_next + 1;
-            dups_found = 1;
-            while ((dup_last < sort_end) &&
-                   ((*dup_last)->key_checksum == (*last)->key_checksum) &&
-                   !strcasecmp((*dup_last)->key, (*last)->key)) {
-                dup_last++;
+    first_dup = t->a.nelts;
+    for (i = 0; i < t->a.nelts; i++) {
+        apr_size_t len = 0;
+        int dup_last = -1;
+
+        if (!elts[i].key) {
+            continue;
+        }
+        for (j = table_dup_last(t, i); j > i; j = table_dup_prev(t, j)) {
+            if (TABLE_IS_DUP(elts, i, j)) {
+                if (dup_last < 0) {
+                    dup_last = j;
+                }
+                len += strlen(elts[j].val) + 2; /* for ", " */
             }
-            dup_last--; /* Elements from last through dup_last, inclusive,
-                         * all have the same key
-                         */
-            if (flags == APR_OVERLAP_TABLES_MERGE) {
-                apr_size_t len = 0;
-                apr_table_entry_t **next = last;
-                char *new_val;
-                char *val_dst;
-                do {
-                    len += strlen((*next)->val);
-                    len += 2; /* for ", " or trailing null */
-                } while (++next <= dup_last);
-                new_val = (char *)apr_palloc(t->a.pool, len);
-                val_dst = new_val;
-                next = last;
-                for (;;) {
-                    strcpy(val_dst, (*next)->val);
-                    val_dst += strlen((*next)->val);
-                    next++;
-                    if (next > dup_last) {
-                        *val_dst = 0;
-                        break;
-                    }
-                    else {
-                        *val_dst++ = ',';
-                        *val_dst++ = ' ';
+        }
+        if (dup_last < 0) {
+            continue;
+        }
+
+        if (flags == APR_OVERLAP_TABLES_MERGE) {
+            /* The duplicates are walked backward, so are their values */
+            apr_size_t first_len = strlen(elts[i].val);
+            char *new_val = apr_palloc(t->a.pool, first_len + len + 1);
+            char *val_dst = new_val + first_len + len;
+
+            *val_dst = '\0';
+            for (j = dup_last; j > i; j = table_dup_prev(t, j)) {
+                if (TABLE_IS_DUP(elts, i, j)) {
+                    apr_size_t val_len = strlen(elts[j].val);
+                    val_dst -= val_len;
+                    memcpy(val_dst, elts[j].val, val_len);
+                    *--val_dst = ' ';
+                    *--val_dst = ',';
+                    elts[j].key = NULL;
+                    if (j < first_dup) {
+                        first_dup = j;
                     }
                 }
-                (*last)->val = new_val;
             }
-            else { /* overwrite */
-                (*last)->val = (*dup_last)->val;
-            }
-            do {
-                (*sort_next)->key = NULL;
-            } while (++sort_next <= dup_last);
+            memcpy(new_val, elts[i].val, first_len);
+            elts[i].val = new_val;
         }
-        else {
-            last = sort_next++;
+        else { /* overwrite */
+            elts[i].val = elts[dup_last].val;
+            for (j = dup_last; j > i; j = table_dup_prev(t, j)) {
+                if (TABLE_IS_DUP(elts, i, j)) {
+                    elts[j].key = NULL;
+                    if (j < first_dup) {
+                        first_dup = j;
+                    }
+                }
+            }
         }
     }
 
     /* Shift elements to the left to fill holes left by removing duplicates */
-    if (dups_found) {
-        apr_table_entry_t *src = (apr_table_entry_t *)t->a.elts;
-        apr_table_entry_t *dst = (apr_table_entry_t *)t->a.elts;
-        apr_table_entry_t *last_elt = src + t->a.nelts;
+    if (first_dup < t->a.nelts) {
+        apr_table_entry_t *src = elts + first_dup;
+        apr_table_entry_t *dst = elts + first_dup;
+        apr_table_entry_t *last_elt = elts + t->a.nelts;
         do {
             if (src->key) {
                 *dst++ = *src;
             }
         } while (++src < last_elt);
         t->a.nelts -= (int)(last_elt - dst);
-    }
 
-    table_reindex(t);
+        table_reindex(t, first_dup);
+    }
 }
 
 static void apr_table_cat(apr_table_t *t, const apr_table_t *s)
@@ -1209,12 +1453,14 @@ static void apr_table_cat(apr_table_t *t, const apr_table_t *s)
     const int n = t->a.nelts;
     register int idx;
 
+    table_own(t);
     apr_array_cat(&t->a,&s->a);
 
     if (n == 0) {
         memcpy(t->index_first,s->index_first,sizeof(int) * TABLE_HASH_SIZE);
         memcpy(t->index_last, s->index_last, sizeof(int) * TABLE_HASH_SIZE);
         t->index_initialized = s->index_initialized;
+        table_hindex_link(t, 0);
         return;
     }
 
@@ -1228,6 +1474,7 @@ static void apr_table_cat(apr_table_t *t, const apr_table_t *s)
     }
 
     t->index_initialized |= s->index_initialized;
+    table_hindex_link(t, n);
 }
 
 APR_DECLARE(void) apr_table_overlap(apr_table_t *a, const apr_table_t *b,
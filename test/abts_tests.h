@@ -41,6 +41,11 @@ const struct testlist {
     {testglobalmutex},
 #endif
     {testhash},
+    {testchash},
+    {testaio},
+    {testresolver},
+    {testflatmap},
+    {testheap},
     {testhooks},
     {testipsub},
     {testlock},
@@ -55,6 +60,8 @@ const struct testlist {
     {testpool},
     {testproc},
     {testprocmutex},
+    {testprocrwlock},
+    {testlockprofile},
     {testrand},
     {testsleep},
     {testshm},
@@ -78,6 +85,7 @@ const struct testlist {
     {testbase64},
     {testmd4},
     {testmd5},
+    {testsha},
     {testcrypto},
     {testdbd},
     {testdate},
@@ -86,14 +94,20 @@ const struct testlist {
     {testxml},
     {testxlate},
     {testrmm},
+    {testshmhash},
+    {testshmring},
+    {testmetrics},
     {testdbm},
     {testqueue},
     {testreslist},
     {testlfsabi},
     {testskiplist},
+    {testslab},
+    {testthreadpool},
     {testsiphash},
     {testjson},
-    {testjose}
+    {testjose},
+    {teststrbuf}
 };
 
 #endif /* APR_TEST_INCLUDES */
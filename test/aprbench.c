@@ -0,0 +1,497 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Microbenchmarks of the core data structures: pools, hash tables,
+ * tables, skiplists, and with threads the queue and the thread pool.
+ * The results are printed as text, or as JSON with -j for comparing
+ * runs (ns per operation being the figure to watch).
+ */
+
+#include "apr.h"
+#include "apr_atomic.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_hash.h"
+#include "apr_pools.h"
+#include "apr_queue.h"
+#include "apr_skiplist.h"
+#include "apr_strings.h"
+#include "apr_tables.h"
+#include "apr_thread_pool.h"
+#include "apr_thread_proc.h"
+#include "apr_time.h"
+#include "apr_version.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_MAX_COUNTER 1000000
+#define DEFAULT_MAX_THREADS 4
+/* Distinct keys of the hash and table runs */
+#define NUM_KEYS 1024
+/* Entries of a table, as many as the headers of a request */
+#define TABLE_ENTRIES 32
+
+static long max_counter = DEFAULT_MAX_COUNTER;
+static int max_threads = DEFAULT_MAX_THREADS;
+static int json = 0;
+
+/* Keep the compiler from optimizing the work away */
+static const void *volatile sink;
+
+typedef struct bench_result_t {
+    const char *name;
+    int threads;
+    long ops;
+    apr_interval_time_t usecs;
+} bench_result_t;
+
+static apr_array_header_t *results;
+
+static void record(const char *name, int threads, long ops,
+                   apr_interval_time_t usecs)
+{
+    bench_result_t *r = apr_array_push(results);
+
+    r->name = name;
+    r->threads = threads;
+    r->ops = ops;
+    r->usecs = usecs;
+
+    if (!json) {
+        printf("    %-32s %2d thr %10ld ops %8" APR_TIME_T_FMT " usec"
+               " %8.2f ns/op\n", name, threads, ops, usecs,
+               ops ? usecs * 1000.0 / ops : 0.0);
+        fflush(stdout);
+    }
+}
+
+static void print_json(void)
+{
+    int i;
+
+    printf("{\n  \"apr_version\": \"%s\",\n", apr_version_string());
+    printf("  \"counter\": %ld,\n  \"max_threads\": %d,\n",
+           max_counter, max_threads);
+    printf("  \"results\": [");
+    for (i = 0; i < results->nelts; i++) {
+        const bench_result_t *r = &APR_ARRAY_IDX(results, i, bench_result_t);
+
+        printf("%s\n    {\"name\": \"%s\", \"threads\": %d, \"ops\": %ld, "
+               "\"usec\": %" APR_TIME_T_FMT ", \"ns_per_op\": %.3f}",
+               i ? "," : "", r->name, r->threads, r->ops, r->usecs,
+               r->ops ? r->usecs * 1000.0 / r->ops : 0.0);
+    }
+    printf("\n  ]\n}\n");
+}
+
+static char **make_keys(apr_pool_t *pool)
+{
+    char **keys = apr_palloc(pool, NUM_KEYS * sizeof(*keys));
+    int i;
+
+    for (i = 0; i < NUM_KEYS; i++) {
+        keys[i] = apr_psprintf(pool, "Key-%04d-of-the-bench", i);
+    }
+    return keys;
+}
+
+/* --------------------------------------------------------------------
+ * Pools
+ */
+
+static void bench_pools(apr_pool_t *parent)
+{
+    apr_pool_t *pool, *sub;
+    apr_time_t start;
+    long i;
+
+    apr_pool_create(&pool, parent);
+
+    start = apr_time_now();
+    for (i = 0; i < max_counter; i++) {
+        sink = apr_palloc(pool, 64);
+        if ((i & 1023) == 1023) {
+            apr_pool_clear(pool);
+        }
+    }
+    record("apr_palloc(64)", 1, max_counter, apr_time_now() - start);
+    apr_pool_clear(pool);
+
+    start = apr_time_now();
+    for (i = 0; i < max_counter / 10; i++) {
+        apr_pool_create(&sub, pool);
+        sink = apr_palloc(sub, 256);
+        apr_pool_destroy(sub);
+    }
+    record("apr_pool_create+destroy", 1, max_counter / 10,
+           apr_time_now() - start);
+
+    apr_pool_create(&sub, pool);
+    start = apr_time_now();
+    for (i = 0; i < max_counter / 10; i++) {
+        sink = apr_palloc(sub, 8192);
+        apr_pool_clear(sub);
+    }
+    record("apr_pool_clear", 1, max_counter / 10, apr_time_now() - start);
+
+    apr_pool_destroy(pool);
+}
+
+/* --------------------------------------------------------------------
+ * Hash tables
+ */
+
+static void bench_hash_flags(apr_pool_t *pool, char **keys,
+                             apr_uint32_t flags, const char *set_name,
+                             const char *get_name, const char *iter_name)
+{
+    apr_hash_t *ht;
+    apr_hash_index_t *hi;
+    apr_time_t start;
+    long i, n;
+
+    /* The last table filled is read below, even if none is */
+    ht = apr_hash_make_ex(pool, NULL, flags);
+
+    start = apr_time_now();
+    for (n = 0; n < max_counter; n += NUM_KEYS) {
+        ht = apr_hash_make_ex(pool, NULL, flags);
+        for (i = 0; i < NUM_KEYS; i++) {
+            apr_hash_set(ht, keys[i], APR_HASH_KEY_STRING, keys[i]);
+        }
+    }
+    record(set_name, 1, n, apr_time_now() - start);
+
+    start = apr_time_now();
+    for (i = 0; i < max_counter; i++) {
+        sink = apr_hash_get(ht, keys[i % NUM_KEYS], APR_HASH_KEY_STRING);
+    }
+    record(get_name, 1, max_counter, apr_time_now() - start);
+
+    start = apr_time_now();
+    for (n = 0; n < max_counter; ) {
+        for (hi = apr_hash_first(NULL, ht); hi; hi = apr_hash_next(hi)) {
+            sink = apr_hash_this_val(hi);
+            n++;
+        }
+    }
+    record(iter_name, 1, n, apr_time_now() - start);
+}
+
+static void bench_hash(apr_pool_t *parent)
+{
+    apr_pool_t *pool;
+    char **keys;
+
+    apr_pool_create(&pool, parent);
+    keys = make_keys(pool);
+
+    bench_hash_flags(pool, keys, 0, "apr_hash_set", "apr_hash_get",
+                     "apr_hash_next");
+    apr_pool_clear(pool);
+    keys = make_keys(pool);
+    bench_hash_flags(pool, keys, APR_HASH_OPEN_ADDRESSING | APR_HASH_FAST_HASH,
+                     "apr_hash_set (open, fast)", "apr_hash_get (open, fast)",
+                     "apr_hash_next (open, fast)");
+
+    apr_pool_destroy(pool);
+}
+
+/* --------------------------------------------------------------------
+ * Tables
+ */
+
+static void bench_table(apr_pool_t *parent)
+{
+    apr_pool_t *pool, *iter;
+    apr_table_t *t, *o;
+    apr_time_t start;
+    char **keys;
+    long i, n;
+
+    apr_pool_create(&pool, parent);
+    apr_pool_create(&iter, pool);
+    keys = make_keys(pool);
+
+    start = apr_time_now();
+    for (n = 0; n < max_counter; n += TABLE_ENTRIES) {
+        t = apr_table_make(iter, TABLE_ENTRIES);
+        for (i = 0; i < TABLE_ENTRIES; i++) {
+            apr_table_setn(t, keys[i], keys[i]);
+        }
+        apr_pool_clear(iter);
+    }
+    record("apr_table_setn", 1, n, apr_time_now() - start);
+
+    t = apr_table_make(pool, TABLE_ENTRIES);
+    for (i = 0; i < TABLE_ENTRIES; i++) {
+        apr_table_setn(t, keys[i], keys[i]);
+    }
+    start = apr_time_now();
+    for (i = 0; i < max_counter; i++) {
+        sink = apr_table_get(t, keys[i % TABLE_ENTRIES]);
+    }
+    record("apr_table_get", 1, max_counter, apr_time_now() - start);
+
+    /* Overlaying then merging the duplicates, as for request headers */
+    o = apr_table_make(pool, TABLE_ENTRIES);
+    for (i = 0; i < TABLE_ENTRIES; i += 2) {
+        apr_table_setn(o, keys[i], keys[i + 1]);
+    }
+    start = apr_time_now();
+    for (n = 0; n < max_counter; n += TABLE_ENTRIES) {
+        apr_table_t *m = apr_table_overlay(iter, t, o);
+
+        apr_table_compress(m, APR_OVERLAP_TABLES_SET);
+        apr_pool_clear(iter);
+    }
+    record("apr_table_overlay+compress", 1, n, apr_time_now() - start);
+
+    apr_pool_destroy(pool);
+}
+
+/* --------------------------------------------------------------------
+ * Skiplists
+ */
+
+static int skiplist_cmp(void *a, void *b)
+{
+    apr_uintptr_t x = (apr_uintptr_t)a, y = (apr_uintptr_t)b;
+
+    return (x > y) - (x < y);
+}
+
+static void bench_skiplist(apr_pool_t *parent)
+{
+    apr_pool_t *pool;
+    apr_skiplist *sl;
+    apr_time_t start;
+    long i, n = max_counter / 10;
+    apr_uint32_t x = 1;
+
+    apr_pool_create(&pool, parent);
+    apr_skiplist_init(&sl, pool);
+    apr_skiplist_set_compare(sl, skiplist_cmp, skiplist_cmp);
+
+    start = apr_time_now();
+    for (i = 0; i < n; i++) {
+        /* xorshift, for keys in no particular order */
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        apr_skiplist_add(sl, (void *)(apr_uintptr_t)(x | 1));
+    }
+    record("apr_skiplist_add", 1, n, apr_time_now() - start);
+
+    start = apr_time_now();
+    for (i = 0; i < n; i++) {
+        sink = apr_skiplist_pop(sl, NULL);
+    }
+    record("apr_skiplist_pop", 1, n, apr_time_now() - start);
+
+    apr_pool_destroy(pool);
+}
+
+#if APR_HAS_THREADS
+
+/* --------------------------------------------------------------------
+ * Queue, with as many consumers as producers
+ */
+
+typedef struct queue_bench_t {
+    apr_queue_t *queue;
+    long count;
+} queue_bench_t;
+
+static void * APR_THREAD_FUNC queue_producer(apr_thread_t *thd, void *data)
+{
+    queue_bench_t *qb = data;
+    long i;
+
+    for (i = 0; i < qb->count; i++) {
+        apr_queue_push(qb->queue, qb);
+    }
+    return NULL;
+}
+
+static void * APR_THREAD_FUNC queue_consumer(apr_thread_t *thd, void *data)
+{
+    queue_bench_t *qb = data;
+    void *item;
+    long i;
+
+    for (i = 0; i < qb->count; i++) {
+        apr_queue_pop(qb->queue, &item);
+    }
+    return NULL;
+}
+
+static void bench_queue(apr_pool_t *parent, int nthreads)
+{
+    apr_thread_t **thds;
+    apr_pool_t *pool;
+    queue_bench_t qb;
+    apr_status_t rv;
+    apr_time_t start;
+    int i;
+
+    apr_pool_create(&pool, parent);
+    thds = apr_palloc(pool, 2 * nthreads * sizeof(*thds));
+    apr_queue_create(&qb.queue, 1024, pool);
+    qb.count = max_counter / 10 / nthreads;
+
+    start = apr_time_now();
+    for (i = 0; i < nthreads; i++) {
+        apr_thread_create(&thds[2 * i], NULL, queue_producer, &qb, pool);
+        apr_thread_create(&thds[2 * i + 1], NULL, queue_consumer, &qb, pool);
+    }
+    for (i = 0; i < 2 * nthreads; i++) {
+        apr_thread_join(&rv, thds[i]);
+    }
+    record("apr_queue_push+pop", nthreads, qb.count * nthreads,
+           apr_time_now() - start);
+
+    apr_queue_term(qb.queue);
+    apr_pool_destroy(pool);
+}
+
+/* --------------------------------------------------------------------
+ * Thread pool, running empty tasks
+ */
+
+static apr_uint32_t tasks_done;
+
+static void * APR_THREAD_FUNC pool_task(apr_thread_t *thd, void *data)
+{
+    apr_atomic_inc32(&tasks_done);
+    return NULL;
+}
+
+static void bench_thread_pool(apr_pool_t *parent, int nthreads,
+                              apr_uint32_t flags, const char *name)
+{
+    apr_thread_pool_t *tp;
+    apr_pool_t *pool;
+    apr_time_t start;
+    long i, n = max_counter / 10;
+
+    apr_pool_create(&pool, parent);
+    if (apr_thread_pool_create_ex(&tp, nthreads, nthreads, flags, NULL,
+                                  NULL, 0, pool) != APR_SUCCESS) {
+        apr_pool_destroy(pool);
+        return;
+    }
+    apr_atomic_set32(&tasks_done, 0);
+
+    start = apr_time_now();
+    for (i = 0; i < n; i++) {
+        apr_thread_pool_push(tp, pool_task, NULL,
+                             APR_THREAD_TASK_PRIORITY_NORMAL, NULL);
+    }
+    while (apr_atomic_read32(&tasks_done) < (apr_uint32_t)n) {
+        apr_thread_yield();
+    }
+    record(name, nthreads, n, apr_time_now() - start);
+
+    apr_thread_pool_destroy(tp);
+    apr_pool_destroy(pool);
+}
+
+#endif /* APR_HAS_THREADS */
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *pool;
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "c:t:j", &optchar, &optarg))
+           == APR_SUCCESS) {
+        if (optchar == 'c') {
+            max_counter = atol(optarg);
+        }
+        else if (optchar == 't') {
+            max_threads = atoi(optarg);
+        }
+        else if (optchar == 'j') {
+            json = 1;
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        fprintf(stderr, "Usage: %s [-c counter] [-t max threads] [-j]\n",
+                argv[0]);
+        exit(-1);
+    }
+    if (max_counter < 10 * NUM_KEYS || max_threads < 1) {
+        fprintf(stderr, "The counter must be %d at least, and the threads "
+                "1 at least\n", 10 * NUM_KEYS);
+        exit(-1);
+    }
+
+    results = apr_array_make(pool, 32, sizeof(bench_result_t));
+
+    if (!json) {
+        printf("APR Benchmarks\n==============\n\n");
+    }
+
+    bench_pools(pool);
+    bench_hash(pool);
+    bench_table(pool);
+    bench_skiplist(pool);
+
+#if APR_HAS_THREADS
+    {
+        int n;
+
+        for (n = 1; n <= max_threads; n *= 2) {
+            bench_queue(pool, n);
+        }
+        for (n = 1; n <= max_threads; n *= 2) {
+            bench_thread_pool(pool, n, 0, "apr_thread_pool_push");
+            bench_thread_pool(pool, n, APR_THREAD_POOL_WORK_STEALING,
+                              "apr_thread_pool_push (stealing)");
+        }
+    }
+#endif
+
+    if (json) {
+        print_json();
+    }
+
+    apr_pool_destroy(pool);
+
+    return 0;
+}
@@ -0,0 +1,390 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr_strings.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_file_io.h"
+#include "apr_network_io.h"
+#include "apr_aio.h"
+
+#define FILENAME "data/testaio.dat"
+#define TIMEOUT apr_time_from_sec(5)
+
+static apr_aio_method_e io_uring_method = APR_AIO_IO_URING;
+static apr_aio_method_e threadpool_method = APR_AIO_THREADPOOL;
+
+static apr_aio_ring_t *create_ring(abts_case *tc, void *data,
+                                   apr_uint32_t size, apr_pool_t *pool)
+{
+    apr_aio_ring_t *ring;
+    apr_status_t rv;
+
+    rv = apr_aio_ring_create_ex(&ring, size, pool, APR_AIO_NODEFAULT,
+                                *(apr_aio_method_e *)data);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "aio method not supported");
+        return NULL;
+    }
+    APR_ASSERT_SUCCESS(tc, "Could not create aio ring", rv);
+    return ring;
+}
+
+/* Reap n operations without callback into ops */
+static void reap_all(abts_case *tc, apr_aio_ring_t *ring,
+                     apr_aio_op_t **ops, int n)
+{
+    apr_int32_t num;
+    int got = 0;
+
+    while (got < n) {
+        apr_status_t rv = apr_aio_ring_reap(ring, TIMEOUT, ops + got,
+                                            n - got, &num);
+        APR_ASSERT_SUCCESS(tc, "Could not reap", rv);
+        if (rv != APR_SUCCESS) {
+            return;
+        }
+        got += num;
+    }
+}
+
+static void reap_empty(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_aio_ring_t *ring;
+    apr_aio_op_t *ops[1];
+    apr_int32_t num;
+    apr_status_t rv;
+
+    apr_pool_create(&pool, p);
+    ring = create_ring(tc, data, 4, pool);
+    if (ring) {
+        rv = apr_aio_ring_reap(ring, 0, ops, 1, &num);
+        ABTS_INT_EQUAL(tc, APR_TIMEUP, rv);
+        ABTS_INT_EQUAL(tc, 0, num);
+        rv = apr_aio_ring_reap(ring, -1, ops, 1, &num);
+        ABTS_INT_EQUAL(tc, APR_TIMEUP, rv);
+    }
+    apr_pool_destroy(pool);
+}
+
+static void file_rw(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_aio_ring_t *ring;
+    apr_file_t *f;
+    apr_aio_op_t op[3], *ops[3];
+    char buf[16];
+    apr_status_t rv;
+
+    apr_pool_create(&pool, p);
+    ring = create_ring(tc, data, 3, pool);
+    if (!ring) {
+        apr_pool_destroy(pool);
+        return;
+    }
+
+    rv = apr_file_open(&f, FILENAME, APR_FOPEN_READ | APR_FOPEN_WRITE
+                       | APR_FOPEN_CREATE | APR_FOPEN_TRUNCATE,
+                       APR_FPROT_OS_DEFAULT, pool);
+    APR_ASSERT_SUCCESS(tc, "Could not open file", rv);
+
+    /* Both halves at once, out of order */
+    rv = apr_aio_file_write(ring, &op[0], f, "world", 5, 6, NULL, NULL);
+    APR_ASSERT_SUCCESS(tc, "Could not queue write", rv);
+    rv = apr_aio_file_write(ring, &op[1], f, "hello ", 6, 0, NULL, NULL);
+    APR_ASSERT_SUCCESS(tc, "Could not queue write", rv);
+    reap_all(tc, ring, ops, 2);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, op[0].status);
+    ABTS_SIZE_EQUAL(tc, 5, op[0].nbytes);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, op[1].status);
+    ABTS_SIZE_EQUAL(tc, 6, op[1].nbytes);
+
+    rv = apr_aio_file_sync(ring, &op[0], f, NULL, NULL);
+    APR_ASSERT_SUCCESS(tc, "Could not queue sync", rv);
+    reap_all(tc, ring, ops, 1);
+    ABTS_PTR_EQUAL(tc, &op[0], ops[0]);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, op[0].status);
+
+    memset(buf, 0, sizeof(buf));
+    rv = apr_aio_file_read(ring, &op[0], f, buf, sizeof(buf) - 1, 0,
+                           NULL, NULL);
+    APR_ASSERT_SUCCESS(tc, "Could not queue read", rv);
+    rv = apr_aio_file_read(ring, &op[1], f, buf, sizeof(buf) - 1, 11,
+                           NULL, NULL);
+    APR_ASSERT_SUCCESS(tc, "Could not queue read", rv);
+    reap_all(tc, ring, ops, 2);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, op[0].status);
+    ABTS_SIZE_EQUAL(tc, 11, op[0].nbytes);
+    ABTS_STR_EQUAL(tc, "hello world", buf);
+    ABTS_INT_EQUAL(tc, APR_EOF, op[1].status);
+    ABTS_SIZE_EQUAL(tc, 0, op[1].nbytes);
+
+    apr_file_close(f);
+    apr_file_remove(FILENAME, pool);
+    apr_pool_destroy(pool);
+}
+
+static void file_buffered(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_aio_ring_t *ring;
+    apr_file_t *f;
+    apr_aio_op_t op;
+    char buf[4];
+    apr_status_t rv;
+
+    apr_pool_create(&pool, p);
+    ring = create_ring(tc, data, 1, pool);
+    if (ring) {
+        rv = apr_file_open(&f, FILENAME, APR_FOPEN_READ | APR_FOPEN_WRITE
+                           | APR_FOPEN_CREATE | APR_FOPEN_BUFFERED,
+                           APR_FPROT_OS_DEFAULT, pool);
+        APR_ASSERT_SUCCESS(tc, "Could not open file", rv);
+        rv = apr_aio_file_read(ring, &op, f, buf, sizeof(buf), 0, NULL, NULL);
+        ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+        apr_file_close(f);
+        apr_file_remove(FILENAME, pool);
+    }
+    apr_pool_destroy(pool);
+}
+
+static void ring_full(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_aio_ring_t *ring;
+    apr_file_t *f;
+    apr_aio_op_t op[3], *ops[2];
+    apr_int32_t num;
+    apr_status_t rv;
+
+    apr_pool_create(&pool, p);
+    ring = create_ring(tc, data, 2, pool);
+    if (ring) {
+        rv = apr_file_open(&f, FILENAME, APR_FOPEN_WRITE | APR_FOPEN_CREATE,
+                           APR_FPROT_OS_DEFAULT, pool);
+        APR_ASSERT_SUCCESS(tc, "Could not open file", rv);
+        rv = apr_aio_file_sync(ring, &op[0], f, NULL, NULL);
+        APR_ASSERT_SUCCESS(tc, "Could not queue sync", rv);
+        rv = apr_aio_file_sync(ring, &op[1], f, NULL, NULL);
+        APR_ASSERT_SUCCESS(tc, "Could not queue sync", rv);
+        rv = apr_aio_file_sync(ring, &op[2], f, NULL, NULL);
+        ABTS_INT_EQUAL(tc, APR_EAGAIN, rv);
+
+        rv = apr_aio_ring_submit(ring);
+        APR_ASSERT_SUCCESS(tc, "Could not submit", rv);
+        reap_all(tc, ring, ops, 2);
+        rv = apr_aio_ring_reap(ring, 0, ops, 2, &num);
+        ABTS_INT_EQUAL(tc, APR_TIMEUP, rv);
+
+        apr_file_close(f);
+        apr_file_remove(FILENAME, pool);
+    }
+    apr_pool_destroy(pool);
+}
+
+static void count_cb(apr_aio_op_t *op)
+{
+    (*(int *)op->data)++;
+}
+
+static void socket_ops(abts_case *tc, void *data)
+{
+    apr_pool_t *pool, *cpool;
+    apr_aio_ring_t *ring;
+    apr_socket_t *listener, *client, *server;
+    apr_sockaddr_t *sa;
+    apr_aio_op_t op[2], *ops[2];
+    apr_int32_t num;
+    apr_port_t port;
+    char buf[16];
+    int called = 0;
+    apr_status_t rv;
+
+    apr_pool_create(&pool, p);
+    ring = create_ring(tc, data, 2, pool);
+    if (!ring) {
+        apr_pool_destroy(pool);
+        return;
+    }
+    apr_pool_create(&cpool, pool);
+
+    rv = apr_sockaddr_info_get(&sa, "127.0.0.1", APR_INET, 0, 0, pool);
+    APR_ASSERT_SUCCESS(tc, "Could not get address", rv);
+    rv = apr_socket_create(&listener, APR_INET, SOCK_STREAM, APR_PROTO_TCP,
+                           pool);
+    APR_ASSERT_SUCCESS(tc, "Could not create listener", rv);
+    rv = apr_socket_bind(listener, sa);
+    APR_ASSERT_SUCCESS(tc, "Could not bind", rv);
+    rv = apr_socket_listen(listener, 5);
+    APR_ASSERT_SUCCESS(tc, "Could not listen", rv);
+    rv = apr_socket_addr_get(&sa, APR_LOCAL, listener);
+    APR_ASSERT_SUCCESS(tc, "Could not get listener address", rv);
+    port = sa->port;
+    rv = apr_socket_create(&client, APR_INET, SOCK_STREAM, APR_PROTO_TCP,
+                           pool);
+    APR_ASSERT_SUCCESS(tc, "Could not create client", rv);
+
+    /* Accept and connect at once, one with a callback */
+    rv = apr_aio_socket_accept(ring, &op[0], listener, cpool, NULL, NULL);
+    APR_ASSERT_SUCCESS(tc, "Could not queue accept", rv);
+    rv = apr_aio_socket_connect(ring, &op[1], client, sa, count_cb, &called);
+    APR_ASSERT_SUCCESS(tc, "Could not queue connect", rv);
+    reap_all(tc, ring, ops, 1);
+    if (called == 0) {
+        rv = apr_aio_ring_reap(ring, TIMEOUT, ops, 1, &num);
+        APR_ASSERT_SUCCESS(tc, "Could not reap connect", rv);
+        ABTS_INT_EQUAL(tc, 0, num);
+    }
+    ABTS_INT_EQUAL(tc, 1, called);
+    ABTS_PTR_EQUAL(tc, &op[0], ops[0]);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, op[0].status);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, op[1].status);
+    server = op[0].accepted;
+    ABTS_PTR_NOTNULL(tc, server);
+    if (!server) {
+        apr_pool_destroy(pool);
+        return;
+    }
+    rv = apr_socket_addr_get(&sa, APR_REMOTE, client);
+    APR_ASSERT_SUCCESS(tc, "Could not get remote address", rv);
+    ABTS_INT_EQUAL(tc, port, sa->port);
+
+    /* Receive before the data is sent, on a non-blocking socket */
+    rv = apr_socket_timeout_set(server, 0);
+    APR_ASSERT_SUCCESS(tc, "Could not set non-blocking", rv);
+    memset(buf, 0, sizeof(buf));
+    rv = apr_aio_socket_recv(ring, &op[0], server, buf, sizeof(buf) - 1,
+                             NULL, NULL);
+    APR_ASSERT_SUCCESS(tc, "Could not queue recv", rv);
+    rv = apr_aio_ring_submit(ring);
+    APR_ASSERT_SUCCESS(tc, "Could not submit", rv);
+    rv = apr_aio_socket_send(ring, &op[1], client, "ping", 4, NULL, NULL);
+    APR_ASSERT_SUCCESS(tc, "Could not queue send", rv);
+    reap_all(tc, ring, ops, 2);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, op[1].status);
+    ABTS_SIZE_EQUAL(tc, 4, op[1].nbytes);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, op[0].status);
+    ABTS_SIZE_EQUAL(tc, 4, op[0].nbytes);
+    ABTS_STR_EQUAL(tc, "ping", buf);
+
+    /* End of stream */
+    apr_socket_close(client);
+    rv = apr_aio_socket_recv(ring, &op[0], server, buf, sizeof(buf) - 1,
+                             NULL, NULL);
+    APR_ASSERT_SUCCESS(tc, "Could not queue recv", rv);
+    reap_all(tc, ring, ops, 1);
+    ABTS_INT_EQUAL(tc, APR_EOF, op[0].status);
+    ABTS_SIZE_EQUAL(tc, 0, op[0].nbytes);
+
+    apr_aio_ring_destroy(ring);
+    apr_pool_destroy(pool);
+}
+
+static void connect_refused(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_aio_ring_t *ring;
+    apr_socket_t *listener, *client;
+    apr_sockaddr_t *sa;
+    apr_aio_op_t op, *ops[1];
+    apr_status_t rv;
+
+    apr_pool_create(&pool, p);
+    ring = create_ring(tc, data, 1, pool);
+    if (!ring) {
+        apr_pool_destroy(pool);
+        return;
+    }
+
+    /* A port just released */
+    rv = apr_sockaddr_info_get(&sa, "127.0.0.1", APR_INET, 0, 0, pool);
+    APR_ASSERT_SUCCESS(tc, "Could not get address", rv);
+    rv = apr_socket_create(&listener, APR_INET, SOCK_STREAM, APR_PROTO_TCP,
+                           pool);
+    APR_ASSERT_SUCCESS(tc, "Could not create socket", rv);
+    rv = apr_socket_bind(listener, sa);
+    APR_ASSERT_SUCCESS(tc, "Could not bind", rv);
+    rv = apr_socket_addr_get(&sa, APR_LOCAL, listener);
+    APR_ASSERT_SUCCESS(tc, "Could not get address", rv);
+    apr_socket_close(listener);
+
+    rv = apr_socket_create(&client, APR_INET, SOCK_STREAM, APR_PROTO_TCP,
+                           pool);
+    APR_ASSERT_SUCCESS(tc, "Could not create client", rv);
+    rv = apr_aio_socket_connect(ring, &op, client, sa, NULL, NULL);
+    APR_ASSERT_SUCCESS(tc, "Could not queue connect", rv);
+    reap_all(tc, ring, ops, 1);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_ECONNREFUSED(op.status));
+
+    apr_pool_destroy(pool);
+}
+
+/* Destroying the ring with an accept in flight must not wait for it */
+static void destroy_inflight(abts_case *tc, void *data)
+{
+    apr_pool_t *pool, *cpool;
+    apr_aio_ring_t *ring;
+    apr_socket_t *listener;
+    apr_sockaddr_t *sa;
+    apr_aio_op_t op;
+    apr_status_t rv;
+
+    apr_pool_create(&pool, p);
+    ring = create_ring(tc, data, 1, pool);
+    if (ring) {
+        apr_pool_create(&cpool, pool);
+        rv = apr_sockaddr_info_get(&sa, "127.0.0.1", APR_INET, 0, 0, pool);
+        APR_ASSERT_SUCCESS(tc, "Could not get address", rv);
+        rv = apr_socket_create(&listener, APR_INET, SOCK_STREAM,
+                               APR_PROTO_TCP, pool);
+        APR_ASSERT_SUCCESS(tc, "Could not create listener", rv);
+        rv = apr_socket_bind(listener, sa);
+        APR_ASSERT_SUCCESS(tc, "Could not bind", rv);
+        rv = apr_socket_listen(listener, 5);
+        APR_ASSERT_SUCCESS(tc, "Could not listen", rv);
+
+        rv = apr_aio_socket_accept(ring, &op, listener, cpool, NULL, NULL);
+        APR_ASSERT_SUCCESS(tc, "Could not queue accept", rv);
+        rv = apr_aio_ring_submit(ring);
+        APR_ASSERT_SUCCESS(tc, "Could not submit", rv);
+    }
+    apr_pool_destroy(pool);
+}
+
+abts_suite *testaio(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+    abts_run_test(suite, reap_empty, &threadpool_method);
+    abts_run_test(suite, file_rw, &threadpool_method);
+    abts_run_test(suite, file_buffered, &threadpool_method);
+    abts_run_test(suite, ring_full, &threadpool_method);
+    abts_run_test(suite, socket_ops, &threadpool_method);
+    abts_run_test(suite, connect_refused, &threadpool_method);
+    abts_run_test(suite, destroy_inflight, &threadpool_method);
+
+    abts_run_test(suite, reap_empty, &io_uring_method);
+    abts_run_test(suite, file_rw, &io_uring_method);
+    abts_run_test(suite, file_buffered, &io_uring_method);
+    abts_run_test(suite, ring_full, &io_uring_method);
+    abts_run_test(suite, socket_ops, &io_uring_method);
+    abts_run_test(suite, connect_refused, &io_uring_method);
+    abts_run_test(suite, destroy_inflight, &io_uring_method);
+
+    return suite;
+}
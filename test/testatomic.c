@@ -347,6 +347,82 @@ static void test_inc_neg164(abts_case *tc, void *data)
 }
 
 
+static void test_and_or_xor32(abts_case *tc, void *data)
+{
+    apr_uint32_t y32;
+
+    apr_atomic_set32(&y32, 0x0ff0);
+    ABTS_UINT_EQUAL(tc, 0x0ff0, apr_atomic_and32(&y32, 0x00ff));
+    ABTS_UINT_EQUAL(tc, 0x00f0, y32);
+    ABTS_UINT_EQUAL(tc, 0x00f0, apr_atomic_or32(&y32, 0xf000));
+    ABTS_UINT_EQUAL(tc, 0xf0f0, y32);
+    ABTS_UINT_EQUAL(tc, 0xf0f0, apr_atomic_xor32(&y32, 0xffff));
+    ABTS_UINT_EQUAL(tc, 0x0f0f, y32);
+}
+
+static void test_and_or_xor64(abts_case *tc, void *data)
+{
+    apr_uint64_t y64;
+
+    apr_atomic_set64(&y64, APR_UINT64_C(0x0000ffff00000000));
+    ABTS_ULLONG_EQUAL(tc, APR_UINT64_C(0x0000ffff00000000),
+                      apr_atomic_or64(&y64, 0xff));
+    ABTS_ULLONG_EQUAL(tc, APR_UINT64_C(0x0000ffff000000ff),
+                      apr_atomic_and64(&y64, APR_UINT64_C(0x0000ff00000000ff)));
+    ABTS_ULLONG_EQUAL(tc, APR_UINT64_C(0x0000ff00000000ff),
+                      apr_atomic_xor64(&y64, APR_UINT64_C(0xffffffffffffffff)));
+    ABTS_ULLONG_EQUAL(tc, APR_UINT64_C(0xffff00ffffffff00), y64);
+}
+
+static void test_acquire_release(abts_case *tc, void *data)
+{
+    apr_uint32_t y32;
+    apr_uint64_t y64;
+
+    apr_atomic_set32_release(&y32, 42);
+    apr_atomic_fence();
+    ABTS_UINT_EQUAL(tc, 42, apr_atomic_read32_acquire(&y32));
+
+    apr_atomic_set64_release(&y64, APR_UINT64_C(0x1111222233334444));
+    apr_atomic_pause();
+    ABTS_ULLONG_EQUAL(tc, APR_UINT64_C(0x1111222233334444),
+                      apr_atomic_read64_acquire(&y64));
+}
+
+/* The second tagged pointer is misaligned (on 64-bit platforms), to
+ * exercise the fallback of apr_atomic_cas_tagptr().
+ */
+static struct {
+    apr_atomic_tagptr_t aligned;
+    char pad[sizeof(void *)];
+    apr_atomic_tagptr_t misaligned;
+} tagptrs __attribute__((aligned(2 * sizeof(void *))));
+
+static void test_cas_tagptr(abts_case *tc, void *data)
+{
+    volatile apr_atomic_tagptr_t *mem = data;
+    apr_atomic_tagptr_t cmp, with;
+    int a = 0, b = 0;
+
+    mem->ptr = &a;
+    mem->tag = 1;
+
+    /* Same pointer, other tag (ABA) */
+    cmp.ptr = &a;
+    cmp.tag = 0;
+    with.ptr = &b;
+    with.tag = 2;
+    ABTS_INT_EQUAL(tc, 0, apr_atomic_cas_tagptr(mem, &cmp, with));
+    ABTS_PTR_EQUAL(tc, &a, cmp.ptr);
+    ABTS_ULLONG_EQUAL(tc, 1, cmp.tag);
+    ABTS_PTR_EQUAL(tc, &a, mem->ptr);
+
+    /* Retried with the updated comparand */
+    ABTS_ASSERT(tc, "swap failed", apr_atomic_cas_tagptr(mem, &cmp, with));
+    ABTS_PTR_EQUAL(tc, &b, mem->ptr);
+    ABTS_ULLONG_EQUAL(tc, 2, mem->tag);
+}
+
 #if APR_HAS_THREADS
 
 void *APR_THREAD_FUNC thread_func_mutex(apr_thread_t *thd, void *data);
@@ -928,6 +1004,87 @@ static void test_atomics_threaded_setread64(abts_case *tc, void *data)
     apr_thread_join(&retval, thread);
 }
 
+static void *APR_THREAD_FUNC thread_func_bitops(apr_thread_t *thd, void *data)
+{
+    apr_uint32_t bit = 1u << *(int *)data;
+    int i;
+
+    /* Each thread flips its own bit off and on, the others stay put */
+    for (i = 0; i < NUM_ITERATIONS; i++) {
+        apr_atomic_xor32(&atomic_ops, bit);
+        apr_atomic_and32(&atomic_ops, ~bit);
+        apr_atomic_or32(&atomic_ops, bit);
+    }
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static void test_atomics_threaded_bitops(abts_case *tc, void *data)
+{
+    apr_thread_t *thread[NUM_THREADS];
+    int id[NUM_THREADS];
+    apr_status_t rv;
+    int i;
+
+    apr_atomic_set32(&atomic_ops, 0);
+
+    for (i = 0; i < NUM_THREADS; i++) {
+        id[i] = i;
+        rv = apr_thread_create(&thread[i], NULL, thread_func_bitops, &id[i], p);
+        APR_ASSERT_SUCCESS(tc, "Failed creating thread", rv);
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        apr_status_t retval;
+        apr_thread_join(&retval, thread[i]);
+    }
+
+    ABTS_UINT_EQUAL(tc, (1u << NUM_THREADS) - 1, apr_atomic_read32(&atomic_ops));
+}
+
+static void *APR_THREAD_FUNC thread_func_tagptr(apr_thread_t *thd, void *data)
+{
+    volatile apr_atomic_tagptr_t *mem = data;
+    int i;
+
+    for (i = 0; i < NUM_ITERATIONS; i++) {
+        apr_atomic_tagptr_t cmp, with;
+
+        cmp.ptr = mem->ptr;
+        cmp.tag = mem->tag;
+        do {
+            with.ptr = (cmp.ptr == mem) ? NULL : (void *)mem;
+            with.tag = cmp.tag + 1;
+        } while (!apr_atomic_cas_tagptr(mem, &cmp, with));
+    }
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static void test_atomics_threaded_tagptr(abts_case *tc, void *data)
+{
+    volatile apr_atomic_tagptr_t *mem = data;
+    apr_thread_t *thread[NUM_THREADS];
+    apr_status_t rv;
+    int i;
+
+    mem->ptr = NULL;
+    mem->tag = 0;
+
+    for (i = 0; i < NUM_THREADS; i++) {
+        rv = apr_thread_create(&thread[i], NULL, thread_func_tagptr,
+                               (void *)mem, p);
+        APR_ASSERT_SUCCESS(tc, "Failed creating thread", rv);
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        apr_status_t retval;
+        apr_thread_join(&retval, thread[i]);
+    }
+
+    /* Each swap toggled the pointer and bumped the tag */
+    ABTS_ULLONG_EQUAL(tc, NUM_THREADS * NUM_ITERATIONS, mem->tag);
+    ABTS_PTR_EQUAL(tc, NULL, mem->ptr);
+}
+
 #endif /* !APR_HAS_THREADS */
 
 abts_suite *testatomic(abts_suite *suite)
@@ -962,6 +1119,11 @@ abts_suite *testatomic(abts_suite *suite)
     abts_run_test(suite, test_set_add_inc_sub64, NULL);
     abts_run_test(suite, test_wrap_zero64, NULL);
     abts_run_test(suite, test_inc_neg164, NULL);
+    abts_run_test(suite, test_and_or_xor32, NULL);
+    abts_run_test(suite, test_and_or_xor64, NULL);
+    abts_run_test(suite, test_acquire_release, NULL);
+    abts_run_test(suite, test_cas_tagptr, &tagptrs.aligned);
+    abts_run_test(suite, test_cas_tagptr, &tagptrs.misaligned);
 
 #if APR_HAS_THREADS
     abts_run_test(suite, test_atomics_threaded, NULL);
@@ -971,6 +1133,9 @@ abts_suite *testatomic(abts_suite *suite)
     abts_run_test(suite, test_atomics_busyloop_threaded64, NULL);
     abts_run_test(suite, test_atomics_threaded_setread64, &atomic_ops64);
     abts_run_test(suite, test_atomics_threaded_setread64, &atomic_pad.ops64);
+    abts_run_test(suite, test_atomics_threaded_bitops, NULL);
+    abts_run_test(suite, test_atomics_threaded_tagptr, &tagptrs.aligned);
+    abts_run_test(suite, test_atomics_threaded_tagptr, &tagptrs.misaligned);
 #endif
 
     return suite;
@@ -0,0 +1,481 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures the brigade operations, in operations and bytes per second:
+ * - the creation and destruction of brigades (and buckets);
+ * - apr_brigade_write() of small writes;
+ * - apr_brigade_split_boundary() and apr_brigade_split_line() on a
+ *   multipart like body (CRLF terminated lines) cut in buckets of a few
+ *   sizes, the boundary straddling buckets. The boundary found is
+ *   checked against a plain scalar search of the flat body, timed as well;
+ * - apr_brigade_flatten() and apr_brigade_partition() of the same body;
+ * - apr_brigade_to_iovec() with apr_socket_sendv(), and
+ *   apr_brigade_write_socket(), to a loopback socket drained by a thread.
+ */
+
+#include "apr_buckets.h"
+#include "apr_pools.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_network_io.h"
+#include "apr_strings.h"
+#include "apr_thread_proc.h"
+#include "apr_time.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_BODY_SIZE (16 * 1024 * 1024)
+#define LINE_SIZE 60
+#define MAX_LINE 8192
+#define SMALL_WRITE 16
+#define CREATE_LOOPS 1000000
+#define PARTITIONS 1000
+
+static const char boundary[] =
+    "\r\n--------------------------4f1d2a7b93c0e5a8";
+
+static apr_size_t body_size = DEFAULT_BODY_SIZE;
+static int verbose = 0;
+
+/* The body, the boundary and a trailer */
+static char *make_data(apr_pool_t *pool, apr_size_t *len)
+{
+    apr_size_t blen = sizeof(boundary) - 1, i;
+    char *data;
+
+    *len = body_size + blen + 4;
+    data = apr_palloc(pool, *len);
+    srand(1);
+    for (i = 0; i < body_size; i++) {
+        if (i % LINE_SIZE == LINE_SIZE - 2) {
+            data[i] = '\r';
+        }
+        else if (i % LINE_SIZE == LINE_SIZE - 1) {
+            data[i] = '\n';
+        }
+        else {
+            /* Some dashes, like the boundary */
+            data[i] = rand() % 8 ? 'a' + rand() % 26 : '-';
+        }
+    }
+    memcpy(data + body_size, boundary, blen);
+    memcpy(data + body_size + blen, "--\r\n", 4);
+    return data;
+}
+
+static apr_bucket_brigade *make_brigade(apr_pool_t *pool,
+                                        apr_bucket_alloc_t *ba,
+                                        const char *data, apr_size_t len,
+                                        apr_size_t bucket_size)
+{
+    apr_bucket_brigade *bb = apr_brigade_create(pool, ba);
+    apr_size_t off, n;
+
+    for (off = 0; off < len; off += n) {
+        n = len - off < bucket_size ? len - off : bucket_size;
+        APR_BRIGADE_INSERT_TAIL(bb,
+                                apr_bucket_immortal_create(data + off, n, ba));
+    }
+    return bb;
+}
+
+/* The scalar search, a comparison at each offset */
+static apr_size_t scalar_search(const char *data, apr_size_t len)
+{
+    apr_size_t blen = sizeof(boundary) - 1, off;
+
+    for (off = 0; off + blen <= len; off++) {
+        if (data[off] == boundary[0] && !memcmp(data + off, boundary, blen)) {
+            return off;
+        }
+    }
+    return len;
+}
+
+static void report(const char *name, apr_size_t bucket_size,
+                   apr_size_t bytes, apr_interval_time_t elapsed)
+{
+    if (bucket_size) {
+        printf("    %-28s %6" APR_SIZE_T_FMT " byte buckets: ", name,
+               bucket_size);
+    }
+    else {
+        printf("    %-48s: ", name);
+    }
+    printf("%8" APR_TIME_T_FMT " usec, %8.1f MB/s\n", elapsed,
+           elapsed ? (double)bytes / elapsed : 0.0);
+}
+
+static void report_ops(const char *name, apr_size_t bucket_size,
+                       apr_size_t ops, apr_size_t bytes,
+                       apr_interval_time_t elapsed)
+{
+    if (bucket_size) {
+        printf("    %-28s %6" APR_SIZE_T_FMT " byte buckets: ", name,
+               bucket_size);
+    }
+    else {
+        printf("    %-48s: ", name);
+    }
+    printf("%8" APR_TIME_T_FMT " usec, %10.0f ops/s", elapsed,
+           elapsed ? (double)ops * APR_USEC_PER_SEC / elapsed : 0.0);
+    if (bytes) {
+        printf(", %8.1f MB/s", elapsed ? (double)bytes / elapsed : 0.0);
+    }
+    printf("\n");
+}
+
+static void bench_create(apr_pool_t *pool)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(pool);
+    apr_bucket_brigade *bb;
+    apr_pool_t *sub;
+    apr_time_t start;
+    int i;
+
+    apr_pool_create(&sub, pool);
+    start = apr_time_now();
+    for (i = 0; i < CREATE_LOOPS; i++) {
+        bb = apr_brigade_create(sub, ba);
+        APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_immortal_create(boundary, 1,
+                                                               ba));
+        APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_eos_create(ba));
+        apr_brigade_destroy(bb);
+        if (i % 1000 == 999) {
+            apr_pool_clear(sub);
+        }
+    }
+    report_ops("brigade create/destroy", 0, CREATE_LOOPS, 0,
+               apr_time_now() - start);
+
+    apr_bucket_alloc_destroy(ba);
+}
+
+static void bench_write(apr_pool_t *pool, const char *data, apr_size_t len)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(pool);
+    apr_bucket_brigade *bb = apr_brigade_create(pool, ba);
+    apr_size_t off;
+    apr_time_t start;
+
+    start = apr_time_now();
+    for (off = 0; off + SMALL_WRITE <= len; off += SMALL_WRITE) {
+        apr_brigade_write(bb, NULL, NULL, data + off, SMALL_WRITE);
+    }
+    report_ops("apr_brigade_write " APR_STRINGIFY(SMALL_WRITE) " bytes", 0,
+               len / SMALL_WRITE, off, apr_time_now() - start);
+
+    apr_brigade_destroy(bb);
+    apr_bucket_alloc_destroy(ba);
+}
+
+static int bench_boundary(apr_pool_t *pool, const char *data, apr_size_t len,
+                          apr_size_t bucket_size, apr_size_t expected)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(pool);
+    apr_bucket_brigade *in, *out;
+    apr_time_t start;
+    apr_status_t rv;
+    apr_off_t found;
+
+    in = make_brigade(pool, ba, data, len, bucket_size);
+    out = apr_brigade_create(pool, ba);
+
+    start = apr_time_now();
+    rv = apr_brigade_split_boundary(out, in, APR_BLOCK_READ, boundary,
+                                    APR_BUCKETS_STRING, len);
+    report("apr_brigade_split_boundary", bucket_size, expected,
+           apr_time_now() - start);
+
+    apr_brigade_length(out, 0, &found);
+    apr_bucket_alloc_destroy(ba);
+    if (rv != APR_SUCCESS || (apr_size_t)found != expected) {
+        fprintf(stderr, "boundary found at %" APR_OFF_T_FMT
+                " (status %d), expected at %" APR_SIZE_T_FMT "\n",
+                found, rv, expected);
+        return 0;
+    }
+    return 1;
+}
+
+static void bench_line(apr_pool_t *pool, const char *data, apr_size_t len,
+                       apr_size_t bucket_size)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(pool);
+    apr_bucket_brigade *in, *out;
+    apr_time_t start;
+    long lines = 0;
+
+    in = make_brigade(pool, ba, data, len, bucket_size);
+    out = apr_brigade_create(pool, ba);
+
+    start = apr_time_now();
+    while (!APR_BRIGADE_EMPTY(in)) {
+        apr_brigade_split_line(out, in, APR_BLOCK_READ, MAX_LINE);
+        apr_brigade_cleanup(out);
+        lines++;
+    }
+    report("apr_brigade_split_line", bucket_size, len,
+           apr_time_now() - start);
+    if (verbose) {
+        printf("    %ld lines\n", lines);
+    }
+
+    apr_bucket_alloc_destroy(ba);
+}
+
+static void bench_flatten(apr_pool_t *pool, const char *data, apr_size_t len,
+                          apr_size_t bucket_size)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(pool);
+    apr_bucket_brigade *bb;
+    apr_size_t flen = len;
+    apr_time_t start;
+    char *buf = malloc(len);
+
+    bb = make_brigade(pool, ba, data, len, bucket_size);
+    start = apr_time_now();
+    apr_brigade_flatten(bb, buf, &flen);
+    report("apr_brigade_flatten", bucket_size, flen, apr_time_now() - start);
+    if (flen != len || memcmp(buf, data, len)) {
+        fprintf(stderr, "flatten mismatch\n");
+    }
+
+    free(buf);
+    apr_bucket_alloc_destroy(ba);
+}
+
+static void bench_partition(apr_pool_t *pool, const char *data, apr_size_t len,
+                            apr_size_t bucket_size)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(pool);
+    apr_bucket_brigade *bb;
+    apr_bucket *e;
+    apr_time_t start;
+    int i;
+
+    bb = make_brigade(pool, ba, data, len, bucket_size);
+    start = apr_time_now();
+    for (i = 0; i < PARTITIONS; i++) {
+        /* Scattered, mostly within buckets */
+        apr_brigade_partition(bb, (apr_off_t)((len / PARTITIONS) * i
+                                              + i % bucket_size), &e);
+    }
+    report_ops("apr_brigade_partition", bucket_size, PARTITIONS, 0,
+               apr_time_now() - start);
+
+    apr_bucket_alloc_destroy(ba);
+}
+
+#if APR_HAS_THREADS
+
+static void *APR_THREAD_FUNC drain_socket(apr_thread_t *thd, void *data)
+{
+    apr_socket_t *sock = data;
+    char buf[64 * 1024];
+    apr_size_t n;
+    apr_status_t rv;
+
+    do {
+        n = sizeof(buf);
+        rv = apr_socket_recv(sock, buf, &n);
+    } while (rv == APR_SUCCESS);
+
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+/* A loopback connection, the receiving end drained by a thread */
+static apr_status_t loopback(apr_socket_t **client, apr_thread_t **thd,
+                             apr_pool_t *pool)
+{
+    apr_socket_t *listener, *server;
+    apr_sockaddr_t *sa;
+    apr_status_t rv;
+
+    if ((rv = apr_sockaddr_info_get(&sa, "127.0.0.1", APR_INET, 0, 0,
+                                    pool)) != APR_SUCCESS
+        || (rv = apr_socket_create(&listener, sa->family, SOCK_STREAM,
+                                   APR_PROTO_TCP, pool)) != APR_SUCCESS
+        || (rv = apr_socket_bind(listener, sa)) != APR_SUCCESS
+        || (rv = apr_socket_listen(listener, 1)) != APR_SUCCESS
+        || (rv = apr_socket_addr_get(&sa, APR_LOCAL,
+                                     listener)) != APR_SUCCESS
+        || (rv = apr_socket_create(client, sa->family, SOCK_STREAM,
+                                   APR_PROTO_TCP, pool)) != APR_SUCCESS
+        || (rv = apr_socket_connect(*client, sa)) != APR_SUCCESS
+        || (rv = apr_socket_accept(&server, listener, pool)) != APR_SUCCESS) {
+        return rv;
+    }
+    apr_socket_close(listener);
+    return apr_thread_create(thd, NULL, drain_socket, server, pool);
+}
+
+static void bench_socket(apr_pool_t *pool, const char *data, apr_size_t len,
+                         apr_size_t bucket_size, int write_socket)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(pool);
+    apr_bucket_brigade *bb;
+    apr_socket_t *client;
+    apr_thread_t *thd;
+    apr_time_t start;
+    apr_status_t rv, trv;
+    long ops = 0;
+
+    if ((rv = loopback(&client, &thd, pool)) != APR_SUCCESS) {
+        fprintf(stderr, "loopback connection failed: %d\n", rv);
+        apr_bucket_alloc_destroy(ba);
+        return;
+    }
+    bb = make_brigade(pool, ba, data, len, bucket_size);
+
+    start = apr_time_now();
+    if (write_socket) {
+        rv = apr_brigade_write_socket(bb, client, 0);
+    }
+    else {
+        while (!APR_BRIGADE_EMPTY(bb)) {
+            struct iovec vec[APR_MAX_IOVEC_SIZE];
+            int nvec = APR_MAX_IOVEC_SIZE;
+            apr_size_t written;
+            apr_bucket *e;
+
+            apr_brigade_to_iovec(bb, vec, &nvec);
+            rv = apr_socket_sendv(client, vec, nvec, &written);
+            if (rv != APR_SUCCESS) {
+                break;
+            }
+            apr_brigade_partition(bb, written, &e);
+            while (APR_BRIGADE_FIRST(bb) != e) {
+                apr_bucket_delete(APR_BRIGADE_FIRST(bb));
+            }
+            ops++;
+        }
+    }
+    report(write_socket ? "apr_brigade_write_socket"
+                        : "apr_brigade_to_iovec+sendv",
+           bucket_size, len, apr_time_now() - start);
+    if (verbose && !write_socket) {
+        printf("    %ld writes\n", ops);
+    }
+    if (rv != APR_SUCCESS) {
+        fprintf(stderr, "writing to the socket failed: %d\n", rv);
+    }
+
+    apr_socket_close(client);
+    apr_thread_join(&trv, thd);
+    apr_bucket_alloc_destroy(ba);
+}
+
+#endif /* APR_HAS_THREADS */
+
+int main(int argc, const char * const *argv)
+{
+    static const apr_size_t sizes[] = { APR_BUCKET_BUFF_SIZE, 1000, 100, 40 };
+    apr_pool_t *pool, *bench;
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    apr_size_t len, expected;
+    apr_time_t start;
+    char *data;
+    int i, ok = 1;
+
+    printf("APR Brigade Performance Test\n==============\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "s:v", &optchar, &optarg)) == APR_SUCCESS) {
+        if (optchar == 's') {
+            body_size = (apr_size_t)atol(optarg) * 1024;
+        }
+        else if (optchar == 'v') {
+            verbose = 1;
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    if (apr_pool_create(&bench, pool) != APR_SUCCESS)
+        exit(-1);
+
+    data = make_data(pool, &len);
+    if (verbose) {
+        printf("%" APR_SIZE_T_FMT " bytes body, %d bytes lines\n\n",
+               body_size, LINE_SIZE);
+    }
+
+    bench_create(bench);
+    apr_pool_clear(bench);
+    bench_write(bench, data, len);
+    apr_pool_clear(bench);
+    printf("\n");
+
+    start = apr_time_now();
+    expected = scalar_search(data, len);
+    report("scalar search (reference)", 0, expected, apr_time_now() - start);
+
+    for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        ok &= bench_boundary(bench, data, len, sizes[i], expected);
+        apr_pool_clear(bench);
+    }
+    printf("\n");
+    for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        bench_line(bench, data, len, sizes[i]);
+        apr_pool_clear(bench);
+    }
+    printf("\n");
+    for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        bench_flatten(bench, data, len, sizes[i]);
+        apr_pool_clear(bench);
+    }
+    printf("\n");
+    for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        bench_partition(bench, data, len, sizes[i]);
+        apr_pool_clear(bench);
+    }
+#if APR_HAS_THREADS
+    printf("\n");
+    for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        bench_socket(bench, data, len, sizes[i], 0);
+        apr_pool_clear(bench);
+        bench_socket(bench, data, len, sizes[i], 1);
+        apr_pool_clear(bench);
+    }
+#endif
+
+    apr_pool_destroy(pool);
+
+    return ok ? 0 : 1;
+}
@@ -18,6 +18,9 @@
 #include "testutil.h"
 #include "apr_buckets.h"
 #include "apr_strings.h"
+#include "apr_md5.h"
+#include "apr_sha1.h"
+#include "apr_thread_proc.h"
 
 static void test_create(abts_case *tc, void *data)
 {
@@ -137,6 +140,49 @@ static int count_buckets(apr_bucket_brigade *bb)
     return count;
 }
 
+static void test_peek_contiguous(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb;
+    apr_bucket *e;
+    const char *str;
+    char *buf;
+    apr_size_t len;
+
+    bb = apr_brigade_create(p, ba);
+    APR_ASSERT_SUCCESS(tc, "peek at empty brigade",
+                       apr_brigade_peek_contiguous(bb, &str, &len, NULL));
+    ABTS_SIZE_EQUAL(tc, 0, len);
+
+    /* A heap bucket split in three, with metadata around */
+    buf = apr_bucket_alloc(12, ba);
+    memcpy(buf, "hello, world", 12);
+    e = apr_bucket_heap_create(buf, 12, apr_bucket_free, ba);
+    APR_BRIGADE_INSERT_TAIL(bb, e);
+    apr_bucket_split(e, 5);
+    apr_bucket_split(APR_BUCKET_NEXT(e), 2);
+    APR_BRIGADE_INSERT_HEAD(bb, apr_bucket_flush_create(ba));
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_eos_create(ba));
+
+    APR_ASSERT_SUCCESS(tc, "peek at contiguous brigade",
+                       apr_brigade_peek_contiguous(bb, &str, &len, NULL));
+    ABTS_PTR_EQUAL(tc, buf, str);
+    ABTS_SIZE_EQUAL(tc, 12, len);
+    apr_brigade_destroy(bb);
+
+    /* Copied when not contiguous */
+    bb = make_simple_brigade(ba, "hello, ", "world");
+    ABTS_INT_EQUAL(tc, APR_INCOMPLETE,
+                   apr_brigade_peek_contiguous(bb, &str, &len, NULL));
+    APR_ASSERT_SUCCESS(tc, "peek at split brigade",
+                       apr_brigade_peek_contiguous(bb, &str, &len, p));
+    ABTS_SIZE_EQUAL(tc, 12, len);
+    ABTS_STR_NEQUAL(tc, "hello, world", str, len);
+
+    apr_brigade_destroy(bb);
+    apr_bucket_alloc_destroy(ba);
+}
+
 static void test_split(abts_case *tc, void *data)
 {
     apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
@@ -209,6 +255,117 @@ static void test_splitline(abts_case *tc, void *data)
     apr_bucket_alloc_destroy(ba);
 }
 
+static void test_find(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb;
+    const apr_strmatch_pattern *pattern;
+    apr_bucket *e;
+    apr_size_t offset;
+
+    bb = make_simple_brigade(ba, "quick brown fox jum",
+                             "ped over the lazy dog");
+    /* a metadata bucket and a few bytes, all spanned by the match */
+    APR_BUCKET_INSERT_AFTER(APR_BRIGADE_FIRST(bb),
+                            apr_bucket_flush_create(ba));
+    APR_BUCKET_INSERT_AFTER(APR_BRIGADE_FIRST(bb),
+                            apr_bucket_immortal_create("p", 1, ba));
+
+    pattern = apr_strmatch_precompile(p, "brown", 1);
+    APR_ASSERT_SUCCESS(tc, "find in a bucket",
+                       apr_brigade_find(bb, pattern, APR_BLOCK_READ,
+                                        &e, &offset));
+    ABTS_PTR_EQUAL(tc, APR_BRIGADE_FIRST(bb), e);
+    ABTS_SIZE_EQUAL(tc, 6, offset);
+
+    pattern = apr_strmatch_precompile(p, "fox jumpped", 1);
+    APR_ASSERT_SUCCESS(tc, "find across buckets",
+                       apr_brigade_find(bb, pattern, APR_BLOCK_READ,
+                                        &e, &offset));
+    ABTS_PTR_EQUAL(tc, APR_BRIGADE_FIRST(bb), e);
+    ABTS_SIZE_EQUAL(tc, 12, offset);
+
+    pattern = apr_strmatch_precompile(p, "PPED", 0);
+    APR_ASSERT_SUCCESS(tc, "find nocase across buckets",
+                       apr_brigade_find(bb, pattern, APR_BLOCK_READ,
+                                        &e, &offset));
+    ABTS_PTR_EQUAL(tc, APR_BUCKET_NEXT(APR_BRIGADE_FIRST(bb)), e);
+    ABTS_SIZE_EQUAL(tc, 0, offset);
+
+    pattern = apr_strmatch_precompile(p, "ped", 1);
+    APR_ASSERT_SUCCESS(tc, "find past the metadata",
+                       apr_brigade_find(bb, pattern, APR_BLOCK_READ,
+                                        &e, &offset));
+    ABTS_PTR_EQUAL(tc, APR_BRIGADE_LAST(bb), e);
+    ABTS_SIZE_EQUAL(tc, 0, offset);
+
+    pattern = apr_strmatch_precompile(p, "jumping", 1);
+    ABTS_INT_EQUAL(tc, APR_NOTFOUND,
+                   apr_brigade_find(bb, pattern, APR_BLOCK_READ,
+                                    &e, &offset));
+
+    pattern = apr_strmatch_precompile(p, "", 1);
+    ABTS_INT_EQUAL(tc, APR_EINVAL,
+                   apr_brigade_find(bb, pattern, APR_BLOCK_READ,
+                                    &e, &offset));
+
+    flatten_match(tc, "untouched", bb,
+                  "quick brown fox jumpped over the lazy dog");
+
+    apr_brigade_destroy(bb);
+    apr_bucket_alloc_destroy(ba);
+}
+
+static void test_encode(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb;
+    apr_encode_stream_t st;
+    const char *str;
+    apr_off_t length;
+
+    bb = make_simple_brigade(ba, "quick brown fox jum",
+                             "ped over the lazy dog");
+    APR_BUCKET_INSERT_AFTER(APR_BRIGADE_FIRST(bb),
+                            apr_bucket_flush_create(ba));
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_eos_create(ba));
+
+    apr_encode_stream_init(&st, APR_ENCODE_CODEC_BASE64, APR_ENCODE_NONE);
+    APR_ASSERT_SUCCESS(tc, "encode a brigade", apr_brigade_encode(bb, &st));
+    flatten_match(tc, "base64", bb,
+                  "cXVpY2sgYnJvd24gZm94IGp1bXBlZCBvdmVyIHRoZSBsYXp5IGRvZw==");
+
+    /* the 19 bytes before the flush make 6 groups, the last byte held */
+    ABTS_SIZE_EQUAL(tc, 24, APR_BRIGADE_FIRST(bb)->length);
+    ABTS_ASSERT(tc, "flush kept",
+                APR_BUCKET_IS_FLUSH(APR_BUCKET_NEXT(APR_BRIGADE_FIRST(bb))));
+    ABTS_ASSERT(tc, "eos kept", APR_BUCKET_IS_EOS(APR_BRIGADE_LAST(bb)));
+
+    /* and back, from a character per bucket */
+    apr_brigade_cleanup(bb);
+    for (str = "cXVpY2sgYnJvd24gZm94IGp1bXBlZA"; *str; str++) {
+        APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_immortal_create(str, 1, ba));
+    }
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_eos_create(ba));
+
+    apr_decode_stream_init(&st, APR_ENCODE_CODEC_BASE64, APR_ENCODE_NONE);
+    APR_ASSERT_SUCCESS(tc, "decode a brigade", apr_brigade_encode(bb, &st));
+    APR_ASSERT_SUCCESS(tc, "length", apr_brigade_length(bb, 1, &length));
+    ABTS_INT_EQUAL(tc, 22, (int)length);
+    flatten_match(tc, "decoded", bb, "quick brown fox jumped");
+
+    /* an invalid character stops the decoding */
+    apr_brigade_cleanup(bb);
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_immortal_create("Zm9v*mFy", 8,
+                                                           ba));
+    apr_decode_stream_init(&st, APR_ENCODE_CODEC_BASE64, APR_ENCODE_NONE);
+    ABTS_INT_EQUAL(tc, APR_BADCH, apr_brigade_encode(bb, &st));
+    flatten_match(tc, "decoded up to the invalid character", bb, "foo");
+
+    apr_brigade_destroy(bb);
+    apr_bucket_alloc_destroy(ba);
+}
+
 static void test_splitboundary(abts_case *tc, void *data)
 {
     apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
@@ -495,8 +652,193 @@ static void test_truncfile(abts_case *tc, void *data)
     apr_bucket_alloc_destroy(ba);
 }
 
+#define READAHEAD_SIZE 300000
+
+static void test_file_readahead(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb = apr_brigade_create(p, ba);
+    apr_file_t *f = make_test_file(tc, "readahead.bin", "");
+    apr_bucket *e;
+    char *expect, *buf;
+    apr_size_t len;
+    apr_status_t rv;
+    int i, mmap;
+
+    expect = apr_palloc(p, READAHEAD_SIZE);
+    buf = apr_palloc(p, READAHEAD_SIZE);
+    for (i = 0; i < READAHEAD_SIZE; i++) {
+        expect[i] = 'a' + i % 26;
+    }
+    APR_ASSERT_SUCCESS(tc, "write test file",
+                       apr_file_write_full(f, expect, READAHEAD_SIZE, NULL));
+
+    /* Read, then memory-mapped */
+    for (mmap = 0; mmap < 2; mmap++) {
+        e = apr_bucket_file_create(f, 1, READAHEAD_SIZE - 1, p, ba);
+        APR_BRIGADE_INSERT_TAIL(bb, e);
+        apr_bucket_file_enable_mmap(e, mmap);
+        apr_bucket_file_set_buf_size(e, 64 * 1024);
+
+        rv = apr_bucket_file_set_read_ahead(e, 128 * 1024);
+        if (rv == APR_ENOTIMPL) {
+            ABTS_NOT_IMPL(tc, "file read ahead");
+            break;
+        }
+        APR_ASSERT_SUCCESS(tc, "set read ahead", rv);
+
+        len = READAHEAD_SIZE;
+        APR_ASSERT_SUCCESS(tc, "flatten brigade",
+                           apr_brigade_flatten(bb, buf, &len));
+        ABTS_SIZE_EQUAL(tc, READAHEAD_SIZE - 1, len);
+        ABTS_ASSERT(tc, "file content", !memcmp(expect + 1, buf, len));
+        apr_brigade_cleanup(bb);
+    }
+
+    apr_file_close(f);
+    apr_file_remove("readahead.bin", p);
+    apr_brigade_destroy(bb);
+    apr_bucket_alloc_destroy(ba);
+}
+
+#define DIGEST_SIZE 20000
+
+static void test_digest(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb = apr_brigade_create(p, ba);
+    apr_file_t *f = make_test_file(tc, "digest.bin", "");
+    unsigned char expect[APR_SHA1_DIGESTSIZE], digest[APR_SHA1_DIGESTSIZE];
+    apr_md5_ctx_t md5;
+    apr_sha1_ctx_t sha1;
+    apr_bucket *e;
+    char *content, *buf;
+    apr_size_t len;
+    int i;
+
+    content = apr_palloc(p, DIGEST_SIZE);
+    buf = apr_palloc(p, DIGEST_SIZE);
+    for (i = 0; i < DIGEST_SIZE; i++) {
+        content[i] = 'a' + i * 7 % 26;
+    }
+    APR_ASSERT_SUCCESS(tc, "write test file",
+                       apr_file_write_full(f, content, DIGEST_SIZE - 100,
+                                           NULL));
+
+    /* the file read in pieces, with a split heap bucket after it */
+    e = apr_bucket_file_create(f, 0, DIGEST_SIZE - 100, p, ba);
+    apr_bucket_file_enable_mmap(e, 0);
+    apr_bucket_file_set_buf_size(e, 3000);
+    APR_BRIGADE_INSERT_TAIL(bb, e);
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_flush_create(ba));
+    APR_BRIGADE_INSERT_TAIL(bb,
+                            apr_bucket_heap_create(content + DIGEST_SIZE - 100,
+                                                   100, NULL, ba));
+
+    /* at once */
+    apr_sha1_init(&sha1);
+    APR_ASSERT_SUCCESS(tc, "digest a brigade",
+                       apr_brigade_digest(bb, APR_BRIGADE_DIGEST_SHA1, &sha1));
+    apr_sha1_final(digest, &sha1);
+    apr_sha1_init(&sha1);
+    apr_sha1_update_binary(&sha1, (unsigned char *)content, DIGEST_SIZE);
+    apr_sha1_final(expect, &sha1);
+    ABTS_ASSERT(tc, "sha1 of the brigade",
+                !memcmp(expect, digest, APR_SHA1_DIGESTSIZE));
+
+    /* as read, the heap bucket split before */
+    apr_brigade_cleanup(bb);
+    e = apr_bucket_file_create(f, 0, DIGEST_SIZE - 100, p, ba);
+    apr_bucket_file_enable_mmap(e, 0);
+    apr_bucket_file_set_buf_size(e, 3000);
+    APR_BRIGADE_INSERT_TAIL(bb, e);
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_flush_create(ba));
+    APR_BRIGADE_INSERT_TAIL(bb,
+                            apr_bucket_heap_create(content + DIGEST_SIZE - 100,
+                                                   100, NULL, ba));
+
+    apr_md5_init(&md5);
+    for (e = APR_BRIGADE_FIRST(bb);
+         e != APR_BRIGADE_SENTINEL(bb);
+         e = APR_BUCKET_NEXT(e)) {
+        if (!APR_BUCKET_IS_METADATA(e)) {
+            apr_bucket_digest_make(e, APR_BRIGADE_DIGEST_MD5, &md5);
+            ABTS_ASSERT(tc, "digest bucket", APR_BUCKET_IS_DIGEST(e));
+        }
+    }
+    e = APR_BRIGADE_LAST(bb);
+    ABTS_SIZE_EQUAL(tc, 100, e->length);
+    APR_ASSERT_SUCCESS(tc, "split digest bucket", apr_bucket_split(e, 30));
+    ABTS_SIZE_EQUAL(tc, 30, e->length);
+    ABTS_ASSERT(tc, "split digest bucket",
+                APR_BUCKET_IS_DIGEST(APR_BRIGADE_LAST(bb)));
+    ABTS_INT_EQUAL(tc, APR_ENOTIMPL, apr_bucket_copy(e, &e));
+
+    len = DIGEST_SIZE;
+    APR_ASSERT_SUCCESS(tc, "flatten brigade",
+                       apr_brigade_flatten(bb, buf, &len));
+    ABTS_SIZE_EQUAL(tc, DIGEST_SIZE, len);
+    ABTS_ASSERT(tc, "content", !memcmp(content, buf, DIGEST_SIZE));
+    for (e = APR_BRIGADE_FIRST(bb);
+         e != APR_BRIGADE_SENTINEL(bb);
+         e = APR_BUCKET_NEXT(e)) {
+        ABTS_ASSERT(tc, "read digest bucket", !APR_BUCKET_IS_DIGEST(e));
+    }
+    apr_md5_final(digest, &md5);
+    apr_md5(expect, content, DIGEST_SIZE);
+    ABTS_ASSERT(tc, "md5 as read",
+                !memcmp(expect, digest, APR_MD5_DIGESTSIZE));
+
+    /* unread, nothing leaks */
+    apr_brigade_cleanup(bb);
+    APR_BRIGADE_INSERT_TAIL(bb,
+                            apr_bucket_digest_create(
+                                apr_bucket_heap_create(content, 10, NULL, ba),
+                                APR_BRIGADE_DIGEST_MD5, &md5, ba));
+
+    apr_file_close(f);
+    apr_file_remove("digest.bin", p);
+    apr_brigade_destroy(bb);
+    apr_bucket_alloc_destroy(ba);
+}
+
 static const char hello[] = "hello, world";
 
+static void test_immortal(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb = apr_brigade_create(p, ba);
+    apr_bucket_alloc_stats_t stats[16];
+    apr_bucket *e, *c;
+    apr_uint64_t nalloc;
+    int i, n;
+
+    e = apr_bucket_immortal_create(hello, strlen(hello), ba);
+    APR_BRIGADE_INSERT_HEAD(bb, e);
+
+    /* Copied and split in place, the data never */
+    APR_ASSERT_SUCCESS(tc, "copy bucket", apr_bucket_copy(e, &c));
+    APR_BRIGADE_INSERT_TAIL(bb, c);
+    APR_ASSERT_SUCCESS(tc, "split bucket", apr_bucket_split(c, 5));
+    APR_ASSERT_SUCCESS(tc, "setaside bucket", apr_bucket_setaside(c, p));
+    for (e = APR_BRIGADE_FIRST(bb); e != APR_BRIGADE_SENTINEL(bb);
+         e = APR_BUCKET_NEXT(e)) {
+        ABTS_ASSERT(tc, "immortal bucket", APR_BUCKET_IS_IMMORTAL(e));
+        ABTS_PTR_EQUAL(tc, hello, e->data);
+    }
+    flatten_match(tc, "immortal buckets", bb, "hello, worldhello, world");
+
+    /* The memory of the buckets only */
+    n = apr_bucket_alloc_stats_get(ba, stats, 16);
+    for (nalloc = 0, i = 0; i < n && i < 16; i++) {
+        nalloc += stats[i].nalloc;
+    }
+    ABTS_INT_EQUAL(tc, 3, (int)nalloc);
+
+    apr_brigade_destroy(bb);
+    apr_bucket_alloc_destroy(ba);
+}
+
 static void test_partition(abts_case *tc, void *data)
 {
     apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
@@ -567,6 +909,293 @@ static void test_write_putstrs(abts_case *tc, void *data)
     apr_bucket_alloc_destroy(ba);
 }
 
+static apr_status_t count_flush(apr_bucket_brigade *bb, void *ctx)
+{
+    (*(int *)ctx)++;
+    return APR_SUCCESS;
+}
+
+static void test_writer(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb = apr_brigade_create(p, ba);
+    apr_brigade_writer_t *w;
+    char *expect, *buf, big[1000];
+    apr_size_t n, len;
+    int i, flushes = 0;
+
+    APR_ASSERT_SUCCESS(tc, "create writer",
+                       apr_brigade_writer_create(&w, bb, 256, count_flush,
+                                                 &flushes));
+
+    expect = apr_palloc(p, 20000);
+    n = 0;
+    for (i = 0; i < 1000; i++) {
+        apr_brigade_writer_putc(w, 'a' + i % 26);
+        expect[n++] = 'a' + i % 26;
+        apr_brigade_writer_printf(w, "[%d]", i);
+        n += apr_snprintf(expect + n, 20, "[%d]", i);
+        apr_brigade_writer_puts(w, "xy");
+        memcpy(expect + n, "xy", 2);
+        n += 2;
+    }
+    /* Buffers of 256 bytes, flushed when full */
+    ABTS_INT_EQUAL(tc, (int)(n / 256), count_buckets(bb));
+    ABTS_INT_EQUAL(tc, (int)(n / 256), flushes);
+
+    /* Not coalesced */
+    memset(big, 'z', sizeof(big));
+    APR_ASSERT_SUCCESS(tc, "big write",
+                       apr_brigade_writer_write(w, big, sizeof(big)));
+    memcpy(expect + n, big, sizeof(big));
+    n += sizeof(big);
+    ABTS_INT_EQUAL(tc, (int)((n - sizeof(big)) / 256) + 2, count_buckets(bb));
+
+    /* Formatted across buffers */
+    apr_brigade_writer_printf(w, "%s%0500d", "end", 7);
+    n += apr_snprintf(expect + n, 600, "%s%0500d", "end", 7);
+
+    APR_ASSERT_SUCCESS(tc, "flush writer", apr_brigade_writer_flush(w));
+    buf = apr_palloc(p, n);
+    len = n;
+    APR_ASSERT_SUCCESS(tc, "flatten", apr_brigade_flatten(bb, buf, &len));
+    ABTS_SIZE_EQUAL(tc, n, len);
+    ABTS_ASSERT(tc, "written data", !memcmp(expect, buf, n));
+    apr_brigade_cleanup(bb);
+
+    /* Without a flush function, nothing pending after a flush */
+    APR_ASSERT_SUCCESS(tc, "create writer",
+                       apr_brigade_writer_create(&w, bb, 0, NULL, NULL));
+    apr_brigade_writer_puts(w, "hello");
+    ABTS_TRUE(tc, APR_BRIGADE_EMPTY(bb));
+    APR_ASSERT_SUCCESS(tc, "flush writer", apr_brigade_writer_flush(w));
+    APR_ASSERT_SUCCESS(tc, "flush writer", apr_brigade_writer_flush(w));
+    flatten_match(tc, "flushed", bb, "hello");
+    /* The rest of its buffer is used by apr_brigade_write() */
+    apr_brigade_puts(bb, NULL, NULL, ", world");
+    ABTS_INT_EQUAL(tc, 1, count_buckets(bb));
+    flatten_match(tc, "appended", bb, "hello, world");
+
+    apr_brigade_destroy(bb);
+    apr_bucket_alloc_destroy(ba);
+}
+
+/* The stats of the class of allocations of size */
+static apr_bucket_alloc_stats_t *alloc_stats(apr_bucket_alloc_t *ba,
+                                             apr_bucket_alloc_stats_t *stats,
+                                             int nstats, apr_size_t size)
+{
+    int i, n = apr_bucket_alloc_stats_get(ba, stats, nstats);
+
+    for (i = 0; i < n && i < nstats; i++) {
+        if (size <= stats[i].size) {
+            return &stats[i];
+        }
+    }
+    return NULL;
+}
+
+static void test_alloc_classes(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_alloc_stats_t stats[16], *s;
+    void *mem[10];
+    int i, n;
+
+    n = apr_bucket_alloc_stats_get(ba, stats, 16);
+    ABTS_ASSERT(tc, "some classes", n > 2 && n <= 16);
+    for (i = 1; i < n; i++) {
+        ABTS_ASSERT(tc, "increasing sizes", stats[i - 1].size < stats[i].size);
+    }
+    ABTS_INT_EQUAL(tc, 1, stats[n - 1].size == APR_SIZE_MAX);
+    ABTS_INT_EQUAL(tc, n, apr_bucket_alloc_stats_get(ba, stats, 1));
+
+    /* The heap buckets' buffers are reused */
+    for (i = 0; i < 2; i++) {
+        mem[i] = apr_bucket_alloc(APR_BUCKET_BUFF_SIZE, ba);
+        memset(mem[i], 'a', APR_BUCKET_BUFF_SIZE);
+        apr_bucket_free(mem[i]);
+    }
+    s = alloc_stats(ba, stats, 16, APR_BUCKET_BUFF_SIZE);
+    ABTS_PTR_NOTNULL(tc, s);
+    ABTS_INT_EQUAL(tc, 1, s->size >= APR_BUCKET_BUFF_SIZE);
+    ABTS_INT_EQUAL(tc, 1, s->size != APR_SIZE_MAX);
+    ABTS_INT_EQUAL(tc, 2, (int)s->nalloc);
+    ABTS_INT_EQUAL(tc, 1, (int)s->nreuse);
+    ABTS_INT_EQUAL(tc, 1, (int)s->nfree);
+
+    /* Up to max_free */
+    APR_ASSERT_SUCCESS(tc, "max_free",
+                       apr_bucket_alloc_max_free_set(ba, APR_BUCKET_BUFF_SIZE,
+                                                     3));
+    for (i = 0; i < 10; i++) {
+        mem[i] = apr_bucket_alloc(APR_BUCKET_BUFF_SIZE, ba);
+    }
+    for (i = 0; i < 10; i++) {
+        apr_bucket_free(mem[i]);
+    }
+    s = alloc_stats(ba, stats, 16, APR_BUCKET_BUFF_SIZE);
+    ABTS_INT_EQUAL(tc, 3, (int)s->max_free);
+    ABTS_INT_EQUAL(tc, 3, (int)s->nfree);
+    ABTS_INT_EQUAL(tc, 12, (int)s->nalloc);
+
+    /* Trimmed when lowered */
+    APR_ASSERT_SUCCESS(tc, "max_free",
+                       apr_bucket_alloc_max_free_set(ba, APR_BUCKET_BUFF_SIZE,
+                                                     0));
+    s = alloc_stats(ba, stats, 16, APR_BUCKET_BUFF_SIZE);
+    ABTS_INT_EQUAL(tc, 0, (int)s->nfree);
+
+    /* Not for the carved (or larger) allocations */
+    ABTS_INT_EQUAL(tc, APR_EINVAL, apr_bucket_alloc_max_free_set(ba, 10, 0));
+    ABTS_INT_EQUAL(tc, APR_EINVAL,
+                   apr_bucket_alloc_max_free_set(ba, 1024 * 1024, 0));
+
+    /* Some sizes of every class */
+    for (i = 0; i < 10; i++) {
+        apr_size_t size = (apr_size_t)1 << (i * 2 + 1);
+        mem[i] = apr_bucket_alloc(size, ba);
+        ABTS_PTR_NOTNULL(tc, mem[i]);
+        memset(mem[i], 'b', size);
+    }
+    for (i = 0; i < 10; i++) {
+        apr_bucket_free(mem[i]);
+    }
+    /* 128K and 512K */
+    s = alloc_stats(ba, stats, 16, APR_SIZE_MAX);
+    ABTS_INT_EQUAL(tc, 2, (int)s->nalloc);
+
+    apr_bucket_alloc_destroy(ba);
+}
+
+static void test_length_track(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb = apr_brigade_create(p, ba);
+    apr_bucket_brigade *bb2 = apr_brigade_create(p, ba);
+    apr_file_t *rd, *wr;
+    apr_size_t nbytes = 5;
+    apr_bucket *e;
+    apr_off_t len;
+
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_immortal_create("hello", 5, ba));
+    ABTS_ASSERT(tc, "untracked length unknown", bb->length == -1);
+
+    apr_brigade_length_track(bb, 1);
+    ABTS_INT_EQUAL(tc, 5, (int)bb->length);
+    e = apr_bucket_heap_create(", world", 7, NULL, ba);
+    APR_BRIGADE_INSERT_TAIL(bb, e);
+    APR_BRIGADE_INSERT_HEAD(bb, apr_bucket_immortal_create(">", 1, ba));
+    ABTS_INT_EQUAL(tc, 13, (int)bb->length);
+
+    /* appended in place of the last heap bucket, and in a new one */
+    apr_brigade_write(bb, NULL, NULL, "!", 1);
+    apr_brigade_puts(bb, NULL, NULL, "\n");
+    ABTS_INT_EQUAL(tc, 15, (int)bb->length);
+
+    apr_brigade_length_track(bb2, 1);
+    apr_brigade_split_ex(bb, APR_BUCKET_NEXT(APR_BRIGADE_FIRST(bb)), bb2);
+    ABTS_INT_EQUAL(tc, 1, (int)bb->length);
+    ABTS_INT_EQUAL(tc, 14, (int)bb2->length);
+
+    APR_BRIGADE_CONCAT(bb, bb2);
+    ABTS_INT_EQUAL(tc, 15, (int)bb->length);
+    ABTS_INT_EQUAL(tc, 0, (int)bb2->length);
+    APR_ASSERT_SUCCESS(tc, "length", apr_brigade_length(bb, 0, &len));
+    ABTS_INT_EQUAL(tc, 15, (int)len);
+
+    /* bucket level changes invalidate it */
+    apr_bucket_delete(APR_BRIGADE_FIRST(bb));
+    APR_BRIGADE_LENGTH_INVALIDATE(bb);
+    APR_ASSERT_SUCCESS(tc, "length", apr_brigade_length(bb, 0, &len));
+    ABTS_INT_EQUAL(tc, 14, (int)len);
+    ABTS_INT_EQUAL(tc, 14, (int)bb->length);
+
+    apr_brigade_cleanup(bb);
+    ABTS_INT_EQUAL(tc, 0, (int)bb->length);
+
+    /* unknown until read */
+    APR_ASSERT_SUCCESS(tc, "create pipe", apr_file_pipe_create(&rd, &wr, p));
+    APR_ASSERT_SUCCESS(tc, "write pipe", apr_file_write(wr, "hello", &nbytes));
+    apr_file_close(wr);
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_pipe_create(rd, ba));
+    ABTS_INT_EQUAL(tc, -1, (int)bb->length);
+    APR_ASSERT_SUCCESS(tc, "length", apr_brigade_length(bb, 0, &len));
+    ABTS_INT_EQUAL(tc, -1, (int)len);
+    APR_ASSERT_SUCCESS(tc, "length", apr_brigade_length(bb, 1, &len));
+    ABTS_INT_EQUAL(tc, 5, (int)len);
+    ABTS_INT_EQUAL(tc, 5, (int)bb->length);
+
+    apr_brigade_length_track(bb, 0);
+    ABTS_INT_EQUAL(tc, -1, (int)bb->length);
+    APR_ASSERT_SUCCESS(tc, "length", apr_brigade_length(bb, 0, &len));
+    ABTS_INT_EQUAL(tc, 5, (int)len);
+
+    apr_brigade_destroy(bb);
+    apr_brigade_destroy(bb2);
+    apr_bucket_alloc_destroy(ba);
+}
+
+#if APR_HAS_THREADS
+
+#define REMOTE_THREADS 2
+#define REMOTE_BUCKETS 50
+
+static void *APR_THREAD_FUNC remote_cleanup(apr_thread_t *thd, void *data)
+{
+    apr_brigade_cleanup(data);
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static void test_alloc_remote_free(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb[REMOTE_THREADS];
+    apr_thread_t *thd[REMOTE_THREADS];
+    apr_bucket_alloc_stats_t stats[16], *s;
+    apr_status_t rv;
+    char *buf;
+    int i, j;
+
+    APR_ASSERT_SUCCESS(tc, "owner", apr_bucket_alloc_owner_set(ba, 1));
+
+    buf = apr_pcalloc(p, APR_BUCKET_BUFF_SIZE);
+    for (i = 0; i < REMOTE_THREADS; i++) {
+        bb[i] = apr_brigade_create(p, ba);
+        for (j = 0; j < REMOTE_BUCKETS; j++) {
+            APR_BRIGADE_INSERT_TAIL(bb[i],
+                apr_bucket_heap_create(buf, APR_BUCKET_BUFF_SIZE, NULL, ba));
+        }
+    }
+
+    /* The buckets are destroyed by the threads, while the owner allocates */
+    for (i = 0; i < REMOTE_THREADS; i++) {
+        APR_ASSERT_SUCCESS(tc, "create thread",
+                           apr_thread_create(&thd[i], NULL, remote_cleanup,
+                                             bb[i], p));
+    }
+    for (j = 0; j < 1000; j++) {
+        apr_bucket_free(apr_bucket_alloc(100, ba));
+    }
+    for (i = 0; i < REMOTE_THREADS; i++) {
+        apr_thread_join(&rv, thd[i]);
+        ABTS_TRUE(tc, APR_BRIGADE_EMPTY(bb[i]));
+    }
+
+    /* Taken back on the next allocation */
+    apr_bucket_free(apr_bucket_alloc(APR_BUCKET_BUFF_SIZE, ba));
+    s = alloc_stats(ba, stats, 16, APR_BUCKET_BUFF_SIZE);
+    ABTS_INT_EQUAL(tc, REMOTE_THREADS * REMOTE_BUCKETS + 1, (int)s->nalloc);
+    ABTS_INT_EQUAL(tc, 1, (int)s->nreuse);
+    ABTS_INT_EQUAL(tc, (int)s->max_free, (int)s->nfree);
+
+    APR_ASSERT_SUCCESS(tc, "not owned", apr_bucket_alloc_owner_set(ba, 0));
+    apr_bucket_alloc_destroy(ba);
+}
+
+#endif /* APR_HAS_THREADS */
+
 abts_suite *testbuckets(abts_suite *suite)
 {
     suite = ADD_SUITE(suite);
@@ -574,17 +1203,29 @@ abts_suite *testbuckets(abts_suite *suite)
     abts_run_test(suite, test_create, NULL);
     abts_run_test(suite, test_simple, NULL);
     abts_run_test(suite, test_flatten, NULL);
+    abts_run_test(suite, test_peek_contiguous, NULL);
     abts_run_test(suite, test_split, NULL);
     abts_run_test(suite, test_bwrite, NULL);
     abts_run_test(suite, test_splitline, NULL);
     abts_run_test(suite, test_splitboundary, NULL);
+    abts_run_test(suite, test_find, NULL);
+    abts_run_test(suite, test_encode, NULL);
     abts_run_test(suite, test_splits, NULL);
     abts_run_test(suite, test_insertfile, NULL);
     abts_run_test(suite, test_manyfile, NULL);
     abts_run_test(suite, test_truncfile, NULL);
+    abts_run_test(suite, test_file_readahead, NULL);
+    abts_run_test(suite, test_digest, NULL);
     abts_run_test(suite, test_partition, NULL);
+    abts_run_test(suite, test_immortal, NULL);
     abts_run_test(suite, test_write_split, NULL);
     abts_run_test(suite, test_write_putstrs, NULL);
+    abts_run_test(suite, test_writer, NULL);
+    abts_run_test(suite, test_alloc_classes, NULL);
+    abts_run_test(suite, test_length_track, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_alloc_remote_free, NULL);
+#endif
 
     return suite;
 }
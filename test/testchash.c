@@ -0,0 +1,280 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr.h"
+#include "apr_strings.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_chash.h"
+#include "apr_atomic.h"
+#include "apr_thread_proc.h"
+
+#define MANY_KEYS 10000
+
+static apr_chash_t *make_chash(abts_case *tc)
+{
+    apr_chash_t *ht;
+    apr_status_t rv;
+
+    rv = apr_chash_create(&ht, NULL, p);
+    APR_ASSERT_SUCCESS(tc, "create chash", rv);
+    return ht;
+}
+
+static void chash_set_get(abts_case *tc, void *data)
+{
+    apr_chash_t *ht = make_chash(tc);
+    char key[16];
+
+    ABTS_PTR_EQUAL(tc, NULL, apr_chash_get(ht, "key", APR_HASH_KEY_STRING));
+
+    /* The key is copied */
+    strcpy(key, "key");
+    APR_ASSERT_SUCCESS(tc, "set",
+                       apr_chash_set(ht, key, APR_HASH_KEY_STRING, "value"));
+    strcpy(key, "xxx");
+    ABTS_STR_EQUAL(tc, "value", apr_chash_get(ht, "key", APR_HASH_KEY_STRING));
+    ABTS_PTR_EQUAL(tc, NULL, apr_chash_get(ht, "xxx", APR_HASH_KEY_STRING));
+    ABTS_INT_EQUAL(tc, 1, apr_chash_count(ht));
+
+    /* Replaced */
+    apr_chash_set(ht, "key", 3, "other");
+    ABTS_STR_EQUAL(tc, "other", apr_chash_get(ht, "key", 3));
+    ABTS_INT_EQUAL(tc, 1, apr_chash_count(ht));
+
+    ABTS_STR_EQUAL(tc, "other",
+                   apr_chash_get_or_set(ht, "key", 3, "value"));
+    ABTS_STR_EQUAL(tc, "new",
+                   apr_chash_get_or_set(ht, "new", 3, "new"));
+    ABTS_PTR_EQUAL(tc, NULL, apr_chash_get_or_set(ht, "none", 4, NULL));
+    ABTS_INT_EQUAL(tc, 2, apr_chash_count(ht));
+
+    /* Deleted */
+    apr_chash_set(ht, "key", 3, NULL);
+    ABTS_PTR_EQUAL(tc, NULL, apr_chash_get(ht, "key", 3));
+    apr_chash_set(ht, "key", 3, NULL);
+    ABTS_INT_EQUAL(tc, 1, apr_chash_count(ht));
+
+    apr_chash_destroy(ht);
+}
+
+static void chash_key_sizes(abts_case *tc, void *data)
+{
+    apr_chash_t *ht = make_chash(tc);
+    static const apr_size_t sizes[] = { 0, 1, 16, 17, 100, 500, 1000, 5000 };
+    char *keys[sizeof(sizes) / sizeof(sizes[0])];
+    int i;
+
+    for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        keys[i] = apr_palloc(p, sizes[i] + 1);
+        memset(keys[i], 'a' + i, sizes[i]);
+        keys[i][sizes[i]] = '\0';
+        apr_chash_set(ht, keys[i], sizes[i], keys[i]);
+    }
+    ABTS_INT_EQUAL(tc, (int)(sizeof(sizes) / sizeof(sizes[0])),
+                   apr_chash_count(ht));
+    for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        ABTS_PTR_EQUAL(tc, keys[i], apr_chash_get(ht, keys[i], sizes[i]));
+        apr_chash_set(ht, keys[i], sizes[i], NULL);
+    }
+    ABTS_INT_EQUAL(tc, 0, apr_chash_count(ht));
+
+    apr_chash_destroy(ht);
+}
+
+static int count_cb(void *rec, const void *key, apr_ssize_t klen,
+                    const void *val)
+{
+    int *count = rec;
+
+    return ++*count < 10;
+}
+
+static void chash_many_keys(abts_case *tc, void *data)
+{
+    apr_chash_t *ht = make_chash(tc);
+    apr_chash_index_t *hi;
+    char **keys;
+    int i, n, ok;
+
+    keys = apr_palloc(p, MANY_KEYS * sizeof(*keys));
+    for (i = 0; i < MANY_KEYS; i++) {
+        keys[i] = apr_psprintf(p, "key%d", i);
+        apr_chash_set(ht, keys[i], APR_HASH_KEY_STRING, keys[i]);
+    }
+    ABTS_INT_EQUAL(tc, MANY_KEYS, apr_chash_count(ht));
+
+    /* Delete the odd ones while iterating */
+    n = 0;
+    for (hi = apr_chash_first(p, ht); hi; hi = apr_chash_next(hi)) {
+        const char *key = apr_chash_this_key(hi);
+        ABTS_INT_EQUAL(tc, strlen(key), apr_chash_this_key_len(hi));
+        if (atoi(key + 3) % 2) {
+            apr_chash_set(ht, key, APR_HASH_KEY_STRING, NULL);
+        }
+        n++;
+    }
+    ABTS_INT_EQUAL(tc, MANY_KEYS, n);
+    ABTS_INT_EQUAL(tc, MANY_KEYS / 2, apr_chash_count(ht));
+
+    ok = 1;
+    for (i = 0; i < MANY_KEYS; i++) {
+        void *expected = i % 2 ? NULL : keys[i];
+        if (apr_chash_get(ht, keys[i], APR_HASH_KEY_STRING) != expected) {
+            ok = 0;
+        }
+    }
+    ABTS_TRUE(tc, ok);
+
+    /* Stopped early */
+    n = 0;
+    ABTS_INT_EQUAL(tc, 0, apr_chash_do(count_cb, &n, ht));
+    ABTS_INT_EQUAL(tc, 10, n);
+    hi = apr_chash_first(p, ht);
+    ABTS_PTR_NOTNULL(tc, hi);
+    apr_chash_stop(hi);
+    ABTS_PTR_EQUAL(tc, NULL, apr_chash_next(hi));
+
+    apr_chash_clear(ht);
+    ABTS_INT_EQUAL(tc, 0, apr_chash_count(ht));
+    ABTS_PTR_EQUAL(tc, NULL, apr_chash_first(p, ht));
+    ABTS_PTR_EQUAL(tc, NULL, apr_chash_get(ht, keys[0], APR_HASH_KEY_STRING));
+
+    /* Still usable after clearing */
+    apr_chash_set(ht, keys[0], APR_HASH_KEY_STRING, keys[0]);
+    ABTS_PTR_EQUAL(tc, keys[0],
+                   apr_chash_get(ht, keys[0], APR_HASH_KEY_STRING));
+
+    apr_chash_destroy(ht);
+}
+
+static void chash_pool_lifetime(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_chash_t *ht;
+    int i;
+
+    APR_ASSERT_SUCCESS(tc, "create pool", apr_pool_create(&pool, p));
+
+    /* Destroyed with the pool, entries included */
+    APR_ASSERT_SUCCESS(tc, "create chash", apr_chash_create(&ht, NULL, pool));
+    for (i = 0; i < 1000; i++) {
+        apr_chash_set(ht, &i, sizeof(i), "value");
+    }
+    apr_pool_destroy(pool);
+}
+
+#if APR_HAS_THREADS
+#define CHASH_THREADS 4
+#define CHASH_ROUNDS  20000
+
+static volatile int chash_failed;
+
+/* Readers check that the stable keys are seen, writers churn others */
+static void *APR_THREAD_FUNC chash_reader(apr_thread_t *thd, void *data)
+{
+    apr_chash_t *ht = data;
+    int i, j, n;
+
+    for (i = 0; i < CHASH_ROUNDS; i++) {
+        j = i % 100;
+        if (apr_chash_get(ht, &j, sizeof(j)) != ht) {
+            chash_failed = 1;
+        }
+        if (i % 1000 == 0) {
+            apr_pool_t *pool;
+            apr_chash_index_t *hi;
+
+            apr_pool_create(&pool, NULL);
+            n = 0;
+            for (hi = apr_chash_first(pool, ht); hi; hi = apr_chash_next(hi)) {
+                if (apr_chash_this_val(hi) == ht) {
+                    n++;
+                }
+            }
+            if (n != 100) {
+                chash_failed = 1;
+            }
+            apr_pool_destroy(pool);
+        }
+    }
+
+    return NULL;
+}
+
+static void *APR_THREAD_FUNC chash_writer(apr_thread_t *thd, void *data)
+{
+    apr_chash_t *ht = data;
+    static volatile apr_uint32_t next_base;
+    int base = 1000 + 100000 * (int)apr_atomic_inc32(&next_base);
+    int i, key;
+
+    for (i = 0; i < CHASH_ROUNDS; i++) {
+        key = base + i;
+        apr_chash_set(ht, &key, sizeof(key), "writer");
+        if (i >= 100) {
+            key = base + i - 100;
+            apr_chash_set(ht, &key, sizeof(key), NULL);
+        }
+    }
+
+    return NULL;
+}
+
+static void chash_threads(abts_case *tc, void *data)
+{
+    apr_thread_t *readers[CHASH_THREADS], *writers[CHASH_THREADS];
+    apr_chash_t *ht = make_chash(tc);
+    apr_status_t rv;
+    int i;
+
+    for (i = 0; i < 100; i++) {
+        apr_chash_set(ht, &i, sizeof(i), ht);
+    }
+
+    chash_failed = 0;
+    for (i = 0; i < CHASH_THREADS; i++) {
+        rv = apr_thread_create(&readers[i], NULL, chash_reader, ht, p);
+        APR_ASSERT_SUCCESS(tc, "create reader", rv);
+        rv = apr_thread_create(&writers[i], NULL, chash_writer, ht, p);
+        APR_ASSERT_SUCCESS(tc, "create writer", rv);
+    }
+    for (i = 0; i < CHASH_THREADS; i++) {
+        apr_thread_join(&rv, readers[i]);
+        apr_thread_join(&rv, writers[i]);
+    }
+    ABTS_INT_EQUAL(tc, 0, chash_failed);
+    ABTS_INT_EQUAL(tc, 100 + CHASH_THREADS * 100, apr_chash_count(ht));
+
+    apr_chash_destroy(ht);
+}
+#endif /* APR_HAS_THREADS */
+
+abts_suite *testchash(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+    abts_run_test(suite, chash_set_get, NULL);
+    abts_run_test(suite, chash_key_sizes, NULL);
+    abts_run_test(suite, chash_many_keys, NULL);
+    abts_run_test(suite, chash_pool_lifetime, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, chash_threads, NULL);
+#endif
+
+    return suite;
+}
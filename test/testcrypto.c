@@ -24,6 +24,7 @@
 #include "apr_strings.h"
 #include "apr_file_io.h"
 #include "apr_thread_proc.h"
+#include "apr_thread_pool.h"
 
 #if APU_HAVE_CRYPTO
 
@@ -1186,6 +1187,381 @@ static void test_crypto_block_openssl(abts_case *tc, void *data)
 
 }
 
+/**
+ * Block contexts of OpenSSL made again for each message, and for another
+ * key.
+ */
+static void test_crypto_block_reuse_openssl(abts_case *tc, void *data)
+{
+    apr_pool_t *pool = NULL;
+    const apr_crypto_driver_t *driver;
+    apr_crypto_t *f;
+    const apr_crypto_key_t *keys[2];
+    apr_crypto_block_t *ectx = NULL, *dctx = NULL;
+    const unsigned char *in = (const unsigned char *) TEST_STRING;
+    unsigned char cipherText[64], plainText[64], *out;
+    apr_size_t len, total;
+    int i;
+
+    apr_pool_create(&pool, NULL);
+    driver = get_openssl_driver(tc, pool);
+    f = make(tc, pool, driver);
+    keys[0] = keysecret(tc, pool, driver, f, APR_KEY_AES_256, APR_MODE_CBC, 1,
+            32, "KEY_AES_256/MODE_CBC");
+    keys[1] = passphrase(tc, pool, driver, f, APR_KEY_AES_256, APR_MODE_CBC,
+            1, "KEY_AES_256/MODE_CBC");
+    if (!keys[0] || !keys[1]) {
+        apr_pool_destroy(pool);
+        return;
+    }
+
+    for (i = 0; i < 6; i++) {
+        const apr_crypto_key_t *key = keys[i / 3];
+        const unsigned char *iv = NULL;
+
+        APR_ASSERT_SUCCESS(tc, "encrypt init",
+                apr_crypto_block_encrypt_init(&ectx, &iv, key, NULL, pool));
+        out = cipherText;
+        len = sizeof(cipherText);
+        APR_ASSERT_SUCCESS(tc, "encrypt", apr_crypto_block_encrypt(&out,
+                &len, in, sizeof(TEST_STRING), ectx));
+        total = len;
+        len = sizeof(cipherText) - total;
+        APR_ASSERT_SUCCESS(tc, "encrypt finish",
+                apr_crypto_block_encrypt_finish(cipherText + total, &len,
+                        ectx));
+        total += len;
+        ABTS_SIZE_EQUAL(tc, 16, total);
+
+        APR_ASSERT_SUCCESS(tc, "decrypt init",
+                apr_crypto_block_decrypt_init(&dctx, NULL, iv, key, pool));
+        out = plainText;
+        len = sizeof(plainText);
+        APR_ASSERT_SUCCESS(tc, "decrypt", apr_crypto_block_decrypt(&out,
+                &len, cipherText, total, dctx));
+        total = len;
+        len = sizeof(plainText) - total;
+        APR_ASSERT_SUCCESS(tc, "decrypt finish",
+                apr_crypto_block_decrypt_finish(plainText + total, &len,
+                        dctx));
+        total += len;
+        ABTS_SIZE_EQUAL(tc, sizeof(TEST_STRING), total);
+        ABTS_STR_EQUAL(tc, TEST_STRING, (char *)plainText);
+    }
+
+    apr_pool_destroy(pool);
+}
+
+/**
+ * Cached passphrase keys of OpenSSL.
+ */
+static void test_crypto_key_cache_openssl(abts_case *tc, void *data)
+{
+    apr_pool_t *pool = NULL;
+    const apr_crypto_driver_t *driver;
+    apr_crypto_t *f;
+    apr_crypto_key_cache_t *cache;
+    const apr_crypto_key_t *key1, *key2, *key;
+    const unsigned char *salt = (const unsigned char *)"salt";
+    apr_size_t ivSize = 0;
+    int i;
+
+    apr_pool_create(&pool, NULL);
+    driver = get_openssl_driver(tc, pool);
+    f = make(tc, pool, driver);
+    if (!f) {
+        apr_pool_destroy(pool);
+        return;
+    }
+
+    ABTS_INT_EQUAL(tc, APR_EINVAL,
+                   apr_crypto_key_cache_create(&cache, 0, f, pool));
+    APR_ASSERT_SUCCESS(tc, "create cache",
+                       apr_crypto_key_cache_create(&cache, 2, f, pool));
+
+    APR_ASSERT_SUCCESS(tc, "derive key",
+            apr_crypto_passphrase_cached(&key1, &ivSize, cache, "secret", 6,
+                    salt, 4, APR_KEY_AES_256, APR_MODE_CBC, 1, 4096));
+    ABTS_SIZE_EQUAL(tc, 16, ivSize);
+    APR_ASSERT_SUCCESS(tc, "cached key",
+            apr_crypto_passphrase_cached(&key, NULL, cache, "secret", 6,
+                    salt, 4, APR_KEY_AES_256, APR_MODE_CBC, 1, 4096));
+    ABTS_PTR_EQUAL(tc, key1, key);
+
+    /* every parameter makes another key */
+    APR_ASSERT_SUCCESS(tc, "other iterations",
+            apr_crypto_passphrase_cached(&key2, NULL, cache, "secret", 6,
+                    salt, 4, APR_KEY_AES_256, APR_MODE_CBC, 1, 4097));
+    ABTS_TRUE(tc, key2 != key1);
+    APR_ASSERT_SUCCESS(tc, "still cached",
+            apr_crypto_passphrase_cached(&key, NULL, cache, "secret", 6,
+                    salt, 4, APR_KEY_AES_256, APR_MODE_CBC, 1, 4096));
+    ABTS_PTR_EQUAL(tc, key1, key);
+
+    /* the least recently used (key2) is replaced */
+    APR_ASSERT_SUCCESS(tc, "other passphrase",
+            apr_crypto_passphrase_cached(&key, NULL, cache, "secreT", 6,
+                    salt, 4, APR_KEY_AES_256, APR_MODE_CBC, 1, 4096));
+    ABTS_TRUE(tc, key != key1);
+    APR_ASSERT_SUCCESS(tc, "kept",
+            apr_crypto_passphrase_cached(&key, NULL, cache, "secret", 6,
+                    salt, 4, APR_KEY_AES_256, APR_MODE_CBC, 1, 4096));
+    ABTS_PTR_EQUAL(tc, key1, key);
+
+    /* the same key as an uncached one */
+    for (i = 0; i < 2; i++) {
+        const apr_crypto_key_t *k = passphrase(tc, pool, driver, f,
+                APR_KEY_AES_256, APR_MODE_CBC, 1, "KEY_AES_256/MODE_CBC");
+        unsigned char *cipherText = NULL, *plainText = NULL;
+        apr_size_t cipherTextLen = 0, plainTextLen = 0;
+        const unsigned char *iv = NULL;
+        apr_size_t blockSize = 0;
+
+        if (!k) {
+            break;
+        }
+        cipherText = encrypt_block(tc, pool, driver, f, i ? k : key1,
+                (const unsigned char *)TEST_STRING, sizeof(TEST_STRING),
+                &cipherText, &cipherTextLen, &iv, &blockSize,
+                "KEY_AES_256/MODE_CBC");
+        plainText = decrypt_block(tc, pool, driver, f, i ? key1 : k,
+                cipherText, cipherTextLen, &plainText, &plainTextLen, iv,
+                &blockSize, "KEY_AES_256/MODE_CBC");
+        ABTS_PTR_NOTNULL(tc, plainText);
+        if (plainText) {
+            ABTS_STR_EQUAL(tc, TEST_STRING, (char *)plainText);
+        }
+    }
+
+    apr_pool_destroy(pool);
+}
+
+/**
+ * AEAD encryption and decryption of OpenSSL.
+ */
+static void test_crypto_aead_openssl(abts_case *tc, void *data)
+{
+    /* AES-128-GCM of 16 zeros, zero key and IV (test case 2 of the spec) */
+    static const unsigned char gcm_ct[16] = {
+        0x03, 0x88, 0xda, 0xce, 0x60, 0xb6, 0xa3, 0x92,
+        0xf3, 0x28, 0xc2, 0xb9, 0x71, 0xb2, 0xfe, 0x78
+    };
+    static const unsigned char gcm_tag[16] = {
+        0xab, 0x6e, 0x47, 0xd4, 0x2c, 0xec, 0x13, 0xbd,
+        0xf5, 0x3a, 0x67, 0xb2, 0x12, 0x57, 0xbd, 0xdf
+    };
+    const unsigned char *aad = (const unsigned char *) "header";
+    const unsigned char *in = (const unsigned char *) ALIGNED_STRING;
+    unsigned char iv[APR_CRYPTO_AEAD_IVSIZE] = { 0 };
+    unsigned char zeros[16] = { 0 };
+    unsigned char tag[APR_CRYPTO_AEAD_TAGSIZE];
+    unsigned char cipherText[sizeof(ALIGNED_STRING)];
+    unsigned char plainText[sizeof(ALIGNED_STRING)];
+    apr_pool_t *pool = NULL;
+    const apr_crypto_driver_t *driver;
+    apr_crypto_t *f;
+    const apr_crypto_key_t *key;
+    apr_crypto_block_t *block = NULL;
+    const unsigned char *blockIv = NULL;
+    int i;
+
+    apr_pool_create(&pool, NULL);
+    driver = get_openssl_driver(tc, pool);
+    f = make(tc, pool, driver);
+
+    key = keysecret(tc, pool, driver, f, APR_KEY_AES_128, APR_MODE_GCM, 0, 16,
+            "KEY_AES_128/MODE_GCM");
+    if (key) {
+        APR_ASSERT_SUCCESS(tc, "gcm encrypt",
+                apr_crypto_aead_encrypt(cipherText, tag, sizeof(tag), zeros,
+                        16, NULL, 0, iv, key));
+        ABTS_ASSERT(tc, "gcm cipher text", !memcmp(cipherText, gcm_ct, 16));
+        ABTS_ASSERT(tc, "gcm tag", !memcmp(tag, gcm_tag, 16));
+
+        ABTS_INT_EQUAL(tc, APR_EINVAL, apr_crypto_aead_encrypt(cipherText,
+                tag, APR_CRYPTO_AEAD_TAGSIZE + 1, in, 1, NULL, 0, iv, key));
+        ABTS_INT_EQUAL(tc, APR_ENOIV, apr_crypto_aead_encrypt(cipherText,
+                tag, sizeof(tag), in, 1, NULL, 0, NULL, key));
+        ABTS_INT_EQUAL(tc, APR_EINVAL, apr_crypto_block_encrypt_init(&block,
+                &blockIv, key, NULL, pool));
+    }
+
+    key = keysecret(tc, pool, driver, f, APR_KEY_AES_256, APR_MODE_CBC, 0, 32,
+            "KEY_AES_256/MODE_CBC");
+    if (key) {
+        ABTS_INT_EQUAL(tc, APR_EINVAL, apr_crypto_aead_encrypt(cipherText,
+                tag, sizeof(tag), in, 1, NULL, 0, iv, key));
+    }
+
+    for (i = 0; i < 2; i++) {
+        key = i ? keysecret(tc, pool, driver, f, APR_KEY_CHACHA20,
+                            APR_MODE_POLY1305, 0, 32,
+                            "KEY_CHACHA20/MODE_POLY1305")
+                : keysecret(tc, pool, driver, f, APR_KEY_AES_256,
+                            APR_MODE_GCM, 0, 32, "KEY_AES_256/MODE_GCM");
+        if (!key) {
+            continue;
+        }
+
+        /* the context cached by the key is reset for each message */
+        iv[0] = 1;
+        APR_ASSERT_SUCCESS(tc, "aead encrypt",
+                apr_crypto_aead_encrypt(cipherText, tag, sizeof(tag), in,
+                        sizeof(ALIGNED_STRING), aad, 6, iv, key));
+        APR_ASSERT_SUCCESS(tc, "aead decrypt",
+                apr_crypto_aead_decrypt(plainText, tag, sizeof(tag),
+                        cipherText, sizeof(ALIGNED_STRING), aad, 6, iv, key));
+        ABTS_STR_EQUAL(tc, ALIGNED_STRING, (char *)plainText);
+
+        /* in place, with a shorter tag */
+        memcpy(plainText, in, sizeof(ALIGNED_STRING));
+        iv[0] = 2;
+        APR_ASSERT_SUCCESS(tc, "aead encrypt in place",
+                apr_crypto_aead_encrypt(plainText, tag, 12, plainText,
+                        sizeof(ALIGNED_STRING), NULL, 0, iv, key));
+        APR_ASSERT_SUCCESS(tc, "aead decrypt in place",
+                apr_crypto_aead_decrypt(plainText, tag, 12, plainText,
+                        sizeof(ALIGNED_STRING), NULL, 0, iv, key));
+        ABTS_STR_EQUAL(tc, ALIGNED_STRING, (char *)plainText);
+
+        /* not authentic */
+        iv[0] = 3;
+        APR_ASSERT_SUCCESS(tc, "aead encrypt",
+                apr_crypto_aead_encrypt(cipherText, tag, sizeof(tag), in,
+                        sizeof(ALIGNED_STRING), aad, 6, iv, key));
+        ABTS_INT_EQUAL(tc, APR_ENOVERIFY, apr_crypto_aead_decrypt(plainText,
+                tag, sizeof(tag), cipherText, sizeof(ALIGNED_STRING), aad, 5,
+                iv, key));
+        ABTS_ASSERT(tc, "not authentic zeroed", !memcmp(plainText, zeros, 16));
+        tag[0] ^= 1;
+        ABTS_INT_EQUAL(tc, APR_ENOVERIFY, apr_crypto_aead_decrypt(plainText,
+                tag, sizeof(tag), cipherText, sizeof(ALIGNED_STRING), aad, 6,
+                iv, key));
+        tag[0] ^= 1;
+        APR_ASSERT_SUCCESS(tc, "aead decrypt after failures",
+                apr_crypto_aead_decrypt(plainText, tag, sizeof(tag),
+                        cipherText, sizeof(ALIGNED_STRING), aad, 6, iv, key));
+        ABTS_STR_EQUAL(tc, ALIGNED_STRING, (char *)plainText);
+    }
+
+    apr_pool_destroy(pool);
+}
+
+/**
+ * STREAM encryption and decryption of OpenSSL, in parallel or not.
+ */
+static void test_crypto_stream_openssl(abts_case *tc, void *data)
+{
+    const apr_size_t len = 100000, chunksize = 4096;
+    const unsigned char prefix[APR_CRYPTO_STREAM_PREFIXSIZE] = "STREAM";
+    apr_pool_t *pool = NULL;
+    const apr_crypto_driver_t *driver;
+    apr_crypto_t *f;
+    const apr_crypto_key_t *key;
+    struct apr_thread_pool *tp = NULL;
+    unsigned char *in, *cipherText, *plainText;
+    apr_size_t cipherLen, plainLen, i;
+    int pass;
+
+    apr_pool_create(&pool, NULL);
+    driver = get_openssl_driver(tc, pool);
+    f = make(tc, pool, driver);
+
+    key = keysecret(tc, pool, driver, f, APR_KEY_AES_256, APR_MODE_GCM, 0, 32,
+            "KEY_AES_256/MODE_GCM");
+    if (!key) {
+        apr_pool_destroy(pool);
+        return;
+    }
+
+    in = apr_palloc(pool, len);
+    for (i = 0; i < len; i++) {
+        in[i] = (unsigned char)(i * 7 + (i >> 8));
+    }
+
+    APR_ASSERT_SUCCESS(tc, "stream size",
+            apr_crypto_stream_encrypt(NULL, &cipherLen, in, len, chunksize,
+                    prefix, key, NULL));
+    ABTS_INT_EQUAL(tc, len + 25 * APR_CRYPTO_AEAD_TAGSIZE, cipherLen);
+    cipherText = apr_palloc(pool, cipherLen);
+    plainText = apr_palloc(pool, len);
+
+#if APR_HAS_THREADS
+    APR_ASSERT_SUCCESS(tc, "thread pool",
+            apr_thread_pool_create(&tp, 0, 4, pool));
+#endif
+
+    for (pass = 0; pass < 2; pass++) {
+        struct apr_thread_pool *p = pass ? NULL : tp;
+
+        memset(cipherText, 0, cipherLen);
+        APR_ASSERT_SUCCESS(tc, "stream encrypt",
+                apr_crypto_stream_encrypt(cipherText, &cipherLen, in, len,
+                        chunksize, prefix, key, p));
+        memset(plainText, 0, len);
+        APR_ASSERT_SUCCESS(tc, "stream decrypt",
+                apr_crypto_stream_decrypt(plainText, &plainLen, cipherText,
+                        cipherLen, chunksize, prefix, key, p));
+        ABTS_INT_EQUAL(tc, len, plainLen);
+        ABTS_ASSERT(tc, "stream round trip", !memcmp(plainText, in, len));
+    }
+
+    /* random access */
+    memset(plainText, 0, len);
+    APR_ASSERT_SUCCESS(tc, "stream decrypt chunk",
+            apr_crypto_stream_decrypt_chunk(plainText, &plainLen, cipherText,
+                    cipherLen, chunksize, 5, prefix, key));
+    ABTS_INT_EQUAL(tc, chunksize, plainLen);
+    ABTS_ASSERT(tc, "stream chunk",
+            !memcmp(plainText, in + 5 * chunksize, chunksize));
+    APR_ASSERT_SUCCESS(tc, "stream decrypt last chunk",
+            apr_crypto_stream_decrypt_chunk(plainText, &plainLen, cipherText,
+                    cipherLen, chunksize, 24, prefix, key));
+    ABTS_INT_EQUAL(tc, len - 24 * chunksize, plainLen);
+    ABTS_ASSERT(tc, "stream last chunk",
+            !memcmp(plainText, in + 24 * chunksize, plainLen));
+    ABTS_INT_EQUAL(tc, APR_EINVAL, apr_crypto_stream_decrypt_chunk(plainText,
+            &plainLen, cipherText, cipherLen, chunksize, 25, prefix, key));
+
+    /* tampered */
+    cipherText[3 * (chunksize + APR_CRYPTO_AEAD_TAGSIZE) + 10] ^= 1;
+    ABTS_INT_EQUAL(tc, APR_ENOVERIFY, apr_crypto_stream_decrypt(plainText,
+            &plainLen, cipherText, cipherLen, chunksize, prefix, key, tp));
+    ABTS_INT_EQUAL(tc, APR_ENOVERIFY, apr_crypto_stream_decrypt_chunk(
+            plainText, &plainLen, cipherText, cipherLen, chunksize, 3,
+            prefix, key));
+    cipherText[3 * (chunksize + APR_CRYPTO_AEAD_TAGSIZE) + 10] ^= 1;
+
+    /* truncated at a chunk boundary: the last chunk is missing */
+    ABTS_INT_EQUAL(tc, APR_ENOVERIFY, apr_crypto_stream_decrypt(plainText,
+            &plainLen, cipherText, 10 * (chunksize + APR_CRYPTO_AEAD_TAGSIZE),
+            chunksize, prefix, key, tp));
+
+    /* reordered chunks */
+    memcpy(plainText, cipherText, chunksize + APR_CRYPTO_AEAD_TAGSIZE);
+    memcpy(cipherText, cipherText + chunksize + APR_CRYPTO_AEAD_TAGSIZE,
+           chunksize + APR_CRYPTO_AEAD_TAGSIZE);
+    memcpy(cipherText + chunksize + APR_CRYPTO_AEAD_TAGSIZE, plainText,
+           chunksize + APR_CRYPTO_AEAD_TAGSIZE);
+    ABTS_INT_EQUAL(tc, APR_ENOVERIFY, apr_crypto_stream_decrypt(plainText,
+            &plainLen, cipherText, cipherLen, chunksize, prefix, key, NULL));
+
+    /* empty */
+    APR_ASSERT_SUCCESS(tc, "stream encrypt empty",
+            apr_crypto_stream_encrypt(cipherText, &cipherLen, in, 0,
+                    chunksize, prefix, key, tp));
+    ABTS_INT_EQUAL(tc, APR_CRYPTO_AEAD_TAGSIZE, cipherLen);
+    APR_ASSERT_SUCCESS(tc, "stream decrypt empty",
+            apr_crypto_stream_decrypt(plainText, &plainLen, cipherText,
+                    cipherLen, chunksize, prefix, key, tp));
+    ABTS_INT_EQUAL(tc, 0, plainLen);
+
+#if APR_HAS_THREADS
+    apr_thread_pool_destroy(tp);
+#endif
+    apr_pool_destroy(pool);
+}
+
 /**
  * Simple test of OpenSSL block signatures.
  */
@@ -2690,6 +3066,14 @@ abts_suite *testcrypto(abts_suite *suite)
     abts_run_test(suite, test_crypto_key_openssl, NULL);
     /* test a simple encrypt / decrypt operation - openssl */
     abts_run_test(suite, test_crypto_block_openssl, NULL);
+    /* test block contexts made again - openssl */
+    abts_run_test(suite, test_crypto_block_reuse_openssl, NULL);
+    /* test cached passphrase keys - openssl */
+    abts_run_test(suite, test_crypto_key_cache_openssl, NULL);
+    /* test the AEAD encrypt / decrypt operations - openssl */
+    abts_run_test(suite, test_crypto_aead_openssl, NULL);
+    /* test the parallel STREAM encrypt / decrypt operations - openssl */
+    abts_run_test(suite, test_crypto_stream_openssl, NULL);
     /* test a simple sign / verify operation - openssl */
     abts_run_test(suite, test_crypto_digest_openssl, NULL);
     /* test a padded encrypt / decrypt operation - openssl */
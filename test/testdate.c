@@ -18,6 +18,7 @@
 #include "testutil.h"
 #include "apr_date.h"
 #include "apr_general.h"
+#include "apr_strings.h"
 
 #if APR_HAVE_TIME_H
 #include <time.h>
@@ -173,6 +174,42 @@ static void test_date_parse_http(abts_case *tc, void *data)
     }
 }
 
+static void test_date_parse_http_forms(abts_case *tc, void *data)
+{
+    static const struct {
+        const char *date;
+        apr_time_t secs;
+    } forms[] = {
+        { "Sun, 06 Nov 1994 08:49:37 GMT", APR_INT64_C(784111777) },
+        { "  Sun, 06 Nov 1994 08:49:37 GMT", APR_INT64_C(784111777) },
+        { "Sun, 06 Nov 1994 08:49:37 +0100", APR_INT64_C(784111777) },
+        { "Sunday, 06-Nov-94 08:49:37 GMT", APR_INT64_C(784111777) },
+        { "Sun Nov  6 08:49:37 1994", APR_INT64_C(784111777) },
+        { "Sun, 6 Nov 1994 08:49:37 GMT", APR_INT64_C(784111777) },
+        { "Mon, 29 Feb 2016 23:59:59 GMT", APR_INT64_C(1456790399) },
+        { "Sun, 06 nov 1994 08:49:37 GMT", APR_DATE_BAD },
+        { "Sun, 06 Nov 1994 24:49:37 GMT", APR_DATE_BAD },
+        { "Sun, 31 Apr 1994 08:49:37 GMT", APR_DATE_BAD },
+        { "Sun, 29 Feb 2015 08:49:37 GMT", APR_DATE_BAD },
+        { "Sun, 06 Nov 1994 08:49:37", APR_DATE_BAD },
+        { "Sun, 06 Nov 1994 08:49", APR_DATE_BAD },
+        { "Sun, 06 Nov 1894 08:49:37 GMT", APR_DATE_BAD },
+        { "Sun,", APR_DATE_BAD },
+        { "", APR_DATE_BAD }
+    };
+    int i;
+
+    for (i = 0; i < sizeof(forms) / sizeof(forms[0]); i++) {
+        apr_time_t expected = forms[i].secs;
+        char msg[80];
+
+        if (expected != APR_DATE_BAD)
+            expected *= APR_USEC_PER_SEC;
+        apr_snprintf(msg, sizeof msg, "parsing '%s'", forms[i].date);
+        ABTS_ASSERT(tc, msg, apr_date_parse_http(forms[i].date) == expected);
+    }
+}
+
 static void test_date_rfc(abts_case *tc, void *data)
 {
     apr_time_t date;
@@ -191,6 +228,27 @@ static void test_date_rfc(abts_case *tc, void *data)
     }
 }
 
+static void test_date_rfc822_cache(abts_case *tc, void *data)
+{
+    char str_date[APR_RFC822_DATE_LEN];
+    apr_time_t t = APR_INT64_C(784111777) * APR_USEC_PER_SEC;
+
+    apr_rfc822_date(str_date, t);
+    ABTS_STR_EQUAL(tc, "Sun, 06 Nov 1994 08:49:37 GMT", str_date);
+    apr_rfc822_date(str_date, t + APR_USEC_PER_SEC - 1);
+    ABTS_STR_EQUAL(tc, "Sun, 06 Nov 1994 08:49:37 GMT", str_date);
+    apr_rfc822_date(str_date, t + APR_USEC_PER_SEC);
+    ABTS_STR_EQUAL(tc, "Sun, 06 Nov 1994 08:49:38 GMT", str_date);
+    apr_rfc822_date(str_date, t);
+    ABTS_STR_EQUAL(tc, "Sun, 06 Nov 1994 08:49:37 GMT", str_date);
+
+    /* Around the epoch */
+    apr_rfc822_date(str_date, 0);
+    ABTS_STR_EQUAL(tc, "Thu, 01 Jan 1970 00:00:00 GMT", str_date);
+    apr_rfc822_date(str_date, -APR_USEC_PER_SEC);
+    ABTS_STR_EQUAL(tc, "Wed, 31 Dec 1969 23:59:59 GMT", str_date);
+}
+
 static void test_date_exp_get(abts_case *tc, void *data)
 {
     apr_time_t t = {0};
@@ -222,7 +280,9 @@ abts_suite *testdate(abts_suite *suite)
     suite = ADD_SUITE(suite);
 
     abts_run_test(suite, test_date_parse_http, NULL);
+    abts_run_test(suite, test_date_parse_http_forms, NULL);
     abts_run_test(suite, test_date_rfc, NULL);
+    abts_run_test(suite, test_date_rfc822_cache, NULL);
     abts_run_test(suite, test_date_exp_get, NULL);
 
     return suite;
@@ -86,6 +86,34 @@ static void insert_data(abts_case *tc, apr_dbd_t* handle,
     }
 }
 
+static void bulk_insert(abts_case *tc, apr_dbd_t* handle,
+                        const apr_dbd_driver_t* driver, int count)
+{
+    apr_pool_t* pool = p;
+    const char *const columns[] = { "col1", "col2", "col3" };
+    const char *values[3];
+    apr_dbd_bulk_t *bulk = NULL;
+    int i, nrows = -1;
+    int rv;
+
+    rv = apr_dbd_bulk_begin(driver, pool, handle, &bulk, "apr_dbd_test",
+                            3, columns);
+    ABTS_ASSERT(tc, "failed to begin bulk load", rv == 0);
+    if (rv) {
+        return;
+    }
+    for (i = 0; i < count; i++) {
+        values[0] = apr_itoa(pool, i);
+        values[1] = (i % 2) ? "it's\tl\\oaded" : NULL;
+        values[2] = values[0];
+        rv = apr_dbd_bulk_row(driver, bulk, values);
+        ABTS_ASSERT(tc, "failed to load row", rv == 0);
+    }
+    rv = apr_dbd_bulk_end(driver, bulk, &nrows);
+    ABTS_ASSERT(tc, "failed to end bulk load", rv == 0);
+    ABTS_INT_EQUAL(tc, count, nrows);
+}
+
 static void select_rows(abts_case *tc, apr_dbd_t* handle,
                         const apr_dbd_driver_t* driver, int count)
 {
@@ -136,6 +164,52 @@ static void select_rows(abts_case *tc, apr_dbd_t* handle,
     ABTS_ASSERT(tc, "If we overseek, get_row should return -1", rv == -1);
 }
 
+static void select_batches(abts_case *tc, apr_dbd_t* handle,
+                           const apr_dbd_driver_t* driver, int count)
+{
+    apr_status_t rv;
+    apr_pool_t* pool = p;
+    const char* sql = "SELECT col1, col2, col3 FROM apr_dbd_test ORDER BY col3";
+    apr_dbd_results_t *res = NULL;
+    apr_dbd_batch_t *batch = NULL;
+    const char *const *values;
+    const apr_size_t *lengths;
+    int i, n = 0;
+
+    rv = apr_dbd_batch_create(&batch, 3, pool);
+    ABTS_ASSERT(tc, "failed to create batch", rv == APR_SUCCESS);
+
+    rv = apr_dbd_select(driver, pool, handle, &res, sql, 0);
+    ABTS_ASSERT(tc, sql, rv == APR_SUCCESS);
+    ABTS_PTR_NOTNULL(tc, res);
+    if (rv) {
+        return;
+    }
+
+    while ((rv = apr_dbd_get_batch(driver, res, batch)) == 0) {
+        int nrows = apr_dbd_batch_nrows(batch);
+
+        ABTS_ASSERT(tc, "invalid batch size", nrows > 0 && nrows <= 3);
+        ABTS_ASSERT(tc, "short batch before the end",
+                    nrows == 3 || n + nrows == count);
+
+        rv = apr_dbd_batch_column(batch, 2, &values, &lengths);
+        ABTS_ASSERT(tc, "failed to get column", rv == APR_SUCCESS);
+        for (i = 0; i < nrows; i++) {
+            const char *expected = apr_itoa(pool, n + i);
+
+            ABTS_STR_EQUAL(tc, expected, values[i]);
+            ABTS_INT_EQUAL(tc, strlen(expected), lengths[i]);
+        }
+        n += nrows;
+    }
+    ABTS_INT_EQUAL(tc, -1, rv);
+    ABTS_INT_EQUAL(tc, count, n);
+
+    rv = apr_dbd_batch_column(batch, 3, &values, &lengths);
+    ABTS_ASSERT(tc, "column out of bounds", rv == APR_EINVAL);
+}
+
 static void test_escape(abts_case *tc, apr_dbd_t *handle,
                         const apr_dbd_driver_t *driver)
 {
@@ -144,6 +218,19 @@ static void test_escape(abts_case *tc, apr_dbd_t *handle,
   ABTS_STR_EQUAL(tc, "foo''bar", escaped);
 }
 
+static void test_not_implemented(abts_case *tc, apr_dbd_t *handle,
+                                 const apr_dbd_driver_t *driver)
+{
+    apr_socket_t *sock = NULL;
+    int rv;
+
+    /* no pipelining nor polling with SQLite */
+    rv = apr_dbd_pipeline_begin(driver, p, handle);
+    ABTS_INT_EQUAL(tc, APR_ENOTIMPL, rv);
+    rv = apr_dbd_socket_get(driver, p, handle, &sock);
+    ABTS_INT_EQUAL(tc, APR_ENOTIMPL, rv);
+}
+
 static void test_dbd_generic(abts_case *tc, apr_dbd_t* handle,
                              const apr_dbd_driver_t* driver)
 {
@@ -164,7 +251,23 @@ static void test_dbd_generic(abts_case *tc, apr_dbd_t* handle,
     select_rows(tc, handle, driver, 0);
     drop_table(tc, handle, driver);
 
+    /* the same (maybe cached) queries after a schema change, and more of
+     * them than the drivers may cache
+     */
+    create_table(tc, handle, driver);
+    insert_data(tc, handle, driver, 20);
+    select_rows(tc, handle, driver, 20);
+    select_batches(tc, handle, driver, 20);
+    drop_table(tc, handle, driver);
+
+    create_table(tc, handle, driver);
+    bulk_insert(tc, handle, driver, 1000);
+    select_rows(tc, handle, driver, 1000);
+    select_batches(tc, handle, driver, 1000);
+    drop_table(tc, handle, driver);
+
     test_escape(tc, handle, driver);
+    test_not_implemented(tc, handle, driver);
 
     rv = apr_dbd_close(driver, handle);
     ABTS_ASSERT(tc, "failed to close database", rv == APR_SUCCESS);
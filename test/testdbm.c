@@ -21,6 +21,8 @@
 #include "apr_dbm.h"
 #include "apr_uuid.h"
 #include "apr_strings.h"
+#include "apr_thread_proc.h"
+#include "apr_sdbm.h"
 #include "abts.h"
 #include "testutil.h"
 
@@ -163,6 +165,453 @@ static void test_dbm_traversal(abts_case *tc, apr_dbm_t *db, dbm_table_t *table)
     }
 }
 
+static void test_dbm_fetch_multi(abts_case *tc, apr_dbm_t *db,
+                                 dbm_table_t *table)
+{
+    apr_datum_t *keys = apr_palloc(p, NUM_TABLE_ROWS * sizeof(*keys));
+    apr_datum_t *vals = apr_pcalloc(p, NUM_TABLE_ROWS * sizeof(*vals));
+    apr_status_t rv;
+    unsigned int i;
+
+    for (i = 0; i < NUM_TABLE_ROWS; i++)
+        keys[i] = table[i].key;
+
+    rv = apr_dbm_fetch_multi(db, keys, NUM_TABLE_ROWS, vals, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    for (i = 0; i < NUM_TABLE_ROWS; i++) {
+        if (!table[i].deleted) {
+            ABTS_SIZE_EQUAL(tc, table[i].val.dsize, vals[i].dsize);
+            ABTS_INT_EQUAL(tc, 0, memcmp(table[i].val.dptr, vals[i].dptr,
+                                         vals[i].dsize));
+        } else {
+            ABTS_PTR_EQUAL(tc, NULL, vals[i].dptr);
+        }
+    }
+}
+
+typedef struct {
+    abts_case *tc;
+    dbm_table_t *table;
+} dbm_iterate_t;
+
+static int dbm_iterate_cb(void *baton, apr_datum_t key, apr_datum_t val)
+{
+    dbm_iterate_t *it = baton;
+    unsigned int i;
+
+    for (i = 0; i < NUM_TABLE_ROWS; i++) {
+        if (it->table[i].key.dsize != key.dsize)
+            continue;
+        if (memcmp(it->table[i].key.dptr, key.dptr, key.dsize))
+            continue;
+        ABTS_INT_EQUAL(it->tc, 0, it->table[i].deleted);
+        ABTS_INT_EQUAL(it->tc, 0, it->table[i].visited);
+        ABTS_SIZE_EQUAL(it->tc, it->table[i].val.dsize, val.dsize);
+        ABTS_INT_EQUAL(it->tc, 0, memcmp(it->table[i].val.dptr, val.dptr,
+                                         val.dsize));
+        it->table[i].visited++;
+    }
+
+    return 1;
+}
+
+static void test_dbm_iterate(abts_case *tc, apr_dbm_t *db, dbm_table_t *table)
+{
+    dbm_iterate_t it;
+    apr_status_t rv;
+    unsigned int i;
+
+    it.tc = tc;
+    it.table = table;
+
+    rv = apr_dbm_iterate(db, dbm_iterate_cb, &it);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    for (i = 0; i < NUM_TABLE_ROWS; i++) {
+        if (table[i].deleted)
+            continue;
+        ABTS_INT_EQUAL(tc, 1, table[i].visited);
+        table[i].visited = 0;
+    }
+}
+
+#if APU_HAVE_SDBM && APR_HAS_THREADS
+#define NUM_THREADS 4
+
+typedef struct {
+    apr_sdbm_t *db;
+    dbm_table_t *table;
+    int failures;
+} sdbm_fetcher_t;
+
+static void * APR_THREAD_FUNC sdbm_fetcher(apr_thread_t *thd, void *data)
+{
+    sdbm_fetcher_t *f = data;
+    apr_sdbm_datum_t key, val;
+    unsigned int i, n;
+
+    for (n = 0; n < 10; n++) {
+        for (i = 0; i < NUM_TABLE_ROWS; i++) {
+            key.dptr = f->table[i].key.dptr;
+            key.dsize = (int)f->table[i].key.dsize;
+            if (apr_sdbm_fetch(f->db, &val, key) != APR_SUCCESS) {
+                f->failures++;
+            }
+            else if (f->table[i].deleted) {
+                f->failures += val.dptr != NULL;
+            }
+            else if ((apr_size_t)val.dsize != f->table[i].val.dsize
+                     || memcmp(val.dptr, f->table[i].val.dptr, val.dsize)) {
+                f->failures++;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/* read-only sdbm fetches are lock free, from any thread */
+static void test_sdbm_threads(abts_case *tc, const char *file,
+                              dbm_table_t *table)
+{
+    apr_sdbm_t *db;
+    apr_thread_t *threads[NUM_THREADS];
+    sdbm_fetcher_t fetchers[NUM_THREADS];
+    apr_status_t rv, retval;
+    int i;
+
+    rv = apr_sdbm_open(&db, file, APR_FOPEN_READ, APR_FPROT_OS_DEFAULT, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    if (rv != APR_SUCCESS)
+        return;
+
+    for (i = 0; i < NUM_THREADS; i++) {
+        fetchers[i].db = db;
+        fetchers[i].table = table;
+        fetchers[i].failures = 0;
+        rv = apr_thread_create(&threads[i], NULL, sdbm_fetcher,
+                               &fetchers[i], p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        apr_thread_join(&retval, threads[i]);
+        ABTS_INT_EQUAL(tc, 0, fetchers[i].failures);
+    }
+
+    apr_sdbm_close(db);
+}
+#endif
+
+#if APU_HAVE_SDBM
+#define NUM_LARGE_ROWS  150
+
+static apr_sdbm_datum_t large_value(int i, int gen)
+{
+    apr_sdbm_datum_t val;
+    int n;
+
+    val.dsize = (i % 3 == 0) ? 20000 + i : (i % 3 == 1) ? 300 : 2000 + gen;
+    val.dptr = apr_palloc(p, val.dsize);
+    for (n = 0; n < val.dsize; n++)
+        val.dptr[n] = (char)(i + gen + n);
+
+    return val;
+}
+
+static int large_rows_check(apr_sdbm_t *db, apr_sdbm_datum_t *keys,
+                            int gen)
+{
+    apr_sdbm_datum_t val, expected;
+    int i, failures = 0;
+
+    for (i = 0; i < NUM_LARGE_ROWS; i++) {
+        expected = large_value(i, (i % 2) ? 0 : gen);
+        if (apr_sdbm_fetch(db, &val, keys[i]) != APR_SUCCESS
+            || val.dsize != expected.dsize
+            || memcmp(val.dptr, expected.dptr, val.dsize))
+            failures++;
+    }
+
+    return failures;
+}
+
+/* larger pages, and the values that don't fit stored aside */
+static void test_sdbm_pagesize(abts_case *tc, void *data)
+{
+    const char *file = "data/test-sdbm-ex";
+    const char *ovfname = apr_pstrcat(p, file, APR_SDBM_OVFFEXT, NULL);
+    apr_sdbm_datum_t keys[NUM_LARGE_ROWS], val;
+    apr_finfo_t finfo;
+    apr_off_t ovfsize;
+    apr_sdbm_t *db;
+    apr_status_t rv;
+    int i;
+
+    rv = apr_sdbm_open_ex(&db, file, APR_FOPEN_WRITE | APR_FOPEN_CREATE,
+                          APR_FPROT_OS_DEFAULT, 1000, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    rv = apr_sdbm_open_ex(&db, file, APR_FOPEN_WRITE | APR_FOPEN_CREATE
+                                     | APR_FOPEN_TRUNCATE,
+                          APR_FPROT_OS_DEFAULT, 4096, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    if (rv != APR_SUCCESS)
+        return;
+
+    for (i = 0; i < NUM_LARGE_ROWS; i++) {
+        /* keys longer than the 1024 bytes pages allow too */
+        keys[i].dsize = (i == 0) ? 2000 : 16;
+        keys[i].dptr = apr_pcalloc(p, keys[i].dsize);
+        apr_snprintf(keys[i].dptr, 16, "key%d", i);
+        rv = apr_sdbm_store(db, keys[i], large_value(i, 0),
+                            APR_SDBM_INSERT);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    ABTS_INT_EQUAL(tc, 0, large_rows_check(db, keys, 0));
+
+    rv = apr_stat(&finfo, ovfname, APR_FINFO_SIZE, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ovfsize = finfo.size;
+    ABTS_ASSERT(tc, "no overflow blocks", ovfsize > 20000);
+
+    /* replaced and deleted values free their blocks for the new ones */
+    for (i = 0; i < NUM_LARGE_ROWS; i += 2) {
+        rv = apr_sdbm_store(db, keys[i], large_value(i, 1),
+                            APR_SDBM_REPLACE);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < NUM_LARGE_ROWS; i += 2) {
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_sdbm_delete(db, keys[i]));
+        rv = apr_sdbm_fetch(db, &val, keys[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_PTR_EQUAL(tc, NULL, val.dptr);
+    }
+    for (i = 0; i < NUM_LARGE_ROWS; i += 2) {
+        rv = apr_sdbm_store(db, keys[i], large_value(i, 2),
+                            APR_SDBM_INSERT);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    ABTS_INT_EQUAL(tc, 0, large_rows_check(db, keys, 2));
+
+    rv = apr_stat(&finfo, ovfname, APR_FINFO_SIZE, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_ASSERT(tc, "overflow blocks not reused",
+                finfo.size <= ovfsize + 2 * 4096);
+
+    apr_sdbm_close(db);
+
+    /* the page size is read from the database */
+    rv = apr_sdbm_open(&db, file, APR_FOPEN_READ, APR_FPROT_OS_DEFAULT, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    if (rv != APR_SUCCESS)
+        return;
+
+    ABTS_INT_EQUAL(tc, 0, large_rows_check(db, keys, 2));
+
+    apr_sdbm_close(db);
+}
+
+static int sdbm_table_check(apr_sdbm_t *db, dbm_table_t *table)
+{
+    apr_sdbm_datum_t key, val;
+    int i, failures = 0;
+
+    for (i = 0; i < NUM_TABLE_ROWS; i++) {
+        key.dptr = table[i].key.dptr;
+        key.dsize = (int)table[i].key.dsize;
+        if (apr_sdbm_fetch(db, &val, key) != APR_SUCCESS
+            || (apr_size_t)val.dsize != table[i].val.dsize
+            || memcmp(val.dptr, table[i].val.dptr, val.dsize))
+            failures++;
+    }
+
+    return failures;
+}
+
+/* cached pages, written back when unlocked */
+static void test_sdbm_cache(abts_case *tc, void *data)
+{
+    const char *file = "data/test-sdbm-cache";
+    dbm_table_t *table = generate_table();
+    apr_sdbm_datum_t key, val;
+    apr_size_t hits, misses;
+    apr_sdbm_t *db, *db2;
+    apr_status_t rv;
+    int i, n;
+
+    rv = apr_sdbm_open(&db, file, APR_FOPEN_WRITE | APR_FOPEN_CREATE
+                                  | APR_FOPEN_TRUNCATE,
+                       APR_FPROT_OS_DEFAULT, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    if (rv != APR_SUCCESS)
+        return;
+
+    ABTS_INT_EQUAL(tc, APR_EINVAL, apr_sdbm_cache_set(db, 100000));
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_sdbm_cache_set(db, 16));
+
+    for (i = 0; i < NUM_TABLE_ROWS; i++) {
+        key.dptr = table[i].key.dptr;
+        key.dsize = (int)table[i].key.dsize;
+        val.dptr = table[i].val.dptr;
+        val.dsize = (int)table[i].val.dsize;
+        rv = apr_sdbm_store(db, key, val, APR_SDBM_INSERT);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    ABTS_INT_EQUAL(tc, 0, sdbm_table_check(db, table));
+
+    /* all the pages, some of them still not written */
+    n = 0;
+    rv = apr_sdbm_firstkey(db, &key);
+    while (rv == APR_SUCCESS && key.dptr != NULL) {
+        n++;
+        rv = apr_sdbm_nextkey(db, &key);
+    }
+    ABTS_ASSERT(tc, "traversal failed",
+                rv == APR_SUCCESS || APR_STATUS_IS_EOF(rv));
+    ABTS_INT_EQUAL(tc, NUM_TABLE_ROWS, n);
+
+    /* the whole database fits */
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_sdbm_cache_set(db, 1024));
+    ABTS_INT_EQUAL(tc, 0, sdbm_table_check(db, table));
+    apr_sdbm_cache_stats(db, &hits, &misses);
+    ABTS_ASSERT(tc, "no cache hits", hits > 0);
+    ABTS_ASSERT(tc, "no cache misses", misses > 0);
+
+    rv = apr_sdbm_close(db);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* the changes reach the files when unlocked */
+    rv = apr_sdbm_open(&db, file, APR_FOPEN_WRITE | APR_FOPEN_SHARELOCK,
+                       APR_FPROT_OS_DEFAULT, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    if (rv != APR_SUCCESS)
+        return;
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_sdbm_cache_set(db, 1024));
+    ABTS_INT_EQUAL(tc, 0, sdbm_table_check(db, table));
+
+    rv = apr_sdbm_open(&db2, file, APR_FOPEN_READ | APR_FOPEN_SHARELOCK,
+                       APR_FPROT_OS_DEFAULT, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    if (rv == APR_SUCCESS) {
+        for (i = 0; i < NUM_TABLE_ROWS; i += 2) {
+            key.dptr = table[i].key.dptr;
+            key.dsize = (int)table[i].key.dsize;
+            ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_sdbm_delete(db, key));
+            table[i].deleted = 1;
+        }
+        n = 0;
+        for (i = 0; i < NUM_TABLE_ROWS; i++) {
+            key.dptr = table[i].key.dptr;
+            key.dsize = (int)table[i].key.dsize;
+            rv = apr_sdbm_fetch(db2, &val, key);
+            ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+            n += (val.dptr == NULL) != !table[i].deleted;
+        }
+        ABTS_INT_EQUAL(tc, NUM_TABLE_ROWS, n);
+        apr_sdbm_close(db2);
+    }
+
+    apr_sdbm_close(db);
+}
+#endif
+
+#define NUM_LSM_ROWS    20000
+
+static apr_datum_t lsm_value(int i, int gen)
+{
+    apr_datum_t val;
+    apr_size_t n;
+
+    val.dsize = 200 + i % 100;
+    val.dptr = apr_palloc(p, val.dsize);
+    for (n = 0; n < val.dsize; n++)
+        val.dptr[n] = (char)(i + gen + n);
+
+    return val;
+}
+
+static int lsm_rows_check(apr_dbm_t *db, apr_datum_t *keys, int gen)
+{
+    apr_datum_t val, expected;
+    int i, failures = 0;
+
+    for (i = 0; i < NUM_LSM_ROWS; i++) {
+        if (apr_dbm_fetch(db, keys[i], &val) != APR_SUCCESS) {
+            failures++;
+            continue;
+        }
+        if (i % 4 == 0) {
+            failures += (val.dptr != NULL);
+            continue;
+        }
+        expected = lsm_value(i, (i % 4 == 1) ? gen : 0);
+        if (val.dsize != expected.dsize
+            || memcmp(val.dptr, expected.dptr, val.dsize))
+            failures++;
+    }
+
+    return failures;
+}
+
+/* enough to flush the log to runs, and merge them */
+static void test_lsm(abts_case *tc, void *data)
+{
+    const char *file = "data/test-lsm-large";
+    apr_datum_t *keys, key;
+    apr_dbm_t *db;
+    apr_status_t rv;
+    int i, n;
+
+    rv = apr_dbm_open_ex(&db, "lsm", file, APR_DBM_RWTRUNC,
+                         APR_FPROT_OS_DEFAULT, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    if (rv != APR_SUCCESS)
+        return;
+
+    keys = apr_palloc(p, NUM_LSM_ROWS * sizeof(*keys));
+    for (i = 0; i < NUM_LSM_ROWS; i++) {
+        keys[i].dptr = apr_psprintf(p, "key%08d", i);
+        keys[i].dsize = strlen(keys[i].dptr);
+        rv = apr_dbm_store(db, keys[i], lsm_value(i, 0));
+        if (rv != APR_SUCCESS)
+            break;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (i = 0; i < NUM_LSM_ROWS; i += 4)
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_dbm_delete(db, keys[i]));
+    for (i = 1; i < NUM_LSM_ROWS; i += 4)
+        ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                       apr_dbm_store(db, keys[i], lsm_value(i, 1)));
+    ABTS_INT_EQUAL(tc, 0, lsm_rows_check(db, keys, 1));
+
+    apr_dbm_close(db);
+
+    rv = apr_dbm_open_ex(&db, "lsm", file, APR_DBM_READONLY,
+                         APR_FPROT_OS_DEFAULT, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    if (rv != APR_SUCCESS)
+        return;
+
+    ABTS_INT_EQUAL(tc, 0, lsm_rows_check(db, keys, 1));
+
+    /* in key order, the deleted ones skipped */
+    n = 0;
+    rv = apr_dbm_firstkey(db, &key);
+    while (rv == APR_SUCCESS && key.dptr != NULL) {
+        i = n / 3 * 4 + n % 3 + 1;
+        if (i >= NUM_LSM_ROWS || key.dsize != keys[i].dsize
+            || memcmp(key.dptr, keys[i].dptr, key.dsize))
+            break;
+        n++;
+        rv = apr_dbm_nextkey(db, &key);
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, NUM_LSM_ROWS / 4 * 3, n);
+
+    apr_dbm_close(db);
+}
+
 static void test_dbm(abts_case *tc, void *data)
 {
     apr_dbm_t *db;
@@ -196,14 +645,23 @@ static void test_dbm(abts_case *tc, void *data)
     test_dbm_exists(tc, db, table);
     test_dbm_traversal(tc, db, table);
     test_dbm_fetch(tc, db, table);
+    test_dbm_fetch_multi(tc, db, table);
+    test_dbm_iterate(tc, db, table);
 
     apr_dbm_close(db);
+
+#if APU_HAVE_SDBM && APR_HAS_THREADS
+    if (!strcmp(type, "sdbm"))
+        test_sdbm_threads(tc, file, table);
+#endif
 }
 
 abts_suite *testdbm(abts_suite *suite)
 {
     suite = ADD_SUITE(suite);
 
+    abts_run_test(suite, test_dbm, "lsm");
+    abts_run_test(suite, test_lsm, NULL);
 #if APU_HAVE_GDBM
     abts_run_test(suite, test_dbm, "gdbm");
 #endif
@@ -212,6 +670,8 @@ abts_suite *testdbm(abts_suite *suite)
 #endif
 #if APU_HAVE_SDBM
     abts_run_test(suite, test_dbm, "sdbm");
+    abts_run_test(suite, test_sdbm_pagesize, NULL);
+    abts_run_test(suite, test_sdbm_cache, NULL);
 #endif
 #if APU_HAVE_DB
     abts_run_test(suite, test_dbm, "db");
@@ -22,7 +22,10 @@
 #include "apr_errno.h"
 #include "apr_general.h"
 #include "apr_lib.h"
+#include "apr_strings.h"
 #include "apr_thread_proc.h"
+#include "apr_thread_pool.h"
+#include "apr_dir_walk.h"
 #include "testutil.h"
 
 static void test_mkdir(abts_case *tc, void *data)
@@ -443,6 +446,185 @@ static void test_readmore_info(abts_case* tc, void* data)
     ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
 }
 
+static void test_read_batch(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_dir_t *dir;
+    apr_file_t *thefile;
+    apr_finfo_t finfo[4], sfinfo;
+    apr_size_t n, i;
+    int j, files = 0, sizes = 0, same = 0;
+    apr_int32_t wanted = APR_FINFO_TYPE | APR_FINFO_SIZE | APR_FINFO_IDENT;
+
+    rv = apr_dir_make("dir3", APR_FPROT_OS_DEFAULT, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* dir3/fileN holds N bytes */
+    for (j = 0; j < 10; j++) {
+        rv = apr_file_open(&thefile, apr_psprintf(p, "dir3/file%d", j),
+                           APR_FOPEN_WRITE | APR_FOPEN_CREATE,
+                           APR_FPROT_OS_DEFAULT, p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        rv = apr_file_write_full(thefile, "0123456789", j, NULL);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        apr_file_close(thefile);
+    }
+    rv = apr_stat(&sfinfo, "dir3/file5", APR_FINFO_IDENT, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_dir_open(&dir, "dir3", p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    while ((rv = apr_dir_read_batch(finfo, 4, &n, wanted, dir))
+           == APR_SUCCESS || rv == APR_INCOMPLETE) {
+        ABTS_TRUE(tc, n > 0 && n <= 4);
+        for (i = 0; i < n; i++) {
+            ABTS_TRUE(tc, finfo[i].valid & APR_FINFO_NAME);
+            if (strncmp(finfo[i].name, "file", 4) != 0) {
+                continue;
+            }
+            ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+            ABTS_INT_EQUAL(tc, APR_REG, finfo[i].filetype);
+            ABTS_INT_EQUAL(tc, atoi(finfo[i].name + 4), (int)finfo[i].size);
+            if (strcmp(finfo[i].name, "file5") == 0) {
+                same = finfo[i].inode == sfinfo.inode
+                       && finfo[i].device == sfinfo.device;
+            }
+            sizes += (int)finfo[i].size;
+            files++;
+        }
+    }
+    ABTS_TRUE(tc, APR_STATUS_IS_ENOENT(rv));
+    ABTS_INT_EQUAL(tc, 0, (int)n);
+    ABTS_INT_EQUAL(tc, 10, files);
+    ABTS_INT_EQUAL(tc, 45, sizes);
+    ABTS_TRUE(tc, same);
+
+    apr_dir_close(dir);
+
+    for (j = 0; j < 10; j++) {
+        rv = apr_file_remove(apr_psprintf(p, "dir3/file%d", j), p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    rv = apr_dir_remove("dir3", p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+typedef struct walk_count_t {
+    int files;
+    int dirs;
+    int calls;
+    int stop_after;
+    const char *first;
+    const char *last;
+    apr_pool_t *pool;
+} walk_count_t;
+
+static apr_status_t walk_count(void *baton, const char *path,
+                               const apr_finfo_t *finfo, apr_pool_t *pool)
+{
+    walk_count_t *count = baton;
+
+    if (finfo->filetype == APR_DIR) {
+        count->dirs++;
+    }
+    else {
+        count->files++;
+    }
+    if (!count->first) {
+        count->first = apr_pstrdup(count->pool, path);
+    }
+    count->last = apr_pstrdup(count->pool, path);
+    if (++count->calls == count->stop_after) {
+        return APR_EGENERAL;
+    }
+    return APR_SUCCESS;
+}
+
+static void test_walk(abts_case *tc, void *data)
+{
+    static const char *const dirs[] = {
+        "dir4", "dir4/a", "dir4/a/b", "dir4/c"
+    };
+    walk_count_t count;
+    apr_file_t *thefile;
+    apr_status_t rv;
+    int i, j;
+#if APR_HAS_THREADS
+    apr_thread_pool_t *tp;
+#endif
+
+    /* 4 directories of 3 files */
+    for (i = 0; i < 4; i++) {
+        rv = apr_dir_make(dirs[i], APR_FPROT_OS_DEFAULT, p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        for (j = 0; j < 3; j++) {
+            rv = apr_file_open(&thefile,
+                               apr_psprintf(p, "%s/file%d", dirs[i], j),
+                               APR_FOPEN_WRITE | APR_FOPEN_CREATE,
+                               APR_FPROT_OS_DEFAULT, p);
+            ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+            apr_file_close(thefile);
+        }
+    }
+
+    memset(&count, 0, sizeof(count));
+    count.pool = p;
+    rv = apr_dir_walk("dir4", APR_FINFO_SIZE, 0, walk_count, &count, NULL, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 4, count.dirs);
+    ABTS_INT_EQUAL(tc, 12, count.files);
+    ABTS_STR_EQUAL(tc, "dir4", count.first);
+
+    memset(&count, 0, sizeof(count));
+    count.pool = p;
+    rv = apr_dir_walk("dir4", 0, APR_DIR_WALK_POSTORDER, walk_count, &count,
+                      NULL, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 16, count.calls);
+    ABTS_STR_EQUAL(tc, "dir4", count.last);
+
+    /* Stopped by the callback */
+    memset(&count, 0, sizeof(count));
+    count.pool = p;
+    count.stop_after = 3;
+    rv = apr_dir_walk("dir4", 0, 0, walk_count, &count, NULL, p);
+    ABTS_INT_EQUAL(tc, APR_EGENERAL, rv);
+    ABTS_INT_EQUAL(tc, 3, count.calls);
+
+    /* Not a directory */
+    memset(&count, 0, sizeof(count));
+    count.pool = p;
+    rv = apr_dir_walk("dir4/file0", 0, 0, walk_count, &count, NULL, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, count.files);
+
+#if APR_HAS_THREADS
+    rv = apr_thread_pool_create(&tp, 0, 4, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    memset(&count, 0, sizeof(count));
+    count.pool = p;
+    rv = apr_dir_walk("dir4", 0, APR_DIR_WALK_SERIAL | APR_DIR_WALK_POSTORDER,
+                      walk_count, &count, tp, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 4, count.dirs);
+    ABTS_INT_EQUAL(tc, 12, count.files);
+    ABTS_STR_EQUAL(tc, "dir4", count.last);
+
+    apr_thread_pool_destroy(tp);
+#endif
+
+    for (i = 3; i >= 0; i--) {
+        for (j = 0; j < 3; j++) {
+            rv = apr_file_remove(apr_psprintf(p, "%s/file%d", dirs[i], j), p);
+            ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        }
+        rv = apr_dir_remove(dirs[i], p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+}
+
 abts_suite *testdir(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -464,6 +646,8 @@ abts_suite *testdir(abts_suite *suite)
     abts_run_test(suite, test_closedir, NULL);
     abts_run_test(suite, test_uncleared_errno, NULL);
     abts_run_test(suite, test_readmore_info, NULL);
+    abts_run_test(suite, test_read_batch, NULL);
+    abts_run_test(suite, test_walk, NULL);
 
     return suite;
 }
@@ -133,6 +133,31 @@ static void test_unload_module(abts_case *tc, void *data)
     ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_ESYMNOTFOUND(status));
 }
 
+static void test_load_module_ex(abts_case *tc, void *data)
+{
+    apr_dso_handle_t *h = NULL;
+    apr_dso_handle_sym_t func1 = NULL;
+    apr_status_t status;
+    int (*function)(int);
+    char errstr[256];
+
+    status = apr_dso_load_ex(&h, modname, APR_DSO_LAZY | APR_DSO_LOCAL, p);
+    ABTS_ASSERT(tc, apr_dso_error(h, errstr, 256), APR_SUCCESS == status);
+    ABTS_PTR_NOTNULL(tc, h);
+
+    status = apr_dso_sym(&func1, h, "count_reps");
+    ABTS_ASSERT(tc, apr_dso_error(h, errstr, 256), APR_SUCCESS == status);
+    ABTS_PTR_NOTNULL(tc, func1);
+
+    if (!tc->failed) {
+        function = (int (*)(int))func1;
+        status = (*function)(3);
+        ABTS_INT_EQUAL(tc, 3, status);
+    }
+
+    apr_dso_unload(h);
+}
+
 
 #ifdef LIB_NAME
 static char *libname;
@@ -245,6 +270,7 @@ abts_suite *testdso(abts_suite *suite)
     abts_run_test(suite, test_dso_sym, NULL);
     abts_run_test(suite, test_dso_sym_return_value, NULL);
     abts_run_test(suite, test_unload_module, NULL);
+    abts_run_test(suite, test_load_module_ex, NULL);
 
 #ifdef LIB_NAME
     apr_filepath_merge(&libname, NULL, LIB_NAME, 0, p);
@@ -1101,6 +1101,298 @@ static void test_decode_errors(abts_case * tc, void *data)
     ABTS_SIZE_EQUAL(tc, 2, len);
 }
 
+/* Long enough for the vectorized blocks, checked against the tables */
+#define LONG_SIZE 300
+
+static void ref_base64(char *dest, const unsigned char *src, apr_size_t n,
+                       const char *alphabet)
+{
+    apr_size_t i;
+
+    for (i = 0; i < n; i += 3) {
+        apr_uint32_t v = (apr_uint32_t)src[i] << 16;
+
+        if (i + 1 < n) {
+            v |= (apr_uint32_t)src[i + 1] << 8;
+        }
+        if (i + 2 < n) {
+            v |= src[i + 2];
+        }
+        *dest++ = alphabet[(v >> 18) & 0x3f];
+        *dest++ = alphabet[(v >> 12) & 0x3f];
+        *dest++ = (i + 1 < n) ? alphabet[(v >> 6) & 0x3f] : '=';
+        *dest++ = (i + 2 < n) ? alphabet[v & 0x3f] : '=';
+    }
+    *dest = '\0';
+}
+
+static void test_long_base64(abts_case * tc, void *data)
+{
+    static const char std[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    static const char url[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+    unsigned char src[LONG_SIZE + 16], udest[LONG_SIZE + 16];
+    char expect[LONG_SIZE * 2], dest[LONG_SIZE * 2];
+    apr_size_t n, off, len, elen;
+    apr_status_t rv;
+
+    for (n = 0; n < sizeof(src); n++) {
+        src[n] = (unsigned char)(n * 151 + 7);
+    }
+
+    for (n = 0; n <= LONG_SIZE; n += (n < 100) ? 1 : 7) {
+        for (off = 0; off < 16; off += 5) {
+            ref_base64(expect, src + off, n, std);
+            elen = strlen(expect);
+
+            rv = apr_encode_base64_binary(dest, src + off, n, 0, &len);
+            ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+            ABTS_SIZE_EQUAL(tc, elen, len);
+            ABTS_STR_EQUAL(tc, expect, dest);
+
+            rv = apr_decode_base64_binary(NULL, expect, elen, 0, &len);
+            ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+            ABTS_ASSERT(tc, "decoded length", len >= n);
+            rv = apr_decode_base64_binary(udest, expect, elen, 0, &len);
+            ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+            ABTS_SIZE_EQUAL(tc, n, len);
+            ABTS_ASSERT(tc, "base64 round trip",
+                        memcmp(udest, src + off, n) == 0);
+
+            ref_base64(expect, src + off, n, url);
+            rv = apr_encode_base64_binary(dest, src + off, n,
+                                          APR_ENCODE_URL, &len);
+            ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+            ABTS_STR_EQUAL(tc, expect, dest);
+            rv = apr_decode_base64_binary(udest, expect, elen, 0, &len);
+            ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+            ABTS_SIZE_EQUAL(tc, n, len);
+            ABTS_ASSERT(tc, "base64url round trip",
+                        memcmp(udest, src + off, n) == 0);
+        }
+    }
+
+    /* a bad character anywhere stops the decoding there */
+    ref_base64(expect, src, LONG_SIZE, std);
+    elen = strlen(expect);
+    for (off = 0; off < elen - 4; off += 3) {
+        apr_size_t want = off / 4 * 3 + (off % 4 ? off % 4 - 1 : 0);
+        char c = expect[off];
+
+        expect[off] = '*';
+        rv = apr_decode_base64(dest, expect, elen, 0, &len);
+        ABTS_INT_EQUAL(tc, off % 4 == 1 ? APR_EINCOMPLETE : APR_BADCH, rv);
+        rv = apr_decode_base64_binary(udest, expect, elen,
+                                      APR_ENCODE_RELAXED, &len);
+        ABTS_INT_EQUAL(tc, off % 4 == 1 ? APR_EINCOMPLETE : APR_SUCCESS, rv);
+        ABTS_SIZE_EQUAL(tc, want, len);
+        ABTS_ASSERT(tc, "decoded up to the bad character",
+                    memcmp(udest, src, want) == 0);
+        rv = apr_decode_base64_binary(NULL, expect, elen,
+                                      APR_ENCODE_RELAXED, &len);
+        ABTS_SIZE_EQUAL(tc, want, len);
+        expect[off] = c;
+    }
+}
+
+static void test_long_base16(abts_case * tc, void *data)
+{
+    static const char upper[] = "0123456789ABCDEF";
+    static const char lower[] = "0123456789abcdef";
+    unsigned char src[LONG_SIZE + 16], udest[LONG_SIZE + 16];
+    char expect[LONG_SIZE * 3], dest[LONG_SIZE * 3];
+    apr_size_t n, off, i, len;
+    apr_status_t rv;
+
+    for (n = 0; n < sizeof(src); n++) {
+        src[n] = (unsigned char)(n * 151 + 7);
+    }
+
+    for (n = 0; n <= LONG_SIZE; n += (n < 100) ? 1 : 7) {
+        for (off = 0; off < 16; off += 5) {
+            for (i = 0; i < n; i++) {
+                expect[i * 2] = lower[src[off + i] >> 4];
+                expect[i * 2 + 1] = lower[src[off + i] & 0xf];
+            }
+            expect[n * 2] = '\0';
+
+            rv = apr_encode_base16_binary(dest, src + off, n,
+                                          APR_ENCODE_LOWER, &len);
+            ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+            ABTS_SIZE_EQUAL(tc, n * 2, len);
+            ABTS_STR_EQUAL(tc, expect, dest);
+
+            rv = apr_decode_base16_binary(udest, expect, n * 2, 0, &len);
+            ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+            ABTS_SIZE_EQUAL(tc, n, len);
+            ABTS_ASSERT(tc, "base16 round trip",
+                        memcmp(udest, src + off, n) == 0);
+
+            for (i = 0; i < n * 2; i++) {
+                expect[i] = upper[(expect[i] <= '9') ? expect[i] - '0'
+                                                      : expect[i] - 'a' + 10];
+            }
+            rv = apr_encode_base16_binary(dest, src + off, n, 0, &len);
+            ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+            ABTS_STR_EQUAL(tc, expect, dest);
+            rv = apr_decode_base16_binary(udest, expect, n * 2, 0, &len);
+            ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+            ABTS_ASSERT(tc, "BASE16 round trip",
+                        memcmp(udest, src + off, n) == 0);
+        }
+    }
+
+    /* a bad character anywhere stops the decoding there */
+    for (i = 0; i < LONG_SIZE; i++) {
+        expect[i * 2] = upper[src[i] >> 4];
+        expect[i * 2 + 1] = upper[src[i] & 0xf];
+    }
+    for (off = 0; off < LONG_SIZE * 2; off += 5) {
+        char c = expect[off];
+
+        expect[off] = 'g';
+        rv = apr_decode_base16_binary(udest, expect, LONG_SIZE * 2, 0, &len);
+        ABTS_INT_EQUAL(tc, off % 2 ? APR_EINCOMPLETE : APR_BADCH, rv);
+        rv = apr_decode_base16_binary(udest, expect, LONG_SIZE * 2,
+                                      APR_ENCODE_RELAXED, &len);
+        ABTS_INT_EQUAL(tc, off % 2 ? APR_EINCOMPLETE : APR_SUCCESS, rv);
+        ABTS_SIZE_EQUAL(tc, off / 2, len);
+        ABTS_ASSERT(tc, "decoded up to the bad character",
+                    memcmp(udest, src, off / 2) == 0);
+        expect[off] = c;
+    }
+}
+
+static apr_status_t whole(apr_encode_codec_e codec, int decode, char *dest,
+                          const char *src, apr_size_t slen, int flags,
+                          apr_size_t *len)
+{
+    const unsigned char *usrc = (const unsigned char *)src;
+    unsigned char *udest = (unsigned char *)dest;
+
+    switch (codec) {
+    case APR_ENCODE_CODEC_BASE64:
+        return decode ? apr_decode_base64_binary(udest, src, slen, flags, len)
+                      : apr_encode_base64_binary(dest, usrc, slen, flags, len);
+    case APR_ENCODE_CODEC_BASE32:
+        return decode ? apr_decode_base32_binary(udest, src, slen, flags, len)
+                      : apr_encode_base32_binary(dest, usrc, slen, flags, len);
+    default:
+        return decode ? apr_decode_base16_binary(udest, src, slen, flags, len)
+                      : apr_encode_base16_binary(dest, usrc, slen, flags, len);
+    }
+}
+
+/* The stream fed by chunks gives what the source gives at once */
+static void check_stream(abts_case *tc, apr_encode_codec_e codec,
+                         int decode, int flags, const char *src,
+                         apr_size_t slen, apr_size_t chunk)
+{
+    char expect[512], dest[512];
+    apr_encode_stream_t st;
+    apr_size_t elen, len, max, off, out = 0;
+    apr_status_t erv, rv = APR_SUCCESS;
+
+    erv = whole(codec, decode, expect, src, slen, flags, &elen);
+
+    if (decode) {
+        ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                       apr_decode_stream_init(&st, codec, flags));
+    }
+    else {
+        ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                       apr_encode_stream_init(&st, codec, flags));
+    }
+    for (off = 0; off < slen && rv == APR_SUCCESS; off += chunk) {
+        apr_size_t n = (slen - off < chunk) ? slen - off : chunk;
+
+        apr_encode_stream(&st, NULL, src + off, n, &max);
+        rv = apr_encode_stream(&st, dest + out, src + off, n, &len);
+        ABTS_ASSERT(tc, "no more than the maximum", len <= max);
+        out += len;
+    }
+    if (rv == APR_SUCCESS) {
+        apr_encode_stream_final(&st, NULL, &max);
+        rv = apr_encode_stream_final(&st, dest + out, &len);
+        ABTS_ASSERT(tc, "no more than the maximum", len <= max);
+        out += len;
+    }
+
+    ABTS_INT_EQUAL(tc, erv, rv);
+    ABTS_SIZE_EQUAL(tc, elen, out);
+    ABTS_ASSERT(tc, "same result", memcmp(expect, dest, out) == 0);
+}
+
+static void test_encode_stream(abts_case * tc, void *data)
+{
+    static const int flags[] = {
+        APR_ENCODE_NONE, APR_ENCODE_NOPADDING, APR_ENCODE_BASE64URL,
+        APR_ENCODE_BASE32HEX, APR_ENCODE_COLON,
+        APR_ENCODE_COLON | APR_ENCODE_LOWER
+    };
+    char src[100];
+    apr_size_t i, slen, chunk;
+    int codec;
+
+    for (i = 0; i < sizeof(src); i++) {
+        src[i] = (char)(i * 151 + 7);
+    }
+
+    for (codec = APR_ENCODE_CODEC_BASE64; codec <= APR_ENCODE_CODEC_BASE16;
+         codec++) {
+        for (i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
+            for (slen = 0; slen <= sizeof(src); slen += 11) {
+                for (chunk = 1; chunk <= 17; chunk++) {
+                    check_stream(tc, codec, 0, flags[i], src, slen, chunk);
+                }
+            }
+        }
+    }
+}
+
+static void test_decode_stream(abts_case * tc, void *data)
+{
+    static const struct {
+        apr_encode_codec_e codec;
+        const char *src;
+    } srcs[] = {
+        { APR_ENCODE_CODEC_BASE64, "Zm9vYmFyZm9vYmFyZm9vYmFy" },
+        { APR_ENCODE_CODEC_BASE64, "Zm9vYmFyZm9vYg==" },
+        { APR_ENCODE_CODEC_BASE64, "Zm9vYmFyZm9vYg" },
+        { APR_ENCODE_CODEC_BASE64, "Zm9vYmFyZm9vYmE=" },
+        { APR_ENCODE_CODEC_BASE64, "Zm9vYmFyZm9vY" },
+        { APR_ENCODE_CODEC_BASE64, "Zm9v-_Fy" },
+        { APR_ENCODE_CODEC_BASE64, "Zm9vYg==Zm9v" },
+        { APR_ENCODE_CODEC_BASE64, "Zm9vYmFy*m9vYmFy" },
+        { APR_ENCODE_CODEC_BASE64, "Zm9vYmFyZ*9vYmFy" },
+        { APR_ENCODE_CODEC_BASE32, "MZXW6YTBOJTG633CMFZA====" },
+        { APR_ENCODE_CODEC_BASE32, "MZXW6YTBOJTG633CMFZA" },
+        { APR_ENCODE_CODEC_BASE32, "MZXW6YQ=MZXW6YTB" },
+        { APR_ENCODE_CODEC_BASE32, "MZXW6YTB*JTG633C" },
+        { APR_ENCODE_CODEC_BASE16, "666f6F626172666F6f626172" },
+        { APR_ENCODE_CODEC_BASE16, "666f6F62617" },
+        { APR_ENCODE_CODEC_BASE16, "66:6f:6F:62:61:72" },
+        { APR_ENCODE_CODEC_BASE16, "66:6f:6F:62:61:" },
+        { APR_ENCODE_CODEC_BASE16, "66:6f:6F*62:61:72" },
+        { APR_ENCODE_CODEC_BASE16, "66:6f:6*F62:61:72" }
+    };
+    static const int flags[] = {
+        APR_ENCODE_NONE, APR_ENCODE_RELAXED, APR_ENCODE_COLON,
+        APR_ENCODE_COLON | APR_ENCODE_RELAXED
+    };
+    apr_size_t i, j, chunk;
+
+    for (i = 0; i < sizeof(srcs) / sizeof(srcs[0]); i++) {
+        for (j = 0; j < sizeof(flags) / sizeof(flags[0]); j++) {
+            for (chunk = 1; chunk <= 25; chunk++) {
+                check_stream(tc, srcs[i].codec, 1, flags[j], srcs[i].src,
+                             strlen(srcs[i].src), chunk);
+            }
+        }
+    }
+}
+
 abts_suite *testencode(abts_suite * suite)
 {
     suite = ADD_SUITE(suite);
@@ -1119,6 +1411,10 @@ abts_suite *testencode(abts_suite * suite)
     abts_run_test(suite, test_decode_base16_binary, NULL);
     abts_run_test(suite, test_encode_errors, NULL);
     abts_run_test(suite, test_decode_errors, NULL);
+    abts_run_test(suite, test_long_base64, NULL);
+    abts_run_test(suite, test_long_base16, NULL);
+    abts_run_test(suite, test_encode_stream, NULL);
+    abts_run_test(suite, test_decode_stream, NULL);
 
     return suite;
 }
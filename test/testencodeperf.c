@@ -0,0 +1,155 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures the throughput of the base64, base64url and base16 encoders
+ * and decoders of apr_encode, over binary data of a few sizes.
+ */
+
+#include "apr_encode.h"
+#include "apr_pools.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_strings.h"
+#include "apr_time.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Bytes converted per run, whatever the size of the buffers */
+#define DEFAULT_MAX_BYTES (256L * 1024 * 1024)
+
+static long max_bytes = DEFAULT_MAX_BYTES;
+static int verbose = 0;
+
+typedef apr_status_t (*encode_fn)(char *dest, const unsigned char *src,
+                                  apr_ssize_t slen, int flags,
+                                  apr_size_t *len);
+typedef apr_status_t (*decode_fn)(unsigned char *dest, const char *src,
+                                  apr_ssize_t slen, int flags,
+                                  apr_size_t *len);
+
+static void report(const char *name, apr_size_t size,
+                   apr_interval_time_t usecs)
+{
+    printf("    %-28s %8" APR_SIZE_T_FMT " bytes: %8" APR_TIME_T_FMT
+           " usec, %8.2f MB/s\n", name, size, usecs,
+           usecs ? (double)max_bytes / usecs : 0.0);
+}
+
+static void bench(apr_pool_t *pool, const char *name, encode_fn encode,
+                  decode_fn decode, int flags, apr_size_t size)
+{
+    unsigned char *src, *back;
+    char *text, label[64];
+    apr_size_t len, tlen, i;
+    long n, runs = max_bytes / (long)size;
+    apr_time_t start;
+
+    if (runs < 1) {
+        runs = 1;
+    }
+
+    src = apr_palloc(pool, size);
+    for (i = 0; i < size; i++) {
+        src[i] = (unsigned char)(i * 151 + 7);
+    }
+    encode(NULL, src, size, flags, &len);
+    text = apr_palloc(pool, len);
+    back = apr_palloc(pool, size + 1);
+
+    start = apr_time_now();
+    for (n = 0; n < runs; n++) {
+        encode(text, src, size, flags, &tlen);
+    }
+    apr_snprintf(label, sizeof(label), "encode %s", name);
+    report(label, size, apr_time_now() - start);
+
+    start = apr_time_now();
+    for (n = 0; n < runs; n++) {
+        decode(back, text, tlen, flags, &len);
+    }
+    apr_snprintf(label, sizeof(label), "decode %s", name);
+    report(label, size, apr_time_now() - start);
+
+    if (len != size || memcmp(back, src, size)) {
+        fprintf(stderr, "%s: round trip failed at %" APR_SIZE_T_FMT
+                " bytes\n", name, size);
+        exit(-1);
+    }
+}
+
+int main(int argc, const char * const *argv)
+{
+    static const apr_size_t sizes[] = { 16, 256, 4096, 1024 * 1024 };
+    apr_pool_t *pool, *sub;
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    int i;
+
+    printf("APR Encoding Performance Test\n==============\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "c:v", &optchar, &optarg)) == APR_SUCCESS) {
+        if (optchar == 'c') {
+            max_bytes = atol(optarg);
+        }
+        else if (optchar == 'v') {
+            verbose = 1;
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    if (apr_pool_create(&sub, pool) != APR_SUCCESS)
+        exit(-1);
+
+    if (verbose) {
+        printf("%ld bytes converted per run\n\n", max_bytes);
+    }
+
+    for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        bench(sub, "base64", apr_encode_base64_binary,
+              apr_decode_base64_binary, 0, sizes[i]);
+        bench(sub, "base64url", apr_encode_base64_binary,
+              apr_decode_base64_binary, APR_ENCODE_BASE64URL, sizes[i]);
+        bench(sub, "base16", apr_encode_base16_binary,
+              apr_decode_base16_binary, 0, sizes[i]);
+
+        apr_pool_clear(sub);
+    }
+
+    return 0;
+}
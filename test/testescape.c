@@ -301,11 +301,133 @@ static void test_escape(abts_case *tc, void *data)
     apr_pool_destroy(pool);
 }
 
+/* The escapers of the long strings, their runs of characters copied as is
+ * skipped at once (by vectors), against the same escaping one character
+ * at a time.
+ */
+typedef apr_status_t (*escape_fn)(char *escaped, const char *str,
+                                  apr_ssize_t slen, int arg, apr_size_t *len);
+
+static apr_status_t escape_shell(char *escaped, const char *str,
+                                 apr_ssize_t slen, int arg, apr_size_t *len)
+{
+    return apr_escape_shell(escaped, str, slen, len);
+}
+
+static apr_status_t escape_path_segment(char *escaped, const char *str,
+                                        apr_ssize_t slen, int arg,
+                                        apr_size_t *len)
+{
+    return apr_escape_path_segment(escaped, str, slen, len);
+}
+
+static apr_status_t escape_urlencoded(char *escaped, const char *str,
+                                      apr_ssize_t slen, int arg,
+                                      apr_size_t *len)
+{
+    return apr_escape_urlencoded(escaped, str, slen, len);
+}
+
+static apr_status_t escape_ldap(char *escaped, const char *str,
+                                apr_ssize_t slen, int arg, apr_size_t *len)
+{
+    return apr_escape_ldap(escaped, str, slen, arg, len);
+}
+
+static void check_escape_runs(abts_case *tc, apr_pool_t *pool,
+                              const char *what, escape_fn escape, int arg,
+                              const char *src)
+{
+    apr_size_t slen = strlen(src), len, clen;
+    apr_status_t rv, expect = APR_NOTFOUND;
+    char *dest, *chars, *d;
+    apr_size_t i;
+
+    /* one character at a time */
+    chars = d = apr_palloc(pool, slen * 8 + 1);
+    for (i = 0; i < slen; i++) {
+        if (escape(d, src + i, 1, arg, &clen) == APR_SUCCESS) {
+            expect = APR_SUCCESS;
+        }
+        d += clen - 1;
+    }
+    *d = '\0';
+
+    rv = escape(NULL, src, APR_ESCAPE_STRING, arg, &len);
+    ABTS_INT_EQUAL(tc, expect, rv);
+    ABTS_ASSERT(tc, apr_psprintf(pool, "%s: size mismatch (%" APR_SIZE_T_FMT
+                                 "!=%" APR_SIZE_T_FMT ")", what, len,
+                                 strlen(chars) + 1),
+                len == strlen(chars) + 1);
+
+    dest = apr_palloc(pool, len);
+    rv = escape(dest, src, APR_ESCAPE_STRING, arg, NULL);
+    ABTS_INT_EQUAL(tc, expect, rv);
+    ABTS_ASSERT(tc, apr_psprintf(pool, "%s: escaped (%s) does not match "
+                                 "expected output (%s)", what, dest, chars),
+                strcmp(dest, chars) == 0);
+
+    /* the same given the length */
+    rv = escape(dest, src, slen, arg, &len);
+    ABTS_INT_EQUAL(tc, expect, rv);
+    ABTS_ASSERT(tc, apr_psprintf(pool, "%s: escaped (%s) does not match "
+                                 "expected output (%s)", what, dest, chars),
+                strcmp(dest, chars) == 0);
+}
+
+static void test_escape_runs(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    char src[300];
+    unsigned c;
+    apr_size_t i, off;
+
+    apr_pool_create(&pool, NULL);
+
+    /* every character at every offset in a run of 16, and a clean string */
+    for (c = 0; c < 256; c++) {
+        for (i = 0; i < sizeof(src) - 1; i++) {
+            src[i] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"[i % 52];
+        }
+        src[sizeof(src) - 1] = '\0';
+        if (c) {
+            for (off = c % 17; off < sizeof(src) - 1; off += 37) {
+                src[off] = (char)c;
+            }
+        }
+
+        check_escape_runs(tc, pool, "shell", escape_shell, 0, src);
+        check_escape_runs(tc, pool, "path segment", escape_path_segment, 0,
+                          src);
+        check_escape_runs(tc, pool, "path", apr_escape_path, 1,
+                          src);
+        check_escape_runs(tc, pool, "urlencoded", escape_urlencoded, 0, src);
+        check_escape_runs(tc, pool, "entity", apr_escape_entity, 0,
+                          src);
+        check_escape_runs(tc, pool, "entity toasc",
+                          apr_escape_entity, 1, src);
+        check_escape_runs(tc, pool, "echo", apr_escape_echo, 0,
+                          src);
+        check_escape_runs(tc, pool, "echo quote", apr_escape_echo,
+                          1, src);
+        check_escape_runs(tc, pool, "ldap dn", escape_ldap,
+                          APR_ESCAPE_LDAP_DN, src);
+        check_escape_runs(tc, pool, "ldap filter", escape_ldap,
+                          APR_ESCAPE_LDAP_FILTER, src);
+        check_escape_runs(tc, pool, "ldap all", escape_ldap,
+                          APR_ESCAPE_LDAP_ALL, src);
+        apr_pool_clear(pool);
+    }
+
+    apr_pool_destroy(pool);
+}
+
 abts_suite *testescape(abts_suite *suite)
 {
     suite = ADD_SUITE(suite);
 
     abts_run_test(suite, test_escape, NULL);
+    abts_run_test(suite, test_escape_runs, NULL);
 
     return suite;
 }
@@ -375,6 +375,63 @@ static void test_buffer_set_get(abts_case *tc, void *data)
 
     apr_file_close(filetest);
 }
+static void test_buffer_default(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_size_t bufsize, maxsize, n;
+    apr_file_t *f = NULL;
+    char buf[1000];
+    int i;
+
+    apr_file_buffer_default_set(8192, 65536);
+    apr_file_buffer_default_get(&bufsize, &maxsize);
+    ABTS_SIZE_EQUAL(tc, 8192, bufsize);
+    ABTS_SIZE_EQUAL(tc, 65536, maxsize);
+
+    rv = apr_file_open(&f, "data/testbufdefault.dat",
+                       APR_FOPEN_WRITE | APR_FOPEN_CREATE | APR_FOPEN_TRUNCATE
+                       | APR_FOPEN_BUFFERED, APR_FPROT_OS_DEFAULT, p);
+    APR_ASSERT_SUCCESS(tc, "open for writing", rv);
+    ABTS_SIZE_EQUAL(tc, 8192, apr_file_buffer_size_get(f));
+    for (i = 0; i < 200; i++) {
+        memset(buf, 'a' + i % 26, sizeof(buf));
+        rv = apr_file_write_full(f, buf, sizeof(buf), NULL);
+        APR_ASSERT_SUCCESS(tc, "write", rv);
+    }
+#if !defined(WIN32) && !defined(OS2)
+    ABTS_SIZE_EQUAL(tc, 65536, apr_file_buffer_size_get(f));
+#endif
+    apr_file_close(f);
+
+    rv = apr_file_open(&f, "data/testbufdefault.dat",
+                       APR_FOPEN_READ | APR_FOPEN_BUFFERED,
+                       APR_FPROT_OS_DEFAULT, p);
+    APR_ASSERT_SUCCESS(tc, "open for reading", rv);
+    for (i = 0; i < 200; i++) {
+        rv = apr_file_read_full(f, buf, sizeof(buf), &n);
+        APR_ASSERT_SUCCESS(tc, "read", rv);
+        ABTS_ASSERT(tc, "contents", buf[0] == 'a' + i % 26
+                                    && buf[sizeof(buf) - 1] == 'a' + i % 26);
+    }
+    rv = apr_file_read_full(f, buf, sizeof(buf), &n);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_EOF(rv));
+#if !defined(WIN32) && !defined(OS2)
+    ABTS_SIZE_EQUAL(tc, 65536, apr_file_buffer_size_get(f));
+#endif
+    apr_file_close(f);
+
+    apr_file_buffer_default_set(0, 0);
+    rv = apr_file_open(&f, "data/testbufdefault.dat",
+                       APR_FOPEN_READ | APR_FOPEN_BUFFERED,
+                       APR_FPROT_OS_DEFAULT, p);
+    APR_ASSERT_SUCCESS(tc, "open for reading", rv);
+    ABTS_SIZE_EQUAL(tc, APR_BUFFERSIZE, apr_file_buffer_size_get(f));
+    apr_file_close(f);
+
+    rv = apr_file_remove("data/testbufdefault.dat", p);
+    APR_ASSERT_SUCCESS(tc, "remove", rv);
+}
+
 static void test_getc(abts_case *tc, void *data)
 {
     apr_file_t *f = NULL;
@@ -1761,6 +1818,118 @@ static void test_atomic_append(abts_case *tc, void *data)
 #endif /* APR_HAS_THREADS */
 }
 
+#if APR_HAS_THREADS
+#define STAGED_THREADS 8
+#define STAGED_RECORDS 500
+
+typedef struct thread_staged_ctx_t {
+    apr_file_t *f;
+    int id;
+} thread_staged_ctx_t;
+
+static void * APR_THREAD_FUNC thread_staged_func(apr_thread_t *thd,
+                                                 void *data)
+{
+    thread_staged_ctx_t *ctx = data;
+    apr_status_t rv = APR_SUCCESS;
+    char line[3000];
+    int i;
+
+    for (i = 0; i < STAGED_RECORDS && rv == APR_SUCCESS; i++) {
+        apr_size_t len = apr_snprintf(line, sizeof(line), "T%02d R%04d ",
+                                      ctx->id, i);
+        struct iovec vec[2];
+        apr_size_t n;
+
+        /* Some lines larger than a stage, some written in two parts */
+        if (i % 100 == 99) {
+            memset(line + len, 'x', sizeof(line) - len - 1);
+            len = sizeof(line) - 1;
+        }
+        line[len++] = '\n';
+        if (i % 2) {
+            vec[0].iov_base = line;
+            vec[0].iov_len = 5;
+            vec[1].iov_base = line + 5;
+            vec[1].iov_len = len - 5;
+            rv = apr_file_writev(ctx->f, vec, 2, &n);
+        }
+        else {
+            rv = apr_file_write_full(ctx->f, line, len, &n);
+        }
+        if (rv == APR_SUCCESS && n != len) {
+            rv = APR_EGENERAL;
+        }
+    }
+    apr_thread_exit(thd, rv);
+    return NULL;
+}
+#endif /* APR_HAS_THREADS */
+
+static void test_append_stages(abts_case *tc, void *data)
+{
+#if APR_HAS_THREADS
+    const char *fname = "data/testappend_stages.dat";
+    thread_staged_ctx_t ctx[STAGED_THREADS];
+    apr_thread_t *t[STAGED_THREADS];
+    int next[STAGED_THREADS] = {0};
+    apr_status_t rv, thread_rv;
+    apr_file_t *f;
+    char line[4000];
+    int i, lines = 0;
+
+    apr_file_remove(fname, p);
+    rv = apr_file_open(&f, fname, APR_FOPEN_WRITE | APR_FOPEN_CREATE
+                       | APR_FOPEN_APPEND | APR_FOPEN_BUFFERED
+                       | APR_FOPEN_XTHREAD, APR_FPROT_OS_DEFAULT, p);
+    APR_ASSERT_SUCCESS(tc, "open file", rv);
+    rv = apr_file_append_stages_set(f, 4, 1024, apr_time_from_msec(10));
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "apr_file_append_stages_set");
+        apr_file_close(f);
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "set stages", rv);
+
+    for (i = 0; i < STAGED_THREADS; i++) {
+        ctx[i].f = f;
+        ctx[i].id = i;
+        rv = apr_thread_create(&t[i], NULL, thread_staged_func, &ctx[i], p);
+        APR_ASSERT_SUCCESS(tc, "create thread", rv);
+    }
+    for (i = 0; i < STAGED_THREADS; i++) {
+        rv = apr_thread_join(&thread_rv, t[i]);
+        APR_ASSERT_SUCCESS(tc, "join thread", rv);
+        APR_ASSERT_SUCCESS(tc, "no thread errors", thread_rv);
+    }
+    rv = apr_file_close(f);
+    APR_ASSERT_SUCCESS(tc, "close file", rv);
+
+    /* Whole lines, in order for each thread */
+    rv = apr_file_open(&f, fname, APR_FOPEN_READ | APR_FOPEN_BUFFERED,
+                       APR_FPROT_OS_DEFAULT, p);
+    APR_ASSERT_SUCCESS(tc, "open file", rv);
+    while (apr_file_gets(line, sizeof(line), f) == APR_SUCCESS) {
+        int id, seq;
+
+        if (sscanf(line, "T%02d R%04d ", &id, &seq) != 2
+            || id < 0 || id >= STAGED_THREADS) {
+            ABTS_FAIL(tc, "interleaved record");
+            break;
+        }
+        ABTS_INT_EQUAL(tc, next[id], seq);
+        next[id] = seq + 1;
+        lines++;
+    }
+    ABTS_INT_EQUAL(tc, STAGED_THREADS * STAGED_RECORDS, lines);
+    apr_file_close(f);
+
+    apr_file_remove(fname, p);
+#else
+    ABTS_SKIP(tc, data, "This test requires APR thread support.");
+#endif /* APR_HAS_THREADS */
+}
+
 static void test_append_locked(abts_case *tc, void *data)
 {
     apr_status_t rv;
@@ -2043,6 +2212,207 @@ static void test_small_and_large_reads_buffered(abts_case *tc, void *data)
     apr_file_remove(fname, p);
 }
 
+static void test_read_write_at(abts_case *tc, void *data)
+{
+    const char *fname = "data/testrwat.dat";
+    apr_file_t *f;
+    apr_off_t pos = 0;
+    apr_size_t n;
+    char buf[32], b1[3], b2[3];
+    struct iovec vec[2];
+    apr_status_t rv;
+
+    rv = apr_file_open(&f, fname, APR_FOPEN_READ | APR_FOPEN_WRITE
+                       | APR_FOPEN_CREATE | APR_FOPEN_TRUNCATE
+                       | APR_FOPEN_BUFFERED, APR_FPROT_OS_DEFAULT, p);
+    APR_ASSERT_SUCCESS(tc, "open file", rv);
+
+    /* Buffered, flushed by apr_file_write_at() */
+    rv = apr_file_write_full(f, "abcdef", 6, NULL);
+    APR_ASSERT_SUCCESS(tc, "write", rv);
+
+    n = 3;
+    rv = apr_file_write_at(f, 10, "XYZ", &n);
+    APR_ASSERT_SUCCESS(tc, "write at 10", rv);
+    ABTS_SIZE_EQUAL(tc, 3, n);
+    rv = apr_file_seek(f, APR_CUR, &pos);
+    APR_ASSERT_SUCCESS(tc, "seek", rv);
+    ABTS_INT_EQUAL(tc, 6, (int)pos);
+
+    n = sizeof(buf);
+    rv = apr_file_read_at(f, 0, buf, &n);
+    APR_ASSERT_SUCCESS(tc, "read at 0", rv);
+    ABTS_SIZE_EQUAL(tc, 13, n);
+    ABTS_ASSERT(tc, "data read at 0",
+                memcmp(buf, "abcdef\0\0\0\0XYZ", 13) == 0);
+
+    vec[0].iov_base = (void *)"12";
+    vec[0].iov_len = 2;
+    vec[1].iov_base = (void *)"34";
+    vec[1].iov_len = 2;
+    rv = apr_file_writev_at(f, 1, vec, 2, &n);
+    APR_ASSERT_SUCCESS(tc, "writev at 1", rv);
+    ABTS_SIZE_EQUAL(tc, 4, n);
+
+    vec[0].iov_base = b1;
+    vec[0].iov_len = sizeof(b1);
+    vec[1].iov_base = b2;
+    vec[1].iov_len = sizeof(b2);
+    rv = apr_file_readv_at(f, 0, vec, 2, &n);
+    APR_ASSERT_SUCCESS(tc, "readv at 0", rv);
+    ABTS_SIZE_EQUAL(tc, 6, n);
+    ABTS_ASSERT(tc, "first vector", memcmp(b1, "a12", 3) == 0);
+    ABTS_ASSERT(tc, "second vector", memcmp(b2, "34f", 3) == 0);
+
+    n = sizeof(buf);
+    rv = apr_file_read_at(f, 100, buf, &n);
+    ABTS_INT_EQUAL(tc, APR_EOF, rv);
+    ABTS_SIZE_EQUAL(tc, 0, n);
+
+    /* The file pointer was left where apr_file_write() put it */
+    rv = apr_file_write_full(f, "gh", 2, NULL);
+    APR_ASSERT_SUCCESS(tc, "write", rv);
+    rv = apr_file_flush(f);
+    APR_ASSERT_SUCCESS(tc, "flush", rv);
+    n = 2;
+    rv = apr_file_read_at(f, 6, buf, &n);
+    APR_ASSERT_SUCCESS(tc, "read at 6", rv);
+    ABTS_SIZE_EQUAL(tc, 2, n);
+    ABTS_ASSERT(tc, "data read at 6", memcmp(buf, "gh", 2) == 0);
+
+    apr_file_close(f);
+    apr_file_remove(fname, p);
+}
+
+#if APR_HAS_THREADS
+#define COMMIT_THREADS 4
+#define COMMIT_RECORDS 50
+
+static void * APR_THREAD_FUNC thread_commit_func(apr_thread_t *thd,
+                                                 void *data)
+{
+    apr_file_group_commit_t *gc = data;
+    apr_status_t rv = APR_SUCCESS;
+    apr_uint64_t ticket;
+    int i;
+
+    for (i = 0; i < COMMIT_RECORDS && rv == APR_SUCCESS; i++) {
+        rv = apr_file_group_commit_write(gc, "record\n", 7, &ticket);
+        if (rv == APR_SUCCESS) {
+            rv = apr_file_group_commit_wait(gc, ticket);
+        }
+    }
+    apr_thread_exit(thd, rv);
+    return NULL;
+}
+#endif /* APR_HAS_THREADS */
+
+static void test_group_commit(abts_case *tc, void *data)
+{
+    const char *fname = "data/testgroupcommit.dat";
+    apr_file_group_commit_t *gc;
+    apr_uint64_t t1, t2, t3;
+    apr_finfo_t finfo;
+    apr_file_t *f;
+    apr_status_t rv;
+#if APR_HAS_THREADS
+    apr_thread_t *t[COMMIT_THREADS];
+    apr_status_t thread_rv;
+    int i;
+#endif
+
+    rv = apr_file_open(&f, fname, APR_FOPEN_WRITE | APR_FOPEN_CREATE
+                       | APR_FOPEN_TRUNCATE | APR_FOPEN_BUFFERED
+                       | APR_FOPEN_XTHREAD, APR_FPROT_OS_DEFAULT, p);
+    APR_ASSERT_SUCCESS(tc, "open file", rv);
+    rv = apr_file_group_commit_create(&gc, f, 0, 0, p);
+    APR_ASSERT_SUCCESS(tc, "create group commit", rv);
+
+    rv = apr_file_group_commit_write(gc, "one\n", 4, &t1);
+    APR_ASSERT_SUCCESS(tc, "write", rv);
+    rv = apr_file_group_commit_write(gc, "two\n", 4, &t2);
+    APR_ASSERT_SUCCESS(tc, "write", rv);
+    rv = apr_file_write_full(f, "three\n", 6, NULL);
+    APR_ASSERT_SUCCESS(tc, "write", rv);
+    t3 = apr_file_group_commit_ticket(gc);
+    ABTS_TRUE(tc, t1 < t2 && t2 < t3);
+
+    ABTS_INT_EQUAL(tc, APR_EINVAL, apr_file_group_commit_wait(gc, t3 + 1));
+
+    /* The sync for t2 covers t3, flushed out of the buffer */
+    rv = apr_file_group_commit_wait(gc, t2);
+    APR_ASSERT_SUCCESS(tc, "wait", rv);
+    rv = apr_file_group_commit_wait(gc, t3);
+    APR_ASSERT_SUCCESS(tc, "wait", rv);
+    rv = apr_file_group_commit_wait(gc, t1);
+    APR_ASSERT_SUCCESS(tc, "wait", rv);
+    rv = apr_stat(&finfo, fname, APR_FINFO_SIZE, p);
+    APR_ASSERT_SUCCESS(tc, "stat", rv);
+    ABTS_INT_EQUAL(tc, 14, (int)finfo.size);
+
+#if APR_HAS_THREADS
+    for (i = 0; i < COMMIT_THREADS; i++) {
+        rv = apr_thread_create(&t[i], NULL, thread_commit_func, gc, p);
+        APR_ASSERT_SUCCESS(tc, "create thread", rv);
+    }
+    for (i = 0; i < COMMIT_THREADS; i++) {
+        rv = apr_thread_join(&thread_rv, t[i]);
+        APR_ASSERT_SUCCESS(tc, "join thread", rv);
+        APR_ASSERT_SUCCESS(tc, "no thread errors", thread_rv);
+    }
+    rv = apr_stat(&finfo, fname, APR_FINFO_SIZE, p);
+    APR_ASSERT_SUCCESS(tc, "stat", rv);
+    ABTS_INT_EQUAL(tc, 14 + COMMIT_THREADS * COMMIT_RECORDS * 7,
+                   (int)finfo.size);
+#endif
+
+    apr_file_close(f);
+    apr_file_remove(fname, p);
+}
+
+static void test_line_iter(abts_case *tc, void *data)
+{
+    static const char *const lines[] = {
+        "first\n", "\n", "a line longer than the buffer of the iterator\n",
+        "short\n", "no newline"
+    };
+    const char *fname = "data/testlineiter.dat";
+    apr_file_line_iter_t *iter;
+    apr_file_t *f;
+    const char *line;
+    apr_size_t len;
+    apr_status_t rv;
+    int i;
+
+    rv = apr_file_open(&f, fname, APR_FOPEN_WRITE | APR_FOPEN_CREATE
+                       | APR_FOPEN_TRUNCATE, APR_FPROT_OS_DEFAULT, p);
+    APR_ASSERT_SUCCESS(tc, "open file", rv);
+    for (i = 0; i < 5; i++) {
+        rv = apr_file_puts(lines[i], f);
+        APR_ASSERT_SUCCESS(tc, "write line", rv);
+    }
+    apr_file_close(f);
+
+    rv = apr_file_open(&f, fname, APR_FOPEN_READ, APR_FPROT_OS_DEFAULT, p);
+    APR_ASSERT_SUCCESS(tc, "open file", rv);
+    rv = apr_file_line_iter_create(&iter, f, 16, p);
+    APR_ASSERT_SUCCESS(tc, "create iterator", rv);
+
+    for (i = 0; i < 5; i++) {
+        rv = apr_file_line_iter_next(iter, &line, &len);
+        APR_ASSERT_SUCCESS(tc, "next line", rv);
+        ABTS_SIZE_EQUAL(tc, strlen(lines[i]), len);
+        ABTS_ASSERT(tc, "line content", rv == APR_SUCCESS
+                    && memcmp(line, lines[i], len) == 0);
+    }
+    rv = apr_file_line_iter_next(iter, &line, &len);
+    ABTS_INT_EQUAL(tc, APR_EOF, rv);
+    ABTS_SIZE_EQUAL(tc, 0, len);
+
+    apr_file_close(f);
+    apr_file_remove(fname, p);
+}
+
 static void test_read_buffered_spanning_over_bufsize(abts_case *tc, void *data)
 {
     apr_status_t rv;
@@ -2295,6 +2665,7 @@ abts_suite *testfile(abts_suite *suite)
     abts_run_test(suite, test_fail_write_flush, NULL);
     abts_run_test(suite, test_fail_read_flush, NULL);
     abts_run_test(suite, test_buffer_set_get, NULL);
+    abts_run_test(suite, test_buffer_default, NULL);
     abts_run_test(suite, test_xthread, NULL);
     abts_run_test(suite, test_append, NULL);
     abts_run_test(suite, test_large_write_buffered, NULL);
@@ -2302,6 +2673,10 @@ abts_suite *testfile(abts_suite *suite)
     abts_run_test(suite, test_small_and_large_writes_buffered, NULL);
     abts_run_test(suite, test_write_buffered_spanning_over_bufsize, NULL);
     abts_run_test(suite, test_atomic_append, NULL);
+    abts_run_test(suite, test_append_stages, NULL);
+    abts_run_test(suite, test_read_write_at, NULL);
+    abts_run_test(suite, test_group_commit, NULL);
+    abts_run_test(suite, test_line_iter, NULL);
     abts_run_test(suite, test_append_locked, NULL);
     abts_run_test(suite, test_append_read, NULL);
     abts_run_test(suite, test_empty_read_buffered, NULL);
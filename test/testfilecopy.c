@@ -19,6 +19,7 @@
 #include "apr_file_info.h"
 #include "apr_errno.h"
 #include "apr_pools.h"
+#include "apr_strings.h"
 
 static void copy_helper(abts_case *tc, const char *from, const char * to,
                         apr_fileperms_t perms, int append, apr_pool_t *p)
@@ -123,6 +124,122 @@ static void append_exist(abts_case *tc, void *data)
     APR_ASSERT_SUCCESS(tc, "Couldn't remove copy file", rv);
 }
 
+/* Write len bytes of pattern at offset into a new file */
+static void write_at(abts_case *tc, const char *fname, apr_off_t offset,
+                     apr_size_t len, apr_pool_t *p)
+{
+    apr_file_t *f;
+    apr_status_t rv;
+    char *buf = apr_palloc(p, len);
+    apr_size_t i;
+
+    for (i = 0; i < len; i++) {
+        buf[i] = (char)('a' + (offset + i) % 26);
+    }
+    rv = apr_file_open(&f, fname, APR_FOPEN_WRITE | APR_FOPEN_CREATE,
+                       APR_FPROT_OS_DEFAULT, p);
+    APR_ASSERT_SUCCESS(tc, "Couldn't open file", rv);
+    rv = apr_file_seek(f, APR_SET, &offset);
+    APR_ASSERT_SUCCESS(tc, "Couldn't seek file", rv);
+    rv = apr_file_write_full(f, buf, len, NULL);
+    APR_ASSERT_SUCCESS(tc, "Couldn't write file", rv);
+    apr_file_close(f);
+}
+
+static void same_contents(abts_case *tc, const char *from, const char *to,
+                          apr_pool_t *p)
+{
+    apr_file_t *f1, *f2;
+    apr_status_t rv1, rv2;
+    char buf1[4096], buf2[4096];
+    apr_size_t n1, n2;
+
+    rv1 = apr_file_open(&f1, from, APR_FOPEN_READ, APR_FPROT_OS_DEFAULT, p);
+    APR_ASSERT_SUCCESS(tc, "Couldn't open original file", rv1);
+    rv2 = apr_file_open(&f2, to, APR_FOPEN_READ, APR_FPROT_OS_DEFAULT, p);
+    APR_ASSERT_SUCCESS(tc, "Couldn't open copy file", rv2);
+    do {
+        rv1 = apr_file_read_full(f1, buf1, sizeof(buf1), &n1);
+        rv2 = apr_file_read_full(f2, buf2, sizeof(buf2), &n2);
+        ABTS_ASSERT(tc, "Contents differ",
+                    n1 == n2 && memcmp(buf1, buf2, n1) == 0);
+    } while (rv1 == APR_SUCCESS && rv2 == APR_SUCCESS && n1 == n2);
+    ABTS_ASSERT(tc, "Both at EOF",
+                APR_STATUS_IS_EOF(rv1) && APR_STATUS_IS_EOF(rv2));
+    apr_file_close(f1);
+    apr_file_close(f2);
+}
+
+static void copy_large_file(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+
+    apr_file_remove("data/file_copy.dat", p);
+    apr_file_remove("data/file_copy_large.dat", p);
+
+    /* Several times the copy buffer, not a multiple of it */
+    write_at(tc, "data/file_copy_large.dat", 0, 300 * 1024 + 7, p);
+
+    copy_helper(tc, "data/file_copy_large.dat", "data/file_copy.dat",
+                APR_FPROT_FILE_SOURCE_PERMS, 0, p);
+    same_contents(tc, "data/file_copy_large.dat", "data/file_copy.dat", p);
+
+    /* Appended after the first copy */
+    copy_helper(tc, "data/file_copy_large.dat", "data/file_copy.dat",
+                APR_FPROT_FILE_SOURCE_PERMS, 1, p);
+
+    rv = apr_file_remove("data/file_copy.dat", p);
+    APR_ASSERT_SUCCESS(tc, "Couldn't remove copy file", rv);
+    rv = apr_file_remove("data/file_copy_large.dat", p);
+    APR_ASSERT_SUCCESS(tc, "Couldn't remove original file", rv);
+}
+
+static void copy_sparse_file(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_finfo_t orig, copy;
+
+    apr_file_remove("data/file_copy.dat", p);
+    apr_file_remove("data/file_copy_sparse.dat", p);
+
+    /* Data, a hole, data and a hole up to the end */
+    write_at(tc, "data/file_copy_sparse.dat", 0, 5000, p);
+    write_at(tc, "data/file_copy_sparse.dat", 4 * 1024 * 1024, 5000, p);
+    {
+        apr_file_t *f;
+
+        rv = apr_file_open(&f, "data/file_copy_sparse.dat", APR_FOPEN_WRITE,
+                           APR_FPROT_OS_DEFAULT, p);
+        APR_ASSERT_SUCCESS(tc, "Couldn't open file", rv);
+        rv = apr_file_trunc(f, 8 * 1024 * 1024);
+        APR_ASSERT_SUCCESS(tc, "Couldn't extend file", rv);
+        apr_file_close(f);
+    }
+
+    rv = apr_file_copy_ex("data/file_copy_sparse.dat", "data/file_copy.dat",
+                          APR_FPROT_FILE_SOURCE_PERMS, APR_FILE_COPY_SPARSE,
+                          p);
+    APR_ASSERT_SUCCESS(tc, "Error copying file", rv);
+
+    rv = apr_stat(&orig, "data/file_copy_sparse.dat",
+                  APR_FINFO_SIZE | APR_FINFO_CSIZE, p);
+    APR_ASSERT_SUCCESS(tc, "Couldn't stat original file", rv);
+    rv = apr_stat(&copy, "data/file_copy.dat",
+                  APR_FINFO_SIZE | APR_FINFO_CSIZE, p);
+    APR_ASSERT_SUCCESS(tc, "Couldn't stat copy file", rv);
+    ABTS_ASSERT(tc, "File size differs", orig.size == copy.size);
+    if ((orig.valid & copy.valid & APR_FINFO_CSIZE) && orig.csize < orig.size) {
+        /* The file system keeps holes, the copy should have them too */
+        ABTS_ASSERT(tc, "Holes not kept", copy.csize < copy.size);
+    }
+    same_contents(tc, "data/file_copy_sparse.dat", "data/file_copy.dat", p);
+
+    rv = apr_file_remove("data/file_copy.dat", p);
+    APR_ASSERT_SUCCESS(tc, "Couldn't remove copy file", rv);
+    rv = apr_file_remove("data/file_copy_sparse.dat", p);
+    APR_ASSERT_SUCCESS(tc, "Couldn't remove original file", rv);
+}
+
 abts_suite *testfilecopy(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -133,6 +250,9 @@ abts_suite *testfilecopy(abts_suite *suite)
     abts_run_test(suite, append_nonexist, NULL);
     abts_run_test(suite, append_exist, NULL);
 
+    abts_run_test(suite, copy_large_file, NULL);
+    abts_run_test(suite, copy_sparse_file, NULL);
+
     return suite;
 }
 
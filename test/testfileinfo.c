@@ -248,6 +248,94 @@ static void test_mtime_set(abts_case *tc, void *data)
     apr_file_close(thefile);
 }
 
+static void test_stat_nosync(abts_case *tc, void *data)
+{
+    apr_finfo_t finfo, nosync;
+    apr_status_t rv;
+
+    rv = apr_stat(&finfo, FILENAME, APR_FINFO_SIZE, p);
+    APR_ASSERT_SUCCESS(tc, "stat file", rv);
+    rv = apr_stat(&nosync, FILENAME, APR_FINFO_SIZE | APR_FINFO_NOSYNC, p);
+    APR_ASSERT_SUCCESS(tc, "stat file without sync", rv);
+    ABTS_TRUE(tc, (nosync.valid & APR_FINFO_SIZE) != 0);
+    ABTS_TRUE(tc, finfo.size == nosync.size);
+}
+
+static void write_file(abts_case *tc, const char *fname, const char *text)
+{
+    apr_file_t *thefile;
+    apr_status_t rv;
+
+    rv = apr_file_open(&thefile, fname,
+                       APR_FOPEN_WRITE | APR_FOPEN_CREATE | APR_FOPEN_TRUNCATE,
+                       APR_FPROT_OS_DEFAULT, p);
+    APR_ASSERT_SUCCESS(tc, "open file", rv);
+    rv = apr_file_puts(text, thefile);
+    APR_ASSERT_SUCCESS(tc, "write file", rv);
+    apr_file_close(thefile);
+}
+
+static void test_stat_cached(abts_case *tc, void *data)
+{
+    apr_stat_cache_t *cache;
+    apr_finfo_t finfo, cached;
+    apr_status_t rv;
+    char *cwd, *fname, *other, *missing;
+
+    rv = apr_filepath_get(&cwd, APR_FILEPATH_NATIVE, p);
+    APR_ASSERT_SUCCESS(tc, "get cwd", rv);
+    fname = apr_pstrcat(p, cwd, "/data/stat_cached1.txt", NULL);
+    other = apr_pstrcat(p, cwd, "/data/stat_cached2.txt", NULL);
+    missing = apr_pstrcat(p, cwd, "/data/stat_cached_missing", NULL);
+    write_file(tc, fname, "abc");
+    write_file(tc, other, "abcdef");
+
+    rv = apr_stat_cache_create(&cache, 1, apr_time_from_sec(3600), p);
+    APR_ASSERT_SUCCESS(tc, "create cache", rv);
+
+    rv = apr_stat(&finfo, fname, APR_FINFO_NORM, p);
+    APR_ASSERT_SUCCESS(tc, "stat file", rv);
+    rv = apr_stat_cached(&cached, cache, fname, APR_FINFO_NORM, p);
+    APR_ASSERT_SUCCESS(tc, "stat file in cache", rv);
+    finfo_equal(tc, &finfo, &cached);
+    ABTS_PTR_EQUAL(tc, fname, cached.fname);
+    rv = apr_stat_cached(&cached, cache, fname, APR_FINFO_SIZE, p);
+    APR_ASSERT_SUCCESS(tc, "stat file from cache", rv);
+    ABTS_INT_EQUAL(tc, 3, (int)cached.size);
+
+    /* The only entry is replaced, so the change is seen whatever the TTL */
+    rv = apr_stat_cached(&cached, cache, other, APR_FINFO_SIZE, p);
+    APR_ASSERT_SUCCESS(tc, "stat other file", rv);
+    ABTS_INT_EQUAL(tc, 6, (int)cached.size);
+    write_file(tc, fname, "abcd");
+    rv = apr_stat_cached(&cached, cache, fname, APR_FINFO_SIZE, p);
+    APR_ASSERT_SUCCESS(tc, "stat changed file", rv);
+    ABTS_INT_EQUAL(tc, 4, (int)cached.size);
+
+    rv = apr_stat_cached(&cached, cache, missing, APR_FINFO_SIZE, p);
+    ABTS_TRUE(tc, APR_STATUS_IS_ENOENT(rv));
+    rv = apr_stat_cached(&cached, cache, missing, APR_FINFO_SIZE, p);
+    ABTS_TRUE(tc, APR_STATUS_IS_ENOENT(rv));
+
+    /* The expired results are stated again */
+    rv = apr_stat_cache_create(&cache, 4, 1, p);
+    APR_ASSERT_SUCCESS(tc, "create cache", rv);
+    rv = apr_stat_cached(&cached, cache, fname, APR_FINFO_SIZE, p);
+    APR_ASSERT_SUCCESS(tc, "stat file", rv);
+    ABTS_INT_EQUAL(tc, 4, (int)cached.size);
+    write_file(tc, fname, "abcde");
+    apr_sleep(1000);
+    rv = apr_stat_cached(&cached, cache, fname, APR_FINFO_SIZE, p);
+    APR_ASSERT_SUCCESS(tc, "stat expired file", rv);
+    ABTS_INT_EQUAL(tc, 5, (int)cached.size);
+
+    rv = apr_stat_cache_create(&cache, 4, 0, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    apr_file_remove(fname, p);
+    apr_file_remove(other, p);
+}
+
 abts_suite *testfileinfo(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -257,6 +345,8 @@ abts_suite *testfileinfo(abts_suite *suite)
     abts_run_test(suite, test_stat_eq_finfo, NULL);
     abts_run_test(suite, test_buffered_write_size, NULL);
     abts_run_test(suite, test_mtime_set, NULL);
+    abts_run_test(suite, test_stat_nosync, NULL);
+    abts_run_test(suite, test_stat_cached, NULL);
 
     return suite;
 }
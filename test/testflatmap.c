@@ -0,0 +1,191 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr.h"
+#include "apr_strings.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_flatmap.h"
+
+#define MANY_KEYS 5000
+
+static void add_pair(apr_array_header_t *pairs, const void *key,
+                     apr_ssize_t klen, const void *val)
+{
+    apr_flatmap_pair_t *pair = apr_array_push(pairs);
+
+    pair->key = key;
+    pair->klen = klen;
+    pair->val = val;
+}
+
+static apr_flatmap_t *make_flatmap(abts_case *tc, apr_array_header_t *pairs)
+{
+    apr_flatmap_t *fm;
+
+    APR_ASSERT_SUCCESS(tc, "make flatmap", apr_flatmap_make(&fm, pairs, p));
+    return fm;
+}
+
+static void flatmap_empty(abts_case *tc, void *data)
+{
+    apr_array_header_t *pairs;
+    apr_flatmap_t *fm;
+
+    pairs = apr_array_make(p, 1, sizeof(int));
+    ABTS_INT_EQUAL(tc, APR_EINVAL, apr_flatmap_make(&fm, pairs, p));
+
+    pairs = apr_array_make(p, 1, sizeof(apr_flatmap_pair_t));
+    fm = make_flatmap(tc, pairs);
+    ABTS_INT_EQUAL(tc, 0, apr_flatmap_count(fm));
+    ABTS_PTR_EQUAL(tc, NULL, apr_flatmap_get(fm, "key", APR_HASH_KEY_STRING));
+    ABTS_PTR_EQUAL(tc, NULL, apr_flatmap_get(fm, "", 0));
+}
+
+static void flatmap_set_get(abts_case *tc, void *data)
+{
+    apr_array_header_t *pairs;
+    apr_flatmap_t *fm;
+    char key[16];
+
+    pairs = apr_array_make(p, 4, sizeof(apr_flatmap_pair_t));
+
+    /* The keys are copied */
+    strcpy(key, "text/html");
+    add_pair(pairs, key, APR_HASH_KEY_STRING, "html");
+    add_pair(pairs, "image/png", 9, "png");
+    add_pair(pairs, "", 0, "empty");
+    /* Same 8 bytes prefixes */
+    add_pair(pairs, "text/plain", APR_HASH_KEY_STRING, "plain");
+    add_pair(pairs, "text/pla", APR_HASH_KEY_STRING, "pla");
+    add_pair(pairs, "text/pla\0n", 10, "binary");
+    add_pair(pairs, "text/pl", APR_HASH_KEY_STRING, "pl");
+    /* The last one is kept */
+    add_pair(pairs, "image/png", APR_HASH_KEY_STRING, "png2");
+
+    fm = make_flatmap(tc, pairs);
+    strcpy(key, "xxx");
+    ABTS_INT_EQUAL(tc, 7, apr_flatmap_count(fm));
+
+    ABTS_STR_EQUAL(tc, "html",
+                   apr_flatmap_get(fm, "text/html", APR_HASH_KEY_STRING));
+    ABTS_STR_EQUAL(tc, "png2", apr_flatmap_get(fm, "image/png", 9));
+    ABTS_STR_EQUAL(tc, "empty", apr_flatmap_get(fm, "", APR_HASH_KEY_STRING));
+    ABTS_STR_EQUAL(tc, "plain",
+                   apr_flatmap_get(fm, "text/plain", APR_HASH_KEY_STRING));
+    ABTS_STR_EQUAL(tc, "pla", apr_flatmap_get(fm, "text/pla", 8));
+    ABTS_STR_EQUAL(tc, "binary", apr_flatmap_get(fm, "text/pla\0n", 10));
+    ABTS_STR_EQUAL(tc, "pl", apr_flatmap_get(fm, "text/pl", 7));
+
+    ABTS_PTR_EQUAL(tc, NULL, apr_flatmap_get(fm, "xxx", APR_HASH_KEY_STRING));
+    ABTS_PTR_EQUAL(tc, NULL, apr_flatmap_get(fm, "text/pla\0", 9));
+    ABTS_PTR_EQUAL(tc, NULL, apr_flatmap_get(fm, "text/plai", 9));
+    ABTS_PTR_EQUAL(tc, NULL, apr_flatmap_get(fm, "a", 1));
+    ABTS_PTR_EQUAL(tc, NULL, apr_flatmap_get(fm, "zzzzzzzzzzz", 11));
+}
+
+typedef struct walk_t {
+    abts_case *tc;
+    const char *prev;
+    apr_ssize_t prev_len;
+    int count;
+    int max;
+} walk_t;
+
+static int walk_cb(void *rec, const void *key, apr_ssize_t klen,
+                   const void *val)
+{
+    walk_t *walk = rec;
+    apr_size_t len;
+
+    /* In the order of the keys, NUL terminated */
+    ABTS_INT_EQUAL(walk->tc, 0, ((const char *)key)[klen]);
+    if (walk->prev) {
+        len = walk->prev_len < klen ? walk->prev_len : klen;
+        ABTS_TRUE(walk->tc, memcmp(walk->prev, key, len) < 0
+                            || (!memcmp(walk->prev, key, len)
+                                && walk->prev_len < klen));
+    }
+    walk->prev = key;
+    walk->prev_len = klen;
+
+    return ++walk->count < walk->max;
+}
+
+static void flatmap_many_keys(abts_case *tc, void *data)
+{
+    apr_array_header_t *pairs;
+    apr_flatmap_t *fm, *copy;
+    apr_pool_t *pool;
+    walk_t walk;
+    char **keys;
+    int i, ok;
+
+    pairs = apr_array_make(p, MANY_KEYS, sizeof(apr_flatmap_pair_t));
+    keys = apr_palloc(p, MANY_KEYS * sizeof(*keys));
+    for (i = 0; i < MANY_KEYS; i++) {
+        /* Not sorted, some sharing long prefixes */
+        keys[i] = apr_psprintf(p, i % 3 ? "key%d" : "application/x-%d",
+                               (i * 7919) % MANY_KEYS);
+        if (i % 2) {
+            add_pair(pairs, keys[i], APR_HASH_KEY_STRING, keys[i]);
+        }
+    }
+    fm = make_flatmap(tc, pairs);
+    ABTS_INT_EQUAL(tc, MANY_KEYS / 2, apr_flatmap_count(fm));
+
+    /* Copied into a pool of its own */
+    APR_ASSERT_SUCCESS(tc, "create pool", apr_pool_create(&pool, p));
+    copy = apr_flatmap_copy(pool, fm);
+    ABTS_INT_EQUAL(tc, apr_flatmap_size(fm), apr_flatmap_size(copy));
+    memset(fm, 0, apr_flatmap_size(fm));
+
+    ok = 1;
+    for (i = 0; i < MANY_KEYS; i++) {
+        void *expected = i % 2 ? keys[i] : NULL;
+        if (apr_flatmap_get(copy, keys[i], APR_HASH_KEY_STRING) != expected) {
+            ok = 0;
+        }
+    }
+    ABTS_TRUE(tc, ok);
+
+    memset(&walk, 0, sizeof(walk));
+    walk.tc = tc;
+    walk.max = MANY_KEYS;
+    ABTS_INT_EQUAL(tc, 1, apr_flatmap_do(walk_cb, &walk, copy));
+    ABTS_INT_EQUAL(tc, MANY_KEYS / 2, walk.count);
+
+    /* Stopped early */
+    memset(&walk, 0, sizeof(walk));
+    walk.tc = tc;
+    walk.max = 10;
+    ABTS_INT_EQUAL(tc, 0, apr_flatmap_do(walk_cb, &walk, copy));
+    ABTS_INT_EQUAL(tc, 10, walk.count);
+
+    apr_pool_destroy(pool);
+}
+
+abts_suite *testflatmap(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+    abts_run_test(suite, flatmap_empty, NULL);
+    abts_run_test(suite, flatmap_set_get, NULL);
+    abts_run_test(suite, flatmap_many_keys, NULL);
+
+    return suite;
+}
@@ -146,6 +146,91 @@ static void error_fmt(abts_case *tc, void *data)
     ABTS_STR_EQUAL(tc, sbuf, s);
 }
 
+static void fixed_fp_fmt(abts_case *tc, void *data)
+{
+    char buf[100];
+
+    apr_snprintf(buf, sizeof buf, "%.2f", 3.14159);
+    ABTS_STR_EQUAL(tc, "3.14", buf);
+    apr_snprintf(buf, sizeof buf, "%.3f", -0.0005);
+    ABTS_STR_EQUAL(tc, "-0.001", buf);
+    apr_snprintf(buf, sizeof buf, "%.1f", 0.26);
+    ABTS_STR_EQUAL(tc, "0.3", buf);
+    apr_snprintf(buf, sizeof buf, "%.0f", 2.4999);
+    ABTS_STR_EQUAL(tc, "2", buf);
+    apr_snprintf(buf, sizeof buf, "%08.3f", 99.9996);
+    ABTS_STR_EQUAL(tc, "0100.000", buf);
+    apr_snprintf(buf, sizeof buf, "%.15f", 0.1);
+    ABTS_STR_EQUAL(tc, "0.100000000000000", buf);
+    apr_snprintf(buf, sizeof buf, "%f", 1e20);
+    ABTS_STR_EQUAL(tc, "100000000000000000000.000000", buf);
+    apr_snprintf(buf, sizeof buf, "%#.0f", 7.0);
+    ABTS_STR_EQUAL(tc, "7.", buf);
+}
+
+static void check_compiled(abts_case *tc, const char *fmt, ...)
+{
+    const apr_format_t *format = apr_format_compile(p, fmt);
+    char buf[100], sbuf[100];
+    apr_size_t len;
+    va_list ap;
+    int n1, n2;
+
+    ABTS_PTR_NOTNULL(tc, format);
+    for (len = 0; len <= 40; len += 7) {
+        va_start(ap, fmt);
+        n1 = apr_vsnprintf(sbuf, len, fmt, ap);
+        va_end(ap);
+        va_start(ap, fmt);
+        n2 = apr_format_vsnprintf(buf, len, format, ap);
+        va_end(ap);
+        ABTS_INT_EQUAL(tc, n1, n2);
+        if (len) {
+            ABTS_STR_EQUAL(tc, sbuf, buf);
+        }
+    }
+    va_start(ap, fmt);
+    apr_vsnprintf(sbuf, sizeof sbuf, fmt, ap);
+    va_end(ap);
+    va_start(ap, fmt);
+    ABTS_STR_EQUAL(tc, apr_pvsprintf(p, fmt, ap), sbuf);
+    va_end(ap);
+    va_start(ap, fmt);
+    ABTS_STR_EQUAL(tc, apr_format_pvsprintf(p, format, ap), sbuf);
+    va_end(ap);
+}
+
+static void compiled_fmt(abts_case *tc, void *data)
+{
+    const apr_format_t *format;
+    apr_status_t rv = APR_ENOENT;
+    char buf[100];
+    int n = 0;
+
+    check_compiled(tc, "");
+    check_compiled(tc, "no conversion at all");
+    check_compiled(tc, "%d", -12);
+    check_compiled(tc, "%s=%d;", "key", 42);
+    check_compiled(tc, "[%-*s|%*.*d]", 6, "ab", 5, 3, 7);
+    check_compiled(tc, "%%%c%%%5.2f%%", 'c', 2.718);
+    check_compiled(tc, "%" APR_INT64_T_FMT " %" APR_UINT64_T_HEX_FMT " %lu %hd",
+                   APR_INT64_C(-5), APR_UINT64_C(255), 7UL, (short)-3);
+    check_compiled(tc, "%pm and %pp too", &rv, (void *)buf);
+    check_compiled(tc, "%10.3e|%-8g|%x|%o", 12345.678, 0.0001, 255U, 8U);
+    check_compiled(tc, "trailing %");
+
+    format = apr_format_compile(p, "[%-*s|%*.*d]");
+    apr_format_snprintf(buf, sizeof buf, format, 6, "ab", 5, 3, 7);
+    ABTS_STR_EQUAL(tc, "[ab    |  007]", buf);
+    ABTS_STR_EQUAL(tc, "[ab    |  007]",
+                   apr_format_psprintf(p, format, 6, "ab", 5, 3, 7));
+
+    format = apr_format_compile(p, "abc%nxyz");
+    apr_format_snprintf(buf, sizeof buf, format, &n);
+    ABTS_STR_EQUAL(tc, "abcxyz", buf);
+    ABTS_INT_EQUAL(tc, 3, n);
+}
+
 abts_suite *testfmt(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -160,6 +245,8 @@ abts_suite *testfmt(abts_suite *suite)
     abts_run_test(suite, uint64_t_hex_fmt, NULL);
     abts_run_test(suite, more_int64_fmts, NULL);
     abts_run_test(suite, error_fmt, NULL);
+    abts_run_test(suite, fixed_fp_fmt, NULL);
+    abts_run_test(suite, compiled_fmt, NULL);
 
     return suite;
 }
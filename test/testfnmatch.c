@@ -18,6 +18,7 @@
 #include "apr_file_info.h"
 #include "apr_fnmatch.h"
 #include "apr_tables.h"
+#include "apr_strings.h"
 
 /* XXX NUM_FILES must be equal to the nummber of expected files with a
  * .txt extension in the data directory at the time testfnmatch
@@ -174,6 +175,110 @@ static void test_fnmatch(abts_case *tc, void *data)
     }
 }
 
+/* The compiled patterns against apr_fnmatch(), with the patterns above
+ * and random ones
+ */
+static void test_fnmatch_compile(abts_case *tc, void *data)
+{
+    static const char alphabet[] = "ab*?[]!^-\\/.A";
+    struct pattern_s *test;
+    char pattern[12], string[10], buf[120];
+    const apr_fnmatch_t *fnm;
+    unsigned int seed = 77;
+    int i, j, k;
+
+    for (test = patterns; test->pattern; ++test) {
+        for (i = 0; i <= APR_FNM_BITS; ++i) {
+            fnm = apr_fnmatch_compile(p, test->pattern, i);
+            if (apr_fnmatch_match(fnm, test->string)
+                != apr_fnmatch(test->pattern, test->string, i)) {
+                sprintf(buf, "apr_fnmatch_match(\"%s\", \"%s\", %d) differs",
+                        test->pattern, test->string, i);
+                abts_fail(tc, buf, __LINE__);
+            }
+        }
+    }
+
+    for (k = 0; k < 20000; k++) {
+        int plen, slen;
+
+        seed = seed * 1103515245 + 12345;
+        plen = (seed >> 16) % (sizeof(pattern) - 1);
+        for (j = 0; j < plen; j++) {
+            seed = seed * 1103515245 + 12345;
+            pattern[j] = alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+        }
+        pattern[plen] = '\0';
+        seed = seed * 1103515245 + 12345;
+        i = (seed >> 16) & APR_FNM_BITS;
+        fnm = apr_fnmatch_compile(p, pattern, i);
+
+        for (j = 0; j < 8; j++) {
+            int n;
+
+            seed = seed * 1103515245 + 12345;
+            slen = (seed >> 16) % sizeof(string);
+            for (n = 0; n < slen; n++) {
+                seed = seed * 1103515245 + 12345;
+                string[n] = alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+            }
+            string[slen] = '\0';
+            /* and sometimes the pattern's literals */
+            if (j == 0) {
+                apr_cpystrn(string, pattern, sizeof(string));
+            }
+            if (apr_fnmatch_match(fnm, string)
+                != apr_fnmatch(pattern, string, i)) {
+                sprintf(buf, "apr_fnmatch_match(\"%s\", \"%s\", %d) differs",
+                        pattern, string, i);
+                abts_fail(tc, buf, __LINE__);
+                return;
+            }
+        }
+    }
+}
+
+static void test_fnmatch_set(abts_case *tc, void *data)
+{
+    static const char *globs[] = {
+        "*.txt", "/usr/*/secret/*", "*admin*", "*ADMIN*.log", "/tmp/??",
+        "*[0-9]*.bak", "/home/*/public_html/*", "*admin*", "README"
+    };
+    static const struct {
+        const char *string;
+        int match;
+    } tests[] = {
+        {"notes.txt", 0},
+        {"/usr/local/secret/key", 1},
+        {"the_admin_page", 2},
+        {"/var/admin/x", -1},
+        {"x_ADMIN_y.log", 3},
+        {"x_admin_y.log", 2},
+        {"/tmp/ab", 4},
+        {"/tmp/abc", -1},
+        {"file1.bak", 5},
+        {"file.bak", -1},
+        {"/home/joe/public_html/index.html", 6},
+        {"README", 8},
+        {"readme", -1},
+        {"", -1}
+    };
+    const apr_fnmatch_t *fnms[sizeof(globs) / sizeof(globs[0])];
+    const apr_fnmatch_set_t *set;
+    int i;
+
+    for (i = 0; i < (int)(sizeof(globs) / sizeof(globs[0])); i++) {
+        fnms[i] = apr_fnmatch_compile(p, globs[i], APR_FNM_PATHNAME);
+    }
+    set = apr_fnmatch_set_make(p, fnms, i);
+    ABTS_PTR_NOTNULL(tc, set);
+
+    for (i = 0; i < (int)(sizeof(tests) / sizeof(tests[0])); i++) {
+        ABTS_INT_EQUAL(tc, tests[i].match,
+                       apr_fnmatch_set_match(set, tests[i].string));
+    }
+}
+
 static void test_fnmatch_test(abts_case *tc, void *data)
 {
     static const struct test {
@@ -247,6 +352,8 @@ abts_suite *testfnmatch(abts_suite *suite)
     suite = ADD_SUITE(suite)
 
     abts_run_test(suite, test_fnmatch, NULL);
+    abts_run_test(suite, test_fnmatch_compile, NULL);
+    abts_run_test(suite, test_fnmatch_set, NULL);
     abts_run_test(suite, test_fnmatch_test, NULL);
     abts_run_test(suite, test_glob, NULL);
     abts_run_test(suite, test_glob_currdir, NULL);
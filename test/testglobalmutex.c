@@ -69,6 +69,7 @@ static const char *mutexname(apr_lockmech_e mech)
     case APR_LOCK_POSIXSEM: return "posixsem";
     case APR_LOCK_DEFAULT: return "default";
     case APR_LOCK_DEFAULT_TIMED: return "default_timed";
+    case APR_LOCK_FUTEX: return "futex";
     default: return "unknown";
     }
 }
@@ -134,6 +135,10 @@ abts_suite *testglobalmutex(abts_suite *suite)
 #if APR_HAS_FLOCK_SERIALIZE
     mech = APR_LOCK_FLOCK;
     abts_run_test(suite, test_exclusive, &mech);
+#endif
+#if APR_HAS_FUTEX_SERIALIZE
+    mech = APR_LOCK_FUTEX;
+    abts_run_test(suite, test_exclusive, &mech);
 #endif
     mech = APR_LOCK_DEFAULT_TIMED;
     abts_run_test(suite, test_exclusive, &mech);
@@ -20,6 +20,8 @@
 #include "apr_general.h"
 #include "apr_pools.h"
 #include "apr_hash.h"
+#include "apr_atomic.h"
+#include "apr_thread_pool.h"
 
 #define MAX_LTH 256
 #define MAX_DEPTH 11
@@ -76,6 +78,12 @@ static void sum_hash(apr_pool_t *p, apr_hash_t *h, int *pcount, int *keySum, int
     *pcount=count;
 }
 
+/* The tests run with all kinds of tables, data points to the flags */
+static apr_hash_t *make_hash(void *data)
+{
+    return apr_hash_make_ex(p, NULL, data ? *(apr_uint32_t *)data : 0);
+}
+
 static void hash_make(abts_case *tc, void *data)
 {
     apr_hash_t *h = NULL;
@@ -89,7 +97,7 @@ static void hash_set(abts_case *tc, void *data)
     apr_hash_t *h = NULL;
     char *result = NULL;
 
-    h = apr_hash_make(p);
+    h = make_hash(data);
     ABTS_PTR_NOTNULL(tc, h);
 
     apr_hash_set(h, "key", APR_HASH_KEY_STRING, "value");
@@ -102,7 +110,7 @@ static void hash_get_or_set(abts_case *tc, void *data)
     apr_hash_t *h = NULL;
     char *result = NULL;
 
-    h = apr_hash_make(p);
+    h = make_hash(data);
     ABTS_PTR_NOTNULL(tc, h);
 
     result = apr_hash_get_or_set(h, "key", APR_HASH_KEY_STRING, "value");
@@ -130,7 +138,7 @@ static void hash_reset(abts_case *tc, void *data)
     apr_hash_t *h = NULL;
     char *result = NULL;
 
-    h = apr_hash_make(p);
+    h = make_hash(data);
     ABTS_PTR_NOTNULL(tc, h);
 
     apr_hash_set(h, "key", APR_HASH_KEY_STRING, "value");
@@ -147,7 +155,7 @@ static void same_value(abts_case *tc, void *data)
     apr_hash_t *h = NULL;
     char *result = NULL;
 
-    h = apr_hash_make(p);
+    h = make_hash(data);
     ABTS_PTR_NOTNULL(tc, h);
 
     apr_hash_set(h, "same1", APR_HASH_KEY_STRING, "same");
@@ -191,7 +199,7 @@ static void key_space(abts_case *tc, void *data)
     apr_hash_t *h = NULL;
     char *result = NULL;
 
-    h = apr_hash_make(p);
+    h = make_hash(data);
     ABTS_PTR_NOTNULL(tc, h);
 
     apr_hash_set(h, "key with space", APR_HASH_KEY_STRING, "value");
@@ -204,7 +212,7 @@ static void hash_clear(abts_case *tc, void *data)
     apr_hash_t *h;
     int i, *e;
 
-    h = apr_hash_make(p);
+    h = make_hash(data);
     ABTS_PTR_NOTNULL(tc, h);
 
     for (i = 1; i <= 10; i++) {
@@ -226,7 +234,7 @@ static void hash_traverse(abts_case *tc, void *data)
     apr_hash_t *h;
     char StrArray[MAX_DEPTH][MAX_LTH];
 
-    h = apr_hash_make(p);
+    h = make_hash(data);
     ABTS_PTR_NOTNULL(tc, h);
 
     apr_hash_set(h, "OVERWRITE", APR_HASH_KEY_STRING, "should not see this");
@@ -261,7 +269,7 @@ static void summation_test(abts_case *tc, void *data)
     int sumKeys, sumVal, trySumKey, trySumVal;
     int i, j, *val, *key;
 
-    h =apr_hash_make(p);
+    h =make_hash(data);
     ABTS_PTR_NOTNULL(tc, h);
 
     sumKeys = 0;
@@ -291,7 +299,7 @@ static void delete_key(abts_case *tc, void *data)
     apr_hash_t *h = NULL;
     char *result = NULL;
 
-    h = apr_hash_make(p);
+    h = make_hash(data);
     ABTS_PTR_NOTNULL(tc, h);
 
     apr_hash_set(h, "key", APR_HASH_KEY_STRING, "value");
@@ -317,7 +325,7 @@ static void hash_count_0(abts_case *tc, void *data)
     apr_hash_t *h = NULL;
     int count;
 
-    h = apr_hash_make(p);
+    h = make_hash(data);
     ABTS_PTR_NOTNULL(tc, h);
 
     count = apr_hash_count(h);
@@ -329,7 +337,7 @@ static void hash_count_1(abts_case *tc, void *data)
     apr_hash_t *h = NULL;
     int count;
 
-    h = apr_hash_make(p);
+    h = make_hash(data);
     ABTS_PTR_NOTNULL(tc, h);
 
     apr_hash_set(h, "key", APR_HASH_KEY_STRING, "value");
@@ -343,7 +351,7 @@ static void hash_count_5(abts_case *tc, void *data)
     apr_hash_t *h = NULL;
     int count;
 
-    h = apr_hash_make(p);
+    h = make_hash(data);
     ABTS_PTR_NOTNULL(tc, h);
 
     apr_hash_set(h, "key1", APR_HASH_KEY_STRING, "value1");
@@ -364,8 +372,8 @@ static void overlay_empty(abts_case *tc, void *data)
     int count;
     char StrArray[MAX_DEPTH][MAX_LTH];
 
-    base = apr_hash_make(p);
-    overlay = apr_hash_make(p);
+    base = make_hash(data);
+    overlay = make_hash(data);
     ABTS_PTR_NOTNULL(tc, base);
     ABTS_PTR_NOTNULL(tc, overlay);
 
@@ -398,8 +406,8 @@ static void overlay_2unique(abts_case *tc, void *data)
     int count;
     char StrArray[MAX_DEPTH][MAX_LTH];
 
-    base = apr_hash_make(p);
-    overlay = apr_hash_make(p);
+    base = make_hash(data);
+    overlay = make_hash(data);
     ABTS_PTR_NOTNULL(tc, base);
     ABTS_PTR_NOTNULL(tc, overlay);
 
@@ -442,7 +450,7 @@ static void overlay_same(abts_case *tc, void *data)
     int count;
     char StrArray[MAX_DEPTH][MAX_LTH];
 
-    base = apr_hash_make(p);
+    base = make_hash(data);
     ABTS_PTR_NOTNULL(tc, base);
 
     apr_hash_set(base, "base1", APR_HASH_KEY_STRING, "value1");
@@ -473,8 +481,8 @@ static void overlay_fetch(abts_case *tc, void *data)
     apr_hash_t *result = NULL;
     int count;
 
-    base = apr_hash_make(p);
-    overlay = apr_hash_make(p);
+    base = make_hash(data);
+    overlay = make_hash(data);
     ABTS_PTR_NOTNULL(tc, base);
     ABTS_PTR_NOTNULL(tc, overlay);
 
@@ -539,31 +547,296 @@ static void overlay_fetch(abts_case *tc, void *data)
                        apr_hash_get(overlay, "overlay5", APR_HASH_KEY_STRING));
 }
 
+#define MANY_KEYS 10000
+
+static void many_keys(abts_case *tc, void *data)
+{
+    apr_hash_t *h = make_hash(data), *copy;
+    apr_hash_index_t *hi;
+    char **keys;
+    int i, n, ok;
+
+    keys = apr_palloc(p, MANY_KEYS * sizeof(*keys));
+    for (i = 0; i < MANY_KEYS; i++) {
+        keys[i] = apr_psprintf(p, "key%d", i);
+        apr_hash_set(h, keys[i], APR_HASH_KEY_STRING, keys[i]);
+    }
+    ABTS_INT_EQUAL(tc, MANY_KEYS, apr_hash_count(h));
+
+    /* Delete the odd ones while iterating */
+    n = 0;
+    for (hi = apr_hash_first(p, h); hi; hi = apr_hash_next(hi)) {
+        const char *key = apr_hash_this_key(hi);
+        if (atoi(key + 3) % 2) {
+            apr_hash_set(h, key, APR_HASH_KEY_STRING, NULL);
+        }
+        n++;
+    }
+    ABTS_INT_EQUAL(tc, MANY_KEYS, n);
+    ABTS_INT_EQUAL(tc, MANY_KEYS / 2, apr_hash_count(h));
+
+    /* Deleted and added again, through the deleted slots */
+    for (i = 0; i < MANY_KEYS; i += 4) {
+        apr_hash_set(h, keys[i], APR_HASH_KEY_STRING, NULL);
+    }
+    for (i = 1; i < MANY_KEYS; i += 2) {
+        ABTS_PTR_EQUAL(tc, keys[i],
+                       apr_hash_get_or_set(h, keys[i], APR_HASH_KEY_STRING,
+                                           keys[i]));
+    }
+    ABTS_INT_EQUAL(tc, MANY_KEYS * 3 / 4, apr_hash_count(h));
+
+    copy = apr_hash_copy(p, h);
+    ok = 1;
+    for (i = 0; i < MANY_KEYS; i++) {
+        void *expected = i % 4 ? keys[i] : NULL;
+        if (apr_hash_get(h, keys[i], APR_HASH_KEY_STRING) != expected
+            || apr_hash_get(copy, keys[i], APR_HASH_KEY_STRING) != expected) {
+            ok = 0;
+        }
+    }
+    ABTS_TRUE(tc, ok);
+    ABTS_INT_EQUAL(tc, MANY_KEYS * 3 / 4, apr_hash_count(copy));
+    ABTS_INT_EQUAL(tc, MANY_KEYS * 3 / 4,
+                   apr_hash_count(apr_hash_overlay(p, copy, h)));
+
+    apr_hash_clear(h);
+    ABTS_INT_EQUAL(tc, 0, apr_hash_count(h));
+    ABTS_PTR_EQUAL(tc, NULL, apr_hash_first(p, h));
+    ABTS_PTR_EQUAL(tc, NULL, apr_hash_get(h, keys[1], APR_HASH_KEY_STRING));
+    ABTS_INT_EQUAL(tc, MANY_KEYS * 3 / 4, apr_hash_count(copy));
+}
+
+static void hash_reserve(abts_case *tc, void *data)
+{
+    apr_hash_t *h = make_hash(data);
+    char **keys;
+    int i, ok;
+
+    keys = apr_palloc(p, MANY_KEYS * sizeof(*keys));
+    for (i = 0; i < MANY_KEYS; i++) {
+        keys[i] = apr_psprintf(p, "key%d", i);
+    }
+
+    /* Reserved early, then again once the table has grown (and is being
+     * expanded if incremental).
+     */
+    apr_hash_reserve(h, MANY_KEYS / 8);
+    for (i = 0; i < MANY_KEYS / 2; i++) {
+        apr_hash_set(h, keys[i], APR_HASH_KEY_STRING, keys[i]);
+    }
+    apr_hash_reserve(h, 0);
+    apr_hash_reserve(h, MANY_KEYS);
+    ABTS_INT_EQUAL(tc, MANY_KEYS / 2, apr_hash_count(h));
+    for (i = MANY_KEYS / 2; i < MANY_KEYS; i++) {
+        apr_hash_set(h, keys[i], APR_HASH_KEY_STRING, keys[i]);
+    }
+    ABTS_INT_EQUAL(tc, MANY_KEYS, apr_hash_count(h));
+
+    ok = 1;
+    for (i = 0; i < MANY_KEYS; i++) {
+        if (apr_hash_get(h, keys[i], APR_HASH_KEY_STRING) != keys[i]) {
+            ok = 0;
+        }
+    }
+    ABTS_TRUE(tc, ok);
+}
+
+static int count_parallel(void *rec, const void *key, apr_ssize_t klen,
+                          const void *value)
+{
+    apr_atomic_inc32(rec);
+    return 1;
+}
+
+static int stop_parallel(void *rec, const void *key, apr_ssize_t klen,
+                         const void *value)
+{
+    apr_atomic_inc32(rec);
+    return strcmp(key, "key42") != 0;
+}
+
+static void hash_parallel(abts_case *tc, void *data)
+{
+    struct apr_thread_pool *tp = NULL;
+    const char **keys, **vals;
+    unsigned int n = MANY_KEYS + MANY_KEYS / 2;
+    apr_uint32_t count;
+    apr_hash_t *h;
+    int i, pass, ok;
+
+    /* The second half sets the first MANY_KEYS / 2 keys again */
+    keys = apr_palloc(p, n * sizeof(*keys));
+    vals = apr_palloc(p, n * sizeof(*vals));
+    for (i = 0; i < (int)n; i++) {
+        keys[i] = apr_psprintf(p, "key%d", i % MANY_KEYS);
+        vals[i] = keys[i];
+    }
+
+#if APR_HAS_THREADS
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_thread_pool_create(&tp, 0, 4, p));
+#endif
+
+    for (pass = 0; pass < 2; pass++) {
+        struct apr_thread_pool *pool = pass ? NULL : tp;
+
+        h = make_hash(data);
+        apr_hash_set(h, "key1", APR_HASH_KEY_STRING, "old");
+        apr_hash_set(h, "other", APR_HASH_KEY_STRING, "other");
+        ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                       apr_hash_build_parallel(h, (const void **)keys, NULL,
+                                               (const void **)vals, n,
+                                               pool));
+        ABTS_INT_EQUAL(tc, MANY_KEYS + 1, apr_hash_count(h));
+
+        ok = 1;
+        for (i = 0; i < MANY_KEYS; i++) {
+            const char *expected = keys[i < MANY_KEYS / 2 ? i + MANY_KEYS
+                                                          : i];
+            if (apr_hash_get(h, keys[i], APR_HASH_KEY_STRING) != expected) {
+                ok = 0;
+            }
+        }
+        ABTS_TRUE(tc, ok);
+        ABTS_STR_EQUAL(tc, "other",
+                       apr_hash_get(h, "other", APR_HASH_KEY_STRING));
+
+        count = 0;
+        ABTS_INT_EQUAL(tc, 1, apr_hash_do_parallel(count_parallel, &count,
+                                                   h, pool));
+        ABTS_INT_EQUAL(tc, MANY_KEYS + 1, count);
+        count = 0;
+        ABTS_INT_EQUAL(tc, 0, apr_hash_do_parallel(stop_parallel, &count,
+                                                   h, pool));
+        ABTS_TRUE(tc, count <= MANY_KEYS + 1);
+
+        /* Nothing added without all the values */
+        vals[MANY_KEYS - 1] = NULL;
+        h = make_hash(data);
+        ABTS_INT_EQUAL(tc, APR_EINVAL,
+                       apr_hash_build_parallel(h, (const void **)keys, NULL,
+                                               (const void **)vals, n,
+                                               pool));
+        ABTS_INT_EQUAL(tc, 0, apr_hash_count(h));
+        vals[MANY_KEYS - 1] = keys[MANY_KEYS - 1];
+    }
+
+#if APR_HAS_THREADS
+    apr_thread_pool_destroy(tp);
+#endif
+}
+
+static void *merge_vals(apr_pool_t *pool, const void *key, apr_ssize_t klen,
+                        const void *h1_val, const void *h2_val,
+                        const void *data)
+{
+    return apr_pstrcat(pool, h1_val, "+", h2_val, NULL);
+}
+
+static void merge_mixed(abts_case *tc, void *data)
+{
+    apr_hash_t *chained = apr_hash_make(p);
+    apr_hash_t *open = apr_hash_make_ex(p, NULL, APR_HASH_OPEN_ADDRESSING);
+    apr_hash_t *result;
+
+    apr_hash_set(chained, "a", APR_HASH_KEY_STRING, "c1");
+    apr_hash_set(chained, "b", APR_HASH_KEY_STRING, "c2");
+    apr_hash_set(open, "b", APR_HASH_KEY_STRING, "o2");
+    apr_hash_set(open, "c", APR_HASH_KEY_STRING, "o3");
+
+    result = apr_hash_merge(p, open, chained, merge_vals, NULL);
+    ABTS_INT_EQUAL(tc, 3, apr_hash_count(result));
+    ABTS_STR_EQUAL(tc, "c1", apr_hash_get(result, "a", APR_HASH_KEY_STRING));
+    ABTS_STR_EQUAL(tc, "o2+c2",
+                   apr_hash_get(result, "b", APR_HASH_KEY_STRING));
+    ABTS_STR_EQUAL(tc, "o3", apr_hash_get(result, "c", APR_HASH_KEY_STRING));
+
+    result = apr_hash_overlay(p, chained, open);
+    ABTS_INT_EQUAL(tc, 3, apr_hash_count(result));
+    ABTS_STR_EQUAL(tc, "c2", apr_hash_get(result, "b", APR_HASH_KEY_STRING));
+    ABTS_STR_EQUAL(tc, "o3", apr_hash_get(result, "c", APR_HASH_KEY_STRING));
+}
+
+static void hashfunc_fast(abts_case *tc, void *data)
+{
+    static const apr_ssize_t lens[] = { 0, 1, 3, 7, 8, 9, 16, 17, 32, 256 };
+    unsigned int hashes[sizeof(lens) / sizeof(lens[0])];
+    char key[257];
+    apr_ssize_t klen;
+    int i, j;
+
+    for (i = 0; i < 256; i++) {
+        key[i] = 'a' + i % 26;
+    }
+    key[256] = '\0';
+
+    klen = APR_HASH_KEY_STRING;
+    hashes[0] = apr_hashfunc_fast(key, &klen);
+    ABTS_INT_EQUAL(tc, 256, (int)klen);
+    klen = 256;
+    ABTS_INT_EQUAL(tc, hashes[0], apr_hashfunc_fast(key, &klen));
+
+    /* Every length and every byte counts */
+    for (i = 0; i < (int)(sizeof(lens) / sizeof(lens[0])); i++) {
+        klen = lens[i];
+        hashes[i] = apr_hashfunc_fast(key, &klen);
+        for (j = 0; j < i; j++) {
+            ABTS_TRUE(tc, hashes[i] != hashes[j]);
+        }
+    }
+    for (i = 0; i < 256; i += 15) {
+        key[i] ^= 1;
+        klen = 256;
+        ABTS_TRUE(tc, hashes[9] != apr_hashfunc_fast(key, &klen));
+        key[i] ^= 1;
+    }
+}
+
 abts_suite *testhash(abts_suite *suite)
 {
+    static apr_uint32_t flags[] = {
+        0,
+        APR_HASH_OPEN_ADDRESSING,
+        APR_HASH_FAST_HASH,
+        APR_HASH_OPEN_ADDRESSING | APR_HASH_FAST_HASH,
+        APR_HASH_INCREMENTAL
+    };
+    int i;
+
     suite = ADD_SUITE(suite)
 
     abts_run_test(suite, hash_make, NULL);
-    abts_run_test(suite, hash_set, NULL);
-    abts_run_test(suite, hash_get_or_set, NULL);
-    abts_run_test(suite, hash_reset, NULL);
-    abts_run_test(suite, same_value, NULL);
     abts_run_test(suite, same_value_custom, NULL);
-    abts_run_test(suite, key_space, NULL);
-    abts_run_test(suite, delete_key, NULL);
-
-    abts_run_test(suite, hash_count_0, NULL);
-    abts_run_test(suite, hash_count_1, NULL);
-    abts_run_test(suite, hash_count_5, NULL);
-
-    abts_run_test(suite, hash_clear, NULL);
-    abts_run_test(suite, hash_traverse, NULL);
-    abts_run_test(suite, summation_test, NULL);
-
-    abts_run_test(suite, overlay_empty, NULL);
-    abts_run_test(suite, overlay_2unique, NULL);
-    abts_run_test(suite, overlay_same, NULL);
-    abts_run_test(suite, overlay_fetch, NULL);
+    abts_run_test(suite, hashfunc_fast, NULL);
+
+    for (i = 0; i < (int)(sizeof(flags) / sizeof(flags[0])); i++) {
+        void *data = &flags[i];
+
+        abts_run_test(suite, hash_set, data);
+        abts_run_test(suite, hash_get_or_set, data);
+        abts_run_test(suite, hash_reset, data);
+        abts_run_test(suite, same_value, data);
+        abts_run_test(suite, key_space, data);
+        abts_run_test(suite, delete_key, data);
+
+        abts_run_test(suite, hash_count_0, data);
+        abts_run_test(suite, hash_count_1, data);
+        abts_run_test(suite, hash_count_5, data);
+
+        abts_run_test(suite, hash_clear, data);
+        abts_run_test(suite, hash_traverse, data);
+        abts_run_test(suite, summation_test, data);
+
+        abts_run_test(suite, overlay_empty, data);
+        abts_run_test(suite, overlay_2unique, data);
+        abts_run_test(suite, overlay_same, data);
+        abts_run_test(suite, overlay_fetch, data);
+
+        abts_run_test(suite, many_keys, data);
+        abts_run_test(suite, hash_reserve, data);
+        abts_run_test(suite, hash_parallel, data);
+    }
+    abts_run_test(suite, merge_mixed, NULL);
 
     return suite;
 }
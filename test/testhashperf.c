@@ -0,0 +1,222 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compares the hash functions, and the lookups in the kinds of hash
+ * tables, for keys of a few sizes. Then the time taken by the additions
+ * growing the tables, overall and the longest one.
+ */
+
+#include "apr_hash.h"
+#include "apr_pools.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_strings.h"
+#include "apr_time.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_MAX_COUNTER 1000000
+/* Distinct keys per run, looked up in turn */
+#define NUM_KEYS 1024
+/* Entries added by the growth runs */
+#define GROW_ENTRIES (1 << 21)
+
+static long max_counter = DEFAULT_MAX_COUNTER;
+static int verbose = 0;
+
+/* Keep the compiler from optimizing the hashes away */
+static volatile unsigned int sink;
+static volatile void *sink_val;
+
+static char **make_keys(apr_pool_t *pool, apr_size_t size)
+{
+    char **keys = apr_palloc(pool, NUM_KEYS * sizeof(*keys));
+    char prefix[8];
+    apr_size_t j;
+    int i;
+
+    for (i = 0; i < NUM_KEYS; i++) {
+        keys[i] = apr_palloc(pool, size + 1);
+        for (j = 0; j < size; j++) {
+            keys[i][j] = 'a' + (char)((i * 31 + j * 7) % 26);
+        }
+        /* Unique prefix, so that keys differ by their first bytes */
+        apr_snprintf(prefix, sizeof(prefix), "%04x", i);
+        memcpy(keys[i], prefix, size < 4 ? size : 4);
+        keys[i][size] = '\0';
+    }
+    return keys;
+}
+
+static apr_interval_time_t bench_func(apr_hashfunc_t func, char **keys,
+                                      apr_size_t size)
+{
+    apr_time_t start = apr_time_now();
+    long i;
+
+    for (i = 0; i < max_counter; i++) {
+        apr_ssize_t klen = size;
+        sink = func(keys[i % NUM_KEYS], &klen);
+    }
+
+    return apr_time_now() - start;
+}
+
+static apr_interval_time_t bench_get(apr_pool_t *pool, apr_uint32_t flags,
+                                     char **keys)
+{
+    apr_hash_t *ht = apr_hash_make_ex(pool, NULL, flags);
+    apr_time_t start;
+    long i;
+
+    for (i = 0; i < NUM_KEYS; i++) {
+        apr_hash_set(ht, keys[i], APR_HASH_KEY_STRING, keys[i]);
+    }
+
+    start = apr_time_now();
+    for (i = 0; i < max_counter; i++) {
+        sink_val = apr_hash_get(ht, keys[i % NUM_KEYS], APR_HASH_KEY_STRING);
+    }
+
+    return apr_time_now() - start;
+}
+
+static void bench_grow(apr_pool_t *pool, const char *name,
+                       apr_uint32_t flags, const apr_uint32_t *keys)
+{
+    apr_hash_t *ht = apr_hash_make_ex(pool, NULL, flags);
+    apr_interval_time_t worst = 0, usecs;
+    apr_time_t start, now, last;
+    int i;
+
+    start = last = apr_time_now();
+    for (i = 0; i < GROW_ENTRIES; i++) {
+        apr_hash_set(ht, &keys[i], sizeof(keys[i]), &keys[i]);
+        now = apr_time_now();
+        if (now - last > worst) {
+            worst = now - last;
+        }
+        last = now;
+    }
+    usecs = last - start;
+
+    printf("    %-28s %8" APR_TIME_T_FMT " usec, longest %6" APR_TIME_T_FMT
+           " usec\n", name, usecs, worst);
+}
+
+static void report(const char *name, apr_size_t size,
+                   apr_interval_time_t usecs)
+{
+    printf("    %-28s %4" APR_SIZE_T_FMT " bytes: %8" APR_TIME_T_FMT
+           " usec, %8.2f Mkeys/s\n", name, size, usecs,
+           usecs ? (double)max_counter / usecs : 0.0);
+}
+
+int main(int argc, const char * const *argv)
+{
+    static const apr_size_t sizes[] = { 8, 32, 256 };
+    apr_pool_t *pool, *bench;
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    char **keys;
+    int i;
+
+    printf("APR Hash Performance Test\n==============\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "c:v", &optchar, &optarg)) == APR_SUCCESS) {
+        if (optchar == 'c') {
+            max_counter = atol(optarg);
+        }
+        else if (optchar == 'v') {
+            verbose = 1;
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    if (apr_pool_create(&bench, pool) != APR_SUCCESS)
+        exit(-1);
+
+    if (verbose) {
+        printf("%ld hashes or lookups per run, over %d keys\n\n",
+               max_counter, NUM_KEYS);
+    }
+
+    for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        keys = make_keys(bench, sizes[i]);
+
+        report("apr_hashfunc_default", sizes[i],
+               bench_func(apr_hashfunc_default, keys, sizes[i]));
+        report("apr_hashfunc_fast", sizes[i],
+               bench_func(apr_hashfunc_fast, keys, sizes[i]));
+
+        report("apr_hash_get", sizes[i], bench_get(bench, 0, keys));
+        report("apr_hash_get (fast)", sizes[i],
+               bench_get(bench, APR_HASH_FAST_HASH, keys));
+        report("apr_hash_get (open)", sizes[i],
+               bench_get(bench, APR_HASH_OPEN_ADDRESSING, keys));
+        report("apr_hash_get (open, fast)", sizes[i],
+               bench_get(bench, APR_HASH_OPEN_ADDRESSING
+                                | APR_HASH_FAST_HASH, keys));
+
+        apr_pool_clear(bench);
+    }
+
+    if (verbose) {
+        printf("\n%d entries added per growth run\n", GROW_ENTRIES);
+    }
+    printf("\n");
+    {
+        apr_uint32_t *ikeys = apr_palloc(pool, GROW_ENTRIES * sizeof(*ikeys));
+
+        for (i = 0; i < GROW_ENTRIES; i++) {
+            ikeys[i] = i;
+        }
+        bench_grow(bench, "apr_hash_set", 0, ikeys);
+        apr_pool_clear(bench);
+        bench_grow(bench, "apr_hash_set (incremental)",
+                   APR_HASH_INCREMENTAL, ikeys);
+        apr_pool_clear(bench);
+        bench_grow(bench, "apr_hash_set (open)",
+                   APR_HASH_OPEN_ADDRESSING, ikeys);
+        apr_pool_clear(bench);
+    }
+
+    apr_pool_destroy(pool);
+
+    return 0;
+}
@@ -0,0 +1,204 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_heap.h"
+
+#define MANY_ELTS 10000
+
+static int int_compare(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+
+    return (x > y) - (x < y);
+}
+
+static apr_heap_t *make_heap(abts_case *tc, apr_size_t nalloc)
+{
+    apr_heap_t *heap;
+
+    APR_ASSERT_SUCCESS(tc, "create heap",
+                       apr_heap_create(&heap, nalloc, int_compare, p));
+    return heap;
+}
+
+/* Pop all the elements, checking they come out in order */
+static int heap_drain(apr_heap_t *heap, int count)
+{
+    int *prev = NULL, *cur, n = 0;
+
+    while ((cur = apr_heap_pop(heap)) != NULL) {
+        if (prev && *cur < *prev) {
+            return -1;
+        }
+        prev = cur;
+        n++;
+    }
+    return n == count ? n : -1;
+}
+
+static void heap_create(abts_case *tc, void *data)
+{
+    apr_heap_t *heap;
+
+    ABTS_INT_EQUAL(tc, APR_EINVAL, apr_heap_create(&heap, 0, NULL, p));
+
+    heap = make_heap(tc, 0);
+    ABTS_INT_EQUAL(tc, 0, apr_heap_size(heap));
+    ABTS_PTR_EQUAL(tc, NULL, apr_heap_peek(heap));
+    ABTS_PTR_EQUAL(tc, NULL, apr_heap_pop(heap));
+}
+
+static void heap_order(abts_case *tc, void *data)
+{
+    apr_heap_t *heap = make_heap(tc, 4);
+    int *elts = apr_palloc(p, MANY_ELTS * sizeof(int));
+    int i, min = 0;
+
+    srand(42);
+    for (i = 0; i < MANY_ELTS; i++) {
+        /* Some duplicates */
+        elts[i] = rand() % (MANY_ELTS / 2);
+        if (!i || elts[i] < elts[min]) {
+            min = i;
+        }
+        APR_ASSERT_SUCCESS(tc, "insert", apr_heap_insert(heap, &elts[i], NULL));
+    }
+    ABTS_INT_EQUAL(tc, MANY_ELTS, apr_heap_size(heap));
+    ABTS_INT_EQUAL(tc, elts[min], *(int *)apr_heap_peek(heap));
+
+    ABTS_INT_EQUAL(tc, MANY_ELTS, heap_drain(heap, MANY_ELTS));
+    ABTS_INT_EQUAL(tc, 0, apr_heap_size(heap));
+}
+
+static void heap_update(abts_case *tc, void *data)
+{
+    apr_heap_t *heap = make_heap(tc, 0);
+    apr_heap_node_t *nodes[100];
+    int elts[100];
+    int i;
+
+    for (i = 0; i < 100; i++) {
+        elts[i] = i * 10;
+        apr_heap_insert(heap, &elts[i], &nodes[i]);
+    }
+
+    /* Decreased */
+    elts[50] = -1;
+    apr_heap_update(heap, nodes[50]);
+    ABTS_PTR_EQUAL(tc, &elts[50], apr_heap_peek(heap));
+
+    /* Increased */
+    elts[50] = 10000;
+    apr_heap_update(heap, nodes[50]);
+    ABTS_PTR_EQUAL(tc, &elts[0], apr_heap_peek(heap));
+    elts[0] = 555;
+    apr_heap_update(heap, nodes[0]);
+    ABTS_PTR_EQUAL(tc, &elts[1], apr_heap_peek(heap));
+
+    /* Unchanged */
+    apr_heap_update(heap, nodes[70]);
+
+    ABTS_INT_EQUAL(tc, 100, heap_drain(heap, 100));
+}
+
+static void heap_remove(abts_case *tc, void *data)
+{
+    apr_heap_t *heap = make_heap(tc, 0);
+    apr_heap_node_t **nodes = apr_palloc(p, MANY_ELTS * sizeof(*nodes));
+    int *elts = apr_palloc(p, MANY_ELTS * sizeof(int));
+    int i;
+
+    srand(7);
+    for (i = 0; i < MANY_ELTS; i++) {
+        elts[i] = rand();
+        apr_heap_insert(heap, &elts[i], &nodes[i]);
+    }
+
+    /* Remove the odd ones, the last one included */
+    for (i = 1; i < MANY_ELTS; i += 2) {
+        ABTS_PTR_EQUAL(tc, &elts[i], apr_heap_remove(heap, nodes[i]));
+    }
+    ABTS_INT_EQUAL(tc, MANY_ELTS / 2, apr_heap_size(heap));
+
+    /* The handles of the others are still good */
+    for (i = 0; i < MANY_ELTS; i += 4) {
+        elts[i] = -elts[i];
+        apr_heap_update(heap, nodes[i]);
+    }
+
+    ABTS_INT_EQUAL(tc, MANY_ELTS / 2, heap_drain(heap, MANY_ELTS / 2));
+}
+
+static void heap_clear(abts_case *tc, void *data)
+{
+    apr_heap_t *heap = make_heap(tc, 0);
+    apr_heap_node_t *node, *first;
+    int elts[10];
+    int i;
+
+    for (i = 0; i < 10; i++) {
+        elts[i] = 10 - i;
+        apr_heap_insert(heap, &elts[i], i % 2 ? &node : NULL);
+    }
+    ABTS_INT_EQUAL(tc, 10, apr_heap_size(heap));
+
+    apr_heap_clear(heap);
+    ABTS_INT_EQUAL(tc, 0, apr_heap_size(heap));
+    ABTS_PTR_EQUAL(tc, NULL, apr_heap_pop(heap));
+
+    /* Still usable after clearing, the handles are recycled */
+    apr_heap_insert(heap, &elts[0], &first);
+    apr_heap_insert(heap, &elts[1], &node);
+    ABTS_PTR_EQUAL(tc, &elts[1], apr_heap_peek(heap));
+    ABTS_PTR_EQUAL(tc, &elts[0], apr_heap_remove(heap, first));
+    ABTS_PTR_EQUAL(tc, &elts[1], apr_heap_pop(heap));
+    ABTS_INT_EQUAL(tc, 0, apr_heap_size(heap));
+}
+
+static void heap_pool_lifetime(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_heap_t *heap;
+    int i;
+
+    APR_ASSERT_SUCCESS(tc, "create pool", apr_pool_create(&pool, p));
+
+    /* The array is given back with the pool */
+    APR_ASSERT_SUCCESS(tc, "create heap",
+                       apr_heap_create(&heap, 0, int_compare, pool));
+    for (i = 0; i < 1000; i++) {
+        apr_heap_insert(heap, &i, NULL);
+    }
+    apr_pool_destroy(pool);
+}
+
+abts_suite *testheap(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+    abts_run_test(suite, heap_create, NULL);
+    abts_run_test(suite, heap_order, NULL);
+    abts_run_test(suite, heap_update, NULL);
+    abts_run_test(suite, heap_remove, NULL);
+    abts_run_test(suite, heap_clear, NULL);
+    abts_run_test(suite, heap_pool_lifetime, NULL);
+
+    return suite;
+}
@@ -183,12 +183,113 @@ static void test_pred_ordering(abts_case *tc, void *data)
     /* FAILS ABTS_STR_EQUAL(tc, "1223", buf); */
 }
 
+static void test_late_registration(abts_case *tc, void *data)
+{
+    char buf[6] = {0};
+
+    apr_hook_global_pool = p;
+    apr_hook_deregister_all();
+
+    ABTS_TRUE(tc, APR_HOOK_IS_EMPTY(toyhook));
+    probe_buf_pool = p;
+    test_run_toyhook(buf, sizeof buf);
+    ABTS_STR_EQUAL(tc, "", buf);
+    ABTS_STR_EQUAL(tc, "ER", probe_buf);
+
+    apr_hook_debug_current = "2";
+    test_hook_toyhook(toyhook_2, NULL, NULL, APR_HOOK_MIDDLE);
+    apr_hook_debug_current = "1";
+    test_hook_toyhook(toyhook_1, NULL, NULL, APR_HOOK_FIRST);
+    ABTS_TRUE(tc, !APR_HOOK_IS_EMPTY(toyhook));
+
+    apr_hook_sort_all();
+
+    /* Hooked after the sort, so run last */
+    apr_hook_debug_current = "3";
+    test_hook_toyhook(toyhook_3, NULL, NULL, APR_HOOK_REALLY_FIRST);
+
+    test_run_toyhook(buf, sizeof buf);
+    ABTS_STR_EQUAL(tc, "123", buf);
+    ABTS_STR_EQUAL(tc, "EI1CI2CI3CR", probe_buf);
+}
+
+static int toyhook_slow(char *x, apr_size_t buf_size)
+{
+    apr_sleep(apr_time_from_msec(2));
+    return toyhook_1(x, buf_size);
+}
+
+typedef struct {
+    abts_case *tc;
+    int n;
+} profile_baton_t;
+
+static int check_profile(void *baton, const apr_hook_profile_t *profile)
+{
+    profile_baton_t *pb = baton;
+
+    ABTS_STR_EQUAL(pb->tc, "toyhook", profile->hook);
+    if (pb->n++ == 0) {
+        /* Sorted by time spent */
+        ABTS_STR_EQUAL(pb->tc, "slow", profile->module);
+        ABTS_PTR_EQUAL(pb->tc, (void *)toyhook_slow, (void *)profile->func);
+        ABTS_INT_EQUAL(pb->tc, 2, (int)profile->calls);
+        ABTS_TRUE(pb->tc, profile->max_ns >= 2000000);
+        ABTS_TRUE(pb->tc, profile->total_ns >= 4000000);
+    }
+    else {
+        ABTS_STR_EQUAL(pb->tc, "2", profile->module);
+        ABTS_INT_EQUAL(pb->tc, 2, (int)profile->calls);
+    }
+    return 1;
+}
+
+static void test_profile(abts_case *tc, void *data)
+{
+    char buf[6];
+    profile_baton_t pb;
+
+    apr_hook_global_pool = p;
+    apr_hook_deregister_all();
+    probe_buf_pool = p;
+
+    apr_hook_debug_current = "slow";
+    test_hook_toyhook(toyhook_slow, NULL, NULL, APR_HOOK_MIDDLE);
+    apr_hook_debug_current = "2";
+    test_hook_toyhook(toyhook_2, NULL, NULL, APR_HOOK_LAST);
+    apr_hook_sort_all();
+
+    /* Not recorded */
+    buf[0] = '\0';
+    test_run_toyhook(buf, sizeof buf);
+
+    apr_hook_profile_enabled = 1;
+    buf[0] = '\0';
+    test_run_toyhook(buf, sizeof buf);
+    ABTS_STR_EQUAL(tc, "12", buf);
+    apr_hook_profile_reset();
+    buf[0] = '\0';
+    test_run_toyhook(buf, sizeof buf);
+    /* Sorting again keeps the profiles */
+    apr_hook_sort_all();
+    buf[0] = '\0';
+    test_run_toyhook(buf, sizeof buf);
+    apr_hook_profile_enabled = 0;
+
+    pb.tc = tc;
+    pb.n = 0;
+    ABTS_INT_EQUAL(tc, 1, apr_hook_profile_do(check_profile, &pb));
+    ABTS_INT_EQUAL(tc, 2, pb.n);
+}
+
 abts_suite *testhooks(abts_suite *suite)
 {
     suite = ADD_SUITE(suite);
 
     abts_run_test(suite, test_basic_ordering, NULL);
     abts_run_test(suite, test_pred_ordering, NULL);
+    abts_run_test(suite, test_late_registration, NULL);
+    abts_run_test(suite, test_profile, NULL);
 
     return suite;
 }
@@ -149,6 +149,83 @@ static void test_interesting_subnets(abts_case *tc, void *data)
     }
 }
 
+static void test_subnet_set(abts_case *tc, void *data)
+{
+    struct {
+        const char *ipstr, *mask;
+    } subnets[] =
+    {
+         {"9.67",             NULL}
+        ,{"10.1.0.0",         "255.0.255.0"}
+        ,{"127.0.0.1",        "8"}
+        ,{"192.168.1.1",      NULL}
+#if APR_HAVE_IPV6
+        ,{"fe80::",           "8"}
+        ,{"3FFE:8160::",      "28"}
+        ,{"38.0.0.0",         "8"}
+#endif
+    };
+    struct {
+        const char *ipstr;
+        int family;
+    } addrs[] =
+    {
+         {"9.67.113.15",          APR_INET}
+        ,{"9.68.113.15",          APR_INET}
+        ,{"10.2.0.3",             APR_INET}
+        ,{"10.1.3.3",             APR_INET}
+        ,{"127.1.2.3",            APR_INET}
+        ,{"128.0.0.1",            APR_INET}
+        ,{"192.168.1.1",          APR_INET}
+        ,{"192.168.1.2",          APR_INET}
+        ,{"38.1.1.1",             APR_INET}
+#if APR_HAVE_IPV6
+        ,{"::ffff:38.1.1.1",      APR_INET6}
+        ,{"::ffff:192.168.1.1",   APR_INET6}
+        ,{"2600::1",              APR_INET6}
+        ,{"fe80::1",              APR_INET6}
+        ,{"ff01::1",              APR_INET6}
+        ,{"3ffE:816e:abcd:1234::1", APR_INET6}
+        ,{"3ffe:8170::1",         APR_INET6}
+#endif
+    };
+    apr_ipsubnet_t *ipsubs[sizeof subnets / sizeof subnets[0]];
+    apr_ipsubnet_set_t *set;
+    apr_sockaddr_t *sa;
+    apr_status_t rv;
+    int i, j, expected;
+
+    rv = apr_ipsubnet_set_create(&set, p);
+    APR_ASSERT_SUCCESS(tc, "create subnet set", rv);
+
+    rv = apr_sockaddr_info_get(&sa, "9.67.113.15", APR_INET, 0, 0, p);
+    APR_ASSERT_SUCCESS(tc, "Problem generating sockaddr", rv);
+    ABTS_INT_EQUAL(tc, 0, apr_ipsubnet_set_test(set, sa));
+
+    for (i = 0; i < sizeof subnets / sizeof subnets[0]; i++) {
+        rv = apr_ipsubnet_create(&ipsubs[i], subnets[i].ipstr,
+                                 subnets[i].mask, p);
+        APR_ASSERT_SUCCESS(tc, "create subnet", rv);
+        rv = apr_ipsubnet_set_add(set, ipsubs[i]);
+        APR_ASSERT_SUCCESS(tc, "add subnet", rv);
+    }
+
+    /* The set matches where any of its subnets does */
+    for (i = 0; i < sizeof addrs / sizeof addrs[0]; i++) {
+        rv = apr_sockaddr_info_get(&sa, addrs[i].ipstr, addrs[i].family,
+                                   0, 0, p);
+        APR_ASSERT_SUCCESS(tc, "Problem generating sockaddr", rv);
+        expected = 0;
+        for (j = 0; j < sizeof subnets / sizeof subnets[0]; j++) {
+            if (apr_ipsubnet_test(ipsubs[j], sa)) {
+                expected = 1;
+            }
+        }
+        ABTS_ASSERT(tc, addrs[i].ipstr,
+                    !apr_ipsubnet_set_test(set, sa) == !expected);
+    }
+}
+
 static void test_badmask_str(abts_case *tc, void *data)
 {
     char buf[128];
@@ -229,6 +306,7 @@ abts_suite *testipsub(abts_suite *suite)
     abts_run_test(suite, test_bad_input, NULL);
     abts_run_test(suite, test_singleton_subnets, NULL);
     abts_run_test(suite, test_interesting_subnets, NULL);
+    abts_run_test(suite, test_subnet_set, NULL);
     abts_run_test(suite, test_badmask_str, NULL);
     abts_run_test(suite, test_badip_str, NULL);
     abts_run_test(suite, test_parse_addr_port, NULL);
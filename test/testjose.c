@@ -255,6 +255,16 @@ static apr_status_t verify_cb(apr_bucket_brigade *bb,
     return APR_ENOTIMPL;
 }
 
+static int verify_count;
+
+static apr_status_t verify_count_cb(apr_bucket_brigade *bb,
+        apr_jose_t *jose, apr_jose_signature_t *signature, void *ctx,
+        int *vflags, apr_pool_t *pool)
+{
+    verify_count++;
+    return verify_cb(bb, jose, signature, ctx, vflags, pool);
+}
+
 static apr_status_t encrypt_cb(apr_bucket_brigade *brigade, apr_jose_t *jose,
         apr_jose_recipient_t *recipient, apr_jose_encryption_t *encryption,
         void *ctx, apr_pool_t *p)
@@ -1396,6 +1406,121 @@ static void test_jose_decode_jwe_json_flattened(abts_case *tc, void *data)
 
 }
 
+static void test_jose_decode_alg(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba;
+    apr_bucket_brigade *bb;
+    const char *alg, *kid;
+    apr_status_t status;
+
+    ba = apr_bucket_alloc_create(p);
+    bb = apr_brigade_create(p, ba);
+
+    /* header in two buckets, the payload is not even base64url */
+    apr_brigade_puts(bb, NULL, NULL, "eyJhbGciOiJub25lIiwidHlw");
+    apr_brigade_puts(bb, NULL, NULL, "IjoiSldUIiwia2lkIjoiazEifQ.***.");
+    status = apr_jose_decode_alg(&alg, &kid, bb, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, status);
+    ABTS_STR_EQUAL(tc, "none", alg);
+    ABTS_STR_EQUAL(tc, "k1", kid);
+
+    apr_brigade_cleanup(bb);
+    apr_brigade_puts(bb, NULL, NULL, "eyJ0eXAiOiJKV1QiLA0KICJhbGciOiJIUzI1NiJ9"
+            ".eyJpc3MiOiJqb2UifQ.");
+    status = apr_jose_decode_alg(&alg, &kid, bb, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, status);
+    ABTS_STR_EQUAL(tc, "HS256", alg);
+    ABTS_PTR_EQUAL(tc, NULL, kid);
+
+    /* no "alg" */
+    apr_brigade_cleanup(bb);
+    apr_brigade_puts(bb, NULL, NULL, "eyJpc3MiOiJqb2UifQ.eyJpc3MiOiJqb2UifQ.");
+    status = apr_jose_decode_alg(&alg, NULL, bb, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, status);
+
+    apr_brigade_cleanup(bb);
+    apr_brigade_puts(bb, NULL, NULL, "e*J.e.");
+    status = apr_jose_decode_alg(&alg, NULL, bb, p);
+    ABTS_INT_EQUAL(tc, APR_BADCH, status);
+}
+
+static void test_jose_decode_cached(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba;
+    apr_bucket_brigade *bb;
+    apr_jose_cache_t *cache;
+    apr_jose_t *jose;
+    apr_json_kv_t *kv;
+    apr_status_t status;
+    int i;
+
+    /* unsecured, expiring in 2100 */
+    const char *source = "eyJhbGciOiJub25lIiwidHlwIjoiSldUIiwia2lkIjoiazEifQ"
+            "."
+            "eyJpc3MiOiJqb2UiLCJleHAiOjQxMDI0NDQ4MDB9"
+            ".";
+    /* expired in 2011 */
+    const char *expired = "eyJhbGciOiJub25lIn0"
+            "."
+            "eyJpc3MiOiJqb2UiLA0KICJleHAiOjEzMDA4MTkzODAsDQogImh0dHA6Ly9leGFt"
+            "cGxlLmNvbS9pc19yb290Ijp0cnVlfQ"
+            ".";
+
+    apr_jose_cb_t cb;
+
+    cb.verify = verify_count_cb;
+    cb.decrypt = decrypt_cb;
+    cb.ctx = tc;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_jose_cache_create(&cache, 100, p));
+
+    ba = apr_bucket_alloc_create(p);
+    bb = apr_brigade_create(p, ba);
+
+    verify_count = 0;
+    for (i = 0; i < 3; i++) {
+        apr_brigade_cleanup(bb);
+        apr_brigade_write(bb, NULL, NULL, source, strlen(source));
+
+        jose = NULL;
+        status = apr_jose_decode_cached(&jose, "JWT", bb, &cb, cache, 10,
+                APR_JOSE_FLAG_NONE, p);
+
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, status);
+        ABTS_PTR_NOTNULL(tc, jose);
+        ABTS_INT_EQUAL(tc, APR_JOSE_TYPE_JWT, jose->type);
+
+        kv = apr_json_object_get(jose->jose.jwt->claims, "iss",
+                APR_JSON_VALUE_STRING);
+        ABTS_PTR_NOTNULL(tc, kv);
+    }
+    ABTS_INT_EQUAL(tc, 1, verify_count);
+
+    /* expired tokens are verified every time */
+    verify_count = 0;
+    for (i = 0; i < 2; i++) {
+        apr_brigade_cleanup(bb);
+        apr_brigade_write(bb, NULL, NULL, expired, strlen(expired));
+
+        jose = NULL;
+        status = apr_jose_decode_cached(&jose, "JWT", bb, &cb, cache, 10,
+                APR_JOSE_FLAG_NONE, p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, status);
+    }
+    ABTS_INT_EQUAL(tc, 2, verify_count);
+
+    /* and everything once cleared */
+    apr_jose_cache_clear(cache);
+    verify_count = 0;
+    apr_brigade_cleanup(bb);
+    apr_brigade_write(bb, NULL, NULL, source, strlen(source));
+    jose = NULL;
+    status = apr_jose_decode_cached(&jose, "JWT", bb, &cb, cache, 10,
+            APR_JOSE_FLAG_DECODE_ALL, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, status);
+    ABTS_INT_EQUAL(tc, 1, verify_count);
+}
+
 abts_suite *testjose(abts_suite *suite)
 {
         suite = ADD_SUITE(suite);
@@ -1407,6 +1532,8 @@ abts_suite *testjose(abts_suite *suite)
         abts_run_test(suite, test_jose_decode_jwe_compact_rsaes_oaep_aes_gcm, NULL);
         abts_run_test(suite, test_jose_decode_jwe_json_general, NULL);
         abts_run_test(suite, test_jose_decode_jwe_json_flattened, NULL);
+        abts_run_test(suite, test_jose_decode_alg, NULL);
+        abts_run_test(suite, test_jose_decode_cached, NULL);
 
         abts_run_test(suite, test_jose_encode_jws_compact_unsecured, NULL);
         abts_run_test(suite, test_jose_encode_jws_compact_hs256, NULL);
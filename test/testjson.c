@@ -19,6 +19,7 @@
 #include <stdlib.h>
 
 #include "apr_json.h"
+#include "apr_strbuf.h"
 
 #include "abts.h"
 #include "testutil.h"
@@ -63,26 +64,26 @@ static void test_json_identity(abts_case * tc, void *data)
 
     ABTS_SIZE_EQUAL(tc, len, (apr_size_t)offset);
     ABTS_INT_EQUAL(tc, APR_JSON_OBJECT, json->type);
-    image = apr_hash_get(json->value.object->hash, "Image", 5);
+    image = apr_json_object_get(json, "Image", 5);
     ABTS_PTR_NOTNULL(tc, image);
-    width = apr_hash_get(image->v->value.object->hash, "Width", 5);
+    width = apr_json_object_get(image->v, "Width", 5);
     ABTS_PTR_NOTNULL(tc, width);
     ABTS_INT_EQUAL(tc, APR_JSON_LONG, width->v->type);
     ABTS_LLONG_EQUAL(tc, 800, width->v->value.lnumber);
-    ids = apr_hash_get(image->v->value.object->hash, "IDs", 3);
+    ids = apr_json_object_get(image->v, "IDs", 3);
     ABTS_PTR_NOTNULL(tc, ids);
     ABTS_INT_EQUAL(tc, APR_JSON_ARRAY, ids->v->type);
-    title = apr_hash_get(image->v->value.object->hash, "Title", 5);
+    title = apr_json_object_get(image->v, "Title", 5);
     ABTS_PTR_NOTNULL(tc, title);
     ABTS_INT_EQUAL(tc, APR_JSON_STRING, title->v->type);
-    animated = apr_hash_get(image->v->value.object->hash, "Animated", 8);
+    animated = apr_json_object_get(image->v, "Animated", 8);
     ABTS_PTR_NOTNULL(tc, animated);
     ABTS_INT_EQUAL(tc, APR_JSON_BOOLEAN, animated->v->type);
     ABTS_TRUE(tc, !animated->v->value.boolean);
-    thumbnail = apr_hash_get(image->v->value.object->hash, "Thumbnail", 9);
+    thumbnail = apr_json_object_get(image->v, "Thumbnail", 9);
     ABTS_PTR_NOTNULL(tc, thumbnail);
     ABTS_INT_EQUAL(tc, APR_JSON_OBJECT, thumbnail->v->type);
-    height = apr_hash_get(image->v->value.object->hash, "Height", 6);
+    height = apr_json_object_get(image->v, "Height", 6);
     ABTS_PTR_NOTNULL(tc, height);
     ABTS_INT_EQUAL(tc, APR_JSON_LONG, height->v->type);
     ABTS_LLONG_EQUAL(tc, 600, height->v->value.lnumber);
@@ -170,7 +171,7 @@ static void test_json_overlay(abts_case * tc, void *data)
     ABTS_INT_EQUAL(tc, APR_SUCCESS, status);
 
     res = apr_json_overlay(p, overlay, base, APR_JSON_FLAGS_NONE);
-    ABTS_INT_EQUAL(tc, 5, apr_hash_count(res->value.object->hash));
+    ABTS_INT_EQUAL(tc, 5, res->value.object->count);
 
     res = apr_json_overlay(p, overlay, base, APR_JSON_FLAGS_STRICT);
     ABTS_ASSERT(tc, "overlay strict should return NULL",
@@ -276,6 +277,442 @@ static void test_json_create(abts_case* tc, void* data)
                    buf);
 }
 
+static void test_json_long_runs(abts_case * tc, void *data)
+{
+    apr_json_value_t *json = NULL, *v;
+    apr_json_kv_t *kv;
+    apr_status_t status;
+    apr_off_t offset = 0;
+    const char *src;
+
+    /* escapes and UTF-8 spanning the chunks of the string scanner */
+    src = "\"0123456789abcdefghijklmn\\\"opqrstuvwxyz0123456789\xc3\xa9"
+          "ABCDEFGHIJKL\\u00e9MNOPQRSTUVWXYZ\xe2\x82\xac 0123456789\"";
+    status = apr_json_decode(&json, src, APR_JSON_VALUE_STRING, &offset,
+            APR_JSON_FLAGS_NONE, 10, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, status);
+    ABTS_INT_EQUAL(tc, APR_JSON_STRING, json->type);
+    ABTS_STR_EQUAL(tc, "0123456789abcdefghijklmn\"opqrstuvwxyz0123456789\xc3\xa9"
+                   "ABCDEFGHIJKL\xc3\xa9MNOPQRSTUVWXYZ\xe2\x82\xac 0123456789",
+                   json->value.string.p);
+
+    /* a bad UTF-8 continuation after a long run */
+    src = "\"0123456789abcdefghijklmnopqrstuvwxyz\xc3(\"";
+    status = apr_json_decode(&json, src, APR_JSON_VALUE_STRING, &offset,
+            APR_JSON_FLAGS_NONE, 10, p);
+    ABTS_INT_EQUAL(tc, APR_BADCH, status);
+
+    /* no trailing quote */
+    src = "[\"0123456789abcdefghijklmnopqrstuvwxyz";
+    status = apr_json_decode(&json, src, APR_JSON_VALUE_STRING, &offset,
+            APR_JSON_FLAGS_NONE, 10, p);
+    ABTS_INT_EQUAL(tc, APR_EOF, status);
+
+    /* long white space, preserved */
+    src = "{\n                                \"k\"\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t:"
+          "\r\n                                 1  ,  \"k\" : 2 }";
+    status = apr_json_decode(&json, src, APR_JSON_VALUE_STRING, &offset,
+            APR_JSON_FLAGS_WHITESPACE, 10, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, status);
+    ABTS_SIZE_EQUAL(tc, strlen(src), (apr_size_t)offset);
+
+    /* the duplicate key replaces the value in place */
+    ABTS_INT_EQUAL(tc, 1, json->value.object->count);
+    kv = apr_json_object_first(json);
+    ABTS_PTR_NOTNULL(tc, kv);
+    ABTS_LLONG_EQUAL(tc, 2, kv->v->value.lnumber);
+    ABTS_PTR_EQUAL(tc, NULL, apr_json_object_next(json, kv));
+    ABTS_STR_EQUAL(tc, "  ", kv->k->pre);
+    ABTS_STR_EQUAL(tc, " ", kv->k->post);
+
+    status = apr_json_decode(&json, "[ 1,\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n 2 ]",
+            APR_JSON_VALUE_STRING, &offset, APR_JSON_FLAGS_WHITESPACE, 10, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, status);
+    v = apr_json_array_get(json, 1);
+    ABTS_PTR_NOTNULL(tc, v);
+    ABTS_STR_EQUAL(tc, "\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n ", v->pre);
+    ABTS_LLONG_EQUAL(tc, 2, v->value.lnumber);
+}
+
+static void test_json_object_index(abts_case * tc, void *data)
+{
+    apr_json_value_t *json;
+    apr_json_kv_t *kv;
+    apr_off_t offset;
+    apr_status_t status;
+    char key[16];
+    int i;
+
+    /* small objects have no hash */
+    status = apr_json_decode(&json, "{\"a\":1,\"b\":2,\"a\":3}",
+            APR_JSON_VALUE_STRING, &offset, APR_JSON_FLAGS_NONE, 10, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, status);
+    ABTS_INT_EQUAL(tc, 2, json->value.object->count);
+    kv = apr_json_object_get(json, "a", APR_JSON_VALUE_STRING);
+    ABTS_PTR_NOTNULL(tc, kv);
+    ABTS_LLONG_EQUAL(tc, 3, kv->v->value.lnumber);
+    ABTS_PTR_EQUAL(tc, NULL, apr_json_object_get(json, "ab", 2));
+    ABTS_PTR_EQUAL(tc, NULL, json->value.object->hash);
+
+    /* grow past the threshold, finding every key before and after */
+    json = apr_json_object_create(p);
+    for (i = 0; i < 40; i++) {
+        apr_snprintf(key, sizeof(key), "key%d", i);
+        apr_json_object_set(json, apr_pstrdup(p, key), APR_JSON_VALUE_STRING,
+                apr_json_long_create(p, i), p);
+        apr_json_object_set(json, apr_pstrdup(p, key), APR_JSON_VALUE_STRING,
+                apr_json_long_create(p, i * 2), p);
+        ABTS_INT_EQUAL(tc, i + 1, json->value.object->count);
+    }
+    ABTS_PTR_NOTNULL(tc, json->value.object->hash);
+    for (i = 0; i < 40; i++) {
+        apr_snprintf(key, sizeof(key), "key%d", i);
+        kv = apr_json_object_get(json, key, APR_JSON_VALUE_STRING);
+        ABTS_PTR_NOTNULL(tc, kv);
+        ABTS_LLONG_EQUAL(tc, i * 2, kv->v->value.lnumber);
+    }
+
+    /* deleting keeps the list and hash in step */
+    apr_json_object_set(json, "key7", APR_JSON_VALUE_STRING, NULL, p);
+    apr_json_object_set(json, "nokey", APR_JSON_VALUE_STRING, NULL, p);
+    ABTS_INT_EQUAL(tc, 39, json->value.object->count);
+    ABTS_PTR_EQUAL(tc, NULL, apr_json_object_get(json, "key7", 4));
+    for (kv = apr_json_object_first(json), i = 0; kv;
+         kv = apr_json_object_next(json, kv), i++) {
+        ABTS_LLONG_EQUAL(tc, (i < 7 ? i : i + 1) * 2, kv->v->value.lnumber);
+    }
+    ABTS_INT_EQUAL(tc, 39, i);
+}
+
+/* Decode the tokens available, as text */
+static apr_status_t json_tokens(apr_json_reader_t *reader, apr_strbuf_t *sb)
+{
+    apr_json_token_t token;
+    apr_status_t status;
+
+    while ((status = apr_json_reader_next(reader, &token)) == APR_SUCCESS) {
+        apr_json_value_t *v = &token.value;
+
+        apr_strbuf_appendf(sb, "%d", token.level);
+        switch (token.type) {
+        case APR_JSON_TOKEN_OBJECT_START:
+            apr_strbuf_appendc(sb, '{');
+            break;
+        case APR_JSON_TOKEN_OBJECT_END:
+            apr_strbuf_appendc(sb, '}');
+            break;
+        case APR_JSON_TOKEN_ARRAY_START:
+            apr_strbuf_appendc(sb, '[');
+            break;
+        case APR_JSON_TOKEN_ARRAY_END:
+            apr_strbuf_appendc(sb, ']');
+            break;
+        case APR_JSON_TOKEN_KEY:
+            apr_strbuf_appendf(sb, "<%s>", v->value.string.p);
+            break;
+        case APR_JSON_TOKEN_VALUE:
+            switch (v->type) {
+            case APR_JSON_STRING:
+                apr_strbuf_appendf(sb, "\"%s\"", v->value.string.p);
+                break;
+            case APR_JSON_LONG:
+                apr_strbuf_appendf(sb, "%" APR_INT64_T_FMT, v->value.lnumber);
+                break;
+            case APR_JSON_DOUBLE:
+                apr_strbuf_appendf(sb, "%g", v->value.dnumber);
+                break;
+            case APR_JSON_BOOLEAN:
+                apr_strbuf_appendstr(sb, v->value.boolean ? "true" : "false");
+                break;
+            case APR_JSON_NULL:
+                apr_strbuf_appendstr(sb, "null");
+                break;
+            default:
+                apr_strbuf_appendc(sb, '?');
+                break;
+            }
+            break;
+        }
+        apr_strbuf_appendc(sb, ' ');
+    }
+
+    return status;
+}
+
+static void test_json_reader(abts_case * tc, void *data)
+{
+    const char *src = "{\"a\" : [1, -2.5e1, true, false, null, \"x\\\"y\\u00e9\"],"
+                      " \"empty\":{}, \"e2\" : [ ] }\n"
+                      "[\"0123456789abcdefghijklmnopqrstuvwxyz\", 12345678]\n"
+                      "42 \"top\"";
+    apr_json_reader_t *reader;
+    apr_bucket_alloc_t *ba;
+    apr_bucket_brigade *bb;
+    apr_strbuf_t sb, sb1;
+    apr_size_t i, len = strlen(src);
+
+    /* all at once */
+    apr_strbuf_init(&sb, p, 0);
+    APR_ASSERT_SUCCESS(tc, "create reader", apr_json_reader_create(&reader, 10, p));
+    apr_json_reader_write(reader, src, strlen(src));
+    ABTS_INT_EQUAL(tc, APR_EAGAIN, json_tokens(reader, &sb));
+    apr_json_reader_eos(reader);
+    ABTS_INT_EQUAL(tc, APR_EOF, json_tokens(reader, &sb));
+    ABTS_STR_EQUAL(tc, "0{ 1<a> 1[ 21 2-25 2true 2false 2null 2\"x\"y\xc3\xa9\" 1] "
+                   "1<empty> 1{ 1} 1<e2> 1[ 1] 0} "
+                   "0[ 1\"0123456789abcdefghijklmnopqrstuvwxyz\" 112345678 0] "
+                   "042 0\"top\" ", sb.data);
+
+    /* octet by octet */
+    apr_strbuf_init(&sb1, p, 0);
+    APR_ASSERT_SUCCESS(tc, "create reader", apr_json_reader_create(&reader, 10, p));
+    for (i = 0; src[i]; i++) {
+        apr_json_reader_write(reader, src + i, 1);
+        ABTS_INT_EQUAL(tc, APR_EAGAIN, json_tokens(reader, &sb1));
+    }
+    apr_json_reader_eos(reader);
+    ABTS_INT_EQUAL(tc, APR_EOF, json_tokens(reader, &sb1));
+    ABTS_STR_EQUAL(tc, sb.data, sb1.data);
+    ABTS_INT_EQUAL(tc, strlen(src), (int)apr_json_reader_offset(reader));
+
+    /* from a brigade, in pieces */
+    ba = apr_bucket_alloc_create(p);
+    bb = apr_brigade_create(p, ba);
+    apr_strbuf_init(&sb1, p, 0);
+    APR_ASSERT_SUCCESS(tc, "create reader", apr_json_reader_create(&reader, 10, p));
+    apr_json_reader_brigade(reader, bb);
+    for (i = 0; i < len; i += 7) {
+        apr_brigade_write(bb, NULL, NULL, src + i, len - i < 7 ? len - i : 7);
+        APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_flush_create(ba));
+    }
+    ABTS_INT_EQUAL(tc, APR_EAGAIN, json_tokens(reader, &sb1));
+    ABTS_TRUE(tc, APR_BRIGADE_EMPTY(bb));
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_eos_create(ba));
+    ABTS_INT_EQUAL(tc, APR_EOF, json_tokens(reader, &sb1));
+    ABTS_STR_EQUAL(tc, sb.data, sb1.data);
+}
+
+static void test_json_reader_errors(abts_case * tc, void *data)
+{
+    static const struct {
+        const char *src;
+        apr_status_t status;
+        int offset;
+    } tests[] = {
+        { "[1,]", APR_BADCH, 3 },
+        { "[1 2]", APR_BADCH, 3 },
+        { "{\"a\" 1}", APR_BADCH, 5 },
+        { "{1:2}", APR_BADCH, 1 },
+        { "{\"a\":1]", APR_BADCH, 6 },
+        { "]", APR_BADCH, 0 },
+        { "[tru]", APR_BADCH, 1 },
+        { "[nul", APR_INCOMPLETE, 1 },
+        { "[1", APR_INCOMPLETE, 2 },
+        { "[\"abc", APR_INCOMPLETE, 1 },
+        { "{\"a\":", APR_INCOMPLETE, 5 },
+        { "[[[[1]]]]", APR_EINVAL, 3 },
+    };
+    apr_json_reader_t *reader;
+    apr_strbuf_t sb;
+    int i;
+
+    for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        APR_ASSERT_SUCCESS(tc, "create reader",
+                apr_json_reader_create(&reader, 3, p));
+        apr_strbuf_init(&sb, p, 0);
+        apr_json_reader_write(reader, tests[i].src, strlen(tests[i].src));
+        apr_json_reader_eos(reader);
+        ABTS_INT_EQUAL(tc, tests[i].status, json_tokens(reader, &sb));
+        ABTS_INT_EQUAL(tc, tests[i].offset, (int)apr_json_reader_offset(reader));
+        /* and again */
+        ABTS_INT_EQUAL(tc, tests[i].status, json_tokens(reader, &sb));
+    }
+}
+
+static void test_json_insitu(abts_case * tc, void *data)
+{
+    char *src = apr_pstrdup(p, "{\"plain\": \"0123456789abcdefghijklmnopqrstuvwxyz\","
+                               " \"a\\tb\": [\"x\\\"y\\u00e9\\u20ac\\/\", \"\"]}");
+    const char *end = src + strlen(src);
+    apr_json_value_t *json, *v;
+    apr_json_kv_t *kv;
+    apr_off_t offset;
+    apr_status_t status;
+
+    status = apr_json_decode(&json, src, APR_JSON_VALUE_STRING, &offset,
+            APR_JSON_FLAGS_INSITU, 10, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, status);
+    ABTS_PTR_EQUAL(tc, end, src + offset);
+
+    kv = apr_json_object_get(json, "plain", APR_JSON_VALUE_STRING);
+    ABTS_PTR_NOTNULL(tc, kv);
+    ABTS_STR_EQUAL(tc, "plain", kv->k->value.string.p);
+    ABTS_PTR_EQUAL(tc, src + 2, kv->k->value.string.p);
+    ABTS_STR_EQUAL(tc, "0123456789abcdefghijklmnopqrstuvwxyz",
+                   kv->v->value.string.p);
+    ABTS_INT_EQUAL(tc, 36, (int)kv->v->value.string.len);
+    ABTS_TRUE(tc, kv->v->value.string.p > src && kv->v->value.string.p < end);
+
+    kv = apr_json_object_get(json, "a\tb", APR_JSON_VALUE_STRING);
+    ABTS_PTR_NOTNULL(tc, kv);
+    ABTS_INT_EQUAL(tc, 3, (int)kv->k->value.string.len);
+    v = apr_json_array_get(kv->v, 0);
+    ABTS_STR_EQUAL(tc, "x\"y\xc3\xa9\xe2\x82\xac/", v->value.string.p);
+    ABTS_INT_EQUAL(tc, 9, (int)v->value.string.len);
+    ABTS_TRUE(tc, v->value.string.p > src && v->value.string.p < end);
+    v = apr_json_array_get(kv->v, 1);
+    ABTS_STR_EQUAL(tc, "", v->value.string.p);
+    ABTS_TRUE(tc, v->value.string.p > src && v->value.string.p < end);
+
+    /* errors are the same */
+    src = apr_pstrdup(p, "[\"abc\\q\"]");
+    status = apr_json_decode(&json, src, APR_JSON_VALUE_STRING, &offset,
+            APR_JSON_FLAGS_INSITU, 10, p);
+    ABTS_INT_EQUAL(tc, APR_BADCH, status);
+    ABTS_INT_EQUAL(tc, 6, (int)offset);
+}
+
+static apr_status_t json_flush(apr_bucket_brigade *bb, void *ctx)
+{
+    apr_strbuf_t *sb = ctx;
+    apr_bucket *e;
+
+    while (!APR_BRIGADE_EMPTY(bb)) {
+        const char *data;
+        apr_size_t len;
+
+        e = APR_BRIGADE_FIRST(bb);
+        apr_bucket_read(e, &data, &len, APR_BLOCK_READ);
+        apr_strbuf_append(sb, data, len);
+        apr_bucket_delete(e);
+    }
+    apr_strbuf_appendc(sb, '|');
+    return APR_SUCCESS;
+}
+
+static void test_json_encode(abts_case * tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb = apr_brigade_create(p, ba);
+    const char *expect = "[\"0123456789abcdef\xc3\xa9\xe2\x82\xac\xf0\x9d\x84\x9e"
+            "\\u0001\\u001f\\\"\\\\/\\n\\r\\t\\b\\f 0123456789abcdef\","
+            "\"\xef\xbf\xbd \xef\xbf\xbd( \xef\xbf\xbd\xef\xbf\xbd "
+            "\xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd "
+            "\xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd "
+            "\xef\xbf\xbd\xef\xbf\xbd\","
+            "\"a\\u0000b\",-9223372036854775808,0,1.500000]";
+    apr_json_value_t *json;
+    apr_strbuf_t sb;
+    char *out;
+    apr_size_t len;
+    int i;
+
+    /* valid UTF-8 is kept, invalid octets are replaced */
+    json = apr_json_array_create(p, 4);
+    apr_json_array_add(json, apr_json_string_create(p,
+            "0123456789abcdef\xc3\xa9\xe2\x82\xac\xf0\x9d\x84\x9e"
+            "\x01\x1f\"\\/\n\r\t\b\f 0123456789abcdef", APR_JSON_VALUE_STRING));
+    apr_json_array_add(json, apr_json_string_create(p,
+            "\x80 \xc3( \xc0\x80 \xed\xa0\x80 \xf4\x90\x80\x80 \xe2\x82",
+            APR_JSON_VALUE_STRING));
+    apr_json_array_add(json, apr_json_string_create(p, "a\0b", 3));
+    apr_json_array_add(json, apr_json_long_create(p, -9223372036854775807LL - 1));
+    apr_json_array_add(json, apr_json_long_create(p, 0));
+    apr_json_array_add(json, apr_json_double_create(p, 1.5));
+
+    APR_ASSERT_SUCCESS(tc, "encode",
+            apr_json_encode(bb, NULL, NULL, json, APR_JSON_FLAGS_NONE, p));
+    apr_brigade_pflatten(bb, &out, &len, p);
+    ABTS_SIZE_EQUAL(tc, strlen(expect), len);
+    ABTS_STR_NEQUAL(tc, expect, out, len);
+    ABTS_TRUE(tc, APR_BUCKET_IS_HEAP(APR_BRIGADE_FIRST(bb)));
+    ABTS_PTR_EQUAL(tc, APR_BRIGADE_LAST(bb), APR_BRIGADE_FIRST(bb));
+    apr_brigade_cleanup(bb);
+
+    /* a long output is flushed by pieces */
+    json = apr_json_array_create(p, 10000);
+    for (i = 0; i < 10000; i++) {
+        apr_json_array_add(json, apr_json_string_create(p,
+                "a longer string value", APR_JSON_VALUE_STRING));
+    }
+    apr_strbuf_init(&sb, p, 0);
+    APR_ASSERT_SUCCESS(tc, "encode",
+            apr_json_encode(bb, json_flush, &sb, json, APR_JSON_FLAGS_NONE, p));
+    json_flush(bb, &sb);
+    ABTS_TRUE(tc, strchr(sb.data, '|') < sb.data + sb.len - 1);
+    out = apr_pstrdup(p, sb.data);
+    for (i = 0, len = 0; out[i]; i++) {
+        if (out[i] != '|') {
+            out[len++] = out[i];
+        }
+    }
+    ABTS_SIZE_EQUAL(tc, 2 + 10000 * 24 - 1, len);
+}
+
+static void test_json_extract(abts_case * tc, void *data)
+{
+    const char *src = "{\"a\": {\"b\": [10, {\"c\": \"x\"}], \"s\\\"k\": 1,"
+                      " \"m~n/o\": 2, \"skip\": [[{}], \"\\\"]\", -1.5e3]},"
+                      " \"k\": {\"x\": 1}, \"k\": {\"y\": 2}}";
+    const char *paths[] = { "/a/b/1/c", "/a/b/0", "/a/s\"k", "/a/m~0n~1o",
+                            "/missing", "/a/b/01", "/a/b/2", "", "/a",
+                            "/a/b/1", "/k/x", "/k/y", "/a/b/0/z" };
+    apr_json_value_t *results[13], *json;
+    apr_off_t offset, doffset;
+    apr_status_t status;
+
+    status = apr_json_extract(results, src, APR_JSON_VALUE_STRING, &offset,
+            paths, 13, APR_JSON_FLAGS_NONE, 10, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, status);
+    ABTS_INT_EQUAL(tc, strlen(src), (int)offset);
+
+    ABTS_PTR_NOTNULL(tc, results[0]);
+    ABTS_STR_EQUAL(tc, "x", results[0]->value.string.p);
+    ABTS_PTR_NOTNULL(tc, results[1]);
+    ABTS_LLONG_EQUAL(tc, 10, results[1]->value.lnumber);
+    ABTS_PTR_NOTNULL(tc, results[2]);
+    ABTS_LLONG_EQUAL(tc, 1, results[2]->value.lnumber);
+    ABTS_PTR_NOTNULL(tc, results[3]);
+    ABTS_LLONG_EQUAL(tc, 2, results[3]->value.lnumber);
+    ABTS_PTR_EQUAL(tc, NULL, results[4]);
+    ABTS_PTR_EQUAL(tc, NULL, results[5]);
+    ABTS_PTR_EQUAL(tc, NULL, results[6]);
+    ABTS_PTR_NOTNULL(tc, results[7]);
+    ABTS_INT_EQUAL(tc, APR_JSON_OBJECT, results[7]->type);
+    ABTS_PTR_NOTNULL(tc, results[8]);
+    ABTS_INT_EQUAL(tc, 4, results[8]->value.object->count);
+    ABTS_PTR_NOTNULL(tc, results[9]);
+    ABTS_INT_EQUAL(tc, APR_JSON_OBJECT, results[9]->type);
+    /* the later "k" replaces the earlier one */
+    ABTS_PTR_EQUAL(tc, NULL, results[10]);
+    ABTS_PTR_NOTNULL(tc, results[11]);
+    ABTS_LLONG_EQUAL(tc, 2, results[11]->value.lnumber);
+    ABTS_PTR_EQUAL(tc, NULL, results[12]);
+
+    /* errors in skipped values are found, as when decoding */
+    src = "{\"a\": 1, \"z\": [1, {\"q\" 2}]}";
+    status = apr_json_extract(results, src, APR_JSON_VALUE_STRING, &offset,
+            paths + 4, 1, APR_JSON_FLAGS_NONE, 10, p);
+    ABTS_INT_EQUAL(tc, APR_BADCH, status);
+    ABTS_INT_EQUAL(tc, APR_BADCH, apr_json_decode(&json, src,
+            APR_JSON_VALUE_STRING, &doffset, APR_JSON_FLAGS_NONE, 10, p));
+    ABTS_INT_EQUAL(tc, (int)doffset, (int)offset);
+
+    status = apr_json_extract(results, "[[[1]]]", APR_JSON_VALUE_STRING,
+            &offset, paths + 4, 1, APR_JSON_FLAGS_NONE, 2, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, status);
+
+    /* a pointer starts with a '/', and '~' is escaped */
+    paths[0] = "a";
+    status = apr_json_extract(results, "{}", APR_JSON_VALUE_STRING, &offset,
+            paths, 1, APR_JSON_FLAGS_NONE, 10, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, status);
+    paths[0] = "/a~2";
+    status = apr_json_extract(results, "{}", APR_JSON_VALUE_STRING, &offset,
+            paths, 1, APR_JSON_FLAGS_NONE, 10, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, status);
+}
+
 abts_suite *testjson(abts_suite * suite)
 {
     suite = ADD_SUITE(suite);
@@ -288,6 +725,13 @@ abts_suite *testjson(abts_suite * suite)
     abts_run_test(suite, test_json_object_iterate, NULL);
     abts_run_test(suite, test_json_array_iterate, NULL);
     abts_run_test(suite, test_json_create, NULL);
+    abts_run_test(suite, test_json_long_runs, NULL);
+    abts_run_test(suite, test_json_object_index, NULL);
+    abts_run_test(suite, test_json_reader, NULL);
+    abts_run_test(suite, test_json_reader_errors, NULL);
+    abts_run_test(suite, test_json_insitu, NULL);
+    abts_run_test(suite, test_json_encode, NULL);
+    abts_run_test(suite, test_json_extract, NULL);
 
     return suite;
 }
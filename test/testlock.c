@@ -302,6 +302,79 @@ static void test_thread_rwlock(abts_case *tc, void *data)
     apr_thread_rwlock_destroy(rwlock);
 }
 
+/* Read mostly: the readers check that they never see a writer halfway */
+static void *APR_THREAD_FUNC thread_rwlock_reader_func(apr_thread_t *thd,
+                                                       void *data)
+{
+    apr_status_t rv = APR_SUCCESS;
+    int n = 0, done = 0;
+
+    while (!done) {
+        apr_thread_rwlock_rdlock(rwlock);
+        if (i != x) {
+            rv = APR_EGENERAL;
+        }
+        done = (i == MAX_ITER);
+        apr_thread_rwlock_unlock(rwlock);
+
+        if (++n % 8 == 0) {
+            apr_thread_rwlock_wrlock(rwlock);
+            if (i != MAX_ITER) {
+                i++;
+                apr_thread_yield();
+                x++;
+            }
+            apr_thread_rwlock_unlock(rwlock);
+        }
+    }
+
+    apr_thread_exit(thd, rv);
+    return NULL;
+}
+
+static void test_thread_distributed_rwlock(abts_case *tc, void *data)
+{
+    apr_thread_t *t[4];
+    apr_status_t rv;
+    int n;
+
+    rv = apr_thread_rwlock_create_ex(&rwlock, APR_THREAD_RWLOCK_DISTRIBUTED,
+                                     p);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "rwlocks not implemented");
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "rwlock_create_ex", rv);
+    ABTS_PTR_NOTNULL(tc, rwlock);
+
+    /* Readers share, writers exclude everyone */
+    APR_ASSERT_SUCCESS(tc, "rdlock", apr_thread_rwlock_rdlock(rwlock));
+    ABTS_INT_EQUAL(tc, APR_EBUSY, apr_thread_rwlock_trywrlock(rwlock));
+    APR_ASSERT_SUCCESS(tc, "unlock", apr_thread_rwlock_unlock(rwlock));
+    APR_ASSERT_SUCCESS(tc, "trywrlock", apr_thread_rwlock_trywrlock(rwlock));
+    ABTS_INT_EQUAL(tc, APR_EBUSY, apr_thread_rwlock_tryrdlock(rwlock));
+    ABTS_INT_EQUAL(tc, APR_EBUSY, apr_thread_rwlock_trywrlock(rwlock));
+    APR_ASSERT_SUCCESS(tc, "unlock", apr_thread_rwlock_unlock(rwlock));
+    APR_ASSERT_SUCCESS(tc, "tryrdlock", apr_thread_rwlock_tryrdlock(rwlock));
+    APR_ASSERT_SUCCESS(tc, "unlock", apr_thread_rwlock_unlock(rwlock));
+
+    i = 0;
+    x = 0;
+
+    for (n = 0; n < 4; n++) {
+        rv = apr_thread_create(&t[n], NULL, thread_rwlock_reader_func,
+                               NULL, p);
+        APR_ASSERT_SUCCESS(tc, "create thread", rv);
+    }
+    for (n = 0; n < 4; n++) {
+        JOIN_WITH_SUCCESS(tc, t[n]);
+    }
+
+    ABTS_INT_EQUAL(tc, MAX_ITER, x);
+
+    APR_ASSERT_SUCCESS(tc, "rwlock_destroy", apr_thread_rwlock_destroy(rwlock));
+}
+
 static void test_cond(abts_case *tc, void *data)
 {
     apr_thread_t *p1, *p2, *p3, *p4, *c1;
@@ -492,6 +565,64 @@ static void test_thread_unnestedmutex(abts_case *tc, void *data)
     ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
 }
 
+static void test_thread_adaptivemutex(abts_case *tc, void *data)
+{
+    apr_thread_t *t1, *t2, *t3, *t4;
+    apr_thread_mutex_stats_t stats;
+    apr_thread_mutex_t *m;
+    apr_status_t rv;
+
+    rv = apr_thread_mutex_create(&thread_mutex, APR_THREAD_MUTEX_ADAPTIVE
+                                                | APR_THREAD_MUTEX_STATS, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_PTR_NOTNULL(tc, thread_mutex);
+
+    i = 0;
+    x = 0;
+
+    rv = apr_thread_create(&t1, NULL, thread_mutex_function, NULL, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_thread_create(&t2, NULL, thread_mutex_function, NULL, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_thread_create(&t3, NULL, thread_mutex_function, NULL, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_thread_create(&t4, NULL, thread_mutex_function, NULL, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    JOIN_WITH_SUCCESS(tc, t1);
+    JOIN_WITH_SUCCESS(tc, t2);
+    JOIN_WITH_SUCCESS(tc, t3);
+    JOIN_WITH_SUCCESS(tc, t4);
+
+    ABTS_INT_EQUAL(tc, MAX_ITER, x);
+
+    rv = apr_thread_mutex_stats_get(thread_mutex, &stats);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "mutex statistics");
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* each thread locks once more to see the counter done */
+    ABTS_ASSERT(tc, "acquisitions", stats.acquired == MAX_ITER + 4);
+    ABTS_ASSERT(tc, "contended acquisitions",
+                stats.contended <= stats.acquired);
+    ABTS_ASSERT(tc, "wait time", stats.contended || !stats.wait_time);
+
+    rv = apr_thread_mutex_trylock(thread_mutex);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_thread_mutex_unlock(thread_mutex);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_thread_mutex_stats_get(thread_mutex, &stats);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_ASSERT(tc, "trylock acquisition", stats.acquired == MAX_ITER + 5);
+
+    rv = apr_thread_mutex_create(&m, APR_THREAD_MUTEX_DEFAULT, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_thread_mutex_stats_get(m, &stats);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+}
+
 #ifdef WIN32
 static void *APR_THREAD_FUNC
 thread_win32_abandoned_mutex_function(apr_thread_t *thd, void *data)
@@ -554,7 +685,9 @@ abts_suite *testlock(abts_suite *suite)
     abts_run_test(suite, test_thread_timedmutex, NULL);
     abts_run_test(suite, test_thread_nestedmutex, NULL);
     abts_run_test(suite, test_thread_unnestedmutex, NULL);
+    abts_run_test(suite, test_thread_adaptivemutex, NULL);
     abts_run_test(suite, test_thread_rwlock, NULL);
+    abts_run_test(suite, test_thread_distributed_rwlock, NULL);
     abts_run_test(suite, test_cond, NULL);
     abts_run_test(suite, test_timeoutcond, NULL);
     abts_run_test(suite, test_timeoutmutex, NULL);
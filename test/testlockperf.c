@@ -14,16 +14,33 @@
  * limitations under the License.
  */
 
+/*
+ * Times the locks and the atomics over 1 to N threads (or processes for
+ * the process mutexes), reporting the throughput and the 99th percentile
+ * of the time taken to acquire the lock, so that the mechanisms can be
+ * compared on a platform.
+ */
+
 #include "apr_thread_proc.h"
 #include "apr_thread_mutex.h"
 #include "apr_thread_rwlock.h"
+#include "apr_thread_cond.h"
+#include "apr_proc_mutex.h"
+#include "apr_global_mutex.h"
+#include "apr_atomic.h"
+#include "apr_shm.h"
 #include "apr_file_io.h"
 #include "apr_errno.h"
 #include "apr_general.h"
 #include "apr_getopt.h"
+#include "apr_strings.h"
 #include "errno.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+#if APR_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 #include "testutil.h"
 
 #if !APR_HAS_THREADS
@@ -35,257 +52,571 @@ int main(void)
 }
 #else /* !APR_HAS_THREADS */
 
-#define DEFAULT_MAX_COUNTER 1000000
-#define MAX_THREADS 6
+#define DEFAULT_MAX_COUNTER 200000
+#define DEFAULT_MAX_THREADS 4
+/* One acquisition in SAMPLE_RATE is timed */
+#define SAMPLE_RATE 8
 
 static int verbose = 0;
-static long mutex_counter;
 static long max_counter = DEFAULT_MAX_COUNTER;
+static int max_threads = 0;
 
-static apr_thread_mutex_t *thread_lock;
-void * APR_THREAD_FUNC thread_mutex_func(apr_thread_t *thd, void *data);
-apr_status_t test_thread_mutex(int num_threads); /* apr_thread_mutex_t */
+apr_pool_t *pool;
+
+/* The lock under test, taken and released by the threads */
+static void (*bench_lock)(long i);
+static void (*bench_unlock)(long i);
 
+static long mutex_counter;
+static volatile apr_uint32_t bench_go;
+
+static apr_thread_mutex_t *thread_lock;
 static apr_thread_rwlock_t *thread_rwlock;
-void * APR_THREAD_FUNC thread_rwlock_func(apr_thread_t *thd, void *data);
-apr_status_t test_thread_rwlock(int num_threads); /* apr_thread_rwlock_t */
+static apr_global_mutex_t *global_lock;
+static apr_proc_mutex_t *proc_lock;
+static apr_interval_time_t timeout;
+static int write_percent;
 
-int test_thread_mutex_nested(int num_threads);
+static apr_uint32_t atomic32;
+static apr_uint64_t atomic64;
+static void *volatile atomicptr;
 
-apr_pool_t *pool;
-int i = 0, x = 0;
+typedef struct bench_thread_t {
+    apr_uint32_t *samples;
+    long nsamples;
+} bench_thread_t;
 
-void * APR_THREAD_FUNC thread_mutex_func(apr_thread_t *thd, void *data)
+static apr_uint64_t now_ns(void)
 {
-    int i;
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (apr_uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+    return (apr_uint64_t)apr_time_now() * 1000;
+#endif
+}
 
+/* The acquisitions of a thread or process, timing one in SAMPLE_RATE */
+static void bench_loop(bench_thread_t *bt)
+{
+    apr_uint64_t start;
+    long i;
+
+    while (!apr_atomic_read32((apr_uint32_t *)&bench_go)) {
+        apr_thread_yield();
+    }
     for (i = 0; i < max_counter; i++) {
-        if (data) {
-            apr_thread_mutex_timedlock(thread_lock, *(apr_interval_time_t *)data);
+        if (i % SAMPLE_RATE == 0) {
+            apr_uint64_t t;
+
+            start = now_ns();
+            bench_lock(i);
+            t = now_ns() - start;
+            bench_unlock(i);
+            bt->samples[bt->nsamples++] = t > APR_UINT32_MAX ? APR_UINT32_MAX
+                                                             : (apr_uint32_t)t;
         }
         else {
-            apr_thread_mutex_lock(thread_lock);
+            bench_lock(i);
+            bench_unlock(i);
         }
-        mutex_counter++;
-        apr_thread_mutex_unlock(thread_lock);
     }
+}
+
+static void * APR_THREAD_FUNC bench_thread_func(apr_thread_t *thd,
+                                                void *data)
+{
+    bench_loop(data);
     return NULL;
 }
 
-void * APR_THREAD_FUNC thread_rwlock_func(apr_thread_t *thd, void *data)
+static int sample_cmp(const void *a, const void *b)
 {
-    int i;
+    apr_uint32_t x = *(const apr_uint32_t *)a, y = *(const apr_uint32_t *)b;
 
-    for (i = 0; i < max_counter; i++) {
-        apr_thread_rwlock_wrlock(thread_rwlock);
-        mutex_counter++;
-        apr_thread_rwlock_unlock(thread_rwlock);
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, int num_threads,
+                   apr_interval_time_t usecs, apr_uint32_t *samples,
+                   long nsamples)
+{
+    double mops = usecs ? (double)max_counter * num_threads / usecs : 0.0;
+    apr_uint32_t p99 = 0;
+
+    if (nsamples) {
+        qsort(samples, nsamples, sizeof(*samples), sample_cmp);
+        p99 = samples[nsamples * 99 / 100];
     }
-    return NULL;
+    printf("    %-36s %3d: %8.2f Mops/s, p99 %8lu ns\n", name, num_threads,
+           mops, (unsigned long)p99);
+    if (verbose) {
+        printf("    %-36s      %8" APR_TIME_T_FMT " usec, median %lu ns\n",
+               "", usecs,
+               (unsigned long)(nsamples ? samples[nsamples / 2] : 0));
+    }
+    fflush(stdout);
 }
 
-int test_thread_mutex(int num_threads)
+/* Runs the lock set up in bench_lock/bench_unlock on num_threads threads */
+static apr_status_t run_threads(const char *name, int num_threads,
+                                int counted)
 {
-    apr_thread_t *t[MAX_THREADS];
-    apr_status_t s[MAX_THREADS];
-    apr_time_t time_start, time_stop;
+    apr_thread_t **t;
+    bench_thread_t *bt;
+    apr_uint32_t *samples;
+    apr_status_t rv;
+    apr_time_t start;
+    long per_thread = max_counter / SAMPLE_RATE + 1, n = 0;
     int i;
 
+    t = apr_palloc(pool, num_threads * sizeof(*t));
+    bt = apr_pcalloc(pool, num_threads * sizeof(*bt));
+    samples = apr_palloc(pool, num_threads * per_thread * sizeof(*samples));
+
     mutex_counter = 0;
+    apr_atomic_set32((apr_uint32_t *)&bench_go, 0);
+    for (i = 0; i < num_threads; ++i) {
+        bt[i].samples = samples + i * per_thread;
+        rv = apr_thread_create(&t[i], NULL, bench_thread_func, &bt[i], pool);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+    }
 
-    printf("apr_thread_mutex_t Tests\n");
-    printf("%-60s", "    Initializing the apr_thread_mutex_t (UNNESTED)");
-    s[0] = apr_thread_mutex_create(&thread_lock, APR_THREAD_MUTEX_UNNESTED, pool);
-    if (s[0] != APR_SUCCESS) {
-        printf("Failed!\n");
-        return s[0];
+    start = apr_time_now();
+    apr_atomic_set32((apr_uint32_t *)&bench_go, 1);
+    for (i = 0; i < num_threads; ++i) {
+        apr_thread_join(&rv, t[i]);
     }
-    printf("OK\n");
+    start = apr_time_now() - start;
 
-    apr_thread_mutex_lock(thread_lock);
-    /* set_concurrency(4)? -aaron */
-    printf("    Starting %d threads    ", num_threads);
+    /* Packed, for the percentiles */
     for (i = 0; i < num_threads; ++i) {
-        s[i] = apr_thread_create(&t[i], NULL, thread_mutex_func, NULL, pool);
-        if (s[i] != APR_SUCCESS) {
-            printf("Failed!\n");
-            return s[i];
-        }
+        memmove(samples + n, bt[i].samples, bt[i].nsamples * sizeof(*samples));
+        n += bt[i].nsamples;
     }
-    printf("OK\n");
+    report(name, num_threads, start, samples, n);
+
+    if (counted && mutex_counter != max_counter * num_threads) {
+        printf("error: counter = %ld\n", mutex_counter);
+        return APR_EGENERAL;
+    }
+    return APR_SUCCESS;
+}
+
+/* --------------------------------------------------------------------
+ * The locks
+ */
 
-    time_start = apr_time_now();
+static void thread_mutex_lock(long i)
+{
+    apr_thread_mutex_lock(thread_lock);
+    mutex_counter++;
+}
+
+static void thread_mutex_timedlock(long i)
+{
+    apr_thread_mutex_timedlock(thread_lock, timeout);
+    mutex_counter++;
+}
+
+static void thread_mutex_unlock(long i)
+{
     apr_thread_mutex_unlock(thread_lock);
+}
 
-    /* printf("%-60s", "    Waiting for threads to exit"); */
-    for (i = 0; i < num_threads; ++i) {
-        apr_thread_join(&s[i], t[i]);
+/* Writes write_percent of the time, reads otherwise */
+static void thread_rwlock_lock(long i)
+{
+    if (i % 100 < write_percent) {
+        apr_thread_rwlock_wrlock(thread_rwlock);
+        mutex_counter++;
+    }
+    else {
+        apr_thread_rwlock_rdlock(thread_rwlock);
     }
-    /* printf("OK\n"); */
+}
 
-    time_stop = apr_time_now();
-    printf("microseconds: %" APR_INT64_T_FMT " usec\n",
-           (time_stop - time_start));
-    if (mutex_counter != max_counter * num_threads)
-        printf("error: counter = %ld\n", mutex_counter);
+static void thread_rwlock_unlock(long i)
+{
+    apr_thread_rwlock_unlock(thread_rwlock);
+}
 
-    return APR_SUCCESS;
+static void global_mutex_lock(long i)
+{
+    apr_global_mutex_lock(global_lock);
+    mutex_counter++;
 }
 
-int test_thread_mutex_nested(int num_threads)
+static void global_mutex_unlock(long i)
 {
-    apr_thread_t *t[MAX_THREADS];
-    apr_status_t s[MAX_THREADS];
-    apr_time_t time_start, time_stop;
-    int i;
+    apr_global_mutex_unlock(global_lock);
+}
 
-    mutex_counter = 0;
+static void proc_mutex_lock(long i)
+{
+    apr_proc_mutex_lock(proc_lock);
+}
+
+static void proc_mutex_unlock(long i)
+{
+    apr_proc_mutex_unlock(proc_lock);
+}
+
+static void atomic_inc32(long i)
+{
+    apr_atomic_inc32(&atomic32);
+}
+
+static void atomic_add32(long i)
+{
+    apr_atomic_add32(&atomic32, 3);
+}
+
+static void atomic_cas32(long i)
+{
+    apr_uint32_t old;
+
+    do {
+        old = apr_atomic_read32(&atomic32);
+    } while (apr_atomic_cas32(&atomic32, old + 1, old) != old);
+}
 
-    printf("apr_thread_mutex_t Tests\n");
-    printf("%-60s", "    Initializing the apr_thread_mutex_t (NESTED)");
-    s[0] = apr_thread_mutex_create(&thread_lock, APR_THREAD_MUTEX_NESTED, pool);
-    if (s[0] != APR_SUCCESS) {
-        printf("Failed!\n");
-        return s[0];
+static void atomic_inc64(long i)
+{
+    apr_atomic_inc64(&atomic64);
+}
+
+static void atomic_xchgptr(long i)
+{
+    apr_atomic_xchgptr(&atomicptr, (void *)&atomicptr);
+}
+
+static void no_unlock(long i)
+{
+}
+
+static apr_status_t test_thread_mutex(int num_threads, unsigned int flags,
+                                      const char *name)
+{
+    apr_status_t rv;
+
+    rv = apr_thread_mutex_create(&thread_lock, flags, pool);
+    if (rv != APR_SUCCESS) {
+        return rv;
     }
-    printf("OK\n");
+    bench_lock = (flags == APR_THREAD_MUTEX_TIMED) ? thread_mutex_timedlock
+                                                   : thread_mutex_lock;
+    bench_unlock = thread_mutex_unlock;
+    rv = run_threads(name, num_threads, 1);
+    apr_thread_mutex_destroy(thread_lock);
+    return rv;
+}
 
-    apr_thread_mutex_lock(thread_lock);
-    /* set_concurrency(4)? -aaron */
-    printf("    Starting %d threads    ", num_threads);
-    for (i = 0; i < num_threads; ++i) {
-        s[i] = apr_thread_create(&t[i], NULL, thread_mutex_func, NULL, pool);
-        if (s[i] != APR_SUCCESS) {
-            printf("Failed!\n");
-            return s[i];
-        }
+static apr_status_t test_thread_rwlock(int num_threads, int percent,
+                                       const char *name)
+{
+    apr_status_t rv;
+    long expected;
+
+    rv = apr_thread_rwlock_create(&thread_rwlock, pool);
+    if (rv != APR_SUCCESS) {
+        return rv;
     }
-    printf("OK\n");
+    write_percent = percent;
+    bench_lock = thread_rwlock_lock;
+    bench_unlock = thread_rwlock_unlock;
+    rv = run_threads(name, num_threads, 0);
+    apr_thread_rwlock_destroy(thread_rwlock);
+
+    /* The writes only are counted, i % 100 < percent of the loop */
+    expected = (max_counter / 100) * percent
+               + (max_counter % 100 < percent ? max_counter % 100 : percent);
+    if (rv == APR_SUCCESS && mutex_counter != expected * num_threads) {
+        printf("error: counter = %ld\n", mutex_counter);
+        rv = APR_EGENERAL;
+    }
+    return rv;
+}
 
-    time_start = apr_time_now();
-    apr_thread_mutex_unlock(thread_lock);
+static apr_status_t test_global_mutex(int num_threads)
+{
+    apr_status_t rv;
 
-    /* printf("%-60s", "    Waiting for threads to exit"); */
-    for (i = 0; i < num_threads; ++i) {
-        apr_thread_join(&s[i], t[i]);
+    rv = apr_global_mutex_create(&global_lock, NULL, APR_LOCK_DEFAULT, pool);
+    if (rv != APR_SUCCESS) {
+        return rv;
     }
-    /* printf("OK\n"); */
+    bench_lock = global_mutex_lock;
+    bench_unlock = global_mutex_unlock;
+    rv = run_threads("apr_global_mutex_t (DEFAULT)", num_threads, 1);
+    apr_global_mutex_destroy(global_lock);
+    return rv;
+}
 
-    time_stop = apr_time_now();
-    printf("microseconds: %" APR_INT64_T_FMT " usec\n",
-           (time_stop - time_start));
-    if (mutex_counter != max_counter * num_threads)
-        printf("error: counter = %ld\n", mutex_counter);
+static apr_status_t test_atomics(int num_threads)
+{
+    static const struct {
+        void (*op)(long i);
+        const char *name;
+    } ops[] = {
+        { atomic_inc32,   "apr_atomic_inc32" },
+        { atomic_add32,   "apr_atomic_add32" },
+        { atomic_cas32,   "apr_atomic_cas32 (loop)" },
+        { atomic_inc64,   "apr_atomic_inc64" },
+        { atomic_xchgptr, "apr_atomic_xchgptr" },
+    };
+    apr_status_t rv;
+    int i;
 
+    apr_atomic_set32(&atomic32, 0);
+    apr_atomic_set64(&atomic64, 0);
+    for (i = 0; i < (int)(sizeof(ops) / sizeof(ops[0])); i++) {
+        bench_lock = ops[i].op;
+        bench_unlock = no_unlock;
+        rv = run_threads(ops[i].name, num_threads, 0);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+    }
+    if (apr_atomic_read64(&atomic64) != (apr_uint64_t)max_counter
+                                        * num_threads) {
+        printf("error: atomic64 = %" APR_UINT64_T_FMT "\n",
+               apr_atomic_read64(&atomic64));
+        return APR_EGENERAL;
+    }
     return APR_SUCCESS;
 }
 
-static int test_thread_mutex_timed(int num_threads)
+/* --------------------------------------------------------------------
+ * Condition variable ping-pong, between two threads
+ */
+
+static apr_thread_cond_t *cond;
+static int turn;
+
+static void * APR_THREAD_FUNC pong_func(apr_thread_t *thd, void *data)
 {
-    apr_thread_t *t[MAX_THREADS];
-    apr_status_t s[MAX_THREADS];
-    apr_time_t time_start, time_stop;
-    apr_time_t timeout;
-    int i;
+    long i;
 
-    mutex_counter = 0;
+    for (i = 0; i < max_counter; i++) {
+        apr_thread_mutex_lock(thread_lock);
+        while (turn != 1) {
+            apr_thread_cond_wait(cond, thread_lock);
+        }
+        turn = 0;
+        apr_thread_cond_signal(cond);
+        apr_thread_mutex_unlock(thread_lock);
+    }
+    return NULL;
+}
 
-    timeout = apr_time_from_sec(5);
+static apr_status_t test_thread_cond(void)
+{
+    apr_thread_t *t;
+    apr_uint32_t *samples;
+    apr_status_t rv;
+    apr_time_t start;
+    long i, n = 0;
 
-    printf("apr_thread_mutex_t Tests\n");
-    printf("%-60s", "    Initializing the apr_thread_mutex_t (TIMED)");
-    s[0] = apr_thread_mutex_create(&thread_lock, APR_THREAD_MUTEX_TIMED, pool);
-    if (s[0] != APR_SUCCESS) {
-        printf("Failed!\n");
-        return s[0];
+    if ((rv = apr_thread_mutex_create(&thread_lock, APR_THREAD_MUTEX_DEFAULT,
+                                      pool)) != APR_SUCCESS
+        || (rv = apr_thread_cond_create(&cond, pool)) != APR_SUCCESS) {
+        return rv;
     }
-    printf("OK\n");
+    samples = apr_palloc(pool, (max_counter / SAMPLE_RATE + 1)
+                               * sizeof(*samples));
+    turn = 0;
 
-    apr_thread_mutex_lock(thread_lock);
-    /* set_concurrency(4)? -aaron */
-    printf("    Starting %d threads    ", num_threads);
-    for (i = 0; i < num_threads; ++i) {
-        s[i] = apr_thread_create(&t[i], NULL, thread_mutex_func, &timeout, pool);
-        if (s[i] != APR_SUCCESS) {
-            printf("Failed!\n");
-            return s[i];
-        }
+    rv = apr_thread_create(&t, NULL, pong_func, NULL, pool);
+    if (rv != APR_SUCCESS) {
+        return rv;
     }
-    printf("OK\n");
 
-    time_start = apr_time_now();
-    apr_thread_mutex_unlock(thread_lock);
+    /* The time of a round trip is sampled */
+    start = apr_time_now();
+    for (i = 0; i < max_counter; i++) {
+        apr_uint64_t t0 = (i % SAMPLE_RATE == 0) ? now_ns() : 0;
 
-    /* printf("%-60s", "    Waiting for threads to exit"); */
-    for (i = 0; i < num_threads; ++i) {
-        apr_thread_join(&s[i], t[i]);
+        apr_thread_mutex_lock(thread_lock);
+        turn = 1;
+        apr_thread_cond_signal(cond);
+        while (turn != 0) {
+            apr_thread_cond_wait(cond, thread_lock);
+        }
+        apr_thread_mutex_unlock(thread_lock);
+        if (t0) {
+            samples[n++] = (apr_uint32_t)(now_ns() - t0);
+        }
     }
-    /* printf("OK\n"); */
+    apr_thread_join(&rv, t);
+    start = apr_time_now() - start;
 
-    time_stop = apr_time_now();
-    printf("microseconds: %" APR_INT64_T_FMT " usec\n",
-           (time_stop - time_start));
-    if (mutex_counter != max_counter * num_threads)
-        printf("error: counter = %ld\n", mutex_counter);
+    /* Two signals per round trip */
+    report("apr_thread_cond_t (round trips)", 2, start, samples, n);
 
+    apr_thread_cond_destroy(cond);
+    apr_thread_mutex_destroy(thread_lock);
     return APR_SUCCESS;
 }
 
-int test_thread_rwlock(int num_threads)
+#if APR_HAS_FORK && APR_HAS_SHARED_MEMORY
+
+/* --------------------------------------------------------------------
+ * Process mutexes, over as many processes
+ */
+
+static apr_status_t test_proc_mutex(int num_procs, apr_lockmech_e mech,
+                                    const char *name)
 {
-    apr_thread_t *t[MAX_THREADS];
-    apr_status_t s[MAX_THREADS];
-    apr_time_t time_start, time_stop;
+    apr_shm_t *shm;
+    apr_proc_t *procs;
+    apr_uint32_t *samples;
+    apr_size_t per_proc = max_counter / SAMPLE_RATE + 1;
+    apr_status_t rv;
+    apr_time_t start;
+    long n = 0;
     int i;
 
-    mutex_counter = 0;
+    rv = apr_proc_mutex_create(&proc_lock, NULL, mech, pool);
+    if (rv != APR_SUCCESS) {
+        /* Not on this platform */
+        return APR_SUCCESS;
+    }
 
-    printf("apr_thread_rwlock_t Tests\n");
-    printf("%-60s", "    Initializing the apr_thread_rwlock_t");
-    s[0] = apr_thread_rwlock_create(&thread_rwlock, pool);
-    if (s[0] != APR_SUCCESS) {
-        printf("Failed!\n");
-        return s[0];
+    /* The go flag, the sample counts, then the samples of each process */
+    rv = apr_shm_create(&shm, (1 + num_procs + num_procs * per_proc)
+                              * sizeof(apr_uint32_t), NULL, pool);
+    if (rv != APR_SUCCESS) {
+        apr_proc_mutex_destroy(proc_lock);
+        return rv;
+    }
+    samples = apr_shm_baseaddr_get(shm);
+    memset(samples, 0, (1 + num_procs) * sizeof(apr_uint32_t));
+    procs = apr_palloc(pool, num_procs * sizeof(*procs));
+
+    bench_lock = proc_mutex_lock;
+    bench_unlock = proc_mutex_unlock;
+    for (i = 0; i < num_procs; i++) {
+        rv = apr_proc_fork(&procs[i], pool);
+        if (rv == APR_INCHILD) {
+            bench_thread_t bt;
+
+            /* Balances the apr_terminate() at exit, which would destroy
+             * the mutex otherwise (as in testprocmutex)
+             */
+            apr_initialize();
+
+            if (apr_proc_mutex_child_init(&proc_lock,
+                                          apr_proc_mutex_lockfile(proc_lock),
+                                          pool) != APR_SUCCESS) {
+                exit(1);
+            }
+            /* Waits for samples[0] */
+            while (!apr_atomic_read32(&samples[0])) {
+                apr_thread_yield();
+            }
+            apr_atomic_set32((apr_uint32_t *)&bench_go, 1);
+            bt.samples = samples + 1 + num_procs + i * per_proc;
+            bt.nsamples = 0;
+            bench_loop(&bt);
+            samples[1 + i] = (apr_uint32_t)bt.nsamples;
+            exit(0);
+        }
+        else if (rv != APR_INPARENT) {
+            return rv;
+        }
     }
-    printf("OK\n");
 
-    apr_thread_rwlock_wrlock(thread_rwlock);
-    /* set_concurrency(4)? -aaron */
-    printf("    Starting %d threads    ", num_threads);
-    for (i = 0; i < num_threads; ++i) {
-        s[i] = apr_thread_create(&t[i], NULL, thread_rwlock_func, NULL, pool);
-        if (s[i] != APR_SUCCESS) {
-            printf("Failed!\n");
-            return s[i];
+    rv = APR_SUCCESS;
+    start = apr_time_now();
+    apr_atomic_set32(&samples[0], 1);
+    for (i = 0; i < num_procs; i++) {
+        int exitcode;
+        apr_exit_why_e why;
+
+        apr_proc_wait(&procs[i], &exitcode, &why, APR_WAIT);
+        if (why != APR_PROC_EXIT || exitcode != 0) {
+            rv = APR_EGENERAL;
         }
     }
-    printf("OK\n");
+    start = apr_time_now() - start;
 
-    time_start = apr_time_now();
-    apr_thread_rwlock_unlock(thread_rwlock);
+    for (i = 0; i < num_procs; i++) {
+        memmove(samples + n, samples + 1 + num_procs + i * per_proc,
+                samples[1 + i] * sizeof(*samples));
+        n += samples[1 + i];
+    }
+    report(name, num_procs, start, samples, n);
 
-    /* printf("%-60s", "    Waiting for threads to exit"); */
-    for (i = 0; i < num_threads; ++i) {
-        apr_thread_join(&s[i], t[i]);
+    apr_shm_destroy(shm);
+    apr_proc_mutex_destroy(proc_lock);
+    return rv;
+}
+
+#endif /* APR_HAS_FORK && APR_HAS_SHARED_MEMORY */
+
+static int ncpus(void)
+{
+#if defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (n > 0) {
+        return (int)n;
     }
-    /* printf("OK\n"); */
+#endif
+    return DEFAULT_MAX_THREADS;
+}
 
-    time_stop = apr_time_now();
-    printf("microseconds: %" APR_INT64_T_FMT " usec\n",
-           (time_stop - time_start));
-    if (mutex_counter != max_counter * num_threads)
-        printf("error: counter = %ld\n", mutex_counter);
+static void check(apr_status_t rv, const char *name, int code)
+{
+    char errmsg[200];
 
-    return APR_SUCCESS;
+    if (rv != APR_SUCCESS) {
+        fprintf(stderr, "%s test failed : [%d] %s\n", name, rv,
+                apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(code);
+    }
 }
 
 int main(int argc, const char * const *argv)
 {
+#if APR_HAS_FORK && APR_HAS_SHARED_MEMORY
+    static const struct {
+        apr_lockmech_e mech;
+        const char *name;
+    } mechs[] = {
+        { APR_LOCK_DEFAULT,      "apr_proc_mutex_t (DEFAULT)" },
+#if APR_HAS_FCNTL_SERIALIZE
+        { APR_LOCK_FCNTL,        "apr_proc_mutex_t (FCNTL)" },
+#endif
+#if APR_HAS_FLOCK_SERIALIZE
+        { APR_LOCK_FLOCK,        "apr_proc_mutex_t (FLOCK)" },
+#endif
+#if APR_HAS_SYSVSEM_SERIALIZE
+        { APR_LOCK_SYSVSEM,      "apr_proc_mutex_t (SYSVSEM)" },
+#endif
+#if APR_HAS_POSIXSEM_SERIALIZE
+        { APR_LOCK_POSIXSEM,     "apr_proc_mutex_t (POSIXSEM)" },
+#endif
+#if APR_HAS_PROC_PTHREAD_SERIALIZE
+        { APR_LOCK_PROC_PTHREAD, "apr_proc_mutex_t (PROC_PTHREAD)" },
+#endif
+#if APR_HAS_FUTEX_SERIALIZE
+        { APR_LOCK_FUTEX,        "apr_proc_mutex_t (FUTEX)" },
+#endif
+    };
+    int m;
+#endif
     apr_status_t rv;
     char errmsg[200];
     apr_getopt_t *opt;
     char optchar;
     const char *optarg;
+    int i, last;
 
     printf("APR Lock Performance Test\n==============\n\n");
 
@@ -301,10 +632,14 @@ int main(int argc, const char * const *argv)
         exit(-1);
     }
 
-    while ((rv = apr_getopt(opt, "c:v", &optchar, &optarg)) == APR_SUCCESS) {
+    while ((rv = apr_getopt(opt, "c:t:v", &optchar, &optarg))
+           == APR_SUCCESS) {
         if (optchar == 'c') {
             max_counter = atol(optarg);
         }
+        else if (optchar == 't') {
+            max_threads = atoi(optarg);
+        }
         else if (optchar == 'v') {
             verbose = 1;
         }
@@ -315,33 +650,47 @@ int main(int argc, const char * const *argv)
                 rv, apr_strerror(rv, errmsg, sizeof errmsg));
         exit(-1);
     }
+    if (max_threads <= 0) {
+        max_threads = ncpus();
+    }
+    timeout = apr_time_from_sec(5);
 
-    for (i = 1; i <= MAX_THREADS; ++i) {
-        if ((rv = test_thread_mutex(i)) != APR_SUCCESS) {
-            fprintf(stderr,"thread_mutex test failed : [%d] %s\n",
-                    rv, apr_strerror(rv, (char*)errmsg, 200));
-            exit(-3);
-        }
-
-        if ((rv = test_thread_mutex_nested(i)) != APR_SUCCESS) {
-            fprintf(stderr,"thread_mutex (NESTED) test failed : [%d] %s\n",
-                    rv, apr_strerror(rv, (char*)errmsg, 200));
-            exit(-4);
-        }
-
-        if ((rv = test_thread_mutex_timed(i)) != APR_SUCCESS) {
-            fprintf(stderr,"thread_mutex (TIMED) test failed : [%d] %s\n",
-                    rv, apr_strerror(rv, (char*)errmsg, 200));
-            exit(-5);
-        }
+    if (verbose) {
+        printf("%ld acquisitions per thread, 1 to %d threads\n\n",
+               max_counter, max_threads);
+    }
 
-        if ((rv = test_thread_rwlock(i)) != APR_SUCCESS) {
-            fprintf(stderr,"thread_rwlock test failed : [%d] %s\n",
-                    rv, apr_strerror(rv, (char*)errmsg, 200));
-            exit(-6);
+    /* 1, 2, 4... and max_threads */
+    for (i = 1, last = 0; !last; i = (i * 2 < max_threads) ? i * 2
+                                                           : max_threads) {
+        last = (i == max_threads);
+
+        check(test_thread_mutex(i, APR_THREAD_MUTEX_DEFAULT,
+                                "apr_thread_mutex_t (DEFAULT)"),
+              "thread_mutex", -3);
+        check(test_thread_mutex(i, APR_THREAD_MUTEX_NESTED,
+                                "apr_thread_mutex_t (NESTED)"),
+              "thread_mutex (NESTED)", -4);
+        check(test_thread_mutex(i, APR_THREAD_MUTEX_TIMED,
+                                "apr_thread_mutex_t (TIMED)"),
+              "thread_mutex (TIMED)", -5);
+        check(test_thread_rwlock(i, 10, "apr_thread_rwlock_t (10% writes)"),
+              "thread_rwlock (read-heavy)", -6);
+        check(test_thread_rwlock(i, 90, "apr_thread_rwlock_t (90% writes)"),
+              "thread_rwlock (write-heavy)", -6);
+        check(test_global_mutex(i), "global_mutex", -7);
+#if APR_HAS_FORK && APR_HAS_SHARED_MEMORY
+        for (m = 0; m < (int)(sizeof(mechs) / sizeof(mechs[0])); m++) {
+            check(test_proc_mutex(i, mechs[m].mech, mechs[m].name),
+                  mechs[m].name, -8);
         }
+#endif
+        check(test_atomics(i), "atomics", -9);
+        printf("\n");
     }
 
+    check(test_thread_cond(), "thread_cond", -10);
+
     return 0;
 }
 
@@ -0,0 +1,289 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_lock_profile.h"
+#include "apr_thread_proc.h"
+#include "apr_thread_mutex.h"
+#include "apr_thread_rwlock.h"
+#include "apr_global_mutex.h"
+#include "apr_strings.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "testutil.h"
+
+#if APR_HAS_LOCK_PROFILE
+
+static int find_profile(apr_lock_profile_t *found, const char *tag)
+{
+    apr_array_header_t *arr;
+    int i;
+
+    if (apr_lock_profile_snapshot(&arr, p) != APR_SUCCESS) {
+        return 0;
+    }
+    for (i = 0; i < arr->nelts; ++i) {
+        apr_lock_profile_t *profile = &APR_ARRAY_IDX(arr, i,
+                                                     apr_lock_profile_t);
+        if (profile->tag && !strcmp(profile->tag, tag)) {
+            *found = *profile;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void test_untagged(abts_case *tc, void *data)
+{
+    apr_lock_profile_t profile;
+    apr_proc_mutex_t *mutex;
+    apr_pool_t *pool;
+
+    APR_ASSERT_SUCCESS(tc, "create pool", apr_pool_create(&pool, p));
+    APR_ASSERT_SUCCESS(tc, "create mutex",
+                       apr_proc_mutex_create(&mutex, NULL,
+                                             APR_LOCK_DEFAULT, pool));
+    APR_ASSERT_SUCCESS(tc, "start profiling", apr_lock_profile_set(1));
+    APR_ASSERT_SUCCESS(tc, "lock", apr_proc_mutex_lock(mutex));
+    APR_ASSERT_SUCCESS(tc, "unlock", apr_proc_mutex_unlock(mutex));
+    APR_ASSERT_SUCCESS(tc, "stop profiling", apr_lock_profile_set(0));
+
+    APR_ASSERT_SUCCESS(tc, "tag", apr_proc_mutex_tag(mutex, "untagged"));
+    ABTS_ASSERT(tc, "tagged profile", find_profile(&profile, "untagged"));
+    ABTS_TRUE(tc, profile.type == APR_LOCK_PROFILE_PROC_MUTEX);
+    ABTS_TRUE(tc, profile.acquired == 0);
+
+    /* Stopped profiling records nothing */
+    APR_ASSERT_SUCCESS(tc, "lock", apr_proc_mutex_lock(mutex));
+    APR_ASSERT_SUCCESS(tc, "unlock", apr_proc_mutex_unlock(mutex));
+    ABTS_ASSERT(tc, "tagged profile", find_profile(&profile, "untagged"));
+    ABTS_TRUE(tc, profile.acquired == 0);
+
+    /* The profile goes with the pool of the lock */
+    apr_pool_destroy(pool);
+    ABTS_ASSERT(tc, "profile gone", !find_profile(&profile, "untagged"));
+}
+
+static void test_global_mutex(abts_case *tc, void *data)
+{
+    apr_lock_profile_t profile;
+    apr_global_mutex_t *mutex;
+    apr_pool_t *pool;
+    apr_status_t rv;
+    int n;
+
+    APR_ASSERT_SUCCESS(tc, "create pool", apr_pool_create(&pool, p));
+    APR_ASSERT_SUCCESS(tc, "create mutex",
+                       apr_global_mutex_create(&mutex, NULL,
+                                               APR_LOCK_DEFAULT, pool));
+    APR_ASSERT_SUCCESS(tc, "tag", apr_global_mutex_tag(mutex, "global"));
+
+    APR_ASSERT_SUCCESS(tc, "start profiling", apr_lock_profile_set(1));
+    for (n = 0; n < 10; ++n) {
+        APR_ASSERT_SUCCESS(tc, "lock", apr_global_mutex_lock(mutex));
+        APR_ASSERT_SUCCESS(tc, "unlock", apr_global_mutex_unlock(mutex));
+    }
+    APR_ASSERT_SUCCESS(tc, "trylock", apr_global_mutex_trylock(mutex));
+    APR_ASSERT_SUCCESS(tc, "unlock", apr_global_mutex_unlock(mutex));
+    rv = apr_global_mutex_timedlock(mutex, apr_time_from_msec(10));
+    if (rv != APR_ENOTIMPL) {
+        APR_ASSERT_SUCCESS(tc, "timedlock", rv);
+        APR_ASSERT_SUCCESS(tc, "unlock", apr_global_mutex_unlock(mutex));
+        n++;
+    }
+    APR_ASSERT_SUCCESS(tc, "stop profiling", apr_lock_profile_set(0));
+
+    ABTS_ASSERT(tc, "tagged profile", find_profile(&profile, "global"));
+    ABTS_INT_EQUAL(tc, n + 1, (int)profile.acquired);
+    ABTS_TRUE(tc, profile.contended == 0);
+    ABTS_TRUE(tc, profile.hold_time >= 0);
+
+    apr_lock_profile_reset();
+    ABTS_ASSERT(tc, "tagged profile", find_profile(&profile, "global"));
+    ABTS_TRUE(tc, profile.acquired == 0);
+
+    apr_pool_destroy(pool);
+}
+
+#if APR_HAS_THREADS
+
+static apr_thread_mutex_t *thread_mutex;
+static apr_thread_rwlock_t *rwlock;
+
+static void *APR_THREAD_FUNC mutex_waiter(apr_thread_t *thd, void *data)
+{
+    apr_status_t rv;
+
+    rv = apr_thread_mutex_lock(thread_mutex);
+    if (rv == APR_SUCCESS) {
+        rv = apr_thread_mutex_unlock(thread_mutex);
+    }
+    apr_thread_exit(thd, rv);
+    return NULL;
+}
+
+static void test_thread_mutex(abts_case *tc, void *data)
+{
+    apr_lock_profile_t profile;
+    apr_thread_t *thread;
+    apr_status_t rv;
+
+    APR_ASSERT_SUCCESS(tc, "create mutex",
+                       apr_thread_mutex_create(&thread_mutex,
+                                               APR_THREAD_MUTEX_DEFAULT, p));
+    APR_ASSERT_SUCCESS(tc, "tag", apr_thread_mutex_tag(thread_mutex,
+                                                       "thread_mutex"));
+    APR_ASSERT_SUCCESS(tc, "start profiling", apr_lock_profile_set(1));
+
+    /* Make the waiter contend with us for 50ms */
+    APR_ASSERT_SUCCESS(tc, "lock", apr_thread_mutex_lock(thread_mutex));
+    APR_ASSERT_SUCCESS(tc, "create thread",
+                       apr_thread_create(&thread, NULL, mutex_waiter,
+                                         NULL, p));
+    apr_sleep(apr_time_from_msec(50));
+    APR_ASSERT_SUCCESS(tc, "unlock", apr_thread_mutex_unlock(thread_mutex));
+    APR_ASSERT_SUCCESS(tc, "join thread", apr_thread_join(&rv, thread));
+    APR_ASSERT_SUCCESS(tc, "waiter", rv);
+
+    APR_ASSERT_SUCCESS(tc, "stop profiling", apr_lock_profile_set(0));
+
+    ABTS_ASSERT(tc, "tagged profile", find_profile(&profile,
+                                                   "thread_mutex"));
+    ABTS_TRUE(tc, profile.type == APR_LOCK_PROFILE_THREAD_MUTEX);
+    ABTS_INT_EQUAL(tc, 2, (int)profile.acquired);
+    ABTS_INT_EQUAL(tc, 1, (int)profile.contended);
+    ABTS_TRUE(tc, profile.wait_time > 0);
+    ABTS_TRUE(tc, profile.max_wait_time == profile.wait_time);
+    ABTS_TRUE(tc, profile.hold_time >= apr_time_from_msec(40));
+
+    APR_ASSERT_SUCCESS(tc, "destroy", apr_thread_mutex_destroy(thread_mutex));
+}
+
+static void *APR_THREAD_FUNC rwlock_reader(apr_thread_t *thd, void *data)
+{
+    apr_status_t rv;
+
+    rv = apr_thread_rwlock_rdlock(rwlock);
+    if (rv == APR_SUCCESS) {
+        rv = apr_thread_rwlock_unlock(rwlock);
+    }
+    apr_thread_exit(thd, rv);
+    return NULL;
+}
+
+static void test_thread_rwlock(abts_case *tc, void *data)
+{
+    apr_lock_profile_t profile;
+    apr_thread_t *thread;
+    apr_status_t rv;
+
+    rv = apr_thread_rwlock_create(&rwlock, p);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "rwlocks not implemented");
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "create rwlock", rv);
+    APR_ASSERT_SUCCESS(tc, "tag", apr_thread_rwlock_tag(rwlock, "rwlock"));
+    APR_ASSERT_SUCCESS(tc, "start profiling", apr_lock_profile_set(1));
+
+    /* Readers share, with no contention nor hold time */
+    APR_ASSERT_SUCCESS(tc, "rdlock", apr_thread_rwlock_rdlock(rwlock));
+    APR_ASSERT_SUCCESS(tc, "tryrdlock", apr_thread_rwlock_tryrdlock(rwlock));
+    APR_ASSERT_SUCCESS(tc, "unlock", apr_thread_rwlock_unlock(rwlock));
+    APR_ASSERT_SUCCESS(tc, "unlock", apr_thread_rwlock_unlock(rwlock));
+
+    ABTS_ASSERT(tc, "tagged profile", find_profile(&profile, "rwlock"));
+    ABTS_TRUE(tc, profile.type == APR_LOCK_PROFILE_THREAD_RWLOCK);
+    ABTS_INT_EQUAL(tc, 2, (int)profile.acquired);
+    ABTS_TRUE(tc, profile.contended == 0);
+    ABTS_TRUE(tc, profile.hold_time == 0);
+
+    /* A writer makes a reader wait */
+    APR_ASSERT_SUCCESS(tc, "wrlock", apr_thread_rwlock_wrlock(rwlock));
+    APR_ASSERT_SUCCESS(tc, "create thread",
+                       apr_thread_create(&thread, NULL, rwlock_reader,
+                                         NULL, p));
+    apr_sleep(apr_time_from_msec(50));
+    APR_ASSERT_SUCCESS(tc, "unlock", apr_thread_rwlock_unlock(rwlock));
+    APR_ASSERT_SUCCESS(tc, "join thread", apr_thread_join(&rv, thread));
+    APR_ASSERT_SUCCESS(tc, "reader", rv);
+
+    APR_ASSERT_SUCCESS(tc, "stop profiling", apr_lock_profile_set(0));
+
+    ABTS_ASSERT(tc, "tagged profile", find_profile(&profile, "rwlock"));
+    ABTS_INT_EQUAL(tc, 4, (int)profile.acquired);
+    ABTS_INT_EQUAL(tc, 1, (int)profile.contended);
+    ABTS_TRUE(tc, profile.wait_time > 0);
+    ABTS_TRUE(tc, profile.hold_time >= apr_time_from_msec(40));
+
+    APR_ASSERT_SUCCESS(tc, "destroy", apr_thread_rwlock_destroy(rwlock));
+}
+
+#endif /* APR_HAS_THREADS */
+
+static int count_profiles(void *baton, const apr_lock_profile_t *profile)
+{
+    int *count = baton;
+
+    return --*count > 0;
+}
+
+static void test_profile_do(abts_case *tc, void *data)
+{
+    apr_array_header_t *arr;
+    int count;
+
+    APR_ASSERT_SUCCESS(tc, "snapshot", apr_lock_profile_snapshot(&arr, p));
+    if (arr->nelts == 0) {
+        return;
+    }
+
+    count = arr->nelts + 1;
+    ABTS_TRUE(tc, apr_lock_profile_do(count_profiles, &count) != 0);
+    ABTS_INT_EQUAL(tc, 1, count);
+
+    count = 1;
+    ABTS_TRUE(tc, apr_lock_profile_do(count_profiles, &count) == 0);
+    ABTS_INT_EQUAL(tc, 0, count);
+}
+
+#else /* APR_HAS_LOCK_PROFILE */
+
+static void lock_profile_not_impl(abts_case *tc, void *data)
+{
+    ABTS_INT_EQUAL(tc, APR_ENOTIMPL, apr_lock_profile_set(1));
+    ABTS_NOT_IMPL(tc, "lock profiling");
+}
+
+#endif /* APR_HAS_LOCK_PROFILE */
+
+abts_suite *testlockprofile(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+#if APR_HAS_LOCK_PROFILE
+    abts_run_test(suite, test_untagged, NULL);
+    abts_run_test(suite, test_global_mutex, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_thread_mutex, NULL);
+    abts_run_test(suite, test_thread_rwlock, NULL);
+#endif
+    abts_run_test(suite, test_profile_do, NULL);
+#else
+    abts_run_test(suite, lock_profile_not_impl, NULL);
+#endif
+
+    return suite;
+}
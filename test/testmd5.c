@@ -90,6 +90,53 @@ static void test_md5sum_unaligned(abts_case *tc, void *data)
                     (memcmp(digest, sum, APR_MD5_DIGESTSIZE) == 0));
 }
 
+static void test_md5_multi(abts_case *tc, void *data)
+{
+        static const apr_size_t sizes[11] = {0, 1, 55, 56, 63, 64, 65,
+                                             119, 120, 130, 300};
+        unsigned char digests[11][APR_MD5_DIGESTSIZE];
+        unsigned char expect[APR_MD5_DIGESTSIZE];
+        const void *inputs[11];
+        apr_size_t lens[11];
+        unsigned char *buf;
+        int n, i;
+
+        /* messages of lengths around the block and padding boundaries */
+        buf = apr_palloc(p, 300);
+        for (i = 0; i < 300; i++) {
+                buf[i] = (unsigned char)(i * 7 + 1);
+        }
+        for (i = 0; i < 11; i++) {
+                inputs[i] = buf + 300 - sizes[i];
+                lens[i] = sizes[i];
+        }
+
+        for (n = 0; n <= 11; n++) {
+                memset(digests, 0, sizeof(digests));
+                ABTS_ASSERT(tc, "apr_md5_multi",
+                            apr_md5_multi(digests, inputs, lens, n)
+                            == APR_SUCCESS);
+                for (i = 0; i < 11; i++) {
+                        apr_md5(expect, inputs[i], lens[i]);
+                        if (i < n) {
+                                ABTS_ASSERT(tc, "apr_md5_multi digest differs",
+                                            memcmp(digests[i], expect,
+                                                   sizeof(expect)) == 0);
+                        }
+                        else {
+                                memset(expect, 0, sizeof(expect));
+                                ABTS_ASSERT(tc, "apr_md5_multi wrote past n",
+                                            memcmp(digests[i], expect,
+                                                   sizeof(expect)) == 0);
+                        }
+                }
+        }
+        ABTS_ASSERT(tc, "check for correct md5 digest of the empty string",
+                    memcmp(digests[0], "\xd4\x1d\x8c\xd9\x8f\x00\xb2\x04"
+                                       "\xe9\x80\x09\x98\xec\xf8\x42\x7e",
+                           APR_MD5_DIGESTSIZE) == 0);
+}
+
 abts_suite *testmd5(abts_suite *suite)
 {
         suite = ADD_SUITE(suite);
@@ -98,6 +145,7 @@ abts_suite *testmd5(abts_suite *suite)
             abts_run_test(suite, test_md5sum, NULL);
         }
         abts_run_test(suite, test_md5sum_unaligned, NULL);
+        abts_run_test(suite, test_md5_multi, NULL);
 
         return suite;
 }
@@ -341,6 +341,86 @@ static void test_memcache_user_funcs(abts_case * tc, void *data)
   ABTS_ASSERT(tc, "wrong server found", found->port == baton->which_server);
 }
 
+#if APR_HAS_THREADS
+/* create a client object of n servers, not connected to until used */
+static apr_memcache_t *create_servers(abts_case *tc, apr_uint32_t flags,
+                              apr_uint16_t n)
+{
+  apr_pool_t *pool = p;
+  apr_memcache_t *client;
+  apr_uint16_t i;
+  apr_status_t rv;
+
+  rv = apr_memcache_create(pool, n, flags, &client);
+  ABTS_ASSERT(tc, "create failed", rv == APR_SUCCESS);
+
+  for (i = 0; i < n; i++) {
+    apr_memcache_server_t *ms;
+
+    rv = apr_memcache_server_create(pool, HOST, i + 1, 0, 1, 1, 60, &ms);
+    ABTS_ASSERT(tc, "server create failed", rv == APR_SUCCESS);
+
+    rv = apr_memcache_add_server(client, ms);
+    ABTS_ASSERT(tc, "server add failed", rv == APR_SUCCESS);
+  }
+
+  return client;
+}
+
+/*
+ * with a consistent hash, adding an 11th server must only move keys to
+ * the new server, and not many of them, and disabling a server must only
+ * move the keys of that server.
+ */
+static void test_memcache_consistent(abts_case * tc, void *data)
+{
+  apr_uint32_t flags = *(apr_uint32_t *)data;
+  apr_memcache_t *ten, *eleven;
+  apr_memcache_server_t *dead;
+  int i, moved = 0;
+
+  ten = create_servers(tc, flags, 10);
+  eleven = create_servers(tc, flags, 11);
+
+  for (i = 0; i < TDATA_SIZE; i++) {
+    const char *key = apr_pstrcat(p, prefix, apr_itoa(p, i), NULL);
+    apr_uint32_t hash = apr_memcache_hash(ten, key, strlen(key));
+    apr_memcache_server_t *s10, *s11;
+
+    s10 = apr_memcache_find_server_hash(ten, hash);
+    s11 = apr_memcache_find_server_hash(eleven, hash);
+    ABTS_PTR_NOTNULL(tc, s10);
+    ABTS_PTR_NOTNULL(tc, s11);
+    if (s10->port != s11->port) {
+      ABTS_INT_EQUAL(tc, 11, s11->port);
+      moved++;
+    }
+  }
+  ABTS_ASSERT(tc, apr_psprintf(p, "%d keys of %d moved", moved, TDATA_SIZE),
+              moved > 0 && moved < TDATA_SIZE / 5);
+
+  dead = apr_memcache_find_server(eleven, HOST, 5);
+  apr_memcache_disable_server(eleven, dead);
+
+  for (i = 0; i < TDATA_SIZE; i++) {
+    const char *key = apr_pstrcat(p, prefix, apr_itoa(p, i), NULL);
+    apr_uint32_t hash = apr_memcache_hash(ten, key, strlen(key));
+    apr_memcache_server_t *s10, *s11;
+
+    s10 = apr_memcache_find_server_hash(ten, hash);
+    s11 = apr_memcache_find_server_hash(eleven, hash);
+    ABTS_PTR_NOTNULL(tc, s11);
+    ABTS_ASSERT(tc, "dead server selected", s11 != dead);
+    if (s10->port != 5 && s11->port != 11) {
+      ABTS_INT_EQUAL(tc, s10->port, s11->port);
+    }
+  }
+}
+
+static apr_uint32_t flag_ketama = APR_MC_FLAG_KETAMA;
+static apr_uint32_t flag_jump = APR_MC_FLAG_JUMP;
+#endif
+
 /* test non data related commands like stats and version */
 static void test_memcache_meta(abts_case * tc, void *data)
 {
@@ -662,16 +742,400 @@ static void test_memcache_setget(abts_case * tc, void *data)
     }
 }
 
+/* test the meta commands */
+
+static void test_memcache_metacmds(abts_case * tc, void *data)
+{
+    apr_pool_t *pool = p;
+    apr_pool_t *tmppool;
+    apr_status_t rv;
+    apr_memcache_t *memcache;
+    apr_memcache_server_t *server;
+    apr_memcache_meta_t items[TDATA_SET + 1], item;
+    int i;
+
+    if (!has_memcache_server()) {
+        ABTS_SKIP(tc, data, "Memcache server not found.");
+        return;
+    }
+
+    rv = apr_pool_create(&tmppool, pool);
+    ABTS_ASSERT(tc, "Couldn't create temp pool", rv == APR_SUCCESS);
+
+    rv = apr_memcache_create(pool, 1, 0, &memcache);
+    ABTS_ASSERT(tc, "memcache create failed", rv == APR_SUCCESS);
+
+    rv = apr_memcache_server_create(pool, HOST, PORT, 0, 1, 1, 60, &server);
+    ABTS_ASSERT(tc, "server create failed", rv == APR_SUCCESS);
+
+    rv = apr_memcache_add_server(memcache, server);
+    ABTS_ASSERT(tc, "server add failed", rv == APR_SUCCESS);
+
+    memset(items, 0, sizeof(items));
+    for (i = 0; i < TDATA_SET; i++) {
+        items[i].key = apr_pstrcat(pool, prefix, "meta", apr_itoa(pool, i),
+                                   NULL);
+        items[i].data = apr_pstrndup(pool, txt,
+                                     randval((apr_uint32_t)strlen(txt)));
+        items[i].len = strlen(items[i].data);
+        items[i].flags = 27;
+    }
+    items[TDATA_SET].key = "nothere3423";
+
+    rv = apr_memcache_meta_set(memcache, tmppool, items, TDATA_SET, 0);
+    ABTS_ASSERT(tc, "meta set failed", rv == APR_SUCCESS);
+    for (i = 0; i < TDATA_SET; i++) {
+        ABTS_ASSERT(tc, "item not set", items[i].status == APR_SUCCESS);
+        items[i].data = NULL;
+        items[i].len = 0;
+        items[i].flags = 0;
+    }
+
+    rv = apr_memcache_meta_get(memcache, tmppool, pool, items, TDATA_SET + 1);
+    ABTS_ASSERT(tc, "meta get failed", rv == APR_SUCCESS);
+    for (i = 0; i < TDATA_SET; i++) {
+        ABTS_ASSERT(tc, "item not got", items[i].status == APR_SUCCESS);
+        ABTS_ASSERT(tc, "bad value", items[i].data != NULL
+                    && strlen(items[i].data) == items[i].len
+                    && strncmp(items[i].data, txt, items[i].len) == 0);
+        ABTS_INT_EQUAL(tc, 27, items[i].flags);
+        ABTS_INT_EQUAL(tc, -1, items[i].ttl);
+        ABTS_ASSERT(tc, "no cas", items[i].cas != 0);
+    }
+    ABTS_INT_EQUAL(tc, APR_NOTFOUND, items[TDATA_SET].status);
+
+    /* only the first client to miss or see the stale item recaches it */
+    memset(&item, 0, sizeof(item));
+    item.key = apr_pstrcat(pool, prefix, "metastampede", NULL);
+    item.vivify = 30;
+    rv = apr_memcache_meta_get(memcache, tmppool, pool, &item, 1);
+    ABTS_ASSERT(tc, "meta get vivify failed", rv == APR_SUCCESS);
+    ABTS_ASSERT(tc, "vivify not won", item.state & APR_MC_META_WIN);
+    rv = apr_memcache_meta_get(memcache, tmppool, pool, &item, 1);
+    ABTS_ASSERT(tc, "meta get vivify failed", rv == APR_SUCCESS);
+    ABTS_ASSERT(tc, "vivify won twice", !(item.state & APR_MC_META_WIN));
+    ABTS_ASSERT(tc, "vivify not won already", item.state & APR_MC_META_WON);
+
+    items[0].ttl = 30;
+    rv = apr_memcache_meta_delete(memcache, tmppool, &items[0], 1, 1);
+    ABTS_ASSERT(tc, "meta invalidate failed", rv == APR_SUCCESS);
+    rv = apr_memcache_meta_get(memcache, tmppool, pool, &items[0], 1);
+    ABTS_ASSERT(tc, "meta get stale failed", rv == APR_SUCCESS);
+    ABTS_ASSERT(tc, "item not got", items[0].status == APR_SUCCESS);
+    ABTS_ASSERT(tc, "item not stale", items[0].state & APR_MC_META_STALE);
+    ABTS_ASSERT(tc, "stale not won", items[0].state & APR_MC_META_WIN);
+
+    rv = apr_memcache_meta_delete(memcache, tmppool, &item, 1, 0);
+    ABTS_ASSERT(tc, "meta delete failed", rv == APR_SUCCESS);
+    rv = apr_memcache_meta_delete(memcache, tmppool, items, TDATA_SET + 1, 0);
+    ABTS_ASSERT(tc, "meta delete failed", rv == APR_SUCCESS);
+    for (i = 0; i < TDATA_SET; i++) {
+        ABTS_ASSERT(tc, "item not deleted", items[i].status == APR_SUCCESS);
+    }
+    ABTS_INT_EQUAL(tc, APR_NOTFOUND, items[TDATA_SET].status);
+
+    apr_pool_destroy(tmppool);
+}
+
+/* test the near cache */
+
+#if APR_HAS_THREADS
+
+#define NEAR_THREADS 8
+#define NEAR_GETS 100
+
+typedef struct near_baton_t {
+    apr_memcache_t *memcache;
+    const char *key;
+    const char *value;
+    int errors;
+} near_baton_t;
+
+static void * APR_THREAD_FUNC near_cache_thread(apr_thread_t *thd,
+                                                void *data)
+{
+    near_baton_t *nb = data;
+    apr_pool_t *pool = apr_thread_pool_get(thd);
+    char *result;
+    apr_size_t len;
+    int i;
+
+    for (i = 0; i < NEAR_GETS; i++) {
+        if (apr_memcache_getp(nb->memcache, pool, nb->key, &result, &len,
+                              NULL) != APR_SUCCESS
+            || strcmp(result, nb->value)) {
+            nb->errors++;
+        }
+    }
+
+    return NULL;
+}
+
+#endif /* APR_HAS_THREADS */
+
+static void test_memcache_near_cache(abts_case * tc, void *data)
+{
+    apr_pool_t *pool = p;
+    apr_status_t rv;
+    apr_memcache_t *memcache, *direct;
+    apr_memcache_server_t *server, *dserver;
+    const char *key = apr_pstrcat(p, prefix, "nearcache", NULL);
+    char *result;
+    apr_size_t len;
+    apr_uint16_t flags;
+#if APR_HAS_THREADS
+    apr_thread_t *threads[NEAR_THREADS];
+    near_baton_t batons[NEAR_THREADS];
+    int i;
+#endif
+
+    if (!has_memcache_server()) {
+        ABTS_SKIP(tc, data, "Memcache server not found.");
+        return;
+    }
+
+    rv = apr_memcache_create(pool, 1, 0, &memcache);
+    ABTS_ASSERT(tc, "memcache create failed", rv == APR_SUCCESS);
+    rv = apr_memcache_server_create(pool, HOST, PORT, 0, 1, 1, 60, &server);
+    ABTS_ASSERT(tc, "server create failed", rv == APR_SUCCESS);
+    rv = apr_memcache_add_server(memcache, server);
+    ABTS_ASSERT(tc, "server add failed", rv == APR_SUCCESS);
+
+    rv = apr_memcache_near_cache_create(memcache, 64, 1024,
+                                        apr_time_from_sec(60));
+    ABTS_ASSERT(tc, "near cache create failed", rv == APR_SUCCESS);
+
+    /* a client without near cache, changing the values behind it */
+    rv = apr_memcache_create(pool, 1, 0, &direct);
+    ABTS_ASSERT(tc, "memcache create failed", rv == APR_SUCCESS);
+    rv = apr_memcache_server_create(pool, HOST, PORT, 0, 1, 1, 60, &dserver);
+    ABTS_ASSERT(tc, "server create failed", rv == APR_SUCCESS);
+    rv = apr_memcache_add_server(direct, dserver);
+    ABTS_ASSERT(tc, "server add failed", rv == APR_SUCCESS);
+
+    rv = apr_memcache_set(memcache, key, "one", 3, 0, 27);
+    ABTS_ASSERT(tc, "set failed", rv == APR_SUCCESS);
+    rv = apr_memcache_getp(memcache, pool, key, &result, &len, &flags);
+    ABTS_ASSERT(tc, "get failed", rv == APR_SUCCESS);
+    ABTS_STR_EQUAL(tc, "one", result);
+    ABTS_INT_EQUAL(tc, 27, flags);
+
+    /* served from the near cache */
+    rv = apr_memcache_set(direct, key, "two", 3, 0, 27);
+    ABTS_ASSERT(tc, "set failed", rv == APR_SUCCESS);
+    rv = apr_memcache_getp(memcache, pool, key, &result, &len, &flags);
+    ABTS_ASSERT(tc, "get failed", rv == APR_SUCCESS);
+    ABTS_STR_EQUAL(tc, "one", result);
+    ABTS_INT_EQUAL(tc, 27, flags);
+
+    /* invalidated by the client's own changes */
+    rv = apr_memcache_set(memcache, key, "three", 5, 0, 27);
+    ABTS_ASSERT(tc, "set failed", rv == APR_SUCCESS);
+    rv = apr_memcache_getp(memcache, pool, key, &result, &len, NULL);
+    ABTS_ASSERT(tc, "get failed", rv == APR_SUCCESS);
+    ABTS_STR_EQUAL(tc, "three", result);
+
+#if APR_HAS_THREADS
+    rv = apr_memcache_delete(memcache, key, 0);
+    ABTS_ASSERT(tc, "delete failed", rv == APR_SUCCESS);
+    rv = apr_memcache_set(direct, key, "four", 4, 0, 27);
+    ABTS_ASSERT(tc, "set failed", rv == APR_SUCCESS);
+
+    for (i = 0; i < NEAR_THREADS; i++) {
+        batons[i].memcache = memcache;
+        batons[i].key = key;
+        batons[i].value = "four";
+        batons[i].errors = 0;
+        rv = apr_thread_create(&threads[i], NULL, near_cache_thread,
+                               &batons[i], pool);
+        ABTS_ASSERT(tc, "thread create failed", rv == APR_SUCCESS);
+    }
+    for (i = 0; i < NEAR_THREADS; i++) {
+        apr_status_t retval;
+
+        apr_thread_join(&retval, threads[i]);
+        ABTS_INT_EQUAL(tc, 0, batons[i].errors);
+    }
+#endif
+
+    rv = apr_memcache_delete(memcache, key, 0);
+    ABTS_ASSERT(tc, "delete failed", rv == APR_SUCCESS);
+    rv = apr_memcache_getp(memcache, pool, key, &result, &len, NULL);
+    ABTS_INT_EQUAL(tc, APR_NOTFOUND, rv);
+}
+
+/* test the latency histograms of the client side metrics */
+static void test_memcache_latency(abts_case * tc, void *data)
+{
+    apr_memcache_latency_t lat;
+    int i;
+
+    ABTS_INT_EQUAL(tc, 1, (int)apr_memcache_latency_bucket_limit(0));
+    ABTS_INT_EQUAL(tc, 4, (int)apr_memcache_latency_bucket_limit(3));
+    ABTS_INT_EQUAL(tc, 5, (int)apr_memcache_latency_bucket_limit(4));
+    ABTS_INT_EQUAL(tc, 8, (int)apr_memcache_latency_bucket_limit(7));
+    ABTS_INT_EQUAL(tc, 10, (int)apr_memcache_latency_bucket_limit(8));
+    ABTS_INT_EQUAL(tc, 1024, (int)apr_memcache_latency_bucket_limit(35));
+    ABTS_INT_EQUAL(tc, -1,
+                   (int)apr_memcache_latency_bucket_limit(APR_MC_LATENCY_BUCKETS - 1));
+
+    memset(&lat, 0, sizeof(lat));
+    ABTS_INT_EQUAL(tc, 0, (int)apr_memcache_latency_percentile(&lat, 50));
+
+    /* 90 latencies of 2us and 10 of 1000us (bucket [896, 1024)) */
+    lat.buckets[2] = 90;
+    lat.buckets[35] = 10;
+    lat.count = 100;
+    lat.sum = 90 * 2 + 10 * 1000;
+    lat.max = 1000;
+    ABTS_INT_EQUAL(tc, 2, (int)apr_memcache_latency_percentile(&lat, 0));
+    ABTS_INT_EQUAL(tc, 2, (int)apr_memcache_latency_percentile(&lat, 50));
+    ABTS_INT_EQUAL(tc, 2, (int)apr_memcache_latency_percentile(&lat, 89.9));
+    ABTS_INT_EQUAL(tc, 1000, (int)apr_memcache_latency_percentile(&lat, 90));
+    ABTS_INT_EQUAL(tc, 1000, (int)apr_memcache_latency_percentile(&lat, 99));
+    ABTS_INT_EQUAL(tc, 1000, (int)apr_memcache_latency_percentile(&lat, 100));
+
+    /* the bounds are increasing, by a quarter at most */
+    for (i = 4; i < APR_MC_LATENCY_BUCKETS - 1; i++) {
+        apr_interval_time_t lo = apr_memcache_latency_bucket_limit(i - 1);
+        apr_interval_time_t hi = apr_memcache_latency_bucket_limit(i);
+
+        ABTS_ASSERT(tc, "bucket bounds out of order", hi > lo);
+        ABTS_ASSERT(tc, "bucket too wide", (hi - lo) * 4 <= lo);
+    }
+}
+
+/* test the client side metrics of a server */
+static void test_memcache_metrics(abts_case * tc, void *data)
+{
+    apr_pool_t *pool = p;
+    apr_status_t rv;
+    apr_memcache_t *memcache;
+    apr_memcache_server_t *server;
+    apr_memcache_metrics_t metrics;
+    char *result;
+    int i;
+
+    if (!has_memcache_server()) {
+        ABTS_SKIP(tc, data, "Memcache server not found.");
+        return;
+    }
+
+    rv = apr_memcache_create(pool, 1, 0, &memcache);
+    ABTS_ASSERT(tc, "memcache create failed", rv == APR_SUCCESS);
+    rv = apr_memcache_server_create(pool, HOST, PORT, 0, 1, 1, 60, &server);
+    ABTS_ASSERT(tc, "server create failed", rv == APR_SUCCESS);
+    rv = apr_memcache_add_server(memcache, server);
+    ABTS_ASSERT(tc, "server add failed", rv == APR_SUCCESS);
+
+    for (i = 0; i < 10; i++) {
+        rv = apr_memcache_version(server, pool, &result);
+        ABTS_ASSERT(tc, "version failed", rv == APR_SUCCESS);
+    }
+
+    rv = apr_memcache_server_metrics(server, &metrics);
+    ABTS_ASSERT(tc, "metrics failed", rv == APR_SUCCESS);
+    ABTS_INT_EQUAL(tc, 10, (int)metrics.requests);
+    ABTS_INT_EQUAL(tc, 0, (int)metrics.errors);
+    ABTS_INT_EQUAL(tc, 1, (int)metrics.connects);
+    ABTS_INT_EQUAL(tc, 1, (int)metrics.connect.count);
+    ABTS_INT_EQUAL(tc, 10, (int)metrics.send.count);
+    ABTS_INT_EQUAL(tc, 10, (int)metrics.first_byte.count);
+    ABTS_INT_EQUAL(tc, 10, (int)metrics.total.count);
+    ABTS_ASSERT(tc, "first byte before the send",
+                apr_memcache_latency_percentile(&metrics.first_byte, 50) >=
+                apr_memcache_latency_percentile(&metrics.send, 50));
+    ABTS_ASSERT(tc, "max below the percentile",
+                (apr_interval_time_t)metrics.total.max >=
+                apr_memcache_latency_percentile(&metrics.total, 99));
+    ABTS_INT_EQUAL(tc, 0, (int)metrics.deaths);
+
+    rv = apr_memcache_disable_server(memcache, server);
+    ABTS_ASSERT(tc, "disable failed", rv == APR_SUCCESS);
+    apr_sleep(1000);
+    rv = apr_memcache_enable_server(memcache, server);
+    ABTS_ASSERT(tc, "enable failed", rv == APR_SUCCESS);
+
+    rv = apr_memcache_server_metrics(server, &metrics);
+    ABTS_ASSERT(tc, "metrics failed", rv == APR_SUCCESS);
+    ABTS_INT_EQUAL(tc, 1, (int)metrics.deaths);
+    ABTS_ASSERT(tc, "no dead time", metrics.dead_time >= 1000);
+
+    apr_memcache_server_metrics_reset(server);
+    rv = apr_memcache_server_metrics(server, &metrics);
+    ABTS_ASSERT(tc, "metrics failed", rv == APR_SUCCESS);
+    ABTS_INT_EQUAL(tc, 0, (int)metrics.requests);
+    ABTS_INT_EQUAL(tc, 0, (int)metrics.total.count);
+    ABTS_INT_EQUAL(tc, 0, (int)metrics.dead_time);
+}
+
+/* test the background probing of the dead servers */
+static void test_memcache_prober(abts_case * tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_status_t rv;
+    apr_memcache_t *memcache;
+    apr_memcache_server_t *server;
+    int i;
+
+    if (!has_memcache_server()) {
+        ABTS_SKIP(tc, data, "Memcache server not found.");
+        return;
+    }
+
+    apr_pool_create(&pool, p);
+    rv = apr_memcache_create(pool, 1, 0, &memcache);
+    ABTS_ASSERT(tc, "memcache create failed", rv == APR_SUCCESS);
+    rv = apr_memcache_server_create(pool, HOST, PORT, 0, 1, 1, 60, &server);
+    ABTS_ASSERT(tc, "server create failed", rv == APR_SUCCESS);
+    rv = apr_memcache_add_server(memcache, server);
+    ABTS_ASSERT(tc, "server add failed", rv == APR_SUCCESS);
+
+    rv = apr_memcache_prober_start(memcache, apr_time_from_msec(10),
+                             apr_time_from_msec(100));
+#if !APR_HAS_THREADS
+    ABTS_INT_EQUAL(tc, APR_ENOTIMPL, rv);
+#else
+    ABTS_ASSERT(tc, "prober start failed", rv == APR_SUCCESS);
+    rv = apr_memcache_prober_start(memcache, apr_time_from_msec(10),
+                             apr_time_from_msec(100));
+    ABTS_INT_EQUAL(tc, APR_EEXIST, rv);
+
+    /* dead until probed, the requests don't probe */
+    rv = apr_memcache_disable_server(memcache, server);
+    ABTS_ASSERT(tc, "disable failed", rv == APR_SUCCESS);
+    ABTS_PTR_EQUAL(tc, NULL, apr_memcache_find_server_hash(memcache, 1));
+
+    for (i = 0; i < 200 && server->status != APR_MC_SERVER_LIVE; i++) {
+        apr_sleep(apr_time_from_msec(10));
+    }
+    ABTS_INT_EQUAL(tc, APR_MC_SERVER_LIVE, server->status);
+    ABTS_PTR_EQUAL(tc, server, apr_memcache_find_server_hash(memcache, 1));
+#endif
+
+    /* stops the prober */
+    apr_pool_destroy(pool);
+}
+
 abts_suite *testmemcache(abts_suite * suite)
 {
     suite = ADD_SUITE(suite);
     abts_run_test(suite, test_memcache_create, NULL);
     abts_run_test(suite, test_memcache_user_funcs, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_memcache_consistent, &flag_ketama);
+    abts_run_test(suite, test_memcache_consistent, &flag_jump);
+#endif
     abts_run_test(suite, test_memcache_meta, NULL);
     abts_run_test(suite, test_memcache_setget, NULL);
     abts_run_test(suite, test_memcache_multiget, NULL);
     abts_run_test(suite, test_memcache_addreplace, NULL);
     abts_run_test(suite, test_memcache_incrdecr, NULL);
+    abts_run_test(suite, test_memcache_metacmds, NULL);
+    abts_run_test(suite, test_memcache_near_cache, NULL);
+    abts_run_test(suite, test_memcache_latency, NULL);
+    abts_run_test(suite, test_memcache_metrics, NULL);
+    abts_run_test(suite, test_memcache_prober, NULL);
 
     return suite;
 }
@@ -0,0 +1,210 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr.h"
+#include "apr_general.h"
+#include "apr_metrics.h"
+#include "apr_pools.h"
+#include "apr_strings.h"
+#include "apr_thread_proc.h"
+
+#include <string.h>
+
+typedef struct find_baton_t {
+    const char *name;
+    int found;
+    apr_metric_value_t value;
+} find_baton_t;
+
+static int find_cb(void *baton, const apr_metric_value_t *value)
+{
+    find_baton_t *fb = baton;
+
+    if (strcmp(value->name, fb->name) == 0) {
+        fb->value = *value;
+        fb->found = 1;
+        return 0;
+    }
+    return 1;
+}
+
+static int find_metric(const char *name, apr_metric_value_t *value)
+{
+    find_baton_t fb;
+
+    fb.name = name;
+    fb.found = 0;
+    apr_metrics_do(find_cb, &fb);
+    if (fb.found) {
+        *value = fb.value;
+    }
+    else {
+        memset(value, 0, sizeof(*value));
+    }
+    return fb.found;
+}
+
+static void test_register(abts_case *tc, void *data)
+{
+    apr_metric_t *m1, *m2;
+    apr_status_t rv;
+
+    rv = apr_metric_register(&m1, "test_register_total", "help",
+                             APR_METRIC_COUNTER);
+    APR_ASSERT_SUCCESS(tc, "register counter", rv);
+    rv = apr_metric_register(&m2, "test_register_total", NULL,
+                             APR_METRIC_COUNTER);
+    APR_ASSERT_SUCCESS(tc, "register counter again", rv);
+    ABTS_PTR_EQUAL(tc, m1, m2);
+
+    rv = apr_metric_register(&m2, "test_register_total", NULL,
+                             APR_METRIC_GAUGE);
+    ABTS_INT_EQUAL(tc, APR_EEXIST, rv);
+}
+
+static void test_gauge(abts_case *tc, void *data)
+{
+    apr_metric_value_t v;
+    apr_metric_t *m;
+    apr_status_t rv;
+
+    rv = apr_metric_register(&m, "test_gauge", "A gauge", APR_METRIC_GAUGE);
+    APR_ASSERT_SUCCESS(tc, "register gauge", rv);
+
+    apr_metric_set(m, 10);
+    apr_metric_add(m, -15);
+    ABTS_TRUE(tc, find_metric("test_gauge", &v));
+    ABTS_INT_EQUAL(tc, APR_METRIC_GAUGE, v.type);
+    ABTS_STR_EQUAL(tc, "A gauge", v.help);
+    ABTS_TRUE(tc, v.value == -5);
+}
+
+static void test_histogram(abts_case *tc, void *data)
+{
+    apr_metric_value_t v;
+    apr_metric_t *m;
+    apr_status_t rv;
+    apr_uint64_t total = 0, low;
+    int i;
+
+    rv = apr_metric_register(&m, "test_histogram", NULL,
+                             APR_METRIC_HISTOGRAM);
+    APR_ASSERT_SUCCESS(tc, "register histogram", rv);
+
+    for (i = 0; i < 1000; i++) {
+        apr_metric_observe(m, i);
+        total += i;
+    }
+    apr_metric_observe(m, APR_UINT64_C(1) << 50);
+
+    ABTS_TRUE(tc, find_metric("test_histogram", &v));
+    ABTS_TRUE(tc, v.count == 1001);
+    ABTS_TRUE(tc, v.sum == total + (APR_UINT64_C(1) << 50));
+    ABTS_TRUE(tc, v.buckets[APR_METRIC_BUCKETS - 1] == 1);
+
+    /* Each bucket counts the values above the previous bound, up to its
+     * bound, and the bounds grow by a quarter of a power of two at most */
+    low = 0;
+    for (i = 0; i < APR_METRIC_BUCKETS - 1; i++) {
+        apr_uint64_t bound = apr_metric_bucket_bound(i);
+        apr_uint64_t expected = 0;
+
+        ABTS_TRUE(tc, i == 0 || bound > low);
+        if (low < 1000) {
+            expected = (bound < 1000 ? bound + 1 : 1000) - (i ? low + 1 : 0);
+        }
+        ABTS_TRUE(tc, v.buckets[i] == expected);
+        if (i >= 8) {
+            ABTS_TRUE(tc, (bound - low) * 4 <= low + 1);
+        }
+        low = bound;
+    }
+    ABTS_TRUE(tc, apr_metric_bucket_bound(APR_METRIC_BUCKETS - 1)
+                  == APR_UINT64_MAX);
+}
+
+static void test_builtin(abts_case *tc, void *data)
+{
+    apr_metric_value_t before, after;
+    apr_pool_t *pool;
+
+    ABTS_TRUE(tc, find_metric("apr_pools_created_total", &before));
+    ABTS_INT_EQUAL(tc, APR_METRIC_COUNTER, before.type);
+
+    apr_pool_create(&pool, p);
+    apr_pool_destroy(pool);
+
+    ABTS_TRUE(tc, find_metric("apr_pools_created_total", &after));
+    ABTS_TRUE(tc, after.value > before.value);
+}
+
+#if APR_HAS_THREADS
+
+#define NUM_THREADS 4
+#define NUM_ADDS 100000
+
+static void * APR_THREAD_FUNC counter_thread(apr_thread_t *thd, void *data)
+{
+    apr_metric_t *m = data;
+    int i;
+
+    for (i = 0; i < NUM_ADDS; i++) {
+        apr_metric_add(m, 1);
+    }
+    return NULL;
+}
+
+static void test_counter_threads(abts_case *tc, void *data)
+{
+    apr_thread_t *threads[NUM_THREADS];
+    apr_metric_value_t v;
+    apr_metric_t *m;
+    apr_status_t rv, retval;
+    int i;
+
+    rv = apr_metric_register(&m, "test_counter_total", "A counter",
+                             APR_METRIC_COUNTER);
+    APR_ASSERT_SUCCESS(tc, "register counter", rv);
+
+    for (i = 0; i < NUM_THREADS; i++) {
+        rv = apr_thread_create(&threads[i], NULL, counter_thread, m, p);
+        APR_ASSERT_SUCCESS(tc, "create thread", rv);
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        apr_thread_join(&retval, threads[i]);
+    }
+
+    ABTS_TRUE(tc, find_metric("test_counter_total", &v));
+    ABTS_TRUE(tc, v.value == (apr_int64_t)NUM_THREADS * NUM_ADDS);
+}
+
+#endif /* APR_HAS_THREADS */
+
+abts_suite *testmetrics(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite);
+
+    abts_run_test(suite, test_register, NULL);
+    abts_run_test(suite, test_gauge, NULL);
+    abts_run_test(suite, test_histogram, NULL);
+    abts_run_test(suite, test_builtin, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_counter_threads, NULL);
+#endif
+
+    return suite;
+}
@@ -174,6 +174,58 @@ static void test_mmap_offset(abts_case *tc, void *data)
     ABTS_STR_NEQUAL(tc, addr, thisfdata + 5, thisfsize - 5);
 }
 
+static void test_mmap_cache(abts_case *tc, void *data)
+{
+    apr_off_t *offset = data;
+    apr_mmap_cache_t *cache;
+    apr_mmap_t *mm1, *mm2, *mm3;
+    apr_pool_t *p1, *p2;
+    void *addr;
+    apr_status_t rv;
+
+    rv = apr_mmap_cache_create(&cache, 2 * thisfsize, ptest);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_pool_create(&p1, ptest);
+    apr_pool_create(&p2, ptest);
+
+    rv = apr_mmap_cache_get(&mm1, cache, thefile, *offset, thisfsize, p1);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_SIZE_EQUAL(tc, thisfsize, mm1->size);
+    ABTS_STR_NEQUAL(tc, mm1->mm, thisfdata, thisfsize);
+
+    /* Shared while in use */
+    rv = apr_mmap_cache_get(&mm2, cache, thefile, *offset, thisfsize, p2);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_PTR_EQUAL(tc, mm1->mm, mm2->mm);
+    addr = mm1->mm;
+
+    rv = apr_mmap_dup(&mm3, mm1, p1);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_mmap_delete(mm1);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_STR_NEQUAL(tc, mm3->mm, thisfdata, thisfsize);
+    apr_pool_clear(p1);
+    ABTS_STR_NEQUAL(tc, mm2->mm, thisfdata, thisfsize);
+    apr_pool_clear(p2);
+
+    /* Kept while unused */
+    rv = apr_mmap_cache_get(&mm1, cache, thefile, *offset, thisfsize, p1);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_PTR_EQUAL(tc, addr, mm1->mm);
+    rv = apr_mmap_offset(&addr, mm1, 5);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_STR_NEQUAL(tc, addr, thisfdata + 5, thisfsize - 5);
+
+    /* Another region */
+    rv = apr_mmap_cache_get(&mm2, cache, thefile, *offset, thisfsize - 1, p2);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_SIZE_EQUAL(tc, thisfsize - 1, mm2->size);
+    ABTS_STR_NEQUAL(tc, mm2->mm, thisfdata, thisfsize - 1);
+
+    apr_pool_destroy(p1);
+    apr_pool_destroy(p2);
+}
+
 #endif
 
 abts_suite *testmmap(abts_suite *suite)
@@ -193,6 +245,7 @@ abts_suite *testmmap(abts_suite *suite)
         abts_run_test(suite, test_mmap_create, &test_set[i].offset);
         abts_run_test(suite, test_mmap_contents, &test_set[i].offset);
         abts_run_test(suite, test_mmap_offset, &test_set[i].offset);
+        abts_run_test(suite, test_mmap_cache, &test_set[i].offset);
         abts_run_test(suite, test_mmap_delete, NULL);
         abts_run_test(suite, test_file_close, NULL);
         apr_pool_clear(ptest);
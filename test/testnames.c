@@ -114,6 +114,83 @@ static void merge_dotdot_dotdot_dotdot(abts_case *tc, void *data)
     ABTS_STR_EQUAL(tc, "../../../", dstpath);
 }
 
+static void merge_buf(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    char buf[64];
+
+    rv = apr_filepath_merge_buf(buf, sizeof(buf), ABS_ROOT"foo", "bar/baz",
+                                0, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_STR_EQUAL(tc, ABS_ROOT"foo/bar/baz", buf);
+
+    rv = apr_filepath_merge_buf(buf, sizeof(buf), ABS_ROOT"foo/",
+                                "bar//./baz/../qux/", 0, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_STR_EQUAL(tc, ABS_ROOT"foo/bar/qux/", buf);
+
+    rv = apr_filepath_merge_buf(buf, sizeof(buf), ABS_ROOT"foo",
+                                ".htaccess", 0, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_STR_EQUAL(tc, ABS_ROOT"foo/.htaccess", buf);
+
+    rv = apr_filepath_merge_buf(buf, sizeof(buf), ABS_ROOT"foo", "../bar",
+                                APR_FILEPATH_SECUREROOT, p);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_EABOVEROOT(rv));
+
+    rv = apr_filepath_merge_buf(buf, 8, ABS_ROOT"foo", "bar/baz", 0, p);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_ENAMETOOLONG(rv));
+}
+
+static void merge_cached(abts_case *tc, void *data)
+{
+    apr_filepath_cache_t *cache;
+    apr_status_t rv;
+    char *dstpath = NULL, *first;
+    int i;
+
+    rv = apr_filepath_cache_create(&cache, 2, p);
+    APR_ASSERT_SUCCESS(tc, "create the cache", rv);
+
+    rv = apr_filepath_merge_cached(&first, cache, ABS_ROOT"foo", "a/../b",
+                                   0, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_STR_EQUAL(tc, ABS_ROOT"foo/b", first);
+
+    /* The hits return copies, the failures are not cached */
+    for (i = 0; i < 2; i++) {
+        rv = apr_filepath_merge_cached(&dstpath, cache, ABS_ROOT"foo",
+                                       "a/../b", 0, p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_STR_EQUAL(tc, ABS_ROOT"foo/b", dstpath);
+        ABTS_TRUE(tc, dstpath != first);
+
+        rv = apr_filepath_merge_cached(&dstpath, cache, ABS_ROOT"foo",
+                                       "../b", APR_FILEPATH_SECUREROOT, p);
+        ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_EABOVEROOT(rv));
+    }
+
+    /* The flags are part of the key, and the oldest entries go first */
+    rv = apr_filepath_merge_cached(&dstpath, cache, ABS_ROOT"foo",
+                                   ABS_ROOT"b", 0, p);
+    ABTS_STR_EQUAL(tc, ABS_ROOT"b", dstpath);
+    rv = apr_filepath_merge_cached(&dstpath, cache, ABS_ROOT"foo",
+                                   ABS_ROOT"b", APR_FILEPATH_NOTABSOLUTE, p);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_EABSOLUTE(rv));
+    rv = apr_filepath_merge_cached(&dstpath, cache, ABS_ROOT"bar", "c", 0, p);
+    ABTS_STR_EQUAL(tc, ABS_ROOT"bar/c", dstpath);
+    for (i = 0; i < 3; i++) {
+        rv = apr_filepath_merge_cached(&dstpath, cache, ABS_ROOT"foo",
+                                       i == 1 ? "c" : "d", 0, p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_STR_EQUAL(tc, i == 1 ? ABS_ROOT"foo/c" : ABS_ROOT"foo/d",
+                       dstpath);
+    }
+    rv = apr_filepath_merge_cached(&dstpath, cache, ABS_ROOT"foo", "a/../b",
+                                   0, p);
+    ABTS_STR_EQUAL(tc, ABS_ROOT"foo/b", dstpath);
+}
+
 static void merge_secure(abts_case *tc, void *data)
 {
     apr_status_t rv;
@@ -372,6 +449,8 @@ abts_suite *testnames(abts_suite *suite)
     abts_run_test(suite, merge_notabs, NULL);
     abts_run_test(suite, merge_notabsfail, NULL);
     abts_run_test(suite, merge_dotdot_dotdot_dotdot, NULL);
+    abts_run_test(suite, merge_buf, NULL);
+    abts_run_test(suite, merge_cached, NULL);
 #if defined(WIN32)
     abts_run_test(suite, merge_lowercasedrive, NULL);
     abts_run_test(suite, merge_shortname, NULL);
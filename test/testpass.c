@@ -195,6 +195,49 @@ static void test_bcryptpass(abts_case *tc, void *data)
                        apr_password_validate(pass3, hash2));
 }
 
+static void test_cachedpass(abts_case *tc, void *data)
+{
+    apr_password_cache_t *cache;
+    unsigned char salt[] = "sardine_sardine";
+    char hash[100], hash2[100];
+    apr_status_t rv;
+
+    rv = apr_password_cache_create(&cache, 1, apr_time_from_sec(60), p);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "no random bytes for the password cache");
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "create password cache", rv);
+    ABTS_INT_EQUAL(tc, APR_EINVAL,
+                   apr_password_cache_create(&cache, 0, 1, p));
+    ABTS_INT_EQUAL(tc, APR_EINVAL,
+                   apr_password_cache_create(&cache, 1, 0, p));
+
+    APR_ASSERT_SUCCESS(tc, "bcrypt encode password",
+                       apr_bcrypt_encode("hellojed", 5, salt, sizeof(salt),
+                                         hash, sizeof(hash)));
+    apr_md5_encode("hellojed", "sardine", hash2, sizeof(hash2));
+
+    APR_ASSERT_SUCCESS(tc, "password validated",
+                       apr_password_validate_cached(cache, "hellojed", hash));
+    APR_ASSERT_SUCCESS(tc, "cached password validated",
+                       apr_password_validate_cached(cache, "hellojed", hash));
+    APR_ASSERT_FAILURE(tc, "wrong password should not validate",
+                       apr_password_validate_cached(cache, "hellojed2", hash));
+    APR_ASSERT_SUCCESS(tc, "password still validated",
+                       apr_password_validate_cached(cache, "hellojed", hash));
+
+    /* replaces the first one (size 1) */
+    APR_ASSERT_SUCCESS(tc, "other hash validated",
+                       apr_password_validate_cached(cache, "hellojed", hash2));
+    APR_ASSERT_FAILURE(tc, "wrong password should not validate other hash",
+                       apr_password_validate_cached(cache, "hellojed2",
+                                                    hash2));
+    APR_ASSERT_SUCCESS(tc, "replaced password validated",
+                       apr_password_validate_cached(cache, "hellojed", hash));
+    APR_ASSERT_FAILURE(tc, "wrong password should not validate again",
+                       apr_password_validate_cached(cache, "hellojed2", hash));
+}
 
 abts_suite *testpass(abts_suite *suite)
 {
@@ -209,6 +252,7 @@ abts_suite *testpass(abts_suite *suite)
     abts_run_test(suite, test_shapass, NULL);
     abts_run_test(suite, test_md5pass, NULL);
     abts_run_test(suite, test_bcryptpass, NULL);
+    abts_run_test(suite, test_cachedpass, NULL);
 #ifdef GLIBCSHA_ALGO_SUPPORTED
     abts_run_test(suite, test_glibc_shapass, NULL);
 #endif
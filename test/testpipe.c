@@ -220,6 +220,125 @@ static void wait_pipe(abts_case *tc, void *data)
     APR_ASSERT_SUCCESS(tc, "Wait for pipe failed", rv);
 }
 
+static void pipe_size(abts_case *tc, void *data)
+{
+    apr_file_t *thefile;
+    apr_size_t size;
+    apr_status_t rv;
+
+    rv = apr_file_pipe_create(&readp, &writep, p);
+    APR_ASSERT_SUCCESS(tc, "Couldn't create pipe", rv);
+
+    rv = apr_file_pipe_size_set(writep, 256 * 1024);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "apr_file_pipe_size_set() not implemented");
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "Couldn't set pipe size", rv);
+    rv = apr_file_pipe_size_get(readp, &size);
+    APR_ASSERT_SUCCESS(tc, "Couldn't get pipe size", rv);
+    ABTS_TRUE(tc, size >= 256 * 1024);
+
+    rv = apr_file_open(&thefile, "data/file_datafile.txt", APR_FOPEN_READ,
+                       APR_FPROT_OS_DEFAULT, p);
+    APR_ASSERT_SUCCESS(tc, "Couldn't open file", rv);
+    rv = apr_file_pipe_size_set(thefile, 256 * 1024);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+    apr_file_close(thefile);
+}
+
+#define SPLICE_DATA "this is spliced data"
+#define SPLICE_FILE "data/testpipe_splice.txt"
+
+static void splice_pipe(abts_case *tc, void *data)
+{
+    apr_file_t *thefile, *readp2, *writep2;
+    apr_size_t nbytes;
+    apr_status_t rv;
+    char buf[64];
+    int buffered;
+
+    rv = apr_file_pipe_create(&readp, &writep, p);
+    APR_ASSERT_SUCCESS(tc, "Couldn't create pipe", rv);
+    rv = apr_file_pipe_create(&readp2, &writep2, p);
+    APR_ASSERT_SUCCESS(tc, "Couldn't create pipe", rv);
+
+    /* Spliced or copied through the buffer */
+    for (buffered = 0; buffered <= APR_FOPEN_BUFFERED;
+         buffered += APR_FOPEN_BUFFERED) {
+        nbytes = strlen(SPLICE_DATA);
+        rv = apr_file_write(writep, SPLICE_DATA, &nbytes);
+        APR_ASSERT_SUCCESS(tc, "Couldn't write to pipe", rv);
+
+        /* From the pipe to the file */
+        rv = apr_file_open(&thefile, SPLICE_FILE, APR_FOPEN_WRITE
+                           | APR_FOPEN_CREATE | APR_FOPEN_TRUNCATE | buffered,
+                           APR_FPROT_OS_DEFAULT, p);
+        APR_ASSERT_SUCCESS(tc, "Couldn't open file", rv);
+        nbytes = sizeof(buf);
+        rv = apr_file_splice(readp, thefile, &nbytes, 0);
+        APR_ASSERT_SUCCESS(tc, "Couldn't splice to file", rv);
+        ABTS_SIZE_EQUAL(tc, strlen(SPLICE_DATA), nbytes);
+        apr_file_close(thefile);
+
+        /* From the file to the other pipe */
+        rv = apr_file_open(&thefile, SPLICE_FILE, APR_FOPEN_READ | buffered,
+                           APR_FPROT_OS_DEFAULT, p);
+        APR_ASSERT_SUCCESS(tc, "Couldn't open file", rv);
+        nbytes = sizeof(buf);
+        rv = apr_file_splice(thefile, writep2, &nbytes, 0);
+        APR_ASSERT_SUCCESS(tc, "Couldn't splice from file", rv);
+        ABTS_SIZE_EQUAL(tc, strlen(SPLICE_DATA), nbytes);
+        nbytes = sizeof(buf);
+        rv = apr_file_splice(thefile, writep2, &nbytes, 0);
+        ABTS_INT_EQUAL(tc, APR_EOF, rv);
+        ABTS_SIZE_EQUAL(tc, 0, nbytes);
+        apr_file_close(thefile);
+
+        nbytes = sizeof(buf);
+        rv = apr_file_read(readp2, buf, &nbytes);
+        APR_ASSERT_SUCCESS(tc, "Couldn't read from pipe", rv);
+        ABTS_SIZE_EQUAL(tc, strlen(SPLICE_DATA), nbytes);
+        ABTS_TRUE(tc, memcmp(buf, SPLICE_DATA, nbytes) == 0);
+    }
+    apr_file_remove(SPLICE_FILE, p);
+
+    /* Copied from pipe to pipe without consuming it */
+    nbytes = strlen(SPLICE_DATA);
+    rv = apr_file_write(writep, SPLICE_DATA, &nbytes);
+    APR_ASSERT_SUCCESS(tc, "Couldn't write to pipe", rv);
+    nbytes = sizeof(buf);
+    rv = apr_file_splice(readp, writep2, &nbytes, APR_FILE_SPLICE_TEE);
+    if (rv != APR_ENOTIMPL) {
+        APR_ASSERT_SUCCESS(tc, "Couldn't tee the pipe", rv);
+        ABTS_SIZE_EQUAL(tc, strlen(SPLICE_DATA), nbytes);
+        nbytes = sizeof(buf);
+        rv = apr_file_read(readp2, buf, &nbytes);
+        APR_ASSERT_SUCCESS(tc, "Couldn't read from pipe", rv);
+        ABTS_SIZE_EQUAL(tc, strlen(SPLICE_DATA), nbytes);
+    }
+    nbytes = sizeof(buf);
+    rv = apr_file_read(readp, buf, &nbytes);
+    APR_ASSERT_SUCCESS(tc, "Couldn't read from pipe", rv);
+    ABTS_SIZE_EQUAL(tc, strlen(SPLICE_DATA), nbytes);
+
+    /* Nothing to move from a non blocking pipe */
+    rv = apr_file_pipe_timeout_set(readp, 0);
+    APR_ASSERT_SUCCESS(tc, "Couldn't set pipe timeout", rv);
+    nbytes = sizeof(buf);
+    rv = apr_file_splice(readp, writep2, &nbytes, 0);
+    ABTS_TRUE(tc, APR_STATUS_IS_EAGAIN(rv));
+    ABTS_SIZE_EQUAL(tc, 0, nbytes);
+
+    apr_file_close(writep);
+    nbytes = sizeof(buf);
+    rv = apr_file_splice(readp, writep2, &nbytes, 0);
+    ABTS_INT_EQUAL(tc, APR_EOF, rv);
+    apr_file_close(readp);
+    apr_file_close(readp2);
+    apr_file_close(writep2);
+}
+
 abts_suite *testpipe(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -234,6 +353,10 @@ abts_suite *testpipe(abts_suite *suite)
     abts_run_test(suite, test_pipe_writefull, NULL);
     abts_run_test(suite, close_pipe, NULL);
     abts_run_test(suite, wait_pipe, NULL);
+    abts_run_test(suite, close_pipe, NULL);
+    abts_run_test(suite, pipe_size, NULL);
+    abts_run_test(suite, close_pipe, NULL);
+    abts_run_test(suite, splice_pipe, NULL);
 
     return suite;
 }
@@ -21,6 +21,14 @@
 #include "apr_lib.h"
 #include "apr_network_io.h"
 #include "apr_poll.h"
+#include "apr_thread_proc.h"
+
+#if APR_HAVE_SIGNAL_H
+#include <signal.h>
+#endif
+#if APR_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 
 #define SMALL_NUM_SOCKETS 3
 /* We can't use 64 here, because some platforms *ahem* Solaris *ahem* have
@@ -567,6 +575,104 @@ static void pollset_remove(abts_case *tc, void *data)
              (hot_files[1].client_data == (void *)1)));
 }
 
+static void pollset_readd(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_pollset_t *pollset;
+    const apr_pollfd_t *hot_files;
+    apr_pollfd_t pfd;
+    apr_int32_t num;
+    int i;
+
+    rv = apr_pollset_create_ex(&pollset, 2, p, APR_POLLSET_THREADSAFE,
+                               default_pollset_impl);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "APR_POLLSET_THREADSAFE not supported");
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    pfd.p = p;
+    pfd.desc_type = APR_POLL_SOCKET;
+    pfd.reqevents = APR_POLLOUT;
+
+    /* The removed copies are reused, each poll must see the last one */
+    for (i = 0; i < 100; i++) {
+        pfd.desc.s = s[i % 2];
+        pfd.client_data = (void *)(apr_uintptr_t)(i + 1);
+        rv = apr_pollset_add(pollset, &pfd);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+        rv = apr_pollset_poll(pollset, 1000, &num, &hot_files);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_INT_EQUAL(tc, 1, num);
+        ABTS_PTR_EQUAL(tc, s[i % 2], hot_files[0].desc.s);
+        ABTS_PTR_EQUAL(tc, (void *)(apr_uintptr_t)(i + 1),
+                       hot_files[0].client_data);
+
+        rv = apr_pollset_remove(pollset, &pfd);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+
+    rv = apr_pollset_remove(pollset, &pfd);
+    ABTS_INT_EQUAL(tc, APR_NOTFOUND, rv);
+}
+
+static void pollset_remove_close(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_pollset_t *ps;
+    const apr_pollfd_t *hot_files;
+    apr_pollfd_t pfd;
+    apr_socket_t *sock;
+    apr_sockaddr_t *addr, *local;
+    apr_int32_t num;
+
+    rv = apr_pollset_create_ex(&ps, 1, p, 0, default_pollset_impl);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_sockaddr_info_get(&addr, "127.0.0.1", APR_UNSPEC, 0, 0, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_socket_create(&sock, addr->family, SOCK_STREAM, 0, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_socket_opt_set(sock, APR_SO_REUSEADDR, 1);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_socket_bind(sock, addr);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_socket_listen(sock, 5);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_socket_addr_get(&local, APR_LOCAL, sock);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    pfd.p = p;
+    pfd.desc_type = APR_POLL_SOCKET;
+    pfd.reqevents = APR_POLLIN;
+    pfd.desc.s = sock;
+    pfd.client_data = NULL;
+    rv = apr_pollset_add(ps, &pfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pollset_poll(ps, 0, &num, &hot_files);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+
+    /* Once removed and closed, the listener's address is free again */
+    rv = apr_pollset_remove(ps, &pfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_socket_close(sock);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_socket_create(&sock, local->family, SOCK_STREAM, 0, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_socket_opt_set(sock, APR_SO_REUSEADDR, 1);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_socket_bind(sock, local);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_socket_listen(sock, 5);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_socket_close(sock);
+
+    apr_pollset_destroy(ps);
+}
+
 #define POLLCB_PREREQ \
     do { \
         if (pollcb == NULL) { \
@@ -578,7 +684,8 @@ static void pollset_remove(abts_case *tc, void *data)
 static void setup_pollcb(abts_case *tc, void *data)
 {
     apr_status_t rv;
-    rv = apr_pollcb_create(&pollcb, LARGE_NUM_SOCKETS, p, 0);
+    rv = apr_pollcb_create_ex(&pollcb, LARGE_NUM_SOCKETS, p, 0,
+                              default_pollset_impl);
     if (rv == APR_ENOTIMPL) {
         pollcb = NULL;
         ABTS_NOT_IMPL(tc, "pollcb interface not supported");
@@ -776,6 +883,36 @@ static void pollcb_default(abts_case *tc, void *data)
     }
 }
 
+/* Wakeups before the poll are coalesced into one */
+static void pollset_wakeup_coalesced(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_pollset_t *pollset;
+    apr_int32_t num;
+    const apr_pollfd_t *descriptors;
+    int i;
+
+    rv = apr_pollset_create_ex(&pollset, 1, p, APR_POLLSET_WAKEABLE,
+                               default_pollset_impl);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "apr_pollset_wakeup() not supported");
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    for (i = 0; i < 3; ++i) {
+        rv = apr_pollset_wakeup(pollset);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    rv = apr_pollset_poll(pollset, -1, &num, &descriptors);
+    ABTS_INT_EQUAL(tc, APR_EINTR, rv);
+    rv = apr_pollset_poll(pollset, 0, &num, &descriptors);
+    ABTS_INT_EQUAL(tc, APR_TIMEUP, rv);
+
+    rv = apr_pollset_destroy(pollset);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
 static void pollset_wakeup(abts_case *tc, void *data)
 {
     apr_status_t rv;
@@ -838,7 +975,8 @@ static void pollcb_wakeup(abts_case *tc, void *data)
     apr_status_t rv;
     apr_pollcb_t *pcb;
 
-    rv = apr_pollcb_create(&pcb, 1, p, APR_POLLSET_WAKEABLE);
+    rv = apr_pollcb_create_ex(&pcb, 1, p, APR_POLLSET_WAKEABLE,
+                              default_pollset_impl);
     if (rv == APR_ENOTIMPL) {
         ABTS_NOT_IMPL(tc, "pollcb interface not supported");
         return;
@@ -854,6 +992,228 @@ static void pollcb_wakeup(abts_case *tc, void *data)
     ABTS_INT_EQUAL(tc, APR_EINTR, rv);
 }
 
+static void pollset_oneshot(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_pollset_t *pollset;
+    const apr_pollfd_t *descriptors;
+    apr_pollfd_t pfd;
+    apr_int32_t num;
+
+    rv = apr_pollset_create_ex(&pollset, 2, p, 0, default_pollset_impl);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    pfd.p = p;
+    pfd.desc_type = APR_POLL_SOCKET;
+    pfd.reqevents = APR_POLLIN | APR_POLLONESHOT;
+    pfd.desc.s = s[10];
+    pfd.client_data = s[10];
+    rv = apr_pollset_add(pollset, &pfd);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "APR_POLLONESHOT not supported");
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    send_msg(s, sa, 10, tc);
+
+    rv = apr_pollset_poll(pollset, apr_time_from_sec(1), &num, &descriptors);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, num);
+    ABTS_PTR_EQUAL(tc, s[10], descriptors[0].client_data);
+    ABTS_ASSERT(tc, "POLLIN not signalled", descriptors[0].rtnevents & APR_POLLIN);
+
+    /* Still readable, but not polled anymore */
+    rv = apr_pollset_poll(pollset, 0, &num, &descriptors);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+
+    rv = apr_pollset_rearm(pollset, &pfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_pollset_poll(pollset, apr_time_from_sec(1), &num, &descriptors);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, num);
+
+    recv_msg(s, 10, p, tc);
+
+    rv = apr_pollset_rearm(pollset, &pfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_pollset_poll(pollset, 0, &num, &descriptors);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+
+    pfd.desc.s = s[11];
+    rv = apr_pollset_rearm(pollset, &pfd);
+    ABTS_INT_EQUAL(tc, APR_NOTFOUND, rv);
+
+    pfd.desc.s = s[10];
+    rv = apr_pollset_remove(pollset, &pfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+static void pollset_edge(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_pollset_t *pollset;
+    const apr_pollfd_t *descriptors;
+    apr_pollfd_t pfd;
+    apr_int32_t num;
+
+    rv = apr_pollset_create_ex(&pollset, 2, p, 0, default_pollset_impl);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    pfd.p = p;
+    pfd.desc_type = APR_POLL_SOCKET;
+    pfd.reqevents = APR_POLLIN | APR_POLLET;
+    pfd.desc.s = s[11];
+    pfd.client_data = s[11];
+    rv = apr_pollset_add(pollset, &pfd);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "APR_POLLET not supported");
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    send_msg(s, sa, 11, tc);
+
+    rv = apr_pollset_poll(pollset, apr_time_from_sec(1), &num, &descriptors);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, num);
+
+    /* Still readable, but nothing new */
+    rv = apr_pollset_poll(pollset, 0, &num, &descriptors);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+
+    send_msg(s, sa, 11, tc);
+
+    rv = apr_pollset_poll(pollset, apr_time_from_sec(1), &num, &descriptors);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, num);
+
+    recv_msg(s, 11, p, tc);
+    recv_msg(s, 11, p, tc);
+
+    rv = apr_pollset_remove(pollset, &pfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+static void pollset_poll_ex(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_pollset_t *pollset;
+    apr_pollfd_t pfd, results[3];
+    apr_int32_t num;
+    int i;
+
+    rv = apr_pollset_create_ex(&pollset, 3, p, 0, default_pollset_impl);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    pfd.p = p;
+    pfd.desc_type = APR_POLL_SOCKET;
+    pfd.reqevents = APR_POLLIN;
+    for (i = 13; i < 16; i++) {
+        pfd.desc.s = s[i];
+        pfd.client_data = s[i];
+        rv = apr_pollset_add(pollset, &pfd);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        send_msg(s, sa, i, tc);
+    }
+
+    /* Fewer results than signalled descriptors */
+    rv = apr_pollset_poll_ex(pollset, apr_time_from_sec(1), 2, &num, results);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "apr_pollset_poll_ex() with a small maxevents");
+    }
+    else {
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_INT_EQUAL(tc, 2, num);
+        for (i = 0; i < num; i++) {
+            ABTS_ASSERT(tc, "POLLIN not signalled",
+                        results[i].rtnevents & APR_POLLIN);
+        }
+    }
+
+    rv = apr_pollset_poll_ex(pollset, apr_time_from_sec(1), 3, &num, results);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 3, num);
+    for (i = 0; i < num; i++) {
+        ABTS_ASSERT(tc, "unexpected descriptor",
+                    results[i].desc.s == results[i].client_data);
+        ABTS_ASSERT(tc, "POLLIN not signalled",
+                    results[i].rtnevents & APR_POLLIN);
+    }
+
+    rv = apr_pollset_poll_ex(pollset, 0, 0, &num, results);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    for (i = 13; i < 16; i++) {
+        recv_msg(s, i, p, tc);
+        pfd.desc.s = s[i];
+        rv = apr_pollset_remove(pollset, &pfd);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+
+    rv = apr_pollset_poll_ex(pollset, 0, 3, &num, results);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+}
+
+static apr_status_t count_pollcb_cb(void *baton, apr_pollfd_t *descriptor)
+{
+    int *count = baton;
+
+    (*count)++;
+    return APR_SUCCESS;
+}
+
+static void pollcb_oneshot(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_pollcb_t *pcb;
+    apr_pollfd_t pfd;
+    int count = 0;
+
+    rv = apr_pollcb_create_ex(&pcb, 2, p, 0, default_pollset_impl);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "pollcb interface not supported");
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    pfd.p = p;
+    pfd.desc_type = APR_POLL_SOCKET;
+    pfd.reqevents = APR_POLLIN | APR_POLLONESHOT;
+    pfd.desc.s = s[12];
+    pfd.client_data = s[12];
+    rv = apr_pollcb_add(pcb, &pfd);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "APR_POLLONESHOT not supported");
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    send_msg(s, sa, 12, tc);
+
+    rv = apr_pollcb_poll(pcb, apr_time_from_sec(1), count_pollcb_cb, &count);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, count);
+
+    rv = apr_pollcb_poll(pcb, 0, count_pollcb_cb, &count);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+    ABTS_INT_EQUAL(tc, 1, count);
+
+    rv = apr_pollcb_rearm(pcb, &pfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_pollcb_poll(pcb, apr_time_from_sec(1), count_pollcb_cb, &count);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 2, count);
+
+    recv_msg(s, 12, p, tc);
+
+    rv = apr_pollcb_remove(pcb, &pfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
 static void justsleep(abts_case *tc, void *data)
 {
     apr_int32_t nsds;
@@ -917,6 +1277,121 @@ static void justsleep(abts_case *tc, void *data)
     }
 }
 
+static void poll_sources(abts_case *tc, void *data)
+{
+    apr_pollset_t *ps;
+    apr_pollfd_t timer, sig, proc;
+    const apr_pollfd_t *descs;
+    apr_uint64_t expirations;
+    apr_int32_t num;
+    apr_status_t rv;
+    int signums[1];
+    int signum;
+
+    rv = apr_pollset_create_ex(&ps, 3, p, 0, default_pollset_impl);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "pollset method not supported");
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "Couldn't create the pollset", rv);
+
+    rv = apr_poll_timer_create(&timer, apr_time_from_msec(10), 0, p);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "poll sources not supported");
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "Couldn't create the timer", rv);
+    ABTS_INT_EQUAL(tc, APR_POLL_TIMER, timer.desc_type);
+    rv = apr_poll_timer_read(&timer, &expirations);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_EAGAIN(rv));
+
+    rv = apr_pollset_add(ps, &timer);
+    APR_ASSERT_SUCCESS(tc, "Couldn't add the timer", rv);
+    rv = apr_pollset_poll(ps, apr_time_from_sec(5), &num, &descs);
+    APR_ASSERT_SUCCESS(tc, "Timer didn't expire", rv);
+    ABTS_INT_EQUAL(tc, 1, num);
+    ABTS_INT_EQUAL(tc, APR_POLL_TIMER, descs[0].desc_type);
+    rv = apr_poll_timer_read(&timer, &expirations);
+    APR_ASSERT_SUCCESS(tc, "Couldn't read the timer", rv);
+    ABTS_TRUE(tc, expirations == 1);
+
+    /* Disarmed until set again */
+    rv = apr_pollset_poll(ps, apr_time_from_msec(20), &num, &descs);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+    rv = apr_poll_timer_set(&timer, apr_time_from_msec(1), 0);
+    APR_ASSERT_SUCCESS(tc, "Couldn't rearm the timer", rv);
+    rv = apr_pollset_poll(ps, apr_time_from_sec(5), &num, &descs);
+    APR_ASSERT_SUCCESS(tc, "Rearmed timer didn't expire", rv);
+    rv = apr_poll_timer_read(&timer, &expirations);
+    APR_ASSERT_SUCCESS(tc, "Couldn't read the rearmed timer", rv);
+    apr_pollset_remove(ps, &timer);
+
+#if APR_HAVE_SIGNAL_H
+    signums[0] = SIGUSR2;
+    rv = apr_poll_signal_create(&sig, signums, 1, p);
+    APR_ASSERT_SUCCESS(tc, "Couldn't create the signal source", rv);
+    rv = apr_pollset_add(ps, &sig);
+    APR_ASSERT_SUCCESS(tc, "Couldn't add the signal source", rv);
+
+    raise(SIGUSR2);
+    rv = apr_pollset_poll(ps, apr_time_from_sec(5), &num, &descs);
+    APR_ASSERT_SUCCESS(tc, "Signal wasn't polled", rv);
+    ABTS_INT_EQUAL(tc, 1, num);
+    ABTS_INT_EQUAL(tc, APR_POLL_SIGNAL, descs[0].desc_type);
+    rv = apr_poll_signal_read(&sig, &signum);
+    APR_ASSERT_SUCCESS(tc, "Couldn't read the signal", rv);
+    ABTS_INT_EQUAL(tc, SIGUSR2, signum);
+    rv = apr_poll_signal_read(&sig, &signum);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_EAGAIN(rv));
+    apr_pollset_remove(ps, &sig);
+#endif
+
+#if APR_HAS_FORK
+    {
+        apr_proc_t child;
+        apr_exit_why_e why;
+        int code;
+
+        rv = apr_proc_fork(&child, p);
+        if (rv == APR_INCHILD) {
+            _exit(42);
+        }
+        ABTS_INT_EQUAL(tc, APR_INPARENT, rv);
+
+        rv = apr_poll_proc_create(&proc, &child, p);
+        if (rv == APR_ENOTIMPL) {
+            apr_proc_wait(&child, &code, &why, APR_WAIT);
+            ABTS_NOT_IMPL(tc, "process source not supported by the kernel");
+        }
+        else {
+            APR_ASSERT_SUCCESS(tc, "Couldn't create the process source", rv);
+            rv = apr_pollset_add(ps, &proc);
+            APR_ASSERT_SUCCESS(tc, "Couldn't add the process source", rv);
+            rv = apr_pollset_poll(ps, apr_time_from_sec(5), &num, &descs);
+            APR_ASSERT_SUCCESS(tc, "Child exit wasn't polled", rv);
+            ABTS_INT_EQUAL(tc, APR_POLL_PROC, descs[0].desc_type);
+
+            rv = apr_proc_wait(&child, &code, &why, APR_NOWAIT);
+            ABTS_INT_EQUAL(tc, APR_CHILD_DONE, rv);
+            ABTS_INT_EQUAL(tc, 42, code);
+            apr_pollset_remove(ps, &proc);
+        }
+    }
+#endif
+
+    apr_pollset_destroy(ps);
+}
+
+static void use_io_uring(abts_case *tc, void *data)
+{
+    default_pollset_impl = APR_POLLSET_IO_URING;
+}
+
+static void use_default(abts_case *tc, void *data)
+{
+    default_pollset_impl = APR_POLLSET_DEFAULT;
+}
+
 abts_suite *testpoll(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -947,6 +1422,8 @@ abts_suite *testpoll(abts_suite *suite)
     abts_run_test(suite, send_last_pollset, NULL);
     abts_run_test(suite, clear_last_pollset, NULL);
     abts_run_test(suite, pollset_remove, NULL);
+    abts_run_test(suite, pollset_readd, NULL);
+    abts_run_test(suite, pollset_remove_close, NULL);
     abts_run_test(suite, close_all_sockets, NULL);
     abts_run_test(suite, create_all_sockets, NULL);
     abts_run_test(suite, setup_pollcb, NULL);
@@ -954,12 +1431,52 @@ abts_suite *testpoll(abts_suite *suite)
     abts_run_test(suite, timeout_pollcb, NULL);
     abts_run_test(suite, timeout_pollin_pollcb, NULL);
     abts_run_test(suite, pollset_wakeup, NULL);
+    abts_run_test(suite, pollset_wakeup_coalesced, NULL);
     abts_run_test(suite, pollcb_wakeup, NULL);
+    abts_run_test(suite, pollset_oneshot, NULL);
+    abts_run_test(suite, pollset_edge, NULL);
+    abts_run_test(suite, pollset_poll_ex, NULL);
+    abts_run_test(suite, pollcb_oneshot, NULL);
+    abts_run_test(suite, poll_sources, NULL);
     abts_run_test(suite, close_all_sockets, NULL);
     abts_run_test(suite, pollset_default, NULL);
     abts_run_test(suite, pollcb_default, NULL);
     abts_run_test(suite, justsleep, NULL);
 
+    /* Again with APR_POLLSET_IO_URING, which falls back to the default
+     * method where it is not supported.  The sockets are not re-created
+     * halfway since they stay open as long as they are polled by a ring.
+     */
+    abts_run_test(suite, use_io_uring, NULL);
+    abts_run_test(suite, create_all_sockets, NULL);
+    abts_run_test(suite, setup_pollset, NULL);
+    abts_run_test(suite, multi_event_pollset, NULL);
+    abts_run_test(suite, add_sockets_pollset, NULL);
+    abts_run_test(suite, nomessage_pollset, NULL);
+    abts_run_test(suite, send0_pollset, NULL);
+    abts_run_test(suite, recv0_pollset, NULL);
+    abts_run_test(suite, send_middle_pollset, NULL);
+    abts_run_test(suite, clear_middle_pollset, NULL);
+    abts_run_test(suite, send_last_pollset, NULL);
+    abts_run_test(suite, clear_last_pollset, NULL);
+    abts_run_test(suite, pollset_remove, NULL);
+    abts_run_test(suite, pollset_readd, NULL);
+    abts_run_test(suite, pollset_remove_close, NULL);
+    abts_run_test(suite, setup_pollcb, NULL);
+    abts_run_test(suite, trigger_pollcb, NULL);
+    abts_run_test(suite, timeout_pollcb, NULL);
+    abts_run_test(suite, timeout_pollin_pollcb, NULL);
+    abts_run_test(suite, pollset_wakeup, NULL);
+    abts_run_test(suite, pollset_wakeup_coalesced, NULL);
+    abts_run_test(suite, pollcb_wakeup, NULL);
+    abts_run_test(suite, pollset_oneshot, NULL);
+    abts_run_test(suite, pollset_edge, NULL);
+    abts_run_test(suite, pollset_poll_ex, NULL);
+    abts_run_test(suite, pollcb_oneshot, NULL);
+    abts_run_test(suite, poll_sources, NULL);
+    abts_run_test(suite, close_all_sockets, NULL);
+    abts_run_test(suite, use_default, NULL);
+
     return suite;
 }
 
@@ -0,0 +1,469 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Scaling benchmark of the pollset and pollcb methods.  For each method
+ * available here (select, poll, epoll, kqueue, port, io_uring...) a set
+ * of -n pipes is watched, and the following is timed:
+ *
+ *   - adding all of the descriptors,
+ *   - polling them while idle, and with one in -a of them readable,
+ *   - removing and adding back a tenth of them (churn),
+ *   - waking up a blocked poll from another thread.
+ *
+ * Each pipe takes two descriptors, so large counts need the limit of
+ * open files to be raised (ulimit -n) beforehand; the count is cut down
+ * to what could be opened otherwise.  Results are printed as text, or as
+ * JSON with -j.
+ */
+
+#include "apr.h"
+#include "apr_atomic.h"
+#include "apr_errno.h"
+#include "apr_file_io.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_poll.h"
+#include "apr_pools.h"
+#include "apr_strings.h"
+#include "apr_tables.h"
+#include "apr_thread_proc.h"
+#include "apr_time.h"
+#include "apr_version.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_NUM_PAIRS 10000
+#define DEFAULT_ROUNDS 1000
+#define DEFAULT_ACTIVE 100
+#define MAX_WAKEUPS 1000
+
+static int num_pairs = DEFAULT_NUM_PAIRS;
+static int rounds = DEFAULT_ROUNDS;
+static int active = DEFAULT_ACTIVE;
+static int json = 0;
+
+typedef struct bench_result_t {
+    const char *method;
+    const char *name;
+    long ops;
+    apr_interval_time_t usecs;
+} bench_result_t;
+
+static apr_array_header_t *results;
+
+static const struct {
+    apr_pollset_method_e method;
+    const char *name;
+} methods[] = {
+    { APR_POLLSET_SELECT, "select" },
+    { APR_POLLSET_POLL, "poll" },
+    { APR_POLLSET_EPOLL, "epoll" },
+    { APR_POLLSET_KQUEUE, "kqueue" },
+    { APR_POLLSET_PORT, "port" },
+    { APR_POLLSET_AIO_MSGQ, "asio" },
+    { APR_POLLSET_IO_URING, "io_uring" }
+};
+
+typedef struct pipe_pair_t {
+    apr_file_t *in;
+    apr_file_t *out;
+} pipe_pair_t;
+
+static void record(const char *method, const char *name, long ops,
+                   apr_interval_time_t usecs)
+{
+    bench_result_t *r = apr_array_push(results);
+
+    r->method = method;
+    r->name = name;
+    r->ops = ops;
+    r->usecs = usecs;
+
+    if (!json) {
+        printf("    %-24s %10ld ops %8" APR_TIME_T_FMT " usec"
+               " %10.2f ns/op\n", name, ops, usecs,
+               ops ? usecs * 1000.0 / ops : 0.0);
+        fflush(stdout);
+    }
+}
+
+static void print_json(void)
+{
+    int i;
+
+    printf("{\n  \"apr_version\": \"%s\",\n", apr_version_string());
+    printf("  \"pairs\": %d,\n  \"rounds\": %d,\n  \"active\": %d,\n",
+           num_pairs, rounds, active);
+    printf("  \"results\": [");
+    for (i = 0; i < results->nelts; i++) {
+        const bench_result_t *r = &APR_ARRAY_IDX(results, i, bench_result_t);
+
+        printf("%s\n    {\"method\": \"%s\", \"name\": \"%s\", "
+               "\"ops\": %ld, \"usec\": %" APR_TIME_T_FMT ", "
+               "\"ns_per_op\": %.3f}",
+               i ? "," : "", r->method, r->name, r->ops, r->usecs,
+               r->ops ? r->usecs * 1000.0 / r->ops : 0.0);
+    }
+    printf("\n  ]\n}\n");
+}
+
+static int make_pairs(pipe_pair_t **ppairs, apr_pollfd_t **ppfds,
+                      apr_pool_t *pool)
+{
+    pipe_pair_t *pairs = apr_pcalloc(pool, num_pairs * sizeof(*pairs));
+    apr_pollfd_t *pfds = apr_pcalloc(pool, num_pairs * sizeof(*pfds));
+    apr_status_t rv;
+    int i;
+
+    for (i = 0; i < num_pairs; i++) {
+        rv = apr_file_pipe_create_ex(&pairs[i].in, &pairs[i].out,
+                                     APR_FULL_NONBLOCK, pool);
+        if (rv != APR_SUCCESS) {
+            char errmsg[200];
+
+            fprintf(stderr, "Only %d pipes could be created: %s\n", i,
+                    apr_strerror(rv, errmsg, sizeof errmsg));
+            break;
+        }
+        pfds[i].p = pool;
+        pfds[i].desc_type = APR_POLL_FILE;
+        pfds[i].desc.f = pairs[i].in;
+        pfds[i].reqevents = APR_POLLIN;
+        pfds[i].client_data = &pairs[i];
+    }
+
+    *ppairs = pairs;
+    *ppfds = pfds;
+    return i;
+}
+
+/* Make one pipe in every "active" readable, returns how many were */
+static int activate(pipe_pair_t *pairs, int n)
+{
+    apr_size_t len;
+    int i, count = 0;
+
+    for (i = 0; i < n; i += active) {
+        len = 1;
+        apr_file_write(pairs[i].out, "x", &len);
+        count++;
+    }
+    return count;
+}
+
+static void deactivate(pipe_pair_t *pairs, int n)
+{
+    char c;
+    apr_size_t len;
+    int i;
+
+    for (i = 0; i < n; i += active) {
+        len = 1;
+        apr_file_read(pairs[i].in, &c, &len);
+    }
+}
+
+static void not_available(const char *kind, const char *name,
+                          apr_status_t rv)
+{
+    char errmsg[200];
+
+    if (!json && !APR_STATUS_IS_ENOTIMPL(rv)) {
+        printf("  %s, %s: not available, %s\n", kind, name,
+               apr_strerror(rv, errmsg, sizeof errmsg));
+    }
+}
+
+#if APR_HAS_THREADS
+
+typedef struct wakeup_ctx_t {
+    apr_pollset_t *pollset;
+    apr_uint32_t armed;
+    apr_uint64_t stamp;
+    int count;
+} wakeup_ctx_t;
+
+static void * APR_THREAD_FUNC wakeup_thread(apr_thread_t *thd, void *data)
+{
+    wakeup_ctx_t *ctx = data;
+    int i;
+
+    for (i = 0; i < ctx->count; i++) {
+        while (!apr_atomic_cas32(&ctx->armed, 0, 1)) {
+            apr_thread_yield();
+        }
+        /* Leave the poller enough time to block */
+        apr_sleep(50);
+        apr_atomic_set64(&ctx->stamp, apr_time_now());
+        apr_pollset_wakeup(ctx->pollset);
+    }
+    return NULL;
+}
+
+static void bench_wakeup(apr_pollset_t *pollset, const char *method,
+                         apr_pool_t *pool)
+{
+    wakeup_ctx_t ctx;
+    apr_thread_t *thd;
+    apr_status_t rv;
+    apr_interval_time_t total = 0;
+    const apr_pollfd_t *out;
+    apr_int32_t num;
+    int i;
+
+    ctx.pollset = pollset;
+    ctx.armed = 0;
+    ctx.stamp = 0;
+    ctx.count = rounds < MAX_WAKEUPS ? rounds : MAX_WAKEUPS;
+
+    if (apr_thread_create(&thd, NULL, wakeup_thread, &ctx, pool)
+            != APR_SUCCESS) {
+        return;
+    }
+    for (i = 0; i < ctx.count; i++) {
+        apr_atomic_set32(&ctx.armed, 1);
+        do {
+            rv = apr_pollset_poll(pollset, -1, &num, &out);
+        } while (rv == APR_SUCCESS);
+        total += apr_time_now() - (apr_time_t)apr_atomic_read64(&ctx.stamp);
+    }
+    apr_thread_join(&rv, thd);
+
+    record(method, "apr_pollset_wakeup", ctx.count, total);
+}
+
+#endif /* APR_HAS_THREADS */
+
+static void bench_pollset(apr_pollset_method_e method, const char *name,
+                          pipe_pair_t *pairs, apr_pollfd_t *pfds, int n,
+                          apr_pool_t *pool)
+{
+    apr_pollset_t *pollset;
+    const apr_pollfd_t *out;
+    apr_int32_t num;
+    apr_status_t rv;
+    apr_time_t start;
+    long events;
+    int i, nactive, nchurn;
+
+    /* One more for the wakeup pipe */
+    rv = apr_pollset_create_ex(&pollset, n + 1, pool,
+                               APR_POLLSET_NODEFAULT | APR_POLLSET_WAKEABLE,
+                               method);
+    if (rv != APR_SUCCESS) {
+        not_available("pollset", name, rv);
+        return;
+    }
+    if (!json) {
+        printf("  pollset, %s\n", name);
+    }
+
+    start = apr_time_now();
+    for (i = 0; i < n; i++) {
+        if ((rv = apr_pollset_add(pollset, &pfds[i])) != APR_SUCCESS) {
+            break;
+        }
+    }
+    if (i < n) {
+        if (!json) {
+            printf("    no more than %d descriptors, skipped\n", i);
+        }
+        apr_pollset_destroy(pollset);
+        return;
+    }
+    record(name, "apr_pollset_add", n, apr_time_now() - start);
+
+    start = apr_time_now();
+    for (i = 0; i < rounds; i++) {
+        apr_pollset_poll(pollset, 0, &num, &out);
+    }
+    record(name, "apr_pollset_poll(idle)", rounds, apr_time_now() - start);
+
+    nactive = activate(pairs, n);
+    events = 0;
+    start = apr_time_now();
+    for (i = 0; i < rounds; i++) {
+        if (apr_pollset_poll(pollset, 0, &num, &out) == APR_SUCCESS) {
+            events += num;
+        }
+    }
+    record(name, "apr_pollset_poll(active)", rounds, apr_time_now() - start);
+    if (events != (long)nactive * rounds) {
+        fprintf(stderr, "%s: %ld events polled, %ld expected\n", name,
+                events, (long)nactive * rounds);
+    }
+    deactivate(pairs, n);
+
+    /* Remove and add back a tenth of the set, scattered */
+    nchurn = n / 10 ? n / 10 : 1;
+    start = apr_time_now();
+    for (i = 0; i < nchurn; i++) {
+        int k = (int)(((apr_uint64_t)i * 7919) % n);
+
+        apr_pollset_remove(pollset, &pfds[k]);
+        apr_pollset_add(pollset, &pfds[k]);
+    }
+    record(name, "apr_pollset_remove+add", nchurn, apr_time_now() - start);
+
+#if APR_HAS_THREADS
+    bench_wakeup(pollset, name, pool);
+#endif
+
+    apr_pollset_destroy(pollset);
+}
+
+static apr_status_t count_cb(void *baton, apr_pollfd_t *descriptor)
+{
+    (*(long *)baton)++;
+    return APR_SUCCESS;
+}
+
+static void bench_pollcb(apr_pollset_method_e method, const char *name,
+                         pipe_pair_t *pairs, apr_pollfd_t *pfds, int n,
+                         apr_pool_t *pool)
+{
+    apr_pollcb_t *pollcb;
+    apr_status_t rv;
+    apr_time_t start;
+    long events;
+    int i, nactive;
+
+    rv = apr_pollcb_create_ex(&pollcb, n, pool, APR_POLLSET_NODEFAULT,
+                              method);
+    if (rv != APR_SUCCESS) {
+        not_available("pollcb", name, rv);
+        return;
+    }
+    if (!json) {
+        printf("  pollcb, %s\n", name);
+    }
+
+    start = apr_time_now();
+    for (i = 0; i < n; i++) {
+        if ((rv = apr_pollcb_add(pollcb, &pfds[i])) != APR_SUCCESS) {
+            break;
+        }
+    }
+    if (i < n) {
+        if (!json) {
+            printf("    no more than %d descriptors, skipped\n", i);
+        }
+        return;
+    }
+    record(name, "apr_pollcb_add", n, apr_time_now() - start);
+
+    nactive = activate(pairs, n);
+    events = 0;
+    start = apr_time_now();
+    for (i = 0; i < rounds; i++) {
+        apr_pollcb_poll(pollcb, 0, count_cb, &events);
+    }
+    record(name, "apr_pollcb_poll(active)", rounds, apr_time_now() - start);
+    if (events != (long)nactive * rounds) {
+        fprintf(stderr, "%s: %ld events polled, %ld expected\n", name,
+                events, (long)nactive * rounds);
+    }
+    deactivate(pairs, n);
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *pool, *subpool;
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    pipe_pair_t *pairs;
+    apr_pollfd_t *pfds;
+    int i, n;
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "n:c:a:j", &optchar, &optarg))
+           == APR_SUCCESS) {
+        if (optchar == 'n') {
+            num_pairs = atoi(optarg);
+        }
+        else if (optchar == 'c') {
+            rounds = atoi(optarg);
+        }
+        else if (optchar == 'a') {
+            active = atoi(optarg);
+        }
+        else if (optchar == 'j') {
+            json = 1;
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        fprintf(stderr, "Usage: %s [-n pairs] [-c rounds] "
+                "[-a one active in] [-j]\n", argv[0]);
+        exit(-1);
+    }
+    if (num_pairs < 1 || rounds < 1 || active < 1) {
+        fprintf(stderr, "The pairs, rounds and active ratio must be "
+                "1 at least\n");
+        exit(-1);
+    }
+
+#if !APR_FILES_AS_SOCKETS
+    fprintf(stderr, "Pipes can't be polled on this platform\n");
+    exit(0);
+#endif
+
+    results = apr_array_make(pool, 32, sizeof(bench_result_t));
+
+    n = make_pairs(&pairs, &pfds, pool);
+    if (n == 0) {
+        exit(-1);
+    }
+    num_pairs = n;
+
+    if (!json) {
+        printf("APR Pollset Benchmarks (%d pipes, one in %d active, "
+               "%d rounds)\n=======================\n\n", n, active, rounds);
+    }
+
+    apr_pool_create(&subpool, pool);
+    for (i = 0; i < (int)(sizeof(methods) / sizeof(methods[0])); i++) {
+        bench_pollset(methods[i].method, methods[i].name, pairs, pfds, n,
+                      subpool);
+        apr_pool_clear(subpool);
+        bench_pollcb(methods[i].method, methods[i].name, pairs, pfds, n,
+                     subpool);
+        apr_pool_clear(subpool);
+    }
+
+    if (json) {
+        print_json();
+    }
+
+    return 0;
+}
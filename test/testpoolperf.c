@@ -0,0 +1,144 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compares apr_palloc() with its inlined fast path apr_palloc_inline()
+ * for small allocations.
+ */
+
+#include "apr_pools.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_time.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_MAX_COUNTER 10000000
+/* Clear the pool every so many allocations, like a request pool would */
+#define ALLOCS_PER_CLEAR 1000
+
+static long max_counter = DEFAULT_MAX_COUNTER;
+static int verbose = 0;
+
+/* Keep the compiler from optimizing the allocations away */
+static volatile char *sink;
+
+static apr_interval_time_t bench_palloc(apr_pool_t *pool, apr_size_t max)
+{
+    apr_time_t start = apr_time_now();
+    long i;
+
+    for (i = 0; i < max_counter; i++) {
+        sink = apr_palloc(pool, 1 + (i & (max - 1)));
+        if (i % ALLOCS_PER_CLEAR == ALLOCS_PER_CLEAR - 1) {
+            apr_pool_clear(pool);
+        }
+    }
+
+    return apr_time_now() - start;
+}
+
+static apr_interval_time_t bench_palloc_inline(apr_pool_t *pool,
+                                               apr_size_t max)
+{
+    apr_time_t start = apr_time_now();
+    long i;
+
+    for (i = 0; i < max_counter; i++) {
+        sink = apr_palloc_inline(pool, 1 + (i & (max - 1)));
+        if (i % ALLOCS_PER_CLEAR == ALLOCS_PER_CLEAR - 1) {
+            apr_pool_clear(pool);
+        }
+    }
+
+    return apr_time_now() - start;
+}
+
+static void report(const char *name, apr_size_t max,
+                   apr_interval_time_t usecs)
+{
+    printf("    %-20s 1..%-4" APR_SIZE_T_FMT " bytes: %8" APR_TIME_T_FMT
+           " usec, %6.2f ns/alloc\n", name, max, usecs,
+           max_counter ? usecs * 1000.0 / max_counter : 0.0);
+}
+
+int main(int argc, const char * const *argv)
+{
+    /* Powers of two, see bench_palloc() */
+    static const apr_size_t sizes[] = { 16, 64, 256 };
+    apr_pool_t *pool, *bench;
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    int i;
+
+    printf("APR Pool Allocation Performance Test\n==============\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "c:v", &optchar, &optarg)) == APR_SUCCESS) {
+        if (optchar == 'c') {
+            max_counter = atol(optarg);
+        }
+        else if (optchar == 'v') {
+            verbose = 1;
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    if (apr_pool_create(&bench, pool) != APR_SUCCESS)
+        exit(-1);
+
+    if (verbose) {
+        printf("%ld allocations per run, pool cleared every %d\n\n",
+               max_counter, ALLOCS_PER_CLEAR);
+    }
+
+    for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        /* Warm the pool's nodes up first */
+        bench_palloc(bench, sizes[i]);
+        apr_pool_clear(bench);
+
+        report("apr_palloc", sizes[i], bench_palloc(bench, sizes[i]));
+        apr_pool_clear(bench);
+
+        report("apr_palloc_inline", sizes[i],
+               bench_palloc_inline(bench, sizes[i]));
+        apr_pool_clear(bench);
+    }
+
+    apr_pool_destroy(pool);
+
+    return 0;
+}
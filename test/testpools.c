@@ -17,8 +17,11 @@
 
 #include "apr_general.h"
 #include "apr_pools.h"
+#include "apr_strings.h"
+#include "apr_allocator.h"
 #include "apr_errno.h"
 #include "apr_file_io.h"
+#include "apr_thread_proc.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -64,6 +67,22 @@ static void calloc_bytes(abts_case *tc, void *data)
     }
 }
 
+static void alloc_inline(abts_case *tc, void *data)
+{
+    char *prev = NULL, *alloc;
+    int i;
+
+    for (i = 0; i < 1000; i++) {
+        /* Some of these don't fit in the active node */
+        alloc = apr_palloc_inline(pmain, i % 10 ? i % 64 + 1 : ALLOC_BYTES * 4);
+        ABTS_PTR_NOTNULL(tc, alloc);
+        ABTS_INT_EQUAL(tc, 0, (int)((apr_uintptr_t)alloc % 8));
+        ABTS_ASSERT(tc, "distinct allocations", alloc != prev);
+        memset(alloc, 0xa, i % 10 ? i % 64 + 1 : ALLOC_BYTES * 4);
+        prev = alloc;
+    }
+}
+
 static void parent_pool(abts_case *tc, void *data)
 {
     apr_status_t rv;
@@ -164,6 +183,189 @@ static void test_cleanups(abts_case *tc, void *data)
     }
 }
 
+static apr_status_t count_cleanup(void *data)
+{
+    (*(int *)data)++;
+    return APR_SUCCESS;
+}
+
+static void test_mark(abts_case *tc, void *data)
+{
+    apr_pool_mark_t outer, inner;
+    apr_pool_t *pool;
+    apr_size_t bytes;
+    char *before, *mem;
+    int before_run = 0, after_run = 0;
+    int i, n;
+
+    APR_ASSERT_SUCCESS(tc, "create pool", apr_pool_create(&pool, pmain));
+    before = apr_pstrdup(pool, "before the mark");
+    apr_pool_cleanup_register(pool, &before_run, count_cleanup,
+                              apr_pool_cleanup_null);
+    bytes = apr_pool_num_bytes(pool, 0);
+
+    for (n = 0; n < 3; n++) {
+        apr_pool_mark(pool, &outer);
+
+        /* Enough to take new nodes, and registered cleanups */
+        mem = apr_palloc(pool, 16);
+        for (i = 0; i < 64; i++) {
+            memset(apr_palloc(pool, 1000), 'x', 1000);
+            apr_psprintf(pool, "%0*d", 500, i);
+        }
+        apr_pool_cleanup_register(pool, &after_run, count_cleanup,
+                                  apr_pool_cleanup_null);
+        apr_pool_pre_cleanup_register(pool, &after_run, count_cleanup);
+
+        /* A cleanup of before the mark can be killed meanwhile */
+        if (n == 1) {
+            apr_pool_cleanup_kill(pool, &before_run, count_cleanup);
+        }
+
+        apr_pool_mark(pool, &inner);
+        apr_palloc(pool, 10000);
+        apr_pool_cleanup_register(pool, &after_run, count_cleanup,
+                                  apr_pool_cleanup_null);
+        if (n == 0) {
+            apr_pool_rewind(pool, &inner);
+            ABTS_INT_EQUAL(tc, 1, after_run);
+        }
+
+        apr_pool_rewind(pool, &outer);
+        ABTS_INT_EQUAL(tc, 3, after_run);
+        after_run = 0;
+        ABTS_INT_EQUAL(tc, 0, before_run);
+        ABTS_STR_EQUAL(tc, "before the mark", before);
+        ABTS_INT_EQUAL(tc, (int)bytes, (int)apr_pool_num_bytes(pool, 0));
+#if !APR_POOL_DEBUG
+        /* The memory after the mark is reused */
+        ABTS_PTR_EQUAL(tc, mem, apr_palloc(pool, 16));
+#endif
+    }
+
+    /* The cleanups of before the mark run as usual */
+    apr_pool_cleanup_register(pool, &before_run, count_cleanup,
+                              apr_pool_cleanup_null);
+    apr_pool_destroy(pool);
+    ABTS_INT_EQUAL(tc, 1, before_run);
+    ABTS_INT_EQUAL(tc, 0, after_run);
+}
+
+static void test_recycle(abts_case *tc, void *data)
+{
+    apr_pool_t *parent, *child, *first, *children[3], *destroyed[3];
+    int run = 0;
+    int i;
+
+    APR_ASSERT_SUCCESS(tc, "create pool", apr_pool_create(&parent, pmain));
+    apr_pool_recycle_max_set(parent, 2);
+
+    APR_ASSERT_SUCCESS(tc, "create child", apr_pool_create(&first, parent));
+    apr_pool_tag(first, "first");
+    memset(apr_palloc(first, 100000), 'x', 100000);
+    apr_pool_cleanup_register(first, &run, count_cleanup,
+                              apr_pool_cleanup_null);
+    apr_pool_destroy(first);
+    ABTS_INT_EQUAL(tc, 1, run);
+
+    /* A fresh pool, in the memory of the first one */
+    APR_ASSERT_SUCCESS(tc, "create child", apr_pool_create(&child, parent));
+#if !APR_POOL_DEBUG
+    ABTS_PTR_EQUAL(tc, first, child);
+    ABTS_PTR_EQUAL(tc, NULL, apr_pool_get_tag(child));
+#endif
+    ABTS_PTR_EQUAL(tc, parent, apr_pool_parent_get(child));
+    ABTS_STR_EQUAL(tc, "fresh", apr_pstrdup(child, "fresh"));
+    apr_pool_destroy(child);
+    ABTS_INT_EQUAL(tc, 1, run);
+
+    /* Up to two are kept, the subpools inheriting the limit */
+    for (i = 0; i < 3; i++) {
+        APR_ASSERT_SUCCESS(tc, "create child",
+                           apr_pool_create(&children[i], parent));
+        APR_ASSERT_SUCCESS(tc, "create grandchild",
+                           apr_pool_create(&child, children[i]));
+        apr_pool_destroy(child);
+    }
+    for (i = 0; i < 3; i++) {
+        destroyed[i] = children[i];
+        apr_pool_destroy(children[i]);
+    }
+    for (i = 0; i < 3; i++) {
+        APR_ASSERT_SUCCESS(tc, "create child",
+                           apr_pool_create(&children[i], parent));
+    }
+#if !APR_POOL_DEBUG
+    /* The last destroyed first */
+    ABTS_PTR_EQUAL(tc, destroyed[1], children[0]);
+    ABTS_PTR_EQUAL(tc, destroyed[0], children[1]);
+#endif
+    for (i = 0; i < 3; i++) {
+        apr_pool_destroy(children[i]);
+    }
+
+    apr_pool_recycle_max_set(parent, 0);
+    apr_pool_destroy(parent);
+}
+
+#define NUM_HANDLES 1000
+
+static int handles_order[NUM_HANDLES];
+static int handles_run;
+
+static apr_status_t order_cleanup(void *data)
+{
+    handles_order[handles_run++] = *(int *)data;
+    return APR_SUCCESS;
+}
+
+static void test_cleanup_handles(abts_case *tc, void *data)
+{
+    apr_pool_cleanup_t *handles[NUM_HANDLES];
+    static int values[NUM_HANDLES];
+    apr_pool_t *pool;
+    apr_status_t rv;
+    int i, expected;
+
+    APR_ASSERT_SUCCESS(tc, "create pool", apr_pool_create(&pool, pmain));
+
+    handles_run = 0;
+    for (i = 0; i < NUM_HANDLES; i++) {
+        values[i] = i;
+        handles[i] = apr_pool_cleanup_register_ex(pool, &values[i],
+                                                  order_cleanup,
+                                                  apr_pool_cleanup_null);
+        ABTS_PTR_NOTNULL(tc, handles[i]);
+    }
+
+    /* Kill the odd ones, the first and last ones, by handle or not */
+    for (i = 1; i < NUM_HANDLES; i += 2) {
+        if (i % 3) {
+            apr_pool_cleanup_kill_ex(pool, handles[i]);
+        }
+        else {
+            apr_pool_cleanup_kill(pool, &values[i], order_cleanup);
+        }
+    }
+    apr_pool_cleanup_kill_ex(pool, handles[0]);
+    rv = apr_pool_cleanup_run_ex(pool, handles[NUM_HANDLES - 2]);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, handles_run);
+    ABTS_INT_EQUAL(tc, NUM_HANDLES - 2, handles_order[0]);
+
+    /* The others run in the reverse order of their registration */
+    handles_run = 0;
+    apr_pool_clear(pool);
+    ABTS_INT_EQUAL(tc, NUM_HANDLES / 2 - 2, handles_run);
+    expected = NUM_HANDLES - 4;
+    for (i = 0; i < handles_run; i++) {
+        ABTS_INT_EQUAL(tc, expected, handles_order[i]);
+        expected -= 2;
+    }
+
+    apr_pool_destroy(pool);
+}
+
 static void test_tags(abts_case *tc, void *data)
 {
     /* if APR_POOL_DEBUG is set, all pools are tagged by default */
@@ -176,6 +378,193 @@ static void test_tags(abts_case *tc, void *data)
     ABTS_STR_EQUAL(tc, "main pool", apr_pool_get_tag(pmain));
 }
 
+static void test_allocator_attrs(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_pool_t *pool, *subpool;
+    apr_status_t rv;
+    char *mem;
+    int i;
+
+    rv = apr_allocator_create_ex(&allocator, 0x80000000, 0);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    rv = apr_allocator_create_ex(&allocator, APR_ALLOCATOR_HUGE_PAGES |
+                                             APR_ALLOCATOR_NUMA_BIND,
+                                 APR_ALLOCATOR_NUMA_CURRENT);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "allocator memory attributes");
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "create allocator with attributes", rv);
+
+    rv = apr_pool_create_ex(&pool, NULL, NULL, allocator);
+    APR_ASSERT_SUCCESS(tc, "create pool", rv);
+    apr_allocator_owner_set(allocator, pool);
+    apr_allocator_max_free_set(allocator, 1);
+
+    /* Enough nodes of various sizes to span several slabs, plus some
+     * too big for a slab.
+     */
+    for (i = 0; i < 64; i++) {
+        rv = apr_pool_create(&subpool, pool);
+        APR_ASSERT_SUCCESS(tc, "create subpool", rv);
+        mem = apr_palloc(subpool, (i % 16) * 16384 + (i % 8 == 0) * 1048576);
+        ABTS_PTR_NOTNULL(tc, mem);
+        memset(mem, i, (i % 16) * 16384);
+        if (i % 3) {
+            apr_pool_destroy(subpool);
+        }
+    }
+
+    apr_pool_destroy(pool);
+}
+
+static int profile_find(void *baton, const apr_pool_profile_t *profile)
+{
+    const apr_pool_profile_t **found = baton;
+
+    if (profile->tag && strcmp(profile->tag, "profiled pool") == 0) {
+        *found = profile;
+    }
+    return 1;
+}
+
+static int profile_check(void *baton, const apr_pool_profile_t *profile)
+{
+    abts_case *tc = baton;
+    apr_uint64_t sum = 0;
+    int i;
+
+    if (!profile->tag || strcmp(profile->tag, "profiled pool") != 0) {
+        return 1;
+    }
+
+    ABTS_INT_EQUAL(tc, 100, (int)profile->allocs);
+    ABTS_INT_EQUAL(tc, 50 * 8 + 50 * 1000, (int)profile->alloc_bytes);
+    for (i = 0; i < APR_POOL_PROFILE_BUCKETS; i++) {
+        sum += profile->sizes[i];
+    }
+    ABTS_INT_EQUAL(tc, 100, (int)sum);
+    ABTS_INT_EQUAL(tc, 50, (int)profile->sizes[3]);
+    ABTS_INT_EQUAL(tc, 50, (int)profile->sizes[9]);
+    ABTS_INT_EQUAL(tc, 2, (int)profile->lifetimes);
+    ABTS_ASSERT(tc, "pool grew", profile->max_nodes > 1);
+    ABTS_ASSERT(tc, "peak bytes", profile->peak_bytes >= 50 * 8 + 50 * 1000);
+
+    return 0;
+}
+
+static void test_profile(abts_case *tc, void *data)
+{
+    const apr_pool_profile_t *found = NULL;
+    apr_pool_t *pool;
+    apr_status_t rv;
+    int i;
+
+    rv = apr_pool_profile_set(1);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "pool profiling");
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "start profiling", rv);
+
+    rv = apr_pool_create(&pool, pmain);
+    APR_ASSERT_SUCCESS(tc, "create pool", rv);
+    apr_pool_tag(pool, "profiled pool");
+
+    for (i = 0; i < 100; i++) {
+        ABTS_PTR_NOTNULL(tc, apr_palloc(pool, i % 2 ? 1000 : 8));
+    }
+    apr_pool_clear(pool);
+    apr_pool_destroy(pool);
+
+    rv = apr_pool_profile_set(0);
+    APR_ASSERT_SUCCESS(tc, "stop profiling", rv);
+
+    ABTS_INT_EQUAL(tc, 0, apr_pool_profile_do(profile_check, tc));
+
+    apr_pool_profile_reset();
+    apr_pool_profile_do(profile_find, &found);
+    ABTS_PTR_EQUAL(tc, NULL, found);
+}
+
+#if APR_HAS_THREADS
+#define TCACHE_THREADS 4
+#define TCACHE_LOOPS 1000
+
+static void tcache_loop(apr_allocator_t *allocator)
+{
+    apr_pool_t *pool;
+    int i;
+
+    for (i = 0; i < TCACHE_LOOPS; i++) {
+        if (apr_pool_create_ex(&pool, NULL, NULL, allocator)) {
+            break;
+        }
+        apr_palloc(pool, i * 64);
+        apr_pool_destroy(pool);
+    }
+}
+
+static void *APR_THREAD_FUNC tcache_thread(apr_thread_t *thd, void *data)
+{
+    tcache_loop(data);
+
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static void test_thread_cache(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_thread_mutex_t *mutex;
+    apr_thread_t *threads[TCACHE_THREADS];
+    apr_pool_t *owner;
+    apr_uint64_t hits, misses;
+    apr_status_t rv;
+    int i;
+
+    rv = apr_allocator_create(&allocator);
+    APR_ASSERT_SUCCESS(tc, "create allocator", rv);
+    rv = apr_pool_create_ex(&owner, NULL, NULL, allocator);
+    APR_ASSERT_SUCCESS(tc, "create owner pool", rv);
+    apr_allocator_owner_set(allocator, owner);
+    rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT, owner);
+    APR_ASSERT_SUCCESS(tc, "create allocator mutex", rv);
+    apr_allocator_mutex_set(allocator, mutex);
+
+    rv = apr_allocator_thread_cache_set(allocator, 16);
+    if (rv == APR_ENOTIMPL) {
+        apr_pool_destroy(owner);
+        ABTS_NOT_IMPL(tc, "per-thread allocator caches");
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "enable thread cache", rv);
+
+    for (i = 0; i < TCACHE_THREADS; i++) {
+        rv = apr_thread_create(&threads[i], NULL, tcache_thread, allocator, p);
+        APR_ASSERT_SUCCESS(tc, "create thread", rv);
+    }
+    for (i = 0; i < TCACHE_THREADS; i++) {
+        apr_status_t retval;
+        rv = apr_thread_join(&retval, threads[i]);
+        APR_ASSERT_SUCCESS(tc, "join thread", rv);
+    }
+
+    /* This thread's cache is taken back when the allocator is destroyed */
+    tcache_loop(allocator);
+
+    rv = apr_allocator_thread_cache_stats(allocator, &hits, &misses);
+    APR_ASSERT_SUCCESS(tc, "get thread cache stats", rv);
+    ABTS_ASSERT(tc, "thread caches were hit", hits > 0);
+    ABTS_ASSERT(tc, "every pool creation was counted",
+                hits + misses >= (TCACHE_THREADS + 1) * TCACHE_LOOPS);
+
+    apr_pool_destroy(owner);
+}
+#endif /* APR_HAS_THREADS */
+
 abts_suite *testpool(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -186,8 +575,17 @@ abts_suite *testpool(abts_suite *suite)
     abts_run_test(suite, test_notancestor, NULL);
     abts_run_test(suite, alloc_bytes, NULL);
     abts_run_test(suite, calloc_bytes, NULL);
+    abts_run_test(suite, alloc_inline, NULL);
     abts_run_test(suite, test_cleanups, NULL);
+    abts_run_test(suite, test_cleanup_handles, NULL);
+    abts_run_test(suite, test_mark, NULL);
+    abts_run_test(suite, test_recycle, NULL);
     abts_run_test(suite, test_tags, NULL);
+    abts_run_test(suite, test_allocator_attrs, NULL);
+    abts_run_test(suite, test_profile, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_thread_cache, NULL);
+#endif
 
     return suite;
 }
@@ -19,6 +19,7 @@
 #include "apr_general.h"
 #include "apr_lib.h"
 #include "apr_strings.h"
+#include "apr_portable.h"
 #include "testutil.h"
 
 #define TESTSTR "This is a test"
@@ -225,6 +226,213 @@ static void test_proc_args(abts_case* tc, void* data)
     ABTS_STR_EQUAL(tc, expected, actual);
 }
 
+static void test_proc_shellcmd(abts_case *tc, void *data)
+{
+    const char *args[3];
+    apr_procattr_t *attr;
+    apr_status_t rv;
+    apr_size_t length;
+    int exitcode;
+    apr_exit_why_e why;
+    char buf[256];
+
+    rv = apr_procattr_create(&attr, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_procattr_io_set(attr, APR_NO_PIPE, APR_FULL_BLOCK, APR_NO_PIPE);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_procattr_cmdtype_set(attr, APR_SHELLCMD_ENV);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_procattr_spawn_set(attr, 1);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    args[0] = "echo";
+    args[1] = TESTSTR;
+    args[2] = NULL;
+
+    rv = apr_proc_create(&newproc, "echo", args, NULL, attr, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    if (rv != APR_SUCCESS)
+        return;
+
+    rv = apr_file_read_full(newproc.out, buf, strlen(TESTSTR), &length);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 0, memcmp(buf, TESTSTR, length));
+
+    rv = apr_proc_wait(&newproc, &exitcode, &why, APR_WAIT);
+    ABTS_INT_EQUAL(tc, APR_CHILD_DONE, rv);
+    ABTS_INT_EQUAL(tc, APR_PROC_EXIT, why);
+    ABTS_INT_EQUAL(tc, 0, exitcode);
+}
+
+static void test_proc_missing(abts_case *tc, void *data)
+{
+    const char *args[2];
+    apr_procattr_t *attr;
+    apr_status_t rv;
+    int exitcode;
+    apr_exit_why_e why;
+
+    rv = apr_procattr_create(&attr, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_procattr_cmdtype_set(attr, APR_PROGRAM_PATH);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_procattr_spawn_set(attr, 1);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    args[0] = "apr-no-such-program";
+    args[1] = NULL;
+
+    /* spawned, the failure is returned; forked, the child says so */
+    rv = apr_proc_create(&newproc, args[0], args, NULL, attr, p);
+    if (rv == APR_SUCCESS) {
+        rv = apr_proc_wait(&newproc, &exitcode, &why, APR_WAIT);
+        ABTS_INT_EQUAL(tc, APR_CHILD_DONE, rv);
+        ABTS_ASSERT(tc, "missing program exited with 0",
+                    why != APR_PROC_EXIT || exitcode != 0);
+    }
+}
+
+static void test_proc_spawn_dup(abts_case *tc, void *data)
+{
+    const char *args[2];
+    apr_procattr_t *attr;
+    apr_file_t *file, *dup = NULL;
+    apr_os_file_t fd;
+    apr_status_t rv;
+    int exitcode;
+    apr_exit_why_e why;
+
+    rv = apr_file_open(&file, "data/file_datafile.txt", APR_FOPEN_READ,
+                       APR_OS_DEFAULT, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    if (rv != APR_SUCCESS)
+        return;
+    rv = apr_file_dup(&dup, file, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_os_file_get(&fd, dup);
+    if (fd > 9) {
+        ABTS_NOT_IMPL(tc, "descriptor not redirectable by the shell");
+        return;
+    }
+
+    rv = apr_procattr_create(&attr, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_procattr_cmdtype_set(attr, APR_SHELLCMD_ENV);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_procattr_spawn_set(attr, 1);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* The duplicate is not inherited, even without the child cleanups */
+    args[0] = apr_psprintf(p, ": 2>/dev/null <&%d", (int)fd);
+    args[1] = NULL;
+    rv = apr_proc_create(&newproc, args[0], args, NULL, attr, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    if (rv == APR_SUCCESS) {
+        rv = apr_proc_wait(&newproc, &exitcode, &why, APR_WAIT);
+        ABTS_INT_EQUAL(tc, APR_CHILD_DONE, rv);
+        ABTS_INT_EQUAL(tc, APR_PROC_EXIT, why);
+        ABTS_ASSERT(tc, "duplicate inherited by the child", exitcode != 0);
+    }
+
+    apr_file_close(dup);
+    apr_file_close(file);
+}
+
+#if APR_HAS_FORK
+static void test_proc_spawner(abts_case *tc, void *data)
+{
+    apr_proc_spawner_t *spawner;
+    const char *args[3];
+    apr_procattr_t *attr;
+    apr_proc_t proc;
+    apr_status_t rv;
+    apr_size_t length;
+    int exitcode;
+    apr_exit_why_e why;
+    char buf[256];
+
+    rv = apr_proc_spawner_create(&spawner, p);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "apr_proc_spawner_create");
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    if (rv != APR_SUCCESS)
+        return;
+
+    rv = apr_procattr_create(&attr, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_procattr_io_set(attr, APR_FULL_BLOCK, APR_FULL_BLOCK,
+                             APR_NO_PIPE);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_procattr_dir_set(attr, "data");
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_procattr_cmdtype_set(attr, APR_PROGRAM_ENV);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    args[0] = "proc_child" EXTENSION;
+    args[1] = NULL;
+
+    rv = apr_proc_spawner_proc_create(spawner, &proc, proc_child, args, NULL,
+                                      attr, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    if (rv != APR_SUCCESS)
+        return;
+
+    /* not ours to wait for */
+    rv = apr_proc_wait(&proc, NULL, NULL, APR_NOWAIT);
+    ABTS_ASSERT(tc, "spawned process is a child", !APR_STATUS_IS_CHILD_DONE(rv)
+                                                  && rv != APR_CHILD_NOTDONE);
+
+    length = strlen(TESTSTR);
+    rv = apr_file_write_full(proc.in, TESTSTR, length, NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_file_close(proc.in);
+
+    rv = apr_file_read_full(proc.out, buf, length, &length);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 0, memcmp(buf, TESTSTR, length));
+
+    rv = apr_proc_spawner_wait(spawner, &proc, &exitcode, &why, APR_WAIT);
+    ABTS_INT_EQUAL(tc, APR_CHILD_DONE, rv);
+    ABTS_INT_EQUAL(tc, APR_PROC_EXIT, why);
+    ABTS_INT_EQUAL(tc, 0, exitcode);
+
+    /* the exit code comes back */
+    rv = apr_procattr_create(&attr, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_procattr_cmdtype_set(attr, APR_SHELLCMD_ENV);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    args[0] = "exit 3";
+    args[1] = NULL;
+
+    rv = apr_proc_spawner_proc_create(spawner, &proc, args[0], args, NULL,
+                                      attr, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    if (rv != APR_SUCCESS)
+        return;
+
+    do {
+        rv = apr_proc_spawner_wait(spawner, &proc, &exitcode, &why,
+                                   APR_NOWAIT);
+        if (rv == APR_CHILD_NOTDONE)
+            apr_sleep(apr_time_from_msec(10));
+    } while (rv == APR_CHILD_NOTDONE);
+    ABTS_INT_EQUAL(tc, APR_CHILD_DONE, rv);
+    ABTS_INT_EQUAL(tc, APR_PROC_EXIT, why);
+    ABTS_INT_EQUAL(tc, 3, exitcode);
+
+    rv = apr_proc_spawner_wait(spawner, &proc, &exitcode, &why, APR_WAIT);
+    ABTS_ASSERT(tc, "waited twice", rv != APR_CHILD_DONE);
+}
+#endif
+
 abts_suite *testproc(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -234,6 +442,12 @@ abts_suite *testproc(abts_suite *suite)
     abts_run_test(suite, test_proc_wait, NULL);
     abts_run_test(suite, test_file_redir, NULL);
     abts_run_test(suite, test_proc_args, NULL);
+    abts_run_test(suite, test_proc_shellcmd, NULL);
+    abts_run_test(suite, test_proc_missing, NULL);
+    abts_run_test(suite, test_proc_spawn_dup, NULL);
+#if APR_HAS_FORK
+    abts_run_test(suite, test_proc_spawner, NULL);
+#endif
 
     return suite;
 }
@@ -18,12 +18,16 @@
 #include "apr_thread_proc.h"
 #include "apr_file_io.h"
 #include "apr_proc_mutex.h"
+#include "apr_global_mutex.h"
 #include "apr_errno.h"
 #include "apr_general.h"
 #include "apr_strings.h"
 #include "apr_getopt.h"
 #include <stdio.h>
 #include <stdlib.h>
+#if APR_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 #include "testutil.h"
 
 #if APR_HAS_FORK
@@ -240,6 +244,110 @@ static void proc_mutex(abts_case *tc, void *data)
     APR_ASSERT_SUCCESS(tc, "Error destroying shared memory block", rv);
 }
 
+#if APR_HAS_THREADS
+
+#define NUM_THREADS 4
+#define NUM_LOCKS 20000
+
+static apr_global_mutex_t *global_lock;
+static volatile int global_counter;
+
+static void * APR_THREAD_FUNC global_mutex_thread(apr_thread_t *thd,
+                                                  void *data)
+{
+    int i;
+
+    for (i = 0; i < NUM_LOCKS; i++) {
+        if (apr_global_mutex_lock(global_lock) != APR_SUCCESS) {
+            break;
+        }
+        global_counter++;
+        apr_global_mutex_unlock(global_lock);
+    }
+    return NULL;
+}
+
+/* The threads are excluded by the global mutex, whether the mechanism
+ * needs a thread mutex or not (spinning on the proc mutex then) */
+static void global_mutex_threads(abts_case *tc, void *data)
+{
+    lockmech_t *mech = data;
+    apr_thread_t *threads[NUM_THREADS];
+    apr_status_t rv, retval;
+    int i;
+
+    rv = apr_global_mutex_create(&global_lock, NULL, mech->num, p);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, mech->name);
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "create the global mutex", rv);
+
+    global_counter = 0;
+    for (i = 0; i < NUM_THREADS; i++) {
+        rv = apr_thread_create(&threads[i], NULL, global_mutex_thread, NULL,
+                               p);
+        APR_ASSERT_SUCCESS(tc, "create a thread", rv);
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        apr_thread_join(&retval, threads[i]);
+    }
+    ABTS_INT_EQUAL(tc, NUM_THREADS * NUM_LOCKS, global_counter);
+
+    rv = apr_global_mutex_destroy(global_lock);
+    APR_ASSERT_SUCCESS(tc, "destroy the global mutex", rv);
+}
+
+#endif /* APR_HAS_THREADS */
+
+#if APR_HAS_FUTEX_SERIALIZE
+/* A child dies holding the mutex, which the parent should take over */
+static void die_locked(abts_case *tc)
+{
+    apr_proc_t proc;
+    apr_status_t rv;
+
+    rv = apr_proc_fork(&proc, p);
+    if (rv == APR_INCHILD) {
+        if (apr_proc_mutex_child_init(&proc_lock, NULL, p)
+                || apr_proc_mutex_lock(proc_lock)) {
+            _exit(1);
+        }
+        _exit(0); /* without unlocking nor running the cleanups */
+    }
+    ABTS_ASSERT(tc, "fork failed", rv == APR_INPARENT);
+    await_child(tc, &proc);
+}
+
+static void test_futex_owner_dead(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+
+    rv = apr_proc_mutex_create(&proc_lock, NULL, APR_LOCK_FUTEX, p);
+    APR_ASSERT_SUCCESS(tc, "create the mutex", rv);
+
+    die_locked(tc);
+    rv = apr_proc_mutex_trylock(proc_lock);
+    APR_ASSERT_SUCCESS(tc, "trylock a mutex of a dead owner", rv);
+    rv = apr_proc_mutex_unlock(proc_lock);
+    APR_ASSERT_SUCCESS(tc, "unlock", rv);
+
+    die_locked(tc);
+    rv = apr_proc_mutex_timedlock(proc_lock, apr_time_from_sec(5));
+    APR_ASSERT_SUCCESS(tc, "timedlock a mutex of a dead owner", rv);
+    rv = apr_proc_mutex_unlock(proc_lock);
+    APR_ASSERT_SUCCESS(tc, "unlock", rv);
+
+    die_locked(tc);
+    rv = apr_proc_mutex_lock(proc_lock);
+    APR_ASSERT_SUCCESS(tc, "lock a mutex of a dead owner", rv);
+    rv = apr_proc_mutex_unlock(proc_lock);
+    APR_ASSERT_SUCCESS(tc, "unlock", rv);
+
+    rv = apr_proc_mutex_destroy(proc_lock);
+    APR_ASSERT_SUCCESS(tc, "destroy the mutex", rv);
+}
+#endif
 
 abts_suite *testprocmutex(abts_suite *suite)
 {
@@ -259,6 +367,9 @@ abts_suite *testprocmutex(abts_suite *suite)
 #endif
 #if APR_HAS_PROC_PTHREAD_SERIALIZE
         ,{APR_LOCK_PROC_PTHREAD, "proc_pthread"}
+#endif
+#if APR_HAS_FUTEX_SERIALIZE
+        ,{APR_LOCK_FUTEX, "futex"}
 #endif
         ,{APR_LOCK_DEFAULT_TIMED, "default_timed"}
     };
@@ -268,6 +379,14 @@ abts_suite *testprocmutex(abts_suite *suite)
     for (i = 0; i < sizeof(lockmechs) / sizeof(lockmechs[0]); i++) {
         abts_run_test(suite, proc_mutex, &lockmechs[i]);
     }
+#if APR_HAS_THREADS
+    for (i = 0; i < sizeof(lockmechs) / sizeof(lockmechs[0]); i++) {
+        abts_run_test(suite, global_mutex_threads, &lockmechs[i]);
+    }
+#endif
+#if APR_HAS_FUTEX_SERIALIZE
+    abts_run_test(suite, test_futex_owner_dead, NULL);
+#endif
     return suite;
 }
 
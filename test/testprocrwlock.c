@@ -0,0 +1,185 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_shm.h"
+#include "apr_thread_proc.h"
+#include "apr_proc_rwlock.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include <stdlib.h>
+#include "testutil.h"
+
+#if APR_HAS_FORK && APR_HAS_SHARED_MEMORY
+
+#define MAX_ITER 200
+#define CHILDREN 4
+
+static apr_proc_rwlock_t *rwlock;
+
+typedef struct {
+    volatile int a, b;
+} counters_t;
+
+static counters_t *counters;
+
+static int create_rwlock(abts_case *tc)
+{
+    apr_status_t rv;
+
+    rv = apr_proc_rwlock_create(&rwlock, NULL, p);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "process read-write locks");
+        return 0;
+    }
+    APR_ASSERT_SUCCESS(tc, "create the rwlock", rv);
+    return rv == APR_SUCCESS;
+}
+
+static void await_child(abts_case *tc, apr_proc_t *proc)
+{
+    int code;
+    apr_exit_why_e why;
+    apr_status_t rv;
+
+    rv = apr_proc_wait(proc, &code, &why, APR_WAIT);
+    ABTS_ASSERT(tc, "child did not terminate with success",
+                rv == APR_CHILD_DONE && why == APR_PROC_EXIT && code == 0);
+}
+
+static void test_shared_readers(abts_case *tc, void *data)
+{
+    apr_proc_t proc;
+    apr_status_t rv;
+
+    if (!create_rwlock(tc)) {
+        return;
+    }
+
+    APR_ASSERT_SUCCESS(tc, "rdlock", apr_proc_rwlock_rdlock(rwlock));
+
+    rv = apr_proc_fork(&proc, p);
+    if (rv == APR_INCHILD) {
+        apr_initialize();
+        if (apr_proc_rwlock_child_init(&rwlock, NULL, p))
+            exit(1);
+        /* Readers share with the parent, writers don't */
+        if (apr_proc_rwlock_tryrdlock(rwlock))
+            exit(2);
+        if (apr_proc_rwlock_unlock(rwlock))
+            exit(3);
+        if (!APR_STATUS_IS_EBUSY(apr_proc_rwlock_trywrlock(rwlock)))
+            exit(4);
+        exit(0);
+    }
+    ABTS_ASSERT(tc, "fork failed", rv == APR_INPARENT);
+    await_child(tc, &proc);
+
+    APR_ASSERT_SUCCESS(tc, "unlock", apr_proc_rwlock_unlock(rwlock));
+
+    APR_ASSERT_SUCCESS(tc, "trywrlock", apr_proc_rwlock_trywrlock(rwlock));
+    ABTS_INT_EQUAL(tc, APR_EBUSY, apr_proc_rwlock_tryrdlock(rwlock));
+    APR_ASSERT_SUCCESS(tc, "unlock", apr_proc_rwlock_unlock(rwlock));
+
+    APR_ASSERT_SUCCESS(tc, "destroy", apr_proc_rwlock_destroy(rwlock));
+}
+
+static void make_child(abts_case *tc, apr_proc_t *proc)
+{
+    apr_status_t rv;
+
+    rv = apr_proc_fork(proc, p);
+    if (rv == APR_INCHILD) {
+        int i;
+
+        apr_initialize();
+        if (apr_proc_rwlock_child_init(&rwlock, NULL, p))
+            exit(1);
+
+        for (i = 0; i < MAX_ITER; i++) {
+            if (apr_proc_rwlock_rdlock(rwlock))
+                exit(1);
+            /* A writer is never seen halfway */
+            if (counters->a != counters->b)
+                exit(2);
+            if (apr_proc_rwlock_unlock(rwlock))
+                exit(1);
+
+            if (apr_proc_rwlock_wrlock(rwlock))
+                exit(1);
+            counters->a++;
+            apr_sleep(1);
+            counters->b++;
+            if (apr_proc_rwlock_unlock(rwlock))
+                exit(1);
+        }
+        exit(0);
+    }
+    ABTS_ASSERT(tc, "fork failed", rv == APR_INPARENT);
+}
+
+static void test_exclusive_writers(abts_case *tc, void *data)
+{
+    apr_proc_t child[CHILDREN];
+    apr_shm_t *shm;
+    apr_status_t rv;
+    int n;
+
+    rv = apr_shm_create(&shm, sizeof(counters_t), NULL, p);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "anonymous shared memory");
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "create shm segment", rv);
+    if (rv != APR_SUCCESS || !create_rwlock(tc)) {
+        return;
+    }
+    counters = apr_shm_baseaddr_get(shm);
+    counters->a = counters->b = 0;
+
+    for (n = 0; n < CHILDREN; n++)
+        make_child(tc, &child[n]);
+    for (n = 0; n < CHILDREN; n++)
+        await_child(tc, &child[n]);
+
+    ABTS_INT_EQUAL(tc, CHILDREN * MAX_ITER, counters->a);
+    ABTS_INT_EQUAL(tc, CHILDREN * MAX_ITER, counters->b);
+
+    APR_ASSERT_SUCCESS(tc, "destroy", apr_proc_rwlock_destroy(rwlock));
+    APR_ASSERT_SUCCESS(tc, "destroy shm", apr_shm_destroy(shm));
+}
+
+#else /* APR_HAS_FORK && APR_HAS_SHARED_MEMORY */
+
+static void proc_rwlock_not_impl(abts_case *tc, void *data)
+{
+    ABTS_NOT_IMPL(tc, "APR lacks fork() or shared memory support");
+}
+
+#endif /* APR_HAS_FORK && APR_HAS_SHARED_MEMORY */
+
+abts_suite *testprocrwlock(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+#if APR_HAS_FORK && APR_HAS_SHARED_MEMORY
+    abts_run_test(suite, test_shared_readers, NULL);
+    abts_run_test(suite, test_exclusive_writers, NULL);
+#else
+    abts_run_test(suite, proc_rwlock_not_impl, NULL);
+#endif
+
+    return suite;
+}
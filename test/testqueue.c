@@ -16,6 +16,8 @@
 
 #include "apu.h"
 #include "apr_queue.h"
+#include "apr_atomic.h"
+#include "apr_thread_proc.h"
 #include "apr_thread_pool.h"
 #include "apr_time.h"
 #include "abts.h"
@@ -123,13 +125,14 @@ static void test_queue_producer_consumer(abts_case *tc, void *data)
 
 static void test_queue_timeout(abts_case *tc, void *data)
 {
+    apr_uint32_t flags = data ? *(apr_uint32_t *)data : 0;
     apr_queue_t *q;
     apr_status_t rv;
     apr_time_t start;
     unsigned int i;
     void *value;
 
-    rv = apr_queue_create(&q, 5, p);
+    rv = apr_queue_create_ex(&q, 5, flags, p);
     ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
 
     for (i = 0; i < 2; ++i) {
@@ -170,15 +173,248 @@ static void test_queue_timeout(abts_case *tc, void *data)
     ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
 }
 
+#define MPMC_THREADS 4
+#define MPMC_ITEMS   100000
+
+static apr_uint32_t mpmc_sum;
+
+static void * APR_THREAD_FUNC mpmc_producer(apr_thread_t *thd, void *data)
+{
+    apr_queue_t *q = data;
+    apr_size_t i;
+
+    for (i = 1; i <= MPMC_ITEMS; i++) {
+        while (apr_queue_push(q, (void *)i) == APR_EINTR)
+            ;
+    }
+
+    return NULL;
+}
+
+static void * APR_THREAD_FUNC mpmc_consumer(apr_thread_t *thd, void *data)
+{
+    apr_queue_t *q = data;
+    apr_uint32_t sum = 0;
+    void *value;
+    int i;
+
+    for (i = 0; i < MPMC_ITEMS; i++) {
+        while (apr_queue_pop(q, &value) == APR_EINTR)
+            ;
+        sum += (apr_uint32_t)(apr_size_t)value;
+    }
+    apr_atomic_add32(&mpmc_sum, sum);
+
+    return NULL;
+}
+
+static void test_queue_lockfree(abts_case *tc, void *data)
+{
+    apr_thread_t *t[2 * MPMC_THREADS];
+    apr_queue_t *q;
+    apr_status_t rv;
+    apr_uint32_t expected = 0;
+    apr_size_t i;
+
+    rv = apr_queue_create_ex(&q, 0, APR_QUEUE_LOCKFREE, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+    rv = apr_queue_create_ex(&q, 5, 0x80000000, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    /* A single slot would look free when full, two are the least */
+    rv = apr_queue_create_ex(&q, 1, APR_QUEUE_LOCKFREE, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+    rv = apr_queue_create_ex(&q, 2, APR_QUEUE_LOCKFREE, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (i = 1; i <= 2; i++) {
+        rv = apr_queue_trypush(q, (void *)i);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    rv = apr_queue_trypush(q, (void *)i);
+    ABTS_TRUE(tc, APR_STATUS_IS_EAGAIN(rv));
+    ABTS_INT_EQUAL(tc, 2, apr_queue_size(q));
+    for (i = 1; i <= 2; i++) {
+        void *value = NULL;
+
+        rv = apr_queue_trypop(q, &value);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_PTR_EQUAL(tc, (void *)i, value);
+    }
+    rv = apr_queue_term(q);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* Small enough for the threads to block on both ends */
+    rv = apr_queue_create_ex(&q, 16, APR_QUEUE_LOCKFREE, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    mpmc_sum = 0;
+    for (i = 0; i < MPMC_THREADS; i++) {
+        rv = apr_thread_create(&t[2 * i], NULL, mpmc_producer, q, p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        rv = apr_thread_create(&t[2 * i + 1], NULL, mpmc_consumer, q, p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < 2 * MPMC_THREADS; i++) {
+        apr_thread_join(&rv, t[i]);
+    }
+    for (i = 1; i <= MPMC_ITEMS; i++) {
+        expected += (apr_uint32_t)i * MPMC_THREADS;
+    }
+    ABTS_INT_EQUAL(tc, expected, mpmc_sum);
+    ABTS_INT_EQUAL(tc, 0, apr_queue_size(q));
+
+    rv = apr_queue_term(q);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_queue_push(q, NULL);
+    ABTS_INT_EQUAL(tc, APR_EOF, rv);
+}
+
+#define BATCH_SIZE 7
+
+static void * APR_THREAD_FUNC batch_producer(apr_thread_t *thd, void *data)
+{
+    apr_queue_t *q = data;
+    void *values[BATCH_SIZE];
+    unsigned int n = 0, k, pushed;
+    apr_size_t i;
+
+    for (i = 1; i <= MPMC_ITEMS; i++) {
+        values[n++] = (void *)i;
+        if (n == BATCH_SIZE || i == MPMC_ITEMS) {
+            for (k = 0; k < n; k += pushed) {
+                if (apr_queue_push_n(q, values + k, n - k,
+                                     &pushed) == APR_EINTR) {
+                    pushed = 0;
+                }
+            }
+            n = 0;
+        }
+    }
+
+    return NULL;
+}
+
+static void * APR_THREAD_FUNC batch_consumer(apr_thread_t *thd, void *data)
+{
+    apr_queue_t *q = data;
+    apr_uint32_t sum = 0;
+    void *values[BATCH_SIZE];
+    unsigned int i, k, popped;
+
+    for (i = 0; i < MPMC_ITEMS; i += popped) {
+        k = MPMC_ITEMS - i < BATCH_SIZE ? MPMC_ITEMS - i : BATCH_SIZE;
+        if (apr_queue_pop_n(q, values, k, &popped) == APR_EINTR) {
+            popped = 0;
+        }
+        for (k = 0; k < popped; k++) {
+            sum += (apr_uint32_t)(apr_size_t)values[k];
+        }
+    }
+    apr_atomic_add32(&mpmc_sum, sum);
+
+    return NULL;
+}
+
+static void test_queue_batch(abts_case *tc, void *data)
+{
+    apr_uint32_t flags = data ? *(apr_uint32_t *)data : 0;
+    apr_thread_t *t[2 * MPMC_THREADS];
+    apr_queue_t *q;
+    apr_status_t rv;
+    apr_uint32_t expected = 0;
+    void *values[8], *out[8];
+    unsigned int count;
+    apr_size_t i;
+
+    rv = apr_queue_create_ex(&q, 5, flags, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (i = 0; i < 8; i++) {
+        values[i] = (void *)(i + 1);
+    }
+
+    rv = apr_queue_trypop_n(q, out, 8, &count);
+    ABTS_INT_EQUAL(tc, APR_EAGAIN, rv);
+    ABTS_INT_EQUAL(tc, 0, count);
+    rv = apr_queue_trypush_n(q, values, 0, &count);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 0, count);
+
+    /* As many as there is room for */
+    rv = apr_queue_trypush_n(q, values, 3, &count);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 3, count);
+    rv = apr_queue_push_n(q, values + 3, 5, &count);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 2, count);
+    rv = apr_queue_trypush_n(q, values + 5, 3, &count);
+    ABTS_INT_EQUAL(tc, APR_EAGAIN, rv);
+    ABTS_INT_EQUAL(tc, 0, count);
+    rv = apr_queue_timedpush_n(q, values + 5, 3, &count, 1000);
+    ABTS_INT_EQUAL(tc, APR_TIMEUP, rv);
+    ABTS_INT_EQUAL(tc, 5, apr_queue_size(q));
+
+    /* As many as available, in order */
+    rv = apr_queue_pop_n(q, out, 2, &count);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 2, count);
+    ABTS_PTR_EQUAL(tc, values[0], out[0]);
+    ABTS_PTR_EQUAL(tc, values[1], out[1]);
+    rv = apr_queue_push_n(q, values + 5, 3, &count);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 2, count);
+    rv = apr_queue_timedpop_n(q, out, 8, &count, 1000);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 5, count);
+    for (i = 0; i < 5; i++) {
+        ABTS_PTR_EQUAL(tc, values[i + 2], out[i]);
+    }
+    rv = apr_queue_timedpop_n(q, out, 8, &count, 1000);
+    ABTS_INT_EQUAL(tc, APR_TIMEUP, rv);
+    ABTS_INT_EQUAL(tc, 0, apr_queue_size(q));
+
+    /* Small enough for the threads to block on both ends */
+    rv = apr_queue_create_ex(&q, 16, flags, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    mpmc_sum = 0;
+    for (i = 0; i < MPMC_THREADS; i++) {
+        rv = apr_thread_create(&t[2 * i], NULL, batch_producer, q, p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        rv = apr_thread_create(&t[2 * i + 1], NULL, batch_consumer, q, p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < 2 * MPMC_THREADS; i++) {
+        apr_thread_join(&rv, t[i]);
+    }
+    for (i = 1; i <= MPMC_ITEMS; i++) {
+        expected += (apr_uint32_t)i * MPMC_THREADS;
+    }
+    ABTS_INT_EQUAL(tc, expected, mpmc_sum);
+    ABTS_INT_EQUAL(tc, 0, apr_queue_size(q));
+
+    rv = apr_queue_term(q);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_queue_pop_n(q, out, 8, &count);
+    ABTS_INT_EQUAL(tc, APR_EOF, rv);
+}
+
 #endif /* APR_HAS_THREADS */
 
 abts_suite *testqueue(abts_suite *suite)
 {
+#if APR_HAS_THREADS
+    static apr_uint32_t lockfree = APR_QUEUE_LOCKFREE;
+#endif
+
     suite = ADD_SUITE(suite);
 
 #if APR_HAS_THREADS
     abts_run_test(suite, test_queue_producer_consumer, NULL);
     abts_run_test(suite, test_queue_timeout, NULL);
+    abts_run_test(suite, test_queue_timeout, &lockfree);
+    abts_run_test(suite, test_queue_lockfree, NULL);
+    abts_run_test(suite, test_queue_batch, NULL);
+    abts_run_test(suite, test_queue_batch, &lockfree);
 #endif /* APR_HAS_THREADS */
 
     return suite;
@@ -22,6 +22,7 @@
 #include "apr_hash.h"
 #include "apr_redis.h"
 #include "apr_network_io.h"
+#include "apr_thread_proc.h"
 
 #include <stdio.h>
 #if APR_HAVE_STDLIB_H
@@ -343,6 +344,86 @@ static void test_redis_user_funcs(abts_case * tc, void *data)
   ABTS_ASSERT(tc, "wrong server found", found->port == baton->which_server);
 }
 
+#if APR_HAS_THREADS
+/* create a client object of n servers, not connected to until used */
+static apr_redis_t *create_servers(abts_case *tc, apr_uint32_t flags,
+                              apr_uint16_t n)
+{
+  apr_pool_t *pool = p;
+  apr_redis_t *client;
+  apr_uint16_t i;
+  apr_status_t rv;
+
+  rv = apr_redis_create(pool, n, flags, &client);
+  ABTS_ASSERT(tc, "create failed", rv == APR_SUCCESS);
+
+  for (i = 0; i < n; i++) {
+    apr_redis_server_t *ms;
+
+    rv = apr_redis_server_create(pool, HOST, i + 1, 0, 1, 1, 60, 60, &ms);
+    ABTS_ASSERT(tc, "server create failed", rv == APR_SUCCESS);
+
+    rv = apr_redis_add_server(client, ms);
+    ABTS_ASSERT(tc, "server add failed", rv == APR_SUCCESS);
+  }
+
+  return client;
+}
+
+/*
+ * with a consistent hash, adding an 11th server must only move keys to
+ * the new server, and not many of them, and disabling a server must only
+ * move the keys of that server.
+ */
+static void test_redis_consistent(abts_case * tc, void *data)
+{
+  apr_uint32_t flags = *(apr_uint32_t *)data;
+  apr_redis_t *ten, *eleven;
+  apr_redis_server_t *dead;
+  int i, moved = 0;
+
+  ten = create_servers(tc, flags, 10);
+  eleven = create_servers(tc, flags, 11);
+
+  for (i = 0; i < TDATA_SIZE; i++) {
+    const char *key = apr_pstrcat(p, prefix, apr_itoa(p, i), NULL);
+    apr_uint32_t hash = apr_redis_hash(ten, key, strlen(key));
+    apr_redis_server_t *s10, *s11;
+
+    s10 = apr_redis_find_server_hash(ten, hash);
+    s11 = apr_redis_find_server_hash(eleven, hash);
+    ABTS_PTR_NOTNULL(tc, s10);
+    ABTS_PTR_NOTNULL(tc, s11);
+    if (s10->port != s11->port) {
+      ABTS_INT_EQUAL(tc, 11, s11->port);
+      moved++;
+    }
+  }
+  ABTS_ASSERT(tc, apr_psprintf(p, "%d keys of %d moved", moved, TDATA_SIZE),
+              moved > 0 && moved < TDATA_SIZE / 5);
+
+  dead = apr_redis_find_server(eleven, HOST, 5);
+  apr_redis_disable_server(eleven, dead);
+
+  for (i = 0; i < TDATA_SIZE; i++) {
+    const char *key = apr_pstrcat(p, prefix, apr_itoa(p, i), NULL);
+    apr_uint32_t hash = apr_redis_hash(ten, key, strlen(key));
+    apr_redis_server_t *s10, *s11;
+
+    s10 = apr_redis_find_server_hash(ten, hash);
+    s11 = apr_redis_find_server_hash(eleven, hash);
+    ABTS_PTR_NOTNULL(tc, s11);
+    ABTS_ASSERT(tc, "dead server selected", s11 != dead);
+    if (s10->port != 5 && s11->port != 11) {
+      ABTS_INT_EQUAL(tc, s10->port, s11->port);
+    }
+  }
+}
+
+static apr_uint32_t flag_ketama = APR_RC_FLAG_KETAMA;
+static apr_uint32_t flag_jump = APR_RC_FLAG_JUMP;
+#endif
+
 /* test non data related commands like stats and version */
 static void test_redis_meta(abts_case * tc, void *data)
 {
@@ -585,17 +666,766 @@ static void test_redis_setexget(abts_case * tc, void *data)
     }
 }
 
+/* test the multiget functionality */
+static void test_redis_multiget(abts_case * tc, void *data)
+{
+    apr_pool_t *pool = p;
+    apr_pool_t *tmppool;
+    apr_status_t rv;
+    apr_redis_t *redis;
+    apr_redis_server_t *server;
+    apr_redis_value_t *value;
+    apr_hash_t *tdata, *values = NULL;
+    apr_hash_index_t *hi;
+    apr_uint32_t i;
+
+    if (!has_redis_server()) {
+        ABTS_SKIP(tc, data, "Redis server not found.");
+        return;
+    }
+
+    rv = apr_redis_create(pool, 1, 0, &redis);
+    ABTS_ASSERT(tc, "redis create failed", rv == APR_SUCCESS);
+
+    rv = apr_redis_server_create(pool, HOST, PORT, 0, 1, 1, 60, 60, &server);
+    ABTS_ASSERT(tc, "server create failed", rv == APR_SUCCESS);
+
+    rv = apr_redis_add_server(redis, server);
+    ABTS_ASSERT(tc, "server add failed", rv == APR_SUCCESS);
+
+    tdata = apr_hash_make(pool);
+
+    create_test_hash(pool, tdata);
+
+    for (hi = apr_hash_first(p, tdata); hi; hi = apr_hash_next(hi)) {
+        const void *k;
+        void *v;
+
+        apr_hash_this(hi, &k, NULL, &v);
+
+        rv = apr_redis_set(redis, k, v, strlen(v), 27);
+        ABTS_ASSERT(tc, "set failed", rv == APR_SUCCESS);
+    }
+
+    apr_pool_create(&tmppool, pool);
+    for (i = 0; i < TDATA_SET; i++) {
+        apr_redis_add_multget_key(pool,
+                                  apr_pstrcat(pool, prefix,
+                                              apr_itoa(pool, i), NULL),
+                                  &values);
+    }
+    apr_redis_add_multget_key(pool, "nothere3423", &values);
+
+    rv = apr_redis_multgetp(redis, tmppool, pool, values);
+    ABTS_ASSERT(tc, "multgetp failed", rv == APR_SUCCESS);
+    ABTS_ASSERT(tc, "multgetp returned too few results",
+                apr_hash_count(values) == TDATA_SET + 1);
+
+    for (hi = apr_hash_first(p, values); hi; hi = apr_hash_next(hi)) {
+        const void *k;
+        void *v;
+        const char *expected;
+
+        apr_hash_this(hi, &k, NULL, &v);
+        value = v;
+        expected = apr_hash_get(tdata, k, APR_HASH_KEY_STRING);
+
+        ABTS_INT_EQUAL(tc, '$', value->type);
+        if (expected) {
+            ABTS_ASSERT(tc, "multgetp returned a wrong value",
+                        value->data && !strcmp(value->data, expected));
+        }
+        else {
+            ABTS_PTR_EQUAL(tc, NULL, value->data);
+        }
+    }
+
+    for (hi = apr_hash_first(p, tdata); hi; hi = apr_hash_next(hi)) {
+        const void *k;
+
+        apr_hash_this(hi, &k, NULL, NULL);
+
+        rv = apr_redis_delete(redis, k, 0);
+        ABTS_ASSERT(tc, "delete failed", rv == APR_SUCCESS);
+    }
+}
+
+/* test pipelining, synchronously then with a pollset */
+
+typedef struct pipeline_baton_t {
+    apr_hash_t *tdata;
+    int replies;
+    int errors;
+} pipeline_baton_t;
+
+static void pipeline_cb(void *baton, const apr_redis_reply_t *reply)
+{
+    pipeline_baton_t *pb = baton;
+    const char *v = apr_hash_get(pb->tdata, reply->key, APR_HASH_KEY_STRING);
+
+    pb->replies++;
+    if (reply->status != APR_SUCCESS) {
+        pb->errors++;
+    }
+    else if (reply->type == '$'
+             && (reply->len != strlen(v) || strcmp(reply->data, v))) {
+        pb->errors++;
+    }
+}
+
+static void pipeline_notfound_cb(void *baton, const apr_redis_reply_t *reply)
+{
+    pipeline_baton_t *pb = baton;
+
+    pb->replies++;
+    if (reply->status != APR_NOTFOUND) {
+        pb->errors++;
+    }
+}
+
+static void test_redis_pipeline(abts_case * tc, void *data)
+{
+    apr_pool_t *pool = p;
+    apr_status_t rv;
+    apr_redis_t *redis;
+    apr_redis_server_t *server;
+    apr_redis_pipeline_t *pl;
+    apr_pollset_t *pollset;
+    apr_hash_t *tdata;
+    apr_hash_index_t *hi;
+    pipeline_baton_t pb;
+    int count;
+
+    if (!has_redis_server()) {
+        ABTS_SKIP(tc, data, "Redis server not found.");
+        return;
+    }
+
+    rv = apr_redis_create(pool, 1, 0, &redis);
+    ABTS_ASSERT(tc, "redis create failed", rv == APR_SUCCESS);
+
+    rv = apr_redis_server_create(pool, HOST, PORT, 0, 1, 1, 60, 60, &server);
+    ABTS_ASSERT(tc, "server create failed", rv == APR_SUCCESS);
+
+    rv = apr_redis_add_server(redis, server);
+    ABTS_ASSERT(tc, "server add failed", rv == APR_SUCCESS);
+
+    rv = apr_redis_pipeline_create(&pl, redis, pool);
+    ABTS_ASSERT(tc, "pipeline create failed", rv == APR_SUCCESS);
+
+    tdata = apr_hash_make(pool);
+    count = create_test_hash(pool, tdata);
+    memset(&pb, 0, sizeof(pb));
+    pb.tdata = tdata;
+
+    for (hi = apr_hash_first(p, tdata); hi; hi = apr_hash_next(hi)) {
+        const void *k;
+        void *v;
+
+        apr_hash_this(hi, &k, NULL, &v);
+        rv = apr_redis_pipeline_set(pl, k, v, strlen(v), 0, pipeline_cb, &pb);
+        ABTS_ASSERT(tc, "pipeline set failed", rv == APR_SUCCESS);
+    }
+    ABTS_INT_EQUAL(tc, count, (int)apr_redis_pipeline_pending(pl));
+
+    rv = apr_redis_pipeline_exec(pl);
+    ABTS_ASSERT(tc, "pipeline exec failed", rv == APR_SUCCESS);
+    ABTS_INT_EQUAL(tc, 0, (int)apr_redis_pipeline_pending(pl));
+    ABTS_INT_EQUAL(tc, count, pb.replies);
+    ABTS_INT_EQUAL(tc, 0, pb.errors);
+
+    rv = apr_pollset_create(&pollset, 1, pool, 0);
+    ABTS_ASSERT(tc, "pollset create failed", rv == APR_SUCCESS);
+
+    pb.replies = 0;
+    for (hi = apr_hash_first(p, tdata); hi; hi = apr_hash_next(hi)) {
+        const void *k;
+
+        apr_hash_this(hi, &k, NULL, NULL);
+        rv = apr_redis_pipeline_get(pl, k, pipeline_cb, &pb);
+        ABTS_ASSERT(tc, "pipeline get failed", rv == APR_SUCCESS);
+    }
+    rv = apr_redis_pipeline_get(pl, "nothere3423", pipeline_notfound_cb, &pb);
+    ABTS_ASSERT(tc, "pipeline get failed", rv == APR_SUCCESS);
+
+    rv = apr_redis_pipeline_send(pl, pollset);
+    ABTS_ASSERT(tc, "pipeline send failed", rv == APR_SUCCESS);
+    while (apr_redis_pipeline_pending(pl)) {
+        const apr_pollfd_t *pfds;
+        apr_int32_t num;
+
+        rv = apr_pollset_poll(pollset, apr_time_from_sec(10), &num, &pfds);
+        ABTS_ASSERT(tc, "pollset poll failed", rv == APR_SUCCESS);
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+        ABTS_PTR_EQUAL(tc, pl, pfds[0].client_data);
+        rv = apr_redis_pipeline_process(pl, &pfds[0]);
+        ABTS_ASSERT(tc, "pipeline process failed",
+                    rv == APR_SUCCESS || rv == APR_EAGAIN);
+    }
+    ABTS_INT_EQUAL(tc, count + 1, pb.replies);
+    ABTS_INT_EQUAL(tc, 0, pb.errors);
+
+    pb.replies = 0;
+    for (hi = apr_hash_first(p, tdata); hi; hi = apr_hash_next(hi)) {
+        const void *k;
+
+        apr_hash_this(hi, &k, NULL, NULL);
+        rv = apr_redis_pipeline_delete(pl, k, pipeline_cb, &pb);
+        ABTS_ASSERT(tc, "pipeline delete failed", rv == APR_SUCCESS);
+    }
+    rv = apr_redis_pipeline_delete(pl, "nothere3423", pipeline_notfound_cb,
+                                   &pb);
+    ABTS_ASSERT(tc, "pipeline delete failed", rv == APR_SUCCESS);
+
+    rv = apr_redis_pipeline_exec(pl);
+    ABTS_ASSERT(tc, "pipeline exec failed", rv == APR_SUCCESS);
+    ABTS_INT_EQUAL(tc, count + 1, pb.replies);
+    ABTS_INT_EQUAL(tc, 0, pb.errors);
+}
+
+/* test the near cache */
+
+#if APR_HAS_THREADS
+
+#define NEAR_THREADS 8
+#define NEAR_GETS 100
+
+typedef struct near_baton_t {
+    apr_redis_t *redis;
+    const char *key;
+    const char *value;
+    int errors;
+} near_baton_t;
+
+static void * APR_THREAD_FUNC near_cache_thread(apr_thread_t *thd,
+                                                void *data)
+{
+    near_baton_t *nb = data;
+    apr_pool_t *pool = apr_thread_pool_get(thd);
+    char *result;
+    apr_size_t len;
+    int i;
+
+    for (i = 0; i < NEAR_GETS; i++) {
+        if (apr_redis_getp(nb->redis, pool, nb->key, &result, &len,
+                              NULL) != APR_SUCCESS
+            || strcmp(result, nb->value)) {
+            nb->errors++;
+        }
+    }
+
+    return NULL;
+}
+
+#endif /* APR_HAS_THREADS */
+
+static void test_redis_near_cache(abts_case * tc, void *data)
+{
+    apr_pool_t *pool = p;
+    apr_status_t rv;
+    apr_redis_t *redis, *direct;
+    apr_redis_server_t *server, *dserver;
+    const char *key = apr_pstrcat(p, prefix, "nearcache", NULL);
+    char *result;
+    apr_size_t len;
+#if APR_HAS_THREADS
+    apr_thread_t *threads[NEAR_THREADS];
+    near_baton_t batons[NEAR_THREADS];
+    int i;
+#endif
+
+    if (!has_redis_server()) {
+        ABTS_SKIP(tc, data, "Redis server not found.");
+        return;
+    }
+
+    rv = apr_redis_create(pool, 1, 0, &redis);
+    ABTS_ASSERT(tc, "redis create failed", rv == APR_SUCCESS);
+    rv = apr_redis_server_create(pool, HOST, PORT, 0, 1, 1, 60, 60, &server);
+    ABTS_ASSERT(tc, "server create failed", rv == APR_SUCCESS);
+    rv = apr_redis_add_server(redis, server);
+    ABTS_ASSERT(tc, "server add failed", rv == APR_SUCCESS);
+
+    rv = apr_redis_near_cache_create(redis, 64, 1024,
+                                        apr_time_from_sec(60));
+    ABTS_ASSERT(tc, "near cache create failed", rv == APR_SUCCESS);
+
+    /* a client without near cache, changing the values behind it */
+    rv = apr_redis_create(pool, 1, 0, &direct);
+    ABTS_ASSERT(tc, "redis create failed", rv == APR_SUCCESS);
+    rv = apr_redis_server_create(pool, HOST, PORT, 0, 1, 1, 60, 60, &dserver);
+    ABTS_ASSERT(tc, "server create failed", rv == APR_SUCCESS);
+    rv = apr_redis_add_server(direct, dserver);
+    ABTS_ASSERT(tc, "server add failed", rv == APR_SUCCESS);
+
+    rv = apr_redis_set(redis, key, "one", 3, 27);
+    ABTS_ASSERT(tc, "set failed", rv == APR_SUCCESS);
+    rv = apr_redis_getp(redis, pool, key, &result, &len, NULL);
+    ABTS_ASSERT(tc, "get failed", rv == APR_SUCCESS);
+    ABTS_STR_EQUAL(tc, "one", result);
+
+    /* served from the near cache */
+    rv = apr_redis_set(direct, key, "two", 3, 27);
+    ABTS_ASSERT(tc, "set failed", rv == APR_SUCCESS);
+    rv = apr_redis_getp(redis, pool, key, &result, &len, NULL);
+    ABTS_ASSERT(tc, "get failed", rv == APR_SUCCESS);
+    ABTS_STR_EQUAL(tc, "one", result);
+
+    /* invalidated by the client's own changes */
+    rv = apr_redis_set(redis, key, "three", 5, 27);
+    ABTS_ASSERT(tc, "set failed", rv == APR_SUCCESS);
+    rv = apr_redis_getp(redis, pool, key, &result, &len, NULL);
+    ABTS_ASSERT(tc, "get failed", rv == APR_SUCCESS);
+    ABTS_STR_EQUAL(tc, "three", result);
+
+#if APR_HAS_THREADS
+    rv = apr_redis_delete(redis, key, 0);
+    ABTS_ASSERT(tc, "delete failed", rv == APR_SUCCESS);
+    rv = apr_redis_set(direct, key, "four", 4, 27);
+    ABTS_ASSERT(tc, "set failed", rv == APR_SUCCESS);
+
+    for (i = 0; i < NEAR_THREADS; i++) {
+        batons[i].redis = redis;
+        batons[i].key = key;
+        batons[i].value = "four";
+        batons[i].errors = 0;
+        rv = apr_thread_create(&threads[i], NULL, near_cache_thread,
+                               &batons[i], pool);
+        ABTS_ASSERT(tc, "thread create failed", rv == APR_SUCCESS);
+    }
+    for (i = 0; i < NEAR_THREADS; i++) {
+        apr_status_t retval;
+
+        apr_thread_join(&retval, threads[i]);
+        ABTS_INT_EQUAL(tc, 0, batons[i].errors);
+    }
+#endif
+
+    rv = apr_redis_delete(redis, key, 0);
+    ABTS_ASSERT(tc, "delete failed", rv == APR_SUCCESS);
+    rv = apr_redis_getp(redis, pool, key, &result, &len, NULL);
+    ABTS_INT_EQUAL(tc, APR_NOTFOUND, rv);
+}
+
+/* test the latency histograms of the client side metrics */
+static void test_redis_latency(abts_case * tc, void *data)
+{
+    apr_redis_latency_t lat;
+    int i;
+
+    ABTS_INT_EQUAL(tc, 1, (int)apr_redis_latency_bucket_limit(0));
+    ABTS_INT_EQUAL(tc, 4, (int)apr_redis_latency_bucket_limit(3));
+    ABTS_INT_EQUAL(tc, 5, (int)apr_redis_latency_bucket_limit(4));
+    ABTS_INT_EQUAL(tc, 8, (int)apr_redis_latency_bucket_limit(7));
+    ABTS_INT_EQUAL(tc, 10, (int)apr_redis_latency_bucket_limit(8));
+    ABTS_INT_EQUAL(tc, 1024, (int)apr_redis_latency_bucket_limit(35));
+    ABTS_INT_EQUAL(tc, -1,
+                   (int)apr_redis_latency_bucket_limit(APR_RC_LATENCY_BUCKETS - 1));
+
+    memset(&lat, 0, sizeof(lat));
+    ABTS_INT_EQUAL(tc, 0, (int)apr_redis_latency_percentile(&lat, 50));
+
+    /* 90 latencies of 2us and 10 of 1000us (bucket [896, 1024)) */
+    lat.buckets[2] = 90;
+    lat.buckets[35] = 10;
+    lat.count = 100;
+    lat.sum = 90 * 2 + 10 * 1000;
+    lat.max = 1000;
+    ABTS_INT_EQUAL(tc, 2, (int)apr_redis_latency_percentile(&lat, 0));
+    ABTS_INT_EQUAL(tc, 2, (int)apr_redis_latency_percentile(&lat, 50));
+    ABTS_INT_EQUAL(tc, 2, (int)apr_redis_latency_percentile(&lat, 89.9));
+    ABTS_INT_EQUAL(tc, 1000, (int)apr_redis_latency_percentile(&lat, 90));
+    ABTS_INT_EQUAL(tc, 1000, (int)apr_redis_latency_percentile(&lat, 99));
+    ABTS_INT_EQUAL(tc, 1000, (int)apr_redis_latency_percentile(&lat, 100));
+
+    /* the bounds are increasing, by a quarter at most */
+    for (i = 4; i < APR_RC_LATENCY_BUCKETS - 1; i++) {
+        apr_interval_time_t lo = apr_redis_latency_bucket_limit(i - 1);
+        apr_interval_time_t hi = apr_redis_latency_bucket_limit(i);
+
+        ABTS_ASSERT(tc, "bucket bounds out of order", hi > lo);
+        ABTS_ASSERT(tc, "bucket too wide", (hi - lo) * 4 <= lo);
+    }
+}
+
+/* test the client side metrics of a server */
+static void test_redis_metrics(abts_case * tc, void *data)
+{
+    apr_pool_t *pool = p;
+    apr_status_t rv;
+    apr_redis_t *redis;
+    apr_redis_server_t *server;
+    apr_redis_metrics_t metrics;
+    int i;
+
+    if (!has_redis_server()) {
+        ABTS_SKIP(tc, data, "Redis server not found.");
+        return;
+    }
+
+    rv = apr_redis_create(pool, 1, 0, &redis);
+    ABTS_ASSERT(tc, "redis create failed", rv == APR_SUCCESS);
+    rv = apr_redis_server_create(pool, HOST, PORT, 0, 1, 1, 60, 60, &server);
+    ABTS_ASSERT(tc, "server create failed", rv == APR_SUCCESS);
+    rv = apr_redis_add_server(redis, server);
+    ABTS_ASSERT(tc, "server add failed", rv == APR_SUCCESS);
+
+    for (i = 0; i < 10; i++) {
+        rv = apr_redis_ping(server);
+        ABTS_ASSERT(tc, "ping failed", rv == APR_SUCCESS);
+    }
+
+    rv = apr_redis_server_metrics(server, &metrics);
+    ABTS_ASSERT(tc, "metrics failed", rv == APR_SUCCESS);
+    ABTS_INT_EQUAL(tc, 10, (int)metrics.requests);
+    ABTS_INT_EQUAL(tc, 0, (int)metrics.errors);
+    ABTS_INT_EQUAL(tc, 1, (int)metrics.connects);
+    ABTS_INT_EQUAL(tc, 1, (int)metrics.connect.count);
+    ABTS_INT_EQUAL(tc, 10, (int)metrics.send.count);
+    ABTS_INT_EQUAL(tc, 10, (int)metrics.first_byte.count);
+    ABTS_INT_EQUAL(tc, 10, (int)metrics.total.count);
+    ABTS_ASSERT(tc, "first byte before the send",
+                apr_redis_latency_percentile(&metrics.first_byte, 50) >=
+                apr_redis_latency_percentile(&metrics.send, 50));
+    ABTS_ASSERT(tc, "max below the percentile",
+                (apr_interval_time_t)metrics.total.max >=
+                apr_redis_latency_percentile(&metrics.total, 99));
+    ABTS_INT_EQUAL(tc, 0, (int)metrics.deaths);
+
+    rv = apr_redis_disable_server(redis, server);
+    ABTS_ASSERT(tc, "disable failed", rv == APR_SUCCESS);
+    apr_sleep(1000);
+    rv = apr_redis_enable_server(redis, server);
+    ABTS_ASSERT(tc, "enable failed", rv == APR_SUCCESS);
+
+    rv = apr_redis_server_metrics(server, &metrics);
+    ABTS_ASSERT(tc, "metrics failed", rv == APR_SUCCESS);
+    ABTS_INT_EQUAL(tc, 1, (int)metrics.deaths);
+    ABTS_ASSERT(tc, "no dead time", metrics.dead_time >= 1000);
+
+    apr_redis_server_metrics_reset(server);
+    rv = apr_redis_server_metrics(server, &metrics);
+    ABTS_ASSERT(tc, "metrics failed", rv == APR_SUCCESS);
+    ABTS_INT_EQUAL(tc, 0, (int)metrics.requests);
+    ABTS_INT_EQUAL(tc, 0, (int)metrics.total.count);
+    ABTS_INT_EQUAL(tc, 0, (int)metrics.dead_time);
+}
+
+/* test the background probing of the dead servers */
+static void test_redis_prober(abts_case * tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_status_t rv;
+    apr_redis_t *redis;
+    apr_redis_server_t *server;
+    int i;
+
+    if (!has_redis_server()) {
+        ABTS_SKIP(tc, data, "Redis server not found.");
+        return;
+    }
+
+    apr_pool_create(&pool, p);
+    rv = apr_redis_create(pool, 1, 0, &redis);
+    ABTS_ASSERT(tc, "redis create failed", rv == APR_SUCCESS);
+    rv = apr_redis_server_create(pool, HOST, PORT, 0, 1, 1, 60, 60, &server);
+    ABTS_ASSERT(tc, "server create failed", rv == APR_SUCCESS);
+    rv = apr_redis_add_server(redis, server);
+    ABTS_ASSERT(tc, "server add failed", rv == APR_SUCCESS);
+
+    rv = apr_redis_prober_start(redis, apr_time_from_msec(10),
+                             apr_time_from_msec(100));
+#if !APR_HAS_THREADS
+    ABTS_INT_EQUAL(tc, APR_ENOTIMPL, rv);
+#else
+    ABTS_ASSERT(tc, "prober start failed", rv == APR_SUCCESS);
+    rv = apr_redis_prober_start(redis, apr_time_from_msec(10),
+                             apr_time_from_msec(100));
+    ABTS_INT_EQUAL(tc, APR_EEXIST, rv);
+
+    /* dead until probed, the requests don't probe */
+    rv = apr_redis_disable_server(redis, server);
+    ABTS_ASSERT(tc, "disable failed", rv == APR_SUCCESS);
+    ABTS_PTR_EQUAL(tc, NULL, apr_redis_find_server_hash(redis, 1));
+
+    for (i = 0; i < 200 && server->status != APR_RC_SERVER_LIVE; i++) {
+        apr_sleep(apr_time_from_msec(10));
+    }
+    ABTS_INT_EQUAL(tc, APR_RC_SERVER_LIVE, server->status);
+    ABTS_PTR_EQUAL(tc, server, apr_redis_find_server_hash(redis, 1));
+#endif
+
+    /* stops the prober */
+    apr_pool_destroy(pool);
+}
+
+/* a brigade of the data in buckets of a few bytes */
+static apr_bucket_brigade *value_brigade(apr_pool_t *pool,
+                                         apr_bucket_alloc_t *ba,
+                                         const char *str, apr_size_t len)
+{
+    apr_bucket_brigade *bb = apr_brigade_create(pool, ba);
+
+    while (len) {
+        apr_size_t n = len < 3 ? len : 3;
+
+        APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_heap_create(str, n, NULL, ba));
+        str += n;
+        len -= n;
+    }
+    return bb;
+}
+
+/* test the RESP2/RESP3 parser */
+static void test_redis_value_read(abts_case * tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_bucket_alloc_t *ba;
+    apr_bucket_brigade *bb;
+    apr_redis_value_t *v, *e;
+    apr_status_t rv;
+    char buf[64];
+    apr_size_t len;
+    apr_off_t off;
+    static const char resp[] =
+        "*6\r\n"
+        "$5\r\nhello\r\n"
+        "$-1\r\n"
+        ":-42\r\n"
+        "$26\r\nabcdefghijklmnopqrstuvwxyz\r\n"
+        "*-1\r\n"
+        "*2\r\n+OK\r\n-ERR oops\r\n"
+        "%2\r\n+a\r\n#t\r\n$1\r\nb\r\n_\r\n"
+        "|1\r\n+ttl\r\n:3600\r\n"
+        "~2\r\n,3.14\r\n(12345678901234567890\r\n"
+        "=8\r\ntxt:abcd\r\n"
+        "!9\r\nERR again\r\n"
+        "+PONG\r\n";
+
+    apr_pool_create(&pool, p);
+    ba = apr_bucket_alloc_create(pool);
+    bb = value_brigade(pool, ba, resp, sizeof(resp) - 1);
+
+    /* RESP2, the long strings in brigades */
+    rv = apr_redis_value_read(bb, pool, 8, &v);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, '*', v->type);
+    ABTS_INT_EQUAL(tc, 6, v->elts->nelts);
+    e = &APR_ARRAY_IDX(v->elts, 0, apr_redis_value_t);
+    ABTS_INT_EQUAL(tc, '$', e->type);
+    ABTS_STR_EQUAL(tc, "hello", e->data);
+    ABTS_PTR_EQUAL(tc, NULL, e->bb);
+    e = &APR_ARRAY_IDX(v->elts, 1, apr_redis_value_t);
+    ABTS_INT_EQUAL(tc, '$', e->type);
+    ABTS_PTR_EQUAL(tc, NULL, e->data);
+    ABTS_PTR_EQUAL(tc, NULL, e->bb);
+    e = &APR_ARRAY_IDX(v->elts, 2, apr_redis_value_t);
+    ABTS_INT_EQUAL(tc, ':', e->type);
+    ABTS_INT_EQUAL(tc, -42, (int)e->integer);
+    e = &APR_ARRAY_IDX(v->elts, 3, apr_redis_value_t);
+    ABTS_INT_EQUAL(tc, '$', e->type);
+    ABTS_PTR_EQUAL(tc, NULL, e->data);
+    ABTS_PTR_NOTNULL(tc, e->bb);
+    ABTS_INT_EQUAL(tc, 26, (int)e->len);
+    len = sizeof(buf);
+    apr_brigade_flatten(e->bb, buf, &len);
+    ABTS_INT_EQUAL(tc, 26, (int)len);
+    ABTS_ASSERT(tc, "wrong brigade contents",
+                memcmp(buf, "abcdefghijklmnopqrstuvwxyz", 26) == 0);
+    e = &APR_ARRAY_IDX(v->elts, 4, apr_redis_value_t);
+    ABTS_INT_EQUAL(tc, '*', e->type);
+    ABTS_PTR_EQUAL(tc, NULL, e->elts);
+    e = &APR_ARRAY_IDX(v->elts, 5, apr_redis_value_t);
+    ABTS_INT_EQUAL(tc, 2, e->elts->nelts);
+    ABTS_STR_EQUAL(tc, "OK", APR_ARRAY_IDX(e->elts, 0, apr_redis_value_t).data);
+    ABTS_INT_EQUAL(tc, '-', APR_ARRAY_IDX(e->elts, 1, apr_redis_value_t).type);
+    ABTS_STR_EQUAL(tc, "ERR oops",
+                   APR_ARRAY_IDX(e->elts, 1, apr_redis_value_t).data);
+
+    /* RESP3 */
+    rv = apr_redis_value_read(bb, pool, 8, &v);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, '%', v->type);
+    ABTS_INT_EQUAL(tc, 4, v->elts->nelts);
+    ABTS_STR_EQUAL(tc, "a", APR_ARRAY_IDX(v->elts, 0, apr_redis_value_t).data);
+    ABTS_INT_EQUAL(tc, '#', APR_ARRAY_IDX(v->elts, 1, apr_redis_value_t).type);
+    ABTS_INT_EQUAL(tc, 1,
+                   (int)APR_ARRAY_IDX(v->elts, 1, apr_redis_value_t).integer);
+    ABTS_STR_EQUAL(tc, "b", APR_ARRAY_IDX(v->elts, 2, apr_redis_value_t).data);
+    ABTS_INT_EQUAL(tc, '_', APR_ARRAY_IDX(v->elts, 3, apr_redis_value_t).type);
+
+    rv = apr_redis_value_read(bb, pool, 8, &v);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, '~', v->type);
+    ABTS_PTR_NOTNULL(tc, v->attributes);
+    ABTS_INT_EQUAL(tc, '|', v->attributes->type);
+    ABTS_INT_EQUAL(tc, 2, v->attributes->elts->nelts);
+    ABTS_STR_EQUAL(tc, "ttl",
+                   APR_ARRAY_IDX(v->attributes->elts, 0, apr_redis_value_t).data);
+    ABTS_INT_EQUAL(tc, 2, v->elts->nelts);
+    ABTS_INT_EQUAL(tc, ',', APR_ARRAY_IDX(v->elts, 0, apr_redis_value_t).type);
+    ABTS_STR_EQUAL(tc, "3.14",
+                   APR_ARRAY_IDX(v->elts, 0, apr_redis_value_t).data);
+    ABTS_STR_EQUAL(tc, "12345678901234567890",
+                   APR_ARRAY_IDX(v->elts, 1, apr_redis_value_t).data);
+
+    rv = apr_redis_value_read(bb, pool, 8, &v);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, '=', v->type);
+    ABTS_STR_EQUAL(tc, "txt:abcd", v->data);
+
+    rv = apr_redis_value_read(bb, pool, 8, &v);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, '!', v->type);
+    ABTS_PTR_NOTNULL(tc, v->bb);
+    ABTS_INT_EQUAL(tc, 9, (int)v->len);
+
+    rv = apr_redis_value_read(bb, pool, 8, &v);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_STR_EQUAL(tc, "PONG", v->data);
+    ABTS_ASSERT(tc, "brigade not consumed",
+                apr_brigade_length(bb, 0, &off) == APR_SUCCESS && off == 0);
+
+    /* truncated and malformed */
+    bb = value_brigade(pool, ba, "$10\r\nabc", 8);
+    ABTS_INT_EQUAL(tc, APR_INCOMPLETE, apr_redis_value_read(bb, pool, 0, &v));
+    bb = value_brigade(pool, ba, "*2\r\n:1\r\n", 8);
+    ABTS_INT_EQUAL(tc, APR_INCOMPLETE, apr_redis_value_read(bb, pool, 0, &v));
+    bb = value_brigade(pool, ba, ":12a\r\n", 6);
+    ABTS_INT_EQUAL(tc, APR_EGENERAL, apr_redis_value_read(bb, pool, 0, &v));
+    bb = value_brigade(pool, ba, "$3\r\nabcd\r\n", 10);
+    ABTS_INT_EQUAL(tc, APR_EGENERAL, apr_redis_value_read(bb, pool, 0, &v));
+    bb = value_brigade(pool, ba, "?\r\n", 3);
+    ABTS_INT_EQUAL(tc, APR_EGENERAL, apr_redis_value_read(bb, pool, 0, &v));
+    bb = value_brigade(pool, ba, "$?\r\n;3\r\nabc\r\n;0\r\n", 18);
+    ABTS_INT_EQUAL(tc, APR_ENOTIMPL, apr_redis_value_read(bb, pool, 0, &v));
+
+    apr_pool_destroy(pool);
+}
+
+/* test the commands whose replies are read as values */
+static void test_redis_command(abts_case * tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_bucket_alloc_t *ba;
+    apr_bucket_brigade *bb;
+    apr_status_t rv;
+    apr_redis_t *redis;
+    apr_redis_server_t *server;
+    apr_redis_value_t *v;
+    const char *argv[6];
+    char *big, *result;
+    apr_size_t len;
+    int i;
+
+    if (!has_redis_server()) {
+        ABTS_SKIP(tc, data, "Redis server not found.");
+        return;
+    }
+
+    apr_pool_create(&pool, p);
+    ba = apr_bucket_alloc_create(pool);
+
+    rv = apr_redis_create(pool, 1, 0, &redis);
+    ABTS_ASSERT(tc, "redis create failed", rv == APR_SUCCESS);
+
+    rv = apr_redis_server_create(pool, HOST, PORT, 0, 1, 1, 60, 60, &server);
+    ABTS_ASSERT(tc, "server create failed", rv == APR_SUCCESS);
+
+    rv = apr_redis_add_server(redis, server);
+    ABTS_ASSERT(tc, "server add failed", rv == APR_SUCCESS);
+
+    /* larger than a socket read */
+    big = apr_palloc(pool, 100000);
+    for (i = 0; i < 100000; i++) {
+        big[i] = 'a' + i % 26;
+    }
+    rv = apr_redis_set(redis, "testredis.command.1", big, 100000, 0);
+    ABTS_ASSERT(tc, "set failed", rv == APR_SUCCESS);
+    rv = apr_redis_set(redis, "testredis.command.2", "two", 3, 0);
+    ABTS_ASSERT(tc, "set failed", rv == APR_SUCCESS);
+    apr_redis_delete(redis, "testredis.command.3", 0);
+
+    argv[0] = "MGET";
+    argv[1] = "testredis.command.1";
+    argv[2] = "testredis.command.2";
+    argv[3] = "testredis.command.3";
+    rv = apr_redis_command(redis, argv[1], 4, argv, NULL, pool, ba, 256, &v);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, '*', v->type);
+    ABTS_INT_EQUAL(tc, 3, v->elts->nelts);
+    ABTS_PTR_NOTNULL(tc, APR_ARRAY_IDX(v->elts, 0, apr_redis_value_t).bb);
+    ABTS_INT_EQUAL(tc, 100000,
+                   (int)APR_ARRAY_IDX(v->elts, 0, apr_redis_value_t).len);
+    ABTS_STR_EQUAL(tc, "two", APR_ARRAY_IDX(v->elts, 1, apr_redis_value_t).data);
+    ABTS_PTR_EQUAL(tc, NULL, APR_ARRAY_IDX(v->elts, 2, apr_redis_value_t).data);
+    ABTS_PTR_EQUAL(tc, NULL, APR_ARRAY_IDX(v->elts, 2, apr_redis_value_t).bb);
+
+    apr_redis_delete(redis, "testredis.command.h", 0);
+    argv[0] = "HSET";
+    argv[1] = "testredis.command.h";
+    argv[2] = "f1";
+    argv[3] = "v1";
+    argv[4] = "f2";
+    argv[5] = "v2";
+    rv = apr_redis_command(redis, argv[1], 6, argv, NULL, pool, ba, 256, &v);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, ':', v->type);
+    ABTS_INT_EQUAL(tc, 2, (int)v->integer);
+    argv[0] = "HGETALL";
+    rv = apr_redis_command(redis, argv[1], 2, argv, NULL, pool, ba, 256, &v);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_ASSERT(tc, "not an aggregate", v->type == '*' || v->type == '%');
+    ABTS_INT_EQUAL(tc, 4, v->elts->nelts);
+    apr_redis_delete(redis, "testredis.command.h", 0);
+
+    /* unknown command */
+    argv[0] = "NOSUCHCOMMAND";
+    rv = apr_redis_command(redis, argv[1], 1, argv, NULL, pool, ba, 256, &v);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, '-', v->type);
+
+    bb = apr_brigade_create(pool, ba);
+    rv = apr_redis_getb(redis, "testredis.command.1", bb, &len);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 100000, (int)len);
+    rv = apr_brigade_pflatten(bb, &result, &len, pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 100000, (int)len);
+    ABTS_ASSERT(tc, "wrong value", memcmp(result, big, len) == 0);
+
+    rv = apr_redis_getb(redis, "testredis.command.3", bb, &len);
+    ABTS_INT_EQUAL(tc, APR_NOTFOUND, rv);
+
+    apr_redis_delete(redis, "testredis.command.1", 0);
+    apr_redis_delete(redis, "testredis.command.2", 0);
+    apr_pool_destroy(pool);
+}
+
 abts_suite *testredis(abts_suite * suite)
 {
     suite = ADD_SUITE(suite);
 
     abts_run_test(suite, test_redis_create, NULL);
     abts_run_test(suite, test_redis_user_funcs, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_redis_consistent, &flag_ketama);
+    abts_run_test(suite, test_redis_consistent, &flag_jump);
+#endif
     abts_run_test(suite, test_redis_meta, NULL);
     abts_run_test(suite, test_redis_setget, NULL);
     abts_run_test(suite, test_redis_setexget, NULL);
-    /* abts_run_test(suite, test_redis_multiget, NULL); */
+    abts_run_test(suite, test_redis_multiget, NULL);
     abts_run_test(suite, test_redis_incrdecr, NULL);
+    abts_run_test(suite, test_redis_pipeline, NULL);
+    abts_run_test(suite, test_redis_near_cache, NULL);
+    abts_run_test(suite, test_redis_latency, NULL);
+    abts_run_test(suite, test_redis_metrics, NULL);
+    abts_run_test(suite, test_redis_prober, NULL);
+    abts_run_test(suite, test_redis_value_read, NULL);
+    abts_run_test(suite, test_redis_command, NULL);
 
     return suite;
 }
@@ -21,6 +21,7 @@
 #include "apu.h"
 #include "apr_reslist.h"
 #include "apr_thread_pool.h"
+#include "apr_atomic.h"
 
 #if APR_HAVE_TIME_H
 #include <time.h>
@@ -299,6 +300,222 @@ static void test_reslist_no_ttl(abts_case *tc, void *data)
     ABTS_INT_EQUAL(tc, params->d_count, 1);
 }
 
+static void test_reslist_affinity(abts_case *tc, void *data)
+{
+    int i;
+    apr_status_t rv;
+    apr_reslist_t *rl;
+    my_parameters_t *params;
+    apr_thread_pool_t *thrp;
+    my_thread_info_t thread_info[CONSUMER_THREADS];
+    my_resource_t *resources[RESLIST_HMAX];
+    void *vp;
+
+    params = apr_pcalloc(p, sizeof(*params));
+    params->sleep_upon_construct = CONSTRUCT_SLEEP_TIME;
+    params->sleep_upon_destruct = DESTRUCT_SLEEP_TIME;
+
+    rv = apr_reslist_create(&rl, RESLIST_MIN, RESLIST_SMAX, RESLIST_HMAX,
+                            RESLIST_TTL, my_constructor, my_destructor,
+                            params, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_reslist_affinity_set(rl, 2);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "apr_reslist_affinity_set");
+        apr_reslist_destroy(rl);
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, APR_EEXIST, apr_reslist_affinity_set(rl, 2));
+
+    /* released to the stash, then acquired from it */
+    rv = apr_reslist_acquire(rl, &vp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_reslist_release(rl, vp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 0, apr_reslist_acquired_count(rl));
+    rv = apr_reslist_acquire(rl, (void **)&resources[0]);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_PTR_EQUAL(tc, vp, resources[0]);
+    ABTS_INT_EQUAL(tc, 1, apr_reslist_acquired_count(rl));
+    rv = apr_reslist_release(rl, resources[0]);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* the stashes compete with the waiters on the hard maximum */
+    rv = apr_thread_pool_create(&thrp, CONSUMER_THREADS/2, CONSUMER_THREADS, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (i = 0; i < CONSUMER_THREADS; i++) {
+        thread_info[i].tid = i;
+        thread_info[i].tc = tc;
+        thread_info[i].reslist = rl;
+        thread_info[i].work_delay_sleep = WORK_DELAY_SLEEP_TIME;
+        thread_info[i].acquire_flags = APR_RESLIST_ACQUIRE_LIFO;
+        rv = apr_thread_pool_push(thrp, resource_consuming_thread,
+                                  &thread_info[i], 0, NULL);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    rv = apr_thread_pool_destroy(thrp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 0, apr_reslist_acquired_count(rl));
+
+    /* the stashed resources are found when the maximum is met */
+    test_timeout(tc, rl, APR_RESLIST_ACQUIRE_LIFO);
+
+    /* batches are all or nothing */
+    rv = apr_reslist_acquire_batch(rl, (void **)resources, RESLIST_HMAX, 0);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, RESLIST_HMAX, apr_reslist_acquired_count(rl));
+    for (i = 1; i < RESLIST_HMAX; i++) {
+        rv = apr_reslist_release(rl, resources[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    rv = apr_reslist_acquire_batch(rl, (void **)&resources[1], RESLIST_HMAX,
+                                   0);
+    ABTS_TRUE(tc, APR_STATUS_IS_TIMEUP(rv));
+    ABTS_INT_EQUAL(tc, 1, apr_reslist_acquired_count(rl));
+    rv = apr_reslist_acquire_batch(rl, (void **)&resources[1], RESLIST_HMAX,
+                                   APR_RESLIST_ACQUIRE_FIFO);
+    ABTS_TRUE(tc, APR_STATUS_IS_TIMEUP(rv));
+    rv = apr_reslist_acquire_batch(rl, (void **)&resources[1],
+                                   RESLIST_HMAX - 1, 0);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (i = 0; i < RESLIST_HMAX; i++) {
+        rv = apr_reslist_release(rl, resources[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    ABTS_INT_EQUAL(tc, APR_EINVAL,
+                   apr_reslist_acquire_batch(rl, (void **)resources,
+                                             RESLIST_HMAX + 1, 0));
+
+    /* the stashed resources are destroyed with the others */
+    rv = apr_reslist_destroy(rl);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, params->c_count, params->d_count);
+}
+
+/* Constructed by the replenisher, without the reslist's lock */
+typedef struct {
+    volatile apr_uint32_t c_count;
+    volatile apr_uint32_t d_count;
+    volatile apr_uint32_t fail;
+} my_async_parameters_t;
+
+static apr_status_t my_async_constructor(void **resource, void *params,
+                                         apr_pool_t *pool)
+{
+    my_resource_t *res;
+    my_async_parameters_t *my_params = params;
+
+    apr_sleep(CONSTRUCT_SLEEP_TIME);
+    if (apr_atomic_read32(&my_params->fail)) {
+        return APR_EGENERAL;
+    }
+
+    res = malloc(sizeof(*res));
+    res->id = apr_atomic_inc32(&my_params->c_count);
+    *resource = res;
+    return APR_SUCCESS;
+}
+
+static apr_status_t my_async_destructor(void *resource, void *params,
+                                        apr_pool_t *pool)
+{
+    my_async_parameters_t *my_params = params;
+
+    apr_atomic_inc32(&my_params->d_count);
+    free(resource);
+    return APR_SUCCESS;
+}
+
+static void test_reslist_replenish(abts_case *tc, void *data)
+{
+    int i;
+    apr_status_t rv;
+    apr_reslist_t *rl;
+    my_async_parameters_t *params;
+    apr_thread_pool_t *thrp;
+    my_thread_info_t thread_info[CONSUMER_THREADS];
+    void *resources[RESLIST_HMAX];
+    void *vp;
+
+    params = apr_pcalloc(p, sizeof(*params));
+
+    rv = apr_reslist_create(&rl, RESLIST_MIN, RESLIST_SMAX, RESLIST_HMAX,
+                            0, my_async_constructor, my_async_destructor,
+                            params, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, RESLIST_MIN, apr_atomic_read32(&params->c_count));
+
+    rv = apr_reslist_replenish_start(rl, apr_time_from_msec(10));
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, APR_EEXIST,
+                   apr_reslist_replenish_start(rl, apr_time_from_msec(10)));
+    apr_reslist_timeout_set(rl, apr_time_from_sec(5));
+
+    /* the minimum is restored in the background */
+    for (i = 0; i < RESLIST_MIN; i++) {
+        rv = apr_reslist_acquire(rl, &resources[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < 100; i++) {
+        if (apr_atomic_read32(&params->c_count) >= 2 * RESLIST_MIN) {
+            break;
+        }
+        apr_sleep(apr_time_from_msec(10));
+    }
+    ABTS_INT_EQUAL(tc, 2 * RESLIST_MIN, apr_atomic_read32(&params->c_count));
+
+    /* and the waiters get the resources constructed for them */
+    for (i = RESLIST_MIN; i < RESLIST_HMAX; i++) {
+        rv = apr_reslist_acquire(rl, &resources[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    ABTS_INT_EQUAL(tc, RESLIST_HMAX, apr_reslist_acquired_count(rl));
+    for (i = 0; i < RESLIST_HMAX; i++) {
+        rv = apr_reslist_release(rl, resources[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+
+    rv = apr_thread_pool_create(&thrp, CONSUMER_THREADS/2, CONSUMER_THREADS, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (i = 0; i < CONSUMER_THREADS; i++) {
+        thread_info[i].tid = i;
+        thread_info[i].tc = tc;
+        thread_info[i].reslist = rl;
+        thread_info[i].work_delay_sleep = WORK_DELAY_SLEEP_TIME;
+        thread_info[i].acquire_flags = APR_RESLIST_ACQUIRE_LIFO;
+        rv = apr_thread_pool_push(thrp, resource_consuming_thread,
+                                  &thread_info[i], 0, NULL);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    rv = apr_thread_pool_destroy(thrp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 0, apr_reslist_acquired_count(rl));
+
+    /* the waiters fail with the constructor */
+    rv = apr_reslist_acquire_batch(rl, resources, RESLIST_HMAX, 0);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_atomic_set32(&params->fail, 1);
+    for (i = 0; i < RESLIST_HMAX; i++) {
+        rv = apr_reslist_invalidate(rl, resources[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    rv = apr_reslist_acquire(rl, &vp);
+    ABTS_INT_EQUAL(tc, APR_EGENERAL, rv);
+    apr_atomic_set32(&params->fail, 0);
+    rv = apr_reslist_acquire(rl, &vp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_reslist_release(rl, vp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* stops the replenisher */
+    rv = apr_reslist_destroy(rl);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, apr_atomic_read32(&params->c_count),
+                   apr_atomic_read32(&params->d_count));
+}
+
 #endif /* APR_HAS_THREADS */
 
 abts_suite *testreslist(abts_suite *suite)
@@ -311,6 +528,8 @@ abts_suite *testreslist(abts_suite *suite)
     abts_run_test(suite, test_reslist,
                   (void*)(apr_uintptr_t)APR_RESLIST_ACQUIRE_FIFO);
     abts_run_test(suite, test_reslist_no_ttl, NULL);
+    abts_run_test(suite, test_reslist_affinity, NULL);
+    abts_run_test(suite, test_reslist_replenish, NULL);
 #endif
 
     return suite;
@@ -0,0 +1,169 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr_strings.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_network_io.h"
+#include "apr_poll.h"
+#include "apr_resolver.h"
+
+#define TIMEOUT apr_time_from_sec(5)
+
+typedef struct {
+    int called;
+    apr_status_t status;
+    apr_port_t port;
+    char ip[64];
+} result_t;
+
+static void resolved(void *baton, apr_status_t status, apr_sockaddr_t *sa)
+{
+    result_t *res = baton;
+
+    res->called++;
+    res->status = status;
+    if (sa) {
+        res->port = sa->port;
+        apr_sockaddr_ip_getbuf(res->ip, sizeof(res->ip), sa);
+    }
+}
+
+static void lookup_cached(abts_case *tc, void *data)
+{
+    apr_resolver_t *resolver;
+    apr_sockaddr_t *sa;
+    char ip[64];
+    apr_status_t rv;
+
+    rv = apr_resolver_create(&resolver, 0, apr_time_from_sec(60),
+                             apr_time_from_sec(1), 0, p);
+    APR_ASSERT_SUCCESS(tc, "Could not create resolver", rv);
+
+    rv = apr_resolver_lookup(&sa, resolver, "127.0.0.1", APR_INET, 8080, 0,
+                             p);
+    APR_ASSERT_SUCCESS(tc, "Could not look up 127.0.0.1", rv);
+    ABTS_INT_EQUAL(tc, 8080, sa->port);
+    apr_sockaddr_ip_getbuf(ip, sizeof(ip), sa);
+    ABTS_STR_EQUAL(tc, "127.0.0.1", ip);
+
+    /* From the cache, with another port */
+    rv = apr_resolver_lookup(&sa, resolver, "127.0.0.1", APR_INET, 80, 0, p);
+    APR_ASSERT_SUCCESS(tc, "Could not look up 127.0.0.1 again", rv);
+    ABTS_INT_EQUAL(tc, 80, sa->port);
+    apr_sockaddr_ip_getbuf(ip, sizeof(ip), sa);
+    ABTS_STR_EQUAL(tc, "127.0.0.1", ip);
+
+    apr_resolver_clear(resolver);
+    rv = apr_resolver_lookup(&sa, resolver, "127.0.0.1", APR_INET, 81, 0, p);
+    APR_ASSERT_SUCCESS(tc, "Could not look up 127.0.0.1 after clear", rv);
+    ABTS_INT_EQUAL(tc, 81, sa->port);
+}
+
+static void resolve_inline(abts_case *tc, void *data)
+{
+    apr_resolver_t *resolver;
+    result_t res = {0};
+    apr_int32_t num;
+    apr_status_t rv;
+
+    rv = apr_resolver_create(&resolver, 0, apr_time_from_sec(60),
+                             apr_time_from_sec(1), 0, p);
+    APR_ASSERT_SUCCESS(tc, "Could not create resolver", rv);
+
+    rv = apr_resolver_resolve(resolver, "127.0.0.1", APR_INET, 8021, 0,
+                              resolved, &res, p);
+    APR_ASSERT_SUCCESS(tc, "Could not resolve 127.0.0.1", rv);
+    /* Not called before apr_resolver_process() */
+    ABTS_INT_EQUAL(tc, 0, res.called);
+
+    rv = apr_resolver_process(resolver, &num);
+    APR_ASSERT_SUCCESS(tc, "Could not process", rv);
+    ABTS_INT_EQUAL(tc, 1, num);
+    ABTS_INT_EQUAL(tc, 1, res.called);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, res.status);
+    ABTS_INT_EQUAL(tc, 8021, res.port);
+    ABTS_STR_EQUAL(tc, "127.0.0.1", res.ip);
+
+    rv = apr_resolver_process(resolver, &num);
+    APR_ASSERT_SUCCESS(tc, "Could not process", rv);
+    ABTS_INT_EQUAL(tc, 0, num);
+}
+
+static void resolve_threads(abts_case *tc, void *data)
+{
+    apr_resolver_t *resolver;
+    apr_pollset_t *pollset;
+    const apr_pollfd_t *pfd, *descs;
+    result_t res[3] = {{0}};
+    apr_int32_t num, total = 0;
+    apr_status_t rv;
+    int i;
+
+    rv = apr_resolver_create(&resolver, 2, apr_time_from_sec(60),
+                             apr_time_from_sec(1), 0, p);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "resolver threads not supported");
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "Could not create resolver", rv);
+
+    rv = apr_pollset_create(&pollset, 1, p, 0);
+    APR_ASSERT_SUCCESS(tc, "Could not create pollset", rv);
+    rv = apr_resolver_pollfd_get(&pfd, resolver);
+    APR_ASSERT_SUCCESS(tc, "Could not get resolver descriptor", rv);
+    ABTS_PTR_EQUAL(tc, resolver, pfd->client_data);
+    rv = apr_pollset_add(pollset, pfd);
+    APR_ASSERT_SUCCESS(tc, "Could not add resolver descriptor", rv);
+
+    /* The first two share a resolution */
+    for (i = 0; i < 3; i++) {
+        rv = apr_resolver_resolve(resolver, i < 2 ? "127.0.0.1" : "127.0.0.2",
+                                  APR_INET, 8000 + i, 0, resolved, &res[i], p);
+        APR_ASSERT_SUCCESS(tc, "Could not resolve", rv);
+    }
+
+    while (total < 3) {
+        rv = apr_pollset_poll(pollset, TIMEOUT, &num, &descs);
+        APR_ASSERT_SUCCESS(tc, "Resolutions not completed", rv);
+        if (rv != APR_SUCCESS) {
+            return;
+        }
+        rv = apr_resolver_process(resolver, &num);
+        APR_ASSERT_SUCCESS(tc, "Could not process", rv);
+        total += num;
+    }
+    ABTS_INT_EQUAL(tc, 3, total);
+
+    for (i = 0; i < 3; i++) {
+        ABTS_INT_EQUAL(tc, 1, res[i].called);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, res[i].status);
+        ABTS_INT_EQUAL(tc, 8000 + i, res[i].port);
+        ABTS_STR_EQUAL(tc, i < 2 ? "127.0.0.1" : "127.0.0.2", res[i].ip);
+    }
+}
+
+abts_suite *testresolver(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+    abts_run_test(suite, lookup_cached, NULL);
+    abts_run_test(suite, resolve_inline, NULL);
+    abts_run_test(suite, resolve_threads, NULL);
+
+    return suite;
+}
@@ -21,6 +21,7 @@
 #include "apr_lib.h"
 #include "apr_strings.h"
 #include "apr_time.h"
+#include "apr_thread_proc.h"
 #include "abts.h"
 #include "testutil.h"
 
@@ -177,6 +178,221 @@ static void test_rmm(abts_case *tc, void *data)
     apr_pool_destroy(pool);
 }
 
+static void test_rmm_free_lists(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_pool_t *pool;
+    apr_shm_t *shm;
+    apr_rmm_t *rmm, *rmm2;
+    apr_size_t size;
+    apr_rmm_off_t off[64], big;
+    int i;
+
+    rv = apr_pool_create(&pool, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    size = 64 * 1024 + apr_rmm_overhead_get(65);
+    rv = apr_shm_create(&shm, size, NULL, pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    if (rv != APR_SUCCESS)
+        return;
+
+    /* Not initialized yet */
+    memset(apr_shm_baseaddr_get(shm), 0, size);
+    rv = apr_rmm_attach(&rmm2, NULL, apr_shm_baseaddr_get(shm), pool);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    rv = apr_rmm_init(&rmm, NULL, apr_shm_baseaddr_get(shm), size, pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    if (rv != APR_SUCCESS)
+        return;
+
+    rv = apr_rmm_attach(&rmm2, NULL, apr_shm_baseaddr_get(shm), pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* Blocks of all sizes, freed every other one, then the rest */
+    for (i = 0; i < 64; i++) {
+        off[i] = apr_rmm_malloc(rmm, (i % 8 + 1) * 100);
+        ABTS_TRUE(tc, off[i] != 0);
+    }
+    for (i = 0; i < 64; i += 2) {
+        rv = apr_rmm_free(rmm2, off[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+
+    /* Double and bogus frees are refused */
+    rv = apr_rmm_free(rmm, off[0]);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+    rv = apr_rmm_free(rmm, off[1] + 8);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+    rv = apr_rmm_free(rmm, size + 8);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    /* The holes are reused */
+    off[0] = apr_rmm_malloc(rmm, 100);
+    ABTS_TRUE(tc, off[0] != 0 && off[0] < off[63]);
+
+    for (i = 0; i < 64; i++) {
+        if (i % 2 == 0 && i) {
+            continue;
+        }
+        rv = apr_rmm_free(rmm, off[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+
+    /* Everything merged back into one block */
+    big = apr_rmm_malloc(rmm, 64 * 1024);
+    ABTS_TRUE(tc, big != 0);
+    rv = apr_rmm_free(rmm, big);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_rmm_destroy(rmm);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_rmm_attach(&rmm2, NULL, apr_shm_baseaddr_get(shm), pool);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    rv = apr_shm_destroy(shm);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    apr_pool_destroy(pool);
+}
+
+#if APR_HAS_THREADS
+
+#define ARENA_COUNT 4
+#define ARENA_THREADS 8
+#define ARENA_LOOPS 20000
+
+static void * APR_THREAD_FUNC thread_rmm(apr_thread_t *thd, void *data)
+{
+    apr_rmm_t *rmm = data;
+    apr_rmm_off_t off[32] = { 0 };
+    apr_size_t size[32];
+    unsigned int seed = (unsigned int)(apr_uintptr_t)thd;
+    apr_status_t rv = APR_SUCCESS;
+    int i, j, k;
+
+    for (i = 0; i < ARENA_LOOPS && rv == APR_SUCCESS; i++) {
+        seed = seed * 1103515245 + 12345;
+        k = (seed >> 16) % 32;
+        if (off[k]) {
+            unsigned char *c = apr_rmm_addr_get(rmm, off[k]);
+
+            for (j = 0; j < (int)size[k]; j++) {
+                if (c[j] != (unsigned char)k) {
+                    rv = APR_EGENERAL;
+                }
+            }
+            if (apr_rmm_free(rmm, off[k]) != APR_SUCCESS) {
+                rv = APR_EGENERAL;
+            }
+            off[k] = 0;
+        }
+        else {
+            size[k] = (seed >> 8) % 600;
+            off[k] = apr_rmm_malloc(rmm, size[k]);
+            if (off[k]) {
+                memset(apr_rmm_addr_get(rmm, off[k]), k, size[k]);
+            }
+        }
+    }
+    for (k = 0; k < 32; k++) {
+        if (off[k]) {
+            apr_rmm_free(rmm, off[k]);
+        }
+    }
+    apr_thread_exit(thd, rv);
+    return NULL;
+}
+
+static void test_rmm_arenas(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_pool_t *pool;
+    apr_shm_t *shm;
+    apr_rmm_t *rmm, *rmm2;
+    apr_anylock_t locks[ARENA_COUNT];
+    apr_thread_t *t[ARENA_THREADS];
+    apr_size_t size = 1024 * 1024;
+    apr_rmm_off_t off, big[ARENA_COUNT];
+    int i;
+
+    rv = apr_pool_create(&pool, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_shm_create(&shm, size, NULL, pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    if (rv != APR_SUCCESS)
+        return;
+
+    for (i = 0; i < ARENA_COUNT; i++) {
+        locks[i].type = apr_anylock_threadmutex;
+        rv = apr_thread_mutex_create(&locks[i].lock.tm,
+                                     APR_THREAD_MUTEX_DEFAULT, pool);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+
+    rv = apr_rmm_init_ex(&rmm, locks, ARENA_COUNT, apr_shm_baseaddr_get(shm),
+                         size, APR_RMM_CACHE, pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    if (rv != APR_SUCCESS)
+        return;
+
+    rv = apr_rmm_attach_ex(&rmm2, locks, ARENA_COUNT - 1,
+                           apr_shm_baseaddr_get(shm), 0, pool);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+    rv = apr_rmm_attach(&rmm2, NULL, apr_shm_baseaddr_get(shm), pool);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    /* Freed small blocks come back from the cache */
+    off = apr_rmm_malloc(rmm, 64);
+    ABTS_TRUE(tc, off != 0);
+    rv = apr_rmm_free(rmm, off);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_rmm_free(rmm, off);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+    ABTS_TRUE(tc, apr_rmm_malloc(rmm, 60) == off);
+    rv = apr_rmm_free(rmm, off);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    for (i = 0; i < ARENA_THREADS; i++) {
+        rv = apr_thread_create(&t[i], NULL, thread_rmm, rmm, pool);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < ARENA_THREADS; i++) {
+        apr_status_t retval;
+
+        apr_thread_join(&retval, t[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, retval);
+    }
+
+    /* Once the cache is flushed, each arena is whole again */
+    rv = apr_rmm_cache_flush(rmm);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (i = 0; i < ARENA_COUNT; i++) {
+        big[i] = apr_rmm_malloc(rmm, size / ARENA_COUNT - 16 * 1024);
+        ABTS_TRUE(tc, big[i] != 0);
+    }
+    ABTS_TRUE(tc, apr_rmm_malloc(rmm, 32 * 1024) == 0);
+    for (i = 0; i < ARENA_COUNT; i++) {
+        rv = apr_rmm_free(rmm, big[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+
+    rv = apr_rmm_detach(rmm);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_rmm_destroy(rmm);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_shm_destroy(shm);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    apr_pool_destroy(pool);
+}
+
+#endif /* APR_HAS_THREADS */
+
 #endif /* APR_HAS_SHARED_MEMORY */
 
 abts_suite *testrmm(abts_suite *suite)
@@ -185,6 +401,10 @@ abts_suite *testrmm(abts_suite *suite)
 
 #if APR_HAS_SHARED_MEMORY
     abts_run_test(suite, test_rmm, NULL);
+    abts_run_test(suite, test_rmm_free_lists, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_rmm_arenas, NULL);
+#endif
 #endif
 
     return suite;
@@ -0,0 +1,172 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include "apr_sha1.h"
+#include "apr_random.h"
+#include "apr_general.h"
+
+#include "abts.h"
+#include "testutil.h"
+
+static struct {
+    const char *string;
+    const char *sha1;
+    const char *sha256;
+} shasums[] =
+{
+    {"",
+     "\xda\x39\xa3\xee\x5e\x6b\x4b\x0d\x32\x55\xbf\xef\x95\x60\x18\x90"
+     "\xaf\xd8\x07\x09",
+     "\xe3\xb0\xc4\x42\x98\xfc\x1c\x14\x9a\xfb\xf4\xc8\x99\x6f\xb9\x24"
+     "\x27\xae\x41\xe4\x64\x9b\x93\x4c\xa4\x95\x99\x1b\x78\x52\xb8\x55"},
+    {"abc",
+     "\xa9\x99\x3e\x36\x47\x06\x81\x6a\xba\x3e\x25\x71\x78\x50\xc2\x6c"
+     "\x9c\xd0\xd8\x9d",
+     "\xba\x78\x16\xbf\x8f\x01\xcf\xea\x41\x41\x40\xde\x5d\xae\x22\x23"
+     "\xb0\x03\x61\xa3\x96\x17\x7a\x9c\xb4\x10\xff\x61\xf2\x00\x15\xad"},
+    /* 56 bytes, the padding spills into a second block */
+    {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+     "\x84\x98\x3e\x44\x1c\x3b\xd2\x6e\xba\xae\x4a\xa1\xf9\x51\x29\xe5"
+     "\xe5\x46\x70\xf1",
+     "\x24\x8d\x6a\x61\xd2\x06\x38\xb8\xe5\xc0\x26\x93\x0c\x3e\x60\x39"
+     "\xa3\x3c\xe4\x59\x64\xff\x21\x67\xf6\xec\xed\xd4\x19\xdb\x06\xc1"}
+};
+
+static int num_sums = sizeof(shasums) / sizeof(shasums[0]);
+
+static void test_sha1(abts_case *tc, void *data)
+{
+    apr_sha1_ctx_t context;
+    unsigned char digest[APR_SHA1_DIGESTSIZE];
+    int i;
+
+    for (i = 0; i < num_sums; i++) {
+        apr_sha1_init(&context);
+        apr_sha1_update_binary(&context,
+                               (const unsigned char *)shasums[i].string,
+                               (unsigned int)strlen(shasums[i].string));
+        apr_sha1_final(digest, &context);
+        ABTS_ASSERT(tc, "check for correct sha1 digest",
+                    memcmp(digest, shasums[i].sha1, sizeof(digest)) == 0);
+    }
+}
+
+/* One million 'a's, fed in pieces that straddle the block boundaries */
+static void test_sha1_long(abts_case *tc, void *data)
+{
+    apr_sha1_ctx_t context;
+    unsigned char digest[APR_SHA1_DIGESTSIZE];
+    unsigned char a[1000];
+    int i;
+
+    memset(a, 'a', sizeof(a));
+    apr_sha1_init(&context);
+    for (i = 0; i < 1000; i++) {
+        apr_sha1_update_binary(&context, a, 1 + i % 100);
+        apr_sha1_update_binary(&context, a, 999 - i % 100);
+    }
+    apr_sha1_final(digest, &context);
+    ABTS_ASSERT(tc, "check for correct sha1 digest of 1000000 'a's",
+                memcmp(digest, "\x34\xaa\x97\x3c\xd4\xc4\xda\xa4\xf6\x1e"
+                               "\xeb\x2b\xdb\xad\x27\x31\x65\x34\x01\x6f",
+                       sizeof(digest)) == 0);
+}
+
+static void test_sha1_multi(abts_case *tc, void *data)
+{
+    unsigned char digests[9][APR_SHA1_DIGESTSIZE];
+    unsigned char expect[APR_SHA1_DIGESTSIZE];
+    const unsigned char *inputs[9];
+    apr_size_t lens[9];
+    unsigned char *buf;
+    int n, i;
+
+    /* messages of lengths around the block and padding boundaries */
+    buf = apr_palloc(p, 300);
+    for (i = 0; i < 300; i++) {
+        buf[i] = (unsigned char)(i * 7 + 1);
+    }
+    for (i = 0; i < 9; i++) {
+        static const apr_size_t sizes[9] = {0, 1, 55, 56, 63, 64, 65, 130, 300};
+        inputs[i] = buf + 300 - sizes[i];
+        lens[i] = sizes[i];
+    }
+
+    for (n = 0; n <= 9; n++) {
+        memset(digests, 0, sizeof(digests));
+        apr_sha1_multi(digests, inputs, lens, n);
+        for (i = 0; i < 9; i++) {
+            apr_sha1_ctx_t context;
+
+            apr_sha1_init(&context);
+            apr_sha1_update_binary(&context, inputs[i], (unsigned int)lens[i]);
+            apr_sha1_final(expect, &context);
+            if (i < n) {
+                ABTS_ASSERT(tc, "apr_sha1_multi digest differs",
+                            memcmp(digests[i], expect, sizeof(expect)) == 0);
+            }
+            else {
+                ABTS_ASSERT(tc, "apr_sha1_multi wrote past n",
+                            memcmp(digests[i], "\0\0\0\0\0\0\0\0\0\0"
+                                               "\0\0\0\0\0\0\0\0\0\0",
+                                   sizeof(expect)) == 0);
+            }
+        }
+    }
+}
+
+static void test_sha256(abts_case *tc, void *data)
+{
+    apr_crypto_hash_t *h = apr_crypto_sha256_new(p);
+    unsigned char digest[32];
+    unsigned char a[1000];
+    int i;
+
+    for (i = 0; i < num_sums; i++) {
+        h->init(h);
+        h->add(h, shasums[i].string, strlen(shasums[i].string));
+        h->finish(h, digest);
+        ABTS_ASSERT(tc, "check for correct sha256 digest",
+                    memcmp(digest, shasums[i].sha256, sizeof(digest)) == 0);
+    }
+
+    memset(a, 'a', sizeof(a));
+    h->init(h);
+    for (i = 0; i < 1000; i++) {
+        h->add(h, a, 1 + i % 100);
+        h->add(h, a, 999 - i % 100);
+    }
+    h->finish(h, digest);
+    ABTS_ASSERT(tc, "check for correct sha256 digest of 1000000 'a's",
+                memcmp(digest, "\xcd\xc7\x6e\x5c\x99\x14\xfb\x92\x81\xa1"
+                               "\xc7\xe2\x84\xd7\x3e\x67\xf1\x80\x9a\x48"
+                               "\xa4\x97\x20\x0e\x04\x6d\x39\xcc\xc7\x11"
+                               "\x2c\xd0", sizeof(digest)) == 0);
+}
+
+abts_suite *testsha(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite);
+
+    abts_run_test(suite, test_sha1, NULL);
+    abts_run_test(suite, test_sha1_long, NULL);
+    abts_run_test(suite, test_sha1_multi, NULL);
+    abts_run_test(suite, test_sha256, NULL);
+
+    return suite;
+}
@@ -78,6 +78,51 @@ static void test_shm_allocate(abts_case *tc, void *data)
     APR_ASSERT_SUCCESS(tc, "Error destroying shared memory block", rv);
 }
 
+static void test_tuned(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_shm_t *shm = NULL, *shm2 = NULL;
+    const char *name = "data/apr.testshm.tuned";
+    apr_int32_t flags = APR_SHM_HUGE_PAGES | APR_SHM_POPULATE
+                        | APR_SHM_NUMA_INTERLEAVE;
+    char *mem;
+
+    /* The tuning flags fall back quietly where they can't be honoured */
+    rv = apr_shm_create_ex(&shm, SHARED_SIZE, NULL, p, flags);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_SKIP(tc, data, "anonymous shared memory not available");
+    }
+    else {
+        APR_ASSERT_SUCCESS(tc, "Error allocating tuned memory block", rv);
+        ABTS_SIZE_EQUAL(tc, SHARED_SIZE, apr_shm_size_get(shm));
+        mem = apr_shm_baseaddr_get(shm);
+        memset(mem, 'x', SHARED_SIZE);
+        ABTS_INT_EQUAL(tc, 'x', mem[SHARED_SIZE - 1]);
+        rv = apr_shm_destroy(shm);
+        APR_ASSERT_SUCCESS(tc, "Error destroying tuned memory block", rv);
+    }
+
+    apr_shm_remove(name, p);
+    rv = apr_shm_create_ex(&shm, SHARED_SIZE, name, p, flags);
+    if (rv == APR_ENOTIMPL) {
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "Error allocating tuned named block", rv);
+    mem = apr_shm_baseaddr_get(shm);
+    memset(mem, 'y', SHARED_SIZE);
+
+    rv = apr_shm_attach_ex(&shm2, name, p, APR_SHM_POPULATE);
+    APR_ASSERT_SUCCESS(tc, "Error attaching to tuned named block", rv);
+    mem = apr_shm_baseaddr_get(shm2);
+    ABTS_INT_EQUAL(tc, 'y', mem[0]);
+    ABTS_INT_EQUAL(tc, 'y', mem[SHARED_SIZE - 1]);
+
+    rv = apr_shm_detach(shm2);
+    APR_ASSERT_SUCCESS(tc, "Error detaching from tuned named block", rv);
+    rv = apr_shm_destroy(shm);
+    APR_ASSERT_SUCCESS(tc, "Error destroying tuned named block", rv);
+}
+
 #if APR_HAS_FORK
 static void test_anon(abts_case *tc, void *data)
 {
@@ -295,6 +340,7 @@ abts_suite *testshm(abts_suite *suite)
     abts_run_test(suite, test_anon_create, NULL);
     abts_run_test(suite, test_check_size, NULL);
     abts_run_test(suite, test_shm_allocate, NULL);
+    abts_run_test(suite, test_tuned, NULL);
 #if APR_HAS_FORK
     abts_run_test(suite, test_anon, NULL);
 #endif
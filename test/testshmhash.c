@@ -0,0 +1,325 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr.h"
+#include "apr_strings.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_shm.h"
+#include "apr_shm_hash.h"
+#include "apr_thread_proc.h"
+
+#define KEY_SIZE 16
+#define VAL_SIZE 32
+
+static apr_shm_hash_t *make_table(abts_case *tc, apr_uint32_t capacity,
+                                  apr_uint32_t flags, void **mem,
+                                  apr_size_t *size)
+{
+    apr_shm_hash_t *ht;
+    apr_status_t rv;
+
+    *size = apr_shm_hash_size_get(capacity, KEY_SIZE, VAL_SIZE);
+    *mem = apr_palloc(p, *size);
+
+    rv = apr_shm_hash_create(&ht, *mem, *size, capacity, KEY_SIZE, VAL_SIZE,
+                             flags, p);
+    APR_ASSERT_SUCCESS(tc, "create table", rv);
+    return ht;
+}
+
+static void shmhash_set_get(abts_case *tc, void *data)
+{
+    apr_shm_hash_t *ht, *ht2;
+    char val[VAL_SIZE], big[KEY_SIZE + 1];
+    apr_size_t size, vlen;
+    void *mem, *copy;
+    apr_status_t rv;
+
+    ht = make_table(tc, 64, 0, &mem, &size);
+
+    rv = apr_shm_hash_get(ht, "key", 3, val, &vlen);
+    ABTS_INT_EQUAL(tc, APR_NOTFOUND, rv);
+
+    APR_ASSERT_SUCCESS(tc, "set", apr_shm_hash_set(ht, "key", 3, "value", 5));
+    rv = apr_shm_hash_get(ht, "key", 3, val, &vlen);
+    APR_ASSERT_SUCCESS(tc, "get", rv);
+    ABTS_SIZE_EQUAL(tc, 5, vlen);
+    ABTS_TRUE(tc, memcmp(val, "value", 5) == 0);
+    ABTS_INT_EQUAL(tc, 1, apr_shm_hash_count(ht));
+
+    /* Replaced */
+    APR_ASSERT_SUCCESS(tc, "replace",
+                       apr_shm_hash_set(ht, "key", 3, "other value", 11));
+    rv = apr_shm_hash_get(ht, "key", 3, val, &vlen);
+    APR_ASSERT_SUCCESS(tc, "get replaced", rv);
+    ABTS_SIZE_EQUAL(tc, 11, vlen);
+    ABTS_TRUE(tc, memcmp(val, "other value", 11) == 0);
+    ABTS_INT_EQUAL(tc, 1, apr_shm_hash_count(ht));
+
+    /* Too long */
+    memset(big, 'x', sizeof(big));
+    rv = apr_shm_hash_set(ht, big, sizeof(big), "value", 5);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+    rv = apr_shm_hash_set(ht, "key", 3, big, VAL_SIZE + 1);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    /* Relocated */
+    copy = apr_pmemdup(p, mem, size);
+    memset(mem, 0, size);
+    rv = apr_shm_hash_attach(&ht2, mem, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+    rv = apr_shm_hash_attach(&ht2, copy, p);
+    APR_ASSERT_SUCCESS(tc, "attach", rv);
+    rv = apr_shm_hash_get(ht2, "key", 3, val, NULL);
+    APR_ASSERT_SUCCESS(tc, "get relocated", rv);
+    ABTS_TRUE(tc, memcmp(val, "other value", 11) == 0);
+
+    APR_ASSERT_SUCCESS(tc, "remove", apr_shm_hash_remove(ht2, "key", 3));
+    rv = apr_shm_hash_remove(ht2, "key", 3);
+    ABTS_INT_EQUAL(tc, APR_NOTFOUND, rv);
+    rv = apr_shm_hash_get(ht2, "key", 3, val, NULL);
+    ABTS_INT_EQUAL(tc, APR_NOTFOUND, rv);
+    ABTS_INT_EQUAL(tc, 0, apr_shm_hash_count(ht2));
+}
+
+static void shmhash_full(abts_case *tc, void *data)
+{
+    apr_shm_hash_t *ht;
+    apr_size_t size;
+    void *mem;
+    char key[KEY_SIZE], val[VAL_SIZE];
+    apr_status_t rv;
+    int i;
+
+    ht = make_table(tc, 16, 0, &mem, &size);
+    for (i = 0; i < 16; i++) {
+        apr_snprintf(key, sizeof(key), "key%d", i);
+        rv = apr_shm_hash_set(ht, key, strlen(key), &i, sizeof(i));
+        APR_ASSERT_SUCCESS(tc, "fill", rv);
+    }
+    ABTS_INT_EQUAL(tc, 16, apr_shm_hash_count(ht));
+
+    rv = apr_shm_hash_set(ht, "more", 4, "value", 5);
+    ABTS_INT_EQUAL(tc, APR_ENOSPC, rv);
+
+    /* Existing keys can still be replaced, and removed ones reused */
+    rv = apr_shm_hash_set(ht, "key3", 4, "value", 5);
+    APR_ASSERT_SUCCESS(tc, "replace when full", rv);
+    APR_ASSERT_SUCCESS(tc, "remove", apr_shm_hash_remove(ht, "key7", 4));
+    rv = apr_shm_hash_set(ht, "more", 4, "value", 5);
+    APR_ASSERT_SUCCESS(tc, "reuse", rv);
+
+    for (i = 0; i < 16; i++) {
+        apr_snprintf(key, sizeof(key), "key%d", i);
+        rv = apr_shm_hash_get(ht, key, strlen(key), val, NULL);
+        ABTS_INT_EQUAL(tc, i == 7 ? APR_NOTFOUND : APR_SUCCESS, rv);
+        if (rv == APR_SUCCESS && i != 3) {
+            ABTS_TRUE(tc, memcmp(val, &i, sizeof(i)) == 0);
+        }
+    }
+}
+
+static void shmhash_evict(abts_case *tc, void *data)
+{
+    apr_shm_hash_t *ht;
+    apr_size_t size;
+    void *mem;
+    char key[KEY_SIZE], val[VAL_SIZE];
+    apr_status_t rv;
+    int i;
+
+    ht = make_table(tc, 64, APR_SHM_HASH_EVICT, &mem, &size);
+    for (i = 0; i < 1000; i++) {
+        apr_snprintf(key, sizeof(key), "key%d", i);
+        rv = apr_shm_hash_set(ht, key, strlen(key), &i, sizeof(i));
+        APR_ASSERT_SUCCESS(tc, "set with eviction", rv);
+
+        /* A key looked up all along stays */
+        rv = apr_shm_hash_get(ht, "key0", 4, val, NULL);
+        APR_ASSERT_SUCCESS(tc, "get hot key", rv);
+    }
+    ABTS_TRUE(tc, apr_shm_hash_count(ht) <= 64);
+
+    rv = apr_shm_hash_get(ht, "key999", 6, val, NULL);
+    APR_ASSERT_SUCCESS(tc, "get last key", rv);
+}
+
+#if APR_HAS_THREADS
+
+#define THREAD_KEYS 256
+#define THREAD_LOOPS 20000
+
+static apr_shm_hash_t *thread_ht;
+
+/* The value of a key is its number, repeated all along */
+static void make_val(char *val, int n, int gen)
+{
+    int i;
+
+    for (i = 0; i < VAL_SIZE / (int)sizeof(int); i++) {
+        ((int *)val)[i] = (i & 1) ? gen : n;
+    }
+}
+
+static void * APR_THREAD_FUNC thread_writer(apr_thread_t *thd, void *data)
+{
+    char key[KEY_SIZE], val[VAL_SIZE];
+    apr_status_t rv = APR_SUCCESS;
+    int i;
+
+    for (i = 0; i < THREAD_LOOPS && rv == APR_SUCCESS; i++) {
+        int n = (i * 7 + (int)(apr_uintptr_t)data) % THREAD_KEYS;
+
+        apr_snprintf(key, sizeof(key), "key%d", n);
+        if (i % 5 == 0) {
+            apr_shm_hash_remove(thread_ht, key, strlen(key));
+        }
+        else {
+            make_val(val, n, i);
+            rv = apr_shm_hash_set(thread_ht, key, strlen(key), val,
+                                  sizeof(val));
+        }
+    }
+    apr_thread_exit(thd, rv);
+    return NULL;
+}
+
+static void * APR_THREAD_FUNC thread_reader(apr_thread_t *thd, void *data)
+{
+    char key[KEY_SIZE], val[VAL_SIZE];
+    apr_status_t rv = APR_SUCCESS;
+    int i, j;
+
+    for (i = 0; i < THREAD_LOOPS && rv == APR_SUCCESS; i++) {
+        int n = (i * 13) % THREAD_KEYS;
+        apr_size_t vlen;
+
+        apr_snprintf(key, sizeof(key), "key%d", n);
+        if (apr_shm_hash_get(thread_ht, key, strlen(key), val,
+                             &vlen) != APR_SUCCESS) {
+            continue;
+        }
+        if (vlen != sizeof(val)) {
+            rv = APR_EGENERAL;
+        }
+        for (j = 0; j < VAL_SIZE / (int)sizeof(int); j += 2) {
+            if (((int *)val)[j] != n
+                || ((int *)val)[j + 1] != ((int *)val)[1]) {
+                rv = APR_EGENERAL;
+            }
+        }
+    }
+    apr_thread_exit(thd, rv);
+    return NULL;
+}
+
+static void shmhash_threads(abts_case *tc, void *data)
+{
+    apr_thread_t *t[8];
+    apr_size_t size;
+    void *mem;
+    apr_status_t rv;
+    int i;
+
+    thread_ht = make_table(tc, THREAD_KEYS * 2, 0, &mem, &size);
+
+    for (i = 0; i < 8; i++) {
+        rv = apr_thread_create(&t[i], NULL,
+                               (i & 1) ? thread_reader : thread_writer,
+                               (void *)(apr_uintptr_t)i, p);
+        APR_ASSERT_SUCCESS(tc, "create thread", rv);
+    }
+    for (i = 0; i < 8; i++) {
+        apr_status_t retval;
+
+        apr_thread_join(&retval, t[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, retval);
+    }
+    ABTS_TRUE(tc, apr_shm_hash_count(thread_ht) <= THREAD_KEYS);
+}
+
+#endif /* APR_HAS_THREADS */
+
+#if APR_HAS_FORK && APR_HAS_SHARED_MEMORY
+
+static void shmhash_procs(abts_case *tc, void *data)
+{
+    apr_shm_hash_t *ht;
+    apr_shm_t *shm;
+    apr_proc_t proc;
+    apr_size_t size = apr_shm_hash_size_get(64, KEY_SIZE, VAL_SIZE);
+    apr_exit_why_e why;
+    char val[VAL_SIZE];
+    int exitcode;
+    apr_status_t rv;
+
+    rv = apr_shm_create(&shm, size, NULL, p);
+    APR_ASSERT_SUCCESS(tc, "create shm", rv);
+    if (rv != APR_SUCCESS) {
+        return;
+    }
+    rv = apr_shm_hash_create(&ht, apr_shm_baseaddr_get(shm), size, 64,
+                             KEY_SIZE, VAL_SIZE, 0, p);
+    APR_ASSERT_SUCCESS(tc, "create table", rv);
+
+    rv = apr_proc_fork(&proc, p);
+    if (rv == APR_INCHILD) {
+        apr_shm_hash_t *child_ht;
+
+        if (apr_shm_hash_attach(&child_ht, apr_shm_baseaddr_get(shm),
+                                p) != APR_SUCCESS
+            || apr_shm_hash_set(child_ht, "child", 5, "was here",
+                                8) != APR_SUCCESS) {
+            exit(1);
+        }
+        exit(0);
+    }
+    APR_ASSERT_SUCCESS(tc, "fork", rv == APR_INPARENT ? APR_SUCCESS : rv);
+    if (rv != APR_INPARENT) {
+        return;
+    }
+
+    apr_proc_wait(&proc, &exitcode, &why, APR_WAIT);
+    ABTS_INT_EQUAL(tc, APR_PROC_EXIT, why);
+    ABTS_INT_EQUAL(tc, 0, exitcode);
+
+    rv = apr_shm_hash_get(ht, "child", 5, val, NULL);
+    APR_ASSERT_SUCCESS(tc, "get from the parent", rv);
+    ABTS_TRUE(tc, memcmp(val, "was here", 8) == 0);
+
+    apr_shm_destroy(shm);
+}
+
+#endif /* APR_HAS_FORK && APR_HAS_SHARED_MEMORY */
+
+abts_suite *testshmhash(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite);
+
+    abts_run_test(suite, shmhash_set_get, NULL);
+    abts_run_test(suite, shmhash_full, NULL);
+    abts_run_test(suite, shmhash_evict, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, shmhash_threads, NULL);
+#endif
+#if APR_HAS_FORK && APR_HAS_SHARED_MEMORY
+    abts_run_test(suite, shmhash_procs, NULL);
+#endif
+
+    return suite;
+}
@@ -0,0 +1,291 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr.h"
+#include "apr_strings.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_shm.h"
+#include "apr_shm_ring.h"
+#include "apr_thread_proc.h"
+
+static apr_shm_ring_t *make_ring(abts_case *tc, apr_size_t capacity,
+                                 void **mem)
+{
+    apr_shm_ring_t *ring;
+    apr_size_t size;
+    apr_status_t rv;
+
+    size = apr_shm_ring_size_get(capacity);
+    *mem = apr_palloc(p, size);
+
+    rv = apr_shm_ring_create(&ring, *mem, size, capacity, p);
+    APR_ASSERT_SUCCESS(tc, "create ring", rv);
+    return ring;
+}
+
+static void shmring_push_pop(abts_case *tc, void *data)
+{
+    apr_shm_ring_t *ring, *ring2;
+    char buf[64];
+    apr_size_t len;
+    void *mem;
+    apr_status_t rv;
+
+    ring = make_ring(tc, 256, &mem);
+    ABTS_SIZE_EQUAL(tc, 120, apr_shm_ring_max_get(ring));
+
+    len = sizeof(buf);
+    rv = apr_shm_ring_pop(ring, buf, &len);
+    ABTS_INT_EQUAL(tc, APR_EAGAIN, rv);
+
+    APR_ASSERT_SUCCESS(tc, "push", apr_shm_ring_push(ring, "first", 5));
+    APR_ASSERT_SUCCESS(tc, "push", apr_shm_ring_push(ring, "", 0));
+    APR_ASSERT_SUCCESS(tc, "push", apr_shm_ring_push(ring, "third one", 9));
+
+    /* Another view of the same ring */
+    rv = apr_shm_ring_attach(&ring2, mem, p);
+    APR_ASSERT_SUCCESS(tc, "attach", rv);
+
+    len = sizeof(buf);
+    APR_ASSERT_SUCCESS(tc, "pop", apr_shm_ring_pop(ring2, buf, &len));
+    ABTS_SIZE_EQUAL(tc, 5, len);
+    ABTS_TRUE(tc, memcmp(buf, "first", 5) == 0);
+    len = sizeof(buf);
+    APR_ASSERT_SUCCESS(tc, "pop", apr_shm_ring_pop(ring2, buf, &len));
+    ABTS_SIZE_EQUAL(tc, 0, len);
+
+    /* Too small a buffer leaves the message */
+    len = 4;
+    rv = apr_shm_ring_pop(ring2, buf, &len);
+    ABTS_INT_EQUAL(tc, APR_ENOSPC, rv);
+    ABTS_SIZE_EQUAL(tc, 9, len);
+    len = sizeof(buf);
+    APR_ASSERT_SUCCESS(tc, "pop", apr_shm_ring_pop(ring2, buf, &len));
+    ABTS_SIZE_EQUAL(tc, 9, len);
+    ABTS_TRUE(tc, memcmp(buf, "third one", 9) == 0);
+
+    len = sizeof(buf);
+    rv = apr_shm_ring_pop(ring, buf, &len);
+    ABTS_INT_EQUAL(tc, APR_EAGAIN, rv);
+
+    memset(mem, 0, 4);
+    rv = apr_shm_ring_attach(&ring2, mem, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+}
+
+static void shmring_full(abts_case *tc, void *data)
+{
+    apr_shm_ring_t *ring;
+    char msg[120], buf[120];
+    apr_size_t len;
+    void *mem;
+    apr_status_t rv;
+    int i, pushed = 0, popped = 0;
+
+    ring = make_ring(tc, 256, &mem);
+
+    rv = apr_shm_ring_push(ring, msg, sizeof(msg) + 1);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    /* Messages of varying lengths, wrapping around the ring many times */
+    for (i = 0; i < 1000; i++) {
+        len = (apr_size_t)(i * 7) % sizeof(msg);
+        memset(msg, 'a' + pushed % 26, len);
+        rv = apr_shm_ring_push(ring, msg, len);
+        if (rv == APR_SUCCESS) {
+            pushed++;
+            continue;
+        }
+        ABTS_INT_EQUAL(tc, APR_EAGAIN, rv);
+
+        /* Drain, the message fits afterwards */
+        for (;;) {
+            len = sizeof(buf);
+            rv = apr_shm_ring_pop(ring, buf, &len);
+            if (rv == APR_EAGAIN) {
+                break;
+            }
+            APR_ASSERT_SUCCESS(tc, "pop", rv);
+            if (len) {
+                ABTS_INT_EQUAL(tc, 'a' + popped % 26, buf[0]);
+                ABTS_INT_EQUAL(tc, 'a' + popped % 26, buf[len - 1]);
+            }
+            popped++;
+        }
+        ABTS_INT_EQUAL(tc, pushed, popped);
+
+        len = (apr_size_t)(i * 7) % sizeof(msg);
+        APR_ASSERT_SUCCESS(tc, "push", apr_shm_ring_push(ring, msg, len));
+        pushed++;
+    }
+    ABTS_TRUE(tc, popped > 0);
+}
+
+#if APR_HAS_THREADS
+
+#define THREAD_PRODUCERS 4
+#define THREAD_MESSAGES  10000
+
+static apr_shm_ring_t *thread_ring;
+
+static void * APR_THREAD_FUNC thread_producer(apr_thread_t *thd, void *data)
+{
+    apr_uint32_t msg[2];
+
+    msg[0] = (apr_uint32_t)(apr_uintptr_t)data;
+    for (msg[1] = 0; msg[1] < THREAD_MESSAGES; msg[1]++) {
+        while (apr_shm_ring_push(thread_ring, msg, sizeof(msg))
+               == APR_EAGAIN) {
+            apr_thread_yield();
+        }
+    }
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static void shmring_threads(abts_case *tc, void *data)
+{
+    apr_thread_t *t[THREAD_PRODUCERS];
+    apr_uint32_t next[THREAD_PRODUCERS] = { 0 }, msg[2];
+    apr_size_t len;
+    void *mem;
+    apr_status_t rv;
+    int i, n, errors = 0;
+
+    thread_ring = make_ring(tc, 4096, &mem);
+
+    for (i = 0; i < THREAD_PRODUCERS; i++) {
+        rv = apr_thread_create(&t[i], NULL, thread_producer,
+                               (void *)(apr_uintptr_t)i, p);
+        APR_ASSERT_SUCCESS(tc, "create thread", rv);
+    }
+
+    /* Each producer's messages come in order */
+    for (n = 0; n < THREAD_PRODUCERS * THREAD_MESSAGES; n++) {
+        rv = apr_shm_ring_wait(thread_ring, apr_time_from_sec(10));
+        APR_ASSERT_SUCCESS(tc, "wait", rv);
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+        len = sizeof(msg);
+        rv = apr_shm_ring_pop(thread_ring, msg, &len);
+        if (rv != APR_SUCCESS || len != sizeof(msg)
+            || msg[0] >= THREAD_PRODUCERS || msg[1] != next[msg[0]]++) {
+            errors++;
+        }
+    }
+    ABTS_INT_EQUAL(tc, 0, errors);
+
+    for (i = 0; i < THREAD_PRODUCERS; i++) {
+        apr_status_t retval;
+
+        apr_thread_join(&retval, t[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, retval);
+    }
+    rv = apr_shm_ring_wait(thread_ring, 0);
+    ABTS_INT_EQUAL(tc, APR_TIMEUP, rv);
+}
+
+#endif /* APR_HAS_THREADS */
+
+#if APR_HAS_FORK && APR_HAS_SHARED_MEMORY
+
+static void shmring_procs(abts_case *tc, void *data)
+{
+    apr_shm_ring_t *ring;
+    apr_shm_t *shm;
+    apr_proc_t proc;
+    apr_file_t *in, *out;
+    apr_size_t size = apr_shm_ring_size_get(1024), len;
+    apr_exit_why_e why;
+    char buf[16];
+    int exitcode;
+    apr_status_t rv;
+
+    rv = apr_shm_create(&shm, size, NULL, p);
+    APR_ASSERT_SUCCESS(tc, "create shm", rv);
+    if (rv != APR_SUCCESS) {
+        return;
+    }
+    rv = apr_shm_ring_create(&ring, apr_shm_baseaddr_get(shm), size, 1024,
+                             p);
+    APR_ASSERT_SUCCESS(tc, "create ring", rv);
+    rv = apr_file_pipe_create_ex(&in, &out, APR_FULL_NONBLOCK, p);
+    APR_ASSERT_SUCCESS(tc, "create pipe", rv);
+
+    /* Asks the child for a notification */
+    rv = apr_shm_ring_wait(ring, 0);
+    ABTS_INT_EQUAL(tc, APR_TIMEUP, rv);
+
+    rv = apr_proc_fork(&proc, p);
+    if (rv == APR_INCHILD) {
+        apr_shm_ring_t *child_ring;
+
+        if (apr_shm_ring_attach(&child_ring, apr_shm_baseaddr_get(shm),
+                                p) != APR_SUCCESS) {
+            exit(1);
+        }
+        apr_shm_ring_notify_set(child_ring, out);
+        if (apr_shm_ring_push(child_ring, "from child", 10)
+                != APR_SUCCESS) {
+            exit(1);
+        }
+        exit(0);
+    }
+    APR_ASSERT_SUCCESS(tc, "fork", rv == APR_INPARENT ? APR_SUCCESS : rv);
+    if (rv != APR_INPARENT) {
+        return;
+    }
+
+    apr_proc_wait(&proc, &exitcode, &why, APR_WAIT);
+    ABTS_INT_EQUAL(tc, APR_PROC_EXIT, why);
+    ABTS_INT_EQUAL(tc, 0, exitcode);
+
+    len = sizeof(buf);
+    rv = apr_file_read(in, buf, &len);
+    APR_ASSERT_SUCCESS(tc, "read notification", rv);
+    ABTS_SIZE_EQUAL(tc, 1, len);
+
+    len = sizeof(buf);
+    rv = apr_shm_ring_pop(ring, buf, &len);
+    APR_ASSERT_SUCCESS(tc, "pop from the parent", rv);
+    ABTS_SIZE_EQUAL(tc, 10, len);
+    ABTS_TRUE(tc, memcmp(buf, "from child", 10) == 0);
+
+    apr_file_close(in);
+    apr_file_close(out);
+    apr_shm_destroy(shm);
+}
+
+#endif /* APR_HAS_FORK && APR_HAS_SHARED_MEMORY */
+
+abts_suite *testshmring(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite);
+
+    abts_run_test(suite, shmring_push_pop, NULL);
+    abts_run_test(suite, shmring_full, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, shmring_threads, NULL);
+#endif
+#if APR_HAS_FORK && APR_HAS_SHARED_MEMORY
+    abts_run_test(suite, shmring_procs, NULL);
+#endif
+
+    return suite;
+}
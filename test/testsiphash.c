@@ -18,6 +18,7 @@
 #include <stdlib.h>
 
 #include "apr_siphash.h"
+#include "apr_hash.h"
 
 #include "abts.h"
 #include "testutil.h"
@@ -138,11 +139,80 @@ static void test_siphash_vectors(abts_case *tc, void *data)
     ABTS_ASSERT(tc, "SipHash-2-4 test vectors", test_vectors());
 }
 
+static void test_siphash13(abts_case *tc, void *data)
+{
+    u8 in[MAXLEN], out[8], k[16];
+    apr_uint64_t h;
+    int i, j;
+
+    for (i = 0; i < 16; ++i) k[i] = i;
+
+    for (i = 0; i < MAXLEN; ++i) {
+        in[i] = i;
+        h = apr_siphash13(in, i, k);
+        ABTS_ASSERT(tc, "SipHash-1-3 is SipHash-c-d with 1 and 3",
+                    h == apr_siphash(in, i, k, 1, 3));
+        apr_siphash13_auth(out, in, i, k);
+        for (j = 0; j < 8; ++j) {
+            ABTS_INT_EQUAL(tc, (int)(h >> (8 * j)) & 0xff, out[j]);
+        }
+    }
+}
+
+static void test_siphash13_multi(abts_case *tc, void *data)
+{
+    u8 in[MAXLEN * 2], k[16];
+    const void *srcs[11] = { NULL };
+    apr_size_t lens[11] = { 0 };
+    apr_uint64_t hashes[11];
+    int i, n;
+
+    for (i = 0; i < 16; ++i) k[i] = 0xf0 ^ i;
+    for (i = 0; i < MAXLEN * 2; ++i) in[i] = i * 7;
+
+    /* every count of lanes, with lengths of all the remainders */
+    for (n = 0; n <= 11; ++n) {
+        for (i = 0; i < n; ++i) {
+            srcs[i] = in + i;
+            lens[i] = (i * 13 + n) % (MAXLEN + 1);
+        }
+        apr_siphash13_multi(hashes, srcs, lens, n, k);
+        for (i = 0; i < n; ++i) {
+            ABTS_ASSERT(tc, "SipHash-1-3 of each message",
+                        hashes[i] == apr_siphash13(srcs[i], lens[i], k));
+        }
+    }
+}
+
+static void test_hashfunc_siphash13(abts_case *tc, void *data)
+{
+    u8 k[16];
+    apr_ssize_t klen = APR_HASH_KEY_STRING;
+    unsigned int h;
+    int i;
+
+    for (i = 0; i < 16; ++i) k[i] = i;
+    apr_hashfunc_siphash13_key(k);
+
+    h = apr_hashfunc_siphash13("hello", &klen);
+    ABTS_INT_EQUAL(tc, 5, (int)klen);
+    ABTS_ASSERT(tc, "hash of the string",
+                h == (unsigned int)apr_siphash13("hello", 5, k));
+    klen = 4;
+    h = apr_hashfunc_siphash13("hello", &klen);
+    ABTS_INT_EQUAL(tc, 4, (int)klen);
+    ABTS_ASSERT(tc, "hash of the prefix",
+                h == (unsigned int)apr_siphash13("hell", 4, k));
+}
+
 abts_suite *testsiphash(abts_suite *suite)
 {
     suite = ADD_SUITE(suite);
 
     abts_run_test(suite, test_siphash_vectors, NULL);
+    abts_run_test(suite, test_siphash13, NULL);
+    abts_run_test(suite, test_siphash13_multi, NULL);
+    abts_run_test(suite, test_hashfunc_siphash13, NULL);
 
     return suite;
 }
@@ -519,6 +519,220 @@ static void skiplist_test(abts_case *tc, void *data) {
     apr_pool_clear(ptmp);
 }
 
+static int int_comp(void *a, void *b)
+{
+    int ia = *(int *)a, ib = *(int *)b;
+    return (ia < ib) ? -1 : (ia > ib);
+}
+
+#define NUM_CHURN 10000
+
+/* Check the order both ways and the removals, with or without a pool */
+static void skiplist_churn_pool(abts_case *tc, apr_pool_t *pool)
+{
+    apr_skiplist *sl;
+    apr_skiplistnode *iter;
+    int *vals, *val, *prev;
+    int i, n, ok = 1;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_skiplist_init(&sl, pool));
+    apr_skiplist_set_compare(sl, int_comp, int_comp);
+
+    vals = malloc(NUM_CHURN * sizeof(*vals));
+    for (i = 0; i < NUM_CHURN; i++) {
+        vals[i] = rand() % (NUM_CHURN / 2);
+        if (!apr_skiplist_add(sl, &vals[i])) {
+            ok = 0;
+        }
+    }
+    ABTS_TRUE(tc, ok);
+    ABTS_SIZE_EQUAL(tc, NUM_CHURN, apr_skiplist_size(sl));
+    /* Random heights, of about log2(NUM_CHURN) levels for the tallest */
+    ABTS_TRUE(tc, apr_skiplist_height(sl) >= 8);
+    ABTS_TRUE(tc, apr_skiplist_height(sl) <= 28);
+
+    /* Forward, dups in insertion order */
+    n = 0;
+    prev = NULL;
+    for (iter = apr_skiplist_getlist(sl); iter; apr_skiplist_next(sl, &iter)) {
+        val = apr_skiplist_element(iter);
+        if (prev && (*prev > *val || (*prev == *val && prev > val))) {
+            ok = 0;
+        }
+        prev = val;
+        n++;
+    }
+    ABTS_TRUE(tc, ok);
+    ABTS_INT_EQUAL(tc, NUM_CHURN, n);
+
+    /* Backward from the last */
+    iter = NULL;
+    val = apr_skiplist_last(sl, prev, &iter);
+    ABTS_PTR_EQUAL(tc, prev, val);
+    for (n = 1; apr_skiplist_previous(sl, &iter); n++) {
+        val = apr_skiplist_element(iter);
+        if (*prev < *val) {
+            ok = 0;
+        }
+        prev = val;
+    }
+    ABTS_TRUE(tc, ok);
+    ABTS_INT_EQUAL(tc, NUM_CHURN, n);
+
+    /* Remove the even values, then pop the other ones in order */
+    for (i = 0; i < NUM_CHURN; i++) {
+        if (vals[i] % 2 == 0) {
+            val = apr_skiplist_find(sl, &vals[i], &iter);
+            ABTS_PTR_NOTNULL(tc, val);
+            apr_skiplist_remove_node(sl, iter, NULL);
+        }
+    }
+    prev = NULL;
+    n = 0;
+    while ((val = apr_skiplist_pop(sl, NULL))) {
+        if (*val % 2 == 0 || (prev && *prev > *val)) {
+            ok = 0;
+        }
+        prev = val;
+        n++;
+    }
+    ABTS_TRUE(tc, ok);
+    ABTS_SIZE_EQUAL(tc, 0, apr_skiplist_size(sl));
+    ABTS_INT_EQUAL(tc, 1, apr_skiplist_height(sl));
+    ABTS_PTR_EQUAL(tc, NULL, apr_skiplist_getlist(sl));
+
+    /* Usable again */
+    ABTS_PTR_NOTNULL(tc, apr_skiplist_insert(sl, &vals[0]));
+    ABTS_PTR_EQUAL(tc, &vals[0], apr_skiplist_peek(sl));
+
+    apr_skiplist_destroy(sl, NULL);
+    free(vals);
+}
+
+static void skiplist_churn(abts_case *tc, void *data)
+{
+    skiplist_churn_pool(tc, ptmp);
+    skiplist_churn_pool(tc, NULL);
+    apr_pool_clear(ptmp);
+}
+
+/* Check the order (strictly if unique) and the size of the skiplist */
+static int skiplist_sorted(apr_skiplist *sl, size_t size, int unique)
+{
+    apr_skiplistnode *iter;
+    int *val, *prev = NULL;
+    size_t n = 0;
+
+    for (iter = apr_skiplist_getlist(sl); iter; apr_skiplist_next(sl, &iter)) {
+        val = apr_skiplist_element(iter);
+        if (prev && (*prev > *val || (unique && *prev == *val))) {
+            return 0;
+        }
+        prev = val;
+        n++;
+    }
+    return n == size && apr_skiplist_size(sl) == size;
+}
+
+static void skiplist_build(abts_case *tc, void *data)
+{
+    apr_skiplist *sl;
+    void **elems;
+    int *vals;
+    int i, ok;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_skiplist_init(&sl, ptmp));
+    vals = apr_palloc(ptmp, NUM_CHURN * sizeof(*vals));
+    elems = apr_palloc(ptmp, NUM_CHURN * sizeof(*elems));
+    for (i = 0; i < NUM_CHURN; i++) {
+        vals[i] = i / 2 * 4;    /* pairs of duplicates, gaps for batches */
+        elems[i] = &vals[i];
+    }
+
+    ABTS_INT_EQUAL(tc, APR_EINVAL,
+                   apr_skiplist_build_sorted(sl, elems, NUM_CHURN));
+    apr_skiplist_set_compare(sl, int_comp, int_comp);
+    elems[0] = &vals[NUM_CHURN - 1];
+    ABTS_INT_EQUAL(tc, APR_EINVAL,
+                   apr_skiplist_build_sorted(sl, elems, NUM_CHURN));
+    elems[0] = &vals[0];
+    ABTS_SIZE_EQUAL(tc, 0, apr_skiplist_size(sl));
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_skiplist_build_sorted(sl, elems, NUM_CHURN));
+    ABTS_TRUE(tc, skiplist_sorted(sl, NUM_CHURN, 0));
+    /* 10000 elements: 14 levels (2^13 <= 10000 < 2^14) */
+    ABTS_INT_EQUAL(tc, 14, apr_skiplist_height(sl));
+    ok = 1;
+    for (i = 0; i < NUM_CHURN; i++) {
+        if (!apr_skiplist_find(sl, &vals[i], NULL)) {
+            ok = 0;
+        }
+    }
+    ABTS_TRUE(tc, ok);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, apr_skiplist_build_sorted(sl, elems, 1));
+
+    /* Still a regular skiplist */
+    ABTS_PTR_EQUAL(tc, NULL, apr_skiplist_insert(sl, &vals[NUM_CHURN - 1]));
+    ABTS_PTR_NOTNULL(tc, apr_skiplist_add(sl, &vals[NUM_CHURN - 1]));
+    ABTS_PTR_EQUAL(tc, &vals[0], apr_skiplist_pop(sl, NULL));
+    apr_skiplist_remove_all(sl, NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_skiplist_build_sorted(sl, elems, 0));
+    ABTS_PTR_EQUAL(tc, NULL, apr_skiplist_getlist(sl));
+
+    apr_pool_clear(ptmp);
+}
+
+static void skiplist_batch(abts_case *tc, void *data)
+{
+    apr_skiplist *sl;
+    void **elems;
+    int *vals, *batch;
+    int i;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_skiplist_init(&sl, ptmp));
+    vals = apr_palloc(ptmp, NUM_CHURN * sizeof(*vals));
+    batch = apr_palloc(ptmp, NUM_CHURN * sizeof(*batch));
+    elems = apr_palloc(ptmp, NUM_CHURN * sizeof(*elems));
+    for (i = 0; i < NUM_CHURN; i++) {
+        vals[i] = i * 4;
+        elems[i] = &vals[i];
+    }
+    ABTS_INT_EQUAL(tc, APR_EINVAL,
+                   apr_skiplist_insert_batch(sl, elems, NUM_CHURN));
+    apr_skiplist_set_compare(sl, int_comp, int_comp);
+
+    /* Into an empty skiplist */
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_skiplist_insert_batch(sl, elems, NUM_CHURN / 2));
+    ABTS_TRUE(tc, skiplist_sorted(sl, NUM_CHURN / 2, 1));
+
+    /* Interleaved in a build one, with runs of existing elements and
+     * duplicates in the batch
+     */
+    for (i = 0; i < NUM_CHURN; i++) {
+        batch[i] = (i % 3 == 0) ? i / 3 * 4 : i / 3 * 4 + i % 3;
+        elems[i] = &batch[i];
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_skiplist_insert_batch(sl, elems, NUM_CHURN));
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_skiplist_insert_batch(sl, elems, NUM_CHURN));
+    /* 3334 groups of 0, 1, 2 + 4k, the first 2500 0 + 4k being there */
+    ABTS_TRUE(tc, skiplist_sorted(sl, NUM_CHURN + (NUM_CHURN / 2 - 3334), 1));
+
+    /* Out of order runs */
+    for (i = 0; i < NUM_CHURN; i++) {
+        batch[i] = (NUM_CHURN - i) % 100 * 1000 + i % 7 * 4 + 3;
+        elems[i] = &batch[i];
+    }
+    apr_skiplist_remove_all(sl, NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_skiplist_insert_batch(sl, elems, NUM_CHURN));
+    ABTS_TRUE(tc, skiplist_sorted(sl, 700, 1));
+
+    apr_pool_clear(ptmp);
+}
 
 abts_suite *testskiplist(abts_suite *suite)
 {
@@ -538,6 +752,9 @@ abts_suite *testskiplist(abts_suite *suite)
     abts_run_test(suite, skiplist_random_loop, NULL);
 
     abts_run_test(suite, skiplist_test, NULL);
+    abts_run_test(suite, skiplist_churn, NULL);
+    abts_run_test(suite, skiplist_build, NULL);
+    abts_run_test(suite, skiplist_batch, NULL);
 
     apr_pool_destroy(ptmp);
 
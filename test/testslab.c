@@ -0,0 +1,224 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_slab.h"
+#include "apr_general.h"
+#include "apr_thread_proc.h"
+#include "apr_strings.h"
+#include "testutil.h"
+
+#define NUM_OBJECTS 1000
+
+static void test_create(abts_case *tc, void *data)
+{
+    apr_slab_t *slab;
+    apr_status_t rv;
+
+    rv = apr_slab_create(&slab, 0, 0, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+    ABTS_PTR_EQUAL(tc, NULL, slab);
+
+    rv = apr_slab_create(&slab, 16, 0x80000000, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    rv = apr_slab_create(&slab, 1, 0, p);
+    APR_ASSERT_SUCCESS(tc, "create slab", rv);
+    ABTS_INT_EQUAL(tc, 1, apr_slab_object_size(slab) >= sizeof(void *));
+    ABTS_INT_EQUAL(tc, 0, (int)(apr_slab_object_size(slab) % 8));
+    apr_slab_destroy(slab);
+
+    rv = apr_slab_create(&slab, 24, APR_SLAB_CACHE_ALIGN, p);
+    APR_ASSERT_SUCCESS(tc, "create aligned slab", rv);
+    ABTS_INT_EQUAL(tc, 64, (int)apr_slab_object_size(slab));
+    apr_slab_destroy(slab);
+}
+
+static void alloc_free(abts_case *tc, apr_slab_t *slab)
+{
+    char *objs[NUM_OBJECTS], *obj;
+    apr_size_t size = apr_slab_object_size(slab);
+    int i, j;
+
+    for (i = 0; i < NUM_OBJECTS; i++) {
+        objs[i] = apr_slab_alloc(slab);
+        ABTS_PTR_NOTNULL(tc, objs[i]);
+        memset(objs[i], i & 0xff, size);
+    }
+    for (i = 0; i < NUM_OBJECTS; i++) {
+        for (j = 0; j < (int)size; j++) {
+            if (objs[i][j] != (char)(i & 0xff)) {
+                ABTS_FAIL(tc, "objects overlap");
+                return;
+            }
+        }
+    }
+
+    /* Freed objects are reused */
+    apr_slab_free(slab, objs[NUM_OBJECTS / 2]);
+    obj = apr_slab_alloc(slab);
+    ABTS_PTR_EQUAL(tc, objs[NUM_OBJECTS / 2], obj);
+
+    obj = apr_slab_calloc(slab);
+    ABTS_PTR_NOTNULL(tc, obj);
+    for (j = 0; j < (int)size; j++) {
+        ABTS_INT_EQUAL(tc, 0, obj[j]);
+    }
+    apr_slab_free(slab, obj);
+
+    for (i = 0; i < NUM_OBJECTS; i++) {
+        apr_slab_free(slab, objs[i]);
+    }
+}
+
+static void test_alloc(abts_case *tc, void *data)
+{
+    apr_slab_t *slab;
+    apr_status_t rv;
+
+    rv = apr_slab_create(&slab, 40, 0, p);
+    APR_ASSERT_SUCCESS(tc, "create slab", rv);
+    alloc_free(tc, slab);
+    apr_slab_destroy(slab);
+}
+
+static void test_cache_align(abts_case *tc, void *data)
+{
+    apr_slab_t *slab;
+    apr_status_t rv;
+    void *obj;
+    int i;
+
+    rv = apr_slab_create(&slab, 100, APR_SLAB_CACHE_ALIGN, p);
+    APR_ASSERT_SUCCESS(tc, "create slab", rv);
+    ABTS_INT_EQUAL(tc, 128, (int)apr_slab_object_size(slab));
+
+    for (i = 0; i < NUM_OBJECTS; i++) {
+        obj = apr_slab_alloc(slab);
+        ABTS_PTR_NOTNULL(tc, obj);
+        ABTS_INT_EQUAL(tc, 0, (int)((apr_uintptr_t)obj % 64));
+    }
+    alloc_free(tc, slab);
+    apr_slab_destroy(slab);
+}
+
+static void test_pool_lifetime(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_slab_t *slab;
+    apr_status_t rv;
+    int i;
+
+    rv = apr_pool_create(&pool, p);
+    APR_ASSERT_SUCCESS(tc, "create pool", rv);
+
+    /* The slabs' memory is given back when the pool is cleared */
+    for (i = 0; i < 3; i++) {
+        rv = apr_slab_create(&slab, 256, 0, pool);
+        APR_ASSERT_SUCCESS(tc, "create slab", rv);
+        ABTS_PTR_NOTNULL(tc, apr_slab_alloc(slab));
+        apr_pool_clear(pool);
+    }
+
+    apr_pool_destroy(pool);
+}
+
+#if APR_HAS_THREADS
+#define SLAB_THREADS 4
+
+static volatile int slab_failed;
+
+static void *APR_THREAD_FUNC slab_thread(apr_thread_t *thd, void *data)
+{
+    apr_slab_t *slab = data;
+    void *objs[64];
+    int i, j;
+
+    for (i = 0; i < 2000; i++) {
+        for (j = 0; j < 64; j++) {
+            objs[j] = apr_slab_alloc(slab);
+            if (objs[j] == NULL) {
+                slab_failed = 1;
+                return NULL;
+            }
+            *(apr_size_t *)objs[j] = (apr_size_t)j;
+        }
+        for (j = 0; j < 64; j++) {
+            if (*(apr_size_t *)objs[j] != (apr_size_t)j) {
+                slab_failed = 1;
+            }
+            apr_slab_free(slab, objs[j]);
+        }
+    }
+
+    return NULL;
+}
+
+static void threads(abts_case *tc, apr_uint32_t flags)
+{
+    apr_thread_t *t[SLAB_THREADS];
+    apr_slab_t *slab;
+    apr_status_t rv;
+    int i;
+
+    rv = apr_slab_create(&slab, 32, flags, p);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "per-thread magazines");
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "create slab", rv);
+
+    slab_failed = 0;
+    for (i = 0; i < SLAB_THREADS; i++) {
+        rv = apr_thread_create(&t[i], NULL, slab_thread, slab, p);
+        APR_ASSERT_SUCCESS(tc, "create thread", rv);
+    }
+    slab_thread(NULL, slab);
+    for (i = 0; i < SLAB_THREADS; i++) {
+        apr_thread_join(&rv, t[i]);
+    }
+    ABTS_INT_EQUAL(tc, 0, slab_failed);
+
+    /* The exited threads' magazines are back in the slab */
+    alloc_free(tc, slab);
+    apr_slab_destroy(slab);
+}
+
+static void test_thread_safe(abts_case *tc, void *data)
+{
+    threads(tc, APR_SLAB_THREAD_SAFE);
+}
+
+static void test_magazines(abts_case *tc, void *data)
+{
+    threads(tc, APR_SLAB_MAGAZINES);
+}
+#endif /* APR_HAS_THREADS */
+
+abts_suite *testslab(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+    abts_run_test(suite, test_create, NULL);
+    abts_run_test(suite, test_alloc, NULL);
+    abts_run_test(suite, test_cache_align, NULL);
+    abts_run_test(suite, test_pool_lifetime, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_thread_safe, NULL);
+    abts_run_test(suite, test_magazines, NULL);
+#endif
+
+    return suite;
+}
@@ -23,6 +23,7 @@
 #include "apr_lib.h"
 #include "apr_strings.h"
 #include "apr_poll.h"
+#include "apr_buckets.h"
 #define APR_WANT_BYTEFUNC
 #include "apr_want.h"
 
@@ -398,6 +399,70 @@ static void test_print_addr(abts_case *tc, void *data)
 #endif
 }
 
+static void test_ip_text(abts_case *tc, void *data)
+{
+    struct {
+        const char *ipstr;
+        int family;
+        const char *text;
+    } testcases[] =
+    {
+         {"0.0.0.0",                  APR_INET,  "0.0.0.0"}
+        ,{"10.20.30.40",              APR_INET,  "10.20.30.40"}
+        ,{"255.255.255.255",          APR_INET,  "255.255.255.255"}
+#if APR_HAVE_IPV6
+        ,{"::",                       APR_INET6, "::"}
+        ,{"::1",                      APR_INET6, "::1"}
+        ,{"1::",                      APR_INET6, "1::"}
+        ,{"2001:DB8:0:0:0:0:0:1",     APR_INET6, "2001:db8::1"}
+        ,{"2001:db8:0:1:0:0:1:0",     APR_INET6, "2001:db8:0:1::1:0"}
+        ,{"2001:0:0:1:0:0:0:1",       APR_INET6, "2001:0:0:1::1"}
+        ,{"1:0:2:3:4:5:6:7",          APR_INET6, "1:0:2:3:4:5:6:7"}
+        ,{"fe80::abcd:ef01:2345:6789", APR_INET6, "fe80::abcd:ef01:2345:6789"}
+        ,{"::ffff:1.2.3.4",           APR_INET6, "1.2.3.4"}
+        ,{"::1.2.3.4",                APR_INET6, "::1.2.3.4"}
+#endif
+    };
+    apr_sockaddr_t *sa;
+    apr_status_t rv;
+    char buf[64];
+    char *s, *s2;
+    int i;
+
+    for (i = 0; i < sizeof testcases / sizeof testcases[0]; i++) {
+        rv = apr_sockaddr_info_get(&sa, testcases[i].ipstr,
+                                   testcases[i].family, 80, 0, p);
+        APR_ASSERT_SUCCESS(tc, "Problem generating sockaddr", rv);
+        if (rv != APR_SUCCESS) {
+            continue;
+        }
+
+        APR_ASSERT_SUCCESS(tc, "get IP address", apr_sockaddr_ip_get(&s, sa));
+        ABTS_STR_EQUAL(tc, testcases[i].text, s);
+
+        /* Computed once */
+        APR_ASSERT_SUCCESS(tc, "get IP address", apr_sockaddr_ip_get(&s2, sa));
+        ABTS_PTR_EQUAL(tc, s, s2);
+
+        APR_ASSERT_SUCCESS(tc, "get IP address",
+                           apr_sockaddr_ip_getbuf(buf, sizeof buf, sa));
+        ABTS_STR_EQUAL(tc, testcases[i].text, buf);
+
+        ABTS_INT_EQUAL(tc, APR_ENOSPC,
+                       apr_sockaddr_ip_getbuf(buf, strlen(testcases[i].text),
+                                              sa));
+    }
+
+    /* Computed again when the address changes */
+    rv = apr_sockaddr_info_get(&sa, "10.20.30.40", APR_INET, 80, 0, p);
+    APR_ASSERT_SUCCESS(tc, "Problem generating sockaddr", rv);
+    APR_ASSERT_SUCCESS(tc, "get IP address", apr_sockaddr_ip_get(&s, sa));
+    ABTS_STR_EQUAL(tc, "10.20.30.40", s);
+    sa->sa.sin.sin_addr.s_addr = htonl(0x7f000001);
+    APR_ASSERT_SUCCESS(tc, "get IP address", apr_sockaddr_ip_get(&s, sa));
+    ABTS_STR_EQUAL(tc, "127.0.0.1", s);
+}
+
 static void test_get_addr(abts_case *tc, void *data)
 {
     apr_status_t rv;
@@ -640,6 +705,437 @@ static void test_freebind(abts_case *tc, void *data)
 #endif
 }
 
+static void test_reuseport_group(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_socket_t *socks[2], *client, *accepted;
+    apr_sockaddr_t *sa, *local0, *local1;
+    apr_pollfd_t pfds[2];
+    apr_int32_t nsds;
+    int i;
+
+    rv = apr_sockaddr_info_get(&sa, "127.0.0.1", APR_INET, 0, 0, p);
+    APR_ASSERT_SUCCESS(tc, "Problem generating sockaddr", rv);
+
+    rv = apr_socket_reuseport_group(socks, 2, sa, SOCK_STREAM, APR_PROTO_TCP,
+                                    5, 0, p);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "SO_REUSEPORT");
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "Problem creating the reuseport group", rv);
+
+    rv = apr_socket_addr_get(&local0, APR_LOCAL, socks[0]);
+    APR_ASSERT_SUCCESS(tc, "Problem getting local address", rv);
+    rv = apr_socket_addr_get(&local1, APR_LOCAL, socks[1]);
+    APR_ASSERT_SUCCESS(tc, "Problem getting local address", rv);
+    ABTS_ASSERT(tc, "ephemeral port should be assigned", local0->port != 0);
+    ABTS_INT_EQUAL(tc, local0->port, local1->port);
+
+    rv = apr_socket_create(&client, APR_INET, SOCK_STREAM, APR_PROTO_TCP, p);
+    APR_ASSERT_SUCCESS(tc, "Problem creating client socket", rv);
+    rv = apr_socket_connect(client, local0);
+    APR_ASSERT_SUCCESS(tc, "Problem connecting to the group", rv);
+
+    /* Accepted by exactly one of the listeners */
+    for (i = 0; i < 2; i++) {
+        pfds[i].p = p;
+        pfds[i].desc_type = APR_POLL_SOCKET;
+        pfds[i].reqevents = APR_POLLIN;
+        pfds[i].rtnevents = 0;
+        pfds[i].desc.s = socks[i];
+        pfds[i].client_data = NULL;
+    }
+    rv = apr_poll(pfds, 2, &nsds, apr_time_from_sec(5));
+    APR_ASSERT_SUCCESS(tc, "Problem polling the group", rv);
+    ABTS_INT_EQUAL(tc, 1, nsds);
+
+    i = (pfds[0].rtnevents & APR_POLLIN) ? 0 : 1;
+    rv = apr_socket_accept(&accepted, socks[i], p);
+    APR_ASSERT_SUCCESS(tc, "Problem accepting connection", rv);
+
+    apr_socket_close(accepted);
+    apr_socket_close(client);
+    for (i = 0; i < 2; i++) {
+        rv = apr_socket_close(socks[i]);
+        APR_ASSERT_SUCCESS(tc, "Problem closing socket", rv);
+    }
+
+    /* The steering program may not be available */
+    rv = apr_socket_reuseport_group(socks, 2, sa, SOCK_STREAM, APR_PROTO_TCP,
+                                    5, APR_REUSEPORT_STEER_CPU, p);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "SO_ATTACH_REUSEPORT_CBPF");
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "Problem creating the steered group", rv);
+    for (i = 0; i < 2; i++) {
+        rv = apr_socket_close(socks[i]);
+        APR_ASSERT_SUCCESS(tc, "Problem closing socket", rv);
+    }
+}
+
+static void test_accept_batch(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_socket_t *listener, *clients[3], *accepted[4];
+    apr_pool_t *pools[4];
+    apr_sockaddr_t *sa;
+    apr_int32_t n;
+    int i, total;
+
+    rv = apr_sockaddr_info_get(&sa, "127.0.0.1", APR_INET, 0, 0, p);
+    APR_ASSERT_SUCCESS(tc, "Problem generating sockaddr", rv);
+    rv = apr_socket_create(&listener, APR_INET, SOCK_STREAM, APR_PROTO_TCP, p);
+    APR_ASSERT_SUCCESS(tc, "Problem creating socket", rv);
+    rv = apr_socket_bind(listener, sa);
+    APR_ASSERT_SUCCESS(tc, "Problem binding socket", rv);
+    rv = apr_socket_listen(listener, 5);
+    APR_ASSERT_SUCCESS(tc, "Problem listening", rv);
+    rv = apr_socket_addr_get(&sa, APR_LOCAL, listener);
+    APR_ASSERT_SUCCESS(tc, "Problem getting local address", rv);
+    rv = apr_socket_opt_set(listener, APR_SO_NONBLOCK, 1);
+    APR_ASSERT_SUCCESS(tc, "Problem setting APR_SO_NONBLOCK", rv);
+
+    for (i = 0; i < 4; i++) {
+        apr_pool_create(&pools[i], p);
+    }
+
+    /* Nothing pending */
+    n = 4;
+    rv = apr_socket_accept_batch(accepted, &n, listener, pools);
+    ABTS_ASSERT(tc, "nothing should be accepted", APR_STATUS_IS_EAGAIN(rv));
+    ABTS_INT_EQUAL(tc, 0, n);
+
+    for (i = 0; i < 3; i++) {
+        rv = apr_socket_create(&clients[i], APR_INET, SOCK_STREAM,
+                               APR_PROTO_TCP, p);
+        APR_ASSERT_SUCCESS(tc, "Problem creating client socket", rv);
+        rv = apr_socket_connect(clients[i], sa);
+        APR_ASSERT_SUCCESS(tc, "Problem connecting", rv);
+    }
+
+    /* Some platforms accept one connection per call */
+    for (total = 0, i = 0; total < 3 && i < 100; i++) {
+        n = 4 - total;
+        rv = apr_socket_accept_batch(accepted + total, &n, listener,
+                                     pools + total);
+        if (APR_STATUS_IS_EAGAIN(rv)) {
+            apr_sleep(apr_time_from_msec(10));
+            continue;
+        }
+        APR_ASSERT_SUCCESS(tc, "Problem accepting connections", rv);
+        ABTS_ASSERT(tc, "too many connections", n >= 1 && total + n <= 3);
+        total += n;
+    }
+    ABTS_INT_EQUAL(tc, 3, total);
+
+    for (i = 0; i < total; i++) {
+        apr_sockaddr_t *remote;
+
+        rv = apr_socket_addr_get(&remote, APR_REMOTE, accepted[i]);
+        APR_ASSERT_SUCCESS(tc, "Problem getting remote address", rv);
+        ABTS_ASSERT(tc, "remote port should be set", remote->port != 0);
+        apr_socket_close(accepted[i]);
+    }
+    for (i = 0; i < 3; i++) {
+        apr_socket_close(clients[i]);
+    }
+    for (i = 0; i < 4; i++) {
+        apr_pool_destroy(pools[i]);
+    }
+    apr_socket_close(listener);
+}
+
+static void test_connect_any(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_socket_t *listener, *closed, *sock, *accepted;
+    apr_sockaddr_t *sa, *refused, *remote;
+
+    rv = apr_sockaddr_info_get(&sa, "127.0.0.1", APR_INET, 0, 0, p);
+    APR_ASSERT_SUCCESS(tc, "Problem generating sockaddr", rv);
+    rv = apr_socket_create(&listener, APR_INET, SOCK_STREAM, APR_PROTO_TCP, p);
+    APR_ASSERT_SUCCESS(tc, "Problem creating socket", rv);
+    rv = apr_socket_bind(listener, sa);
+    APR_ASSERT_SUCCESS(tc, "Problem binding socket", rv);
+    rv = apr_socket_listen(listener, 5);
+    APR_ASSERT_SUCCESS(tc, "Problem listening", rv);
+    rv = apr_socket_addr_get(&sa, APR_LOCAL, listener);
+    APR_ASSERT_SUCCESS(tc, "Problem getting local address", rv);
+
+    /* A port bound but not listening refuses connections */
+    rv = apr_sockaddr_info_get(&refused, "127.0.0.1", APR_INET, 0, 0, p);
+    APR_ASSERT_SUCCESS(tc, "Problem generating sockaddr", rv);
+    rv = apr_socket_create(&closed, APR_INET, SOCK_STREAM, APR_PROTO_TCP, p);
+    APR_ASSERT_SUCCESS(tc, "Problem creating socket", rv);
+    rv = apr_socket_bind(closed, refused);
+    APR_ASSERT_SUCCESS(tc, "Problem binding socket", rv);
+    rv = apr_socket_addr_get(&refused, APR_LOCAL, closed);
+    APR_ASSERT_SUCCESS(tc, "Problem getting local address", rv);
+    rv = apr_sockaddr_info_copy(&refused, refused, p);
+    APR_ASSERT_SUCCESS(tc, "Problem copying sockaddr", rv);
+
+    rv = apr_socket_connect_any(&sock, refused, SOCK_STREAM, APR_PROTO_TCP,
+                                apr_time_from_sec(5), apr_time_from_msec(250),
+                                p);
+    ABTS_ASSERT(tc, "connection should be refused", rv != APR_SUCCESS);
+    ABTS_PTR_EQUAL(tc, NULL, sock);
+
+    /* The refused attempt starts the next one at once */
+    refused->next = sa;
+    rv = apr_socket_connect_any(&sock, refused, SOCK_STREAM, APR_PROTO_TCP,
+                                apr_time_from_sec(5), apr_time_from_sec(5),
+                                p);
+    APR_ASSERT_SUCCESS(tc, "Problem connecting to any address", rv);
+    if (rv != APR_SUCCESS) {
+        return;
+    }
+    rv = apr_socket_addr_get(&remote, APR_REMOTE, sock);
+    APR_ASSERT_SUCCESS(tc, "Problem getting remote address", rv);
+    ABTS_INT_EQUAL(tc, sa->port, remote->port);
+
+    rv = apr_socket_accept(&accepted, listener, p);
+    APR_ASSERT_SUCCESS(tc, "Problem accepting connection", rv);
+
+    apr_socket_close(accepted);
+    apr_socket_close(sock);
+    apr_socket_close(closed);
+    apr_socket_close(listener);
+}
+
+static apr_status_t zerocopy_cb(void *baton, apr_uint32_t first,
+                                apr_uint32_t last, int copied)
+{
+    apr_uint32_t *completed = baton;
+
+    *completed += last - first + 1;
+    return APR_SUCCESS;
+}
+
+static void test_zerocopy(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_socket_t *listener, *client, *server;
+    apr_sockaddr_t *sa;
+    apr_uint32_t seq, completed = 0;
+    char buf[16];
+    apr_size_t len;
+    int i;
+
+    rv = apr_sockaddr_info_get(&sa, "127.0.0.1", APR_INET, 0, 0, p);
+    APR_ASSERT_SUCCESS(tc, "Problem generating sockaddr", rv);
+    rv = apr_socket_create(&listener, APR_INET, SOCK_STREAM, APR_PROTO_TCP, p);
+    APR_ASSERT_SUCCESS(tc, "Problem creating socket", rv);
+    rv = apr_socket_bind(listener, sa);
+    APR_ASSERT_SUCCESS(tc, "Problem binding socket", rv);
+    rv = apr_socket_listen(listener, 5);
+    APR_ASSERT_SUCCESS(tc, "Problem listening", rv);
+    rv = apr_socket_addr_get(&sa, APR_LOCAL, listener);
+    APR_ASSERT_SUCCESS(tc, "Problem getting local address", rv);
+
+    rv = apr_socket_create(&client, APR_INET, SOCK_STREAM, APR_PROTO_TCP, p);
+    APR_ASSERT_SUCCESS(tc, "Problem creating client socket", rv);
+    rv = apr_socket_connect(client, sa);
+    APR_ASSERT_SUCCESS(tc, "Problem connecting", rv);
+    rv = apr_socket_accept(&server, listener, p);
+    APR_ASSERT_SUCCESS(tc, "Problem accepting connection", rv);
+
+    rv = apr_socket_opt_set(client, APR_SO_ZEROCOPY, 1);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "APR_SO_ZEROCOPY");
+        goto cleanup;
+    }
+    APR_ASSERT_SUCCESS(tc, "Problem setting APR_SO_ZEROCOPY", rv);
+
+    for (i = 0; i < 2; i++) {
+        rv = apr_socket_zerocopy_seq(client, &seq);
+        APR_ASSERT_SUCCESS(tc, "Problem getting the sequence", rv);
+        ABTS_INT_EQUAL(tc, i, seq);
+
+        len = 5;
+        rv = apr_socket_send(client, "hello", &len);
+        APR_ASSERT_SUCCESS(tc, "Problem sending", rv);
+        ABTS_SIZE_EQUAL(tc, 5, len);
+
+        len = 5;
+        rv = apr_socket_recv(server, buf, &len);
+        APR_ASSERT_SUCCESS(tc, "Problem receiving", rv);
+        ABTS_SIZE_EQUAL(tc, 5, len);
+    }
+
+    /* The completions are queued once the data is released */
+    for (i = 0; i < 100 && completed < 2; i++) {
+        rv = apr_socket_zerocopy_reap(client, zerocopy_cb, &completed);
+        APR_ASSERT_SUCCESS(tc, "Problem reaping the completions", rv);
+        if (completed < 2) {
+            apr_sleep(apr_time_from_msec(10));
+        }
+    }
+    ABTS_INT_EQUAL(tc, 2, completed);
+
+cleanup:
+    apr_socket_close(server);
+    apr_socket_close(client);
+    apr_socket_close(listener);
+}
+
+static void test_kernel_timeout(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_socket_t *listener, *client, *server;
+    apr_sockaddr_t *sa;
+    apr_interval_time_t t;
+    apr_time_t start;
+    apr_int32_t on;
+    char buf[16];
+    apr_size_t len;
+
+    rv = apr_sockaddr_info_get(&sa, "127.0.0.1", APR_INET, 0, 0, p);
+    APR_ASSERT_SUCCESS(tc, "Problem generating sockaddr", rv);
+    rv = apr_socket_create(&listener, APR_INET, SOCK_STREAM, APR_PROTO_TCP, p);
+    APR_ASSERT_SUCCESS(tc, "Problem creating socket", rv);
+    rv = apr_socket_bind(listener, sa);
+    APR_ASSERT_SUCCESS(tc, "Problem binding socket", rv);
+    rv = apr_socket_listen(listener, 5);
+    APR_ASSERT_SUCCESS(tc, "Problem listening", rv);
+    rv = apr_socket_addr_get(&sa, APR_LOCAL, listener);
+    APR_ASSERT_SUCCESS(tc, "Problem getting local address", rv);
+
+    rv = apr_socket_create(&client, APR_INET, SOCK_STREAM, APR_PROTO_TCP, p);
+    APR_ASSERT_SUCCESS(tc, "Problem creating client socket", rv);
+    rv = apr_socket_connect(client, sa);
+    APR_ASSERT_SUCCESS(tc, "Problem connecting", rv);
+    rv = apr_socket_accept(&server, listener, p);
+    APR_ASSERT_SUCCESS(tc, "Problem accepting connection", rv);
+
+    rv = apr_socket_timeout_set(server, apr_time_from_msec(100));
+    APR_ASSERT_SUCCESS(tc, "Problem setting the timeout", rv);
+    rv = apr_socket_opt_set(server, APR_SO_KERNEL_TIMEOUT, 1);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "APR_SO_KERNEL_TIMEOUT");
+        goto cleanup;
+    }
+    APR_ASSERT_SUCCESS(tc, "Problem setting APR_SO_KERNEL_TIMEOUT", rv);
+
+    /* The descriptor is blocking, with the same timeout */
+    rv = apr_socket_opt_get(server, APR_SO_NONBLOCK, &on);
+    APR_ASSERT_SUCCESS(tc, "Problem getting APR_SO_NONBLOCK", rv);
+    ABTS_INT_EQUAL(tc, 0, on);
+    rv = apr_socket_timeout_get(server, &t);
+    APR_ASSERT_SUCCESS(tc, "Problem getting the timeout", rv);
+    ABTS_TRUE(tc, t == apr_time_from_msec(100));
+
+    start = apr_time_now();
+    len = sizeof(buf);
+    rv = apr_socket_recv(server, buf, &len);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+    ABTS_SIZE_EQUAL(tc, 0, len);
+    ABTS_TRUE(tc, apr_time_now() - start >= apr_time_from_msec(90));
+
+    len = 5;
+    rv = apr_socket_send(client, "hello", &len);
+    APR_ASSERT_SUCCESS(tc, "Problem sending", rv);
+    len = sizeof(buf);
+    rv = apr_socket_recv(server, buf, &len);
+    APR_ASSERT_SUCCESS(tc, "Problem receiving", rv);
+    ABTS_SIZE_EQUAL(tc, 5, len);
+
+    /* A zero timeout still needs a non-blocking descriptor */
+    rv = apr_socket_timeout_set(server, 0);
+    APR_ASSERT_SUCCESS(tc, "Problem clearing the timeout", rv);
+    len = sizeof(buf);
+    rv = apr_socket_recv(server, buf, &len);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_EAGAIN(rv));
+
+    /* And back to polling */
+    rv = apr_socket_timeout_set(server, apr_time_from_msec(50));
+    APR_ASSERT_SUCCESS(tc, "Problem setting the timeout", rv);
+    rv = apr_socket_opt_set(server, APR_SO_KERNEL_TIMEOUT, 0);
+    APR_ASSERT_SUCCESS(tc, "Problem clearing APR_SO_KERNEL_TIMEOUT", rv);
+    rv = apr_socket_opt_get(server, APR_SO_NONBLOCK, &on);
+    APR_ASSERT_SUCCESS(tc, "Problem getting APR_SO_NONBLOCK", rv);
+    ABTS_INT_EQUAL(tc, 1, on);
+    len = sizeof(buf);
+    rv = apr_socket_recv(server, buf, &len);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+
+cleanup:
+    apr_socket_close(server);
+    apr_socket_close(client);
+    apr_socket_close(listener);
+}
+
+static void test_adaptive_wait(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_socket_t *listener, *client, *server;
+    apr_sockaddr_t *sa;
+    apr_int32_t on;
+    char buf[16];
+    apr_size_t len;
+
+    rv = apr_sockaddr_info_get(&sa, "127.0.0.1", APR_INET, 0, 0, p);
+    APR_ASSERT_SUCCESS(tc, "Problem generating sockaddr", rv);
+    rv = apr_socket_create(&listener, APR_INET, SOCK_STREAM, APR_PROTO_TCP, p);
+    APR_ASSERT_SUCCESS(tc, "Problem creating socket", rv);
+    rv = apr_socket_bind(listener, sa);
+    APR_ASSERT_SUCCESS(tc, "Problem binding socket", rv);
+    rv = apr_socket_listen(listener, 5);
+    APR_ASSERT_SUCCESS(tc, "Problem listening", rv);
+    rv = apr_socket_addr_get(&sa, APR_LOCAL, listener);
+    APR_ASSERT_SUCCESS(tc, "Problem getting local address", rv);
+
+    rv = apr_socket_create(&client, APR_INET, SOCK_STREAM, APR_PROTO_TCP, p);
+    APR_ASSERT_SUCCESS(tc, "Problem creating client socket", rv);
+    rv = apr_socket_connect(client, sa);
+    APR_ASSERT_SUCCESS(tc, "Problem connecting", rv);
+    rv = apr_socket_accept(&server, listener, p);
+    APR_ASSERT_SUCCESS(tc, "Problem accepting connection", rv);
+
+    rv = apr_socket_timeout_set(server, apr_time_from_msec(50));
+    APR_ASSERT_SUCCESS(tc, "Problem setting the timeout", rv);
+    rv = apr_socket_opt_set(server, APR_SO_ADAPTIVE_WAIT, 1);
+    APR_ASSERT_SUCCESS(tc, "Problem setting APR_SO_ADAPTIVE_WAIT", rv);
+
+    /* A full read that did not have to wait */
+    len = 4;
+    rv = apr_socket_send(client, "abcd", &len);
+    APR_ASSERT_SUCCESS(tc, "Problem sending", rv);
+    apr_sleep(apr_time_from_msec(10));
+    len = 4;
+    rv = apr_socket_recv(server, buf, &len);
+    APR_ASSERT_SUCCESS(tc, "Problem receiving", rv);
+    ABTS_SIZE_EQUAL(tc, 4, len);
+    rv = apr_socket_opt_get(server, APR_INCOMPLETE_READ, &on);
+    APR_ASSERT_SUCCESS(tc, "Problem getting APR_INCOMPLETE_READ", rv);
+    ABTS_INT_EQUAL(tc, 0, on);
+
+    /* After EAGAIN the next read waits first */
+    len = sizeof(buf);
+    rv = apr_socket_recv(server, buf, &len);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+    rv = apr_socket_opt_get(server, APR_INCOMPLETE_READ, &on);
+    APR_ASSERT_SUCCESS(tc, "Problem getting APR_INCOMPLETE_READ", rv);
+    ABTS_INT_EQUAL(tc, 1, on);
+
+    /* Which it doesn't need after that one */
+    len = 4;
+    rv = apr_socket_send(client, "abcd", &len);
+    APR_ASSERT_SUCCESS(tc, "Problem sending", rv);
+    len = 4;
+    rv = apr_socket_recv(server, buf, &len);
+    APR_ASSERT_SUCCESS(tc, "Problem receiving", rv);
+    ABTS_SIZE_EQUAL(tc, 4, len);
+    rv = apr_socket_opt_get(server, APR_INCOMPLETE_READ, &on);
+    APR_ASSERT_SUCCESS(tc, "Problem getting APR_INCOMPLETE_READ", rv);
+    ABTS_INT_EQUAL(tc, 0, on);
+
+    apr_socket_close(server);
+    apr_socket_close(client);
+    apr_socket_close(listener);
+}
+
 #define TEST_ZONE_ADDR "fe80::1"
 
 #ifdef __linux__
@@ -734,6 +1230,349 @@ static void test_zone(abts_case *tc, void *data)
 #endif /* APR_HAVE_IPV6 */
 }
 
+#define BRIGADE_BUCKETS   2000
+#define BRIGADE_FILE_SIZE 100000
+#define BRIGADE_BIG_SIZE  (1024 * 1024)
+
+static void test_brigade_write(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_socket_t *server, *server_connection, *client;
+    apr_sockaddr_t *server_addr;
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb = apr_brigade_create(p, ba);
+    apr_file_t *f1, *f2;
+    char filename[] = "data/testbrigadeXXXXXX";
+    char *expect, *buf, *big;
+    apr_size_t elen, got, n;
+    apr_time_t deadline;
+    int i;
+
+    server = setup_socket(tc);
+    if (!server) return;
+
+    rv = apr_sockaddr_info_get(&server_addr, socket_name, socket_type, 8021, 0, p);
+    APR_ASSERT_SUCCESS(tc, "setting up sockaddr", rv);
+    rv = apr_socket_create(&client, server_addr->family, SOCK_STREAM, 0, p);
+    APR_ASSERT_SUCCESS(tc, "creating client socket", rv);
+    rv = apr_socket_connect(client, server_addr);
+    APR_ASSERT_SUCCESS(tc, "connecting client to server", rv);
+    rv = apr_socket_accept(&server_connection, server, p);
+    APR_ASSERT_SUCCESS(tc, "accepting client connection", rv);
+
+    /* Both ends non-blocking, to write and read in turn */
+    apr_socket_timeout_set(server_connection, 0);
+    apr_socket_timeout_set(client, 0);
+
+    elen = 7 + BRIGADE_BUCKETS * 4 + 3 * BRIGADE_FILE_SIZE + BRIGADE_BIG_SIZE;
+    expect = apr_palloc(p, elen);
+    buf = apr_palloc(p, elen);
+
+    /* More memory buckets than fit in an iovec */
+    APR_BRIGADE_INSERT_TAIL(bb,
+                            apr_bucket_transient_create("hello, ", 7, ba));
+    memcpy(expect, "hello, ", 7);
+    n = 7;
+    for (i = 0; i < BRIGADE_BUCKETS; i++) {
+        apr_brigade_printf(bb, NULL, NULL, "%04d", i);
+        apr_snprintf(expect + n, 5, "%04d", i);
+        n += 4;
+    }
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_flush_create(ba));
+
+    /* A file sent twice with sendfile(), once read */
+    rv = apr_file_mktemp(&f1, filename, APR_FOPEN_CREATE | APR_FOPEN_READ |
+                         APR_FOPEN_WRITE | APR_FOPEN_EXCL |
+                         APR_FOPEN_DELONCLOSE | APR_FOPEN_SENDFILE_ENABLED, p);
+    APR_ASSERT_SUCCESS(tc, "creating temp file", rv);
+    for (i = 0; i < BRIGADE_FILE_SIZE; i++) {
+        expect[n + i] = 'a' + i % 26;
+    }
+    rv = apr_file_write_full(f1, expect + n, BRIGADE_FILE_SIZE, NULL);
+    APR_ASSERT_SUCCESS(tc, "writing temp file", rv);
+    rv = apr_file_open(&f2, filename, APR_FOPEN_READ, 0, p);
+    APR_ASSERT_SUCCESS(tc, "opening temp file", rv);
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_file_create(f1, 0, BRIGADE_FILE_SIZE,
+                                                       p, ba));
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_immortal_create("x", 1, ba));
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_file_create(f2, 1,
+                                                       BRIGADE_FILE_SIZE - 1,
+                                                       p, ba));
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_file_create(f1, 0, BRIGADE_FILE_SIZE,
+                                                       p, ba));
+    n += BRIGADE_FILE_SIZE;
+    expect[n] = 'x';
+    memcpy(expect + n + 1, expect + n - BRIGADE_FILE_SIZE + 1,
+           BRIGADE_FILE_SIZE - 1);
+    n += BRIGADE_FILE_SIZE;
+    memcpy(expect + n, expect + n - 2 * BRIGADE_FILE_SIZE, BRIGADE_FILE_SIZE);
+    n += BRIGADE_FILE_SIZE;
+
+    /* More than the socket buffers, written in parts */
+    big = apr_bucket_alloc(BRIGADE_BIG_SIZE, ba);
+    for (i = 0; i < BRIGADE_BIG_SIZE; i++) {
+        big[i] = (char)(i * 7);
+    }
+    memcpy(expect + n, big, BRIGADE_BIG_SIZE);
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_heap_create(big, BRIGADE_BIG_SIZE,
+                                                       apr_bucket_free, ba));
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_eos_create(ba));
+
+    got = 0;
+    deadline = apr_time_now() + apr_time_from_sec(20);
+    while ((!APR_BRIGADE_EMPTY(bb) || got < elen) && apr_time_now() < deadline) {
+        rv = apr_brigade_write_socket(bb, server_connection, 0);
+        if (!APR_STATUS_IS_EAGAIN(rv)) {
+            APR_ASSERT_SUCCESS(tc, "writing brigade", rv);
+            if (rv != APR_SUCCESS) break;
+        }
+        do {
+            n = elen - got;
+            rv = apr_socket_recv(client, buf + got, &n);
+            got += n;
+        } while (rv == APR_SUCCESS && got < elen);
+    }
+    ABTS_ASSERT(tc, "brigade written", APR_BRIGADE_EMPTY(bb));
+    ABTS_SIZE_EQUAL(tc, elen, got);
+    ABTS_ASSERT(tc, "data received", !memcmp(expect, buf, elen));
+
+    apr_file_close(f2);
+    apr_file_close(f1);
+    apr_brigade_destroy(bb);
+    apr_bucket_alloc_destroy(ba);
+    apr_socket_close(client);
+    apr_socket_close(server_connection);
+    rv = apr_socket_close(server);
+    APR_ASSERT_SUCCESS(tc, "couldn't close server socket", rv);
+}
+
+#define SPLICE_SIZE 50000
+
+static void test_brigade_splice(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_socket_t *server, *server_connection, *client, *source, *sink;
+    apr_sockaddr_t *server_addr;
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb = apr_brigade_create(p, ba);
+    apr_file_t *pin, *pout;
+    char *expect, *buf;
+    apr_size_t elen, got, n;
+    apr_time_t deadline;
+    int i;
+
+    server = setup_socket(tc);
+    if (!server) return;
+
+    /* The client, then the source of the socket bucket */
+    rv = apr_sockaddr_info_get(&server_addr, socket_name, socket_type, 8021, 0, p);
+    APR_ASSERT_SUCCESS(tc, "setting up sockaddr", rv);
+    rv = apr_socket_create(&client, server_addr->family, SOCK_STREAM, 0, p);
+    APR_ASSERT_SUCCESS(tc, "creating client socket", rv);
+    rv = apr_socket_connect(client, server_addr);
+    APR_ASSERT_SUCCESS(tc, "connecting client to server", rv);
+    rv = apr_socket_accept(&server_connection, server, p);
+    APR_ASSERT_SUCCESS(tc, "accepting client connection", rv);
+    rv = apr_socket_create(&source, server_addr->family, SOCK_STREAM, 0, p);
+    APR_ASSERT_SUCCESS(tc, "creating source socket", rv);
+    rv = apr_socket_connect(source, server_addr);
+    APR_ASSERT_SUCCESS(tc, "connecting source to server", rv);
+    rv = apr_socket_accept(&sink, server, p);
+    APR_ASSERT_SUCCESS(tc, "accepting source connection", rv);
+
+    apr_socket_timeout_set(server_connection, 0);
+    apr_socket_timeout_set(client, 0);
+
+    elen = 5 + 2 * SPLICE_SIZE + 4 + 4;
+    expect = apr_palloc(p, elen);
+    buf = apr_palloc(p, elen);
+    memcpy(expect, "head ", 5);
+    for (i = 0; i < SPLICE_SIZE; i++) {
+        expect[5 + i] = 'a' + i % 26;
+        expect[5 + SPLICE_SIZE + 4 + i] = (char)(i * 7);
+    }
+    memcpy(expect + 5 + SPLICE_SIZE, " mid", 4);
+    memcpy(expect + elen - 4, " end", 4);
+
+    /* Filled (and ended) beforehand */
+    rv = apr_file_pipe_create(&pin, &pout, p);
+    APR_ASSERT_SUCCESS(tc, "creating pipe", rv);
+    rv = apr_file_write_full(pout, expect + 5, SPLICE_SIZE, NULL);
+    APR_ASSERT_SUCCESS(tc, "writing pipe", rv);
+    apr_file_close(pout);
+    n = SPLICE_SIZE;
+    rv = apr_socket_send(source, expect + 5 + SPLICE_SIZE + 4, &n);
+    APR_ASSERT_SUCCESS(tc, "writing source socket", rv);
+    ABTS_SIZE_EQUAL(tc, SPLICE_SIZE, n);
+    apr_socket_shutdown(source, APR_SHUTDOWN_WRITE);
+
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_immortal_create("head ", 5, ba));
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_flush_create(ba));
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_pipe_create(pin, ba));
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_immortal_create(" mid", 4, ba));
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_socket_create(sink, ba));
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_immortal_create(" end", 4, ba));
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_eos_create(ba));
+
+    got = 0;
+    deadline = apr_time_now() + apr_time_from_sec(20);
+    while ((!APR_BRIGADE_EMPTY(bb) || got < elen) && apr_time_now() < deadline) {
+        rv = apr_brigade_write_socket(bb, server_connection,
+                                      APR_BRIGADE_WRITE_SPLICE);
+        if (!APR_STATUS_IS_EAGAIN(rv)) {
+            APR_ASSERT_SUCCESS(tc, "splicing brigade", rv);
+            if (rv != APR_SUCCESS) break;
+        }
+        do {
+            n = elen - got;
+            rv = apr_socket_recv(client, buf + got, &n);
+            got += n;
+        } while (rv == APR_SUCCESS && got < elen);
+    }
+    ABTS_ASSERT(tc, "brigade written", APR_BRIGADE_EMPTY(bb));
+    ABTS_SIZE_EQUAL(tc, elen, got);
+    ABTS_ASSERT(tc, "data received", !memcmp(expect, buf, elen));
+
+    apr_brigade_destroy(bb);
+    apr_bucket_alloc_destroy(ba);
+    apr_socket_close(sink);
+    apr_socket_close(source);
+    apr_socket_close(client);
+    apr_socket_close(server_connection);
+    rv = apr_socket_close(server);
+    APR_ASSERT_SUCCESS(tc, "couldn't close server socket", rv);
+}
+
+#if APR_HAVE_SOCKADDR_UN
+#define DESC_SOCKET_NAME    "/tmp/apr-socket-desc"
+
+static void test_descriptors(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_socket_t *unx, *left, *right, *listener, *client, *accepted;
+    apr_socket_descriptor_t descs[2];
+    apr_sockaddr_t *sa, *tcp_sa;
+    apr_file_t *in, *out;
+    apr_pool_t *subp;
+    apr_size_t len;
+    char buf[8];
+    int n, type;
+
+    apr_file_remove(DESC_SOCKET_NAME, p);
+    rv = apr_sockaddr_info_get(&sa, DESC_SOCKET_NAME, APR_UNIX, 0, 0, p);
+    APR_ASSERT_SUCCESS(tc, "Problem generating sockaddr", rv);
+    rv = apr_socket_create(&unx, APR_UNIX, SOCK_STREAM, 0, p);
+    APR_ASSERT_SUCCESS(tc, "Problem creating socket", rv);
+    rv = apr_socket_bind(unx, sa);
+    APR_ASSERT_SUCCESS(tc, "Problem binding socket", rv);
+    rv = apr_socket_listen(unx, 5);
+    APR_ASSERT_SUCCESS(tc, "Problem listening", rv);
+    rv = apr_socket_create(&left, APR_UNIX, SOCK_STREAM, 0, p);
+    APR_ASSERT_SUCCESS(tc, "Problem creating socket", rv);
+    rv = apr_socket_connect(left, sa);
+    APR_ASSERT_SUCCESS(tc, "Problem connecting", rv);
+    rv = apr_socket_accept(&right, unx, p);
+    APR_ASSERT_SUCCESS(tc, "Problem accepting", rv);
+
+    /* A TCP listener and the write end of a pipe */
+    rv = apr_sockaddr_info_get(&tcp_sa, "127.0.0.1", APR_INET, 0, 0, p);
+    APR_ASSERT_SUCCESS(tc, "Problem generating sockaddr", rv);
+    rv = apr_socket_create(&listener, APR_INET, SOCK_STREAM, APR_PROTO_TCP,
+                           p);
+    APR_ASSERT_SUCCESS(tc, "Problem creating socket", rv);
+    rv = apr_socket_bind(listener, tcp_sa);
+    APR_ASSERT_SUCCESS(tc, "Problem binding socket", rv);
+    rv = apr_socket_listen(listener, 5);
+    APR_ASSERT_SUCCESS(tc, "Problem listening", rv);
+    rv = apr_socket_addr_get(&tcp_sa, APR_LOCAL, listener);
+    APR_ASSERT_SUCCESS(tc, "Problem getting local address", rv);
+    rv = apr_file_pipe_create(&in, &out, p);
+    APR_ASSERT_SUCCESS(tc, "Problem creating pipe", rv);
+
+    descs[0].sock = listener;
+    descs[0].file = NULL;
+    descs[1].sock = NULL;
+    descs[1].file = out;
+
+    len = 0;
+    rv = apr_socket_send_descriptors(left, "x", &len, descs, 2);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    len = 1;
+    rv = apr_socket_send_descriptors(left, "x", &len, descs, 2);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "Passing descriptors");
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "Problem sending descriptors", rv);
+    ABTS_SIZE_EQUAL(tc, 1, len);
+
+    apr_pool_create(&subp, p);
+    len = sizeof(buf);
+    n = 2;
+    rv = apr_socket_recv_descriptors(right, buf, &len, descs, &n, subp);
+    APR_ASSERT_SUCCESS(tc, "Problem receiving descriptors", rv);
+    ABTS_SIZE_EQUAL(tc, 1, len);
+    ABTS_INT_EQUAL(tc, 'x', buf[0]);
+    ABTS_INT_EQUAL(tc, 2, n);
+    if (n != 2) {
+        return;
+    }
+    ABTS_PTR_NOTNULL(tc, descs[0].sock);
+    ABTS_PTR_NOTNULL(tc, descs[1].file);
+
+    /* Closing ours, the received ones still work */
+    apr_socket_close(listener);
+    apr_file_close(out);
+
+    rv = apr_socket_type_get(descs[0].sock, &type);
+    APR_ASSERT_SUCCESS(tc, "Problem getting socket type", rv);
+    ABTS_INT_EQUAL(tc, SOCK_STREAM, type);
+    rv = apr_socket_addr_get(&sa, APR_LOCAL, descs[0].sock);
+    APR_ASSERT_SUCCESS(tc, "Problem getting local address", rv);
+    ABTS_INT_EQUAL(tc, tcp_sa->port, sa->port);
+
+    rv = apr_socket_create(&client, APR_INET, SOCK_STREAM, APR_PROTO_TCP, p);
+    APR_ASSERT_SUCCESS(tc, "Problem creating client socket", rv);
+    rv = apr_socket_connect(client, tcp_sa);
+    APR_ASSERT_SUCCESS(tc, "Problem connecting", rv);
+    rv = apr_socket_accept(&accepted, descs[0].sock, p);
+    APR_ASSERT_SUCCESS(tc, "Problem accepting on the received socket", rv);
+
+    len = 2;
+    rv = apr_file_write(descs[1].file, "ok", &len);
+    APR_ASSERT_SUCCESS(tc, "Problem writing to the received pipe", rv);
+    len = sizeof(buf);
+    rv = apr_file_read(in, buf, &len);
+    APR_ASSERT_SUCCESS(tc, "Problem reading the pipe", rv);
+    ABTS_SIZE_EQUAL(tc, 2, len);
+    ABTS_TRUE(tc, memcmp(buf, "ok", 2) == 0);
+
+    /* Only the data when nothing is passed, and EOF when closed */
+    len = 1;
+    rv = apr_socket_send_descriptors(left, "y", &len, NULL, 0);
+    APR_ASSERT_SUCCESS(tc, "Problem sending data", rv);
+    apr_socket_close(left);
+    len = sizeof(buf);
+    n = 2;
+    rv = apr_socket_recv_descriptors(right, buf, &len, descs, &n, subp);
+    APR_ASSERT_SUCCESS(tc, "Problem receiving data", rv);
+    ABTS_SIZE_EQUAL(tc, 1, len);
+    ABTS_INT_EQUAL(tc, 0, n);
+    len = sizeof(buf);
+    n = 2;
+    rv = apr_socket_recv_descriptors(right, buf, &len, descs, &n, subp);
+    ABTS_INT_EQUAL(tc, APR_EOF, rv);
+
+    apr_pool_destroy(subp);
+    apr_socket_close(accepted);
+    apr_socket_close(client);
+    apr_socket_close(right);
+    apr_file_close(in);
+    apr_socket_close(unx);
+}
+#endif
+
 abts_suite *testsock(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -747,10 +1586,19 @@ abts_suite *testsock(abts_suite *suite)
     abts_run_test(suite, test_atreadeof, NULL);
     abts_run_test(suite, test_timeout, NULL);
     abts_run_test(suite, test_print_addr, NULL);
+    abts_run_test(suite, test_ip_text, NULL);
     abts_run_test(suite, test_get_addr, NULL);
     abts_run_test(suite, test_wait, NULL);
+    abts_run_test(suite, test_brigade_write, NULL);
+    abts_run_test(suite, test_brigade_splice, NULL);
     abts_run_test(suite, test_nonblock_inheritance, NULL);
     abts_run_test(suite, test_freebind, NULL);
+    abts_run_test(suite, test_reuseport_group, NULL);
+    abts_run_test(suite, test_zerocopy, NULL);
+    abts_run_test(suite, test_kernel_timeout, NULL);
+    abts_run_test(suite, test_adaptive_wait, NULL);
+    abts_run_test(suite, test_accept_batch, NULL);
+    abts_run_test(suite, test_connect_any, NULL);
     abts_run_test(suite, test_zone, NULL);
 #if APR_HAVE_SOCKADDR_UN
     socket_name = UNIX_SOCKET_NAME;
@@ -762,6 +1610,9 @@ abts_suite *testsock(abts_suite *suite)
     abts_run_test(suite, test_recv, NULL);
     abts_run_test(suite, test_timeout, NULL);
     abts_run_test(suite, test_wait, NULL);
+    abts_run_test(suite, test_brigade_write, NULL);
+    abts_run_test(suite, test_brigade_splice, NULL);
+    abts_run_test(suite, test_descriptors, NULL);
 #endif
     return suite;
 }
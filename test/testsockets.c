@@ -192,6 +192,124 @@ static void sendto_receivefrom6(abts_case *tc, void *data)
 }
 #endif
 
+static void sendmmsg_recvmmsg(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_socket_t *sock, *sock2;
+    apr_sockaddr_t *sa, *to, *from[4];
+    apr_socket_msg_t msgs[4];
+    struct iovec vec[5];
+    char recvbuf[4][16];
+    const char *expected[] = { "one", "two", "three" };
+    apr_int32_t n;
+    int i, total;
+
+    rv = apr_sockaddr_info_get(&sa, "127.0.0.1", APR_INET, 0, 0, p);
+    APR_ASSERT_SUCCESS(tc, "Problem generating sockaddr", rv);
+    rv = apr_socket_create(&sock, APR_INET, SOCK_DGRAM, 0, p);
+    APR_ASSERT_SUCCESS(tc, "Problem creating socket", rv);
+    rv = apr_socket_create(&sock2, APR_INET, SOCK_DGRAM, 0, p);
+    APR_ASSERT_SUCCESS(tc, "Problem creating second socket", rv);
+    rv = apr_socket_bind(sock, sa);
+    APR_ASSERT_SUCCESS(tc, "Could not bind socket", rv);
+    rv = apr_socket_bind(sock2, sa);
+    APR_ASSERT_SUCCESS(tc, "Could not bind second socket", rv);
+    rv = apr_socket_addr_get(&to, APR_LOCAL, sock);
+    APR_ASSERT_SUCCESS(tc, "Could not get local address", rv);
+    rv = apr_socket_timeout_set(sock, apr_time_from_sec(5));
+    APR_ASSERT_SUCCESS(tc, "Could not set timeout", rv);
+
+    /* The last datagram is gathered from two buffers */
+    vec[0].iov_base = "one";
+    vec[0].iov_len = 3;
+    vec[1].iov_base = "two";
+    vec[1].iov_len = 3;
+    vec[2].iov_base = "th";
+    vec[2].iov_len = 2;
+    vec[3].iov_base = "ree";
+    vec[3].iov_len = 3;
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < 3; i++) {
+        msgs[i].addr = to;
+        msgs[i].vec = &vec[i];
+        msgs[i].nvec = 1;
+    }
+    msgs[2].nvec = 2;
+
+    n = 3;
+    rv = apr_socket_sendmmsg(sock2, msgs, &n, 0);
+    if (rv == APR_ENOTIMPL) {
+        /* Without gathering, send the first two datagrams and "three" */
+        vec[2].iov_base = "three";
+        vec[2].iov_len = 5;
+        msgs[2].nvec = 1;
+        n = 3;
+        rv = apr_socket_sendmmsg(sock2, msgs, &n, 0);
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 3, n);
+    ABTS_SIZE_EQUAL(tc, 5, msgs[2].len);
+
+    /* Some platforms receive one datagram per call */
+    for (total = 0; total < 3; total += n) {
+        for (i = 0; i < 4; i++) {
+            rv = apr_sockaddr_info_get(&from[i], "127.1.2.3", APR_INET,
+                                       4242, 0, p);
+            APR_ASSERT_SUCCESS(tc, "Problem generating sockaddr", rv);
+            memset(recvbuf[i], 0, sizeof(recvbuf[i]));
+            vec[i].iov_base = recvbuf[i];
+            vec[i].iov_len = sizeof(recvbuf[i]) - 1;
+            msgs[i].addr = from[i];
+            msgs[i].vec = &vec[i];
+            msgs[i].nvec = 1;
+        }
+        n = 4;
+        rv = apr_socket_recvmmsg(sock, msgs, &n, 0);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+        ABTS_ASSERT(tc, "too many datagrams", n >= 1 && total + n <= 3);
+        for (i = 0; i < n && total + i < 3; i++) {
+            char *ip;
+
+            ABTS_SIZE_EQUAL(tc, strlen(expected[total + i]), msgs[i].len);
+            ABTS_STR_EQUAL(tc, expected[total + i], recvbuf[i]);
+            apr_sockaddr_ip_get(&ip, from[i]);
+            ABTS_STR_EQUAL(tc, "127.0.0.1", ip);
+        }
+    }
+
+    /* A datagram split in two segments by the kernel */
+    vec[0].iov_base = "abcdef";
+    vec[0].iov_len = 6;
+    msgs[0].addr = to;
+    msgs[0].vec = &vec[0];
+    msgs[0].nvec = 1;
+    msgs[0].segment_size = 3;
+    n = 1;
+    rv = apr_socket_sendmmsg(sock2, msgs, &n, 0);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "UDP_SEGMENT");
+    }
+    else {
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_INT_EQUAL(tc, 1, n);
+        for (i = 0; i < 2; i++) {
+            apr_size_t len = sizeof(recvbuf[0]);
+
+            rv = apr_socket_recvfrom(from[0], sock, 0, recvbuf[0], &len);
+            ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+            ABTS_SIZE_EQUAL(tc, 3, len);
+            ABTS_ASSERT(tc, "unexpected segment",
+                        memcmp(recvbuf[0], i ? "def" : "abc", 3) == 0);
+        }
+    }
+
+    apr_socket_close(sock);
+    apr_socket_close(sock2);
+}
+
 static void socket_userdata(abts_case *tc, void *data)
 {
     apr_socket_t *sock1, *sock2;
@@ -225,6 +343,7 @@ abts_suite *testsockets(abts_suite *suite)
     abts_run_test(suite, udp_socket, NULL);
 
     abts_run_test(suite, sendto_receivefrom, NULL);
+    abts_run_test(suite, sendmmsg_recvmmsg, NULL);
 
 #if APR_HAVE_IPV6
     abts_run_test(suite, tcp6_socket, NULL);
@@ -384,6 +384,68 @@ static void snprintf_overflow(abts_case *tc, void *data)
     ABTS_TRUE(tc, buf[2] == '4' && buf[3] == '2');
 }
 
+/* The tokens of input joined by '|' */
+static const char *tokens(const char *input, apr_ssize_t len,
+                          const char *sep, int flags)
+{
+    apr_cstr_tokiter_t it;
+    const char *token, *res = NULL;
+    apr_size_t tlen;
+
+    apr_cstr_tokiter_init(&it, input, len, sep, flags);
+    while (apr_cstr_tokiter_next(&it, &token, &tlen)) {
+        const char *t = apr_pstrmemdup(p, token, tlen);
+        res = res ? apr_pstrcat(p, res, "|", t, NULL) : t;
+    }
+    return res ? res : "";
+}
+
+static void string_tokiter(abts_case *tc, void *data)
+{
+    const char *list = "  gzip, deflate ,,br;q=0.5 ,";
+    const char *params = "a=1; b=\"x; y\"; c=\"\\\"; d\" ;";
+    char big[100];
+    apr_array_header_t *arr;
+
+    ABTS_STR_EQUAL(tc, "  gzip| deflate |br;q=0.5 ",
+                   tokens(list, -1, ",", 0));
+    ABTS_STR_EQUAL(tc, "gzip|deflate|br;q=0.5",
+                   tokens(list, -1, ",", APR_CSTR_TOK_TRIM));
+    ABTS_STR_EQUAL(tc, "gzip|deflate||br;q=0.5|",
+                   tokens(list, -1, ",",
+                          APR_CSTR_TOK_TRIM | APR_CSTR_TOK_EMPTY));
+    ABTS_STR_EQUAL(tc, "gzip|deflate|br|q=0.5",
+                   tokens(list, -1, ",; ", 0));
+    ABTS_STR_EQUAL(tc, "  gzip| def", tokens(list, 11, ",", 0));
+    ABTS_STR_EQUAL(tc, "", tokens("", -1, ",", 0));
+    ABTS_STR_EQUAL(tc, "", tokens("", -1, ",", APR_CSTR_TOK_EMPTY));
+
+    /* Quoted strings keep their separators, quotes and escapes */
+    ABTS_STR_EQUAL(tc, "a=1|b=\"x; y\"|c=\"\\\"; d\"",
+                   tokens(params, -1, ";",
+                          APR_CSTR_TOK_TRIM | APR_CSTR_TOK_QUOTED));
+    ABTS_STR_EQUAL(tc, "a=1| b=\"x| y\"| c=\"\\\"| d\" ",
+                   tokens(params, -1, ";", 0));
+
+    /* Long tokens, more separators than the vectorized search handles */
+    memset(big, 'x', sizeof(big));
+    big[40] = ',';
+    big[77] = '\t';
+    ABTS_STR_EQUAL(tc, apr_pstrcat(p, apr_pstrmemdup(p, big, 40), "|",
+                                   apr_pstrmemdup(p, big + 41, 59), NULL),
+                   tokens(big, sizeof(big), ",", APR_CSTR_TOK_TRIM));
+    ABTS_STR_EQUAL(tc, apr_pstrcat(p, apr_pstrmemdup(p, big, 40), "|",
+                                   apr_pstrmemdup(p, big + 41, 36), "|",
+                                   apr_pstrmemdup(p, big + 78, 22), NULL),
+                   tokens(big, sizeof(big), ",;: \t", 0));
+
+    arr = apr_cstr_split(list, ",", TRUE, p);
+    ABTS_INT_EQUAL(tc, 3, arr->nelts);
+    ABTS_STR_EQUAL(tc, "gzip", APR_ARRAY_IDX(arr, 0, const char *));
+    ABTS_STR_EQUAL(tc, "deflate", APR_ARRAY_IDX(arr, 1, const char *));
+    ABTS_STR_EQUAL(tc, "br;q=0.5", APR_ARRAY_IDX(arr, 2, const char *));
+}
+
 static void skip_prefix(abts_case *tc, void *data)
 {
     ABTS_STR_EQUAL(tc, apr_cstr_skip_prefix("12345", "12345"), "");
@@ -395,6 +457,122 @@ static void skip_prefix(abts_case *tc, void *data)
     ABTS_STR_EQUAL(tc, apr_cstr_skip_prefix("",      "12"),    NULL);
 }
 
+static int ref_fold(int c)
+{
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+static int ref_casecmpn(const char *s1, const char *s2, apr_size_t n)
+{
+    const unsigned char *u1 = (const unsigned char *)s1;
+    const unsigned char *u2 = (const unsigned char *)s2;
+
+    for (; n; n--, u1++, u2++) {
+        int cmp = ref_fold(*u1) - ref_fold(*u2);
+        if (cmp || !*u1) {
+            return cmp;
+        }
+    }
+    return 0;
+}
+
+static int sign(int x)
+{
+    return (x > 0) - (x < 0);
+}
+
+static void string_casecmp(abts_case *tc, void *data)
+{
+    /* Twice a page, to put the strings anywhere across a boundary */
+    char *buf1 = apr_palloc(p, 3 * 4096), *buf2 = apr_palloc(p, 3 * 4096);
+    char *page1 = (char *)(((apr_uintptr_t)buf1 + 4095) & ~(apr_uintptr_t)4095);
+    char *page2 = (char *)(((apr_uintptr_t)buf2 + 4095) & ~(apr_uintptr_t)4095);
+    int i, c;
+
+    ABTS_INT_EQUAL(tc, 0, apr_cstr_casecmp("", ""));
+    ABTS_INT_EQUAL(tc, 0, apr_cstr_casecmp("Content-Length",
+                                           "content-LENGTH"));
+    ABTS_INT_EQUAL(tc, 1, apr_cstr_casecmp("ab", "A") > 0);
+    ABTS_INT_EQUAL(tc, 1, apr_cstr_casecmp("a", "AB") < 0);
+    ABTS_INT_EQUAL(tc, 1, apr_cstr_casecmp("[", "a") < 0);
+    ABTS_INT_EQUAL(tc, 0, apr_cstr_casecmpn("abcX", "ABCy", 3));
+    ABTS_INT_EQUAL(tc, 0, apr_cstr_casecmpn("abc", "ABC", 100));
+
+    /* Only A-Z fold */
+    for (c = 1; c < 256; c++) {
+        char s1[2], s2[2];
+
+        s1[0] = (char)c;
+        s1[1] = '\0';
+        s2[0] = (char)ref_fold(c);
+        s2[1] = '\0';
+        ABTS_INT_EQUAL(tc, 0, apr_cstr_casecmp(s1, s2));
+        s2[0] = (char)(c ^ 0x20);
+        ABTS_INT_EQUAL(tc, sign(ref_casecmpn(s1, s2, 2)),
+                       sign(apr_cstr_casecmp(s1, s2)));
+    }
+
+    srand(42);
+    for (i = 0; i < 20000; i++) {
+        apr_size_t len = rand() % 70, n = rand() % 80, j;
+        char *s1 = page1 + 4096 - 40 + rand() % 60 - (int)len;
+        char *s2 = page2 + 4096 - 40 + rand() % 60 - (int)len;
+
+        for (j = 0; j < len; j++) {
+            s1[j] = (char)(rand() % 4 ? 'a' + rand() % 26 : rand() % 255 + 1);
+            s2[j] = (char)(rand() % 2 ? apr_toupper(s1[j]) : s1[j]);
+        }
+        s1[len] = s2[len] = '\0';
+        if (len && rand() % 2) {
+            /* a difference, or an early end */
+            s2[rand() % len] = (char)(rand() % 256);
+        }
+        ABTS_INT_EQUAL(tc, sign(ref_casecmpn(s1, s2, (apr_size_t)-1)),
+                       sign(apr_cstr_casecmp(s1, s2)));
+        ABTS_INT_EQUAL(tc, sign(ref_casecmpn(s1, s2, n)),
+                       sign(apr_cstr_casecmpn(s1, s2, n)));
+    }
+}
+
+static void string_tolower(abts_case *tc, void *data)
+{
+    char *buf = apr_palloc(p, 3 * 4096);
+    char *page = (char *)(((apr_uintptr_t)buf + 4095) & ~(apr_uintptr_t)4095);
+    char s[] = "Hello, WORLD! [@`{] \xc9t\xe9";
+    int i;
+
+    apr_cstr_tolower(s);
+    ABTS_STR_EQUAL(tc, "hello, world! [@`{] \xc9t\xe9", s);
+    apr_cstr_toupper(s);
+    ABTS_STR_EQUAL(tc, "HELLO, WORLD! [@`{] \xc9T\xe9", s);
+    s[0] = '\0';
+    apr_cstr_tolower(s);
+    ABTS_STR_EQUAL(tc, "", s);
+
+    srand(7);
+    for (i = 0; i < 5000; i++) {
+        apr_size_t len = rand() % 70, j;
+        char *str = page + 4096 - 40 + rand() % 60 - (int)len;
+        char lower[80], upper[80];
+
+        for (j = 0; j < len; j++) {
+            str[j] = (char)(rand() % 255 + 1);
+            lower[j] = (char)ref_fold((unsigned char)str[j]);
+            upper[j] = (str[j] >= 'a' && str[j] <= 'z')
+                       ? str[j] - 'a' + 'A' : str[j];
+        }
+        str[len] = lower[len] = upper[len] = '\0';
+        /* nothing past the NUL is touched */
+        str[len + 1] = 'A';
+
+        apr_cstr_toupper(str);
+        ABTS_STR_EQUAL(tc, upper, str);
+        apr_cstr_tolower(str);
+        ABTS_STR_EQUAL(tc, lower, str);
+        ABTS_INT_EQUAL(tc, 'A', str[len + 1]);
+    }
+}
+
 static void pstrcat(abts_case *tc, void *data)
 {
     ABTS_STR_EQUAL(tc, apr_pstrcat(p, "a", "bc", "def", NULL),
@@ -426,7 +604,10 @@ abts_suite *teststr(abts_suite *suite)
     abts_run_test(suite, string_cpystrn, NULL);
     abts_run_test(suite, snprintf_overflow, NULL);
     abts_run_test(suite, skip_prefix, NULL);
+    abts_run_test(suite, string_tokiter, NULL);
     abts_run_test(suite, pstrcat, NULL);
+    abts_run_test(suite, string_casecmp, NULL);
+    abts_run_test(suite, string_tolower, NULL);
 
     return suite;
 }
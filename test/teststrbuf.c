@@ -0,0 +1,192 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_strbuf.h"
+#include "apr_strings.h"
+#include "apr_general.h"
+#include "testutil.h"
+
+static void test_empty(abts_case *tc, void *data)
+{
+    apr_strbuf_t sb;
+    apr_size_t len = 1;
+    char *s;
+
+    apr_strbuf_init(&sb, p, 0);
+    ABTS_STR_EQUAL(tc, "", sb.data);
+    s = apr_strbuf_finish(&sb, &len);
+    ABTS_STR_EQUAL(tc, "", s);
+    ABTS_SIZE_EQUAL(tc, 0, len);
+
+    apr_strbuf_init(&sb, p, 16);
+    apr_strbuf_appendstr(&sb, "");
+    apr_strbuf_append(&sb, "ignored", 0);
+    ABTS_STR_EQUAL(tc, "", apr_strbuf_finish(&sb, NULL));
+}
+
+static void test_append(abts_case *tc, void *data)
+{
+    apr_strbuf_t sb;
+    char *s, *expect = "";
+    apr_size_t len;
+    int i;
+
+    apr_strbuf_init(&sb, p, 0);
+    for (i = 0; i < 1000; i++) {
+        char piece[16];
+
+        apr_snprintf(piece, sizeof piece, "%d,", i);
+        switch (i % 3) {
+        case 0:
+            apr_strbuf_appendstr(&sb, piece);
+            break;
+        case 1:
+            apr_strbuf_append(&sb, piece, strlen(piece));
+            break;
+        default:
+            apr_strbuf_appendf(&sb, "%d", i);
+            apr_strbuf_appendc(&sb, ',');
+            break;
+        }
+        expect = apr_pstrcat(p, expect, piece, NULL);
+        ABTS_SIZE_EQUAL(tc, strlen(expect), sb.len);
+    }
+    ABTS_STR_EQUAL(tc, expect, sb.data);
+    ABTS_ASSERT(tc, "room for the NUL", sb.size > sb.len);
+
+    s = apr_strbuf_finish(&sb, &len);
+    ABTS_STR_EQUAL(tc, expect, s);
+    ABTS_SIZE_EQUAL(tc, strlen(expect), len);
+    ABTS_SIZE_EQUAL(tc, 0, sb.len);
+}
+
+static void test_appendf(abts_case *tc, void *data)
+{
+    apr_strbuf_t sb;
+    char *big = apr_palloc(p, 10001);
+    char *s;
+
+    memset(big, 'x', 10000);
+    big[10000] = '\0';
+
+    /* Formatting flushes more than once */
+    apr_strbuf_init(&sb, p, 1);
+    apr_strbuf_appendf(&sb, "[%s|%5d|%s]", big, 42, big);
+    s = apr_strbuf_finish(&sb, NULL);
+    ABTS_STR_EQUAL(tc, apr_psprintf(p, "[%s|%5d|%s]", big, 42, big), s);
+
+    apr_strbuf_init(&sb, p, 0);
+    apr_strbuf_appendstr(&sb, "a");
+    apr_strbuf_appendf(&sb, "%s", "");
+    apr_strbuf_appendf(&sb, "%c%c", 'b', 'c');
+    ABTS_STR_EQUAL(tc, "abc", apr_strbuf_finish(&sb, NULL));
+}
+
+static void test_reserve(abts_case *tc, void *data)
+{
+    apr_strbuf_t sb;
+    char *w;
+
+    apr_strbuf_init(&sb, p, 0);
+    apr_strbuf_appendstr(&sb, "head:");
+    w = apr_strbuf_reserve(&sb, 1000);
+    ABTS_PTR_EQUAL(tc, sb.data + sb.len, w);
+    ABTS_ASSERT(tc, "reserved", sb.size - sb.len > 1000);
+    memset(w, 'z', 1000);
+    sb.len += 3;
+    sb.data[sb.len] = '\0';
+    apr_strbuf_appendstr(&sb, ":tail");
+    ABTS_STR_EQUAL(tc, "head:zzz:tail", apr_strbuf_finish(&sb, NULL));
+}
+
+static void test_in_place(abts_case *tc, void *data)
+{
+#if APR_POOL_DEBUG
+    ABTS_NOT_IMPL(tc, "in place growth with APR_POOL_DEBUG");
+#else
+    apr_pool_t *subp;
+    apr_strbuf_t sb;
+    char *first, *s, *next;
+    int i;
+
+    APR_ASSERT_SUCCESS(tc, "create pool", apr_pool_create(&subp, p));
+
+    apr_strbuf_init(&sb, subp, 0);
+    apr_strbuf_appendc(&sb, 'a');
+    first = sb.data;
+    /* Doubling from the first size, stays in the pool's first memnode */
+    for (i = 1; i < 1000; i++) {
+        apr_strbuf_appendc(&sb, 'a');
+    }
+    ABTS_PTR_EQUAL(tc, first, sb.data);
+    ABTS_ASSERT(tc, "doubled", sb.size >= 1001);
+
+    /* The unused tail is given back */
+    s = apr_strbuf_finish(&sb, NULL);
+    ABTS_PTR_EQUAL(tc, first, s);
+    next = apr_palloc(subp, 1);
+    ABTS_PTR_EQUAL(tc, s + APR_ALIGN_DEFAULT(1001), next);
+
+    /* Not the last block anymore, then copied */
+    apr_strbuf_init(&sb, subp, 8);
+    first = sb.data;
+    apr_palloc(subp, 8);
+    apr_strbuf_appendstr(&sb, "0123456789");
+    ABTS_ASSERT(tc, "copied", first != sb.data);
+    ABTS_STR_EQUAL(tc, "0123456789", sb.data);
+
+    apr_pool_destroy(subp);
+#endif
+}
+
+static void test_presize(abts_case *tc, void *data)
+{
+    apr_pool_t *subp;
+    char *mem, *other;
+
+    APR_ASSERT_SUCCESS(tc, "create pool", apr_pool_create(&subp, p));
+
+    mem = apr_palloc(subp, 10);
+    ABTS_INT_EQUAL(tc, 1, apr_presize(subp, mem, 10, 5));
+#if !APR_POOL_DEBUG
+    ABTS_INT_EQUAL(tc, 1, apr_presize(subp, mem, 5, 100));
+    ABTS_INT_EQUAL(tc, 0, apr_presize(subp, mem, 100, 1024 * 1024));
+    other = apr_palloc(subp, 1);
+    ABTS_PTR_EQUAL(tc, mem + 104, other);
+    ABTS_INT_EQUAL(tc, 0, apr_presize(subp, mem, 100, 200));
+    ABTS_INT_EQUAL(tc, 1, apr_presize(subp, mem, 100, 50));
+    ABTS_INT_EQUAL(tc, 1, apr_presize(subp, other, 1, 64));
+#else
+    other = apr_palloc(subp, 1);
+    ABTS_INT_EQUAL(tc, 0, apr_presize(subp, other, 1, 64));
+#endif
+
+    apr_pool_destroy(subp);
+}
+
+abts_suite *teststrbuf(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+    abts_run_test(suite, test_empty, NULL);
+    abts_run_test(suite, test_append, NULL);
+    abts_run_test(suite, test_appendf, NULL);
+    abts_run_test(suite, test_reserve, NULL);
+    abts_run_test(suite, test_in_place, NULL);
+    abts_run_test(suite, test_presize, NULL);
+
+    return suite;
+}
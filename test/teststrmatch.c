@@ -19,6 +19,8 @@
 #include "apr.h"
 #include "apr_general.h"
 #include "apr_strmatch.h"
+#include "apr_strings.h"
+#include "apr_lib.h"
 #if APR_HAVE_STDLIB_H
 #include <stdlib.h>
 #endif
@@ -81,11 +83,289 @@ static void test_str(abts_case *tc, void *data)
     ABTS_PTR_EQUAL(tc, input6 + 35, match);
 }
 
+/* the first match of the naive search */
+static const char *naive_match(const char *pat, apr_size_t plen,
+                               const char *s, apr_size_t slen,
+                               int case_sensitive)
+{
+    apr_size_t i, j;
+
+    for (i = 0; i + plen <= slen; i++) {
+        for (j = 0; j < plen; j++) {
+            if (case_sensitive ? s[i + j] != pat[j]
+                               : apr_tolower(s[i + j]) != apr_tolower(pat[j])) {
+                break;
+            }
+        }
+        if (j == plen) {
+            return s + i;
+        }
+    }
+    return NULL;
+}
+
+/* the patterns of all lengths, at all the offsets of texts of all
+ * lengths, around the vectors and the long patterns' capped shifts
+ */
+static void test_str_offsets(abts_case *tc, void *data)
+{
+    static const apr_size_t plens[] = { 1, 2, 3, 7, 15, 16, 17, 31, 300 };
+    apr_pool_t *pool;
+    char *text, *pat;
+    apr_size_t n, i, off, tlen;
+    int cs;
+
+    apr_pool_create(&pool, p);
+    text = apr_palloc(pool, 1024);
+    pat = apr_palloc(pool, 301);
+
+    for (n = 0; n < sizeof(plens) / sizeof(plens[0]); n++) {
+        apr_size_t plen = plens[n];
+
+        /* near misses all over the text */
+        for (i = 0; i < plen; i++) {
+            pat[i] = (i % 5 == 4) ? 'X' : 'a' + (char)(i % 3);
+        }
+        pat[plen] = '\0';
+
+        for (cs = 0; cs <= 1; cs++) {
+            const apr_strmatch_pattern *pattern;
+
+            pattern = apr_strmatch_precompile(pool, pat, cs);
+            for (tlen = plen; tlen < plen + 70; tlen += 3) {
+                for (off = 0; off + plen <= tlen; off++) {
+                    const char *want, *got;
+
+                    for (i = 0; i < tlen; i++) {
+                        text[i] = 'a' + (char)(i % 3);
+                    }
+                    memcpy(text + off, pat, plen);
+                    if (!cs) {
+                        text[off] = apr_toupper(text[off]);
+                        text[off + plen - 1] = apr_toupper(text[off + plen - 1]);
+                    }
+                    want = naive_match(pat, plen, text, tlen, cs);
+                    got = apr_strmatch(pattern, text, tlen);
+                    ABTS_PTR_EQUAL(tc, want, got);
+
+                    /* and not found */
+                    text[off + plen / 2] = '#';
+                    want = naive_match(pat, plen, text, tlen, cs);
+                    got = apr_strmatch(pattern, text, tlen);
+                    ABTS_PTR_EQUAL(tc, want, got);
+                }
+            }
+        }
+    }
+
+    apr_pool_destroy(pool);
+}
+
+/* the bytes above 0x7f of a nocase pattern match themselves */
+static void test_str_nonascii(abts_case *tc, void *data)
+{
+    static const char *const patterns[] = {
+        "\xe9", "\xc3\xa9", "CAF\xc3\xa9", "caf\xc3\xa9 au lait \xff!"
+    };
+    const char *input = "Un petit caf\xc3\xa9 au lait \xff! Un CAF\xc3\xa9 noir."
+                        " Un caf\xc3\xa9 au lait \xff! Caf\xe9.";
+    apr_size_t ilen = strlen(input);
+    const apr_strmatch_pattern *pattern;
+    apr_strmatch_stream_t *stream;
+    apr_off_t offset;
+    apr_size_t used;
+    int i;
+
+    for (i = 0; i < (int)(sizeof(patterns) / sizeof(patterns[0])); i++) {
+        const char *want = naive_match(patterns[i], strlen(patterns[i]),
+                                       input, ilen, 0);
+
+        ABTS_PTR_NOTNULL(tc, want);
+        pattern = apr_strmatch_precompile(p, patterns[i], 0);
+        ABTS_PTR_EQUAL(tc, want, apr_strmatch(pattern, input, ilen));
+
+        stream = apr_strmatch_stream_create(p, pattern);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                       apr_strmatch_stream(stream, input, ilen, &offset,
+                                           &used));
+        ABTS_INT_EQUAL(tc, (int)(want - input), (int)offset);
+    }
+}
+
+/* a pattern over strings split at all the places */
+static void test_stream(abts_case *tc, void *data)
+{
+    apr_pool_t *pool = p;
+    const char *input = "patpattern at pattern, and ppatternn";
+    apr_size_t ilen = strlen(input);
+    const apr_strmatch_pattern *pattern;
+    apr_strmatch_stream_t *stream;
+    apr_off_t offset;
+    apr_size_t used, cut1, cut2;
+
+    pattern = apr_strmatch_precompile(pool, "", 1);
+    ABTS_PTR_EQUAL(tc, NULL, apr_strmatch_stream_create(pool, pattern));
+
+    pattern = apr_strmatch_precompile(pool, "pattern", 1);
+    stream = apr_strmatch_stream_create(pool, pattern);
+    ABTS_PTR_NOTNULL(tc, stream);
+
+    for (cut1 = 0; cut1 <= ilen; cut1++) {
+        for (cut2 = cut1; cut2 <= ilen; cut2++) {
+            const char *s[3];
+            apr_size_t slen[3];
+            apr_off_t found[4];
+            int i, n = 0;
+
+            s[0] = input;
+            slen[0] = cut1;
+            s[1] = input + cut1;
+            slen[1] = cut2 - cut1;
+            s[2] = input + cut2;
+            slen[2] = ilen - cut2;
+
+            apr_strmatch_stream_reset(stream);
+            for (i = 0; i < 3; i++) {
+                while (apr_strmatch_stream(stream, s[i], slen[i], &offset,
+                                           &used) == APR_SUCCESS) {
+                    if (n < 4) {
+                        found[n] = offset;
+                    }
+                    n++;
+                    s[i] += used;
+                    slen[i] -= used;
+                }
+                ABTS_SIZE_EQUAL(tc, slen[i], used);
+            }
+            ABTS_INT_EQUAL(tc, 3, n);
+            ABTS_INT_EQUAL(tc, 3, (int)found[0]);
+            ABTS_INT_EQUAL(tc, 14, (int)found[1]);
+            ABTS_INT_EQUAL(tc, 28, (int)found[2]);
+            ABTS_INT_EQUAL(tc, (int)ilen, (int)stream->offset);
+        }
+    }
+}
+
+typedef struct multi_match_t {
+    int n;
+    int pattern[8];
+    apr_off_t offset[8];
+} multi_match_t;
+
+static int multi_cb(void *baton, int pattern, apr_off_t offset)
+{
+    multi_match_t *m = baton;
+
+    if (m->n < 8) {
+        m->pattern[m->n] = pattern;
+        m->offset[m->n] = offset;
+    }
+    m->n++;
+    return 0;
+}
+
+static void test_multi(abts_case *tc, void *data)
+{
+    apr_pool_t *pool = p;
+    static const char * const patterns[] = { "he", "she", "his", "hers" };
+    static const char * const empty[] = { "a", "" };
+    const apr_strmatch_multi_t *multi, *multi_nocase;
+    apr_strmatch_multi_state_t state;
+    multi_match_t m;
+    const char *input = "ushers";
+    const char *upper = "USHERS";
+    const char *match;
+    int which = -1;
+
+    ABTS_PTR_EQUAL(tc, NULL, apr_strmatch_multi_precompile(pool, patterns,
+                                                           0, 0));
+    ABTS_PTR_EQUAL(tc, NULL, apr_strmatch_multi_precompile(pool, empty,
+                                                           2, 0));
+
+    multi = apr_strmatch_multi_precompile(pool, patterns, 4, 0);
+    ABTS_PTR_NOTNULL(tc, multi);
+
+    memset(&m, 0, sizeof(m));
+    apr_strmatch_multi_init(multi, &state);
+    ABTS_INT_EQUAL(tc, 0, apr_strmatch_multi_scan(&state, input, 6,
+                                                  multi_cb, &m));
+    ABTS_INT_EQUAL(tc, 3, m.n);
+    ABTS_INT_EQUAL(tc, 1, m.pattern[0]);
+    ABTS_INT_EQUAL(tc, 1, (int)m.offset[0]);
+    ABTS_INT_EQUAL(tc, 0, m.pattern[1]);
+    ABTS_INT_EQUAL(tc, 2, (int)m.offset[1]);
+    ABTS_INT_EQUAL(tc, 3, m.pattern[2]);
+    ABTS_INT_EQUAL(tc, 2, (int)m.offset[2]);
+    ABTS_INT_EQUAL(tc, 6, (int)state.offset);
+
+    /* the same across several strings */
+    memset(&m, 0, sizeof(m));
+    apr_strmatch_multi_init(multi, &state);
+    apr_strmatch_multi_scan(&state, "us", 2, multi_cb, &m);
+    apr_strmatch_multi_scan(&state, "h", 1, multi_cb, &m);
+    apr_strmatch_multi_scan(&state, "ers", 3, multi_cb, &m);
+    ABTS_INT_EQUAL(tc, 3, m.n);
+    ABTS_INT_EQUAL(tc, 1, (int)m.offset[0]);
+    ABTS_INT_EQUAL(tc, 3, m.pattern[2]);
+    ABTS_INT_EQUAL(tc, 2, (int)m.offset[2]);
+
+    match = apr_strmatch_multi(multi, input, 6, &which);
+    ABTS_PTR_EQUAL(tc, input + 1, match);
+    ABTS_INT_EQUAL(tc, 1, which);
+
+    match = apr_strmatch_multi(multi, "that is it", 10, &which);
+    ABTS_PTR_EQUAL(tc, NULL, match);
+
+    match = apr_strmatch_multi(multi, "USHERS his", 10, &which);
+    ABTS_INT_EQUAL(tc, 2, which);
+
+    multi_nocase = apr_strmatch_multi_precompile(pool, patterns, 4,
+                                                 APR_STRMATCH_MULTI_NOCASE);
+    ABTS_PTR_NOTNULL(tc, multi_nocase);
+    match = apr_strmatch_multi(multi_nocase, upper, 6, &which);
+    ABTS_PTR_EQUAL(tc, upper + 1, match);
+}
+
+/* many patterns, beyond the transition table */
+static void test_multi_large(abts_case *tc, void *data)
+{
+    apr_pool_t *pool = p;
+    const apr_strmatch_multi_t *multi;
+    apr_strmatch_multi_state_t state;
+    const char **patterns;
+    char *text;
+    multi_match_t m;
+    int i, n = 8000;
+
+    patterns = apr_palloc(pool, n * sizeof(char *));
+    for (i = 0; i < n; i++) {
+        patterns[i] = apr_psprintf(pool, "key%05d-%08x", i,
+                                   (unsigned int)i * 2654435761u);
+    }
+    multi = apr_strmatch_multi_precompile(pool, patterns, n, 0);
+    ABTS_PTR_NOTNULL(tc, multi);
+
+    text = apr_pstrcat(pool, "some key00001-", patterns[4321], " and ",
+                       patterns[7999], "key", NULL);
+    memset(&m, 0, sizeof(m));
+    apr_strmatch_multi_init(multi, &state);
+    apr_strmatch_multi_scan(&state, text, strlen(text), multi_cb, &m);
+    ABTS_INT_EQUAL(tc, 2, m.n);
+    ABTS_INT_EQUAL(tc, 4321, m.pattern[0]);
+    ABTS_INT_EQUAL(tc, 14, (int)m.offset[0]);
+    ABTS_INT_EQUAL(tc, 7999, m.pattern[1]);
+}
+
 abts_suite *teststrmatch(abts_suite *suite)
 {
     suite = ADD_SUITE(suite);
 
     abts_run_test(suite, test_str, NULL);
+    abts_run_test(suite, test_str_offsets, NULL);
+    abts_run_test(suite, test_str_nonascii, NULL);
+    abts_run_test(suite, test_stream, NULL);
+    abts_run_test(suite, test_multi, NULL);
+    abts_run_test(suite, test_multi_large, NULL);
 
     return suite;
 }
@@ -0,0 +1,223 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures the throughput of apr_strmatch() for patterns of a few
+ * lengths, case sensitive or not, over a text where they are not found.
+ * Then the one pass search of sets of patterns with apr_strmatch_multi(),
+ * against a pass per pattern.
+ */
+
+#include "apr_strmatch.h"
+#include "apr_pools.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_strings.h"
+#include "apr_time.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Searches per run */
+#define DEFAULT_MAX_COUNTER 200
+/* The length of the text searched */
+#define TEXT_SIZE (256 * 1024)
+
+static long max_counter = DEFAULT_MAX_COUNTER;
+static int verbose = 0;
+
+/* Keep the compiler from optimizing the searches away */
+static volatile const void *sink;
+
+static char *make_text(apr_pool_t *pool)
+{
+    char *text = apr_palloc(pool, TEXT_SIZE + 1);
+    apr_size_t i;
+
+    /* words made of the letters of the patterns, so that they nearly
+     * match as often as with real contents
+     */
+    for (i = 0; i < TEXT_SIZE; i++) {
+        text[i] = (i % 7 == 6) ? ' ' : 'a' + (char)((i * 13 + i / 7) % 26);
+    }
+    text[TEXT_SIZE] = '\0';
+    return text;
+}
+
+static char *make_pattern(apr_pool_t *pool, apr_size_t len, int seed)
+{
+    char *pat = apr_palloc(pool, len + 1);
+    apr_size_t i;
+
+    for (i = 0; i < len; i++) {
+        pat[i] = 'a' + (char)((i * 7 + seed * 3) % 26);
+    }
+    /* not in the text */
+    pat[len - 1] = '!';
+    pat[len] = '\0';
+    return pat;
+}
+
+static void report(const char *name, apr_size_t len,
+                   apr_interval_time_t usecs)
+{
+    printf("    %-28s %4" APR_SIZE_T_FMT " bytes: %8" APR_TIME_T_FMT
+           " usec, %8.2f MB/s\n", name, len, usecs,
+           usecs ? (double)TEXT_SIZE * max_counter / usecs : 0.0);
+}
+
+static apr_interval_time_t bench_single(apr_pool_t *pool, const char *text,
+                                        const char *pat, int case_sensitive)
+{
+    const apr_strmatch_pattern *pattern;
+    apr_time_t start;
+    long i;
+
+    pattern = apr_strmatch_precompile(pool, pat, case_sensitive);
+
+    start = apr_time_now();
+    for (i = 0; i < max_counter; i++) {
+        sink = apr_strmatch(pattern, text, TEXT_SIZE);
+    }
+
+    return apr_time_now() - start;
+}
+
+static apr_interval_time_t bench_passes(apr_pool_t *pool, const char *text,
+                                        const char **pats, int n)
+{
+    const apr_strmatch_pattern **patterns;
+    apr_time_t start;
+    long i;
+    int j;
+
+    patterns = apr_palloc(pool, n * sizeof(*patterns));
+    for (j = 0; j < n; j++) {
+        patterns[j] = apr_strmatch_precompile(pool, pats[j], 1);
+    }
+
+    start = apr_time_now();
+    for (i = 0; i < max_counter; i++) {
+        for (j = 0; j < n; j++) {
+            sink = apr_strmatch(patterns[j], text, TEXT_SIZE);
+        }
+    }
+
+    return apr_time_now() - start;
+}
+
+static apr_interval_time_t bench_multi(apr_pool_t *pool, const char *text,
+                                       const char **pats, int n)
+{
+    const apr_strmatch_multi_t *multi;
+    apr_time_t start;
+    long i;
+
+    multi = apr_strmatch_multi_precompile(pool, pats, n, 0);
+
+    start = apr_time_now();
+    for (i = 0; i < max_counter; i++) {
+        sink = apr_strmatch_multi(multi, text, TEXT_SIZE, NULL);
+    }
+
+    return apr_time_now() - start;
+}
+
+int main(int argc, const char * const *argv)
+{
+    static const apr_size_t lens[] = { 2, 4, 16, 64 };
+    static const int sets[] = { 4, 32, 256 };
+    apr_pool_t *pool, *bench;
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    const char **pats;
+    char *text;
+    int i, j;
+
+    printf("APR String Matching Performance Test\n==============\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "c:v", &optchar, &optarg)) == APR_SUCCESS) {
+        if (optchar == 'c') {
+            max_counter = atol(optarg);
+        }
+        else if (optchar == 'v') {
+            verbose = 1;
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    if (apr_pool_create(&bench, pool) != APR_SUCCESS)
+        exit(-1);
+
+    if (verbose) {
+        printf("%ld searches per run, of %d bytes\n\n",
+               max_counter, TEXT_SIZE);
+    }
+
+    text = make_text(pool);
+
+    for (i = 0; i < (int)(sizeof(lens) / sizeof(lens[0])); i++) {
+        const char *pat = make_pattern(bench, lens[i], 0);
+
+        report("apr_strmatch", lens[i], bench_single(bench, text, pat, 1));
+        report("apr_strmatch (nocase)", lens[i],
+               bench_single(bench, text, pat, 0));
+
+        apr_pool_clear(bench);
+    }
+
+    if (verbose) {
+        printf("\nSets of patterns of 8 bytes\n\n");
+    }
+
+    for (i = 0; i < (int)(sizeof(sets) / sizeof(sets[0])); i++) {
+        char name[64];
+
+        pats = apr_palloc(bench, sets[i] * sizeof(*pats));
+        for (j = 0; j < sets[i]; j++) {
+            pats[j] = make_pattern(bench, 8, j);
+        }
+
+        apr_snprintf(name, sizeof(name), "apr_strmatch x%d", sets[i]);
+        report(name, 8, bench_passes(bench, text, pats, sets[i]));
+        apr_snprintf(name, sizeof(name), "apr_strmatch_multi x%d", sets[i]);
+        report(name, 8, bench_multi(bench, text, pats, sets[i]));
+
+        apr_pool_clear(bench);
+    }
+
+    return 0;
+}
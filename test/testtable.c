@@ -42,6 +42,63 @@ static void array_clear(abts_case *tc, void *data)
     ABTS_INT_EQUAL(tc, 0, a1->nelts);
 }
 
+static void array_push_n(abts_case *tc, void *data)
+{
+    apr_array_header_t *a;
+    apr_pool_t *sub;
+    int *elts, i;
+
+    apr_pool_create(&sub, p);
+    a = apr_array_make(sub, 1, sizeof(int));
+    APR_ARRAY_PUSH(a, int) = 0;
+    elts = apr_array_push_n(a, 99);
+    for (i = 0; i < 99; i++) {
+        ABTS_INT_EQUAL(tc, 0, elts[i]);
+        elts[i] = i + 1;
+    }
+    ABTS_INT_EQUAL(tc, 100, a->nelts);
+    ABTS_TRUE(tc, a->nalloc >= 100);
+
+    apr_array_reserve(a, 200);
+    ABTS_TRUE(tc, a->nalloc >= 200);
+    for (i = 0; i < 200; i++) {
+        APR_ARRAY_PUSH(a, int) = 100 + i;
+    }
+    ABTS_INT_EQUAL(tc, 300, a->nelts);
+    for (i = 0; i < 300; i++) {
+        ABTS_INT_EQUAL(tc, i, APR_ARRAY_IDX(a, i, int));
+    }
+
+    apr_array_shrink_to_fit(a);
+    ABTS_INT_EQUAL(tc, 300, a->nelts);
+    ABTS_TRUE(tc, a->nalloc >= 300);
+    APR_ARRAY_PUSH(a, int) = 300;
+    ABTS_INT_EQUAL(tc, 300, APR_ARRAY_IDX(a, 300, int));
+    ABTS_INT_EQUAL(tc, 299, APR_ARRAY_IDX(a, 299, int));
+
+    apr_pool_destroy(sub);
+}
+
+static int int_cmp(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+static void array_sort(abts_case *tc, void *data)
+{
+    apr_array_header_t *a = apr_array_make(p, 0, sizeof(int));
+    int i;
+
+    apr_array_sort(a, int_cmp);
+    for (i = 0; i < 100; i++) {
+        APR_ARRAY_PUSH(a, int) = (i * 37) % 100;
+    }
+    apr_array_sort(a, int_cmp);
+    for (i = 0; i < 100; i++) {
+        ABTS_INT_EQUAL(tc, i, APR_ARRAY_IDX(a, i, int));
+    }
+}
+
 static void table_make(abts_case *tc, void *data)
 {
     t1 = apr_table_make(p, 5);
@@ -122,6 +179,81 @@ static void table_nelts(abts_case *tc, void *data)
     ABTS_INT_EQUAL(tc, 3, apr_table_elts(t)->nelts);
 }
 
+static void table_copy(abts_case *tc, void *data)
+{
+    apr_table_t *t = apr_table_make(p, 1), *t2, *t3;
+    apr_table_entry_t *elts;
+    apr_pool_t *sub;
+
+    apr_table_set(t, "a", "1");
+    apr_table_set(t, "b", "2");
+
+    /* A copy has its own entries, even written in place */
+    t2 = apr_table_copy(p, t);
+    ABTS_TRUE(tc, apr_table_elts(t)->elts != apr_table_elts(t2)->elts);
+    elts = (apr_table_entry_t *)apr_table_elts(t2)->elts;
+    elts[0].val = "in place";
+    ABTS_STR_EQUAL(tc, "in place", apr_table_get(t2, "a"));
+    ABTS_STR_EQUAL(tc, "1", apr_table_get(t, "a"));
+
+    /* Changes of either table are not seen by the other one */
+    t2 = apr_table_copy_cow(p, t);
+    t3 = apr_table_clone(p, t);
+    ABTS_PTR_EQUAL(tc, apr_table_elts(t)->elts, apr_table_elts(t2)->elts);
+    apr_table_set(t, "a", "changed");
+    apr_table_unset(t, "b");
+    ABTS_STR_EQUAL(tc, "1", apr_table_get(t2, "a"));
+    ABTS_STR_EQUAL(tc, "2", apr_table_get(t3, "b"));
+    apr_table_add(t2, "c", "3");
+    apr_table_set(t3, "a", "cloned");
+    ABTS_INT_EQUAL(tc, 1, apr_table_elts(t)->nelts);
+    ABTS_STR_EQUAL(tc, "changed", apr_table_get(t, "a"));
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, "c"));
+    ABTS_INT_EQUAL(tc, 3, apr_table_elts(t2)->nelts);
+    ABTS_STR_EQUAL(tc, "1", apr_table_get(t2, "a"));
+    ABTS_STR_EQUAL(tc, "cloned", apr_table_get(t3, "a"));
+
+    /* A clone outliving the table has its own keys and values */
+    apr_pool_create(&sub, p);
+    t2 = apr_table_make(sub, 1);
+    apr_table_set(t2, "key", "value");
+    t3 = apr_table_clone(p, t2);
+    ABTS_TRUE(tc, apr_table_elts(t2)->elts != apr_table_elts(t3)->elts);
+    apr_pool_destroy(sub);
+    ABTS_STR_EQUAL(tc, "value", apr_table_get(t3, "key"));
+
+#if !APR_POOL_DEBUG
+    /* So does a copy outliving the table, but for the keys and values */
+    apr_pool_create(&sub, p);
+    t2 = apr_table_make(sub, 1);
+    apr_table_setn(t2, "key", "value");
+    t = apr_table_copy_cow(p, t2);
+    ABTS_TRUE(tc, apr_table_elts(t2)->elts != apr_table_elts(t)->elts);
+    apr_pool_destroy(sub);
+    apr_pool_create(&sub, p);
+    memset(apr_palloc(sub, 4096), 0xff, 4096);
+    ABTS_INT_EQUAL(tc, 1, apr_table_elts(t)->nelts);
+    ABTS_STR_EQUAL(tc, "value", apr_table_get(t, "key"));
+    apr_pool_destroy(sub);
+#endif
+
+    t2 = apr_table_copy_cow(p, t3);
+    apr_table_clear(t2);
+    ABTS_INT_EQUAL(tc, 0, apr_table_elts(t2)->nelts);
+    ABTS_STR_EQUAL(tc, "value", apr_table_get(t3, "key"));
+
+    /* Nor by an overlay on an empty table, which has its own entries */
+    t = apr_table_make(p, 1);
+    apr_table_set(t, "A", "1");
+    t3 = apr_table_copy_cow(p, t);
+    t2 = apr_table_overlay(p, t, apr_table_make(p, 1));
+    ABTS_TRUE(tc, apr_table_elts(t)->elts != apr_table_elts(t2)->elts);
+    apr_table_set(t2, "A", "x");
+    ABTS_STR_EQUAL(tc, "x", apr_table_get(t2, "A"));
+    ABTS_STR_EQUAL(tc, "1", apr_table_get(t, "A"));
+    ABTS_STR_EQUAL(tc, "1", apr_table_get(t3, "A"));
+}
+
 static void table_clear(abts_case *tc, void *data)
 {
     apr_table_clear(t1);
@@ -222,11 +354,161 @@ static void table_overlap3(abts_case *tc, void *data)
 
 }
 
+/* Get the first value of key by scanning the whole table */
+static const char *scan_get(const apr_table_t *t, const char *key)
+{
+    const apr_array_header_t *arr = apr_table_elts(t);
+    const apr_table_entry_t *elts = (const apr_table_entry_t *)arr->elts;
+    int i;
+
+    for (i = 0; i < arr->nelts; i++) {
+        if (!strcasecmp(elts[i].key, key)) {
+            return elts[i].val;
+        }
+    }
+    return NULL;
+}
+
+/* Check all the keys of the big tables, some of them absent */
+static int check_big(const apr_table_t *t)
+{
+    char key[32];
+    int i;
+
+    for (i = 0; i < 300; i++) {
+        apr_snprintf(key, sizeof(key), "%s-%d", i % 2 ? "Accept" : "CONTENT",
+                     i / 2);
+        if (apr_table_get(t, key) != scan_get(t, key)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void table_big(abts_case *tc, void *data)
+{
+    apr_table_t *t = apr_table_make(p, 1), *t2;
+    char key[32];
+    const char *val;
+    int i;
+
+    /* Keys sharing their first characters, in mixed case */
+    for (i = 0; i < 200; i++) {
+        apr_snprintf(key, sizeof(key), "%s-%d", i % 2 ? "accept" : "Content",
+                     i / 2);
+        apr_table_add(t, key, apr_itoa(p, i));
+    }
+    ABTS_INT_EQUAL(tc, 200, apr_table_elts(t)->nelts);
+    ABTS_TRUE(tc, check_big(t));
+    ABTS_STR_EQUAL(tc, "1", apr_table_get(t, "ACCEPT-0"));
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, "Accept-100"));
+
+    /* Multiple values keep their order */
+    apr_table_add(t, "Content-0", "dup");
+    apr_table_add(t, "Accept-1", "dup");
+    ABTS_STR_EQUAL(tc, "0", apr_table_get(t, "content-0"));
+    ABTS_STR_EQUAL(tc, "0,dup", apr_table_getm(p, t, "Content-0"));
+    apr_table_merge(t, "Accept-1", "merged");
+    ABTS_STR_EQUAL(tc, "3, merged,dup", apr_table_getm(p, t, "Accept-1"));
+
+    /* Removals move the following entries */
+    apr_table_set(t, "Content-0", "set");
+    ABTS_STR_EQUAL(tc, "set", apr_table_getm(p, t, "Content-0"));
+    apr_table_unset(t, "Accept-1");
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, "Accept-1"));
+    for (i = 10; i < 50; i++) {
+        apr_snprintf(key, sizeof(key), "Content-%d", i);
+        apr_table_unset(t, key);
+    }
+    ABTS_INT_EQUAL(tc, 159, apr_table_elts(t)->nelts);
+    ABTS_TRUE(tc, check_big(t));
+    apr_table_setn(t, "Accept-99", "last");
+    ABTS_STR_EQUAL(tc, "last", apr_table_get(t, "accept-99"));
+
+    /* And the derived tables */
+    t2 = apr_table_copy(p, t);
+    apr_table_add(t2, "Content-10", "copy");
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, "Content-10"));
+    ABTS_STR_EQUAL(tc, "copy", apr_table_get(t2, "Content-10"));
+    ABTS_TRUE(tc, check_big(t2));
+
+    t2 = apr_table_overlay(p, t2, t);
+    ABTS_INT_EQUAL(tc, 319, apr_table_elts(t2)->nelts);
+    ABTS_TRUE(tc, check_big(t2));
+    apr_table_compress(t2, APR_OVERLAP_TABLES_SET);
+    ABTS_INT_EQUAL(tc, 160, apr_table_elts(t2)->nelts);
+    ABTS_TRUE(tc, check_big(t2));
+
+    t2 = apr_table_clone(p, t);
+    apr_table_overlap(t2, t, APR_OVERLAP_TABLES_ADD);
+    ABTS_INT_EQUAL(tc, 318, apr_table_elts(t2)->nelts);
+    val = apr_table_getm(p, t2, "Accept-2");
+    ABTS_STR_EQUAL(tc, "5,5", val);
+    ABTS_TRUE(tc, check_big(t2));
+
+    apr_table_clear(t);
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, "Content-1"));
+    apr_table_set(t, "Content-1", "again");
+    ABTS_STR_EQUAL(tc, "again", apr_table_get(t, "Content-1"));
+}
+
+static void table_compress(abts_case *tc, void *data)
+{
+    apr_table_t *t = apr_table_make(p, 1), *t2;
+    char key[32];
+    int i;
+
+    /* Small tables */
+    apr_table_addn(t, "a", "1");
+    apr_table_addn(t, "b", "2");
+    apr_table_addn(t, "A", "3");
+    apr_table_addn(t, "c", "4");
+    apr_table_addn(t, "a", "5");
+    t2 = apr_table_copy(p, t);
+    apr_table_compress(t, APR_OVERLAP_TABLES_MERGE);
+    ABTS_INT_EQUAL(tc, 3, apr_table_elts(t)->nelts);
+    ABTS_STR_EQUAL(tc, "1, 3, 5", apr_table_get(t, "a"));
+    ABTS_STR_EQUAL(tc, "2", apr_table_get(t, "b"));
+    ABTS_STR_EQUAL(tc, "4", apr_table_get(t, "c"));
+    apr_table_compress(t2, APR_OVERLAP_TABLES_SET);
+    ABTS_INT_EQUAL(tc, 3, apr_table_elts(t2)->nelts);
+    ABTS_STR_EQUAL(tc, "5", apr_table_get(t2, "a"));
+    ABTS_STR_EQUAL(tc, "a",
+                   ((apr_table_entry_t *)apr_table_elts(t2)->elts)[0].key);
+
+    /* Big ones, the duplicates interleaved */
+    t = apr_table_make(p, 1);
+    for (i = 0; i < 300; i++) {
+        apr_snprintf(key, sizeof(key), "Content-%d", i % 100);
+        apr_table_add(t, key, apr_itoa(p, i));
+    }
+    apr_table_add(t, "content-7", "last");
+    t2 = apr_table_copy(p, t);
+    apr_table_compress(t, APR_OVERLAP_TABLES_MERGE);
+    ABTS_INT_EQUAL(tc, 100, apr_table_elts(t)->nelts);
+    ABTS_STR_EQUAL(tc, "7, 107, 207, last", apr_table_get(t, "Content-7"));
+    ABTS_STR_EQUAL(tc, "99, 199, 299", apr_table_get(t, "Content-99"));
+    apr_table_compress(t2, APR_OVERLAP_TABLES_SET);
+    ABTS_INT_EQUAL(tc, 100, apr_table_elts(t2)->nelts);
+    ABTS_STR_EQUAL(tc, "last", apr_table_get(t2, "Content-7"));
+    for (i = 0; i < 100; i++) {
+        apr_snprintf(key, sizeof(key), "Content-%d", i);
+        ABTS_STR_EQUAL(tc, key,
+                       ((apr_table_entry_t *)apr_table_elts(t2)->elts)[i].key);
+    }
+    ABTS_STR_EQUAL(tc, "250", apr_table_get(t2, "Content-50"));
+    apr_table_unset(t2, "Content-50");
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t2, "Content-50"));
+    ABTS_STR_EQUAL(tc, "251", apr_table_get(t2, "Content-51"));
+}
+
 abts_suite *testtable(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
 
     abts_run_test(suite, array_clear, NULL);
+    abts_run_test(suite, array_push_n, NULL);
+    abts_run_test(suite, array_sort, NULL);
     abts_run_test(suite, table_make, NULL);
     abts_run_test(suite, table_get, NULL);
     abts_run_test(suite, table_getm, NULL);
@@ -234,11 +516,14 @@ abts_suite *testtable(abts_suite *suite)
     abts_run_test(suite, table_getnotthere, NULL);
     abts_run_test(suite, table_add, NULL);
     abts_run_test(suite, table_nelts, NULL);
+    abts_run_test(suite, table_copy, NULL);
     abts_run_test(suite, table_clear, NULL);
     abts_run_test(suite, table_unset, NULL);
     abts_run_test(suite, table_overlap, NULL);
     abts_run_test(suite, table_overlap2, NULL);
     abts_run_test(suite, table_overlap3, NULL);
+    abts_run_test(suite, table_big, NULL);
+    abts_run_test(suite, table_compress, NULL);
 
     return suite;
 }
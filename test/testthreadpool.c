@@ -0,0 +1,513 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_thread_pool.h"
+#include "apr_atomic.h"
+#include "apr_time.h"
+#include "abts.h"
+#include "testutil.h"
+
+#if APR_HAS_THREADS
+
+#define NUM_THREADS  8
+#define NUM_ROOTS    16
+#define NUM_CHILDREN 200
+
+static apr_thread_pool_t *thrp;
+static apr_uint32_t tasks_done;
+static char owner_a, owner_b;
+
+static void * APR_THREAD_FUNC child_task(apr_thread_t *thd, void *data)
+{
+    if (data) {
+        apr_sleep(*(apr_interval_time_t *)data);
+    }
+    apr_atomic_inc32(&tasks_done);
+    return NULL;
+}
+
+/* Push (from a worker) the children of this root task */
+static void * APR_THREAD_FUNC root_task(apr_thread_t *thd, void *data)
+{
+    void *owner;
+    int i;
+
+    apr_thread_pool_task_owner_get(thd, &owner);
+    for (i = 0; i < NUM_CHILDREN; i++) {
+        apr_thread_pool_push(thrp, child_task, data,
+                             (apr_byte_t)(i % 4 * 64), owner);
+    }
+    apr_atomic_inc32(&tasks_done);
+    return NULL;
+}
+
+static apr_thread_start_t batch_funcs[NUM_CHILDREN];
+static void *batch_params[NUM_CHILDREN];
+
+/* Push (from a worker) the children of this root task as a batch */
+static void * APR_THREAD_FUNC batch_task(apr_thread_t *thd, void *data)
+{
+    apr_thread_pool_push_batch(thrp, NUM_CHILDREN, batch_funcs, batch_params,
+                               APR_THREAD_TASK_PRIORITY_NORMAL, NULL, data);
+    apr_atomic_inc32(&tasks_done);
+    return NULL;
+}
+
+static int wait_tasks_done(apr_uint32_t n)
+{
+    int i;
+
+    for (i = 0; i < 1000 && apr_atomic_read32(&tasks_done) < n; i++) {
+        apr_sleep(apr_time_from_msec(10));
+    }
+    return apr_atomic_read32(&tasks_done) == n;
+}
+
+static void create_pool(abts_case *tc, apr_uint32_t flags)
+{
+    apr_status_t rv;
+
+    rv = apr_thread_pool_create_ex(&thrp, NUM_THREADS, NUM_THREADS,
+                                   flags, NULL, NULL, 0, p);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "work stealing thread pool");
+        thrp = NULL;
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+static void test_create(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+
+    apr_threadattr_t *attr;
+    int cpu = 0;
+
+    rv = apr_thread_pool_create_ex(&thrp, 1, 1, 0x80000000, NULL, NULL, 0, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+    ABTS_PTR_EQUAL(tc, NULL, thrp);
+
+    rv = apr_thread_pool_create_ex(&thrp, 1, 1,
+                                   APR_THREAD_POOL_AFFINITY_COMPACT
+                                   | APR_THREAD_POOL_AFFINITY_SCATTER,
+                                   NULL, NULL, 0, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+    rv = apr_thread_pool_create_ex(&thrp, 1, 1, 0, NULL, &cpu, 0, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    /* The threads are joined */
+    rv = apr_threadattr_create(&attr, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_threadattr_detach_set(attr, 1);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_thread_pool_create_ex(&thrp, 1, 1, 0, attr, NULL, 0, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+}
+
+static void test_nested_push(abts_case *tc, void *data)
+{
+    apr_uint32_t flags = *(apr_uint32_t *)data;
+    apr_status_t rv;
+    int i;
+
+    create_pool(tc, flags);
+    if (!thrp) {
+        return;
+    }
+
+    tasks_done = 0;
+    for (i = 0; i < NUM_ROOTS; i++) {
+        rv = apr_thread_pool_push(thrp, root_task, NULL,
+                                  APR_THREAD_TASK_PRIORITY_NORMAL, NULL);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+
+    ABTS_TRUE(tc, wait_tasks_done(NUM_ROOTS * (NUM_CHILDREN + 1)));
+    ABTS_INT_EQUAL(tc, 0, (int)apr_thread_pool_tasks_count(thrp));
+    ABTS_TRUE(tc, apr_thread_pool_tasks_run_count(thrp)
+                  >= NUM_ROOTS * (NUM_CHILDREN + 1));
+
+    rv = apr_thread_pool_destroy(thrp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+static void test_cancel(abts_case *tc, void *data)
+{
+    apr_uint32_t flags = *(apr_uint32_t *)data;
+    apr_interval_time_t delay = apr_time_from_msec(1);
+    apr_uint32_t done;
+    apr_status_t rv;
+
+    create_pool(tc, flags);
+    if (!thrp) {
+        return;
+    }
+
+    /* The children of owner_a's root are pushed from a worker, so they
+     * are in its deque with work stealing.
+     */
+    tasks_done = 0;
+    rv = apr_thread_pool_push(thrp, root_task, &delay,
+                              APR_THREAD_TASK_PRIORITY_NORMAL, &owner_a);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_thread_pool_push(thrp, child_task, NULL,
+                              APR_THREAD_TASK_PRIORITY_NORMAL, &owner_b);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    while (apr_atomic_read32(&tasks_done) < 2) {
+        apr_sleep(apr_time_from_msec(1));
+    }
+
+    rv = apr_thread_pool_tasks_cancel(thrp, &owner_a);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* No task of owner_a runs once cancelled */
+    done = apr_atomic_read32(&tasks_done);
+    ABTS_TRUE(tc, done < NUM_CHILDREN + 2);
+    apr_sleep(apr_time_from_msec(50));
+    ABTS_INT_EQUAL(tc, done, apr_atomic_read32(&tasks_done));
+    ABTS_INT_EQUAL(tc, 0, (int)apr_thread_pool_tasks_count(thrp));
+
+    rv = apr_thread_pool_destroy(thrp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+static void test_push_batch(abts_case *tc, void *data)
+{
+    apr_uint32_t flags = *(apr_uint32_t *)data;
+    apr_interval_time_t delay = apr_time_from_msec(100);
+    apr_thread_pool_latch_t *latch;
+    apr_thread_start_t root_funcs[NUM_ROOTS];
+    void *root_params[NUM_ROOTS];
+    apr_status_t rv;
+    int i;
+
+    create_pool(tc, flags);
+    if (!thrp) {
+        return;
+    }
+    rv = apr_thread_pool_latch_create(&latch, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    for (i = 0; i < NUM_CHILDREN; i++) {
+        batch_funcs[i] = child_task;
+        batch_params[i] = NULL;
+    }
+    for (i = 0; i < NUM_ROOTS; i++) {
+        root_funcs[i] = batch_task;
+        root_params[i] = latch;
+    }
+
+    /* Nothing to wait for */
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_thread_pool_latch_wait(latch, 0));
+    rv = apr_thread_pool_push_batch(thrp, 0, NULL, NULL,
+                                    APR_THREAD_TASK_PRIORITY_NORMAL, NULL,
+                                    latch);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* The roots push their children with the same latch before being done,
+     * so waiting for the latch waits for all of them.
+     */
+    tasks_done = 0;
+    rv = apr_thread_pool_push_batch(thrp, NUM_ROOTS, root_funcs, root_params,
+                                    APR_THREAD_TASK_PRIORITY_NORMAL, NULL,
+                                    latch);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_thread_pool_latch_wait(latch, -1);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, NUM_ROOTS * (NUM_CHILDREN + 1),
+                   apr_atomic_read32(&tasks_done));
+
+    /* The latch is reusable, and times out */
+    tasks_done = 0;
+    root_funcs[0] = child_task;
+    root_params[0] = &delay;
+    rv = apr_thread_pool_push_batch(thrp, 1, root_funcs, root_params,
+                                    APR_THREAD_TASK_PRIORITY_NORMAL, NULL,
+                                    latch);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_thread_pool_latch_wait(latch, apr_time_from_msec(1));
+    ABTS_INT_EQUAL(tc, APR_TIMEUP, rv);
+    rv = apr_thread_pool_latch_wait(latch, apr_time_from_sec(10));
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, apr_atomic_read32(&tasks_done));
+
+    rv = apr_thread_pool_destroy(thrp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+static apr_status_t scratch_cleanup(void *data)
+{
+    apr_atomic_inc32(data);
+    return APR_SUCCESS;
+}
+
+static void * APR_THREAD_FUNC scratch_task(apr_thread_t *thd, void *data)
+{
+    apr_pool_t *pool, *again;
+
+    /* Cleared after each task */
+    if (apr_thread_pool_task_pool_get(thd, &pool) == APR_SUCCESS
+        && apr_thread_pool_task_pool_get(thd, &again) == APR_SUCCESS
+        && pool == again) {
+        apr_pool_cleanup_register(pool, data, scratch_cleanup,
+                                  apr_pool_cleanup_null);
+        apr_palloc(pool, 4096);
+    }
+    apr_atomic_inc32(&tasks_done);
+    return NULL;
+}
+
+static void test_task_pool(abts_case *tc, void *data)
+{
+    apr_uint32_t flags = *(apr_uint32_t *)data;
+    apr_uint32_t cleared = 0;
+    apr_pool_t *pool;
+    apr_status_t rv;
+    int i;
+
+    create_pool(tc, flags);
+    if (!thrp) {
+        return;
+    }
+
+    /* Not from a task */
+    rv = apr_thread_pool_task_pool_get(apr_thread_current(), &pool);
+    ABTS_TRUE(tc, rv != APR_SUCCESS);
+    ABTS_PTR_EQUAL(tc, NULL, pool);
+
+    tasks_done = 0;
+    for (i = 0; i < NUM_CHILDREN; i++) {
+        rv = apr_thread_pool_push(thrp, scratch_task, &cleared,
+                                  APR_THREAD_TASK_PRIORITY_NORMAL, NULL);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    ABTS_TRUE(tc, wait_tasks_done(NUM_CHILDREN));
+
+    rv = apr_thread_pool_destroy(thrp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, NUM_CHILDREN, apr_atomic_read32(&cleared));
+}
+
+static void test_affinity(abts_case *tc, void *data)
+{
+    static const apr_uint32_t policies[] = {
+        0, APR_THREAD_POOL_AFFINITY_COMPACT, APR_THREAD_POOL_AFFINITY_SCATTER
+    };
+    apr_threadattr_t *attr;
+    apr_status_t rv;
+    int cpu = 0;
+    int i, j;
+
+    rv = apr_threadattr_create(&attr, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_threadattr_stacksize_set(attr, 256 * 1024);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* Policies over all the CPUs, or CPU 0 only (which may not be in the
+     * process' CPUs, so is best effort).
+     */
+    for (i = 0; i < 6; i++) {
+        rv = apr_thread_pool_create_ex(&thrp, 2, NUM_THREADS, policies[i % 3],
+                                       attr, i < 3 ? NULL : &cpu, 1, p);
+        if (rv == APR_ENOTIMPL) {
+            ABTS_NOT_IMPL(tc, "CPU affinity");
+            return;
+        }
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+        tasks_done = 0;
+        for (j = 0; j < NUM_CHILDREN; j++) {
+            rv = apr_thread_pool_push(thrp, child_task, NULL,
+                                      APR_THREAD_TASK_PRIORITY_NORMAL, NULL);
+            ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        }
+        ABTS_TRUE(tc, wait_tasks_done(NUM_CHILDREN));
+
+        rv = apr_thread_pool_destroy(thrp);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+}
+
+static void test_latency(abts_case *tc, void *data)
+{
+    apr_uint32_t flags = *(apr_uint32_t *)data;
+    apr_interval_time_t delay = apr_time_from_msec(2);
+    apr_thread_pool_latency_t wait, run;
+    apr_uint64_t sum, longer;
+    apr_status_t rv;
+    int i, j;
+
+    create_pool(tc, flags);
+    if (!thrp) {
+        return;
+    }
+
+    tasks_done = 0;
+    for (i = 0; i < NUM_ROOTS; i++) {
+        rv = apr_thread_pool_push(thrp, child_task, &delay,
+                                  APR_THREAD_TASK_PRIORITY_HIGH, NULL);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        rv = apr_thread_pool_push(thrp, child_task, NULL,
+                                  APR_THREAD_TASK_PRIORITY_LOW, NULL);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    ABTS_TRUE(tc, wait_tasks_done(2 * NUM_ROOTS));
+
+    /* The run latency is recorded once the task returned */
+    for (i = 0; i < 1000; i++) {
+        apr_thread_pool_latency_get(thrp, APR_THREAD_TASK_PRIORITY_HIGH,
+                                    &wait, &run);
+        if (run.count == NUM_ROOTS) {
+            break;
+        }
+        apr_sleep(apr_time_from_msec(1));
+    }
+    ABTS_TRUE(tc, wait.count == NUM_ROOTS);
+    ABTS_TRUE(tc, run.count == NUM_ROOTS);
+    ABTS_TRUE(tc, run.max >= (apr_uint64_t)delay);
+    ABTS_TRUE(tc, run.total >= NUM_ROOTS * (apr_uint64_t)delay);
+
+    /* All the tasks of at least 2000us are in bucket 11 (1024us) and up */
+    sum = longer = 0;
+    for (j = 0; j < APR_THREAD_POOL_LATENCY_BUCKETS; j++) {
+        sum += run.buckets[j];
+        if (j >= 11) {
+            longer += run.buckets[j];
+        }
+    }
+    ABTS_TRUE(tc, sum == run.count);
+    ABTS_TRUE(tc, longer == run.count);
+
+    apr_thread_pool_latency_get(thrp, APR_THREAD_TASK_PRIORITY_NORMAL,
+                                &wait, NULL);
+    ABTS_TRUE(tc, wait.count == 0);
+
+    apr_thread_pool_latency_reset(thrp);
+    apr_thread_pool_latency_get(thrp, APR_THREAD_TASK_PRIORITY_HIGH,
+                                &wait, &run);
+    ABTS_TRUE(tc, wait.count == 0 && run.count == 0 && run.max == 0);
+
+    rv = apr_thread_pool_destroy(thrp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+#define NUM_SCHEDULED 1000
+
+static int scheduled_order[NUM_SCHEDULED];
+
+static void * APR_THREAD_FUNC scheduled_task(apr_thread_t *thd, void *data)
+{
+    int *slot = data;
+
+    *slot = (int)apr_atomic_inc32(&tasks_done);
+    return NULL;
+}
+
+static void test_schedule(abts_case *tc, void *data)
+{
+    apr_interval_time_t elapsed;
+    apr_time_t start;
+    apr_status_t rv;
+    int i, ordered = 1;
+
+    /* A single thread runs the tasks in the scheduled order */
+    rv = apr_thread_pool_create(&thrp, 1, 1, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    tasks_done = 0;
+    start = apr_time_now();
+    for (i = 0; i < NUM_SCHEDULED; i++) {
+        /* 200ms..300ms, shuffled, odd ones of owner_b */
+        apr_interval_time_t delay = apr_time_from_msec(200)
+                                    + (i * 7919 % NUM_SCHEDULED) * 100;
+
+        scheduled_order[i] = -1;
+        rv = apr_thread_pool_schedule(thrp, scheduled_task,
+                                      &scheduled_order[i], delay,
+                                      i % 2 ? &owner_b : &owner_a);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    elapsed = apr_time_now() - start;
+    ABTS_INT_EQUAL(tc, NUM_SCHEDULED,
+                   (int)apr_thread_pool_scheduled_tasks_count(thrp));
+
+    rv = apr_thread_pool_tasks_cancel(thrp, &owner_b);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_TRUE(tc, apr_thread_pool_scheduled_tasks_count(thrp)
+                  <= NUM_SCHEDULED / 2);
+
+    ABTS_TRUE(tc, wait_tasks_done(NUM_SCHEDULED / 2));
+    ABTS_INT_EQUAL(tc, 0, (int)apr_thread_pool_scheduled_tasks_count(thrp));
+
+    /* The shuffle maps i to (i * 7919) % NUM_SCHEDULED, so the even ones
+     * must have run in the order of their delays, give or take the time
+     * it took to schedule them.
+     */
+    for (i = 0; i < NUM_SCHEDULED; i += 2) {
+        int j;
+
+        if (scheduled_order[i] < 0) {
+            ordered = 0;
+            break;
+        }
+        for (j = 0; j < NUM_SCHEDULED; j += 2) {
+            if (((j * 7919 % NUM_SCHEDULED)
+                 - (i * 7919 % NUM_SCHEDULED)) * 100 > elapsed
+                && scheduled_order[i] > scheduled_order[j]) {
+                ordered = 0;
+            }
+        }
+    }
+    ABTS_TRUE(tc, ordered);
+    for (i = 1; i < NUM_SCHEDULED; i += 2) {
+        ABTS_INT_EQUAL(tc, -1, scheduled_order[i]);
+    }
+
+    rv = apr_thread_pool_destroy(thrp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+#endif /* APR_HAS_THREADS */
+
+abts_suite *testthreadpool(abts_suite *suite)
+{
+#if APR_HAS_THREADS
+    static apr_uint32_t shared = 0;
+    static apr_uint32_t stealing = APR_THREAD_POOL_WORK_STEALING;
+#endif
+
+    suite = ADD_SUITE(suite);
+
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_create, NULL);
+    abts_run_test(suite, test_nested_push, &shared);
+    abts_run_test(suite, test_nested_push, &stealing);
+    abts_run_test(suite, test_cancel, &shared);
+    abts_run_test(suite, test_cancel, &stealing);
+    abts_run_test(suite, test_push_batch, &shared);
+    abts_run_test(suite, test_push_batch, &stealing);
+    abts_run_test(suite, test_schedule, NULL);
+    abts_run_test(suite, test_task_pool, &shared);
+    abts_run_test(suite, test_task_pool, &stealing);
+    abts_run_test(suite, test_affinity, NULL);
+    abts_run_test(suite, test_latency, &shared);
+    abts_run_test(suite, test_latency, &stealing);
+#endif /* APR_HAS_THREADS */
+
+    return suite;
+}
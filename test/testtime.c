@@ -293,6 +293,70 @@ static void test_2038(abts_case *tc, void *data)
                        apr_time_exp_get(&t, &xt));
 }
 
+static void test_monotonic(abts_case *tc, void *data)
+{
+    apr_time_t m1, m2;
+
+    m1 = apr_time_monotonic();
+    apr_sleep(apr_time_from_msec(20));
+    m2 = apr_time_monotonic();
+
+    /* never goes backwards, and counts the time slept */
+    ABTS_ASSERT(tc, "monotonic clock went backwards", m2 >= m1);
+    ABTS_ASSERT(tc, "monotonic clock missed the sleep",
+                m2 - m1 >= apr_time_from_msec(10));
+    ABTS_ASSERT(tc, "monotonic clock ran ahead",
+                m2 - m1 < apr_time_from_sec(10));
+}
+
+static void test_now_coarse(abts_case *tc, void *data)
+{
+    apr_time_t now, coarse;
+
+    /* The coarse clock lags by at most a tick or so */
+    now = apr_time_now();
+    coarse = apr_time_now_coarse();
+    ABTS_ASSERT(tc, "coarse clock is not the wall clock",
+                coarse > now - apr_time_from_sec(1)
+                && coarse < now + apr_time_from_sec(1));
+}
+
+/* Exploding the same second again only changes tm_usec, and GMT and
+ * local time do not serve each other's results.
+ */
+static void test_exp_same_second(abts_case *tc, void *data)
+{
+    apr_time_exp_t gmt1, gmt2, lt1, lt2, xt;
+    apr_time_t base = now - now % APR_USEC_PER_SEC;
+
+    apr_time_exp_gmt(&gmt1, base + 1);
+    apr_time_exp_lt(&lt1, base + 2);
+    apr_time_exp_gmt(&gmt2, base + 999999);
+    apr_time_exp_lt(&lt2, base + 3);
+
+    ABTS_INT_EQUAL(tc, 1, gmt1.tm_usec);
+    ABTS_INT_EQUAL(tc, 999999, gmt2.tm_usec);
+    ABTS_INT_EQUAL(tc, 2, lt1.tm_usec);
+    ABTS_INT_EQUAL(tc, 3, lt2.tm_usec);
+    gmt2.tm_usec = gmt1.tm_usec;
+    lt2.tm_usec = lt1.tm_usec;
+    ABTS_TRUE(tc, memcmp(&gmt1, &gmt2, sizeof(xt)) == 0);
+    ABTS_TRUE(tc, memcmp(&lt1, &lt2, sizeof(xt)) == 0);
+    ABTS_INT_EQUAL(tc, 0, gmt1.tm_gmtoff);
+
+    /* an offset shifts the GMT second that is looked up */
+    apr_time_exp_tz(&xt, base, 3600);
+    ABTS_INT_EQUAL(tc, (gmt1.tm_hour + 1) % 24, xt.tm_hour);
+    ABTS_INT_EQUAL(tc, 3600, xt.tm_gmtoff);
+    apr_time_exp_gmt(&xt, base);
+    ABTS_INT_EQUAL(tc, gmt1.tm_hour, xt.tm_hour);
+    ABTS_INT_EQUAL(tc, 0, xt.tm_gmtoff);
+
+    /* the next second is exploded afresh */
+    apr_time_exp_gmt(&xt, base + APR_USEC_PER_SEC);
+    ABTS_INT_EQUAL(tc, (gmt1.tm_sec + 1) % 60, xt.tm_sec);
+}
+
 abts_suite *testtime(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -310,6 +374,9 @@ abts_suite *testtime(abts_suite *suite)
     abts_run_test(suite, test_exp_tz, NULL);
     abts_run_test(suite, test_strftimeoffset, NULL);
     abts_run_test(suite, test_2038, NULL);
+    abts_run_test(suite, test_monotonic, NULL);
+    abts_run_test(suite, test_now_coarse, NULL);
+    abts_run_test(suite, test_exp_same_second, NULL);
 
     return suite;
 }
@@ -299,6 +299,44 @@ static void test_aup(abts_case *tc, void *data)
     }
 }
 
+static void span_equal(abts_case *tc, const char *uri,
+                       const apr_uri_span_t *span, const char *expected,
+                       int lineno)
+{
+    const char *actual = NULL;
+
+    if (APR_URI_SPAN_PRESENT(*span)) {
+        actual = apr_pstrmemdup(p, uri + span->off, span->len);
+    }
+    abts_str_equal(tc, expected, actual, lineno);
+}
+
+static void test_aup_spans(abts_case *tc, void *data)
+{
+    int i;
+    apr_status_t rv;
+    apr_uri_spans_t spans;
+    struct aup_test *t;
+
+    for (i = 0; i < sizeof(aup_tests) / sizeof(aup_tests[0]); i++) {
+        t = &aup_tests[i];
+        rv = apr_uri_parse_spans(t->uri, &spans);
+        ABTS_INT_EQUAL(tc, t->rv, rv);
+        if (t->rv == APR_SUCCESS) {
+            span_equal(tc, t->uri, &spans.scheme, t->scheme, __LINE__);
+            span_equal(tc, t->uri, &spans.hostinfo, t->hostinfo, __LINE__);
+            span_equal(tc, t->uri, &spans.user, t->user, __LINE__);
+            span_equal(tc, t->uri, &spans.password, t->password, __LINE__);
+            span_equal(tc, t->uri, &spans.hostname, t->hostname, __LINE__);
+            span_equal(tc, t->uri, &spans.port_str, t->port_str, __LINE__);
+            span_equal(tc, t->uri, &spans.path, t->path, __LINE__);
+            span_equal(tc, t->uri, &spans.query, t->query, __LINE__);
+            span_equal(tc, t->uri, &spans.fragment, t->fragment, __LINE__);
+            ABTS_INT_EQUAL(tc, t->port, spans.port);
+        }
+    }
+}
+
 static void test_uph(abts_case *tc, void *data)
 {
     int i;
@@ -324,6 +362,7 @@ abts_suite *testuri(abts_suite *suite)
     suite = ADD_SUITE(suite);
 
     abts_run_test(suite, test_aup, NULL);
+    abts_run_test(suite, test_aup_spans, NULL);
     abts_run_test(suite, test_uph, NULL);
 
     return suite;
@@ -81,6 +81,11 @@ abts_suite *testfnmatch(abts_suite *suite);
 abts_suite *testgetopt(abts_suite *suite);
 abts_suite *testglobalmutex(abts_suite *suite);
 abts_suite *testhash(abts_suite *suite);
+abts_suite *testchash(abts_suite *suite);
+abts_suite *testaio(abts_suite *suite);
+abts_suite *testresolver(abts_suite *suite);
+abts_suite *testflatmap(abts_suite *suite);
+abts_suite *testheap(abts_suite *suite);
 abts_suite *testhooks(abts_suite *suite);
 abts_suite *testipsub(abts_suite *suite);
 abts_suite *testlock(abts_suite *suite);
@@ -95,6 +100,8 @@ abts_suite *testpoll(abts_suite *suite);
 abts_suite *testpool(abts_suite *suite);
 abts_suite *testproc(abts_suite *suite);
 abts_suite *testprocmutex(abts_suite *suite);
+abts_suite *testprocrwlock(abts_suite *suite);
+abts_suite *testlockprofile(abts_suite *suite);
 abts_suite *testrand(abts_suite *suite);
 abts_suite *testsleep(abts_suite *suite);
 abts_suite *testshm(abts_suite *suite);
@@ -120,6 +127,7 @@ abts_suite *testpass(abts_suite *suite);
 abts_suite *testbase64(abts_suite *suite);
 abts_suite *testmd4(abts_suite *suite);
 abts_suite *testmd5(abts_suite *suite);
+abts_suite *testsha(abts_suite *suite);
 abts_suite *testcrypto(abts_suite *suite);
 abts_suite *testdbd(abts_suite *suite);
 abts_suite *testdate(abts_suite *suite);
@@ -130,11 +138,17 @@ abts_suite *testqueue(abts_suite *suite);
 abts_suite *testxml(abts_suite *suite);
 abts_suite *testxlate(abts_suite *suite);
 abts_suite *testrmm(abts_suite *suite);
+abts_suite *testshmhash(abts_suite *suite);
+abts_suite *testshmring(abts_suite *suite);
+abts_suite *testmetrics(abts_suite *suite);
 abts_suite *testdbm(abts_suite *suite);
 abts_suite *testlfsabi(abts_suite *suite);
 abts_suite *testskiplist(abts_suite *suite);
+abts_suite *testslab(abts_suite *suite);
+abts_suite *testthreadpool(abts_suite *suite);
 abts_suite *testsiphash(abts_suite *suite);
 abts_suite *testjson(abts_suite *suite);
 abts_suite *testjose(abts_suite *suite);
+abts_suite *teststrbuf(abts_suite *suite);
 
 #endif /* APR_TEST_INCLUDES */
@@ -17,6 +17,9 @@
 #include "testutil.h"
 #include "apr_general.h"
 #include "apr_uuid.h"
+#include "apr_thread_proc.h"
+
+#include <stdlib.h>
 
 static void test_uuid_parse(abts_case *tc, void *data)
 {
@@ -45,12 +48,139 @@ static void test_gen2(abts_case *tc, void *data)
              memcmp(&uuid, &uuid2, sizeof(uuid)) != 0);
 }
 
+static int uuid_cmp(const void *a, const void *b)
+{
+    return memcmp(a, b, sizeof(apr_uuid_t));
+}
+
+#define BATCH 100
+
+static void test_batch(abts_case *tc, void *data)
+{
+    apr_uuid_t uuids[BATCH];
+    int i;
+
+    apr_uuid_get_batch(uuids, BATCH);
+    for (i = 0; i < BATCH; i++) {
+        /* RFC 4122 variant */
+        ABTS_INT_EQUAL(tc, 0x80, uuids[i].data[8] & 0xC0);
+    }
+
+    qsort(uuids, BATCH, sizeof(apr_uuid_t), uuid_cmp);
+    for (i = 1; i < BATCH; i++) {
+        ABTS_ASSERT(tc, "batch holds the same UUID twice",
+                    uuid_cmp(&uuids[i - 1], &uuids[i]) != 0);
+    }
+}
+
+static void test_v7(abts_case *tc, void *data)
+{
+    apr_uuid_t uuids[BATCH + 1];
+    apr_uint64_t ms;
+    apr_time_t before, after;
+    int i;
+
+    before = apr_time_as_msec(apr_time_now());
+    apr_uuid_get_v7_batch(uuids, BATCH);
+    apr_uuid_get_v7(&uuids[BATCH]);
+    after = apr_time_as_msec(apr_time_now());
+
+    for (i = 0; i <= BATCH; i++) {
+        ABTS_INT_EQUAL(tc, 0x70, uuids[i].data[6] & 0xF0);
+        ABTS_INT_EQUAL(tc, 0x80, uuids[i].data[8] & 0xC0);
+        if (i) {
+            ABTS_ASSERT(tc, "V7 UUIDs are not increasing",
+                        uuid_cmp(&uuids[i - 1], &uuids[i]) < 0);
+        }
+    }
+
+    ms = ((apr_uint64_t)uuids[0].data[0] << 40)
+         | ((apr_uint64_t)uuids[0].data[1] << 32)
+         | ((apr_uint64_t)uuids[0].data[2] << 24)
+         | ((apr_uint64_t)uuids[0].data[3] << 16)
+         | ((apr_uint64_t)uuids[0].data[4] << 8)
+         | uuids[0].data[5];
+    ABTS_ASSERT(tc, "V7 timestamp is not the current time",
+                (apr_time_t)ms >= before && (apr_time_t)ms <= after);
+}
+
+#if APR_HAS_THREADS
+
+#define NTHREADS 4
+
+static apr_uuid_t thread_uuids[NTHREADS][BATCH * 10];
+
+static void * APR_THREAD_FUNC uuid_thread(apr_thread_t *thd, void *data)
+{
+    apr_uuid_t *uuids = data;
+    int i;
+
+    for (i = 0; i < BATCH * 10; i += BATCH) {
+        if (i % (2 * BATCH)) {
+            apr_uuid_get_batch(&uuids[i], BATCH);
+        }
+        else {
+            int j;
+            for (j = 0; j < BATCH; j++) {
+                apr_uuid_get(&uuids[i + j]);
+            }
+        }
+    }
+    return NULL;
+}
+
+static void * APR_THREAD_FUNC uuid_v7_thread(apr_thread_t *thd, void *data)
+{
+    apr_uuid_t *uuids = data;
+    int i;
+
+    for (i = 0; i < BATCH * 10; i += BATCH) {
+        apr_uuid_get_v7_batch(&uuids[i], BATCH);
+    }
+    return NULL;
+}
+
+static void test_threads(abts_case *tc, void *data)
+{
+    apr_thread_start_t func = data;
+    apr_thread_t *threads[NTHREADS];
+    apr_uuid_t *all = &thread_uuids[0][0];
+    apr_size_t total = NTHREADS * BATCH * 10, i;
+    apr_status_t rv;
+    int t;
+
+    for (t = 0; t < NTHREADS; t++) {
+        rv = apr_thread_create(&threads[t], NULL, func,
+                               thread_uuids[t], p);
+        APR_ASSERT_SUCCESS(tc, "create thread", rv);
+    }
+    for (t = 0; t < NTHREADS; t++) {
+        apr_thread_join(&rv, threads[t]);
+    }
+
+    qsort(all, total, sizeof(apr_uuid_t), uuid_cmp);
+    for (i = 1; i < total; i++) {
+        if (!uuid_cmp(&all[i - 1], &all[i])) {
+            break;
+        }
+    }
+    ABTS_ASSERT(tc, "threads generated the same UUID twice", i == total);
+}
+
+#endif /* APR_HAS_THREADS */
+
 abts_suite *testuuid(abts_suite *suite)
 {
     suite = ADD_SUITE(suite);
 
     abts_run_test(suite, test_uuid_parse, NULL);
     abts_run_test(suite, test_gen2, NULL);
+    abts_run_test(suite, test_batch, NULL);
+    abts_run_test(suite, test_v7, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_threads, uuid_thread);
+    abts_run_test(suite, test_threads, uuid_v7_thread);
+#endif
 
     return suite;
 }
@@ -112,6 +112,85 @@ static void test_transformation(abts_case *tc, void *data)
     one_test(tc, "UTF-7", "UTF-8", test_utf7, test_utf8, p);
 }
 
+static void test_utf8_latin1(abts_case *tc, void *data)
+{
+    static const char long_utf8[] = "0123456789abcdefghij\xc3\xa9"
+                                    "0123456789abcdefghij\xc3\xbf";
+    static const char long_latin1[] = "0123456789abcdefghij\xe9"
+                                      "0123456789abcdefghij\xff";
+    apr_xlate_t *convset;
+    apr_size_t inbytes_left, outbytes_left;
+    char buf[4];
+    apr_status_t rv;
+
+    one_test(tc, "UTF-8", "ISO-8859-1", long_utf8, long_latin1, p);
+    one_test(tc, "ISO-8859-1", "UTF-8", long_latin1, long_utf8, p);
+    one_test(tc, "utf8", "latin1", test_utf8, test_latin1, p);
+
+    rv = apr_xlate_open(&convset, "ISO-8859-1", "UTF-8", p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* Truncated character */
+    inbytes_left = 3;
+    outbytes_left = sizeof(buf);
+    rv = apr_xlate_conv_buffer(convset, "a\xe2\x82", &inbytes_left,
+                               buf, &outbytes_left);
+    ABTS_INT_EQUAL(tc, APR_INCOMPLETE, rv);
+    ABTS_SIZE_EQUAL(tc, 2, inbytes_left);
+    ABTS_SIZE_EQUAL(tc, sizeof(buf) - 1, outbytes_left);
+
+    /* Not in Latin-1 */
+    inbytes_left = 4;
+    outbytes_left = sizeof(buf);
+    rv = apr_xlate_conv_buffer(convset, "a\xe2\x82\xac", &inbytes_left,
+                               buf, &outbytes_left);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+    ABTS_SIZE_EQUAL(tc, 3, inbytes_left);
+
+    apr_xlate_close(convset);
+
+    rv = apr_xlate_open(&convset, "UTF-8", "ISO-8859-1", p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* Out of output space, not an error */
+    inbytes_left = 3;
+    outbytes_left = 2;
+    rv = apr_xlate_conv_buffer(convset, "a\xe9" "b", &inbytes_left,
+                               buf, &outbytes_left);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_SIZE_EQUAL(tc, 2, inbytes_left);
+    ABTS_SIZE_EQUAL(tc, 1, outbytes_left);
+
+    apr_xlate_close(convset);
+}
+
+static void test_reopen(abts_case *tc, void *data)
+{
+    apr_xlate_t *convset;
+    apr_size_t inbytes_left, outbytes_left;
+    char buf[16];
+    apr_status_t rv;
+    int i;
+
+    /* Leave a descriptor in a shifted state, it is reset when reused */
+    rv = apr_xlate_open(&convset, "UTF-7", "UTF-8", p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    inbytes_left = 2;
+    outbytes_left = sizeof(buf);
+    rv = apr_xlate_conv_buffer(convset, "\xc3\x9f", &inbytes_left,
+                               buf, &outbytes_left);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_xlate_close(convset);
+
+    for (i = 0; i < 3; i++) {
+        one_test(tc, "UTF-8", "UTF-7", test_utf8, test_utf7, p);
+        if (is_transform_supported(tc, "ISO-8859-1", "ISO-8859-2", p)) {
+            one_test(tc, "ISO-8859-1", "ISO-8859-2", test_latin1,
+                     test_latin2, p);
+        }
+    }
+}
+
 #endif /* APR_HAS_XLATE */
 
 abts_suite *testxlate(abts_suite *suite)
@@ -120,6 +199,8 @@ abts_suite *testxlate(abts_suite *suite)
 
 #if APR_HAS_XLATE
     abts_run_test(suite, test_transformation, NULL);
+    abts_run_test(suite, test_utf8_latin1, NULL);
+    abts_run_test(suite, test_reopen, NULL);
 #endif
 
     return suite;
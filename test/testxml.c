@@ -16,6 +16,7 @@
 
 #include "apr.h"
 #include "apr_general.h"
+#include "apr_strings.h"
 #include "apr_xml.h"
 #include "abts.h"
 #include "testutil.h"
@@ -324,6 +325,218 @@ static void test_xml_parser_geterror(abts_case *tc, void *data)
 #endif
 }
 
+static void test_xml_to_text(abts_case *tc, void *data)
+{
+    const char *xml =
+        "<a:r xmlns:a='urn:a' xmlns='urn:d' xml:lang='fr' x='1' a:y='2'>"
+        "t<b xml:lang='de'>u</b>v<f xmlns:q='Q' q:z='&quot;'><q:g/></f>"
+        "</a:r>";
+    apr_xml_parser *parser;
+    apr_xml_doc *doc;
+    const char *text;
+    apr_size_t size;
+    apr_status_t rv;
+
+    parser = apr_xml_parser_create(p);
+    rv = apr_xml_parser_feed(parser, xml, strlen(xml));
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_xml_parser_done(parser, &doc);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    if (rv != APR_SUCCESS)
+        return;
+
+    apr_xml_to_text(p, doc->root, APR_XML_X2T_PARSED, doc->namespaces, NULL,
+                    &text, &size);
+    ABTS_STR_EQUAL(tc, "<a:r a:y=\"2\" x=\"1\" xml:lang=\"fr\" "
+                   "xmlns:a=\"urn:a\" xmlns=\"urn:d\">"
+                   "t<b xml:lang=\"de\">u</b>v"
+                   "<f q:z=\"\"\" xmlns:q=\"Q\"><q:g/></f></a:r>", text);
+    ABTS_SIZE_EQUAL(tc, strlen(text) + 1, size);
+
+    /* the xml:lang, a null, then the contents */
+    apr_xml_to_text(p, doc->root, APR_XML_X2T_LANG_INNER, doc->namespaces,
+                    NULL, &text, &size);
+    ABTS_STR_EQUAL(tc, "fr", text);
+    ABTS_STR_EQUAL(tc, "t<ns1:b xml:lang=\"de\">u</ns1:b>v"
+                   "<ns1:f ns3:z=\"\"\"><ns3:g/></ns1:f>", text + 3);
+    ABTS_SIZE_EQUAL(tc, 3 + strlen(text + 3) + 1, size);
+
+    apr_xml_quote_elem(p, doc->root);
+    apr_xml_to_text(p, doc->root, APR_XML_X2T_FULL_NS_LANG, doc->namespaces,
+                    NULL, &text, &size);
+    ABTS_STR_EQUAL(tc, "<ns2:r ns2:y=\"2\" x=\"1\" xml:lang=\"fr\" "
+                   "xmlns:ns3=\"Q\" xmlns:ns2=\"urn:a\" "
+                   "xmlns:ns1=\"urn:d\" xmlns:ns0=\"DAV:\">"
+                   "t<ns1:b xml:lang=\"de\">u</ns1:b>v"
+                   "<ns1:f ns3:z=\"&quot;\"><ns3:g/></ns1:f></ns2:r>", text);
+    ABTS_SIZE_EQUAL(tc, strlen(text) + 1, size);
+
+    ABTS_STR_EQUAL(tc, "plain", apr_xml_quote_string(p, "plain", 1));
+    ABTS_STR_EQUAL(tc, "a&lt;b&gt;&amp;&quot;c&quot;",
+                   apr_xml_quote_string(p, "a<b>&\"c\"", 1));
+    ABTS_STR_EQUAL(tc, "a&lt;b&gt;&amp;\"c\"",
+                   apr_xml_quote_string(p, "a<b>&\"c\"", 0));
+    xml = "\"no markup\"";
+    ABTS_PTR_EQUAL(tc, xml, apr_xml_quote_string(p, xml, 0));
+}
+
+typedef struct {
+    apr_pool_t *pool;
+    int starts;
+    int ends;
+    const char *kept;
+} stream_baton;
+
+static void stream_start(void *baton, const apr_xml_doc *doc,
+                         apr_xml_elem *elem)
+{
+    stream_baton *sb = baton;
+
+    sb->starts++;
+}
+
+static void stream_end(void *baton, const apr_xml_doc *doc,
+                       apr_xml_elem *elem)
+{
+    stream_baton *sb = baton;
+    const char *text;
+
+    sb->ends++;
+    if (!APR_XML_ELEM_IS_EMPTY(elem)) {
+        apr_xml_to_text(sb->pool, elem, APR_XML_X2T_INNER, doc->namespaces,
+                        NULL, &text, NULL);
+        sb->kept = apr_pstrcat(sb->pool, sb->kept, "[", elem->name, ":",
+                               text, "]", NULL);
+    }
+}
+
+static void test_xml_stream(abts_case *tc, void *data)
+{
+    const char *xml =
+        "<D:multistatus xmlns:D='DAV:' xmlns:x='urn:x'>"
+        "<D:response><D:href>/a</D:href><D:propstat>text</D:propstat>"
+        "</D:response>"
+        "<D:response><D:href>/b</D:href></D:response>"
+        "<x:href>/not</x:href>"
+        "<x:other><D:href>/in</D:href> <x:y/></x:other>"
+        "</D:multistatus>";
+    apr_xml_parser *parser;
+    apr_xml_doc *doc;
+    apr_status_t rv;
+    stream_baton sb;
+    apr_size_t i, len = strlen(xml);
+    apr_pool_t *pool;
+
+    apr_pool_create(&pool, p);
+
+    sb.pool = pool;
+    sb.starts = sb.ends = 0;
+    sb.kept = "";
+
+    parser = apr_xml_parser_create_stream(pool, stream_start, stream_end, &sb);
+    APR_ASSERT_SUCCESS(tc, "keep D:href",
+                       apr_xml_parser_keep(parser, "DAV:", "href"));
+    APR_ASSERT_SUCCESS(tc, "keep x:other",
+                       apr_xml_parser_keep(parser, "urn:x", "other"));
+
+    for (i = 0; i < len; i++) {
+        rv = apr_xml_parser_feed(parser, xml + i, 1);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    rv = apr_xml_parser_done(parser, &doc);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    ABTS_INT_EQUAL(tc, 10, sb.starts);
+    ABTS_INT_EQUAL(tc, 10, sb.ends);
+    ABTS_STR_EQUAL(tc, "[href:/a][href:/b][href:/in]"
+                   "[other:<ns0:href>/in</ns0:href> <ns1:y/>]", sb.kept);
+    ABTS_PTR_EQUAL(tc, NULL, doc->root);
+
+    /* A kept root element is the document's root */
+    parser = apr_xml_parser_create_stream(pool, NULL, NULL, NULL);
+    APR_ASSERT_SUCCESS(tc, "keep root",
+                       apr_xml_parser_keep(parser, "", "root"));
+    xml = "<root xml:lang='en' a='1'>x<y z='2'/>z</root>";
+    rv = apr_xml_parser_feed(parser, xml, strlen(xml));
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_xml_parser_done(parser, &doc);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_PTR_NOTNULL(tc, doc->root);
+    if (doc->root) {
+        const char *text;
+
+        apr_xml_to_text(pool, doc->root, APR_XML_X2T_FULL, doc->namespaces,
+                        NULL, &text, NULL);
+        ABTS_STR_EQUAL(tc, "<root a=\"1\" xml:lang=\"en\">"
+                       "x<y z=\"2\"/>z</root>", text);
+        ABTS_STR_EQUAL(tc, "en", doc->root->lang);
+    }
+
+    /* Only streaming parsers keep subtrees */
+    parser = apr_xml_parser_create(pool);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, apr_xml_parser_keep(parser, NULL, "x"));
+    apr_xml_parser_done(parser, NULL);
+
+    apr_pool_destroy(pool);
+}
+
+static void test_xml_intern(abts_case *tc, void *data)
+{
+    const char *xml =
+        "<D:prop xmlns:D='DAV:' xmlns:x='urn:x'>"
+        "<D:href x:id='1'>/a</D:href><x:href id='2'>/b</x:href>"
+        "<href xmlns='urn:x'>/c</href>"
+        "</D:prop>";
+    apr_xml_parser *parser;
+    apr_xml_doc *doc;
+    apr_xml_elem *e;
+    const char *href, *id, *text;
+    apr_size_t i;
+    apr_status_t rv;
+
+    parser = apr_xml_parser_create(p);
+    href = apr_xml_parser_intern(parser, "href");
+    ABTS_STR_EQUAL(tc, "href", href);
+    ABTS_PTR_EQUAL(tc, href, apr_xml_parser_intern(parser, "href"));
+
+    rv = apr_xml_parser_feed(parser, xml, strlen(xml));
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_xml_parser_done(parser, &doc);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* The same names, prefixed or not, are the same pointer */
+    e = doc->root->first_child;
+    ABTS_PTR_EQUAL(tc, href, e->name);
+    ABTS_PTR_EQUAL(tc, href, e->next->name);
+    ABTS_PTR_EQUAL(tc, href, e->next->next->name);
+    id = e->attr->name;
+    ABTS_STR_EQUAL(tc, "id", id);
+    ABTS_PTR_EQUAL(tc, id, e->next->attr->name);
+    ABTS_PTR_EQUAL(tc, id, apr_xml_parser_intern(parser, "id"));
+
+    /* One namespace per URI, declared twice */
+    ABTS_INT_EQUAL(tc, e->attr->ns, e->next->ns);
+    ABTS_INT_EQUAL(tc, e->next->ns, e->next->next->ns);
+    ABTS_INT_EQUAL(tc, APR_XML_NS_NONE, e->next->attr->ns);
+    ABTS_INT_EQUAL(tc, 2, doc->namespaces->nelts);
+
+    /* The default namespace outlives the buffers of the XML parser */
+    xml = "<a xmlns='urn:d' xmlns:p='urn:p'><b p:c='1' d='2'/>"
+          "<p:e xmlns='urn:f'><g/></p:e></a>";
+    parser = apr_xml_parser_create(p);
+    for (i = 0; i < strlen(xml); i++) {
+        rv = apr_xml_parser_feed(parser, xml + i, 1);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    rv = apr_xml_parser_done(parser, &doc);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_xml_to_text(p, doc->root, APR_XML_X2T_PARSED, doc->namespaces,
+                    NULL, &text, NULL);
+    ABTS_STR_EQUAL(tc, "<a xmlns=\"urn:d\" xmlns:p=\"urn:p\">"
+                   "<b d=\"2\" p:c=\"1\"/>"
+                   "<p:e xmlns=\"urn:f\"><g/></p:e></a>", text);
+}
+
 abts_suite *testxml(abts_suite *suite)
 {
     suite = ADD_SUITE(suite);
@@ -332,6 +545,9 @@ abts_suite *testxml(abts_suite *suite)
     abts_run_test(suite, test_billion_laughs, NULL);
     abts_run_test(suite, test_xml_roundtrip, NULL);
     abts_run_test(suite, test_xml_parser_geterror, NULL);
+    abts_run_test(suite, test_xml_to_text, NULL);
+    abts_run_test(suite, test_xml_stream, NULL);
+    abts_run_test(suite, test_xml_intern, NULL);
 
     return suite;
 }
@@ -331,6 +331,13 @@ APR_DECLARE(apr_status_t) apr_procattr_addrspace_set(apr_procattr_t *attr,
     return APR_SUCCESS;
 }
 
+APR_DECLARE(apr_status_t) apr_procattr_spawn_set(apr_procattr_t *attr,
+                                                 apr_int32_t spawn)
+{
+    attr->spawn = spawn;
+    return APR_SUCCESS;
+}
+
 APR_DECLARE(apr_status_t) apr_procattr_user_set(apr_procattr_t *attr,
                                                 const char *username,
                                                 const char *password)
@@ -361,6 +368,200 @@ APR_DECLARE(apr_status_t) apr_procattr_group_set(apr_procattr_t *attr,
     return rv;
 }
 
+/* SHELL_PATH -c "args..." */
+static void shell_args(const char *newargs[4], const char * const *args,
+                       apr_pool_t *pool)
+{
+    int i, onearg_len = 0;
+
+    newargs[0] = SHELL_PATH;
+    newargs[1] = "-c";
+
+    i = 0;
+    while (args[i]) {
+        onearg_len += strlen(args[i]);
+        onearg_len++; /* for space delimiter */
+        i++;
+    }
+
+    switch(i) {
+    case 0:
+        /* bad parameters; we're doomed */
+        newargs[2] = NULL;
+        break;
+    case 1:
+        /* no args, or caller already built a single string from
+         * progname and args
+         */
+        newargs[2] = args[0];
+        break;
+    default:
+    {
+        char *ch, *onearg;
+
+        ch = onearg = apr_palloc(pool, onearg_len);
+        i = 0;
+        while (args[i]) {
+            size_t len = strlen(args[i]);
+
+            memcpy(ch, args[i], len);
+            ch += len;
+            *ch = ' ';
+            ++ch;
+            ++i;
+        }
+        --ch; /* back up to trailing blank */
+        *ch = '\0';
+        newargs[2] = onearg;
+    }
+    }
+
+    newargs[3] = NULL;
+}
+
+#if defined(HAVE_SPAWN_H) && defined(HAVE_POSIX_SPAWN)
+#define PROC_SPAWN
+
+extern char **environ;
+
+/* Whether the child can be set up without running code of ours in it,
+ * otherwise it is forked.  The child cleanups of the pools need it to
+ * run, hence the caller opts in.
+ */
+static int proc_spawnable(apr_procattr_t *attr)
+{
+    if (!attr->spawn || attr->detached) {
+        return 0;
+    }
+#ifndef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCHDIR_NP
+    if (attr->currdir) {
+        return 0;
+    }
+#endif
+    /* the user and group are switched only as root */
+    if ((attr->uid != -1 || attr->gid != -1 || attr->perms_set_callbacks)
+        && !geteuid()) {
+        return 0;
+    }
+#ifdef RLIMIT_CPU
+    if (attr->limit_cpu) {
+        return 0;
+    }
+#endif
+#if defined (RLIMIT_DATA) || defined (RLIMIT_VMEM) || defined(RLIMIT_AS)
+    if (attr->limit_mem) {
+        return 0;
+    }
+#endif
+#ifdef RLIMIT_NPROC
+    if (attr->limit_nproc) {
+        return 0;
+    }
+#endif
+#ifdef RLIMIT_NOFILE
+    if (attr->limit_nofile) {
+        return 0;
+    }
+#endif
+    return 1;
+}
+
+static apr_status_t proc_spawn(pid_t *pid, const char *progname,
+                               const char * const *args,
+                               const char * const *env,
+                               apr_procattr_t *attr, apr_pool_t *pool)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t spawnattr;
+    sigset_t sigdefault;
+    apr_file_t *child[3];
+    const char *newargs[4];
+    int i, j, rc;
+
+    if ((rc = posix_spawn_file_actions_init(&actions)) != 0) {
+        return rc;
+    }
+    if ((rc = posix_spawnattr_init(&spawnattr)) != 0) {
+        posix_spawn_file_actions_destroy(&actions);
+        return rc;
+    }
+
+    /* the child's ends to 0-2, then closed as the forked child does */
+    child[STDIN_FILENO] = attr->child_in;
+    child[STDOUT_FILENO] = attr->child_out;
+    child[STDERR_FILENO] = attr->child_err;
+    for (i = 0; i < 3 && !rc; i++) {
+        if (child[i] && child[i]->filedes == -1) {
+            rc = posix_spawn_file_actions_addclose(&actions, i);
+        }
+        else if (child[i] && child[i]->filedes != i) {
+            rc = posix_spawn_file_actions_adddup2(&actions,
+                                                  child[i]->filedes, i);
+        }
+    }
+    for (i = 0; i < 3 && !rc; i++) {
+        if (!child[i] || child[i]->filedes <= STDERR_FILENO) {
+            continue;
+        }
+        for (j = 0; j < i; j++) {
+            if (child[j] && child[j]->filedes == child[i]->filedes) {
+                break;
+            }
+        }
+        if (j == i) {
+            rc = posix_spawn_file_actions_addclose(&actions,
+                                                   child[i]->filedes);
+        }
+    }
+
+#ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCHDIR_NP
+    if (!rc && attr->currdir) {
+        rc = posix_spawn_file_actions_addchdir_np(&actions, attr->currdir);
+    }
+#endif
+
+    if (!rc) {
+        sigemptyset(&sigdefault);
+        sigaddset(&sigdefault, SIGCHLD);
+        rc = posix_spawnattr_setsigdefault(&spawnattr, &sigdefault);
+    }
+    if (!rc) {
+        rc = posix_spawnattr_setflags(&spawnattr, POSIX_SPAWN_SETSIGDEF);
+    }
+
+    if (!rc) {
+        switch (attr->cmdtype) {
+        case APR_SHELLCMD:
+        case APR_SHELLCMD_ENV:
+            shell_args(newargs, args, pool);
+            rc = posix_spawn(pid, SHELL_PATH, &actions, &spawnattr,
+                             (char * const *)newargs,
+                             attr->cmdtype == APR_SHELLCMD
+                                 ? (char * const *)env : environ);
+            break;
+        case APR_PROGRAM:
+            rc = posix_spawn(pid, progname, &actions, &spawnattr,
+                             (char * const *)args, (char * const *)env);
+            break;
+        case APR_PROGRAM_ENV:
+            rc = posix_spawn(pid, progname, &actions, &spawnattr,
+                             (char * const *)args, environ);
+            break;
+        default:
+            /* APR_PROGRAM_PATH */
+            rc = posix_spawnp(pid, progname, &actions, &spawnattr,
+                              (char * const *)args, environ);
+            break;
+        }
+    }
+
+    posix_spawnattr_destroy(&spawnattr);
+    posix_spawn_file_actions_destroy(&actions);
+
+    return rc;
+}
+#endif
+
 APR_DECLARE(apr_status_t) apr_proc_create(apr_proc_t *new,
                                           const char *progname,
                                           const char * const *args,
@@ -368,7 +569,6 @@ APR_DECLARE(apr_status_t) apr_proc_create(apr_proc_t *new,
                                           apr_procattr_t *attr,
                                           apr_pool_t *pool)
 {
-    int i;
     const char * const empty_envp[] = {NULL};
 
     if (!env) { /* Specs require an empty array instead of NULL;
@@ -408,6 +608,18 @@ APR_DECLARE(apr_status_t) apr_proc_create(apr_proc_t *new,
         }
     }
 
+#ifdef PROC_SPAWN
+    /* no copy of our address space when the attributes do not need it */
+    if (proc_spawnable(attr)) {
+        apr_status_t rv = proc_spawn(&new->pid, progname, args, env,
+                                     attr, pool);
+
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+    }
+    else
+#endif
     if ((new->pid = fork()) < 0) {
         return errno;
     }
@@ -522,51 +734,9 @@ APR_DECLARE(apr_status_t) apr_proc_create(apr_proc_t *new,
 
         if (attr->cmdtype == APR_SHELLCMD ||
             attr->cmdtype == APR_SHELLCMD_ENV) {
-            int onearg_len = 0;
             const char *newargs[4];
 
-            newargs[0] = SHELL_PATH;
-            newargs[1] = "-c";
-
-            i = 0;
-            while (args[i]) {
-                onearg_len += strlen(args[i]);
-                onearg_len++; /* for space delimiter */
-                i++;
-            }
-
-            switch(i) {
-            case 0:
-                /* bad parameters; we're doomed */
-                break;
-            case 1:
-                /* no args, or caller already built a single string from
-                 * progname and args
-                 */
-                newargs[2] = args[0];
-                break;
-            default:
-            {
-                char *ch, *onearg;
-
-                ch = onearg = apr_palloc(pool, onearg_len);
-                i = 0;
-                while (args[i]) {
-                    size_t len = strlen(args[i]);
-
-                    memcpy(ch, args[i], len);
-                    ch += len;
-                    *ch = ' ';
-                    ++ch;
-                    ++i;
-                }
-                --ch; /* back up to trailing blank */
-                *ch = '\0';
-                newargs[2] = onearg;
-            }
-            }
-
-            newargs[3] = NULL;
+            shell_args(newargs, args, pool);
 
             if (attr->detached) {
                 apr_proc_detach(APR_PROC_DETACH_DAEMONIZE);
@@ -629,6 +799,32 @@ APR_DECLARE(apr_status_t) apr_proc_create(apr_proc_t *new,
     return APR_SUCCESS;
 }
 
+apr_status_t apr_unix_proc_exit_status(int exit_int, int *exitcode,
+                                       apr_exit_why_e *exitwhy)
+{
+    if (WIFEXITED(exit_int)) {
+        *exitwhy = APR_PROC_EXIT;
+        *exitcode = WEXITSTATUS(exit_int);
+    }
+    else if (WIFSIGNALED(exit_int)) {
+        *exitwhy = APR_PROC_SIGNAL;
+
+#ifdef WCOREDUMP
+        if (WCOREDUMP(exit_int)) {
+            *exitwhy |= APR_PROC_SIGNAL_CORE;
+        }
+#endif
+
+        *exitcode = WTERMSIG(exit_int);
+    }
+    else {
+        /* unexpected condition */
+        return APR_EGENERAL;
+    }
+
+    return APR_CHILD_DONE;
+}
+
 APR_DECLARE(apr_status_t) apr_proc_wait_all_procs(apr_proc_t *proc,
                                                   int *exitcode,
                                                   apr_exit_why_e *exitwhy,
@@ -668,27 +864,7 @@ APR_DECLARE(apr_status_t) apr_proc_wait(apr_proc_t *proc,
     if (pstatus > 0) {
         proc->pid = pstatus;
 
-        if (WIFEXITED(exit_int)) {
-            *exitwhy = APR_PROC_EXIT;
-            *exitcode = WEXITSTATUS(exit_int);
-        }
-        else if (WIFSIGNALED(exit_int)) {
-            *exitwhy = APR_PROC_SIGNAL;
-
-#ifdef WCOREDUMP
-            if (WCOREDUMP(exit_int)) {
-                *exitwhy |= APR_PROC_SIGNAL_CORE;
-            }
-#endif
-
-            *exitcode = WTERMSIG(exit_int);
-        }
-        else {
-            /* unexpected condition */
-            return APR_EGENERAL;
-        }
-
-        return APR_CHILD_DONE;
+        return apr_unix_proc_exit_status(exit_int, exitcode, exitwhy);
     }
     else if (pstatus == 0) {
         return APR_CHILD_NOTDONE;
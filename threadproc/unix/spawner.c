@@ -0,0 +1,905 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_arch_threadproc.h"
+#include "apr_hash.h"
+#include "apr_portable.h"
+#include "apr_strings.h"
+#include "apr_thread_mutex.h"
+
+#include <stdlib.h> /* for malloc, free */
+
+#if APR_HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+#if APR_HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+#if APR_HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#if HAVE_POLL_H
+#include <poll.h>
+#endif
+
+/*
+ * The spawner is a helper process forked early, creating the children
+ * of the processes holding its pool.  A request is a datagram carrying
+ * the attributes, a stream socket for the strings and the outcome, the
+ * write end of a socket for the exit status of the child, and the child
+ * ends of its standard descriptors.  The helper exits when the lifeline,
+ * a pipe held by the users, is closed by the last of them.
+ */
+
+#if defined(SCM_RIGHTS) && HAVE_POLL_H
+
+#ifdef MSG_NOSIGNAL
+#define SPAWN_NOSIGNAL MSG_NOSIGNAL
+#else
+#define SPAWN_NOSIGNAL 0
+#endif
+
+#ifdef MSG_CMSG_CLOEXEC
+#define SPAWN_CMSG_CLOEXEC MSG_CMSG_CLOEXEC
+#else
+#define SPAWN_CMSG_CLOEXEC 0
+#endif
+
+#define SPAWN_INHERIT   0           /* the helper's descriptor */
+#define SPAWN_CLOSE     1           /* APR_NO_FILE */
+#define SPAWN_FD        2           /* passed along */
+
+#define SPAWN_MAXFDS    5           /* request, status, stdin/out/err */
+#define SPAWN_MAXDATA   (1024 * 1024)
+#define SPAWN_NLIMITS   4           /* APR_LIMIT_CPU..APR_LIMIT_NOFILE */
+
+typedef struct spawn_request_t {
+    apr_uint32_t size;              /* of the strings following */
+    apr_int32_t cmdtype;
+    apr_int32_t detached;
+    apr_int32_t errchk;
+    apr_int32_t nargs;
+    apr_int32_t nenv;               /* -1 for no environment */
+    apr_int32_t hasdir;
+    apr_int32_t stdio[3];
+    apr_uid_t uid;
+    apr_gid_t gid;
+#if APR_HAVE_STRUCT_RLIMIT
+    apr_int32_t limits;             /* mask of the limits set */
+    struct rlimit limit[SPAWN_NLIMITS];
+#endif
+} spawn_request_t;
+
+typedef struct spawn_reply_t {
+    apr_status_t status;
+    pid_t pid;
+} spawn_reply_t;
+
+typedef struct spawn_child_t {
+    pid_t pid;
+    int fd;                         /* the exit status comes through */
+} spawn_child_t;
+
+struct apr_proc_spawner_t {
+    apr_pool_t *pool;
+    int sd;                         /* datagrams to the helper */
+    int lifeline;
+    apr_hash_t *children;
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *lock;
+#endif
+};
+
+static int sigchld_pipe[2];
+
+static apr_status_t set_cloexec(int fd)
+{
+    int flags = fcntl(fd, F_GETFD);
+
+    if (flags == -1 || fcntl(fd, F_SETFD, flags | FD_CLOEXEC) == -1) {
+        return errno;
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t make_pair(int type, int sv[2])
+{
+    apr_status_t rv;
+
+    if (socketpair(AF_UNIX, type, 0, sv) == -1) {
+        return errno;
+    }
+    if ((rv = set_cloexec(sv[0])) != APR_SUCCESS
+        || (rv = set_cloexec(sv[1])) != APR_SUCCESS) {
+        close(sv[0]);
+        close(sv[1]);
+        return rv;
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t send_full(int sd, const void *buf, apr_size_t len)
+{
+    const char *ptr = buf;
+
+    while (len) {
+        ssize_t n = send(sd, ptr, len, SPAWN_NOSIGNAL);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        ptr += n;
+        len -= n;
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t read_full(int fd, void *buf, apr_size_t len)
+{
+    char *ptr = buf;
+
+    while (len) {
+        ssize_t n = read(fd, ptr, len);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        if (n == 0) {
+            return APR_EOF;
+        }
+        ptr += n;
+        len -= n;
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t send_fds(int sd, const void *buf, apr_size_t len,
+                             const int *fds, int nfds)
+{
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int) * SPAWN_MAXFDS)];
+    } control;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    ssize_t n;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    iov.iov_base = (void *)buf;
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+
+    do {
+        n = sendmsg(sd, &msg, SPAWN_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) {
+        return errno;
+    }
+    return (apr_size_t)n == len ? APR_SUCCESS : APR_EGENERAL;
+}
+
+static apr_status_t recv_fds(int sd, void *buf, apr_size_t len,
+                             int *fds, int *nfds)
+{
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int) * SPAWN_MAXFDS)];
+    } control;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    ssize_t n;
+    int i;
+
+    *nfds = 0;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    do {
+        n = recvmsg(sd, &msg, SPAWN_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) {
+        return errno;
+    }
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        int count;
+
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        count = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        for (i = 0; i < count; i++) {
+            int fd;
+
+            memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            if (*nfds < SPAWN_MAXFDS && set_cloexec(fd) == APR_SUCCESS) {
+                fds[(*nfds)++] = fd;
+            }
+            else {
+                close(fd);
+            }
+        }
+    }
+
+    if ((apr_size_t)n != len || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+        for (i = 0; i < *nfds; i++) {
+            close(fds[i]);
+        }
+        *nfds = 0;
+        return APR_EGENERAL;
+    }
+    return APR_SUCCESS;
+}
+
+/* --------------------------------------------------------------------
+ * The helper process
+ */
+
+static void spawner_sigchld(int signo)
+{
+    int errsave = errno;
+
+    if (write(sigchld_pipe[1], "", 1) < 0) {
+        /* full already */
+    }
+    errno = errsave;
+}
+
+static void spawner_sigpipe(int signo)
+{
+    /* EPIPE instead, the handler is reset for the programs run */
+}
+
+static void spawner_reap(apr_hash_t *children)
+{
+    spawn_child_t *child;
+    pid_t pid;
+    int status;
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        child = apr_hash_get(children, &pid, sizeof(pid));
+        if (child) {
+            (void) send_full(child->fd, &status, sizeof(status));
+            close(child->fd);
+            apr_hash_set(children, &child->pid, sizeof(child->pid), NULL);
+            free(child);
+        }
+    }
+}
+
+static const char *next_string(char **data, const char *end)
+{
+    char *str = *data;
+
+    if (str >= end) {
+        return NULL;
+    }
+    *data += strlen(str) + 1;
+    return str;
+}
+
+static apr_status_t spawner_proc_create(const spawn_request_t *req, int conn,
+                                        int *fds, int nfds, pid_t *pid,
+                                        apr_pool_t *p)
+{
+    apr_procattr_t *attr;
+    apr_file_t *files[3] = { NULL, NULL, NULL };
+    const char *progname, **args, **env = NULL, *dir = NULL;
+    char *data, *end;
+    apr_proc_t proc;
+    apr_status_t rv;
+    int i, used = 0;
+
+    if (req->size > SPAWN_MAXDATA || req->nargs < 0
+        || (apr_uint32_t)req->nargs > req->size || req->nenv < -1
+        || req->nenv > (apr_int32_t)req->size) {
+        rv = APR_EINVAL;
+        goto done;
+    }
+
+    data = apr_palloc(p, req->size + 1);
+    if ((rv = read_full(conn, data, req->size)) != APR_SUCCESS) {
+        goto done;
+    }
+    data[req->size] = '\0';
+    end = data + req->size;
+
+    rv = APR_EINVAL;
+    if ((progname = next_string(&data, end)) == NULL) {
+        goto done;
+    }
+    args = apr_pcalloc(p, (req->nargs + 1) * sizeof(*args));
+    for (i = 0; i < req->nargs; i++) {
+        if ((args[i] = next_string(&data, end)) == NULL) {
+            goto done;
+        }
+    }
+    if (req->nenv >= 0) {
+        env = apr_pcalloc(p, (req->nenv + 1) * sizeof(*env));
+        for (i = 0; i < req->nenv; i++) {
+            if ((env[i] = next_string(&data, end)) == NULL) {
+                goto done;
+            }
+        }
+    }
+    if (req->hasdir && (dir = next_string(&data, end)) == NULL) {
+        goto done;
+    }
+
+    if ((rv = apr_procattr_create(&attr, p)) != APR_SUCCESS) {
+        goto done;
+    }
+    attr->cmdtype = req->cmdtype;
+    attr->detached = req->detached;
+    attr->errchk = req->errchk;
+    attr->uid = req->uid;
+    attr->gid = req->gid;
+    attr->currdir = (char *)dir;
+#if APR_HAVE_STRUCT_RLIMIT
+    for (i = 0; i < SPAWN_NLIMITS; i++) {
+        if (req->limits & (1 << i)) {
+            apr_procattr_limit_set(attr, i, (struct rlimit *)&req->limit[i]);
+        }
+    }
+#endif
+
+    for (i = 0; i < 3; i++) {
+        if (req->stdio[i] == SPAWN_CLOSE) {
+            files[i] = apr_pcalloc(p, sizeof(apr_file_t));
+            files[i]->filedes = -1;
+        }
+        else if (req->stdio[i] == SPAWN_FD && used < nfds) {
+            apr_os_file_put(&files[i], &fds[used++], 0, p);
+        }
+    }
+    attr->child_in = files[0];
+    attr->child_out = files[1];
+    attr->child_err = files[2];
+
+    rv = apr_proc_create(&proc, progname, args, env, attr, p);
+    if (rv == APR_SUCCESS) {
+        *pid = proc.pid;
+    }
+
+done:
+    /* apr_proc_create() closed those it passed to the child */
+    for (i = 0; i < 3; i++) {
+        if (files[i] && files[i]->filedes != -1) {
+            close(files[i]->filedes);
+        }
+    }
+    for (i = used; i < nfds; i++) {
+        close(fds[i]);
+    }
+    return rv;
+}
+
+static void spawner_serve(int sd, apr_hash_t *children, apr_pool_t *p)
+{
+    spawn_request_t req;
+    spawn_reply_t reply;
+    spawn_child_t *child;
+    int fds[SPAWN_MAXFDS], nfds, i;
+
+    if (recv_fds(sd, &req, sizeof(req), fds, &nfds) != APR_SUCCESS) {
+        return;
+    }
+    if (nfds < 2) {
+        for (i = 0; i < nfds; i++) {
+            close(fds[i]);
+        }
+        return;
+    }
+
+    reply.pid = -1;
+    if ((child = malloc(sizeof(*child))) == NULL) {
+        reply.status = APR_ENOMEM;
+        for (i = 2; i < nfds; i++) {
+            close(fds[i]);
+        }
+    }
+    else {
+        reply.status = spawner_proc_create(&req, fds[0], fds + 2, nfds - 2,
+                                           &reply.pid, p);
+    }
+
+    if (reply.status == APR_SUCCESS) {
+        child->pid = reply.pid;
+        child->fd = fds[1];
+        apr_hash_set(children, &child->pid, sizeof(child->pid), child);
+    }
+    else {
+        free(child);
+        close(fds[1]);
+    }
+
+    (void) send_full(fds[0], &reply, sizeof(reply));
+    close(fds[0]);
+}
+
+static void spawner_main(int sd, int lifeline)
+{
+    apr_pool_t *pool, *p;
+    apr_hash_t *children;
+    struct pollfd pfd[3];
+    struct sigaction sa;
+    sigset_t sigs;
+    char buf[64];
+    long fd, maxfd;
+
+    /* the caller's descriptors not to be inherited are not ours either */
+    maxfd = sysconf(_SC_OPEN_MAX);
+    for (fd = STDERR_FILENO + 1; fd < maxfd; fd++) {
+        int flags;
+
+        if (fd != sd && fd != lifeline
+            && (flags = fcntl(fd, F_GETFD)) != -1 && (flags & FD_CLOEXEC)) {
+            close(fd);
+        }
+    }
+
+    if (apr_pool_create_unmanaged_ex(&pool, NULL, NULL) != APR_SUCCESS
+        || apr_pool_create(&p, pool) != APR_SUCCESS) {
+        _exit(1);
+    }
+    children = apr_hash_make(pool);
+
+    if (pipe(sigchld_pipe) == -1
+        || set_cloexec(sigchld_pipe[0]) != APR_SUCCESS
+        || set_cloexec(sigchld_pipe[1]) != APR_SUCCESS
+        || fcntl(sigchld_pipe[0], F_SETFL, O_NONBLOCK) == -1
+        || fcntl(sigchld_pipe[1], F_SETFL, O_NONBLOCK) == -1) {
+        _exit(1);
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_NOCLDSTOP;
+    sa.sa_handler = spawner_sigchld;
+    sigaction(SIGCHLD, &sa, NULL);
+    sa.sa_flags = 0;
+    sa.sa_handler = spawner_sigpipe;
+    sigaction(SIGPIPE, &sa, NULL);
+
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGCHLD);
+    sigaddset(&sigs, SIGPIPE);
+    sigprocmask(SIG_UNBLOCK, &sigs, NULL);
+
+    for (;;) {
+        pfd[0].fd = sd;
+        pfd[0].events = POLLIN;
+        pfd[1].fd = lifeline;
+        pfd[1].events = POLLIN;
+        pfd[2].fd = sigchld_pipe[0];
+        pfd[2].events = POLLIN;
+
+        if (poll(pfd, 3, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            _exit(1);
+        }
+
+        if (pfd[2].revents) {
+            while (read(sigchld_pipe[0], buf, sizeof(buf)) > 0) {
+                /* drain */
+            }
+            spawner_reap(children);
+        }
+        if (pfd[0].revents & POLLIN) {
+            spawner_serve(sd, children, p);
+            apr_pool_clear(p);
+        }
+        if (pfd[1].revents) {
+            /* nothing is written there, the last user is gone */
+            _exit(0);
+        }
+    }
+}
+
+/* --------------------------------------------------------------------
+ * The users
+ */
+
+static apr_status_t spawner_cleanup(void *data)
+{
+    apr_proc_spawner_t *spawner = data;
+    apr_hash_index_t *hi;
+
+    for (hi = apr_hash_first(NULL, spawner->children); hi;
+         hi = apr_hash_next(hi)) {
+        spawn_child_t *child = apr_hash_this_val(hi);
+
+        close(child->fd);
+        free(child);
+    }
+    apr_hash_clear(spawner->children);
+
+    close(spawner->sd);
+    close(spawner->lifeline);
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_proc_spawner_create(apr_proc_spawner_t **spawner,
+                                                  apr_pool_t *pool)
+{
+    apr_proc_spawner_t *new;
+    apr_status_t rv;
+    int sv[2], life[2], status;
+    pid_t pid;
+
+    new = apr_pcalloc(pool, sizeof(*new));
+    new->pool = pool;
+    new->children = apr_hash_make(pool);
+#if APR_HAS_THREADS
+    if ((rv = apr_thread_mutex_create(&new->lock, APR_THREAD_MUTEX_DEFAULT,
+                                      pool)) != APR_SUCCESS) {
+        return rv;
+    }
+#endif
+
+    if ((rv = make_pair(SOCK_DGRAM, sv)) != APR_SUCCESS) {
+        return rv;
+    }
+    if (pipe(life) == -1) {
+        rv = errno;
+        close(sv[0]);
+        close(sv[1]);
+        return rv;
+    }
+    if ((rv = set_cloexec(life[0])) != APR_SUCCESS
+        || (rv = set_cloexec(life[1])) != APR_SUCCESS
+        || (pid = fork()) < 0) {
+        if (rv == APR_SUCCESS) {
+            rv = errno;
+        }
+        close(sv[0]);
+        close(sv[1]);
+        close(life[0]);
+        close(life[1]);
+        return rv;
+    }
+
+    if (pid == 0) {
+        close(sv[0]);
+        close(life[1]);
+
+        /* reparented, nothing for the caller to reap */
+        if ((pid = fork()) != 0) {
+            _exit(pid < 0);
+        }
+        spawner_main(sv[1], life[0]);
+    }
+
+    close(sv[1]);
+    close(life[0]);
+
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            status = -1;
+            break;
+        }
+    }
+    new->sd = sv[0];
+    new->lifeline = life[1];
+
+    if (status != 0) {
+        spawner_cleanup(new);
+        return APR_EGENERAL;
+    }
+
+    apr_pool_cleanup_register(pool, new, spawner_cleanup,
+                              apr_pool_cleanup_null);
+
+    *spawner = new;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_proc_spawner_proc_create(apr_proc_spawner_t *spawner,
+                                                       apr_proc_t *new_proc,
+                                                       const char *progname,
+                                                       const char * const *args,
+                                                       const char * const *env,
+                                                       apr_procattr_t *attr,
+                                                       apr_pool_t *pool)
+{
+    spawn_request_t req;
+    spawn_reply_t reply;
+    spawn_child_t *child;
+    apr_file_t *stdio[3];
+    apr_size_t size, len;
+    char *data, *ptr;
+    int fds[SPAWN_MAXFDS], nfds = 2, conn[2], status[2];
+    apr_status_t rv;
+    int i;
+
+    if (attr->perms_set_callbacks) {
+        return APR_ENOTIMPL;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.cmdtype = attr->cmdtype;
+    req.detached = attr->detached;
+    req.errchk = attr->errchk;
+    req.uid = attr->uid;
+    req.gid = attr->gid;
+    req.hasdir = (attr->currdir != NULL);
+#if APR_HAVE_STRUCT_RLIMIT
+#ifdef RLIMIT_CPU
+    if (attr->limit_cpu) {
+        req.limits |= 1 << APR_LIMIT_CPU;
+        req.limit[APR_LIMIT_CPU] = *attr->limit_cpu;
+    }
+#endif
+#if defined (RLIMIT_DATA) || defined (RLIMIT_VMEM) || defined(RLIMIT_AS)
+    if (attr->limit_mem) {
+        req.limits |= 1 << APR_LIMIT_MEM;
+        req.limit[APR_LIMIT_MEM] = *attr->limit_mem;
+    }
+#endif
+#ifdef RLIMIT_NPROC
+    if (attr->limit_nproc) {
+        req.limits |= 1 << APR_LIMIT_NPROC;
+        req.limit[APR_LIMIT_NPROC] = *attr->limit_nproc;
+    }
+#endif
+#ifdef RLIMIT_NOFILE
+    if (attr->limit_nofile) {
+        req.limits |= 1 << APR_LIMIT_NOFILE;
+        req.limit[APR_LIMIT_NOFILE] = *attr->limit_nofile;
+    }
+#endif
+#endif
+
+    /* the strings: progname, args, env and dir */
+    size = strlen(progname) + 1;
+    for (i = 0; args && args[i]; i++) {
+        size += strlen(args[i]) + 1;
+    }
+    req.nargs = i;
+    req.nenv = -1;
+    if (env) {
+        for (i = 0; env[i]; i++) {
+            size += strlen(env[i]) + 1;
+        }
+        req.nenv = i;
+    }
+    if (attr->currdir) {
+        size += strlen(attr->currdir) + 1;
+    }
+    if (size > SPAWN_MAXDATA) {
+        return APR_EINVAL;
+    }
+    req.size = (apr_uint32_t)size;
+
+    ptr = data = apr_palloc(pool, size);
+    len = strlen(progname) + 1;
+    memcpy(ptr, progname, len);
+    ptr += len;
+    for (i = 0; i < req.nargs; i++) {
+        len = strlen(args[i]) + 1;
+        memcpy(ptr, args[i], len);
+        ptr += len;
+    }
+    for (i = 0; i < req.nenv; i++) {
+        len = strlen(env[i]) + 1;
+        memcpy(ptr, env[i], len);
+        ptr += len;
+    }
+    if (attr->currdir) {
+        memcpy(ptr, attr->currdir, strlen(attr->currdir) + 1);
+    }
+
+    stdio[0] = attr->child_in;
+    stdio[1] = attr->child_out;
+    stdio[2] = attr->child_err;
+    for (i = 0; i < 3; i++) {
+        if (stdio[i] == NULL) {
+            req.stdio[i] = SPAWN_INHERIT;
+        }
+        else if (stdio[i]->filedes == -1) {
+            req.stdio[i] = SPAWN_CLOSE;
+        }
+        else {
+            req.stdio[i] = SPAWN_FD;
+            fds[nfds++] = stdio[i]->filedes;
+        }
+    }
+
+    if ((child = malloc(sizeof(*child))) == NULL) {
+        return APR_ENOMEM;
+    }
+    if ((rv = make_pair(SOCK_STREAM, conn)) != APR_SUCCESS) {
+        free(child);
+        return rv;
+    }
+    if ((rv = make_pair(SOCK_STREAM, status)) != APR_SUCCESS) {
+        close(conn[0]);
+        close(conn[1]);
+        free(child);
+        return rv;
+    }
+
+    fds[0] = conn[1];
+    fds[1] = status[1];
+    rv = send_fds(spawner->sd, &req, sizeof(req), fds, nfds);
+    close(conn[1]);
+    close(status[1]);
+    if (rv == APR_SUCCESS) {
+        rv = send_full(conn[0], data, size);
+    }
+    if (rv == APR_SUCCESS) {
+        rv = read_full(conn[0], &reply, sizeof(reply));
+    }
+    close(conn[0]);
+    if (rv == APR_SUCCESS) {
+        rv = reply.status;
+    }
+    if (rv != APR_SUCCESS) {
+        close(status[0]);
+        free(child);
+        return rv;
+    }
+
+    child->pid = reply.pid;
+    child->fd = status[0];
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(spawner->lock);
+#endif
+    apr_hash_set(spawner->children, &child->pid, sizeof(child->pid), child);
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(spawner->lock);
+#endif
+
+    new_proc->pid = reply.pid;
+    new_proc->in = attr->parent_in;
+    new_proc->out = attr->parent_out;
+    new_proc->err = attr->parent_err;
+
+    /* with the child now, as apr_proc_create() does */
+    for (i = 0; i < 3; i++) {
+        if (stdio[i] && stdio[i]->filedes != -1) {
+            apr_file_close(stdio[i]);
+        }
+    }
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_proc_spawner_wait(apr_proc_spawner_t *spawner,
+                                                apr_proc_t *proc,
+                                                int *exitcode,
+                                                apr_exit_why_e *exitwhy,
+                                                apr_wait_how_e waithow)
+{
+    spawn_child_t *child;
+    struct pollfd pfd;
+    apr_status_t rv;
+    int status, n;
+    int ignore;
+    apr_exit_why_e ignorewhy;
+
+    if (exitcode == NULL) {
+        exitcode = &ignore;
+    }
+
+    if (exitwhy == NULL) {
+        exitwhy = &ignorewhy;
+    }
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(spawner->lock);
+#endif
+    child = apr_hash_get(spawner->children, &proc->pid, sizeof(proc->pid));
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(spawner->lock);
+#endif
+    if (child == NULL) {
+        return ECHILD;
+    }
+
+    if (waithow != APR_WAIT) {
+        pfd.fd = child->fd;
+        pfd.events = POLLIN;
+        do {
+            n = poll(&pfd, 1, 0);
+        } while (n < 0 && errno == EINTR);
+
+        if (n < 0) {
+            return errno;
+        }
+        if (n == 0) {
+            return APR_CHILD_NOTDONE;
+        }
+    }
+
+    rv = read_full(child->fd, &status, sizeof(status));
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(spawner->lock);
+#endif
+    apr_hash_set(spawner->children, &child->pid, sizeof(child->pid), NULL);
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(spawner->lock);
+#endif
+    close(child->fd);
+    free(child);
+
+    if (rv != APR_SUCCESS) {
+        /* the helper is gone */
+        return APR_STATUS_IS_EOF(rv) ? ECHILD : rv;
+    }
+
+    return apr_unix_proc_exit_status(status, exitcode, exitwhy);
+}
+
+#else /* !SCM_RIGHTS */
+
+APR_DECLARE(apr_status_t) apr_proc_spawner_create(apr_proc_spawner_t **spawner,
+                                                  apr_pool_t *pool)
+{
+    return APR_ENOTIMPL;
+}
+
+APR_DECLARE(apr_status_t) apr_proc_spawner_proc_create(apr_proc_spawner_t *spawner,
+                                                       apr_proc_t *new_proc,
+                                                       const char *progname,
+                                                       const char * const *args,
+                                                       const char * const *env,
+                                                       apr_procattr_t *attr,
+                                                       apr_pool_t *pool)
+{
+    return APR_ENOTIMPL;
+}
+
+APR_DECLARE(apr_status_t) apr_proc_spawner_wait(apr_proc_spawner_t *spawner,
+                                                apr_proc_t *proc,
+                                                int *exitcode,
+                                                apr_exit_why_e *exitwhy,
+                                                apr_wait_how_e waithow)
+{
+    return APR_ENOTIMPL;
+}
+
+#endif
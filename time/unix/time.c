@@ -19,6 +19,7 @@
 #include "apr_lib.h"
 #include "apr_private.h"
 #include "apr_strings.h"
+#include "apr_thread_proc.h" /* for APR_THREAD_LOCAL */
 
 /* private APR headers */
 #include "apr_arch_internal_time.h"
@@ -33,6 +34,9 @@
 #ifdef HAVE_TIME_H
 #include <time.h>
 #endif
+#ifdef HAVE_MACH_MACH_TIME_H
+#include <mach/mach_time.h>
+#endif
 /* End System Headers */
 
 #if !defined(HAVE_STRUCT_TM_TM_GMTOFF) && !defined(HAVE_STRUCT_TM___TM_GMTOFF)
@@ -78,12 +82,81 @@ APR_DECLARE(apr_time_t) apr_time_now(void)
     return tv.tv_sec * (apr_time_t)APR_USEC_PER_SEC + (apr_time_t)tv.tv_usec;
 }
 
+#ifdef HAVE_CLOCK_GETTIME
+#if defined(CLOCK_REALTIME_COARSE)
+#define APR_CLOCK_COARSE CLOCK_REALTIME_COARSE  /* Linux */
+#elif defined(CLOCK_REALTIME_FAST)
+#define APR_CLOCK_COARSE CLOCK_REALTIME_FAST    /* FreeBSD */
+#endif
+#endif
+
+APR_DECLARE(apr_time_t) apr_time_now_coarse(void)
+{
+#ifdef APR_CLOCK_COARSE
+    struct timespec ts;
+    if (clock_gettime(APR_CLOCK_COARSE, &ts) == 0) {
+        return ts.tv_sec * (apr_time_t)APR_USEC_PER_SEC
+               + (apr_time_t)(ts.tv_nsec / 1000);
+    }
+#endif
+    return apr_time_now();
+}
+
+APR_DECLARE(apr_time_t) apr_time_monotonic(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+        return ts.tv_sec * (apr_time_t)APR_USEC_PER_SEC
+               + (apr_time_t)(ts.tv_nsec / 1000);
+    }
+#elif defined(HAVE_MACH_MACH_TIME_H)
+    static mach_timebase_info_data_t timebase;
+    if (!timebase.denom) {
+        /* Racing initializers all store the same values */
+        mach_timebase_info(&timebase);
+    }
+    return (apr_time_t)(mach_absolute_time() / 1000
+                        * timebase.numer / timebase.denom);
+#endif
+    return apr_time_now();
+}
+
+/* Logging explodes the same second over and over, so each thread keeps
+ * the last second exploded as GMT and as local time.  Local time can
+ * only change at a second boundary, but a TZ change made while the
+ * same second is still being exploded is not seen until the next one.
+ */
+#if APR_HAS_THREADS && APR_HAS_THREAD_LOCAL
+#define EXPLODE_CACHE APR_THREAD_LOCAL
+#elif !APR_HAS_THREADS
+#define EXPLODE_CACHE
+#endif
+
+#ifdef EXPLODE_CACHE
+static EXPLODE_CACHE struct {
+    time_t tt;
+    int valid;
+    apr_time_exp_t xt;
+} explode_cache[2];
+#endif
+
 static void explode_time(apr_time_exp_t *xt, apr_time_t t,
                          apr_int32_t offset, int use_localtime)
 {
     struct tm tm;
     time_t tt = (t / APR_USEC_PER_SEC) + offset;
-    xt->tm_usec = t % APR_USEC_PER_SEC;
+    apr_int32_t usec = t % APR_USEC_PER_SEC;
+#ifdef EXPLODE_CACHE
+    int i = use_localtime != 0;
+
+    if (explode_cache[i].valid && explode_cache[i].tt == tt) {
+        *xt = explode_cache[i].xt;
+        xt->tm_usec = usec;
+        return;
+    }
+#endif
+    xt->tm_usec = usec;
 
 #if APR_HAS_THREADS && defined (_POSIX_THREAD_SAFE_FUNCTIONS)
     if (use_localtime)
@@ -107,6 +180,12 @@ static void explode_time(apr_time_exp_t *xt, apr_time_t t,
     xt->tm_yday = tm.tm_yday;
     xt->tm_isdst = tm.tm_isdst;
     xt->tm_gmtoff = get_offset(&tm);
+
+#ifdef EXPLODE_CACHE
+    explode_cache[i].tt = tt;
+    explode_cache[i].xt = *xt;
+    explode_cache[i].valid = 1;
+#endif
 }
 
 APR_DECLARE(apr_status_t) apr_time_exp_tz(apr_time_exp_t *result,
@@ -97,6 +97,29 @@ APR_DECLARE(apr_time_t) apr_time_now(void)
     return aprtime;
 }
 
+APR_DECLARE(apr_time_t) apr_time_now_coarse(void)
+{
+    /* GetSystemTimeAsFileTime() already reads the tick-granular
+     * system time without a hardware clock query.
+     */
+    return apr_time_now();
+}
+
+APR_DECLARE(apr_time_t) apr_time_monotonic(void)
+{
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+
+    /* The frequency is fixed at boot; racing initializers agree */
+    if (!freq.QuadPart && !QueryPerformanceFrequency(&freq)) {
+        return apr_time_now();
+    }
+    QueryPerformanceCounter(&count);
+    return (apr_time_t)(count.QuadPart / freq.QuadPart) * APR_USEC_PER_SEC
+           + (apr_time_t)(count.QuadPart % freq.QuadPart)
+             * APR_USEC_PER_SEC / freq.QuadPart;
+}
+
 APR_DECLARE(apr_status_t) apr_time_exp_gmt(apr_time_exp_t *result,
                                            apr_time_t input)
 {
@@ -17,6 +17,7 @@
 #include "apr_arch_atime.h"
 #include "apr_portable.h"
 #include "apr_strings.h"
+#include "apr_thread_proc.h" /* for APR_THREAD_LOCAL */
 
 #if APR_HAVE_STDLIB_H
 #include <stdlib.h>
@@ -31,11 +32,37 @@ APR_DECLARE_DATA const char apr_day_snames[7][4] =
     "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
 };
 
+/* The same second is usually formatted many times in a row, so each
+ * thread keeps the last one.
+ */
+#if APR_HAS_THREADS && APR_HAS_THREAD_LOCAL
+#define RFC822_DATE_CACHE APR_THREAD_LOCAL
+#elif !APR_HAS_THREADS
+#define RFC822_DATE_CACHE
+#endif
+
+#ifdef RFC822_DATE_CACHE
+static RFC822_DATE_CACHE struct {
+    apr_time_t sec;
+    char date[APR_RFC822_DATE_LEN];
+} rfc822_date_cache;
+#endif
+
 APR_DECLARE(apr_status_t) apr_rfc822_date(char *date_str, apr_time_t t)
 {
     apr_time_exp_t xt;
     const char *s;
     int real_year;
+#ifdef RFC822_DATE_CACHE
+    char *start = date_str;
+
+    /* the cache starts empty, and holds no time before the epoch */
+    if (t >= 0 && rfc822_date_cache.date[0]
+        && rfc822_date_cache.sec == apr_time_sec(t)) {
+        memcpy(date_str, rfc822_date_cache.date, APR_RFC822_DATE_LEN);
+        return APR_SUCCESS;
+    }
+#endif
 
     apr_time_exp_gmt(&xt, t);
 
@@ -76,6 +103,13 @@ APR_DECLARE(apr_status_t) apr_rfc822_date(char *date_str, apr_time_t t)
     *date_str++ = 'M';
     *date_str++ = 'T';
     *date_str++ = 0;
+
+#ifdef RFC822_DATE_CACHE
+    if (t >= 0) {
+        rfc822_date_cache.sec = apr_time_sec(t);
+        memcpy(rfc822_date_cache.date, start, APR_RFC822_DATE_LEN);
+    }
+#endif
     return APR_SUCCESS;
 }
 
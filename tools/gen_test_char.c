@@ -35,10 +35,13 @@
 #define T_ESCAPE_LDAP_DN      (0x40)
 #define T_ESCAPE_LDAP_FILTER  (0x80)
 
+#define T_FLAGS_COUNT 8
+
 int main(int argc, char *argv[])
 {
-    unsigned c;
+    unsigned c, i;
     unsigned char flags;
+    unsigned char table[256];
 
     printf("/* this file is automatically generated by gen_test_char, "
            "do not edit. \"make include/private/apr_escape_test_char.h\" to regenerate. */\n"
@@ -122,10 +125,43 @@ int main(int argc, char *argv[])
             flags |= T_ESCAPE_LDAP_FILTER;
         }
 
+        table[c] = flags;
         printf("%u%c", flags, (c < 255) ? ',' : ' ');
     }
 
     printf("\n};\n");
 
+    /* The same by flag, as bitmaps of the high nibbles indexed by the low
+     * nibble, so that a vector can be looked up at once.  NUL and, for
+     * urlencoding, the space end the runs of characters copied as is too.
+     */
+    printf("\n"
+           "/* For each flag by increasing value, the characters ending a run of\n"
+           " * characters copied as is: bit h of entry l is set for the character\n"
+           " * (h << 4 | l) in the first 16 entries, (8 + h) << 4 | l in the next.\n"
+           " */\n"
+           "static const unsigned char test_char_runs[%u][32] = {", T_FLAGS_COUNT);
+
+    for (i = 0; i < T_FLAGS_COUNT; ++i) {
+        printf("\n    {");
+        for (c = 0; c < 32; ++c) {
+            unsigned h, bits = 0;
+
+            for (h = 0; h < 8; ++h) {
+                unsigned ch = ((h + (c & 16 ? 8 : 0)) << 4) | (c & 15);
+
+                if ((table[ch] & (1u << i)) || ch == 0
+                    || ((1u << i) == T_ESCAPE_URLENCODED && ch == ' ')) {
+                    bits |= 1u << h;
+                }
+            }
+            printf("%s%u%s", (c % 16 == 0) ? "\n        " : " ", bits,
+                   (c < 31) ? "," : "");
+        }
+        printf("\n    }%s", (i < T_FLAGS_COUNT - 1) ? "," : "");
+    }
+
+    printf("\n};\n");
+
     return 0;
 }
@@ -25,6 +25,7 @@
 #include "apr.h"
 #include "apr_general.h"
 #include "apr_strings.h"
+#include "apr_strbuf.h"
 
 #define APR_WANT_STRFUNC
 #include "apr_want.h"
@@ -91,72 +92,79 @@ APR_DECLARE(char *) apr_uri_unparse(apr_pool_t *p,
                                     const apr_uri_t *uptr,
                                     unsigned flags)
 {
-    char *ret = "";
+    apr_strbuf_t sb;
+
+    apr_strbuf_init(&sb, p, 0);
 
     /* If suppressing the site part, omit both user name & scheme://hostname */
     if (!(flags & APR_URI_UNP_OMITSITEPART)) {
+        int show_user = (uptr->user && !(flags & APR_URI_UNP_OMITUSER));
+        int show_password = (uptr->password
+                             && !(flags & APR_URI_UNP_OMITPASSWORD));
 
-        /* Construct a "user:password@" string, honoring the passed
-         * APR_URI_UNP_ flags: */
-        if (uptr->user || uptr->password) {
-            ret = apr_pstrcat(p,
-                      (uptr->user     && !(flags & APR_URI_UNP_OMITUSER))
-                          ? uptr->user : "",
-                      (uptr->password && !(flags & APR_URI_UNP_OMITPASSWORD))
-                          ? ":" : "",
-                      (uptr->password && !(flags & APR_URI_UNP_OMITPASSWORD))
-                          ? ((flags & APR_URI_UNP_REVEALPASSWORD)
-                              ? uptr->password : "XXXXXXXX")
-                          : "",
-                      ((uptr->user     && !(flags & APR_URI_UNP_OMITUSER)) ||
-                       (uptr->password && !(flags & APR_URI_UNP_OMITPASSWORD)))
-                          ? "@" : "",
-                      NULL);
+        if (uptr->scheme) {
+            apr_strbuf_appendstr(&sb, uptr->scheme);
+            apr_strbuf_appendc(&sb, ':');
         }
 
-        /* Construct scheme://site string */
+        /* Construct the //user:password@site string, honoring the passed
+         * APR_URI_UNP_ flags; without a hostname only
+         * user:password@ remains.
+         */
         if (uptr->hostname) {
-            int is_default_port;
-            const char *lbrk = "", *rbrk = "";
+            apr_strbuf_append(&sb, "//", 2);
+        }
+        if (show_user) {
+            apr_strbuf_appendstr(&sb, uptr->user);
+        }
+        if (show_password) {
+            apr_strbuf_appendc(&sb, ':');
+            apr_strbuf_appendstr(&sb, (flags & APR_URI_UNP_REVEALPASSWORD)
+                                      ? uptr->password : "XXXXXXXX");
+        }
+        if (show_user || show_password) {
+            apr_strbuf_appendc(&sb, '@');
+        }
 
-            if (strchr(uptr->hostname, ':')) { /* v6 literal */
-                lbrk = "[";
-                rbrk = "]";
-            }
+        if (uptr->hostname) {
+            int is_default_port;
+            int is_v6_literal = (strchr(uptr->hostname, ':') != NULL);
 
             is_default_port =
                 (uptr->port_str == NULL ||
                  uptr->port == 0 ||
                  uptr->port == apr_uri_port_of_scheme(uptr->scheme));
 
-            ret = apr_pstrcat(p, "//", ret, lbrk, uptr->hostname, rbrk,
-                        is_default_port ? "" : ":",
-                        is_default_port ? "" : uptr->port_str,
-                        NULL);
+            if (is_v6_literal) {
+                apr_strbuf_appendc(&sb, '[');
+            }
+            apr_strbuf_appendstr(&sb, uptr->hostname);
+            if (is_v6_literal) {
+                apr_strbuf_appendc(&sb, ']');
+            }
+            if (!is_default_port) {
+                apr_strbuf_appendc(&sb, ':');
+                apr_strbuf_appendstr(&sb, uptr->port_str);
+            }
         }
-	if (uptr->scheme) {
-	    ret = apr_pstrcat(p, uptr->scheme, ":", ret, NULL);
-	}
     }
 
     /* Should we suppress all path info? */
     if (!(flags & APR_URI_UNP_OMITPATHINFO)) {
         /* Append path, query and fragment strings: */
-        ret = apr_pstrcat(p,
-                          ret,
-                          (uptr->path)
-                              ? uptr->path : "",
-                          (uptr->query    && !(flags & APR_URI_UNP_OMITQUERY))
-                              ? "?" : "",
-                          (uptr->query    && !(flags & APR_URI_UNP_OMITQUERY))
-                              ? uptr->query : "",
-                          (uptr->fragment && !(flags & APR_URI_UNP_OMITQUERY))
-                              ? "#" : NULL,
-                          (uptr->fragment && !(flags & APR_URI_UNP_OMITQUERY))
-                              ? uptr->fragment : NULL,
-                          NULL);
+        if (uptr->path) {
+            apr_strbuf_appendstr(&sb, uptr->path);
+        }
+        if (uptr->query && !(flags & APR_URI_UNP_OMITQUERY)) {
+            apr_strbuf_appendc(&sb, '?');
+            apr_strbuf_appendstr(&sb, uptr->query);
+        }
+        if (uptr->fragment && !(flags & APR_URI_UNP_OMITQUERY)) {
+            apr_strbuf_appendc(&sb, '#');
+            apr_strbuf_appendstr(&sb, uptr->fragment);
+        }
     }
-    return ret;
+    return apr_strbuf_finish(&sb, NULL);
 }
 
 /* Here is the hand-optimized parse_uri_components().  There are some wild
@@ -702,26 +710,35 @@ static const unsigned char uri_delims[256] = {
 #endif
 
 
-/* it works like this:
-    if (uri_delims[ch] & NOTEND_foobar) {
-        then we're not at a delimiter for foobar
+/* the default port of a scheme that is not null terminated */
+static apr_port_t port_of_scheme(const char *scheme_str, apr_size_t len)
+{
+    schemes_t *scheme;
+
+    for (scheme = schemes; scheme->name != NULL; ++scheme) {
+        if (strncasecmp(scheme_str, scheme->name, len) == 0
+            && scheme->name[len] == '\0') {
+            return scheme->default_port;
+        }
     }
-*/
+    return 0;
+}
 
-#define NOTEND_HOSTINFO   (T_SLASH | T_QUESTION | T_HASH | T_NUL)
-#define NOTEND_PATH       (T_QUESTION | T_HASH | T_NUL)
+/* set a part to [start, end) of the uri */
+#define URI_SPAN(span, start, end) \
+    ((span).off = (start) - base, (span).len = (end) - (start))
 
-/* parse_uri_components():
- * Parse a given URI, fill in all supplied fields of a uri_components
- * structure. This eliminates the necessity of extracting host, port,
- * path, query info repeatedly in the modules.
+/* apr_uri_parse_spans():
+ * Parse a given URI, locating all the fields of a apr_uri_t in it.
+ * The delimiters are found with strcspn() and memchr(), which the C
+ * library vectorizes.
  * Side effects:
- *  - fills in fields of uri_components *uptr
- *  - none on any of the r->* fields
+ *  - fills in fields of apr_uri_spans_t *spans
  */
-APR_DECLARE(apr_status_t) apr_uri_parse(apr_pool_t *p, const char *uri,
-                                        apr_uri_t *uptr)
+APR_DECLARE(apr_status_t) apr_uri_parse_spans(const char *uri,
+                                              apr_uri_spans_t *spans)
 {
+    const char *base = uri;
     const char *s;
     const char *s1;
     const char *hostinfo;
@@ -729,11 +746,14 @@ APR_DECLARE(apr_status_t) apr_uri_parse(apr_pool_t *p, const char *uri,
     int port;
     int v6_offset1 = 0, v6_offset2 = 0;
 
-    /* Initialize the structure. parse_uri() and parse_uri_components()
-     * can be called more than once per request.
-     */
-    memset (uptr, '\0', sizeof(*uptr));
-    uptr->is_initialized = 1;
+    /* Initialize the structure, all parts absent. */
+    spans->scheme.off = spans->hostinfo.off = spans->user.off =
+        spans->password.off = spans->hostname.off = spans->port_str.off =
+        spans->path.off = spans->query.off = spans->fragment.off = -1;
+    spans->scheme.len = spans->hostinfo.len = spans->user.len =
+        spans->password.len = spans->hostname.len = spans->port_str.len =
+        spans->path.len = spans->query.len = spans->fragment.len = 0;
+    spans->port = 0;
 
     /* We assume the processor has a branch predictor like most --
      * it assumes forward branches are untaken and backwards are taken.  That's
@@ -758,12 +778,9 @@ deal_with_path:
         /* we expect uri to point to first character of path ... remember
          * that the path could be empty -- http://foobar?query for example
          */
-        s = uri;
-        while ((uri_delims[*(unsigned char *)s] & NOTEND_PATH) == 0) {
-            ++s;
-        }
+        s = uri + strcspn(uri, "?#");
         if (s != uri) {
-            uptr->path = apr_pstrmemdup(p, uri, s - uri);
+            URI_SPAN(spans->path, uri, s);
         }
         if (*s == 0) {
             return APR_SUCCESS;
@@ -772,16 +789,16 @@ deal_with_path:
             ++s;
             s1 = strchr(s, '#');
             if (s1) {
-                uptr->fragment = apr_pstrdup(p, s1 + 1);
-                uptr->query = apr_pstrmemdup(p, s, s1 - s);
+                URI_SPAN(spans->fragment, s1 + 1, s1 + 1 + strlen(s1 + 1));
+                URI_SPAN(spans->query, s, s1);
             }
             else {
-                uptr->query = apr_pstrdup(p, s);
+                URI_SPAN(spans->query, s, s + strlen(s));
             }
             return APR_SUCCESS;
         }
         /* otherwise it's a fragment */
-        uptr->fragment = apr_pstrdup(p, s + 1);
+        URI_SPAN(spans->fragment, s + 1, s + 1 + strlen(s + 1));
         return APR_SUCCESS;
     }
 
@@ -795,7 +812,7 @@ deal_with_path:
     }
     /* scheme must be non-empty and followed by : */
     if (s != uri && s[0] == ':') {
-        uptr->scheme = apr_pstrmemdup(p, uri, s - uri);
+        URI_SPAN(spans->scheme, uri, s);
         s++;
     }
     else {
@@ -809,13 +826,10 @@ deal_with_path:
              * RFC 3986 3.3: If we have no scheme and no authority,
              * the leading segment of a relative path must not contain a ':'.
              */
-            char *first_slash = strchr(uri, '/');
+            const char *first_slash = strchr(uri, '/');
             if (first_slash) {
-                while (s < first_slash) {
-                    if (s[0] == ':')
-                        return APR_EGENERAL;
-                    ++s;
-                }
+                if (memchr(uri, ':', first_slash - uri) != NULL)
+                    return APR_EGENERAL;
                 /* no scheme but relative path, e.g. '../image.jpg' */
             }
             else {
@@ -834,11 +848,9 @@ deal_with_path:
 
 deal_with_authority:
     hostinfo = s;
-    while ((uri_delims[*(unsigned char *)s] & NOTEND_HOSTINFO) == 0) {
-        ++s;
-    }
+    s += strcspn(s, "/?#");
     uri = s;        /* whatever follows hostinfo is start of uri */
-    uptr->hostinfo = apr_pstrmemdup(p, hostinfo, uri - hostinfo);
+    URI_SPAN(spans->hostinfo, hostinfo, uri);
 
     /* If there's a username:password@host:port, the @ we want is the last @...
      * too bad there's no memrchr()... For the C purists, note that hostinfo
@@ -871,43 +883,91 @@ deal_with_host:
         }
         if (s == NULL) {
             /* we expect the common case to have no port */
-            uptr->hostname = apr_pstrmemdup(p,
-                                            hostinfo + v6_offset1,
-                                            uri - hostinfo - v6_offset2);
+            URI_SPAN(spans->hostname, hostinfo + v6_offset1,
+                     uri - (v6_offset2 - v6_offset1));
             goto deal_with_path;
         }
-        uptr->hostname = apr_pstrmemdup(p,
-                                        hostinfo + v6_offset1,
-                                        s - hostinfo - v6_offset2);
+        URI_SPAN(spans->hostname, hostinfo + v6_offset1,
+                 s - (v6_offset2 - v6_offset1));
         ++s;
-        uptr->port_str = apr_pstrmemdup(p, s, uri - s);
+        URI_SPAN(spans->port_str, s, uri);
         if (uri != s) {
-            port = strtol(uptr->port_str, &endstr, 10);
-            uptr->port = port;
-            if (*endstr == '\0') {
+            /* the first delimiter after the port is not a digit */
+            port = strtol(s, &endstr, 10);
+            spans->port = port;
+            if (endstr == uri) {
                 goto deal_with_path;
             }
             /* Invalid characters after ':' found */
             return APR_EGENERAL;
         }
-        uptr->port = apr_uri_port_of_scheme(uptr->scheme);
+        if (APR_URI_SPAN_PRESENT(spans->scheme)) {
+            spans->port = port_of_scheme(base + spans->scheme.off,
+                                         spans->scheme.len);
+        }
         goto deal_with_path;
     }
 
     /* first colon delimits username:password */
     s1 = memchr(hostinfo, ':', s - hostinfo);
     if (s1) {
-        uptr->user = apr_pstrmemdup(p, hostinfo, s1 - hostinfo);
+        URI_SPAN(spans->user, hostinfo, s1);
         ++s1;
-        uptr->password = apr_pstrmemdup(p, s1, s - s1);
+        URI_SPAN(spans->password, s1, s);
     }
     else {
-        uptr->user = apr_pstrmemdup(p, hostinfo, s - hostinfo);
+        URI_SPAN(spans->user, hostinfo, s);
     }
     hostinfo = s + 1;
     goto deal_with_host;
 }
 
+/* a copy of the part of the uri, or NULL when it is not present */
+static char *uri_span_dup(apr_pool_t *p, const char *uri,
+                          const apr_uri_span_t *span)
+{
+    if (!APR_URI_SPAN_PRESENT(*span)) {
+        return NULL;
+    }
+    return apr_pstrmemdup(p, uri + span->off, span->len);
+}
+
+/* parse_uri_components():
+ * Parse a given URI, fill in all supplied fields of a uri_components
+ * structure. This eliminates the necessity of extracting host, port,
+ * path, query info repeatedly in the modules.
+ * Side effects:
+ *  - fills in fields of uri_components *uptr
+ *  - none on any of the r->* fields
+ */
+APR_DECLARE(apr_status_t) apr_uri_parse(apr_pool_t *p, const char *uri,
+                                        apr_uri_t *uptr)
+{
+    apr_uri_spans_t spans;
+    apr_status_t rv;
+
+    rv = apr_uri_parse_spans(uri, &spans);
+
+    /* Initialize the structure. parse_uri() and parse_uri_components()
+     * can be called more than once per request.
+     */
+    memset (uptr, '\0', sizeof(*uptr));
+    uptr->is_initialized = 1;
+
+    uptr->scheme = uri_span_dup(p, uri, &spans.scheme);
+    uptr->hostinfo = uri_span_dup(p, uri, &spans.hostinfo);
+    uptr->user = uri_span_dup(p, uri, &spans.user);
+    uptr->password = uri_span_dup(p, uri, &spans.password);
+    uptr->hostname = uri_span_dup(p, uri, &spans.hostname);
+    uptr->port_str = uri_span_dup(p, uri, &spans.port_str);
+    uptr->path = uri_span_dup(p, uri, &spans.path);
+    uptr->query = uri_span_dup(p, uri, &spans.query);
+    uptr->fragment = uri_span_dup(p, uri, &spans.fragment);
+    uptr->port = spans.port;
+
+    return rv;
+}
+
 /* Special case for CONNECT parsing: it comes with the hostinfo part only */
 /* See the INTERNET-DRAFT document "Tunneling SSL Through a WWW Proxy"
  * currently at http://www.mcom.com/newsref/std/tunneling_ssl.html
@@ -95,6 +95,25 @@ APR_DECLARE(int) apr_date_checkmask(const char *data, const char *mask)
     return 0;          /* We only get here if mask is corrupted (exceeds 256) */
 }
 
+/*
+ * Is this the IMF-fixdate of RFC 7231, "Sun, 06 Nov 1994 08:49:37 GMT",
+ * up to the time and as apr_date_parse_http() checks it? The characters
+ * are tested in order, not to read past the end of a shorter string.
+ */
+static int date_is_fixdate(const char *d)
+{
+    return apr_isalpha(d[0]) && apr_isalpha(d[1]) && apr_isalpha(d[2])
+        && d[3] == ',' && d[4] == ' '
+        && apr_isdigit(d[5]) && apr_isdigit(d[6]) && d[7] == ' '
+        && apr_isupper(d[8]) && apr_islower(d[9]) && apr_islower(d[10])
+        && d[11] == ' '
+        && apr_isdigit(d[12]) && apr_isdigit(d[13])
+        && apr_isdigit(d[14]) && apr_isdigit(d[15]) && d[16] == ' '
+        && apr_isdigit(d[17]) && apr_isdigit(d[18]) && d[19] == ':'
+        && apr_isdigit(d[20]) && apr_isdigit(d[21]) && d[22] == ':'
+        && apr_isdigit(d[23]) && apr_isdigit(d[24]) && d[25] == ' ';
+}
+
 /*
  * Parses an HTTP date in one of three standard forms:
  *
@@ -166,6 +185,12 @@ APR_DECLARE(apr_time_t) apr_date_parse_http(const char *date)
     if (*date == '\0')
         return APR_DATE_BAD;
 
+    if (date_is_fixdate(date)) {
+        /* the usual case, without looking for the format */
+        date += 5;
+        goto rfc1123;
+    }
+
     if ((date = strchr(date, ' ')) == NULL)       /* Find space after weekday */
         return APR_DATE_BAD;
 
@@ -174,6 +199,7 @@ APR_DECLARE(apr_time_t) apr_date_parse_http(const char *date)
     /* start of the actual date information for all 4 formats. */
 
     if (apr_date_checkmask(date, "## @$$ #### ##:##:## *")) {
+rfc1123:
         /* RFC 1123 format with two days */
         ds.tm_year = ((date[7] - '0') * 10 + (date[8] - '0') - 19) * 100;
         if (ds.tm_year < 0)
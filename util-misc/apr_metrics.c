@@ -0,0 +1,333 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr.h"
+#include "apr_atomic.h"
+#include "apr_general.h"
+#include "apr_metrics.h"
+#include "apr_thread_proc.h" /* for APR_THREAD_LOCAL */
+
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+/*
+ * The metrics are malloc()ed and never freed, so that the subsystems can
+ * keep them in static variables, whatever the pools and the
+ * (re)initializations of APR.  They are chained in the order of their registration, under the
+ * registry lock which also covers apr_metrics_do() taking a copy of the
+ * chain, so the updates never take it.
+ *
+ * Counters and histograms have METRIC_SHARDS shards, each on its own
+ * cache lines, and each thread updates the shard of its slot (assigned
+ * round robin on first use), so there is no contention between threads
+ * unless there are more than METRIC_SHARDS of them.  A thread local
+ * storage is needed for that, otherwise all the threads update the first
+ * shard.  Gauges, which can be set, have a single value.
+ */
+
+#define METRIC_MAX 1024
+
+#define METRIC_LINE 64
+
+#if APR_HAS_THREADS
+#define METRIC_SHARDS 16
+#else
+#define METRIC_SHARDS 1
+#endif
+
+/* The buckets of the histograms: values below METRIC_LINEAR have their
+ * own bucket, then each power of two is split in METRIC_LINEAR buckets.
+ */
+#define METRIC_LINEAR_BITS 2
+#define METRIC_LINEAR (1 << METRIC_LINEAR_BITS)
+
+typedef struct counter_shard_t {
+    volatile apr_uint64_t value;
+    char pad[METRIC_LINE - sizeof(apr_uint64_t)];
+} counter_shard_t;
+
+typedef struct histogram_shard_t {
+    volatile apr_uint64_t count;
+    volatile apr_uint64_t sum;
+    volatile apr_uint64_t buckets[APR_METRIC_BUCKETS];
+} histogram_shard_t;
+
+#define HISTOGRAM_SHARD_SIZE \
+    APR_ALIGN(sizeof(histogram_shard_t), METRIC_LINE)
+
+struct apr_metric_t {
+    apr_metric_t *next;
+    char *name;
+    char *help;
+    apr_metric_type_e type;
+    volatile apr_uint64_t gauge;
+    /* METRIC_SHARDS counter_shard_t or histogram_shard_t */
+    char *shards;
+};
+
+static apr_metric_t *metrics_head = NULL;
+static apr_metric_t **metrics_tail = &metrics_head;
+static int metrics_count = 0;
+static volatile apr_uint32_t metrics_lock = 0;
+
+#if APR_HAS_THREADS && APR_HAS_THREAD_LOCAL
+/* Shard index + 1 of the current thread, 0 until its first update */
+static volatile apr_uint32_t shard_next = 0;
+static APR_THREAD_LOCAL apr_uint32_t shard_slot;
+#endif
+
+static void metrics_acquire(void)
+{
+    while (apr_atomic_cas32(&metrics_lock, 1, 0) != 0) {
+#if APR_HAS_THREADS
+        apr_thread_yield();
+#endif
+    }
+}
+
+static void metrics_release(void)
+{
+    apr_atomic_set32(&metrics_lock, 0);
+}
+
+static APR_INLINE apr_uint32_t metric_shard(void)
+{
+#if APR_HAS_THREADS && APR_HAS_THREAD_LOCAL
+    if (!shard_slot) {
+        shard_slot = apr_atomic_inc32(&shard_next) % METRIC_SHARDS + 1;
+    }
+    return shard_slot - 1;
+#else
+    return 0;
+#endif
+}
+
+static APR_INLINE int metric_bucket(apr_uint64_t value)
+{
+    int log2 = 0, bucket;
+
+    if (value < METRIC_LINEAR) {
+        return (int)value;
+    }
+#if defined(__GNUC__)
+    log2 = 63 - __builtin_clzll(value);
+#else
+    while (value >> (log2 + 1)) {
+        log2++;
+    }
+#endif
+    bucket = (log2 - METRIC_LINEAR_BITS + 1) * METRIC_LINEAR
+             + (int)((value >> (log2 - METRIC_LINEAR_BITS))
+                     & (METRIC_LINEAR - 1));
+    return bucket < APR_METRIC_BUCKETS ? bucket : APR_METRIC_BUCKETS - 1;
+}
+
+APR_DECLARE(apr_uint64_t) apr_metric_bucket_bound(int bucket)
+{
+    int log2;
+    apr_uint64_t sub;
+
+    if (bucket < METRIC_LINEAR) {
+        return bucket;
+    }
+    if (bucket >= APR_METRIC_BUCKETS - 1) {
+        return APR_UINT64_MAX;
+    }
+    log2 = bucket / METRIC_LINEAR + METRIC_LINEAR_BITS - 1;
+    sub = bucket % METRIC_LINEAR;
+    return ((METRIC_LINEAR + sub + 1) << (log2 - METRIC_LINEAR_BITS)) - 1;
+}
+
+static char *metric_strdup(const char *s)
+{
+    apr_size_t len = strlen(s) + 1;
+    char *d = malloc(len);
+
+    if (d) {
+        memcpy(d, s, len);
+    }
+    return d;
+}
+
+APR_DECLARE(apr_status_t) apr_metric_register(apr_metric_t **metric,
+                                              const char *name,
+                                              const char *help,
+                                              apr_metric_type_e type)
+{
+    apr_metric_t *m;
+    apr_size_t size = 0;
+    char *shards;
+
+    metrics_acquire();
+
+    for (m = metrics_head; m; m = m->next) {
+        if (strcmp(m->name, name) == 0) {
+            metrics_release();
+            if (m->type != type) {
+                return APR_EEXIST;
+            }
+            *metric = m;
+            return APR_SUCCESS;
+        }
+    }
+    if (metrics_count == METRIC_MAX) {
+        metrics_release();
+        return APR_ENOMEM;
+    }
+
+    if (type == APR_METRIC_COUNTER) {
+        size = METRIC_SHARDS * sizeof(counter_shard_t);
+    }
+    else if (type == APR_METRIC_HISTOGRAM) {
+        size = METRIC_SHARDS * HISTOGRAM_SHARD_SIZE;
+    }
+
+    m = calloc(1, sizeof(*m));
+    shards = size ? calloc(1, size + METRIC_LINE) : NULL;
+    if (!m || (size && !shards)
+            || !(m->name = metric_strdup(name))
+            || !(m->help = metric_strdup(help ? help : ""))) {
+        metrics_release();
+        if (m) {
+            free(m->name);
+        }
+        free(shards);
+        free(m);
+        return APR_ENOMEM;
+    }
+    m->type = type;
+    if (shards) {
+        m->shards = (char *)APR_ALIGN((apr_uintptr_t)shards, METRIC_LINE);
+    }
+
+    *metrics_tail = m;
+    metrics_tail = &m->next;
+    metrics_count++;
+
+    metrics_release();
+
+    *metric = m;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(void) apr_metric_add(apr_metric_t *metric, apr_int64_t delta)
+{
+    if (metric->type == APR_METRIC_COUNTER) {
+        counter_shard_t *shard = (counter_shard_t *)metric->shards
+                                 + metric_shard();
+
+        apr_atomic_add64(&shard->value, (apr_uint64_t)delta);
+    }
+    else if (metric->type == APR_METRIC_GAUGE) {
+        apr_atomic_add64(&metric->gauge, (apr_uint64_t)delta);
+    }
+}
+
+APR_DECLARE(void) apr_metric_set(apr_metric_t *metric, apr_int64_t value)
+{
+    if (metric->type == APR_METRIC_GAUGE) {
+        apr_atomic_set64(&metric->gauge, (apr_uint64_t)value);
+    }
+}
+
+APR_DECLARE(void) apr_metric_observe(apr_metric_t *metric,
+                                     apr_uint64_t value)
+{
+    histogram_shard_t *shard;
+
+    if (metric->type != APR_METRIC_HISTOGRAM) {
+        return;
+    }
+    shard = (histogram_shard_t *)(metric->shards
+                                  + metric_shard() * HISTOGRAM_SHARD_SIZE);
+    apr_atomic_inc64(&shard->buckets[metric_bucket(value)]);
+    apr_atomic_add64(&shard->sum, value);
+    apr_atomic_inc64(&shard->count);
+}
+
+static void metric_snapshot(const apr_metric_t *m, apr_metric_value_t *v)
+{
+    int i, j;
+
+    memset(v, 0, sizeof(*v));
+    v->name = m->name;
+    v->help = m->help;
+    v->type = m->type;
+
+    switch (m->type) {
+    case APR_METRIC_COUNTER:
+        for (i = 0; i < METRIC_SHARDS; i++) {
+            counter_shard_t *shard = (counter_shard_t *)m->shards + i;
+
+            v->value += (apr_int64_t)apr_atomic_read64(&shard->value);
+        }
+        break;
+    case APR_METRIC_GAUGE:
+        v->value = (apr_int64_t)apr_atomic_read64((apr_uint64_t *)&m->gauge);
+        break;
+    case APR_METRIC_HISTOGRAM:
+        for (i = 0; i < METRIC_SHARDS; i++) {
+            histogram_shard_t *shard = (histogram_shard_t *)(m->shards
+                                       + i * HISTOGRAM_SHARD_SIZE);
+
+            /* The count is read first, so that it never exceeds what
+             * the buckets add up to */
+            v->count += apr_atomic_read64(&shard->count);
+            v->sum += apr_atomic_read64(&shard->sum);
+            for (j = 0; j < APR_METRIC_BUCKETS; j++) {
+                v->buckets[j] += apr_atomic_read64(&shard->buckets[j]);
+            }
+        }
+        break;
+    }
+}
+
+APR_DECLARE(int) apr_metrics_do(apr_metrics_cb_t *cb, void *baton)
+{
+    apr_metric_t **list, *m;
+    apr_metric_value_t *value;
+    int i, n = 0, rv = 1;
+
+    /* Copy the chain, to release the lock before running the callback */
+    metrics_acquire();
+    list = malloc((metrics_count + 1) * sizeof(*list));
+    if (list) {
+        for (m = metrics_head; m; m = m->next) {
+            list[n++] = m;
+        }
+    }
+    metrics_release();
+
+    value = malloc(sizeof(*value));
+    if (!list || !value) {
+        free(list);
+        free(value);
+        return 0;
+    }
+
+    for (i = 0; i < n && rv; i++) {
+        metric_snapshot(list[i], value);
+        rv = cb(baton, value);
+    }
+
+    free(value);
+    free(list);
+    return rv;
+}
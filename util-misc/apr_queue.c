@@ -28,6 +28,7 @@
 
 #include "apu.h"
 #include "apr_portable.h"
+#include "apr_atomic.h"
 #include "apr_thread_mutex.h"
 #include "apr_thread_cond.h"
 #include "apr_errno.h"
@@ -40,7 +41,35 @@
 #define QUEUE_DEBUG
  */
 
+/* Cache line size, to keep the producers' and consumers' positions of
+ * the lock-free ring apart.
+ */
+#define QUEUE_CACHELINE_SIZE 64
+
+/**
+ * A slot of the lock-free ring. Its sequence number tells the state of the
+ * slot relative to the producers' and consumers' positions: the slot is
+ * free for the producer at position pos when seq == pos, and filled for
+ * the consumer at position pos when seq == pos + 1.
+ */
+typedef struct queue_slot_t {
+    volatile apr_uint64_t seq;
+    void                 *data;
+} queue_slot_t;
+
 struct apr_queue_t {
+    /** The lock-free ring (APR_QUEUE_LOCKFREE), the positions are never
+     *  wrapped (thus the slot of a position is pos % bounds)
+     */
+    volatile apr_uint64_t tail;
+    char                  pad1[QUEUE_CACHELINE_SIZE - sizeof(apr_uint64_t)];
+    volatile apr_uint64_t head;
+    char                  pad2[QUEUE_CACHELINE_SIZE - sizeof(apr_uint64_t)];
+    queue_slot_t         *slots;
+    /** Waiters of the lock-free ring, read without the mutex */
+    volatile apr_uint32_t lf_full_waiters;
+    volatile apr_uint32_t lf_empty_waiters;
+    apr_uint32_t        flags;
     void              **data;
     unsigned int        nelts; /**< # elements */
     unsigned int        in;    /**< next empty location */
@@ -51,7 +80,7 @@ struct apr_queue_t {
     apr_thread_mutex_t *one_big_mutex;
     apr_thread_cond_t  *not_empty;
     apr_thread_cond_t  *not_full;
-    int                 terminated;
+    volatile int        terminated;
 };
 
 #ifdef QUEUE_DEBUG
@@ -101,9 +130,26 @@ static apr_status_t queue_destroy(void *data)
 APR_DECLARE(apr_status_t) apr_queue_create(apr_queue_t **q,
                                            unsigned int queue_capacity,
                                            apr_pool_t *a)
+{
+    return apr_queue_create_ex(q, queue_capacity, 0, a);
+}
+
+APR_DECLARE(apr_status_t) apr_queue_create_ex(apr_queue_t **q,
+                                              unsigned int queue_capacity,
+                                              apr_uint32_t flags,
+                                              apr_pool_t *a)
 {
     apr_status_t rv;
     apr_queue_t *queue;
+
+    if (flags & ~APR_QUEUE_LOCKFREE) {
+        return APR_EINVAL;
+    }
+    /* The sequence numbers of a single slot cannot tell full from empty */
+    if (queue_capacity < 2 && (flags & APR_QUEUE_LOCKFREE)) {
+        return APR_EINVAL;
+    }
+
     queue = apr_palloc(a, sizeof(apr_queue_t));
     *q = queue;
 
@@ -125,8 +171,26 @@ APR_DECLARE(apr_status_t) apr_queue_create(apr_queue_t **q,
         return rv;
     }
 
-    /* Set all the data in the queue to NULL */
-    queue->data = apr_pcalloc(a, queue_capacity * sizeof(void*));
+    queue->flags = flags;
+    if (flags & APR_QUEUE_LOCKFREE) {
+        unsigned int i;
+
+        queue->slots = apr_palloc(a, queue_capacity * sizeof(queue_slot_t));
+        for (i = 0; i < queue_capacity; i++) {
+            queue->slots[i].seq = i;
+            queue->slots[i].data = NULL;
+        }
+        queue->data = NULL;
+    }
+    else {
+        queue->slots = NULL;
+        /* Set all the data in the queue to NULL */
+        queue->data = apr_pcalloc(a, queue_capacity * sizeof(void*));
+    }
+    queue->head = 0;
+    queue->tail = 0;
+    queue->lf_full_waiters = 0;
+    queue->lf_empty_waiters = 0;
     queue->bounds = queue_capacity;
     queue->nelts = 0;
     queue->in = 0;
@@ -140,15 +204,252 @@ APR_DECLARE(apr_status_t) apr_queue_create(apr_queue_t **q,
     return APR_SUCCESS;
 }
 
+/*
+ * Lock-free ring (APR_QUEUE_LOCKFREE), a bounded MPMC queue of sequence
+ * numbered slots. The mutex and condition variables are used only to
+ * block when the ring is full or empty, and to wake up the blocked ones.
+ */
+
+static int ring_push(apr_queue_t *queue, void *data)
+{
+    apr_uint64_t pos = apr_atomic_read64(&queue->tail), seq;
+    queue_slot_t *slot;
+
+    for (;;) {
+        slot = &queue->slots[pos % queue->bounds];
+        seq = apr_atomic_read64(&slot->seq);
+        if (seq == pos) {
+            /* Free, claim it */
+            if (apr_atomic_cas64(&queue->tail, pos + 1, pos) == pos) {
+                break;
+            }
+        }
+        else if ((apr_int64_t)(seq - pos) < 0) {
+            /* Not consumed yet since the previous round, full */
+            return 0;
+        }
+        pos = apr_atomic_read64(&queue->tail);
+    }
+
+    slot->data = data;
+    apr_atomic_set64(&slot->seq, pos + 1);
+    return 1;
+}
+
+static int ring_pop(apr_queue_t *queue, void **data)
+{
+    apr_uint64_t pos = apr_atomic_read64(&queue->head), seq;
+    queue_slot_t *slot;
+
+    for (;;) {
+        slot = &queue->slots[pos % queue->bounds];
+        seq = apr_atomic_read64(&slot->seq);
+        if (seq == pos + 1) {
+            /* Filled, claim it */
+            if (apr_atomic_cas64(&queue->head, pos + 1, pos) == pos) {
+                break;
+            }
+        }
+        else if ((apr_int64_t)(seq - (pos + 1)) < 0) {
+            /* Not produced yet, empty */
+            return 0;
+        }
+        pos = apr_atomic_read64(&queue->head);
+    }
+
+    *data = slot->data;
+    apr_atomic_set64(&slot->seq, pos + queue->bounds);
+    return 1;
+}
+
+/* Wake up one of the waiters (all of them if many slots changed), if
+ * any. The waiters increment their count before checking the ring a last
+ * time (both sequentially consistent), so either they find the ring
+ * changed or we find them waiting.
+ */
+static apr_status_t ring_signal(apr_queue_t *queue,
+                                volatile apr_uint32_t *waiters,
+                                apr_thread_cond_t *cond, int all)
+{
+    apr_status_t rv;
+
+    if (!apr_atomic_read32(waiters)) {
+        return APR_SUCCESS;
+    }
+
+    rv = apr_thread_mutex_lock(queue->one_big_mutex);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    rv = all ? apr_thread_cond_broadcast(cond) : apr_thread_cond_signal(cond);
+    apr_thread_mutex_unlock(queue->one_big_mutex);
+
+    return rv;
+}
+
+static apr_status_t ring_wait(apr_queue_t *queue, int push, void **data,
+                              apr_interval_time_t timeout)
+{
+    volatile apr_uint32_t *waiters;
+    apr_thread_cond_t *cond;
+    apr_status_t rv;
+    int done = 0;
+
+    if (push) {
+        waiters = &queue->lf_full_waiters;
+        cond = queue->not_full;
+    }
+    else {
+        waiters = &queue->lf_empty_waiters;
+        cond = queue->not_empty;
+    }
+
+    rv = apr_thread_mutex_lock(queue->one_big_mutex);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    if (!queue->terminated) {
+        apr_atomic_inc32(waiters);
+        done = push ? ring_push(queue, *data) : ring_pop(queue, data);
+        if (!done) {
+            if (timeout > 0) {
+                rv = apr_thread_cond_timedwait(cond, queue->one_big_mutex,
+                                               timeout);
+            }
+            else {
+                rv = apr_thread_cond_wait(cond, queue->one_big_mutex);
+            }
+        }
+        apr_atomic_dec32(waiters);
+        if (rv != APR_SUCCESS) {
+            apr_thread_mutex_unlock(queue->one_big_mutex);
+            return rv;
+        }
+    }
+
+    rv = apr_thread_mutex_unlock(queue->one_big_mutex);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    if (!done) {
+        done = push ? ring_push(queue, *data) : ring_pop(queue, data);
+    }
+    if (!done) {
+        /* If we wake up and it's still full/empty, then we were
+         * interrupted
+         */
+        Q_DBG(push ? "ring full (intr)" : "ring empty (intr)", queue);
+        if (queue->terminated) {
+            return APR_EOF; /* no more elements ever again */
+        }
+        return APR_EINTR;
+    }
+
+    if (push) {
+        return ring_signal(queue, &queue->lf_empty_waiters, queue->not_empty,
+                           0);
+    }
+    return ring_signal(queue, &queue->lf_full_waiters, queue->not_full, 0);
+}
+
+/* The batches are pushed or popped slot by slot, but with one wake up,
+ * waiting (if need be) for the first slot only.
+ */
+static apr_status_t ring_queue_push(apr_queue_t *queue, void **data,
+                                    unsigned int n, unsigned int *count,
+                                    apr_interval_time_t timeout)
+{
+    unsigned int k = 0;
+    apr_status_t rv;
+
+    if (queue->terminated) {
+        return APR_EOF; /* no more elements ever again */
+    }
+
+    while (k < n && ring_push(queue, data[k])) {
+        k++;
+    }
+    if (!k) {
+        if (!timeout) {
+            return APR_EAGAIN;
+        }
+        rv = ring_wait(queue, 1, data, timeout);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        for (k = 1; k < n && ring_push(queue, data[k]); k++) {
+            /* more room */
+        }
+        if (k == 1) {
+            *count = 1;
+            return APR_SUCCESS; /* signaled by ring_wait() */
+        }
+    }
+
+    *count = k;
+    return ring_signal(queue, &queue->lf_empty_waiters, queue->not_empty,
+                       k > 1);
+}
+
+static apr_status_t ring_queue_pop(apr_queue_t *queue, void **data,
+                                   unsigned int max, unsigned int *count,
+                                   apr_interval_time_t timeout)
+{
+    unsigned int k = 0;
+    apr_status_t rv;
+
+    if (queue->terminated) {
+        return APR_EOF; /* no more elements ever again */
+    }
+
+    while (k < max && ring_pop(queue, &data[k])) {
+        k++;
+    }
+    if (!k) {
+        if (!timeout) {
+            return APR_EAGAIN;
+        }
+        rv = ring_wait(queue, 0, data, timeout);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        for (k = 1; k < max && ring_pop(queue, &data[k]); k++) {
+            /* more available */
+        }
+        if (k == 1) {
+            *count = 1;
+            return APR_SUCCESS; /* signaled by ring_wait() */
+        }
+    }
+
+    *count = k;
+    return ring_signal(queue, &queue->lf_full_waiters, queue->not_full,
+                       k > 1);
+}
+
 /**
- * Push new data onto the queue. Blocks if the queue is full. Once
- * the push operation has completed, it signals other threads waiting
- * in apr_queue_pop() that they may continue consuming sockets.
+ * Push new data onto the queue, as many of the n elements as there is
+ * room for (at least one, blocks if the queue is full). Once the push
+ * operation has completed, it signals other threads waiting in
+ * apr_queue_pop() that they may continue consuming sockets.
  */
-static apr_status_t queue_push(apr_queue_t *queue, void *data,
+static apr_status_t queue_push(apr_queue_t *queue, void **data,
+                               unsigned int n, unsigned int *count,
                                apr_interval_time_t timeout)
 {
     apr_status_t rv;
+    unsigned int k;
+
+    *count = 0;
+    if (!n) {
+        return APR_SUCCESS;
+    }
+
+    if (queue->flags & APR_QUEUE_LOCKFREE) {
+        return ring_queue_push(queue, data, n, count, timeout);
+    }
 
     if (queue->terminated) {
         return APR_EOF; /* no more elements ever again */
@@ -197,15 +498,26 @@ static apr_status_t queue_push(apr_queue_t *queue, void *data,
         }
     }
 
-    queue->data[queue->in] = data;
-    queue->in++;
-    if (queue->in >= queue->bounds)
-        queue->in -= queue->bounds;
-    queue->nelts++;
+    if (n > queue->bounds - queue->nelts) {
+        n = queue->bounds - queue->nelts;
+    }
+    for (k = 0; k < n; k++) {
+        queue->data[queue->in] = data[k];
+        queue->in++;
+        if (queue->in >= queue->bounds)
+            queue->in -= queue->bounds;
+    }
+    queue->nelts += n;
+    *count = n;
 
     if (queue->empty_waiters) {
         Q_DBG("sig !empty", queue);
-        rv = apr_thread_cond_signal(queue->not_empty);
+        if (n > 1) {
+            rv = apr_thread_cond_broadcast(queue->not_empty);
+        }
+        else {
+            rv = apr_thread_cond_signal(queue->not_empty);
+        }
         if (rv != APR_SUCCESS) {
             apr_thread_mutex_unlock(queue->one_big_mutex);
             return rv;
@@ -218,7 +530,9 @@ static apr_status_t queue_push(apr_queue_t *queue, void *data,
 
 APR_DECLARE(apr_status_t) apr_queue_push(apr_queue_t *queue, void *data)
 {
-    return queue_push(queue, data, -1);
+    unsigned int count;
+
+    return queue_push(queue, &data, 1, &count, -1);
 }
 
 /**
@@ -228,33 +542,76 @@ APR_DECLARE(apr_status_t) apr_queue_push(apr_queue_t *queue, void *data)
  */
 APR_DECLARE(apr_status_t) apr_queue_trypush(apr_queue_t *queue, void *data)
 {
-    return queue_push(queue, data, 0);
+    unsigned int count;
+
+    return queue_push(queue, &data, 1, &count, 0);
 }
 
 APR_DECLARE(apr_status_t) apr_queue_timedpush(apr_queue_t *queue, void *data,
                                               apr_interval_time_t timeout)
 {
-    return queue_push(queue, data, timeout);
+    unsigned int count;
+
+    return queue_push(queue, &data, 1, &count, timeout);
+}
+
+APR_DECLARE(apr_status_t) apr_queue_push_n(apr_queue_t *queue, void **data,
+                                           unsigned int n,
+                                           unsigned int *pushed)
+{
+    return queue_push(queue, data, n, pushed, -1);
+}
+
+APR_DECLARE(apr_status_t) apr_queue_trypush_n(apr_queue_t *queue,
+                                              void **data, unsigned int n,
+                                              unsigned int *pushed)
+{
+    return queue_push(queue, data, n, pushed, 0);
+}
+
+APR_DECLARE(apr_status_t) apr_queue_timedpush_n(apr_queue_t *queue,
+                                                void **data, unsigned int n,
+                                                unsigned int *pushed,
+                                                apr_interval_time_t timeout)
+{
+    return queue_push(queue, data, n, pushed, timeout);
 }
 
 /**
  * not thread safe
  */
 APR_DECLARE(unsigned int) apr_queue_size(apr_queue_t *queue) {
+    if (queue->flags & APR_QUEUE_LOCKFREE) {
+        apr_uint64_t head = apr_atomic_read64(&queue->head);
+        apr_uint64_t tail = apr_atomic_read64(&queue->tail);
+
+        return tail > head ? (unsigned int)(tail - head) : 0;
+    }
     return queue->nelts;
 }
 
 /**
- * Retrieves the next item from the queue. If there are no
+ * Retrieves the next items from the queue, up to max. If there are no
  * items available, it will either return APR_EAGAIN (timeout = 0),
  * or block until one becomes available (infinitely with timeout < 0,
  * otherwise until the given timeout expires). Once retrieved, the
- * item is placed into the address specified by 'data'.
+ * items are placed into the array specified by 'data'.
  */
 static apr_status_t queue_pop(apr_queue_t *queue, void **data,
+                              unsigned int max, unsigned int *count,
                               apr_interval_time_t timeout)
 {
     apr_status_t rv;
+    unsigned int k;
+
+    *count = 0;
+    if (!max) {
+        return APR_SUCCESS;
+    }
+
+    if (queue->flags & APR_QUEUE_LOCKFREE) {
+        return ring_queue_pop(queue, data, max, count, timeout);
+    }
 
     if (queue->terminated) {
         return APR_EOF; /* no more elements ever again */
@@ -304,15 +661,26 @@ static apr_status_t queue_pop(apr_queue_t *queue, void **data,
         }
     }
 
-    *data = queue->data[queue->out];
-    queue->nelts--;
+    if (max > queue->nelts) {
+        max = queue->nelts;
+    }
+    for (k = 0; k < max; k++) {
+        data[k] = queue->data[queue->out];
+        queue->out++;
+        if (queue->out >= queue->bounds)
+            queue->out -= queue->bounds;
+    }
+    queue->nelts -= max;
+    *count = max;
 
-    queue->out++;
-    if (queue->out >= queue->bounds)
-        queue->out -= queue->bounds;
     if (queue->full_waiters) {
         Q_DBG("signal !full", queue);
-        rv = apr_thread_cond_signal(queue->not_full);
+        if (max > 1) {
+            rv = apr_thread_cond_broadcast(queue->not_full);
+        }
+        else {
+            rv = apr_thread_cond_signal(queue->not_full);
+        }
         if (rv != APR_SUCCESS) {
             apr_thread_mutex_unlock(queue->one_big_mutex);
             return rv;
@@ -325,18 +693,46 @@ static apr_status_t queue_pop(apr_queue_t *queue, void **data,
 
 APR_DECLARE(apr_status_t) apr_queue_pop(apr_queue_t *queue, void **data)
 {
-    return queue_pop(queue, data, -1);
+    unsigned int count;
+
+    return queue_pop(queue, data, 1, &count, -1);
 }
 
 APR_DECLARE(apr_status_t) apr_queue_trypop(apr_queue_t *queue, void **data)
 {
-    return queue_pop(queue, data, 0);
+    unsigned int count;
+
+    return queue_pop(queue, data, 1, &count, 0);
 }
 
 APR_DECLARE(apr_status_t) apr_queue_timedpop(apr_queue_t *queue, void **data,
                                              apr_interval_time_t timeout)
 {
-    return queue_pop(queue, data, timeout);
+    unsigned int count;
+
+    return queue_pop(queue, data, 1, &count, timeout);
+}
+
+APR_DECLARE(apr_status_t) apr_queue_pop_n(apr_queue_t *queue, void **data,
+                                          unsigned int max,
+                                          unsigned int *popped)
+{
+    return queue_pop(queue, data, max, popped, -1);
+}
+
+APR_DECLARE(apr_status_t) apr_queue_trypop_n(apr_queue_t *queue, void **data,
+                                             unsigned int max,
+                                             unsigned int *popped)
+{
+    return queue_pop(queue, data, max, popped, 0);
+}
+
+APR_DECLARE(apr_status_t) apr_queue_timedpop_n(apr_queue_t *queue,
+                                               void **data, unsigned int max,
+                                               unsigned int *popped,
+                                               apr_interval_time_t timeout)
+{
+    return queue_pop(queue, data, max, popped, timeout);
 }
 
 APR_DECLARE(apr_status_t) apr_queue_interrupt_all(apr_queue_t *queue)
@@ -22,8 +22,16 @@
 #include "apr_strings.h"
 #include "apr_thread_mutex.h"
 #include "apr_thread_cond.h"
+#include "apr_thread_proc.h" /* for APR_THREAD_LOCAL */
+#include "apr_atomic.h"
 #include "apr_ring.h"
 
+#if APR_HAS_THREADS && APR_HAS_THREAD_LOCAL
+#define RESLIST_AFFINITY 1
+#else
+#define RESLIST_AFFINITY 0
+#endif
+
 /**
  * A single resource element.
  */
@@ -40,6 +48,33 @@ typedef struct apr_res_t apr_res_t;
 APR_RING_HEAD(apr_resring_t, apr_res_t);
 typedef struct apr_resring_t apr_resring_t;
 
+#if RESLIST_AFFINITY
+/**
+ * The stashes of idle resources, see apr_reslist_affinity_set().  Threads
+ * take the stripes round robin, and a stripe is locked by a spinlock held
+ * for a few instructions only.
+ */
+#define RESLIST_STRIPES 16 /* a power of two */
+#define RESLIST_CACHE_LINE 64
+
+typedef struct {
+    void *opaque;
+    apr_time_t freed;
+} stash_entry_t;
+
+typedef struct {
+    volatile apr_uint32_t lock;
+    int count;
+    stash_entry_t *entries;
+    char pad[RESLIST_CACHE_LINE - sizeof(apr_uint32_t) - sizeof(int)
+             - sizeof(stash_entry_t *)];
+} reslist_stripe_t;
+
+/* Stripe index + 1 of the current thread, 0 until its first use */
+static volatile apr_uint32_t stripe_next = 0;
+static APR_THREAD_LOCAL apr_uint32_t stripe_thread_slot;
+#endif
+
 struct apr_reslist_t {
     apr_pool_t *pool; /* the pool used in constructor and destructor calls */
     int ntotal;     /* total number of resources managed by this list */
@@ -57,6 +92,23 @@ struct apr_reslist_t {
 #if APR_HAS_THREADS
     apr_thread_mutex_t *listlock;
     apr_thread_cond_t *avail;
+    /* The replenisher, NULL unless apr_reslist_replenish_start() */
+    apr_thread_t *replenisher;
+    apr_thread_cond_t *replenish; /* wakes the replenisher up */
+    apr_interval_time_t replenish_interval;
+    int replenish_stop;
+    int npending;   /* resources under construction by the replenisher */
+    int ndemand;    /* acquirers waiting for a resource */
+    int nmisses;    /* acquisitions finding no idle resource, this interval */
+    int miss_rate;  /* moving average of nmisses per interval, times 16 */
+    apr_uint32_t nfailed; /* failed constructions by the replenisher */
+    apr_status_t failed_rv; /* the status of the last one */
+#endif
+#if RESLIST_AFFINITY
+    reslist_stripe_t *stripes; /* NULL unless apr_reslist_affinity_set() */
+    int stash;                 /* capacity of each stripe */
+    volatile apr_uint32_t nstashed; /* idle resources in the stripes */
+    volatile apr_uint32_t nwaiters; /* acquirers blocked on the list */
 #endif
 };
 
@@ -88,7 +140,7 @@ static apr_status_t push_resource(apr_reslist_t *reslist,
 {
     APR_RING_INSERT_HEAD(&reslist->avail_list, resource, apr_res_t, link);
     if (reslist->ttl) {
-        resource->freed = apr_time_now();
+        resource->freed = apr_time_monotonic();
     }
     reslist->nidle++;
     if (new) {
@@ -126,6 +178,123 @@ static void free_container(apr_reslist_t *reslist, apr_res_t *container)
     APR_RING_INSERT_TAIL(&reslist->free_list, container, apr_res_t, link);
 }
 
+#if RESLIST_AFFINITY
+
+static reslist_stripe_t *stripe_get(apr_reslist_t *reslist)
+{
+    apr_uint32_t slot = stripe_thread_slot;
+
+    if (!slot) {
+        slot = (apr_atomic_inc32(&stripe_next) & 0x7fffffff) + 1;
+        stripe_thread_slot = slot;
+    }
+    return &reslist->stripes[(slot - 1) & (RESLIST_STRIPES - 1)];
+}
+
+static void stripe_lock(reslist_stripe_t *stripe)
+{
+    while (apr_atomic_xchg32(&stripe->lock, 1)) {
+        do {
+            apr_atomic_pause();
+        } while (apr_atomic_read32(&stripe->lock));
+    }
+}
+
+static void stripe_unlock(reslist_stripe_t *stripe)
+{
+    apr_atomic_set32(&stripe->lock, 0);
+}
+
+/**
+ * Take the latest resource stashed by the thread's stripe, if any,
+ * destroying the expired ones on the way.
+ */
+static int stash_pop(apr_reslist_t *reslist, void **resource)
+{
+    reslist_stripe_t *stripe = stripe_get(reslist);
+    stash_entry_t e;
+
+    for (;;) {
+        stripe_lock(stripe);
+        if (stripe->count == 0) {
+            stripe_unlock(stripe);
+            return 0;
+        }
+        e = stripe->entries[--stripe->count];
+        stripe_unlock(stripe);
+        apr_atomic_dec32(&reslist->nstashed);
+
+        if (!reslist->ttl || apr_time_monotonic() - e.freed < reslist->ttl) {
+            *resource = e.opaque;
+            return 1;
+        }
+        apr_reslist_invalidate(reslist, e.opaque);
+    }
+}
+
+/**
+ * Stash a released resource in the thread's stripe, unless it is full or
+ * some acquirer is blocked waiting for a resource.
+ */
+static int stash_push(apr_reslist_t *reslist, void *resource)
+{
+    reslist_stripe_t *stripe = stripe_get(reslist);
+    int stashed = 0;
+
+    stripe_lock(stripe);
+    /* checked under the stripe's lock, see stash_drain() */
+    if (stripe->count < reslist->stash
+        && !apr_atomic_read32(&reslist->nwaiters)) {
+        stash_entry_t *e = &stripe->entries[stripe->count++];
+
+        e->opaque = resource;
+        e->freed = reslist->ttl ? apr_time_monotonic() : 0;
+        apr_atomic_inc32(&reslist->nstashed);
+        stashed = 1;
+    }
+    stripe_unlock(stripe);
+
+    return stashed;
+}
+
+/**
+ * Move all the stashed resources to the list of available resources.
+ * Once nwaiters is raised, nothing is stashed behind our back since
+ * stash_push() checks it under the stripe's lock.
+ * Assumes: that the reslist is locked.
+ */
+static void stash_drain(apr_reslist_t *reslist)
+{
+    int i;
+
+    for (i = 0; i < RESLIST_STRIPES; i++) {
+        reslist_stripe_t *stripe = &reslist->stripes[i];
+
+        stripe_lock(stripe);
+        while (stripe->count > 0) {
+            stash_entry_t *e = &stripe->entries[--stripe->count];
+            apr_res_t *res = get_container(reslist);
+
+            /* older than those available, keep their age */
+            res->opaque = e->opaque;
+            res->freed = e->freed;
+            APR_RING_INSERT_TAIL(&reslist->avail_list, res, apr_res_t, link);
+            reslist->nidle++;
+            apr_atomic_dec32(&reslist->nstashed);
+        }
+        stripe_unlock(stripe);
+    }
+}
+
+#define STASHED(reslist) \
+    ((reslist)->stripes ? (int)apr_atomic_read32(&(reslist)->nstashed) : 0)
+
+#else /* RESLIST_AFFINITY */
+
+#define STASHED(reslist) 0
+
+#endif /* RESLIST_AFFINITY */
+
 /**
  * Create a new resource and return it.
  * Assumes: that the reslist is locked.
@@ -152,6 +321,94 @@ static apr_status_t destroy_resource(apr_reslist_t *reslist, apr_res_t *res)
     return reslist->destructor(res->opaque, reslist->params, reslist->pool);
 }
 
+#if APR_HAS_THREADS
+
+/**
+ * Construct resources outside of the list's lock, for the acquirers
+ * waiting for one and to keep the idle ones above both the minimum and
+ * the recent rate of acquisitions finding none.
+ */
+static void * APR_THREAD_FUNC replenisher_thread(apr_thread_t *thd,
+                                                 void *data)
+{
+    apr_reslist_t *rl = data;
+    apr_time_t tick = apr_time_monotonic() + rl->replenish_interval;
+
+    apr_thread_mutex_lock(rl->listlock);
+    apr_pool_owner_set(rl->pool, 0);
+    while (!rl->replenish_stop) {
+        apr_time_t now = apr_time_monotonic();
+        int need;
+
+        if (now >= tick) {
+            rl->miss_rate = (3 * rl->miss_rate + 16 * rl->nmisses) / 4;
+            rl->nmisses = 0;
+            tick = now + rl->replenish_interval;
+        }
+
+        need = rl->min + (rl->miss_rate + 15) / 16
+               - rl->nidle - STASHED(rl);
+        if (need < rl->ndemand) {
+            need = rl->ndemand;
+        }
+        if (need > rl->npending && rl->ntotal + rl->npending < rl->hmax) {
+            apr_res_t *res = get_container(rl);
+            apr_status_t rv;
+
+            rl->npending++;
+            apr_thread_mutex_unlock(rl->listlock);
+            rv = rl->constructor(&res->opaque, rl->params, rl->pool);
+            apr_thread_mutex_lock(rl->listlock);
+            apr_pool_owner_set(rl->pool, 0);
+            rl->npending--;
+
+            if (rv == APR_SUCCESS) {
+                push_resource(rl, res, 1);
+                continue;
+            }
+            free_container(rl, res);
+
+            /* Fail the waiters, and retry later only */
+            rl->failed_rv = rv;
+            rl->nfailed++;
+            apr_thread_cond_broadcast(rl->avail);
+        }
+        if (!rl->replenish_stop) {
+            apr_thread_cond_timedwait(rl->replenish, rl->listlock,
+                                      tick > now ? tick - now : 0);
+        }
+    }
+    apr_thread_mutex_unlock(rl->listlock);
+
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static apr_status_t replenisher_stop(void *data_)
+{
+    apr_reslist_t *rl = data_;
+    apr_thread_t *thd = rl->replenisher;
+    apr_status_t rv;
+
+    if (!thd) {
+        return APR_SUCCESS;
+    }
+
+    apr_thread_mutex_lock(rl->listlock);
+    apr_pool_owner_set(rl->pool, 0);
+    rl->replenish_stop = 1;
+    apr_thread_cond_signal(rl->replenish);
+    apr_thread_mutex_unlock(rl->listlock);
+
+    apr_thread_join(&rv, thd);
+    rl->replenisher = NULL;
+    apr_pool_cleanup_kill(rl->pool, rl, replenisher_stop);
+
+    return APR_SUCCESS;
+}
+
+#endif /* APR_HAS_THREADS */
+
 static apr_status_t reslist_cleanup(void *data_)
 {
     apr_status_t rv = APR_SUCCESS;
@@ -159,9 +416,16 @@ static apr_status_t reslist_cleanup(void *data_)
     apr_res_t *res;
 
 #if APR_HAS_THREADS
+    replenisher_stop(rl);
+
     apr_thread_mutex_lock(rl->listlock);
     apr_pool_owner_set(rl->pool, 0);
 #endif
+#if RESLIST_AFFINITY
+    if (rl->stripes) {
+        stash_drain(rl);
+    }
+#endif
 
     while (rl->nidle > 0) {
         apr_status_t rv1;
@@ -182,6 +446,9 @@ static apr_status_t reslist_cleanup(void *data_)
     apr_thread_mutex_unlock(rl->listlock);
     apr_thread_mutex_destroy(rl->listlock);
     apr_thread_cond_destroy(rl->avail);
+    if (rl->replenish) {
+        apr_thread_cond_destroy(rl->replenish);
+    }
 #endif
 
     return rv;
@@ -198,8 +465,19 @@ static apr_status_t reslist_maintain(apr_reslist_t *reslist)
     apr_res_t *res;
     int created_one = 0;
 
+#if APR_HAS_THREADS
+    /* Leave the creations to the replenisher, if any */
+    if (reslist->replenisher) {
+        if (reslist->nidle + STASHED(reslist) < reslist->min) {
+            apr_thread_cond_signal(reslist->replenish);
+            created_one = 1;
+        }
+    }
+    else
+#endif
     /* Check if we need to create more resources, and if we are allowed to. */
-    while (reslist->nidle < reslist->min && reslist->ntotal < reslist->hmax) {
+    while (reslist->nidle + STASHED(reslist) < reslist->min
+           && reslist->ntotal < reslist->hmax) {
         /* Create the resource */
         rv = create_resource(reslist, &res);
         if (rv != APR_SUCCESS) {
@@ -222,7 +500,7 @@ static apr_status_t reslist_maintain(apr_reslist_t *reslist)
     }
 
     /* Check if we need to expire old resources */
-    now = apr_time_now();
+    now = apr_time_monotonic();
     while (reslist->nidle > reslist->smax && reslist->nidle > 0) {
         /* Peek at the oldest resource in the list */
         res = APR_RING_LAST(&reslist->avail_list);
@@ -335,26 +613,74 @@ APR_DECLARE(apr_status_t) apr_reslist_destroy(apr_reslist_t *reslist)
     return apr_pool_cleanup_run(reslist->pool, reslist, reslist_cleanup);
 }
 
-static apr_status_t reslist_acquire(apr_reslist_t *reslist,
-                                    void **resource, int flags)
+#if APR_HAS_THREADS
+/**
+ * Wait for the replenisher (or a release) to make a resource available.
+ * Assumes: that the reslist is locked.
+ */
+static apr_status_t reslist_wait_replenished(apr_reslist_t *reslist,
+                                             void **resource, int fifo)
 {
-    apr_status_t rv;
+    apr_uint32_t nfailed = reslist->nfailed;
+    apr_status_t rv = APR_SUCCESS;
     apr_res_t *res;
-    int fifo;
 
-    if (flags & ~APR_RESLIST_ACQUIRE_MASK) {
-        return APR_EINVAL;
+    reslist->nmisses++;
+#if RESLIST_AFFINITY
+    if (reslist->stripes) {
+        apr_atomic_inc32(&reslist->nwaiters);
+        stash_drain(reslist);
+    }
+#endif
+    reslist->ndemand++;
+    apr_thread_cond_signal(reslist->replenish);
+    while (reslist->nidle <= 0) {
+        if (reslist->nfailed != nfailed) {
+            rv = reslist->failed_rv;
+            break;
+        }
+        if (reslist->timeout) {
+            rv = apr_thread_cond_timedwait(reslist->avail, reslist->listlock,
+                                           reslist->timeout);
+            if (rv != APR_SUCCESS) {
+                break;
+            }
+        }
+        else {
+            apr_thread_cond_wait(reslist->avail, reslist->listlock);
+        }
+    }
+    reslist->ndemand--;
+#if RESLIST_AFFINITY
+    if (reslist->stripes) {
+        apr_atomic_dec32(&reslist->nwaiters);
+    }
+#endif
+    if (reslist->nidle <= 0) {
+        return rv;
     }
-    fifo = flags & APR_RESLIST_ACQUIRE_FIFO;
 
-#if APR_HAS_THREADS
-    apr_thread_mutex_lock(reslist->listlock);
-    apr_pool_owner_set(reslist->pool, 0);
+    res = pop_resource(reslist, fifo);
+    *resource = res->opaque;
+    free_container(reslist, res);
+    return APR_SUCCESS;
+}
 #endif
+
+/**
+ * Acquire a resource.
+ * Assumes: that the reslist is locked.
+ */
+static apr_status_t reslist_acquire_locked(apr_reslist_t *reslist,
+                                           void **resource, int fifo)
+{
+    apr_status_t rv = APR_SUCCESS;
+    apr_res_t *res;
+
     /* If there are expired resources in the available list, kill
      * them right away. */
     if (reslist->ttl && reslist->nidle > 0) {
-        apr_time_t now = apr_time_now();
+        apr_time_t now = apr_time_monotonic();
         do {
             /* Peek at the oldest resource in the list */
             res = APR_RING_LAST(&reslist->avail_list);
@@ -370,9 +696,6 @@ static apr_status_t reslist_acquire(apr_reslist_t *reslist,
             rv = destroy_resource(reslist, res);
             free_container(reslist, res);
             if (rv != APR_SUCCESS) {
-#if APR_HAS_THREADS
-                apr_thread_mutex_unlock(reslist->listlock);
-#endif
                 return rv;  /* FIXME: this might cause unnecessary fails */
             }
         } while (reslist->nidle > 0);
@@ -382,28 +705,48 @@ static apr_status_t reslist_acquire(apr_reslist_t *reslist,
         res = pop_resource(reslist, fifo);
         *resource = res->opaque;
         free_container(reslist, res);
-#if APR_HAS_THREADS
-        apr_thread_mutex_unlock(reslist->listlock);
-#endif
         return APR_SUCCESS;
     }
+#if APR_HAS_THREADS
+    /* Never construct inline with a replenisher */
+    if (reslist->replenisher) {
+        return reslist_wait_replenished(reslist, resource, fifo);
+    }
+#endif
     /* If we've hit our max, block until we're allowed to create
      * a new one, or something becomes free. */
-    while (reslist->ntotal >= reslist->hmax && reslist->nidle <= 0) {
+    if (reslist->ntotal >= reslist->hmax) {
+#if RESLIST_AFFINITY
+        /* Stop stashing, and take the resources stashed so far */
+        if (reslist->stripes) {
+            apr_atomic_inc32(&reslist->nwaiters);
+            stash_drain(reslist);
+        }
+#endif
+        while (reslist->ntotal >= reslist->hmax && reslist->nidle <= 0) {
 #if APR_HAS_THREADS
-        if (reslist->timeout) {
-            if ((rv = apr_thread_cond_timedwait(reslist->avail,
-                reslist->listlock, reslist->timeout)) != APR_SUCCESS) {
-                apr_thread_mutex_unlock(reslist->listlock);
-                return rv;
+            if (reslist->timeout) {
+                if ((rv = apr_thread_cond_timedwait(reslist->avail,
+                    reslist->listlock, reslist->timeout)) != APR_SUCCESS) {
+                    break;
+                }
             }
+            else {
+                apr_thread_cond_wait(reslist->avail, reslist->listlock);
+            }
+#else
+            rv = APR_EAGAIN;
+            break;
+#endif
         }
-        else {
-            apr_thread_cond_wait(reslist->avail, reslist->listlock);
+#if RESLIST_AFFINITY
+        if (reslist->stripes) {
+            apr_atomic_dec32(&reslist->nwaiters);
         }
-#else
-        return APR_EAGAIN;
 #endif
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
     }
     /* If we popped out of the loop, first try to see if there
      * are new resources available for immediate use. */
@@ -411,9 +754,6 @@ static apr_status_t reslist_acquire(apr_reslist_t *reslist,
         res = pop_resource(reslist, fifo);
         *resource = res->opaque;
         free_container(reslist, res);
-#if APR_HAS_THREADS
-        apr_thread_mutex_unlock(reslist->listlock);
-#endif
         return APR_SUCCESS;
     }
     /* Otherwise the reason we dropped out of the loop
@@ -426,13 +766,39 @@ static apr_status_t reslist_acquire(apr_reslist_t *reslist,
             *resource = res->opaque;
         }
         free_container(reslist, res);
-#if APR_HAS_THREADS
-        apr_thread_mutex_unlock(reslist->listlock);
-#endif
         return rv;
     }
 }
 
+static apr_status_t reslist_acquire(apr_reslist_t *reslist,
+                                    void **resource, int flags)
+{
+    apr_status_t rv;
+    int fifo;
+
+    if (flags & ~APR_RESLIST_ACQUIRE_MASK) {
+        return APR_EINVAL;
+    }
+    fifo = flags & APR_RESLIST_ACQUIRE_FIFO;
+
+#if RESLIST_AFFINITY
+    /* The thread's stash is LIFO, without locking the list */
+    if (reslist->stripes && !fifo && stash_pop(reslist, resource)) {
+        return APR_SUCCESS;
+    }
+#endif
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(reslist->listlock);
+    apr_pool_owner_set(reslist->pool, 0);
+#endif
+    rv = reslist_acquire_locked(reslist, resource, fifo);
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(reslist->listlock);
+#endif
+    return rv;
+}
+
 APR_DECLARE(apr_status_t) apr_reslist_acquire_ex(apr_reslist_t *reslist,
                                                  void **resource, int flags)
 {
@@ -445,12 +811,55 @@ APR_DECLARE(apr_status_t) apr_reslist_acquire(apr_reslist_t *reslist,
     return reslist_acquire(reslist, resource, 0);
 }
 
+APR_DECLARE(apr_status_t) apr_reslist_acquire_batch(apr_reslist_t *reslist,
+                                                    void **resources, int n,
+                                                    int flags)
+{
+    apr_status_t rv = APR_SUCCESS;
+    int fifo, i;
+
+    if ((flags & ~APR_RESLIST_ACQUIRE_MASK) || n < 0 || n > reslist->hmax) {
+        return APR_EINVAL;
+    }
+    fifo = flags & APR_RESLIST_ACQUIRE_FIFO;
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(reslist->listlock);
+    apr_pool_owner_set(reslist->pool, 0);
+#endif
+    for (i = 0; i < n; i++) {
+        rv = reslist_acquire_locked(reslist, &resources[i], fifo);
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+    }
+    if (rv != APR_SUCCESS) {
+        /* All or nothing */
+        while (i-- > 0) {
+            apr_res_t *res = get_container(reslist);
+
+            res->opaque = resources[i];
+            push_resource(reslist, res, 0);
+        }
+    }
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(reslist->listlock);
+#endif
+    return rv;
+}
+
 APR_DECLARE(apr_status_t) apr_reslist_release(apr_reslist_t *reslist,
                                               void *resource)
 {
     apr_status_t rv;
     apr_res_t *res;
 
+#if RESLIST_AFFINITY
+    if (reslist->stripes && stash_push(reslist, resource)) {
+        return APR_SUCCESS;
+    }
+#endif
+
 #if APR_HAS_THREADS
     apr_thread_mutex_lock(reslist->listlock);
     apr_pool_owner_set(reslist->pool, 0);
@@ -479,7 +888,7 @@ APR_DECLARE(apr_uint32_t) apr_reslist_acquired_count(apr_reslist_t *reslist)
     apr_thread_mutex_lock(reslist->listlock);
     apr_pool_owner_set(reslist->pool, 0);
 #endif
-    count = reslist->ntotal - reslist->nidle;
+    count = reslist->ntotal - reslist->nidle - STASHED(reslist);
 #if APR_HAS_THREADS
     apr_thread_mutex_unlock(reslist->listlock);
 #endif
@@ -504,6 +913,78 @@ APR_DECLARE(apr_status_t) apr_reslist_invalidate(apr_reslist_t *reslist,
     return ret;
 }
 
+APR_DECLARE(apr_status_t) apr_reslist_affinity_set(apr_reslist_t *reslist,
+                                                   int stash)
+{
+#if RESLIST_AFFINITY
+    reslist_stripe_t *stripes;
+    int i;
+
+    if (stash <= 0) {
+        return APR_EINVAL;
+    }
+    if (reslist->stripes) {
+        return APR_EEXIST;
+    }
+
+    stripes = apr_pcalloc(reslist->pool, RESLIST_STRIPES * sizeof(*stripes));
+    for (i = 0; i < RESLIST_STRIPES; i++) {
+        stripes[i].entries = apr_palloc(reslist->pool,
+                                        stash * sizeof(stash_entry_t));
+    }
+    reslist->stash = stash;
+    reslist->stripes = stripes;
+
+    return APR_SUCCESS;
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
+APR_DECLARE(apr_status_t) apr_reslist_replenish_start(apr_reslist_t *reslist,
+                                                      apr_interval_time_t interval)
+{
+#if APR_HAS_THREADS
+    apr_status_t rv;
+
+    if (interval <= 0) {
+        return APR_EINVAL;
+    }
+
+    apr_thread_mutex_lock(reslist->listlock);
+    apr_pool_owner_set(reslist->pool, 0);
+    if (reslist->replenisher) {
+        rv = APR_EEXIST;
+    }
+    else if (reslist->replenish == NULL) {
+        rv = apr_thread_cond_create(&reslist->replenish, reslist->pool);
+    }
+    else {
+        rv = APR_SUCCESS;
+    }
+    if (rv == APR_SUCCESS) {
+        reslist->replenish_interval = interval;
+        reslist->replenish_stop = 0;
+        /* the thread starts by waiting for the lock */
+        rv = apr_thread_create(&reslist->replenisher, NULL,
+                               replenisher_thread, reslist, reslist->pool);
+        if (rv != APR_SUCCESS) {
+            reslist->replenisher = NULL;
+        }
+    }
+    apr_thread_mutex_unlock(reslist->listlock);
+
+    if (rv == APR_SUCCESS) {
+        /* stopped before the pool's subpools (the thread's) go away */
+        apr_pool_pre_cleanup_register(reslist->pool, reslist,
+                                      replenisher_stop);
+    }
+    return rv;
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
 APR_DECLARE(void) apr_reslist_cleanup_order_set(apr_reslist_t *rl,
                                                 apr_uint32_t mode)
 {
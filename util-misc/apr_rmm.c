@@ -20,310 +20,657 @@
 #include "apr_lib.h"
 #include "apr_strings.h"
 
-/* The RMM region is made up of two doubly-linked-list of blocks; the
- * list of used blocks, and the list of free blocks (either list may
- * be empty).  The base pointer, rmm->base, points at the beginning of
- * the shmem region in use.  Each block is addressable by an
+/* The RMM region is a sequence of blocks, each prefixed by an
+ * "rmm_block_t" structure, followed by the caller-usable region
+ * represented by the block.  The base pointer, rmm->base, points at the
+ * beginning of the shmem region in use.  Each block is addressable by an
  * apr_rmm_off_t value, which represents the offset from the base
  * pointer.  The term "address" is used here to mean such a value; an
  * "offset from rmm->base".
  *
- * The RMM region contains exactly one "rmm_hdr_block_t" structure,
- * the "header block", which is always stored at the base pointer.
- * The firstused field in this structure is the address of the first
- * block in the "used blocks" list; the firstfree field is the address
- * of the first block in the "free blocks" list.
+ * The RMM region starts with an "rmm_region_t" structure, always stored
+ * at the base pointer ("address 0" is thus *not* a valid address for a
+ * block), followed by one "rmm_hdr_block_t" structure, the "header
+ * block", per arena.  The rest of the region is split evenly between the
+ * arenas, each with a lock of its own, so that processes allocating from
+ * different arenas don't wait for each other.
  *
- * Each block is prefixed by an "rmm_block_t" structure, followed by
- * the caller-usable region represented by the block.  The next and
- * prev fields of the structure are zero if the block is at the end or
- * beginning of the linked-list respectively, or otherwise hold the
- * address of the next and previous blocks in the list.  ("address 0",
- * i.e. rmm->base is *not* a valid address for a block, since the
- * header block is always stored at that address).
+ * The size of a block includes its rmm_block_t, and its low bit is set
+ * while the block is free.  Blocks also know the address of the block
+ * before them (zero for the first one of an arena), so that freeing a
+ * block merges it with its free neighbours in constant time.
  *
- * At creation, the RMM region is initialized to hold a single block
- * on the free list representing the entire available shm segment
- * (minus header block); subsequent allocation and deallocation of
- * blocks involves splitting blocks and coalescing adjacent blocks,
- * and switching them between the free and used lists as
- * appropriate. */
+ * Free blocks are kept in segregated lists (TLSF, "Two-Level Segregated
+ * Fit"): sizes are split in power of two classes, each split again in
+ * RMM_SL_COUNT linear subclasses, and each subclass has a doubly-linked
+ * list of its free blocks, linked by an rmm_free_t stored right after
+ * the rmm_block_t.  Bitmaps in the header tell the non-empty classes and
+ * subclasses, so that finding a free block large enough takes two
+ * find-first-set operations whatever the number of blocks.
+ *
+ * At creation, each arena is initialized to hold a single free block
+ * representing its share of the shm segment; subsequent allocation and
+ * deallocation of blocks involves splitting blocks and coalescing
+ * adjacent blocks as appropriate.
+ *
+ * With APR_RMM_CACHE, the small blocks freed are kept by the process in
+ * a per-size cache first, still in use as far as the arenas know, and
+ * handed out again without taking any arena lock. */
 
 typedef struct rmm_block_t {
     apr_size_t size;
     apr_rmm_off_t prev;
-    apr_rmm_off_t next;
 } rmm_block_t;
 
+typedef struct rmm_free_t {
+    apr_rmm_off_t prev;
+    apr_rmm_off_t next;
+} rmm_free_t;
+
+#define RMM_BLOCK_SIZE (APR_ALIGN_DEFAULT(sizeof(rmm_block_t)))
+#define RMM_MIN_BLOCK_SIZE (RMM_BLOCK_SIZE \
+                            + APR_ALIGN_DEFAULT(sizeof(rmm_free_t)))
+#define RMM_FREE ((apr_size_t)1)
+
+/* The subclasses of each class, and the sizes whose class is the
+ * linear class zero.  Sizes of 2^32 and more all share the last class.
+ */
+#define RMM_SL_SHIFT 3
+#define RMM_SL_COUNT (1 << RMM_SL_SHIFT)
+#define RMM_ALIGN_SHIFT 3
+#define RMM_SMALL_SHIFT (RMM_SL_SHIFT + RMM_ALIGN_SHIFT)
+#define RMM_FL_COUNT (32 - RMM_SMALL_SHIFT + 2)
+
+/* The format of the region, checked by apr_rmm_attach() */
+#define RMM_MAGIC   0x524d4d00 /* "RMM" */
+#define RMM_VERSION 2
+
 /* Always at our apr_rmm_off(0):
  */
-typedef struct rmm_hdr_block_t {
+typedef struct rmm_region_t {
     apr_size_t abssize;
-    apr_rmm_off_t /* rmm_block_t */ firstused;
-    apr_rmm_off_t /* rmm_block_t */ firstfree;
+    apr_uint32_t magic;
+    apr_uint32_t narenas;
+    apr_size_t arena_size;
+} rmm_region_t;
+
+#define RMM_REGION_SIZE (APR_ALIGN_DEFAULT(sizeof(rmm_region_t)))
+
+/* At the start of each arena's header block:
+ */
+typedef struct rmm_hdr_block_t {
+    apr_uint32_t flmap;
+    apr_uint32_t slmap[RMM_FL_COUNT];
+    apr_rmm_off_t /* rmm_block_t */ free[RMM_FL_COUNT][RMM_SL_COUNT];
 } rmm_hdr_block_t;
 
 #define RMM_HDR_BLOCK_SIZE (APR_ALIGN_DEFAULT(sizeof(rmm_hdr_block_t)))
-#define RMM_BLOCK_SIZE (APR_ALIGN_DEFAULT(sizeof(rmm_block_t)))
+
+/* The blocks of the process cache, for the sizes up to RMM_CACHE_MAX */
+#define RMM_CACHE_MAX 512
+#define RMM_CACHE_BINS ((RMM_CACHE_MAX >> RMM_ALIGN_SHIFT) + 1)
+#define RMM_CACHE_DEPTH 16
+
+typedef struct rmm_arena_t {
+    rmm_hdr_block_t *hdr;
+    apr_rmm_off_t start;
+    apr_rmm_off_t end;
+    apr_anylock_t lock;
+} rmm_arena_t;
+
+typedef struct rmm_cache_t {
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *lock;
+#endif
+    int count[RMM_CACHE_BINS];
+    apr_rmm_off_t /* rmm_block_t */ blocks[RMM_CACHE_BINS][RMM_CACHE_DEPTH];
+} rmm_cache_t;
 
 struct apr_rmm_t {
     apr_pool_t *p;
-    rmm_hdr_block_t *base;
+    rmm_region_t *base;
     apr_size_t size;
-    apr_anylock_t lock;
+    int narenas;
+    rmm_arena_t *arenas;
+    /* The arena of the last allocation, tried first */
+    int home;
+    rmm_cache_t *cache;
 };
 
-static apr_rmm_off_t find_block_by_offset(apr_rmm_t *rmm, apr_rmm_off_t next,
-                                          apr_rmm_off_t find, int includes)
-{
-    apr_rmm_off_t prev = 0;
+#define RMM_BLOCK(rmm, off) ((rmm_block_t *)((char *)(rmm)->base + (off)))
+#define RMM_FREE_LINKS(rmm, off) \
+    ((rmm_free_t *)((char *)(rmm)->base + (off) + RMM_BLOCK_SIZE))
+#define RMM_SIZE(blk) ((blk)->size & ~RMM_FREE)
 
-    while (next) {
-        struct rmm_block_t *blk = (rmm_block_t*)((char*)rmm->base + next);
+static int rmm_ffs(apr_uint32_t map)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(map);
+#else
+    int i = 0;
+
+    while (!(map & 1)) {
+        map >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
 
-        if (find == next)
-            return next;
+static int rmm_fls(apr_size_t size)
+{
+#if defined(__GNUC__)
+    if (sizeof(size) > sizeof(unsigned long)) {
+        return (int)(sizeof(unsigned long long) * 8) - 1
+               - __builtin_clzll((unsigned long long)size);
+    }
+    return (int)(sizeof(unsigned long) * 8) - 1
+           - __builtin_clzl((unsigned long)size);
+#else
+    int i = -1;
+
+    while (size) {
+        size >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
 
-        /* Overshot? */
-        if (find < next)
-            return includes ? prev : 0;
+/* The class and subclass of a free block of this size */
+static void rmm_mapping(apr_size_t size, int *fl, int *sl)
+{
+    int bit;
 
-        prev = next;
-        next = blk->next;
+    if (size < ((apr_size_t)1 << RMM_SMALL_SHIFT)) {
+        *fl = 0;
+        *sl = (int)(size >> RMM_ALIGN_SHIFT);
+        return;
     }
-    return includes ? prev : 0;
+    bit = rmm_fls(size);
+    if (bit >= 32) {
+        *fl = RMM_FL_COUNT - 1;
+        *sl = RMM_SL_COUNT - 1;
+        return;
+    }
+    *fl = bit - RMM_SMALL_SHIFT + 1;
+    *sl = (int)(size >> (bit - RMM_SL_SHIFT)) & (RMM_SL_COUNT - 1);
 }
 
-static apr_rmm_off_t find_block_of_size(apr_rmm_t *rmm, apr_size_t size)
+static void insert_free(apr_rmm_t *rmm, rmm_arena_t *a, apr_rmm_off_t this)
 {
-    apr_rmm_off_t next = rmm->base->firstfree;
-    apr_rmm_off_t best = 0;
-    apr_rmm_off_t bestsize = 0;
-
-    while (next) {
-        struct rmm_block_t *blk = (rmm_block_t*)((char*)rmm->base + next);
-
-        if (blk->size == size)
-            return next;
-
-        if (blk->size >= size) {
-            /* XXX: sub optimal algorithm
-             * We need the most thorough best-fit logic, since we can
-             * never grow our rmm, we are SOL when we hit the wall.
-             */
-            if (!bestsize || (blk->size < bestsize)) {
-                bestsize = blk->size;
-                best = next;
-            }
-        }
-
-        next = blk->next;
+    rmm_block_t *blk = RMM_BLOCK(rmm, this);
+    rmm_free_t *links = RMM_FREE_LINKS(rmm, this);
+    apr_rmm_off_t *head;
+    int fl, sl;
+
+    blk->size |= RMM_FREE;
+    rmm_mapping(RMM_SIZE(blk), &fl, &sl);
+    head = &a->hdr->free[fl][sl];
+
+    links->prev = 0;
+    links->next = *head;
+    if (*head) {
+        RMM_FREE_LINKS(rmm, *head)->prev = this;
     }
+    *head = this;
 
-    if (bestsize > RMM_BLOCK_SIZE + size) {
-        struct rmm_block_t *blk = (rmm_block_t*)((char*)rmm->base + best);
-        struct rmm_block_t *new = (rmm_block_t*)((char*)rmm->base + best + size);
+    a->hdr->flmap |= (apr_uint32_t)1 << fl;
+    a->hdr->slmap[fl] |= (apr_uint32_t)1 << sl;
+}
 
-        new->size = blk->size - size;
-        new->next = blk->next;
-        new->prev = best;
+static void remove_free(apr_rmm_t *rmm, rmm_arena_t *a, apr_rmm_off_t this)
+{
+    rmm_block_t *blk = RMM_BLOCK(rmm, this);
+    rmm_free_t *links = RMM_FREE_LINKS(rmm, this);
+    int fl, sl;
 
-        blk->size = size;
-        blk->next = best + size;
+    rmm_mapping(RMM_SIZE(blk), &fl, &sl);
 
-        if (new->next) {
-            blk = (rmm_block_t*)((char*)rmm->base + new->next);
-            blk->prev = best + size;
+    if (links->prev) {
+        RMM_FREE_LINKS(rmm, links->prev)->next = links->next;
+    }
+    else {
+        a->hdr->free[fl][sl] = links->next;
+        if (!links->next) {
+            a->hdr->slmap[fl] &= ~((apr_uint32_t)1 << sl);
+            if (!a->hdr->slmap[fl]) {
+                a->hdr->flmap &= ~((apr_uint32_t)1 << fl);
+            }
         }
     }
+    if (links->next) {
+        RMM_FREE_LINKS(rmm, links->next)->prev = links->prev;
+    }
 
-    return best;
+    blk->size &= ~RMM_FREE;
 }
 
-static void move_block(apr_rmm_t *rmm, apr_rmm_off_t this, int free)
+/* The first block of the list large enough, for the lists whose blocks
+ * may not all be.
+ */
+static apr_rmm_off_t scan_free(apr_rmm_t *rmm, rmm_arena_t *a,
+                               int fl, int sl, apr_size_t size)
 {
-    struct rmm_block_t *blk = (rmm_block_t*)((char*)rmm->base + this);
+    apr_rmm_off_t this = a->hdr->free[fl][sl];
 
-    /* close the gap */
-    if (blk->prev) {
-        struct rmm_block_t *prev = (rmm_block_t*)((char*)rmm->base + blk->prev);
-        prev->next = blk->next;
+    while (this && RMM_SIZE(RMM_BLOCK(rmm, this)) < size) {
+        this = RMM_FREE_LINKS(rmm, this)->next;
     }
-    else {
-        if (free) {
-            rmm->base->firstused = blk->next;
+    return this;
+}
+
+static apr_rmm_off_t find_block_of_size(apr_rmm_t *rmm, rmm_arena_t *a,
+                                        apr_size_t size)
+{
+    apr_rmm_off_t this = 0;
+    apr_uint32_t map;
+    int fl, sl, exact_fl, exact_sl, bit;
+
+    rmm_mapping(size, &exact_fl, &exact_sl);
+
+    /* Look from the next subclass, where all the blocks are large enough,
+     * unless the size is the first of its subclass.
+     */
+    fl = exact_fl;
+    sl = exact_sl;
+    if (fl > 0 && fl < RMM_FL_COUNT - 1) {
+        bit = rmm_fls(size);
+        if (size & (((apr_size_t)1 << (bit - RMM_SL_SHIFT)) - 1)) {
+            if (++sl == RMM_SL_COUNT) {
+                sl = 0;
+                fl++;
+            }
+        }
+    }
+
+    map = a->hdr->slmap[fl] & (~(apr_uint32_t)0 << sl);
+    if (!map) {
+        map = (fl + 1 < RMM_FL_COUNT)
+              ? a->hdr->flmap & (~(apr_uint32_t)0 << (fl + 1)) : 0;
+        if (map) {
+            fl = rmm_ffs(map);
+            map = a->hdr->slmap[fl];
+        }
+    }
+    if (map) {
+        sl = rmm_ffs(map);
+        if (fl == RMM_FL_COUNT - 1) {
+            this = scan_free(rmm, a, fl, sl, size);
         }
         else {
-            rmm->base->firstfree = blk->next;
+            this = a->hdr->free[fl][sl];
         }
     }
-    if (blk->next) {
-        struct rmm_block_t *next = (rmm_block_t*)((char*)rmm->base + blk->next);
-        next->prev = blk->prev;
+    if (!this && (fl != exact_fl || sl != exact_sl)) {
+        /* Only the subclass of the size may have a block large enough */
+        this = scan_free(rmm, a, exact_fl, exact_sl, size);
+    }
+    if (!this) {
+        return 0;
     }
 
-    /* now find it in the other list, pushing it to the head if required */
-    if (free) {
-        blk->prev = find_block_by_offset(rmm, rmm->base->firstfree, this, 1);
-        if (!blk->prev) {
-            blk->next = rmm->base->firstfree;
-            rmm->base->firstfree = this;
+    remove_free(rmm, a, this);
+
+    /* Give back what we don't need */
+    if (RMM_SIZE(RMM_BLOCK(rmm, this)) >= size + RMM_MIN_BLOCK_SIZE) {
+        rmm_block_t *blk = RMM_BLOCK(rmm, this);
+        apr_rmm_off_t rest = this + size;
+        rmm_block_t *new = RMM_BLOCK(rmm, rest);
+
+        new->size = blk->size - size;
+        new->prev = this;
+        blk->size = size;
+        if (rest + new->size < a->end) {
+            RMM_BLOCK(rmm, rest + new->size)->prev = rest;
         }
+        insert_free(rmm, a, rest);
     }
-    else {
-        blk->prev = find_block_by_offset(rmm, rmm->base->firstused, this, 1);
-        if (!blk->prev) {
-            blk->next = rmm->base->firstused;
-            rmm->base->firstused = this;
-        }
+
+    return this;
+}
+
+static void free_block(apr_rmm_t *rmm, rmm_arena_t *a, apr_rmm_off_t this)
+{
+    rmm_block_t *blk = RMM_BLOCK(rmm, this);
+    apr_rmm_off_t next = this + blk->size;
+
+    /* Merge with our successor and predecessor when free */
+    if (next < a->end && (RMM_BLOCK(rmm, next)->size & RMM_FREE)) {
+        remove_free(rmm, a, next);
+        blk->size += RMM_BLOCK(rmm, next)->size;
+        next = this + blk->size;
     }
+    if (blk->prev && (RMM_BLOCK(rmm, blk->prev)->size & RMM_FREE)) {
+        apr_rmm_off_t prev = blk->prev;
 
-    /* and open it up */
-    if (blk->prev) {
-        struct rmm_block_t *prev = (rmm_block_t*)((char*)rmm->base + blk->prev);
-        if (free && (blk->prev + prev->size == this)) {
-            /* Collapse us into our predecessor */
-            prev->size += blk->size;
-            this = blk->prev;
-            blk = prev;
+        remove_free(rmm, a, prev);
+        RMM_BLOCK(rmm, prev)->size += blk->size;
+        this = prev;
+        blk = RMM_BLOCK(rmm, prev);
+    }
+    if (next < a->end) {
+        RMM_BLOCK(rmm, next)->prev = this;
+    }
+
+    insert_free(rmm, a, this);
+}
+
+/* The arena holding a block */
+static rmm_arena_t *block_arena(apr_rmm_t *rmm, apr_rmm_off_t this)
+{
+    apr_size_t i = (this - rmm->arenas[0].start) / rmm->base->arena_size;
+
+    return &rmm->arenas[i < (apr_size_t)rmm->narenas ? i
+                                                     : rmm->narenas - 1];
+}
+
+/* Set up our view of the arenas of a region */
+static apr_status_t rmm_open(apr_rmm_t **rmm, apr_anylock_t *locks,
+                             int narenas, void *base, apr_size_t size,
+                             apr_uint32_t flags, apr_pool_t *p)
+{
+    apr_rmm_t *new_rmm;
+    apr_rmm_off_t start = RMM_REGION_SIZE + narenas * RMM_HDR_BLOCK_SIZE;
+    apr_size_t arena_size;
+    int i;
+
+    arena_size = ((size - start) / narenas) & ~(APR_ALIGN_DEFAULT(1) - 1);
+
+    new_rmm = (apr_rmm_t *)apr_pcalloc(p, sizeof(apr_rmm_t));
+    new_rmm->p = p;
+    new_rmm->base = base;
+    new_rmm->size = size;
+    new_rmm->narenas = narenas;
+    new_rmm->arenas = apr_pcalloc(p, narenas * sizeof(rmm_arena_t));
+
+    for (i = 0; i < narenas; i++) {
+        rmm_arena_t *a = &new_rmm->arenas[i];
+
+        a->hdr = (rmm_hdr_block_t *)((char *)base + RMM_REGION_SIZE
+                                     + i * RMM_HDR_BLOCK_SIZE);
+        a->start = start + i * arena_size;
+        a->end = (i == narenas - 1) ? size : a->start + arena_size;
+        if (locks) {
+            a->lock = locks[i];
         }
         else {
-            blk->next = prev->next;
-            prev->next = this;
+            a->lock.type = apr_anylock_none;
+            a->lock.lock.pm = NULL;
         }
     }
 
-    if (blk->next) {
-        struct rmm_block_t *next = (rmm_block_t*)((char*)rmm->base + blk->next);
-        if (free && (this + blk->size == blk->next)) {
-            /* Collapse us into our successor */
-            blk->size += next->size;
-            blk->next = next->next;
-            if (blk->next) {
-                next = (rmm_block_t*)((char*)rmm->base + blk->next);
-                next->prev = this;
+    if (flags & APR_RMM_CACHE) {
+        new_rmm->cache = apr_pcalloc(p, sizeof(rmm_cache_t));
+#if APR_HAS_THREADS
+        {
+            apr_status_t rv;
+
+            rv = apr_thread_mutex_create(&new_rmm->cache->lock,
+                                         APR_THREAD_MUTEX_DEFAULT, p);
+            if (rv != APR_SUCCESS) {
+                return rv;
             }
         }
-        else {
-            next->prev = this;
-        }
+#endif
     }
+
+    *rmm = new_rmm;
+    return APR_SUCCESS;
 }
 
 APR_DECLARE(apr_status_t) apr_rmm_init(apr_rmm_t **rmm, apr_anylock_t *lock,
                                        void *base, apr_size_t size,
                                        apr_pool_t *p)
 {
-    apr_status_t rv;
-    rmm_block_t *blk;
-    apr_anylock_t nulllock;
+    return apr_rmm_init_ex(rmm, lock, 1, base, size, 0, p);
+}
 
-    if (!lock) {
-        nulllock.type = apr_anylock_none;
-        nulllock.lock.pm = NULL;
-        lock = &nulllock;
+APR_DECLARE(apr_status_t) apr_rmm_init_ex(apr_rmm_t **rmm,
+                                          apr_anylock_t *locks,
+                                          int narenas,
+                                          void *base,
+                                          apr_size_t size,
+                                          apr_uint32_t flags,
+                                          apr_pool_t *p)
+{
+    apr_status_t rv;
+    rmm_region_t *region = base;
+    apr_rmm_off_t start;
+    int i;
+
+    start = RMM_REGION_SIZE + narenas * RMM_HDR_BLOCK_SIZE;
+    if (narenas < 1
+        || size < start
+        || (size - start) / narenas < RMM_MIN_BLOCK_SIZE
+                                      + APR_ALIGN_DEFAULT(1)) {
+        return APR_EINVAL;
     }
-    if ((rv = APR_ANYLOCK_LOCK(lock)) != APR_SUCCESS)
-        return rv;
+    /* Whole blocks only, the free flag needs their low bit */
+    size = start + ((size - start) & ~(APR_ALIGN_DEFAULT(1) - 1));
 
-    (*rmm) = (apr_rmm_t *)apr_pcalloc(p, sizeof(apr_rmm_t));
-    (*rmm)->p = p;
-    (*rmm)->base = base;
-    (*rmm)->size = size;
-    (*rmm)->lock = *lock;
+    if ((rv = rmm_open(rmm, locks, narenas, base, size, flags,
+                       p)) != APR_SUCCESS) {
+        return rv;
+    }
 
-    (*rmm)->base->abssize = size;
-    (*rmm)->base->firstused = 0;
-    (*rmm)->base->firstfree = RMM_HDR_BLOCK_SIZE;
+    memset(region, 0, start);
+    region->abssize = size;
+    region->narenas = narenas;
+    region->arena_size = ((size - start) / narenas)
+                         & ~(APR_ALIGN_DEFAULT(1) - 1);
 
-    blk = (rmm_block_t *)((char*)base + (*rmm)->base->firstfree);
+    for (i = 0; i < narenas; i++) {
+        rmm_arena_t *a = &(*rmm)->arenas[i];
+        rmm_block_t *blk;
 
-    blk->size = size - (*rmm)->base->firstfree;
-    blk->prev = 0;
-    blk->next = 0;
+        if ((rv = APR_ANYLOCK_LOCK(&a->lock)) != APR_SUCCESS) {
+            return rv;
+        }
+        blk = RMM_BLOCK(*rmm, a->start);
+        blk->size = a->end - a->start;
+        blk->prev = 0;
+        insert_free(*rmm, a, a->start);
+        APR_ANYLOCK_UNLOCK(&a->lock);
+    }
 
-    return APR_ANYLOCK_UNLOCK(lock);
+    /* Attachable once complete */
+    region->magic = RMM_MAGIC | RMM_VERSION;
+    return APR_SUCCESS;
 }
 
 APR_DECLARE(apr_status_t) apr_rmm_destroy(apr_rmm_t *rmm)
 {
     apr_status_t rv;
-    rmm_block_t *blk;
+    rmm_arena_t *a = &rmm->arenas[0];
 
-    if ((rv = APR_ANYLOCK_LOCK(&rmm->lock)) != APR_SUCCESS) {
+    if ((rv = APR_ANYLOCK_LOCK(&a->lock)) != APR_SUCCESS) {
         return rv;
     }
     /* Blast it all --- no going back :) */
-    if (rmm->base->firstused) {
-        apr_rmm_off_t this = rmm->base->firstused;
-        do {
-            blk = (rmm_block_t *)((char*)rmm->base + this);
-            this = blk->next;
-            blk->next = blk->prev = 0;
-        } while (this);
-        rmm->base->firstused = 0;
-    }
-    if (rmm->base->firstfree) {
-        apr_rmm_off_t this = rmm->base->firstfree;
-        do {
-            blk = (rmm_block_t *)((char*)rmm->base + this);
-            this = blk->next;
-            blk->next = blk->prev = 0;
-        } while (this);
-        rmm->base->firstfree = 0;
-    }
-    rmm->base->abssize = 0;
+    memset(rmm->base, 0,
+           RMM_REGION_SIZE + rmm->narenas * RMM_HDR_BLOCK_SIZE);
+    if (rmm->cache) {
+        memset(rmm->cache->count, 0, sizeof(rmm->cache->count));
+    }
     rmm->size = 0;
 
-    return APR_ANYLOCK_UNLOCK(&rmm->lock);
+    return APR_ANYLOCK_UNLOCK(&a->lock);
 }
 
 APR_DECLARE(apr_status_t) apr_rmm_attach(apr_rmm_t **rmm, apr_anylock_t *lock,
                                          void *base, apr_pool_t *p)
 {
-    apr_anylock_t nulllock;
+    return apr_rmm_attach_ex(rmm, lock, 1, base, 0, p);
+}
+
+APR_DECLARE(apr_status_t) apr_rmm_attach_ex(apr_rmm_t **rmm,
+                                            apr_anylock_t *locks,
+                                            int narenas,
+                                            void *base,
+                                            apr_uint32_t flags,
+                                            apr_pool_t *p)
+{
+    rmm_region_t *region = base;
 
-    if (!lock) {
-        nulllock.type = apr_anylock_none;
-        nulllock.lock.pm = NULL;
-        lock = &nulllock;
+    /* Not a region of ours, or of another layout or number of arenas */
+    if (region->magic != (RMM_MAGIC | RMM_VERSION)
+        || narenas < 1 || region->narenas != (apr_uint32_t)narenas) {
+        return APR_EINVAL;
     }
 
-    /* sanity would be good here */
-    (*rmm) = (apr_rmm_t *)apr_pcalloc(p, sizeof(apr_rmm_t));
-    (*rmm)->p = p;
-    (*rmm)->base = base;
-    (*rmm)->size = (*rmm)->base->abssize;
-    (*rmm)->lock = *lock;
-    return APR_SUCCESS;
+    return rmm_open(rmm, locks, narenas, base, region->abssize, flags, p);
 }
 
 APR_DECLARE(apr_status_t) apr_rmm_detach(apr_rmm_t *rmm)
 {
-    /* A noop until we introduce locked/refcounts */
-    return APR_SUCCESS;
+    /* Nothing else until we introduce locked/refcounts */
+    return apr_rmm_cache_flush(rmm);
 }
 
-APR_DECLARE(apr_rmm_off_t) apr_rmm_malloc(apr_rmm_t *rmm, apr_size_t reqsize)
+APR_DECLARE(apr_status_t) apr_rmm_cache_flush(apr_rmm_t *rmm)
 {
-    apr_size_t size;
-    apr_rmm_off_t this;
+    rmm_cache_t *cache = rmm->cache;
+    apr_status_t rv = APR_SUCCESS;
+    int i;
+
+    if (!cache || !rmm->size) {
+        return APR_SUCCESS;
+    }
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(cache->lock);
+#endif
+    for (i = 0; i < RMM_CACHE_BINS; i++) {
+        while (cache->count[i]) {
+            apr_rmm_off_t this = cache->blocks[i][cache->count[i] - 1];
+            rmm_arena_t *a = block_arena(rmm, this);
+
+            if ((rv = APR_ANYLOCK_LOCK(&a->lock)) != APR_SUCCESS) {
+                break;
+            }
+            free_block(rmm, a, this);
+            APR_ANYLOCK_UNLOCK(&a->lock);
+            cache->count[i]--;
+        }
+    }
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(cache->lock);
+#endif
+
+    return rv;
+}
+
+/* The size of the block for reqsize bytes, or 0 on overflow */
+static apr_size_t block_size(apr_size_t reqsize)
+{
+    apr_size_t size = APR_ALIGN_DEFAULT(reqsize) + RMM_BLOCK_SIZE;
 
-    size = APR_ALIGN_DEFAULT(reqsize) + RMM_BLOCK_SIZE;
     if (size < reqsize) {
         return 0;
     }
+    return (size < RMM_MIN_BLOCK_SIZE) ? RMM_MIN_BLOCK_SIZE : size;
+}
+
+/* A block from the process cache, if any */
+static apr_rmm_off_t cache_get(apr_rmm_t *rmm, apr_size_t size)
+{
+    rmm_cache_t *cache = rmm->cache;
+    apr_rmm_off_t this = 0;
+    int bin = (int)(size >> RMM_ALIGN_SHIFT);
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(cache->lock);
+#endif
+    if (cache->count[bin]) {
+        this = cache->blocks[bin][--cache->count[bin]];
+    }
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(cache->lock);
+#endif
+
+    return this;
+}
+
+/* Keep a block in the process cache, unless it is full */
+static apr_status_t cache_put(apr_rmm_t *rmm, apr_rmm_off_t this,
+                              apr_size_t size)
+{
+    rmm_cache_t *cache = rmm->cache;
+    apr_status_t rv = APR_INCOMPLETE;
+    int bin = (int)(size >> RMM_ALIGN_SHIFT), i;
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(cache->lock);
+#endif
+    for (i = 0; i < cache->count[bin]; i++) {
+        if (cache->blocks[bin][i] == this) {
+            rv = APR_EINVAL;
+            break;
+        }
+    }
+    if (rv != APR_EINVAL && cache->count[bin] < RMM_CACHE_DEPTH) {
+        cache->blocks[bin][cache->count[bin]++] = this;
+        rv = APR_SUCCESS;
+    }
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(cache->lock);
+#endif
+
+    return rv;
+}
+
+/* A block from the first arena not busy, starting with the last one
+ * used, or from any arena at all once they were all found busy.
+ */
+static apr_rmm_off_t arena_alloc(apr_rmm_t *rmm, apr_size_t size)
+{
+    int n = rmm->narenas, home = rmm->home, i;
+
+    for (i = (n > 1) ? 0 : n; i < 2 * n; i++) {
+        int k = (home + i) % n;
+        rmm_arena_t *a = &rmm->arenas[k];
+        apr_rmm_off_t this;
+
+        if (i < n) {
+            if (APR_ANYLOCK_TRYLOCK(&a->lock) != APR_SUCCESS) {
+                continue;
+            }
+        }
+        else if (APR_ANYLOCK_LOCK(&a->lock) != APR_SUCCESS) {
+            continue;
+        }
+        this = find_block_of_size(rmm, a, size);
+        APR_ANYLOCK_UNLOCK(&a->lock);
+
+        if (this) {
+            rmm->home = k;
+            return this;
+        }
+    }
 
-    APR_ANYLOCK_LOCK(&rmm->lock);
+    return 0;
+}
 
-    this = find_block_of_size(rmm, size);
+APR_DECLARE(apr_rmm_off_t) apr_rmm_malloc(apr_rmm_t *rmm, apr_size_t reqsize)
+{
+    apr_size_t size;
+    apr_rmm_off_t this = 0;
+
+    if ((size = block_size(reqsize)) == 0) {
+        return 0;
+    }
 
+    if (rmm->cache && size <= RMM_CACHE_MAX) {
+        this = cache_get(rmm, size);
+    }
+    if (!this) {
+        this = arena_alloc(rmm, size);
+    }
     if (this) {
-        move_block(rmm, this, 0);
         this += RMM_BLOCK_SIZE;
     }
 
-    APR_ANYLOCK_UNLOCK(&rmm->lock);
     return this;
 }
 
@@ -332,22 +679,16 @@ APR_DECLARE(apr_rmm_off_t) apr_rmm_calloc(apr_rmm_t *rmm, apr_size_t reqsize)
     apr_size_t size;
     apr_rmm_off_t this;
 
-    size = APR_ALIGN_DEFAULT(reqsize) + RMM_BLOCK_SIZE;
-    if (size < reqsize) {
+    if ((size = block_size(reqsize)) == 0) {
         return 0;
     }
 
-    APR_ANYLOCK_LOCK(&rmm->lock);
-
-    this = find_block_of_size(rmm, size);
+    this = apr_rmm_malloc(rmm, reqsize);
 
     if (this) {
-        move_block(rmm, this, 0);
-        this += RMM_BLOCK_SIZE;
         memset((char*)rmm->base + this, 0, size - RMM_BLOCK_SIZE);
     }
 
-    APR_ANYLOCK_UNLOCK(&rmm->lock);
     return this;
 }
 
@@ -373,8 +714,8 @@ APR_DECLARE(apr_rmm_off_t) apr_rmm_realloc(apr_rmm_t *rmm, void *entity,
         return 0;
     }
 
-    blk = (rmm_block_t*)((char*)rmm->base + old - RMM_BLOCK_SIZE);
-    oldsize = blk->size;
+    blk = RMM_BLOCK(rmm, old - RMM_BLOCK_SIZE);
+    oldsize = RMM_SIZE(blk) - RMM_BLOCK_SIZE;
 
     memcpy(apr_rmm_addr_get(rmm, this),
            apr_rmm_addr_get(rmm, old), oldsize < size ? oldsize : size);
@@ -387,48 +728,64 @@ APR_DECLARE(apr_status_t) apr_rmm_free(apr_rmm_t *rmm, apr_rmm_off_t this)
 {
     apr_status_t rv;
     struct rmm_block_t *blk;
+    rmm_arena_t *a;
+    apr_rmm_off_t next;
 
     /* A little sanity check is always healthy, especially here.
      * If we really cared, we could make this compile-time
      */
-    if (this < RMM_HDR_BLOCK_SIZE + RMM_BLOCK_SIZE) {
+    if (this < rmm->arenas[0].start + RMM_BLOCK_SIZE
+        || this >= rmm->size
+        || (this - rmm->arenas[0].start) % APR_ALIGN_DEFAULT(1)) {
         return APR_EINVAL;
     }
 
     this -= RMM_BLOCK_SIZE;
 
-    blk = (rmm_block_t*)((char*)rmm->base + this);
+    blk = RMM_BLOCK(rmm, this);
+    a = block_arena(rmm, this);
 
-    if ((rv = APR_ANYLOCK_LOCK(&rmm->lock)) != APR_SUCCESS) {
-        return rv;
+    /* The size of a block in use is ours to read */
+    next = this + RMM_SIZE(blk);
+    if ((blk->size & RMM_FREE)
+        || blk->size < RMM_MIN_BLOCK_SIZE
+        || next > a->end) {
+        return APR_EINVAL;
     }
-    if (blk->prev) {
-        struct rmm_block_t *prev = (rmm_block_t*)((char*)rmm->base + blk->prev);
-        if (prev->next != this) {
-            APR_ANYLOCK_UNLOCK(&rmm->lock);
-            return APR_EINVAL;
+
+    if (rmm->cache && blk->size <= RMM_CACHE_MAX) {
+        rv = cache_put(rmm, this, blk->size);
+        if (rv != APR_INCOMPLETE) {
+            return rv;
         }
     }
-    else {
-        if (rmm->base->firstused != this) {
-            APR_ANYLOCK_UNLOCK(&rmm->lock);
-            return APR_EINVAL;
-        }
+
+    if ((rv = APR_ANYLOCK_LOCK(&a->lock)) != APR_SUCCESS) {
+        return rv;
     }
 
-    if (blk->next) {
-        struct rmm_block_t *next = (rmm_block_t*)((char*)rmm->base + blk->next);
-        if (next->prev != this) {
-            APR_ANYLOCK_UNLOCK(&rmm->lock);
+    /* Not a block whose neighbours know it */
+    if (next < a->end && RMM_BLOCK(rmm, next)->prev != this) {
+        APR_ANYLOCK_UNLOCK(&a->lock);
+        return APR_EINVAL;
+    }
+    if (blk->prev) {
+        if (blk->prev < a->start || blk->prev >= this
+            || blk->prev + RMM_SIZE(RMM_BLOCK(rmm, blk->prev)) != this) {
+            APR_ANYLOCK_UNLOCK(&a->lock);
             return APR_EINVAL;
         }
     }
+    else if (this != a->start) {
+        APR_ANYLOCK_UNLOCK(&a->lock);
+        return APR_EINVAL;
+    }
 
-    /* Ok, it remained [apparently] sane, so unlink it
+    /* Ok, it remained [apparently] sane, so give it back
      */
-    move_block(rmm, this, 1);
+    free_block(rmm, a, this);
 
-    return APR_ANYLOCK_UNLOCK(&rmm->lock);
+    return APR_ANYLOCK_UNLOCK(&a->lock);
 }
 
 APR_DECLARE(void *) apr_rmm_addr_get(apr_rmm_t *rmm, apr_rmm_off_t entity)
@@ -451,7 +808,9 @@ APR_DECLARE(apr_rmm_off_t) apr_rmm_offset_get(apr_rmm_t *rmm, void* entity)
 APR_DECLARE(apr_size_t) apr_rmm_overhead_get(int n)
 {
     /* overhead per block is at most APR_ALIGN_DEFAULT(1) wasted bytes
-     * for alignment overhead, plus the size of the rmm_block_t
-     * structure. */
-    return RMM_HDR_BLOCK_SIZE + n * (RMM_BLOCK_SIZE + APR_ALIGN_DEFAULT(1));
+     * for alignment overhead, plus the size of the smallest block, which
+     * has room for the rmm_block_t structure and the links of the free
+     * lists. */
+    return RMM_REGION_SIZE + RMM_HDR_BLOCK_SIZE
+           + n * (RMM_MIN_BLOCK_SIZE + APR_ALIGN_DEFAULT(1));
 }
@@ -0,0 +1,489 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr.h"
+#include "apr_general.h"
+#include "apr_atomic.h"
+#include "apr_hash.h"
+#include "apr_time.h"
+#include "apr_shm_hash.h"
+
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+/*
+ * The table is a header followed by an array of slots, probed linearly
+ * from the hash of the keys.  A slot is never emptied once used: removed
+ * entries leave a tombstone, reused by later insertions, so a lookup can
+ * stop at the first empty slot.
+ *
+ * Each slot has a sequence counter, odd while a writer changes the slot.
+ * Readers copy the slot between two reads of the counter and retry if it
+ * changed.  Writers take the counter from even to odd with a CAS, so only
+ * one writer changes a slot at a time, and they hold the stripe lock of
+ * their key while they look for its slot, so that no two writers can
+ * insert the same key in two different slots.
+ *
+ * Nothing here is a pointer, so the table works at any address.  A
+ * process dying while it holds a stripe or a slot blocks the writers of
+ * the stripe, or the readers of the slot, for good.
+ */
+
+#define SHM_HASH_MAGIC   0x53484831 /* "SHH1" */
+#define SHM_HASH_STRIPES 64
+
+/* The slots probed for a free one before evicting an entry */
+#define SHM_HASH_EVICT_WINDOW 16
+
+/* Busy loops before sleeping, while waiting for a writer */
+#define SHM_HASH_SPINS 100
+
+#define SLOT_EMPTY 0
+#define SLOT_USED  1
+#define SLOT_TOMB  2
+
+typedef struct shm_hash_hdr_t {
+    apr_uint32_t magic;
+    apr_uint32_t capacity;
+    apr_uint32_t flags;
+    volatile apr_uint32_t count;
+    apr_size_t key_size;
+    apr_size_t val_size;
+    apr_size_t slot_size;
+    volatile apr_uint32_t stripes[SHM_HASH_STRIPES];
+} shm_hash_hdr_t;
+
+#define SHM_HASH_HDR_SIZE (APR_ALIGN_DEFAULT(sizeof(shm_hash_hdr_t)))
+
+/* Followed by the key, then the value */
+typedef struct shm_hash_slot_t {
+    volatile apr_uint32_t seq;
+    volatile apr_uint32_t ref;
+    apr_uint32_t state;
+    apr_uint32_t hash;
+    apr_uint32_t klen;
+    apr_uint32_t vlen;
+} shm_hash_slot_t;
+
+#define SHM_HASH_SLOT_SIZE (APR_ALIGN_DEFAULT(sizeof(shm_hash_slot_t)))
+
+struct apr_shm_hash_t {
+    apr_pool_t *pool;
+    shm_hash_hdr_t *hdr;
+    char *slots;
+    apr_uint32_t mask;
+};
+
+#define SLOT(ht, i) \
+    ((shm_hash_slot_t *)((ht)->slots + (apr_size_t)(i) * (ht)->hdr->slot_size))
+#define SLOT_KEY(s) ((char *)(s) + SHM_HASH_SLOT_SIZE)
+#define SLOT_VAL(ht, s) (SLOT_KEY(s) + (ht)->hdr->key_size)
+
+/* Orders the reads of a slot before the second read of its counter.  The
+ * apr_atomic functions are full barriers, so without the compiler's fence
+ * a CAS leaving the counter unchanged does it.
+ */
+#if defined(__GNUC__) && ((__GNUC__ > 4) \
+                          || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+#define shm_hash_read_seq_again(s, seq) \
+    (__atomic_thread_fence(__ATOMIC_ACQUIRE), apr_atomic_read32(&(s)->seq))
+#else
+#define shm_hash_read_seq_again(s, seq) \
+    apr_atomic_cas32(&(s)->seq, (seq), (seq))
+#endif
+
+static void shm_hash_pause(int *spins)
+{
+    if (*spins < SHM_HASH_SPINS) {
+        (*spins)++;
+    }
+    else {
+        apr_sleep(1);
+    }
+}
+
+static apr_uint32_t round_capacity(apr_uint32_t capacity)
+{
+    apr_uint32_t n = 2;
+
+    while (n < capacity && n < 0x80000000) {
+        n <<= 1;
+    }
+    return n;
+}
+
+static apr_size_t slot_size(apr_size_t key_size, apr_size_t val_size)
+{
+    return SHM_HASH_SLOT_SIZE + APR_ALIGN_DEFAULT(key_size + val_size);
+}
+
+APR_DECLARE(apr_size_t) apr_shm_hash_size_get(apr_uint32_t capacity,
+                                              apr_size_t key_size,
+                                              apr_size_t val_size)
+{
+    return SHM_HASH_HDR_SIZE
+           + round_capacity(capacity) * slot_size(key_size, val_size);
+}
+
+APR_DECLARE(apr_status_t) apr_shm_hash_create(apr_shm_hash_t **ht,
+                                              void *membuf,
+                                              apr_size_t memsize,
+                                              apr_uint32_t capacity,
+                                              apr_size_t key_size,
+                                              apr_size_t val_size,
+                                              apr_uint32_t flags,
+                                              apr_pool_t *p)
+{
+    shm_hash_hdr_t *hdr = membuf;
+    apr_shm_hash_t *new_ht;
+
+    if (!key_size || key_size > APR_UINT32_MAX || val_size > APR_UINT32_MAX
+        || memsize < apr_shm_hash_size_get(capacity, key_size, val_size)) {
+        return APR_EINVAL;
+    }
+
+    capacity = round_capacity(capacity);
+    memset(hdr, 0, apr_shm_hash_size_get(capacity, key_size, val_size));
+    hdr->capacity = capacity;
+    hdr->flags = flags;
+    hdr->key_size = key_size;
+    hdr->val_size = val_size;
+    hdr->slot_size = slot_size(key_size, val_size);
+
+    new_ht = apr_pcalloc(p, sizeof(*new_ht));
+    new_ht->pool = p;
+    new_ht->hdr = hdr;
+    new_ht->slots = (char *)membuf + SHM_HASH_HDR_SIZE;
+    new_ht->mask = capacity - 1;
+
+    /* Attachable once complete */
+    apr_atomic_set32(&hdr->magic, SHM_HASH_MAGIC);
+
+    *ht = new_ht;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_shm_hash_attach(apr_shm_hash_t **ht,
+                                              void *membuf,
+                                              apr_pool_t *p)
+{
+    shm_hash_hdr_t *hdr = membuf;
+    apr_shm_hash_t *new_ht;
+
+    if (apr_atomic_read32(&hdr->magic) != SHM_HASH_MAGIC) {
+        return APR_EINVAL;
+    }
+
+    new_ht = apr_pcalloc(p, sizeof(*new_ht));
+    new_ht->pool = p;
+    new_ht->hdr = hdr;
+    new_ht->slots = (char *)membuf + SHM_HASH_HDR_SIZE;
+    new_ht->mask = hdr->capacity - 1;
+
+    *ht = new_ht;
+    return APR_SUCCESS;
+}
+
+static apr_uint32_t shm_hash_key(const void *key, apr_size_t klen)
+{
+    apr_ssize_t len = (apr_ssize_t)klen;
+
+    return apr_hashfunc_fast(key, &len);
+}
+
+/* Whether a slot holds the key, as of a consistent read of the slot */
+static int slot_match(apr_shm_hash_t *ht, shm_hash_slot_t *s,
+                      apr_uint32_t hash, const void *key, apr_size_t klen,
+                      apr_uint32_t *state)
+{
+    int spins = 0;
+
+    for (;;) {
+        apr_uint32_t seq = apr_atomic_read32(&s->seq);
+        int match;
+
+        if (seq & 1) {
+            shm_hash_pause(&spins);
+            continue;
+        }
+        *state = s->state;
+        match = (*state == SLOT_USED && s->hash == hash && s->klen == klen
+                 && memcmp(SLOT_KEY(s), key, klen) == 0);
+        if (shm_hash_read_seq_again(s, seq) == seq) {
+            return match;
+        }
+    }
+}
+
+static apr_uint32_t slot_lock(shm_hash_slot_t *s)
+{
+    int spins = 0;
+
+    for (;;) {
+        apr_uint32_t seq = apr_atomic_read32(&s->seq);
+
+        if (!(seq & 1) && apr_atomic_cas32(&s->seq, seq + 1, seq) == seq) {
+            return seq + 1;
+        }
+        shm_hash_pause(&spins);
+    }
+}
+
+static void slot_unlock(shm_hash_slot_t *s, apr_uint32_t seq)
+{
+    apr_atomic_set32(&s->seq, seq + 1);
+}
+
+static void stripe_lock(apr_shm_hash_t *ht, apr_uint32_t hash)
+{
+    volatile apr_uint32_t *stripe = &ht->hdr->stripes[hash % SHM_HASH_STRIPES];
+    int spins = 0;
+
+    while (apr_atomic_cas32(stripe, 1, 0) != 0) {
+        shm_hash_pause(&spins);
+    }
+}
+
+static void stripe_unlock(apr_shm_hash_t *ht, apr_uint32_t hash)
+{
+    apr_atomic_set32(&ht->hdr->stripes[hash % SHM_HASH_STRIPES], 0);
+}
+
+APR_DECLARE(apr_status_t) apr_shm_hash_get(apr_shm_hash_t *ht,
+                                           const void *key,
+                                           apr_size_t klen,
+                                           void *val,
+                                           apr_size_t *vlen)
+{
+    apr_uint32_t hash = shm_hash_key(key, klen), i;
+
+    if (klen > ht->hdr->key_size) {
+        return APR_NOTFOUND;
+    }
+
+    for (i = 0; i <= ht->mask; i++) {
+        shm_hash_slot_t *s = SLOT(ht, (hash + i) & ht->mask);
+        int spins = 0;
+
+        for (;;) {
+            apr_uint32_t seq = apr_atomic_read32(&s->seq), state, len;
+            int match;
+
+            if (seq & 1) {
+                shm_hash_pause(&spins);
+                continue;
+            }
+            state = s->state;
+            match = (state == SLOT_USED && s->hash == hash && s->klen == klen
+                     && memcmp(SLOT_KEY(s), key, klen) == 0);
+            if (match) {
+                len = s->vlen;
+                if (len > ht->hdr->val_size) {
+                    len = 0;
+                }
+                memcpy(val, SLOT_VAL(ht, s), len);
+            }
+            if (shm_hash_read_seq_again(s, seq) != seq) {
+                continue;
+            }
+
+            if (state == SLOT_EMPTY) {
+                return APR_NOTFOUND;
+            }
+            if (match) {
+                if ((ht->hdr->flags & APR_SHM_HASH_EVICT)
+                    && !apr_atomic_read32(&s->ref)) {
+                    apr_atomic_set32(&s->ref, 1);
+                }
+                if (vlen) {
+                    *vlen = len;
+                }
+                return APR_SUCCESS;
+            }
+            break;
+        }
+    }
+
+    return APR_NOTFOUND;
+}
+
+/* The slot holding the key, or else the first free slot of its probe
+ * and its distance from the start, with the stripe of the key held.
+ */
+static shm_hash_slot_t *find_slot(apr_shm_hash_t *ht, apr_uint32_t hash,
+                                  const void *key, apr_size_t klen,
+                                  int *found, apr_uint32_t *dist)
+{
+    shm_hash_slot_t *free_slot = NULL;
+    apr_uint32_t i, state;
+
+    for (i = 0; i <= ht->mask; i++) {
+        shm_hash_slot_t *s = SLOT(ht, (hash + i) & ht->mask);
+
+        if (slot_match(ht, s, hash, key, klen, &state)) {
+            *found = 1;
+            return s;
+        }
+        if (state != SLOT_USED && !free_slot) {
+            free_slot = s;
+            *dist = i;
+        }
+        if (state == SLOT_EMPTY) {
+            break;
+        }
+    }
+
+    *found = 0;
+    return free_slot;
+}
+
+/* Clock eviction among the first slots of the probe of a key: the
+ * entries looked up since the last pass get a second chance.
+ */
+static shm_hash_slot_t *find_victim(apr_shm_hash_t *ht, apr_uint32_t hash)
+{
+    apr_uint32_t window = SHM_HASH_EVICT_WINDOW, i;
+
+    if (window > ht->mask + 1) {
+        window = ht->mask + 1;
+    }
+    for (i = 0; i < 2 * window; i++) {
+        shm_hash_slot_t *s = SLOT(ht, (hash + i % window) & ht->mask);
+
+        if (!apr_atomic_read32(&s->ref)) {
+            return s;
+        }
+        apr_atomic_set32(&s->ref, 0);
+    }
+    return SLOT(ht, hash & ht->mask);
+}
+
+APR_DECLARE(apr_status_t) apr_shm_hash_set(apr_shm_hash_t *ht,
+                                           const void *key,
+                                           apr_size_t klen,
+                                           const void *val,
+                                           apr_size_t vlen)
+{
+    apr_uint32_t hash = shm_hash_key(key, klen);
+
+    if (klen > ht->hdr->key_size || vlen > ht->hdr->val_size) {
+        return APR_EINVAL;
+    }
+
+    stripe_lock(ht, hash);
+    for (;;) {
+        shm_hash_slot_t *s;
+        apr_uint32_t seq, dist = 0;
+        int found, evict = 0;
+
+        s = find_slot(ht, hash, key, klen, &found, &dist);
+        if (ht->hdr->flags & APR_SHM_HASH_EVICT) {
+            /* Keep the probes short rather than filling the table */
+            if (!s || (!found && dist >= SHM_HASH_EVICT_WINDOW)) {
+                s = find_victim(ht, hash);
+                evict = 1;
+            }
+        }
+        else if (!s) {
+            stripe_unlock(ht, hash);
+            return APR_ENOSPC;
+        }
+
+        /* The slot may have been taken or evicted by a writer of another
+         * key since we looked at it.
+         */
+        seq = slot_lock(s);
+        if (found) {
+            if (s->state != SLOT_USED || s->hash != hash || s->klen != klen
+                || memcmp(SLOT_KEY(s), key, klen) != 0) {
+                slot_unlock(s, seq);
+                continue;
+            }
+        }
+        else if (!evict) {
+            if (s->state == SLOT_USED) {
+                slot_unlock(s, seq);
+                continue;
+            }
+            apr_atomic_inc32(&ht->hdr->count);
+        }
+        else if (s->state != SLOT_USED) {
+            apr_atomic_inc32(&ht->hdr->count);
+        }
+
+        if (!found) {
+            s->state = SLOT_USED;
+            s->hash = hash;
+            s->klen = (apr_uint32_t)klen;
+            memcpy(SLOT_KEY(s), key, klen);
+        }
+        s->vlen = (apr_uint32_t)vlen;
+        memcpy(SLOT_VAL(ht, s), val, vlen);
+        /* New entries are the first evicted, until looked up */
+        apr_atomic_set32(&s->ref, found);
+        slot_unlock(s, seq);
+        break;
+    }
+    stripe_unlock(ht, hash);
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_shm_hash_remove(apr_shm_hash_t *ht,
+                                              const void *key,
+                                              apr_size_t klen)
+{
+    apr_uint32_t hash = shm_hash_key(key, klen);
+    apr_status_t rv = APR_NOTFOUND;
+
+    if (klen > ht->hdr->key_size) {
+        return APR_NOTFOUND;
+    }
+
+    stripe_lock(ht, hash);
+    for (;;) {
+        shm_hash_slot_t *s;
+        apr_uint32_t seq, dist;
+        int found;
+
+        s = find_slot(ht, hash, key, klen, &found, &dist);
+        if (!found) {
+            break;
+        }
+
+        seq = slot_lock(s);
+        if (s->state != SLOT_USED || s->hash != hash || s->klen != klen
+            || memcmp(SLOT_KEY(s), key, klen) != 0) {
+            /* Evicted meanwhile */
+            slot_unlock(s, seq);
+            continue;
+        }
+        s->state = SLOT_TOMB;
+        apr_atomic_dec32(&ht->hdr->count);
+        slot_unlock(s, seq);
+        rv = APR_SUCCESS;
+        break;
+    }
+    stripe_unlock(ht, hash);
+
+    return rv;
+}
+
+APR_DECLARE(apr_uint32_t) apr_shm_hash_count(apr_shm_hash_t *ht)
+{
+    return apr_atomic_read32(&ht->hdr->count);
+}
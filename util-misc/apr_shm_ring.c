@@ -0,0 +1,363 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr.h"
+#include "apr_general.h"
+#include "apr_atomic.h"
+#include "apr_time.h"
+#include "apr_shm_ring.h"
+
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+#if APR_HAS_FUTEX_SERIALIZE
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+/*
+ * The ring is a header followed by the messages, each one preceded by its
+ * length and padded to 8 bytes.  The positions are byte counters, wrapping
+ * around at 2^32, whose low bits give the offsets in the ring.  A message
+ * is never split at the end of the ring: the room left there is skipped,
+ * with a padding record when there is room for one.
+ *
+ * The producers reserve their room by moving 'reserve' forward with a
+ * CAS, copy their message, and then move 'commit' forward in the order
+ * of the reservations, waiting for the producers which reserved before
+ * them.  So the consumer pops messages up to 'commit', which are complete,
+ * and moves 'tail' forward to give their room back.
+ *
+ * 'waiting' is set by a consumer about to sleep, and cleared (and the
+ * consumer woken up) by the first producer committing next.  That is the
+ * only time the producers make a system call.
+ *
+ * Nothing here is a pointer, so the ring works at any address.
+ */
+
+#define SHM_RING_MAGIC 0x53485231 /* "SHR1" */
+
+/* Fields written by different sides live on different cache lines */
+#define SHM_RING_LINE  64
+
+/* Largest capacity, so that the positions can't wrap within a ring */
+#define SHM_RING_MAX_CAPACITY 0x40000000
+
+/* The length of a padding record */
+#define SHM_RING_PAD   APR_UINT32_MAX
+
+/* Busy loops before sleeping, while waiting for a producer to commit */
+#define SHM_RING_SPINS 100
+
+typedef struct shm_ring_hdr_t {
+    volatile apr_uint32_t magic;
+    apr_uint32_t capacity;
+    char pad0[SHM_RING_LINE - 2 * sizeof(apr_uint32_t)];
+    /* Written by the producers */
+    volatile apr_uint32_t reserve;
+    volatile apr_uint32_t commit;
+    char pad1[SHM_RING_LINE - 2 * sizeof(apr_uint32_t)];
+    /* Written by the consumer */
+    volatile apr_uint32_t tail;
+    volatile apr_uint32_t waiting;
+    char pad2[SHM_RING_LINE - 2 * sizeof(apr_uint32_t)];
+} shm_ring_hdr_t;
+
+#define SHM_RING_HDR_SIZE (APR_ALIGN_DEFAULT(sizeof(shm_ring_hdr_t)))
+
+/* Followed by the message */
+typedef struct shm_ring_rec_t {
+    apr_uint32_t len;
+    apr_uint32_t unused;
+} shm_ring_rec_t;
+
+#define SHM_RING_REC_SIZE (sizeof(shm_ring_rec_t))
+
+struct apr_shm_ring_t {
+    apr_pool_t *pool;
+    shm_ring_hdr_t *hdr;
+    char *data;
+    apr_uint32_t mask;
+    apr_file_t *notify;
+};
+
+#define REC(ring, pos) \
+    ((shm_ring_rec_t *)((ring)->data + ((pos) & (ring)->mask)))
+#define REC_SIZE(len) (SHM_RING_REC_SIZE + APR_ALIGN((len), 8))
+
+/* Orders the reads of the messages after the read of 'commit', as in
+ * apr_shm_hash.c.
+ */
+#if defined(__GNUC__) && ((__GNUC__ > 4) \
+                          || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+#define shm_ring_read_commit(hdr) \
+    __atomic_load_n(&(hdr)->commit, __ATOMIC_ACQUIRE)
+#else
+#define shm_ring_read_commit(hdr) \
+    apr_atomic_cas32(&(hdr)->commit, 0, 0)
+#endif
+
+static apr_uint32_t round_capacity(apr_size_t capacity)
+{
+    apr_uint32_t n = 64;
+
+    while (n < capacity && n < SHM_RING_MAX_CAPACITY) {
+        n <<= 1;
+    }
+    return n;
+}
+
+APR_DECLARE(apr_size_t) apr_shm_ring_size_get(apr_size_t capacity)
+{
+    return SHM_RING_HDR_SIZE + round_capacity(capacity);
+}
+
+APR_DECLARE(apr_status_t) apr_shm_ring_create(apr_shm_ring_t **ring,
+                                              void *membuf,
+                                              apr_size_t memsize,
+                                              apr_size_t capacity,
+                                              apr_pool_t *p)
+{
+    shm_ring_hdr_t *hdr = membuf;
+    apr_shm_ring_t *new_ring;
+
+    if (capacity > SHM_RING_MAX_CAPACITY
+        || memsize < apr_shm_ring_size_get(capacity)) {
+        return APR_EINVAL;
+    }
+
+    memset(hdr, 0, SHM_RING_HDR_SIZE);
+    hdr->capacity = round_capacity(capacity);
+
+    new_ring = apr_pcalloc(p, sizeof(*new_ring));
+    new_ring->pool = p;
+    new_ring->hdr = hdr;
+    new_ring->data = (char *)membuf + SHM_RING_HDR_SIZE;
+    new_ring->mask = hdr->capacity - 1;
+
+    /* Attachable once complete */
+    apr_atomic_set32(&hdr->magic, SHM_RING_MAGIC);
+
+    *ring = new_ring;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_shm_ring_attach(apr_shm_ring_t **ring,
+                                              void *membuf,
+                                              apr_pool_t *p)
+{
+    shm_ring_hdr_t *hdr = membuf;
+    apr_shm_ring_t *new_ring;
+
+    if (apr_atomic_read32(&hdr->magic) != SHM_RING_MAGIC) {
+        return APR_EINVAL;
+    }
+
+    new_ring = apr_pcalloc(p, sizeof(*new_ring));
+    new_ring->pool = p;
+    new_ring->hdr = hdr;
+    new_ring->data = (char *)membuf + SHM_RING_HDR_SIZE;
+    new_ring->mask = hdr->capacity - 1;
+
+    *ring = new_ring;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_size_t) apr_shm_ring_max_get(apr_shm_ring_t *ring)
+{
+    /* So that a message always fits once the ring is drained, even after
+     * the room skipped at the end of the ring.
+     */
+    return ring->hdr->capacity / 2 - SHM_RING_REC_SIZE;
+}
+
+APR_DECLARE(void) apr_shm_ring_notify_set(apr_shm_ring_t *ring,
+                                          apr_file_t *notify)
+{
+    ring->notify = notify;
+}
+
+static void shm_ring_wakeup(apr_shm_ring_t *ring)
+{
+    shm_ring_hdr_t *hdr = ring->hdr;
+
+    if (apr_atomic_cas32(&hdr->waiting, 0, 1) != 1) {
+        /* woken up by another producer meanwhile */
+        return;
+    }
+#if APR_HAS_FUTEX_SERIALIZE
+    syscall(SYS_futex, &hdr->waiting, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+    if (ring->notify) {
+        char c = 0;
+        apr_size_t n = 1;
+
+        /* A full pipe wakes the consumer up just as well */
+        apr_file_write(ring->notify, &c, &n);
+    }
+}
+
+APR_DECLARE(apr_status_t) apr_shm_ring_push(apr_shm_ring_t *ring,
+                                            const void *data,
+                                            apr_size_t len)
+{
+    shm_ring_hdr_t *hdr = ring->hdr;
+    apr_uint32_t capacity = hdr->capacity;
+    apr_uint32_t head, tail, need, skip, used;
+    shm_ring_rec_t *rec;
+    int spins = 0;
+
+    if (len > apr_shm_ring_max_get(ring)) {
+        return APR_EINVAL;
+    }
+    need = (apr_uint32_t)REC_SIZE(len);
+
+    /* Reserve the room, after skipping the end of the ring if too short */
+    do {
+        head = apr_atomic_read32(&hdr->reserve);
+        tail = apr_atomic_read32(&hdr->tail);
+        skip = capacity - (head & ring->mask);
+        if (skip >= need) {
+            skip = 0;
+        }
+        used = head - tail;
+        if (used + skip + need > capacity) {
+            return APR_EAGAIN;
+        }
+    } while (apr_atomic_cas32(&hdr->reserve, head + skip + need, head)
+             != head);
+
+    if (skip) {
+        /* The records and their sizes are multiples of 8 bytes, so there
+         * is always room for the padding record.
+         */
+        REC(ring, head)->len = SHM_RING_PAD;
+    }
+    rec = REC(ring, head + skip);
+    rec->len = (apr_uint32_t)len;
+    memcpy(rec + 1, data, len);
+
+    /* Commit in the order of the reservations */
+    while (apr_atomic_read32(&hdr->commit) != head) {
+        if (spins < SHM_RING_SPINS) {
+            spins++;
+        }
+        else {
+            apr_sleep(1);
+        }
+    }
+    apr_atomic_set32(&hdr->commit, head + skip + need);
+
+    if (apr_atomic_read32(&hdr->waiting)) {
+        shm_ring_wakeup(ring);
+    }
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_shm_ring_pop(apr_shm_ring_t *ring,
+                                           void *buf,
+                                           apr_size_t *len)
+{
+    shm_ring_hdr_t *hdr = ring->hdr;
+    apr_uint32_t tail = hdr->tail, commit;
+    shm_ring_rec_t *rec;
+
+    commit = shm_ring_read_commit(hdr);
+    if (tail == commit) {
+        return APR_EAGAIN;
+    }
+
+    rec = REC(ring, tail);
+    if (rec->len == SHM_RING_PAD) {
+        /* Skip the end of the ring, a message follows */
+        tail += hdr->capacity - (tail & ring->mask);
+        rec = REC(ring, tail);
+    }
+
+    if (rec->len > *len) {
+        *len = rec->len;
+        return APR_ENOSPC;
+    }
+    *len = rec->len;
+    memcpy(buf, rec + 1, rec->len);
+
+    /* Give the room back */
+    apr_atomic_set32(&hdr->tail, tail + (apr_uint32_t)REC_SIZE(rec->len));
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_shm_ring_wait(apr_shm_ring_t *ring,
+                                            apr_interval_time_t timeout)
+{
+    shm_ring_hdr_t *hdr = ring->hdr;
+    apr_time_t deadline = 0;
+
+    if (timeout > 0) {
+        deadline = apr_time_now() + timeout;
+    }
+
+    for (;;) {
+        apr_interval_time_t wait = -1;
+
+        if (hdr->tail != shm_ring_read_commit(hdr)) {
+            return APR_SUCCESS;
+        }
+
+        /* Ask the producers for a wakeup, then check again so that a
+         * message committed meanwhile isn't missed.
+         */
+        apr_atomic_set32(&hdr->waiting, 1);
+        if (hdr->tail != shm_ring_read_commit(hdr)) {
+            apr_atomic_cas32(&hdr->waiting, 0, 1);
+            return APR_SUCCESS;
+        }
+
+        if (timeout == 0) {
+            return APR_TIMEUP;
+        }
+        if (timeout > 0) {
+            wait = deadline - apr_time_now();
+            if (wait <= 0) {
+                return APR_TIMEUP;
+            }
+        }
+
+#if APR_HAS_FUTEX_SERIALIZE
+        {
+            struct timespec reltime, *reltimep = NULL;
+
+            if (wait >= 0) {
+                reltime.tv_sec = apr_time_sec(wait);
+                reltime.tv_nsec = apr_time_usec(wait) * 1000;
+                reltimep = &reltime;
+            }
+            syscall(SYS_futex, &hdr->waiting, FUTEX_WAIT, 1, reltimep,
+                    NULL, 0);
+        }
+#else
+        if (wait < 0 || wait > apr_time_from_msec(1)) {
+            wait = apr_time_from_msec(1);
+        }
+        apr_sleep(wait);
+#endif
+    }
+}
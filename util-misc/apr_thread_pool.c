@@ -17,16 +17,52 @@
  */
 
 #include <assert.h>
+#include "apr_private.h"
 #include "apr_thread_pool.h"
 #include "apr_ring.h"
+#include "apr_atomic.h"
 #include "apr_thread_cond.h"
 #include "apr_portable.h"
+#include "apr_file_io.h"
+#include "apr_strings.h"
+#include "apr_metrics.h"
+#include "apr_probes.h"
+#define APR_WANT_MEMFUNC
+#include "apr_want.h"
+
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>     /* for qsort */
+#endif
+
+#if APR_HAS_THREADS && defined(HAVE_PTHREAD_SETAFFINITY_NP) \
+    && defined(HAVE_PTHREAD_GETAFFINITY_NP)
+#include <pthread.h>
+#include <sched.h>
+#define THREAD_AFFINITY 1
+#else
+#define THREAD_AFFINITY 0
+#endif
 
 #if APR_HAS_THREADS
 
 #define TASK_PRIORITY_SEGS 4
 #define TASK_PRIORITY_SEG(x) (((x)->dispatch.priority & 0xFF) / 64)
 
+/* Work stealing needs to know whether (and which) worker thread a task is
+ * pushed from.
+ */
+#define WORK_STEALING APR_HAS_THREAD_LOCAL
+
+/* Maximum number of tasks a worker runs from its own deque (or steals)
+ * before looking at the shared queue again.
+ */
+#define WORK_STEALING_BATCH 64
+
+#define THREAD_POOL_AFFINITY (APR_THREAD_POOL_AFFINITY_COMPACT | \
+                              APR_THREAD_POOL_AFFINITY_SCATTER)
+#define THREAD_POOL_FLAGS (APR_THREAD_POOL_WORK_STEALING | \
+                           THREAD_POOL_AFFINITY)
+
 typedef struct apr_thread_pool_task
 {
     APR_RING_ENTRY(apr_thread_pool_task) link;
@@ -38,8 +74,25 @@ typedef struct apr_thread_pool_task
         apr_byte_t priority;
         apr_time_t time;
     } dispatch;
+    /* Order of the scheduled tasks of the same time */
+    apr_uint64_t seq;
+    /* The latch of the batch the task was pushed with, if any */
+    apr_thread_pool_latch_t *latch;
+    /* The worker running the task */
+    struct apr_thread_list_elt *elt;
+    /* When the task was pushed, or is due for a scheduled one */
+    apr_time_t queued;
+    /* The priority it was pushed with */
+    apr_byte_t priority;
 } apr_thread_pool_task_t;
 
+struct apr_thread_pool_latch
+{
+    apr_thread_mutex_t *lock;
+    apr_thread_cond_t *done;
+    apr_size_t count;
+};
+
 APR_RING_HEAD(apr_thread_pool_tasks, apr_thread_pool_task);
 
 struct apr_thread_list_elt
@@ -49,10 +102,43 @@ struct apr_thread_list_elt
     void *current_owner;
     enum { TH_RUN, TH_STOP, TH_PROBATION } state;
     int signal_work_done;
+    /* Created by apr_thread_pool_task_pool_get(), cleared after each task */
+    apr_pool_t *scratch;
+#if WORK_STEALING
+    /* With APR_THREAD_POOL_WORK_STEALING, the tasks pushed by this thread
+     * (by priority segment) and its recycled tasks. These are protected by
+     * deque_lock, as are current_owner and signal_work_done (in addition
+     * to the pool's lock for the tasks taken from the shared queue).
+     */
+    apr_thread_pool_t *me;
+    APR_RING_ENTRY(apr_thread_list_elt) ws_link;
+    apr_thread_mutex_t *deque_lock;
+    struct apr_thread_pool_tasks deque[TASK_PRIORITY_SEGS];
+    struct apr_thread_pool_tasks deque_recycled;
+    volatile apr_size_t deque_cnt;
+#endif
 };
 
 APR_RING_HEAD(apr_thread_list, apr_thread_list_elt);
 
+/* The latencies of a priority segment, updated with atomics by the
+ * workers, see apr_thread_pool_latency_t.
+ */
+typedef struct thread_pool_latency_t {
+    volatile apr_uint64_t count;
+    volatile apr_uint64_t total;
+    volatile apr_uint64_t max;
+    volatile apr_uint64_t buckets[APR_THREAD_POOL_LATENCY_BUCKETS];
+} thread_pool_latency_t;
+
+/* Tasks run by all the thread pools, registered by the first one */
+static apr_metric_t *tasks_metric = NULL;
+
+#if WORK_STEALING
+/* The worker the calling thread is, if any */
+static APR_THREAD_LOCAL struct apr_thread_list_elt *current_elt;
+#endif
+
 struct apr_thread_pool
 {
     apr_pool_t *pool;
@@ -69,8 +155,14 @@ struct apr_thread_pool
     volatile apr_size_t tasks_high;
     volatile apr_size_t thd_high;
     volatile apr_size_t thd_timed_out;
+    /* Enqueue-to-start and start-to-finish latencies per priority */
+    thread_pool_latency_t wait_latency[TASK_PRIORITY_SEGS];
+    thread_pool_latency_t run_latency[TASK_PRIORITY_SEGS];
     struct apr_thread_pool_tasks *tasks;
-    struct apr_thread_pool_tasks *scheduled_tasks;
+    /* Binary min-heap of the scheduled tasks, by dispatch time */
+    apr_thread_pool_task_t **scheduled_tasks;
+    apr_size_t scheduled_task_max;
+    apr_uint64_t scheduled_seq;
     struct apr_thread_list *busy_thds;
     struct apr_thread_list *idle_thds;
     struct apr_thread_list *dead_thds;
@@ -82,17 +174,240 @@ struct apr_thread_pool
     struct apr_thread_pool_tasks *recycled_tasks;
     struct apr_thread_list *recycled_thds;
     apr_thread_pool_task_t *task_idx[TASK_PRIORITY_SEGS];
+    apr_uint32_t flags;
+    apr_threadattr_t *attr;
+    /* The CPUs to run the workers on, and the next one (by policy) */
+    int *cpus;
+    apr_size_t ncpus;
+    apr_size_t cpu_next;
+#if WORK_STEALING
+    /* The workers with a deque, protected by steal_lock which is taken
+     * after the pool's lock and before the deques' locks.
+     */
+    struct apr_thread_list *ws_thds;
+    apr_thread_mutex_t *steal_lock;
+#endif
 };
 
+static void latency_record(thread_pool_latency_t *lat,
+                           apr_interval_time_t usecs)
+{
+    apr_uint64_t value = usecs > 0 ? (apr_uint64_t)usecs : 0, max;
+    int bucket = 0;
+
+    while (value >> bucket && bucket < APR_THREAD_POOL_LATENCY_BUCKETS - 1) {
+        bucket++;
+    }
+    apr_atomic_inc64(&lat->buckets[bucket]);
+    apr_atomic_add64(&lat->total, value);
+    apr_atomic_inc64(&lat->count);
+    while ((max = apr_atomic_read64(&lat->max)) < value) {
+        if (apr_atomic_cas64(&lat->max, value, max) == max) {
+            break;
+        }
+    }
+}
+
+/*
+ * Count tasks in, or out once run (or cancelled).
+ */
+static void latch_add(apr_thread_pool_latch_t *latch, apr_size_t n)
+{
+    apr_thread_mutex_lock(latch->lock);
+    latch->count += n;
+    apr_thread_mutex_unlock(latch->lock);
+}
+
+static void latch_done(apr_thread_pool_latch_t *latch)
+{
+    apr_thread_mutex_lock(latch->lock);
+    if (--latch->count == 0) {
+        apr_thread_cond_broadcast(latch->done);
+    }
+    apr_thread_mutex_unlock(latch->lock);
+}
+
+#if THREAD_AFFINITY
+/*
+ * CPU topology, to order the CPUs by affinity policy.
+ */
+typedef struct
+{
+    int cpu;
+    int package;
+    int core;
+    int sibling;
+} cpu_topology_t;
+
+static int cpu_topology_read(int cpu, const char *name, apr_pool_t *pool)
+{
+    apr_file_t *f;
+    char path[128], buf[32];
+    int id = -1;
+
+    apr_snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    if (apr_file_open(&f, path, APR_FOPEN_READ, APR_FPROT_OS_DEFAULT,
+                      pool) == APR_SUCCESS) {
+        if (apr_file_gets(buf, sizeof(buf), f) == APR_SUCCESS) {
+            id = atoi(buf);
+        }
+        apr_file_close(f);
+    }
+    return id;
+}
+
+/* All the siblings of a core, then the cores of a package */
+static int cpu_compact_cmp(const void *a, const void *b)
+{
+    const cpu_topology_t *x = a, *y = b;
+
+    if (x->package != y->package)
+        return x->package < y->package ? -1 : 1;
+    if (x->core != y->core)
+        return x->core < y->core ? -1 : 1;
+    return x->cpu < y->cpu ? -1 : x->cpu > y->cpu;
+}
+
+/* One core of each package in turn, before any sibling */
+static int cpu_scatter_cmp(const void *a, const void *b)
+{
+    const cpu_topology_t *x = a, *y = b;
+
+    if (x->sibling != y->sibling)
+        return x->sibling < y->sibling ? -1 : 1;
+    if (x->core != y->core)
+        return x->core < y->core ? -1 : 1;
+    if (x->package != y->package)
+        return x->package < y->package ? -1 : 1;
+    return x->cpu < y->cpu ? -1 : x->cpu > y->cpu;
+}
+
+/*
+ * Order me->cpus by policy, using the topology when the system tells it
+ * (or the CPUs' numbers otherwise).
+ */
+static void thread_pool_cpus_sort(apr_thread_pool_t *me)
+{
+    cpu_topology_t *topo;
+    apr_pool_t *tmp;
+    apr_size_t i, j;
+
+    if (apr_pool_create(&tmp, me->pool) != APR_SUCCESS) {
+        return;
+    }
+    topo = apr_palloc(tmp, me->ncpus * sizeof(*topo));
+    for (i = 0; i < me->ncpus; i++) {
+        topo[i].cpu = me->cpus[i];
+        topo[i].package = cpu_topology_read(me->cpus[i],
+                                            "physical_package_id", tmp);
+        topo[i].core = cpu_topology_read(me->cpus[i], "core_id", tmp);
+        if (topo[i].core < 0) {
+            topo[i].core = me->cpus[i];
+        }
+    }
+    qsort(topo, me->ncpus, sizeof(*topo), cpu_compact_cmp);
+    for (i = 0; i < me->ncpus; i++) {
+        topo[i].sibling = 0;
+        for (j = i; j > 0 && topo[j - 1].package == topo[i].package
+                    && topo[j - 1].core == topo[i].core; j--) {
+            topo[i].sibling++;
+        }
+    }
+    if (me->flags & APR_THREAD_POOL_AFFINITY_SCATTER) {
+        qsort(topo, me->ncpus, sizeof(*topo), cpu_scatter_cmp);
+    }
+    for (i = 0; i < me->ncpus; i++) {
+        me->cpus[i] = topo[i].cpu;
+    }
+
+    apr_pool_destroy(tmp);
+}
+
+/*
+ * Set the CPUs of the workers, those given or those the calling thread
+ * can run on.
+ */
+static apr_status_t thread_pool_cpus(apr_thread_pool_t *me,
+                                     const int *cpus, apr_size_t ncpus)
+{
+    cpu_set_t set;
+    apr_size_t i;
+    int cpu, rv;
+
+    if (!cpus) {
+        if (!(me->flags & THREAD_POOL_AFFINITY)) {
+            return APR_SUCCESS;
+        }
+        rv = pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+        if (rv) {
+            return rv;
+        }
+        me->cpus = apr_palloc(me->pool, CPU_COUNT(&set) * sizeof(int));
+        for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                me->cpus[me->ncpus++] = cpu;
+            }
+        }
+    }
+    else {
+        me->cpus = apr_palloc(me->pool, ncpus * sizeof(int));
+        for (i = 0; i < ncpus; i++) {
+            if (cpus[i] < 0 || cpus[i] >= CPU_SETSIZE) {
+                return APR_EINVAL;
+            }
+            me->cpus[i] = cpus[i];
+        }
+        me->ncpus = ncpus;
+    }
+    if (me->ncpus && (me->flags & THREAD_POOL_AFFINITY)) {
+        thread_pool_cpus_sort(me);
+    }
+
+    return APR_SUCCESS;
+}
+
+/*
+ * Pin the calling worker to its CPU, or to the CPU set.
+ * NOTE: This function is not thread safe by itself. Caller should hold the lock
+ */
+static void thread_affinity_set(apr_thread_pool_t *me)
+{
+    cpu_set_t set;
+    apr_size_t i;
+
+    CPU_ZERO(&set);
+    if (me->flags & THREAD_POOL_AFFINITY) {
+        CPU_SET(me->cpus[me->cpu_next++ % me->ncpus], &set);
+    }
+    else {
+        for (i = 0; i < me->ncpus; i++) {
+            CPU_SET(me->cpus[i], &set);
+        }
+    }
+
+    /* Best effort, the CPUs may have gone offline since */
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+#endif /* THREAD_AFFINITY */
+
 static apr_status_t thread_pool_construct(apr_thread_pool_t **tp,
                                           apr_size_t init_threads,
                                           apr_size_t max_threads,
+                                          apr_uint32_t flags,
                                           apr_pool_t *pool)
 {
     apr_status_t rv;
     apr_thread_pool_t *me;
 
+    if (!tasks_metric) {
+        apr_metric_register(&tasks_metric, "apr_thread_pool_tasks_total",
+                            "Tasks run by the thread pools",
+                            APR_METRIC_COUNTER);
+    }
+
     me = *tp = apr_pcalloc(pool, sizeof(apr_thread_pool_t));
+    me->flags = flags;
     me->thd_max = max_threads;
     me->idle_max = init_threads;
     me->threshold = init_threads / 2;
@@ -135,11 +450,6 @@ static apr_status_t thread_pool_construct(apr_thread_pool_t **tp,
         goto CATCH_ENOMEM;
     }
     APR_RING_INIT(me->tasks, apr_thread_pool_task, link);
-    me->scheduled_tasks = apr_palloc(me->pool, sizeof(*me->scheduled_tasks));
-    if (!me->scheduled_tasks) {
-        goto CATCH_ENOMEM;
-    }
-    APR_RING_INIT(me->scheduled_tasks, apr_thread_pool_task, link);
     me->recycled_tasks = apr_palloc(me->pool, sizeof(*me->recycled_tasks));
     if (!me->recycled_tasks) {
         goto CATCH_ENOMEM;
@@ -165,6 +475,24 @@ static apr_status_t thread_pool_construct(apr_thread_pool_t **tp,
         goto CATCH_ENOMEM;
     }
     APR_RING_INIT(me->recycled_thds, apr_thread_list_elt, link);
+#if WORK_STEALING
+    if (flags & APR_THREAD_POOL_WORK_STEALING) {
+        me->ws_thds = apr_palloc(me->pool, sizeof(*me->ws_thds));
+        if (!me->ws_thds) {
+            goto CATCH_ENOMEM;
+        }
+        APR_RING_INIT(me->ws_thds, apr_thread_list_elt, ws_link);
+        rv = apr_thread_mutex_create(&me->steal_lock,
+                                     APR_THREAD_MUTEX_DEFAULT, me->pool);
+        if (APR_SUCCESS != rv) {
+            apr_thread_cond_destroy(me->all_done);
+            apr_thread_cond_destroy(me->work_done);
+            apr_thread_cond_destroy(me->more_work);
+            apr_thread_mutex_destroy(me->lock);
+            return rv;
+        }
+    }
+#endif
     goto FINAL_EXIT;
   CATCH_ENOMEM:
     rv = APR_ENOMEM;
@@ -176,6 +504,89 @@ static apr_status_t thread_pool_construct(apr_thread_pool_t **tp,
     return rv;
 }
 
+/*
+ * Scheduled tasks heap, whose root is the next task to run.
+ */
+
+#define SCHEDULED_BEFORE(a, b) ((a)->dispatch.time < (b)->dispatch.time \
+                                || ((a)->dispatch.time == (b)->dispatch.time \
+                                    && (a)->seq < (b)->seq))
+
+static void scheduled_sift_up(apr_thread_pool_t *me, apr_size_t i)
+{
+    apr_thread_pool_task_t **heap = me->scheduled_tasks, *t = heap[i];
+
+    while (i > 0 && SCHEDULED_BEFORE(t, heap[(i - 1) / 2])) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = t;
+}
+
+static void scheduled_sift_down(apr_thread_pool_t *me, apr_size_t i)
+{
+    apr_thread_pool_task_t **heap = me->scheduled_tasks, *t = heap[i];
+    apr_size_t n = me->scheduled_task_cnt, child;
+
+    while ((child = 2 * i + 1) < n) {
+        if (child + 1 < n && SCHEDULED_BEFORE(heap[child + 1], heap[child])) {
+            child++;
+        }
+        if (!SCHEDULED_BEFORE(heap[child], t)) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = t;
+}
+
+/*
+ * NOTE: This function is not thread safe by itself. Caller should hold the lock
+ */
+static apr_status_t scheduled_push(apr_thread_pool_t *me,
+                                   apr_thread_pool_task_t *t)
+{
+    if (me->scheduled_task_cnt == me->scheduled_task_max) {
+        apr_size_t max = me->scheduled_task_max ? me->scheduled_task_max * 2
+                                                : 64;
+        apr_thread_pool_task_t **heap;
+
+        /* The previous heap is left to the pool, these add up to less
+         * than the final one.
+         */
+        heap = apr_palloc(me->pool, max * sizeof(*heap));
+        if (NULL == heap) {
+            return APR_ENOMEM;
+        }
+        if (me->scheduled_task_cnt) {
+            memcpy(heap, me->scheduled_tasks,
+                   me->scheduled_task_cnt * sizeof(*heap));
+        }
+        me->scheduled_tasks = heap;
+        me->scheduled_task_max = max;
+    }
+
+    t->seq = me->scheduled_seq++;
+    me->scheduled_tasks[me->scheduled_task_cnt] = t;
+    scheduled_sift_up(me, me->scheduled_task_cnt++);
+    return APR_SUCCESS;
+}
+
+/*
+ * NOTE: This function is not thread safe by itself. Caller should hold the lock
+ */
+static apr_thread_pool_task_t *scheduled_pop(apr_thread_pool_t *me)
+{
+    apr_thread_pool_task_t *task = me->scheduled_tasks[0];
+
+    if (--me->scheduled_task_cnt > 0) {
+        me->scheduled_tasks[0] = me->scheduled_tasks[me->scheduled_task_cnt];
+        scheduled_sift_down(me, 0);
+    }
+    return task;
+}
+
 /*
  * NOTE: This function is not thread safe by itself. Caller should hold the lock
  */
@@ -186,16 +597,11 @@ static apr_thread_pool_task_t *pop_task(apr_thread_pool_t * me)
 
     /* check for scheduled tasks */
     if (me->scheduled_task_cnt > 0) {
-        task = APR_RING_FIRST(me->scheduled_tasks);
+        task = me->scheduled_tasks[0];
         assert(task != NULL);
-        assert(task !=
-               APR_RING_SENTINEL(me->scheduled_tasks, apr_thread_pool_task,
-                                 link));
         /* if it's time */
-        if (task->dispatch.time <= apr_time_now()) {
-            --me->scheduled_task_cnt;
-            APR_RING_REMOVE(task, link);
-            return task;
+        if (task->dispatch.time <= apr_time_monotonic()) {
+            return scheduled_pop(me);
         }
     }
     /* check for normal tasks if we're not returning a scheduled task */
@@ -224,12 +630,9 @@ static apr_interval_time_t waiting_time(apr_thread_pool_t * me)
 {
     apr_thread_pool_task_t *task = NULL;
 
-    task = APR_RING_FIRST(me->scheduled_tasks);
+    task = me->scheduled_tasks[0];
     assert(task != NULL);
-    assert(task !=
-           APR_RING_SENTINEL(me->scheduled_tasks, apr_thread_pool_task,
-                             link));
-    return task->dispatch.time - apr_time_now();
+    return task->dispatch.time - apr_time_monotonic();
 }
 
 /*
@@ -245,6 +648,24 @@ static struct apr_thread_list_elt *elt_new(apr_thread_pool_t * me,
         if (NULL == elt) {
             return NULL;
         }
+#if WORK_STEALING
+        elt->me = me;
+        elt->deque_lock = NULL;
+        if (me->flags & APR_THREAD_POOL_WORK_STEALING) {
+            int seg;
+
+            if (apr_thread_mutex_create(&elt->deque_lock,
+                                        APR_THREAD_MUTEX_DEFAULT,
+                                        me->pool) != APR_SUCCESS) {
+                return NULL;
+            }
+            for (seg = 0; seg < TASK_PRIORITY_SEGS; seg++) {
+                APR_RING_INIT(&elt->deque[seg], apr_thread_pool_task, link);
+            }
+            APR_RING_INIT(&elt->deque_recycled, apr_thread_pool_task, link);
+            elt->deque_cnt = 0;
+        }
+#endif
     }
     else {
         elt = APR_RING_FIRST(me->recycled_thds);
@@ -255,10 +676,261 @@ static struct apr_thread_list_elt *elt_new(apr_thread_pool_t * me,
     elt->thd = t;
     elt->current_owner = NULL;
     elt->signal_work_done = 0;
+    elt->scratch = NULL;
     elt->state = TH_RUN;
     return elt;
 }
 
+static void insert_task(apr_thread_pool_t *me, apr_thread_pool_task_t *t,
+                        int push);
+
+#if WORK_STEALING
+/*
+ * Work stealing (APR_THREAD_POOL_WORK_STEALING): the tasks pushed by a worker
+ * go to its own deque, which it runs without taking the pool's lock, and
+ * the workers without tasks steal from the others' deques before going
+ * idle.
+ */
+
+/*
+ * NOTE: This function is not thread safe by itself. Caller should hold the
+ * deque_lock
+ */
+static void deque_add(struct apr_thread_list_elt *elt,
+                      apr_thread_pool_task_t *t, int push)
+{
+    struct apr_thread_pool_tasks *ring = &elt->deque[TASK_PRIORITY_SEG(t)];
+    apr_thread_pool_task_t *t_loc;
+
+    /* Most tasks have the same priority as their neighbours, so check
+     * the ends first.
+     */
+    if (push) {
+        t_loc = APR_RING_SENTINEL(ring, apr_thread_pool_task, link);
+        if (!APR_RING_EMPTY(ring, apr_thread_pool_task, link)
+            && APR_RING_LAST(ring)->dispatch.priority < t->dispatch.priority) {
+            t_loc = APR_RING_FIRST(ring);
+            while (t_loc->dispatch.priority >= t->dispatch.priority) {
+                t_loc = APR_RING_NEXT(t_loc, link);
+            }
+        }
+    }
+    else {
+        t_loc = APR_RING_FIRST(ring);
+        while (t_loc != APR_RING_SENTINEL(ring, apr_thread_pool_task, link)
+               && t_loc->dispatch.priority > t->dispatch.priority) {
+            t_loc = APR_RING_NEXT(t_loc, link);
+        }
+    }
+    APR_RING_INSERT_BEFORE(t_loc, t, link);
+    ++elt->deque_cnt;
+}
+
+/*
+ * NOTE: This function is not thread safe by itself. Caller should hold the
+ * deque_lock
+ */
+static apr_thread_pool_task_t *deque_pop(struct apr_thread_list_elt *elt)
+{
+    apr_thread_pool_task_t *task;
+    int seg;
+
+    for (seg = TASK_PRIORITY_SEGS - 1; seg >= 0; seg--) {
+        if (!APR_RING_EMPTY(&elt->deque[seg], apr_thread_pool_task, link)) {
+            task = APR_RING_FIRST(&elt->deque[seg]);
+            APR_RING_REMOVE(task, link);
+            --elt->deque_cnt;
+            return task;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Steal the highest priority task of another worker. The steal_lock is held
+ * until the task is accounted to the thief, so that
+ * apr_thread_pool_tasks_cancel() can't miss it.
+ */
+static apr_thread_pool_task_t *ws_steal(apr_thread_pool_t *me,
+                                        struct apr_thread_list_elt *elt)
+{
+    struct apr_thread_list_elt *victim;
+    apr_thread_pool_task_t *task = NULL;
+
+    apr_thread_mutex_lock(me->steal_lock);
+    for (victim = APR_RING_NEXT(elt, ws_link); victim != elt;
+         victim = APR_RING_NEXT(victim, ws_link)) {
+        if (victim == APR_RING_SENTINEL(me->ws_thds, apr_thread_list_elt,
+                                        ws_link) || !victim->deque_cnt) {
+            continue;
+        }
+        apr_thread_mutex_lock(victim->deque_lock);
+        task = deque_pop(victim);
+        apr_thread_mutex_unlock(victim->deque_lock);
+        if (task) {
+            apr_thread_mutex_lock(elt->deque_lock);
+            elt->current_owner = task->owner;
+            apr_thread_mutex_unlock(elt->deque_lock);
+            break;
+        }
+    }
+    apr_thread_mutex_unlock(me->steal_lock);
+
+    return task;
+}
+
+/*
+ * Run the tasks of the worker's deque, or stolen from the others, up to
+ * WORK_STEALING_BATCH. Returns the number of tasks run.
+ * NOTE: Called without the pool's lock
+ */
+static apr_size_t ws_run_tasks(apr_thread_pool_t *me,
+                               struct apr_thread_list_elt *elt,
+                               apr_thread_t *t)
+{
+    apr_thread_pool_task_t *task;
+    apr_time_t start;
+    apr_size_t n;
+    int signal_work_done;
+
+    for (n = 0; n < WORK_STEALING_BATCH && elt->state != TH_STOP; n++) {
+        apr_thread_mutex_lock(elt->deque_lock);
+        task = deque_pop(elt);
+        if (task) {
+            elt->current_owner = task->owner;
+        }
+        apr_thread_mutex_unlock(elt->deque_lock);
+        if (!task && !(task = ws_steal(me, elt))) {
+            break;
+        }
+
+        /* Run the task (or drop it if terminated already) */
+        if (!me->terminated) {
+            task->elt = elt;
+            apr_thread_data_set(task, "apr_thread_pool_task", NULL, t);
+            start = apr_time_monotonic();
+            latency_record(&me->wait_latency[task->priority / 64],
+                           start - task->queued);
+            APR_PROBE3(thread_pool__start, me, task, start - task->queued);
+            task->func(t, task->param);
+            latency_record(&me->run_latency[task->priority / 64],
+                           apr_time_monotonic() - start);
+            APR_PROBE2(thread_pool__finish, me, task);
+            if (elt->scratch) {
+                apr_pool_clear(elt->scratch);
+            }
+        }
+        if (task->latch) {
+            latch_done(task->latch);
+        }
+
+        apr_thread_mutex_lock(elt->deque_lock);
+        APR_RING_INSERT_TAIL(&elt->deque_recycled, task,
+                             apr_thread_pool_task, link);
+        elt->current_owner = NULL;
+        signal_work_done = elt->signal_work_done;
+        elt->signal_work_done = 0;
+        apr_thread_mutex_unlock(elt->deque_lock);
+
+        if (signal_work_done) {
+            apr_thread_mutex_lock(me->lock);
+            apr_pool_owner_set(me->pool, 0);
+            apr_thread_cond_signal(me->work_done);
+            apr_thread_mutex_unlock(me->lock);
+        }
+    }
+
+    return n;
+}
+
+/*
+ * Whether some worker has tasks in its deque.
+ * NOTE: This function is not thread safe by itself. Caller should hold the lock
+ */
+static int ws_pending(apr_thread_pool_t *me)
+{
+    struct apr_thread_list_elt *elt;
+    int pending = 0;
+
+    apr_thread_mutex_lock(me->steal_lock);
+    for (elt = APR_RING_FIRST(me->ws_thds);
+         !pending && elt != APR_RING_SENTINEL(me->ws_thds,
+                                              apr_thread_list_elt, ws_link);
+         elt = APR_RING_NEXT(elt, ws_link)) {
+        apr_thread_mutex_lock(elt->deque_lock);
+        pending = elt->deque_cnt != 0;
+        apr_thread_mutex_unlock(elt->deque_lock);
+    }
+    apr_thread_mutex_unlock(me->steal_lock);
+
+    return pending;
+}
+
+/*
+ * The worker is exiting, hand its tasks over to the shared queue.
+ * NOTE: This function is not thread safe by itself. Caller should hold the lock
+ */
+static void ws_detach(apr_thread_pool_t *me, struct apr_thread_list_elt *elt)
+{
+    apr_thread_pool_task_t *task;
+    int moved = 0;
+
+    apr_thread_mutex_lock(me->steal_lock);
+    APR_RING_REMOVE(elt, ws_link);
+    apr_thread_mutex_lock(elt->deque_lock);
+    while ((task = deque_pop(elt)) != NULL) {
+        insert_task(me, task, 1);
+        moved = 1;
+    }
+    APR_RING_CONCAT(me->recycled_tasks, &elt->deque_recycled,
+                    apr_thread_pool_task, link);
+    apr_thread_mutex_unlock(elt->deque_lock);
+    apr_thread_mutex_unlock(me->steal_lock);
+
+    current_elt = NULL;
+    if (moved) {
+        apr_thread_cond_signal(me->more_work);
+    }
+}
+
+/*
+ * Remove the tasks of the owner (or all) from the deques.
+ * NOTE: This function is not thread safe by itself. Caller should hold the lock
+ */
+static void ws_remove_tasks(apr_thread_pool_t *me, void *owner)
+{
+    struct apr_thread_list_elt *elt;
+    apr_thread_pool_task_t *t_loc, *next;
+    int seg;
+
+    apr_thread_mutex_lock(me->steal_lock);
+    for (elt = APR_RING_FIRST(me->ws_thds);
+         elt != APR_RING_SENTINEL(me->ws_thds, apr_thread_list_elt, ws_link);
+         elt = APR_RING_NEXT(elt, ws_link)) {
+        apr_thread_mutex_lock(elt->deque_lock);
+        for (seg = 0; seg < TASK_PRIORITY_SEGS; seg++) {
+            t_loc = APR_RING_FIRST(&elt->deque[seg]);
+            while (t_loc != APR_RING_SENTINEL(&elt->deque[seg],
+                                              apr_thread_pool_task, link)) {
+                next = APR_RING_NEXT(t_loc, link);
+                if (!owner || t_loc->owner == owner) {
+                    --elt->deque_cnt;
+                    APR_RING_REMOVE(t_loc, link);
+                    if (t_loc->latch) {
+                        latch_done(t_loc->latch);
+                    }
+                    APR_RING_INSERT_TAIL(&elt->deque_recycled, t_loc,
+                                         apr_thread_pool_task, link);
+                }
+                t_loc = next;
+            }
+        }
+        apr_thread_mutex_unlock(elt->deque_lock);
+    }
+    apr_thread_mutex_unlock(me->steal_lock);
+}
+#endif /* WORK_STEALING */
+
 /*
  * The worker thread function. Take a task from the queue and perform it if
  * there is any. Otherwise, put itself into the idle thread list and waiting
@@ -272,7 +944,11 @@ static void *APR_THREAD_FUNC thread_pool_func(apr_thread_t * t, void *param)
     apr_thread_pool_t *me = param;
     apr_thread_pool_task_t *task = NULL;
     apr_interval_time_t wait;
+    apr_time_t start;
     struct apr_thread_list_elt *elt;
+#if WORK_STEALING
+    apr_size_t ws_run = 0;
+#endif
 
     apr_thread_mutex_lock(me->lock);
     apr_pool_owner_set(me->pool, 0);
@@ -282,6 +958,19 @@ static void *APR_THREAD_FUNC thread_pool_func(apr_thread_t * t, void *param)
         apr_thread_mutex_unlock(me->lock);
         apr_thread_exit(t, APR_ENOMEM);
     }
+#if WORK_STEALING
+    if (elt->deque_lock) {
+        apr_thread_mutex_lock(me->steal_lock);
+        APR_RING_INSERT_TAIL(me->ws_thds, elt, apr_thread_list_elt, ws_link);
+        apr_thread_mutex_unlock(me->steal_lock);
+        current_elt = elt;
+    }
+#endif
+#if THREAD_AFFINITY
+    if (me->ncpus) {
+        thread_affinity_set(me);
+    }
+#endif
 
     for (;;) {
         /* Test if not new element, it is awakened from idle */
@@ -295,18 +984,57 @@ static void *APR_THREAD_FUNC thread_pool_func(apr_thread_t * t, void *param)
             APR_RING_INSERT_TAIL(me->busy_thds, elt,
                                  apr_thread_list_elt, link);
             do {
+#if WORK_STEALING
+                if (elt->deque_lock) {
+                    apr_thread_mutex_unlock(me->lock);
+                    ws_run = ws_run_tasks(me, elt, t);
+                    apr_thread_mutex_lock(me->lock);
+                    apr_pool_owner_set(me->pool, 0);
+                    me->tasks_run += ws_run;
+                    if (ws_run && tasks_metric) {
+                        apr_metric_add(tasks_metric, ws_run);
+                    }
+                    if (elt->state == TH_STOP) {
+                        break;
+                    }
+                }
+#endif
                 task = pop_task(me);
                 if (!task) {
+#if WORK_STEALING
+                    /* Look at the deques again */
+                    if (ws_run) {
+                        continue;
+                    }
+#endif
                     break;
                 }
                 ++me->tasks_run;
+                if (tasks_metric) {
+                    apr_metric_add(tasks_metric, 1);
+                }
                 elt->current_owner = task->owner;
                 apr_thread_mutex_unlock(me->lock);
 
                 /* Run the task (or drop it if terminated already) */
                 if (!me->terminated) {
+                    task->elt = elt;
                     apr_thread_data_set(task, "apr_thread_pool_task", NULL, t);
+                    start = apr_time_monotonic();
+                    latency_record(&me->wait_latency[task->priority / 64],
+                                   start - task->queued);
+                    APR_PROBE3(thread_pool__start, me, task,
+                               start - task->queued);
                     task->func(t, task->param);
+                    latency_record(&me->run_latency[task->priority / 64],
+                                   apr_time_monotonic() - start);
+                    APR_PROBE2(thread_pool__finish, me, task);
+                    if (elt->scratch) {
+                        apr_pool_clear(elt->scratch);
+                    }
+                }
+                if (task->latch) {
+                    latch_done(task->latch);
                 }
 
                 apr_thread_mutex_lock(me->lock);
@@ -339,6 +1067,15 @@ static void *APR_THREAD_FUNC thread_pool_func(apr_thread_t * t, void *param)
         ++me->idle_cnt;
         APR_RING_INSERT_TAIL(me->idle_thds, elt, apr_thread_list_elt, link);
 
+#if WORK_STEALING
+        /* A worker pushing to its deque signals more_work only if it
+         * sees an idle thread, so check the deques once idle.
+         */
+        if (elt->deque_lock && ws_pending(me)) {
+            continue;
+        }
+#endif
+
         /*
          * If there is a scheduled task, always scheduled to perform that task.
          * Since there is no guarantee that current idle threads are scheduled
@@ -362,6 +1099,12 @@ static void *APR_THREAD_FUNC thread_pool_func(apr_thread_t * t, void *param)
         apr_pool_owner_set(me->pool, 0);
     }
 
+#if WORK_STEALING
+    if (elt->deque_lock) {
+        ws_detach(me, elt);
+    }
+#endif
+
     /* Dead thread, to be joined */
     APR_RING_INSERT_TAIL(me->dead_thds, elt, apr_thread_list_elt, link);
     if (--me->thd_cnt == 0 && me->terminated) {
@@ -420,6 +1163,19 @@ APR_DECLARE(apr_status_t) apr_thread_pool_create(apr_thread_pool_t ** me,
                                                  apr_size_t init_threads,
                                                  apr_size_t max_threads,
                                                  apr_pool_t * pool)
+{
+    return apr_thread_pool_create_ex(me, init_threads, max_threads, 0, NULL,
+                                     NULL, 0, pool);
+}
+
+APR_DECLARE(apr_status_t) apr_thread_pool_create_ex(apr_thread_pool_t ** me,
+                                                    apr_size_t init_threads,
+                                                    apr_size_t max_threads,
+                                                    apr_uint32_t flags,
+                                                    apr_threadattr_t *attr,
+                                                    const int *cpus,
+                                                    apr_size_t ncpus,
+                                                    apr_pool_t * pool)
 {
     apr_thread_t *t;
     apr_status_t rv = APR_SUCCESS;
@@ -427,9 +1183,37 @@ APR_DECLARE(apr_status_t) apr_thread_pool_create(apr_thread_pool_t ** me,
 
     *me = NULL;
 
-    rv = thread_pool_construct(&tp, init_threads, max_threads, pool);
+    if ((flags & ~THREAD_POOL_FLAGS)
+        || (flags & THREAD_POOL_AFFINITY) == THREAD_POOL_AFFINITY
+        || (cpus && !ncpus)) {
+        return APR_EINVAL;
+    }
+    /* The threads are joined */
+    if (attr && apr_threadattr_detach_get(attr) == APR_DETACH) {
+        return APR_EINVAL;
+    }
+#if !WORK_STEALING
+    if (flags & APR_THREAD_POOL_WORK_STEALING) {
+        return APR_ENOTIMPL;
+    }
+#endif
+#if !THREAD_AFFINITY
+    if ((flags & THREAD_POOL_AFFINITY) || cpus) {
+        return APR_ENOTIMPL;
+    }
+#endif
+
+    rv = thread_pool_construct(&tp, init_threads, max_threads, flags, pool);
     if (APR_SUCCESS != rv)
         return rv;
+    tp->attr = attr;
+#if THREAD_AFFINITY
+    rv = thread_pool_cpus(tp, cpus, ncpus);
+    if (APR_SUCCESS != rv) {
+        apr_pool_destroy(tp->pool);
+        return rv;
+    }
+#endif
     apr_pool_pre_cleanup_register(tp->pool, tp, thread_pool_cleanup);
 
     /* Grab the mutex as apr_thread_create() and thread_pool_func() will
@@ -439,7 +1223,7 @@ APR_DECLARE(apr_status_t) apr_thread_pool_create(apr_thread_pool_t ** me,
     apr_thread_mutex_lock(tp->lock);
     apr_pool_owner_set(tp->pool, 0);
     while (init_threads--) {
-        rv = apr_thread_create(&t, NULL, thread_pool_func, tp, tp->pool);
+        rv = apr_thread_create(&t, tp->attr, thread_pool_func, tp, tp->pool);
         if (APR_SUCCESS != rv) {
             break;
         }
@@ -463,6 +1247,27 @@ APR_DECLARE(apr_status_t) apr_thread_pool_destroy(apr_thread_pool_t * me)
     return APR_SUCCESS;
 }
 
+static void task_init(apr_thread_pool_task_t *t, apr_thread_start_t func,
+                      void *param, apr_byte_t priority, void *owner,
+                      apr_time_t time)
+{
+    APR_RING_ELEM_INIT(t, link);
+
+    t->func = func;
+    t->param = param;
+    t->owner = owner;
+    t->latch = NULL;
+    t->priority = priority;
+    t->queued = apr_time_monotonic();
+    if (time > 0) {
+        t->dispatch.time = t->queued += time;
+    }
+    else {
+        t->dispatch.priority = priority;
+    }
+    APR_PROBE3(thread_pool__push, t, func, param);
+}
+
 /*
  * NOTE: This function is not thread safe by itself. Caller should hold the lock
  */
@@ -483,17 +1288,7 @@ static apr_thread_pool_task_t *task_new(apr_thread_pool_t * me,
         t = APR_RING_FIRST(me->recycled_tasks);
         APR_RING_REMOVE(t, link);
     }
-    APR_RING_ELEM_INIT(t, link);
-
-    t->func = func;
-    t->param = param;
-    t->owner = owner;
-    if (time > 0) {
-        t->dispatch.time = apr_time_now() + time;
-    }
-    else {
-        t->dispatch.priority = priority;
-    }
+    task_init(t, func, param, priority, owner, time);
     return t;
 }
 
@@ -548,7 +1343,6 @@ static apr_status_t schedule_task(apr_thread_pool_t *me,
                                   void *owner, apr_interval_time_t time)
 {
     apr_thread_pool_task_t *t;
-    apr_thread_pool_task_t *t_loc;
     apr_thread_t *thd;
     apr_status_t rv = APR_SUCCESS;
 
@@ -569,29 +1363,15 @@ static apr_status_t schedule_task(apr_thread_pool_t *me,
         apr_thread_mutex_unlock(me->lock);
         return APR_ENOMEM;
     }
-    t_loc = APR_RING_FIRST(me->scheduled_tasks);
-    while (NULL != t_loc) {
-        /* if the time is less than the entry insert ahead of it */
-        if (t->dispatch.time < t_loc->dispatch.time) {
-            ++me->scheduled_task_cnt;
-            APR_RING_INSERT_BEFORE(t_loc, t, link);
-            break;
-        }
-        else {
-            t_loc = APR_RING_NEXT(t_loc, link);
-            if (t_loc ==
-                APR_RING_SENTINEL(me->scheduled_tasks, apr_thread_pool_task,
-                                  link)) {
-                ++me->scheduled_task_cnt;
-                APR_RING_INSERT_TAIL(me->scheduled_tasks, t,
-                                     apr_thread_pool_task, link);
-                break;
-            }
-        }
+    if (scheduled_push(me, t) != APR_SUCCESS) {
+        APR_RING_INSERT_TAIL(me->recycled_tasks, t,
+                             apr_thread_pool_task, link);
+        apr_thread_mutex_unlock(me->lock);
+        return APR_ENOMEM;
     }
     /* there should be at least one thread for scheduled tasks */
     if (0 == me->thd_cnt) {
-        rv = apr_thread_create(&thd, NULL, thread_pool_func, me, me->pool);
+        rv = apr_thread_create(&thd, me->attr, thread_pool_func, me, me->pool);
         if (APR_SUCCESS == rv) {
             ++me->thd_cnt;
             if (me->thd_cnt > me->thd_high)
@@ -604,32 +1384,14 @@ static apr_status_t schedule_task(apr_thread_pool_t *me,
     return rv;
 }
 
-static apr_status_t add_task(apr_thread_pool_t *me, apr_thread_start_t func,
-                             void *param, apr_byte_t priority, int push,
-                             void *owner)
+/*
+ * Add the task to the shared queue.
+ * NOTE: This function is not thread safe by itself. Caller should hold the lock
+ */
+static void insert_task(apr_thread_pool_t *me, apr_thread_pool_task_t *t,
+                        int push)
 {
-    apr_thread_pool_task_t *t;
     apr_thread_pool_task_t *t_loc;
-    apr_thread_t *thd;
-    apr_status_t rv = APR_SUCCESS;
-
-    apr_thread_mutex_lock(me->lock);
-    apr_pool_owner_set(me->pool, 0);
-
-    if (me->terminated) {
-        /* Let the caller know that we are done */
-        apr_thread_mutex_unlock(me->lock);
-        return APR_NOTFOUND;
-    }
-
-    /* Maintain dead threads */
-    join_dead_threads(me);
-
-    t = task_new(me, func, param, priority, owner, 0);
-    if (NULL == t) {
-        apr_thread_mutex_unlock(me->lock);
-        return APR_ENOMEM;
-    }
 
     t_loc = add_if_empty(me, t);
     if (NULL == t_loc) {
@@ -653,22 +1415,208 @@ static apr_status_t add_task(apr_thread_pool_t *me, apr_thread_start_t func,
     me->task_cnt++;
     if (me->task_cnt > me->tasks_high)
         me->tasks_high = me->task_cnt;
-    if (0 == me->thd_cnt || (0 == me->idle_cnt && me->thd_cnt < me->thd_max &&
-                             me->task_cnt > me->threshold)) {
-        rv = apr_thread_create(&thd, NULL, thread_pool_func, me, me->pool);
-        if (APR_SUCCESS == rv) {
-            ++me->thd_cnt;
-            if (me->thd_cnt > me->thd_high)
-                me->thd_high = me->thd_cnt;
+}
+
+/*
+ * Get a new task for each function of the batch, appended to the ring.
+ * On failure, the tasks of the ring are recycled and APR_ENOMEM returned.
+ * NOTE: This function is not thread safe by itself. Caller should hold the lock
+ */
+static apr_status_t tasks_new(apr_thread_pool_t *me,
+                              struct apr_thread_pool_tasks *ring,
+                              apr_size_t n, apr_thread_start_t *funcs,
+                              void *const *params, apr_byte_t priority,
+                              void *owner, apr_thread_pool_latch_t *latch)
+{
+    apr_thread_pool_task_t *t;
+    apr_size_t i;
+
+    for (i = 0; i < n; i++) {
+        t = task_new(me, funcs[i], params[i], priority, owner, 0);
+        if (NULL == t) {
+            APR_RING_CONCAT(me->recycled_tasks, ring,
+                            apr_thread_pool_task, link);
+            return APR_ENOMEM;
         }
+        t->latch = latch;
+        APR_RING_INSERT_TAIL(ring, t, apr_thread_pool_task, link);
     }
+    return APR_SUCCESS;
+}
 
-    apr_thread_cond_signal(me->more_work);
+#if WORK_STEALING
+/*
+ * Add the tasks pushed by a worker to its own deque.
+ */
+static apr_status_t ws_add_tasks(apr_thread_pool_t *me,
+                                 struct apr_thread_list_elt *elt,
+                                 apr_size_t n, apr_thread_start_t *funcs,
+                                 void *const *params, apr_byte_t priority,
+                                 int push, void *owner,
+                                 apr_thread_pool_latch_t *latch)
+{
+    struct apr_thread_pool_tasks ring;
+    apr_thread_pool_task_t *t;
+    apr_thread_t *thd;
+    apr_status_t rv = APR_SUCCESS;
+    apr_size_t i, cnt;
+
+    if (me->terminated) {
+        /* Let the caller know that we are done */
+        return APR_NOTFOUND;
+    }
+
+    APR_RING_INIT(&ring, apr_thread_pool_task, link);
+    apr_thread_mutex_lock(elt->deque_lock);
+    for (i = 0; i < n && !APR_RING_EMPTY(&elt->deque_recycled,
+                                         apr_thread_pool_task, link); i++) {
+        t = APR_RING_FIRST(&elt->deque_recycled);
+        APR_RING_REMOVE(t, link);
+        task_init(t, funcs[i], params[i], priority, owner, 0);
+        t->latch = latch;
+        APR_RING_INSERT_TAIL(&ring, t, apr_thread_pool_task, link);
+    }
+    apr_thread_mutex_unlock(elt->deque_lock);
+
+    if (i < n) {
+        apr_thread_mutex_lock(me->lock);
+        apr_pool_owner_set(me->pool, 0);
+        rv = tasks_new(me, &ring, n - i, funcs + i, params + i, priority,
+                       owner, latch);
+        apr_thread_mutex_unlock(me->lock);
+        if (APR_SUCCESS != rv) {
+            return rv;
+        }
+    }
+
+    if (latch) {
+        latch_add(latch, n);
+    }
+
+    apr_thread_mutex_lock(elt->deque_lock);
+    while (!APR_RING_EMPTY(&ring, apr_thread_pool_task, link)) {
+        t = APR_RING_FIRST(&ring);
+        APR_RING_REMOVE(t, link);
+        deque_add(elt, t, push);
+    }
+    cnt = elt->deque_cnt;
+    apr_thread_mutex_unlock(elt->deque_lock);
+
+    /* Idle threads check the deques after becoming idle (see
+     * thread_pool_func), so reading idle_cnt after the push is enough
+     * to not miss them.
+     */
+    if (me->idle_cnt || (me->thd_cnt < me->thd_max && cnt > me->threshold)) {
+        apr_thread_mutex_lock(me->lock);
+        apr_pool_owner_set(me->pool, 0);
+        if (me->idle_cnt) {
+            for (i = 0; i < n && i < me->idle_cnt; i++) {
+                apr_thread_cond_signal(me->more_work);
+            }
+        }
+        else if (me->thd_cnt < me->thd_max && cnt > me->threshold) {
+            rv = apr_thread_create(&thd, me->attr, thread_pool_func, me,
+                                   me->pool);
+            if (APR_SUCCESS == rv) {
+                ++me->thd_cnt;
+                if (me->thd_cnt > me->thd_high)
+                    me->thd_high = me->thd_cnt;
+            }
+        }
+        apr_thread_mutex_unlock(me->lock);
+    }
+
+    return rv;
+}
+#endif /* WORK_STEALING */
+
+/*
+ * Add the n tasks at once, all of them or none.
+ */
+static apr_status_t add_tasks(apr_thread_pool_t *me, apr_size_t n,
+                              apr_thread_start_t *funcs, void *const *params,
+                              apr_byte_t priority, int push, void *owner,
+                              apr_thread_pool_latch_t *latch)
+{
+    struct apr_thread_pool_tasks ring;
+    apr_thread_pool_task_t *t;
+    apr_thread_t *thd;
+    apr_status_t rv = APR_SUCCESS;
+    apr_size_t i;
+
+#if WORK_STEALING
+    /* Pushed by one of our workers? */
+    if (current_elt && current_elt->me == me && current_elt->deque_lock) {
+        return ws_add_tasks(me, current_elt, n, funcs, params, priority,
+                            push, owner, latch);
+    }
+#endif
+
+    apr_thread_mutex_lock(me->lock);
+    apr_pool_owner_set(me->pool, 0);
+
+    if (me->terminated) {
+        /* Let the caller know that we are done */
+        apr_thread_mutex_unlock(me->lock);
+        return APR_NOTFOUND;
+    }
+
+    /* Maintain dead threads */
+    join_dead_threads(me);
+
+    APR_RING_INIT(&ring, apr_thread_pool_task, link);
+    rv = tasks_new(me, &ring, n, funcs, params, priority, owner, latch);
+    if (APR_SUCCESS != rv) {
+        apr_thread_mutex_unlock(me->lock);
+        return rv;
+    }
+
+    if (latch) {
+        latch_add(latch, n);
+    }
+
+    while (!APR_RING_EMPTY(&ring, apr_thread_pool_task, link)) {
+        t = APR_RING_FIRST(&ring);
+        APR_RING_REMOVE(t, link);
+        insert_task(me, t, push);
+    }
+
+    /* Create the threads for the tasks that no idle thread will take */
+    for (i = me->idle_cnt; i < n || 0 == me->thd_cnt; i++) {
+        if (me->thd_cnt && (me->thd_cnt >= me->thd_max
+                            || me->task_cnt <= me->threshold)) {
+            break;
+        }
+        rv = apr_thread_create(&thd, me->attr, thread_pool_func, me, me->pool);
+        if (APR_SUCCESS != rv) {
+            break;
+        }
+        ++me->thd_cnt;
+        if (me->thd_cnt > me->thd_high)
+            me->thd_high = me->thd_cnt;
+    }
+
+    /* Wake up min(n, idle) threads */
+    if (n >= me->idle_cnt) {
+        apr_thread_cond_broadcast(me->more_work);
+    }
+    else {
+        for (i = 0; i < n; i++) {
+            apr_thread_cond_signal(me->more_work);
+        }
+    }
     apr_thread_mutex_unlock(me->lock);
 
     return rv;
 }
 
+static apr_status_t add_task(apr_thread_pool_t *me, apr_thread_start_t func,
+                             void *param, apr_byte_t priority, int push,
+                             void *owner)
+{
+    return add_tasks(me, 1, &func, &param, priority, push, owner, NULL);
+}
+
 APR_DECLARE(apr_status_t) apr_thread_pool_push(apr_thread_pool_t *me,
                                                apr_thread_start_t func,
                                                void *param,
@@ -678,6 +1626,73 @@ APR_DECLARE(apr_status_t) apr_thread_pool_push(apr_thread_pool_t *me,
     return add_task(me, func, param, priority, 1, owner);
 }
 
+APR_DECLARE(apr_status_t)
+    apr_thread_pool_push_batch(apr_thread_pool_t *me, apr_size_t n,
+                               apr_thread_start_t *funcs, void *const *params,
+                               apr_byte_t priority, void *owner,
+                               apr_thread_pool_latch_t *latch)
+{
+    if (!n) {
+        return APR_SUCCESS;
+    }
+    return add_tasks(me, n, funcs, params, priority, 1, owner, latch);
+}
+
+APR_DECLARE(apr_status_t)
+    apr_thread_pool_latch_create(apr_thread_pool_latch_t **latch,
+                                 apr_pool_t *pool)
+{
+    apr_thread_pool_latch_t *l;
+    apr_status_t rv;
+
+    *latch = NULL;
+
+    l = apr_pcalloc(pool, sizeof(*l));
+    rv = apr_thread_mutex_create(&l->lock, APR_THREAD_MUTEX_DEFAULT, pool);
+    if (APR_SUCCESS != rv) {
+        return rv;
+    }
+    rv = apr_thread_cond_create(&l->done, pool);
+    if (APR_SUCCESS != rv) {
+        apr_thread_mutex_destroy(l->lock);
+        return rv;
+    }
+
+    *latch = l;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t)
+    apr_thread_pool_latch_wait(apr_thread_pool_latch_t *latch,
+                               apr_interval_time_t timeout)
+{
+    apr_time_t deadline = 0;
+    apr_status_t rv = APR_SUCCESS;
+
+    if (timeout > 0) {
+        deadline = apr_time_monotonic() + timeout;
+    }
+
+    apr_thread_mutex_lock(latch->lock);
+    while (latch->count) {
+        if (timeout < 0) {
+            apr_thread_cond_wait(latch->done, latch->lock);
+            continue;
+        }
+        if (timeout > 0) {
+            timeout = deadline - apr_time_monotonic();
+        }
+        if (timeout <= 0) {
+            rv = APR_TIMEUP;
+            break;
+        }
+        apr_thread_cond_timedwait(latch->done, latch->lock, timeout);
+    }
+    apr_thread_mutex_unlock(latch->lock);
+
+    return rv;
+}
+
 APR_DECLARE(apr_status_t) apr_thread_pool_schedule(apr_thread_pool_t *me,
                                                    apr_thread_start_t func,
                                                    void *param,
@@ -700,19 +1715,24 @@ static apr_status_t remove_scheduled_tasks(apr_thread_pool_t *me,
                                            void *owner)
 {
     apr_thread_pool_task_t *t_loc;
-    apr_thread_pool_task_t *next;
+    apr_size_t i, n = 0;
 
-    t_loc = APR_RING_FIRST(me->scheduled_tasks);
-    while (t_loc !=
-           APR_RING_SENTINEL(me->scheduled_tasks, apr_thread_pool_task,
-                             link)) {
-        next = APR_RING_NEXT(t_loc, link);
+    for (i = 0; i < me->scheduled_task_cnt; i++) {
+        t_loc = me->scheduled_tasks[i];
         /* if this is the owner remove it */
         if (!owner || t_loc->owner == owner) {
-            --me->scheduled_task_cnt;
-            APR_RING_REMOVE(t_loc, link);
+            APR_RING_INSERT_TAIL(me->recycled_tasks, t_loc,
+                                 apr_thread_pool_task, link);
+        }
+        else {
+            me->scheduled_tasks[n++] = t_loc;
         }
-        t_loc = next;
+    }
+
+    /* Re-heapify what remains */
+    me->scheduled_task_cnt = n;
+    for (i = n / 2; i-- > 0;) {
+        scheduled_sift_down(me, i);
     }
     return APR_SUCCESS;
 }
@@ -739,6 +1759,9 @@ static apr_status_t remove_tasks(apr_thread_pool_t *me, void *owner)
                 }
             }
             APR_RING_REMOVE(t_loc, link);
+            if (t_loc->latch) {
+                latch_done(t_loc->latch);
+            }
         }
         t_loc = next;
     }
@@ -755,7 +1778,23 @@ static void wait_on_busy_threads(apr_thread_pool_t *me, void *owner)
 
     elt = APR_RING_FIRST(me->busy_thds);
     while (elt != APR_RING_SENTINEL(me->busy_thds, apr_thread_list_elt, link)) {
-        if (owner ? owner != elt->current_owner : !elt->current_owner) {
+        int busy;
+
+#if WORK_STEALING
+        if (elt->deque_lock) {
+            apr_thread_mutex_lock(elt->deque_lock);
+        }
+#endif
+        busy = owner ? owner == elt->current_owner : !!elt->current_owner;
+        if (busy) {
+            elt->signal_work_done = 1;
+        }
+#if WORK_STEALING
+        if (elt->deque_lock) {
+            apr_thread_mutex_unlock(elt->deque_lock);
+        }
+#endif
+        if (!busy) {
             elt = APR_RING_NEXT(elt, link);
             continue;
         }
@@ -771,7 +1810,6 @@ static void wait_on_busy_threads(apr_thread_pool_t *me, void *owner)
 #endif
 #endif
 
-        elt->signal_work_done = 1;
         apr_thread_cond_wait(me->work_done, me->lock);
         apr_pool_owner_set(me->pool, 0);
 
@@ -794,6 +1832,11 @@ APR_DECLARE(apr_status_t) apr_thread_pool_tasks_cancel(apr_thread_pool_t *me,
     if (me->task_cnt > 0) {
         rv = remove_tasks(me, owner);
     }
+#if WORK_STEALING
+    if (me->ws_thds) {
+        ws_remove_tasks(me, owner);
+    }
+#endif
     if (me->scheduled_task_cnt > 0) {
         rv = remove_scheduled_tasks(me, owner);
     }
@@ -807,6 +1850,23 @@ APR_DECLARE(apr_status_t) apr_thread_pool_tasks_cancel(apr_thread_pool_t *me,
 
 APR_DECLARE(apr_size_t) apr_thread_pool_tasks_count(apr_thread_pool_t *me)
 {
+#if WORK_STEALING
+    if (me->ws_thds) {
+        struct apr_thread_list_elt *elt;
+        apr_size_t cnt = me->task_cnt;
+
+        apr_thread_mutex_lock(me->steal_lock);
+        for (elt = APR_RING_FIRST(me->ws_thds);
+             elt != APR_RING_SENTINEL(me->ws_thds, apr_thread_list_elt,
+                                      ws_link);
+             elt = APR_RING_NEXT(elt, ws_link)) {
+            cnt += elt->deque_cnt;
+        }
+        apr_thread_mutex_unlock(me->steal_lock);
+
+        return cnt;
+    }
+#endif
     return me->task_cnt;
 }
 
@@ -843,6 +1903,56 @@ APR_DECLARE(apr_size_t)
     return me->tasks_high;
 }
 
+static void latency_get(const thread_pool_latency_t *lat,
+                        apr_thread_pool_latency_t *latency)
+{
+    int i;
+
+    /* The count first, so that it never exceeds the buckets' */
+    latency->count = apr_atomic_read64((apr_uint64_t *)&lat->count);
+    latency->total = apr_atomic_read64((apr_uint64_t *)&lat->total);
+    latency->max = apr_atomic_read64((apr_uint64_t *)&lat->max);
+    for (i = 0; i < APR_THREAD_POOL_LATENCY_BUCKETS; i++) {
+        latency->buckets[i] =
+            apr_atomic_read64((apr_uint64_t *)&lat->buckets[i]);
+    }
+}
+
+APR_DECLARE(void) apr_thread_pool_latency_get(apr_thread_pool_t *me,
+                                              apr_byte_t priority,
+                                              apr_thread_pool_latency_t *wait,
+                                              apr_thread_pool_latency_t *run)
+{
+    if (wait) {
+        latency_get(&me->wait_latency[priority / 64], wait);
+    }
+    if (run) {
+        latency_get(&me->run_latency[priority / 64], run);
+    }
+}
+
+static void latency_reset(thread_pool_latency_t *lat)
+{
+    int i;
+
+    apr_atomic_set64(&lat->count, 0);
+    apr_atomic_set64(&lat->total, 0);
+    apr_atomic_set64(&lat->max, 0);
+    for (i = 0; i < APR_THREAD_POOL_LATENCY_BUCKETS; i++) {
+        apr_atomic_set64(&lat->buckets[i], 0);
+    }
+}
+
+APR_DECLARE(void) apr_thread_pool_latency_reset(apr_thread_pool_t *me)
+{
+    int seg;
+
+    for (seg = 0; seg < TASK_PRIORITY_SEGS; seg++) {
+        latency_reset(&me->wait_latency[seg]);
+        latency_reset(&me->run_latency[seg]);
+    }
+}
+
 APR_DECLARE(apr_size_t)
     apr_thread_pool_threads_high_count(apr_thread_pool_t * me)
 {
@@ -1019,6 +2129,40 @@ APR_DECLARE(apr_status_t) apr_thread_pool_task_owner_get(apr_thread_t *thd,
     return APR_SUCCESS;
 }
 
+APR_DECLARE(apr_status_t) apr_thread_pool_task_pool_get(apr_thread_t *thd,
+                                                        apr_pool_t **pool)
+{
+    apr_status_t rv;
+    apr_thread_pool_task_t *task;
+    struct apr_thread_list_elt *elt;
+    void *data;
+
+    *pool = NULL;
+
+    rv = apr_thread_data_get(&data, "apr_thread_pool_task", thd);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    task = data;
+    if (!task) {
+        return APR_BADARG;
+    }
+
+    /* The worker's own pool is used by the worker only */
+    elt = task->elt;
+    if (!elt->scratch) {
+        rv = apr_pool_create(&elt->scratch, apr_thread_pool_get(thd));
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        apr_pool_tag(elt->scratch, "apr_thread_pool_task");
+    }
+
+    *pool = elt->scratch;
+    return APR_SUCCESS;
+}
+
 #endif /* APR_HAS_THREADS */
 
 /* vim: set ts=4 sw=4 et cin tw=80: */
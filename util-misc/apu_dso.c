@@ -37,6 +37,7 @@
 static apr_thread_mutex_t* mutex = NULL;
 #endif
 static apr_hash_t *dsos = NULL;
+static const char *dsodir = NULL;
 static apr_uint32_t in_init = 0, initialised = 0;
 
 #if APR_HAS_THREADS
@@ -71,6 +72,7 @@ static apr_status_t apu_dso_term(void *ptr)
 
         /* set statics to NULL so init can work again */
         dsos = NULL;
+        dsodir = NULL;
 #if APR_HAS_THREADS
         mutex = NULL;
 #endif
@@ -122,11 +124,38 @@ apr_status_t apu_dso_init(apr_pool_t *pool)
     return ret;
 }
 
+/* A loaded module, and the symbols resolved from it */
 struct dso_entry {
     apr_dso_handle_t *handle;
-    apr_dso_handle_sym_t *sym;
+    apr_hash_t *syms;
 };
 
+/* The drivers only need their own symbols bound at load time, the ones
+ * of their client libraries are bound lazily on first use.
+ */
+#define DSO_LOAD_FLAGS APR_DSO_LAZY
+
+static apr_status_t dso_sym(apr_dso_handle_sym_t *dsoptr,
+                            struct dso_entry *entry, const char *modsym)
+{
+    apr_dso_handle_sym_t sym;
+    apr_status_t rv;
+
+    sym = apr_hash_get(entry->syms, modsym, APR_HASH_KEY_STRING);
+    if (sym) {
+        *dsoptr = sym;
+        return APR_SUCCESS;
+    }
+    rv = apr_dso_sym(dsoptr, entry->handle, modsym);
+    if (rv == APR_SUCCESS) {
+        apr_pool_t *global = apr_hash_pool_get(dsos);
+
+        apr_hash_set(entry->syms, apr_pstrdup(global, modsym),
+                     APR_HASH_KEY_STRING, *dsoptr);
+    }
+    return rv;
+}
+
 apr_status_t apu_dso_load(apr_dso_handle_t **dlhandleptr,
                           apr_dso_handle_sym_t *dsoptr,
                           const char *module,
@@ -145,9 +174,11 @@ apr_status_t apu_dso_load(apr_dso_handle_t **dlhandleptr,
 
     entry = apr_hash_get(dsos, module, APR_HASH_KEY_STRING);
     if (entry) {
-        *dlhandleptr = entry->handle;
-        *dsoptr = entry->sym;
-        return APR_EINIT;
+        if (dlhandleptr) {
+            *dlhandleptr = entry->handle;
+        }
+        rv = dso_sym(dsoptr, entry, modsym);
+        return rv == APR_SUCCESS ? APR_EINIT : rv;
     }
 
     /* The driver DSO must have exactly the same lifetime as the
@@ -166,7 +197,20 @@ apr_status_t apu_dso_load(apr_dso_handle_t **dlhandleptr,
     (*((char **)apr_array_push(paths))) = APR_DSO_LIBDIR;
 #endif
 
-    for (i = 0; i < paths->nelts; ++i)
+    /* The modules usually live together, try where the last one was
+     * found before searching the paths
+     */
+    if (dsodir) {
+        eos = apr_cpystrn(path, dsodir, sizeof(path));
+        apr_cpystrn(eos, module, sizeof(path) - (eos - path));
+        rv = apr_dso_load_ex(&dlhandle, path, DSO_LOAD_FLAGS, global);
+        if (dlhandleptr) {
+            *dlhandleptr = dlhandle;
+        }
+        eos = (rv == APR_SUCCESS) ? eos : NULL;
+    }
+
+    for (i = 0; rv != APR_SUCCESS && i < paths->nelts; ++i)
     {
 #if defined(WIN32)
         /* Use win32 dso search semantics and attempt to
@@ -185,7 +229,7 @@ apr_status_t apu_dso_load(apr_dso_handle_t **dlhandleptr,
         }
         apr_cpystrn(eos, module, sizeof(path) - (eos - path));
 
-        rv = apr_dso_load(&dlhandle, path, global);
+        rv = apr_dso_load_ex(&dlhandle, path, DSO_LOAD_FLAGS, global);
         if (dlhandleptr) {
             *dlhandleptr = dlhandle;
         }
@@ -204,7 +248,7 @@ apr_status_t apu_dso_load(apr_dso_handle_t **dlhandleptr,
 
             apr_cpystrn(eos, module, sizeof(path) - (eos - path));
 
-            rv = apr_dso_load(&dlhandle, path, global);
+            rv = apr_dso_load_ex(&dlhandle, path, DSO_LOAD_FLAGS, global);
             if (dlhandleptr) {
                 *dlhandleptr = dlhandle;
             }
@@ -217,16 +261,17 @@ apr_status_t apu_dso_load(apr_dso_handle_t **dlhandleptr,
     if (rv != APR_SUCCESS) /* APR_ESYMNOTFOUND */
         return rv;
 
-    rv = apr_dso_sym(dsoptr, dlhandle, modsym);
+    entry = apr_palloc(global, sizeof(*entry));
+    entry->handle = dlhandle;
+    entry->syms = apr_hash_make(global);
+    rv = dso_sym(dsoptr, entry, modsym);
     if (rv != APR_SUCCESS) { /* APR_ESYMNOTFOUND */
         apr_dso_unload(dlhandle);
     }
     else {
         module = apr_pstrdup(global, module);
-        entry = apr_palloc(global, sizeof(*entry));
-        entry->handle = dlhandle;
-        entry->sym = *dsoptr;
         apr_hash_set(dsos, module, APR_HASH_KEY_STRING, entry);
+        dsodir = apr_pstrmemdup(global, path, eos - path);
     }
     return rv;
 }
@@ -16,9 +16,11 @@
 
 #include "apu.h"
 #include "apr_private.h"
+#include "apr_atomic.h"
 #include "apr_lib.h"
 #include "apr_strings.h"
 #include "apr_portable.h"
+#include "apr_thread_proc.h" /* for apr_thread_yield */
 #include "apr_xlate.h"
 
 /* If no implementation is available, don't generate code here since
@@ -39,6 +41,7 @@
 #ifdef HAVE_ICONV_H
 #include <iconv.h>
 #endif
+#include <stdlib.h> /* for malloc */
 
 #if defined(APU_ICONV_INBUF_CONST)
 #define ICONV_INBUF_TYPE const char **
@@ -50,16 +53,324 @@
 #define min(x,y) ((x) <= (y) ? (x) : (y))
 #endif
 
+/* The conversions done without iconv */
+#define XLATE_UTF8_LATIN1 1
+#define XLATE_LATIN1_UTF8 2
+
+#if APU_HAVE_ICONV
+/*
+ * Process-wide cache of the pages pairs opened, so that the same pair
+ * opened again (usually per request) neither probes for a single byte
+ * conversion nor creates an iconv descriptor: the single byte tables
+ * are shared, and the descriptors of the closed apr_xlate_t are reset
+ * and kept for the next ones.  The entries and tables live as long as
+ * the process, and are protected by xlate_cache_lock.
+ */
+#define XLATE_CACHE_PAIRS   64
+#define XLATE_CACHE_HANDLES 8
+
+typedef struct xlate_cache_t xlate_cache_t;
+
+struct xlate_cache_t {
+    xlate_cache_t *next;
+    /** Whether sbcs_table is known (set or not) */
+    int probed;
+    char *sbcs_table;
+    int nhandles;
+    iconv_t handles[XLATE_CACHE_HANDLES];
+    char *frompage;
+    /* followed by the topage and frompage strings */
+    char topage[1];
+};
+
+static xlate_cache_t *xlate_cache = NULL;
+static int xlate_cache_pairs = 0;
+static volatile apr_uint32_t xlate_cache_lock = 0;
+#endif /* APU_HAVE_ICONV */
+
 struct apr_xlate_t {
     apr_pool_t *pool;
     char *frompage;
     char *topage;
     char *sbcs_table;
+    /** XLATE_* when converted without iconv, zero otherwise */
+    int builtin;
+    /** Whether the ASCII characters are converted to themselves, as the
+     *  same single bytes */
+    int ascii;
 #if APU_HAVE_ICONV
     iconv_t ich;
+    xlate_cache_t *cache;
 #endif
 };
 
+/* Compare the charset name 'page' with 'name' (upper case, without
+ * separators), ignoring case, dashes and underscores in 'page'. With
+ * 'prefix', 'page' only needs to start with 'name'.
+ */
+static int page_is(const char *page, const char *name, int prefix)
+{
+    for (;; page++, name++) {
+        while (*page == '-' || *page == '_') {
+            page++;
+        }
+        if (!*name) {
+            return prefix || !*page;
+        }
+        if (apr_toupper(*page) != *name) {
+            return 0;
+        }
+    }
+}
+
+static int is_latin1(const char *page)
+{
+    return page_is(page, "ISO88591", 0)
+           || page_is(page, "LATIN1", 0);
+}
+
+static int builtin_conversion(const char *topage, const char *frompage)
+{
+    if (page_is(frompage, "UTF8", 0) && is_latin1(topage)) {
+        return XLATE_UTF8_LATIN1;
+    }
+    if (is_latin1(frompage) && page_is(topage, "UTF8", 0)) {
+        return XLATE_LATIN1_UTF8;
+    }
+    return 0;
+}
+
+/* Length of the leading ASCII bytes of buf, up to len, a word at a time */
+static APR_INLINE apr_size_t ascii_span(const unsigned char *buf,
+                                        apr_size_t len)
+{
+    apr_size_t n = 0;
+    apr_uint64_t w;
+
+    while (n + sizeof(w) <= len) {
+        memcpy(&w, buf + n, sizeof(w));
+        if (w & APR_UINT64_C(0x8080808080808080)) {
+            break;
+        }
+        n += sizeof(w);
+    }
+    while (n < len && buf[n] < 0x80) {
+        n++;
+    }
+
+    return n;
+}
+
+/* Whether the non-ASCII UTF-8 sequence at buf is only truncated by the
+ * end of the input, rather than invalid.
+ */
+static int utf8_truncated(const unsigned char *buf, apr_size_t len)
+{
+    apr_size_t n, i;
+
+    if (buf[0] >= 0xC2 && buf[0] <= 0xDF) {
+        n = 2;
+    }
+    else if (buf[0] >= 0xE0 && buf[0] <= 0xEF) {
+        n = 3;
+    }
+    else if (buf[0] >= 0xF0 && buf[0] <= 0xF4) {
+        n = 4;
+    }
+    else {
+        return 0;
+    }
+    if (len >= n) {
+        return 0;
+    }
+    for (i = 1; i < len; i++) {
+        if ((buf[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* The built-in conversions, with the same results as iconv's: they stop
+ * at the end of the input or output (APR_SUCCESS, like E2BIG), at a
+ * truncated character (APR_INCOMPLETE), or at an invalid one or one that
+ * the target can't represent (APR_EINVAL).
+ */
+static apr_status_t conv_builtin(apr_xlate_t *convset,
+                                 const char *inbuf,
+                                 apr_size_t *inbytes_left,
+                                 char *outbuf,
+                                 apr_size_t *outbytes_left)
+{
+    const unsigned char *in = (const unsigned char *)inbuf;
+    unsigned char *out = (unsigned char *)outbuf;
+    apr_size_t inleft = *inbytes_left, outleft = *outbytes_left, n;
+    apr_status_t status = APR_SUCCESS;
+
+    while (inleft && outleft) {
+        n = ascii_span(in, min(inleft, outleft));
+        memcpy(out, in, n);
+        in += n;
+        inleft -= n;
+        out += n;
+        outleft -= n;
+        if (!inleft || !outleft) {
+            break;
+        }
+
+        if (convset->builtin == XLATE_UTF8_LATIN1) {
+            if (in[0] != 0xC2 && in[0] != 0xC3) {
+                status = utf8_truncated(in, inleft) ? APR_INCOMPLETE
+                                                    : APR_EINVAL;
+                break;
+            }
+            if (inleft < 2) {
+                status = APR_INCOMPLETE;
+                break;
+            }
+            if ((in[1] & 0xC0) != 0x80) {
+                status = APR_EINVAL;
+                break;
+            }
+            *out = (unsigned char)(((in[0] & 0x03) << 6) | (in[1] & 0x3F));
+            in += 2;
+            inleft -= 2;
+            out++;
+            outleft--;
+        }
+        else {
+            if (outleft < 2) {
+                break;
+            }
+            out[0] = (unsigned char)(0xC0 | (in[0] >> 6));
+            out[1] = (unsigned char)(0x80 | (in[0] & 0x3F));
+            in++;
+            inleft--;
+            out += 2;
+            outleft -= 2;
+        }
+    }
+
+    *inbytes_left = inleft;
+    *outbytes_left = outleft;
+    return status;
+}
+
+#if APU_HAVE_ICONV
+/* Whether the charset is stateless and encodes ASCII as the same single
+ * bytes, which never occur in the encoding of other characters.
+ */
+static int is_ascii_superset(const char *page)
+{
+    return page_is(page, "UTF8", 0)
+           || page_is(page, "USASCII", 0)
+           || page_is(page, "ASCII", 0)
+           || page_is(page, "ISO8859", 1)
+           || page_is(page, "LATIN", 1)
+           || page_is(page, "WINDOWS125", 1)
+           || page_is(page, "CP125", 1);
+}
+
+static void cache_acquire(void)
+{
+    while (apr_atomic_cas32(&xlate_cache_lock, 1, 0) != 0) {
+#if APR_HAS_THREADS
+        apr_thread_yield();
+#endif
+    }
+}
+
+static void cache_release(void)
+{
+    apr_atomic_set32(&xlate_cache_lock, 0);
+}
+
+/* Find (or add) the entry of the pages, NULL if the cache is full */
+static xlate_cache_t *cache_find(const char *topage, const char *frompage)
+{
+    xlate_cache_t *cache;
+    apr_size_t tolen, fromlen;
+
+    cache_acquire();
+
+    for (cache = xlate_cache; cache; cache = cache->next) {
+        if (!strcmp(cache->topage, topage)
+            && !strcmp(cache->frompage, frompage)) {
+            break;
+        }
+    }
+    if (!cache && xlate_cache_pairs < XLATE_CACHE_PAIRS) {
+        tolen = strlen(topage) + 1;
+        fromlen = strlen(frompage) + 1;
+        cache = calloc(1, sizeof(*cache) + tolen + fromlen);
+        if (cache) {
+            memcpy(cache->topage, topage, tolen);
+            cache->frompage = cache->topage + tolen;
+            memcpy(cache->frompage, frompage, fromlen);
+            cache->next = xlate_cache;
+            xlate_cache = cache;
+            xlate_cache_pairs++;
+        }
+    }
+
+    cache_release();
+
+    return cache;
+}
+
+/* Take an idle descriptor of the pages, if any */
+static iconv_t cache_take(xlate_cache_t *cache)
+{
+    iconv_t ich = (iconv_t)-1;
+
+    cache_acquire();
+    if (cache->nhandles) {
+        ich = cache->handles[--cache->nhandles];
+    }
+    cache_release();
+
+    return ich;
+}
+
+/* Give a descriptor back, reset, returning whether it was kept */
+static int cache_give(xlate_cache_t *cache, iconv_t ich)
+{
+    int kept = 0;
+
+    iconv(ich, NULL, NULL, NULL, NULL);
+
+    cache_acquire();
+    if (cache->nhandles < XLATE_CACHE_HANDLES) {
+        cache->handles[cache->nhandles++] = ich;
+        kept = 1;
+    }
+    cache_release();
+
+    return kept;
+}
+
+/* Record the outcome of check_sbcs() for the pages */
+static void cache_probed(xlate_cache_t *cache, const char *sbcs_table)
+{
+    char *table = NULL;
+
+    if (sbcs_table && (table = malloc(256)) != NULL) {
+        memcpy(table, sbcs_table, 256);
+    }
+
+    cache_acquire();
+    if (!cache->probed && (table || !sbcs_table)) {
+        cache->sbcs_table = table;
+        cache->probed = 1;
+        table = NULL;
+    }
+    cache_release();
+
+    free(table);
+}
+#endif /* APU_HAVE_ICONV */
+
 
 static const char *handle_special_names(const char *page, apr_pool_t *pool)
 {
@@ -85,6 +396,9 @@ static apr_status_t apr_xlate_cleanup(void *convset)
 
 #if APU_HAVE_ICONV
     if (old->ich != (iconv_t)-1) {
+        if (old->cache && cache_give(old->cache, old->ich)) {
+            return APR_SUCCESS;
+        }
         if (iconv_close(old->ich)) {
             int rv = errno;
 
@@ -127,7 +441,7 @@ static void check_sbcs(apr_xlate_t *convset)
         iconv_close(convset->ich);
         convset->ich = (iconv_t)-1;
 
-        /* TODO: add the table to the cache */
+        /* the caller adds the table to the cache */
     }
     else {
         /* reset the iconv descriptor, since it's now in an undefined
@@ -216,20 +530,16 @@ APR_DECLARE(apr_status_t) apr_xlate_open(apr_xlate_t **convset,
         return APR_ENOMEM;
     }
 
-#ifdef TODO
-    /* search cache of codepage pairs; we may be able to avoid the
-     * expensive iconv_open()
-     */
-
-    set found to non-zero if found in the cache
-#endif
-
     if ((! found) && (strcmp(topage, frompage) == 0)) {
         /* to and from are the same */
         found = 1;
         make_identity_table(new);
     }
 
+    if (!found && (new->builtin = builtin_conversion(topage, frompage))) {
+        found = 1;
+    }
+
 #if APU_HAVE_APR_ICONV
     if (!found) {
         rv = apr_iconv_open(topage, frompage, pool, &new->ich);
@@ -242,17 +552,38 @@ APR_DECLARE(apr_status_t) apr_xlate_open(apr_xlate_t **convset,
         new->ich = (apr_iconv_t)-1;
 
 #elif APU_HAVE_ICONV
+    new->ich = (iconv_t)-1;
     if (!found) {
-        new->ich = iconv_open(topage, frompage);
-        if (new->ich == (iconv_t)-1) {
-            int rv = errno;
-            /* Sometimes, iconv is not good about setting errno. */
-            return rv ? rv : APR_EINVAL;
+        int probed = 0;
+
+        new->ascii = is_ascii_superset(topage) && is_ascii_superset(frompage);
+        if ((new->cache = cache_find(topage, frompage)) != NULL) {
+            cache_acquire();
+            probed = new->cache->probed;
+            new->sbcs_table = new->cache->sbcs_table;
+            cache_release();
+        }
+        if (!new->sbcs_table) {
+            if (probed) {
+                new->ich = cache_take(new->cache);
+            }
+            if (new->ich == (iconv_t)-1) {
+                new->ich = iconv_open(topage, frompage);
+                if (new->ich == (iconv_t)-1) {
+                    int rv = errno;
+                    /* Sometimes, iconv is not good about setting errno. */
+                    return rv ? rv : APR_EINVAL;
+                }
+            }
+            if (!probed) {
+                check_sbcs(new);
+                if (new->cache) {
+                    cache_probed(new->cache, new->sbcs_table);
+                }
+            }
         }
         found = 1;
-        check_sbcs(new);
-    } else
-        new->ich = (iconv_t)-1;
+    }
 #endif /* APU_HAVE_ICONV */
 
     if (found) {
@@ -283,11 +614,32 @@ APR_DECLARE(apr_status_t) apr_xlate_conv_buffer(apr_xlate_t *convset,
 {
     apr_status_t status = APR_SUCCESS;
 
+    if (convset->builtin) {
+        /* Stateless, nothing to flush */
+        if (inbuf) {
+            status = conv_builtin(convset, inbuf, inbytes_left,
+                                  outbuf, outbytes_left);
+        }
+        return status;
+    }
+
 #if APU_HAVE_ICONV
     if (convset->ich != (iconv_t)-1) {
         const char *inbufptr = inbuf;
         char *outbufptr = outbuf;
         apr_size_t translated;
+
+        if (convset->ascii && inbuf) {
+            /* No need for iconv to convert the ASCII characters */
+            apr_size_t n = ascii_span((const unsigned char *)inbuf,
+                                      min(*inbytes_left, *outbytes_left));
+
+            memcpy(outbufptr, inbufptr, n);
+            inbufptr += n;
+            outbufptr += n;
+            *inbytes_left -= n;
+            *outbytes_left -= n;
+        }
         translated = iconv(convset->ich, (ICONV_INBUF_TYPE)&inbufptr,
                            inbytes_left, &outbufptr, outbytes_left);
 
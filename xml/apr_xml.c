@@ -17,8 +17,8 @@
 #include "apr.h"
 #include "apr_private.h"
 #include "apr_strings.h"
+#include "apr_strbuf.h"
 
-#define APR_WANT_STDIO          /* for sprintf() */
 #define APR_WANT_STRFUNC
 #include "apr_want.h"
 
@@ -52,9 +52,78 @@ typedef struct apr_xml_ns_scope {
     struct apr_xml_ns_scope *next;      /* next scoped namespace */
 } apr_xml_ns_scope;
 
+/* a subtree for a streaming parser to keep */
+typedef struct apr_xml_keep {
+    const char *uri;            /* namespace URI, or NULL for any */
+    const char *name;           /* local name */
+} apr_xml_keep;
 
-/* return namespace table index for a given prefix */
-static int find_prefix(apr_xml_parser *parser, const char *prefix)
+/* the most names a streaming parser interns for its scratch elements */
+#define APR_XML_MAX_NAMES 1024
+
+/* return the parser's copy of a name, stored once for all its uses */
+static const char *intern_name(apr_xml_parser *parser, apr_pool_t *pool,
+                               const char *name, apr_size_t len)
+{
+    char *copy;
+
+    if (parser->names == NULL)
+        parser->names = apr_hash_make(parser->p);
+
+    copy = apr_hash_get(parser->names, name, len);
+    if (copy != NULL)
+        return copy;
+
+    /* the names of a streamed document do not grow the parser forever */
+    if (pool != parser->p
+        && apr_hash_count(parser->names) >= APR_XML_MAX_NAMES)
+        return apr_pstrmemdup(pool, name, len);
+
+    copy = apr_pstrmemdup(parser->p, name, len);
+    apr_hash_set(parser->names, copy, len, copy);
+    return copy;
+}
+
+/* return the URI's index in the doc's namespaces, inserting it if new */
+static int insert_uri(apr_xml_parser *parser, apr_pool_t *pool,
+                      const char *uri)
+{
+    apr_array_header_t *namespaces = parser->doc->namespaces;
+    void *index;
+
+    /* never insert an empty URI; this index is always APR_XML_NS_NONE */
+    if (*uri == '\0')
+        return APR_XML_NS_NONE;
+
+    if (parser->uris == NULL)
+        parser->uris = apr_hash_make(parser->p);
+
+    /* catch up with apr_xml_insert_uri(), the last duplicate winning */
+    for (; parser->nuris < namespaces->nelts; parser->nuris++) {
+        apr_hash_set(parser->uris,
+                     APR_XML_GET_URI_ITEM(namespaces, parser->nuris),
+                     APR_HASH_KEY_STRING,
+                     (void *)(apr_intptr_t)(parser->nuris + 1));
+    }
+
+    index = apr_hash_get(parser->uris, uri, APR_HASH_KEY_STRING);
+    if (index != NULL)
+        return (int)(apr_intptr_t)index - 1;
+
+    /* a new URI outlives the scratch element */
+    if (pool != parser->p)
+        uri = apr_pstrdup(parser->p, uri);
+
+    APR_ARRAY_PUSH(namespaces, const char *) = uri;
+    parser->nuris = namespaces->nelts;
+    apr_hash_set(parser->uris, uri, APR_HASH_KEY_STRING,
+                 (void *)(apr_intptr_t)parser->nuris);
+    return parser->nuris - 1;
+}
+
+/* return namespace table index for a given prefix (of len chars) */
+static int find_prefix(apr_xml_parser *parser, const char *prefix,
+                       apr_size_t len)
 {
     apr_xml_elem *elem = parser->cur_elem;
 
@@ -66,7 +135,8 @@ static int find_prefix(apr_xml_parser *parser, const char *prefix)
         apr_xml_ns_scope *ns_scope;
 
         for (ns_scope = elem->ns_scope; ns_scope; ns_scope = ns_scope->next) {
-            if (strcmp(prefix, ns_scope->prefix) == 0) {
+            if (strncmp(prefix, ns_scope->prefix, len) == 0
+                && ns_scope->prefix[len] == '\0') {
                 if (ns_scope->emptyURI) {
                     /*
                     ** It is possible to set the default namespace to an
@@ -89,7 +159,7 @@ static int find_prefix(apr_xml_parser *parser, const char *prefix)
      * into ns_scope with an empty prefix). This means the element/attribute
      * has "no namespace". We have a reserved value for this.
      */
-    if (*prefix == '\0') {
+    if (len == 0) {
         return APR_XML_NS_NONE;
     }
 
@@ -116,30 +186,116 @@ static const char * find_prefix_name(const apr_xml_elem *elem, int ns, int paren
     return "";
 }
 
+/* the pool for the elements at the current depth of a streaming parser */
+static apr_pool_t *scratch_pool(apr_xml_parser *parser)
+{
+    while (parser->scratch->nelts < parser->depth) {
+        apr_pool_t *pool;
+
+        apr_pool_create(&pool, parser->p);
+        APR_ARRAY_PUSH(parser->scratch, apr_pool_t *) = pool;
+    }
+
+    return APR_ARRAY_IDX(parser->scratch, parser->depth - 1, apr_pool_t *);
+}
+
+/* is this element the root of a subtree to keep? */
+static int keep_elem(const apr_xml_parser *parser, const apr_xml_elem *elem)
+{
+    int i;
+
+    for (i = 0; i < parser->keep->nelts; i++) {
+        const apr_xml_keep *keep = &APR_ARRAY_IDX(parser->keep, i,
+                                                  apr_xml_keep);
+
+        /* the names are interned */
+        if (keep->name != elem->name)
+            continue;
+        if (keep->uri == NULL)
+            return 1;
+        if (elem->ns == APR_XML_NS_NONE) {
+            if (*keep->uri == '\0')
+                return 1;
+        }
+        else if (strcmp(keep->uri, APR_XML_GET_URI_ITEM(parser->doc->namespaces,
+                                                         elem->ns)) == 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* copy a name into the parser's pool, unless it is interned */
+static const char *copy_name(apr_xml_parser *parser, const char *name)
+{
+    if (apr_hash_get(parser->names, name, APR_HASH_KEY_STRING) == name)
+        return name;
+
+    return apr_pstrdup(parser->p, name);
+}
+
+/* copy a scratch element into the parser's pool */
+static apr_xml_elem *copy_elem(apr_xml_parser *parser,
+                               const apr_xml_elem *elem)
+{
+    apr_pool_t *p = parser->p;
+    apr_xml_elem *copy = apr_pmemdup(p, elem, sizeof(*elem));
+    apr_xml_attr **attr;
+    apr_xml_ns_scope **ns_scope;
+
+    copy->name = copy_name(parser, elem->name);
+    if (copy->lang != NULL)
+        copy->lang = apr_pstrdup(p, elem->lang);
+
+    for (attr = &copy->attr; *attr; attr = &(*attr)->next) {
+        *attr = apr_pmemdup(p, *attr, sizeof(**attr));
+        (*attr)->name = copy_name(parser, (*attr)->name);
+        (*attr)->value = apr_pstrdup(p, (*attr)->value);
+    }
+    for (ns_scope = &copy->ns_scope; *ns_scope; ns_scope = &(*ns_scope)->next) {
+        *ns_scope = apr_pmemdup(p, *ns_scope, sizeof(**ns_scope));
+        (*ns_scope)->prefix = copy_name(parser, (*ns_scope)->prefix);
+    }
+
+    return copy;
+}
+
 static void start_handler(void *userdata, const char *name, const char **attrs)
 {
     apr_xml_parser *parser = userdata;
+    apr_pool_t *pool = parser->p;
     apr_xml_elem *elem;
     apr_xml_attr *attr;
     apr_xml_attr *prev;
-    char *colon;
+    const char *colon;
     const char *quoted;
-    char *elem_name;
 
     /* punt once we find an error */
     if (parser->error)
         return;
 
-    elem = apr_pcalloc(parser->p, sizeof(*elem));
+    parser->depth++;
+
+    /* outside of the kept subtrees, streaming reuses the memory */
+    if (parser->scratch != NULL && !parser->kept)
+        pool = scratch_pool(parser);
 
-    /* prep the element */
-    elem->name = elem_name = apr_pstrdup(parser->p, name);
+    elem = apr_pcalloc(pool, sizeof(*elem));
+
+    /* prep the element, with its local name */
+    colon = strchr(name, 0x3A);
+    if (colon != NULL && !APR_XML_NS_IS_RESERVED(name))
+        elem->name = intern_name(parser, pool, colon + 1, strlen(colon + 1));
+    else
+        elem->name = intern_name(parser, pool, name, strlen(name));
 
     /* fill in the attributes (note: ends up in reverse order) */
     while (attrs && *attrs) {
-        attr = apr_palloc(parser->p, sizeof(*attr));
-        attr->name = apr_pstrdup(parser->p, *attrs++);
-        attr->value = apr_pstrdup(parser->p, *attrs++);
+        attr = apr_palloc(pool, sizeof(*attr));
+        attr->name = intern_name(parser, pool, *attrs, strlen(*attrs));
+        attrs++;
+        attr->value = apr_pstrdup(pool, *attrs++);
         attr->next = elem->attr;
         elem->attr = attr;
     }
@@ -147,14 +303,19 @@ static void start_handler(void *userdata, const char *name, const char **attrs)
     /* hook the element into the tree */
     if (parser->cur_elem == NULL) {
         /* no current element; this also becomes the root */
-        parser->cur_elem = parser->doc->root = elem;
+        parser->cur_elem = elem;
+        if (pool == parser->p)
+            parser->doc->root = elem;
     }
     else {
         /* this element appeared within the current elem */
         elem->parent = parser->cur_elem;
 
-        /* set up the child/sibling links */
-        if (elem->parent->last_child == NULL) {
+        /* set up the child/sibling links, of a kept parent only */
+        if (pool != parser->p) {
+            /* scratch; the parent never sees its children */
+        }
+        else if (elem->parent->last_child == NULL) {
             /* no first child either */
             elem->parent->first_child = elem->parent->last_child = elem;
         }
@@ -185,20 +346,24 @@ static void start_handler(void *userdata, const char *name, const char **attrs)
                     return;
                 }
                 ++prefix;
+                prefix = intern_name(parser, pool, prefix, strlen(prefix));
             }
             else if (*prefix != '\0') {
                 /* advance "prev" since "attr" is still present */
                 prev = attr;
                 continue;
             }
+            else {
+                prefix = "";
+            }
 
             /* quote the URI before we ever start working with it */
-            quoted = apr_xml_quote_string(parser->p, attr->value, 1);
+            quoted = apr_xml_quote_string(pool, attr->value, 1);
 
             /* build and insert the new scope */
-            ns_scope = apr_pcalloc(parser->p, sizeof(*ns_scope));
+            ns_scope = apr_pcalloc(pool, sizeof(*ns_scope));
             ns_scope->prefix = prefix;
-            ns_scope->ns = apr_xml_insert_uri(parser->doc->namespaces, quoted);
+            ns_scope->ns = insert_uri(parser, pool, quoted);
             ns_scope->emptyURI = *quoted == '\0';
             ns_scope->next = elem->ns_scope;
             elem->ns_scope = ns_scope;
@@ -213,7 +378,7 @@ static void start_handler(void *userdata, const char *name, const char **attrs)
         }
         else if (strcmp(attr->name, APR_KW_xmlns_lang) == 0) {
             /* save away the language (in quoted form) */
-            elem->lang = apr_xml_quote_string(parser->p, attr->value, 1);
+            elem->lang = apr_xml_quote_string(pool, attr->value, 1);
 
             /* remove this attribute from the element */
             if (prev == NULL)
@@ -239,22 +404,19 @@ static void start_handler(void *userdata, const char *name, const char **attrs)
         elem->lang = elem->parent->lang;
 
     /* adjust the element's namespace */
-    colon = strchr(elem_name, 0x3A);
     if (colon == NULL) {
         /*
          * The element is using the default namespace, which will always
          * be found. Either it will be "no namespace", or a default
          * namespace URI has been specified at some point.
          */
-        elem->ns = find_prefix(parser, "");
+        elem->ns = find_prefix(parser, "", 0);
     }
-    else if (APR_XML_NS_IS_RESERVED(elem->name)) {
+    else if (APR_XML_NS_IS_RESERVED(name)) {
         elem->ns = APR_XML_NS_NONE;
     }
     else {
-        *colon = '\0';
-        elem->ns = find_prefix(parser, elem->name);
-        elem->name = colon + 1;
+        elem->ns = find_prefix(parser, name, colon - name);
 
         if (APR_XML_NS_IS_ERROR(elem->ns)) {
             parser->error = elem->ns;
@@ -264,14 +426,7 @@ static void start_handler(void *userdata, const char *name, const char **attrs)
 
     /* adjust all remaining attributes' namespaces */
     for (attr = elem->attr; attr; attr = attr->next) {
-        /*
-         * apr_xml_attr defines this as "const" but we dup'd it, so we
-         * know that we can change it. a bit hacky, but the existing
-         * structure def is best.
-         */
-        char *attr_name = (char *)attr->name;
-
-        colon = strchr(attr_name, 0x3A);
+        colon = strchr(attr->name, 0x3A);
         if (colon == NULL) {
             /*
              * Attributes do NOT use the default namespace. Therefore,
@@ -283,9 +438,9 @@ static void start_handler(void *userdata, const char *name, const char **attrs)
             attr->ns = APR_XML_NS_NONE;
         }
         else {
-            *colon = '\0';
-            attr->ns = find_prefix(parser, attr->name);
-            attr->name = colon + 1;
+            attr->ns = find_prefix(parser, attr->name, colon - attr->name);
+            attr->name = intern_name(parser, pool, colon + 1,
+                                     strlen(colon + 1));
 
             if (APR_XML_NS_IS_ERROR(attr->ns)) {
                 parser->error = attr->ns;
@@ -293,18 +448,47 @@ static void start_handler(void *userdata, const char *name, const char **attrs)
             }
         }
     }
+
+    /* a subtree to keep starts here, from the parser's pool */
+    if (pool != parser->p && keep_elem(parser, elem)) {
+        elem = copy_elem(parser, elem);
+        parser->cur_elem = elem;
+        if (elem->parent == NULL)
+            parser->doc->root = elem;
+        parser->kept = parser->depth;
+    }
+
+    if (parser->start_func)
+        parser->start_func(parser->baton, parser->doc, elem);
 }
 
 static void end_handler(void *userdata, const char *name)
 {
     apr_xml_parser *parser = userdata;
+    apr_xml_elem *elem = parser->cur_elem;
 
     /* punt once we find an error */
     if (parser->error)
         return;
 
+    if (parser->end_func)
+        parser->end_func(parser->baton, parser->doc, elem);
+
     /* pop up one level */
-    parser->cur_elem = parser->cur_elem->parent;
+    parser->cur_elem = elem->parent;
+
+    if (parser->scratch != NULL) {
+        if (parser->kept == parser->depth) {
+            /* the kept subtree is done, its ancestors are not kept */
+            elem->parent = NULL;
+            parser->kept = 0;
+        }
+        if (!parser->kept)
+            apr_pool_clear(APR_ARRAY_IDX(parser->scratch, parser->depth - 1,
+                                         apr_pool_t *));
+    }
+
+    parser->depth--;
 }
 
 static void cdata_handler(void *userdata, const char *data, int len)
@@ -318,6 +502,10 @@ static void cdata_handler(void *userdata, const char *data, int len)
     if (parser->error)
         return;
 
+    /* streaming keeps no cdata outside of the kept subtrees */
+    if (parser->scratch != NULL && !parser->kept)
+        return;
+
     elem = parser->cur_elem;
     s = apr_pstrndup(parser->p, data, len);
 
@@ -338,6 +526,47 @@ APR_DECLARE(apr_xml_parser *) apr_xml_parser_create(apr_pool_t *pool)
     return apr_xml_parser_create_internal(pool, &start_handler, &end_handler, &cdata_handler);
 }
 
+APR_DECLARE(apr_xml_parser *) apr_xml_parser_create_stream(apr_pool_t *pool,
+                                             apr_xml_elem_fn_t *start_func,
+                                             apr_xml_elem_fn_t *end_func,
+                                             void *baton)
+{
+    apr_xml_parser *parser = apr_xml_parser_create(pool);
+
+    if (parser == NULL)
+        return NULL;
+
+    parser->scratch = apr_array_make(pool, 8, sizeof(apr_pool_t *));
+    parser->keep = apr_array_make(pool, 2, sizeof(apr_xml_keep));
+    parser->start_func = start_func;
+    parser->end_func = end_func;
+    parser->baton = baton;
+
+    return parser;
+}
+
+APR_DECLARE(apr_status_t) apr_xml_parser_keep(apr_xml_parser *parser,
+                                              const char *uri,
+                                              const char *name)
+{
+    apr_xml_keep *keep;
+
+    if (parser->keep == NULL)
+        return APR_EINVAL;
+
+    keep = apr_array_push(parser->keep);
+    keep->uri = uri ? apr_pstrdup(parser->p, uri) : NULL;
+    keep->name = apr_xml_parser_intern(parser, name);
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(const char *) apr_xml_parser_intern(apr_xml_parser *parser,
+                                                const char *name)
+{
+    return intern_name(parser, parser->p, name, strlen(name));
+}
+
 APR_DECLARE(apr_status_t) apr_xml_parser_feed(apr_xml_parser *parser,
                                               const char *data,
                                               apr_size_t len)
@@ -479,13 +708,19 @@ APR_DECLARE(const char *) apr_xml_quote_string(apr_pool_t *p, const char *s,
                                                int quotes)
 {
     const char *scan;
-    apr_size_t len = 0;
+    apr_size_t plain;
+    apr_size_t len;
     apr_size_t extra = 0;
     char *qstr;
     char *qscan;
     char c;
 
-    for (scan = s; (c = *scan) != '\0'; ++scan, ++len) {
+    /* most strings need no quoting, found by a (vectorized) strcspn() */
+    plain = strcspn(s, quotes ? "<>&\"" : "<>&");
+    if (s[plain] == '\0')
+        return s;
+
+    for (scan = s + plain, len = plain; (c = *scan) != '\0'; ++scan, ++len) {
         if (c == '<' || c == '>')
             extra += 3;         /* &lt; or &gt; */
         else if (c == '&')
@@ -494,12 +729,9 @@ APR_DECLARE(const char *) apr_xml_quote_string(apr_pool_t *p, const char *s,
             extra += 5;         /* &quot; */
     }
 
-    /* nothing to do? */
-    if (extra == 0)
-        return s;
-
     qstr = apr_palloc(p, len + extra + 1);
-    for (scan = s, qscan = qstr; (c = *scan) != '\0'; ++scan) {
+    memcpy(qstr, s, plain);
+    for (scan = s + plain, qscan = qstr + plain; (c = *scan) != '\0'; ++scan) {
         if (c == '<') {
             *qscan++ = '&';
             *qscan++ = 'l';
@@ -536,199 +768,87 @@ APR_DECLARE(const char *) apr_xml_quote_string(apr_pool_t *p, const char *s,
     return qstr;
 }
 
-/* how many characters for the given integer? */
-#define APR_XML_NS_LEN(ns) ((ns) < 10 ? 1 : (ns) < 100 ? 2 : (ns) < 1000 ? 3 : \
-                            (ns) < 10000 ? 4 : (ns) < 100000 ? 5 : \
-                            (ns) < 1000000 ? 6 : (ns) < 10000000 ? 7 : \
-                            (ns) < 100000000 ? 8 : (ns) < 1000000000 ? 9 : 10)
-
-static apr_size_t text_size(const apr_text *t)
+/* append "ns%d" */
+static void write_ns(apr_strbuf_t *sb, int ns)
 {
-    apr_size_t size = 0;
+    char buf[2 + 10];
+    char *d = buf + sizeof(buf);
+    unsigned int n = ns;
 
-    for (; t; t = t->next)
-        size += strlen(t->text);
-    return size;
+    do {
+        *--d = '0' + n % 10;
+    } while (n /= 10);
+    *--d = 's';
+    *--d = 'n';
+
+    apr_strbuf_append(sb, d, buf + sizeof(buf) - d);
 }
 
-static apr_size_t elem_size(const apr_xml_elem *elem, int style,
-                            apr_array_header_t *namespaces, int *ns_map)
+/* append the prefixed name of an element or attribute */
+static void write_name(apr_strbuf_t *sb, const apr_xml_elem *elem,
+                       const char *name, int ns, int style, int *ns_map)
 {
-    apr_size_t size;
-
-    if (style == APR_XML_X2T_FULL || style == APR_XML_X2T_FULL_NS_LANG ||
-        style == APR_XML_X2T_PARSED) {
-        const apr_xml_attr *attr;
-
-        size = 0;
-
-        if (style == APR_XML_X2T_FULL_NS_LANG) {
-            int i;
-
-            /*
-            ** The outer element will contain xmlns:ns%d="%s" attributes
-            ** and an xml:lang attribute, if applicable.
-            */
-
-            for (i = namespaces->nelts; i--;) {
-                /* compute size of: ' xmlns:ns%d="%s"' */
-                size += (9 + APR_XML_NS_LEN(i) + 2 +
-                         strlen(APR_XML_GET_URI_ITEM(namespaces, i)) + 1);
-            }
-
-            if (elem->lang != NULL) {
-                /* compute size of: ' xml:lang="%s"' */
-                size += 11 + strlen(elem->lang) + 1;
-            }
-        }
-        else if (style == APR_XML_X2T_PARSED) {
-            apr_xml_ns_scope *ns_scope = elem->ns_scope;
-
-            /* compute size of: ' xmlns:%s="%s"' */
-            for (; ns_scope; ns_scope = ns_scope->next) {
-                size += 10 + strlen(find_prefix_name(elem, ns_scope->ns, 0)) +
-                             strlen(APR_XML_GET_URI_ITEM(namespaces, ns_scope->ns));
-            }
-
-            if (elem->lang != NULL) {
-                /* compute size of: ' xml:lang="%s"' */
-                size += 11 + strlen(elem->lang) + 1;
-            }
-        }
-
-        if (elem->ns == APR_XML_NS_NONE) {
-            /* compute size of: <%s> */
-            size += 1 + strlen(elem->name) + 1;
-        }
-        else if (style == APR_XML_X2T_PARSED) {
-            /* compute size of: <%s:%s> */
-            size += 3 + strlen(find_prefix_name(elem, elem->ns, 1)) + strlen(elem->name);
-        }
-        else {
-            int ns = ns_map ? ns_map[elem->ns] : elem->ns;
-
-            /* compute size of: <ns%d:%s> */
-            size += 3 + APR_XML_NS_LEN(ns) + 1 + strlen(elem->name) + 1;
-        }
-
-        if (APR_XML_ELEM_IS_EMPTY(elem)) {
-            /* insert a closing "/" */
-            size += 1;
-        }
-        else {
-            /*
-             * two of above plus "/":
-             *     <ns%d:%s> ... </ns%d:%s>
-             * OR  <%s> ... </%s>
-             */
-            size = 2 * size + 1;
-        }
-
-        for (attr = elem->attr; attr; attr = attr->next) {
-            if (attr->ns == APR_XML_NS_NONE) {
-                /* compute size of: ' %s="%s"' */
-                size += 1 + strlen(attr->name) + 2 + strlen(attr->value) + 1;
-            }
-            else if (style == APR_XML_X2T_PARSED) {
-                /* compute size of: ' %s:%s="%s"' */
-                size += 5 + strlen(find_prefix_name(elem, attr->ns, 1)) + strlen(attr->name) + strlen(attr->value);
-            }
-            else {
-                /* compute size of: ' ns%d:%s="%s"' */
-                int ns = ns_map ? ns_map[attr->ns] : attr->ns;
-                size += 3 + APR_XML_NS_LEN(ns) + 1 + strlen(attr->name) + 2 + strlen(attr->value) + 1;
-            }
-        }
+    if (ns == APR_XML_NS_NONE) {
+        /* %s */
+    }
+    else if (style == APR_XML_X2T_PARSED) {
+        /* %s:%s, or %s for the default namespace */
+        const char *prefix = find_prefix_name(elem, ns, 1);
 
-        /*
-        ** If the element has an xml:lang value that is *different* from
-        ** its parent, then add the thing in: ' xml:lang="%s"'.
-        **
-        ** NOTE: we take advantage of the pointer equality established by
-        ** the parsing for "inheriting" the xml:lang values from parents.
-        */
-        if (elem->lang != NULL &&
-            (elem->parent == NULL || elem->lang != elem->parent->lang)) {
-            size += 11 + strlen(elem->lang) + 1;
+        if (*prefix) {
+            apr_strbuf_appendstr(sb, prefix);
+            apr_strbuf_appendc(sb, ':');
         }
     }
-    else if (style == APR_XML_X2T_LANG_INNER) {
-        /*
-         * This style prepends the xml:lang value plus a null terminator.
-         * If a lang value is not present, then we insert a null term.
-         */
-        size = elem->lang ? strlen(elem->lang) + 1 : 1;
-    }
-    else
-        size = 0;
-
-    size += text_size(elem->first_cdata.first);
-
-    for (elem = elem->first_child; elem; elem = elem->next) {
-        /* the size of the child element plus the CDATA that follows it */
-        size += (elem_size(elem, style == APR_XML_X2T_PARSED ? APR_XML_X2T_PARSED : APR_XML_X2T_FULL, NULL, ns_map) +
-                 text_size(elem->following_cdata.first));
+    else {
+        /* ns%d:%s */
+        write_ns(sb, ns_map ? ns_map[ns] : ns);
+        apr_strbuf_appendc(sb, ':');
     }
-
-    return size;
+    apr_strbuf_appendstr(sb, name);
 }
 
-static char *write_text(char *s, const apr_text *t)
+static void write_text(apr_strbuf_t *sb, const apr_text *t)
 {
-    for (; t; t = t->next) {
-        apr_size_t len = strlen(t->text);
-        memcpy(s, t->text, len);
-        s += len;
-    }
-    return s;
+    for (; t; t = t->next)
+        apr_strbuf_appendstr(sb, t->text);
 }
 
-static char *write_elem(char *s, const apr_xml_elem *elem, int style,
-                        apr_array_header_t *namespaces, int *ns_map)
+static void write_elem(apr_strbuf_t *sb, const apr_xml_elem *elem, int style,
+                       apr_array_header_t *namespaces, int *ns_map)
 {
     const apr_xml_elem *child;
-    apr_size_t len;
-    int ns;
 
     if (style == APR_XML_X2T_FULL || style == APR_XML_X2T_FULL_NS_LANG ||
         style == APR_XML_X2T_PARSED) {
         int empty = APR_XML_ELEM_IS_EMPTY(elem);
         const apr_xml_attr *attr;
 
-        if (elem->ns == APR_XML_NS_NONE) {
-            len = sprintf(s, "<%s", elem->name);
-        }
-        else if (style == APR_XML_X2T_PARSED) {
-            len = sprintf(s, "<%s:%s", find_prefix_name(elem, elem->ns, 1), elem->name);
-        }
-        else {
-            ns = ns_map ? ns_map[elem->ns] : elem->ns;
-            len = sprintf(s, "<ns%d:%s", ns, elem->name);
-        }
-        s += len;
+        apr_strbuf_appendc(sb, '<');
+        write_name(sb, elem, elem->name, elem->ns, style, ns_map);
 
         for (attr = elem->attr; attr; attr = attr->next) {
-            if (attr->ns == APR_XML_NS_NONE) {
-                len = sprintf(s, " %s=\"%s\"", attr->name, attr->value);
-            }
-            else if (style == APR_XML_X2T_PARSED) {
-                len = sprintf(s, " %s:%s=\"%s\"",
-                              find_prefix_name(elem, attr->ns, 1), attr->name, attr->value);
-            }
-            else {
-                ns = ns_map ? ns_map[attr->ns] : attr->ns;
-                len = sprintf(s, " ns%d:%s=\"%s\"", ns, attr->name, attr->value);
-            }
-            s += len;
+            apr_strbuf_appendc(sb, ' ');
+            write_name(sb, elem, attr->name, attr->ns, style, ns_map);
+            apr_strbuf_append(sb, "=\"", 2);
+            apr_strbuf_appendstr(sb, attr->value);
+            apr_strbuf_appendc(sb, '"');
         }
 
-        /* add the xml:lang value if necessary */
+        /*
+        ** Add the xml:lang value if necessary: if the element has an
+        ** xml:lang value that is *different* from its parent.
+        **
+        ** NOTE: we take advantage of the pointer equality established by
+        ** the parsing for "inheriting" the xml:lang values from parents.
+        */
         if (elem->lang != NULL &&
             (style == APR_XML_X2T_FULL_NS_LANG ||
              elem->parent == NULL ||
              elem->lang != elem->parent->lang)) {
-            len = sprintf(s, " xml:lang=\"%s\"", elem->lang);
-            s += len;
+            apr_strbuf_append(sb, " xml:lang=\"", 11);
+            apr_strbuf_appendstr(sb, elem->lang);
+            apr_strbuf_appendc(sb, '"');
         }
 
         /* add namespace definitions, if required */
@@ -736,9 +856,11 @@ static char *write_elem(char *s, const apr_xml_elem *elem, int style,
             int i;
 
             for (i = namespaces->nelts; i--;) {
-                len = sprintf(s, " xmlns:ns%d=\"%s\"", i,
-                              APR_XML_GET_URI_ITEM(namespaces, i));
-                s += len;
+                apr_strbuf_append(sb, " xmlns:", 7);
+                write_ns(sb, i);
+                apr_strbuf_append(sb, "=\"", 2);
+                apr_strbuf_appendstr(sb, APR_XML_GET_URI_ITEM(namespaces, i));
+                apr_strbuf_appendc(sb, '"');
             }
         }
 
@@ -748,58 +870,50 @@ static char *write_elem(char *s, const apr_xml_elem *elem, int style,
             for (; ns_scope; ns_scope = ns_scope->next) {
                 const char *prefix = find_prefix_name(elem, ns_scope->ns, 0);
 
-                len = sprintf(s, " xmlns%s%s=\"%s\"",
-                              *prefix ? ":" : "", *prefix ? prefix : "",
-                              APR_XML_GET_URI_ITEM(namespaces, ns_scope->ns));
-                s += len;
+                apr_strbuf_append(sb, " xmlns", 6);
+                if (*prefix) {
+                    apr_strbuf_appendc(sb, ':');
+                    apr_strbuf_appendstr(sb, prefix);
+                }
+                apr_strbuf_append(sb, "=\"", 2);
+                apr_strbuf_appendstr(sb,
+                        APR_XML_GET_URI_ITEM(namespaces, ns_scope->ns));
+                apr_strbuf_appendc(sb, '"');
             }
         }
 
         /* no more to do. close it up and go. */
         if (empty) {
-            *s++ = '/';
-            *s++ = '>';
-            return s;
+            apr_strbuf_append(sb, "/>", 2);
+            return;
         }
 
         /* just close it */
-        *s++ = '>';
+        apr_strbuf_appendc(sb, '>');
     }
     else if (style == APR_XML_X2T_LANG_INNER) {
         /* prepend the xml:lang value */
         if (elem->lang != NULL) {
-            len = strlen(elem->lang);
-            memcpy(s, elem->lang, len);
-            s += len;
+            apr_strbuf_appendstr(sb, elem->lang);
         }
-        *s++ = '\0';
+        apr_strbuf_append(sb, "", 1);
     }
 
-    s = write_text(s, elem->first_cdata.first);
+    write_text(sb, elem->first_cdata.first);
 
     for (child = elem->first_child; child; child = child->next) {
-        s = write_elem(s, child,
-                       style == APR_XML_X2T_PARSED ? APR_XML_X2T_PARSED : APR_XML_X2T_FULL,
-                       NULL, ns_map);
-        s = write_text(s, child->following_cdata.first);
+        write_elem(sb, child,
+                   style == APR_XML_X2T_PARSED ? APR_XML_X2T_PARSED : APR_XML_X2T_FULL,
+                   namespaces, ns_map);
+        write_text(sb, child->following_cdata.first);
     }
 
     if (style == APR_XML_X2T_FULL || style == APR_XML_X2T_FULL_NS_LANG ||
         style == APR_XML_X2T_PARSED) {
-        if (elem->ns == APR_XML_NS_NONE) {
-            len = sprintf(s, "</%s>", elem->name);
-        }
-        else if (style == APR_XML_X2T_PARSED) {
-            len = sprintf(s, "</%s:%s>", find_prefix_name(elem, elem->ns, 1), elem->name);
-        }
-        else {
-            ns = ns_map ? ns_map[elem->ns] : elem->ns;
-            len = sprintf(s, "</ns%d:%s>", ns, elem->name);
-        }
-        s += len;
+        apr_strbuf_append(sb, "</", 2);
+        write_name(sb, elem, elem->name, elem->ns, style, ns_map);
+        apr_strbuf_appendc(sb, '>');
     }
-
-    return s;
 }
 
 APR_DECLARE(void) apr_xml_quote_elem(apr_pool_t *p, apr_xml_elem *elem)
@@ -841,16 +955,16 @@ APR_DECLARE(void) apr_xml_to_text(apr_pool_t * p, const apr_xml_elem *elem,
                                   int *ns_map, const char **pbuf,
                                   apr_size_t *psize)
 {
-    /* get the exact size, plus a null terminator */
-    apr_size_t size = elem_size(elem, style, namespaces, ns_map) + 1;
-    char *s = apr_palloc(p, size);
+    apr_strbuf_t sb;
+    apr_size_t len;
 
-    (void) write_elem(s, elem, style, namespaces, ns_map);
-    s[size - 1] = '\0';
+    /* a single walk, growing the buffer in place where it can */
+    apr_strbuf_init(&sb, p, 0);
+    write_elem(&sb, elem, style, namespaces, ns_map);
 
-    *pbuf = s;
+    *pbuf = apr_strbuf_finish(&sb, &len);
     if (psize)
-        *psize = size;
+        *psize = len + 1;       /* plus the null terminator */
 }
 
 APR_DECLARE(const char *) apr_xml_empty_elem(apr_pool_t * p,
@@ -888,9 +1002,10 @@ APR_DECLARE(int) apr_xml_insert_uri(apr_array_header_t *uri_array,
     return uri_array->nelts - 1;
 }
 
-/* convert the element to EBCDIC */
+/* convert the element to EBCDIC, the (interned) names into copies */
 #if APR_CHARSET_EBCDIC
-static apr_status_t apr_xml_parser_convert_elem(apr_xml_elem *e,
+static apr_status_t apr_xml_parser_convert_elem(apr_pool_t *pool,
+                                                apr_xml_elem *e,
                                                 apr_xlate_t *convset)
 {
     apr_xml_attr *a;
@@ -899,6 +1014,7 @@ static apr_status_t apr_xml_parser_convert_elem(apr_xml_elem *e,
     apr_size_t inbytes_left, outbytes_left;
     apr_status_t status;
 
+    e->name = apr_pstrdup(pool, e->name);
     inbytes_left = outbytes_left = strlen(e->name);
     status = apr_xlate_conv_buffer(convset, e->name,  &inbytes_left, (char *) e->name, &outbytes_left);
     if (status) {
@@ -922,6 +1038,7 @@ static apr_status_t apr_xml_parser_convert_elem(apr_xml_elem *e,
     }
 
     for (a = e->attr; a != NULL; a = a->next) {
+        a->name = apr_pstrdup(pool, a->name);
         inbytes_left = outbytes_left = strlen(a->name);
         status = apr_xlate_conv_buffer(convset, a->name, &inbytes_left, (char *) a->name, &outbytes_left);
         if (status) {
@@ -935,7 +1052,7 @@ static apr_status_t apr_xml_parser_convert_elem(apr_xml_elem *e,
     }
 
     for (ec = e->first_child; ec != NULL; ec = ec->next) {
-        status = apr_xml_parser_convert_elem(ec, convset);
+        status = apr_xml_parser_convert_elem(pool, ec, convset);
         if (status) {
             return status;
         }
@@ -971,6 +1088,6 @@ APR_DECLARE(apr_status_t) apr_xml_parser_convert_doc(apr_pool_t *pool,
         }
         pdoc->namespaces = namespaces;
     }
-    return apr_xml_parser_convert_elem(pdoc->root, convset);
+    return apr_xml_parser_convert_elem(pool, pdoc->root, convset);
 }
 #endif
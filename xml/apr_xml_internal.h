@@ -17,6 +17,8 @@
 #ifndef APR_XML_INTERNAL_H
 #define APR_XML_INTERNAL_H
 
+#include "apr_hash.h"
+
 
 struct XMLParserImpl {
     /** parse callback */
@@ -50,6 +52,26 @@ struct apr_xml_parser {
     const char *xp_msg;
     /** XML parser implementation */
     XMLParserImpl *impl;
+
+    /** depth of the current element */
+    int depth;
+    /** streaming: a pool per depth for the elements not kept */
+    apr_array_header_t *scratch;
+    /** streaming: the namespaces and names of the subtrees to keep */
+    apr_array_header_t *keep;
+    /** streaming: depth of the subtree being kept, or zero */
+    int kept;
+    /** streaming: element callbacks and their baton */
+    apr_xml_elem_fn_t *start_func;
+    apr_xml_elem_fn_t *end_func;
+    void *baton;
+
+    /** the element and attribute names, each stored once */
+    apr_hash_t *names;
+    /** the index (plus one) of each namespace URI of the doc */
+    apr_hash_t *uris;
+    /** the namespaces of the doc already in uris */
+    int nuris;
 };
 
 apr_xml_parser* apr_xml_parser_create_internal(apr_pool_t*, void*, void*, void*);